@@ -0,0 +1,54 @@
+#
+# Licensed to the Apache Software Foundation (ASF) under one
+# or more contributor license agreements.  See the NOTICE file
+# distributed with this work for additional information
+# regarding copyright ownership.  The ASF licenses this file
+# to you under the Apache License, Version 2.0 (the
+# "License"); you may not use this file except in compliance
+# with the License.  You may obtain a copy of the License at
+#
+#   https://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied.  See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+# Tries to find Lz4 headers and libraries.
+#
+# Usage of this module as follows:
+#
+#  find_package(Lz4)
+#
+# Variables used by this module, they can change the default behaviour and need
+# to be set before calling find_package:
+#
+#  LZ4_ROOT_DIR  Set this variable to the root installation of
+#                    Lz4 if the module has problems finding
+#                    the proper installation path.
+#
+# Variables defined by this module:
+#
+#  LZ4_FOUND              System has Lz4 libs/headers
+#  LZ4_LIBRARIES          The Lz4 libraries
+#  LZ4_INCLUDE_DIR        The location of Lz4 headers
+
+find_path(LZ4_INCLUDE_DIR
+    NAMES lz4frame.h
+    HINTS ${LZ4_ROOT_DIR}/include)
+
+find_library(LZ4_LIBRARIES
+    NAMES lz4
+    HINTS ${LZ4_ROOT_DIR}/lib)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(Lz4 DEFAULT_MSG
+    LZ4_LIBRARIES
+    LZ4_INCLUDE_DIR)
+
+mark_as_advanced(
+    LZ4_ROOT_DIR
+    LZ4_LIBRARIES
+    LZ4_INCLUDE_DIR)
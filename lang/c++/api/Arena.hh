@@ -0,0 +1,87 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_Arena_hh__
+#define avro_Arena_hh__
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Config.hh"
+
+namespace avro {
+
+/**
+ * A monotonic memory region. Allocation bumps a pointer within the current
+ * chunk and takes a new chunk when that one is full; nothing is freed one
+ * by one. reset() makes all the memory available again at once and keeps
+ * the chunks for reuse.
+ *
+ * Objects placed in an arena must be destroyed, not deleted, and before
+ * the arena is reset or destroyed.
+ */
+class AVRO_DECL Arena {
+    const size_t chunkSize_;
+    std::vector<std::pair<uint8_t *, size_t>> chunks_;
+    size_t current_;
+    uint8_t *next_;
+    uint8_t *end_;
+
+    void *allocateSlow(size_t size, size_t align);
+
+public:
+    /**
+     * Constructs an arena that takes memory in chunks of \p chunkSize bytes,
+     * or more for larger allocations.
+     */
+    explicit Arena(size_t chunkSize = 64 * 1024);
+
+    ~Arena();
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    /**
+     * Returns \p size bytes aligned to \p align, which must be a power of two.
+     */
+    void *allocate(size_t size, size_t align) {
+        uint8_t *p = reinterpret_cast<uint8_t *>(
+            (reinterpret_cast<uintptr_t>(next_) + align - 1) & ~(static_cast<uintptr_t>(align) - 1));
+        if (next_ != nullptr && p + size <= end_) {
+            next_ = p + size;
+            return p;
+        }
+        return allocateSlow(size, align);
+    }
+
+    /**
+     * Makes all the memory allocated so far available again.
+     */
+    void reset();
+
+    /**
+     * Returns the number of bytes held in chunks.
+     */
+    size_t capacity() const;
+};
+
+} // namespace avro
+
+#endif
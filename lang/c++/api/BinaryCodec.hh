@@ -0,0 +1,382 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_BinaryCodec_hh__
+#define avro_BinaryCodec_hh__
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Config.hh"
+#include "Decoder.hh"
+#include "DirectCodec.hh"
+#include "Encoder.hh"
+#include "Exception.hh"
+#include "Zigzag.hh"
+
+/// \file
+/// The Encoder and Decoder for the Avro binary encoding, as concrete types.
+///
+/// binaryEncoder() and binaryDecoder() return these classes behind
+/// EncoderPtr and DecoderPtr. Held by their own types, their primitive
+/// operations are final and inline, so the calls made on them do not go
+/// through the virtual table and compile down to work on the stream's
+/// chunk pointers. The encode() and decode() overloads here take the
+/// concrete types and use direct_codec_traits, which are templated over
+/// the encoder or decoder, where a type has them; other types fall back
+/// to codec_traits.
+
+namespace avro {
+
+/**
+ * Writes the Avro binary encoding to an OutputStream.
+ *
+ * The primitives are final; arrays and maps are not, so that
+ * blockingBinaryEncoder() can write them in blocks.
+ */
+class AVRO_DECL BinaryEncoder : public Encoder {
+protected:
+    StreamWriter out_;
+
+    void doEncodeLong(int64_t l) {
+        // The longest varint takes 10 bytes. If the current chunk has room
+        // for that many, encode straight into it.
+        if (static_cast<size_t>(out_.end_ - out_.next_) >= 10) {
+            out_.next_ += encodeVarintUnchecked(encodeZigzag64(l), out_.next_);
+        } else {
+            doEncodeLongSlow(l);
+        }
+    }
+
+    void doEncodeLongSlow(int64_t l);
+    template<typename T>
+    void doEncodeLongs(const T *values, size_t n);
+
+public:
+    using Encoder::encodeBytes;
+    using Encoder::encodeFixed;
+    using Encoder::encodeStringView;
+
+    void init(OutputStream &os) override;
+    void flush() override;
+    int64_t byteCount() const override;
+
+    void encodeNull() final {}
+
+    void encodeBool(bool b) final {
+        out_.write(b ? 1 : 0);
+    }
+
+    void encodeInt(int32_t i) final {
+        doEncodeLong(i);
+    }
+
+    void encodeLong(int64_t l) final {
+        doEncodeLong(l);
+    }
+
+    void encodeFloat(float f) final {
+        out_.writeBytes(reinterpret_cast<const uint8_t *>(&f), sizeof(float));
+    }
+
+    void encodeDouble(double d) final {
+        out_.writeBytes(reinterpret_cast<const uint8_t *>(&d), sizeof(double));
+    }
+
+    void encodeString(const std::string &s) final {
+        encodeStringView(s.data(), s.size());
+    }
+
+    void encodeStringView(const char *data, size_t len) final {
+        doEncodeLong(static_cast<int64_t>(len));
+        out_.writeBytes(reinterpret_cast<const uint8_t *>(data), len);
+    }
+
+    void encodeBytes(const uint8_t *bytes, size_t len) final {
+        doEncodeLong(static_cast<int64_t>(len));
+        out_.writeBytes(bytes, len);
+    }
+
+    void encodeFixed(const uint8_t *bytes, size_t len) final {
+        out_.writeBytes(bytes, len);
+    }
+
+    void encodeEnum(size_t e) final {
+        doEncodeLong(static_cast<int64_t>(e));
+    }
+
+    void encodeUnionIndex(size_t e) final {
+        doEncodeLong(static_cast<int64_t>(e));
+    }
+
+    void arrayStart() override {}
+    void arrayEnd() override;
+    void mapStart() override {}
+    void mapEnd() override;
+    void setItemCount(size_t count) override;
+    void startItem() override {}
+    void encodeIntArray(const int32_t *values, size_t n) override;
+    void encodeLongArray(const int64_t *values, size_t n) override;
+    void encodeFloatArray(const float *values, size_t n) override;
+    void encodeDoubleArray(const double *values, size_t n) override;
+};
+
+/**
+ * Reads the Avro binary encoding from an InputStream.
+ */
+class AVRO_DECL BinaryDecoder final : public Decoder {
+    StreamReader in_;
+    // Holds values returned by the view calls that straddle chunks.
+    std::vector<uint8_t> viewBuffer_;
+    bool validateUtf8_ = false;
+
+    int64_t doDecodeLong() {
+        // The longest valid varint takes 10 bytes. If the current chunk
+        // holds that many, decode straight from it without any bounds
+        // checks.
+        const uint8_t *p = in_.next_;
+        if (static_cast<size_t>(in_.end_ - p) >= 10) {
+            uint64_t u = *p++;
+            if ((u & 0x80) == 0) {
+                in_.next_ = p;
+                return decodeZigzag64(u);
+            }
+            uint64_t encoded = u & 0x7f;
+            for (int shift = 7; shift < 64; shift += 7) {
+                u = *p++;
+                encoded |= (u & 0x7f) << shift;
+                if ((u & 0x80) == 0) {
+                    in_.next_ = p;
+                    return decodeZigzag64(encoded);
+                }
+            }
+            throw Exception("Invalid Avro varint");
+        }
+        return doDecodeLongSlow();
+    }
+
+    int32_t doDecodeInt() {
+        int64_t val = doDecodeLong();
+        if (val < INT32_MIN || val > INT32_MAX) {
+            throw Exception(boost::format("Value out of range for Avro int: %1%") % val);
+        }
+        return static_cast<int32_t>(val);
+    }
+
+    size_t doDecodeLength() {
+        int32_t len = doDecodeInt();
+        if (len < 0) {
+            throw Exception(boost::format("Cannot have negative length: %1%") % len);
+        }
+        return static_cast<size_t>(len);
+    }
+
+    size_t doDecodeItemCount() {
+        int64_t result = doDecodeLong();
+        if (result < 0) {
+            doDecodeLong();
+            return static_cast<size_t>(-result);
+        }
+        return static_cast<size_t>(result);
+    }
+
+    const uint8_t *doDecodeView(size_t len) {
+        const uint8_t *result = in_.next_;
+        if (static_cast<size_t>(in_.end_ - result) >= len) {
+            in_.next_ += len;
+            return result;
+        }
+        return doDecodeViewSlow(len);
+    }
+
+    int64_t doDecodeLongSlow();
+    const uint8_t *doDecodeViewSlow(size_t len);
+    void checkUtf8(const char *data, size_t len) const;
+
+public:
+    using Decoder::decodeBytes;
+    using Decoder::decodeFixed;
+    using Decoder::decodeString;
+
+    void init(InputStream &is) override;
+    void drain() override;
+
+    void decodeNull() override {}
+
+    bool decodeBool() override {
+        uint8_t v = in_.read();
+        if (v == 0) {
+            return false;
+        } else if (v == 1) {
+            return true;
+        }
+        throw Exception(boost::format("Invalid value for bool: %1%") % v);
+    }
+
+    int32_t decodeInt() override {
+        return doDecodeInt();
+    }
+
+    int64_t decodeLong() override {
+        return doDecodeLong();
+    }
+
+    float decodeFloat() override {
+        float result;
+        in_.readBytes(reinterpret_cast<uint8_t *>(&result), sizeof(float));
+        return result;
+    }
+
+    double decodeDouble() override {
+        double result;
+        in_.readBytes(reinterpret_cast<uint8_t *>(&result), sizeof(double));
+        return result;
+    }
+
+    void decodeString(std::string &value) override {
+        size_t len = doDecodeLength();
+        value.resize(len);
+        if (len > 0) {
+            in_.readBytes(reinterpret_cast<uint8_t *>(&value[0]), len);
+            if (validateUtf8_) {
+                // While the copy is still in the cache.
+                checkUtf8(value.data(), len);
+            }
+        }
+    }
+
+    void decodeStringView(const char *&data, size_t &len) override {
+        len = doDecodeLength();
+        data = reinterpret_cast<const char *>(doDecodeView(len));
+        if (validateUtf8_) {
+            checkUtf8(data, len);
+        }
+    }
+
+    void decodeBytes(std::vector<uint8_t> &value) override {
+        size_t len = doDecodeLength();
+        value.resize(len);
+        if (len > 0) {
+            in_.readBytes(value.data(), len);
+        }
+    }
+
+    void decodeBytesView(const uint8_t *&data, size_t &len) override {
+        len = doDecodeLength();
+        data = doDecodeView(len);
+    }
+
+    void decodeFixed(size_t n, std::vector<uint8_t> &value) override {
+        value.resize(n);
+        if (n > 0) {
+            in_.readBytes(value.data(), n);
+        }
+    }
+
+    void decodeFixedView(size_t n, const uint8_t *&data) override {
+        data = doDecodeView(n);
+    }
+
+    size_t decodeEnum() override {
+        return static_cast<size_t>(doDecodeLong());
+    }
+
+    size_t arrayStart() override {
+        return doDecodeItemCount();
+    }
+
+    size_t arrayNext() override {
+        return doDecodeItemCount();
+    }
+
+    size_t mapStart() override {
+        return doDecodeItemCount();
+    }
+
+    size_t mapNext() override {
+        return doDecodeItemCount();
+    }
+
+    size_t decodeUnionIndex() override {
+        return static_cast<size_t>(doDecodeLong());
+    }
+
+    void skipString() override;
+    void skipBytes() override;
+    void skipFixed(size_t n) override;
+    size_t skipArray() override;
+    size_t skipMap() override;
+    void decodeIntArray(int32_t *values, size_t n) override;
+    void decodeLongArray(int64_t *values, size_t n) override;
+    void decodeFloatArray(float *values, size_t n) override;
+    void decodeDoubleArray(double *values, size_t n) override;
+
+    void setUtf8Validation(bool validate) override {
+        validateUtf8_ = validate;
+    }
+};
+
+namespace detail {
+
+template<typename T>
+void binaryEncode(BinaryEncoder &e, const T &t, std::true_type) {
+    direct_codec_traits<T>::encode(e, t);
+}
+
+template<typename T>
+void binaryEncode(BinaryEncoder &e, const T &t, std::false_type) {
+    codec_traits<T>::encode(e, t);
+}
+
+template<typename T>
+void binaryDecode(BinaryDecoder &d, T &t, std::true_type) {
+    direct_codec_traits<T>::decode(d, t);
+}
+
+template<typename T>
+void binaryDecode(BinaryDecoder &d, T &t, std::false_type) {
+    codec_traits<T>::decode(d, t);
+}
+
+} // namespace detail
+
+/**
+ * Encodes \p t with the binary encoder itself rather than through
+ * Encoder, using direct_codec_traits<T> if T has them and codec_traits<T>
+ * otherwise.
+ */
+template<typename T>
+void encode(BinaryEncoder &e, const T &t) {
+    detail::binaryEncode(e, t, has_direct_codec<T>());
+}
+
+/**
+ * Decodes \p t with the binary decoder itself rather than through
+ * Decoder, using direct_codec_traits<T> if T has them and codec_traits<T>
+ * otherwise.
+ */
+template<typename T>
+void decode(BinaryDecoder &d, T &t) {
+    detail::binaryDecode(d, t, has_direct_codec<T>());
+}
+
+} // namespace avro
+
+#endif
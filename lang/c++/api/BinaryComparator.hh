@@ -0,0 +1,86 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef avro_BinaryComparator_hh__
+#define avro_BinaryComparator_hh__
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Config.hh"
+#include "ValidSchema.hh"
+
+/// \file
+/// Compares data in Avro binary encoding in the sort order of the spec,
+/// without decoding any values.
+
+namespace avro {
+
+/**
+ * Compares binary encoded data of one schema in the sort order defined
+ * by the Avro specification: records field by field, honouring the
+ * "order" of each field, arrays item by item, unions by branch and then
+ * by value, enums by symbol position, strings and bytes as unsigned
+ * bytes, and numbers by value. Maps have no order and a comparison that
+ * reaches one throws.
+ *
+ * The schema is compiled once, when the comparator is made, and
+ * comparing keeps no state, so one comparator can be shared among
+ * threads, for instance by the runs of an external merge sort.
+ */
+class AVRO_DECL BinaryComparator {
+public:
+    struct Program;
+
+private:
+    std::shared_ptr<const Program> program_;
+
+public:
+    explicit BinaryComparator(const ValidSchema &schema);
+
+    /**
+     * Compares the datum encoded at the start of \p a with the one at the
+     * start of \p b. Returns a negative number, zero or a positive number
+     * as the first sorts before, together with or after the second.
+     * Only the bytes up to the first difference are looked at. Throws an
+     * Exception if either runs out before its datum does.
+     */
+    int compare(const uint8_t *a, size_t aLen,
+                const uint8_t *b, size_t bLen) const;
+
+    /// Orders encoded data, for use with the standard algorithms.
+    bool operator()(const std::vector<uint8_t> &a,
+                    const std::vector<uint8_t> &b) const {
+        return compare(a.data(), a.size(), b.data(), b.size()) < 0;
+    }
+};
+
+/**
+ * Compares two binary encoded data of \p schema as
+ * BinaryComparator::compare does. To compare many, make a
+ * BinaryComparator once instead.
+ */
+AVRO_DECL int compareBinary(const ValidSchema &schema,
+                            const uint8_t *a, size_t aLen,
+                            const uint8_t *b, size_t bLen);
+
+} // namespace avro
+
+#endif
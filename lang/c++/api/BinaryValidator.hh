@@ -0,0 +1,154 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef avro_BinaryValidator_hh__
+#define avro_BinaryValidator_hh__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Config.hh"
+#include "Decoder.hh"
+#include "Specific.hh"
+#include "Stream.hh"
+#include "ValidSchema.hh"
+
+/// \file
+/// Checks that data in Avro binary encoding conforms to a schema, without
+/// decoding any values.
+
+namespace avro {
+
+/**
+ * What came of checking a datum without exceptions: whether it conforms
+ * and, if not, what is wrong and where. The message is only put together
+ * when asked for, so rejecting malformed data costs no more than finding
+ * it malformed.
+ */
+struct AVRO_DECL DecodeStatus {
+    enum Code {
+        ok,
+        truncated,     // The data ends before the datum does.
+        badVarint,     // A varint longer than ten bytes.
+        badBool,       // value is the byte found.
+        badInt,        // value is out of the range of an int.
+        badLength,     // A negative length of bytes or a string.
+        badBlockCount, // A block count or block size out of range.
+        badEnum,       // value is the symbol, limit the number of symbols.
+        badUnion,      // value is the branch, limit the number of branches.
+    };
+
+    Code code = ok;
+    // The offset, from the start of the datum, of the value at fault.
+    size_t offset = 0;
+    int64_t value = 0;
+    int64_t limit = 0;
+
+    /// True if the datum conforms.
+    explicit operator bool() const { return code == ok; }
+
+    /// Describes the fault, as the exception thrown for it would.
+    std::string message() const;
+};
+
+/**
+ * Checks binary encoded data against one schema. The schema is compiled
+ * once, when the validator is made, into a flat program that steps over
+ * the data straight from the chunks of the stream, checking
+ * booleans, the range of ints, lengths, enum symbols and union branches
+ * on the way. Items of arrays and maps are always walked, even where the
+ * writer gave the size of their blocks.
+ *
+ * A validator keeps scratch state and so is not to be shared among
+ * threads; the program itself is shared by copies.
+ */
+class AVRO_DECL BinaryValidator {
+public:
+    struct Program;
+
+private:
+    struct Frame {
+        // The return point for calls, the first item instruction for loops.
+        size_t pc;
+        // Items left in the current block, for loops.
+        int64_t remaining;
+    };
+
+    std::shared_ptr<const Program> program_;
+    DecoderPtr decoder_;
+    std::vector<Frame> frames_;
+
+public:
+    explicit BinaryValidator(const ValidSchema &schema);
+    BinaryValidator(const BinaryValidator &other);
+    BinaryValidator &operator=(const BinaryValidator &other);
+    ~BinaryValidator();
+
+    /**
+     * Consumes one datum from \p in, leaving the stream just past it.
+     * Throws an Exception if the datum does not conform to the schema or
+     * the stream ends before it does.
+     */
+    void validate(InputStream &in);
+
+    /**
+     * Like validate(), but tells of a datum that does not conform in the
+     * status returned rather than by throwing; the stream is then left
+     * somewhere within the datum. Only the stream itself may throw.
+     */
+    DecodeStatus tryValidate(InputStream &in);
+
+    /**
+     * Decodes the datum in the \p len bytes at \p data into \p value,
+     * if it conforms to the schema of this validator; otherwise \p value
+     * is left alone and the status tells why. The datum is checked in
+     * full before any of it is decoded, so the decoder never meets
+     * malformed data. \p value must be encoded with this schema.
+     */
+    template<typename T>
+    DecodeStatus tryDecode(const uint8_t *data, size_t len, T &value) {
+        std::unique_ptr<InputStream> in = memoryInputStream(data, len);
+        DecodeStatus result = tryValidate(*in);
+        if (result) {
+            in->backup(in->byteCount());
+            decoder_->init(*in);
+            try {
+                avro::decode(*decoder_, value);
+            } catch (...) {
+                decoder_->drain();
+                throw;
+            }
+            // The decoder is not to hold on to the stream.
+            decoder_->drain();
+        }
+        return result;
+    }
+};
+
+/**
+ * Checks one datum from \p in against \p schema. To check many, make a
+ * BinaryValidator once instead.
+ */
+AVRO_DECL void validateBinary(const ValidSchema &schema, InputStream &in);
+
+} // namespace avro
+
+#endif
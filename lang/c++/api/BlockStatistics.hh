@@ -0,0 +1,162 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_BlockStatistics_hh__
+#define avro_BlockStatistics_hh__
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Config.hh"
+#include "Decoder.hh"
+#include "GenericDatum.hh"
+#include "Stream.hh"
+#include "ValidSchema.hh"
+
+/// \file
+/// Per-block minimum and maximum values of selected top-level fields of a
+/// data file, which let readers skip blocks that cannot match a predicate.
+///
+/// The statistics are kept out of the data file, which stays readable by
+/// any Avro implementation, in a sidecar that is itself an Avro data file
+/// with one record per block. By convention the sidecar of a file is named
+/// after it with a ".stats" suffix.
+///
+/// Within the blocks that are read, a RecordFilter lets readers skip the
+/// records that do not match a predicate on the same kind of fields.
+
+namespace avro {
+
+/**
+ * The range of the values of one field within one block.
+ */
+struct AVRO_DECL FieldStatistics {
+    /// The name of the top-level field.
+    std::string name;
+
+    /// The smallest and largest values of the field in the block: longs
+    /// for int and long fields, doubles for float and double fields and
+    /// strings for string fields. Both are null if every value in the
+    /// block was null.
+    GenericDatum min;
+    GenericDatum max;
+};
+
+/**
+ * The statistics of one block of a data file.
+ */
+struct AVRO_DECL BlockStatistics {
+    /// The offset of the block in the data file, as in DataFileBlock.
+    int64_t offset = 0;
+
+    /// The number of objects in the block.
+    int64_t objectCount = 0;
+
+    /// One entry per tracked field.
+    std::vector<FieldStatistics> fields;
+
+    /**
+     * Returns the statistics of the named field or null if the field is
+     * not tracked.
+     */
+    const FieldStatistics *field(const std::string &name) const;
+
+    /**
+     * Returns false only if no value of the named field in this block can
+     * lie in [lo, hi]. A null bound leaves that side open. Untracked fields
+     * always overlap, since nothing is known about them.
+     * Throws if a bound cannot be compared with the field's values.
+     */
+    bool overlaps(const std::string &name,
+                  const GenericDatum &lo, const GenericDatum &hi) const;
+};
+
+/**
+ * Decides, from its statistics, whether a block has to be read.
+ */
+typedef std::function<bool(const BlockStatistics &)> BlockFilter;
+
+/**
+ * Computes the statistics of blocks of objects of a record schema.
+ * Tracked fields must be top-level fields of type int, long, float,
+ * double or string, or unions of null and one of these.
+ */
+class AVRO_DECL BlockStatisticsCollector {
+    struct Plan;
+    std::shared_ptr<Plan> plan_;
+
+public:
+    BlockStatisticsCollector(const ValidSchema &schema,
+                             const std::vector<std::string> &fields);
+
+    /**
+     * Decodes the \p objectCount uncompressed objects in the \p len bytes
+     * at \p data and returns their statistics, leaving the offset zero.
+     */
+    BlockStatistics collect(const uint8_t *data, size_t len,
+                            int64_t objectCount) const;
+};
+
+/**
+ * Decides, from the values of some top-level fields of a record, whether
+ * the record has to be decoded. The values come in the order the fields
+ * were named in.
+ */
+typedef std::function<bool(const std::vector<GenericDatum> &)> RecordPredicate;
+
+/**
+ * Applies a predicate to records of a record schema as they are found
+ * in the data, decoding only the fields the predicate looks at and
+ * skipping the others.
+ */
+class AVRO_DECL RecordFilter {
+    struct Plan;
+    std::shared_ptr<Plan> plan_;
+
+public:
+    RecordFilter(const ValidSchema &schema, const std::vector<std::string> &fields,
+                 RecordPredicate predicate);
+
+    /**
+     * Reads the whole of the next record from \p d, which decodes the
+     * binary encoding of the schema, and returns what the predicate says
+     * of it.
+     */
+    bool accept(Decoder &d) const;
+};
+
+/**
+ * Writes the statistics of the blocks of a data file to a sidecar.
+ */
+AVRO_DECL void writeBlockStatistics(std::unique_ptr<OutputStream> out,
+                                    const std::vector<BlockStatistics> &stats);
+
+/**
+ * Reads the statistics written by writeBlockStatistics().
+ */
+AVRO_DECL std::vector<BlockStatistics> readBlockStatistics(
+    std::unique_ptr<InputStream> in);
+AVRO_DECL std::vector<BlockStatistics> readBlockStatistics(
+    const std::string &filename);
+
+} // namespace avro
+
+#endif
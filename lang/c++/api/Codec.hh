@@ -0,0 +1,204 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_BlockCodec_hh__
+#define avro_BlockCodec_hh__
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Config.hh"
+
+/// \file
+/// The block compression codecs of data files and the registry that maps
+/// the names in a file's avro.codec metadata to them.
+
+namespace avro {
+
+class ValidSchema;
+
+/**
+ * Compresses whole blocks. An instance may keep codec state, such as a
+ * compression context, from one block to the next; it is used by one
+ * thread at a time.
+ */
+class AVRO_DECL BlockCompressor {
+public:
+    virtual ~BlockCompressor();
+
+    /**
+     * Compresses \p len bytes at \p in, at the given level, into the front
+     * of \p out. The caller reuses \p out from one block to the next, so
+     * implementations should only grow it.
+     * \return the number of compressed bytes.
+     */
+    virtual size_t compress(const uint8_t *in, size_t len, int level,
+                            std::vector<char> &out) = 0;
+};
+
+/**
+ * Decompresses whole blocks; the counterpart of BlockCompressor.
+ */
+class AVRO_DECL BlockDecompressor {
+public:
+    virtual ~BlockDecompressor();
+
+    /**
+     * Decompresses \p len bytes at \p in into the front of \p out, which
+     * implementations should only grow.
+     * \return the number of decompressed bytes.
+     */
+    virtual size_t decompress(const uint8_t *in, size_t len,
+                              std::vector<uint8_t> &out) = 0;
+
+    /**
+     * Turns the checking of any checksum the codec keeps in its blocks,
+     * such as snappy's CRC-32, on or off. It is on to begin with; codecs
+     * that keep none ignore this.
+     */
+    virtual void setChecksumVerification(bool verify);
+};
+
+/**
+ * A block compression codec. Data file writers and readers make one
+ * compressor or decompressor per thread that needs one and keep it for as
+ * long as they live, so that is where a codec keeps contexts that are
+ * costly to set up.
+ */
+class AVRO_DECL BlockCodec {
+public:
+    virtual ~BlockCodec();
+
+    /**
+     * Returns the name of the codec in the avro.codec metadata.
+     */
+    virtual std::string name() const = 0;
+
+    /**
+     * Returns the compression level writers use unless told otherwise.
+     */
+    virtual int defaultLevel() const;
+
+    /**
+     * Throws an Exception if \p level is not a valid compression level
+     * for this codec. The default accepts none.
+     */
+    virtual void checkLevel(int level) const;
+
+    virtual std::unique_ptr<BlockCompressor> newCompressor() const = 0;
+
+    virtual std::unique_ptr<BlockDecompressor> newDecompressor() const = 0;
+
+    /**
+     * Adds to the metadata of a data file what its readers need besides
+     * the codec's name, such as a compression dictionary. The default
+     * adds nothing.
+     */
+    virtual void addMetadata(std::map<std::string, std::vector<uint8_t>> &metadata) const;
+};
+
+typedef std::shared_ptr<BlockCodec> BlockCodecPtr;
+
+/**
+ * Registers \p codec under its name, replacing any codec registered with
+ * that name, built-in ones included. The null, deflate and, when
+ * available, snappy, zstandard, xz and lz4 codecs are registered from the
+ * start. With xz comes lzma, the raw LZMA2 blocks of the C library's data
+ * files. lz4 blocks are LZ4 frames; lz4 is not in the specification, so
+ * other implementations may not read files that use it.
+ */
+AVRO_DECL void registerCodec(const BlockCodecPtr &codec);
+
+/**
+ * Returns the codec registered with the given name, or null if there is
+ * none.
+ */
+AVRO_DECL BlockCodecPtr findCodec(const std::string &name);
+
+/**
+ * Returns the names of the registered codecs, in alphabetical order.
+ */
+AVRO_DECL std::vector<std::string> codecNames();
+
+/**
+ * Returns a codec that transposes blocks of objects of \p schema before
+ * compressing them with \p codec. The bytes of each field go to a stream
+ * of their own: numbers and fixeds, as well as the lengths of strings and
+ * bytes apart from their contents. Blocks of mostly numeric records
+ * compress better and faster that way. The codec is named after \p codec
+ * with "transposed-" in front, such as "transposed-zstandard"; its levels
+ * are those of \p codec.
+ *
+ * Readers need the schema to put the blocks back together, so findCodec()
+ * with a schema is what finds these codecs, and the data file readers use
+ * it. Implementations that do not know the name refuse such files rather
+ * than misread them.
+ */
+AVRO_DECL BlockCodecPtr transposingCodec(const ValidSchema &schema, const BlockCodecPtr &codec);
+
+/**
+ * Like findCodec(name), but for data files whose objects have \p schema;
+ * names of transposing codecs find one over the codec they name.
+ */
+AVRO_DECL BlockCodecPtr findCodec(const std::string &name, const ValidSchema &schema);
+
+/**
+ * Like findCodec(name, schema), for a data file with the given
+ * \p metadata, from which codecs such as zstandard with a dictionary
+ * take what they added to it.
+ */
+AVRO_DECL BlockCodecPtr findCodec(const std::string &name, const ValidSchema &schema,
+                                  const std::map<std::string, std::vector<uint8_t>> &metadata);
+
+/**
+ * The metadata key of the dictionary of zstandard data files compressed
+ * with one.
+ */
+AVRO_DECL extern const char *const ZSTD_DICTIONARY_KEY;
+
+/**
+ * Returns a zstandard codec that compresses every block with
+ * \p dictionary, which suits the small blocks of short sync intervals far
+ * better than compressing each on its own. The codec prepares the
+ * dictionary once for each level and once for decompression, and shares
+ * it between its compressors and decompressors. Writers store the
+ * dictionary in the file's metadata under ZSTD_DICTIONARY_KEY, next to
+ * the usual "zstandard" codec name, and findCodec() with metadata finds
+ * it again; implementations that know no dictionaries fail to decompress
+ * the blocks rather than misread them. Throws if zstandard is not built
+ * in.
+ */
+AVRO_DECL BlockCodecPtr zstdDictionaryCodec(const std::vector<uint8_t> &dictionary);
+
+/**
+ * Trains a zstandard dictionary of at most \p maxSize bytes on
+ * \p samples, such as the binary encodings of typical objects of a
+ * schema. Training needs many samples, a hundred or more, whose total
+ * size is well above \p maxSize. Throws if zstandard is not built in or
+ * training fails.
+ */
+AVRO_DECL std::vector<uint8_t> trainZstdDictionary(const std::vector<std::vector<uint8_t>> &samples,
+                                                   size_t maxSize = 16 * 1024);
+
+} // namespace avro
+
+#endif
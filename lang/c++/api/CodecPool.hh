@@ -0,0 +1,149 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_CodecPool_hh__
+#define avro_CodecPool_hh__
+
+#include <memory>
+
+#include <boost/noncopyable.hpp>
+
+#include "Config.hh"
+#include "Decoder.hh"
+#include "Encoder.hh"
+#include "ValidSchema.hh"
+
+/// \file
+/// Pools of decoders and encoders for a schema or a pair of schemas.
+///
+/// Validating and resolving codecs build a grammar or a program for their
+/// schemas when they are created. A pool creates them once and hands them
+/// out again: acquire() returns an idle codec, or a new one if there is
+/// none, and the codec goes back to the pool when the last copy of the
+/// returned pointer is released, which must happen while the stream it
+/// was last initialized with is still alive. init() puts a pooled codec back at the
+/// start of its schema, so it must be called before each use; it only
+/// resets the parsing state, not the grammar.
+///
+/// Pools may be used from several threads. A pool keeps at most capacity
+/// idle codecs, and codecs released after their pool is destroyed are
+/// simply freed.
+
+namespace avro {
+
+/**
+ * A pool of binary decoders, or of validating decoders for a schema.
+ */
+class AVRO_DECL DecoderPool : private boost::noncopyable {
+public:
+    struct Impl;
+
+    /**
+     * Creates a pool of decoders returned by binaryDecoder().
+     */
+    explicit DecoderPool(size_t capacity = 16);
+
+    /**
+     * Creates a pool of validating decoders for \p schema over binary
+     * decoders.
+     */
+    explicit DecoderPool(const ValidSchema &schema, size_t capacity = 16);
+
+    ~DecoderPool();
+
+    /**
+     * Returns a decoder of the pool, which is returned to it once the
+     * pointer and its copies are gone.
+     */
+    DecoderPtr acquire();
+
+    /**
+     * Returns the number of idle decoders in the pool.
+     */
+    size_t idle() const;
+
+private:
+    std::shared_ptr<Impl> impl_;
+};
+
+/**
+ * A pool of decoders that resolve data written with one schema against
+ * another, as returned by compiledResolvingDecoder() over binary decoders.
+ */
+class AVRO_DECL ResolvingDecoderPool : private boost::noncopyable {
+public:
+    struct Impl;
+
+    ResolvingDecoderPool(const ValidSchema &writer, const ValidSchema &reader, size_t capacity = 16);
+
+    ~ResolvingDecoderPool();
+
+    /**
+     * Returns a decoder of the pool, which is returned to it once the
+     * pointer and its copies are gone.
+     */
+    ResolvingDecoderPtr acquire();
+
+    /**
+     * Returns the number of idle decoders in the pool.
+     */
+    size_t idle() const;
+
+private:
+    std::shared_ptr<Impl> impl_;
+};
+
+/**
+ * A pool of binary encoders, or of validating encoders for a schema.
+ */
+class AVRO_DECL EncoderPool : private boost::noncopyable {
+public:
+    struct Impl;
+
+    /**
+     * Creates a pool of encoders returned by binaryEncoder().
+     */
+    explicit EncoderPool(size_t capacity = 16);
+
+    /**
+     * Creates a pool of validating encoders for \p schema over binary
+     * encoders.
+     */
+    explicit EncoderPool(const ValidSchema &schema, size_t capacity = 16);
+
+    ~EncoderPool();
+
+    /**
+     * Returns an encoder of the pool, which is returned to it once the
+     * pointer and its copies are gone. Flush the encoder before letting
+     * go of it.
+     */
+    EncoderPtr acquire();
+
+    /**
+     * Returns the number of idle encoders in the pool.
+     */
+    size_t idle() const;
+
+private:
+    std::shared_ptr<Impl> impl_;
+};
+
+} // namespace avro
+
+#endif
@@ -0,0 +1,127 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_CodecSelector_hh__
+#define avro_CodecSelector_hh__
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "Codec.hh"
+#include "Config.hh"
+
+/// \file
+/// Picks the codec and level of data files from samples of the blocks
+/// being written.
+
+namespace avro {
+
+/**
+ * A codec and the level to compress with it. Codecs without levels take
+ * their defaultLevel().
+ */
+struct AVRO_DECL CodecSetting {
+    BlockCodecPtr codec;
+    int level;
+
+    CodecSetting() : level(0) {}
+    CodecSetting(BlockCodecPtr c, int l) : codec(std::move(c)), level(l) {}
+    explicit CodecSetting(const BlockCodecPtr &c) : codec(c), level(c ? c->defaultLevel() : 0) {}
+};
+
+/**
+ * How a candidate did on the samples the last time select() ran.
+ */
+struct AVRO_DECL CodecMeasurement {
+    CodecSetting setting;
+    size_t rawBytes = 0;
+    size_t compressedBytes = 0;
+    int64_t nanos = 0;
+};
+
+/**
+ * Chooses among candidate codecs and levels by compressing samples of the
+ * blocks written with each: the setting that compresses them the most
+ * within a budget of compression time per uncompressed byte wins, or the
+ * fastest if none is within it. Data files have a single codec, so a
+ * DataFileWriterBase given a selector switches only when it rolls on to
+ * a new file; see DataFileWriterBase::setCodecSelector().
+ *
+ * A selector is used by one thread at a time.
+ */
+class AVRO_DECL CodecSelector : boost::noncopyable {
+    const std::vector<CodecSetting> candidates_;
+    const double maxNanosPerByte_;
+    const size_t sampleEvery_;
+    const size_t maxSamples_;
+    // The blocks seen since the last sample.
+    size_t skipped_;
+    // The most recent samples, oldest first.
+    std::deque<std::vector<uint8_t>> samples_;
+    std::vector<CodecMeasurement> measurements_;
+
+public:
+    /**
+     * Chooses among \p candidates, spending at most \p maxNanosPerByte
+     * nanoseconds compressing each uncompressed byte. Every
+     * \p sampleEvery-th block is sampled, starting with the first, and
+     * the \p maxSamples most recent samples are kept. Throws if there are
+     * no candidates or a level is invalid for its codec.
+     */
+    CodecSelector(std::vector<CodecSetting> candidates, double maxNanosPerByte,
+                  size_t sampleEvery = 16, size_t maxSamples = 4);
+
+    /**
+     * Returns every level of deflate, snappy, every level of zstandard
+     * from 1 to 9 and the null codec, as far as they are built in.
+     */
+    static std::vector<CodecSetting> defaultCandidates();
+
+    /**
+     * Offers the uncompressed block of \p len bytes at \p data, which is
+     * copied if it is sampled.
+     */
+    void sample(const uint8_t *data, size_t len);
+
+    /**
+     * Returns true if there are samples to select() with.
+     */
+    bool hasSamples() const { return !samples_.empty(); }
+
+    /**
+     * Compresses the samples with every candidate and returns the best
+     * setting; the samples are dropped, so that the next choice goes by
+     * the blocks to come. With no samples, returns the first candidate.
+     */
+    CodecSetting select();
+
+    /**
+     * Returns how the candidates did the last time select() had samples,
+     * in the order of the candidates.
+     */
+    const std::vector<CodecMeasurement> &measurements() const { return measurements_; }
+};
+
+} // namespace avro
+
+#endif
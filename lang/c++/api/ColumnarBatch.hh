@@ -0,0 +1,217 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_ColumnarBatch_hh__
+#define avro_ColumnarBatch_hh__
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "Config.hh"
+#include "DataFile.hh"
+#include "LogicalType.hh"
+#include "Types.hh"
+
+/// \file
+/// Reading and writing data files straight from and into columns laid out
+/// as in the Apache Arrow columnar format, without an object per row.
+///
+/// The records of the file become one column per primitive, enum or fixed
+/// field, nested records included; the column of field b of a record in
+/// field a is named "a.b". A union of null and one other type makes the
+/// column, or the columns of the record it holds, nullable. Arrays, maps,
+/// other unions and recursive records cannot be read this way.
+
+namespace avro {
+
+/**
+ * The values of one field for the rows of a batch, in the buffers of an
+ * Arrow array of the matching type:
+ *
+ * - validity: the validity bitmap, least significant bit first, with a
+ *   set bit for each row that is not null. Empty if the column is not
+ *   nullable.
+ * - values: for boolean, the values as a bitmap like validity; for int,
+ *   long, float, double and enum, the values in native byte order, enums
+ *   as the int32 index of their symbol, which suits a dictionary array;
+ *   for fixed, the values back to back; for string and bytes, the bytes
+ *   of all the values. Rows that are null hold zeros.
+ * - offsets: for string and bytes, length + 1 int32 offsets into values.
+ *
+ * Null rows of a string or bytes column take no bytes. Null columns, for
+ * fields of type null, have no buffers.
+ */
+struct AVRO_DECL Column {
+    /// The name of the field, with the names of the records it is in.
+    std::string name;
+    Type type;
+    LogicalType logicalType;
+    /// The size of the values of fixed columns.
+    size_t fixedSize;
+    bool nullable;
+    /// The symbols of enum columns.
+    std::vector<std::string> symbols;
+
+    size_t length;
+    size_t nullCount;
+    std::vector<uint8_t> validity;
+    std::vector<uint8_t> values;
+    std::vector<int32_t> offsets;
+
+    Column() : type(AVRO_NULL), logicalType(LogicalType::NONE), fixedSize(0), nullable(false),
+               length(0), nullCount(0) {}
+
+    /**
+     * Drops the values, keeping the memory of the buffers.
+     */
+    void clear();
+};
+
+/**
+ * The columns of a run of rows.
+ */
+struct AVRO_DECL ColumnarBatch {
+    size_t length;
+    std::vector<Column> columns;
+
+    ColumnarBatch() : length(0) {}
+
+    /**
+     * Returns the index of the column named \p name, or -1 if there is
+     * none.
+     */
+    int columnIndex(const std::string &name) const;
+};
+
+// The columns of a record schema and the steps that walk them.
+struct ColumnarProgram;
+
+/**
+ * Reads the records of a data file a batch of columns at a time. A batch
+ * holds rows of one block only, so a block is decoded straight into the
+ * buffers of the batch.
+ */
+class AVRO_DECL ColumnarBatchReader : boost::noncopyable {
+    const std::unique_ptr<DataFileReaderBase> base_;
+    std::unique_ptr<ColumnarProgram> program_;
+
+    void init();
+
+public:
+    /**
+     * Reads the file with the schema it was written with.
+     */
+    explicit ColumnarBatchReader(const char *filename);
+
+    /**
+     * Reads the file with the schema it was written with through \p base,
+     * which must not have been initialized yet.
+     */
+    explicit ColumnarBatchReader(std::unique_ptr<DataFileReaderBase> base);
+
+    /**
+     * Reads the file through \p base with \p readerSchema, resolving the
+     * data against it.
+     */
+    ColumnarBatchReader(std::unique_ptr<DataFileReaderBase> base, const ValidSchema &readerSchema);
+
+    ~ColumnarBatchReader();
+
+    /**
+     * Replaces the contents of \p batch with the next rows of the file:
+     * the rest of the current block, up to \p maxRows rows unless it is
+     * zero. The batch is meant to be reused, so that its buffers keep
+     * their memory. Returns false, leaving \p batch empty, at the end of
+     * the file.
+     */
+    bool next(ColumnarBatch &batch, size_t maxRows = 64 * 1024);
+
+    /**
+     * Returns the schema the rows are read with.
+     */
+    const ValidSchema &readerSchema() const;
+
+    /**
+     * Returns the reader the file is read with, for seeking and such.
+     */
+    DataFileReaderBase &base() { return *base_; }
+};
+
+/**
+ * Writes records to a data file from batches of columns, as read by
+ * ColumnarBatchReader. Each batch must have the columns of the schema, in
+ * the order and with the names and types of those of batch(), and each
+ * column must have the batch's length.
+ *
+ * The validity bitmap of a nullable column may be empty when no row is
+ * null. A record that is the non-null branch of a union is null in the
+ * rows where the first of its columns is.
+ */
+class AVRO_DECL ColumnarBatchWriter : boost::noncopyable {
+    const std::unique_ptr<DataFileWriterBase> base_;
+    std::unique_ptr<ColumnarProgram> program_;
+
+    void init();
+
+public:
+    /**
+     * Creates the data file \p filename for records of \p schema.
+     */
+    ColumnarBatchWriter(const char *filename, const ValidSchema &schema,
+                        size_t syncInterval = 16 * 1024, Codec codec = NULL_CODEC);
+
+    /**
+     * Writes the file through \p base.
+     */
+    explicit ColumnarBatchWriter(std::unique_ptr<DataFileWriterBase> base);
+
+    ~ColumnarBatchWriter();
+
+    /**
+     * Returns an empty batch with the columns of the schema.
+     */
+    ColumnarBatch batch() const;
+
+    /**
+     * Appends the rows of \p batch to the file. Throws, having written
+     * none of them, if the batch does not fit the schema.
+     */
+    void write(const ColumnarBatch &batch);
+
+    /**
+     * Flushes the rows written so far to the file.
+     */
+    void flush() { base_->flush(); }
+
+    /**
+     * Closes the file.
+     */
+    void close() { base_->close(); }
+
+    /**
+     * Returns the writer the file is written with.
+     */
+    DataFileWriterBase &base() { return *base_; }
+};
+
+} // namespace avro
+
+#endif
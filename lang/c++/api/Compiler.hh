@@ -22,6 +22,11 @@
 #include "Config.hh"
 #include <cstdint>
 #include <istream>
+#include <string>
+#include <vector>
+
+#include "Executor.hh"
+#include "ValidSchema.hh"
 
 namespace avro {
 
@@ -58,6 +63,32 @@ AVRO_DECL ValidSchema compileJsonSchemaFromString(const std::string &input);
 
 AVRO_DECL ValidSchema compileJsonSchemaFromFile(const char *filename);
 
+/// A schema compiled by compileJsonSchemas(), or why it did not compile.
+struct AVRO_DECL CompiledSchema {
+    ValidSchema schema;
+    /// The Rabin fingerprint of the schema, as ValidSchema has it.
+    uint64_t fingerprint = 0;
+    /// Empty if the schema compiled.
+    std::string error;
+};
+
+/// Compiles many JSON schemas at once, such as those of a registry, in
+/// tasks on \p executor, or defaultExecutor() if null. Identical strings
+/// are compiled once and share their ValidSchema. Fingerprints are
+/// computed in the tasks too. A schema that does not compile has its
+/// error set and does not hold the others up. The results are in the
+/// order of \p inputs.
+AVRO_DECL std::vector<CompiledSchema> compileJsonSchemas(const std::vector<std::string> &inputs,
+                                                         ExecutorPtr executor = ExecutorPtr());
+
+class AVRO_DECL Protocol;
+
+/// Compiles the JSON of a protocol, as found in .avpr files. Throws if it
+/// is not a valid protocol.
+AVRO_DECL Protocol compileJsonProtocolFromString(const std::string &input);
+
+AVRO_DECL Protocol compileJsonProtocolFromFile(const char *filename);
+
 } // namespace avro
 
 #endif
@@ -0,0 +1,254 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_ConcurrentDataFileWriter_hh__
+#define avro_ConcurrentDataFileWriter_hh__
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "Config.hh"
+#include "DataFile.hh"
+
+namespace avro {
+
+/**
+ * Type-independent portion of ConcurrentDataFileWriter: a data file to
+ * which several threads write whole blocks. Each producing thread fills
+ * a BlockBuilder of its own, and filled blocks are queued to a single
+ * flusher thread that compresses them and writes them, with the sync
+ * markers, through a DataFileWriterBase.
+ */
+class AVRO_DECL ConcurrentDataFileWriterBase : boost::noncopyable {
+public:
+    /**
+     * The block being filled by one producing thread. Once it holds the
+     * writer's sync interval of bytes, the block is queued to be written
+     * and the builder starts the next one.
+     */
+    class AVRO_DECL BlockBuilder : boost::noncopyable {
+        ConcurrentDataFileWriterBase &writer_;
+
+        class Buffer;
+        std::unique_ptr<Buffer> buffer_;
+        const EncoderPtr encoder_;
+        int64_t objectCount_;
+
+        void submit();
+
+    public:
+        explicit BlockBuilder(ConcurrentDataFileWriterBase &writer);
+
+        /**
+         * Queues what is left of the block, leaving errors to the
+         * writer's flush() or close().
+         */
+        ~BlockBuilder();
+
+        /**
+         * Returns the encoder to write the next object with.
+         */
+        Encoder &encoder() const { return *encoder_; }
+
+        /**
+         * Counts the object just encoded, and queues the block if it
+         * is full.
+         */
+        void incr();
+
+        /**
+         * Queues the block filled so far, if it holds any object.
+         */
+        void flush();
+    };
+
+private:
+    struct Block {
+        std::vector<uint8_t> data;
+        size_t size;
+        int64_t objectCount;
+    };
+
+    const std::unique_ptr<DataFileWriterBase> writer_;
+    const size_t syncInterval_;
+    const size_t maxQueued_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    // Blocks waiting for the flusher, in the order they were filled.
+    std::deque<Block> queue_;
+    // The buffers of written blocks, for builders to reuse.
+    std::vector<std::vector<uint8_t>> spare_;
+    bool writing_;
+    bool stopping_;
+    std::exception_ptr error_;
+
+    // Held by the flusher while it writes, and by whoever else uses the
+    // underlying writer.
+    std::mutex writerMutex_;
+    std::thread flusher_;
+
+    void start();
+    void flushLoop();
+    void rethrow();
+
+    /**
+     * Queues the \p size bytes of \p data holding \p objectCount objects
+     * and replaces \p data with a spare buffer, waiting while the queue
+     * is full.
+     */
+    void submit(std::vector<uint8_t> &data, size_t size, int64_t objectCount);
+
+public:
+    /**
+     * Constructs a data file written by blocks of about \p syncInterval
+     * bytes, with at most \p maxQueued filled blocks waiting to be
+     * written, after which producers wait; zero means twice the number
+     * of hardware threads.
+     */
+    ConcurrentDataFileWriterBase(const char *filename, const ValidSchema &schema,
+                                 size_t syncInterval, Codec codec = NULL_CODEC,
+                                 size_t maxQueued = 0);
+    ConcurrentDataFileWriterBase(std::unique_ptr<OutputStream> outputStream,
+                                 const ValidSchema &schema, size_t syncInterval,
+                                 Codec codec = NULL_CODEC, size_t maxQueued = 0);
+
+    ~ConcurrentDataFileWriterBase();
+
+    /**
+     * Returns the schema of the file.
+     */
+    const ValidSchema &schema() const { return writer_->schema(); }
+
+    /**
+     * Waits for the queued blocks to be written and flushes the file.
+     * Blocks still being filled are not written. If writing a block has
+     * failed, this throws the error.
+     */
+    void flush();
+
+    /**
+     * Writes the queued blocks and closes the file. All BlockBuilders
+     * must have been flushed or destroyed before.
+     */
+    void close();
+
+    /**
+     * Compresses blocks on background threads rather than on the
+     * flusher. See DataFileWriterBase::setCompressionThreads().
+     */
+    void setCompressionThreads(size_t threads, size_t maxPendingBlocks = 0);
+
+    /**
+     * See DataFileWriterBase::stats().
+     */
+    DataFileStats stats() const { return writer_->stats(); }
+};
+
+/**
+ * A data file of objects of type T written by several threads, each
+ * through a Producer of its own:
+ * \code
+ * ConcurrentDataFileWriter<T> writer(filename, schema);
+ * // On each producing thread:
+ * ConcurrentDataFileWriter<T>::Producer producer(writer);
+ * producer.write(t);
+ * \endcode
+ * Objects written through one producer keep their order within its
+ * blocks, and blocks of different producers interleave in the file.
+ */
+template<typename T>
+class ConcurrentDataFileWriter : boost::noncopyable {
+    std::unique_ptr<ConcurrentDataFileWriterBase> base_;
+
+public:
+    /**
+     * Writes objects into blocks of its own. A producer may be used by
+     * only one thread at a time.
+     */
+    class Producer : boost::noncopyable {
+        ConcurrentDataFileWriterBase::BlockBuilder builder_;
+
+    public:
+        explicit Producer(ConcurrentDataFileWriter &writer) : builder_(*writer.base_) {}
+
+        /**
+         * Writes the given piece of data into the producer's block.
+         */
+        void write(const T &datum) {
+            avro::encode(builder_.encoder(), datum);
+            builder_.incr();
+        }
+
+        /**
+         * Queues the block filled so far to be written.
+         */
+        void flush() { builder_.flush(); }
+    };
+
+    /**
+     * Constructs a new data file.
+     * See ConcurrentDataFileWriterBase::ConcurrentDataFileWriterBase().
+     */
+    ConcurrentDataFileWriter(const char *filename, const ValidSchema &schema,
+                             size_t syncInterval = 16 * 1024, Codec codec = NULL_CODEC,
+                             size_t maxQueued = 0) : base_(new ConcurrentDataFileWriterBase(filename, schema, syncInterval, codec, maxQueued)) {}
+
+    ConcurrentDataFileWriter(std::unique_ptr<OutputStream> outputStream, const ValidSchema &schema,
+                             size_t syncInterval = 16 * 1024, Codec codec = NULL_CODEC,
+                             size_t maxQueued = 0) : base_(new ConcurrentDataFileWriterBase(std::move(outputStream), schema, syncInterval, codec, maxQueued)) {}
+
+    /**
+     * Returns the schema for this data file.
+     */
+    const ValidSchema &schema() const { return base_->schema(); }
+
+    /**
+     * See ConcurrentDataFileWriterBase::flush().
+     */
+    void flush() { base_->flush(); }
+
+    /**
+     * See ConcurrentDataFileWriterBase::close().
+     */
+    void close() { base_->close(); }
+
+    /**
+     * See DataFileWriterBase::setCompressionThreads().
+     */
+    void setCompressionThreads(size_t threads, size_t maxPendingBlocks = 0) {
+        base_->setCompressionThreads(threads, maxPendingBlocks);
+    }
+
+    /**
+     * See DataFileWriterBase::stats().
+     */
+    DataFileStats stats() const { return base_->stats(); }
+};
+
+} // namespace avro
+
+#endif
@@ -0,0 +1,39 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_Crc32_hh__
+#define avro_Crc32_hh__
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Config.hh"
+/// \file
+/// The CRC-32 that the snappy codec appends to each block.
+
+namespace avro {
+
+/// Returns the CRC-32 (the ISO-HDLC one that zlib computes) of \p len
+/// bytes at \p data, continuing from \p crc, the CRC of the bytes before.
+/// It uses carry-less multiplication or CRC instructions where the
+/// processor has them.
+AVRO_DECL uint32_t crc32(const uint8_t *data, size_t len, uint32_t crc = 0) noexcept;
+
+} // namespace avro
+
+#endif
@@ -19,20 +19,33 @@
 #ifndef avro_DataFile_hh__
 #define avro_DataFile_hh__
 
+#include "BinaryValidator.hh"
+#include "BlockStatistics.hh"
+#include "Codec.hh"
+#include "CodecSelector.hh"
 #include "Config.hh"
+#include "DataFileIndex.hh"
+#include "DirectCodec.hh"
 #include "Encoder.hh"
+#include "Executor.hh"
+#include "RecordBatch.hh"
 #include "Specific.hh"
 #include "Stream.hh"
 #include "ValidSchema.hh"
 #include "buffer/Buffer.hh"
 
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <limits>
+#include <list>
 #include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include "array"
 #include "boost/utility.hpp"
-#include <boost/iostreams/filtering_stream.hpp>
 
 namespace avro {
 
@@ -42,9 +55,45 @@ enum Codec {
     DEFLATE_CODEC,
 
 #ifdef SNAPPY_CODEC_AVAILABLE
-    SNAPPY_CODEC
+    SNAPPY_CODEC,
 #endif
 
+#ifdef ZSTD_CODEC_AVAILABLE
+    ZSTD_CODEC,
+#endif
+
+#ifdef XZ_CODEC_AVAILABLE
+    XZ_CODEC,
+#endif
+
+#ifdef LZ4_CODEC_AVAILABLE
+    LZ4_CODEC,
+#endif
+
+};
+
+/**
+ * Returns the registered codec for one of the built-in codecs, which is
+ * the library's own unless registerCodec() replaced it.
+ */
+AVRO_DECL BlockCodecPtr blockCodec(Codec codec);
+
+/**
+ * How much a data file reader checks that the blocks it reads are those
+ * that were written.
+ */
+enum BlockVerification {
+    /// Codecs check the checksums they keep, such as snappy's CRC-32, and
+    /// blocks whose checksum is in the reader's index are checked against
+    /// it before they are decoded.
+    VERIFY_BLOCKS,
+    /// As VERIFY_BLOCKS, but the checksums of the index are checked on a
+    /// worker thread while the block is decoded; a mismatch throws when
+    /// the reader moves on from the block.
+    VERIFY_BLOCKS_ASYNC,
+    /// Nothing is checked, for files that are trusted, such as those the
+    /// process wrote itself.
+    TRUST_BLOCKS
 };
 
 const int SyncSize = 16;
@@ -53,33 +102,210 @@ const int SyncSize = 16;
  */
 typedef std::array<uint8_t, SyncSize> DataFileSync;
 
+/**
+ * What a data file writer or reader has done so far. Counts are always
+ * kept. Times, in nanoseconds of std::chrono::steady_clock, only once
+ * timing has been turned on, since it reads the clock twice per object.
+ * Times add up the work of every thread, so with compression threads
+ * they can exceed the time elapsed.
+ */
+struct AVRO_DECL DataFileStats {
+    /**
+     * The number of buckets of blockSizes. Bucket i counts the blocks
+     * whose uncompressed size is in [2^i, 2^(i+1)), except that the first
+     * also takes empty blocks and the last all larger ones.
+     */
+    static const size_t sizeBuckets = 32;
+
+    int64_t blocks = 0;
+    int64_t objects = 0;
+
+    /// The bytes of the blocks before compression and as stored. Blocks
+    /// a reader skips without decoding are not counted.
+    int64_t rawBytes = 0;
+    int64_t compressedBytes = 0;
+
+    /// Writers only: encoding objects into blocks.
+    int64_t encodeNanos = 0;
+    /// Compressing or decompressing blocks, including any checksum the
+    /// codec keeps, such as snappy's CRC-32.
+    int64_t compressNanos = 0;
+    /// Writing blocks to, or reading them from, the underlying stream.
+    int64_t ioNanos = 0;
+    /// Readers only: decoding objects out of blocks.
+    int64_t decodeNanos = 0;
+
+    /// Readers only: objects a record filter rejected, which are among
+    /// objects but were never decoded.
+    int64_t filteredObjects = 0;
+
+    /**
+     * Bytes the writer or reader copied between buffers of its own, on
+     * top of what its stream counts: growing the block being written,
+     * piecing a block together from chunks of the stream, or reading
+     * ahead. Reading a block that lies in one chunk, or in the memory of
+     * a mapped file, with the null codec copies nothing.
+     */
+    int64_t copiedBytes = 0;
+    /// The buffers of blocks allocated, or reallocated to grow.
+    int64_t bufferAllocations = 0;
+
+    std::array<int64_t, sizeBuckets> blockSizes{};
+};
+
+class DataFileCounters;
+class GroupCommitter;
+
+/**
+ * When a data file writer ends a block, besides when it is flushed.
+ * A block ends as soon as any of the enabled limits is reached; zero
+ * disables a limit. With no limit set, blocks end once they hold the
+ * writer's sync interval of uncompressed bytes.
+ */
+struct AVRO_DECL SyncPolicy {
+    /**
+     * The size blocks should have once compressed. The writer ends a
+     * block when its uncompressed size reaches this divided by the
+     * compression ratio achieved so far, which starts out as the sync
+     * interval until a block has been compressed.
+     */
+    size_t targetBlockSize = 0;
+
+    /**
+     * How long the first object of a block may wait for the block to be
+     * written, so that readers tailing the file see it in time. This is
+     * checked on each write and by DataFileWriterBase::syncIfStale().
+     */
+    std::chrono::steady_clock::duration maxLatency{0};
+
+    /// The number of objects in a block.
+    int64_t maxObjects = 0;
+};
+
 /**
  * Type-independent portion of DataFileWriter.
  *  At any given point in time, at most one file can be written using
  *  this object.
  */
 class AVRO_DECL DataFileWriterBase : boost::noncopyable {
-    const std::string filename_;
+    std::string filename_;
     const ValidSchema schema_;
     const EncoderPtr encoderPtr_;
     const size_t syncInterval_;
-    Codec codec_;
+    BlockCodecPtr codec_;
+    int compressionLevel_;
+    const StreamOptions bufferOptions_;
 
     std::unique_ptr<OutputStream> stream_;
-    std::unique_ptr<OutputStream> buffer_;
-    const DataFileSync sync_;
+
+    /**
+     * The contiguous, reusable buffer of the block being written.
+     */
+    class BlockBuffer;
+    std::unique_ptr<BlockBuffer> buffer_;
+    std::vector<char> compressed_;
+
+    /**
+     * With setDirectBlocks(), the objects are encoded straight into
+     * stream_, through blockStream_, after a slot for the count and size
+     * of the block that sync() fills in. blockData_ is where the objects
+     * of the open block start.
+     */
+    class BlockStream;
+    std::unique_ptr<BlockStream> blockStream_;
+    bool direct_{};
+    bool blockOpen_{};
+    uint64_t blockData_{};
+    DataFileSync sync_;
     int64_t objectCount_;
 
     typedef std::map<std::string, std::vector<uint8_t>> Metadata;
 
     Metadata metadata_;
+    // The magic and metadata of the header, encoded once for all the
+    // files the writer rolls on to.
+    std::vector<uint8_t> header_;
     int64_t lastSync_;
 
+    /**
+     * Compresses blocks on the caller's thread, keeping codec state
+     * such as compression contexts alive from one block to the next;
+     * null for the null codec.
+     */
+    std::unique_ptr<BlockCompressor> compressor_;
+
+    /**
+     * Compresses and writes filled blocks in tasks on executor_ when
+     * parallel compression is enabled; null otherwise.
+     */
+    class BlockPipeline;
+    std::unique_ptr<BlockPipeline> pipeline_;
+    ExecutorPtr executor_;
+    // As last given to setCompressionThreads(), for the codecs rolled on
+    // to.
+    size_t compressionThreads_{};
+    size_t maxPendingBlocks_{};
+
+    // Samples the blocks and picks the codec of the files rolled on to;
+    // null if the codec stays.
+    std::shared_ptr<CodecSelector> codecSelector_;
+
+    /**
+     * Computes the statistics of each block when they are enabled, in
+     * which case they are gathered in blockStatistics_ and written to
+     * statisticsStream_ on close.
+     */
+    std::unique_ptr<BlockStatisticsCollector> statisticsCollector_;
+    std::unique_ptr<OutputStream> statisticsStream_;
+    std::vector<BlockStatistics> blockStatistics_;
+    // True if the statistics, or the index, are written next to the data
+    // file, and so go on next to the files the writer rolls on to.
+    bool statisticsNamed_{};
+    bool indexNamed_{};
+
+    /**
+     * The index of the blocks written, kept when indexStream_ is set and
+     * written to it on close.
+     */
+    std::unique_ptr<OutputStream> indexStream_;
+    DataFileIndex blockIndex_;
+    // True if blockIndex_ keeps the checksums of the blocks.
+    bool blockChecksums_{};
+    // The offset of the first block.
+    int64_t dataStart_{};
+
+    std::unique_ptr<DataFileCounters> counters_;
+    bool timing_{};
+    // The compressed bytes counted before the current file.
+    int64_t rolledBytes_{};
+
+    std::shared_ptr<GroupCommitter> committer_;
+
+    SyncPolicy syncPolicy_;
+    // The uncompressed size at which blocks end.
+    size_t syncThreshold_;
+    // When the first object of the current block was written.
+    std::chrono::steady_clock::time_point blockOpened_;
+
+    // Checks the objects of batches given to appendEncodedBatch(); made
+    // on first use.
+    std::unique_ptr<BinaryValidator> batchValidator_;
+    // Where each object of the batch being appended ends.
+    std::vector<size_t> batchEnds_;
+
+    void updateSyncThreshold();
+
     static std::unique_ptr<OutputStream> makeStream(const char *filename);
     static DataFileSync makeSync();
+    friend class DataFileAppender;
 
     void writeHeader();
     void setMetadata(const std::string &key, const std::string &value);
+    void openBlock();
+    size_t blockBytes() const;
+    bool canWriteDirect() const;
+    void rollTo(std::unique_ptr<OutputStream> outputStream, const std::string &filename);
+    void changeCodec(const CodecSetting &setting);
 
     /**
      * Generates a sync marker in the file.
@@ -89,7 +315,7 @@ class AVRO_DECL DataFileWriterBase : boost::noncopyable {
     /**
      * Shared constructor portion since we aren't using C++11
      */
-    void init(const ValidSchema &schema, size_t syncInterval, const Codec &codec);
+    void init(const ValidSchema &schema, size_t syncInterval);
 
 public:
     /**
@@ -98,205 +324,1419 @@ public:
     Encoder &encoder() const { return *encoderPtr_; }
 
     /**
-     * Returns true if the buffer has sufficient data for a sync to be
-     * inserted.
+     * Ends the current block if it has reached a limit of the sync
+     * policy, before an object is written.
      */
     void syncIfNeeded();
 
+    /**
+     * As syncIfNeeded(), but also ends the current block, if it holds
+     * any object, when an object of \p next bytes would take it past
+     * the size at which blocks end, so that blocks do not overshoot it. The size
+     * may be that from a GenericSizeEstimator, or any other estimate.
+     */
+    void syncIfNeeded(size_t next);
+
+    /**
+     * Ends the current block if its first object has waited longer than
+     * the sync policy's maxLatency. Writers that may go quiet call this
+     * periodically, from the thread that writes, to bound the latency.
+     */
+    void syncIfStale();
+
+    /**
+     * Replaces the limits at which blocks end, for the blocks to come.
+     */
+    void setSyncPolicy(const SyncPolicy &policy);
+
     /**
      * Returns the byte offset (within the current file) of the start of the current block being written.
+     * If blocks are being compressed in the background, this waits until they are written.
      */
     uint64_t getCurrentBlockStart() const;
 
     /**
      * Increments the object count.
      */
-    void incr() {
-        ++objectCount_;
-    }
+    void incr() {
+        ++objectCount_;
+        if (timing_) {
+            encoded();
+        }
+    }
+
+    /**
+     * Adds \p n to the object count, after a batch of objects.
+     */
+    void incr(int64_t n) {
+        objectCount_ += n;
+        if (timing_) {
+            encoded();
+        }
+    }
+
+    /**
+     * Adds the time since the last syncIfNeeded() to the encoding time.
+     */
+    void encoded();
+
+    /**
+     * Returns how many of \p n objects to come can be written, right
+     * after syncIfNeeded(), before the block should be checked again:
+     * as many as the average size of the objects written so far says
+     * fit under the policy's limits, at least one and at most n.
+     */
+    size_t batchRoom(size_t n) const;
+
+    /**
+     * Appends \p len bytes holding the binary encoding of \p n objects
+     * to the current block, as from a DirectBinaryEncoder.
+     */
+    void writeEncoded(const uint8_t *data, size_t len, int64_t n);
+
+    /**
+     * Ends the current block, if it holds any object, and writes \p len
+     * bytes holding the binary encoding of \p n objects as a block of
+     * their own, compressed like any other.
+     */
+    void writeEncodedBlock(const uint8_t *data, size_t len, int64_t n);
+
+    /**
+     * Appends \p count objects whose binary encodings are concatenated
+     * in the \p len bytes at \p data, copying them as they are. With
+     * \p validate, the objects are first checked against the schema,
+     * nothing is appended unless there are exactly \p count of them,
+     * and blocks end between objects as the sync policy has it.
+     * Otherwise the bytes are trusted, and go into the current block
+     * whole, which may then run past the sync interval by up to \p len.
+     */
+    void appendEncodedBatch(const uint8_t *data, size_t len, int64_t count,
+                            bool validate = true);
+
+    /**
+     * Constructs a data file writer with the given sync interval and name.
+     */
+    DataFileWriterBase(const char *filename, const ValidSchema &schema,
+                       size_t syncInterval, Codec codec = NULL_CODEC);
+    DataFileWriterBase(std::unique_ptr<OutputStream> outputStream,
+                       const ValidSchema &schema, size_t syncInterval, Codec codec);
+
+    /**
+     * Constructs a data file writer with the given stream options:
+     * options.chunkSize, if not zero, is the initial size of the block
+     * buffer and, for the file form, the size of the file buffer.
+     */
+    DataFileWriterBase(const char *filename, const ValidSchema &schema,
+                       size_t syncInterval, Codec codec, const StreamOptions &options);
+    DataFileWriterBase(std::unique_ptr<OutputStream> outputStream,
+                       const ValidSchema &schema, size_t syncInterval, Codec codec,
+                       const StreamOptions &options);
+
+    /**
+     * Constructs a data file writer whose blocks are compressed with the
+     * given codec, such as one from findCodec().
+     */
+    DataFileWriterBase(const char *filename, const ValidSchema &schema,
+                       size_t syncInterval, const BlockCodecPtr &codec,
+                       const StreamOptions &options = StreamOptions());
+    DataFileWriterBase(std::unique_ptr<OutputStream> outputStream,
+                       const ValidSchema &schema, size_t syncInterval,
+                       const BlockCodecPtr &codec,
+                       const StreamOptions &options = StreamOptions());
+
+    ~DataFileWriterBase();
+    /**
+     * Closes the current file. Once closed this datafile object cannot be
+     * used for writing any more.
+     */
+    void close();
+
+    /**
+     * Returns the schema for this data file.
+     */
+    const ValidSchema &schema() const { return schema_; }
+
+    /**
+     * Flushes any unwritten data into the file.
+     */
+    void flush();
+
+    /**
+     * Ends the current block and the current file, as close() does, and
+     * goes on writing to a new data file \p filename, with a sync marker
+     * of its own. Everything else is kept: the encoder, the block buffers
+     * and the compressor, the compression threads, the sync policy and
+     * the header, which is only encoded once. Statistics and indexes
+     * written next to the data file go on next to the new one; those
+     * given a stream of their own are written and stop.
+     */
+    void roll(const char *filename);
+
+    /**
+     * As above, for a new data file written to \p outputStream; no
+     * statistics or index are kept for it.
+     */
+    void roll(std::unique_ptr<OutputStream> outputStream);
+
+    /**
+     * Makes flush(), and so close(), return only once the file is durable
+     * on its device, syncing it through \p committer together with the
+     * other files committed at about the same time. A null committer
+     * leaves durability to the system again.
+     */
+    void setGroupCommitter(std::shared_ptr<GroupCommitter> committer);
+
+    /**
+     * Returns about how many bytes the current file has: those of its
+     * header and of the blocks written so far, as compressed. With
+     * compression threads, blocks count once they are written.
+     */
+    int64_t fileBytes() const;
+
+    /**
+     * Hands filled blocks over to up to \p threads tasks at once on the
+     * writer's executor to be compressed while the caller keeps encoding
+     * the next block. The compressed blocks are written to the output
+     * stream by those tasks, in the order in which they were filled. At
+     * most \p maxPendingBlocks blocks are held in memory; once that many
+     * are waiting to be written, the next sync blocks the caller, who
+     * compresses the blocks no task has started on meanwhile.
+     *
+     * Passing zero threads waits for the pending blocks and returns to
+     * compressing on the caller's thread. The null codec is always
+     * written on the caller's thread since there is nothing to compress.
+     */
+    void setCompressionThreads(size_t threads, size_t maxPendingBlocks = 0);
+
+    /**
+     * Runs the compression tasks of the next setCompressionThreads() on
+     * \p executor; defaultExecutor() if null, as it is to begin with.
+     */
+    void setExecutor(ExecutorPtr executor) { executor_ = std::move(executor); }
+
+    /**
+     * Sets the compression level for the blocks filled from now on.
+     * Only the deflate (0 to 9, default 6) and zstandard (default 3)
+     * codecs have levels; for any other codec this throws.
+     */
+    void setCompressionLevel(int level);
+
+    /**
+     * Offers the blocks filled from now on to \p selector and, on every
+     * roll(), writes the new file with the codec and level it selects
+     * from them. The header of a data file names a single codec, so the
+     * current file keeps its own. Compression threads carry over to the
+     * new codec. A null selector keeps the codec from then on.
+     */
+    void setCodecSelector(std::shared_ptr<CodecSelector> selector) { codecSelector_ = std::move(selector); }
+
+    /**
+     * Returns the codec of the current file.
+     */
+    const BlockCodecPtr &currentCodec() const { return codec_; }
+
+    /**
+     * Returns the compression level of the blocks being filled.
+     */
+    int compressionLevel() const { return compressionLevel_; }
+
+    /**
+     * Keeps the minimum and maximum values of the given top-level fields
+     * in every block written from now on, and writes them to \p sidecar
+     * when the file is closed. See BlockStatisticsCollector for the
+     * fields that can be tracked.
+     */
+    void setBlockStatistics(const std::vector<std::string> &fields,
+                            std::unique_ptr<OutputStream> sidecar);
+
+    /**
+     * As above, with the statistics written next to the data file, in a
+     * file named after it with a ".stats" suffix.
+     */
+    void setBlockStatistics(const std::vector<std::string> &fields);
+
+    /**
+     * Keeps an index of the offsets of the blocks and of the objects in
+     * them, and writes it to \p sidecar when the file is closed. This must
+     * be called before the first block is written.
+     */
+    void setBlockIndex(std::unique_ptr<OutputStream> sidecar);
+
+    /**
+     * As above, with the index written next to the data file, in a file
+     * named after it with a ".idx" suffix.
+     */
+    void setBlockIndex();
+
+    /**
+     * Keeps the xxHash64() of every block, as stored, in the block index,
+     * so that readers given the index check blocks end to end whatever
+     * the codec; see DataFileReaderBase::setBlockVerification(). The
+     * block index must have been enabled, and no block written yet.
+     */
+    void setBlockChecksums();
+
+    /**
+     * Encodes the objects of each block straight into the output stream
+     * rather than into the block buffer, which is then copied there.
+     * Room for the object count and size of a block is left in front of
+     * its objects, as varints padded to five bytes, which readers take
+     * like any other, and they are filled in with OutputStream::rewrite()
+     * when the block ends. This needs the null codec and a stream that
+     * can rewrite, such as a file or a mapped file, and rules out block
+     * statistics and checksums; it throws otherwise. Files rolled on to
+     * with another codec or a stream that cannot rewrite are written
+     * through the buffer.
+     */
+    void setDirectBlocks();
+
+    /**
+     * Turns the timing of encoding, compression and output on or off.
+     */
+    void setTiming(bool enabled);
+
+    /**
+     * Returns what the writer has done so far, also after close().
+     * Blocks still being compressed in the background are counted once
+     * they are written.
+     */
+    DataFileStats stats() const;
+};
+
+/**
+ *  An Avro datafile that can store objects of type T.
+ */
+template<typename T>
+class DataFileWriter : boost::noncopyable {
+    std::unique_ptr<DataFileWriterBase> base_;
+    std::unique_ptr<DirectBinaryEncoder> direct_;
+
+    void writeBatch(const T *begin, const T *end, std::false_type) {
+        while (begin != end) {
+            base_->syncIfNeeded();
+            size_t n = base_->batchRoom(static_cast<size_t>(end - begin));
+            Encoder &e = base_->encoder();
+            for (const T *stop = begin + n; begin != stop; ++begin) {
+                avro::encode(e, *begin);
+            }
+            base_->incr(static_cast<int64_t>(n));
+        }
+    }
+
+    void writeBatch(const T *begin, const T *end, std::true_type) {
+        if (!direct_) {
+            direct_.reset(new DirectBinaryEncoder());
+        }
+        while (begin != end) {
+            base_->syncIfNeeded();
+            size_t n = base_->batchRoom(static_cast<size_t>(end - begin));
+            direct_->clear();
+            for (const T *stop = begin + n; begin != stop; ++begin) {
+                directEncode(*direct_, *begin);
+            }
+            base_->writeEncoded(direct_->data(), direct_->size(), static_cast<int64_t>(n));
+        }
+    }
+
+public:
+    /**
+     * Constructs a new data file.
+     */
+    DataFileWriter(const char *filename, const ValidSchema &schema,
+                   size_t syncInterval = 16 * 1024, Codec codec = NULL_CODEC) : base_(new DataFileWriterBase(filename, schema, syncInterval, codec)) {}
+
+    DataFileWriter(std::unique_ptr<OutputStream> outputStream, const ValidSchema &schema,
+                   size_t syncInterval = 16 * 1024, Codec codec = NULL_CODEC) : base_(new DataFileWriterBase(std::move(outputStream), schema, syncInterval, codec)) {}
+
+    /**
+     * Constructs a new data file, with the given stream options.
+     */
+    DataFileWriter(const char *filename, const ValidSchema &schema,
+                   size_t syncInterval, Codec codec, const StreamOptions &options) : base_(new DataFileWriterBase(filename, schema, syncInterval, codec, options)) {}
+
+    DataFileWriter(std::unique_ptr<OutputStream> outputStream, const ValidSchema &schema,
+                   size_t syncInterval, Codec codec, const StreamOptions &options) : base_(new DataFileWriterBase(std::move(outputStream), schema, syncInterval, codec, options)) {}
+
+    /**
+     * Constructs a new data file whose blocks are compressed with the
+     * given codec.
+     */
+    DataFileWriter(const char *filename, const ValidSchema &schema,
+                   size_t syncInterval, const BlockCodecPtr &codec,
+                   const StreamOptions &options = StreamOptions()) : base_(new DataFileWriterBase(filename, schema, syncInterval, codec, options)) {}
+
+    DataFileWriter(std::unique_ptr<OutputStream> outputStream, const ValidSchema &schema,
+                   size_t syncInterval, const BlockCodecPtr &codec,
+                   const StreamOptions &options = StreamOptions()) : base_(new DataFileWriterBase(std::move(outputStream), schema, syncInterval, codec, options)) {}
+
+    /**
+     * Writes the given piece of data into the file.
+     */
+    void write(const T &datum) {
+        base_->syncIfNeeded();
+        avro::encode(base_->encoder(), datum);
+        base_->incr();
+    }
+
+    /**
+     * Writes the given piece of data into the file, given that it
+     * encodes to about \p size bytes, ending the current block first
+     * if the datum would take it past the size at which blocks end.
+     */
+    void write(const T &datum, size_t size) {
+        base_->syncIfNeeded(size);
+        avro::encode(base_->encoder(), datum);
+        base_->incr();
+    }
+
+    /**
+     * Writes the objects in [begin, end), in order. Block limits are
+     * checked once per run of objects estimated to fit in the current
+     * block rather than once per object, and types with
+     * direct_codec_traits, as avrogencpp generates with --direct-codec,
+     * are encoded a run at a time without virtual calls.
+     */
+    void writeBatch(const T *begin, const T *end) {
+        writeBatch(begin, end, has_direct_codec<T>());
+    }
+
+    /**
+     * See DataFileWriterBase::setTiming().
+     */
+    void setTiming(bool enabled) { base_->setTiming(enabled); }
+
+    /**
+     * See DataFileWriterBase::stats().
+     */
+    DataFileStats stats() const { return base_->stats(); }
+
+    /**
+     * See DataFileWriterBase::setSyncPolicy().
+     */
+    void setSyncPolicy(const SyncPolicy &policy) { base_->setSyncPolicy(policy); }
+
+    /**
+     * See DataFileWriterBase::syncIfStale().
+     */
+    void syncIfStale() { base_->syncIfStale(); }
+
+    /**
+     * See DataFileWriterBase::appendEncodedBatch().
+     */
+    void appendEncodedBatch(const uint8_t *data, size_t len, int64_t count,
+                            bool validate = true) {
+        base_->appendEncodedBatch(data, len, count, validate);
+    }
+
+    /**
+     *  Returns the byte offset (within the current file) of the start of the current block being written.
+     */
+    uint64_t getCurrentBlockStart() { return base_->getCurrentBlockStart(); }
+
+    /**
+     * Closes the current file. Once closed this datafile object cannot be
+     * used for writing any more.
+     */
+    void close() { base_->close(); }
+
+    /**
+     * Returns the schema for this data file.
+     */
+    const ValidSchema &schema() const { return base_->schema(); }
+
+    /**
+     * Flushes any unwritten data into the file.
+     */
+    void flush() { base_->flush(); }
+
+    /**
+     * Goes on writing to another file. See DataFileWriterBase::roll().
+     */
+    void roll(const char *filename) { base_->roll(filename); }
+
+    void roll(std::unique_ptr<OutputStream> outputStream) { base_->roll(std::move(outputStream)); }
+
+    /**
+     * See DataFileWriterBase::fileBytes().
+     */
+    int64_t fileBytes() const { return base_->fileBytes(); }
+
+    /**
+     * Makes flush() wait until the data is durable.
+     * See DataFileWriterBase::setGroupCommitter().
+     */
+    void setGroupCommitter(std::shared_ptr<GroupCommitter> committer) {
+        base_->setGroupCommitter(std::move(committer));
+    }
+
+    /**
+     * Compresses blocks on the given number of worker threads.
+     * See DataFileWriterBase::setCompressionThreads().
+     */
+    void setCompressionThreads(size_t threads, size_t maxPendingBlocks = 0) {
+        base_->setCompressionThreads(threads, maxPendingBlocks);
+    }
+
+    /**
+     * Sets the executor of the compression tasks.
+     * See DataFileWriterBase::setExecutor().
+     */
+    void setExecutor(ExecutorPtr executor) { base_->setExecutor(std::move(executor)); }
+
+    /**
+     * Sets the compression level for the blocks filled from now on.
+     * See DataFileWriterBase::setCompressionLevel().
+     */
+    void setCompressionLevel(int level) { base_->setCompressionLevel(level); }
+
+    /**
+     * Picks the codec of every file rolled on to from samples of the
+     * blocks. See DataFileWriterBase::setCodecSelector().
+     */
+    void setCodecSelector(std::shared_ptr<CodecSelector> selector) {
+        base_->setCodecSelector(std::move(selector));
+    }
+
+    /**
+     * Returns the codec of the current file.
+     */
+    const BlockCodecPtr &currentCodec() const { return base_->currentCodec(); }
+
+    /**
+     * Keeps per-block statistics of the given fields.
+     * See DataFileWriterBase::setBlockStatistics().
+     */
+    void setBlockStatistics(const std::vector<std::string> &fields,
+                            std::unique_ptr<OutputStream> sidecar) {
+        base_->setBlockStatistics(fields, std::move(sidecar));
+    }
+
+    void setBlockStatistics(const std::vector<std::string> &fields) {
+        base_->setBlockStatistics(fields);
+    }
+
+    /**
+     * Keeps an index of the blocks.
+     * See DataFileWriterBase::setBlockIndex().
+     */
+    void setBlockIndex(std::unique_ptr<OutputStream> sidecar) { base_->setBlockIndex(std::move(sidecar)); }
+
+    void setBlockIndex() { base_->setBlockIndex(); }
+
+    /**
+     * Keeps the checksums of the blocks in the block index.
+     * See DataFileWriterBase::setBlockChecksums().
+     */
+    void setBlockChecksums() { base_->setBlockChecksums(); }
+
+    /**
+     * Encodes the objects straight into the output stream.
+     * See DataFileWriterBase::setDirectBlocks().
+     */
+    void setDirectBlocks() { base_->setDirectBlocks(); }
+};
+
+/**
+ * The schemas of data files, compiled once for each distinct schema JSON
+ * found in their headers. Readers of files that share a cache share the
+ * compiled schema, and with it the fingerprints the resolving decoder's
+ * program cache is keyed by, so opening one of many files of a few
+ * schemas neither parses JSON nor hashes a schema. It may be used from
+ * several threads.
+ */
+class AVRO_DECL DataFileSchemaCache : boost::noncopyable {
+    mutable std::mutex mutex_;
+    std::map<std::string, ValidSchema> schemas_;
+
+public:
+    /**
+     * Returns the schema of the JSON \p json, compiling it if it was not
+     * seen before.
+     */
+    ValidSchema schema(const std::vector<uint8_t> &json);
+
+    /**
+     * Returns the number of distinct schemas compiled.
+     */
+    size_t size() const;
+};
+
+/**
+ * Decompressed blocks of data files, kept for readers that come back to
+ * them, such as those seeking about for point lookups. Blocks are known
+ * by the sync marker of their file, which is random for every file
+ * written, and their offset in it, so readers of the same file share
+ * them whatever they opened it as. The least recently used blocks are
+ * dropped to keep the total within a budget. It may be used from several
+ * threads, and is meant to be shared by all the readers of a process.
+ */
+class AVRO_DECL DataFileBlockCache : boost::noncopyable {
+public:
+    typedef std::shared_ptr<const std::vector<uint8_t>> Block;
+
+private:
+    typedef std::pair<DataFileSync, int64_t> Key;
+    typedef std::list<std::pair<Key, Block>> Entries;
+
+    const size_t capacity_;
+    mutable std::mutex mutex_;
+    // Most recently used first.
+    Entries entries_;
+    std::map<Key, Entries::iterator> index_;
+    size_t size_;
+    int64_t hits_;
+    int64_t misses_;
+
+public:
+    /**
+     * Constructs a cache of at most \p capacity bytes of blocks.
+     */
+    explicit DataFileBlockCache(size_t capacity);
+
+    /**
+     * Returns the block at \p offset of the file with the sync marker
+     * \p sync, or null if it is not in the cache.
+     */
+    Block find(const DataFileSync &sync, int64_t offset);
+
+    /**
+     * Adds a block, dropping the least recently used ones to make room.
+     * Blocks larger than the whole budget are not kept.
+     */
+    void insert(const DataFileSync &sync, int64_t offset, Block block);
+
+    /**
+     * Drops every block.
+     */
+    void clear();
+
+    size_t capacity() const { return capacity_; }
+
+    /**
+     * Returns the bytes of the blocks held.
+     */
+    size_t size() const;
+
+    /**
+     * Returns the number of find() calls that found a block.
+     */
+    int64_t hits() const;
+
+    /**
+     * Returns the number of find() calls that did not.
+     */
+    int64_t misses() const;
+};
+
+/**
+ * A data file opened once, and its header read once, for readers on many
+ * threads, such as those serving random reads at the block offsets of a
+ * DataFileIndex. Readers made from it read the one descriptor through a
+ * SharedFile, each at a position of its own, and have buffers, decoders
+ * and decompressors of their own, but neither open the file nor read its
+ * header. It may be used from several threads. Not available on Windows.
+ */
+class AVRO_DECL SharedDataFile : boost::noncopyable {
+public:
+    typedef std::map<std::string, std::vector<uint8_t>> Metadata;
+
+private:
+    const std::string filename_;
+    const SharedFilePtr file_;
+    Metadata metadata_;
+    ValidSchema dataSchema_;
+    std::string codecName_;
+    DataFileSync sync_{};
+    // Where the first block starts, after the header.
+    int64_t dataStart_;
+
+public:
+    /**
+     * Opens the file and reads its header, taking its schema from
+     * \p schemas if given; see DataFileSchemaCache.
+     */
+    explicit SharedDataFile(const char *filename, DataFileSchemaCache *schemas = nullptr);
+
+    const std::string &filename() const { return filename_; }
+
+    const SharedFilePtr &file() const { return file_; }
+
+    const Metadata &metadata() const { return metadata_; }
+
+    const ValidSchema &dataSchema() const { return dataSchema_; }
+
+    const std::string &codecName() const { return codecName_; }
+
+    const DataFileSync &syncMarker() const { return sync_; }
+
+    /**
+     * Returns the offset of the first block.
+     */
+    int64_t dataStart() const { return dataStart_; }
+};
+
+/**
+ * The type independent portion of reader.
+ */
+class AVRO_DECL DataFileReaderBase : boost::noncopyable {
+    std::string filename_;
+    std::unique_ptr<InputStream> stream_;
+    const DecoderPtr decoder_;
+    // The whole file, when it is read from memory; null otherwise.
+    const uint8_t *memory_;
+    size_t memorySize_;
+    int64_t objectCount_;
+    bool eof_;
+    BlockCodecPtr codec_;
+    int64_t blockStart_{};
+    int64_t blockEnd_{};
+
+    ValidSchema readerSchema_;
+    ValidSchema dataSchema_;
+    // True if init() was given a reader schema, which a file reopened
+    // with another schema is resolved against.
+    bool hasReaderSchema_{};
+    DecoderPtr dataDecoder_;
+    std::unique_ptr<InputStream> dataStream_;
+    typedef std::map<std::string, std::vector<uint8_t>> Metadata;
+
+    Metadata metadata_;
+    DataFileSync sync_{};
+
+    // for compressed buffer
+    std::vector<char> compressed_;
+
+    /**
+     * Decompresses whole blocks into decompressed_ for all codecs but
+     * null, keeping codec state and the buffer alive across blocks.
+     */
+    std::unique_ptr<BlockDecompressor> decompressor_;
+    std::vector<uint8_t> decompressed_;
+
+    /**
+     * Reads and decompresses blocks ahead of the consumer, in tasks on
+     * executor_, when parallel decompression is enabled; null otherwise.
+     */
+    class BlockPrefetcher;
+    std::unique_ptr<BlockPrefetcher> prefetcher_;
+    ExecutorPtr executor_;
+    // As last given to setDecompressionThreads().
+    size_t decompressionThreads_{};
+    size_t readAhead_{};
+    // True if the current block was handed over by prefetcher_, in
+    // which case its sync marker has already been read.
+    bool prefetched_;
+
+    /**
+     * The statistics of the blocks, ordered by offset, and the filter
+     * that decides from them which blocks to skip.
+     */
+    std::vector<BlockStatistics> blockStatistics_;
+    BlockFilter blockFilter_;
+
+    /**
+     * Decides which records of the blocks read are decoded; null to
+     * decode them all. While it is set, blocks are read whole into
+     * memory, so that a record can be scanned by filterDecoder_ and then
+     * decoded again from its start.
+     */
+    std::unique_ptr<RecordFilter> recordFilter_;
+    DecoderPtr filterDecoder_;
+    // True if the data stream is at a record the filter accepted, which
+    // is yet to be decoded.
+    bool accepted_{};
+    // The position in the data stream of the record after the one last
+    // scanned.
+    size_t nextRecord_{};
+    // The number of objects left in the current block when the data
+    // decoder was last started on it.
+    int64_t blockObjectCount_{};
+    // The rest of the block being read when the filter was set, or when
+    // objects were first checked.
+    std::vector<uint8_t> held_;
+    // True once checkNext() has been called, for blocks to be read whole.
+    bool holdBlocks_{};
+
+    /**
+     * Reads the rest of the current block into held_ if it is being read
+     * as it is decoded.
+     */
+    void holdBlock();
+
+    DataFileIndex index_;
+    bool hasIndex_{};
+
+    std::shared_ptr<DataFileBlockCache> blockCache_;
+    // The block being decoded when it came from, or went into, the cache.
+    DataFileBlockCache::Block cachedBlock_;
+
+    /**
+     * Steps over the objects skip() leaves out of a block, made when it
+     * is first needed.
+     */
+    std::unique_ptr<BinaryValidator> skipper_;
+    // The objects skip() has yet to skip; blocks with no more than this
+    // are passed over unread.
+    int64_t skipObjects_{};
+
+    std::unique_ptr<DataFileCounters> counters_;
+    bool timing_{};
+
+    BlockVerification verification_{VERIFY_BLOCKS};
+    /**
+     * Whether the block at checkStart_ matches its checksum, when it is
+     * checked on a worker thread. Last, so that it is waited for before
+     * the buffers the check reads go away.
+     */
+    std::future<bool> check_;
+    int64_t checkStart_{};
+
+    /**
+     * Returns the index entry of the block starting at \p offset if its
+     * checksum is to be checked, and null otherwise.
+     */
+    const DataFileIndexEntry *checkedBlock(int64_t offset) const;
+
+    /**
+     * Checks, or starts checking, the data of the current block as stored
+     * against the checksum in \p e.
+     */
+    void checkBlock(const uint8_t *data, size_t len, const DataFileIndexEntry &e);
+
+    /**
+     * Waits for the check of the last block, if any, and throws if the
+     * block does not match.
+     */
+    void finishCheck();
+
+    /**
+     * Returns true if the block starting at \p offset is rejected by the
+     * block filter. Blocks without statistics are never rejected.
+     */
+    bool skipBlock(int64_t offset) const;
+
+    /**
+     * Skips the records the record filter rejects, up to the end of the
+     * block, and returns true if one it accepts is next.
+     */
+    bool findAccepted();
+
+    /**
+     * Reads the header of the file, creating a decompressor unless the
+     * codec is the one already in use. Returns true if the schema is not
+     * byte for byte \p previous, and so was compiled anew.
+     */
+    bool readHeader(DataFileSchemaCache *schemas = nullptr,
+                    const std::vector<uint8_t> *previous = nullptr);
+
+    /**
+     * Reads the blocks with the codec named \p codecName, creating a
+     * decompressor unless it is the one already in use.
+     */
+    void useCodec(const std::string &codecName);
+
+    /**
+     * Hands back what the decoders read ahead of the current file, before
+     * its stream is replaced.
+     */
+    void release();
+
+    /**
+     * Starts reading the file the stream has been replaced with.
+     */
+    void restart();
+
+    void readDataBlock();
+    void doSeek(int64_t position);
+
+    /**
+     * Skips \p n objects, fewer than are left, of the current block.
+     */
+    void skipInBlock(int64_t n);
+
+public:
+    /**
+     * Returns the current decoder for this reader.
+     */
+    Decoder &decoder() { return *dataDecoder_; }
+
+    /**
+     * Returns true if and only if there is more to read.
+     */
+    bool hasMore();
+
+    /**
+     * Decrements the number of objects yet to read. When timing, starts
+     * the clock for decoding the object, which decoded() stops.
+     */
+    void decr() {
+        --objectCount_;
+        accepted_ = false;
+        if (timing_) {
+            startDecode();
+        }
+    }
+
+    /**
+     * Takes \p n objects, at most objectsLeftInBlock(), off the number yet
+     * to read, before decoding them as a batch.
+     */
+    void decr(int64_t n) {
+        objectCount_ -= n;
+        accepted_ = false;
+        if (timing_) {
+            startDecode();
+        }
+    }
+
+    void startDecode();
+
+    /**
+     * Adds the time since decr() to the decoding time.
+     */
+    void decoded() {
+        if (timing_) {
+            endDecode();
+        }
+    }
+
+    void endDecode();
+
+    /**
+     * Returns the number of objects yet to read in the current block,
+     * which is zero before hasMore() has opened one.
+     */
+    int64_t objectsLeftInBlock() const { return objectCount_; }
+
+    /**
+     * Returns true if there is more to read in the current block. Unlike
+     * hasMore(), this does not move on to the next block.
+     */
+    bool hasMoreInBlock() {
+        return objectCount_ != 0 && (!recordFilter_ || findAccepted());
+    }
+
+    /**
+     * Constructs the reader for the given file and the reader is
+     * expected to use the schema that is used with data.
+     * This function should be called exactly once after constructing
+     * the DataFileReaderBase object.
+     */
+    explicit DataFileReaderBase(const char *filename);
+
+    explicit DataFileReaderBase(std::unique_ptr<InputStream> inputStream);
+
+    /**
+     * Constructs the reader for the data file held in the \p len bytes
+     * at \p data, which must stay valid while the reader is used. Blocks
+     * are decoded and decompressed where they lie, without being copied.
+     */
+    DataFileReaderBase(const uint8_t *data, size_t len);
+
+    /**
+     * Constructs the reader for the given file, reading it through a
+     * buffer of options.chunkSize bytes unless it is zero.
+     */
+    DataFileReaderBase(const char *filename, const StreamOptions &options);
+
+    /**
+     * Constructs the reader for the given file, taking its schema from
+     * \p schemas.
+     */
+    DataFileReaderBase(const char *filename, DataFileSchemaCache &schemas);
+
+    /**
+     * Constructs a reader of \p file, which must outlive it, positioned
+     * at its first block. The header is taken from \p file rather than
+     * read again.
+     */
+    explicit DataFileReaderBase(const SharedDataFile &file);
+
+    /**
+     * Initializes the reader so that the reader and writer schemas
+     * are the same.
+     */
+    void init();
+
+    /**
+     * Initializes the reader to read objects according to the given
+     * schema. This gives an opportunity for the reader to see the schema
+     * in the data file before deciding the right schema to use for reading.
+     * This must be called exactly once after constructing the
+     * DataFileReaderBase object.
+     */
+    void init(const ValidSchema &readerSchema);
+
+    /**
+     * Moves on to the start of the data file \p filename, after init().
+     * The buffer of the file stream, the decoders and the decompressor
+     * are kept, as are the decompression threads and the block
+     * verification. The header is read and checked as usual; if its
+     * schema is byte for byte that of the last file, neither the schema
+     * nor the resolution to the reader's schema is compiled again, and
+     * the record filter is kept. Otherwise, objects are read in the new
+     * schema unless init() was given a reader schema, and the record
+     * filter is dropped. Block filters and the index, which are about
+     * one file, are always dropped; stats() go on counting. If this
+     * throws, the reader can only be reopened or destroyed.
+     */
+    void reopen(const char *filename);
+
+    /**
+     * As reopen(), for the data file in \p inputStream.
+     */
+    void reset(std::unique_ptr<InputStream> inputStream);
+
+    /**
+     * Returns the schema for this object.
+     */
+    const ValidSchema &readerSchema() { return readerSchema_; }
+
+    /**
+     * Returns the schema stored with the data file.
+     */
+    const ValidSchema &dataSchema() { return dataSchema_; }
+
+    /**
+     * Closes the reader. No further operation is possible on this reader.
+     */
+    void close();
+
+    /**
+     * Move to a specific, known synchronization point, for example one returned
+     * from tell() after sync().
+     */
+    void seek(int64_t position);
+
+    /**
+     * Move to the next synchronization point after a position. To process a
+     * range of file entries, call this with the starting position, then check
+     * pastSync() with the end point before each use of decoder().
+     */
+    void sync(int64_t position);
+
+    /**
+     * Return true if past the next synchronization point after a position.
+     */
+    bool pastSync(int64_t position);
+
+    /**
+     * Return the last synchronization point before our current position.
+     */
+    int64_t previousSync() const;
+
+    /**
+     * Reads up to \p readAhead blocks past the current one and
+     * decompresses them in up to \p threads tasks at once on the
+     * reader's executor, so that the decoder is handed already inflated
+     * blocks in file order. A block no task has started on by the time
+     * it is needed is decompressed by the caller. A \p readAhead of
+     * zero means twice the number of threads.
+     *
+     * The block being decoded when this is enabled is finished as
+     * before. Once enabled, it can only be changed, or disabled by
+     * passing zero threads, at the end of the file. The null codec is
+     * always read on the caller's thread since there is nothing to
+     * decompress.
+     */
+    void setDecompressionThreads(size_t threads, size_t readAhead = 0);
+
+    /**
+     * Runs the decompression tasks of the next setDecompressionThreads()
+     * on \p executor; defaultExecutor() if null, as it is to begin with.
+     */
+    void setExecutor(ExecutorPtr executor) { executor_ = std::move(executor); }
+
+    /**
+     * Skips, without decompressing them, the blocks for which \p filter
+     * returns false when given their statistics, such as those read by
+     * readBlockStatistics(). Blocks with no statistics are always read.
+     * The current block is dropped if it is rejected. An empty filter
+     * reads every block again.
+     */
+    void setBlockFilter(std::vector<BlockStatistics> stats, BlockFilter filter);
+
+    /**
+     * Decodes only the records for which \p predicate returns true when
+     * given the values of the named top-level fields, as a RecordFilter
+     * on the schema of the data file. Those fields are decoded as they
+     * are found in the data, the others of rejected records are skipped,
+     * and accepted records are then decoded from their start as usual.
+     * hasMore() and hasMoreInBlock() skip to the next accepted record.
+     * An empty predicate decodes every record again.
+     */
+    void setRecordFilter(const std::vector<std::string> &fields, RecordPredicate predicate);
+
+    /**
+     * Returns true if a record filter has been set.
+     */
+    bool hasRecordFilter() const { return recordFilter_ != nullptr; }
+
+    /**
+     * Sets the index, such as one from readDataFileIndex(), used by
+     * seekToBlockOf().
+     */
+    void setIndex(DataFileIndex index);
+
+    /**
+     * Moves to the block holding object number \p object, counted from
+     * zero, and returns the number of objects that precede it in the
+     * block. Returns -1, leaving the position alone, if the file has fewer
+     * objects. Throws if no index has been set.
+     */
+    int64_t seekToBlockOf(int64_t object);
+
+    /**
+     * Sets how much blocks read from now on are checked, VERIFY_BLOCKS to
+     * begin with. Checksums kept in the index are only checked if an
+     * index has been set, with setIndex(), and they are only there if the
+     * writer was told to keep them; see
+     * DataFileWriterBase::setBlockChecksums().
+     */
+    void setBlockVerification(BlockVerification verification);
+
+    /**
+     * Looks for compressed blocks in \p cache before reading and
+     * decompressing them, and adds those it decompresses. Blocks
+     * prefetched by decompression threads do not go through the cache,
+     * nor do those of the null codec, which have nothing to decompress.
+     * Blocks found in the cache are not checked again. A null cache
+     * stops using it.
+     */
+    void setBlockCache(std::shared_ptr<DataFileBlockCache> cache);
+
+    /**
+     * Skips the next \p n objects and returns the number skipped, which
+     * is fewer only at the end of the file. Blocks with no more objects
+     * than are left to skip are passed over without being decompressed,
+     * unless decompression threads have read them ahead, and objects of
+     * the block skip() stops in are stepped over by a BinaryValidator on
+     * the schema of the file instead of being decoded. With a record
+     * filter, only the objects it accepts are counted.
+     */
+    int64_t skip(int64_t n);
+
+    /**
+     * Checks the next object against the schema of the file without
+     * decoding it or throwing if it is malformed, and leaves the decoder
+     * at its start; hasMore() must have returned true. Once this has been
+     * called, blocks are read whole into memory, so that the object can
+     * be checked and then decoded. The offset of a fault is counted from
+     * the start of the object.
+     */
+    DecodeStatus checkNext();
+
+    /**
+     * Turns the timing of input, decompression and decoding on or off.
+     */
+    void setTiming(bool enabled);
+
+    /**
+     * Returns what the reader has done so far. Blocks read ahead by
+     * decompression threads are counted as they are read.
+     */
+    DataFileStats stats() const;
+
+    ~DataFileReaderBase();
+};
+
+/**
+ * Describes one block of a data file.
+ */
+struct DataFileBlock {
+    /// The number of objects in the block.
+    int64_t objectCount;
+    /// The size of the block's data, as stored, that is compressed.
+    int64_t byteSize;
+    /// The position of the block in the file; DataFileReaderBase::seek()
+    /// to it reads the block's objects.
+    int64_t offset;
+
+    DataFileBlock() : objectCount(0), byteSize(0), offset(0) {}
+};
+
+/**
+ * Walks the blocks of a data file without decoding or decompressing
+ * them. Blocks whose data is not read with readBlockRaw() are skipped
+ * over, so counting the objects of a file or finding the offsets to
+ * split it at costs little more than reading the block headers.
+ */
+class AVRO_DECL DataFileBlockReader : boost::noncopyable {
+    const std::string filename_;
+    const std::unique_ptr<InputStream> stream_;
+    const DecoderPtr decoder_;
+
+    typedef std::map<std::string, std::vector<uint8_t>> Metadata;
+
+    Metadata metadata_;
+    ValidSchema dataSchema_;
+    std::string codecName_;
+    DataFileSync sync_{};
+
+    DataFileBlock current_;
+    // True between next() and the sync marker that ends the block.
+    bool started_;
+    // True if the data of the current block is still to be read.
+    bool unread_;
+
+    void readHeader();
+
+public:
+    explicit DataFileBlockReader(const char *filename);
+
+    explicit DataFileBlockReader(std::unique_ptr<InputStream> inputStream);
+
+    /**
+     * Moves to the next block, skipping the data of the current one if
+     * it was not read, and describes it in \p block.
+     * \return false at the end of the file.
+     */
+    bool next(DataFileBlock &block);
+
+    /**
+     * Reads the data of the current block as stored in the file, that is
+     * without decompressing it.
+     */
+    void readBlockRaw(std::vector<uint8_t> &data);
+
+    /**
+     * Returns the schema stored with the data file.
+     */
+    const ValidSchema &dataSchema() const { return dataSchema_; }
+
     /**
-     * Constructs a data file writer with the given sync interval and name.
+     * Returns the codec the blocks are compressed with; throws if it is
+     * not one of the built-in codecs.
      */
-    DataFileWriterBase(const char *filename, const ValidSchema &schema,
-                       size_t syncInterval, Codec codec = NULL_CODEC);
-    DataFileWriterBase(std::unique_ptr<OutputStream> outputStream,
-                       const ValidSchema &schema, size_t syncInterval, Codec codec);
+    Codec codec() const;
 
-    ~DataFileWriterBase();
     /**
-     * Closes the current file. Once closed this datafile object cannot be
-     * used for writing any more.
+     * Returns the name of the codec the blocks are compressed with.
      */
-    void close();
+    const std::string &codecName() const { return codecName_; }
 
     /**
-     * Returns the schema for this data file.
+     * Returns the sync marker of the file.
      */
-    const ValidSchema &schema() const { return schema_; }
+    const DataFileSync &syncMarker() const { return sync_; }
 
     /**
-     * Flushes any unwritten data into the file.
+     * Returns the metadata in the header of the file.
      */
-    void flush();
+    const Metadata &metadata() const { return metadata_; }
 };
 
 /**
- *  An Avro datafile that can store objects of type T.
+ * Reads a data file from an AsyncInputStream without ever waiting for
+ * it. Reads are ranged requests of at least minReadSize bytes, so that
+ * small blocks are fetched together, and up to readDepth of them are
+ * kept outstanding ahead of the decoder: on high latency storage, the
+ * throughput is about readDepth * minReadSize bytes per round trip. Once
+ * a block header has arrived, its size tells how far the block reaches,
+ * and a block larger than minReadSize is asked for in one read.
+ *
+ * Blocks are handed over, in order, on whatever thread completes the
+ * read that finished them, and never on two threads at a time. The
+ * reader must be kept alive until the done handler has been called.
  */
-template<typename T>
-class DataFileWriter : boost::noncopyable {
-    std::unique_ptr<DataFileWriterBase> base_;
-
+class AVRO_DECL AsyncDataFileReaderBase : boost::noncopyable {
 public:
     /**
-     * Constructs a new data file.
+     * Called with a decoder positioned at the first of the \p objectCount
+     * objects of a block, all of which it must decode, in the reader
+     * schema, before returning.
      */
-    DataFileWriter(const char *filename, const ValidSchema &schema,
-                   size_t syncInterval = 16 * 1024, Codec codec = NULL_CODEC) : base_(new DataFileWriterBase(filename, schema, syncInterval, codec)) {}
+    typedef std::function<void(Decoder &decoder, int64_t objectCount)> BlockHandler;
 
-    DataFileWriter(std::unique_ptr<OutputStream> outputStream, const ValidSchema &schema,
-                   size_t syncInterval = 16 * 1024, Codec codec = NULL_CODEC) : base_(new DataFileWriterBase(std::move(outputStream), schema, syncInterval, codec)) {}
+    /**
+     * Called once when the reader stops, with the error if it failed or
+     * with nullptr at the end of the file.
+     */
+    typedef std::function<void(std::exception_ptr error)> DoneHandler;
+
+private:
+    typedef std::map<std::string, std::vector<uint8_t>> Metadata;
 
+    const AsyncInputStreamPtr stream_;
+    const size_t minReadSize_;
+    const size_t readDepth_;
+    bool hasReaderSchema_;
+    ValidSchema readerSchema_;
+    ValidSchema dataSchema_;
+    Metadata metadata_;
+    DataFileSync sync_{};
+    std::unique_ptr<BlockDecompressor> decompressor_;
+    std::vector<uint8_t> decompressed_;
+    DecoderPtr decoder_;
+    DecoderPtr dataDecoder_;
+
+    BlockHandler onBlock_;
+    DoneHandler onDone_;
+
+    // Owned by the thread handing blocks over. buffer_ holds the bytes
+    // from bufferOffset_, of which those before pos_ are used up, and
+    // reads have been started up to requestedEnd_.
+    std::vector<uint8_t> buffer_;
+    int64_t bufferOffset_;
+    int64_t pos_;
+    int64_t requestedEnd_;
+    int64_t startPosition_;
+    bool headerRead_;
+    bool eof_;
+    bool finished_;
+    std::exception_ptr error_;
+
+    struct Arrival {
+        size_t requested;
+        std::vector<uint8_t> data;
+        std::exception_ptr error;
+    };
+
+    std::mutex mutex_;
+    // Guarded by mutex_. Completed reads, by offset, as they may
+    // complete out of order.
+    bool running_;
+    size_t inflight_;
+    std::map<int64_t, Arrival> arrivals_;
+
+    void onRead(int64_t offset, size_t requested,
+                std::exception_ptr error, std::vector<uint8_t> data);
+    bool merge();
+    void run();
+    bool step();
+    bool readHeader();
+    bool readBlock();
+    void fetch(int64_t until);
+    void finish(std::exception_ptr error);
+
+public:
     /**
-     * Writes the given piece of data into the file.
+     * Constructs a reader of the data file in \p stream, with at most
+     * \p readDepth reads outstanding. Objects are decoded in the schema
+     * of the file unless setReaderSchema() is called before start().
      */
-    void write(const T &datum) {
-        base_->syncIfNeeded();
-        avro::encode(base_->encoder(), datum);
-        base_->incr();
+    explicit AsyncDataFileReaderBase(AsyncInputStreamPtr stream,
+                                     size_t minReadSize = 1024 * 1024,
+                                     size_t readDepth = 4);
+
+    /**
+     * Decodes objects in \p readerSchema, resolving them from the schema
+     * of the file.
+     */
+    void setReaderSchema(const ValidSchema &readerSchema) {
+        readerSchema_ = readerSchema;
+        hasReaderSchema_ = true;
     }
 
     /**
-     *  Returns the byte offset (within the current file) of the start of the current block being written.
+     * Reads the blocks from \p position on, like
+     * DataFileReaderBase::seek(): the position must be the offset of a
+     * block, as given by DataFileBlockReader, DataFileIndex or
+     * DataFileReaderBase::previousSync(). Only the header is read before
+     * it. Must be called before start().
      */
-    uint64_t getCurrentBlockStart() { return base_->getCurrentBlockStart(); }
+    void seek(int64_t position) { startPosition_ = position; }
 
     /**
-     * Closes the current file. Once closed this datafile object cannot be
-     * used for writing any more.
+     * Starts reading, and returns without waiting for any read.
      */
-    void close() { base_->close(); }
+    void start(BlockHandler onBlock, DoneHandler onDone);
 
     /**
-     * Returns the schema for this data file.
+     * Returns the schema stored with the data file; valid from the first
+     * block on.
      */
-    const ValidSchema &schema() const { return base_->schema(); }
+    const ValidSchema &dataSchema() const { return dataSchema_; }
 
     /**
-     * Flushes any unwritten data into the file.
+     * Returns the metadata in the header of the file; valid from the
+     * first block on.
      */
-    void flush() { base_->flush(); }
+    const Metadata &metadata() const { return metadata_; }
 };
 
 /**
- * The type independent portion of reader.
+ * Adds blocks to the end of a data file as they are, without decoding or
+ * recompressing them. Blocks copied from other files only get the sync
+ * marker of this file, so merging files with the same schema and codec
+ * costs about as much as copying them.
  */
-class AVRO_DECL DataFileReaderBase : boost::noncopyable {
+class AVRO_DECL DataFileAppender : boost::noncopyable {
     const std::string filename_;
-    const std::unique_ptr<InputStream> stream_;
-    const DecoderPtr decoder_;
-    int64_t objectCount_;
-    bool eof_;
-    Codec codec_;
-    int64_t blockStart_{};
-    int64_t blockEnd_{};
-
-    ValidSchema readerSchema_;
-    ValidSchema dataSchema_;
-    DecoderPtr dataDecoder_;
-    std::unique_ptr<InputStream> dataStream_;
-    typedef std::map<std::string, std::vector<uint8_t>> Metadata;
-
-    Metadata metadata_;
+    ValidSchema schema_;
+    std::string codecName_;
     DataFileSync sync_{};
-
-    // for compressed buffer
-    std::unique_ptr<boost::iostreams::filtering_istream> os_;
-    std::vector<char> compressed_;
-    std::string uncompressed;
-    void readHeader();
-
-    void readDataBlock();
-    void doSeek(int64_t position);
+    std::unique_ptr<OutputStream> stream_;
+    const EncoderPtr encoder_;
+    std::vector<uint8_t> buffer_;
 
 public:
     /**
-     * Returns the current decoder for this reader.
-     */
-    Decoder &decoder() { return *dataDecoder_; }
-
-    /**
-     * Returns true if and only if there is more to read.
+     * Opens an existing data file to add blocks to its end.
      */
-    bool hasMore();
+    explicit DataFileAppender(const char *filename);
 
     /**
-     * Decrements the number of objects yet to read.
+     * Creates a data file, with no blocks yet, for the given schema and
+     * codec. If the file exists, it is overwritten.
      */
-    void decr() { --objectCount_; }
+    DataFileAppender(const char *filename, const ValidSchema &schema,
+                     Codec codec = NULL_CODEC);
 
     /**
-     * Constructs the reader for the given file and the reader is
-     * expected to use the schema that is used with data.
-     * This function should be called exactly once after constructing
-     * the DataFileReaderBase object.
+     * Creates a data file for blocks compressed with the codec of the
+     * given name, which need not be registered.
      */
-    explicit DataFileReaderBase(const char *filename);
-
-    explicit DataFileReaderBase(std::unique_ptr<InputStream> inputStream);
+    DataFileAppender(const char *filename, const ValidSchema &schema,
+                     const std::string &codecName);
 
-    /**
-     * Initializes the reader so that the reader and writer schemas
-     * are the same.
-     */
-    void init();
+    ~DataFileAppender();
 
     /**
-     * Initializes the reader to read objects according to the given
-     * schema. This gives an opportunity for the reader to see the schema
-     * in the data file before deciding the right schema to use for reading.
-     * This must be called exactly once after constructing the
-     * DataFileReaderBase object.
+     * Returns the schema of the file.
      */
-    void init(const ValidSchema &readerSchema);
+    const ValidSchema &schema() const { return schema_; }
 
     /**
-     * Returns the schema for this object.
+     * Returns the codec of the file's blocks; throws if it is not one of
+     * the built-in codecs.
      */
-    const ValidSchema &readerSchema() { return readerSchema_; }
+    Codec codec() const;
 
     /**
-     * Returns the schema stored with the data file.
+     * Returns the name of the codec of the file's blocks.
      */
-    const ValidSchema &dataSchema() { return dataSchema_; }
+    const std::string &codecName() const { return codecName_; }
 
     /**
-     * Closes the reader. No further operation is possible on this reader.
+     * Adds a block of \p objectCount objects whose data, as compressed
+     * with the file's codec, is \p data.
      */
-    void close();
+    void appendBlock(int64_t objectCount, const uint8_t *data, size_t len);
 
     /**
-     * Move to a specific, known synchronization point, for example one returned
-     * from tell() after sync().
+     * Copies the remaining blocks of \p reader. The blocks must have the
+     * same codec as this file and a schema with the same Parsing
+     * Canonical Form and logical types (see ValidSchema::sameData()),
+     * else an Exception is thrown before anything is copied.
+     * \return the number of objects copied.
      */
-    void seek(int64_t position);
+    int64_t append(DataFileBlockReader &reader);
 
     /**
-     * Move to the next synchronization point after a position. To process a
-     * range of file entries, call this with the starting position, then check
-     * pastSync() with the end point before each use of decoder().
+     * Copies the blocks of the data file with the given name.
      */
-    void sync(int64_t position);
+    int64_t append(const char *filename);
 
     /**
-     * Return true if past the next synchronization point after a position.
+     * Flushes any unwritten data into the file.
      */
-    bool pastSync(int64_t position);
+    void flush();
 
     /**
-     * Return the last synchronization point before our current position.
+     * Closes the file. No further operation is possible.
      */
-    int64_t previousSync() const;
+    void close();
 };
 
 /**
@@ -331,6 +1771,55 @@ public:
         base_->init();
     }
 
+    /**
+     * Constructs the reader for the data file in the \p len bytes at
+     * \p data. See DataFileReaderBase::DataFileReaderBase().
+     */
+    DataFileReader(const uint8_t *data, size_t len, const ValidSchema &readerSchema) : base_(new DataFileReaderBase(data, len)) {
+        base_->init(readerSchema);
+    }
+
+    DataFileReader(const uint8_t *data, size_t len) : base_(new DataFileReaderBase(data, len)) {
+        base_->init();
+    }
+
+    /**
+     * Like the constructors above, reading the file with the given
+     * stream options.
+     */
+    DataFileReader(const char *filename, const ValidSchema &readerSchema,
+                   const StreamOptions &options) : base_(new DataFileReaderBase(filename, options)) {
+        base_->init(readerSchema);
+    }
+
+    DataFileReader(const char *filename, const StreamOptions &options) : base_(new DataFileReaderBase(filename, options)) {
+        base_->init();
+    }
+
+    /**
+     * Constructs the reader for the given file, taking its schema from
+     * \p schemas; see DataFileSchemaCache.
+     */
+    DataFileReader(const char *filename, const ValidSchema &readerSchema,
+                   DataFileSchemaCache &schemas) : base_(new DataFileReaderBase(filename, schemas)) {
+        base_->init(readerSchema);
+    }
+
+    DataFileReader(const char *filename, DataFileSchemaCache &schemas) : base_(new DataFileReaderBase(filename, schemas)) {
+        base_->init();
+    }
+
+    /**
+     * Constructs a reader of \p file, one per thread; see SharedDataFile.
+     */
+    DataFileReader(const SharedDataFile &file, const ValidSchema &readerSchema) : base_(new DataFileReaderBase(file)) {
+        base_->init(readerSchema);
+    }
+
+    explicit DataFileReader(const SharedDataFile &file) : base_(new DataFileReaderBase(file)) {
+        base_->init();
+    }
+
     /**
      * Constructs a reader using the reader base. This form of constructor
      * allows the user to examine the schema of a given file and then
@@ -367,11 +1856,104 @@ public:
         if (base_->hasMore()) {
             base_->decr();
             avro::decode(base_->decoder(), datum);
+            base_->decoded();
             return true;
         }
         return false;
     }
 
+    /**
+     * Reads up to \p max of the next entries into \p items, which is
+     * resized to their number, decoding into the entries it already holds
+     * so that their storage is reused. T must be default-constructible.
+     * Entries come from one block at a time, so a batch can be shorter
+     * than \p max with more to follow.
+     * \return the number of entries read, zero at the end of the file.
+     */
+    size_t readBatch(std::vector<T> &items, size_t max) {
+        if (max == 0 || !base_->hasMore()) {
+            items.clear();
+            return 0;
+        }
+        if (base_->hasRecordFilter()) {
+            // Rejected records lie between the accepted ones.
+            size_t n = 0;
+            do {
+                if (n == items.size()) {
+                    items.emplace_back();
+                }
+                base_->decr();
+                avro::decode(base_->decoder(), items[n++]);
+                base_->decoded();
+            } while (n < max && base_->hasMoreInBlock());
+            items.resize(n);
+            return n;
+        }
+        size_t n = std::min(static_cast<size_t>(base_->objectsLeftInBlock()), max);
+        items.resize(n);
+        base_->decr(static_cast<int64_t>(n));
+        Decoder &d = base_->decoder();
+        for (T &item : items) {
+            avro::decode(d, item);
+        }
+        base_->decoded();
+        return n;
+    }
+
+    /**
+     * Reads up to \p max of the next entries into \p batch like the
+     * readBatch() above, to be shared without copying. The entries of the
+     * batch are reused if no other batch shares them.
+     * \return the number of entries read, zero at the end of the file.
+     */
+    size_t readBatch(RecordBatch<T> &batch, size_t max) {
+        size_t n = 0;
+        batch.refill([this, max, &n](std::vector<T> &items) { n = readBatch(items, max); });
+        return n;
+    }
+
+    /**
+     * Reads the rest of the current block, or the whole of the next one,
+     * into \p items like readBatch().
+     * \return the number of entries read, zero at the end of the file.
+     */
+    size_t readBlock(std::vector<T> &items) {
+        return readBatch(items, std::numeric_limits<size_t>::max());
+    }
+
+    /**
+     * Reads the whole of the block at \p offset, such as one listed in a
+     * DataFileIndex, into \p items like readBlock().
+     * \return the number of entries read, zero at the end of the file.
+     */
+    size_t readBlockAt(int64_t offset, std::vector<T> &items) {
+        base_->seek(offset);
+        return readBlock(items);
+    }
+
+    /**
+     * Moves on to another data file, reusing what was set up for this
+     * one. See DataFileReaderBase::reopen().
+     */
+    void reopen(const char *filename) { base_->reopen(filename); }
+
+    /**
+     * See DataFileReaderBase::reset().
+     */
+    void reset(std::unique_ptr<InputStream> inputStream) {
+        base_->reset(std::move(inputStream));
+    }
+
+    /**
+     * See DataFileReaderBase::setTiming().
+     */
+    void setTiming(bool enabled) { base_->setTiming(enabled); }
+
+    /**
+     * See DataFileReaderBase::stats().
+     */
+    DataFileStats stats() const { return base_->stats(); }
+
     /**
      * Returns the schema for this object.
      */
@@ -409,6 +1991,158 @@ public:
      * Return the last synchronization point before our current position.
      */
     int64_t previousSync() { return base_->previousSync(); }
+
+    /**
+     * Decompresses blocks ahead of time on the given number of worker
+     * threads. See DataFileReaderBase::setDecompressionThreads().
+     */
+    void setDecompressionThreads(size_t threads, size_t readAhead = 0) {
+        base_->setDecompressionThreads(threads, readAhead);
+    }
+
+    /**
+     * Sets the executor of the decompression tasks.
+     * See DataFileReaderBase::setExecutor().
+     */
+    void setExecutor(ExecutorPtr executor) { base_->setExecutor(std::move(executor)); }
+
+    /**
+     * Skips the blocks rejected by a filter on their statistics.
+     * See DataFileReaderBase::setBlockFilter().
+     */
+    void setBlockFilter(std::vector<BlockStatistics> stats, BlockFilter filter) {
+        base_->setBlockFilter(std::move(stats), std::move(filter));
+    }
+
+    /**
+     * Decodes only the records accepted by a predicate on some of their
+     * top-level fields. See DataFileReaderBase::setRecordFilter().
+     */
+    void setRecordFilter(const std::vector<std::string> &fields, RecordPredicate predicate) {
+        base_->setRecordFilter(fields, std::move(predicate));
+    }
+
+    /**
+     * Sets the index used by seekToRecord(), and to check blocks against
+     * the checksums it keeps.
+     */
+    void setIndex(DataFileIndex index) { base_->setIndex(std::move(index)); }
+
+    /**
+     * See DataFileReaderBase::setBlockVerification().
+     */
+    void setBlockVerification(BlockVerification verification) {
+        base_->setBlockVerification(verification);
+    }
+
+    /**
+     * Shares decompressed blocks with other readers through \p cache.
+     * See DataFileReaderBase::setBlockCache().
+     */
+    void setBlockCache(std::shared_ptr<DataFileBlockCache> cache) {
+        base_->setBlockCache(std::move(cache));
+    }
+
+    /**
+     * Moves to object number \p n, counted from zero, so that the next
+     * read() returns it. The block holding it is found in the index and
+     * the objects before it in the block are skipped. Returns false,
+     * leaving the position alone, if the file has fewer objects.
+     */
+    bool seekToRecord(int64_t n) {
+        int64_t skip = base_->seekToBlockOf(n);
+        if (skip < 0) {
+            return false;
+        }
+        base_->skip(skip);
+        return true;
+    }
+
+    /**
+     * Skips the next \p n objects without decoding them, and returns the
+     * number skipped. See DataFileReaderBase::skip().
+     */
+    int64_t skip(int64_t n) { return base_->skip(n); }
+
+    /**
+     * Like read(), but checks the entry against the schema of the file
+     * before decoding it, so that a malformed entry is told of in
+     * \p status rather than by an exception. Faults in the framing of
+     * the file itself, such as a sync mismatch, still throw.
+     * \return true if an entry has been read into \p datum; false at
+     * the end of the file, or if \p status tells of a malformed entry,
+     * which is left unread.
+     */
+    bool tryRead(T &datum, DecodeStatus &status) {
+        status = DecodeStatus();
+        if (!base_->hasMore()) {
+            return false;
+        }
+        status = base_->checkNext();
+        if (!status) {
+            return false;
+        }
+        base_->decr();
+        avro::decode(base_->decoder(), datum);
+        base_->decoded();
+        return true;
+    }
+};
+
+/**
+ * Reads objects of type T from a data file through an AsyncInputStream.
+ * See AsyncDataFileReaderBase:
+ * \code
+ * AsyncDataFileReader<T> reader(stream);
+ * reader.start([](T &t) { ... }, [](std::exception_ptr error) { ... });
+ * \endcode
+ */
+template<typename T>
+class AsyncDataFileReader : boost::noncopyable {
+    AsyncDataFileReaderBase base_;
+    T datum_;
+
+public:
+    /**
+     * Called with each object in turn. The object is reused for the next
+     * one once the handler returns.
+     */
+    typedef std::function<void(T &datum)> ObjectHandler;
+
+    explicit AsyncDataFileReader(AsyncInputStreamPtr stream, size_t minReadSize = 1024 * 1024,
+                                 size_t readDepth = 4) : base_(std::move(stream), minReadSize, readDepth) {}
+
+    /**
+     * Constructs a reader decoding objects in \p readerSchema.
+     */
+    AsyncDataFileReader(AsyncInputStreamPtr stream, const ValidSchema &readerSchema,
+                        size_t minReadSize = 1024 * 1024,
+                        size_t readDepth = 4) : base_(std::move(stream), minReadSize, readDepth) {
+        base_.setReaderSchema(readerSchema);
+    }
+
+    /**
+     * See AsyncDataFileReaderBase::seek().
+     */
+    void seek(int64_t position) { base_.seek(position); }
+
+    /**
+     * Starts reading, and returns without waiting for any read.
+     */
+    void start(ObjectHandler onObject, AsyncDataFileReaderBase::DoneHandler onDone) {
+        base_.start([this, onObject](Decoder &d, int64_t objectCount) {
+            for (int64_t i = 0; i < objectCount; ++i) {
+                avro::decode(d, datum_);
+                onObject(datum_);
+            }
+        },
+                    std::move(onDone));
+    }
+
+    /**
+     * See AsyncDataFileReaderBase::dataSchema().
+     */
+    const ValidSchema &dataSchema() const { return base_.dataSchema(); }
 };
 
 } // namespace avro
@@ -0,0 +1,116 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_DataFileIndex_hh__
+#define avro_DataFileIndex_hh__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Config.hh"
+#include "Stream.hh"
+
+/// \file
+/// An index of the blocks of a data file, mapping object numbers to the
+/// blocks that hold them for random access.
+///
+/// Like block statistics, the index is kept in a sidecar that is itself an
+/// Avro data file. By convention the index of a file is named after it
+/// with a ".idx" suffix.
+
+namespace avro {
+
+/**
+ * One block of a data file.
+ */
+struct DataFileIndexEntry {
+    /// The offset of the block, to be given to DataFileReaderBase::seek().
+    int64_t offset;
+    /// The number, counted from zero, of the first object in the block.
+    int64_t firstObject;
+    /// The number of objects in the block.
+    int64_t objectCount;
+    /// True if the index keeps the checksum of the block.
+    bool hasChecksum;
+    /// The xxHash64() of the block's data as stored, that is compressed.
+    uint64_t checksum;
+};
+
+/**
+ * The non-empty blocks of a data file, in file order.
+ */
+class AVRO_DECL DataFileIndex {
+    std::vector<DataFileIndexEntry> entries_;
+
+    void append(DataFileIndexEntry e);
+
+public:
+    /**
+     * Appends the block at \p offset holding \p objectCount objects.
+     * Empty blocks are left out.
+     */
+    void add(int64_t offset, int64_t objectCount);
+
+    /**
+     * As above, with the checksum of the block.
+     */
+    void add(int64_t offset, int64_t objectCount, uint64_t checksum);
+
+    /**
+     * Returns the block holding object number \p object, or null if the
+     * file has fewer objects.
+     */
+    const DataFileIndexEntry *find(int64_t object) const;
+
+    /**
+     * Returns the block at \p offset, or null if there is none.
+     */
+    const DataFileIndexEntry *atOffset(int64_t offset) const;
+
+    /**
+     * Returns the number of objects in the file.
+     */
+    int64_t objectCount() const;
+
+    const std::vector<DataFileIndexEntry> &entries() const { return entries_; }
+};
+
+/**
+ * Writes an index to a sidecar.
+ */
+AVRO_DECL void writeDataFileIndex(std::unique_ptr<OutputStream> out,
+                                  const DataFileIndex &index);
+
+/**
+ * Reads the index written by writeDataFileIndex().
+ */
+AVRO_DECL DataFileIndex readDataFileIndex(std::unique_ptr<InputStream> in);
+AVRO_DECL DataFileIndex readDataFileIndex(const std::string &filename);
+
+/**
+ * Builds the index of an existing data file by walking its block headers,
+ * without decompressing the blocks. With \p checksums, the blocks are
+ * read, still without being decompressed, to keep their checksums.
+ */
+AVRO_DECL DataFileIndex buildDataFileIndex(const char *filename, bool checksums = false);
+
+} // namespace avro
+
+#endif
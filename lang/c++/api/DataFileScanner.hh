@@ -0,0 +1,357 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_DataFileScanner_hh__
+#define avro_DataFileScanner_hh__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "DataFile.hh"
+#include "Executor.hh"
+
+namespace avro {
+
+/**
+ * Reads a data file in several tasks at once on an executor, the caller
+ * taking part. The file is cut into splits, runs
+ * of whole blocks of about the same size found with DataFileBlockReader,
+ * and each split is read by its own DataFileReader that seeks to the
+ * split's first block and reads exactly the split's objects. Unlike
+ * splitting at arbitrary byte offsets with sync()/pastSync(), readers do
+ * not scan for sync markers or inflate the block after their split.
+ *
+ * T must be copyable; new objects are copies of the prototype given at
+ * construction, which for GenericDatum carries the schema.
+ */
+template<typename T>
+class ParallelDataFileScanner : boost::noncopyable {
+    const std::string filename_;
+    const ValidSchema readerSchema_;
+    const bool hasReaderSchema_;
+    const T prototype_;
+    // Zero for the executor's concurrency, and four splits per thread.
+    const size_t threads_;
+    size_t splits_;
+    ExecutorPtr executor_;
+
+    typedef std::vector<DataFileBlock> Split;
+
+    // Cuts the file into at most splits() runs of whole blocks of about
+    // the same size, found from the block headers alone.
+    std::vector<Split> makeSplits() const {
+        std::vector<DataFileBlock> blocks;
+        int64_t bytes = 0;
+        {
+            DataFileBlockReader br(filename_.c_str());
+            DataFileBlock b;
+            while (br.next(b)) {
+                blocks.push_back(b);
+                bytes += b.byteSize;
+            }
+        }
+        std::vector<Split> splits;
+        int64_t done = 0;
+        for (std::vector<DataFileBlock>::const_iterator it = blocks.begin(); it != blocks.end(); ++it) {
+            // The split a block goes to is decided by where it starts
+            // among the data bytes.
+            size_t index = static_cast<size_t>(done * static_cast<int64_t>(this->splits()) / (bytes + 1));
+            if (splits.empty() || splits.size() <= index) {
+                splits.push_back(Split());
+            }
+            splits.back().push_back(*it);
+            done += it->byteSize;
+        }
+        return splits;
+    }
+
+    std::unique_ptr<DataFileReader<T>> open(const Split &split) const {
+        std::unique_ptr<DataFileReader<T>> r;
+        if (hasReaderSchema_) {
+            r.reset(new DataFileReader<T>(filename_.c_str(), readerSchema_));
+        } else {
+            r.reset(new DataFileReader<T>(filename_.c_str()));
+        }
+        if (r->previousSync() != split.front().offset) {
+            r->seek(split.front().offset);
+        }
+        return r;
+    }
+
+    // Reading exactly the block's objects keeps the reader from inflating
+    // the block after the split.
+    void read(DataFileReader<T> &r, T &item) const {
+        if (!r.read(item)) {
+            throw Exception("Data file ended within a block: " + filename_);
+        }
+    }
+
+    // Reads one split, handing each object to onItem. The object is
+    // reused from one read to the next.
+    template<typename F>
+    int64_t scanSplit(const Split &split, F &onItem) const {
+        std::unique_ptr<DataFileReader<T>> r = open(split);
+        T item(prototype_);
+        int64_t count = 0;
+        for (typename Split::const_iterator it = split.begin(); it != split.end(); ++it) {
+            for (int64_t i = 0; i < it->objectCount; ++i) {
+                read(*r, item);
+                onItem(static_cast<const T &>(item));
+            }
+            count += it->objectCount;
+        }
+        return count;
+    }
+
+    // Reads one split, handing each block's objects to onBlock.
+    template<typename F>
+    int64_t scanSplitBlocks(const Split &split, F &onBlock) const {
+        std::unique_ptr<DataFileReader<T>> r = open(split);
+        std::vector<T> items;
+        int64_t count = 0;
+        for (typename Split::const_iterator it = split.begin(); it != split.end(); ++it) {
+            size_t n = static_cast<size_t>(it->objectCount);
+            if (items.size() < n) {
+                items.resize(n, prototype_);
+            }
+            for (size_t i = 0; i < n; ++i) {
+                read(*r, items[i]);
+            }
+            if (n > 0) {
+                onBlock(items, n);
+            }
+            count += n;
+        }
+        return count;
+    }
+
+    // Calls scan for every split in threads() tasks, rethrowing the
+    // first exception any of them throws once all are done. On a
+    // NumaExecutor each node is given a run of the splits of its own and
+    // tasks on the node's threads, so that the readers, and the buffers
+    // they allocate, stay on the node; a node done with its share helps
+    // with those of the others.
+    void runSplits(const std::vector<Split> &splits, const std::function<void(const Split &)> &scan) const {
+        const NumaExecutor *numa = dynamic_cast<const NumaExecutor *>(executor_.get());
+        const size_t nodes = numa != nullptr ? numa->nodes() : 1;
+        const size_t n = threads();
+        std::unique_ptr<std::atomic<size_t>[]> next(new std::atomic<size_t>[nodes]);
+        std::vector<size_t> end(nodes);
+        std::vector<size_t> tasks(nodes);
+        std::vector<std::unique_ptr<TaskGroup>> groups;
+        for (size_t k = 0; k < nodes; ++k) {
+            next[k] = splits.size() * k / nodes;
+            end[k] = splits.size() * (k + 1) / nodes;
+            tasks[k] = std::max(n * (k + 1) / nodes - n * k / nodes, static_cast<size_t>(1));
+            groups.emplace_back(new TaskGroup(numa != nullptr ? numa->node(k) : executor_, tasks[k]));
+        }
+        auto stopped = [&groups]() {
+            for (const std::unique_ptr<TaskGroup> &g : groups) {
+                if (g->failed()) {
+                    return true;
+                }
+            }
+            return false;
+        };
+        for (size_t k = 0; k < nodes; ++k) {
+            for (size_t i = 0; i < tasks[k]; ++i) {
+                groups[k]->run([&, k]() {
+                    for (size_t j = 0; j < nodes; ++j) {
+                        size_t share = (k + j) % nodes;
+                        for (size_t s = next[share]++; s < end[share] && !stopped(); s = next[share]++) {
+                            scan(splits[s]);
+                        }
+                    }
+                });
+            }
+        }
+        std::exception_ptr error;
+        for (const std::unique_ptr<TaskGroup> &g : groups) {
+            try {
+                g->wait();
+            } catch (...) {
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+public:
+    /**
+     * Reads the file with the schema stored in it in \p threads tasks at
+     * once, or as many as the executor runs at once if zero.
+     */
+    explicit ParallelDataFileScanner(const char *filename, size_t threads = 0,
+                                     const T &prototype = T())
+        : filename_(filename), hasReaderSchema_(false), prototype_(prototype), threads_(threads),
+          splits_(0) {}
+
+    /**
+     * Reads the file with the given reader schema.
+     */
+    ParallelDataFileScanner(const char *filename, const ValidSchema &readerSchema,
+                            size_t threads = 0, const T &prototype = T())
+        : filename_(filename), readerSchema_(readerSchema), hasReaderSchema_(true), prototype_(prototype),
+          threads_(threads), splits_(0) {}
+
+    /**
+     * Sets the largest number of splits the file is cut into; four per
+     * thread by default. A split has at least one block.
+     */
+    void setSplits(size_t splits) {
+        splits_ = splits == 0 ? 1 : splits;
+    }
+
+    /**
+     * Runs the scans on \p executor; defaultExecutor() if null, as it is
+     * to begin with. forEach() and forEachBlock() give each node of a
+     * NumaExecutor its own run of splits.
+     */
+    void setExecutor(ExecutorPtr executor) { executor_ = std::move(executor); }
+
+    size_t threads() const {
+        if (threads_ != 0) {
+            return threads_;
+        }
+        return std::max((executor_ ? executor_ : defaultExecutor())->concurrency(), static_cast<size_t>(1));
+    }
+
+    size_t splits() const { return splits_ != 0 ? splits_ : 4 * threads(); }
+
+    /**
+     * Calls \p f(const T&) for every object. Calls for objects of the
+     * same split are in file order, but f is called from several threads
+     * at once.
+     * \return the number of objects read.
+     */
+    template<typename F>
+    int64_t forEach(F f) {
+        std::atomic<int64_t> total(0);
+        runSplits(makeSplits(), [&](const Split &split) { total += scanSplit(split, f); });
+        return total;
+    }
+
+    /**
+     * Calls \p f(const T *items, size_t n) with the objects of every
+     * block, from several threads at once. The items are only valid
+     * during the call.
+     * \return the number of objects read.
+     */
+    template<typename F>
+    int64_t forEachBlock(F f) {
+        auto onBlock = [&f](std::vector<T> &items, size_t n) {
+            f(static_cast<const T *>(items.data()), n);
+        };
+        std::atomic<int64_t> total(0);
+        runSplits(makeSplits(), [&](const Split &split) { total += scanSplitBlocks(split, onBlock); });
+        return total;
+    }
+
+    /**
+     * Calls \p f(const T&) for every object in file order, on the
+     * calling thread, while the splits after the current one are read
+     * ahead in tasks on the executor.
+     * \return the number of objects read.
+     */
+    template<typename F>
+    int64_t forEachOrdered(F f) {
+        const std::vector<Split> splits = makeSplits();
+        const size_t window = 2 * threads();
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::vector<std::vector<T>> results(splits.size());
+        std::vector<bool> ready(splits.size(), false);
+        bool failed = false;
+        TaskGroup tasks(executor_, threads());
+
+        auto readSplit = [&](size_t s) {
+            std::vector<T> items;
+            auto onBlock = [&items](std::vector<T> &block, size_t n) {
+                items.insert(items.end(), block.begin(), block.begin() + n);
+            };
+            try {
+                scanSplitBlocks(splits[s], onBlock);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                failed = true;
+                cond.notify_all();
+                throw;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            results[s].swap(items);
+            ready[s] = true;
+            cond.notify_all();
+        };
+
+        int64_t total = 0;
+        size_t submitted = 0;
+        try {
+            for (size_t s = 0; s < splits.size(); ++s) {
+                for (; submitted < splits.size() && submitted < s + window; ++submitted) {
+                    size_t k = submitted;
+                    tasks.run([&readSplit, k]() { readSplit(k); });
+                }
+                std::vector<T> items;
+                {
+                    // Splits no task has started on yet are read here.
+                    std::unique_lock<std::mutex> lock(mutex);
+                    while (!ready[s] && !failed) {
+                        lock.unlock();
+                        bool ran = tasks.runPending();
+                        lock.lock();
+                        if (!ran && !ready[s] && !failed) {
+                            cond.wait(lock);
+                        }
+                    }
+                    if (!ready[s]) {
+                        break;
+                    }
+                    items.swap(results[s]);
+                }
+                for (typename std::vector<T>::const_iterator it = items.begin(); it != items.end(); ++it) {
+                    f(*it);
+                }
+                total += items.size();
+            }
+        } catch (...) {
+            tasks.clear();
+            try {
+                tasks.wait();
+            } catch (...) {
+            }
+            throw;
+        }
+        tasks.clear();
+        tasks.wait();
+        return total;
+    }
+};
+
+} // namespace avro
+
+#endif
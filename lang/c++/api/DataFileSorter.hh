@@ -0,0 +1,100 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_DataFileSorter_hh__
+#define avro_DataFileSorter_hh__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Config.hh"
+#include "Executor.hh"
+
+/// \file
+/// Sorts data files that need not fit in memory, in the sort order of
+/// their schema, by merging sorted runs.
+
+namespace avro {
+
+/**
+ * How sortDataFile() and mergeDataFiles() go about it.
+ */
+struct AVRO_DECL SortOptions {
+    /**
+     * The most bytes of encoded objects held in memory at once. The input
+     * is cut into runs of about this divided by one more than the number
+     * of threads, so that every thread has a run to sort while the next
+     * one is read.
+     */
+    size_t memoryLimit = 64 * 1024 * 1024;
+
+    /// The number of runs sorted and written at once, in tasks on
+    /// executor.
+    size_t threads = 1;
+
+    /// Where runs are sorted; defaultExecutor() if null.
+    ExecutorPtr executor;
+
+    /**
+     * Where runs are written until they are merged; the directory of the
+     * output file if empty. Runs are removed once merged, or if sorting
+     * fails.
+     */
+    std::string tempDirectory;
+
+    /**
+     * The top-level field of the records to sort by, in its own order
+     * if it has one and in ascending order otherwise. If empty, objects
+     * sort by the whole schema, as BinaryComparator has it.
+     */
+    std::string keyField;
+
+    /// The codec of the output file; that of the (first) input if empty.
+    std::string codec;
+
+    /// The sync interval of the output file.
+    size_t syncInterval = 16 * 1024;
+};
+
+/**
+ * Writes the objects of the data file \p input to the data file
+ * \p output, sorted. Objects are never decoded: they are compared in
+ * their binary encoding, and copied as they are. Objects that compare
+ * equal keep the order they had. Returns the number of objects.
+ */
+AVRO_DECL int64_t sortDataFile(const std::string &input,
+                               const std::string &output,
+                               const SortOptions &options = SortOptions());
+
+/**
+ * Merges data files whose objects are each already sorted into the
+ * sorted data file \p output, streaming through them block by block.
+ * The inputs must have the same schema. Objects that compare equal come
+ * in the order of the inputs they are from. Only the key field, codec
+ * and sync interval of \p options are used. Returns the number of
+ * objects.
+ */
+AVRO_DECL int64_t mergeDataFiles(const std::vector<std::string> &inputs,
+                                 const std::string &output,
+                                 const SortOptions &options = SortOptions());
+
+} // namespace avro
+
+#endif
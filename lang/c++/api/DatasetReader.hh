@@ -0,0 +1,178 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_DatasetReader_hh__
+#define avro_DatasetReader_hh__
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "DataFile.hh"
+#include "Executor.hh"
+
+namespace avro {
+
+/**
+ * Reads a list of data files as one dataset. The files are opened through
+ * one DataFileSchemaCache, so that each distinct writer's schema is
+ * compiled once however many files carry it, and the resolution of each
+ * to the reader's schema is compiled once as well. Files can be read one
+ * after another with read(), or several at a time with forEach().
+ * T must be copyable; for forEach(), new objects are copies of the
+ * prototype given at construction, which for GenericDatum carries the
+ * schema.
+ */
+template<typename T>
+class DatasetReader : boost::noncopyable {
+    const std::vector<std::string> files_;
+    const ValidSchema readerSchema_;
+    const bool hasReaderSchema_;
+    const T prototype_;
+    size_t threads_;
+    ExecutorPtr executor_;
+    DataFileSchemaCache schemas_;
+    // The next file read() opens, and the one it reads.
+    size_t next_;
+    std::unique_ptr<DataFileReader<T>> reader_;
+
+    std::unique_ptr<DataFileReader<T>> open(const std::string &filename) {
+        return std::unique_ptr<DataFileReader<T>>(hasReaderSchema_
+                                                      ? new DataFileReader<T>(filename.c_str(), readerSchema_, schemas_)
+                                                      : new DataFileReader<T>(filename.c_str(), schemas_));
+    }
+
+public:
+    /**
+     * Reads \p files, each with the schema stored in it.
+     */
+    explicit DatasetReader(std::vector<std::string> files, const T &prototype = T())
+        : files_(std::move(files)), hasReaderSchema_(false), prototype_(prototype), threads_(1), next_(0) {}
+
+    /**
+     * Reads \p files with the given reader schema.
+     */
+    DatasetReader(std::vector<std::string> files, const ValidSchema &readerSchema,
+                  const T &prototype = T())
+        : files_(std::move(files)), readerSchema_(readerSchema), hasReaderSchema_(true), prototype_(prototype),
+          threads_(1), next_(0) {}
+
+    /**
+     * Sets the number of files forEach() reads at once, as many as the
+     * executor runs tasks at once if zero. One to begin with.
+     */
+    void setThreads(size_t threads) { threads_ = threads; }
+
+    /**
+     * Reads the files of forEach() in tasks on \p executor;
+     * defaultExecutor() if null, as it is to begin with.
+     */
+    void setExecutor(ExecutorPtr executor) { executor_ = std::move(executor); }
+
+    size_t threads() const {
+        if (threads_ != 0) {
+            return threads_;
+        }
+        return std::max((executor_ ? executor_ : defaultExecutor())->concurrency(), static_cast<size_t>(1));
+    }
+
+    const std::vector<std::string> &files() const { return files_; }
+
+    /**
+     * The schemas of the files opened so far.
+     */
+    const DataFileSchemaCache &schemas() const { return schemas_; }
+
+    /**
+     * Reads the next object, going through the files in order. Returns
+     * false when all have been read.
+     */
+    bool read(T &datum) {
+        for (;;) {
+            if (reader_ && reader_->read(datum)) {
+                return true;
+            }
+            if (reader_) {
+                reader_->close();
+                reader_.reset();
+            }
+            if (next_ == files_.size()) {
+                return false;
+            }
+            reader_ = open(files_[next_++]);
+        }
+    }
+
+    /**
+     * The file the last object read() returned is from.
+     */
+    const std::string &currentFile() const {
+        return files_[next_ - 1];
+    }
+
+    /**
+     * Calls \p f(const T&) for every object of every file, reading as
+     * many files at once as setThreads() says, in tasks on the executor
+     * and on the calling thread. Calls for objects of the
+     * same file are in file order, but f is called from several threads
+     * at once. read() is not affected. If reading a file throws, the
+     * files not yet begun are left, and the first exception is rethrown
+     * once the others are done.
+     * \return the number of objects read.
+     */
+    template<typename F>
+    int64_t forEach(F f) {
+        std::atomic<size_t> next(0);
+        std::atomic<int64_t> total(0);
+        std::atomic<bool> failed(false);
+        auto work = [&]() {
+            try {
+                T item(prototype_);
+                for (size_t i = next++; i < files_.size() && !failed; i = next++) {
+                    std::unique_ptr<DataFileReader<T>> r = open(files_[i]);
+                    int64_t count = 0;
+                    while (r->read(item)) {
+                        f(static_cast<const T &>(item));
+                        ++count;
+                    }
+                    total += count;
+                }
+            } catch (...) {
+                failed = true;
+                throw;
+            }
+        };
+        const size_t n = std::min(threads(), files_.size());
+        if (n <= 1) {
+            work();
+            return total;
+        }
+        TaskGroup tasks(executor_, n);
+        for (size_t i = 0; i < n; ++i) {
+            tasks.run(work);
+        }
+        tasks.wait();
+        return total;
+    }
+};
+
+} // namespace avro
+
+#endif
@@ -0,0 +1,141 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_DatumVisitor_hh__
+#define avro_DatumVisitor_hh__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "Config.hh"
+#include "Decoder.hh"
+#include "Node.hh"
+#include "ValidSchema.hh"
+
+/// \file
+/// Reading values as a stream of events instead of into GenericDatums.
+///
+/// A DatumReader walks the schema as it decodes a value and reports each
+/// part of it to a DatumVisitor, in the order of the reader's schema.
+/// Nothing is allocated on the way, so consumers filling their own
+/// structures avoid building and then taking apart a GenericDatum tree.
+
+namespace avro {
+
+/**
+ * The events of a value being read. Every callback does nothing by
+ * default, so a visitor only overrides those it needs.
+ *
+ * Strings, bytes, fixeds and map keys come as a pointer and a length,
+ * like Decoder::decodeStringView(). They point into the input or a buffer
+ * of the reader and are valid only until the callback returns.
+ */
+class AVRO_DECL DatumVisitor {
+public:
+    virtual ~DatumVisitor();
+
+    virtual void onNull() {}
+    virtual void onBool(bool) {}
+    virtual void onInt(int32_t) {}
+    virtual void onLong(int64_t) {}
+    virtual void onFloat(float) {}
+    virtual void onDouble(double) {}
+    virtual void onString(const char *, size_t) {}
+    virtual void onBytes(const uint8_t *, size_t) {}
+    virtual void onFixed(const uint8_t *, size_t) {}
+
+    /// An enum, by the index and name of its symbol in the reader's schema.
+    virtual void onEnum(size_t, const std::string &) {}
+
+    /// The start of a record, with its schema.
+    virtual void onRecordStart(const Node &) {}
+
+    /// Comes before the value of each field, with the index and name of
+    /// the field in the reader's schema. Under resolution, fields come in
+    /// the writer's order, followed by those filled from defaults.
+    virtual void onField(size_t, const std::string &) {}
+
+    virtual void onRecordEnd(const Node &) {}
+
+    virtual void onArrayStart(const Node &) {}
+
+    /// Comes before each item, with its position in the array.
+    virtual void onArrayItem(size_t) {}
+
+    /// The end of an array, with the number of its items.
+    virtual void onArrayEnd(size_t) {}
+
+    virtual void onMapStart(const Node &) {}
+
+    /// Comes before the value of each entry.
+    virtual void onMapKey(const char *, size_t) {}
+
+    /// The end of a map, with the number of its entries.
+    virtual void onMapEnd(size_t) {}
+
+    /// Comes before the value of a union, with the index of its branch.
+    virtual void onUnionBranch(size_t) {}
+};
+
+/**
+ * Decodes values of a schema and reports them to a DatumVisitor.
+ */
+class AVRO_DECL DatumReader : boost::noncopyable {
+    const ValidSchema schema_;
+    const bool isResolving_;
+    const DecoderPtr decoder_;
+    // Fixeds are decoded into this.
+    std::vector<uint8_t> fixed_;
+
+    void read(const Node &n, DatumVisitor &v);
+
+public:
+    /**
+     * Constructs a reader for values of \p s on \p decoder, which may be a
+     * resolving decoder with \p s as the reader's schema.
+     */
+    DatumReader(ValidSchema s, const DecoderPtr &decoder);
+
+    /**
+     * Constructs a reader for data of \p writerSchema on \p decoder,
+     * resolved against \p readerSchema unless the two have the same
+     * encoding.
+     */
+    DatumReader(const ValidSchema &writerSchema,
+                const ValidSchema &readerSchema, const DecoderPtr &decoder);
+
+    /**
+     * Reads a value off the decoder and reports it to \p visitor.
+     */
+    void read(DatumVisitor &visitor);
+
+    /**
+     * Drains any residual bytes in the input stream; see
+     * GenericReader::drain().
+     */
+    void drain() {
+        decoder_->drain();
+    }
+};
+
+} // namespace avro
+
+#endif
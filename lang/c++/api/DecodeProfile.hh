@@ -0,0 +1,141 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_DecodeProfile_hh__
+#define avro_DecodeProfile_hh__
+
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Config.hh"
+#include "Decoder.hh"
+#include "ValidSchema.hh"
+
+/// \file
+/// Finds out which fields of a schema are the costly ones to decode.
+
+namespace avro {
+
+/**
+ * What decoding the values at one path of a schema has cost.
+ *
+ * Paths name fields by their names, separated by dots, as in
+ * "header.tenant_id"; the items of an array at "tags" are at "tags[]"
+ * and the values of a map at "attributes" at "attributes{}". The keys of
+ * a map count towards the map itself, as do the block counts of arrays
+ * and maps and the branch indexes of unions; the branch counts towards
+ * the path of the union. The top-level value is at "".
+ */
+struct AVRO_DECL DecodeCost {
+    std::string path;
+    /// The number of values decoded, or skipped.
+    uint64_t values = 0;
+    /**
+     * The bytes the values take in the binary encoding, whichever
+     * decoder read them. For resolving decoders, they are those of the
+     * values as the reader's schema has them.
+     */
+    uint64_t bytes = 0;
+    /**
+     * The number of times a string, bytes or fixed outgrew the capacity of
+     * the one it was decoded into, which is when decoding allocates.
+     */
+    uint64_t allocations = 0;
+    /// The estimated time spent, from the sampled calls.
+    uint64_t nanos = 0;
+    /// The number of calls timed.
+    uint64_t samples = 0;
+};
+
+class DecodeProfiler;
+
+/**
+ * Collects the costs of decoding by path, from the decoders made by
+ * profilingDecoder(). Those update it without locking, so a profile must
+ * not be shared by decoders in different threads; merge() the profiles of
+ * several threads instead.
+ */
+class AVRO_DECL DecodeProfile {
+    struct Entry {
+        DecodeCost cost;
+        uint64_t calls = 0;
+    };
+    std::vector<Entry> entries_;
+    std::map<std::string, size_t> index_;
+
+    size_t intern(const std::string &path);
+
+    friend class DecodeProfiler;
+
+public:
+    /**
+     * The costs of the paths decoded so far, costliest first: by
+     * estimated time, then by bytes.
+     */
+    std::vector<DecodeCost> costs() const;
+
+    /**
+     * Adds the costs of \p other to those of this profile.
+     */
+    void merge(const DecodeProfile &other);
+
+    /**
+     * Forgets all costs.
+     */
+    void clear();
+
+    /**
+     * Writes a table of the costliest \p limit paths, or all if it is zero,
+     * with their share of the total time and bytes.
+     */
+    void report(std::ostream &os, size_t limit = 0) const;
+};
+
+using DecodeProfilePtr = std::shared_ptr<DecodeProfile>;
+
+/**
+ * Returns a decoder that decodes with \p base and charges what every call
+ * costs to the path of \p schema it decodes, in \p profile. The schema is
+ * the one the calls follow: that of the data for binary decoders, and the
+ * reader's schema for resolving decoders, when the result is itself a
+ * ResolvingDecoder.
+ *
+ * Every \p sampleInterval'th call is timed, so that the estimated times
+ * cost two reads of the clock per that many calls; 1 times them all.
+ */
+AVRO_DECL DecoderPtr profilingDecoder(const ValidSchema &schema,
+                                      const DecoderPtr &base,
+                                      const DecodeProfilePtr &profile,
+                                      size_t sampleInterval = 64);
+
+/**
+ * Like profilingDecoder() above, for a resolving decoder; the result
+ * passes on the field order of \p base.
+ */
+AVRO_DECL ResolvingDecoderPtr profilingDecoder(const ValidSchema &readerSchema,
+                                               const ResolvingDecoderPtr &base,
+                                               const DecodeProfilePtr &profile,
+                                               size_t sampleInterval = 64);
+
+} // namespace avro
+
+#endif
@@ -20,11 +20,13 @@
 #define avro_Decoder_hh__
 
 #include "Config.hh"
+#include <algorithm>
 #include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "Exception.hh"
 #include "Stream.hh"
 #include "ValidSchema.hh"
 
@@ -71,6 +73,39 @@ public:
     /// Decodes a double-precision floating point number from current stream.
     virtual double decodeDouble() = 0;
 
+    /// Decodes \p n consecutive 32-bit ints into \p values. They must all
+    /// belong to the current array block, that is \p n must not exceed
+    /// the count returned by the last arrayStart() or arrayNext().
+    virtual void decodeIntArray(int32_t *values, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            values[i] = decodeInt();
+        }
+    }
+
+    /// Decodes \p n consecutive 64-bit ints of the current array block
+    /// into \p values.
+    virtual void decodeLongArray(int64_t *values, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            values[i] = decodeLong();
+        }
+    }
+
+    /// Decodes \p n consecutive single-precision floating point numbers
+    /// of the current array block into \p values.
+    virtual void decodeFloatArray(float *values, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            values[i] = decodeFloat();
+        }
+    }
+
+    /// Decodes \p n consecutive double-precision floating point numbers
+    /// of the current array block into \p values.
+    virtual void decodeDoubleArray(double *values, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            values[i] = decodeDouble();
+        }
+    }
+
     /// Decodes a UTF-8 string from the current stream.
     std::string decodeString() {
         std::string result;
@@ -86,6 +121,21 @@ public:
     /// Skips a string on the current stream.
     virtual void skipString() = 0;
 
+    /**
+     * Decodes a UTF-8 string from the current stream without copying it
+     * where possible. On return \p data points to the string's bytes,
+     * which are not null-terminated, and \p len holds their count.
+     * The bytes remain valid only until the next call on this decoder.
+     * Decoders that cannot point into their input, or a string that
+     * straddles two chunks of the input, fall back to a copy held by the
+     * decoder.
+     */
+    virtual void decodeStringView(const char *&data, size_t &len) {
+        decodeString(stringViewBuffer_);
+        data = stringViewBuffer_.data();
+        len = stringViewBuffer_.size();
+    }
+
     /// Decodes arbitrary binary data from the current stream.
     std::vector<uint8_t> decodeBytes() {
         std::vector<uint8_t> result;
@@ -100,6 +150,17 @@ public:
     /// Skips bytes on the current stream.
     virtual void skipBytes() = 0;
 
+    /**
+     * Decodes arbitrary binary data from the current stream without
+     * copying it where possible. The same lifetime rules as for
+     * decodeStringView() apply to \p data.
+     */
+    virtual void decodeBytesView(const uint8_t *&data, size_t &len) {
+        decodeBytes(bytesViewBuffer_);
+        data = bytesViewBuffer_.data();
+        len = bytesViewBuffer_.size();
+    }
+
     /**
      * Decodes fixed length binary from the current stream.
      * \param[in] n The size (byte count) of the fixed being read.
@@ -120,6 +181,15 @@ public:
      */
     virtual void decodeFixed(size_t n, std::vector<uint8_t> &value) = 0;
 
+    /**
+     * Decodes a fixed of \p n bytes without copying it where possible.
+     * The same lifetime rules as for decodeStringView() apply to \p data.
+     */
+    virtual void decodeFixedView(size_t n, const uint8_t *&data) {
+        decodeFixed(n, bytesViewBuffer_);
+        data = bytesViewBuffer_.data();
+    }
+
     /// Skips fixed length binary on the current stream.
     virtual void skipFixed(size_t n) = 0;
 
@@ -169,6 +239,24 @@ public:
     /// by the avro decoder. Similar set of problems occur if the Decoder
     /// consumes more than what it should.
     virtual void drain() = 0;
+
+    /**
+     * Turns on or off checking that the strings this decoder decodes are
+     * well-formed UTF-8, throwing an Exception for those that are not.
+     * The check runs over each string as it is copied out or viewed, in
+     * place of a pass over the decoded values; skipped strings are not
+     * checked. Off by default. Decoders that wrap another have it check;
+     * the others throw if asked to check.
+     */
+    virtual void setUtf8Validation(bool validate) {
+        if (validate) {
+            throw Exception("This decoder cannot check UTF-8");
+        }
+    }
+
+private:
+    std::string stringViewBuffer_;
+    std::vector<uint8_t> bytesViewBuffer_;
 };
 
 /**
@@ -201,7 +289,8 @@ AVRO_DECL DecoderPtr binaryDecoder();
 
 /**
  *  Returns an decoder that validates sequence of calls to an underlying
- *  Decoder against the given schema.
+ *  Decoder against the given schema. The grammar for the schema is built
+ *  once and cached; see setValidatingCodecCacheCapacity().
  */
 AVRO_DECL DecoderPtr validatingDecoder(const ValidSchema &schema,
                                        const DecoderPtr &base);
@@ -215,11 +304,57 @@ AVRO_DECL DecoderPtr jsonDecoder(const ValidSchema &schema);
  *  Returns a decoder that decodes avro data from base written according to
  *  writerSchema and resolves against readerSchema.
  *  The client uses the decoder as if the data were written using readerSchema.
+ *  The grammar for the pair is built once and cached; see
+ *  setResolvingDecoderCacheCapacity().
  *  // FIXME: Handle out of order fields.
  */
 AVRO_DECL ResolvingDecoderPtr resolvingDecoder(const ValidSchema &writer,
                                                const ValidSchema &reader, const DecoderPtr &base);
 
+/**
+ *  Returns a decoder that does the same as resolvingDecoder(), but turns
+ *  the resolution of readerSchema against writerSchema into a flat
+ *  program once, when it is created. Decoding then only steps through
+ *  that program, which is considerably cheaper per value than the
+ *  grammar based decoder.
+ */
+AVRO_DECL ResolvingDecoderPtr compiledResolvingDecoder(const ValidSchema &writer,
+                                                       const ValidSchema &reader, const DecoderPtr &base);
+
+/**
+ *  resolvingDecoder() and compiledResolvingDecoder() keep the result of
+ *  resolving the most recently used writer/reader schema pairs, so that
+ *  creating another decoder for a pair seen before does not walk the
+ *  schemas again. Sets the number of pairs kept, 64 by default; 0 turns
+ *  the cache off. The cache is shared by all threads.
+ */
+AVRO_DECL void setResolvingDecoderCacheCapacity(size_t capacity);
+
+/**
+ *  validatingDecoder() and validatingEncoder() share the grammar of a
+ *  schema among all the decoders and encoders for it, in all threads,
+ *  and keep those of the most recently used schemas. Sets the number of
+ *  schemas kept, 64 by default; 0 turns the cache off.
+ */
+AVRO_DECL void setValidatingCodecCacheCapacity(size_t capacity);
+
+namespace detail {
+
+/**
+ * Returns the number of items to reserve room for before decoding a
+ * block of n more into a container of the given size and capacity. The
+ * block counts come from the data, so the room grows by at most 64K items
+ * at a time, but it at least doubles, so that many small blocks do not
+ * each reallocate.
+ */
+inline size_t reserveFor(size_t size, size_t capacity, size_t n) {
+    const size_t maxStep = 64 * 1024;
+    size_t wanted = size + std::min(n, maxStep);
+    return wanted <= capacity ? capacity : std::max(wanted, std::min(2 * capacity, size + maxStep));
+}
+
+} // namespace detail
+
 } // namespace avro
 
 #endif
@@ -0,0 +1,640 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_DirectCodec_hh__
+#define avro_DirectCodec_hh__
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#if __cplusplus >= 201703L
+#include <optional>
+#endif
+
+#include "Config.hh"
+#include "Exception.hh"
+#include "Specific.hh"
+#include "Zigzag.hh"
+
+/// \file
+/// Non-virtual Avro binary encoding and decoding over contiguous memory.
+///
+/// DirectBinaryEncoder and DirectBinaryDecoder have the same operations as
+/// Encoder and Decoder, but are concrete classes with inline members that
+/// work on a memory buffer. The direct_codec_traits and the directEncode()
+/// and directDecode() functions are templates over the encoder or decoder,
+/// so with these classes the compiler sees, and can inline, the coding of
+/// a whole value. avrogencpp emits direct_codec_traits for generated types
+/// when run with --direct-codec.
+///
+/// The direct path is for data in the binary encoding with the schema it
+/// was written with; there is no validation. Schema resolution is only
+/// available through the resolving_traits avrogencpp generates for writer
+/// schemas known at build time.
+
+namespace avro {
+
+/**
+ * Decodes Avro binary data from a buffer that the caller keeps alive while
+ * decoding.
+ */
+class DirectBinaryDecoder {
+    const uint8_t *next_;
+    const uint8_t *end_;
+
+    void need(size_t n) const {
+        if (static_cast<size_t>(end_ - next_) < n) {
+            throw Exception("EOF reached");
+        }
+    }
+
+    size_t decodeLength() {
+        int64_t len = decodeLong();
+        if (len < 0) {
+            throw Exception("Cannot have negative length");
+        }
+        need(static_cast<size_t>(len));
+        return static_cast<size_t>(len);
+    }
+
+    size_t decodeItemCount() {
+        int64_t n = decodeLong();
+        if (n < 0) {
+            // The block's items must fit in its byte size, which must
+            // fit in what is left.
+            int64_t bytes = decodeLong();
+            if (bytes < 0 || static_cast<uint64_t>(bytes) > static_cast<uint64_t>(end_ - next_)) {
+                throw Exception("EOF reached");
+            }
+            return static_cast<size_t>(-n);
+        }
+        return static_cast<size_t>(n);
+    }
+
+public:
+    DirectBinaryDecoder(const uint8_t *data, size_t len) : next_(data), end_(data + len) {}
+
+    /// Returns the position of the next byte to decode.
+    const uint8_t *position() const {
+        return next_;
+    }
+
+    void decodeNull() {}
+
+    bool decodeBool() {
+        need(1);
+        uint8_t v = *next_++;
+        if (v > 1) {
+            throw Exception("Invalid value for bool");
+        }
+        return v == 1;
+    }
+
+    int32_t decodeInt() {
+        int64_t v = decodeLong();
+        if (v < INT32_MIN || v > INT32_MAX) {
+            throw Exception("Value out of range for Avro int");
+        }
+        return static_cast<int32_t>(v);
+    }
+
+    int64_t decodeLong() {
+        uint64_t encoded = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            need(1);
+            uint64_t u = *next_++;
+            encoded |= (u & 0x7f) << shift;
+            if ((u & 0x80) == 0) {
+                return decodeZigzag64(encoded);
+            }
+        }
+        throw Exception("Invalid Avro varint");
+    }
+
+    float decodeFloat() {
+        float result;
+        need(sizeof(result));
+        memcpy(&result, next_, sizeof(result));
+        next_ += sizeof(result);
+        return result;
+    }
+
+    double decodeDouble() {
+        double result;
+        need(sizeof(result));
+        memcpy(&result, next_, sizeof(result));
+        next_ += sizeof(result);
+        return result;
+    }
+
+    void decodeString(std::string &value) {
+        size_t len = decodeLength();
+        value.assign(reinterpret_cast<const char *>(next_), len);
+        next_ += len;
+    }
+
+    void decodeStringView(const char *&data, size_t &len) {
+        len = decodeLength();
+        data = reinterpret_cast<const char *>(next_);
+        next_ += len;
+    }
+
+    void skipString() {
+        next_ += decodeLength();
+    }
+
+    void decodeBytes(std::vector<uint8_t> &value) {
+        size_t len = decodeLength();
+        value.assign(next_, next_ + len);
+        next_ += len;
+    }
+
+    void decodeBytesView(const uint8_t *&data, size_t &len) {
+        len = decodeLength();
+        data = next_;
+        next_ += len;
+    }
+
+    void skipBytes() {
+        skipString();
+    }
+
+    void decodeFixed(size_t n, uint8_t *value) {
+        need(n);
+        memcpy(value, next_, n);
+        next_ += n;
+    }
+
+    void decodeFixedView(size_t n, const uint8_t *&data) {
+        need(n);
+        data = next_;
+        next_ += n;
+    }
+
+    void skipFixed(size_t n) {
+        need(n);
+        next_ += n;
+    }
+
+    size_t decodeEnum() {
+        return static_cast<size_t>(decodeLong());
+    }
+
+    size_t arrayStart() {
+        return decodeItemCount();
+    }
+
+    size_t arrayNext() {
+        return decodeItemCount();
+    }
+
+    size_t mapStart() {
+        return decodeItemCount();
+    }
+
+    size_t mapNext() {
+        return decodeItemCount();
+    }
+
+    size_t skipArray() {
+        for (;;) {
+            int64_t n = decodeLong();
+            if (n >= 0) {
+                return static_cast<size_t>(n);
+            }
+            next_ += decodeLength();
+        }
+    }
+
+    size_t skipMap() {
+        return skipArray();
+    }
+
+    size_t decodeUnionIndex() {
+        return static_cast<size_t>(decodeLong());
+    }
+};
+
+/**
+ * Encodes Avro binary data into a growing buffer.
+ */
+class DirectBinaryEncoder {
+    std::vector<uint8_t> buffer_;
+    size_t size_;
+
+    uint8_t *reserve(size_t n) {
+        if (buffer_.size() - size_ < n) {
+            buffer_.resize(std::max(buffer_.size() * 2, size_ + n));
+        }
+        return buffer_.data() + size_;
+    }
+
+    void write(const uint8_t *data, size_t n) {
+        if (n > 0) {
+            memcpy(reserve(n), data, n);
+            size_ += n;
+        }
+    }
+
+public:
+    explicit DirectBinaryEncoder(size_t capacity = 1024) : buffer_(capacity), size_(0) {}
+
+    /// Returns the encoded bytes.
+    const uint8_t *data() const {
+        return buffer_.data();
+    }
+
+    /// Returns the number of encoded bytes.
+    size_t size() const {
+        return size_;
+    }
+
+    /// Discards the encoded bytes, keeping the buffer.
+    void clear() {
+        size_ = 0;
+    }
+
+    void encodeNull() {}
+
+    void encodeBool(bool b) {
+        *reserve(1) = b ? 1 : 0;
+        ++size_;
+    }
+
+    void encodeInt(int32_t i) {
+        encodeLong(i);
+    }
+
+    void encodeLong(int64_t l) {
+        uint8_t *p = reserve(10);
+        uint64_t v = encodeZigzag64(l);
+        size_t n = 0;
+        while (v >= 0x80) {
+            p[n++] = static_cast<uint8_t>(v | 0x80);
+            v >>= 7;
+        }
+        p[n++] = static_cast<uint8_t>(v);
+        size_ += n;
+    }
+
+    void encodeFloat(float f) {
+        write(reinterpret_cast<const uint8_t *>(&f), sizeof(f));
+    }
+
+    void encodeDouble(double d) {
+        write(reinterpret_cast<const uint8_t *>(&d), sizeof(d));
+    }
+
+    void encodeString(const std::string &s) {
+        encodeStringView(s.data(), s.size());
+    }
+
+    void encodeStringView(const char *data, size_t len) {
+        encodeLong(static_cast<int64_t>(len));
+        write(reinterpret_cast<const uint8_t *>(data), len);
+    }
+
+    void encodeBytes(const uint8_t *bytes, size_t len) {
+        encodeLong(static_cast<int64_t>(len));
+        write(bytes, len);
+    }
+
+    void encodeFixed(const uint8_t *bytes, size_t len) {
+        write(bytes, len);
+    }
+
+    void encodeEnum(size_t e) {
+        encodeLong(static_cast<int64_t>(e));
+    }
+
+    void arrayStart() {}
+
+    void arrayEnd() {
+        encodeLong(0);
+    }
+
+    void mapStart() {}
+
+    void mapEnd() {
+        encodeLong(0);
+    }
+
+    void setItemCount(size_t count) {
+        if (count > 0) {
+            encodeLong(static_cast<int64_t>(count));
+        }
+    }
+
+    void startItem() {}
+
+    void encodeUnionIndex(size_t e) {
+        encodeLong(static_cast<int64_t>(e));
+    }
+};
+
+/**
+ * Like codec_traits, but with encode and decode templated over the encoder
+ * and decoder, for DirectBinaryEncoder and DirectBinaryDecoder.
+ */
+template<typename T>
+struct direct_codec_traits;
+
+/**
+ * Tells whether direct_codec_traits<T> is defined where this is first
+ * used for T.
+ */
+template<typename T, typename = void>
+struct has_direct_codec : std::false_type {};
+
+template<typename T>
+struct has_direct_codec<T, decltype(void(sizeof(direct_codec_traits<T>)))> : std::true_type {};
+
+/**
+ * Reads data written with a known writer schema into T, which avrogencpp
+ * generates for the reader's schema. avrogencpp emits one specialization
+ * per writer schema given with --writer, numbered from zero. Its decode()
+ * is templated over the decoder like direct_codec_traits, with schema
+ * resolution done by code generated for that writer: fields are read in
+ * the writer's order, promoted or skipped as needed, and reader-only
+ * fields get their defaults. fingerprint() returns the CRC-64-AVRO
+ * fingerprint of the writer schema.
+ */
+template<typename T, size_t W>
+struct resolving_traits;
+
+/**
+ * Selects among the resolving_traits avrogencpp generated for T: count()
+ * is the number of writer schemas, find() maps a writer schema fingerprint to
+ * its index and decode() reads with the writer of a given index.
+ */
+template<typename T>
+struct resolving_writers;
+
+template<typename E, typename T>
+void directEncode(E &e, const T &t) {
+    direct_codec_traits<T>::encode(e, t);
+}
+
+template<typename D, typename T>
+void directDecode(D &d, T &t) {
+    direct_codec_traits<T>::decode(d, t);
+}
+
+/**
+ * Reads data written with the writer schema of the given index, as
+ * counted by resolving_writers<T>, into t.
+ */
+template<typename D, typename T>
+void resolvingDecode(D &d, size_t writer, T &t) {
+    resolving_writers<T>::decode(d, writer, t);
+}
+
+template<>
+struct direct_codec_traits<bool> {
+    template<typename E>
+    static void encode(E &e, bool b) {
+        e.encodeBool(b);
+    }
+    template<typename D>
+    static void decode(D &d, bool &b) {
+        b = d.decodeBool();
+    }
+};
+
+template<>
+struct direct_codec_traits<int32_t> {
+    template<typename E>
+    static void encode(E &e, int32_t i) {
+        e.encodeInt(i);
+    }
+    template<typename D>
+    static void decode(D &d, int32_t &i) {
+        i = d.decodeInt();
+    }
+};
+
+template<>
+struct direct_codec_traits<int64_t> {
+    template<typename E>
+    static void encode(E &e, int64_t l) {
+        e.encodeLong(l);
+    }
+    template<typename D>
+    static void decode(D &d, int64_t &l) {
+        l = d.decodeLong();
+    }
+};
+
+template<>
+struct direct_codec_traits<float> {
+    template<typename E>
+    static void encode(E &e, float f) {
+        e.encodeFloat(f);
+    }
+    template<typename D>
+    static void decode(D &d, float &f) {
+        f = d.decodeFloat();
+    }
+};
+
+template<>
+struct direct_codec_traits<double> {
+    template<typename E>
+    static void encode(E &e, double f) {
+        e.encodeDouble(f);
+    }
+    template<typename D>
+    static void decode(D &d, double &f) {
+        f = d.decodeDouble();
+    }
+};
+
+template<>
+struct direct_codec_traits<std::string> {
+    template<typename E>
+    static void encode(E &e, const std::string &s) {
+        e.encodeString(s);
+    }
+    template<typename D>
+    static void decode(D &d, std::string &s) {
+        d.decodeString(s);
+    }
+};
+
+template<>
+struct direct_codec_traits<std::vector<uint8_t>> {
+    template<typename E>
+    static void encode(E &e, const std::vector<uint8_t> &b) {
+        e.encodeBytes(b.data(), b.size());
+    }
+    template<typename D>
+    static void decode(D &d, std::vector<uint8_t> &b) {
+        d.decodeBytes(b);
+    }
+};
+
+template<size_t N>
+struct direct_codec_traits<std::array<uint8_t, N>> {
+    template<typename E>
+    static void encode(E &e, const std::array<uint8_t, N> &b) {
+        e.encodeFixed(b.data(), N);
+    }
+    template<typename D>
+    static void decode(D &d, std::array<uint8_t, N> &b) {
+        d.decodeFixed(N, b.data());
+    }
+};
+
+template<typename T>
+struct direct_codec_traits<std::vector<T>> {
+    template<typename E>
+    static void encode(E &e, const std::vector<T> &b) {
+        e.arrayStart();
+        if (!b.empty()) {
+            e.setItemCount(b.size());
+            for (typename std::vector<T>::const_iterator it = b.begin(); it != b.end(); ++it) {
+                e.startItem();
+                directEncode(e, *it);
+            }
+        }
+        e.arrayEnd();
+    }
+    template<typename D>
+    static void decode(D &d, std::vector<T> &s) {
+        s.clear();
+        for (size_t n = d.arrayStart(); n != 0; n = d.arrayNext()) {
+            s.reserve(detail::reserveFor(s.size(), s.capacity(), n));
+            for (size_t i = 0; i < n; ++i) {
+                s.emplace_back();
+                directDecode(d, s.back());
+            }
+        }
+    }
+};
+
+template<typename T>
+struct direct_codec_traits<std::map<std::string, T>> {
+    template<typename E>
+    static void encode(E &e, const std::map<std::string, T> &b) {
+        e.mapStart();
+        if (!b.empty()) {
+            e.setItemCount(b.size());
+            for (typename std::map<std::string, T>::const_iterator it = b.begin(); it != b.end(); ++it) {
+                e.startItem();
+                e.encodeString(it->first);
+                directEncode(e, it->second);
+            }
+        }
+        e.mapEnd();
+    }
+    template<typename D>
+    static void decode(D &d, std::map<std::string, T> &s) {
+        s.clear();
+        std::string k;
+        for (size_t n = d.mapStart(); n != 0; n = d.mapNext()) {
+            for (size_t i = 0; i < n; ++i) {
+                d.decodeString(k);
+                directDecode(d, s[k]);
+            }
+        }
+    }
+};
+
+template<typename T>
+struct direct_codec_traits<std::unordered_map<std::string, T>> {
+    template<typename E>
+    static void encode(E &e, const std::unordered_map<std::string, T> &b) {
+        e.mapStart();
+        if (!b.empty()) {
+            e.setItemCount(b.size());
+            for (const auto &entry : b) {
+                e.startItem();
+                e.encodeString(entry.first);
+                directEncode(e, entry.second);
+            }
+        }
+        e.mapEnd();
+    }
+    template<typename D>
+    static void decode(D &d, std::unordered_map<std::string, T> &s) {
+        s.clear();
+        std::string k;
+        for (size_t n = d.mapStart(); n != 0; n = d.mapNext()) {
+            s.reserve(detail::reserveFor(s.size(), static_cast<size_t>(s.bucket_count() * s.max_load_factor()), n));
+            for (size_t i = 0; i < n; ++i) {
+                d.decodeString(k);
+                directDecode(d, s[k]);
+            }
+        }
+    }
+};
+
+template<>
+struct direct_codec_traits<avro::null> {
+    template<typename E>
+    static void encode(E &e, const avro::null &) {
+        e.encodeNull();
+    }
+    template<typename D>
+    static void decode(D &d, avro::null &) {
+        d.decodeNull();
+    }
+};
+
+#if __cplusplus >= 201703L
+template<typename T>
+struct direct_codec_traits<std::optional<T>> {
+    template<typename E>
+    static void encode(E &e, const std::optional<T> &b) {
+        if (b) {
+            e.encodeUnionIndex(1);
+            directEncode(e, *b);
+        } else {
+            e.encodeUnionIndex(0);
+            e.encodeNull();
+        }
+    }
+    template<typename D>
+    static void decode(D &d, std::optional<T> &s) {
+        switch (d.decodeUnionIndex()) {
+            case 0:
+                d.decodeNull();
+                s.reset();
+                break;
+            case 1:
+                if (!s) {
+                    s.emplace();
+                }
+                directDecode(d, *s);
+                break;
+            default:
+                throw Exception("Union index too big");
+        }
+    }
+};
+#endif
+
+} // namespace avro
+
+#endif
@@ -21,9 +21,16 @@
 
 #include "Config.hh"
 #include <cstdint>
+#include <cstring>
 #include <memory>
 #include <string>
 #include <vector>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+#if __cplusplus >= 202002L
+#include <span>
+#endif
 
 #include "Stream.hh"
 #include "ValidSchema.hh"
@@ -85,6 +92,30 @@ public:
     /// Encodes a UTF-8 string to the current stream.
     virtual void encodeString(const std::string &s) = 0;
 
+    /**
+     * Encodes the UTF-8 string of \p len bytes at \p data, for strings
+     * not held in a std::string. The default makes a std::string of it.
+     */
+    virtual void encodeStringView(const char *data, size_t len) {
+        encodeString(std::string(data, len));
+    }
+
+    /**
+     * Encodes the null-terminated UTF-8 string \p s.
+     */
+    void encodeStringView(const char *s) {
+        encodeStringView(s, std::strlen(s));
+    }
+
+#if __cplusplus >= 201703L
+    /**
+     * Encodes the UTF-8 string \p s without making a std::string of it.
+     */
+    void encodeStringView(std::string_view s) {
+        encodeStringView(s.data(), s.size());
+    }
+#endif
+
     /**
      * Encodes arbitrary binary data into the current stream as Avro "bytes"
      * data type.
@@ -103,6 +134,16 @@ public:
         encodeBytes(bytes.empty() ? &b : bytes.data(), bytes.size());
     }
 
+#if __cplusplus >= 202002L
+    /**
+     * Encodes the binary data \p bytes, held wherever, as Avro "bytes".
+     */
+    void encodeBytes(std::span<const uint8_t> bytes) {
+        uint8_t b = 0;
+        encodeBytes(bytes.empty() ? &b : bytes.data(), bytes.size());
+    }
+#endif
+
     /// Encodes fixed length binary to the current stream.
     virtual void encodeFixed(const uint8_t *bytes, size_t len) = 0;
 
@@ -139,6 +180,42 @@ public:
 
     /// Encodes a branch of a union. The actual value is to follow.
     virtual void encodeUnionIndex(size_t e) = 0;
+
+    /// Encodes \p n 32-bit ints as items of the current array. This is
+    /// the same as calling startItem() and encodeInt() for each of them;
+    /// setItemCount() must already have been called.
+    virtual void encodeIntArray(const int32_t *values, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            startItem();
+            encodeInt(values[i]);
+        }
+    }
+
+    /// Encodes \p n 64-bit ints as items of the current array.
+    virtual void encodeLongArray(const int64_t *values, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            startItem();
+            encodeLong(values[i]);
+        }
+    }
+
+    /// Encodes \p n single-precision floating point numbers as items of
+    /// the current array.
+    virtual void encodeFloatArray(const float *values, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            startItem();
+            encodeFloat(values[i]);
+        }
+    }
+
+    /// Encodes \p n double-precision floating point numbers as items of
+    /// the current array.
+    virtual void encodeDoubleArray(const double *values, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            startItem();
+            encodeDouble(values[i]);
+        }
+    }
 };
 
 /**
@@ -151,9 +228,27 @@ using EncoderPtr = std::shared_ptr<Encoder>;
  */
 AVRO_DECL EncoderPtr binaryEncoder();
 
+/**
+ *  Returns a binary encoder that writes arrays and maps as blocks of at
+ *  most \p blockItems items, each preceded by its negated item count and
+ *  its byte size, so that readers can skip them without decoding their
+ *  items. Each block is buffered until it is complete, so the bytes of
+ *  open arrays and maps reach the stream, and byteCount(), only when
+ *  their blocks do.
+ */
+AVRO_DECL EncoderPtr blockingBinaryEncoder(size_t blockItems = 1024);
+
+/**
+ *  Returns an encoder that writes nothing but counts the bytes that the
+ *  binary encoder would write for the same calls. byteCount() returns
+ *  the count so far; init() starts it afresh and ignores the stream.
+ */
+AVRO_DECL EncoderPtr sizingEncoder();
+
 /**
  *  Returns an encoder that validates sequence of calls to an underlying
- *  Encoder against the given schema.
+ *  Encoder against the given schema. The grammar for the schema is built
+ *  once and cached; see setValidatingCodecCacheCapacity() in Decoder.hh.
  */
 AVRO_DECL EncoderPtr validatingEncoder(const ValidSchema &schema,
                                        const EncoderPtr &base);
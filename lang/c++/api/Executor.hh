@@ -0,0 +1,210 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_Executor_hh__
+#define avro_Executor_hh__
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "Config.hh"
+
+namespace avro {
+
+/**
+ * Runs the tasks of the library's parallel components: compression and
+ * decompression of data file blocks, parallel scans and sorting. Give
+ * them an executor of the application's own, over its thread pool, to
+ * keep the library from starting threads of its own; by default they
+ * share defaultExecutor().
+ *
+ * Tasks never wait for other tasks; a component that waits for its
+ * tasks runs those not yet started itself. Exceptions do not escape
+ * tasks.
+ */
+class AVRO_DECL Executor : boost::noncopyable {
+public:
+    virtual ~Executor();
+
+    /**
+     * Runs \p task, on some thread, some time later.
+     */
+    virtual void submit(std::function<void()> task) = 0;
+
+    /**
+     * How many tasks run at once; components asked for as many threads
+     * as there are cores use this many.
+     */
+    virtual size_t concurrency() const = 0;
+};
+
+typedef std::shared_ptr<Executor> ExecutorPtr;
+
+/**
+ * An executor over a pool of threads of its own, each with a queue of
+ * tasks. A task submitted from one of the threads goes to that thread's
+ * queue, and threads whose queue is empty take tasks from the others.
+ */
+class AVRO_DECL WorkStealingExecutor : public Executor {
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+
+public:
+    /**
+     * Starts \p threads threads, as many as there are cores if zero.
+     */
+    explicit WorkStealingExecutor(size_t threads = 0);
+
+    /**
+     * Starts \p threads threads that run only on the given CPUs, on
+     * Linux; on any if \p cpus is empty. Zero threads is one per CPU.
+     */
+    WorkStealingExecutor(size_t threads, const std::vector<int> &cpus);
+
+    /**
+     * Runs the tasks still queued, and stops the threads.
+     */
+    ~WorkStealingExecutor() override;
+
+    void submit(std::function<void()> task) override;
+
+    size_t concurrency() const override;
+};
+
+/**
+ * The CPUs of each NUMA node of the machine that has any, from
+ * /sys/devices/system/node on Linux. Elsewhere, a single node with no
+ * CPUs listed, which stands for all of them.
+ */
+AVRO_DECL std::vector<std::vector<int>> numaNodes();
+
+/**
+ * An executor with a WorkStealingExecutor per NUMA node, whose threads
+ * run only on the CPUs of their node. The memory a task allocates and
+ * first writes, such as the buffers of a DataFileReader it opens, is
+ * then on the node it runs on. Tasks given to submit() are spread over
+ * the nodes; components that split their work, such as
+ * ParallelDataFileScanner, give each node its own share through node().
+ */
+class AVRO_DECL NumaExecutor : public Executor {
+    std::vector<ExecutorPtr> nodes_;
+    std::atomic<size_t> next_;
+
+public:
+    /**
+     * Starts \p threadsPerNode threads on each node of numaNodes(), or
+     * one per CPU of the node if zero.
+     */
+    explicit NumaExecutor(size_t threadsPerNode = 0);
+
+    /**
+     * Starts \p threadsPerNode threads for each of the given lists of
+     * CPUs, as numaNodes() returns them.
+     */
+    NumaExecutor(const std::vector<std::vector<int>> &nodes, size_t threadsPerNode = 0);
+
+    void submit(std::function<void()> task) override;
+
+    size_t concurrency() const override;
+
+    size_t nodes() const { return nodes_.size(); }
+
+    /**
+     * The executor of node \p i, whose tasks run on its CPUs.
+     */
+    const ExecutorPtr &node(size_t i) const { return nodes_[i]; }
+};
+
+/**
+ * The executor of the components not given one: the one last passed to
+ * setDefaultExecutor(), or a WorkStealingExecutor with a thread per core
+ * started on first use.
+ */
+AVRO_DECL ExecutorPtr defaultExecutor();
+
+/**
+ * Makes \p executor the one returned by defaultExecutor() from now on;
+ * null goes back to the library's own. Components already running keep
+ * the executor they have.
+ */
+AVRO_DECL void setDefaultExecutor(ExecutorPtr executor);
+
+/**
+ * Tasks run on an executor that can be waited for together. At most
+ * \p maxConcurrency of them run at once on the executor. Tasks not yet
+ * started when wait() is called run on the waiting thread, so waiting
+ * finishes even if the executor's threads are all busy, or are waiting
+ * themselves.
+ */
+class AVRO_DECL TaskGroup : boost::noncopyable {
+    struct State;
+
+    const ExecutorPtr executor_;
+    const size_t maxConcurrency_;
+    std::shared_ptr<State> state_;
+
+    static bool runOne(State &s);
+
+public:
+    /**
+     * Runs tasks on \p executor, or defaultExecutor() if null, at most
+     * \p maxConcurrency at once, or the executor's concurrency if zero.
+     */
+    explicit TaskGroup(ExecutorPtr executor = ExecutorPtr(), size_t maxConcurrency = 0);
+
+    /**
+     * Waits for the tasks, dropping their exceptions.
+     */
+    ~TaskGroup();
+
+    /**
+     * Queues \p task. If it throws, the exception is rethrown by wait().
+     */
+    void run(std::function<void()> task);
+
+    /**
+     * Runs the oldest task not yet started on the calling thread.
+     * Returns false if there is none.
+     */
+    bool runPending();
+
+    /**
+     * Drops the tasks not yet started.
+     */
+    void clear();
+
+    /**
+     * Whether a task has thrown.
+     */
+    bool failed() const;
+
+    /**
+     * Waits for all the tasks run so far, then rethrows the first
+     * exception any of them threw.
+     */
+    void wait();
+};
+
+} // namespace avro
+
+#endif
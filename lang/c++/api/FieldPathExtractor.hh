@@ -0,0 +1,133 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_FieldPathExtractor_hh__
+#define avro_FieldPathExtractor_hh__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Config.hh"
+#include "GenericDatum.hh"
+#include "ValidSchema.hh"
+
+/// \file
+/// Finds, and replaces, a nested field of binary encoded records without
+/// decoding the rest of them.
+
+namespace avro {
+
+/**
+ * The encoded bytes of a field within a datum, or null data if the datum
+ * does not have the field.
+ */
+struct FieldSpan {
+    const uint8_t *data;
+    size_t size;
+};
+
+/**
+ * Finds one field of binary encoded data of a record schema, given a
+ * dotted path of field names such as "header.tenant_id". The schema and
+ * path are compiled once, when the extractor is made, into the skips of
+ * the fields before each one on the path, with fields of a fixed width
+ * taken together; finding the field steps over those and nothing else.
+ * A field can be replaced the same way, by putting a new encoding of it
+ * between the bytes before and after it.
+ *
+ * A record on the path may come as a branch of a union, for instance of
+ * null and the record. Data that holds another branch does not have the
+ * field.
+ *
+ * Finding keeps no state, so one extractor can be shared among threads.
+ */
+class AVRO_DECL FieldPathExtractor {
+public:
+    struct Program;
+
+private:
+    std::shared_ptr<const Program> program_;
+
+public:
+    /**
+     * Compiles \p path within \p schema. Throws an Exception if a name on
+     * the path is not that of a field of the record before it.
+     */
+    FieldPathExtractor(const ValidSchema &schema, const std::string &path);
+
+    /**
+     * The schema of the field.
+     */
+    const NodePtr &fieldSchema() const;
+
+    /**
+     * Returns the encoded bytes of the field in the datum encoded at the
+     * start of \p data, to be hashed or compared as they are, or a span
+     * with null data if a union on the path holds another branch. Throws
+     * an Exception if \p data runs out before the field does.
+     */
+    FieldSpan find(const uint8_t *data, size_t len) const;
+
+    /**
+     * Finds the field in each of the \p count data at \p data, of the
+     * lengths at \p lengths, and puts their spans in \p spans.
+     */
+    void find(const uint8_t *const *data, const size_t *lengths,
+              size_t count, FieldSpan *spans) const;
+
+    /**
+     * Decodes the field in the datum encoded at the start of \p data into
+     * \p value. Returns false, leaving \p value as it is, if the datum
+     * does not have the field.
+     */
+    bool extract(const uint8_t *data, size_t len, GenericDatum &value) const;
+
+    /**
+     * Appends to \p out the \p len bytes of \p data, which start with an
+     * encoded datum, with the field replaced by the \p valueLen bytes at
+     * \p value, which must encode a value of the field's schema. Nothing
+     * but the field is decoded: the bytes before and after it are copied
+     * as they are. Returns false, leaving \p out as it is, if the datum
+     * does not have the field.
+     */
+    bool patch(const uint8_t *data, size_t len,
+               const uint8_t *value, size_t valueLen,
+               std::vector<uint8_t> &out) const;
+
+    /**
+     * As the other patch(), with the field replaced by the binary
+     * encoding of \p value.
+     */
+    bool patch(const uint8_t *data, size_t len, const GenericDatum &value,
+               std::vector<uint8_t> &out) const;
+
+    /**
+     * Replaces the field of the datum at the start of \p datum with the
+     * \p valueLen bytes at \p value, in place. Only the bytes after the
+     * field are moved, and only if the new value is not as long as the
+     * old one. Returns false if the datum does not have the field.
+     */
+    bool patchInPlace(std::vector<uint8_t> &datum,
+                      const uint8_t *value, size_t valueLen) const;
+};
+
+} // namespace avro
+
+#endif
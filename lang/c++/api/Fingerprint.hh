@@ -0,0 +1,50 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_Fingerprint_hh__
+#define avro_Fingerprint_hh__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "Config.hh"
+/// \file
+/// Hash functions the Avro specification uses for schema fingerprints.
+/// ValidSchema applies them to its Parsing Canonical Form. Also a fast
+/// hash for encoded values.
+
+namespace avro {
+
+/// The 64-bit Rabin fingerprint, CRC-64-AVRO, used by single-object encoding.
+AVRO_DECL uint64_t rabinFingerprint(const uint8_t *data, size_t len) noexcept;
+
+/// The 128-bit MD5 digest.
+AVRO_DECL std::array<uint8_t, 16> md5Fingerprint(const uint8_t *data, size_t len) noexcept;
+
+/// The 256-bit SHA-256 digest.
+AVRO_DECL std::array<uint8_t, 32> sha256Fingerprint(const uint8_t *data, size_t len) noexcept;
+
+/// The 64-bit wyhash (final version 4) of a buffer, read as little-endian
+/// words on every platform. Not a schema fingerprint, but a fast hash for
+/// binary encoded values; it agrees with the C library's avro_hash_bytes.
+AVRO_DECL uint64_t hash64(const uint8_t *data, size_t len, uint64_t seed = 0) noexcept;
+
+} // namespace avro
+
+#endif
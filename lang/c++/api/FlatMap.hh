@@ -0,0 +1,271 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_FlatMap_hh__
+#define avro_FlatMap_hh__
+
+#include <algorithm>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Config.hh"
+#include "DirectCodec.hh"
+#include "Specific.hh"
+
+namespace avro {
+
+/**
+ * A map from strings to T kept as a vector of entries sorted by key.
+ * Lookups are binary searches, and a whole map is decoded into the
+ * vector and sorted once rather than inserted entry by entry. avrogencpp
+ * generates it for Avro maps with --map-container flat.
+ */
+template<typename T>
+class FlatMap {
+public:
+    typedef std::string key_type;
+    typedef T mapped_type;
+    typedef std::pair<std::string, T> value_type;
+    typedef std::vector<value_type> sequence_type;
+    typedef typename sequence_type::iterator iterator;
+    typedef typename sequence_type::const_iterator const_iterator;
+    typedef size_t size_type;
+
+private:
+    sequence_type items_;
+
+    struct KeyLess {
+        bool operator()(const value_type &entry, const std::string &key) const {
+            return entry.first < key;
+        }
+        bool operator()(const value_type &a, const value_type &b) const {
+            return a.first < b.first;
+        }
+    };
+
+    // Sorts the entries by key, keeping the last of the entries of a key.
+    void normalize() {
+        if (std::adjacent_find(items_.begin(), items_.end(),
+                               [](const value_type &a, const value_type &b) { return !(a.first < b.first); })
+            == items_.end()) {
+            return;
+        }
+        std::stable_sort(items_.begin(), items_.end(), KeyLess());
+        iterator out = items_.begin();
+        for (iterator it = items_.begin(); it != items_.end(); ++it) {
+            if (out != items_.begin() && (out - 1)->first == it->first) {
+                *(out - 1) = std::move(*it);
+            } else {
+                if (out != it) {
+                    *out = std::move(*it);
+                }
+                ++out;
+            }
+        }
+        items_.erase(out, items_.end());
+    }
+
+public:
+    FlatMap() = default;
+
+    FlatMap(std::initializer_list<value_type> items) : items_(items) {
+        normalize();
+    }
+
+    size_t size() const { return items_.size(); }
+    bool empty() const { return items_.empty(); }
+    void clear() { items_.clear(); }
+    void reserve(size_t n) { items_.reserve(n); }
+
+    iterator begin() { return items_.begin(); }
+    iterator end() { return items_.end(); }
+    const_iterator begin() const { return items_.begin(); }
+    const_iterator end() const { return items_.end(); }
+
+    iterator lower_bound(const std::string &key) {
+        return std::lower_bound(items_.begin(), items_.end(), key, KeyLess());
+    }
+
+    const_iterator lower_bound(const std::string &key) const {
+        return std::lower_bound(items_.begin(), items_.end(), key, KeyLess());
+    }
+
+    iterator find(const std::string &key) {
+        iterator it = lower_bound(key);
+        return it != items_.end() && it->first == key ? it : items_.end();
+    }
+
+    const_iterator find(const std::string &key) const {
+        const_iterator it = lower_bound(key);
+        return it != items_.end() && it->first == key ? it : items_.end();
+    }
+
+    size_t count(const std::string &key) const {
+        return find(key) == items_.end() ? 0 : 1;
+    }
+
+    T &at(const std::string &key) {
+        iterator it = find(key);
+        if (it == items_.end()) {
+            throw std::out_of_range("No such key in FlatMap: " + key);
+        }
+        return it->second;
+    }
+
+    const T &at(const std::string &key) const {
+        const_iterator it = find(key);
+        if (it == items_.end()) {
+            throw std::out_of_range("No such key in FlatMap: " + key);
+        }
+        return it->second;
+    }
+
+    T &operator[](const std::string &key) {
+        iterator it = lower_bound(key);
+        if (it == items_.end() || it->first != key) {
+            it = items_.emplace(it, key, T());
+        }
+        return it->second;
+    }
+
+    std::pair<iterator, bool> insert(value_type entry) {
+        iterator it = lower_bound(entry.first);
+        if (it != items_.end() && it->first == entry.first) {
+            return std::make_pair(it, false);
+        }
+        return std::make_pair(items_.insert(it, std::move(entry)), true);
+    }
+
+    size_t erase(const std::string &key) {
+        iterator it = find(key);
+        if (it == items_.end()) {
+            return 0;
+        }
+        items_.erase(it);
+        return 1;
+    }
+
+    iterator erase(const_iterator it) {
+        return items_.erase(it);
+    }
+
+    /**
+     * Replaces the entries with the given ones, in any order. Of several
+     * entries with the same key, the last one is kept, as when they are
+     * assigned one by one.
+     */
+    void assign(sequence_type &&items) {
+        items_ = std::move(items);
+        normalize();
+    }
+
+    /**
+     * Takes the entries out, leaving the map empty. Decoding refills the
+     * vector and assign()s it back, reusing its capacity.
+     */
+    sequence_type extract() {
+        sequence_type result;
+        result.swap(items_);
+        return result;
+    }
+
+    bool operator==(const FlatMap &other) const {
+        return items_ == other.items_;
+    }
+
+    bool operator!=(const FlatMap &other) const {
+        return items_ != other.items_;
+    }
+};
+
+/**
+ * codec_traits for Avro maps held in a FlatMap.
+ */
+template<typename T>
+struct codec_traits<FlatMap<T>> {
+    /**
+     * Encodes a given value.
+     */
+    static void encode(Encoder &e, const FlatMap<T> &b) {
+        e.mapStart();
+        if (!b.empty()) {
+            e.setItemCount(b.size());
+            for (const auto &entry : b) {
+                e.startItem();
+                avro::encode(e, entry.first);
+                avro::encode(e, entry.second);
+            }
+        }
+        e.mapEnd();
+    }
+
+    /**
+     * Decodes into a given value.
+     */
+    static void decode(Decoder &d, FlatMap<T> &s) {
+        typename FlatMap<T>::sequence_type items = s.extract();
+        items.clear();
+        for (size_t n = d.mapStart(); n != 0; n = d.mapNext()) {
+            items.reserve(detail::reserveFor(items.size(), items.capacity(), n));
+            for (size_t i = 0; i < n; ++i) {
+                items.emplace_back();
+                avro::decode(d, items.back().first);
+                avro::decode(d, items.back().second);
+            }
+        }
+        s.assign(std::move(items));
+    }
+};
+
+template<typename T>
+struct direct_codec_traits<FlatMap<T>> {
+    template<typename E>
+    static void encode(E &e, const FlatMap<T> &b) {
+        e.mapStart();
+        if (!b.empty()) {
+            e.setItemCount(b.size());
+            for (const auto &entry : b) {
+                e.startItem();
+                e.encodeString(entry.first);
+                directEncode(e, entry.second);
+            }
+        }
+        e.mapEnd();
+    }
+    template<typename D>
+    static void decode(D &d, FlatMap<T> &s) {
+        typename FlatMap<T>::sequence_type items = s.extract();
+        items.clear();
+        for (size_t n = d.mapStart(); n != 0; n = d.mapNext()) {
+            items.reserve(detail::reserveFor(items.size(), items.capacity(), n));
+            for (size_t i = 0; i < n; ++i) {
+                items.emplace_back();
+                d.decodeString(items.back().first);
+                directDecode(d, items.back().second);
+            }
+        }
+        s.assign(std::move(items));
+    }
+};
+
+} // namespace avro
+
+#endif
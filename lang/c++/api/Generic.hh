@@ -19,6 +19,11 @@
 #ifndef avro_Generic_hh__
 #define avro_Generic_hh__
 
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
 #include <boost/utility.hpp>
 
 #include "Config.hh"
@@ -28,15 +33,22 @@
 #include "Types.hh"
 
 namespace avro {
+
+class CompiledGenericReader;
+class CompiledGenericWriter;
+
 /**
- * A utility class to read generic datum from decoders.
+ * A utility class to read generic datum from decoders. The members
+ * reading from the reader's decoder follow a CompiledGenericReader made
+ * for its schema; the static ones walk the datum's schema as they go.
  */
 class AVRO_DECL GenericReader : boost::noncopyable {
     const ValidSchema schema_;
     const bool isResolving_;
     const DecoderPtr decoder_;
+    const std::unique_ptr<CompiledGenericReader> compiled_;
 
-    static void read(GenericDatum &datum, Decoder &d, bool isResolving);
+    static void read(GenericDatum &datum, Decoder &d, bool isResolving, bool inPlace);
 
 public:
     /**
@@ -48,15 +60,42 @@ public:
      * Constructs a reader for the given reader's schema \c readerSchema
      * using the given
      * decoder which holds data matching writer's schema \c writerSchema.
+     * If the two schemas have the same encoding, the decoder is read
+     * as it is, without resolution.
      */
     GenericReader(const ValidSchema &writerSchema,
                   const ValidSchema &readerSchema, const DecoderPtr &decoder);
 
+    ~GenericReader();
+
     /**
      * Reads a value off the decoder.
      */
     void read(GenericDatum &datum) const;
 
+    /**
+     * Reads a value off the decoder into a datum placed in \p arena.
+     * Allocating the tree of datums is then mostly bumping a pointer and
+     * releasing it, after the datum is destroyed, a reset() of the arena.
+     */
+    void read(GenericDatum &datum, Arena &arena) const;
+
+    /**
+     * Reads a value off the decoder into \p datum, which must already hold
+     * a value of the reader's schema, such as the one from the previous
+     * read. Strings, bytes, array and map items, records and union branches
+     * already in the datum are read into rather than replaced, so reading
+     * a run of similar values into the same datum hardly allocates.
+     */
+    void readInPlace(GenericDatum &datum) const;
+
+    /**
+     * Makes the strings read at \p path shared through a dictionary of
+     * up to \p capacity distinct values; see
+     * CompiledGenericReader::internStrings().
+     */
+    const StringDictionary &internStrings(const std::string &path, size_t capacity = 1024);
+
     /**
      * Drains any residual bytes in the input stream (e.g. because
      * reader's schema has no use of them) and return unused bytes
@@ -74,14 +113,215 @@ public:
      * Reads a generic datum from the stream, using the given schema.
      */
     static void read(Decoder &d, GenericDatum &g, const ValidSchema &s);
+
+    /**
+     * Reads a generic datum from the stream into \p g, which must already
+     * hold a value of the schema the data is read as; see
+     * the member readInPlace().
+     */
+    static void readInPlace(Decoder &d, GenericDatum &g);
 };
 
 /**
- * A utility class to write generic datum to encoders.
+ * Reads generic datums like GenericReader, but works out once, when it is
+ * constructed, how each value of the schema is read. Each node of the
+ * schema gets its read routine ahead of time, so reading a value calls
+ * those routines in turn rather than switching on the type of every
+ * datum. With a writer's schema, the resolution is compiled too, through
+ * compiledResolvingDecoder(). This suits schemas that are only known at
+ * run time, for which avrogencpp cannot generate code.
+ */
+class AVRO_DECL CompiledGenericReader : boost::noncopyable {
+public:
+    struct Step;
+
+private:
+    const ValidSchema schema_;
+    const bool isResolving_;
+    // True if the decoder comes from compiledResolvingDecoder(), whose
+    // field orders stay put while nested records are read.
+    const bool compiledResolution_;
+    const DecoderPtr decoder_;
+    // What read() starts each value from.
+    const GenericDatumPrototype prototype_;
+    // The routines of the schema's nodes; recursive schemas refer back
+    // to earlier steps.
+    std::vector<std::unique_ptr<Step>> steps_;
+    const Step *root_;
+
+    const Step *compile(const NodePtr &node, std::map<const Node *, const Step *> &named);
+
+public:
+    /**
+     * Constructs a reader for the given schema using the given decoder.
+     */
+    CompiledGenericReader(const ValidSchema &schema, const DecoderPtr &decoder);
+
+    /**
+     * Constructs a reader for the reader's schema \p readerSchema, of
+     * data written with \p writerSchema, using the given decoder, which
+     * is only resolved if the schemas differ in their encoding.
+     */
+    CompiledGenericReader(const ValidSchema &writerSchema,
+                          const ValidSchema &readerSchema, const DecoderPtr &decoder);
+
+    ~CompiledGenericReader();
+
+    /**
+     * Reads a value off the decoder.
+     */
+    void read(GenericDatum &datum) const;
+
+    /**
+     * Reads a value off the decoder into a datum placed in \p arena; see
+     * GenericReader::read().
+     */
+    void read(GenericDatum &datum, Arena &arena) const;
+
+    /**
+     * Reads a value off the decoder into \p datum, which must already
+     * hold a value of the reader's schema; see
+     * GenericReader::readInPlace().
+     */
+    void readInPlace(GenericDatum &datum) const;
+
+    /**
+     * Makes the strings read at \p path shared: each distinct value is
+     * kept, up to \p capacity of them, in a dictionary looked up by its
+     * encoded bytes, and the datums read get that value rather than a copy
+     * of their own; see GenericDatum::shareString(). This suits fields
+     * with few distinct values, whose datums then take neither an
+     * allocation nor a copy to read, nor memory of their own to hold.
+     *
+     * \p path names record fields from the root, separated by dots, with
+     * "[]" for the items of an array and "{}" for the values of a map,
+     * such as "region", "address.country" or "tags[]"; unions on the way
+     * are passed through. Records of one name share their steps, so every
+     * place a named record is read shares the dictionary too. Returns the
+     * dictionary, for its counts, and throws if \p path does not lead to
+     * a string.
+     */
+    const StringDictionary &internStrings(const std::string &path, size_t capacity = 1024);
+
+    /**
+     * See GenericReader::drain().
+     */
+    void drain() {
+        decoder_->drain();
+    }
+};
+
+/**
+ * A record held in its binary encoding, whose fields are decoded only
+ * when they are asked for. Where a field's value starts is worked out the
+ * first time a field at or after it is needed, by skipping over the
+ * fields before it, and remembered; the offsets of the fields after a
+ * leading run of fixed-width fields are known without reading anything.
+ * Decoded fields are kept, so asking again costs nothing. This suits
+ * wide records of which only a few fields, chosen at run time, are read.
+ */
+class AVRO_DECL LazyGenericRecord : boost::noncopyable {
+    const NodePtr schema_;
+    const std::vector<uint8_t> data_;
+    const InputStreamPtr in_;
+    const DecoderPtr decoder_;
+    // The offsets into data_ of the fields found so far, in field order.
+    mutable std::vector<size_t> offsets_;
+    mutable std::vector<GenericDatum> fields_;
+    mutable std::vector<bool> decoded_;
+
+    size_t offsetAt(size_t pos) const;
+
+public:
+    /**
+     * Constructs a record of the schema \p schema, which should be of
+     * Avro type record, over its binary encoding \p data.
+     */
+    LazyGenericRecord(const NodePtr &schema, std::vector<uint8_t> data);
+
+    /**
+     * Constructs a record of the root of \p schema over its binary
+     * encoding \p data.
+     */
+    LazyGenericRecord(const ValidSchema &schema, std::vector<uint8_t> data);
+
+    /**
+     * Returns the schema of the record.
+     */
+    const NodePtr &schema() const {
+        return schema_;
+    }
+
+    /**
+     * Returns the encoding the record was constructed over.
+     */
+    const std::vector<uint8_t> &data() const {
+        return data_;
+    }
+
+    /**
+     * Returns the number of fields in the record.
+     */
+    size_t fieldCount() const {
+        return schema_->leaves();
+    }
+
+    /**
+     * Returns index of the field with the given name \p name.
+     */
+    size_t fieldIndex(const std::string &name) const {
+        size_t index = 0;
+        if (!schema_->nameIndex(name, index)) {
+            throw Exception("Invalid field name: " + name);
+        }
+        return index;
+    }
+
+    /**
+     * Returns true if a field with the given name \p name is located in
+     * this record, false otherwise.
+     */
+    bool hasField(const std::string &name) const {
+        size_t index = 0;
+        return schema_->nameIndex(name, index);
+    }
+
+    /**
+     * Returns the field with the given name \p name, decoding it if it
+     * has not been yet.
+     */
+    const GenericDatum &field(const std::string &name) const {
+        return fieldAt(fieldIndex(name));
+    }
+
+    /**
+     * Returns the field at the given position \p pos, decoding it if it
+     * has not been yet.
+     */
+    const GenericDatum &fieldAt(size_t pos) const;
+
+    /**
+     * Returns true if the field at position \p pos has been decoded.
+     */
+    bool isDecoded(size_t pos) const {
+        return decoded_[pos];
+    }
+
+    /**
+     * Returns the whole record, decoding the fields that have not been yet.
+     */
+    GenericRecord record() const;
+};
+
+/**
+ * A utility class to write generic datum to encoders. The member writing
+ * to the writer's encoder follows a CompiledGenericWriter made for its
+ * schema; the static ones walk the datum as they go.
  */
 class AVRO_DECL GenericWriter : boost::noncopyable {
     const ValidSchema schema_;
     const EncoderPtr encoder_;
+    const std::unique_ptr<CompiledGenericWriter> compiled_;
 
     static void write(const GenericDatum &datum, Encoder &e);
 
@@ -91,6 +331,8 @@ public:
      */
     GenericWriter(ValidSchema s, EncoderPtr encoder);
 
+    ~GenericWriter();
+
     /**
      * Writes a value onto the encoder.
      */
@@ -110,6 +352,89 @@ public:
     }
 };
 
+/**
+ * Writes generic datums like GenericWriter, but works out once, when it
+ * is constructed, how each value of the schema is written, as
+ * CompiledGenericReader does for reading. Record fields are written by
+ * index through the steps of their schemas, and union branches through
+ * the step of the branch the datum holds, without asking any datum for
+ * its type. If the encoder is a BinaryEncoder, the steps call its final
+ * primitives, which write straight to its stream, rather than going
+ * through the virtual table. The datums written must be of the schema.
+ */
+class AVRO_DECL CompiledGenericWriter : boost::noncopyable {
+public:
+    struct Step;
+
+private:
+    const ValidSchema schema_;
+    const EncoderPtr encoder_;
+    // The routines of the schema's nodes; recursive schemas refer back
+    // to earlier steps.
+    std::vector<std::unique_ptr<Step>> steps_;
+    const Step *root_;
+
+    template<typename E>
+    const Step *compile(const NodePtr &node, std::map<const Node *, const Step *> &named);
+
+public:
+    /**
+     * Constructs a writer for the given schema using the given encoder.
+     */
+    CompiledGenericWriter(const ValidSchema &schema, const EncoderPtr &encoder);
+
+    ~CompiledGenericWriter();
+
+    /**
+     * Writes a value onto the encoder.
+     */
+    void write(const GenericDatum &datum) const;
+};
+
+/**
+ * Works out the size of the binary encoding of generic datums without
+ * encoding them, to pack records into frames or blocks of a given size.
+ * What is sized is the encoding as BinaryEncoder writes it: lengths of
+ * strings and bytes, the varints of numbers, counts and indices, and the
+ * fixed widths of the rest. Parts of the schema whose encoding always
+ * has the same size are summed once, when the estimator is constructed,
+ * and are not visited at all; for a schema that is all such parts,
+ * size() costs nothing. The datums sized must be of the schema.
+ */
+class AVRO_DECL GenericSizeEstimator : boost::noncopyable {
+public:
+    struct Step;
+
+private:
+    const ValidSchema schema_;
+    std::vector<std::unique_ptr<Step>> steps_;
+    const Step *root_;
+
+    const Step *compile(const NodePtr &node, std::map<const Node *, const Step *> &named);
+
+public:
+    explicit GenericSizeEstimator(const ValidSchema &schema);
+
+    ~GenericSizeEstimator();
+
+    /**
+     * Whether every datum of the schema encodes to the same size.
+     */
+    bool fixedSize() const;
+
+    /**
+     * Returns the size of the binary encoding of \p datum.
+     */
+    size_t size(const GenericDatum &datum) const;
+};
+
+/**
+ * Hashes the binary encoding of a datum with hash64, so a datum hashes
+ * the same as its encoded bytes, here or through the C library's
+ * avro_binary_hash. Maps hash in the order of their entries.
+ */
+AVRO_DECL uint64_t hashDatum(const GenericDatum &datum, uint64_t seed = 0);
+
 template<typename T>
 struct codec_traits;
 
@@ -149,4 +474,16 @@ struct codec_traits<GenericDatum> {
 };
 
 } // namespace avro
+
+namespace std {
+
+/// Hashes generic datums with avro::hashDatum.
+template<>
+struct hash<avro::GenericDatum> {
+    size_t operator()(const avro::GenericDatum &datum) const {
+        return static_cast<size_t>(avro::hashDatum(datum));
+    }
+};
+
+} // namespace std
 #endif
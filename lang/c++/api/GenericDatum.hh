@@ -19,23 +19,324 @@
 #ifndef avro_GenericDatum_hh__
 #define avro_GenericDatum_hh__
 
+#include <atomic>
 #include <cstdint>
+#include <cstring>
 #include <map>
+#include <new>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
-#if __cplusplus >= 201703L
-#include <any>
-#else
-#include "boost/any.hpp"
-#endif
-
+#include "Arena.hh"
 #include "LogicalType.hh"
 #include "Node.hh"
+#include "StringDictionary.hh"
 #include "ValidSchema.hh"
 
 namespace avro {
 
+namespace detail {
+
+/// Whether values of type T are held inline in DatumValue.
+template<typename T>
+struct IsInlineDatumValue : std::false_type {};
+
+template<>
+struct IsInlineDatumValue<bool> : std::true_type {};
+
+template<>
+struct IsInlineDatumValue<int32_t> : std::true_type {};
+
+template<>
+struct IsInlineDatumValue<int64_t> : std::true_type {};
+
+template<>
+struct IsInlineDatumValue<float> : std::true_type {};
+
+template<>
+struct IsInlineDatumValue<double> : std::true_type {};
+
+} // namespace detail
+
+class GenericRecord;
+class GenericArray;
+class GenericMap;
+class GenericEnum;
+class GenericFixed;
+
+namespace detail {
+
+/// The Avro type of the datums whose values are of type T.
+template<typename T>
+struct DatumType;
+
+template<>
+struct DatumType<bool> : std::integral_constant<Type, AVRO_BOOL> {};
+
+template<>
+struct DatumType<int32_t> : std::integral_constant<Type, AVRO_INT> {};
+
+template<>
+struct DatumType<int64_t> : std::integral_constant<Type, AVRO_LONG> {};
+
+template<>
+struct DatumType<float> : std::integral_constant<Type, AVRO_FLOAT> {};
+
+template<>
+struct DatumType<double> : std::integral_constant<Type, AVRO_DOUBLE> {};
+
+template<>
+struct DatumType<std::string> : std::integral_constant<Type, AVRO_STRING> {};
+
+template<>
+struct DatumType<std::vector<uint8_t>> : std::integral_constant<Type, AVRO_BYTES> {};
+
+template<>
+struct DatumType<GenericRecord> : std::integral_constant<Type, AVRO_RECORD> {};
+
+template<>
+struct DatumType<GenericArray> : std::integral_constant<Type, AVRO_ARRAY> {};
+
+template<>
+struct DatumType<GenericMap> : std::integral_constant<Type, AVRO_MAP> {};
+
+template<>
+struct DatumType<GenericEnum> : std::integral_constant<Type, AVRO_ENUM> {};
+
+template<>
+struct DatumType<GenericFixed> : std::integral_constant<Type, AVRO_FIXED> {};
+
+/**
+ * A value of type T, counted by reference, that the datums sharing it
+ * hold in place of values of their own; see GenericDatum::share(). It is
+ * a T underneath, so that datums hand out the value itself.
+ */
+template<typename T>
+class SharedValue : public T {
+    std::atomic<size_t> refs_;
+
+public:
+    explicit SharedValue(T &&v) : T(std::move(v)), refs_(1) {}
+
+    SharedValue(const SharedValue &) = delete;
+    SharedValue &operator=(const SharedValue &) = delete;
+
+    /**
+     * Returns the shared value whose T is \p p.
+     */
+    static SharedValue *of(const T *p) {
+        return static_cast<SharedValue *>(const_cast<T *>(p));
+    }
+
+    void retain() {
+        refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release() {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+};
+
+/**
+ * Holds the value of a GenericDatum without RTTI; the datum's type says
+ * what the value is. Booleans and numbers are kept inline. Anything else
+ * is behind a pointer, on the heap or in an Arena; a value in an arena is
+ * only destroyed on release, its memory goes with the arena. Copies always
+ * go to the heap, because their lifetime is not tied to the arena; moves
+ * keep the storage. A value other than a boolean or a number may also be
+ * shared, a SharedString or a SharedValue, which copies share, and which
+ * is copied into a value of its own before it is handed out to be
+ * changed.
+ */
+class DatumValue {
+    struct Ops {
+        void (*destroy)(void *p);
+        void *(*copy)(const void *p);
+        // True if the value is shared, and not freed here.
+        bool shared;
+    };
+
+    template<typename T>
+    struct OpsFor {
+        static void destroy(void *p) {
+            static_cast<T *>(p)->~T();
+        }
+
+        static void *copy(const void *p) {
+            return new (::operator new(sizeof(T))) T(*static_cast<const T *>(p));
+        }
+
+        static const Ops ops;
+    };
+
+    // H is SharedString or SharedValue<T>, and the value a T within it.
+    template<typename H, typename T>
+    struct SharedOpsFor {
+        static void destroy(void *p) {
+            H::of(static_cast<const T *>(p))->release();
+        }
+
+        static void *copy(const void *p) {
+            H::of(static_cast<const T *>(p))->retain();
+            return const_cast<void *>(p);
+        }
+
+        static const Ops ops;
+    };
+
+    union {
+        void *ptr_;
+        int64_t long_;
+        double double_;
+        unsigned char inline_[sizeof(int64_t)];
+    };
+    // Null for inline values and the null datum.
+    const Ops *ops_;
+    Arena *arena_;
+
+    void release() {
+        if (ops_ != nullptr) {
+            ops_->destroy(ptr_);
+            if (arena_ == nullptr && !ops_->shared) {
+                ::operator delete(ptr_);
+            }
+            ops_ = nullptr;
+        }
+    }
+
+    template<typename T>
+    void setValue(T &&v, std::true_type) {
+        typedef typename std::decay<T>::type U;
+        release();
+        new (inline_) U(v);
+    }
+
+    template<typename T>
+    void setValue(T &&v, std::false_type) {
+        typedef typename std::decay<T>::type U;
+        void *p = (arena_ != nullptr) ? arena_->allocate(sizeof(U), alignof(U)) : ::operator new(sizeof(U));
+        try {
+            new (p) U(std::forward<T>(v));
+        } catch (...) {
+            if (arena_ == nullptr) {
+                ::operator delete(p);
+            }
+            throw;
+        }
+        release();
+        ptr_ = p;
+        ops_ = &OpsFor<U>::ops;
+    }
+
+    template<typename T>
+    T &getValue(std::true_type) {
+        return *reinterpret_cast<T *>(inline_);
+    }
+
+    template<typename T>
+    T &getValue(std::false_type) {
+        return *static_cast<T *>(ptr_);
+    }
+
+public:
+    explicit DatumValue(Arena *arena = nullptr) : long_(0), ops_(nullptr), arena_(arena) {}
+
+    DatumValue(const DatumValue &other) : long_(other.long_), ops_(other.ops_), arena_(nullptr) {
+        if (ops_ != nullptr) {
+            ptr_ = ops_->copy(other.ptr_);
+        }
+    }
+
+    DatumValue(DatumValue &&other) noexcept : long_(other.long_), ops_(other.ops_),
+                                              arena_(other.arena_) {
+        other.ops_ = nullptr;
+    }
+
+    ~DatumValue() {
+        release();
+    }
+
+    DatumValue &operator=(const DatumValue &other) {
+        if (this != &other) {
+            DatumValue tmp(other);
+            *this = std::move(tmp);
+        }
+        return *this;
+    }
+
+    DatumValue &operator=(DatumValue &&other) noexcept {
+        if (this != &other) {
+            release();
+            long_ = other.long_;
+            ops_ = other.ops_;
+            arena_ = other.arena_;
+            other.ops_ = nullptr;
+        }
+        return *this;
+    }
+
+    /// Replaces the value by \p v.
+    template<typename T>
+    void set(T &&v) {
+        setValue(std::forward<T>(v), IsInlineDatumValue<typename std::decay<T>::type>());
+    }
+
+    /// Replaces the value by the string of \p s, which it keeps a
+    /// reference to.
+    void setShared(SharedString *s) {
+        s->retain();
+        release();
+        ptr_ = const_cast<std::string *>(&s->str());
+        ops_ = &SharedOpsFor<SharedString, std::string>::ops;
+    }
+
+    /// Moves the value, of type T, into a SharedValue, unless it is
+    /// shared already.
+    template<typename T>
+    void share() {
+        if (!isShared()) {
+            SharedValue<T> *h = new SharedValue<T>(std::move(getValue<T>(std::false_type())));
+            release();
+            ptr_ = static_cast<T *>(h);
+            ops_ = &SharedOpsFor<SharedValue<T>, T>::ops;
+        }
+    }
+
+    /// Whether the value is a string shared with other values.
+    bool isShared() const {
+        return ops_ != nullptr && ops_->shared;
+    }
+
+    template<typename T>
+    T &get() {
+        if (!IsInlineDatumValue<T>::value && isShared()) {
+            set(T(getValue<T>(std::false_type())));
+        }
+        return getValue<T>(IsInlineDatumValue<T>());
+    }
+
+    template<typename T>
+    const T &get() const {
+        return const_cast<DatumValue *>(this)->getValue<T>(IsInlineDatumValue<T>());
+    }
+
+    Arena *arena() const {
+        return arena_;
+    }
+};
+
+template<typename T>
+const DatumValue::Ops DatumValue::OpsFor<T>::ops = {&DatumValue::OpsFor<T>::destroy, &DatumValue::OpsFor<T>::copy, false};
+
+template<typename H, typename T>
+const DatumValue::Ops DatumValue::SharedOpsFor<H, T>::ops = {&DatumValue::SharedOpsFor<H, T>::destroy, &DatumValue::SharedOpsFor<H, T>::copy, true};
+
+} // namespace detail
+
 /**
  * Generic datum which can hold any Avro type. The datum has a type
  * and a value. The type is one of the Avro data types. The C++ type for
@@ -62,11 +363,7 @@ class AVRO_DECL GenericDatum {
 protected:
     Type type_;
     LogicalType logicalType_;
-#if __cplusplus >= 201703L
-    std::any value_;
-#else
-    boost::any value_;
-#endif
+    detail::DatumValue value_;
 
     explicit GenericDatum(Type t)
         : type_(t), logicalType_(LogicalType::NONE) {}
@@ -76,10 +373,15 @@ protected:
 
     template<typename T>
     GenericDatum(Type t, LogicalType logicalType, const T &v)
-        : type_(t), logicalType_(logicalType), value_(v) {}
+        : type_(t), logicalType_(logicalType) {
+        value_.set(v);
+    }
 
     void init(const NodePtr &schema);
 
+    // Out of line, so that value() stays a comparison.
+    [[noreturn]] void throwTypeMismatch(Type requested) const;
+
 public:
     /**
      * The avro data type this datum holds.
@@ -94,7 +396,7 @@ public:
     /**
      * Returns the value held by this datum.
      * T The type for the value. This must correspond to the
-     * avro type returned by type().
+     * avro type returned by type(); if not, an Exception is thrown.
      */
     template<typename T>
     const T &value() const;
@@ -106,11 +408,38 @@ public:
      * be changed.
      *
      * T The type for the value. This must correspond to the
-     * avro type returned by type().
+     * avro type returned by type(); if not, an Exception is thrown.
      */
     template<typename T>
     T &value();
 
+    /**
+     * Makes this datum, which must be of Avro type string (or a union
+     * whose current branch is), hold the string of \p s without copying
+     * it. Copies of the datum share it too. The non-const value() gives
+     * the datum a string of its own first, so that changing it leaves the
+     * shared one alone.
+     */
+    void shareString(SharedString *s);
+
+    /**
+     * Makes the value of this datum, and the values within it, shared by
+     * the copies made of the datum from then on, so that copying it only
+     * counts a reference, however deep the value. Changing a copy through
+     * the non-const value() gives it a value of its own first, which
+     * copies one level and leaves the levels below it shared, so the
+     * other copies keep theirs. This suits handing one record to several
+     * consumers. Booleans, numbers and enums are copied as they are.
+     */
+    void share();
+
+    /**
+     * Returns true if the value of this datum is shared with others.
+     */
+    bool isShared() const {
+        return value_.isShared();
+    }
+
     /**
      * Returns true if and only if this datum is a union.
      */
@@ -135,43 +464,70 @@ public:
     /// We don't make this explicit constructor because we want to allow automatic conversion
     // NOLINTNEXTLINE(google-explicit-constructor)
     GenericDatum(bool v)
-        : type_(AVRO_BOOL), logicalType_(LogicalType::NONE), value_(v) {}
+        : type_(AVRO_BOOL), logicalType_(LogicalType::NONE) {
+        value_.set(v);
+    }
 
     /// Makes a new AVRO_INT datum whose value is of type int32_t.
     /// We don't make this explicit constructor because we want to allow automatic conversion
     // NOLINTNEXTLINE(google-explicit-constructor)
     GenericDatum(int32_t v)
-        : type_(AVRO_INT), logicalType_(LogicalType::NONE), value_(v) {}
+        : type_(AVRO_INT), logicalType_(LogicalType::NONE) {
+        value_.set(v);
+    }
 
     /// Makes a new AVRO_LONG datum whose value is of type int64_t.
     /// We don't make this explicit constructor because we want to allow automatic conversion
     // NOLINTNEXTLINE(google-explicit-constructor)
     GenericDatum(int64_t v)
-        : type_(AVRO_LONG), logicalType_(LogicalType::NONE), value_(v) {}
+        : type_(AVRO_LONG), logicalType_(LogicalType::NONE) {
+        value_.set(v);
+    }
 
     /// Makes a new AVRO_FLOAT datum whose value is of type float.
     /// We don't make this explicit constructor because we want to allow automatic conversion
     // NOLINTNEXTLINE(google-explicit-constructor)
     GenericDatum(float v)
-        : type_(AVRO_FLOAT), logicalType_(LogicalType::NONE), value_(v) {}
+        : type_(AVRO_FLOAT), logicalType_(LogicalType::NONE) {
+        value_.set(v);
+    }
 
     /// Makes a new AVRO_DOUBLE datum whose value is of type double.
     /// We don't make this explicit constructor because we want to allow automatic conversion
     // NOLINTNEXTLINE(google-explicit-constructor)
     GenericDatum(double v)
-        : type_(AVRO_DOUBLE), logicalType_(LogicalType::NONE), value_(v) {}
+        : type_(AVRO_DOUBLE), logicalType_(LogicalType::NONE) {
+        value_.set(v);
+    }
 
     /// Makes a new AVRO_STRING datum whose value is of type std::string.
     /// We don't make this explicit constructor because we want to allow automatic conversion
     // NOLINTNEXTLINE(google-explicit-constructor)
     GenericDatum(const std::string &v)
-        : type_(AVRO_STRING), logicalType_(LogicalType::NONE), value_(v) {}
+        : type_(AVRO_STRING), logicalType_(LogicalType::NONE) {
+        value_.set(v);
+    }
+
+    /// Makes a new AVRO_STRING datum that takes over the string \p v.
+    // NOLINTNEXTLINE(google-explicit-constructor)
+    GenericDatum(std::string &&v)
+        : type_(AVRO_STRING), logicalType_(LogicalType::NONE) {
+        value_.set(std::move(v));
+    }
 
     /// Makes a new AVRO_BYTES datum whose value is of type
     /// std::vector<uint8_t>.
     /// We don't make this explicit constructor because we want to allow automatic conversion
     // NOLINTNEXTLINE(google-explicit-constructor)
-    GenericDatum(const std::vector<uint8_t> &v) : type_(AVRO_BYTES), logicalType_(LogicalType::NONE), value_(v) {}
+    GenericDatum(const std::vector<uint8_t> &v) : type_(AVRO_BYTES), logicalType_(LogicalType::NONE) {
+        value_.set(v);
+    }
+
+    /// Makes a new AVRO_BYTES datum that takes over the bytes \p v.
+    // NOLINTNEXTLINE(google-explicit-constructor)
+    GenericDatum(std::vector<uint8_t> &&v) : type_(AVRO_BYTES), logicalType_(LogicalType::NONE) {
+        value_.set(std::move(v));
+    }
 
     /**
      * Constructs a datum corresponding to the given avro type.
@@ -187,16 +543,13 @@ public:
      * Constructs a datum corresponding to the given avro type and set
      * the value.
      * \param schema The schema that defines the avro type.
-     * \param v The value for this type.
+     * \param v The value for this type, which is moved from if it is an
+     * rvalue.
      */
     template<typename T>
-    GenericDatum(const NodePtr &schema, const T &v) : type_(schema->type()), logicalType_(schema->logicalType()) {
+    GenericDatum(const NodePtr &schema, T &&v) : type_(schema->type()), logicalType_(schema->logicalType()) {
         init(schema);
-#if __cplusplus >= 201703L
-        *std::any_cast<T>(&value_) = v;
-#else
-        *boost::any_cast<T>(&value_) = v;
-#endif
+        value_.get<typename std::decay<T>::type>() = std::forward<T>(v);
     }
 
     /**
@@ -206,6 +559,27 @@ public:
      * \param schema The schema that defines the avro type.
      */
     explicit GenericDatum(const ValidSchema &schema);
+
+    /**
+     * Constructs a datum for the given schema whose value, and the values
+     * of any records and unions within, are placed in \p arena. Datums
+     * that GenericReader adds to arrays and maps within go there too.
+     * The datum must be destroyed before the arena is reset.
+     */
+    GenericDatum(const NodePtr &schema, Arena *arena);
+
+    /**
+     * Constructs a datum for the given schema in \p arena.
+     */
+    GenericDatum(const ValidSchema &schema, Arena &arena);
+
+    /**
+     * Returns the arena the value of this datum is in, or nullptr if it is
+     * on the heap.
+     */
+    Arena *arena() const {
+        return value_.arena();
+    }
 };
 
 /**
@@ -236,17 +610,36 @@ public:
 class AVRO_DECL GenericUnion : public GenericContainer {
     size_t curBranch_;
     GenericDatum datum_;
+    Arena *arena_;
 
 public:
     /**
      * Constructs a generic union corresponding to the given schema \p schema,
      * and the given value. The schema should be of Avro type union
      * and the value should correspond to one of the branches of the union.
+     * The branches selected are placed in \p arena, if given.
      */
-    explicit GenericUnion(const NodePtr &schema) : GenericContainer(AVRO_UNION, schema), curBranch_(schema->leaves()) {
+    explicit GenericUnion(const NodePtr &schema, Arena *arena = nullptr) : GenericContainer(AVRO_UNION, schema), curBranch_(schema->leaves()),
+                                                                           arena_(arena) {
         selectBranch(0);
     }
 
+    // A copy is on the heap, so it places its branches there too.
+    GenericUnion(const GenericUnion &other) : GenericContainer(other), curBranch_(other.curBranch_),
+                                              datum_(other.datum_), arena_(nullptr) {}
+
+    GenericUnion(GenericUnion &&other) = default;
+
+    GenericUnion &operator=(const GenericUnion &other) {
+        GenericContainer::operator=(other);
+        curBranch_ = other.curBranch_;
+        datum_ = other.datum_;
+        arena_ = nullptr;
+        return *this;
+    }
+
+    GenericUnion &operator=(GenericUnion &&other) = default;
+
     /**
      * Returns the index of the current branch.
      */
@@ -258,7 +651,7 @@ public:
      */
     void selectBranch(size_t branch) {
         if (curBranch_ != branch) {
-            datum_ = GenericDatum(schema()->leafAt(branch));
+            datum_ = GenericDatum(schema()->leafAt(branch), arena_);
             curBranch_ = branch;
         }
     }
@@ -293,6 +686,12 @@ public:
      */
     explicit GenericRecord(const NodePtr &schema);
 
+    /**
+     * Constructs a generic record whose fields' values are placed in
+     * \p arena.
+     */
+    GenericRecord(const NodePtr &schema, Arena *arena);
+
     /**
      * Returns the number of fields in the current record.
      */
@@ -304,20 +703,37 @@ public:
      * Returns index of the field with the given name \p name
      */
     size_t fieldIndex(const std::string &name) const {
+        return fieldIndex(name.data(), name.size());
+    }
+
+    /**
+     * Returns index of the field named by the \p length characters at
+     * \p name.
+     */
+    size_t fieldIndex(const char *name, size_t length) const {
         size_t index = 0;
-        if (!schema()->nameIndex(name, index)) {
-            throw Exception("Invalid field name: " + name);
+        if (!schema()->nameIndex(name, length, index)) {
+            throw Exception("Invalid field name: " + std::string(name, length));
         }
         return index;
     }
 
+    size_t fieldIndex(const char *name) const {
+        return fieldIndex(name, std::strlen(name));
+    }
+
     /**
      * Returns true if a field with the given name \p name is located in this r
      * false otherwise
      */
     bool hasField(const std::string &name) const {
         size_t index = 0;
-        return schema()->nameIndex(name, index);
+        return schema()->nameIndex(name.data(), name.size(), index);
+    }
+
+    bool hasField(const char *name) const {
+        size_t index = 0;
+        return schema()->nameIndex(name, std::strlen(name), index);
     }
 
     /**
@@ -327,6 +743,10 @@ public:
         return fieldAt(fieldIndex(name));
     }
 
+    const GenericDatum &field(const char *name) const {
+        return fieldAt(fieldIndex(name));
+    }
+
     /**
      * Returns the reference to the field with the given name \p name,
      * which can be used to change the contents.
@@ -335,6 +755,29 @@ public:
         return fieldAt(fieldIndex(name));
     }
 
+    GenericDatum &field(const char *name) {
+        return fieldAt(fieldIndex(name));
+    }
+
+#if __cplusplus >= 201703L
+    size_t fieldIndex(std::string_view name) const {
+        return fieldIndex(name.data(), name.size());
+    }
+
+    bool hasField(std::string_view name) const {
+        size_t index = 0;
+        return schema()->nameIndex(name.data(), name.size(), index);
+    }
+
+    const GenericDatum &field(std::string_view name) const {
+        return fieldAt(fieldIndex(name));
+    }
+
+    GenericDatum &field(std::string_view name) {
+        return fieldAt(fieldIndex(name));
+    }
+#endif
+
     /**
      * Returns the field at the given position \p pos.
      */
@@ -357,6 +800,14 @@ public:
         // assertSameType(v, schema()->leafAt(pos));
         fields_[pos] = v;
     }
+
+    /**
+     * Replaces the field at the given position \p pos with \p v, which
+     * it takes over.
+     */
+    void setFieldAt(size_t pos, GenericDatum &&v) {
+        fields_[pos] = std::move(v);
+    }
 };
 
 /**
@@ -390,6 +841,15 @@ public:
         return value_;
     }
 
+    /**
+     * Appends an item of the array's item schema, with its default value,
+     * and returns it to be filled in where it is.
+     */
+    GenericDatum &emplace() {
+        value_.emplace_back(schema()->leafAt(0));
+        return value_.back();
+    }
+
 private:
     Value value_;
 };
@@ -425,6 +885,16 @@ public:
         return value_;
     }
 
+    /**
+     * Appends an entry of key \p key whose value is of the map's value
+     * schema, with its default value, and returns the value to be filled
+     * in where it is. The key is not checked against those already in.
+     */
+    GenericDatum &emplace(std::string key) {
+        value_.emplace_back(std::move(key), GenericDatum(schema()->leafAt(1)));
+        return value_.back().second;
+    }
+
 private:
     Value value_;
 };
@@ -539,15 +1009,7 @@ public:
 };
 
 inline Type GenericDatum::type() const {
-    return (type_ == AVRO_UNION) ?
-#if __cplusplus >= 201703L
-                                 std::any_cast<GenericUnion>(&value_)->datum().type()
-                                 :
-#else
-                                 boost::any_cast<GenericUnion>(&value_)->datum().type()
-                                 :
-#endif
-                                 type_;
+    return (type_ == AVRO_UNION) ? value_.get<GenericUnion>().datum().type() : type_;
 }
 
 inline LogicalType GenericDatum::logicalType() const {
@@ -556,43 +1018,75 @@ inline LogicalType GenericDatum::logicalType() const {
 
 template<typename T>
 T &GenericDatum::value() {
-    return (type_ == AVRO_UNION) ?
-#if __cplusplus >= 201703L
-                                 std::any_cast<GenericUnion>(&value_)->datum().value<T>()
-                                 : *std::any_cast<T>(&value_);
-#else
-                                 boost::any_cast<GenericUnion>(&value_)->datum().value<T>()
-                                 : *boost::any_cast<T>(&value_);
-#endif
+    if (type_ == AVRO_UNION) {
+        return value_.get<GenericUnion>().datum().value<T>();
+    }
+    // The value is not tagged with its type, so that a wrong T would
+    // reinterpret it.
+    if (type_ != detail::DatumType<T>::value) {
+        throwTypeMismatch(detail::DatumType<T>::value);
+    }
+    return value_.get<T>();
 }
 
 template<typename T>
 const T &GenericDatum::value() const {
-    return (type_ == AVRO_UNION) ?
-#if __cplusplus >= 201703L
-                                 std::any_cast<GenericUnion>(&value_)->datum().value<T>()
-                                 : *std::any_cast<T>(&value_);
-#else
-                                 boost::any_cast<GenericUnion>(&value_)->datum().value<T>()
-                                 : *boost::any_cast<T>(&value_);
-#endif
+    if (type_ == AVRO_UNION) {
+        return value_.get<GenericUnion>().datum().value<T>();
+    }
+    if (type_ != detail::DatumType<T>::value) {
+        throwTypeMismatch(detail::DatumType<T>::value);
+    }
+    return value_.get<T>();
+}
+
+inline void GenericDatum::shareString(SharedString *s) {
+    if (type_ == AVRO_UNION) {
+        value_.get<GenericUnion>().datum().shareString(s);
+    } else {
+        value_.setShared(s);
+    }
 }
 
 inline size_t GenericDatum::unionBranch() const {
-#if __cplusplus >= 201703L
-    return std::any_cast<GenericUnion>(&value_)->currentBranch();
-#else
-    return boost::any_cast<GenericUnion>(&value_)->currentBranch();
-#endif
+    return value_.get<GenericUnion>().currentBranch();
 }
 
 inline void GenericDatum::selectBranch(size_t branch) {
-#if __cplusplus >= 201703L
-    std::any_cast<GenericUnion>(&value_)->selectBranch(branch);
-#else
-    boost::any_cast<GenericUnion>(&value_)->selectBranch(branch);
-#endif
+    value_.get<GenericUnion>().selectBranch(branch);
 }
 
+/**
+ * A datum built once for a schema, from which fresh datums of that schema
+ * are made by copying, without walking the schema again. Decoders that
+ * read a new datum per value take it from here.
+ */
+class AVRO_DECL GenericDatumPrototype {
+    GenericDatum prototype_;
+
+public:
+    explicit GenericDatumPrototype(const NodePtr &schema) : prototype_(schema) {}
+
+    explicit GenericDatumPrototype(const ValidSchema &schema) : prototype_(schema) {}
+
+    /**
+     * Returns a fresh datum, on the heap, as GenericDatum(schema) would.
+     */
+    GenericDatum make() const { return prototype_; }
+
+    /**
+     * Returns the datum copied by make().
+     */
+    const GenericDatum &prototype() const { return prototype_; }
+
+    /**
+     * Puts back the values of a fresh datum into \p datum, which must hold
+     * a value of the same schema. Strings, bytes, arrays and maps are
+     * emptied rather than replaced, so they keep their capacity; only
+     * unions on another branch are rebuilt.
+     */
+    void reset(GenericDatum &datum) const;
+};
+
 } // namespace avro
 #endif // avro_GenericDatum_hh__
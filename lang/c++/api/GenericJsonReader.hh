@@ -0,0 +1,71 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_GenericJsonReader_hh__
+#define avro_GenericJsonReader_hh__
+
+#include <memory>
+
+#include <boost/utility.hpp>
+
+#include "Config.hh"
+#include "GenericDatum.hh"
+#include "Stream.hh"
+#include "ValidSchema.hh"
+
+/// \file
+/// Reads generic data from JSON straight through a compiled schema.
+
+namespace avro {
+
+/**
+ * Reads generic data from the JSON encoding of their schema, the text
+ * GenericJsonWriter and jsonEncoder() produce, without the grammar of
+ * jsonDecoder(). The fields of a record may come in any order, as JSON
+ * from elsewhere often has them. Each record, enum and union of the
+ * schema gets a perfect hash table of its field, symbol or branch names
+ * when the reader is made, so that a key is hashed once and matched
+ * with a single comparison, straight from the bytes of the input,
+ * without being copied into a string.
+ *
+ * Every field of a record must be present, once; unknown fields and
+ * symbols make read() throw. A reader is for one thread at a time.
+ */
+class AVRO_DECL GenericJsonReader : boost::noncopyable {
+public:
+    class Impl;
+
+private:
+    std::unique_ptr<Impl> impl_;
+
+public:
+    explicit GenericJsonReader(const ValidSchema &schema);
+    ~GenericJsonReader();
+
+    /**
+     * Reads the next JSON value from \p in into \p datum, which must
+     * have been made of the schema, as GenericDatum(schema) does. The
+     * strings, arrays and maps of the datum are reused. The bytes of
+     * \p in after the value are left unread.
+     */
+    void read(InputStream &in, GenericDatum &datum);
+};
+
+} // namespace avro
+
+#endif
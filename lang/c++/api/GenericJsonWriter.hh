@@ -0,0 +1,70 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_GenericJsonWriter_hh__
+#define avro_GenericJsonWriter_hh__
+
+#include <memory>
+#include <vector>
+
+#include <boost/utility.hpp>
+
+#include "Config.hh"
+#include "GenericDatum.hh"
+#include "Stream.hh"
+#include "ValidSchema.hh"
+
+/// \file
+/// Writes generic data as JSON straight from a compiled schema.
+
+namespace avro {
+
+/**
+ * Writes generic data in the JSON encoding of their schema, the text
+ * jsonEncoder() and GenericWriter produce, without the grammar that
+ * the encoder checks every token against. The schema is compiled once,
+ * when the writer is made, with the field names, enum symbols and union
+ * branch names already quoted and escaped, so that the names of a record
+ * are copied out as they are rather than escaped again for each record.
+ *
+ * The data are taken to be of the schema; a datum whose type is not the
+ * one the schema has where it is found makes write() throw. A writer
+ * keeps the state of the JSON being written, so it is for one thread at
+ * a time.
+ */
+class AVRO_DECL GenericJsonWriter : boost::noncopyable {
+public:
+    class Impl;
+
+private:
+    std::unique_ptr<Impl> impl_;
+
+public:
+    explicit GenericJsonWriter(const ValidSchema &schema);
+    ~GenericJsonWriter();
+
+    /// Writes \p datum onto \p out, and flushes the stream.
+    void write(const GenericDatum &datum, OutputStream &out);
+
+    /// Writes \p data onto \p out as a JSON array, and flushes the stream.
+    void writeArray(const std::vector<GenericDatum> &data, OutputStream &out);
+};
+
+} // namespace avro
+
+#endif
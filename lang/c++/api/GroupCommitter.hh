@@ -0,0 +1,97 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_GroupCommitter_hh__
+#define avro_GroupCommitter_hh__
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "Config.hh"
+#include "Stream.hh"
+
+namespace avro {
+
+/**
+ * Makes what writers have flushed to their files durable, a batch at a
+ * time: commit() queues its stream and waits, while a single background
+ * thread gathers the commits that come within a window and syncs each
+ * of their streams once, so that writers sharing a disk, or flushing one
+ * file often, do not each pay for a sync of their own. The wider the
+ * window, the fewer the syncs and the longer each commit waits.
+ */
+class AVRO_DECL GroupCommitter : boost::noncopyable {
+    struct Request;
+    typedef std::shared_ptr<Request> RequestPtr;
+
+    const std::chrono::steady_clock::duration window_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::vector<RequestPtr> pending_;
+    bool stopping_;
+    int64_t commits_;
+    int64_t syncs_;
+    std::thread thread_;
+
+    void run();
+
+public:
+    /**
+     * Starts the thread that syncs, which waits \p window after the first
+     * commit of a batch for others to join it. With no window, commits
+     * made while a batch is being synced make the next batch.
+     */
+    explicit GroupCommitter(std::chrono::steady_clock::duration window = std::chrono::milliseconds(2));
+
+    /**
+     * Syncs what is still queued, and stops the thread.
+     */
+    ~GroupCommitter();
+
+    /**
+     * Returns once the data flushed to \p stream so far is durable, or
+     * throws if syncing it failed. Streams that cannot be synced, see
+     * OutputStream::sync(), return at the end of the batch. \p stream
+     * must not be written to until this returns.
+     */
+    void commit(OutputStream &stream);
+
+    /**
+     * Returns the number of commit() calls done.
+     */
+    int64_t commits();
+
+    /**
+     * Returns the number of streams synced, at most one per stream per
+     * batch.
+     */
+    int64_t syncs();
+};
+
+} // namespace avro
+
+#endif
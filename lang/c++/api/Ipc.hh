@@ -0,0 +1,205 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_Ipc_hh__
+#define avro_Ipc_hh__
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Config.hh"
+#include "Decoder.hh"
+#include "Encoder.hh"
+#include "Exception.hh"
+#include "GenericDatum.hh"
+#include "Protocol.hh"
+#include "Stream.hh"
+
+/// \file
+/// Avro RPC over stateful connections, such as those of the socket
+/// streams: messages are framed, each connection handshakes on its first
+/// call, and calls may be pipelined, their responses coming back in order.
+
+namespace avro {
+
+/**
+ * Writes the bytes of \p message to \p out as one framed message: a frame
+ * for each chunk of it, of at most \p frameSize bytes, after its length in
+ * four big-endian bytes, and then the empty frame that ends the message.
+ * The frames go out with one call to writeChunks(). Does not flush.
+ */
+AVRO_DECL void writeFrames(OutputStream &out, InputStream &message,
+                           size_t frameSize = 8 * 1024);
+
+/**
+ * Reads one framed message from \p in into \p message. Returns false if
+ * \p in ends before the message begins, and throws if it ends within it.
+ */
+AVRO_DECL bool readFrames(InputStream &in, std::vector<uint8_t> &message);
+
+/**
+ * An error a server answered a call with.
+ */
+class AVRO_DECL RpcError : public Exception {
+public:
+    /**
+     * \p error is a datum of the errors union of the message: a string for
+     * errors the protocol does not declare, or one of the declared errors.
+     * A responder may also throw it with a datum of a declared error
+     * itself.
+     */
+    RpcError(const std::string &what, GenericDatum error) : std::runtime_error(what),
+                                                             Exception(what),
+                                                             error_(std::move(error)) {}
+
+    const GenericDatum &error() const {
+        return error_;
+    }
+
+private:
+    GenericDatum error_;
+};
+
+/**
+ * Remembers which servers have completed a handshake for which client
+ * protocols, and the hashes of the servers' protocols, so that later
+ * connections to them neither send the client's protocol nor have the
+ * server's sent back. It may be shared by the clients of many threads.
+ */
+class AVRO_DECL HandshakeCache {
+public:
+    using Hash = std::array<uint8_t, 16>;
+
+    /// Looks up the hash of the protocol of \p server, once it has
+    /// accepted the protocol with hash \p client.
+    bool lookup(const std::string &server, const Hash &client, Hash &serverHash) const;
+
+    void store(const std::string &server, const Hash &client, const Hash &serverHash);
+
+    void forget(const std::string &server, const Hash &client);
+
+private:
+    mutable std::mutex mutex_;
+    std::map<std::pair<std::string, Hash>, Hash> servers_;
+};
+
+/**
+ * Calls the messages of a protocol over one connection. Calls are sent
+ * as they are made and their responses read as they are asked for, in the
+ * same order, so that many calls may be outstanding at once. The first
+ * call waits for the handshake.
+ */
+class AVRO_DECL RpcClient {
+public:
+    /**
+     * Talks \p protocol over the connection that \p in and \p out read
+     * from and write to, both of which must outlive the client. With a
+     * \p cache, the handshakes of earlier connections to \p server are
+     * reused.
+     */
+    RpcClient(const Protocol &protocol, InputStream &in, OutputStream &out,
+              std::shared_ptr<HandshakeCache> cache = nullptr,
+              std::string server = std::string());
+
+    /**
+     * Calls \p message with \p request, a datum of its request record,
+     * without waiting for the response. The call may stay buffered until
+     * flush() or receive().
+     */
+    void send(const std::string &message, const GenericDatum &request);
+
+    /// Sends the calls still buffered.
+    void flush();
+
+    /**
+     * Waits for the response to the earliest call that has not had it,
+     * and sets \p response to it. Throws RpcError if the server answered
+     * the call with an error. One-way calls have no response.
+     */
+    void receive(GenericDatum &response);
+
+    /// Calls \p message and waits for its response.
+    GenericDatum call(const std::string &message, const GenericDatum &request);
+
+    /// The number of calls whose responses have not been received.
+    size_t pending() const {
+        return pending_.size();
+    }
+
+private:
+    void handshake(const Message &message, const GenericDatum &request);
+    void writeCall(const Message &message, const GenericDatum &request);
+    void sendMessage();
+
+    const Protocol &protocol_;
+    InputStream &in_;
+    OutputStream &out_;
+    std::shared_ptr<HandshakeCache> cache_;
+    const std::string server_;
+    bool connected_;
+
+    OutputStreamPtr buffer_;
+    EncoderPtr encoder_;
+    DecoderPtr decoder_;
+    std::vector<uint8_t> response_;
+    InputStreamPtr responseIn_;
+    // The response to the first call, read with the handshake.
+    bool haveFirst_;
+    std::deque<const Message *> pending_;
+};
+
+/**
+ * Answers the calls of clients of a protocol.
+ */
+class AVRO_DECL RpcResponder {
+public:
+    explicit RpcResponder(const Protocol &protocol);
+
+    virtual ~RpcResponder();
+
+    /**
+     * Answers a call of \p message: \p request is a datum of its request
+     * record, and \p response is to be set to a datum of its response.
+     * To answer with an error the protocol declares for the message,
+     * throw RpcError with a datum of that error. Other exceptions answer
+     * with their message, as a string error.
+     */
+    virtual void respond(const Message &message, const GenericDatum &request,
+                         GenericDatum &response) = 0;
+
+    /**
+     * Answers the calls of one connection, in order, until \p in ends.
+     * Clients whose protocol differs from that of the responder are
+     * refused in the handshake.
+     */
+    void serve(InputStream &in, OutputStream &out);
+
+protected:
+    const Protocol &protocol_;
+};
+
+} // namespace avro
+
+#endif
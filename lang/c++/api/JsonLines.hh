@@ -0,0 +1,76 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_JsonLines_hh__
+#define avro_JsonLines_hh__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Config.hh"
+#include "Stream.hh"
+#include "ValidSchema.hh"
+
+/// \file
+/// Converts newline-delimited JSON into data files, parsing in parallel.
+
+namespace avro {
+
+/**
+ * How jsonLinesToDataFile() goes about it.
+ */
+struct AVRO_DECL JsonLinesOptions {
+    /// The number of threads that parse and encode lines.
+    size_t threads = 1;
+
+    /**
+     * The bytes of input handed to a thread at a time, cut at the last
+     * newline within; a longer line is handed over whole.
+     */
+    size_t batchSize = 4 * 1024 * 1024;
+
+    /// The codec of the output file.
+    std::string codec = "null";
+
+    /// The sync interval of the output file.
+    size_t syncInterval = 16 * 1024;
+};
+
+/**
+ * Writes the JSON values of \p input, one per line, as the objects of
+ * the data file \p output of \p schema, in the order of the lines.
+ * Lines are read by GenericJsonReader, so the fields of records may come
+ * in any order. Blank lines are skipped. Batches of lines are parsed and
+ * binary encoded by the threads of \p options, each into blocks of about
+ * the sync interval, which are appended to the file as they are.
+ * Returns the number of objects. A line that is not a value of the
+ * schema throws an Exception that names it.
+ */
+AVRO_DECL int64_t jsonLinesToDataFile(InputStream &input, const ValidSchema &schema,
+                                      const std::string &output,
+                                      const JsonLinesOptions &options = JsonLinesOptions());
+
+/// Converts the file named \p input as the function above does.
+AVRO_DECL int64_t jsonLinesToDataFile(const std::string &input, const ValidSchema &schema,
+                                      const std::string &output,
+                                      const JsonLinesOptions &options = JsonLinesOptions());
+
+} // namespace avro
+
+#endif
@@ -0,0 +1,419 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_LogicalValues_hh__
+#define avro_LogicalValues_hh__
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "Decoder.hh"
+#include "DirectCodec.hh"
+#include "Encoder.hh"
+#include "Exception.hh"
+#include "Specific.hh"
+
+/// \file
+/// Values of logical types as native C++ types, decoded straight from
+/// the input without intermediate vectors or strings:
+///
+///   - decimals on bytes or fixed as their unscaled value, in an int64_t
+///     or, where the compiler has __int128, an int128_t; the scale is
+///     that of the schema;
+///   - timestamp-millis and timestamp-micros as time points of the
+///     system clock;
+///   - uuids as their 16 bytes.
+///
+/// The functions below take a Decoder or Encoder as well as a
+/// DirectBinaryDecoder or DirectBinaryEncoder. For avrogencpp
+/// --logical-types, the wrapper types Decimal, Decimal128, FixedDecimal,
+/// FixedDecimal128 and Uuid, and the two time points, have codec_traits
+/// and direct_codec_traits.
+
+namespace avro {
+
+#ifdef __SIZEOF_INT128__
+#define AVRO_HAVE_INT128 1
+__extension__ typedef __int128 int128_t;
+__extension__ typedef unsigned __int128 uint128_t;
+#endif
+
+typedef std::chrono::time_point<std::chrono::system_clock, std::chrono::milliseconds> TimestampMillis;
+typedef std::chrono::time_point<std::chrono::system_clock, std::chrono::microseconds> TimestampMicros;
+
+namespace detail {
+
+/**
+ * Returns the big-endian two's complement integer in \p len bytes, which
+ * may have more bytes than U as long as those are sign extension.
+ */
+template<typename I, typename U>
+I decimalFromBytes(const uint8_t *data, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    const uint8_t sign = (data[0] & 0x80) != 0 ? 0xff : 0;
+    size_t i = 0;
+    for (; len - i > sizeof(U); ++i) {
+        if (data[i] != sign) {
+            throw Exception(boost::format("Decimal of %1% bytes does not fit in %2% bits") % len % (8 * sizeof(U)));
+        }
+    }
+    if (i != 0 && (data[i] & 0x80) != (sign & 0x80)) {
+        throw Exception(boost::format("Decimal of %1% bytes does not fit in %2% bits") % len % (8 * sizeof(U)));
+    }
+    U v = sign != 0 ? ~static_cast<U>(0) : 0;
+    for (; i < len; ++i) {
+        v = static_cast<U>(v << 8) | data[i];
+    }
+    return static_cast<I>(v);
+}
+
+/**
+ * Writes \p v in big-endian two's complement to the sizeof(U) bytes of
+ * \p out and returns the offset of its shortest form there.
+ */
+template<typename U>
+size_t decimalToBytes(U v, uint8_t *out) {
+    for (size_t i = sizeof(U); i-- > 0;) {
+        out[i] = static_cast<uint8_t>(v);
+        v >>= 8;
+    }
+    size_t start = 0;
+    while (start + 1 < sizeof(U)
+           && ((out[start] == 0 && (out[start + 1] & 0x80) == 0)
+               || (out[start] == 0xff && (out[start + 1] & 0x80) != 0))) {
+        ++start;
+    }
+    return start;
+}
+
+template<typename E, typename U>
+void encodeFixedDecimal(E &e, U v, size_t n) {
+    uint8_t bytes[sizeof(U)];
+    size_t start = detail::decimalToBytes(v, bytes);
+    size_t len = sizeof(U) - start;
+    if (n < len) {
+        throw Exception(boost::format("Decimal needs %1% bytes, more than the fixed's %2%") % len % n);
+    }
+    uint8_t out[64];
+    if (n > sizeof(out)) {
+        throw Exception(boost::format("Fixed of %1% bytes is too long for a decimal") % n);
+    }
+    std::fill(out, out + n - len, (bytes[start] & 0x80) != 0 ? 0xff : 0);
+    std::copy(bytes + start, bytes + sizeof(U), out + n - len);
+    e.encodeFixed(out, n);
+}
+
+inline int hexDigit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+} // namespace detail
+
+/**
+ * Decodes a decimal on bytes into its unscaled value. Throws if it does
+ * not fit in 64 bits.
+ */
+template<typename D>
+int64_t decodeDecimal(D &d) {
+    const uint8_t *data;
+    size_t len;
+    d.decodeBytesView(data, len);
+    return detail::decimalFromBytes<int64_t, uint64_t>(data, len);
+}
+
+/**
+ * Decodes a decimal on a fixed of \p n bytes into its unscaled value.
+ */
+template<typename D>
+int64_t decodeFixedDecimal(D &d, size_t n) {
+    const uint8_t *data;
+    d.decodeFixedView(n, data);
+    return detail::decimalFromBytes<int64_t, uint64_t>(data, n);
+}
+
+/**
+ * Encodes \p unscaled as a decimal on bytes, in as few bytes as it takes.
+ */
+template<typename E>
+void encodeDecimal(E &e, int64_t unscaled) {
+    uint8_t bytes[sizeof(uint64_t)];
+    size_t start = detail::decimalToBytes(static_cast<uint64_t>(unscaled), bytes);
+    e.encodeBytes(bytes + start, sizeof(bytes) - start);
+}
+
+/**
+ * Encodes \p unscaled as a decimal on a fixed of \p n bytes.
+ */
+template<typename E>
+void encodeFixedDecimal(E &e, int64_t unscaled, size_t n) {
+    detail::encodeFixedDecimal(e, static_cast<uint64_t>(unscaled), n);
+}
+
+#ifdef AVRO_HAVE_INT128
+
+/**
+ * Decodes a decimal on bytes, of a precision up to 38, into its unscaled
+ * value.
+ */
+template<typename D>
+int128_t decodeDecimal128(D &d) {
+    const uint8_t *data;
+    size_t len;
+    d.decodeBytesView(data, len);
+    return detail::decimalFromBytes<int128_t, uint128_t>(data, len);
+}
+
+template<typename D>
+int128_t decodeFixedDecimal128(D &d, size_t n) {
+    const uint8_t *data;
+    d.decodeFixedView(n, data);
+    return detail::decimalFromBytes<int128_t, uint128_t>(data, n);
+}
+
+template<typename E>
+void encodeDecimal128(E &e, int128_t unscaled) {
+    uint8_t bytes[sizeof(uint128_t)];
+    size_t start = detail::decimalToBytes(static_cast<uint128_t>(unscaled), bytes);
+    e.encodeBytes(bytes + start, sizeof(bytes) - start);
+}
+
+template<typename E>
+void encodeFixedDecimal128(E &e, int128_t unscaled, size_t n) {
+    detail::encodeFixedDecimal(e, static_cast<uint128_t>(unscaled), n);
+}
+
+#endif
+
+template<typename D>
+TimestampMillis decodeTimestampMillis(D &d) {
+    return TimestampMillis(std::chrono::milliseconds(d.decodeLong()));
+}
+
+template<typename D>
+TimestampMicros decodeTimestampMicros(D &d) {
+    return TimestampMicros(std::chrono::microseconds(d.decodeLong()));
+}
+
+template<typename E>
+void encodeTimestamp(E &e, TimestampMillis t) {
+    e.encodeLong(static_cast<int64_t>(t.time_since_epoch().count()));
+}
+
+template<typename E>
+void encodeTimestamp(E &e, TimestampMicros t) {
+    e.encodeLong(static_cast<int64_t>(t.time_since_epoch().count()));
+}
+
+/**
+ * Decodes a uuid string, in the canonical 8-4-4-4-12 hexadecimal form,
+ * into \p bytes. Throws if the string is not a uuid.
+ */
+template<typename D>
+void decodeUuid(D &d, std::array<uint8_t, 16> &bytes) {
+    const char *data;
+    size_t len;
+    d.decodeStringView(data, len);
+    if (len != 36) {
+        throw Exception(boost::format("Invalid uuid of %1% characters") % len);
+    }
+    size_t b = 0;
+    for (size_t i = 0; i < len;) {
+        if (i == 8 || i == 13 || i == 18 || i == 23) {
+            if (data[i] != '-') {
+                throw Exception(boost::format("Invalid uuid: %1%") % std::string(data, len));
+            }
+            ++i;
+            continue;
+        }
+        int hi = detail::hexDigit(data[i]);
+        int lo = detail::hexDigit(data[i + 1]);
+        if (hi < 0 || lo < 0) {
+            throw Exception(boost::format("Invalid uuid: %1%") % std::string(data, len));
+        }
+        bytes[b++] = static_cast<uint8_t>(hi << 4 | lo);
+        i += 2;
+    }
+}
+
+/**
+ * Encodes \p bytes as a uuid string in the canonical form, in lower case.
+ */
+template<typename E>
+void encodeUuid(E &e, const std::array<uint8_t, 16> &bytes) {
+    static const char digits[] = "0123456789abcdef";
+    std::string s(36, '-');
+    size_t i = 0;
+    for (size_t b = 0; b < bytes.size(); ++b) {
+        if (i == 8 || i == 13 || i == 18 || i == 23) {
+            ++i;
+        }
+        s[i++] = digits[bytes[b] >> 4];
+        s[i++] = digits[bytes[b] & 0xf];
+    }
+    e.encodeString(s);
+}
+
+/// A decimal on bytes, by its unscaled value.
+struct Decimal {
+    int64_t unscaled = 0;
+};
+
+/// A decimal on a fixed of N bytes, by its unscaled value.
+template<size_t N>
+struct FixedDecimal {
+    int64_t unscaled = 0;
+};
+
+#ifdef AVRO_HAVE_INT128
+
+struct Decimal128 {
+    int128_t unscaled = 0;
+};
+
+template<size_t N>
+struct FixedDecimal128 {
+    int128_t unscaled = 0;
+};
+
+#endif
+
+/// A uuid, by its 16 bytes.
+struct Uuid {
+    std::array<uint8_t, 16> bytes{};
+
+    bool operator==(const Uuid &other) const { return bytes == other.bytes; }
+    bool operator!=(const Uuid &other) const { return bytes != other.bytes; }
+};
+
+template<>
+struct codec_traits<Decimal> {
+    static void encode(Encoder &e, const Decimal &v) { encodeDecimal(e, v.unscaled); }
+    static void decode(Decoder &d, Decimal &v) { v.unscaled = decodeDecimal(d); }
+};
+
+template<>
+struct direct_codec_traits<Decimal> {
+    template<typename E>
+    static void encode(E &e, const Decimal &v) { encodeDecimal(e, v.unscaled); }
+    template<typename D>
+    static void decode(D &d, Decimal &v) { v.unscaled = decodeDecimal(d); }
+};
+
+template<size_t N>
+struct codec_traits<FixedDecimal<N>> {
+    static void encode(Encoder &e, const FixedDecimal<N> &v) { encodeFixedDecimal(e, v.unscaled, N); }
+    static void decode(Decoder &d, FixedDecimal<N> &v) { v.unscaled = decodeFixedDecimal(d, N); }
+};
+
+template<size_t N>
+struct direct_codec_traits<FixedDecimal<N>> {
+    template<typename E>
+    static void encode(E &e, const FixedDecimal<N> &v) { encodeFixedDecimal(e, v.unscaled, N); }
+    template<typename D>
+    static void decode(D &d, FixedDecimal<N> &v) { v.unscaled = decodeFixedDecimal(d, N); }
+};
+
+#ifdef AVRO_HAVE_INT128
+
+template<>
+struct codec_traits<Decimal128> {
+    static void encode(Encoder &e, const Decimal128 &v) { encodeDecimal128(e, v.unscaled); }
+    static void decode(Decoder &d, Decimal128 &v) { v.unscaled = decodeDecimal128(d); }
+};
+
+template<>
+struct direct_codec_traits<Decimal128> {
+    template<typename E>
+    static void encode(E &e, const Decimal128 &v) { encodeDecimal128(e, v.unscaled); }
+    template<typename D>
+    static void decode(D &d, Decimal128 &v) { v.unscaled = decodeDecimal128(d); }
+};
+
+template<size_t N>
+struct codec_traits<FixedDecimal128<N>> {
+    static void encode(Encoder &e, const FixedDecimal128<N> &v) { encodeFixedDecimal128(e, v.unscaled, N); }
+    static void decode(Decoder &d, FixedDecimal128<N> &v) { v.unscaled = decodeFixedDecimal128(d, N); }
+};
+
+template<size_t N>
+struct direct_codec_traits<FixedDecimal128<N>> {
+    template<typename E>
+    static void encode(E &e, const FixedDecimal128<N> &v) { encodeFixedDecimal128(e, v.unscaled, N); }
+    template<typename D>
+    static void decode(D &d, FixedDecimal128<N> &v) { v.unscaled = decodeFixedDecimal128(d, N); }
+};
+
+#endif
+
+template<>
+struct codec_traits<TimestampMillis> {
+    static void encode(Encoder &e, const TimestampMillis &v) { encodeTimestamp(e, v); }
+    static void decode(Decoder &d, TimestampMillis &v) { v = decodeTimestampMillis(d); }
+};
+
+template<>
+struct direct_codec_traits<TimestampMillis> {
+    template<typename E>
+    static void encode(E &e, const TimestampMillis &v) { encodeTimestamp(e, v); }
+    template<typename D>
+    static void decode(D &d, TimestampMillis &v) { v = decodeTimestampMillis(d); }
+};
+
+template<>
+struct codec_traits<TimestampMicros> {
+    static void encode(Encoder &e, const TimestampMicros &v) { encodeTimestamp(e, v); }
+    static void decode(Decoder &d, TimestampMicros &v) { v = decodeTimestampMicros(d); }
+};
+
+template<>
+struct direct_codec_traits<TimestampMicros> {
+    template<typename E>
+    static void encode(E &e, const TimestampMicros &v) { encodeTimestamp(e, v); }
+    template<typename D>
+    static void decode(D &d, TimestampMicros &v) { v = decodeTimestampMicros(d); }
+};
+
+template<>
+struct codec_traits<Uuid> {
+    static void encode(Encoder &e, const Uuid &v) { encodeUuid(e, v.bytes); }
+    static void decode(Decoder &d, Uuid &v) { decodeUuid(d, v.bytes); }
+};
+
+template<>
+struct direct_codec_traits<Uuid> {
+    template<typename E>
+    static void encode(E &e, const Uuid &v) { encodeUuid(e, v.bytes); }
+    template<typename D>
+    static void decode(D &d, Uuid &v) { decodeUuid(d, v.bytes); }
+};
+
+} // namespace avro
+
+#endif
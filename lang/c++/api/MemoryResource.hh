@@ -0,0 +1,99 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_MemoryResource_hh__
+#define avro_MemoryResource_hh__
+
+#include <cstddef>
+
+#include <boost/noncopyable.hpp>
+
+#include "Config.hh"
+
+namespace avro {
+
+/**
+ * Where the library gets its buffers from: the chunks of memory output
+ * streams, the buffers of file and stream input and output, and the
+ * blocks of data file writers. Modelled on std::pmr::memory_resource, so
+ * that one can be wrapped in the other; implement it over jemalloc
+ * arenas, or memory local to a NUMA node, to keep a thread's buffers
+ * there.
+ *
+ * Objects take their resource when they are made and give everything
+ * back to it, so it must outlive them. The small allocations of schemas,
+ * generic data and decoded strings still go through operator new.
+ */
+class AVRO_DECL MemoryResource : boost::noncopyable {
+public:
+    virtual ~MemoryResource();
+
+    /**
+     * Returns \p bytes bytes aligned to \p alignment, a power of two, or
+     * throws std::bad_alloc.
+     */
+    virtual void *allocate(size_t bytes, size_t alignment) = 0;
+
+    /**
+     * Gives back what allocate() returned for the same \p bytes and
+     * \p alignment.
+     */
+    virtual void deallocate(void *p, size_t bytes, size_t alignment) = 0;
+};
+
+/**
+ * The alignment of buffers that ask for none in particular.
+ */
+const size_t defaultAlignment = 16;
+
+/**
+ * The resource over operator new, and aligned allocation for alignments
+ * beyond defaultAlignment.
+ */
+AVRO_DECL MemoryResource *newDeleteResource();
+
+/**
+ * The resource of objects made without one: that of the innermost
+ * ScopedMemoryResource of the calling thread, or else the one last given
+ * to setDefaultMemoryResource(), newDeleteResource() to begin with.
+ */
+AVRO_DECL MemoryResource *defaultMemoryResource();
+
+/**
+ * Makes \p resource the default of all threads that do not set their own,
+ * returning the one before; null stands for newDeleteResource().
+ */
+AVRO_DECL MemoryResource *setDefaultMemoryResource(MemoryResource *resource);
+
+/**
+ * Makes \p resource the default of the calling thread for as long as it
+ * lives. Work the library hands over to an executor does not see it, but
+ * the buffers of the objects made meanwhile come from it wherever they
+ * are used.
+ */
+class AVRO_DECL ScopedMemoryResource : boost::noncopyable {
+    MemoryResource *const previous_;
+
+public:
+    explicit ScopedMemoryResource(MemoryResource *resource);
+    ~ScopedMemoryResource();
+};
+
+} // namespace avro
+
+#endif
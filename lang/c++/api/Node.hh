@@ -25,6 +25,9 @@
 #include <cassert>
 #include <memory>
 #include <utility>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
 
 #include "Exception.hh"
 #include "LogicalType.hh"
@@ -137,6 +140,10 @@ public:
     virtual const GenericDatum &defaultValueAt(size_t index) {
         throw Exception(boost::format("No default value at: %1%") % index);
     }
+    /// The sort order of a field of a record, by index.
+    virtual SortOrder fieldOrderAt(size_t) const {
+        return ORDER_ASCENDING;
+    }
 
     void addName(const std::string &name) {
         checkLock();
@@ -147,6 +154,20 @@ public:
     virtual const std::string &nameAt(size_t index) const = 0;
     virtual bool nameIndex(const std::string &name, size_t &index) const = 0;
 
+    /**
+     * Looks up the field named by the \p length characters at \p name
+     * without making a string of them.
+     */
+    virtual bool nameIndex(const char *name, size_t length, size_t &index) const {
+        return nameIndex(std::string(name, length), index);
+    }
+
+#if __cplusplus >= 201703L
+    bool nameIndex(std::string_view name, size_t &index) const {
+        return nameIndex(name.data(), name.size(), index);
+    }
+#endif
+
     void setFixedSize(size_t size) {
         checkLock();
         doSetFixedSize(size);
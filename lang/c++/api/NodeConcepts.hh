@@ -22,7 +22,9 @@
 #include "Config.hh"
 
 #include "Exception.hh"
-#include <map>
+#include <cstdint>
+#include <cstring>
+#include <string>
 #include <vector>
 
 namespace avro {
@@ -159,40 +161,87 @@ private:
 template<typename T>
 struct NameIndexConcept {
 
-    bool lookup(const std::string &name, size_t &index) const {
+    bool lookup(const T &, const char *, size_t, size_t &) const {
         throw Exception("Name index does not exist");
     }
 
-    bool add(const ::std::string &name, size_t) {
+    bool add(const T &) {
         throw Exception("Name index does not exist");
     }
 };
 
+/// Maps the field names of records to their positions with an open
+/// addressing hash table, built as the fields are added when the schema
+/// is compiled. Lookups need no std::string, so callers holding just the
+/// characters of a name do not allocate. The table holds positions only;
+/// the names are compared where the node keeps them.
 template<>
 struct NameIndexConcept<MultiAttribute<std::string>> {
-    using IndexMap = std::map<std::string, size_t>;
+    using Names = MultiAttribute<std::string>;
 
-    bool lookup(const std::string &name, size_t &index) const {
-        auto iter = map_.find(name);
-        if (iter == map_.end()) {
+    bool lookup(const Names &names, const char *name, size_t length, size_t &index) const {
+        if (slots_.empty()) {
             return false;
         }
-        index = iter->second;
-        return true;
+        const size_t mask = slots_.size() - 1;
+        for (size_t i = static_cast<size_t>(hash(name, length)) & mask;; i = (i + 1) & mask) {
+            uint32_t slot = slots_[i];
+            if (slot == 0) {
+                return false;
+            }
+            const std::string &s = names.get(slot - 1);
+            if (s.size() == length && std::memcmp(s.data(), name, length) == 0) {
+                index = slot - 1;
+                return true;
+            }
+        }
     }
 
-    bool add(const ::std::string &name, size_t index) {
-        bool added = false;
-        auto lb = map_.lower_bound(name);
-        if (lb == map_.end() || map_.key_comp()(name, lb->first)) {
-            map_.insert(lb, IndexMap::value_type(name, index));
-            added = true;
+    /// Indexes the first of \p names not yet indexed, unless it is the
+    /// same as one that is.
+    bool add(const Names &names) {
+        const std::string &name = names.get(count_);
+        size_t existing;
+        if (lookup(names, name.data(), name.size(), existing)) {
+            return false;
         }
-        return added;
+        ++count_;
+        // Keep the table at most half full.
+        if (2 * count_ > slots_.size()) {
+            slots_.assign(slots_.empty() ? 8 : 2 * slots_.size(), 0);
+            for (uint32_t i = 0; i < count_; ++i) {
+                insert(names, i);
+            }
+        } else {
+            insert(names, count_ - 1);
+        }
+        return true;
     }
 
 private:
-    IndexMap map_;
+    // FNV-1a.
+    static uint64_t hash(const char *name, size_t length) {
+        uint64_t h = 14695981039346656037ULL;
+        for (size_t i = 0; i < length; ++i) {
+            h = (h ^ static_cast<unsigned char>(name[i])) * 1099511628211ULL;
+        }
+        return h;
+    }
+
+    void insert(const Names &names, uint32_t index) {
+        const std::string &name = names.get(index);
+        const size_t mask = slots_.size() - 1;
+        size_t i = static_cast<size_t>(hash(name.data(), name.size())) & mask;
+        while (slots_[i] != 0) {
+            i = (i + 1) & mask;
+        }
+        slots_[i] = index + 1;
+    }
+
+    uint32_t count_ = 0;
+    // One more than the position of the name hashed to each slot, or zero
+    // for free slots.
+    std::vector<uint32_t> slots_;
 };
 
 } // namespace concepts
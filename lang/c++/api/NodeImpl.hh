@@ -72,7 +72,7 @@ protected:
              const LeafNamesConcept &leafNames,
              const SizeConcept &size) : Node(type),
                                         nameAttribute_(name),
-                                        docAttribute_(doc),
+                                        docAttribute_(doc.get().empty() ? nullptr : new std::string(doc.get())),
                                         leafAttributes_(leaves),
                                         leafNameAttributes_(leafNames),
                                         sizeAttribute_(size) {}
@@ -100,11 +100,12 @@ protected:
     }
 
     void doSetDoc(const std::string &doc) override {
-        docAttribute_.add(doc);
+        docAttribute_.reset(doc.empty() ? nullptr : new std::string(doc));
     }
 
     const std::string &getDoc() const override {
-        return docAttribute_.get();
+        static const std::string none;
+        return docAttribute_ ? *docAttribute_ : none;
     }
 
     void doAddLeaf(const NodePtr &newLeaf) final {
@@ -120,10 +121,12 @@ protected:
     }
 
     void doAddName(const std::string &name) override {
-        if (!nameIndex_.add(name, leafNameAttributes_.size())) {
+        size_t index;
+        if (nameIndex_.lookup(leafNameAttributes_, name.data(), name.size(), index)) {
             throw Exception(boost::format("Cannot add duplicate name: %1%") % name);
         }
         leafNameAttributes_.add(name);
+        nameIndex_.add(leafNameAttributes_);
     }
 
     size_t names() const override {
@@ -135,7 +138,11 @@ protected:
     }
 
     bool nameIndex(const std::string &name, size_t &index) const override {
-        return nameIndex_.lookup(name, index);
+        return nameIndex_.lookup(leafNameAttributes_, name.data(), name.size(), index);
+    }
+
+    bool nameIndex(const char *name, size_t length, size_t &index) const override {
+        return nameIndex_.lookup(leafNameAttributes_, name, length, index);
     }
 
     void doSetFixedSize(size_t size) override {
@@ -191,7 +198,8 @@ protected:
     NameConcept nameAttribute_;
 
     // Rem: NameConcept type is HasName (= SingleAttribute<Name>), we use std::string instead
-    concepts::SingleAttribute<std::string> docAttribute_; /** Doc used to compare schemas */
+    // Most nodes have no doc, so it is kept apart; null when empty.
+    std::unique_ptr<std::string> docAttribute_; /** Doc used to compare schemas */
 
     LeavesConcept leafAttributes_;
     LeafNamesConcept leafNameAttributes_;
@@ -224,6 +232,20 @@ using NodeImplMap = NodeImpl<NoName, MultiLeaves, NoLeafNames, NoSize>;
 using NodeImplUnion = NodeImpl<NoName, MultiLeaves, NoLeafNames, NoSize>;
 using NodeImplFixed = NodeImpl<HasName, NoLeaves, NoLeafNames, HasSize>;
 
+/**
+ * Returns the node of the primitive \p type that schemas share. It is
+ * locked, so a primitive with a logical type or a doc needs a node of its
+ * own.
+ */
+AVRO_DECL const NodePtr &primitiveNode(Type type);
+
+/**
+ * Returns the node of the primitive \p type with \p logicalType that
+ * schemas share, made the first time it is asked for. Throws if the
+ * logical type cannot annotate the type.
+ */
+AVRO_DECL NodePtr primitiveNode(Type type, const LogicalType &logicalType);
+
 class AVRO_DECL NodePrimitive : public NodeImplPrimitive {
 public:
     explicit NodePrimitive(Type type) : NodeImplPrimitive(type) {}
@@ -247,7 +269,7 @@ public:
 
     explicit NodeSymbolic(const HasName &name) : NodeImplSymbolic(AVRO_SYMBOLIC, name, NoLeaves(), NoLeafNames(), NoSize()) {}
 
-    NodeSymbolic(const HasName &name, const NodePtr &n) : NodeImplSymbolic(AVRO_SYMBOLIC, name, NoLeaves(), NoLeafNames(), NoSize()), actualNode_(n) {}
+    NodeSymbolic(const HasName &name, const NodePtr &n) : NodeImplSymbolic(AVRO_SYMBOLIC, name, NoLeaves(), NoLeafNames(), NoSize()), actualNode_(n), node_(n.get()), unowned_(n && n.use_count() == 0) {}
     SchemaResolution resolve(const Node &reader) const override;
 
     void printJson(std::ostream &os, size_t depth) const override;
@@ -259,10 +281,13 @@ public:
     void printDefaultToJson(const GenericDatum &g, std::ostream &os, size_t depth) const override;
 
     bool isSet() const {
-        return (actualNode_.lock() != nullptr);
+        return unowned_ ? node_ != nullptr : (actualNode_.lock() != nullptr);
     }
 
     NodePtr getNode() const {
+        if (unowned_) {
+            return NodePtr(NodePtr(), node_);
+        }
         NodePtr node = actualNode_.lock();
         if (!node) {
             throw Exception(boost::format("Could not follow symbol %1%") % name());
@@ -270,16 +295,40 @@ public:
         return node;
     }
 
+    /**
+     * Returns the node this symbol refers to without taking a reference
+     * to it. The node lives as long as the schema both belong to.
+     */
+    const Node &actualNode() const {
+        if (node_ == nullptr) {
+            throw Exception(boost::format("Could not follow symbol %1%") % name());
+        }
+        return *node_;
+    }
+
+    /**
+     * Makes this symbol refer to \p node. If \p node does not own what it
+     * points to, as within a frozen schema, the symbol keeps the pointer
+     * itself rather than a weak reference.
+     */
     void setNode(const NodePtr &node) {
         actualNode_ = node;
+        node_ = node.get();
+        unowned_ = node && node.use_count() == 0;
     }
 
 protected:
     NodeWeakPtr actualNode_;
+    Node *node_ = nullptr;
+    bool unowned_ = false;
 };
 
 class AVRO_DECL NodeRecord : public NodeImplRecord {
     std::vector<GenericDatum> defaultValues;
+    // Empty when every field sorts in ascending order.
+    std::vector<SortOrder> fieldOrders;
+
+    void indexFields();
 
 public:
     NodeRecord() : NodeImplRecord(AVRO_RECORD) {}
@@ -291,18 +340,13 @@ public:
                const LeafNames &fieldsNames,
                std::vector<GenericDatum> dv) : NodeImplRecord(AVRO_RECORD, name, doc, fields, fieldsNames, NoSize()),
                                                defaultValues(std::move(dv)) {
-        for (size_t i = 0; i < leafNameAttributes_.size(); ++i) {
-            if (!nameIndex_.add(leafNameAttributes_.get(i), i)) {
-                throw Exception(boost::format(
-                                    "Cannot add duplicate field: %1%")
-                                % leafNameAttributes_.get(i));
-            }
-        }
+        indexFields();
     }
 
     void swap(NodeRecord &r) {
         NodeImplRecord::swap(r);
         defaultValues.swap(r.defaultValues);
+        fieldOrders.swap(r.fieldOrders);
     }
 
     SchemaResolution resolve(const Node &reader) const override;
@@ -314,7 +358,18 @@ public:
     }
 
     const GenericDatum &defaultValueAt(size_t index) override {
-        return defaultValues[index];
+        // Records built field by field through Schema.hh have no defaults.
+        static const GenericDatum none;
+        return index < defaultValues.size() ? defaultValues[index] : none;
+    }
+
+    SortOrder fieldOrderAt(size_t index) const override {
+        return index < fieldOrders.size() ? fieldOrders[index] : ORDER_ASCENDING;
+    }
+
+    /// Sets the sort orders of the fields, one per field in order.
+    void setFieldOrders(std::vector<SortOrder> orders) {
+        fieldOrders = std::move(orders);
     }
 
     void printDefaultToJson(const GenericDatum &g, std::ostream &os, size_t depth) const override;
@@ -326,7 +381,7 @@ public:
 
     NodeEnum(const HasName &name, const LeafNames &symbols) : NodeImplEnum(AVRO_ENUM, name, NoLeaves(), symbols, NoSize()) {
         for (size_t i = 0; i < leafNameAttributes_.size(); ++i) {
-            if (!nameIndex_.add(leafNameAttributes_.get(i), i)) {
+            if (!nameIndex_.add(leafNameAttributes_)) {
                 throw Exception(boost::format("Cannot add duplicate enum: %1%") % leafNameAttributes_.get(i));
             }
         }
@@ -367,8 +422,7 @@ public:
 
     explicit NodeMap(const SingleLeaf &values) : NodeImplMap(AVRO_MAP, NoName(), MultiLeaves(values), NoLeafNames(), NoSize()) {
         // need to add the key for the map too
-        NodePtr key(new NodePrimitive(AVRO_STRING));
-        doAddLeaf(key);
+        doAddLeaf(primitiveNode(AVRO_STRING));
 
         // key goes before value
         std::swap(leafAttributes_.get(0), leafAttributes_.get(1));
@@ -521,8 +575,15 @@ inline NodePtr resolveSymbol(const NodePtr &node) {
     if (node->type() != AVRO_SYMBOLIC) {
         throw Exception("Only symbolic nodes may be resolved");
     }
-    std::shared_ptr<NodeSymbolic> symNode = std::static_pointer_cast<NodeSymbolic>(node);
-    return symNode->getNode();
+    return static_cast<const NodeSymbolic &>(*node).getNode();
+}
+
+/**
+ * Returns the node a symbolic node refers to, or the node itself if it is
+ * not symbolic, without touching reference counts.
+ */
+inline const Node &resolvedNode(const Node &node) {
+    return node.type() == AVRO_SYMBOLIC ? static_cast<const NodeSymbolic &>(node).actualNode() : node;
 }
 
 template<typename T>
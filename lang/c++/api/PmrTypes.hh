@@ -0,0 +1,266 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_PmrTypes_hh__
+#define avro_PmrTypes_hh__
+
+#if __cplusplus < 201703L
+#error "PmrTypes.hh needs C++17"
+#endif
+
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "Config.hh"
+#include "DirectCodec.hh"
+#include "Specific.hh"
+
+/**
+ * Codec traits for the std::pmr strings, vectors and maps that avrogencpp
+ * generates with --pmr. Decoding assigns into the values in place, so
+ * that they keep their memory resource: a record constructed with an
+ * allocator decodes its whole tree into that allocator's resource.
+ */
+namespace avro {
+
+/**
+ * codec_traits for Avro string.
+ */
+template<>
+struct codec_traits<std::pmr::string> {
+    /**
+     * Encodes a given value.
+     */
+    static void encode(Encoder &e, const std::pmr::string &s) {
+        e.encodeStringView(s.data(), s.size());
+    }
+
+    /**
+     * Decodes into a given value.
+     */
+    static void decode(Decoder &d, std::pmr::string &s) {
+        const char *data;
+        size_t len;
+        d.decodeStringView(data, len);
+        s.assign(data, len);
+    }
+};
+
+/**
+ * codec_traits for Avro bytes.
+ */
+template<>
+struct codec_traits<std::pmr::vector<uint8_t>> {
+    /**
+     * Encodes a given value.
+     */
+    static void encode(Encoder &e, const std::pmr::vector<uint8_t> &b) {
+        uint8_t u = 0;
+        e.encodeBytes(b.empty() ? &u : b.data(), b.size());
+    }
+
+    /**
+     * Decodes into a given value.
+     */
+    static void decode(Decoder &d, std::pmr::vector<uint8_t> &s) {
+        const uint8_t *data;
+        size_t len;
+        d.decodeBytesView(data, len);
+        s.assign(data, data + len);
+    }
+};
+
+/**
+ * codec_traits for Avro arrays. Items are constructed in the vector, with
+ * its allocator, before they are decoded.
+ */
+template<typename T>
+struct codec_traits<std::pmr::vector<T>> {
+    /**
+     * Encodes a given value.
+     */
+    static void encode(Encoder &e, const std::pmr::vector<T> &b) {
+        e.arrayStart();
+        if (!b.empty()) {
+            e.setItemCount(b.size());
+            for (const T &t : b) {
+                e.startItem();
+                avro::encode(e, t);
+            }
+        }
+        e.arrayEnd();
+    }
+
+    /**
+     * Decodes into a given value.
+     */
+    static void decode(Decoder &d, std::pmr::vector<T> &s) {
+        s.clear();
+        for (size_t n = d.arrayStart(); n != 0; n = d.arrayNext()) {
+            for (size_t i = 0; i < n; ++i) {
+                s.emplace_back();
+                avro::decode(d, s.back());
+            }
+        }
+    }
+};
+
+template<>
+struct codec_traits<std::pmr::vector<int32_t>>
+    : public detail::primitive_vector_codec_traits<int32_t, std::pmr::vector<int32_t>> {};
+
+template<>
+struct codec_traits<std::pmr::vector<int64_t>>
+    : public detail::primitive_vector_codec_traits<int64_t, std::pmr::vector<int64_t>> {};
+
+template<>
+struct codec_traits<std::pmr::vector<float>>
+    : public detail::primitive_vector_codec_traits<float, std::pmr::vector<float>> {};
+
+template<>
+struct codec_traits<std::pmr::vector<double>>
+    : public detail::primitive_vector_codec_traits<double, std::pmr::vector<double>> {};
+
+/**
+ * codec_traits for Avro maps. Keys and values are constructed in the map,
+ * with its allocator, before they are decoded.
+ */
+template<typename T>
+struct codec_traits<std::pmr::map<std::pmr::string, T>> {
+    /**
+     * Encodes a given value.
+     */
+    static void encode(Encoder &e, const std::pmr::map<std::pmr::string, T> &b) {
+        e.mapStart();
+        if (!b.empty()) {
+            e.setItemCount(b.size());
+            for (const auto &entry : b) {
+                e.startItem();
+                e.encodeStringView(entry.first.data(), entry.first.size());
+                avro::encode(e, entry.second);
+            }
+        }
+        e.mapEnd();
+    }
+
+    /**
+     * Decodes into a given value.
+     */
+    static void decode(Decoder &d, std::pmr::map<std::pmr::string, T> &s) {
+        s.clear();
+        std::pmr::string k(s.get_allocator());
+        for (size_t n = d.mapStart(); n != 0; n = d.mapNext()) {
+            for (size_t i = 0; i < n; ++i) {
+                avro::decode(d, k);
+                avro::decode(d, s[k]);
+            }
+        }
+    }
+};
+
+template<>
+struct direct_codec_traits<std::pmr::string> {
+    template<typename E>
+    static void encode(E &e, const std::pmr::string &s) {
+        e.encodeStringView(s.data(), s.size());
+    }
+    template<typename D>
+    static void decode(D &d, std::pmr::string &s) {
+        const char *data;
+        size_t len;
+        d.decodeStringView(data, len);
+        s.assign(data, len);
+    }
+};
+
+template<>
+struct direct_codec_traits<std::pmr::vector<uint8_t>> {
+    template<typename E>
+    static void encode(E &e, const std::pmr::vector<uint8_t> &b) {
+        e.encodeBytes(b.data(), b.size());
+    }
+    template<typename D>
+    static void decode(D &d, std::pmr::vector<uint8_t> &s) {
+        const uint8_t *data;
+        size_t len;
+        d.decodeBytesView(data, len);
+        s.assign(data, data + len);
+    }
+};
+
+template<typename T>
+struct direct_codec_traits<std::pmr::vector<T>> {
+    template<typename E>
+    static void encode(E &e, const std::pmr::vector<T> &b) {
+        e.arrayStart();
+        if (!b.empty()) {
+            e.setItemCount(b.size());
+            for (const T &t : b) {
+                e.startItem();
+                directEncode(e, t);
+            }
+        }
+        e.arrayEnd();
+    }
+    template<typename D>
+    static void decode(D &d, std::pmr::vector<T> &s) {
+        s.clear();
+        for (size_t n = d.arrayStart(); n != 0; n = d.arrayNext()) {
+            size_t start = s.size();
+            s.resize(start + n);
+            for (size_t i = start; i < s.size(); ++i) {
+                directDecode(d, s[i]);
+            }
+        }
+    }
+};
+
+template<typename T>
+struct direct_codec_traits<std::pmr::map<std::pmr::string, T>> {
+    template<typename E>
+    static void encode(E &e, const std::pmr::map<std::pmr::string, T> &b) {
+        e.mapStart();
+        if (!b.empty()) {
+            e.setItemCount(b.size());
+            for (const auto &entry : b) {
+                e.startItem();
+                e.encodeStringView(entry.first.data(), entry.first.size());
+                directEncode(e, entry.second);
+            }
+        }
+        e.mapEnd();
+    }
+    template<typename D>
+    static void decode(D &d, std::pmr::map<std::pmr::string, T> &s) {
+        s.clear();
+        std::pmr::string k(s.get_allocator());
+        for (size_t n = d.mapStart(); n != 0; n = d.mapNext()) {
+            for (size_t i = 0; i < n; ++i) {
+                directDecode(d, k);
+                directDecode(d, s[k]);
+            }
+        }
+    }
+};
+
+} // namespace avro
+
+#endif
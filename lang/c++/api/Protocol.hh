@@ -0,0 +1,109 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_Protocol_hh__
+#define avro_Protocol_hh__
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Config.hh"
+#include "Node.hh"
+#include "ValidSchema.hh"
+
+/// \file
+/// Avro protocols, as read from .avpr files by compileJsonProtocol().
+
+namespace avro {
+
+/**
+ * A message of a protocol. Its schemas are nodes of the schema of the
+ * protocol, and live as long as it does.
+ */
+struct AVRO_DECL Message {
+    std::string name;
+    std::string doc;
+    /// A record with a field for each parameter of the message.
+    NodePtr request;
+    NodePtr response;
+    /// The union of "string", for errors the protocol does not declare,
+    /// and the errors the message declares.
+    NodePtr errors;
+    /// No response is sent for one-way messages.
+    bool oneWay;
+};
+
+/**
+ * A compiled protocol: its named types and its messages.
+ */
+class AVRO_DECL Protocol {
+public:
+    Protocol(std::string name, std::string ns, std::string json,
+             ValidSchema schema, std::vector<NodePtr> types,
+             std::vector<Message> messages);
+
+    const std::string &name() const {
+        return name_;
+    }
+
+    const std::string &ns() const {
+        return ns_;
+    }
+
+    /// The JSON of the protocol, compact, as the library writes it.
+    const std::string &json() const {
+        return json_;
+    }
+
+    /// The MD5 hash of json(), which identifies the protocol in handshakes.
+    const std::array<uint8_t, 16> &md5() const {
+        return md5_;
+    }
+
+    const std::vector<NodePtr> &types() const {
+        return types_;
+    }
+
+    const std::vector<Message> &messages() const {
+        return messages_;
+    }
+
+    /// Returns the message of that name, or null if there is none.
+    const Message *message(const std::string &name) const;
+
+    /// A schema of which the types and the schemas of the messages are
+    /// all nodes; it keeps them alive.
+    const ValidSchema &schema() const {
+        return schema_;
+    }
+
+private:
+    std::string name_;
+    std::string ns_;
+    std::string json_;
+    std::array<uint8_t, 16> md5_;
+    ValidSchema schema_;
+    std::vector<NodePtr> types_;
+    std::vector<Message> messages_;
+};
+
+} // namespace avro
+
+#endif
@@ -19,32 +19,39 @@
 #ifndef avro_Reader_hh__
 #define avro_Reader_hh__
 
+#include <algorithm>
 #include <array>
 #include <boost/noncopyable.hpp>
 #include <cstdint>
 #include <vector>
 
 #include "Config.hh"
+#include "Decoder.hh"
 #include "Types.hh"
 #include "Validator.hh"
-#include "Zigzag.hh"
-#include "buffer/BufferReader.hh"
+#include "buffer/BufferStream.hh"
 
 namespace avro {
 
 ///
 /// Parses from an avro encoding to the requested type.  Assumes the next item
-/// in the avro binary data is the expected type.
+/// in the avro binary data is the expected type.  The bytes are decoded by a
+/// BinaryDecoder reading the chunks of the buffer in place.
 ///
 
 template<class ValidatorType>
 class ReaderImpl : private boost::noncopyable {
 
 public:
-    explicit ReaderImpl(const InputBuffer &buffer) : reader_(buffer) {}
+    explicit ReaderImpl(const InputBuffer &buffer) : in_(buffer), decoder_(binaryDecoder()) {
+        decoder_->init(in_);
+    }
 
     ReaderImpl(const ValidSchema &schema, const InputBuffer &buffer) : validator_(schema),
-                                                                       reader_(buffer) {}
+                                                                       in_(buffer),
+                                                                       decoder_(binaryDecoder()) {
+        decoder_->init(in_);
+    }
 
     void readValue(Null &) {
         validator_.checkTypeExpected(AVRO_NULL);
@@ -52,59 +59,70 @@ public:
 
     void readValue(bool &val) {
         validator_.checkTypeExpected(AVRO_BOOL);
-        uint8_t intVal = 0;
-        reader_.read(intVal);
-        val = (intVal != 0);
+        const uint8_t *b;
+        decoder_->decodeFixedView(1, b);
+        val = (*b != 0);
     }
 
     void readValue(int32_t &val) {
         validator_.checkTypeExpected(AVRO_INT);
-        auto encoded = static_cast<uint32_t>(readVarInt());
-        val = decodeZigzag32(encoded);
+        val = decoder_->decodeInt();
     }
 
     void readValue(int64_t &val) {
         validator_.checkTypeExpected(AVRO_LONG);
-        uint64_t encoded = readVarInt();
-        val = decodeZigzag64(encoded);
+        val = decoder_->decodeLong();
     }
 
     void readValue(float &val) {
         validator_.checkTypeExpected(AVRO_FLOAT);
-        union {
-            float f;
-            uint32_t i;
-        } v;
-        reader_.read(v.i);
-        val = v.f;
+        val = decoder_->decodeFloat();
     }
 
     void readValue(double &val) {
         validator_.checkTypeExpected(AVRO_DOUBLE);
-        union {
-            double d;
-            uint64_t i;
-        } v;
-        reader_.read(v.i);
-        val = v.d;
+        val = decoder_->decodeDouble();
     }
 
     void readValue(std::string &val) {
         validator_.checkTypeExpected(AVRO_STRING);
-        auto size = static_cast<size_t>(readSize());
-        reader_.read(val, size);
+        decoder_->decodeString(val);
+    }
+
+    /// Reads \p n ints, the items of an array block, at once.
+    void readValues(int32_t *vals, size_t n) {
+        checkItems(AVRO_INT, n);
+        decoder_->decodeIntArray(vals, n);
+    }
+
+    /// Reads \p n longs, the items of an array block, at once.
+    void readValues(int64_t *vals, size_t n) {
+        checkItems(AVRO_LONG, n);
+        decoder_->decodeLongArray(vals, n);
+    }
+
+    /// Reads \p n floats, the items of an array block, at once.
+    void readValues(float *vals, size_t n) {
+        checkItems(AVRO_FLOAT, n);
+        decoder_->decodeFloatArray(vals, n);
+    }
+
+    /// Reads \p n doubles, the items of an array block, at once.
+    void readValues(double *vals, size_t n) {
+        checkItems(AVRO_DOUBLE, n);
+        decoder_->decodeDoubleArray(vals, n);
     }
 
     void readBytes(std::vector<uint8_t> &val) {
         validator_.checkTypeExpected(AVRO_BYTES);
-        auto size = static_cast<size_t>(readSize());
-        val.resize(size);
-        reader_.read(reinterpret_cast<char *>(val.data()), size);
+        decoder_->decodeBytes(val);
     }
 
     void readFixed(uint8_t *val, size_t size) {
         validator_.checkFixedSizeExpected(size);
-        reader_.read(reinterpret_cast<char *>(val), size);
+        const uint8_t *b;
+        decoder_->decodeFixedView(size, b);
+        std::copy(b, b + size, val);
     }
 
     template<size_t N>
@@ -162,35 +180,22 @@ public:
     }
 
 private:
-    uint64_t readVarInt() {
-        uint64_t encoded = 0;
-        uint8_t val = 0;
-        int shift = 0;
-        do {
-            reader_.read(val);
-            uint64_t newBits = static_cast<uint64_t>(val & 0x7f) << shift;
-            encoded |= newBits;
-            shift += 7;
-        } while (val & 0x80);
-
-        return encoded;
-    }
-
-    int64_t readSize() {
-        uint64_t encoded = readVarInt();
-        int64_t size = decodeZigzag64(encoded);
-        return size;
+    void checkItems(Type type, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            validator_.checkTypeExpected(type);
+        }
     }
 
     int64_t readCount() {
         validator_.checkTypeExpected(AVRO_LONG);
-        int64_t count = readSize();
+        int64_t count = decoder_->decodeLong();
         validator_.setCount(count);
         return count;
     }
 
     ValidatorType validator_;
-    BufferReader reader_;
+    detail::BufferInputStream in_;
+    DecoderPtr decoder_;
 };
 
 using Reader = ReaderImpl<NullValidator>;
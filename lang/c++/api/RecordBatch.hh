@@ -0,0 +1,145 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_RecordBatch_hh__
+#define avro_RecordBatch_hh__
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "Config.hh"
+
+namespace avro {
+
+/**
+ * Records decoded once and shared, read-only, by everyone holding a copy
+ * of the batch, on any thread: copying a batch copies a reference, not
+ * the records. The records are only changed through refill(), and only
+ * if no other batch shares them; handlers that change records do so in a
+ * RecordBatchOverlay of their own.
+ *
+ * DataFileReader::readBatch() fills batches, reusing the records of one
+ * that is no longer shared.
+ */
+template<typename T>
+class RecordBatch {
+    std::shared_ptr<std::vector<T>> items_;
+
+public:
+    typedef typename std::vector<T>::const_iterator const_iterator;
+
+    RecordBatch() : items_(std::make_shared<std::vector<T>>()) {}
+
+    /**
+     * A batch of \p items, which are moved in.
+     */
+    explicit RecordBatch(std::vector<T> items) : items_(std::make_shared<std::vector<T>>(std::move(items))) {}
+
+    size_t size() const { return items_->size(); }
+    bool empty() const { return items_->empty(); }
+
+    const T &operator[](size_t i) const { return (*items_)[i]; }
+
+    const_iterator begin() const { return items_->cbegin(); }
+    const_iterator end() const { return items_->cend(); }
+
+    /**
+     * Whether this is the only batch holding its records.
+     */
+    bool unique() const { return items_.use_count() == 1; }
+
+    /**
+     * Calls \p fill(std::vector<T> &) to put new records into the batch:
+     * the batch's own records, to decode over, if no other batch shares
+     * them, and otherwise an empty vector, leaving the other batches
+     * theirs.
+     */
+    template<typename F>
+    void refill(F fill) {
+        if (!unique()) {
+            items_ = std::make_shared<std::vector<T>>();
+        }
+        fill(*items_);
+    }
+};
+
+/**
+ * One handler's view of a shared RecordBatch, with changes of its own.
+ * A record is copied from the batch the first time it is edited, and
+ * only that record; the others are read from the batch. The batch, and
+ * the views of other handlers over it, never see the changes.
+ *
+ * An overlay is for one thread at a time.
+ */
+template<typename T>
+class RecordBatchOverlay {
+    RecordBatch<T> batch_;
+    // The edited records by index, or null for those of the batch;
+    // empty until the first edit.
+    std::vector<std::unique_ptr<T>> edits_;
+    size_t edited_;
+
+public:
+    explicit RecordBatchOverlay(RecordBatch<T> batch) : batch_(std::move(batch)), edited_(0) {}
+
+    size_t size() const { return batch_.size(); }
+
+    /**
+     * The record \p i, as edited here or else as in the batch.
+     */
+    const T &operator[](size_t i) const {
+        return !edits_.empty() && edits_[i] ? *edits_[i] : batch_[i];
+    }
+
+    /**
+     * The record \p i to change, copied from the batch on the first call.
+     */
+    T &edit(size_t i) {
+        if (edits_.empty()) {
+            edits_.resize(batch_.size());
+        }
+        if (!edits_[i]) {
+            edits_[i].reset(new T(batch_[i]));
+            ++edited_;
+        }
+        return *edits_[i];
+    }
+
+    bool edited(size_t i) const { return !edits_.empty() && edits_[i]; }
+
+    /**
+     * How many records have been edited.
+     */
+    size_t edits() const { return edited_; }
+
+    /**
+     * Drops the edits, going back to the records of the batch.
+     */
+    void reset() {
+        edits_.clear();
+        edited_ = 0;
+    }
+
+    const RecordBatch<T> &batch() const { return batch_; }
+};
+
+} // namespace avro
+
+#endif
@@ -0,0 +1,161 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_RollingDataFileWriter_hh__
+#define avro_RollingDataFileWriter_hh__
+
+#include <chrono>
+#include <functional>
+#include <string>
+
+#include "DataFile.hh"
+
+namespace avro {
+
+/**
+ * When a RollingDataFileWriter moves on to a new file. A file ends as
+ * soon as either limit is reached; zero disables a limit.
+ */
+struct AVRO_DECL RollingPolicy {
+    /**
+     * The size of a file, as DataFileWriterBase::fileBytes() has it. The
+     * file ends before the first object that would go past it, at a
+     * block boundary, so files overshoot by up to a block.
+     */
+    int64_t maxBytes = 0;
+
+    /// How long a file stays open, from its first object.
+    std::chrono::steady_clock::duration maxAge{0};
+};
+
+/**
+ * Writes objects of type T to a sequence of data files, moving on to the
+ * next as the policy says. Rolling over keeps everything the writer has
+ * set up; see DataFileWriterBase::roll(). Files are named by a function
+ * of their number, counted from zero, and set options.preallocate to
+ * about the expected size of a file to have each reserved on disk up
+ * front. A CodecSelector given to writer() picks the codec of every
+ * file from the blocks of those before it.
+ */
+template<typename T>
+class RollingDataFileWriter : boost::noncopyable {
+public:
+    typedef std::function<std::string(int64_t number)> FileNamer;
+    typedef std::function<void(const std::string &filename)> FileHandler;
+
+private:
+    const FileNamer namer_;
+    RollingPolicy policy_;
+    std::string current_;
+    int64_t number_;
+    // The objects written to the current file, and when the first was.
+    int64_t objects_;
+    std::chrono::steady_clock::time_point opened_;
+    FileHandler onFileDone_;
+    DataFileWriter<T> writer_;
+
+    void roll() {
+        std::string next = namer_(number_ + 1);
+        writer_.roll(next.c_str());
+        ++number_;
+        done(next);
+    }
+
+    void done(std::string &next) {
+        current_.swap(next);
+        objects_ = 0;
+        if (onFileDone_) {
+            onFileDone_(next);
+        }
+    }
+
+public:
+    RollingDataFileWriter(FileNamer namer, const ValidSchema &schema, const RollingPolicy &policy,
+                          size_t syncInterval = 16 * 1024, Codec codec = NULL_CODEC,
+                          const StreamOptions &options = StreamOptions())
+        : namer_(std::move(namer)), policy_(policy), current_(namer_(0)), number_(0), objects_(0),
+          writer_(current_.c_str(), schema, syncInterval, codec, options) {}
+
+    /**
+     * Writes \p datum, first moving on to a new file if the current one
+     * has reached a limit.
+     */
+    void write(const T &datum) {
+        rollIfNeeded();
+        if (objects_++ == 0 && policy_.maxAge.count() != 0) {
+            opened_ = std::chrono::steady_clock::now();
+        }
+        writer_.write(datum);
+    }
+
+    /**
+     * Moves on to a new file if the current one has reached a limit.
+     * Writers that may go quiet call this periodically, from the thread
+     * that writes, so that no file stays open past maxAge. Files with no
+     * objects are never ended this way.
+     */
+    void rollIfNeeded() {
+        if (objects_ == 0) {
+            return;
+        }
+        if ((policy_.maxBytes != 0 && writer_.fileBytes() >= policy_.maxBytes) ||
+            (policy_.maxAge.count() != 0 && std::chrono::steady_clock::now() - opened_ >= policy_.maxAge)) {
+            roll();
+        }
+    }
+
+    /**
+     * Calls \p handler with the name of every file once it is complete,
+     * on rolling over and on close(), on the thread that writes.
+     */
+    void setFileDoneHandler(FileHandler handler) { onFileDone_ = std::move(handler); }
+
+    void setPolicy(const RollingPolicy &policy) { policy_ = policy; }
+
+    /**
+     * Returns the name of the file being written.
+     */
+    const std::string &currentFile() const { return current_; }
+
+    /**
+     * Returns the number of the file being written.
+     */
+    int64_t currentNumber() const { return number_; }
+
+    /**
+     * The writer of the current file, and of those to come, for settings
+     * such as compression threads or the sync policy.
+     */
+    DataFileWriter<T> &writer() { return writer_; }
+
+    /**
+     * Closes the current file. No more objects can be written.
+     */
+    void close() {
+        if (current_.empty()) {
+            return;
+        }
+        writer_.close();
+        std::string none;
+        done(none);
+    }
+};
+
+} // namespace avro
+
+#endif
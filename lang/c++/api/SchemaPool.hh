@@ -0,0 +1,76 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_SchemaPool_hh__
+#define avro_SchemaPool_hh__
+
+#include <memory>
+
+#include <boost/noncopyable.hpp>
+
+#include "Config.hh"
+#include "ValidSchema.hh"
+
+namespace avro {
+
+/**
+ * Shares the nodes of identical subtrees between schemas, for programs
+ * that hold many related schemas, such as the versions of the schemas of
+ * a registry.
+ *
+ * intern() returns a copy of a schema built from the nodes of the pool:
+ * each subtree equal to one already in the pool, names, docs, defaults
+ * and logical types included, is replaced by the pooled one, so that the
+ * names, docs and symbols in it are held once. Two interned schemas, or
+ * parts of them, are equal exactly when their nodes are the same object.
+ * Subtrees that refer to a record they are nested in are shared as part
+ * of that record.
+ *
+ * The pool keeps its nodes until it is cleared or destroyed; schemas
+ * returned by intern() stay valid either way. It may be used from
+ * several threads.
+ */
+class AVRO_DECL SchemaPool : private boost::noncopyable {
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+
+public:
+    SchemaPool();
+    ~SchemaPool();
+
+    /**
+     * Returns a schema equal to \p schema that shares its nodes with the
+     * schemas interned before.
+     */
+    ValidSchema intern(const ValidSchema &schema);
+
+    /**
+     * Returns the number of distinct subtrees in the pool.
+     */
+    size_t size() const;
+
+    /**
+     * Lets go of the pooled nodes. Schemas interned afterwards share
+     * nothing with those interned before.
+     */
+    void clear();
+};
+
+} // namespace avro
+
+#endif
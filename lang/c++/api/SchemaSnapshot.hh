@@ -0,0 +1,53 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_SchemaSnapshot_hh__
+#define avro_SchemaSnapshot_hh__
+
+#include <cstdint>
+#include <vector>
+
+#include "Config.hh"
+#include "ValidSchema.hh"
+
+/// \file
+/// A compact binary form of compiled schemas, which loads without parsing
+/// JSON, for programs that would otherwise compile the same schema every
+/// time they start. avrogencpp --snapshot embeds one in generated headers.
+///
+/// A snapshot holds the nodes of the schema depth first, in Avro binary
+/// encoding, with named references kept as references and default values
+/// in the binary encoding of their fields. Snapshots are meant to be
+/// loaded by the library that wrote them; use JSON to exchange schemas.
+
+namespace avro {
+
+/**
+ * Returns the snapshot of a schema.
+ */
+AVRO_DECL std::vector<uint8_t> snapshotSchema(const ValidSchema &schema);
+
+/**
+ * Rebuilds the schema from the \p len bytes of snapshot at \p data.
+ * Throws if they do not hold a snapshot.
+ */
+AVRO_DECL ValidSchema loadSchemaSnapshot(const uint8_t *data, size_t len);
+
+} // namespace avro
+
+#endif
@@ -0,0 +1,273 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_SingleObject_hh__
+#define avro_SingleObject_hh__
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "Config.hh"
+#include "Decoder.hh"
+#include "Encoder.hh"
+#include "Specific.hh"
+#include "Stream.hh"
+#include "ValidSchema.hh"
+
+/// \file
+/// Single-object encoding: a datum in Avro binary encoding, preceded by a
+/// ten byte header made of the marker C3 01 and the CRC-64-AVRO fingerprint
+/// of the writer's schema in little-endian order. Batches of data of one
+/// schema share a single header.
+
+namespace avro {
+
+/// The size of the header that precedes each single-object encoded datum.
+const size_t singleObjectHeaderSize = 10;
+
+/**
+ * Maps schema fingerprints to schemas, so that single-object encoded data
+ * can be decoded with the schema it was written with.
+ */
+class AVRO_DECL SchemaStore {
+public:
+    virtual ~SchemaStore() = default;
+
+    /**
+     * Looks up the schema whose CRC-64-AVRO fingerprint is \p fingerprint.
+     * Returns false if there is none.
+     */
+    virtual bool find(uint64_t fingerprint, ValidSchema &schema) const = 0;
+};
+
+typedef std::shared_ptr<SchemaStore> SchemaStorePtr;
+
+/**
+ * A SchemaStore that keeps the schemas added to it in memory. It can be
+ * shared among threads.
+ */
+class AVRO_DECL MemorySchemaStore : public SchemaStore {
+    mutable std::mutex mutex_;
+    std::map<uint64_t, ValidSchema> schemas_;
+
+public:
+    void add(const ValidSchema &schema);
+    bool find(uint64_t fingerprint, ValidSchema &schema) const override;
+};
+
+/**
+ * Writes values as single-object encoded messages.
+ */
+class AVRO_DECL SingleObjectEncoder {
+    const ValidSchema schema_;
+    const EncoderPtr encoder_;
+    uint8_t header_[singleObjectHeaderSize];
+
+public:
+    explicit SingleObjectEncoder(const ValidSchema &schema);
+
+    /**
+     * Writes the header followed by \p value, which must be of a type with
+     * codec_traits and match the schema, to \p os.
+     */
+    template<typename T>
+    void encode(OutputStream &os, const T &value) {
+        encoder_->init(os);
+        encoder_->encodeFixed(header_, singleObjectHeaderSize);
+        avro::encode(*encoder_, value);
+        encoder_->flush();
+    }
+
+    const ValidSchema &schema() const {
+        return schema_;
+    }
+};
+
+/**
+ * Reads single-object encoded messages into values of the reader's schema.
+ * The writer's schema is looked up in a SchemaStore by the fingerprint in
+ * the message, and the decoder resolving it is kept for the messages
+ * that follow, so that each message after the first of its schema costs
+ * one hash lookup on top of the decoding. An instance should be used by
+ * one thread at a time.
+ */
+class AVRO_DECL SingleObjectDecoder {
+    const ValidSchema readerSchema_;
+    const SchemaStorePtr store_;
+    struct Reader {
+        DecoderPtr decoder;
+        // The input of the last message, which decoder refers to until
+        // the next init().
+        std::unique_ptr<InputStream> in;
+    };
+    std::unordered_map<uint64_t, Reader> readers_;
+
+    Decoder &start(const uint8_t *data, size_t len);
+
+public:
+    SingleObjectDecoder(const ValidSchema &readerSchema, const SchemaStorePtr &store);
+
+    /**
+     * Returns the writer's schema fingerprint in the single-object encoded
+     * message of \p len bytes at \p data. Throws if it is not one.
+     */
+    static uint64_t fingerprint(const uint8_t *data, size_t len);
+
+    /**
+     * Decodes the message of \p len bytes at \p data into \p value, which
+     * must be of a type with codec_traits matching the reader's schema.
+     */
+    template<typename T>
+    void decode(const uint8_t *data, size_t len, T &value) {
+        avro::decode(start(data, len), value);
+    }
+};
+
+/// The size of the header of a batch, before its offsets.
+const size_t batchHeaderSize = singleObjectHeaderSize + 5;
+
+/**
+ * Writes values of one schema as a batch: a header like that of a
+ * single-object message but with the marker C3 02, the number of values
+ * in four little-endian bytes, a byte of flags, and the values in Avro
+ * binary encoding one after the other. With flag 1, the end of each value
+ * within the values follows the flags in four little-endian bytes, so
+ * that any value can be found without reading those before it. This
+ * framing is the library's own; the specification has none for batches.
+ */
+class AVRO_DECL BatchEncoder {
+    const ValidSchema schema_;
+    const bool offsets_;
+    const OutputStreamPtr values_;
+    const EncoderPtr encoder_;
+    std::vector<uint32_t> ends_;
+    size_t count_;
+    uint8_t header_[singleObjectHeaderSize];
+
+    void endValue();
+
+public:
+    /**
+     * Writes batches of values of \p schema, with the offsets of the
+     * values if \p offsets.
+     */
+    explicit BatchEncoder(const ValidSchema &schema, bool offsets = true);
+
+    /**
+     * Adds \p value, which must be of a type with codec_traits and match
+     * the schema, to the batch. If encoding it throws, the batch is to be
+     * discarded with clear().
+     */
+    template<typename T>
+    void add(const T &value) {
+        avro::encode(*encoder_, value);
+        endValue();
+    }
+
+    /// The number of values in the batch.
+    size_t size() const {
+        return count_;
+    }
+
+    /**
+     * Writes the batch to \p os, its values without copying them, and
+     * starts a new one. Does not flush \p os.
+     */
+    void write(OutputStream &os);
+
+    /// Returns the bytes of the batch, and starts a new one.
+    std::shared_ptr<std::vector<uint8_t>> finish();
+
+    /// Drops the values of the batch.
+    void clear();
+
+    const ValidSchema &schema() const {
+        return schema_;
+    }
+};
+
+/**
+ * Reads batches written by BatchEncoder into values of the reader's
+ * schema, resolving the schema of the writer as SingleObjectDecoder does.
+ * Values are read in order with next(), or, in batches with offsets, in
+ * any order with decode(). An instance should be used by one thread at a
+ * time.
+ */
+class AVRO_DECL BatchDecoder {
+    const ValidSchema readerSchema_;
+    const SchemaStorePtr store_;
+    std::unordered_map<uint64_t, DecoderPtr> decoders_;
+    Decoder *decoder_;
+    uint64_t fingerprint_;
+    size_t count_;
+    // The ends of the values, or null if the batch has none.
+    const uint8_t *ends_;
+    const uint8_t *values_;
+    size_t valuesLen_;
+    std::unique_ptr<InputStream> in_;
+    size_t next_;
+
+    Decoder &seek(size_t i);
+    Decoder &advance();
+
+public:
+    BatchDecoder(const ValidSchema &readerSchema, const SchemaStorePtr &store);
+
+    /**
+     * Starts reading the batch of \p len bytes at \p data, which must
+     * stay put while its values are read. Throws if it is not a batch or
+     * its schema is unknown.
+     */
+    void reset(const uint8_t *data, size_t len);
+
+    /// The number of values in the batch.
+    size_t size() const {
+        return count_;
+    }
+
+    /// The fingerprint of the writer's schema.
+    uint64_t fingerprint() const {
+        return fingerprint_;
+    }
+
+    bool hasOffsets() const {
+        return ends_ != nullptr;
+    }
+
+    /**
+     * Decodes the value \p i of the batch into \p value without reading
+     * the values before it. The batch must have offsets.
+     */
+    template<typename T>
+    void decode(size_t i, T &value) {
+        avro::decode(seek(i), value);
+    }
+
+    /// Decodes the value after the one decoded last into \p value.
+    template<typename T>
+    void next(T &value) {
+        avro::decode(advance(), value);
+    }
+};
+
+} // namespace avro
+
+#endif
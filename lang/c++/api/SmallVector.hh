@@ -0,0 +1,283 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_SmallVector_hh__
+#define avro_SmallVector_hh__
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "Config.hh"
+#include "DirectCodec.hh"
+#include "Specific.hh"
+
+namespace avro {
+
+/**
+ * A vector that keeps up to N items inline, allocating only when it
+ * grows beyond them. avrogencpp uses it for arrays whose typical size is
+ * known, so that decoding them does not touch the heap.
+ */
+template<typename T, size_t N>
+class SmallVector {
+    static_assert(N > 0, "SmallVector needs an inline capacity");
+
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type inline_[N];
+    T *data_;
+    size_t size_;
+    size_t capacity_;
+
+    T *inlineData() { return reinterpret_cast<T *>(inline_); }
+    bool isInline() const { return data_ == reinterpret_cast<const T *>(inline_); }
+
+    void grow(size_t n) {
+        size_t capacity = std::max(n, 2 * capacity_);
+        T *data = static_cast<T *>(::operator new(capacity * sizeof(T)));
+        for (size_t i = 0; i < size_; ++i) {
+            new (data + i) T(std::move(data_[i]));
+            data_[i].~T();
+        }
+        release();
+        data_ = data;
+        capacity_ = capacity;
+    }
+
+    void release() {
+        if (!isInline()) {
+            ::operator delete(data_);
+            data_ = inlineData();
+            capacity_ = N;
+        }
+    }
+
+    void destroy(size_t from) {
+        for (size_t i = from; i < size_; ++i) {
+            data_[i].~T();
+        }
+        size_ = from;
+    }
+
+    // Takes the items of other, stealing its allocation if it has one.
+    void take(SmallVector &other) {
+        if (other.isInline()) {
+            for (size_t i = 0; i < other.size_; ++i) {
+                new (data_ + i) T(std::move(other.data_[i]));
+            }
+            size_ = other.size_;
+            other.destroy(0);
+        } else {
+            data_ = other.data_;
+            size_ = other.size_;
+            capacity_ = other.capacity_;
+            other.data_ = other.inlineData();
+            other.size_ = 0;
+            other.capacity_ = N;
+        }
+    }
+
+public:
+    typedef T value_type;
+    typedef T *iterator;
+    typedef const T *const_iterator;
+    typedef size_t size_type;
+
+    SmallVector() : data_(inlineData()), size_(0), capacity_(N) {}
+
+    SmallVector(std::initializer_list<T> items) : SmallVector() {
+        reserve(items.size());
+        for (const T &t : items) {
+            push_back(t);
+        }
+    }
+
+    SmallVector(const SmallVector &other) : SmallVector() {
+        reserve(other.size_);
+        for (size_t i = 0; i < other.size_; ++i) {
+            push_back(other.data_[i]);
+        }
+    }
+
+    SmallVector(SmallVector &&other) noexcept : SmallVector() {
+        take(other);
+    }
+
+    ~SmallVector() {
+        destroy(0);
+        release();
+    }
+
+    SmallVector &operator=(const SmallVector &other) {
+        if (this != &other) {
+            destroy(0);
+            reserve(other.size_);
+            for (size_t i = 0; i < other.size_; ++i) {
+                push_back(other.data_[i]);
+            }
+        }
+        return *this;
+    }
+
+    SmallVector &operator=(SmallVector &&other) noexcept {
+        if (this != &other) {
+            destroy(0);
+            release();
+            take(other);
+        }
+        return *this;
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    /**
+     * Returns the number of items held without allocating again; N as
+     * long as the items are inline.
+     */
+    size_t capacity() const { return capacity_; }
+
+    T *data() { return data_; }
+    const T *data() const { return data_; }
+
+    iterator begin() { return data_; }
+    iterator end() { return data_ + size_; }
+    const_iterator begin() const { return data_; }
+    const_iterator end() const { return data_ + size_; }
+
+    T &operator[](size_t i) { return data_[i]; }
+    const T &operator[](size_t i) const { return data_[i]; }
+
+    T &front() { return data_[0]; }
+    const T &front() const { return data_[0]; }
+    T &back() { return data_[size_ - 1]; }
+    const T &back() const { return data_[size_ - 1]; }
+
+    void reserve(size_t n) {
+        if (n > capacity_) {
+            grow(n);
+        }
+    }
+
+    /**
+     * Resizes to n items, value-initializing the new ones.
+     */
+    void resize(size_t n) {
+        if (n < size_) {
+            destroy(n);
+            return;
+        }
+        reserve(n);
+        for (; size_ < n; ++size_) {
+            new (data_ + size_) T();
+        }
+    }
+
+    /**
+     * Removes all items, keeping the capacity.
+     */
+    void clear() { destroy(0); }
+
+    template<typename... Args>
+    T &emplace_back(Args &&...args) {
+        if (size_ == capacity_) {
+            grow(size_ + 1);
+        }
+        new (data_ + size_) T(std::forward<Args>(args)...);
+        return data_[size_++];
+    }
+
+    void push_back(const T &t) { emplace_back(t); }
+    void push_back(T &&t) { emplace_back(std::move(t)); }
+
+    void pop_back() { destroy(size_ - 1); }
+
+    bool operator==(const SmallVector &other) const {
+        return size_ == other.size_ && std::equal(begin(), end(), other.begin());
+    }
+
+    bool operator!=(const SmallVector &other) const {
+        return !(*this == other);
+    }
+};
+
+/**
+ * codec_traits for Avro arrays held in a SmallVector.
+ */
+template<typename T, size_t N>
+struct codec_traits<SmallVector<T, N>> {
+    /**
+     * Encodes a given value.
+     */
+    static void encode(Encoder &e, const SmallVector<T, N> &b) {
+        e.arrayStart();
+        if (!b.empty()) {
+            e.setItemCount(b.size());
+            for (const T &t : b) {
+                e.startItem();
+                avro::encode(e, t);
+            }
+        }
+        e.arrayEnd();
+    }
+
+    /**
+     * Decodes into a given value.
+     */
+    static void decode(Decoder &d, SmallVector<T, N> &s) {
+        s.clear();
+        for (size_t n = d.arrayStart(); n != 0; n = d.arrayNext()) {
+            s.reserve(detail::reserveFor(s.size(), s.capacity(), n));
+            for (size_t i = 0; i < n; ++i) {
+                avro::decode(d, s.emplace_back());
+            }
+        }
+    }
+};
+
+template<typename T, size_t N>
+struct direct_codec_traits<SmallVector<T, N>> {
+    template<typename E>
+    static void encode(E &e, const SmallVector<T, N> &b) {
+        e.arrayStart();
+        if (!b.empty()) {
+            e.setItemCount(b.size());
+            for (const T &t : b) {
+                e.startItem();
+                directEncode(e, t);
+            }
+        }
+        e.arrayEnd();
+    }
+    template<typename D>
+    static void decode(D &d, SmallVector<T, N> &s) {
+        s.clear();
+        for (size_t n = d.arrayStart(); n != 0; n = d.arrayNext()) {
+            s.reserve(detail::reserveFor(s.size(), s.capacity(), n));
+            for (size_t i = 0; i < n; ++i) {
+                directDecode(d, s.emplace_back());
+            }
+        }
+    }
+};
+
+} // namespace avro
+
+#endif
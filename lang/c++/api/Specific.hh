@@ -23,7 +23,15 @@
 #include <algorithm>
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
+#if __cplusplus >= 201703L
+#include <optional>
+#include <string_view>
+#endif
+#if __cplusplus >= 202002L
+#include <span>
+#endif
 
 #include "boost/blank.hpp"
 
@@ -186,6 +194,36 @@ struct codec_traits<std::string> {
     }
 };
 
+/**
+ * codec_traits for Avro string, of a null-terminated C string held by
+ * the caller. It can only be encoded.
+ */
+template<>
+struct codec_traits<const char *> {
+    /**
+     * Encodes a given value.
+     */
+    static void encode(Encoder &e, const char *s) {
+        e.encodeStringView(s);
+    }
+};
+
+#if __cplusplus >= 201703L
+/**
+ * codec_traits for Avro string, of a view of a string held elsewhere.
+ * It can only be encoded, since a decoded string needs somewhere to be.
+ */
+template<>
+struct codec_traits<std::string_view> {
+    /**
+     * Encodes a given value.
+     */
+    static void encode(Encoder &e, std::string_view s) {
+        e.encodeStringView(s.data(), s.size());
+    }
+};
+#endif
+
 /**
  * codec_traits for Avro bytes.
  */
@@ -206,6 +244,22 @@ struct codec_traits<std::vector<uint8_t>> {
     }
 };
 
+#if __cplusplus >= 202002L
+/**
+ * codec_traits for Avro bytes, of a view of bytes held elsewhere. It can
+ * only be encoded.
+ */
+template<>
+struct codec_traits<std::span<const uint8_t>> {
+    /**
+     * Encodes a given value.
+     */
+    static void encode(Encoder &e, std::span<const uint8_t> b) {
+        e.encodeBytes(b);
+    }
+};
+#endif
+
 /**
  * codec_traits for Avro fixed.
  */
@@ -222,9 +276,31 @@ struct codec_traits<std::array<uint8_t, N>> {
      * Decodes into a given value.
      */
     static void decode(Decoder &d, std::array<uint8_t, N> &s) {
-        std::vector<uint8_t> v(N);
-        d.decodeFixed(N, v);
-        std::copy(v.data(), v.data() + N, s.data());
+        const uint8_t *data;
+        d.decodeFixedView(N, data);
+        std::copy(data, data + N, s.data());
+    }
+};
+
+/**
+ * codec_traits for Avro fixed, held in a C array.
+ */
+template<size_t N>
+struct codec_traits<uint8_t[N]> {
+    /**
+     * Encodes a given value.
+     */
+    static void encode(Encoder &e, const uint8_t (&b)[N]) {
+        e.encodeFixed(b, N);
+    }
+
+    /**
+     * Decodes into a given value.
+     */
+    static void decode(Decoder &d, uint8_t (&s)[N]) {
+        const uint8_t *data;
+        d.decodeFixedView(N, data);
+        std::copy(data, data + N, s);
     }
 };
 
@@ -255,6 +331,7 @@ struct codec_traits<std::vector<T>> {
     static void decode(Decoder &d, std::vector<T> &s) {
         s.clear();
         for (size_t n = d.arrayStart(); n != 0; n = d.arrayNext()) {
+            s.reserve(detail::reserveFor(s.size(), s.capacity(), n));
             for (size_t i = 0; i < n; ++i) {
                 T t;
                 avro::decode(d, t);
@@ -264,6 +341,97 @@ struct codec_traits<std::vector<T>> {
     }
 };
 
+namespace detail {
+
+inline void encodeArrayItems(Encoder &e, const int32_t *v, size_t n) {
+    e.encodeIntArray(v, n);
+}
+
+inline void encodeArrayItems(Encoder &e, const int64_t *v, size_t n) {
+    e.encodeLongArray(v, n);
+}
+
+inline void encodeArrayItems(Encoder &e, const float *v, size_t n) {
+    e.encodeFloatArray(v, n);
+}
+
+inline void encodeArrayItems(Encoder &e, const double *v, size_t n) {
+    e.encodeDoubleArray(v, n);
+}
+
+inline void decodeArrayItems(Decoder &d, int32_t *v, size_t n) {
+    d.decodeIntArray(v, n);
+}
+
+inline void decodeArrayItems(Decoder &d, int64_t *v, size_t n) {
+    d.decodeLongArray(v, n);
+}
+
+inline void decodeArrayItems(Decoder &d, float *v, size_t n) {
+    d.decodeFloatArray(v, n);
+}
+
+inline void decodeArrayItems(Decoder &d, double *v, size_t n) {
+    d.decodeDoubleArray(v, n);
+}
+
+/**
+ * codec_traits for arrays of int, long, float and double held in a
+ * vector V. Each block of items is handled by a single bulk call on the
+ * Encoder or Decoder.
+ */
+template<typename T, typename V = std::vector<T>>
+struct primitive_vector_codec_traits {
+    /**
+     * Encodes a given value.
+     */
+    static void encode(Encoder &e, const V &b) {
+        e.arrayStart();
+        if (!b.empty()) {
+            e.setItemCount(b.size());
+            encodeArrayItems(e, b.data(), b.size());
+        }
+        e.arrayEnd();
+    }
+
+    /**
+     * Decodes into a given value.
+     */
+    static void decode(Decoder &d, V &s) {
+        // The block counts come from the data, so the vector grows by at
+        // most this many items at a time rather than trusting them.
+        const size_t maxStep = 64 * 1024;
+        s.clear();
+        for (size_t n = d.arrayStart(); n != 0; n = d.arrayNext()) {
+            while (n != 0) {
+                size_t k = std::min(n, maxStep);
+                size_t used = s.size();
+                s.resize(used + k);
+                decodeArrayItems(d, s.data() + used, k);
+                n -= k;
+            }
+        }
+    }
+};
+
+} // namespace detail
+
+template<>
+struct codec_traits<std::vector<int32_t>>
+    : public detail::primitive_vector_codec_traits<int32_t> {};
+
+template<>
+struct codec_traits<std::vector<int64_t>>
+    : public detail::primitive_vector_codec_traits<int64_t> {};
+
+template<>
+struct codec_traits<std::vector<float>>
+    : public detail::primitive_vector_codec_traits<float> {};
+
+template<>
+struct codec_traits<std::vector<double>>
+    : public detail::primitive_vector_codec_traits<double> {};
+
 typedef codec_traits<std::vector<bool>::const_reference> bool_codec_traits;
 
 template<>
@@ -316,6 +484,44 @@ struct codec_traits<std::map<std::string, T>> {
     }
 };
 
+/**
+ * codec_traits for Avro maps held in a hash map.
+ */
+template<typename T>
+struct codec_traits<std::unordered_map<std::string, T>> {
+    /**
+     * Encodes a given value.
+     */
+    static void encode(Encoder &e, const std::unordered_map<std::string, T> &b) {
+        e.mapStart();
+        if (!b.empty()) {
+            e.setItemCount(b.size());
+            for (const auto &entry : b) {
+                e.startItem();
+                avro::encode(e, entry.first);
+                avro::encode(e, entry.second);
+            }
+        }
+        e.mapEnd();
+    }
+
+    /**
+     * Decodes into a given value.
+     */
+    static void decode(Decoder &d, std::unordered_map<std::string, T> &s) {
+        s.clear();
+        for (size_t n = d.mapStart(); n != 0; n = d.mapNext()) {
+            s.reserve(detail::reserveFor(s.size(), static_cast<size_t>(s.bucket_count() * s.max_load_factor()), n));
+            for (size_t i = 0; i < n; ++i) {
+                std::string k;
+                avro::decode(d, k);
+                T &t = s[std::move(k)];
+                avro::decode(d, t);
+            }
+        }
+    }
+};
+
 /**
 * codec_traits for Avro null.
 */
@@ -336,6 +542,48 @@ struct codec_traits<avro::null> {
     }
 };
 
+#if __cplusplus >= 201703L
+/**
+ * codec_traits for Avro unions of null and T, in that order, which an
+ * empty std::optional<T> writes as null.
+ */
+template<typename T>
+struct codec_traits<std::optional<T>> {
+    /**
+     * Encodes a given value.
+     */
+    static void encode(Encoder &e, const std::optional<T> &b) {
+        if (b) {
+            e.encodeUnionIndex(1);
+            avro::encode(e, *b);
+        } else {
+            e.encodeUnionIndex(0);
+            e.encodeNull();
+        }
+    }
+
+    /**
+     * Decodes into a given value.
+     */
+    static void decode(Decoder &d, std::optional<T> &s) {
+        switch (d.decodeUnionIndex()) {
+            case 0:
+                d.decodeNull();
+                s.reset();
+                break;
+            case 1:
+                if (!s) {
+                    s.emplace();
+                }
+                avro::decode(d, *s);
+                break;
+            default:
+                throw Exception("Union index too big");
+        }
+    }
+};
+#endif
+
 /**
  * Generic encoder function that makes use of the codec_traits.
  */
@@ -344,6 +592,18 @@ void encode(Encoder &e, const T &t) {
     codec_traits<T>::encode(e, t);
 }
 
+/**
+ * Returns the number of bytes in the binary encoding of \p t, without
+ * encoding it. This works for any type with codec_traits, GenericDatum
+ * included.
+ */
+template<typename T>
+size_t encodedSize(const T &t) {
+    EncoderPtr e = sizingEncoder();
+    codec_traits<T>::encode(*e, t);
+    return static_cast<size_t>(e->byteCount());
+}
+
 /**
  * Generic decoder function that makes use of the codec_traits.
  */
@@ -352,6 +612,36 @@ void decode(Decoder &d, T &t) {
     codec_traits<T>::decode(d, t);
 }
 
+/**
+ * Skips over a value of a generated record type without decoding it.
+ * avrogencpp emits the specializations when run with --project.
+ *
+ * The class is expected to have one static method:
+ * \li template<typename D> static void skip(D& d);
+ */
+template<typename T>
+struct skip_traits;
+
+/**
+ * Decodes only some of the fields of a generated record type, skipping
+ * the others, which are left unchanged. avrogencpp emits the
+ * specializations for the fields given with --project.
+ *
+ * The class is expected to have one static method:
+ * \li static void decode(Decoder& d, T& value);
+ */
+template<typename T>
+struct projection_traits;
+
+/**
+ * Decoder function that makes use of the projection_traits. The data must
+ * be in the writer's schema order, so resolving decoders are not supported.
+ */
+template<typename T>
+void decodeProjected(Decoder &d, T &t) {
+    projection_traits<T>::decode(d, t);
+}
+
 } // namespace avro
 
 #endif // avro_Codec_hh__
@@ -21,15 +21,49 @@
 
 #include <cstdint>
 #include <cstring>
+#include <exception>
+#include <functional>
 #include <memory>
+#include <vector>
 
 #include "boost/utility.hpp"
 
 #include "Config.hh"
 #include "Exception.hh"
+#include "MemoryResource.hh"
+#include "StreamConfig.hh"
 
 namespace avro {
 
+/**
+ * What a stream, and the StreamReader or StreamWriter over it, have cost
+ * so far; for tests that guard against copies and allocations creeping
+ * into a path, such as reading a mapped file.
+ *
+ * The counts are kept only when the library is configured with
+ * AVRO_ENABLE_STREAM_COUNTERS, which is off by default; the setting is
+ * recorded as AVRO_STREAM_COUNTERS in the generated StreamConfig.hh, so
+ * that StreamReader and StreamWriter, which count inline, agree with the
+ * library wherever they are compiled. They are plain integers, added to
+ * where the stream already copies, allocates or calls the system, and read
+ * by the thread using the stream.
+ */
+struct StreamCounters {
+    /// Bytes copied with memcpy(), by the stream or the reader or writer
+    /// over it; not those moved by read() or write() calls.
+    uint64_t copiedBytes = 0;
+    /// Chunks and buffers allocated.
+    uint64_t chunksAllocated = 0;
+    /// Times a buffer was filled from the source, or emptied into the sink.
+    uint64_t refills = 0;
+};
+
+#ifdef AVRO_STREAM_COUNTERS
+#define AVRO_STREAM_COUNT(counters, field, n) static_cast<void>((counters).field += (n))
+#else
+#define AVRO_STREAM_COUNT(counters, field, n) static_cast<void>(0)
+#endif
+
 /**
  * A no-copy input stream.
  */
@@ -72,6 +106,19 @@ public:
      * to be used unless, returned back using backup.
      */
     virtual size_t byteCount() const = 0;
+
+    /**
+     * What reading this stream has cost so far.
+     */
+    const StreamCounters &counters() const { return counters_; }
+
+    /**
+     * For the readers over the stream to add their copies to.
+     */
+    StreamCounters &counters() { return counters_; }
+
+protected:
+    StreamCounters counters_;
 };
 
 typedef std::unique_ptr<InputStream> InputStreamPtr;
@@ -102,6 +149,48 @@ public:
 
 typedef std::unique_ptr<SeekableInputStream> SeekableInputStreamPtr;
 
+/**
+ * An input whose reads complete later, such as an object in remote
+ * storage fetched with ranged requests. Nothing waits for a read to
+ * complete: the handler is called once the bytes are in, possibly on
+ * another thread, so that one thread can drive many reads at a time.
+ */
+class AVRO_DECL AsyncInputStream : boost::noncopyable {
+public:
+    /**
+     * Called when a read completes, with the error if it failed or else
+     * with the bytes read. Fewer bytes than asked for means that the
+     * input ends there.
+     */
+    typedef std::function<void(std::exception_ptr error, std::vector<uint8_t> data)> ReadHandler;
+
+    virtual ~AsyncInputStream() = default;
+
+    /**
+     * Starts reading \p len bytes at \p offset and returns, calling
+     * \p handler once it is done. The handler may also be called before
+     * read() returns.
+     */
+    virtual void read(int64_t offset, size_t len, ReadHandler handler) = 0;
+};
+
+typedef std::shared_ptr<AsyncInputStream> AsyncInputStreamPtr;
+
+/**
+ * Returns an AsyncInputStream whose reads seek \p in and complete before
+ * they return. Besides tests, this helps share code between local files
+ * and remote inputs.
+ */
+AVRO_DECL AsyncInputStreamPtr asyncInputStream(SeekableInputStreamPtr in);
+
+/**
+ * A piece of memory handed to OutputStream::writeChunks().
+ */
+struct OutputChunk {
+    const uint8_t *data;
+    size_t len;
+};
+
 /**
  * A no-copy output stream.
  */
@@ -143,19 +232,119 @@ public:
      * store, if any.
      */
     virtual void flush() = 0;
+
+    /**
+     * Writes count chunks of memory, in order, as if each were copied
+     * into the buffers returned by next(). File streams hand whatever
+     * they have buffered and the chunks to the system in one writev()
+     * call, without copying the chunks.
+     */
+    virtual void writeChunks(const OutputChunk *chunks, size_t count);
+
+    /**
+     * Writes \p len bytes over those written at \p position, all of which
+     * must have been written already, flushed or not. Returns false,
+     * doing nothing, for streams that cannot go back, such as pipes,
+     * sockets and files opened for appending; memory streams, mapped
+     * files and files written from where they were opened can.
+     */
+    virtual bool rewrite(uint64_t position, const uint8_t *data, size_t len);
+
+    /**
+     * Has the data flushed so far written through to the device, as
+     * fdatasync() does. Returns false, doing nothing, for streams that
+     * are not over files, such as memory streams, pipes and sockets.
+     * Streams over files may be synced from another thread while the one
+     * writing waits.
+     */
+    virtual bool sync();
+
+    /**
+     * What writing this stream has cost so far.
+     */
+    const StreamCounters &counters() const { return counters_; }
+
+    /**
+     * For the writers over the stream to add their copies to.
+     */
+    StreamCounters &counters() { return counters_; }
+
+protected:
+    StreamCounters counters_;
 };
 
 typedef std::unique_ptr<OutputStream> OutputStreamPtr;
 
+/**
+ * Buffering options for the memory and file streams.
+ */
+struct StreamOptions {
+    /**
+     * How the chunks of a memory output stream grow.
+     */
+    enum ChunkGrowth {
+        /// Every chunk has chunkSize bytes.
+        FIXED_CHUNKS,
+        /// Each chunk is twice the size of the one before, up to
+        /// maxChunkSize, so that large contents take few chunks.
+        GEOMETRIC_CHUNKS
+    };
+
+    /**
+     * How file input streams use the page cache, so that a large scan
+     * does not evict the pages other processes on the machine need.
+     */
+    enum CacheMode {
+        /// Reads through the page cache as usual.
+        CACHE_NORMAL,
+        /// Tells the kernel that the file is read once, in order, and
+        /// drops the pages behind the read position from the cache.
+        CACHE_DROP_BEHIND,
+        /// Reads around the page cache with O_DIRECT, into aligned
+        /// buffers of 1 MB unless chunkSize says otherwise. The kernel
+        /// does not read ahead; DataFileReader's decompression threads
+        /// can. File systems without O_DIRECT get CACHE_DROP_BEHIND.
+        CACHE_DIRECT
+    };
+
+    /// The size of the buffer of file streams and of the first chunk of
+    /// memory output streams; zero keeps each stream's default.
+    size_t chunkSize;
+    ChunkGrowth growth;
+    /// The largest chunk with GEOMETRIC_CHUNKS.
+    size_t maxChunkSize;
+    /// Aligns memory output stream chunks of 2 MB or more to 2 MB and,
+    /// on Linux, asks for them to be backed by transparent huge pages.
+    bool hugePages;
+    /// The bytes a new file output stream reserves on disk up front, on
+    /// Linux, so that the file does not fragment as it grows. The size
+    /// of the file is still what is written to it.
+    size_t preallocate;
+    /// How file input streams use the page cache; only on POSIX systems.
+    CacheMode cache;
+    /// Where the stream's chunks or buffer come from; if null, the
+    /// defaultMemoryResource() of the thread making the stream.
+    MemoryResource *memoryResource;
+
+    StreamOptions() : chunkSize(0), growth(FIXED_CHUNKS), maxChunkSize(1024 * 1024), hugePages(false), preallocate(0), cache(CACHE_NORMAL),
+                      memoryResource(nullptr) {}
+};
+
 /**
  * Returns a new OutputStream, which grows in memory chunks of specified size.
  */
 AVRO_DECL OutputStreamPtr memoryOutputStream(size_t chunkSize = 4 * 1024);
 
+/**
+ * Returns a new OutputStream, which grows in memory chunks as set by the
+ * options; the first chunk is 4 KB unless options.chunkSize says otherwise.
+ */
+AVRO_DECL OutputStreamPtr memoryOutputStream(const StreamOptions &options);
+
 /**
  * Returns a new InputStream, with the data from the given byte array.
  * It does not copy the data, the byte array should remain valid
- * until the InputStream is used.
+ * until the InputStream is used. The stream is a SeekableInputStream.
  */
 AVRO_DECL InputStreamPtr memoryInputStream(const uint8_t *data, size_t len);
 
@@ -175,6 +364,13 @@ AVRO_DECL InputStreamPtr memoryInputStream(const OutputStream &source);
  */
 AVRO_DECL std::shared_ptr<std::vector<uint8_t>> snapshot(const OutputStream &source);
 
+/**
+ * Empties a memory output stream, one returned by memoryOutputStream(),
+ * keeping the chunks it allocated for the data written next. Input
+ * streams made from it with memoryInputStream() must no longer be used.
+ */
+AVRO_DECL void resetMemoryOutputStream(OutputStream &source);
+
 /**
  * Returns a new OutputStream whose contents would be stored in a file.
  * Data is written in chunks of given buffer size.
@@ -185,6 +381,70 @@ AVRO_DECL std::shared_ptr<std::vector<uint8_t>> snapshot(const OutputStream &sou
 AVRO_DECL OutputStreamPtr fileOutputStream(const char *filename,
                                            size_t bufferSize = 8 * 1024);
 
+/**
+ * Like fileOutputStream() above, with a buffer of options.chunkSize bytes
+ * unless it is zero, and options.preallocate bytes reserved on disk.
+ */
+AVRO_DECL OutputStreamPtr fileOutputStream(const char *filename,
+                                           const StreamOptions &options);
+
+/**
+ * Returns a new OutputStream which writes to an open file descriptor,
+ * such as a pipe or a socket, in chunks of given buffer size. The
+ * descriptor is not closed with the stream. Not available on Windows.
+ */
+AVRO_DECL OutputStreamPtr fdOutputStream(int fd, size_t bufferSize = 8 * 1024);
+
+/**
+ * Returns a new OutputStream whose contents are added to the end of a
+ * file. Data is written in chunks of given buffer size.
+ *
+ * If there is no file with the given name, it is created.
+ */
+AVRO_DECL OutputStreamPtr fileAppendOutputStream(const char *filename,
+                                                 size_t bufferSize = 8 * 1024);
+
+/**
+ * Options for asyncFileOutputStream().
+ */
+struct AsyncFileOptions {
+    /**
+     * When the file's data is synced to the device with fdatasync().
+     */
+    enum SyncPolicy {
+        SYNC_NEVER,
+        SYNC_EACH_WRITE,
+        SYNC_ON_CLOSE
+    };
+
+    /// The size of each of the two buffers, rounded up to 4 KB.
+    size_t bufferSize;
+    /// Opens the file with O_DIRECT where the system and file system
+    /// support it. flush() then only writes whole 4 KB blocks; the
+    /// rest is written with the next ones or when the stream is closed.
+    bool direct;
+    SyncPolicy sync;
+    /// Writes through io_uring where available instead of a thread.
+    bool ioUring;
+    /// Where the buffers come from; if null, the defaultMemoryResource()
+    /// of the thread making the stream.
+    MemoryResource *memoryResource;
+
+    AsyncFileOptions() : bufferSize(64 * 1024), direct(false), sync(SYNC_NEVER), ioUring(true), memoryResource(nullptr) {}
+};
+
+/**
+ * Returns a new OutputStream whose contents would be stored in a file,
+ * truncating it, like fileOutputStream(). The stream has two buffers:
+ * when one is full, or flush() is called, it is written to the file in
+ * the background, on Linux through io_uring and elsewhere by a thread,
+ * while next() hands out the other one. flush() therefore only waits for
+ * the write before it; a failed write is reported by the flush() or
+ * next() call after it. The stream's destructor waits for all writes.
+ */
+AVRO_DECL OutputStreamPtr asyncFileOutputStream(const char *filename,
+                                                const AsyncFileOptions &options = AsyncFileOptions());
+
 /**
  * Returns a new InputStream whose contents come from the given file.
  * Data is read in chunks of given buffer size.
@@ -194,6 +454,123 @@ AVRO_DECL InputStreamPtr fileInputStream(
 AVRO_DECL SeekableInputStreamPtr fileSeekableInputStream(
     const char *filename, size_t bufferSize = 8 * 1024);
 
+/**
+ * Like fileInputStream() and fileSeekableInputStream() above, with a
+ * buffer of options.chunkSize bytes unless it is zero, using the page
+ * cache as options.cache says.
+ */
+AVRO_DECL InputStreamPtr fileInputStream(const char *filename,
+                                         const StreamOptions &options);
+AVRO_DECL SeekableInputStreamPtr fileSeekableInputStream(
+    const char *filename, const StreamOptions &options);
+
+/**
+ * Points \p stream, made by one of the functions above, at the start of
+ * another file, keeping its buffer and cache mode. Returns false, leaving the stream
+ * alone, for streams that are not read through a buffer of their own,
+ * such as mapped and memory streams.
+ */
+AVRO_DECL bool reopenFileInputStream(InputStream &stream, const char *filename);
+
+/**
+ * Returns a new SeekableInputStream whose contents come from the given
+ * file, which is mapped into memory. Nothing is copied: next() returns
+ * the rest of the file in one chunk that points straight into the
+ * mapping, and seeking only moves the read position. The kernel is told
+ * that the file is read sequentially, and the pages just ahead of the
+ * read position are requested as reading progresses.
+ *
+ * The file must not be truncated while the stream is in use. To read a
+ * data file this way, pass the stream to the DataFileReader constructor.
+ */
+AVRO_DECL SeekableInputStreamPtr mappedFileInputStream(const char *filename);
+
+/**
+ * A file opened once for reading by any number of streams, on any
+ * threads. The streams share the file's descriptor but read it with
+ * pread(), each at a position of its own, so that none moves another.
+ * The file is closed when the handle and its streams are all gone. Not
+ * available on Windows.
+ */
+class AVRO_DECL SharedFile : boost::noncopyable {
+    const int fd_;
+
+public:
+    explicit SharedFile(const char *filename);
+
+    ~SharedFile();
+
+    /**
+     * Reads up to \p len bytes at \p offset into \p data, returning how
+     * many were read: fewer only at the end of the file.
+     */
+    size_t read(int64_t offset, uint8_t *data, size_t len) const;
+};
+
+typedef std::shared_ptr<SharedFile> SharedFilePtr;
+
+/**
+ * Returns a new SeekableInputStream reading \p file from its start,
+ * through a buffer of its own of the given size.
+ */
+AVRO_DECL SeekableInputStreamPtr sharedFileInputStream(const SharedFilePtr &file,
+                                                       size_t bufferSize = 8 * 1024);
+
+/**
+ * Returns a new OutputStream whose contents are stored in a file of at
+ * most \p size bytes, which is created or truncated, has its blocks
+ * allocated up front and is mapped into memory. next() returns the rest
+ * of the mapping, so data is written by copying it there, with no system
+ * call; a write past \p size throws. flush() starts writing the pages
+ * filled since the last flush back to the file without waiting, and
+ * sync() waits for all of them. When the stream is destroyed the file is
+ * cut to the bytes written.
+ *
+ * A DataFileWriter over the stream flushes it after each block. Not
+ * available on Windows.
+ */
+AVRO_DECL OutputStreamPtr mappedFileOutputStream(const char *filename, size_t size);
+
+/**
+ * Options for socketOutputStream() and socketInputStream().
+ */
+struct SocketOptions {
+    /// The size of each buffer chunk.
+    size_t chunkSize;
+    /// The number of chunks. An output stream sends all of its chunks
+    /// with one sendmsg() call once they are full; an input stream
+    /// fills as many of them as it can with one readv() call.
+    size_t chunkCount;
+    /// Sends with MSG_ZEROCOPY on Linux when the socket supports it.
+    /// The kernel then reads the bytes straight from the chunks, and
+    /// the stream waits for it to be done with them before reusing
+    /// them. Only sends of zeroCopyThreshold bytes or more use it.
+    bool zeroCopy;
+    size_t zeroCopyThreshold;
+
+    SocketOptions() : chunkSize(16 * 1024), chunkCount(16), zeroCopy(false), zeroCopyThreshold(16 * 1024) {}
+};
+
+/**
+ * Returns a new OutputStream which sends to a connected stream socket.
+ * Bytes are collected in a ring of chunks, which flush() sends together
+ * with one vectored send; writeChunks() sends the caller's chunks in the
+ * same call without copying them. The socket is not closed with the
+ * stream, and may be non-blocking. Not available on Windows.
+ */
+AVRO_DECL OutputStreamPtr socketOutputStream(int fd,
+                                             const SocketOptions &options = SocketOptions());
+
+/**
+ * Returns a new InputStream which receives from a connected stream
+ * socket. It reads with readv() into a ring of chunks that are reused
+ * once next() has moved past all of them, and each call to next()
+ * returns the rest of one chunk in place. The stream ends when the peer
+ * shuts the connection down. Not available on Windows.
+ */
+AVRO_DECL InputStreamPtr socketInputStream(int fd,
+                                           const SocketOptions &options = SocketOptions());
+
 /**
  * Returns a new OutputStream whose contents will be sent to the given
  * std::ostream. The std::ostream object should outlive the returned
@@ -287,6 +664,7 @@ struct StreamReader {
                 q = n;
             }
             ::memcpy(b, next_, q);
+            AVRO_STREAM_COUNT(in_->counters(), copiedBytes, q);
             next_ += q;
             b += q;
             n -= q;
@@ -417,6 +795,7 @@ struct StreamWriter {
                 q = n;
             }
             ::memcpy(next_, b, q);
+            AVRO_STREAM_COUNT(out_->counters(), copiedBytes, q);
             next_ += q;
             b += q;
             n -= q;
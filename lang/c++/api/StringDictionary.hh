@@ -0,0 +1,142 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_StringDictionary_hh__
+#define avro_StringDictionary_hh__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Config.hh"
+
+namespace avro {
+
+/**
+ * An immutable string, counted by reference, that any number of datums
+ * can hold at once. It is a std::string underneath, so that a datum
+ * holding one hands out the string itself.
+ */
+class AVRO_DECL SharedString : private std::string {
+    std::atomic<size_t> refs_;
+
+    SharedString(const char *data, size_t length) : std::string(data, length), refs_(1) {}
+
+public:
+    SharedString(const SharedString &) = delete;
+    SharedString &operator=(const SharedString &) = delete;
+
+    /**
+     * Returns a new shared string of the \p length bytes at \p data, with
+     * one reference, which the caller holds.
+     */
+    static SharedString *make(const char *data, size_t length) {
+        return new SharedString(data, length);
+    }
+
+    /**
+     * Returns the shared string whose str() is \p s.
+     */
+    static SharedString *of(const std::string *s) {
+        return static_cast<SharedString *>(const_cast<std::string *>(s));
+    }
+
+    const std::string &str() const {
+        return *this;
+    }
+
+    void retain() {
+        refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release() {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+};
+
+/**
+ * A bounded table of the distinct values of a string field, looked up by
+ * a hash of their encoded bytes, so that reading a value seen before
+ * costs a lookup rather than an allocation and a copy, and the datums
+ * holding it share one string. Once the table holds \p capacity values,
+ * new ones are no longer added. It suits fields with few distinct values,
+ * such as statuses, regions and types.
+ *
+ * A dictionary is not safe to use from more than one thread at once; the
+ * strings it hands out are.
+ */
+class AVRO_DECL StringDictionary {
+    struct Slot {
+        uint64_t hash;
+        SharedString *value;
+    };
+
+    const size_t capacity_;
+    std::vector<Slot> slots_;
+    size_t size_;
+    uint64_t hits_;
+    uint64_t misses_;
+
+    void insert(uint64_t hash, SharedString *value);
+
+public:
+    /**
+     * Constructs a dictionary of at most \p capacity values.
+     */
+    explicit StringDictionary(size_t capacity = 1024);
+
+    ~StringDictionary();
+
+    StringDictionary(const StringDictionary &) = delete;
+    StringDictionary &operator=(const StringDictionary &) = delete;
+
+    /**
+     * Returns the shared string of the \p length bytes at \p data, adding
+     * it if it is not in the dictionary yet, or null if it is not and the
+     * dictionary is full. The reference returned stays the dictionary's;
+     * whoever keeps the string retains it.
+     */
+    SharedString *intern(const char *data, size_t length);
+
+    /// The number of values in the dictionary.
+    size_t size() const {
+        return size_;
+    }
+
+    size_t capacity() const {
+        return capacity_;
+    }
+
+    /// The number of lookups that found their value.
+    uint64_t hits() const {
+        return hits_;
+    }
+
+    /// The number of lookups that did not, whether added or not.
+    uint64_t misses() const {
+        return misses_;
+    }
+};
+
+} // namespace avro
+
+#endif
@@ -0,0 +1,129 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_Trace_hh__
+#define avro_Trace_hh__
+
+#include <cstdint>
+
+#include "Config.hh"
+
+#if defined(AVRO_TRACING) && defined(AVRO_HAVE_SDT)
+#include <sys/sdt.h>
+#endif
+
+/// \file
+/// Trace points around the slower steps of reading data, for attributing
+/// latency in production.
+///
+/// The trace points are compiled in only when the library is built with
+/// AVRO_ENABLE_TRACING, which defines AVRO_TRACING; otherwise they are
+/// empty and the handler below is never called. Each one marks the begin
+/// and end of a span, with a point and an argument:
+///
+///   - TRACE_READ_DATA_BLOCK: DataFileReaderBase reading the next block;
+///     the argument is the offset it starts from.
+///   - TRACE_SYNC: DataFileReaderBase::sync(), with the position given.
+///   - TRACE_RESOLVE: building the grammar or program that resolves a
+///     writer's schema against a reader's.
+///   - TRACE_COMPILE_SCHEMA: compiling a JSON schema, with the length of
+///     its text when known and zero otherwise.
+///
+/// Where <sys/sdt.h> is available, each span also fires the USDT probes
+/// avro:begin and avro:end with the point and the argument, for use by
+/// bpftrace or perf without any handler, e.g.
+/// \code
+/// bpftrace -e 'usdt:libavrocpp.so:avro:begin /arg0 == 0/ { ... }'
+/// \endcode
+
+namespace avro {
+
+enum TracePoint {
+    TRACE_READ_DATA_BLOCK,
+    TRACE_SYNC,
+    TRACE_RESOLVE,
+    TRACE_COMPILE_SCHEMA
+};
+
+/**
+ * Receives the spans of the trace points. Calls come from whichever
+ * thread runs the traced step, so handlers must be thread-safe.
+ */
+class AVRO_DECL TraceHandler {
+public:
+    virtual ~TraceHandler();
+
+    virtual void begin(TracePoint point, int64_t arg) = 0;
+    virtual void end(TracePoint point, int64_t arg) = 0;
+};
+
+/**
+ * Installs \p handler, which must outlive its use, in place of the
+ * current one, and returns the latter. Null removes the handler.
+ */
+AVRO_DECL TraceHandler *setTraceHandler(TraceHandler *handler);
+
+/**
+ * Returns the installed handler, or null.
+ */
+AVRO_DECL TraceHandler *traceHandler();
+
+#ifdef AVRO_TRACING
+
+/**
+ * A span of a trace point, from construction to destruction.
+ */
+class TraceScope {
+    const TracePoint point_;
+    const int64_t arg_;
+    TraceHandler *const handler_;
+
+public:
+    TraceScope(TracePoint point, int64_t arg) : point_(point), arg_(arg), handler_(traceHandler()) {
+#ifdef AVRO_HAVE_SDT
+        DTRACE_PROBE2(avro, begin, static_cast<int>(point_), arg_);
+#endif
+        if (handler_) {
+            handler_->begin(point_, arg_);
+        }
+    }
+
+    ~TraceScope() {
+        if (handler_) {
+            handler_->end(point_, arg_);
+        }
+#ifdef AVRO_HAVE_SDT
+        DTRACE_PROBE2(avro, end, static_cast<int>(point_), arg_);
+#endif
+    }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+};
+
+#define AVRO_TRACE_SCOPE(point, arg) ::avro::TraceScope avroTraceScope_((point), (arg))
+
+#else
+
+#define AVRO_TRACE_SCOPE(point, arg) static_cast<void>(0)
+
+#endif
+
+} // namespace avro
+
+#endif
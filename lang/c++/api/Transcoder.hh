@@ -0,0 +1,105 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_Transcoder_hh__
+#define avro_Transcoder_hh__
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Config.hh"
+#include "ValidSchema.hh"
+
+/// \file
+/// Turns data in the binary encoding of a writer's schema into the binary
+/// encoding of a reader's schema, without decoding any values.
+
+namespace avro {
+
+struct BinaryCursor;
+
+/**
+ * Rewrites binary encoded data of a writer's schema into the binary
+ * encoding of a reader's schema, resolving the two as a resolving decoder
+ * would. The schema pair is compiled once, when the transcoder is made:
+ * parts that both schemas encode alike, such as runs of unchanged fields
+ * or an int read as a long, are stepped over and copied as they are;
+ * fields the reader does not have are stepped over; promoted numbers are
+ * converted; enum symbols and union branches are renumbered; and the
+ * defaults of fields the writer does not have are encoded once and copied
+ * in. Fields the reader orders differently are moved into its order.
+ *
+ * Arrays and maps come out in blocks of the sizes the writer used, but
+ * without their sizes in bytes. Writer data that does not resolve, such
+ * as an enum symbol the reader does not have, is only an error when it is
+ * met.
+ *
+ * A transcoder keeps scratch state and so is not to be shared among
+ * threads; the program itself is shared by copies.
+ */
+class AVRO_DECL Transcoder {
+public:
+    struct Program;
+
+private:
+    // The part of a record's output that one or more of the reader's
+    // fields took, while the record is put in the reader's order.
+    struct Segment {
+        size_t field;
+        size_t begin;
+        size_t end;
+    };
+
+    std::shared_ptr<const Program> program_;
+    std::vector<Segment> segments_;
+    std::vector<uint8_t> scratch_;
+
+    void transcode(size_t step, BinaryCursor &c, std::vector<uint8_t> &out);
+    void transcodeRecord(size_t step, BinaryCursor &c, std::vector<uint8_t> &out);
+
+public:
+    /**
+     * Compiles the resolution of \p writer's schema to \p reader's.
+     */
+    Transcoder(const ValidSchema &writer, const ValidSchema &reader);
+
+    /**
+     * Appends to \p out the reader's encoding of the datum encoded at the
+     * start of \p data, and returns the number of bytes of \p data it
+     * took. Throws an Exception if \p data runs out before its datum does
+     * or holds something that does not resolve; \p out may then have
+     * been added to.
+     */
+    size_t transcode(const uint8_t *data, size_t len, std::vector<uint8_t> &out);
+};
+
+/**
+ * Appends to \p out the datum encoded at the start of \p data with
+ * \p writer's schema, in the encoding of \p reader's, as
+ * Transcoder::transcode does. To transcode many, make a Transcoder once
+ * instead.
+ */
+AVRO_DECL size_t transcodeBinary(const ValidSchema &writer,
+                                 const ValidSchema &reader,
+                                 const uint8_t *data, size_t len,
+                                 std::vector<uint8_t> &out);
+
+} // namespace avro
+
+#endif
@@ -54,6 +54,16 @@ enum Type {
     AVRO_UNKNOWN = -1               /*!< Used internally. */
 };
 
+/**
+ * The order in which the values of a record field sort, as given by the
+ * field's "order" attribute.
+ */
+enum SortOrder {
+    ORDER_ASCENDING,  /*!< The default */
+    ORDER_DESCENDING, /*!< Reverses the order of the field's values */
+    ORDER_IGNORE      /*!< The field is not compared at all */
+};
+
 /**
  * Returns true if and only if the given type is a primitive.
  * Primitive types are: string, bytes, int, long, float, double, boolean
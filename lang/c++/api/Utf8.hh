@@ -0,0 +1,44 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_Utf8_hh__
+#define avro_Utf8_hh__
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Config.hh"
+/// \file
+/// Checks that strings are well-formed UTF-8.
+
+namespace avro {
+
+/// Returns true if the \p len bytes at \p data are well-formed UTF-8, as
+/// the Unicode standard has it: no overlong forms, no surrogates and
+/// nothing past U+10FFFF. It checks sixteen bytes at a time with SSSE3
+/// where the processor has it, and runs of ASCII eight at a time
+/// otherwise.
+AVRO_DECL bool isValidUtf8(const uint8_t *data, size_t len) noexcept;
+
+inline bool isValidUtf8(const char *data, size_t len) noexcept {
+    return isValidUtf8(reinterpret_cast<const uint8_t *>(data), len);
+}
+
+} // namespace avro
+
+#endif
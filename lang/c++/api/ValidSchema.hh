@@ -19,6 +19,9 @@
 #ifndef avro_ValidSchema_hh__
 #define avro_ValidSchema_hh__
 
+#include <array>
+#include <memory>
+
 #include "Config.hh"
 #include "Node.hh"
 
@@ -49,15 +52,65 @@ public:
         return root_;
     }
 
+    /// Returns a copy of this schema whose nodes do not count references
+    /// to each other. Its nodes are placed together in one arena, which the
+    /// returned schema and its copies own, and every NodePtr within it,
+    /// root() included, points into that arena without owning anything.
+    /// Copying those pointers, as building GenericDatum objects does, then
+    /// touches no shared counters, so threads decoding with the same frozen
+    /// schema do not contend on it.
+    ///
+    /// The nodes, and the datums and other objects that refer to them,
+    /// must not outlive the frozen schema and its copies.
+    ValidSchema frozen() const;
+
     void toJson(std::ostream &os) const;
     std::string toJson(bool prettyPrint = true) const;
 
+    /// Returns the JSON of the schema, as toJson() does. It is made on
+    /// first use and then kept with the schema, shared by its copies.
+    const std::string &json(bool prettyPrint = true) const;
+
     void toFlatList(std::ostream &os) const;
 
+    /// Returns the Parsing Canonical Form of the schema, as defined by the
+    /// specification. It and the fingerprints below are computed on first
+    /// use and then kept with the schema, shared by its copies.
+    const std::string &canonicalForm() const;
+
+    /// The CRC-64-AVRO fingerprint of canonicalForm().
+    uint64_t rabinFingerprint() const;
+
+    /// The MD5 fingerprint of canonicalForm().
+    const std::array<uint8_t, 16> &md5Fingerprint() const;
+
+    /// The SHA-256 fingerprint of canonicalForm().
+    const std::array<uint8_t, 32> &sha256Fingerprint() const;
+
+    /// Returns true if data written with \p other reads the same with this
+    /// schema as with it: the two have the same canonicalForm(), and so
+    /// differ at most in docs, defaults, aliases, orders and logical
+    /// types. Such schemas need no resolution.
+    bool sameEncoding(const ValidSchema &other) const;
+
+    /// Returns true if data written with \p other means the same read with
+    /// this schema: the two have the sameEncoding() and the same logical
+    /// types, down to the precision and scale of decimals.
+    bool sameData(const ValidSchema &other) const;
+
 protected:
     NodePtr root_;
 
 private:
+    struct Fingerprints;
+    std::shared_ptr<Fingerprints> fingerprints_;
+
+    // The arena holding the nodes of a frozen schema.
+    struct Frozen;
+    std::shared_ptr<Frozen> frozen_;
+
+    const Fingerprints &fingerprints() const;
+
     static std::string compactSchema(const std::string &schema);
 };
 
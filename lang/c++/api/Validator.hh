@@ -112,7 +112,20 @@ private:
         return flag;
     }
 
-    void setupOperation(const NodePtr &node);
+    /// The schema compiled into one step per node, with the leaves of a
+    /// step referring to other steps by index; recursive records refer
+    /// back to their own step.
+    struct Step {
+        Type type;
+        flag_t flags;       ///< the types accepted for this node
+        int fixedSize;      ///< the size of fixeds
+        const Node *node;   ///< for the names of records and their fields
+        std::vector<size_t> leaves;
+    };
+
+    size_t compile(const NodePtr &node, std::vector<std::pair<const Node *, size_t>> &records);
+
+    void setupOperation(size_t step);
 
     void setWaitingForCount();
 
@@ -125,9 +138,8 @@ private:
     void unionAdvance();
     void fixedAdvance();
 
-    void setupFlag(Type type);
-
     const ValidSchema schema_;
+    std::vector<Step> steps_;
 
     Type nextType_;
     flag_t expectedTypesFlag_;
@@ -136,9 +148,9 @@ private:
     int64_t count_;
 
     struct CompoundType {
-        explicit CompoundType(NodePtr n) : node(std::move(n)), pos(0) {}
-        NodePtr node; ///< save the node
-        size_t pos;   ///< track the leaf position to visit
+        explicit CompoundType(size_t s) : step(s), pos(0) {}
+        size_t step; ///< the step of the node
+        size_t pos;  ///< track the leaf position to visit
     };
 
     std::vector<CompoundType> compoundStack_;
@@ -23,22 +23,30 @@
 #include <boost/noncopyable.hpp>
 
 #include "Config.hh"
+#include "Encoder.hh"
 #include "Types.hh"
 #include "Validator.hh"
-#include "Zigzag.hh"
 #include "buffer/Buffer.hh"
+#include "buffer/BufferStream.hh"
 
 namespace avro {
 
-/// Class for writing avro data to a stream.
+/// Class for writing avro data to a stream.  The values are encoded by a
+/// BinaryEncoder writing into the free space of the buffer.
 
 template<class ValidatorType>
 class WriterImpl : private boost::noncopyable {
 
 public:
-    WriterImpl() = default;
+    WriterImpl() : out_(buffer_, 4 * 1024), encoder_(binaryEncoder()) {
+        encoder_->init(out_);
+    }
 
-    explicit WriterImpl(const ValidSchema &schema) : validator_(schema) {}
+    explicit WriterImpl(const ValidSchema &schema) : validator_(schema),
+                                                     out_(buffer_, 4 * 1024),
+                                                     encoder_(binaryEncoder()) {
+        encoder_->init(out_);
+    }
 
     void writeValue(const Null &) {
         validator_.checkTypeExpected(AVRO_NULL);
@@ -46,65 +54,49 @@ public:
 
     void writeValue(bool val) {
         validator_.checkTypeExpected(AVRO_BOOL);
-        int8_t byte = (val != 0);
-        buffer_.writeTo(byte);
+        encoder_->encodeBool(val);
     }
 
     void writeValue(int32_t val) {
         validator_.checkTypeExpected(AVRO_INT);
-        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-member-init)
-        std::array<uint8_t, 5> bytes;
-        size_t size = encodeInt32(val, bytes);
-        buffer_.writeTo(reinterpret_cast<const char *>(bytes.data()), size);
+        encoder_->encodeInt(val);
     }
 
     void writeValue(int64_t val) {
         validator_.checkTypeExpected(AVRO_LONG);
-        putLong(val);
+        encoder_->encodeLong(val);
     }
 
     void writeValue(float val) {
         validator_.checkTypeExpected(AVRO_FLOAT);
-        union {
-            float f;
-            int32_t i;
-        } v;
-
-        v.f = val;
-        buffer_.writeTo(v.i);
+        encoder_->encodeFloat(val);
     }
 
     void writeValue(double val) {
         validator_.checkTypeExpected(AVRO_DOUBLE);
-        union {
-            double d;
-            int64_t i;
-        } v;
-
-        v.d = val;
-        buffer_.writeTo(v.i);
+        encoder_->encodeDouble(val);
     }
 
     void writeValue(const std::string &val) {
         validator_.checkTypeExpected(AVRO_STRING);
-        putBytes(val.c_str(), val.size());
+        encoder_->encodeString(val);
     }
 
     void writeBytes(const void *val, size_t size) {
         validator_.checkTypeExpected(AVRO_BYTES);
-        putBytes(val, size);
+        encoder_->encodeBytes(static_cast<const uint8_t *>(val), size);
     }
 
     template<size_t N>
     void writeFixed(const uint8_t (&val)[N]) {
         validator_.checkFixedSizeExpected(N);
-        buffer_.writeTo(reinterpret_cast<const char *>(val), N);
+        encoder_->encodeFixed(val, N);
     }
 
     template<size_t N>
     void writeFixed(const std::array<uint8_t, N> &val) {
         validator_.checkFixedSizeExpected(val.size());
-        buffer_.writeTo(reinterpret_cast<const char *>(val.data()), val.size());
+        encoder_->encodeFixed(val.data(), val.size());
     }
 
     void writeRecord() {
@@ -147,31 +139,23 @@ public:
         writeCount(choice);
     }
 
+    /// Returns what has been written so far.
     InputBuffer buffer() const {
+        encoder_->flush();
         return buffer_;
     }
 
 private:
-    void putLong(int64_t val) {
-        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-member-init)
-        std::array<uint8_t, 10> bytes;
-        size_t size = encodeInt64(val, bytes);
-        buffer_.writeTo(reinterpret_cast<const char *>(bytes.data()), size);
-    }
-
-    void putBytes(const void *val, size_t size) {
-        putLong(size);
-        buffer_.writeTo(reinterpret_cast<const char *>(val), size);
-    }
-
     void writeCount(int64_t count) {
         validator_.checkTypeExpected(AVRO_LONG);
         validator_.setCount(count);
-        putLong(count);
+        encoder_->encodeLong(count);
     }
 
     ValidatorType validator_;
     OutputBuffer buffer_;
+    detail::BufferOutputStream out_;
+    EncoderPtr encoder_;
 };
 
 using Writer = WriterImpl<NullValidator>;
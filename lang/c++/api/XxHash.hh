@@ -0,0 +1,38 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_XxHash_hh__
+#define avro_XxHash_hh__
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Config.hh"
+/// \file
+/// The 64-bit xxHash that data file writers can keep of each block in the
+/// block index.
+
+namespace avro {
+
+/// Returns the XXH64 hash of \p len bytes at \p data with the given
+/// \p seed, as the reference implementation computes it.
+AVRO_DECL uint64_t xxHash64(const uint8_t *data, size_t len, uint64_t seed = 0) noexcept;
+
+} // namespace avro
+
+#endif
@@ -22,6 +22,7 @@
 #include <array>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 #include "Config.hh"
 /// \file
@@ -45,6 +46,66 @@ AVRO_DECL constexpr int32_t decodeZigzag32(uint32_t input) noexcept {
     return static_cast<int32_t>(((input >> 1) ^ -(static_cast<int64_t>(input) & 1)));
 }
 
+/**
+ * Returns the number of bytes in the varint encoding of \p val: one for
+ * every seven significant bits, and one for zero.
+ */
+inline size_t varintLength(uint64_t val) noexcept {
+#if defined(__GNUC__)
+    return (70 - __builtin_clzll(val | 1)) / 7;
+#else
+    size_t result = 1;
+    while (val >>= 7) {
+        ++result;
+    }
+    return result;
+#endif
+}
+
+/**
+ * Writes the varint encoding of \p val to \p output and returns its
+ * length. There must be room for ten bytes, all of which may be written
+ * to.
+ */
+inline size_t encodeVarintUnchecked(uint64_t val, uint8_t *output) noexcept {
+    size_t n = varintLength(val);
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // Spreads the low 56 bits over eight bytes, seven to a byte, and sets
+    // the continuation bits of all bytes but the last, with no branches
+    // on the value.
+    uint64_t spread = 0;
+    for (int k = 0; k < 8; ++k) {
+        spread |= ((val >> (7 * k)) & 0x7f) << (8 * k);
+    }
+    const uint64_t high = 0x8080808080808080ULL;
+    spread |= n > 8 ? high : high & ((uint64_t(1) << (8 * (n - 1))) - 1);
+    ::memcpy(output, &spread, sizeof(spread));
+    output[8] = static_cast<uint8_t>(((val >> 56) & 0x7f) | (n > 9 ? 0x80 : 0));
+    output[9] = static_cast<uint8_t>(val >> 63);
+#else
+    for (size_t i = 0; i + 1 < n; ++i) {
+        output[i] = static_cast<uint8_t>(val | 0x80);
+        val >>= 7;
+    }
+    output[n - 1] = static_cast<uint8_t>(val);
+#endif
+    return n;
+}
+
+/**
+ * Writes the varint encoding of \p val, which takes up to ten bytes, to
+ * \p output and returns its length.
+ */
+inline size_t encodeVarint(uint64_t val, uint8_t *output) noexcept {
+    size_t n = varintLength(val);
+    for (size_t i = 0; i + 1 < n; ++i) {
+        output[i] = static_cast<uint8_t>(val | 0x80);
+        val >>= 7;
+    }
+    output[n - 1] = static_cast<uint8_t>(val);
+    return n;
+}
+
 AVRO_DECL size_t encodeInt32(int32_t input, std::array<uint8_t, 5> &output) noexcept;
 AVRO_DECL size_t encodeInt64(int64_t input, std::array<uint8_t, 10> &output) noexcept;
 
@@ -19,12 +19,14 @@
 #ifndef avro_BufferStream_hh__
 #define avro_BufferStream_hh__
 
+#include "../Stream.hh"
 #include "BufferStreambuf.hh"
 
 /**
  * \file BufferStream.hh
  *
- * \brief Custom istream and ostream classes for use with buffers
+ * \brief Custom istream and ostream classes for use with buffers, and
+ * adapters from buffers to avro's OutputStream and InputStream
  **/
 
 namespace avro {
@@ -84,6 +86,143 @@ protected:
     istreambuf ibuf_;
 };
 
+namespace detail {
+
+/**
+ * OutputStream that hands out the free space of an OutputBuffer. The
+ * bytes returned by next() become data of the buffer on the following
+ * next() or flush(), or when the stream is destroyed.
+ **/
+
+class BufferOutputStream : public OutputStream {
+
+public:
+    BufferOutputStream(OutputBuffer &buf, size_t chunkSize) : buf_(buf),
+                                                              chunkSize_(chunkSize),
+                                                              pending_(0),
+                                                              byteCount_(0) {}
+
+    ~BufferOutputStream() override {
+        commit();
+    }
+
+    bool next(uint8_t **data, size_t *len) override {
+        commit();
+        if (buf_.freeSpace() == 0) {
+            buf_.reserve(chunkSize_);
+        }
+        OutputBuffer::const_iterator it = buf_.begin();
+        *data = reinterpret_cast<uint8_t *>(it->data());
+        *len = it->size();
+        pending_ = *len;
+        byteCount_ += *len;
+        return true;
+    }
+
+    void backup(size_t len) override {
+        pending_ -= len;
+        byteCount_ -= len;
+    }
+
+    uint64_t byteCount() const override {
+        return byteCount_;
+    }
+
+    void flush() override {
+        commit();
+    }
+
+private:
+    void commit() {
+        if (pending_ > 0) {
+            buf_.wroteTo(pending_);
+            pending_ = 0;
+        }
+    }
+
+    OutputBuffer &buf_;
+    const size_t chunkSize_;
+    size_t pending_;
+    uint64_t byteCount_;
+};
+
+/**
+ * InputStream over the chunks of an InputBuffer, without copying them.
+ **/
+
+class BufferInputStream : public InputStream {
+
+public:
+    explicit BufferInputStream(const InputBuffer &buf) : buf_(buf),
+                                                         it_(buf_.begin()),
+                                                         end_(buf_.end()),
+                                                         offset_(0),
+                                                         byteCount_(0) {}
+
+    bool next(const uint8_t **data, size_t *len) override {
+        while (it_ != end_ && offset_ == it_->size()) {
+            ++it_;
+            offset_ = 0;
+        }
+        if (it_ == end_) {
+            return false;
+        }
+        *data = reinterpret_cast<const uint8_t *>(it_->data()) + offset_;
+        *len = it_->size() - offset_;
+        offset_ = it_->size();
+        byteCount_ += *len;
+        return true;
+    }
+
+    void backup(size_t len) override {
+        offset_ -= len;
+        byteCount_ -= len;
+    }
+
+    void skip(size_t len) override {
+        const uint8_t *data;
+        size_t n;
+        while (len > 0 && next(&data, &n)) {
+            if (n > len) {
+                backup(n - len);
+                n = len;
+            }
+            len -= n;
+        }
+    }
+
+    size_t byteCount() const override {
+        return byteCount_;
+    }
+
+private:
+    const InputBuffer buf_;
+    InputBuffer::const_iterator it_;
+    const InputBuffer::const_iterator end_;
+    size_t offset_;
+    size_t byteCount_;
+};
+
+} // namespace detail
+
+/**
+ * Returns an OutputStream that writes into buf, growing it in chunks of
+ * chunkSize bytes. Flush the stream before reading buf.
+ **/
+
+inline OutputStreamPtr bufferOutputStream(OutputBuffer &buf, size_t chunkSize = 4 * 1024) {
+    return OutputStreamPtr(new detail::BufferOutputStream(buf, chunkSize));
+}
+
+/**
+ * Returns an InputStream that reads the chunks of buf in place. The
+ * stream keeps its own reference to the chunks.
+ **/
+
+inline InputStreamPtr bufferInputStream(const InputBuffer &buf) {
+    return InputStreamPtr(new detail::BufferInputStream(buf));
+}
+
 } // namespace avro
 
 #endif
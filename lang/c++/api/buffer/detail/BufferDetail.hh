@@ -20,17 +20,20 @@
 #define avro_BufferDetail_hh__
 
 #include <boost/function.hpp>
-#include <boost/shared_array.hpp>
+#include <boost/intrusive_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/static_assert.hpp>
 #include <boost/utility.hpp>
 #ifdef HAVE_BOOST_ASIO
 #include <boost/asio/buffer.hpp>
 #endif
+#include <atomic>
 #include <cassert>
 #include <deque>
 #include <exception>
 
+#include "../../Config.hh"
+
 /**
  * \file BufferDetail.hh
  *
@@ -54,6 +57,49 @@ const size_type kMinBlockSize = 4096;
 const size_type kMaxBlockSize = 16384;
 const size_type kDefaultBlockSize = kMinBlockSize;
 
+/**
+ * \brief The memory block backing one or more chunks.
+ *
+ * The bytes of a block follow its header in the same allocation.  Blocks
+ * come from allocateBlock(), which rounds the size up to 4, 8 or 16 KiB,
+ * and are handed back with releaseBlock() once the last chunk using them
+ * goes away.  Each thread keeps the blocks it releases in a free list per
+ * size, so that allocating a block is most often a single pop.
+ **/
+struct Block {
+    std::atomic<long> refs;
+    size_type size; ///< The number of bytes following the header
+    Block *next;    ///< The next block in a free list
+
+    data_type *data() {
+        return reinterpret_cast<data_type *>(this + 1);
+    }
+};
+
+/// Returns a block of at least \p size bytes with a count of one reference.
+AVRO_DECL Block *allocateBlock(size_type size);
+
+/// Puts a block no chunk uses back into the free list of this thread, or
+/// frees it if the list is full.
+AVRO_DECL void releaseBlock(Block *block);
+
+/**
+ * Frees the blocks in the free lists of this thread; the memory of the
+ * buffers the thread has released is kept for reuse until it ends or
+ * calls this.
+ **/
+AVRO_DECL void trimBlockPool();
+
+inline void intrusive_ptr_add_ref(Block *block) {
+    block->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void intrusive_ptr_release(Block *block) {
+    if (block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        releaseBlock(block);
+    }
+}
+
 typedef boost::function<void(void)> free_func;
 
 /**
@@ -78,8 +124,8 @@ private:
  * A chunk is backed by a memory block, and internally it maintains information
  * about which area of the block it may use, and the portion of this area that
  * contains valid data.  More than one chunk may share the same underlying
- * block, but the areas should never overlap.  Chunk holds a shared pointer to
- * an array of bytes so that shared blocks are reference counted.
+ * block, but the areas should never overlap.  Chunk holds an intrusive pointer
+ * to its Block so that shared blocks are reference counted.
  *
  * When a chunk is copied, the copy shares the same underlying buffer, but the
  * copy receives its own copies of the start/cursor/end pointers, so each copy
@@ -95,8 +141,8 @@ public:
     typedef boost::shared_ptr<Chunk> SharedPtr;
 
     /// Default constructor, allocates a new underlying block for this chunk.
-    Chunk(size_type size) : underlyingBlock_(new data_type[size]),
-                            readPos_(underlyingBlock_.get()),
+    Chunk(size_type size) : underlyingBlock_(allocateBlock(size), false),
+                            readPos_(underlyingBlock_->data()),
                             writePos_(readPos_),
                             endPos_(readPos_ + size) {}
 
@@ -161,8 +207,9 @@ private:
     friend bool operator==(const Chunk &lhs, const Chunk &rhs);
     friend bool operator!=(const Chunk &lhs, const Chunk &rhs);
 
-    // more than one buffer can share an underlying block, so use SharedPtr
-    boost::shared_array<data_type> underlyingBlock_;
+    // more than one buffer can share an underlying block, so it is reference
+    // counted
+    boost::intrusive_ptr<Block> underlyingBlock_;
 
     data_type *readPos_;  ///< The first readable byte in the block
     data_type *writePos_; ///< The end of written data and start of free space
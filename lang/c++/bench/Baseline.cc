@@ -0,0 +1,85 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Baseline.hh"
+
+#include <fstream>
+#include <iostream>
+
+namespace avro {
+namespace bench {
+
+namespace {
+
+// Allocations per record that are not counted as more: those made once
+// per iteration, such as the input stream, come to a fraction of one
+// that changes with the number of iterations.
+const double allocSlack = 0.01;
+
+} // namespace
+
+void BaselineReporter::ReportRuns(const std::vector<Run> &runs) {
+    ConsoleReporter::ReportRuns(runs);
+    for (const Run &run : runs) {
+        std::string name = run.benchmark_name();
+        if (run.error_occurred || run.run_type != Run::RT_Iteration || name.compare(0, 6, "Route/") != 0) {
+            continue;
+        }
+        benchmark::UserCounters::const_iterator t = run.counters.find("perRecord");
+        benchmark::UserCounters::const_iterator a = run.counters.find("allocs");
+        if (t != run.counters.end() && a != run.counters.end()) {
+            Result &r = results_[name];
+            r.nanos = t->second.value * 1e9;
+            r.allocs = a->second.value;
+        }
+    }
+}
+
+bool BaselineReporter::check(const std::string &filename, double tolerance) const {
+    std::ifstream in(filename.c_str());
+    if (!in) {
+        std::ofstream out(filename.c_str());
+        for (const auto &it : results_) {
+            out << it.first << ' ' << it.second.nanos << ' ' << it.second.allocs << '\n';
+        }
+        std::cout << "Wrote the baseline " << filename << std::endl;
+        return static_cast<bool>(out);
+    }
+    bool result = true;
+    std::string name;
+    Result base{};
+    while (in >> name >> base.nanos >> base.allocs) {
+        std::map<std::string, Result>::const_iterator it = results_.find(name);
+        if (it == results_.end()) {
+            continue;
+        }
+        const Result &now = it->second;
+        if (now.nanos > base.nanos * (1 + tolerance)) {
+            std::cout << name << ": " << now.nanos << " ns per record, baseline " << base.nanos << std::endl;
+            result = false;
+        }
+        if (now.allocs > base.allocs + allocSlack) {
+            std::cout << name << ": " << now.allocs << " allocations per record, baseline " << base.allocs << std::endl;
+            result = false;
+        }
+    }
+    return result;
+}
+
+} // namespace bench
+} // namespace avro
@@ -0,0 +1,58 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_bench_Baseline_hh__
+#define avro_bench_Baseline_hh__
+
+#include <benchmark/benchmark.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace avro {
+namespace bench {
+
+/**
+ * Reports to the console like the default reporter, keeping the time and
+ * allocations per record of the Route/ benchmarks to hold them against
+ * a baseline from an earlier run.
+ */
+class BaselineReporter : public benchmark::ConsoleReporter {
+    struct Result {
+        double nanos;
+        double allocs;
+    };
+    std::map<std::string, Result> results_;
+
+public:
+    void ReportRuns(const std::vector<Run> &runs) override;
+
+    /**
+     * Writes the results to the baseline \p filename if there is no such
+     * file. Otherwise compares them with it and returns false, having
+     * printed them, if any route takes more than \p tolerance (0.1 for
+     * 10%) longer per record than in the baseline, or allocates more.
+     */
+    bool check(const std::string &filename, double tolerance) const;
+};
+
+} // namespace bench
+} // namespace avro
+
+#endif
@@ -0,0 +1,90 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Baseline.hh"
+#include "Corpus.hh"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+
+/// \file
+///
+/// Microbenchmarks for the encoders, decoders and data files. Every
+/// benchmark works on a batch of records generated from a schema in the
+/// jsonschemas directory and reports throughput as bytes (of binary or
+/// JSON encoding) and items (records) per second. The data are generated
+/// from a fixed seed, so runs on the same build are comparable. Usual
+/// google-benchmark flags apply, for instance --benchmark_filter=Decode/.
+/// The schema directory can be overridden with AVRO_BENCH_SCHEMA_DIR.
+/// The Schema/ benchmarks measure startup instead: the time and
+/// allocations taken to compile schemas and generate their grammars.
+///
+/// The Route/ benchmarks decode the same data through each way of
+/// decoding there is, reporting the time (perRecord, in seconds) and the
+/// allocations per record, as a baseline for changes to any of them.
+/// With AVRO_BENCH_BASELINE naming a file, their results are written to
+/// it if there is none, and otherwise compared with it: the program
+/// fails if a route got slower by more than AVRO_BENCH_TOLERANCE
+/// percent (10 by default) or allocates more per record. Results then go
+/// to the console whatever --benchmark_format says.
+
+namespace {
+
+const char *const schemas[] = {
+    "bigrecord",
+    "bigrecord2",
+    "tweet",
+    "large_schema.avsc",
+    "primitivetypes",
+    "union_array_union",
+    "union_map_union",
+    "tree1",
+};
+
+const size_t recordCount = 1000;
+
+} // namespace
+
+int main(int argc, char **argv) {
+    const char *env = std::getenv("AVRO_BENCH_SCHEMA_DIR");
+    std::string dir = env != nullptr ? env : AVRO_BENCH_SCHEMA_DIR;
+
+    for (size_t i = 0; i < sizeof(schemas) / sizeof(schemas[0]); ++i) {
+        avro::bench::CorpusPtr c = std::make_shared<avro::bench::Corpus>(dir, schemas[i], recordCount);
+        avro::bench::registerCodecBenchmarks(c);
+        avro::bench::registerDataFileBenchmarks(c);
+    }
+    avro::bench::registerSpecificBenchmarks(dir, recordCount);
+    avro::bench::registerSchemaBenchmarks(dir);
+    avro::bench::registerRouteBenchmarks(dir, recordCount);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    const char *baseline = std::getenv("AVRO_BENCH_BASELINE");
+    if (baseline == nullptr) {
+        benchmark::RunSpecifiedBenchmarks();
+        return 0;
+    }
+    const char *tolerance = std::getenv("AVRO_BENCH_TOLERANCE");
+    avro::bench::BaselineReporter reporter;
+    benchmark::RunSpecifiedBenchmarks(&reporter);
+    return reporter.check(baseline, (tolerance != nullptr ? std::atof(tolerance) : 10.0) / 100) ? 0 : 1;
+}
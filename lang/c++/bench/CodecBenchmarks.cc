@@ -0,0 +1,258 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Corpus.hh"
+
+#include <benchmark/benchmark.h>
+
+#include "bigrecord.hh"
+#include "tweet.hh"
+
+namespace avro {
+namespace bench {
+
+namespace {
+
+typedef EncoderPtr (*EncoderFactory)(const ValidSchema &);
+typedef DecoderPtr (*DecoderFactory)(const ValidSchema &);
+
+EncoderPtr makeBinaryEncoder(const ValidSchema &) {
+    return binaryEncoder();
+}
+
+EncoderPtr makeValidatingEncoder(const ValidSchema &s) {
+    return validatingEncoder(s, binaryEncoder());
+}
+
+EncoderPtr makeJsonEncoder(const ValidSchema &s) {
+    return jsonEncoder(s);
+}
+
+DecoderPtr makeBinaryDecoder(const ValidSchema &) {
+    return binaryDecoder();
+}
+
+DecoderPtr makeValidatingDecoder(const ValidSchema &s) {
+    return validatingDecoder(s, binaryDecoder());
+}
+
+DecoderPtr makeResolvingDecoder(const ValidSchema &s) {
+    return resolvingDecoder(s, s, binaryDecoder());
+}
+
+DecoderPtr makeCompiledResolvingDecoder(const ValidSchema &s) {
+    return compiledResolvingDecoder(s, s, binaryDecoder());
+}
+
+DecoderPtr makeJsonDecoder(const ValidSchema &s) {
+    return jsonDecoder(s);
+}
+
+void encodeGeneric(benchmark::State &state, const CorpusPtr &c,
+                   EncoderFactory f, size_t encodedSize) {
+    EncoderPtr e = f(c->schema);
+    // Encoders and decoders hand unused buffer back to their previous
+    // stream on init(), so that stream is only released afterwards.
+    std::unique_ptr<OutputStream> os;
+    for (auto _ : state) {
+        std::unique_ptr<OutputStream> next = memoryOutputStream();
+        e->init(*next);
+        os = std::move(next);
+        for (std::vector<GenericDatum>::const_iterator it = c->records.begin();
+             it != c->records.end(); ++it) {
+            avro::encode(*e, *it);
+        }
+        e->flush();
+    }
+    state.SetItemsProcessed(state.iterations() * c->records.size());
+    state.SetBytesProcessed(state.iterations() * encodedSize);
+}
+
+void decodeGeneric(benchmark::State &state, const CorpusPtr &c,
+                   DecoderFactory f, const std::vector<uint8_t> &encoded,
+                   bool inPlace) {
+    DecoderPtr d = f(c->schema);
+    GenericDatum datum(c->schema);
+    std::unique_ptr<InputStream> is;
+    for (auto _ : state) {
+        std::unique_ptr<InputStream> next = memoryInputStream(encoded.data(), encoded.size());
+        d->init(*next);
+        is = std::move(next);
+        for (size_t i = 0; i < c->records.size(); ++i) {
+            if (inPlace) {
+                GenericReader::readInPlace(*d, datum);
+            } else {
+                avro::decode(*d, datum);
+            }
+        }
+        benchmark::DoNotOptimize(datum);
+    }
+    state.SetItemsProcessed(state.iterations() * c->records.size());
+    state.SetBytesProcessed(state.iterations() * encoded.size());
+}
+
+template<typename T>
+void encodeSpecific(benchmark::State &state, const std::vector<T> &values,
+                    size_t encodedSize) {
+    EncoderPtr e = binaryEncoder();
+    std::unique_ptr<OutputStream> os;
+    for (auto _ : state) {
+        std::unique_ptr<OutputStream> next = memoryOutputStream();
+        e->init(*next);
+        os = std::move(next);
+        for (typename std::vector<T>::const_iterator it = values.begin();
+             it != values.end(); ++it) {
+            avro::encode(*e, *it);
+        }
+        e->flush();
+    }
+    state.SetItemsProcessed(state.iterations() * values.size());
+    state.SetBytesProcessed(state.iterations() * encodedSize);
+}
+
+template<typename T>
+void decodeSpecific(benchmark::State &state, size_t count,
+                    const std::vector<uint8_t> &encoded) {
+    DecoderPtr d = binaryDecoder();
+    T value;
+    std::unique_ptr<InputStream> is;
+    for (auto _ : state) {
+        std::unique_ptr<InputStream> next = memoryInputStream(encoded.data(), encoded.size());
+        d->init(*next);
+        is = std::move(next);
+        for (size_t i = 0; i < count; ++i) {
+            avro::decode(*d, value);
+        }
+        benchmark::DoNotOptimize(value);
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+    state.SetBytesProcessed(state.iterations() * encoded.size());
+}
+
+template<typename T>
+void encodeDirect(benchmark::State &state, const std::vector<T> &values,
+                  size_t encodedSize) {
+    DirectBinaryEncoder e(encodedSize);
+    for (auto _ : state) {
+        e.clear();
+        for (typename std::vector<T>::const_iterator it = values.begin();
+             it != values.end(); ++it) {
+            avro::directEncode(e, *it);
+        }
+        benchmark::DoNotOptimize(e.data());
+    }
+    state.SetItemsProcessed(state.iterations() * values.size());
+    state.SetBytesProcessed(state.iterations() * encodedSize);
+}
+
+template<typename T>
+void decodeDirect(benchmark::State &state, size_t count,
+                  const std::vector<uint8_t> &encoded) {
+    T value;
+    for (auto _ : state) {
+        DirectBinaryDecoder d(encoded.data(), encoded.size());
+        for (size_t i = 0; i < count; ++i) {
+            avro::directDecode(d, value);
+        }
+        benchmark::DoNotOptimize(value);
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+    state.SetBytesProcessed(state.iterations() * encoded.size());
+}
+
+// The specific types are read from the generic corpus so that both paths
+// see the same data.
+template<typename T>
+void registerSpecific(const std::string &dir, const std::string &file,
+                      size_t count) {
+    CorpusPtr c = std::make_shared<Corpus>(dir, file, count);
+    std::shared_ptr<std::vector<T>> values = std::make_shared<std::vector<T>>(count);
+    DecoderPtr d = binaryDecoder();
+    std::unique_ptr<InputStream> is = memoryInputStream(c->binary.data(), c->binary.size());
+    d->init(*is);
+    for (size_t i = 0; i < count; ++i) {
+        avro::decode(*d, (*values)[i]);
+    }
+
+    benchmark::RegisterBenchmark(("Encode/specific/" + file).c_str(),
+                                 [c, values](benchmark::State &st) {
+                                     encodeSpecific(st, *values, c->binary.size());
+                                 });
+    benchmark::RegisterBenchmark(("Decode/specific/" + file).c_str(),
+                                 [c](benchmark::State &st) {
+                                     decodeSpecific<T>(st, c->records.size(), c->binary);
+                                 });
+    benchmark::RegisterBenchmark(("Encode/direct/" + file).c_str(),
+                                 [c, values](benchmark::State &st) {
+                                     encodeDirect(st, *values, c->binary.size());
+                                 });
+    benchmark::RegisterBenchmark(("Decode/direct/" + file).c_str(),
+                                 [c](benchmark::State &st) {
+                                     decodeDirect<T>(st, c->records.size(), c->binary);
+                                 });
+}
+
+} // namespace
+
+void registerCodecBenchmarks(const CorpusPtr &c) {
+    static const struct {
+        const char *name;
+        EncoderFactory encoder;
+        DecoderFactory decoder;
+        bool json;
+        bool validates;
+    } codecs[] = {
+        {"binary", makeBinaryEncoder, makeBinaryDecoder, false, false},
+        {"validating", makeValidatingEncoder, makeValidatingDecoder, false, true},
+        {"resolving", nullptr, makeResolvingDecoder, false, false},
+        {"compiled", nullptr, makeCompiledResolvingDecoder, false, false},
+        {"json", makeJsonEncoder, makeJsonDecoder, true, true},
+    };
+
+    for (size_t i = 0; i < sizeof(codecs) / sizeof(codecs[0]); ++i) {
+        if (codecs[i].validates && !c->validates) {
+            continue;
+        }
+        std::string suffix = std::string(codecs[i].name) + "/" + c->name;
+        const std::vector<uint8_t> &encoded = codecs[i].json ? c->json : c->binary;
+        if (codecs[i].encoder != nullptr) {
+            EncoderFactory f = codecs[i].encoder;
+            benchmark::RegisterBenchmark(("Encode/" + suffix).c_str(),
+                                         [c, f, &encoded](benchmark::State &st) {
+                                             encodeGeneric(st, c, f, encoded.size());
+                                         });
+        }
+        DecoderFactory f = codecs[i].decoder;
+        benchmark::RegisterBenchmark(("Decode/" + suffix).c_str(),
+                                     [c, f, &encoded](benchmark::State &st) {
+                                         decodeGeneric(st, c, f, encoded, false);
+                                     });
+    }
+    benchmark::RegisterBenchmark(("DecodeInPlace/binary/" + c->name).c_str(),
+                                 [c](benchmark::State &st) {
+                                     decodeGeneric(st, c, makeBinaryDecoder, c->binary, true);
+                                 });
+}
+
+void registerSpecificBenchmarks(const std::string &dir, size_t count) {
+    registerSpecific<testgen::RootRecord>(dir, "bigrecord", count);
+    registerSpecific<testgen3::AvroTweet>(dir, "tweet", count);
+}
+
+} // namespace bench
+} // namespace avro
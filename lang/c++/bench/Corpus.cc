@@ -0,0 +1,224 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Corpus.hh"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+
+#include "NodeImpl.hh"
+
+/// Global allocation counters, so that benchmarks can report how many
+/// allocations they make along with their time.
+namespace {
+
+std::atomic<size_t> allocations(0);
+std::atomic<size_t> allocatedBytes(0);
+
+} // namespace
+
+// The replacements are a matched pair over malloc() and free(); GCC,
+// seeing free() inlined where operator new was called, takes it for a
+// mismatch.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void *operator new(size_t n) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(n, std::memory_order_relaxed);
+    void *p = std::malloc(n != 0 ? n : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+namespace avro {
+namespace bench {
+
+AllocationCounter::AllocationCounter(benchmark::State &state, size_t items) : state_(state),
+                                                                              items_(items),
+                                                                              allocations_(allocations.load()),
+                                                                              bytes_(allocatedBytes.load()) {}
+
+AllocationCounter::~AllocationCounter() {
+    if (state_.iterations() == 0) {
+        return;
+    }
+    double n = static_cast<double>(state_.iterations()) * static_cast<double>(items_);
+    state_.counters["allocs"] = (allocations.load() - allocations_) / n;
+    state_.counters["allocBytes"] = (allocatedBytes.load() - bytes_) / n;
+}
+
+namespace {
+
+const int maxDepth = 4;
+
+std::string randomString(std::mt19937_64 &rng) {
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyz0123456789 ";
+    std::string result(rng() % 32, ' ');
+    for (std::string::iterator it = result.begin(); it != result.end(); ++it) {
+        *it = letters[rng() % (sizeof(letters) - 1)];
+    }
+    return result;
+}
+
+std::vector<uint8_t> randomBytes(std::mt19937_64 &rng, size_t n) {
+    std::vector<uint8_t> result(n);
+    for (std::vector<uint8_t>::iterator it = result.begin(); it != result.end(); ++it) {
+        *it = static_cast<uint8_t>(rng());
+    }
+    return result;
+}
+
+// Integers are spread over the varint sizes so that decoding is not
+// dominated by single-byte values.
+int64_t randomLong(std::mt19937_64 &rng) {
+    int bits = static_cast<int>(rng() % 64);
+    int64_t v = static_cast<int64_t>(rng() >> (63 - bits));
+    return (rng() & 1) ? v : -v;
+}
+
+} // namespace
+
+void fill(GenericDatum &datum, const NodePtr &n, std::mt19937_64 &rng,
+          int depth) {
+    NodePtr node = (n->type() == AVRO_SYMBOLIC) ? resolveSymbol(n) : n;
+    switch (node->type()) {
+        case AVRO_NULL:
+            break;
+        case AVRO_BOOL:
+            datum.value<bool>() = (rng() & 1) != 0;
+            break;
+        case AVRO_INT:
+            datum.value<int32_t>() = static_cast<int32_t>(randomLong(rng));
+            break;
+        case AVRO_LONG:
+            datum.value<int64_t>() = randomLong(rng);
+            break;
+        case AVRO_FLOAT:
+            datum.value<float>() = static_cast<float>(rng() % 1000000) / 7.0f;
+            break;
+        case AVRO_DOUBLE:
+            datum.value<double>() = static_cast<double>(rng()) / 7.0;
+            break;
+        case AVRO_STRING:
+            datum.value<std::string>() = randomString(rng);
+            break;
+        case AVRO_BYTES:
+            datum.value<std::vector<uint8_t>>() = randomBytes(rng, rng() % 32);
+            break;
+        case AVRO_FIXED:
+            datum.value<GenericFixed>().value() = randomBytes(rng, node->fixedSize());
+            break;
+        case AVRO_ENUM:
+            datum.value<GenericEnum>().set(rng() % node->names());
+            break;
+        case AVRO_RECORD: {
+            GenericRecord &r = datum.value<GenericRecord>();
+            for (size_t i = 0; i < node->leaves(); ++i) {
+                fill(r.fieldAt(i), node->leafAt(i), rng, depth + 1);
+            }
+        } break;
+        case AVRO_ARRAY: {
+            GenericArray::Value &v = datum.value<GenericArray>().value();
+            size_t count = depth < maxDepth ? rng() % 8 : 0;
+            for (size_t i = 0; i < count; ++i) {
+                GenericDatum item(node->leafAt(0));
+                fill(item, node->leafAt(0), rng, depth + 1);
+                v.push_back(item);
+            }
+        } break;
+        case AVRO_MAP: {
+            GenericMap::Value &v = datum.value<GenericMap>().value();
+            size_t count = depth < maxDepth ? rng() % 8 : 0;
+            for (size_t i = 0; i < count; ++i) {
+                GenericDatum item(node->leafAt(1));
+                fill(item, node->leafAt(1), rng, depth + 1);
+                v.push_back(std::make_pair(randomString(rng), item));
+            }
+        } break;
+        case AVRO_UNION: {
+            // Past the depth limit stay on the first branch, which in
+            // recursive schemas is conventionally null.
+            size_t branch = depth < maxDepth ? rng() % node->leaves() : 0;
+            datum.selectBranch(branch);
+            fill(datum, node->leafAt(branch), rng, depth + 1);
+        } break;
+        default:
+            throw Exception("Unsupported type in benchmark schema");
+    }
+}
+
+Corpus::Corpus(const std::string &dir, const std::string &file, size_t count) : name(file), validates(false) {
+    std::ifstream in((dir + "/" + file).c_str());
+    if (!in) {
+        throw Exception(boost::format("Cannot open schema: %1%") % file);
+    }
+    compileJsonSchema(in, schema);
+
+    std::mt19937_64 rng(count);
+    records.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        records.push_back(GenericDatum(schema));
+        fill(records.back(), schema.root(), rng, 0);
+    }
+
+    EncoderPtr e = binaryEncoder();
+    binary = encodeAll(*e, records);
+    try {
+        e = jsonEncoder(schema);
+        json = encodeAll(*e, records);
+        // Make sure the JSON reads back, so that benchmarks cannot fail
+        // half way through.
+        DecoderPtr d = jsonDecoder(schema);
+        std::unique_ptr<InputStream> is = memoryInputStream(json.data(), json.size());
+        d->init(*is);
+        GenericDatum datum(schema);
+        for (size_t i = 0; i < count; ++i) {
+            avro::decode(*d, datum);
+        }
+        validates = true;
+    } catch (const Exception &ex) {
+        std::cerr << "Skipping validating and JSON benchmarks for " << file
+                  << ": " << ex.what() << std::endl;
+        validates = false;
+    }
+}
+
+} // namespace bench
+} // namespace avro
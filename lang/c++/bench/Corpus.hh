@@ -0,0 +1,144 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_bench_Corpus_hh__
+#define avro_bench_Corpus_hh__
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Compiler.hh"
+#include "Generic.hh"
+#include "Specific.hh"
+#include "Stream.hh"
+#include "ValidSchema.hh"
+
+namespace benchmark {
+class State;
+} // namespace benchmark
+
+namespace avro {
+namespace bench {
+
+/**
+ * A batch of records of one schema from the jsonschemas directory, filled
+ * with pseudo-random but reproducible values, along with their binary and
+ * JSON encodings. Every benchmark processes the whole batch per iteration.
+ */
+struct Corpus {
+    std::string name;
+    ValidSchema schema;
+    std::vector<GenericDatum> records;
+    std::vector<uint8_t> binary;
+    std::vector<uint8_t> json;
+
+    /**
+     * False if the records cannot be taken through the validating and
+     * JSON codecs, which happens with some deeply recursive schemas and
+     * with bytes that the JSON codec does not read back. Such corpora
+     * only run through the binary and resolving paths.
+     */
+    bool validates;
+
+    Corpus(const std::string &dir, const std::string &file, size_t count);
+};
+
+typedef std::shared_ptr<Corpus> CorpusPtr;
+
+/**
+ * Returns the bytes written to \p os so far in one contiguous vector.
+ */
+inline std::vector<uint8_t> toBytes(const OutputStream &os) {
+    std::vector<uint8_t> result(static_cast<size_t>(os.byteCount()));
+    std::unique_ptr<InputStream> is = memoryInputStream(os);
+    StreamReader r(*is);
+    r.readBytes(result.data(), result.size());
+    return result;
+}
+
+/**
+ * Encodes everything in \p values with \p e and returns the bytes.
+ */
+template<typename T>
+std::vector<uint8_t> encodeAll(Encoder &e, const std::vector<T> &values) {
+    std::unique_ptr<OutputStream> os = memoryOutputStream();
+    e.init(*os);
+    for (typename std::vector<T>::const_iterator it = values.begin();
+         it != values.end(); ++it) {
+        avro::encode(e, *it);
+    }
+    e.flush();
+    return toBytes(*os);
+}
+
+/**
+ * Fills \p datum, which is of schema \p node, with random values.
+ * Containers and unions are kept shallow beyond \p depth so that
+ * recursive schemas terminate.
+ */
+void fill(GenericDatum &datum, const NodePtr &node, std::mt19937_64 &rng,
+          int depth);
+
+/**
+ * Reports the allocations made while it is alive, through the global
+ * operator new that the benchmarks replace, as the counters allocs and
+ * allocBytes: per iteration of \p state, or per item given the \p items
+ * of each iteration.
+ */
+class AllocationCounter {
+    benchmark::State &state_;
+    const size_t items_;
+    const size_t allocations_;
+    const size_t bytes_;
+
+public:
+    explicit AllocationCounter(benchmark::State &state, size_t items = 1);
+
+    ~AllocationCounter();
+};
+
+/**
+ * Register the benchmarks of each group with the benchmark library.
+ */
+void registerCodecBenchmarks(const CorpusPtr &corpus);
+void registerSpecificBenchmarks(const std::string &dir, size_t count);
+void registerDataFileBenchmarks(const CorpusPtr &corpus);
+
+/**
+ * Register the benchmarks that decode the same data, the corpora of the
+ * schemas avrogencpp generates types for in the build, through each of
+ * the routes there are: generic, specific, resolving with the schema
+ * itself and with an evolved one, and the legacy Parser. They report
+ * the time and allocations per record.
+ */
+void registerRouteBenchmarks(const std::string &dir, size_t count);
+
+/**
+ * Register the benchmarks of the fixed costs of a schema: compiling it,
+ * validating it and generating its grammars, for some schemas of \p dir
+ * and for generated deep and wide ones.
+ */
+void registerSchemaBenchmarks(const std::string &dir);
+
+} // namespace bench
+} // namespace avro
+
+#endif
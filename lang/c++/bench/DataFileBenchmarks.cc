@@ -0,0 +1,137 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Corpus.hh"
+
+#include <benchmark/benchmark.h>
+#include <boost/filesystem.hpp>
+
+#include "DataFile.hh"
+#include "DataFileScanner.hh"
+
+namespace avro {
+namespace bench {
+
+namespace {
+
+struct CodecInfo {
+    const char *name;
+    Codec codec;
+};
+
+const CodecInfo codecs[] = {
+    {"null", NULL_CODEC},
+    {"deflate", DEFLATE_CODEC},
+#ifdef SNAPPY_CODEC_AVAILABLE
+    {"snappy", SNAPPY_CODEC},
+#endif
+#ifdef ZSTD_CODEC_AVAILABLE
+    {"zstandard", ZSTD_CODEC},
+#endif
+#ifdef XZ_CODEC_AVAILABLE
+    {"xz", XZ_CODEC},
+#endif
+#ifdef LZ4_CODEC_AVAILABLE
+    {"lz4", LZ4_CODEC},
+#endif
+};
+
+std::string tempFile(const std::string &name) {
+    boost::filesystem::path p = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("avrobench-%%%%%%%%-" + name + ".avro");
+    return p.string();
+}
+
+void writeAll(const std::string &filename, const CorpusPtr &c, Codec codec) {
+    DataFileWriter<GenericDatum> w(filename.c_str(), c->schema, 64 * 1024, codec);
+    for (std::vector<GenericDatum>::const_iterator it = c->records.begin();
+         it != c->records.end(); ++it) {
+        w.write(*it);
+    }
+    w.close();
+}
+
+void writeFile(benchmark::State &state, const CorpusPtr &c, Codec codec) {
+    std::string filename = tempFile(c->name);
+    for (auto _ : state) {
+        writeAll(filename, c, codec);
+    }
+    state.counters["ratio"] = static_cast<double>(c->binary.size()) / boost::filesystem::file_size(filename);
+    boost::filesystem::remove(filename);
+    state.SetItemsProcessed(state.iterations() * c->records.size());
+    state.SetBytesProcessed(state.iterations() * c->binary.size());
+}
+
+void readFile(benchmark::State &state, const CorpusPtr &c, Codec codec) {
+    std::string filename = tempFile(c->name);
+    writeAll(filename, c, codec);
+    GenericDatum datum(c->schema);
+    for (auto _ : state) {
+        DataFileReader<GenericDatum> r(filename.c_str(), c->schema);
+        while (r.read(datum)) {
+        }
+        benchmark::DoNotOptimize(datum);
+    }
+    boost::filesystem::remove(filename);
+    state.SetItemsProcessed(state.iterations() * c->records.size());
+    state.SetBytesProcessed(state.iterations() * c->binary.size());
+}
+
+// Reads the file on state.range(0) threads to show how the scan scales.
+void scanFile(benchmark::State &state, const CorpusPtr &c, Codec codec) {
+    std::string filename = tempFile(c->name);
+    writeAll(filename, c, codec);
+    ParallelDataFileScanner<GenericDatum> scanner(filename.c_str(), c->schema,
+                                                  static_cast<size_t>(state.range(0)),
+                                                  GenericDatum(c->schema));
+    for (auto _ : state) {
+        int64_t n = scanner.forEach([](const GenericDatum &d) {
+            benchmark::DoNotOptimize(&d);
+        });
+        benchmark::DoNotOptimize(n);
+    }
+    boost::filesystem::remove(filename);
+    state.SetItemsProcessed(state.iterations() * c->records.size());
+    state.SetBytesProcessed(state.iterations() * c->binary.size());
+}
+
+} // namespace
+
+void registerDataFileBenchmarks(const CorpusPtr &c) {
+    for (size_t i = 0; i < sizeof(codecs) / sizeof(codecs[0]); ++i) {
+        std::string suffix = std::string(codecs[i].name) + "/" + c->name;
+        Codec codec = codecs[i].codec;
+        benchmark::RegisterBenchmark(("DataFileWrite/" + suffix).c_str(),
+                                     [c, codec](benchmark::State &st) {
+                                         writeFile(st, c, codec);
+                                     });
+        benchmark::RegisterBenchmark(("DataFileRead/" + suffix).c_str(),
+                                     [c, codec](benchmark::State &st) {
+                                         readFile(st, c, codec);
+                                     });
+        benchmark::RegisterBenchmark(("DataFileScan/" + suffix).c_str(),
+                                     [c, codec](benchmark::State &st) {
+                                         scanFile(st, c, codec);
+                                     })
+            ->RangeMultiplier(2)
+            ->Range(1, 8)
+            ->UseRealTime();
+    }
+}
+
+} // namespace bench
+} // namespace avro
@@ -0,0 +1,281 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Corpus.hh"
+
+#include <benchmark/benchmark.h>
+
+#include <sstream>
+
+#include "NodeImpl.hh"
+#include "Reader.hh"
+#include "buffer/Buffer.hh"
+
+#include "bigrecord.hh"
+#include "tweet.hh"
+
+namespace avro {
+namespace bench {
+
+namespace {
+
+/**
+ * Returns the schema a reader that has moved on from \p writer might
+ * have: the last field of a primitive type dropped, the first int, long
+ * or float field promoted, and a string field with a default added.
+ * Only the top-level record changes.
+ */
+ValidSchema evolve(const ValidSchema &writer) {
+    const NodePtr &root = writer.root();
+    if (root->type() != AVRO_RECORD) {
+        throw Exception("Only records can be evolved");
+    }
+    size_t promoted = root->leaves();
+    size_t dropped = root->leaves();
+    for (size_t i = 0; i < root->leaves(); ++i) {
+        Type t = root->leafAt(i)->type();
+        if (promoted == root->leaves() && (t == AVRO_INT || t == AVRO_LONG || t == AVRO_FLOAT)) {
+            promoted = i;
+        } else if (isPrimitive(t)) {
+            dropped = i;
+        }
+    }
+
+    // Fields are written in order, so named types are defined at their
+    // first use as in the writer's schema; only a primitive one is
+    // dropped.
+    std::ostringstream os;
+    os << "{\"type\": \"record\", \"name\": \"" << root->name().fullname() << "\", \"fields\": [";
+    for (size_t i = 0; i < root->leaves(); ++i) {
+        if (i == dropped) {
+            continue;
+        }
+        os << "{\"name\": \"" << root->nameAt(i) << "\", \"type\": ";
+        if (i == promoted) {
+            os << (root->leafAt(i)->type() == AVRO_INT ? "\"long\"" : "\"double\"");
+        } else {
+            root->leafAt(i)->printJson(os, 0);
+        }
+        os << "}, ";
+    }
+    os << "{\"name\": \"evolvedAdded\", \"type\": \"string\", \"default\": \"\"}]}";
+    return compileJsonSchemaFromString(os.str());
+}
+
+/**
+ * Reads a datum of schema \p n into \p datum with the legacy Reader API,
+ * walking the schema as an application of that API would. Parser wraps
+ * the same Reader, but only reads fixeds of sizes known when compiled.
+ */
+void readLegacy(Reader &r, const NodePtr &n, GenericDatum &datum) {
+    NodePtr node = (n->type() == AVRO_SYMBOLIC) ? resolveSymbol(n) : n;
+    switch (node->type()) {
+        case AVRO_NULL: {
+            Null null;
+            r.readValue(null);
+        } break;
+        case AVRO_BOOL:
+            r.readValue(datum.value<bool>());
+            break;
+        case AVRO_INT:
+            r.readValue(datum.value<int32_t>());
+            break;
+        case AVRO_LONG:
+            r.readValue(datum.value<int64_t>());
+            break;
+        case AVRO_FLOAT:
+            r.readValue(datum.value<float>());
+            break;
+        case AVRO_DOUBLE:
+            r.readValue(datum.value<double>());
+            break;
+        case AVRO_STRING:
+            r.readValue(datum.value<std::string>());
+            break;
+        case AVRO_BYTES:
+            r.readBytes(datum.value<std::vector<uint8_t>>());
+            break;
+        case AVRO_FIXED: {
+            std::vector<uint8_t> &v = datum.value<GenericFixed>().value();
+            v.resize(node->fixedSize());
+            r.readFixed(v.data(), v.size());
+        } break;
+        case AVRO_ENUM:
+            datum.value<GenericEnum>().set(static_cast<size_t>(r.readEnum()));
+            break;
+        case AVRO_RECORD: {
+            GenericRecord &rec = datum.value<GenericRecord>();
+            r.readRecord();
+            for (size_t i = 0; i < node->leaves(); ++i) {
+                readLegacy(r, node->leafAt(i), rec.fieldAt(i));
+            }
+            r.readRecordEnd();
+        } break;
+        case AVRO_UNION: {
+            size_t branch = static_cast<size_t>(r.readUnion());
+            datum.selectBranch(branch);
+            readLegacy(r, node->leafAt(branch), datum);
+        } break;
+        case AVRO_ARRAY: {
+            GenericArray::Value &v = datum.value<GenericArray>().value();
+            v.clear();
+            for (int64_t m = r.readArrayBlockSize(); m != 0; m = r.readArrayBlockSize()) {
+                for (int64_t i = 0; i < m; ++i) {
+                    v.emplace_back(node->leafAt(0));
+                    readLegacy(r, node->leafAt(0), v.back());
+                }
+            }
+        } break;
+        case AVRO_MAP: {
+            GenericMap::Value &v = datum.value<GenericMap>().value();
+            v.clear();
+            for (int64_t m = r.readMapBlockSize(); m != 0; m = r.readMapBlockSize()) {
+                for (int64_t i = 0; i < m; ++i) {
+                    v.emplace_back(std::string(), GenericDatum(node->leafAt(1)));
+                    r.readValue(v.back().first);
+                    readLegacy(r, node->leafAt(1), v.back().second);
+                }
+            }
+        } break;
+        default:
+            throw Exception(boost::format("Unknown schema type %1%") % toString(node->type()));
+    }
+}
+
+void setRouteCounters(benchmark::State &state, const Corpus &c) {
+    size_t n = c.records.size();
+    state.SetItemsProcessed(state.iterations() * n);
+    state.SetBytesProcessed(state.iterations() * c.binary.size());
+    // Seconds per record, shown with an SI prefix.
+    state.counters["perRecord"] = benchmark::Counter(static_cast<double>(n),
+                                                     benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+
+/**
+ * Decodes the corpus every iteration, calling \p read() once per record
+ * after starting \p d on the binary encoding.
+ */
+template<typename F>
+void decodeRoute(benchmark::State &state, const Corpus &c, const DecoderPtr &d, F read) {
+    std::unique_ptr<InputStream> is;
+    {
+        AllocationCounter counter(state, c.records.size());
+        for (auto _ : state) {
+            std::unique_ptr<InputStream> next = memoryInputStream(c.binary.data(), c.binary.size());
+            d->init(*next);
+            is = std::move(next);
+            for (size_t i = 0; i < c.records.size(); ++i) {
+                read();
+            }
+        }
+    }
+    setRouteCounters(state, c);
+}
+
+void decodeGeneric(benchmark::State &state, const Corpus &c, const ValidSchema &readerSchema,
+                   const DecoderPtr &d) {
+    GenericReader reader(readerSchema, d);
+    GenericDatum datum(readerSchema);
+    decodeRoute(state, c, d, [&]() { reader.read(datum); });
+    benchmark::DoNotOptimize(datum);
+}
+
+template<typename T>
+void decodeSpecific(benchmark::State &state, const Corpus &c) {
+    DecoderPtr d = binaryDecoder();
+    T value;
+    decodeRoute(state, c, d, [&]() { avro::decode(*d, value); });
+    benchmark::DoNotOptimize(value);
+}
+
+void decodeLegacy(benchmark::State &state, const Corpus &c, const InputBuffer &in) {
+    GenericDatum datum(c.schema);
+    {
+        AllocationCounter counter(state, c.records.size());
+        for (auto _ : state) {
+            Reader r(in);
+            for (size_t i = 0; i < c.records.size(); ++i) {
+                readLegacy(r, c.schema.root(), datum);
+            }
+        }
+    }
+    setRouteCounters(state, c);
+    benchmark::DoNotOptimize(datum);
+}
+
+/**
+ * Registers the routes for the corpus of \p file, whose records are of
+ * the generated type T.
+ */
+template<typename T>
+void registerRoutes(const std::string &dir, const std::string &file, size_t count) {
+    CorpusPtr c = std::make_shared<Corpus>(dir, file, count);
+    std::shared_ptr<ValidSchema> evolved = std::make_shared<ValidSchema>(evolve(c->schema));
+    std::shared_ptr<InputBuffer> in;
+    {
+        OutputBuffer out;
+        out.writeTo(reinterpret_cast<const char *>(c->binary.data()), c->binary.size());
+        in = std::make_shared<InputBuffer>(out);
+    }
+
+    // Every route must read what was written: the legacy one, written
+    // here, is checked by encoding what it reads back.
+    {
+        Reader r(*in);
+        std::vector<GenericDatum> read;
+        for (size_t i = 0; i < c->records.size(); ++i) {
+            read.emplace_back(c->schema);
+            readLegacy(r, c->schema.root(), read.back());
+        }
+        EncoderPtr e = binaryEncoder();
+        if (encodeAll(*e, read) != c->binary) {
+            throw Exception("The legacy route does not read back " + file);
+        }
+    }
+
+    benchmark::RegisterBenchmark(("Route/generic/" + file).c_str(),
+                                 [c](benchmark::State &st) {
+                                     decodeGeneric(st, *c, c->schema, binaryDecoder());
+                                 });
+    benchmark::RegisterBenchmark(("Route/specific/" + file).c_str(),
+                                 [c](benchmark::State &st) {
+                                     decodeSpecific<T>(st, *c);
+                                 });
+    benchmark::RegisterBenchmark(("Route/resolving/" + file).c_str(),
+                                 [c](benchmark::State &st) {
+                                     decodeGeneric(st, *c, c->schema, resolvingDecoder(c->schema, c->schema, binaryDecoder()));
+                                 });
+    benchmark::RegisterBenchmark(("Route/evolved/" + file).c_str(),
+                                 [c, evolved](benchmark::State &st) {
+                                     decodeGeneric(st, *c, *evolved, resolvingDecoder(c->schema, *evolved, binaryDecoder()));
+                                 });
+    benchmark::RegisterBenchmark(("Route/legacy/" + file).c_str(),
+                                 [c, in](benchmark::State &st) {
+                                     decodeLegacy(st, *c, *in);
+                                 });
+}
+
+} // namespace
+
+void registerRouteBenchmarks(const std::string &dir, size_t count) {
+    registerRoutes<testgen::RootRecord>(dir, "bigrecord", count);
+    registerRoutes<testgen3::AvroTweet>(dir, "tweet", count);
+}
+
+} // namespace bench
+} // namespace avro
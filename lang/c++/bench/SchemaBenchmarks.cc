@@ -0,0 +1,149 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Corpus.hh"
+
+#include <benchmark/benchmark.h>
+
+#include <fstream>
+#include <sstream>
+
+#include "Decoder.hh"
+
+namespace avro {
+namespace bench {
+
+namespace {
+
+std::string readSchema(const std::string &dir, const std::string &file) {
+    std::ifstream in((dir + "/" + file).c_str());
+    std::ostringstream os;
+    os << in.rdbuf();
+    return os.str();
+}
+
+// A record holding a record, and so on, \p depth times.
+std::string deepSchema(size_t depth) {
+    std::string result = "{\"type\": \"long\"}";
+    for (size_t i = depth; i != 0; --i) {
+        std::ostringstream os;
+        os << "{\"type\": \"record\", \"name\": \"R" << i << "\", \"fields\": ["
+           << "{\"name\": \"id\", \"type\": \"int\"}, "
+           << "{\"name\": \"next\", \"type\": " << result << "}]}";
+        result = os.str();
+    }
+    return result;
+}
+
+// A record of \p width fields of assorted types.
+std::string wideSchema(size_t width) {
+    static const char *const types[] = {
+        "\"int\"",
+        "\"string\"",
+        "[\"null\", \"double\"]",
+        "{\"type\": \"array\", \"items\": \"long\"}",
+        "{\"type\": \"map\", \"values\": \"bytes\"}",
+    };
+    const size_t typeCount = sizeof(types) / sizeof(types[0]);
+    std::ostringstream os;
+    os << "{\"type\": \"record\", \"name\": \"Wide\", \"fields\": [";
+    for (size_t i = 0; i < width; ++i) {
+        os << (i == 0 ? "" : ", ") << "{\"name\": \"f" << i
+           << "\", \"type\": " << types[i % typeCount] << "}";
+    }
+    os << "]}";
+    return os.str();
+}
+
+void compile(benchmark::State &state, const std::string &json) {
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        ValidSchema s = compileJsonSchemaFromString(json);
+        benchmark::DoNotOptimize(s);
+    }
+    state.SetBytesProcessed(state.iterations() * json.size());
+}
+
+void validate(benchmark::State &state, const ValidSchema &schema) {
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        ValidSchema s(schema.root());
+        benchmark::DoNotOptimize(s);
+    }
+}
+
+// The caches would otherwise build the grammars only once.
+template<typename F>
+void uncached(benchmark::State &state, F build) {
+    setResolvingDecoderCacheCapacity(0);
+    setValidatingCodecCacheCapacity(0);
+    {
+        AllocationCounter counter(state);
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(build());
+        }
+    }
+    setResolvingDecoderCacheCapacity(64);
+    setValidatingCodecCacheCapacity(64);
+}
+
+void registerStages(const std::string &name, const std::string &json) {
+    std::shared_ptr<ValidSchema> s = std::make_shared<ValidSchema>(compileJsonSchemaFromString(json));
+    benchmark::RegisterBenchmark(("Schema/compile/" + name).c_str(),
+                                 [json](benchmark::State &st) { compile(st, json); });
+    benchmark::RegisterBenchmark(("Schema/validate/" + name).c_str(),
+                                 [s](benchmark::State &st) { validate(st, *s); });
+    benchmark::RegisterBenchmark(("Schema/validatingGrammar/" + name).c_str(),
+                                 [s](benchmark::State &st) {
+                                     uncached(st, [s]() { return validatingDecoder(*s, binaryDecoder()); });
+                                 });
+    benchmark::RegisterBenchmark(("Schema/resolvingGrammar/" + name).c_str(),
+                                 [s](benchmark::State &st) {
+                                     uncached(st, [s]() { return resolvingDecoder(*s, *s, binaryDecoder()); });
+                                 });
+    benchmark::RegisterBenchmark(("Schema/resolvingProgram/" + name).c_str(),
+                                 [s](benchmark::State &st) {
+                                     uncached(st, [s]() { return compiledResolvingDecoder(*s, *s, binaryDecoder()); });
+                                 });
+    benchmark::RegisterBenchmark(("Schema/jsonGrammar/" + name).c_str(),
+                                 [s](benchmark::State &st) {
+                                     uncached(st, [s]() { return jsonDecoder(*s); });
+                                 });
+}
+
+} // namespace
+
+void registerSchemaBenchmarks(const std::string &dir) {
+    static const char *const files[] = {
+        "large_schema.avsc",
+        "bigrecord",
+        "recursive",
+        "tree1",
+    };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i) {
+        registerStages(files[i], readSchema(dir, files[i]));
+    }
+    static const size_t sizes[] = {8, 64, 512};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        registerStages("deep" + std::to_string(sizes[i]), deepSchema(sizes[i]));
+        registerStages("wide" + std::to_string(sizes[i]), wideSchema(sizes[i]));
+    }
+}
+
+} // namespace bench
+} // namespace avro
@@ -0,0 +1,78 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Arena.hh"
+
+#include <algorithm>
+#include <new>
+
+namespace avro {
+
+Arena::Arena(size_t chunkSize) : chunkSize_(chunkSize), current_(0),
+                                 next_(nullptr), end_(nullptr) {
+}
+
+Arena::~Arena() {
+    for (std::vector<std::pair<uint8_t *, size_t>>::const_iterator it = chunks_.begin();
+         it != chunks_.end(); ++it) {
+        ::operator delete(it->first);
+    }
+}
+
+void *Arena::allocateSlow(size_t size, size_t align) {
+    // Moves on to the first free chunk that is large enough, taking a new
+    // one if there is none, and keeps the chunks in use ahead of the free
+    // ones.
+    size_t needed = size + align - 1;
+    size_t target = (next_ == nullptr) ? current_ : current_ + 1;
+    size_t i = target;
+    for (; i < chunks_.size(); ++i) {
+        if (chunks_[i].second >= needed) {
+            break;
+        }
+    }
+    if (i == chunks_.size()) {
+        size_t n = std::max(chunkSize_, needed);
+        chunks_.push_back(std::make_pair(static_cast<uint8_t *>(::operator new(n)), n));
+    }
+    if (i != target) {
+        std::swap(chunks_[i], chunks_[target]);
+        i = target;
+    }
+    current_ = i;
+    next_ = chunks_[i].first;
+    end_ = next_ + chunks_[i].second;
+    return allocate(size, align);
+}
+
+void Arena::reset() {
+    current_ = 0;
+    next_ = nullptr;
+    end_ = nullptr;
+}
+
+size_t Arena::capacity() const {
+    size_t result = 0;
+    for (std::vector<std::pair<uint8_t *, size_t>>::const_iterator it = chunks_.begin();
+         it != chunks_.end(); ++it) {
+        result += it->second;
+    }
+    return result;
+}
+
+} // namespace avro
@@ -0,0 +1,364 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "BinaryComparator.hh"
+#include "Exception.hh"
+#include "NodeImpl.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <map>
+
+namespace avro {
+
+using std::map;
+using std::vector;
+
+/**
+ * A schema compiled into an array of steps, one per schema; a step refers
+ * to those of its items, fields or branches by index, so that recursive
+ * schemas compile to finite programs.
+ */
+struct BinaryComparator::Program {
+    struct Step {
+        Type type;
+        // The size of fixeds.
+        size_t size;
+        // Fields of records, branches of unions, the items of arrays and
+        // the values of maps.
+        vector<size_t> leaves;
+        // The orders of the fields of records.
+        vector<SortOrder> orders;
+    };
+
+    vector<Step> steps;
+};
+
+namespace {
+
+typedef BinaryComparator::Program Program;
+
+class ProgramCompiler {
+    Program &p_;
+    map<const Node *, size_t> records_;
+
+public:
+    explicit ProgramCompiler(Program &p) : p_(p) {}
+
+    size_t compile(const NodePtr &node) {
+        NodePtr n = node->type() == AVRO_SYMBOLIC
+            ? std::static_pointer_cast<NodeSymbolic>(node)->getNode()
+            : node;
+        if (n->type() == AVRO_RECORD) {
+            map<const Node *, size_t>::const_iterator it = records_.find(n.get());
+            if (it != records_.end()) {
+                return it->second;
+            }
+        }
+        size_t result = p_.steps.size();
+        p_.steps.emplace_back();
+        p_.steps[result].type = n->type();
+        p_.steps[result].size = n->type() == AVRO_FIXED ? n->fixedSize() : 0;
+        vector<size_t> leaves;
+        switch (n->type()) {
+            case AVRO_RECORD:
+                records_[n.get()] = result;
+                for (size_t i = 0; i < n->leaves(); ++i) {
+                    p_.steps[result].orders.push_back(n->fieldOrderAt(i));
+                }
+                for (size_t i = 0; i < n->leaves(); ++i) {
+                    leaves.push_back(compile(n->leafAt(i)));
+                }
+                break;
+            case AVRO_UNION:
+                for (size_t i = 0; i < n->leaves(); ++i) {
+                    leaves.push_back(compile(n->leafAt(i)));
+                }
+                break;
+            case AVRO_ARRAY:
+                leaves.push_back(compile(n->leafAt(0)));
+                break;
+            case AVRO_MAP:
+                leaves.push_back(compile(n->leafAt(1)));
+                break;
+            default:
+                break;
+        }
+        // Compiling the leaves may have moved the steps.
+        p_.steps[result].leaves.swap(leaves);
+        return result;
+    }
+};
+
+struct Cursor {
+    const uint8_t *p;
+    const uint8_t *end;
+
+    void need(size_t n) const {
+        if (static_cast<size_t>(end - p) < n) {
+            throw Exception("Binary data ends before its datum");
+        }
+    }
+
+    int64_t readLong() {
+        uint64_t encoded = 0;
+        int shift = 0;
+        uint8_t u;
+        do {
+            if (shift >= 64) {
+                throw Exception("Invalid Avro varint");
+            }
+            need(1);
+            u = *p++;
+            encoded |= static_cast<uint64_t>(u & 0x7f) << shift;
+            shift += 7;
+        } while (u & 0x80);
+        return static_cast<int64_t>((encoded >> 1) ^ -(encoded & 1));
+    }
+
+    size_t readSize() {
+        int64_t n = readLong();
+        if (n < 0) {
+            throw Exception(boost::format("Cannot have negative length: %1%") % n);
+        }
+        need(static_cast<size_t>(n));
+        return static_cast<size_t>(n);
+    }
+
+    // Reads the item count of a block of an array or a map, and the size
+    // in bytes that may follow it.
+    int64_t readBlockCount() {
+        int64_t n = readLong();
+        if (n < 0) {
+            if (n == INT64_MIN) {
+                throw Exception(boost::format("Invalid block count: %1%") % n);
+            }
+            n = -n;
+            readLong();
+        }
+        return n;
+    }
+
+    const uint8_t *take(size_t n) {
+        need(n);
+        const uint8_t *result = p;
+        p += n;
+        return result;
+    }
+};
+
+template<typename T>
+int compareValues(T a, T b) {
+    return a < b ? -1 : (b < a ? 1 : 0);
+}
+
+// Orders floating point numbers as Java's Float.compare and
+// Double.compare do: -0.0 before 0.0, and NaN after everything else.
+template<typename F, typename I>
+int compareFloating(const uint8_t *a, const uint8_t *b) {
+    F x, y;
+    std::memcpy(&x, a, sizeof(F));
+    std::memcpy(&y, b, sizeof(F));
+    if (x < y) {
+        return -1;
+    }
+    if (y < x) {
+        return 1;
+    }
+    // Equal, or unordered; the bits tell zeros apart, and every NaN is
+    // taken to be the greatest integer.
+    I i, j;
+    std::memcpy(&i, a, sizeof(F));
+    std::memcpy(&j, b, sizeof(F));
+    if (x != x) {
+        i = std::numeric_limits<I>::max();
+    }
+    if (y != y) {
+        j = std::numeric_limits<I>::max();
+    }
+    return compareValues(i, j);
+}
+
+int compareBytes(Cursor &a, Cursor &b, size_t aLen, size_t bLen) {
+    int r = std::memcmp(a.take(aLen), b.take(bLen), std::min(aLen, bLen));
+    return r != 0 ? r : compareValues(aLen, bLen);
+}
+
+class Walker {
+    const vector<Program::Step> &steps_;
+
+public:
+    explicit Walker(const Program &p) : steps_(p.steps) {}
+
+    void skip(size_t s, Cursor &c) const {
+        const Program::Step &step = steps_[s];
+        switch (step.type) {
+            case AVRO_NULL:
+                break;
+            case AVRO_BOOL:
+                c.take(1);
+                break;
+            case AVRO_INT:
+            case AVRO_LONG:
+            case AVRO_ENUM:
+                c.readLong();
+                break;
+            case AVRO_FLOAT:
+                c.take(sizeof(float));
+                break;
+            case AVRO_DOUBLE:
+                c.take(sizeof(double));
+                break;
+            case AVRO_STRING:
+            case AVRO_BYTES:
+                c.take(c.readSize());
+                break;
+            case AVRO_FIXED:
+                c.take(step.size);
+                break;
+            case AVRO_RECORD:
+                for (size_t f : step.leaves) {
+                    skip(f, c);
+                }
+                break;
+            case AVRO_UNION:
+                skip(step.leaves[branch(step, c)], c);
+                break;
+            case AVRO_ARRAY:
+            case AVRO_MAP:
+                for (int64_t n = c.readBlockCount(); n != 0; n = c.readBlockCount()) {
+                    for (; n != 0; --n) {
+                        if (step.type == AVRO_MAP) {
+                            c.take(c.readSize());
+                        }
+                        skip(step.leaves[0], c);
+                    }
+                }
+                break;
+            default:
+                throw Exception(boost::format("Cannot compare %1%") % step.type);
+        }
+    }
+
+    int compare(size_t s, Cursor &a, Cursor &b) const {
+        const Program::Step &step = steps_[s];
+        switch (step.type) {
+            case AVRO_NULL:
+                return 0;
+            case AVRO_BOOL:
+                return compareValues(*a.take(1), *b.take(1));
+            case AVRO_INT:
+            case AVRO_LONG:
+            case AVRO_ENUM:
+                return compareValues(a.readLong(), b.readLong());
+            case AVRO_FLOAT:
+                return compareFloating<float, int32_t>(a.take(sizeof(float)), b.take(sizeof(float)));
+            case AVRO_DOUBLE:
+                return compareFloating<double, int64_t>(a.take(sizeof(double)), b.take(sizeof(double)));
+            case AVRO_STRING:
+            case AVRO_BYTES: {
+                size_t aLen = a.readSize();
+                return compareBytes(a, b, aLen, b.readSize());
+            }
+            case AVRO_FIXED:
+                return compareBytes(a, b, step.size, step.size);
+            case AVRO_RECORD:
+                for (size_t i = 0; i < step.leaves.size(); ++i) {
+                    int r;
+                    switch (step.orders[i]) {
+                        case ORDER_ASCENDING:
+                            r = compare(step.leaves[i], a, b);
+                            break;
+                        case ORDER_DESCENDING:
+                            r = compare(step.leaves[i], b, a);
+                            break;
+                        default:
+                            skip(step.leaves[i], a);
+                            skip(step.leaves[i], b);
+                            r = 0;
+                            break;
+                    }
+                    if (r != 0) {
+                        return r;
+                    }
+                }
+                return 0;
+            case AVRO_UNION: {
+                size_t i = branch(step, a), j = branch(step, b);
+                return i != j ? compareValues(i, j) : compare(step.leaves[i], a, b);
+            }
+            case AVRO_ARRAY: {
+                int64_t i = 0, j = 0;
+                for (;;) {
+                    if (i == 0) {
+                        i = a.readBlockCount();
+                    }
+                    if (j == 0) {
+                        j = b.readBlockCount();
+                    }
+                    if (i == 0 || j == 0) {
+                        return compareValues(i != 0, j != 0);
+                    }
+                    int r = compare(step.leaves[0], a, b);
+                    if (r != 0) {
+                        return r;
+                    }
+                    --i;
+                    --j;
+                }
+            }
+            case AVRO_MAP:
+                throw Exception("Maps cannot be compared");
+            default:
+                throw Exception(boost::format("Cannot compare %1%") % step.type);
+        }
+    }
+
+    static size_t branch(const Program::Step &step, Cursor &c) {
+        int64_t n = c.readLong();
+        if (n < 0 || static_cast<uint64_t>(n) >= step.leaves.size()) {
+            throw Exception(boost::format("Union branch %1% out of range; there are %2%") % n % step.leaves.size());
+        }
+        return static_cast<size_t>(n);
+    }
+};
+
+} // namespace
+
+BinaryComparator::BinaryComparator(const ValidSchema &schema) {
+    std::shared_ptr<Program> p = std::make_shared<Program>();
+    ProgramCompiler(*p).compile(schema.root());
+    program_ = p;
+}
+
+int BinaryComparator::compare(const uint8_t *a, size_t aLen,
+                              const uint8_t *b, size_t bLen) const {
+    Cursor ca = {a, a + aLen};
+    Cursor cb = {b, b + bLen};
+    return Walker(*program_).compare(0, ca, cb);
+}
+
+int compareBinary(const ValidSchema &schema,
+                  const uint8_t *a, size_t aLen,
+                  const uint8_t *b, size_t bLen) {
+    return BinaryComparator(schema).compare(a, aLen, b, bLen);
+}
+
+} // namespace avro
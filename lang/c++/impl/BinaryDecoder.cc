@@ -16,8 +16,10 @@
  * limitations under the License.
  */
 
+#include "BinaryCodec.hh"
 #include "Decoder.hh"
 #include "Exception.hh"
+#include "Utf8.hh"
 #include "Zigzag.hh"
 #include <memory>
 
@@ -25,37 +27,6 @@ namespace avro {
 
 using std::make_shared;
 
-class BinaryDecoder : public Decoder {
-    StreamReader in_;
-
-    void init(InputStream &is) override;
-    void decodeNull() override;
-    bool decodeBool() override;
-    int32_t decodeInt() override;
-    int64_t decodeLong() override;
-    float decodeFloat() override;
-    double decodeDouble() override;
-    void decodeString(std::string &value) override;
-    void skipString() override;
-    void decodeBytes(std::vector<uint8_t> &value) override;
-    void skipBytes() override;
-    void decodeFixed(size_t n, std::vector<uint8_t> &value) override;
-    void skipFixed(size_t n) override;
-    size_t decodeEnum() override;
-    size_t arrayStart() override;
-    size_t arrayNext() override;
-    size_t skipArray() override;
-    size_t mapStart() override;
-    size_t mapNext() override;
-    size_t skipMap() override;
-    size_t decodeUnionIndex() override;
-
-    int64_t doDecodeLong();
-    size_t doDecodeItemCount();
-    size_t doDecodeLength();
-    void drain() override;
-};
-
 DecoderPtr binaryDecoder() {
     return make_shared<BinaryDecoder>();
 }
@@ -64,64 +35,19 @@ void BinaryDecoder::init(InputStream &is) {
     in_.reset(is);
 }
 
-void BinaryDecoder::decodeNull() {
-}
-
-bool BinaryDecoder::decodeBool() {
-    auto v = in_.read();
-    if (v == 0) {
-        return false;
-    } else if (v == 1) {
-        return true;
-    }
-    throw Exception(boost::format("Invalid value for bool: %1%") % v);
-}
-
-int32_t BinaryDecoder::decodeInt() {
-    auto val = doDecodeLong();
-    if (val < INT32_MIN || val > INT32_MAX) {
-        throw Exception(
-            boost::format("Value out of range for Avro int: %1%") % val);
-    }
-    return static_cast<int32_t>(val);
-}
-
-int64_t BinaryDecoder::decodeLong() {
-    return doDecodeLong();
-}
-
-float BinaryDecoder::decodeFloat() {
-    float result;
-    in_.readBytes(reinterpret_cast<uint8_t *>(&result), sizeof(float));
-    return result;
-}
-
-double BinaryDecoder::decodeDouble() {
-    double result;
-    in_.readBytes(reinterpret_cast<uint8_t *>(&result), sizeof(double));
-    return result;
-}
-
-size_t BinaryDecoder::doDecodeLength() {
-    ssize_t len = decodeInt();
-    if (len < 0) {
-        throw Exception(
-            boost::format("Cannot have negative length: %1%") % len);
-    }
-    return len;
-}
-
 void BinaryDecoder::drain() {
     in_.drain(false);
 }
 
-void BinaryDecoder::decodeString(std::string &value) {
-    size_t len = doDecodeLength();
-    value.resize(len);
-    if (len > 0) {
-        in_.readBytes(const_cast<uint8_t *>(
-                          reinterpret_cast<const uint8_t *>(value.c_str())),
-                      len);
+const uint8_t *BinaryDecoder::doDecodeViewSlow(size_t len) {
+    viewBuffer_.resize(len);
+    in_.readBytes(viewBuffer_.data(), len);
+    return viewBuffer_.data();
+}
+
+void BinaryDecoder::checkUtf8(const char *data, size_t len) const {
+    if (!isValidUtf8(data, len)) {
+        throw Exception(boost::format("Invalid UTF-8 in a string of %1% bytes") % len);
     }
 }
 
@@ -130,51 +56,15 @@ void BinaryDecoder::skipString() {
     in_.skipBytes(len);
 }
 
-void BinaryDecoder::decodeBytes(std::vector<uint8_t> &value) {
-    size_t len = doDecodeLength();
-    value.resize(len);
-    if (len > 0) {
-        in_.readBytes(value.data(), len);
-    }
-}
-
 void BinaryDecoder::skipBytes() {
     size_t len = doDecodeLength();
     in_.skipBytes(len);
 }
 
-void BinaryDecoder::decodeFixed(size_t n, std::vector<uint8_t> &value) {
-    value.resize(n);
-    if (n > 0) {
-        in_.readBytes(value.data(), n);
-    }
-}
-
 void BinaryDecoder::skipFixed(size_t n) {
     in_.skipBytes(n);
 }
 
-size_t BinaryDecoder::decodeEnum() {
-    return static_cast<size_t>(doDecodeLong());
-}
-
-size_t BinaryDecoder::arrayStart() {
-    return doDecodeItemCount();
-}
-
-size_t BinaryDecoder::doDecodeItemCount() {
-    auto result = doDecodeLong();
-    if (result < 0) {
-        doDecodeLong();
-        return static_cast<size_t>(-result);
-    }
-    return static_cast<size_t>(result);
-}
-
-size_t BinaryDecoder::arrayNext() {
-    return static_cast<size_t>(doDecodeLong());
-}
-
 size_t BinaryDecoder::skipArray() {
     for (;;) {
         auto r = doDecodeLong();
@@ -187,23 +77,33 @@ size_t BinaryDecoder::skipArray() {
     }
 }
 
-size_t BinaryDecoder::mapStart() {
-    return doDecodeItemCount();
+size_t BinaryDecoder::skipMap() {
+    return skipArray();
 }
 
-size_t BinaryDecoder::mapNext() {
-    return doDecodeItemCount();
+void BinaryDecoder::decodeIntArray(int32_t *values, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        values[i] = doDecodeInt();
+    }
 }
 
-size_t BinaryDecoder::skipMap() {
-    return skipArray();
+void BinaryDecoder::decodeLongArray(int64_t *values, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        values[i] = doDecodeLong();
+    }
+}
+
+// Like decodeFloat() and decodeDouble(), these take the host
+// representation, so the whole array comes in with one copy.
+void BinaryDecoder::decodeFloatArray(float *values, size_t n) {
+    in_.readBytes(reinterpret_cast<uint8_t *>(values), n * sizeof(float));
 }
 
-size_t BinaryDecoder::decodeUnionIndex() {
-    return static_cast<size_t>(doDecodeLong());
+void BinaryDecoder::decodeDoubleArray(double *values, size_t n) {
+    in_.readBytes(reinterpret_cast<uint8_t *>(values), n * sizeof(double));
 }
 
-int64_t BinaryDecoder::doDecodeLong() {
+int64_t BinaryDecoder::doDecodeLongSlow() {
     uint64_t encoded = 0;
     int shift = 0;
     uint8_t u;
@@ -16,106 +16,311 @@
  * limitations under the License.
  */
 
+#include "BinaryCodec.hh"
 #include "Encoder.hh"
 #include "Zigzag.hh"
+#include <algorithm>
 #include <array>
+#include <vector>
 
 namespace avro {
 
 using std::make_shared;
 
-class BinaryEncoder : public Encoder {
-    StreamWriter out_;
-
-    void init(OutputStream &os) override;
-    void flush() override;
-    int64_t byteCount() const override;
-    void encodeNull() override;
-    void encodeBool(bool b) override;
-    void encodeInt(int32_t i) override;
-    void encodeLong(int64_t l) override;
-    void encodeFloat(float f) override;
-    void encodeDouble(double d) override;
-    void encodeString(const std::string &s) override;
-    void encodeBytes(const uint8_t *bytes, size_t len) override;
-    void encodeFixed(const uint8_t *bytes, size_t len) override;
-    void encodeEnum(size_t e) override;
-    void arrayStart() override;
-    void arrayEnd() override;
-    void mapStart() override;
-    void mapEnd() override;
-    void setItemCount(size_t count) override;
-    void startItem() override;
-    void encodeUnionIndex(size_t e) override;
-
-    void doEncodeLong(int64_t l);
-};
-
 EncoderPtr binaryEncoder() {
     return make_shared<BinaryEncoder>();
 }
 
-void BinaryEncoder::init(OutputStream &os) {
-    out_.reset(os);
-}
+/**
+ * A growable buffer holding one block while it is encoded.
+ */
+class BlockBuffer : public OutputStream {
+    std::vector<uint8_t> data_;
+    size_t size_ = 0;
 
-void BinaryEncoder::flush() {
-    out_.flush();
-}
+public:
+    bool next(uint8_t **data, size_t *len) override {
+        if (size_ == data_.size()) {
+            data_.resize(std::max(2 * data_.size(), static_cast<size_t>(1024)));
+        }
+        *data = data_.data() + size_;
+        *len = data_.size() - size_;
+        size_ = data_.size();
+        return true;
+    }
 
-void BinaryEncoder::encodeNull() {
-}
+    void backup(size_t len) override {
+        size_ -= len;
+    }
 
-void BinaryEncoder::encodeBool(bool b) {
-    out_.write(b ? 1 : 0);
-}
+    uint64_t byteCount() const override {
+        return size_;
+    }
 
-void BinaryEncoder::encodeInt(int32_t i) {
-    doEncodeLong(i);
-}
+    void flush() override {}
 
-void BinaryEncoder::encodeLong(int64_t l) {
-    doEncodeLong(l);
-}
+    const uint8_t *data() const { return data_.data(); }
+    size_t size() const { return size_; }
+    void clear() { size_ = 0; }
+};
 
-void BinaryEncoder::encodeFloat(float f) {
-    const auto *p = reinterpret_cast<const uint8_t *>(&f);
-    out_.writeBytes(p, sizeof(float));
-}
+/**
+ * Writes arrays and maps as blocks of at most blockItems_ items, each one
+ * preceded by its negated item count and its byte size. Each block is
+ * encoded into a buffer of its own and copied out once complete.
+ */
+class BlockingBinaryEncoder : public BinaryEncoder {
+    struct Block {
+        BlockBuffer buffer;
+        size_t items = 0;
+    };
 
-void BinaryEncoder::encodeDouble(double d) {
-    const auto *p = reinterpret_cast<const uint8_t *>(&d);
-    out_.writeBytes(p, sizeof(double));
-}
+    const size_t blockItems_;
+    OutputStream *os_ = nullptr;
+    // The blocks of the arrays and maps open, innermost last; those past
+    // depth_ are kept for their buffers.
+    std::vector<std::unique_ptr<Block>> blocks_;
+    size_t depth_ = 0;
 
-void BinaryEncoder::encodeString(const std::string &s) {
-    doEncodeLong(s.size());
-    out_.writeBytes(reinterpret_cast<const uint8_t *>(s.c_str()), s.size());
-}
+    OutputStream &parent() {
+        return depth_ == 1 ? *os_ : blocks_[depth_ - 2]->buffer;
+    }
+
+    void start() {
+        if (blocks_.size() == depth_) {
+            blocks_.emplace_back(new Block());
+        }
+        blocks_[depth_]->buffer.clear();
+        blocks_[depth_]->items = 0;
+        ++depth_;
+    }
+
+    void writeBlock() {
+        Block &b = *blocks_[depth_ - 1];
+        out_.reset(parent());
+        doEncodeLong(-static_cast<int64_t>(b.items));
+        doEncodeLong(static_cast<int64_t>(b.buffer.size()));
+        out_.writeBytes(b.buffer.data(), b.buffer.size());
+        b.buffer.clear();
+        b.items = 0;
+    }
+
+    void end() {
+        if (blocks_[depth_ - 1]->items != 0) {
+            writeBlock();
+        }
+        --depth_;
+        doEncodeLong(0);
+    }
+
+    // Returns the block the next items go to, starting it if need be.
+    Block &block() {
+        if (depth_ == 0) {
+            throw Exception("Item outside an array or map");
+        }
+        Block &b = *blocks_[depth_ - 1];
+        if (b.items == blockItems_) {
+            writeBlock();
+        }
+        if (b.items == 0) {
+            out_.reset(b.buffer);
+        }
+        return b;
+    }
+
+    template<typename T, typename F>
+    void encodeItems(const T *values, size_t n, F bulk) {
+        while (n != 0) {
+            Block &b = block();
+            size_t k = std::min(n, blockItems_ - b.items);
+            (this->*bulk)(values, k);
+            b.items += k;
+            values += k;
+            n -= k;
+        }
+    }
+
+public:
+    explicit BlockingBinaryEncoder(size_t blockItems) : blockItems_(blockItems) {
+        if (blockItems == 0) {
+            throw Exception("Block item count cannot be zero");
+        }
+    }
+
+    void init(OutputStream &os) override {
+        BinaryEncoder::init(os);
+        os_ = &os;
+        depth_ = 0;
+    }
+
+    int64_t byteCount() const override {
+        return os_->byteCount();
+    }
+
+    void arrayStart() override {
+        start();
+    }
+
+    void arrayEnd() override {
+        end();
+    }
+
+    void mapStart() override {
+        start();
+    }
+
+    void mapEnd() override {
+        end();
+    }
+
+    void setItemCount(size_t count) override {
+        if (count == 0) {
+            throw Exception("Count cannot be zero");
+        }
+    }
+
+    void startItem() override {
+        ++block().items;
+    }
+
+    void encodeIntArray(const int32_t *values, size_t n) override {
+        encodeItems(values, n, &BlockingBinaryEncoder::encodeInts);
+    }
+
+    void encodeLongArray(const int64_t *values, size_t n) override {
+        encodeItems(values, n, &BlockingBinaryEncoder::encodeLongs);
+    }
+
+    void encodeFloatArray(const float *values, size_t n) override {
+        encodeItems(values, n, &BlockingBinaryEncoder::encodeFloats);
+    }
+
+    void encodeDoubleArray(const double *values, size_t n) override {
+        encodeItems(values, n, &BlockingBinaryEncoder::encodeDoubles);
+    }
 
-void BinaryEncoder::encodeBytes(const uint8_t *bytes, size_t len) {
-    doEncodeLong(len);
-    out_.writeBytes(bytes, len);
+private:
+    void encodeInts(const int32_t *values, size_t n) {
+        BinaryEncoder::encodeIntArray(values, n);
+    }
+    void encodeLongs(const int64_t *values, size_t n) {
+        BinaryEncoder::encodeLongArray(values, n);
+    }
+    void encodeFloats(const float *values, size_t n) {
+        BinaryEncoder::encodeFloatArray(values, n);
+    }
+    void encodeDoubles(const double *values, size_t n) {
+        BinaryEncoder::encodeDoubleArray(values, n);
+    }
+};
+
+EncoderPtr blockingBinaryEncoder(size_t blockItems) {
+    return make_shared<BlockingBinaryEncoder>(blockItems);
 }
 
-void BinaryEncoder::encodeFixed(const uint8_t *bytes, size_t len) {
-    out_.writeBytes(bytes, len);
+/**
+ * Counts what BinaryEncoder would write, call for call.
+ */
+class SizingEncoder : public Encoder {
+    int64_t count_ = 0;
+
+    void doEncodeLong(int64_t l) {
+        count_ += varintLength(encodeZigzag64(l));
+    }
+
+    void init(OutputStream &) override {
+        count_ = 0;
+    }
+    void flush() override {}
+    int64_t byteCount() const override {
+        return count_;
+    }
+    void encodeNull() override {}
+    void encodeBool(bool) override {
+        ++count_;
+    }
+    void encodeInt(int32_t i) override {
+        doEncodeLong(i);
+    }
+    void encodeLong(int64_t l) override {
+        doEncodeLong(l);
+    }
+    void encodeFloat(float) override {
+        count_ += sizeof(float);
+    }
+    void encodeDouble(double) override {
+        count_ += sizeof(double);
+    }
+    void encodeString(const std::string &s) override {
+        doEncodeLong(s.size());
+        count_ += s.size();
+    }
+    void encodeStringView(const char *, size_t len) override {
+        doEncodeLong(len);
+        count_ += len;
+    }
+    void encodeBytes(const uint8_t *, size_t len) override {
+        doEncodeLong(len);
+        count_ += len;
+    }
+    void encodeFixed(const uint8_t *, size_t len) override {
+        count_ += len;
+    }
+    void encodeEnum(size_t e) override {
+        doEncodeLong(e);
+    }
+    void arrayStart() override {}
+    void arrayEnd() override {
+        doEncodeLong(0);
+    }
+    void mapStart() override {}
+    void mapEnd() override {
+        doEncodeLong(0);
+    }
+    void setItemCount(size_t count) override {
+        if (count == 0) {
+            throw Exception("Count cannot be zero");
+        }
+        doEncodeLong(count);
+    }
+    void startItem() override {}
+    void encodeUnionIndex(size_t e) override {
+        doEncodeLong(e);
+    }
+    void encodeIntArray(const int32_t *values, size_t n) override {
+        for (size_t i = 0; i < n; ++i) {
+            doEncodeLong(values[i]);
+        }
+    }
+    void encodeLongArray(const int64_t *values, size_t n) override {
+        for (size_t i = 0; i < n; ++i) {
+            doEncodeLong(values[i]);
+        }
+    }
+    void encodeFloatArray(const float *, size_t n) override {
+        count_ += n * sizeof(float);
+    }
+    void encodeDoubleArray(const double *, size_t n) override {
+        count_ += n * sizeof(double);
+    }
+};
+
+EncoderPtr sizingEncoder() {
+    return make_shared<SizingEncoder>();
 }
 
-void BinaryEncoder::encodeEnum(size_t e) {
-    doEncodeLong(e);
+void BinaryEncoder::init(OutputStream &os) {
+    out_.reset(os);
 }
 
-void BinaryEncoder::arrayStart() {
+void BinaryEncoder::flush() {
+    out_.flush();
 }
 
 void BinaryEncoder::arrayEnd() {
     doEncodeLong(0);
 }
 
-void BinaryEncoder::mapStart() {
-}
-
 void BinaryEncoder::mapEnd() {
     doEncodeLong(0);
 }
@@ -127,21 +332,50 @@ void BinaryEncoder::setItemCount(size_t count) {
     doEncodeLong(count);
 }
 
-void BinaryEncoder::startItem() {
+void BinaryEncoder::encodeIntArray(const int32_t *values, size_t n) {
+    doEncodeLongs(values, n);
 }
 
-void BinaryEncoder::encodeUnionIndex(size_t e) {
-    doEncodeLong(e);
+void BinaryEncoder::encodeLongArray(const int64_t *values, size_t n) {
+    doEncodeLongs(values, n);
+}
+
+// Like encodeFloat() and encodeDouble(), these write the host
+// representation, so the whole array goes out in one copy.
+void BinaryEncoder::encodeFloatArray(const float *values, size_t n) {
+    out_.writeBytes(reinterpret_cast<const uint8_t *>(values), n * sizeof(float));
+}
+
+void BinaryEncoder::encodeDoubleArray(const double *values, size_t n) {
+    out_.writeBytes(reinterpret_cast<const uint8_t *>(values), n * sizeof(double));
 }
 
 int64_t BinaryEncoder::byteCount() const {
     return out_.byteCount();
 }
 
-void BinaryEncoder::doEncodeLong(int64_t l) {
+void BinaryEncoder::doEncodeLongSlow(int64_t l) {
     // NOLINTNEXTLINE(cppcoreguidelines-pro-type-member-init)
     std::array<uint8_t, 10> bytes;
     auto size = encodeInt64(l, bytes);
     out_.writeBytes(bytes.data(), size);
 }
+
+template<typename T>
+void BinaryEncoder::doEncodeLongs(const T *values, size_t n) {
+    // Works on copies of the chunk pointers, which stay in registers.
+    uint8_t *next = out_.next_;
+    uint8_t *end = out_.end_;
+    for (size_t i = 0; i < n; ++i) {
+        if (static_cast<size_t>(end - next) < 10) {
+            out_.next_ = next;
+            doEncodeLongSlow(values[i]);
+            next = out_.next_;
+            end = out_.end_;
+        } else {
+            next += encodeVarintUnchecked(encodeZigzag64(values[i]), next);
+        }
+    }
+    out_.next_ = next;
+}
 } // namespace avro
@@ -0,0 +1,262 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_BinarySkip_hh__
+#define avro_BinarySkip_hh__
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "Exception.hh"
+#include "NodeImpl.hh"
+
+namespace avro {
+
+/**
+ * Reads data in Avro binary encoding straight out of memory.
+ */
+struct BinaryCursor {
+    const uint8_t *p;
+    const uint8_t *end;
+
+    void need(size_t n) const {
+        if (static_cast<size_t>(end - p) < n) {
+            throw Exception("Binary data ends before its datum");
+        }
+    }
+
+    int64_t readLong() {
+        uint64_t encoded = 0;
+        int shift = 0;
+        uint8_t u;
+        do {
+            if (shift >= 64) {
+                throw Exception("Invalid Avro varint");
+            }
+            need(1);
+            u = *p++;
+            encoded |= static_cast<uint64_t>(u & 0x7f) << shift;
+            shift += 7;
+        } while (u & 0x80);
+        return static_cast<int64_t>((encoded >> 1) ^ -(encoded & 1));
+    }
+
+    size_t readSize() {
+        int64_t n = readLong();
+        if (n < 0) {
+            throw Exception(boost::format("Cannot have negative length: %1%") % n);
+        }
+        need(static_cast<size_t>(n));
+        return static_cast<size_t>(n);
+    }
+
+    // Reads the item count of a block of an array or a map, and sets
+    // bytes to the size in bytes that may follow it, or to -1.
+    int64_t readBlockCount(int64_t &bytes) {
+        int64_t n = readLong();
+        bytes = -1;
+        if (n < 0) {
+            if (n == INT64_MIN) {
+                throw Exception(boost::format("Invalid block count: %1%") % n);
+            }
+            n = -n;
+            bytes = readLong();
+        }
+        return n;
+    }
+
+    const uint8_t *take(size_t n) {
+        need(n);
+        const uint8_t *result = p;
+        p += n;
+        return result;
+    }
+
+    size_t branch(size_t branches) {
+        int64_t n = readLong();
+        if (n < 0 || static_cast<uint64_t>(n) >= branches) {
+            throw Exception(boost::format("Union branch %1% out of range; there are %2%") % n % branches);
+        }
+        return static_cast<size_t>(n);
+    }
+};
+
+/**
+ * Schemas compiled into steps that step over their values in the binary
+ * encoding. A step refers to those of its fields, branches or items by
+ * index, so that recursive schemas compile to finite programs.
+ */
+class SkipProgram {
+    struct Step {
+        Type type;
+        // The size of fixeds, and of runs of fixed-width values.
+        size_t size;
+        std::vector<size_t> leaves;
+    };
+
+    std::vector<Step> steps_;
+    std::map<const Node *, size_t> records_;
+
+    size_t add(Type type, size_t size) {
+        Step s = {type, size, std::vector<size_t>()};
+        steps_.push_back(s);
+        return steps_.size() - 1;
+    }
+
+public:
+    /**
+     * Returns the step that skips a value of \p node.
+     */
+    size_t compile(const NodePtr &node) {
+        NodePtr n = node->type() == AVRO_SYMBOLIC ? resolveSymbol(node) : node;
+        if (n->type() == AVRO_RECORD) {
+            std::map<const Node *, size_t>::const_iterator it = records_.find(n.get());
+            if (it != records_.end()) {
+                return it->second;
+            }
+        }
+        size_t result = add(n->type(), n->type() == AVRO_FIXED ? n->fixedSize() : 0);
+        std::vector<size_t> leaves;
+        switch (n->type()) {
+            case AVRO_RECORD:
+                records_[n.get()] = result;
+                for (size_t i = 0; i < n->leaves(); ++i) {
+                    leaves.push_back(compile(n->leafAt(i)));
+                }
+                break;
+            case AVRO_UNION:
+                for (size_t i = 0; i < n->leaves(); ++i) {
+                    leaves.push_back(compile(n->leafAt(i)));
+                }
+                break;
+            case AVRO_ARRAY:
+                leaves.push_back(compile(n->leafAt(0)));
+                break;
+            case AVRO_MAP:
+                leaves.push_back(compile(n->leafAt(1)));
+                break;
+            default:
+                break;
+        }
+        // Compiling the leaves may have moved the steps.
+        steps_[result].leaves.swap(leaves);
+        return result;
+    }
+
+    /**
+     * Returns a step that skips \p size bytes.
+     */
+    size_t bytes(size_t size) {
+        return add(AVRO_FIXED, size);
+    }
+
+    /**
+     * Tells whether values of \p node always take the same number of
+     * bytes, and adds that number to \p size if so. Records nested too
+     * deep, which a record that contains itself would be, are not.
+     */
+    static bool fixedWidth(const NodePtr &node, size_t &size, size_t depth = 0) {
+        NodePtr n = node->type() == AVRO_SYMBOLIC ? resolveSymbol(node) : node;
+        switch (n->type()) {
+            case AVRO_NULL:
+                return true;
+            case AVRO_FLOAT:
+                size += 4;
+                return true;
+            case AVRO_DOUBLE:
+                size += 8;
+                return true;
+            case AVRO_FIXED:
+                size += n->fixedSize();
+                return true;
+            case AVRO_RECORD:
+                if (depth == 32) {
+                    return false;
+                }
+                for (size_t i = 0; i < n->leaves(); ++i) {
+                    if (!fixedWidth(n->leafAt(i), size, depth + 1)) {
+                        return false;
+                    }
+                }
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    void skip(size_t s, BinaryCursor &c) const {
+        const Step &step = steps_[s];
+        switch (step.type) {
+            case AVRO_NULL:
+                break;
+            case AVRO_BOOL:
+                c.take(1);
+                break;
+            case AVRO_INT:
+            case AVRO_LONG:
+            case AVRO_ENUM:
+                c.readLong();
+                break;
+            case AVRO_FLOAT:
+                c.take(sizeof(float));
+                break;
+            case AVRO_DOUBLE:
+                c.take(sizeof(double));
+                break;
+            case AVRO_STRING:
+            case AVRO_BYTES:
+                c.take(c.readSize());
+                break;
+            case AVRO_FIXED:
+                c.take(step.size);
+                break;
+            case AVRO_RECORD:
+                for (size_t f : step.leaves) {
+                    skip(f, c);
+                }
+                break;
+            case AVRO_UNION:
+                skip(step.leaves[c.branch(step.leaves.size())], c);
+                break;
+            case AVRO_ARRAY:
+            case AVRO_MAP: {
+                int64_t bytes;
+                for (int64_t n = c.readBlockCount(bytes); n != 0; n = c.readBlockCount(bytes)) {
+                    if (bytes >= 0) {
+                        // The writer said how long the block is.
+                        c.take(static_cast<size_t>(bytes));
+                        continue;
+                    }
+                    for (; n != 0; --n) {
+                        if (step.type == AVRO_MAP) {
+                            c.take(c.readSize());
+                        }
+                        skip(step.leaves[0], c);
+                    }
+                }
+            } break;
+            default:
+                throw Exception(boost::format("Cannot skip %1%") % step.type);
+        }
+    }
+};
+
+} // namespace avro
+
+#endif
@@ -0,0 +1,521 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "BinaryValidator.hh"
+#include "Exception.hh"
+#include "NodeImpl.hh"
+
+#include <cstdint>
+#include <map>
+
+namespace avro {
+
+using std::map;
+using std::shared_ptr;
+using std::vector;
+
+/**
+ * A schema compiled into one flat array of instructions, one per value
+ * that takes bytes. Records become routines that are called, so that
+ * recursive schemas compile to finite programs; records without fields
+ * and nulls take no bytes and compile to nothing.
+ */
+struct BinaryValidator::Program {
+    enum Op {
+        opBool,
+        opInt,
+        opLong,
+        opBytes,  // Strings as well as bytes.
+        opFixed,  // arg is the size, for floats and doubles as well.
+        opEnum,   // arg is the number of symbols.
+        opUnion,  // arg indexes unions.
+        opRepeat, // Arrays and maps; arg is the length of the item code.
+        opLoop,   // Ends the item code.
+        opCall,   // arg is the entry point.
+        opReturn,
+        opEnd,
+    };
+
+    struct Instruction {
+        Op op;
+        size_t arg;
+    };
+
+    vector<Instruction> code;
+    // The entry points of the branches of each union.
+    vector<vector<size_t>> unions;
+    size_t entry = 0;
+};
+
+namespace {
+
+typedef BinaryValidator::Program Program;
+typedef vector<Program::Instruction> Code;
+
+Program::Instruction instr(Program::Op op, size_t arg = 0) {
+    Program::Instruction result = {op, arg};
+    return result;
+}
+
+NodePtr resolved(const NodePtr &n) {
+    return n->type() == AVRO_SYMBOLIC
+        ? std::static_pointer_cast<NodeSymbolic>(n)->getNode()
+        : n;
+}
+
+class ProgramCompiler {
+    Program &p_;
+    // Routine ids of records, whose entry points are known only once the
+    // records have been compiled.
+    map<const Node *, size_t> routines_;
+    vector<NodePtr> pending_;
+    vector<size_t> routinePcs_;
+
+    size_t append(const Code &c) {
+        size_t result = p_.code.size();
+        p_.code.insert(p_.code.end(), c.begin(), c.end());
+        return result;
+    }
+
+    size_t routine(const NodePtr &record) {
+        map<const Node *, size_t>::const_iterator it = routines_.find(record.get());
+        if (it != routines_.end()) {
+            return it->second;
+        }
+        size_t result = routinePcs_.size();
+        routines_[record.get()] = result;
+        routinePcs_.push_back(0);
+        pending_.push_back(record);
+        return result;
+    }
+
+    void emit(const NodePtr &n, Code &out) {
+        switch (n->type()) {
+            case AVRO_NULL:
+                break;
+            case AVRO_BOOL:
+                out.push_back(instr(Program::opBool));
+                break;
+            case AVRO_INT:
+                out.push_back(instr(Program::opInt));
+                break;
+            case AVRO_LONG:
+                out.push_back(instr(Program::opLong));
+                break;
+            case AVRO_FLOAT:
+                out.push_back(instr(Program::opFixed, sizeof(float)));
+                break;
+            case AVRO_DOUBLE:
+                out.push_back(instr(Program::opFixed, sizeof(double)));
+                break;
+            case AVRO_STRING:
+            case AVRO_BYTES:
+                out.push_back(instr(Program::opBytes));
+                break;
+            case AVRO_FIXED:
+                out.push_back(instr(Program::opFixed, n->fixedSize()));
+                break;
+            case AVRO_ENUM:
+                out.push_back(instr(Program::opEnum, n->names()));
+                break;
+            case AVRO_RECORD:
+                if (n->leaves() != 0) {
+                    out.push_back(instr(Program::opCall, routine(n)));
+                }
+                break;
+            case AVRO_ARRAY:
+                emitRepeated(resolved(n->leafAt(0)), false, out);
+                break;
+            case AVRO_MAP:
+                emitRepeated(resolved(n->leafAt(1)), true, out);
+                break;
+            case AVRO_UNION: {
+                vector<size_t> branches;
+                for (size_t i = 0; i < n->leaves(); ++i) {
+                    Code c;
+                    emit(resolved(n->leafAt(i)), c);
+                    c.push_back(instr(Program::opReturn));
+                    branches.push_back(append(c));
+                }
+                out.push_back(instr(Program::opUnion, p_.unions.size()));
+                p_.unions.push_back(branches);
+            } break;
+            case AVRO_SYMBOLIC:
+                emit(resolved(n), out);
+                break;
+            default:
+                throw Exception(boost::format("Cannot validate %1%") % n->type());
+        }
+    }
+
+    void emitRepeated(const NodePtr &item, bool hasKey, Code &out) {
+        Code body;
+        if (hasKey) {
+            body.push_back(instr(Program::opBytes));
+        }
+        emit(item, body);
+        out.push_back(instr(Program::opRepeat, body.size()));
+        out.insert(out.end(), body.begin(), body.end());
+        out.push_back(instr(Program::opLoop));
+    }
+
+public:
+    explicit ProgramCompiler(Program &p) : p_(p) {}
+
+    void compile(const ValidSchema &schema) {
+        Code main;
+        emit(resolved(schema.root()), main);
+        main.push_back(instr(Program::opEnd));
+        p_.entry = append(main);
+        while (!pending_.empty()) {
+            NodePtr r = pending_.back();
+            pending_.pop_back();
+            Code c;
+            for (size_t i = 0; i < r->leaves(); ++i) {
+                emit(resolved(r->leafAt(i)), c);
+            }
+            c.push_back(instr(Program::opReturn));
+            routinePcs_[routines_[r.get()]] = append(c);
+        }
+        for (vector<Program::Instruction>::iterator it = p_.code.begin(); it != p_.code.end(); ++it) {
+            if (it->op == Program::opCall) {
+                it->arg = routinePcs_[it->arg];
+            }
+        }
+    }
+};
+
+bool fail(DecodeStatus &s, DecodeStatus::Code code, size_t offset,
+          int64_t value = 0, int64_t limit = 0) {
+    s.code = code;
+    s.offset = offset;
+    s.value = value;
+    s.limit = limit;
+    return false;
+}
+
+/**
+ * Reads a datum from an input stream chunk by chunk, saying whether it
+ * could rather than throwing, and handing back what it has not read when
+ * done.
+ */
+class Cursor {
+    InputStream &in_;
+    const size_t start_;
+    const uint8_t *next_ = nullptr;
+    const uint8_t *end_ = nullptr;
+
+    bool fill() {
+        size_t n = 0;
+        while (next_ == end_) {
+            if (!in_.next(&next_, &n)) {
+                next_ = end_ = nullptr;
+                return false;
+            }
+            end_ = next_ + n;
+        }
+        return true;
+    }
+
+public:
+    explicit Cursor(InputStream &in) : in_(in), start_(in.byteCount()) {}
+
+    ~Cursor() {
+        if (next_ != end_) {
+            in_.backup(end_ - next_);
+        }
+    }
+
+    size_t offset() const {
+        return in_.byteCount() - static_cast<size_t>(end_ - next_) - start_;
+    }
+
+    bool readByte(uint8_t &b) {
+        if (next_ == end_ && !fill()) {
+            return false;
+        }
+        b = *next_++;
+        return true;
+    }
+
+    bool skip(size_t n) {
+        while (n > static_cast<size_t>(end_ - next_)) {
+            n -= end_ - next_;
+            next_ = end_;
+            if (!fill()) {
+                return false;
+            }
+        }
+        next_ += n;
+        return true;
+    }
+
+    bool readLong(int64_t &l, DecodeStatus &s) {
+        size_t at = offset();
+        uint64_t encoded = 0;
+        int shift = 0;
+        uint8_t u;
+        do {
+            if (shift >= 64) {
+                return fail(s, DecodeStatus::badVarint, at);
+            }
+            if (!readByte(u)) {
+                return fail(s, DecodeStatus::truncated, at);
+            }
+            encoded |= static_cast<uint64_t>(u & 0x7f) << shift;
+            shift += 7;
+        } while (u & 0x80);
+        l = static_cast<int64_t>((encoded >> 1) ^ -(encoded & 1));
+        return true;
+    }
+
+    bool skipBytes(DecodeStatus &s) {
+        size_t at = offset();
+        int64_t n;
+        if (!readLong(n, s)) {
+            return false;
+        }
+        if (n < 0) {
+            return fail(s, DecodeStatus::badLength, at, n);
+        }
+        return skip(static_cast<size_t>(n)) || fail(s, DecodeStatus::truncated, at);
+    }
+
+    // Reads the item count of a block of an array or a map, and the size
+    // in bytes that may follow it.
+    bool blockCount(int64_t &n, DecodeStatus &s) {
+        size_t at = offset();
+        if (!readLong(n, s)) {
+            return false;
+        }
+        if (n < 0) {
+            if (n == INT64_MIN) {
+                return fail(s, DecodeStatus::badBlockCount, at, n);
+            }
+            n = -n;
+            int64_t size;
+            if (!readLong(size, s)) {
+                return false;
+            }
+            if (size < 0) {
+                return fail(s, DecodeStatus::badBlockCount, at, size);
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace
+
+BinaryValidator::BinaryValidator(const ValidSchema &schema) : decoder_(binaryDecoder()) {
+    shared_ptr<Program> p = std::make_shared<Program>();
+    ProgramCompiler(*p).compile(schema);
+    program_ = p;
+}
+
+BinaryValidator::BinaryValidator(const BinaryValidator &other)
+    : program_(other.program_), decoder_(binaryDecoder()) {
+}
+
+BinaryValidator &BinaryValidator::operator=(const BinaryValidator &other) {
+    program_ = other.program_;
+    return *this;
+}
+
+BinaryValidator::~BinaryValidator() = default;
+
+void BinaryValidator::validate(InputStream &in) {
+    DecodeStatus s = tryValidate(in);
+    if (!s) {
+        throw Exception(s.message());
+    }
+}
+
+DecodeStatus BinaryValidator::tryValidate(InputStream &in) {
+    const Program &p = *program_;
+    const Program::Instruction *const code = p.code.data();
+    Cursor c(in);
+    DecodeStatus s;
+    frames_.clear();
+    size_t pc = p.entry;
+    for (;;) {
+        const Program::Instruction &i = code[pc];
+        switch (i.op) {
+            case Program::opBool: {
+                size_t at = c.offset();
+                uint8_t b;
+                if (!c.readByte(b)) {
+                    fail(s, DecodeStatus::truncated, at);
+                    return s;
+                }
+                if (b > 1) {
+                    fail(s, DecodeStatus::badBool, at, b);
+                    return s;
+                }
+                ++pc;
+            } break;
+            case Program::opInt: {
+                size_t at = c.offset();
+                int64_t n;
+                if (!c.readLong(n, s)) {
+                    return s;
+                }
+                if (n < INT32_MIN || n > INT32_MAX) {
+                    fail(s, DecodeStatus::badInt, at, n);
+                    return s;
+                }
+                ++pc;
+            } break;
+            case Program::opLong: {
+                int64_t n;
+                if (!c.readLong(n, s)) {
+                    return s;
+                }
+                ++pc;
+            } break;
+            case Program::opBytes:
+                if (!c.skipBytes(s)) {
+                    return s;
+                }
+                ++pc;
+                break;
+            case Program::opFixed: {
+                size_t at = c.offset();
+                if (!c.skip(i.arg)) {
+                    fail(s, DecodeStatus::truncated, at);
+                    return s;
+                }
+                ++pc;
+            } break;
+            case Program::opEnum: {
+                size_t at = c.offset();
+                int64_t n;
+                if (!c.readLong(n, s)) {
+                    return s;
+                }
+                if (n < 0 || static_cast<uint64_t>(n) >= i.arg) {
+                    fail(s, DecodeStatus::badEnum, at, n, static_cast<int64_t>(i.arg));
+                    return s;
+                }
+                ++pc;
+            } break;
+            case Program::opUnion: {
+                size_t at = c.offset();
+                int64_t n;
+                if (!c.readLong(n, s)) {
+                    return s;
+                }
+                const vector<size_t> &branches = p.unions[i.arg];
+                if (n < 0 || static_cast<uint64_t>(n) >= branches.size()) {
+                    fail(s, DecodeStatus::badUnion, at, n, static_cast<int64_t>(branches.size()));
+                    return s;
+                }
+                Frame f = {pc + 1, 0};
+                frames_.push_back(f);
+                pc = branches[n];
+            } break;
+            case Program::opRepeat: {
+                int64_t n;
+                if (!c.blockCount(n, s)) {
+                    return s;
+                }
+                if (i.arg == 0) {
+                    // Items that take no bytes need not be walked.
+                    while (n != 0) {
+                        if (!c.blockCount(n, s)) {
+                            return s;
+                        }
+                    }
+                }
+                if (n == 0) {
+                    pc += i.arg + 2;
+                } else {
+                    Frame f = {pc + 1, n - 1};
+                    frames_.push_back(f);
+                    ++pc;
+                }
+            } break;
+            case Program::opLoop: {
+                Frame &f = frames_.back();
+                if (f.remaining == 0) {
+                    if (!c.blockCount(f.remaining, s)) {
+                        return s;
+                    }
+                    if (f.remaining == 0) {
+                        frames_.pop_back();
+                        ++pc;
+                        break;
+                    }
+                }
+                --f.remaining;
+                pc = f.pc;
+            } break;
+            case Program::opCall: {
+                Frame f = {pc + 1, 0};
+                frames_.push_back(f);
+                pc = i.arg;
+            } break;
+            case Program::opReturn:
+                pc = frames_.back().pc;
+                frames_.pop_back();
+                break;
+            case Program::opEnd:
+                return s;
+        }
+    }
+}
+
+std::string DecodeStatus::message() const {
+    boost::format f;
+    switch (code) {
+        case ok:
+            return std::string();
+        case truncated:
+            f = boost::format("Data ends before its datum does, at offset %1%") % offset;
+            break;
+        case badVarint:
+            f = boost::format("Invalid Avro varint at offset %1%") % offset;
+            break;
+        case badBool:
+            f = boost::format("Invalid value for bool: %1% at offset %2%") % value % offset;
+            break;
+        case badInt:
+            f = boost::format("Value out of range for Avro int: %1% at offset %2%") % value % offset;
+            break;
+        case badLength:
+            f = boost::format("Cannot have negative length: %1% at offset %2%") % value % offset;
+            break;
+        case badBlockCount:
+            f = boost::format("Invalid block count or size: %1% at offset %2%") % value % offset;
+            break;
+        case badEnum:
+            f = boost::format("Enum symbol %1% out of range; there are %2%, at offset %3%") % value % limit % offset;
+            break;
+        case badUnion:
+            f = boost::format("Union branch %1% out of range; there are %2%, at offset %3%") % value % limit % offset;
+            break;
+    }
+    return boost::str(f);
+}
+
+void validateBinary(const ValidSchema &schema, InputStream &in) {
+    BinaryValidator(schema).validate(in);
+}
+
+} // namespace avro
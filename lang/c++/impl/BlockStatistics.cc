@@ -0,0 +1,460 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BlockStatistics.hh"
+#include "Compiler.hh"
+#include "DataFile.hh"
+#include "Decoder.hh"
+#include "Exception.hh"
+#include "Generic.hh"
+#include "NodeImpl.hh"
+#include "Specific.hh"
+
+#include <cmath>
+
+namespace avro {
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+const char *const statisticsSchema = R"({
+    "type": "record",
+    "name": "BlockStatistics",
+    "namespace": "org.apache.avro.file",
+    "fields": [
+        {"name": "offset", "type": "long"},
+        {"name": "objectCount", "type": "long"},
+        {"name": "fields", "type": {"type": "array", "items": {
+            "type": "record",
+            "name": "FieldStatistics",
+            "fields": [
+                {"name": "name", "type": "string"},
+                {"name": "min", "type": ["null", "long", "double", "string"]},
+                {"name": "max", "type": ["null", "long", "double", "string"]}
+            ]
+        }}}
+    ]
+})";
+
+const ValidSchema &sidecarSchema() {
+    static const ValidSchema schema = compileJsonSchemaFromString(statisticsSchema);
+    return schema;
+}
+
+/**
+ * Orders two non-null values, converting between long and double.
+ */
+int compare(const GenericDatum &a, const GenericDatum &b) {
+    if (a.type() == AVRO_STRING || b.type() == AVRO_STRING) {
+        if (a.type() != b.type()) {
+            throw Exception("Cannot compare a string with a number");
+        }
+        return a.value<string>().compare(b.value<string>());
+    }
+    if (a.type() == AVRO_LONG && b.type() == AVRO_LONG) {
+        int64_t x = a.value<int64_t>();
+        int64_t y = b.value<int64_t>();
+        return x < y ? -1 : (y < x ? 1 : 0);
+    }
+    auto asDouble = [](const GenericDatum &d) {
+        switch (d.type()) {
+            case AVRO_LONG:
+                return static_cast<double>(d.value<int64_t>());
+            case AVRO_INT:
+                return static_cast<double>(d.value<int32_t>());
+            case AVRO_FLOAT:
+                return static_cast<double>(d.value<float>());
+            case AVRO_DOUBLE:
+                return d.value<double>();
+            default:
+                throw Exception(boost::format("Cannot compare a value of type %1%") % d.type());
+        }
+    };
+    double x = asDouble(a);
+    double y = asDouble(b);
+    return x < y ? -1 : (y < x ? 1 : 0);
+}
+
+/**
+ * Widens a bound given as an int to the long the statistics hold.
+ */
+GenericDatum widen(const GenericDatum &d) {
+    if (d.type() == AVRO_INT) {
+        return GenericDatum(static_cast<int64_t>(d.value<int32_t>()));
+    }
+    return d;
+}
+
+NodePtr resolved(const NodePtr &n) {
+    return n->type() == AVRO_SYMBOLIC ? resolveSymbol(n) : n;
+}
+
+void skip(Decoder &d, const NodePtr &n) {
+    switch (n->type()) {
+        case AVRO_NULL:
+            d.decodeNull();
+            break;
+        case AVRO_BOOL:
+            d.decodeBool();
+            break;
+        case AVRO_INT:
+            d.decodeInt();
+            break;
+        case AVRO_LONG:
+            d.decodeLong();
+            break;
+        case AVRO_FLOAT:
+            d.decodeFloat();
+            break;
+        case AVRO_DOUBLE:
+            d.decodeDouble();
+            break;
+        case AVRO_STRING:
+            d.skipString();
+            break;
+        case AVRO_BYTES:
+            d.skipBytes();
+            break;
+        case AVRO_FIXED:
+            d.skipFixed(n->fixedSize());
+            break;
+        case AVRO_ENUM:
+            d.decodeEnum();
+            break;
+        case AVRO_RECORD:
+            for (size_t i = 0; i < n->leaves(); ++i) {
+                skip(d, n->leafAt(i));
+            }
+            break;
+        case AVRO_ARRAY:
+            for (size_t m = d.skipArray(); m != 0; m = d.skipArray()) {
+                for (size_t i = 0; i < m; ++i) {
+                    skip(d, n->leafAt(0));
+                }
+            }
+            break;
+        case AVRO_MAP:
+            for (size_t m = d.skipMap(); m != 0; m = d.skipMap()) {
+                for (size_t i = 0; i < m; ++i) {
+                    d.skipString();
+                    skip(d, n->leafAt(1));
+                }
+            }
+            break;
+        case AVRO_UNION:
+            skip(d, n->leafAt(d.decodeUnionIndex()));
+            break;
+        case AVRO_SYMBOLIC:
+            skip(d, resolveSymbol(n));
+            break;
+        default:
+            throw Exception(boost::format("Cannot skip a value of type %1%") % n->type());
+    }
+}
+
+} // namespace
+
+const FieldStatistics *BlockStatistics::field(const string &name) const {
+    for (const auto &f : fields) {
+        if (f.name == name) {
+            return &f;
+        }
+    }
+    return nullptr;
+}
+
+bool BlockStatistics::overlaps(const string &name,
+                               const GenericDatum &lo, const GenericDatum &hi) const {
+    const FieldStatistics *f = field(name);
+    if (f == nullptr) {
+        return true;
+    }
+    if (f->min.type() == AVRO_NULL) {
+        // Every value was null, and null lies in no range.
+        return false;
+    }
+    if (lo.type() != AVRO_NULL && compare(f->max, widen(lo)) < 0) {
+        return false;
+    }
+    if (hi.type() != AVRO_NULL && compare(f->min, widen(hi)) > 0) {
+        return false;
+    }
+    return true;
+}
+
+struct BlockStatisticsCollector::Plan {
+    struct Tracked {
+        string name;
+        Type type;
+        // The branch holding null for nullable fields, -1 otherwise.
+        int64_t nullBranch;
+    };
+
+    NodePtr root;
+    // For each leaf of the root, its index in tracked or -1.
+    vector<int> slots;
+    vector<Tracked> tracked;
+};
+
+BlockStatisticsCollector::BlockStatisticsCollector(const ValidSchema &schema,
+                                                   const vector<string> &fields) : plan_(std::make_shared<Plan>()) {
+    Plan &p = *plan_;
+    p.root = resolved(schema.root());
+    if (p.root->type() != AVRO_RECORD) {
+        throw Exception("Block statistics need a record schema");
+    }
+    p.slots.assign(p.root->leaves(), -1);
+    for (const auto &name : fields) {
+        size_t pos = 0;
+        if (!p.root->nameIndex(name, pos)) {
+            throw Exception(boost::format("No field named %1% for block statistics") % name);
+        }
+        if (p.slots[pos] != -1) {
+            throw Exception(boost::format("Field %1% given twice for block statistics") % name);
+        }
+        NodePtr n = resolved(p.root->leafAt(pos));
+        int64_t nullBranch = -1;
+        if (n->type() == AVRO_UNION && n->leaves() == 2) {
+            for (size_t i = 0; i < 2; ++i) {
+                if (n->leafAt(i)->type() == AVRO_NULL) {
+                    nullBranch = static_cast<int64_t>(i);
+                    n = resolved(n->leafAt(1 - i));
+                    break;
+                }
+            }
+        }
+        switch (n->type()) {
+            case AVRO_INT:
+            case AVRO_LONG:
+            case AVRO_FLOAT:
+            case AVRO_DOUBLE:
+            case AVRO_STRING:
+                break;
+            default:
+                throw Exception(boost::format("Cannot keep block statistics of field %1% of type %2%")
+                                % name % n->type());
+        }
+        p.slots[pos] = static_cast<int>(p.tracked.size());
+        p.tracked.push_back(Plan::Tracked{name, n->type(), nullBranch});
+    }
+}
+
+BlockStatistics BlockStatisticsCollector::collect(const uint8_t *data, size_t len,
+                                                  int64_t objectCount) const {
+    const Plan &p = *plan_;
+    BlockStatistics result;
+    result.objectCount = objectCount;
+    result.fields.resize(p.tracked.size());
+    for (size_t i = 0; i < p.tracked.size(); ++i) {
+        result.fields[i].name = p.tracked[i].name;
+    }
+
+    unique_ptr<InputStream> in = memoryInputStream(data, len);
+    DecoderPtr d = binaryDecoder();
+    d->init(*in);
+    string s;
+    for (int64_t k = 0; k < objectCount; ++k) {
+        for (size_t i = 0; i < p.slots.size(); ++i) {
+            if (p.slots[i] < 0) {
+                skip(*d, p.root->leafAt(i));
+                continue;
+            }
+            const Plan::Tracked &t = p.tracked[p.slots[i]];
+            if (t.nullBranch >= 0 && static_cast<int64_t>(d->decodeUnionIndex()) == t.nullBranch) {
+                d->decodeNull();
+                continue;
+            }
+            GenericDatum v;
+            switch (t.type) {
+                case AVRO_INT:
+                    v = GenericDatum(static_cast<int64_t>(d->decodeInt()));
+                    break;
+                case AVRO_LONG:
+                    v = GenericDatum(d->decodeLong());
+                    break;
+                case AVRO_FLOAT:
+                    v = GenericDatum(static_cast<double>(d->decodeFloat()));
+                    break;
+                case AVRO_DOUBLE:
+                    v = GenericDatum(d->decodeDouble());
+                    break;
+                default:
+                    d->decodeString(s);
+                    v = GenericDatum(s);
+                    break;
+            }
+            if (v.type() == AVRO_DOUBLE && std::isnan(v.value<double>())) {
+                // NaN is unordered; leave it out of the range.
+                continue;
+            }
+            FieldStatistics &f = result.fields[p.slots[i]];
+            if (f.min.type() == AVRO_NULL) {
+                f.min = v;
+                f.max = v;
+            } else if (compare(v, f.min) < 0) {
+                f.min = v;
+            } else if (compare(f.max, v) < 0) {
+                f.max = v;
+            }
+        }
+    }
+    return result;
+}
+
+struct RecordFilter::Plan {
+    NodePtr root;
+    // For each leaf of the root, the index of its value or -1.
+    vector<int> slots;
+    // Reused from record to record.
+    mutable vector<GenericDatum> values;
+    RecordPredicate predicate;
+};
+
+RecordFilter::RecordFilter(const ValidSchema &schema, const vector<string> &fields,
+                           RecordPredicate predicate) : plan_(std::make_shared<Plan>()) {
+    Plan &p = *plan_;
+    p.root = resolved(schema.root());
+    if (p.root->type() != AVRO_RECORD) {
+        throw Exception("A record filter needs a record schema");
+    }
+    if (!predicate) {
+        throw Exception("A record filter needs a predicate");
+    }
+    p.slots.assign(p.root->leaves(), -1);
+    for (const auto &name : fields) {
+        size_t pos = 0;
+        if (!p.root->nameIndex(name, pos)) {
+            throw Exception(boost::format("No field named %1% to filter on") % name);
+        }
+        if (p.slots[pos] != -1) {
+            throw Exception(boost::format("Field %1% given twice to filter on") % name);
+        }
+        p.slots[pos] = static_cast<int>(p.values.size());
+        p.values.emplace_back(p.root->leafAt(pos));
+    }
+    p.predicate = std::move(predicate);
+}
+
+bool RecordFilter::accept(Decoder &d) const {
+    const Plan &p = *plan_;
+    for (size_t i = 0; i < p.slots.size(); ++i) {
+        if (p.slots[i] < 0) {
+            skip(d, p.root->leafAt(i));
+        } else {
+            GenericReader::readInPlace(d, p.values[p.slots[i]]);
+        }
+    }
+    return p.predicate(p.values);
+}
+
+template<>
+struct codec_traits<FieldStatistics> {
+    static void encodeValue(Encoder &e, const GenericDatum &v) {
+        switch (v.type()) {
+            case AVRO_NULL:
+                e.encodeUnionIndex(0);
+                e.encodeNull();
+                break;
+            case AVRO_LONG:
+                e.encodeUnionIndex(1);
+                e.encodeLong(v.value<int64_t>());
+                break;
+            case AVRO_DOUBLE:
+                e.encodeUnionIndex(2);
+                e.encodeDouble(v.value<double>());
+                break;
+            case AVRO_STRING:
+                e.encodeUnionIndex(3);
+                e.encodeString(v.value<string>());
+                break;
+            default:
+                throw Exception(boost::format("Invalid block statistics value of type %1%") % v.type());
+        }
+    }
+
+    static GenericDatum decodeValue(Decoder &d) {
+        switch (d.decodeUnionIndex()) {
+            case 0:
+                d.decodeNull();
+                return GenericDatum();
+            case 1:
+                return GenericDatum(d.decodeLong());
+            case 2:
+                return GenericDatum(d.decodeDouble());
+            case 3:
+                return GenericDatum(d.decodeString());
+            default:
+                throw Exception("Invalid union branch in block statistics");
+        }
+    }
+
+    static void encode(Encoder &e, const FieldStatistics &f) {
+        e.encodeString(f.name);
+        encodeValue(e, f.min);
+        encodeValue(e, f.max);
+    }
+
+    static void decode(Decoder &d, FieldStatistics &f) {
+        d.decodeString(f.name);
+        f.min = decodeValue(d);
+        f.max = decodeValue(d);
+    }
+};
+
+template<>
+struct codec_traits<BlockStatistics> {
+    static void encode(Encoder &e, const BlockStatistics &b) {
+        avro::encode(e, b.offset);
+        avro::encode(e, b.objectCount);
+        avro::encode(e, b.fields);
+    }
+
+    static void decode(Decoder &d, BlockStatistics &b) {
+        avro::decode(d, b.offset);
+        avro::decode(d, b.objectCount);
+        avro::decode(d, b.fields);
+    }
+};
+
+void writeBlockStatistics(unique_ptr<OutputStream> out, const vector<BlockStatistics> &stats) {
+    DataFileWriter<BlockStatistics> writer(std::move(out), sidecarSchema());
+    for (const auto &b : stats) {
+        writer.write(b);
+    }
+    writer.close();
+}
+
+vector<BlockStatistics> readBlockStatistics(unique_ptr<InputStream> in) {
+    DataFileReader<BlockStatistics> reader(std::move(in));
+    vector<BlockStatistics> result;
+    BlockStatistics b;
+    while (reader.read(b)) {
+        result.push_back(std::move(b));
+        b = BlockStatistics();
+    }
+    return result;
+}
+
+vector<BlockStatistics> readBlockStatistics(const string &filename) {
+    return readBlockStatistics(fileInputStream(filename.c_str()));
+}
+
+} // namespace avro
@@ -0,0 +1,120 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "buffer/detail/BufferDetail.hh"
+
+#include <new>
+
+namespace avro {
+namespace detail {
+
+namespace {
+
+// The sizes blocks are rounded up to; larger blocks are not pooled.
+const size_type kBlockSizes[] = {kMinBlockSize, 2 * kMinBlockSize, kMaxBlockSize};
+const size_t kSizeClasses = sizeof(kBlockSizes) / sizeof(kBlockSizes[0]);
+
+// The most blocks a thread keeps of each size.
+const size_t kMaxFreeBlocks = 64;
+
+struct FreeList {
+    Block *head;
+    size_t count;
+};
+
+// Plain data, so that it is usable, and zero, however late in the life of
+// the thread a buffer is released.
+struct Pool {
+    FreeList lists[kSizeClasses];
+    bool closed;
+};
+
+thread_local Pool pool;
+
+void drain(Pool &p) {
+    for (FreeList &list : p.lists) {
+        while (Block *b = list.head) {
+            list.head = b->next;
+            ::operator delete(b);
+        }
+        list.count = 0;
+    }
+}
+
+// Frees the free lists when the thread ends. Buffers released later, by
+// destructors that run after this one, free their blocks directly.
+struct PoolCloser {
+    ~PoolCloser() {
+        drain(pool);
+        pool.closed = true;
+    }
+};
+
+thread_local PoolCloser closer;
+
+size_t sizeClass(size_type size) {
+    size_t c = 0;
+    while (c < kSizeClasses && kBlockSizes[c] < size) {
+        ++c;
+    }
+    return c;
+}
+
+} // namespace
+
+Block *allocateBlock(size_type size) {
+    size_t c = sizeClass(size);
+    if (c < kSizeClasses) {
+        FreeList &list = pool.lists[c];
+        if (Block *b = list.head) {
+            list.head = b->next;
+            --list.count;
+            b->refs.store(1, std::memory_order_relaxed);
+            return b;
+        }
+        size = kBlockSizes[c];
+    }
+    Block *b = static_cast<Block *>(::operator new(sizeof(Block) + size));
+    new (&b->refs) std::atomic<long>(1);
+    b->size = size;
+    b->next = nullptr;
+    return b;
+}
+
+void releaseBlock(Block *block) {
+    size_t c = sizeClass(block->size);
+    if (c < kSizeClasses && kBlockSizes[c] == block->size && !pool.closed) {
+        // Makes sure the lists are freed when the thread ends.
+        (void) &closer;
+        FreeList &list = pool.lists[c];
+        if (list.count < kMaxFreeBlocks) {
+            block->next = list.head;
+            list.head = block;
+            ++list.count;
+            return;
+        }
+    }
+    ::operator delete(block);
+}
+
+void trimBlockPool() {
+    drain(pool);
+}
+
+} // namespace detail
+} // namespace avro
@@ -0,0 +1,849 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Codec.hh"
+#include "Crc32.hh"
+#include "Exception.hh"
+
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <mutex>
+
+#include <zlib.h>
+
+#ifdef SNAPPY_CODEC_AVAILABLE
+#include <snappy.h>
+#endif
+
+#ifdef ZSTD_CODEC_AVAILABLE
+#include <zdict.h>
+#include <zstd.h>
+#endif
+
+#ifdef XZ_CODEC_AVAILABLE
+#include <lzma.h>
+#endif
+
+#ifdef LZ4_CODEC_AVAILABLE
+#include <lz4.h>
+#include <lz4frame.h>
+#endif
+
+namespace avro {
+
+BlockCompressor::~BlockCompressor() = default;
+
+BlockDecompressor::~BlockDecompressor() = default;
+
+void BlockDecompressor::setChecksumVerification(bool) {}
+
+BlockCodec::~BlockCodec() = default;
+
+int BlockCodec::defaultLevel() const {
+    return 0;
+}
+
+void BlockCodec::checkLevel(int) const {
+    throw Exception("Compression level is not supported by the codec");
+}
+
+void BlockCodec::addMetadata(std::map<std::string, std::vector<uint8_t>> &) const {}
+
+const char *const ZSTD_DICTIONARY_KEY = "zstandard.dictionary";
+
+namespace {
+
+class NullCompressor : public BlockCompressor {
+public:
+    size_t compress(const uint8_t *in, size_t len, int, std::vector<char> &out) override {
+        if (out.size() < len) {
+            out.resize(len);
+        }
+        std::copy(in, in + len, out.begin());
+        return len;
+    }
+};
+
+class NullDecompressor : public BlockDecompressor {
+public:
+    size_t decompress(const uint8_t *in, size_t len, std::vector<uint8_t> &out) override {
+        if (out.size() < len) {
+            out.resize(len);
+        }
+        std::copy(in, in + len, out.begin());
+        return len;
+    }
+};
+
+class NullCodec : public BlockCodec {
+public:
+    std::string name() const override { return "null"; }
+
+    std::unique_ptr<BlockCompressor> newCompressor() const override {
+        return std::unique_ptr<BlockCompressor>(new NullCompressor());
+    }
+
+    std::unique_ptr<BlockDecompressor> newDecompressor() const override {
+        return std::unique_ptr<BlockDecompressor>(new NullDecompressor());
+    }
+};
+
+const int defaultDeflateLevel = 6;
+
+// Raw deflate, without the zlib header, as the specification asks.
+class DeflateCompressor : public BlockCompressor {
+    z_stream zlib_;
+    int level_;
+
+public:
+    DeflateCompressor() : zlib_(), level_(defaultDeflateLevel) {
+        if (deflateInit2(&zlib_, level_, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw Exception("Cannot create deflate compression context");
+        }
+    }
+
+    ~DeflateCompressor() override {
+        deflateEnd(&zlib_);
+    }
+
+    size_t compress(const uint8_t *in, size_t len, int level, std::vector<char> &out) override {
+        deflateReset(&zlib_);
+        if (level != level_) {
+            deflateParams(&zlib_, level, Z_DEFAULT_STRATEGY);
+            level_ = level;
+        }
+        size_t bound = deflateBound(&zlib_, len);
+        if (out.size() < bound) {
+            out.resize(bound);
+        }
+        zlib_.next_in = const_cast<Bytef *>(in);
+        zlib_.avail_in = static_cast<uInt>(len);
+        zlib_.next_out = reinterpret_cast<Bytef *>(out.data());
+        zlib_.avail_out = static_cast<uInt>(out.size());
+        int r = deflate(&zlib_, Z_FINISH);
+        if (r != Z_STREAM_END) {
+            throw Exception(boost::format("Deflate compression failed: %1%") % r);
+        }
+        return zlib_.total_out;
+    }
+};
+
+class DeflateDecompressor : public BlockDecompressor {
+    z_stream zlib_;
+
+public:
+    DeflateDecompressor() : zlib_() {
+        if (inflateInit2(&zlib_, -MAX_WBITS) != Z_OK) {
+            throw Exception("Cannot create deflate decompression context");
+        }
+    }
+
+    ~DeflateDecompressor() override {
+        inflateEnd(&zlib_);
+    }
+
+    size_t decompress(const uint8_t *in, size_t len, std::vector<uint8_t> &out) override {
+        inflateReset(&zlib_);
+        zlib_.next_in = const_cast<Bytef *>(in);
+        zlib_.avail_in = static_cast<uInt>(len);
+        size_t used = 0;
+        for (;;) {
+            if (out.size() - used < 8 * 1024) {
+                out.resize(std::max(2 * out.size(), used + 8 * 1024));
+            }
+            uInt avail = static_cast<uInt>(std::min<size_t>(out.size() - used, UINT_MAX));
+            zlib_.next_out = out.data() + used;
+            zlib_.avail_out = avail;
+            int r = inflate(&zlib_, Z_NO_FLUSH);
+            used += avail - zlib_.avail_out;
+            if (r == Z_STREAM_END) {
+                return used;
+            } else if (r == Z_BUF_ERROR && zlib_.avail_out != 0) {
+                throw Exception("Deflate block is truncated");
+            } else if (r != Z_OK && r != Z_BUF_ERROR) {
+                throw Exception(boost::format("Deflate decompression failed: %1%") % r);
+            }
+        }
+    }
+};
+
+class DeflateCodec : public BlockCodec {
+public:
+    std::string name() const override { return "deflate"; }
+
+    int defaultLevel() const override { return defaultDeflateLevel; }
+
+    void checkLevel(int level) const override {
+        if (level < 0 || level > 9) {
+            throw Exception(boost::format("Invalid deflate compression level: %1%") % level);
+        }
+    }
+
+    std::unique_ptr<BlockCompressor> newCompressor() const override {
+        return std::unique_ptr<BlockCompressor>(new DeflateCompressor());
+    }
+
+    std::unique_ptr<BlockDecompressor> newDecompressor() const override {
+        return std::unique_ptr<BlockDecompressor>(new DeflateDecompressor());
+    }
+};
+
+#ifdef SNAPPY_CODEC_AVAILABLE
+// Snappy blocks end with the big-endian CRC-32 of the uncompressed data.
+class SnappyCompressor : public BlockCompressor {
+public:
+    size_t compress(const uint8_t *in, size_t len, int, std::vector<char> &out) override {
+        size_t bound = snappy::MaxCompressedLength(len) + 4;
+        if (out.size() < bound) {
+            out.resize(bound);
+        }
+        size_t n;
+        snappy::RawCompress(reinterpret_cast<const char *>(in), len, out.data(), &n);
+
+        uint32_t checksum = crc32(in, len);
+        out[n++] = static_cast<char>((checksum >> 24) & 0xFF);
+        out[n++] = static_cast<char>((checksum >> 16) & 0xFF);
+        out[n++] = static_cast<char>((checksum >> 8) & 0xFF);
+        out[n++] = static_cast<char>(checksum & 0xFF);
+        return n;
+    }
+};
+
+class SnappyDecompressor : public BlockDecompressor {
+    bool verify_ = true;
+
+public:
+    void setChecksumVerification(bool verify) override {
+        verify_ = verify;
+    }
+
+    size_t decompress(const uint8_t *in, size_t len, std::vector<uint8_t> &out) override {
+        if (len < 4) {
+            throw Exception("Snappy block is too short");
+        }
+        const char *compressed = reinterpret_cast<const char *>(in);
+        uint32_t checksum = (static_cast<uint32_t>(in[len - 4]) << 24)
+            | (static_cast<uint32_t>(in[len - 3]) << 16)
+            | (static_cast<uint32_t>(in[len - 2]) << 8)
+            | static_cast<uint32_t>(in[len - 1]);
+        size_t n;
+        if (!snappy::GetUncompressedLength(compressed, len - 4, &n)) {
+            throw Exception(
+                "Snappy Compression reported an error when decompressing");
+        }
+        if (out.size() < n) {
+            out.resize(n);
+        }
+        if (!snappy::RawUncompress(compressed, len - 4, reinterpret_cast<char *>(out.data()))) {
+            throw Exception(
+                "Snappy Compression reported an error when decompressing");
+        }
+        if (!verify_) {
+            return n;
+        }
+        uint32_t c = crc32(out.data(), n);
+        if (checksum != c) {
+            throw Exception(
+                boost::format("Checksum did not match for Snappy compression: Expected: %1%, computed: %2%") % checksum
+                % c);
+        }
+        return n;
+    }
+};
+
+class SnappyCodec : public BlockCodec {
+public:
+    std::string name() const override { return "snappy"; }
+
+    std::unique_ptr<BlockCompressor> newCompressor() const override {
+        return std::unique_ptr<BlockCompressor>(new SnappyCompressor());
+    }
+
+    std::unique_ptr<BlockDecompressor> newDecompressor() const override {
+        return std::unique_ptr<BlockDecompressor>(new SnappyDecompressor());
+    }
+};
+#endif
+
+#ifdef ZSTD_CODEC_AVAILABLE
+const int defaultZstdLevel = 3;
+
+/**
+ * A dictionary, prepared once for decompression and once for every level
+ * it compresses at, for the compressors and decompressors of a codec to
+ * share.
+ */
+class ZstdDictionary {
+    const std::vector<uint8_t> bytes_;
+    std::shared_ptr<ZSTD_DDict> ddict_;
+    std::mutex mutex_;
+    std::map<int, std::shared_ptr<ZSTD_CDict>> cdicts_;
+
+public:
+    explicit ZstdDictionary(const std::vector<uint8_t> &bytes)
+        : bytes_(bytes), ddict_(ZSTD_createDDict(bytes_.data(), bytes_.size()), ZSTD_freeDDict) {
+        if (bytes_.empty() || !ddict_) {
+            throw Exception("Invalid zstandard dictionary");
+        }
+    }
+
+    const std::vector<uint8_t> &bytes() const { return bytes_; }
+
+    const ZSTD_DDict *decompression() const { return ddict_.get(); }
+
+    std::shared_ptr<ZSTD_CDict> compression(int level) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::shared_ptr<ZSTD_CDict> &result = cdicts_[level];
+        if (!result) {
+            result.reset(ZSTD_createCDict(bytes_.data(), bytes_.size(), level), ZSTD_freeCDict);
+            if (!result) {
+                cdicts_.erase(level);
+                throw Exception("Cannot prepare the zstandard dictionary");
+            }
+        }
+        return result;
+    }
+};
+
+class ZstdCompressor : public BlockCompressor {
+    ZSTD_CCtx *zstd_;
+    const std::shared_ptr<ZstdDictionary> dictionary_;
+    // The dictionary prepared for the level of the last block.
+    std::shared_ptr<ZSTD_CDict> cdict_;
+    int cdictLevel_;
+
+public:
+    explicit ZstdCompressor(std::shared_ptr<ZstdDictionary> dictionary = nullptr)
+        : zstd_(ZSTD_createCCtx()), dictionary_(std::move(dictionary)), cdictLevel_(0) {
+        if (zstd_ == nullptr) {
+            throw Exception("Cannot create zstandard compression context");
+        }
+    }
+
+    ~ZstdCompressor() override {
+        ZSTD_freeCCtx(zstd_);
+    }
+
+    size_t compress(const uint8_t *in, size_t len, int level, std::vector<char> &out) override {
+        size_t bound = ZSTD_compressBound(len);
+        if (out.size() < bound) {
+            out.resize(bound);
+        }
+        size_t r;
+        if (dictionary_) {
+            if (!cdict_ || cdictLevel_ != level) {
+                cdict_ = dictionary_->compression(level);
+                cdictLevel_ = level;
+            }
+            r = ZSTD_compress_usingCDict(zstd_, out.data(), out.size(), in, len, cdict_.get());
+        } else {
+            ZSTD_CCtx_reset(zstd_, ZSTD_reset_session_only);
+            ZSTD_CCtx_setParameter(zstd_, ZSTD_c_compressionLevel, level);
+            r = ZSTD_compress2(zstd_, out.data(), out.size(), in, len);
+        }
+        if (ZSTD_isError(r)) {
+            throw Exception(boost::format("Zstandard compression failed: %1%") % ZSTD_getErrorName(r));
+        }
+        return r;
+    }
+};
+
+class ZstdDecompressor : public BlockDecompressor {
+    ZSTD_DCtx *zstd_;
+    const std::shared_ptr<ZstdDictionary> dictionary_;
+
+public:
+    explicit ZstdDecompressor(std::shared_ptr<ZstdDictionary> dictionary = nullptr)
+        : zstd_(ZSTD_createDCtx()), dictionary_(std::move(dictionary)) {
+        if (zstd_ == nullptr) {
+            throw Exception("Cannot create zstandard decompression context");
+        }
+        // Resetting the session keeps the dictionary for every block.
+        if (dictionary_) {
+            ZSTD_DCtx_refDDict(zstd_, dictionary_->decompression());
+        }
+    }
+
+    ~ZstdDecompressor() override {
+        ZSTD_freeDCtx(zstd_);
+    }
+
+    size_t decompress(const uint8_t *in, size_t len, std::vector<uint8_t> &out) override {
+        // Writers that stream their input need not record the size of
+        // the frame, so be prepared to grow the output.
+        unsigned long long size = ZSTD_getFrameContentSize(in, len);
+        if (size == ZSTD_CONTENTSIZE_ERROR) {
+            throw Exception("Not a zstandard frame");
+        }
+        if (size != ZSTD_CONTENTSIZE_UNKNOWN && out.size() < size) {
+            out.resize(static_cast<size_t>(size));
+        }
+        ZSTD_DCtx_reset(zstd_, ZSTD_reset_session_only);
+        ZSTD_inBuffer i = {in, len, 0};
+        size_t used = 0;
+        size_t r;
+        do {
+            if (out.size() == used) {
+                out.resize(used + ZSTD_DStreamOutSize());
+            }
+            ZSTD_outBuffer o = {out.data() + used, out.size() - used, 0};
+            r = ZSTD_decompressStream(zstd_, &o, &i);
+            if (ZSTD_isError(r)) {
+                throw Exception(boost::format("Zstandard decompression failed: %1%") % ZSTD_getErrorName(r));
+            }
+            used += o.pos;
+            if (r != 0 && i.pos == i.size && o.pos < o.size) {
+                throw Exception("Truncated zstandard frame");
+            }
+        } while (r != 0);
+        return used;
+    }
+};
+
+class ZstdCodec : public BlockCodec {
+public:
+    std::string name() const override { return "zstandard"; }
+
+    int defaultLevel() const override { return defaultZstdLevel; }
+
+    void checkLevel(int level) const override {
+        if (level < ZSTD_minCLevel() || level > ZSTD_maxCLevel()) {
+            throw Exception(boost::format("Invalid zstandard compression level: %1%. "
+                                          "Should be between %2% and %3%")
+                            % level % ZSTD_minCLevel() % ZSTD_maxCLevel());
+        }
+    }
+
+    std::unique_ptr<BlockCompressor> newCompressor() const override {
+        return std::unique_ptr<BlockCompressor>(new ZstdCompressor());
+    }
+
+    std::unique_ptr<BlockDecompressor> newDecompressor() const override {
+        return std::unique_ptr<BlockDecompressor>(new ZstdDecompressor());
+    }
+};
+
+class ZstdDictionaryCodec : public ZstdCodec {
+    const std::shared_ptr<ZstdDictionary> dictionary_;
+
+public:
+    explicit ZstdDictionaryCodec(const std::vector<uint8_t> &dictionary)
+        : dictionary_(std::make_shared<ZstdDictionary>(dictionary)) {}
+
+    std::unique_ptr<BlockCompressor> newCompressor() const override {
+        return std::unique_ptr<BlockCompressor>(new ZstdCompressor(dictionary_));
+    }
+
+    std::unique_ptr<BlockDecompressor> newDecompressor() const override {
+        return std::unique_ptr<BlockDecompressor>(new ZstdDecompressor(dictionary_));
+    }
+
+    void addMetadata(std::map<std::string, std::vector<uint8_t>> &metadata) const override {
+        metadata[ZSTD_DICTIONARY_KEY] = dictionary_->bytes();
+    }
+};
+#endif
+
+#ifdef XZ_CODEC_AVAILABLE
+const int defaultXzLevel = 6;
+
+void checkXzLevel(int level) {
+    if (level < 0 || level > 9) {
+        throw Exception(boost::format("Invalid xz compression level: %1%") % level);
+    }
+}
+
+/**
+ * Holds an lzma_stream from one block to the next. Setting up a coder of
+ * the same kind on a stream again reuses the memory of the last one.
+ */
+class LzmaStream {
+protected:
+    lzma_stream lzma_;
+
+    LzmaStream() : lzma_() {}
+
+    ~LzmaStream() {
+        lzma_end(&lzma_);
+    }
+
+    size_t encode(const uint8_t *in, size_t len, std::vector<char> &out) {
+        size_t bound = lzma_stream_buffer_bound(len);
+        if (out.size() < bound) {
+            out.resize(bound);
+        }
+        lzma_.next_in = in;
+        lzma_.avail_in = len;
+        lzma_.next_out = reinterpret_cast<uint8_t *>(out.data());
+        lzma_.avail_out = out.size();
+        lzma_ret r = lzma_code(&lzma_, LZMA_FINISH);
+        if (r != LZMA_STREAM_END) {
+            throw Exception(boost::format("xz compression failed: %1%") % r);
+        }
+        return out.size() - lzma_.avail_out;
+    }
+
+    size_t decode(const uint8_t *in, size_t len, std::vector<uint8_t> &out) {
+        lzma_.next_in = in;
+        lzma_.avail_in = len;
+        size_t used = 0;
+        for (;;) {
+            if (out.size() - used < 8 * 1024) {
+                out.resize(std::max(2 * out.size(), used + 8 * 1024));
+            }
+            size_t avail = out.size() - used;
+            lzma_.next_out = out.data() + used;
+            lzma_.avail_out = avail;
+            lzma_ret r = lzma_code(&lzma_, LZMA_FINISH);
+            used += avail - lzma_.avail_out;
+            if (r == LZMA_STREAM_END) {
+                return used;
+            } else if (r == LZMA_BUF_ERROR) {
+                throw Exception("xz block is truncated");
+            } else if (r != LZMA_OK) {
+                throw Exception(boost::format("xz decompression failed: %1%") % r);
+            }
+        }
+    }
+};
+
+// Blocks in the .xz container format, as the specification asks.
+class XzCompressor : public BlockCompressor, LzmaStream {
+public:
+    size_t compress(const uint8_t *in, size_t len, int level, std::vector<char> &out) override {
+        if (lzma_easy_encoder(&lzma_, static_cast<uint32_t>(level), LZMA_CHECK_CRC64) != LZMA_OK) {
+            throw Exception("Cannot create xz compression context");
+        }
+        return encode(in, len, out);
+    }
+};
+
+class XzDecompressor : public BlockDecompressor, LzmaStream {
+    bool verify_ = true;
+
+public:
+    void setChecksumVerification(bool verify) override {
+        verify_ = verify;
+    }
+
+    size_t decompress(const uint8_t *in, size_t len, std::vector<uint8_t> &out) override {
+        uint32_t flags = 0;
+#ifdef LZMA_IGNORE_CHECK
+        if (!verify_) {
+            flags |= LZMA_IGNORE_CHECK;
+        }
+#endif
+        if (lzma_stream_decoder(&lzma_, UINT64_MAX, flags) != LZMA_OK) {
+            throw Exception("Cannot create xz decompression context");
+        }
+        return decode(in, len, out);
+    }
+};
+
+class XzCodec : public BlockCodec {
+public:
+    std::string name() const override { return "xz"; }
+
+    int defaultLevel() const override { return defaultXzLevel; }
+
+    void checkLevel(int level) const override {
+        checkXzLevel(level);
+    }
+
+    std::unique_ptr<BlockCompressor> newCompressor() const override {
+        return std::unique_ptr<BlockCompressor>(new XzCompressor());
+    }
+
+    std::unique_ptr<BlockDecompressor> newDecompressor() const override {
+        return std::unique_ptr<BlockDecompressor>(new XzDecompressor());
+    }
+};
+
+// The C library's lzma codec writes raw LZMA2 data, without the .xz
+// container, and reads it with the dictionary of the default preset. The
+// dictionary is capped at that size so that it can read ours too.
+class LzmaCompressor : public BlockCompressor, LzmaStream {
+public:
+    size_t compress(const uint8_t *in, size_t len, int level, std::vector<char> &out) override {
+        lzma_options_lzma options;
+        lzma_lzma_preset(&options, static_cast<uint32_t>(level));
+        options.dict_size = std::min<uint32_t>(options.dict_size, LZMA_DICT_SIZE_DEFAULT);
+        const lzma_filter filters[] = {{LZMA_FILTER_LZMA2, &options}, {LZMA_VLI_UNKNOWN, nullptr}};
+        if (lzma_raw_encoder(&lzma_, filters) != LZMA_OK) {
+            throw Exception("Cannot create lzma compression context");
+        }
+        return encode(in, len, out);
+    }
+};
+
+class LzmaDecompressor : public BlockDecompressor, LzmaStream {
+public:
+    size_t decompress(const uint8_t *in, size_t len, std::vector<uint8_t> &out) override {
+        lzma_options_lzma options;
+        lzma_lzma_preset(&options, LZMA_PRESET_DEFAULT);
+        const lzma_filter filters[] = {{LZMA_FILTER_LZMA2, &options}, {LZMA_VLI_UNKNOWN, nullptr}};
+        if (lzma_raw_decoder(&lzma_, filters) != LZMA_OK) {
+            throw Exception("Cannot create lzma decompression context");
+        }
+        return decode(in, len, out);
+    }
+};
+
+class LzmaCodec : public BlockCodec {
+public:
+    std::string name() const override { return "lzma"; }
+
+    int defaultLevel() const override { return defaultXzLevel; }
+
+    void checkLevel(int level) const override {
+        checkXzLevel(level);
+    }
+
+    std::unique_ptr<BlockCompressor> newCompressor() const override {
+        return std::unique_ptr<BlockCompressor>(new LzmaCompressor());
+    }
+
+    std::unique_ptr<BlockDecompressor> newDecompressor() const override {
+        return std::unique_ptr<BlockDecompressor>(new LzmaDecompressor());
+    }
+};
+#endif
+
+#ifdef LZ4_CODEC_AVAILABLE
+// LZ4 frames that record the size of the block and a checksum of it.
+class Lz4Compressor : public BlockCompressor {
+    LZ4F_cctx *lz4_;
+
+public:
+    Lz4Compressor() : lz4_(nullptr) {
+        if (LZ4F_isError(LZ4F_createCompressionContext(&lz4_, LZ4F_VERSION))) {
+            throw Exception("Cannot create lz4 compression context");
+        }
+    }
+
+    ~Lz4Compressor() override {
+        LZ4F_freeCompressionContext(lz4_);
+    }
+
+    size_t compress(const uint8_t *in, size_t len, int level, std::vector<char> &out) override {
+        LZ4F_preferences_t prefs = LZ4F_preferences_t();
+        prefs.frameInfo.contentSize = len;
+        prefs.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+        prefs.compressionLevel = level;
+        size_t bound = LZ4F_compressFrameBound(len, &prefs);
+        if (out.size() < bound) {
+            out.resize(bound);
+        }
+        size_t n = check(LZ4F_compressBegin(lz4_, out.data(), out.size(), &prefs));
+        n += check(LZ4F_compressUpdate(lz4_, out.data() + n, out.size() - n, in, len, nullptr));
+        n += check(LZ4F_compressEnd(lz4_, out.data() + n, out.size() - n, nullptr));
+        return n;
+    }
+
+private:
+    static size_t check(size_t r) {
+        if (LZ4F_isError(r)) {
+            throw Exception(boost::format("lz4 compression failed: %1%") % LZ4F_getErrorName(r));
+        }
+        return r;
+    }
+};
+
+class Lz4Decompressor : public BlockDecompressor {
+    LZ4F_dctx *lz4_;
+    bool verify_ = true;
+
+    // Leaves the context ready for the next frame and throws.
+    void fail(const std::string &message) {
+        LZ4F_resetDecompressionContext(lz4_);
+        throw Exception(message);
+    }
+
+public:
+    Lz4Decompressor() : lz4_(nullptr) {
+        if (LZ4F_isError(LZ4F_createDecompressionContext(&lz4_, LZ4F_VERSION))) {
+            throw Exception("Cannot create lz4 decompression context");
+        }
+    }
+
+    ~Lz4Decompressor() override {
+        LZ4F_freeDecompressionContext(lz4_);
+    }
+
+    void setChecksumVerification(bool verify) override {
+        verify_ = verify;
+    }
+
+    size_t decompress(const uint8_t *in, size_t len, std::vector<uint8_t> &out) override {
+        LZ4F_frameInfo_t info = LZ4F_frameInfo_t();
+        size_t pos = len;
+        size_t r = LZ4F_getFrameInfo(lz4_, &info, in, &pos);
+        if (LZ4F_isError(r)) {
+            fail(std::string("Not an lz4 frame: ") + LZ4F_getErrorName(r));
+        }
+        // Frames from other writers need not record their size, so be
+        // prepared to grow the output.
+        if (out.size() < info.contentSize) {
+            out.resize(static_cast<size_t>(info.contentSize));
+        }
+        LZ4F_decompressOptions_t options = LZ4F_decompressOptions_t();
+#if LZ4_VERSION_NUMBER >= 10904
+        options.skipChecksums = verify_ ? 0 : 1;
+#endif
+        size_t used = 0;
+        while (r != 0) {
+            if (out.size() == used) {
+                out.resize(std::max(2 * out.size(), used + 64 * 1024));
+            }
+            size_t avail = out.size() - used;
+            size_t produced = avail;
+            size_t consumed = len - pos;
+            r = LZ4F_decompress(lz4_, out.data() + used, &produced, in + pos, &consumed, &options);
+            if (LZ4F_isError(r)) {
+                fail(std::string("lz4 decompression failed: ") + LZ4F_getErrorName(r));
+            }
+            used += produced;
+            pos += consumed;
+            if (r != 0 && pos == len && produced < avail) {
+                fail("lz4 block is truncated");
+            }
+        }
+        return used;
+    }
+};
+
+class Lz4Codec : public BlockCodec {
+public:
+    std::string name() const override { return "lz4"; }
+
+    int defaultLevel() const override { return 0; }
+
+    void checkLevel(int level) const override {
+        if (level < 0 || level > LZ4F_compressionLevel_max()) {
+            throw Exception(boost::format("Invalid lz4 compression level: %1%. "
+                                          "Should be between 0 and %2%")
+                            % level % LZ4F_compressionLevel_max());
+        }
+    }
+
+    std::unique_ptr<BlockCompressor> newCompressor() const override {
+        return std::unique_ptr<BlockCompressor>(new Lz4Compressor());
+    }
+
+    std::unique_ptr<BlockDecompressor> newDecompressor() const override {
+        return std::unique_ptr<BlockDecompressor>(new Lz4Decompressor());
+    }
+};
+#endif
+
+struct CodecRegistry {
+    std::mutex mutex;
+    std::map<std::string, BlockCodecPtr> codecs;
+
+    void add(const BlockCodecPtr &codec) {
+        codecs[codec->name()] = codec;
+    }
+
+    CodecRegistry() {
+        add(std::make_shared<NullCodec>());
+        add(std::make_shared<DeflateCodec>());
+#ifdef SNAPPY_CODEC_AVAILABLE
+        add(std::make_shared<SnappyCodec>());
+#endif
+#ifdef ZSTD_CODEC_AVAILABLE
+        add(std::make_shared<ZstdCodec>());
+#endif
+#ifdef XZ_CODEC_AVAILABLE
+        add(std::make_shared<XzCodec>());
+        add(std::make_shared<LzmaCodec>());
+#endif
+#ifdef LZ4_CODEC_AVAILABLE
+        add(std::make_shared<Lz4Codec>());
+#endif
+    }
+};
+
+CodecRegistry &codecRegistry() {
+    static CodecRegistry registry;
+    return registry;
+}
+
+} // namespace
+
+void registerCodec(const BlockCodecPtr &codec) {
+    if (!codec) {
+        throw Exception("Cannot register a null codec");
+    }
+    CodecRegistry &r = codecRegistry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.add(codec);
+}
+
+BlockCodecPtr findCodec(const std::string &name) {
+    CodecRegistry &r = codecRegistry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    std::map<std::string, BlockCodecPtr>::const_iterator it = r.codecs.find(name);
+    return it == r.codecs.end() ? BlockCodecPtr() : it->second;
+}
+
+BlockCodecPtr zstdDictionaryCodec(const std::vector<uint8_t> &dictionary) {
+#ifdef ZSTD_CODEC_AVAILABLE
+    return std::make_shared<ZstdDictionaryCodec>(dictionary);
+#else
+    (void) dictionary;
+    throw Exception("Zstandard codec is not available");
+#endif
+}
+
+std::vector<uint8_t> trainZstdDictionary(const std::vector<std::vector<uint8_t>> &samples, size_t maxSize) {
+#ifdef ZSTD_CODEC_AVAILABLE
+    std::vector<uint8_t> all;
+    std::vector<size_t> sizes;
+    sizes.reserve(samples.size());
+    for (const std::vector<uint8_t> &s : samples) {
+        all.insert(all.end(), s.begin(), s.end());
+        sizes.push_back(s.size());
+    }
+    std::vector<uint8_t> result(maxSize);
+    size_t r = ZDICT_trainFromBuffer(result.data(), result.size(), all.data(), sizes.data(),
+                                     static_cast<unsigned>(sizes.size()));
+    if (ZDICT_isError(r)) {
+        throw Exception(boost::format("Cannot train a zstandard dictionary: %1%") % ZDICT_getErrorName(r));
+    }
+    result.resize(r);
+    return result;
+#else
+    (void) samples;
+    (void) maxSize;
+    throw Exception("Zstandard codec is not available");
+#endif
+}
+
+std::vector<std::string> codecNames() {
+    CodecRegistry &r = codecRegistry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    std::vector<std::string> result;
+    for (std::map<std::string, BlockCodecPtr>::const_iterator it = r.codecs.begin();
+         it != r.codecs.end(); ++it) {
+        result.push_back(it->first);
+    }
+    return result;
+}
+
+} // namespace avro
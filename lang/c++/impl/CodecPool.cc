@@ -0,0 +1,160 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CodecPool.hh"
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace avro {
+
+namespace {
+
+template<typename T>
+class Pool {
+    const std::function<std::shared_ptr<T>()> make_;
+    const size_t capacity_;
+    // Released codecs are pointed at these, so that they do not touch the
+    // stream of their last use when initialized again.
+    const std::unique_ptr<InputStream> noInput_;
+    const std::unique_ptr<OutputStream> noOutput_;
+    mutable std::mutex mutex_;
+    std::vector<std::shared_ptr<T>> idle_;
+
+    // The deleter of the pointers acquire() hands out; it puts the codec
+    // back instead of freeing it.
+    struct Returner {
+        std::weak_ptr<Pool> pool;
+        std::shared_ptr<T> codec;
+
+        void operator()(T *) {
+            if (std::shared_ptr<Pool> p = pool.lock()) {
+                p->release(std::move(codec));
+            }
+        }
+    };
+
+    void detach(Decoder &d) {
+        d.init(*noInput_);
+    }
+
+    void detach(Encoder &e) {
+        e.init(*noOutput_);
+    }
+
+    void release(std::shared_ptr<T> codec) {
+        detach(*codec);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (idle_.size() < capacity_) {
+            idle_.push_back(std::move(codec));
+        }
+    }
+
+public:
+    Pool(std::function<std::shared_ptr<T>()> make, size_t capacity) : make_(std::move(make)),
+                                                                     capacity_(capacity),
+                                                                     noInput_(memoryInputStream(nullptr, 0)),
+                                                                     noOutput_(memoryOutputStream(1)) {}
+
+    static std::shared_ptr<T> acquire(const std::shared_ptr<Pool> &self) {
+        std::shared_ptr<T> codec;
+        {
+            std::lock_guard<std::mutex> lock(self->mutex_);
+            if (!self->idle_.empty()) {
+                codec = std::move(self->idle_.back());
+                self->idle_.pop_back();
+            }
+        }
+        if (!codec) {
+            codec = self->make_();
+        }
+        T *p = codec.get();
+        return std::shared_ptr<T>(p, Returner{self, std::move(codec)});
+    }
+
+    size_t idle() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return idle_.size();
+    }
+};
+
+} // namespace
+
+struct DecoderPool::Impl : public Pool<Decoder> {
+    Impl(std::function<DecoderPtr()> make, size_t capacity) : Pool<Decoder>(std::move(make), capacity) {}
+};
+
+DecoderPool::DecoderPool(size_t capacity) : impl_(std::make_shared<Impl>([]() { return binaryDecoder(); }, capacity)) {
+}
+
+DecoderPool::DecoderPool(const ValidSchema &schema, size_t capacity)
+    : impl_(std::make_shared<Impl>([schema]() { return validatingDecoder(schema, binaryDecoder()); }, capacity)) {
+}
+
+DecoderPool::~DecoderPool() = default;
+
+DecoderPtr DecoderPool::acquire() {
+    return Impl::acquire(impl_);
+}
+
+size_t DecoderPool::idle() const {
+    return impl_->idle();
+}
+
+struct ResolvingDecoderPool::Impl : public Pool<ResolvingDecoder> {
+    Impl(std::function<ResolvingDecoderPtr()> make, size_t capacity) : Pool<ResolvingDecoder>(std::move(make), capacity) {}
+};
+
+ResolvingDecoderPool::ResolvingDecoderPool(const ValidSchema &writer, const ValidSchema &reader, size_t capacity)
+    : impl_(std::make_shared<Impl>([writer, reader]() { return compiledResolvingDecoder(writer, reader, binaryDecoder()); },
+                                   capacity)) {
+}
+
+ResolvingDecoderPool::~ResolvingDecoderPool() = default;
+
+ResolvingDecoderPtr ResolvingDecoderPool::acquire() {
+    return Impl::acquire(impl_);
+}
+
+size_t ResolvingDecoderPool::idle() const {
+    return impl_->idle();
+}
+
+struct EncoderPool::Impl : public Pool<Encoder> {
+    Impl(std::function<EncoderPtr()> make, size_t capacity) : Pool<Encoder>(std::move(make), capacity) {}
+};
+
+EncoderPool::EncoderPool(size_t capacity) : impl_(std::make_shared<Impl>([]() { return binaryEncoder(); }, capacity)) {
+}
+
+EncoderPool::EncoderPool(const ValidSchema &schema, size_t capacity)
+    : impl_(std::make_shared<Impl>([schema]() { return validatingEncoder(schema, binaryEncoder()); }, capacity)) {
+}
+
+EncoderPool::~EncoderPool() = default;
+
+EncoderPtr EncoderPool::acquire() {
+    return Impl::acquire(impl_);
+}
+
+size_t EncoderPool::idle() const {
+    return impl_->idle();
+}
+
+} // namespace avro
@@ -0,0 +1,112 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CodecSelector.hh"
+#include "Exception.hh"
+
+#include <chrono>
+
+namespace avro {
+
+CodecSelector::CodecSelector(std::vector<CodecSetting> candidates, double maxNanosPerByte,
+                             size_t sampleEvery, size_t maxSamples)
+    : candidates_(std::move(candidates)), maxNanosPerByte_(maxNanosPerByte),
+      sampleEvery_(sampleEvery == 0 ? 1 : sampleEvery), maxSamples_(maxSamples == 0 ? 1 : maxSamples),
+      skipped_(0) {
+    if (candidates_.empty()) {
+        throw Exception("No candidate codecs given");
+    }
+    for (const CodecSetting &c : candidates_) {
+        if (!c.codec) {
+            throw Exception("No codec given");
+        }
+        if (c.level != c.codec->defaultLevel()) {
+            c.codec->checkLevel(c.level);
+        }
+    }
+}
+
+std::vector<CodecSetting> CodecSelector::defaultCandidates() {
+    std::vector<CodecSetting> result;
+    BlockCodecPtr c = findCodec("deflate");
+    for (int level = 1; c && level <= 9; ++level) {
+        result.emplace_back(c, level);
+    }
+    c = findCodec("snappy");
+    if (c) {
+        result.emplace_back(c);
+    }
+    c = findCodec("zstandard");
+    for (int level = 1; c && level <= 9; ++level) {
+        result.emplace_back(c, level);
+    }
+    result.emplace_back(findCodec("null"));
+    return result;
+}
+
+void CodecSelector::sample(const uint8_t *data, size_t len) {
+    if (skipped_++ % sampleEvery_ != 0 || len == 0) {
+        return;
+    }
+    if (samples_.size() == maxSamples_) {
+        samples_.pop_front();
+    }
+    samples_.emplace_back(data, data + len);
+}
+
+CodecSetting CodecSelector::select() {
+    if (samples_.empty()) {
+        return candidates_.front();
+    }
+    measurements_.clear();
+    std::vector<char> out;
+    for (const CodecSetting &c : candidates_) {
+        CodecMeasurement m;
+        m.setting = c;
+        std::unique_ptr<BlockCompressor> compressor = c.codec->newCompressor();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (const std::vector<uint8_t> &s : samples_) {
+            m.rawBytes += s.size();
+            m.compressedBytes += compressor->compress(s.data(), s.size(), c.level, out);
+        }
+        m.nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+        measurements_.push_back(m);
+    }
+    samples_.clear();
+    skipped_ = 0;
+
+    const CodecMeasurement *best = nullptr;
+    const CodecMeasurement *fastest = nullptr;
+    for (const CodecMeasurement &m : measurements_) {
+        if (!fastest || m.nanos < fastest->nanos) {
+            fastest = &m;
+        }
+        if (m.nanos > maxNanosPerByte_ * static_cast<double>(m.rawBytes)) {
+            continue;
+        }
+        if (!best || m.compressedBytes < best->compressedBytes ||
+            (m.compressedBytes == best->compressedBytes && m.nanos < best->nanos)) {
+            best = &m;
+        }
+    }
+    return (best ? best : fastest)->setting;
+}
+
+} // namespace avro
@@ -0,0 +1,508 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ColumnarBatch.hh"
+#include "Decoder.hh"
+#include "Encoder.hh"
+#include "NodeImpl.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <set>
+
+namespace avro {
+
+void Column::clear() {
+    length = 0;
+    nullCount = 0;
+    validity.clear();
+    values.clear();
+    offsets.clear();
+    if (type == AVRO_STRING || type == AVRO_BYTES) {
+        offsets.push_back(0);
+    }
+}
+
+int ColumnarBatch::columnIndex(const std::string &name) const {
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (columns[i].name == name) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+/**
+ * The steps that decode a row into the columns, or encode one from them,
+ * following a record schema.
+ */
+struct ColumnarProgram {
+    struct Step {
+        enum Kind {
+            Record,
+            Nullable,
+            Leaf
+        };
+        Kind kind;
+        // The fields of records by index, or the value of nullables.
+        std::vector<Step> children;
+        // The branch of nullables that holds null.
+        size_t nullBranch;
+        // The column of leaves, or the first of the columns below.
+        size_t column;
+        size_t endColumn;
+    };
+
+    Step root;
+    std::vector<Column> columns;
+    bool resolving;
+    std::vector<uint8_t> fixed;
+
+    ColumnarProgram() : root(), resolving(false) {}
+
+    explicit ColumnarProgram(const NodePtr &schema) : root(), resolving(false) {
+        if (resolvedNode(*schema).type() != AVRO_RECORD) {
+            throw Exception("Only records can be held in columns");
+        }
+        std::set<const Node *> open;
+        root = build(*schema, std::string(), false, open);
+    }
+
+    // Makes the steps for n, whose columns are named after prefix.
+    Step build(const Node &node, const std::string &prefix, bool nullable, std::set<const Node *> &open) {
+        const Node &n = resolvedNode(node);
+        Step s;
+        s.nullBranch = 0;
+        s.column = columns.size();
+        switch (n.type()) {
+            case AVRO_RECORD:
+                if (!open.insert(&n).second) {
+                    throw Exception(boost::format("Cannot read recursive record %1% into columns") % n.name());
+                }
+                s.kind = Step::Record;
+                for (size_t i = 0; i < n.leaves(); ++i) {
+                    std::string name = prefix.empty() ? n.nameAt(i) : prefix + "." + n.nameAt(i);
+                    s.children.push_back(build(*n.leafAt(i), name, nullable, open));
+                }
+                open.erase(&n);
+                break;
+            case AVRO_UNION: {
+                size_t branch = n.leaves();
+                for (size_t i = 0; i < n.leaves(); ++i) {
+                    if (n.leafAt(i)->type() == AVRO_NULL) {
+                        branch = i;
+                    }
+                }
+                if (n.leaves() != 2 || branch == n.leaves()
+                    || resolvedNode(*n.leafAt(1 - branch)).type() == AVRO_UNION) {
+                    throw Exception(boost::format("Cannot read union %1% into columns, only unions of null and one other type") % prefix);
+                }
+                s.kind = Step::Nullable;
+                s.nullBranch = branch;
+                s.children.push_back(build(*n.leafAt(1 - branch), prefix, true, open));
+                break;
+            }
+            case AVRO_ARRAY:
+            case AVRO_MAP:
+                throw Exception(boost::format("Cannot read %1% %2% into columns") % toString(n.type()) % prefix);
+            default: {
+                s.kind = Step::Leaf;
+                Column c;
+                c.name = prefix;
+                c.type = n.type();
+                c.logicalType = n.logicalType();
+                c.nullable = nullable;
+                if (c.type == AVRO_FIXED) {
+                    c.fixedSize = n.fixedSize();
+                } else if (c.type == AVRO_ENUM) {
+                    for (size_t i = 0; i < n.names(); ++i) {
+                        c.symbols.push_back(n.nameAt(i));
+                    }
+                }
+                c.clear();
+                columns.push_back(c);
+                break;
+            }
+        }
+        s.endColumn = columns.size();
+        return s;
+    }
+
+    static void setBit(std::vector<uint8_t> &bits, size_t index, bool value) {
+        if (index % 8 == 0) {
+            bits.push_back(0);
+        }
+        if (value) {
+            bits.back() |= static_cast<uint8_t>(1U << (index % 8));
+        }
+    }
+
+    template<typename T>
+    static void append(std::vector<uint8_t> &values, T v) {
+        size_t n = values.size();
+        values.resize(n + sizeof(T));
+        std::memcpy(&values[n], &v, sizeof(T));
+    }
+
+    static void appendBytes(Column &c, const uint8_t *data, size_t len) {
+        c.values.insert(c.values.end(), data, data + len);
+        if (c.values.size() > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+            throw Exception(boost::format("Column %1% has more than 2GB of values in one batch") % c.name);
+        }
+        c.offsets.push_back(static_cast<int32_t>(c.values.size()));
+    }
+
+    static void appendNull(Column &c) {
+        switch (c.type) {
+            case AVRO_BOOL:
+                setBit(c.values, c.length, false);
+                break;
+            case AVRO_INT:
+            case AVRO_ENUM:
+            case AVRO_FLOAT:
+                c.values.resize(c.values.size() + 4);
+                break;
+            case AVRO_LONG:
+            case AVRO_DOUBLE:
+                c.values.resize(c.values.size() + 8);
+                break;
+            case AVRO_FIXED:
+                c.values.resize(c.values.size() + c.fixedSize);
+                break;
+            case AVRO_STRING:
+            case AVRO_BYTES:
+                c.offsets.push_back(c.offsets.back());
+                break;
+            default:
+                break;
+        }
+        if (c.type != AVRO_NULL) {
+            setBit(c.validity, c.length, false);
+        }
+        ++c.nullCount;
+        ++c.length;
+    }
+
+    void appendValue(Column &c, Decoder &d) {
+        switch (c.type) {
+            case AVRO_NULL:
+                d.decodeNull();
+                ++c.nullCount;
+                break;
+            case AVRO_BOOL:
+                setBit(c.values, c.length, d.decodeBool());
+                break;
+            case AVRO_INT:
+                append(c.values, d.decodeInt());
+                break;
+            case AVRO_LONG:
+                append(c.values, d.decodeLong());
+                break;
+            case AVRO_FLOAT:
+                append(c.values, d.decodeFloat());
+                break;
+            case AVRO_DOUBLE:
+                append(c.values, d.decodeDouble());
+                break;
+            case AVRO_ENUM:
+                append(c.values, static_cast<int32_t>(d.decodeEnum()));
+                break;
+            case AVRO_FIXED:
+                d.decodeFixed(c.fixedSize, fixed);
+                c.values.insert(c.values.end(), fixed.begin(), fixed.end());
+                break;
+            case AVRO_STRING: {
+                const char *data;
+                size_t len;
+                d.decodeStringView(data, len);
+                appendBytes(c, reinterpret_cast<const uint8_t *>(data), len);
+                break;
+            }
+            case AVRO_BYTES: {
+                const uint8_t *data;
+                size_t len;
+                d.decodeBytesView(data, len);
+                appendBytes(c, data, len);
+                break;
+            }
+            default:
+                break;
+        }
+        if (c.nullable && c.type != AVRO_NULL) {
+            setBit(c.validity, c.length, true);
+        }
+        ++c.length;
+    }
+
+    static bool bit(const std::vector<uint8_t> &bits, size_t index) {
+        return ((bits[index / 8] >> (index % 8)) & 1) != 0;
+    }
+
+    static bool isNull(const Column &c, size_t row) {
+        return c.type == AVRO_NULL || (!c.validity.empty() && !bit(c.validity, row));
+    }
+
+    static size_t width(const Column &c) {
+        switch (c.type) {
+            case AVRO_INT:
+            case AVRO_ENUM:
+            case AVRO_FLOAT:
+                return 4;
+            case AVRO_LONG:
+            case AVRO_DOUBLE:
+                return 8;
+            case AVRO_FIXED:
+                return c.fixedSize;
+            default:
+                return 0;
+        }
+    }
+
+    // Throws unless the buffers of c hold length rows.
+    static void check(const Column &c, size_t length) {
+        size_t bitmap = (length + 7) / 8;
+        bool ok = c.length == length && (c.validity.empty() || c.validity.size() >= bitmap);
+        if (c.type == AVRO_BOOL) {
+            ok = ok && c.values.size() >= bitmap;
+        } else if (c.type == AVRO_STRING || c.type == AVRO_BYTES) {
+            ok = ok && c.offsets.size() == length + 1 && c.offsets[0] >= 0;
+            for (size_t i = 0; ok && i < length; ++i) {
+                ok = c.offsets[i] <= c.offsets[i + 1];
+            }
+            ok = ok && static_cast<size_t>(c.offsets[length]) <= c.values.size();
+        } else {
+            ok = ok && c.values.size() >= length * width(c);
+        }
+        if (!ok) {
+            throw Exception(boost::format("Column %1% does not hold %2% rows") % c.name % length);
+        }
+        if (c.type == AVRO_ENUM) {
+            for (size_t i = 0; i < length; ++i) {
+                int32_t v;
+                std::memcpy(&v, &c.values[i * 4], 4);
+                if (!isNull(c, i) && (v < 0 || static_cast<size_t>(v) >= c.symbols.size())) {
+                    throw Exception(boost::format("Enum column %1% has no symbol %2%") % c.name % v);
+                }
+            }
+        }
+    }
+
+    void check(const ColumnarBatch &batch) const {
+        if (batch.columns.size() != columns.size()) {
+            throw Exception(boost::format("Batch has %1% columns, the schema %2%")
+                            % batch.columns.size() % columns.size());
+        }
+        for (size_t i = 0; i < columns.size(); ++i) {
+            const Column &c = batch.columns[i];
+            if (c.name != columns[i].name || c.type != columns[i].type
+                || (c.type == AVRO_FIXED && c.fixedSize != columns[i].fixedSize)) {
+                throw Exception(boost::format("Column %1% is %2% %3%, the schema has %4% %5%")
+                                % i % toString(c.type) % c.name % toString(columns[i].type) % columns[i].name);
+            }
+            check(c, batch.length);
+        }
+    }
+
+    template<typename T>
+    static T get(const Column &c, size_t row) {
+        T v;
+        std::memcpy(&v, &c.values[row * sizeof(T)], sizeof(T));
+        return v;
+    }
+
+    static void encodeValue(const Column &c, size_t row, Encoder &e) {
+        switch (c.type) {
+            case AVRO_NULL:
+                e.encodeNull();
+                break;
+            case AVRO_BOOL:
+                e.encodeBool(bit(c.values, row));
+                break;
+            case AVRO_INT:
+                e.encodeInt(get<int32_t>(c, row));
+                break;
+            case AVRO_LONG:
+                e.encodeLong(get<int64_t>(c, row));
+                break;
+            case AVRO_FLOAT:
+                e.encodeFloat(get<float>(c, row));
+                break;
+            case AVRO_DOUBLE:
+                e.encodeDouble(get<double>(c, row));
+                break;
+            case AVRO_ENUM:
+                e.encodeEnum(static_cast<size_t>(get<int32_t>(c, row)));
+                break;
+            case AVRO_FIXED:
+                e.encodeFixed(c.values.data() + row * c.fixedSize, c.fixedSize);
+                break;
+            case AVRO_STRING:
+            case AVRO_BYTES:
+                // Strings are encoded as bytes, which spares a std::string
+                // and is the same in the binary encoding of data files.
+                e.encodeBytes(c.values.data() + c.offsets[row],
+                              static_cast<size_t>(c.offsets[row + 1] - c.offsets[row]));
+                break;
+            default:
+                break;
+        }
+    }
+
+    void encode(const Step &s, const std::vector<Column> &in, size_t row, Encoder &e) const {
+        switch (s.kind) {
+            case Step::Record:
+                for (size_t i = 0; i < s.children.size(); ++i) {
+                    encode(s.children[i], in, row, e);
+                }
+                break;
+            case Step::Nullable:
+                if (s.column != s.endColumn && isNull(in[s.column], row)) {
+                    e.encodeUnionIndex(s.nullBranch);
+                    e.encodeNull();
+                } else {
+                    e.encodeUnionIndex(1 - s.nullBranch);
+                    encode(s.children[0], in, row, e);
+                }
+                break;
+            case Step::Leaf:
+                encodeValue(in[s.column], row, e);
+                break;
+        }
+    }
+
+    void decode(const Step &s, Decoder &d, std::vector<Column> &out) {
+        switch (s.kind) {
+            case Step::Record:
+                if (resolving) {
+                    const std::vector<size_t> &fo = static_cast<ResolvingDecoder &>(d).fieldOrder();
+                    for (size_t i = 0; i < fo.size(); ++i) {
+                        decode(s.children[fo[i]], d, out);
+                    }
+                } else {
+                    for (size_t i = 0; i < s.children.size(); ++i) {
+                        decode(s.children[i], d, out);
+                    }
+                }
+                break;
+            case Step::Nullable:
+                if (d.decodeUnionIndex() == s.nullBranch) {
+                    d.decodeNull();
+                    for (size_t i = s.column; i < s.endColumn; ++i) {
+                        appendNull(out[i]);
+                    }
+                } else {
+                    decode(s.children[0], d, out);
+                }
+                break;
+            case Step::Leaf:
+                appendValue(out[s.column], d);
+                break;
+        }
+    }
+};
+
+ColumnarBatchReader::ColumnarBatchReader(const char *filename) : base_(new DataFileReaderBase(filename)) {
+    base_->init();
+    init();
+}
+
+ColumnarBatchReader::ColumnarBatchReader(std::unique_ptr<DataFileReaderBase> base) : base_(std::move(base)) {
+    base_->init();
+    init();
+}
+
+ColumnarBatchReader::ColumnarBatchReader(std::unique_ptr<DataFileReaderBase> base,
+                                         const ValidSchema &readerSchema) : base_(std::move(base)) {
+    base_->init(readerSchema);
+    init();
+}
+
+ColumnarBatchReader::~ColumnarBatchReader() = default;
+
+void ColumnarBatchReader::init() {
+    program_.reset(new ColumnarProgram(base_->readerSchema().root()));
+    program_->resolving = dynamic_cast<ResolvingDecoder *>(&base_->decoder()) != nullptr;
+}
+
+const ValidSchema &ColumnarBatchReader::readerSchema() const {
+    return base_->readerSchema();
+}
+
+bool ColumnarBatchReader::next(ColumnarBatch &batch, size_t maxRows) {
+    const std::vector<Column> &columns = program_->columns;
+    if (batch.columns.size() != columns.size()) {
+        batch.columns = columns;
+    }
+    for (size_t i = 0; i < columns.size(); ++i) {
+        Column &c = batch.columns[i];
+        if (c.name != columns[i].name || c.type != columns[i].type) {
+            c = columns[i];
+        }
+        c.clear();
+    }
+    batch.length = 0;
+    if (!base_->hasMore()) {
+        return false;
+    }
+
+    size_t n = static_cast<size_t>(base_->objectsLeftInBlock());
+    if (maxRows != 0) {
+        n = std::min(n, maxRows);
+    }
+    Decoder &d = base_->decoder();
+    for (size_t i = 0; i < n; ++i) {
+        base_->decr();
+        program_->decode(program_->root, d, batch.columns);
+    }
+    batch.length = n;
+    return true;
+}
+
+ColumnarBatchWriter::ColumnarBatchWriter(const char *filename, const ValidSchema &schema,
+                                         size_t syncInterval, Codec codec)
+    : base_(new DataFileWriterBase(filename, schema, syncInterval, codec)) {
+    init();
+}
+
+ColumnarBatchWriter::ColumnarBatchWriter(std::unique_ptr<DataFileWriterBase> base) : base_(std::move(base)) {
+    init();
+}
+
+ColumnarBatchWriter::~ColumnarBatchWriter() = default;
+
+void ColumnarBatchWriter::init() {
+    program_.reset(new ColumnarProgram(base_->schema().root()));
+}
+
+ColumnarBatch ColumnarBatchWriter::batch() const {
+    ColumnarBatch result;
+    result.columns = program_->columns;
+    return result;
+}
+
+void ColumnarBatchWriter::write(const ColumnarBatch &batch) {
+    program_->check(batch);
+    for (size_t i = 0; i < batch.length; ++i) {
+        base_->syncIfNeeded();
+        program_->encode(program_->root, batch.columns, i, base_->encoder());
+        base_->incr();
+    }
+}
+
+} // namespace avro
@@ -15,17 +15,23 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <algorithm>
 #include <boost/algorithm/string/replace.hpp>
+#include <set>
 #include <sstream>
+#include <unordered_map>
 #include <utility>
 
 #include "Compiler.hh"
+#include "Protocol.hh"
 #include "Schema.hh"
 #include "Stream.hh"
+#include "Trace.hh"
 #include "Types.hh"
 #include "ValidSchema.hh"
 
 #include "json/JsonDom.hh"
+#include "json/JsonIO.hh"
 
 using std::make_pair;
 using std::map;
@@ -45,26 +51,47 @@ using SymbolTable = map<Name, NodePtr>;
 
 static NodePtr makePrimitive(const string &t) {
     if (t == "null") {
-        return NodePtr(new NodePrimitive(AVRO_NULL));
+        return primitiveNode(AVRO_NULL);
     } else if (t == "boolean") {
-        return NodePtr(new NodePrimitive(AVRO_BOOL));
+        return primitiveNode(AVRO_BOOL);
     } else if (t == "int") {
-        return NodePtr(new NodePrimitive(AVRO_INT));
+        return primitiveNode(AVRO_INT);
     } else if (t == "long") {
-        return NodePtr(new NodePrimitive(AVRO_LONG));
+        return primitiveNode(AVRO_LONG);
     } else if (t == "float") {
-        return NodePtr(new NodePrimitive(AVRO_FLOAT));
+        return primitiveNode(AVRO_FLOAT);
     } else if (t == "double") {
-        return NodePtr(new NodePrimitive(AVRO_DOUBLE));
+        return primitiveNode(AVRO_DOUBLE);
     } else if (t == "string") {
-        return NodePtr(new NodePrimitive(AVRO_STRING));
+        return primitiveNode(AVRO_STRING);
     } else if (t == "bytes") {
-        return NodePtr(new NodePrimitive(AVRO_BYTES));
+        return primitiveNode(AVRO_BYTES);
     } else {
         return NodePtr();
     }
 }
 
+// Primitives share their nodes, which are locked, with those of the same
+// logical type; one with a doc gets a node of its own.
+static void unshare(NodePtr &node) {
+    if (node->locked() && isPrimitive(node->type())) {
+        NodePtr n(new NodePrimitive(node->type()));
+        n->setLogicalType(node->logicalType());
+        node = n;
+    }
+}
+
+static void setLogicalType(NodePtr &node, LogicalType lt) {
+    if (lt.type() == LogicalType::NONE) {
+        return;
+    }
+    if (node->locked() && isPrimitive(node->type())) {
+        node = primitiveNode(node->type(), lt);
+    } else {
+        node->setLogicalType(lt);
+    }
+}
+
 static NodePtr makeNode(const json::Entity &e, SymbolTable &st, const string &ns);
 
 template<typename T>
@@ -146,9 +173,24 @@ struct Field {
     const string name;
     const NodePtr schema;
     const GenericDatum defaultValue;
-    Field(string n, NodePtr v, GenericDatum dv) : name(std::move(n)), schema(std::move(v)), defaultValue(std::move(dv)) {}
+    const SortOrder order;
+    Field(string n, NodePtr v, GenericDatum dv, SortOrder o) : name(std::move(n)), schema(std::move(v)), defaultValue(std::move(dv)), order(o) {}
 };
 
+// Returns false if the "order" of a field is none of those in the spec.
+static bool parseSortOrder(const string &s, SortOrder &order) {
+    if (s == "ascending") {
+        order = ORDER_ASCENDING;
+    } else if (s == "descending") {
+        order = ORDER_DESCENDING;
+    } else if (s == "ignore") {
+        order = ORDER_IGNORE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
 static void assertType(const Entity &e, EntityType et) {
     if (e.type() != et) {
         throw Exception(boost::format("Unexpected type for default value: "
@@ -263,10 +305,18 @@ static Field makeField(const Entity &e, SymbolTable &st, const string &ns) {
     auto it2 = m.find("default");
     NodePtr node = makeNode(it->second, st, ns);
     if (containsField(m, "doc")) {
+        unshare(node);
         node->setDoc(getDocField(e, m));
     }
     GenericDatum d = (it2 == m.end()) ? GenericDatum() : makeGenericDatum(node, it2->second, st);
-    return Field(n, node, d);
+    SortOrder order = ORDER_ASCENDING;
+    if (containsField(m, "order")) {
+        const string &o = getStringField(e, m, "order");
+        if (!parseSortOrder(o, order)) {
+            throw Exception(boost::format("Unknown field order: %1%") % o);
+        }
+    }
+    return Field(n, node, d, order);
 }
 
 // Extended makeRecordNode (with doc).
@@ -277,12 +327,16 @@ static NodePtr makeRecordNode(const Entity &e, const Name &name,
     concepts::MultiAttribute<string> fieldNames;
     concepts::MultiAttribute<NodePtr> fieldValues;
     vector<GenericDatum> defaultValues;
+    vector<SortOrder> fieldOrders;
+    bool ordered = false;
 
     for (const auto &it : v) {
         Field f = makeField(it, st, ns);
         fieldNames.add(f.name);
         fieldValues.add(f.schema);
         defaultValues.push_back(f.defaultValue);
+        fieldOrders.push_back(f.order);
+        ordered = ordered || f.order != ORDER_ASCENDING;
     }
     NodeRecord *node;
     if (doc == nullptr) {
@@ -292,6 +346,9 @@ static NodePtr makeRecordNode(const Entity &e, const Name &name,
         node = new NodeRecord(asSingleAttribute(name), asSingleAttribute(*doc),
                               fieldValues, fieldNames, defaultValues);
     }
+    if (ordered) {
+        node->setFieldOrders(std::move(fieldOrders));
+    }
     return NodePtr(node);
 }
 
@@ -444,7 +501,7 @@ static NodePtr makeNode(const Entity &e, const Object &m,
 
     if (result) {
         try {
-            result->setLogicalType(makeLogicalType(e, m));
+            setLogicalType(result, makeLogicalType(e, m));
         } catch (Exception &ex) {
             // Per the standard we must ignore the logical type attribute if it
             // is malformed.
@@ -487,20 +544,358 @@ const Array &getArrayField(const Entity &e, const Object &m, const string &field
     return it->second.arrayValue();
 }
 
+namespace {
+
+/**
+ * Compiles a schema straight from the parser's tokens, without building a
+ * json::Entity tree first. It relies on the member order every Avro
+ * implementation writes: a schema object gives its "type" before the
+ * members that depend on it, and a record its name and namespace before
+ * its fields. Whenever that does not hold, or the schema is invalid,
+ * compile() throws and the caller falls back to the tree-based compiler,
+ * which accepts any order and produces the error messages.
+ */
+class StreamingCompiler {
+    json::JsonParser &p_;
+    SymbolTable &st_;
+
+    [[noreturn]] static void fallBack() {
+        throw Exception("Schema needs the tree-based compiler");
+    }
+
+    void skipValue() {
+        size_t depth = 0;
+        do {
+            switch (p_.advance()) {
+                case json::JsonParser::tkArrayStart:
+                case json::JsonParser::tkObjectStart:
+                    ++depth;
+                    break;
+                case json::JsonParser::tkArrayEnd:
+                case json::JsonParser::tkObjectEnd:
+                    --depth;
+                    break;
+                default:
+                    break;
+            }
+        } while (depth != 0);
+    }
+
+    void stringValue(string &s, bool &seen) {
+        if (seen || p_.advance() != json::JsonParser::tkString) {
+            fallBack();
+        }
+        p_.stringValue(s);
+        seen = true;
+    }
+
+    static Name makeName(const string &name, bool hasNs, const string &nsValue,
+                         const string &ns) {
+        if (isFullName(name)) {
+            return Name(name);
+        }
+        return hasNs ? Name(name, nsValue) : Name(name, ns);
+    }
+
+    void compileField(const string &ns, concepts::MultiAttribute<string> &names,
+                      concepts::MultiAttribute<NodePtr> &values,
+                      vector<GenericDatum> &defaults, vector<SortOrder> &orders) {
+        if (p_.advance() != json::JsonParser::tkObjectStart) {
+            fallBack();
+        }
+        string key, name, doc, order;
+        bool hasName = false, hasDoc = false, hasDefault = false, hasOrder = false;
+        NodePtr type;
+        Entity defaultValue;
+        while (p_.advance() != json::JsonParser::tkObjectEnd) {
+            p_.stringValue(key);
+            if (key == "name") {
+                stringValue(name, hasName);
+            } else if (key == "type") {
+                if (type) {
+                    fallBack();
+                }
+                type = compile(ns);
+            } else if (key == "doc") {
+                stringValue(doc, hasDoc);
+            } else if (key == "default") {
+                if (hasDefault) {
+                    fallBack();
+                }
+                defaultValue = json::readEntity(p_);
+                hasDefault = true;
+            } else if (key == "order") {
+                stringValue(order, hasOrder);
+            } else {
+                skipValue();
+            }
+        }
+        SortOrder o = ORDER_ASCENDING;
+        if (!hasName || !type || (hasOrder && !parseSortOrder(order, o))) {
+            fallBack();
+        }
+        if (hasDoc) {
+            unescape(doc);
+            unshare(type);
+            type->setDoc(doc);
+        }
+        orders.push_back(o);
+        names.add(name);
+        values.add(type);
+        defaults.push_back(hasDefault ? makeGenericDatum(type, defaultValue, st_) : GenericDatum());
+    }
+
+    NodePtr compileObject(const string &ns) {
+        string key, type, name, nsValue, doc;
+        bool hasType = false, hasName = false, hasNs = false, hasDoc = false;
+        bool isRecord = false, hasFields = false;
+        Name nm;
+        NodePtr result, items;
+        concepts::MultiAttribute<string> fieldNames, symbols;
+        concepts::MultiAttribute<NodePtr> fieldValues;
+        vector<GenericDatum> defaultValues;
+        vector<SortOrder> fieldOrders;
+        bool hasSymbols = false;
+        Entity size;
+        Object logical;
+
+        while (p_.advance() != json::JsonParser::tkObjectEnd) {
+            p_.stringValue(key);
+            if (key == "type") {
+                stringValue(type, hasType);
+                isRecord = type == "record" || type == "error";
+            } else if (key == "name") {
+                stringValue(name, hasName);
+            } else if (key == "namespace") {
+                stringValue(nsValue, hasNs);
+                // The fields were compiled in the namespace known then.
+                if (hasFields && !isFullName(name)) {
+                    fallBack();
+                }
+            } else if (key == "doc") {
+                stringValue(doc, hasDoc);
+            } else if (key == "logicalType" || key == "precision" || key == "scale") {
+                logical.emplace(key, json::readEntity(p_));
+            } else if (key == "size") {
+                size = json::readEntity(p_);
+            } else if (key == "fields" || key == "symbols" || key == "items" || key == "values") {
+                if (!hasType) {
+                    fallBack();
+                }
+                if (key == "fields" && isRecord) {
+                    if (!hasName || hasFields || p_.advance() != json::JsonParser::tkArrayStart) {
+                        fallBack();
+                    }
+                    nm = makeName(name, hasNs, nsValue, ns);
+                    result = NodePtr(new NodeRecord());
+                    st_[nm] = result;
+                    hasFields = true;
+                    while (p_.peek() != json::JsonParser::tkArrayEnd) {
+                        compileField(nm.ns(), fieldNames, fieldValues, defaultValues, fieldOrders);
+                    }
+                    p_.advance();
+                } else if (key == "symbols" && type == "enum") {
+                    if (hasSymbols || p_.advance() != json::JsonParser::tkArrayStart) {
+                        fallBack();
+                    }
+                    hasSymbols = true;
+                    string symbol;
+                    while (p_.advance() != json::JsonParser::tkArrayEnd) {
+                        if (p_.cur() != json::JsonParser::tkString) {
+                            fallBack();
+                        }
+                        p_.stringValue(symbol);
+                        symbols.add(symbol);
+                    }
+                } else if ((key == "items" && type == "array") || (key == "values" && type == "map")) {
+                    if (items) {
+                        fallBack();
+                    }
+                    items = compile(ns);
+                } else {
+                    skipValue();
+                }
+            } else {
+                skipValue();
+            }
+        }
+
+        if (!hasType) {
+            fallBack();
+        }
+        if (hasDoc) {
+            unescape(doc);
+        }
+        if (isRecord) {
+            if (!hasFields) {
+                fallBack();
+            }
+            std::unique_ptr<NodeRecord> r(hasDoc
+                                              ? new NodeRecord(asSingleAttribute(nm), asSingleAttribute(doc),
+                                                               fieldValues, fieldNames, defaultValues)
+                                              : new NodeRecord(asSingleAttribute(nm), fieldValues,
+                                                               fieldNames, defaultValues));
+            if (std::any_of(fieldOrders.begin(), fieldOrders.end(),
+                            [](SortOrder o) { return o != ORDER_ASCENDING; })) {
+                r->setFieldOrders(std::move(fieldOrders));
+            }
+            std::static_pointer_cast<NodeRecord>(result)->swap(*r);
+        } else if (type == "enum" || type == "fixed") {
+            if (!hasName) {
+                fallBack();
+            }
+            nm = makeName(name, hasNs, nsValue, ns);
+            if (type == "enum") {
+                if (!hasSymbols) {
+                    fallBack();
+                }
+                result = NodePtr(new NodeEnum(asSingleAttribute(nm), symbols));
+            } else {
+                if (size.type() != json::etLong || size.longValue() <= 0) {
+                    fallBack();
+                }
+                result = NodePtr(new NodeFixed(asSingleAttribute(nm),
+                                               asSingleAttribute(static_cast<int>(size.longValue()))));
+            }
+            if (hasDoc) {
+                result->setDoc(doc);
+            }
+            st_[nm] = result;
+        } else if (type == "array" || type == "map") {
+            if (!items) {
+                fallBack();
+            }
+            if (type == "array") {
+                result = NodePtr(new NodeArray(asSingleAttribute(items)));
+            } else {
+                result = NodePtr(new NodeMap(asSingleAttribute(items)));
+            }
+            if (hasDoc) {
+                result->setDoc(doc);
+            }
+        } else {
+            result = makePrimitive(type);
+            if (!result) {
+                fallBack();
+            }
+        }
+
+        if (!logical.empty()) {
+            try {
+                setLogicalType(result, makeLogicalType(Entity(), logical));
+            } catch (Exception &ex) {
+                // Malformed logical types are ignored, as in makeNode().
+            }
+        }
+        return result;
+    }
+
+public:
+    StreamingCompiler(json::JsonParser &p, SymbolTable &st) : p_(p), st_(st) {}
+
+    NodePtr compile(const string &ns) {
+        switch (p_.advance()) {
+            case json::JsonParser::tkString: {
+                string t;
+                p_.stringValue(t);
+                return makeNode(t, st_, ns);
+            }
+            case json::JsonParser::tkArrayStart: {
+                concepts::MultiAttribute<NodePtr> branches;
+                while (p_.peek() != json::JsonParser::tkArrayEnd) {
+                    branches.add(compile(ns));
+                }
+                p_.advance();
+                return NodePtr(new NodeUnion(branches));
+            }
+            case json::JsonParser::tkObjectStart:
+                return compileObject(ns);
+            default:
+                fallBack();
+        }
+    }
+};
+
+/**
+ * Makes the identical anonymous arrays, maps and unions of a compiled
+ * schema one node, so that those who look nodes up, such as the grammar
+ * generators, find them once. Their leaves are interned first, so that
+ * nodes are identical when their leaves are the same nodes; symbolic
+ * leaves count as references to the nodes they refer to, which are not
+ * the same as the definitions of those nodes.
+ */
+class Interner {
+    map<vector<uintptr_t>, NodePtr> nodes_;
+    std::set<const Node *> records_;
+
+    // Nodes are aligned, so that references, with the low bit set, are
+    // told apart from definitions.
+    static uintptr_t identity(const NodePtr &node) {
+        if (node->type() == AVRO_SYMBOLIC && node->getDoc().empty()) {
+            return reinterpret_cast<uintptr_t>(&resolvedNode(*node)) | 1;
+        }
+        return reinterpret_cast<uintptr_t>(node.get());
+    }
+
+public:
+    void intern(NodePtr &node) {
+        Type t = node->type();
+        if (t == AVRO_SYMBOLIC || (t == AVRO_RECORD && !records_.insert(node.get()).second)) {
+            return;
+        }
+        vector<uintptr_t> key(1, t);
+        for (size_t i = 0; i < node->leaves(); ++i) {
+            // As in setLeafToSymbolic().
+            auto &leaf = const_cast<NodePtr &>(node->leafAt(i));
+            intern(leaf);
+            key.push_back(identity(leaf));
+        }
+        if ((t == AVRO_ARRAY || t == AVRO_MAP || t == AVRO_UNION) && node->getDoc().empty()) {
+            node = nodes_.emplace(std::move(key), node).first->second;
+        }
+    }
+};
+
+static NodePtr intern(NodePtr node) {
+    Interner().intern(node);
+    return node;
+}
+
+} // namespace
+
 ValidSchema compileJsonSchemaFromStream(InputStream &is) {
+    AVRO_TRACE_SCOPE(TRACE_COMPILE_SCHEMA, 0);
     json::Entity e = json::loadEntity(is);
     SymbolTable st;
     NodePtr n = makeNode(e, st, "");
-    return ValidSchema(n);
+    return ValidSchema(intern(n));
 }
 
 AVRO_DECL ValidSchema compileJsonSchemaFromFile(const char *filename) {
     std::unique_ptr<InputStream> s = fileInputStream(filename);
-    return compileJsonSchemaFromStream(*s);
+    vector<uint8_t> text;
+    const uint8_t *data;
+    size_t len;
+    while (s->next(&data, &len)) {
+        text.insert(text.end(), data, data + len);
+    }
+    return compileJsonSchemaFromMemory(text.data(), text.size());
 }
 
 AVRO_DECL ValidSchema compileJsonSchemaFromMemory(const uint8_t *input, size_t len) {
-    return compileJsonSchemaFromStream(*memoryInputStream(input, len));
+    AVRO_TRACE_SCOPE(TRACE_COMPILE_SCHEMA, static_cast<int64_t>(len));
+    NodePtr n;
+    try {
+        std::unique_ptr<InputStream> in = memoryInputStream(input, len);
+        json::JsonParser p;
+        p.init(*in);
+        SymbolTable st;
+        n = StreamingCompiler(p, st).compile("");
+    } catch (const std::exception &) {
+        // Unusual member order or an invalid schema; see StreamingCompiler.
+        return compileJsonSchemaFromStream(*memoryInputStream(input, len));
+    }
+    return ValidSchema(intern(n));
 }
 
 AVRO_DECL ValidSchema compileJsonSchemaFromString(const char *input) {
@@ -513,6 +908,67 @@ AVRO_DECL ValidSchema compileJsonSchemaFromString(const string &input) {
         reinterpret_cast<const uint8_t *>(input.data()), input.size());
 }
 
+namespace {
+
+// Hashes and compares the strings pointed to, so that they need not be
+// copied into a map.
+struct StringPtrHash {
+    size_t operator()(const string *s) const { return std::hash<string>()(*s); }
+};
+
+struct StringPtrEqual {
+    bool operator()(const string *a, const string *b) const { return *a == *b; }
+};
+
+} // namespace
+
+std::vector<CompiledSchema> compileJsonSchemas(const vector<string> &inputs, ExecutorPtr executor) {
+    vector<CompiledSchema> result(inputs.size());
+    // The index of the first of the inputs equal to each, which alone is
+    // compiled.
+    vector<size_t> first(inputs.size());
+    vector<size_t> distinct;
+    std::unordered_map<const string *, size_t, StringPtrHash, StringPtrEqual> seen;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        auto it = seen.emplace(&inputs[i], i);
+        first[i] = it.first->second;
+        if (it.second) {
+            distinct.push_back(i);
+        }
+    }
+
+    if (!executor) {
+        executor = defaultExecutor();
+    }
+    // A few tasks a thread, so that threads given long schemas do not
+    // leave the others idle at the end.
+    size_t perTask = std::max<size_t>(1, distinct.size() / (4 * std::max<size_t>(1, executor->concurrency())));
+    TaskGroup tasks(executor);
+    for (size_t begin = 0; begin < distinct.size(); begin += perTask) {
+        size_t end = std::min(begin + perTask, distinct.size());
+        tasks.run([&inputs, &result, &distinct, begin, end]() {
+            for (size_t k = begin; k < end; ++k) {
+                size_t i = distinct[k];
+                try {
+                    ValidSchema s = compileJsonSchemaFromString(inputs[i]);
+                    result[i].fingerprint = s.rabinFingerprint();
+                    result[i].schema = s;
+                } catch (const std::exception &e) {
+                    result[i].error = e.what();
+                }
+            }
+        });
+    }
+    tasks.wait();
+
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        if (first[i] != i) {
+            result[i] = result[first[i]];
+        }
+    }
+    return result;
+}
+
 static ValidSchema compile(std::istream &is) {
     std::unique_ptr<InputStream> in = istreamInputStream(is);
     return compileJsonSchemaFromStream(*in);
@@ -536,4 +992,120 @@ AVRO_DECL bool compileJsonSchema(std::istream &is, ValidSchema &schema, string &
     }
 }
 
+// The messages of a protocol become fields of a record that holds its
+// types too, so that one ValidSchema keeps them all. Its name and those
+// of the request records are in namespaces of their own, so as not to
+// take the names of the protocol's types or of each other.
+static const char protocolNamespace[] = "avro.ipc.protocol";
+static const char requestNamespace[] = "avro.ipc.request";
+
+static Message makeMessage(const string &name, const Entity &e, SymbolTable &st, const string &ns) {
+    if (e.type() != json::etObject) {
+        throw Exception(boost::format("Message %1% is not a JSON object") % name);
+    }
+    const Object &m = e.objectValue();
+    Message result;
+    result.name = name;
+    if (containsField(m, "doc")) {
+        result.doc = getDocField(e, m);
+    }
+
+    concepts::MultiAttribute<string> fieldNames;
+    concepts::MultiAttribute<NodePtr> fieldValues;
+    vector<GenericDatum> defaultValues;
+    for (const auto &it : getArrayField(e, m, "request")) {
+        Field f = makeField(it, st, ns);
+        fieldNames.add(f.name);
+        fieldValues.add(f.schema);
+        defaultValues.push_back(f.defaultValue);
+    }
+    result.request = NodePtr(new NodeRecord(asSingleAttribute(Name(name, requestNamespace)),
+                                            fieldValues, fieldNames, defaultValues));
+
+    result.response = makeNode(findField(e, m, "response")->second, st, ns);
+
+    concepts::MultiAttribute<NodePtr> errors;
+    errors.add(primitiveNode(AVRO_STRING));
+    if (containsField(m, "errors")) {
+        for (const auto &it : getArrayField(e, m, "errors")) {
+            errors.add(makeNode(it, st, ns));
+        }
+    }
+    result.errors = NodePtr(new NodeUnion(errors));
+
+    result.oneWay = false;
+    auto it = m.find("one-way");
+    if (it != m.end()) {
+        ensureType<bool>(it->second, "one-way");
+        result.oneWay = it->second.boolValue();
+    }
+    if (result.oneWay && (result.response->type() != AVRO_NULL || errors.size() != 1)) {
+        throw Exception(boost::format("One-way message %1% has a response or errors") % name);
+    }
+    return result;
+}
+
+AVRO_DECL Protocol compileJsonProtocolFromString(const string &input) {
+    json::Entity e = json::loadEntity(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+    if (e.type() != json::etObject) {
+        throw Exception("Protocol is not a JSON object");
+    }
+    const Object &m = e.objectValue();
+    const string name = getStringField(e, m, "protocol");
+    const string ns = containsField(m, "namespace") ? getStringField(e, m, "namespace") : string();
+
+    SymbolTable st;
+    concepts::MultiAttribute<string> names;
+    concepts::MultiAttribute<NodePtr> leaves;
+    if (containsField(m, "types")) {
+        for (const auto &it : getArrayField(e, m, "types")) {
+            names.add("type" + std::to_string(names.size()));
+            leaves.add(makeNode(it, st, ns));
+        }
+    }
+    const size_t typeCount = leaves.size();
+
+    vector<Message> messages;
+    auto it = m.find("messages");
+    if (it != m.end()) {
+        ensureType<Object>(it->second, "messages");
+        for (const auto &msg : it->second.objectValue()) {
+            messages.push_back(makeMessage(msg.first, msg.second, st, ns));
+            const string i = std::to_string(messages.size() - 1);
+            names.add("request" + i);
+            leaves.add(messages.back().request);
+            names.add("response" + i);
+            leaves.add(messages.back().response);
+            names.add("errors" + i);
+            leaves.add(messages.back().errors);
+        }
+    }
+
+    ValidSchema schema(NodePtr(new NodeRecord(asSingleAttribute(Name("Protocol", protocolNamespace)),
+                                              leaves, names, vector<GenericDatum>())));
+    // Validating may have replaced some of the leaves.
+    const NodePtr &root = schema.root();
+    vector<NodePtr> types;
+    for (size_t i = 0; i < typeCount; ++i) {
+        types.push_back(root->leafAt(i));
+    }
+    for (size_t i = 0; i < messages.size(); ++i) {
+        messages[i].request = root->leafAt(typeCount + 3 * i);
+        messages[i].response = root->leafAt(typeCount + 3 * i + 1);
+        messages[i].errors = root->leafAt(typeCount + 3 * i + 2);
+    }
+    return Protocol(name, ns, e.toString(), schema, std::move(types), std::move(messages));
+}
+
+AVRO_DECL Protocol compileJsonProtocolFromFile(const char *filename) {
+    std::unique_ptr<InputStream> s = fileInputStream(filename);
+    string text;
+    const uint8_t *data;
+    size_t len;
+    while (s->next(&data, &len)) {
+        text.append(reinterpret_cast<const char *>(data), len);
+    }
+    return compileJsonProtocolFromString(text);
+}
+
 } // namespace avro
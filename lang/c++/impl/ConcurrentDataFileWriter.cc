@@ -0,0 +1,228 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ConcurrentDataFileWriter.hh"
+#include "Exception.hh"
+
+#include <algorithm>
+#include <utility>
+
+namespace avro {
+
+/**
+ * A growable buffer for a block, handed over to the flusher by swapping
+ * its vector for a spare one.
+ */
+class ConcurrentDataFileWriterBase::BlockBuilder::Buffer : public OutputStream {
+    std::vector<uint8_t> data_;
+    size_t size_;
+
+public:
+    Buffer() : size_(0) {}
+
+    bool next(uint8_t **data, size_t *len) override {
+        if (size_ == data_.size()) {
+            data_.resize(std::max(2 * data_.size(), static_cast<size_t>(4 * 1024)));
+        }
+        *data = data_.data() + size_;
+        *len = data_.size() - size_;
+        size_ = data_.size();
+        return true;
+    }
+
+    void backup(size_t len) override {
+        size_ -= len;
+    }
+
+    uint64_t byteCount() const override {
+        return size_;
+    }
+
+    void flush() override {}
+
+    std::vector<uint8_t> &data() { return data_; }
+    size_t size() const { return size_; }
+    void clear() { size_ = 0; }
+};
+
+ConcurrentDataFileWriterBase::BlockBuilder::BlockBuilder(ConcurrentDataFileWriterBase &writer) : writer_(writer),
+                                                                                               buffer_(new Buffer()),
+                                                                                               encoder_(binaryEncoder()),
+                                                                                               objectCount_(0) {
+    encoder_->init(*buffer_);
+}
+
+ConcurrentDataFileWriterBase::BlockBuilder::~BlockBuilder() {
+    try {
+        flush();
+    } catch (...) {
+        // The writer keeps the error for flush() and close().
+    }
+}
+
+void ConcurrentDataFileWriterBase::BlockBuilder::incr() {
+    ++objectCount_;
+    encoder_->flush();
+    if (buffer_->size() >= writer_.syncInterval_) {
+        submit();
+    }
+}
+
+void ConcurrentDataFileWriterBase::BlockBuilder::flush() {
+    encoder_->flush();
+    if (objectCount_ != 0) {
+        submit();
+    }
+}
+
+void ConcurrentDataFileWriterBase::BlockBuilder::submit() {
+    size_t size = buffer_->size();
+    int64_t objectCount = objectCount_;
+    buffer_->clear();
+    objectCount_ = 0;
+    writer_.submit(buffer_->data(), size, objectCount);
+    encoder_->init(*buffer_);
+}
+
+ConcurrentDataFileWriterBase::ConcurrentDataFileWriterBase(const char *filename, const ValidSchema &schema,
+                                                           size_t syncInterval, Codec codec, size_t maxQueued) : writer_(new DataFileWriterBase(filename, schema, syncInterval, codec)),
+                                                                                                                 syncInterval_(syncInterval),
+                                                                                                                 maxQueued_(maxQueued != 0 ? maxQueued : std::max(2 * std::thread::hardware_concurrency(), 2U)),
+                                                                                                                 writing_(false),
+                                                                                                                 stopping_(false) {
+    start();
+}
+
+ConcurrentDataFileWriterBase::ConcurrentDataFileWriterBase(std::unique_ptr<OutputStream> outputStream,
+                                                           const ValidSchema &schema, size_t syncInterval,
+                                                           Codec codec, size_t maxQueued) : writer_(new DataFileWriterBase(std::move(outputStream), schema, syncInterval, codec)),
+                                                                                            syncInterval_(syncInterval),
+                                                                                            maxQueued_(maxQueued != 0 ? maxQueued : std::max(2 * std::thread::hardware_concurrency(), 2U)),
+                                                                                            writing_(false),
+                                                                                            stopping_(false) {
+    start();
+}
+
+ConcurrentDataFileWriterBase::~ConcurrentDataFileWriterBase() {
+    if (flusher_.joinable()) {
+        try {
+            close();
+        } catch (...) {
+        }
+    }
+}
+
+void ConcurrentDataFileWriterBase::start() {
+    flusher_ = std::thread(&ConcurrentDataFileWriterBase::flushLoop, this);
+}
+
+void ConcurrentDataFileWriterBase::flushLoop() {
+    for (;;) {
+        Block b;
+        bool failed;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+            b = std::move(queue_.front());
+            queue_.pop_front();
+            writing_ = true;
+            failed = static_cast<bool>(error_);
+        }
+        cond_.notify_all();
+        if (!failed) {
+            try {
+                std::lock_guard<std::mutex> lock(writerMutex_);
+                writer_->writeEncodedBlock(b.data.data(), b.size, b.objectCount);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!error_) {
+                    error_ = std::current_exception();
+                }
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            spare_.push_back(std::move(b.data));
+            writing_ = false;
+        }
+        cond_.notify_all();
+    }
+}
+
+void ConcurrentDataFileWriterBase::rethrow() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+}
+
+void ConcurrentDataFileWriterBase::submit(std::vector<uint8_t> &data, size_t size, int64_t objectCount) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this] { return stopping_ || error_ || queue_.size() < maxQueued_; });
+        if (error_) {
+            std::rethrow_exception(error_);
+        } else if (stopping_) {
+            throw Exception("Cannot write to a closed data file");
+        }
+        Block b;
+        b.size = size;
+        b.objectCount = objectCount;
+        b.data.swap(data);
+        queue_.push_back(std::move(b));
+        if (!spare_.empty()) {
+            data.swap(spare_.back());
+            spare_.pop_back();
+        }
+    }
+    cond_.notify_all();
+}
+
+void ConcurrentDataFileWriterBase::flush() {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this] { return queue_.empty() && !writing_; });
+    }
+    rethrow();
+    std::lock_guard<std::mutex> lock(writerMutex_);
+    writer_->flush();
+}
+
+void ConcurrentDataFileWriterBase::close() {
+    if (!flusher_.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cond_.notify_all();
+    flusher_.join();
+    writer_->close();
+    rethrow();
+}
+
+void ConcurrentDataFileWriterBase::setCompressionThreads(size_t threads, size_t maxPendingBlocks) {
+    std::lock_guard<std::mutex> lock(writerMutex_);
+    writer_->setCompressionThreads(threads, maxPendingBlocks);
+}
+
+} // namespace avro
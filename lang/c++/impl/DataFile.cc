@@ -19,17 +19,30 @@
 #include "DataFile.hh"
 #include "Compiler.hh"
 #include "Exception.hh"
-
+#include "Executor.hh"
+#include "GroupCommitter.hh"
+#include "Trace.hh"
+#include "XxHash.hh"
+#include "Zigzag.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
-#include <boost/crc.hpp> // for boost::crc_32_type
-#include <boost/iostreams/device/file.hpp>
-#include <boost/iostreams/filter/gzip.hpp>
-#include <boost/iostreams/filter/zlib.hpp>
 #include <boost/random/mersenne_twister.hpp>
 
-#ifdef SNAPPY_CODEC_AVAILABLE
-#include <snappy.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
 #endif
 
 namespace avro {
@@ -52,392 +65,1938 @@ const string AVRO_DEFLATE_CODEC("deflate");
 const string AVRO_SNAPPY_CODEC = "snappy";
 #endif
 
+#ifdef ZSTD_CODEC_AVAILABLE
+const string AVRO_ZSTD_CODEC = "zstandard";
+#endif
+
+#ifdef XZ_CODEC_AVAILABLE
+const string AVRO_XZ_CODEC = "xz";
+#endif
+
+#ifdef LZ4_CODEC_AVAILABLE
+const string AVRO_LZ4_CODEC = "lz4";
+#endif
+
 const size_t minSyncInterval = 32;
 const size_t maxSyncInterval = 1u << 30;
-
-boost::iostreams::zlib_params get_zlib_params() {
-    boost::iostreams::zlib_params ret;
-    ret.method = boost::iostreams::zlib::deflated;
-    ret.noheader = true;
-    return ret;
-}
 } // namespace
 
-DataFileWriterBase::DataFileWriterBase(const char *filename, const ValidSchema &schema, size_t syncInterval,
-                                       Codec codec) : filename_(filename),
-                                                      schema_(schema),
-                                                      encoderPtr_(binaryEncoder()),
-                                                      syncInterval_(syncInterval),
-                                                      codec_(codec),
-                                                      stream_(fileOutputStream(filename)),
-                                                      buffer_(memoryOutputStream()),
-                                                      sync_(makeSync()),
-                                                      objectCount_(0),
-                                                      lastSync_(0) {
-    init(schema, syncInterval, codec);
-}
-
-DataFileWriterBase::DataFileWriterBase(std::unique_ptr<OutputStream> outputStream,
-                                       const ValidSchema &schema, size_t syncInterval, Codec codec) : filename_(),
-                                                                                                      schema_(schema),
-                                                                                                      encoderPtr_(binaryEncoder()),
-                                                                                                      syncInterval_(syncInterval),
-                                                                                                      codec_(codec),
-                                                                                                      stream_(std::move(outputStream)),
-                                                                                                      buffer_(memoryOutputStream()),
-                                                                                                      sync_(makeSync()),
-                                                                                                      objectCount_(0),
-                                                                                                      lastSync_(0) {
-    init(schema, syncInterval, codec);
-}
-
-void DataFileWriterBase::init(const ValidSchema &schema, size_t syncInterval, const Codec &codec) {
-    if (syncInterval < minSyncInterval || syncInterval > maxSyncInterval) {
-        throw Exception(boost::format("Invalid sync interval: %1%. "
-                                      "Should be between %2% and %3%")
-                        % syncInterval % minSyncInterval % maxSyncInterval);
+static const string &codecName(Codec codec) {
+    switch (codec) {
+        case NULL_CODEC:
+            return AVRO_NULL_CODEC;
+        case DEFLATE_CODEC:
+            return AVRO_DEFLATE_CODEC;
+#ifdef SNAPPY_CODEC_AVAILABLE
+        case SNAPPY_CODEC:
+            return AVRO_SNAPPY_CODEC;
+#endif
+#ifdef ZSTD_CODEC_AVAILABLE
+        case ZSTD_CODEC:
+            return AVRO_ZSTD_CODEC;
+#endif
+#ifdef XZ_CODEC_AVAILABLE
+        case XZ_CODEC:
+            return AVRO_XZ_CODEC;
+#endif
+#ifdef LZ4_CODEC_AVAILABLE
+        case LZ4_CODEC:
+            return AVRO_LZ4_CODEC;
+#endif
+        default:
+            throw Exception(boost::format("Unknown codec: %1%") % codec);
     }
-    setMetadata(AVRO_CODEC_KEY, AVRO_NULL_CODEC);
+}
 
-    if (codec_ == NULL_CODEC) {
-        setMetadata(AVRO_CODEC_KEY, AVRO_NULL_CODEC);
-    } else if (codec_ == DEFLATE_CODEC) {
-        setMetadata(AVRO_CODEC_KEY, AVRO_DEFLATE_CODEC);
+static Codec builtinCodec(const string &name) {
+    if (name == AVRO_NULL_CODEC) {
+        return NULL_CODEC;
+    } else if (name == AVRO_DEFLATE_CODEC) {
+        return DEFLATE_CODEC;
 #ifdef SNAPPY_CODEC_AVAILABLE
-    } else if (codec_ == SNAPPY_CODEC) {
-        setMetadata(AVRO_CODEC_KEY, AVRO_SNAPPY_CODEC);
+    } else if (name == AVRO_SNAPPY_CODEC) {
+        return SNAPPY_CODEC;
+#endif
+#ifdef ZSTD_CODEC_AVAILABLE
+    } else if (name == AVRO_ZSTD_CODEC) {
+        return ZSTD_CODEC;
+#endif
+#ifdef XZ_CODEC_AVAILABLE
+    } else if (name == AVRO_XZ_CODEC) {
+        return XZ_CODEC;
+#endif
+#ifdef LZ4_CODEC_AVAILABLE
+    } else if (name == AVRO_LZ4_CODEC) {
+        return LZ4_CODEC;
 #endif
-    } else {
-        throw Exception(boost::format("Unknown codec: %1%") % codec);
     }
-    setMetadata(AVRO_SCHEMA_KEY, schema.toJson(false));
-
-    writeHeader();
-    encoderPtr_->init(*buffer_);
-
-    lastSync_ = stream_->byteCount();
+    throw Exception(boost::format("Codec %1% is not a built-in codec") % name);
 }
 
-DataFileWriterBase::~DataFileWriterBase() {
-    if (stream_) {
-        close();
+BlockCodecPtr blockCodec(Codec codec) {
+    BlockCodecPtr result = findCodec(codecName(codec));
+    if (!result) {
+        throw Exception(boost::format("Unknown codec: %1%") % codec);
     }
+    return result;
 }
 
-void DataFileWriterBase::close() {
-    flush();
-    stream_.reset();
-}
+/**
+ * The counters behind DataFileStats. Compression threads add to them
+ * too, so they are relaxed atomics, which cost next to nothing when
+ * there is no contention.
+ */
+class DataFileCounters {
+public:
+    typedef std::atomic<int64_t> Counter;
+
+    Counter blocks{0};
+    Counter objects{0};
+    Counter rawBytes{0};
+    Counter compressedBytes{0};
+    Counter encodeNanos{0};
+    Counter compressNanos{0};
+    Counter ioNanos{0};
+    Counter decodeNanos{0};
+    Counter filteredObjects{0};
+    Counter copiedBytes{0};
+    Counter bufferAllocations{0};
+    std::array<Counter, DataFileStats::sizeBuckets> blockSizes;
+    std::atomic<bool> timing{false};
+    // When encoding or decoding the current object started; only used by
+    // the thread calling the writer or reader.
+    int64_t start = 0;
+
+    DataFileCounters() {
+        for (Counter &c : blockSizes) {
+            c.store(0, std::memory_order_relaxed);
+        }
+    }
 
-void DataFileWriterBase::sync() {
-    encoderPtr_->flush();
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
 
-    encoderPtr_->init(*stream_);
-    avro::encode(*encoderPtr_, objectCount_);
-    if (codec_ == NULL_CODEC) {
-        int64_t byteCount = buffer_->byteCount();
-        avro::encode(*encoderPtr_, byteCount);
-        encoderPtr_->flush();
-        std::unique_ptr<InputStream> in = memoryInputStream(*buffer_);
-        copy(*in, *stream_);
-    } else if (codec_ == DEFLATE_CODEC) {
-        std::vector<char> buf;
-        {
-            boost::iostreams::filtering_ostream os;
-            os.push(boost::iostreams::zlib_compressor(get_zlib_params()));
-            os.push(boost::iostreams::back_inserter(buf));
-            const uint8_t *data;
-            size_t len;
-
-            std::unique_ptr<InputStream> input = memoryInputStream(*buffer_);
-            while (input->next(&data, &len)) {
-                boost::iostreams::write(os, reinterpret_cast<const char *>(data), len);
-            }
-        } // make sure all is flushed
-        std::unique_ptr<InputStream> in = memoryInputStream(
-            reinterpret_cast<const uint8_t *>(buf.data()), buf.size());
-        int64_t byteCount = buf.size();
-        avro::encode(*encoderPtr_, byteCount);
-        encoderPtr_->flush();
-        copy(*in, *stream_);
-#ifdef SNAPPY_CODEC_AVAILABLE
-    } else if (codec_ == SNAPPY_CODEC) {
-        std::vector<char> temp;
-        std::string compressed;
-        boost::crc_32_type crc;
-        {
-            boost::iostreams::filtering_ostream os;
-            os.push(boost::iostreams::back_inserter(temp));
-            const uint8_t *data;
-            size_t len;
-
-            std::unique_ptr<InputStream> input = memoryInputStream(*buffer_);
-            while (input->next(&data, &len)) {
-                boost::iostreams::write(os, reinterpret_cast<const char *>(data),
-                                        len);
-            }
-        } // make sure all is flushed
-
-        crc.process_bytes(reinterpret_cast<const char *>(temp.data()),
-                          temp.size());
-        // For Snappy, add the CRC32 checksum
-        int32_t checksum = crc();
-
-        // Now compress
-        size_t compressed_size = snappy::Compress(
-            reinterpret_cast<const char *>(temp.data()), temp.size(),
-            &compressed);
-        temp.clear();
-        {
-            boost::iostreams::filtering_ostream os;
-            os.push(boost::iostreams::back_inserter(temp));
-            boost::iostreams::write(os, compressed.c_str(), compressed_size);
-        }
-        temp.push_back((checksum >> 24) & 0xFF);
-        temp.push_back((checksum >> 16) & 0xFF);
-        temp.push_back((checksum >> 8) & 0xFF);
-        temp.push_back(checksum & 0xFF);
-        std::unique_ptr<InputStream> in = memoryInputStream(
-            reinterpret_cast<const uint8_t *>(temp.data()), temp.size());
-        int64_t byteCount = temp.size();
-        avro::encode(*encoderPtr_, byteCount);
-        encoderPtr_->flush();
-        copy(*in, *stream_);
-#endif
+    static void add(Counter &c, int64_t n) {
+        c.fetch_add(n, std::memory_order_relaxed);
     }
 
-    encoderPtr_->init(*stream_);
-    avro::encode(*encoderPtr_, sync_);
-    encoderPtr_->flush();
+    void block(int64_t objectCount, size_t raw, size_t stored) {
+        add(blocks, 1);
+        add(objects, objectCount);
+        add(rawBytes, static_cast<int64_t>(raw));
+        add(compressedBytes, static_cast<int64_t>(stored));
+        size_t bucket = 0;
+        while (bucket + 1 < DataFileStats::sizeBuckets && (raw >> (bucket + 1)) != 0) {
+            ++bucket;
+        }
+        add(blockSizes[bucket], 1);
+    }
 
-    lastSync_ = stream_->byteCount();
+    // Counts a copy of n bytes into buf, and its growing if it did.
+    template<typename Buffer>
+    void copied(size_t n, const Buffer &buf, size_t oldCapacity) {
+        add(copiedBytes, static_cast<int64_t>(n));
+        grown(buf, oldCapacity);
+    }
 
-    buffer_ = memoryOutputStream();
-    encoderPtr_->init(*buffer_);
-    objectCount_ = 0;
-}
+    template<typename Buffer>
+    void grown(const Buffer &buf, size_t oldCapacity) {
+        if (buf.capacity() != oldCapacity) {
+            add(bufferAllocations, 1);
+        }
+    }
 
-void DataFileWriterBase::syncIfNeeded() {
-    encoderPtr_->flush();
-    if (buffer_->byteCount() >= syncInterval_) {
-        sync();
+    // Moves what a block buffer counted into these counters.
+    void take(StreamCounters &c) {
+        add(copiedBytes, static_cast<int64_t>(c.copiedBytes));
+        add(bufferAllocations, static_cast<int64_t>(c.chunksAllocated));
+        c = StreamCounters();
     }
-}
 
-uint64_t DataFileWriterBase::getCurrentBlockStart() const {
-    return lastSync_;
-}
+    DataFileStats stats() const {
+        DataFileStats result;
+        result.blocks = blocks.load(std::memory_order_relaxed);
+        result.objects = objects.load(std::memory_order_relaxed);
+        result.rawBytes = rawBytes.load(std::memory_order_relaxed);
+        result.compressedBytes = compressedBytes.load(std::memory_order_relaxed);
+        result.encodeNanos = encodeNanos.load(std::memory_order_relaxed);
+        result.compressNanos = compressNanos.load(std::memory_order_relaxed);
+        result.ioNanos = ioNanos.load(std::memory_order_relaxed);
+        result.decodeNanos = decodeNanos.load(std::memory_order_relaxed);
+        result.filteredObjects = filteredObjects.load(std::memory_order_relaxed);
+        result.copiedBytes = copiedBytes.load(std::memory_order_relaxed);
+        result.bufferAllocations = bufferAllocations.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < DataFileStats::sizeBuckets; ++i) {
+            result.blockSizes[i] = blockSizes[i].load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+};
 
-void DataFileWriterBase::flush() {
-    sync();
-}
+namespace {
 
-boost::mt19937 random(static_cast<uint32_t>(time(nullptr)));
+/**
+ * Adds the time spent in its scope to a counter, if timing is on.
+ */
+class ScopedTimer {
+    DataFileCounters::Counter *counter_;
+    const int64_t start_;
 
-DataFileSync DataFileWriterBase::makeSync() {
-    DataFileSync sync;
-    std::generate(sync.begin(), sync.end(), random);
-    return sync;
-}
+public:
+    ScopedTimer(const DataFileCounters &counters, DataFileCounters::Counter &counter)
+        : counter_(counters.timing.load(std::memory_order_relaxed) ? &counter : nullptr),
+          start_(counter_ ? DataFileCounters::now() : 0) {}
 
-typedef array<uint8_t, 4> Magic;
-static Magic magic = {{'O', 'b', 'j', '\x01'}};
+    ~ScopedTimer() {
+        stop();
+    }
 
-void DataFileWriterBase::writeHeader() {
-    encoderPtr_->init(*stream_);
-    avro::encode(*encoderPtr_, magic);
-    avro::encode(*encoderPtr_, metadata_);
-    avro::encode(*encoderPtr_, sync_);
-    encoderPtr_->flush();
-}
+    // Ends the scope early.
+    void stop() {
+        if (counter_) {
+            DataFileCounters::add(*counter_, DataFileCounters::now() - start_);
+            counter_ = nullptr;
+        }
+    }
+};
 
-void DataFileWriterBase::setMetadata(const string &key, const string &value) {
-    vector<uint8_t> v(value.size());
-    copy(value.begin(), value.end(), v.begin());
-    metadata_[key] = v;
-}
+} // namespace
 
-DataFileReaderBase::DataFileReaderBase(const char *filename) : filename_(filename), codec_(NULL_CODEC), stream_(fileSeekableInputStream(filename)),
-                                                               decoder_(binaryDecoder()), objectCount_(0), eof_(false), blockStart_(-1),
-                                                               blockEnd_(-1) {
-    readHeader();
-}
+/**
+ * Holds the block being written in one contiguous region, which keeps its
+ * capacity from one block to the next so that, once it has grown to the
+ * largest block, writing blocks allocates nothing. Its stream counters
+ * count what it allocates and copies, until the writer takes them.
+ */
+class DataFileWriterBase::BlockBuffer : public OutputStream {
+    MemoryResource &resource_;
+    uint8_t *data_;
+    size_t capacity_;
+    size_t size_;
+
+    void grow(size_t capacity) {
+        uint8_t *d = static_cast<uint8_t *>(resource_.allocate(capacity, 1));
+        std::copy(data_, data_ + size_, d);
+        resource_.deallocate(data_, capacity_, 1);
+        data_ = d;
+        capacity_ = capacity;
+        ++counters_.chunksAllocated;
+        counters_.copiedBytes += size_;
+    }
 
-DataFileReaderBase::DataFileReaderBase(std::unique_ptr<InputStream> inputStream) : codec_(NULL_CODEC), stream_(std::move(inputStream)),
-                                                                                   decoder_(binaryDecoder()), objectCount_(0), eof_(false) {
-    readHeader();
-}
+public:
+    /// A buffer from the memory resource of \p options, starting at its
+    /// chunk size.
+    static BlockBuffer *make(const StreamOptions &options) {
+        return new BlockBuffer(options.memoryResource != nullptr ? *options.memoryResource : *defaultMemoryResource(),
+                               options.chunkSize != 0 ? options.chunkSize : 4 * 1024);
+    }
 
-void DataFileReaderBase::init() {
-    readerSchema_ = dataSchema_;
-    dataDecoder_ = binaryDecoder();
-    readDataBlock();
-}
+    BlockBuffer(MemoryResource &resource, size_t capacity) : resource_(resource),
+                                                             data_(static_cast<uint8_t *>(resource.allocate(capacity, 1))),
+                                                             capacity_(capacity), size_(0) {
+        ++counters_.chunksAllocated;
+    }
 
-void DataFileReaderBase::init(const ValidSchema &readerSchema) {
-    readerSchema_ = readerSchema;
-    dataDecoder_ = (readerSchema_.toJson(true) != dataSchema_.toJson(true)) ? resolvingDecoder(dataSchema_, readerSchema_, binaryDecoder()) : binaryDecoder();
-    readDataBlock();
-}
+    ~BlockBuffer() override {
+        resource_.deallocate(data_, capacity_, 1);
+    }
 
-static void drain(InputStream &in) {
-    const uint8_t *p = nullptr;
-    size_t n = 0;
-    while (in.next(&p, &n))
-        ;
-}
+    bool next(uint8_t **data, size_t *len) override {
+        if (size_ == capacity_) {
+            grow(2 * capacity_);
+        }
+        *data = data_ + size_;
+        *len = capacity_ - size_;
+        size_ = capacity_;
+        return true;
+    }
 
-char hex(unsigned int x) {
-    return static_cast<char>(x + (x < 10 ? '0' : ('a' - 10)));
-}
+    void backup(size_t len) override {
+        size_ -= len;
+    }
 
-std::ostream &operator<<(std::ostream &os, const DataFileSync &s) {
-    for (uint8_t i : s) {
-        os << hex(i / 16) << hex(i % 16) << ' ';
+    uint64_t byteCount() const override {
+        return size_;
     }
-    os << std::endl;
-    return os;
-}
 
-bool DataFileReaderBase::hasMore() {
-    for (;;) {
-        if (eof_) {
-            return false;
-        } else if (objectCount_ != 0) {
-            return true;
-        }
+    void flush() override {}
 
-        dataDecoder_->init(*dataStream_);
-        drain(*dataStream_);
-        DataFileSync s;
-        decoder_->init(*stream_);
-        avro::decode(*decoder_, s);
-        if (s != sync_) {
-            throw Exception("Sync mismatch");
+    const uint8_t *data() const { return data_; }
+    size_t size() const { return size_; }
+    void clear() { size_ = 0; }
+
+    void append(const uint8_t *data, size_t len) {
+        if (capacity_ - size_ < len) {
+            grow(std::max(2 * capacity_, size_ + len));
         }
-        readDataBlock();
+        std::copy(data, data + len, data_ + size_);
+        counters_.copiedBytes += len;
+        size_ += len;
+    }
+};
+
+/**
+ * The data file's own stream, for the encoder to write the objects of a
+ * direct block to. flush() does nothing, since the writer flushes the
+ * encoder after every object; the stream is flushed when the block
+ * ends. It follows stream_ to the files rolled on to.
+ */
+class DataFileWriterBase::BlockStream : public OutputStream {
+    std::unique_ptr<OutputStream> &out_;
+
+public:
+    explicit BlockStream(std::unique_ptr<OutputStream> &out) : out_(out) {}
+
+    bool next(uint8_t **data, size_t *len) override {
+        return out_->next(data, len);
+    }
+
+    void backup(size_t len) override {
+        out_->backup(len);
+    }
+
+    uint64_t byteCount() const override {
+        return out_->byteCount();
+    }
+
+    void flush() override {}
+};
+
+// The bytes of each of the two varints in front of a direct block.
+const size_t directHeaderWidth = 5;
+
+// Writes n as a varint of exactly width bytes. The padding is of bytes
+// with the continuation bit set and nothing else, which decoders add up
+// to the same value as the shortest form.
+static void encodePaddedLong(int64_t n, uint8_t *out, size_t width) {
+    uint64_t v = encodeZigzag64(n);
+    if ((v >> (7 * width)) != 0) {
+        throw Exception(boost::format("%1% does not fit in a block header of %2% bytes") % n % width);
     }
+    for (size_t i = 0; i + 1 < width; ++i) {
+        out[i] = static_cast<uint8_t>(v | 0x80);
+        v >>= 7;
+    }
+    out[width - 1] = static_cast<uint8_t>(v);
 }
 
-class BoundedInputStream : public InputStream {
-    InputStream &in_;
-    size_t limit_;
+/**
+ * Appends a block to out as one list of chunks: the object count and
+ * size, the (compressed) data and the sync marker. Streams over files
+ * and sockets write the list with a single writev(), so the block data
+ * is not copied into the stream's buffer. The stream is flushed, so that
+ * every complete block reaches the file.
+ */
+static void writeBlock(OutputStream &out, int64_t objectCount,
+                       const uint8_t *data, size_t len, const DataFileSync &sync) {
+    array<uint8_t, 10> count;
+    array<uint8_t, 10> size;
+    OutputChunk chunks[] = {
+        {count.data(), encodeInt64(objectCount, count)},
+        {size.data(), encodeInt64(static_cast<int64_t>(len), size)},
+        {data, len},
+        {sync.data(), sync.size()}};
+    out.writeChunks(chunks, sizeof(chunks) / sizeof(chunks[0]));
+    out.flush();
+}
 
-    bool next(const uint8_t **data, size_t *len) override {
-        if (limit_ != 0 && in_.next(data, len)) {
-            if (*len > limit_) {
-                in_.backup(*len - limit_);
-                *len = limit_;
+/**
+ * Compresses blocks in tasks on an executor. Whichever task finds the
+ * oldest block compressed appends it, and the blocks compressed after it,
+ * to the file, so that they are written in the order in which they were
+ * handed over.
+ */
+class DataFileWriterBase::BlockPipeline {
+    struct Block {
+        std::unique_ptr<BlockBuffer> raw;
+        int64_t objectCount;
+        int level;
+        std::unique_ptr<BlockStatistics> stats;
+        std::vector<char> compressed;
+        size_t compressedSize;
+        // The xxHash64() of compressed, if the index keeps it.
+        uint64_t checksum;
+        bool ready;
+
+        Block(std::unique_ptr<BlockBuffer> r, int64_t n, int l, std::unique_ptr<BlockStatistics> st) : raw(std::move(r)), objectCount(n), level(l), stats(std::move(st)),
+                                                                                                     compressedSize(0), checksum(0), ready(false) {}
+    };
+    typedef std::shared_ptr<Block> BlockPtr;
+
+    DataFileWriterBase &writer_;
+    const BlockCodecPtr codec_;
+    const size_t maxPending_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    // Blocks not yet written, in file order.
+    std::deque<BlockPtr> pending_;
+    // Buffers of written blocks, kept for the blocks to come, and the
+    // compressors of the tasks that are done.
+    std::vector<std::unique_ptr<BlockBuffer>> spareBuffers_;
+    std::vector<std::vector<char>> spareCompressed_;
+    std::vector<std::unique_ptr<BlockCompressor>> spareCompressors_;
+    // Whether a task is appending blocks to the file.
+    bool writing_;
+    std::exception_ptr error_;
+
+    TaskGroup tasks_;
+
+    void setError() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error_) {
+            error_ = std::current_exception();
+        }
+    }
+
+    void compress(const BlockPtr &b) {
+        std::unique_ptr<BlockCompressor> compressor;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!spareCompressors_.empty()) {
+                compressor = std::move(spareCompressors_.back());
+                spareCompressors_.pop_back();
             }
-            limit_ -= *len;
-            return true;
         }
-        return false;
+        try {
+            if (!compressor) {
+                compressor = codec_->newCompressor();
+            }
+            ScopedTimer timer(*writer_.counters_, writer_.counters_->compressNanos);
+            size_t capacity = b->compressed.capacity();
+            b->compressedSize = compressor->compress(b->raw->data(), b->raw->size(),
+                                                     b->level, b->compressed);
+            writer_.counters_->grown(b->compressed, capacity);
+            if (writer_.blockChecksums_) {
+                b->checksum = xxHash64(reinterpret_cast<const uint8_t *>(b->compressed.data()),
+                                       b->compressedSize);
+            }
+        } catch (...) {
+            setError();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (compressor) {
+                spareCompressors_.push_back(std::move(compressor));
+            }
+            b->ready = true;
+            if (writing_) {
+                // The task writing will get to this block.
+                return;
+            }
+            writing_ = true;
+        }
+        writeReady();
     }
 
-    void backup(size_t len) override {
-        in_.backup(len);
-        limit_ += len;
+    // Appends the compressed blocks at the front of pending_.
+    void writeReady() {
+        for (;;) {
+            BlockPtr b;
+            bool failed;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (pending_.empty() || !pending_.front()->ready) {
+                    writing_ = false;
+                    return;
+                }
+                b = pending_.front();
+                failed = static_cast<bool>(error_);
+            }
+            if (!failed) {
+                try {
+                    OutputStream &out = *writer_.stream_;
+                    int64_t start = out.byteCount();
+                    {
+                        ScopedTimer timer(*writer_.counters_, writer_.counters_->ioNanos);
+                        writeBlock(out, b->objectCount,
+                                   reinterpret_cast<const uint8_t *>(b->compressed.data()),
+                                   b->compressedSize, writer_.sync_);
+                    }
+                    writer_.counters_->block(b->objectCount, b->raw->size(), b->compressedSize);
+                    writer_.counters_->take(b->raw->counters());
+                    writer_.lastSync_ = out.byteCount();
+                    if (b->stats) {
+                        // Only the writing task touches the statistics
+                        // until the pipeline is drained.
+                        b->stats->offset = start;
+                        writer_.blockStatistics_.push_back(std::move(*b->stats));
+                    }
+                    if (writer_.blockChecksums_) {
+                        writer_.blockIndex_.add(start, b->objectCount, b->checksum);
+                    } else if (writer_.indexStream_) {
+                        writer_.blockIndex_.add(start, b->objectCount);
+                    }
+                } catch (...) {
+                    setError();
+                }
+            }
+            b->raw->clear();
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                spareBuffers_.push_back(std::move(b->raw));
+                spareCompressed_.push_back(std::move(b->compressed));
+                pending_.pop_front();
+            }
+            cond_.notify_all();
+        }
     }
 
-    void skip(size_t len) override {
-        if (len > limit_) {
-            len = limit_;
+    // Waits until done(), compressing the blocks no task has started on
+    // meanwhile.
+    void waitFor(std::unique_lock<std::mutex> &lock, const std::function<bool()> &done) {
+        while (!done()) {
+            lock.unlock();
+            bool ran = tasks_.runPending();
+            lock.lock();
+            if (!ran && !done()) {
+                cond_.wait(lock);
+            }
         }
-        in_.skip(len);
-        limit_ -= len;
     }
 
-    size_t byteCount() const override {
-        return in_.byteCount();
+    // The error stays: the failed block is gone, so no later one may
+    // follow it into the file.
+    void rethrow() {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
     }
 
 public:
-    BoundedInputStream(InputStream &in, size_t limit) : in_(in), limit_(limit) {}
-};
-
-unique_ptr<InputStream> boundedInputStream(InputStream &in, size_t limit) {
-    return unique_ptr<InputStream>(new BoundedInputStream(in, limit));
-}
+    BlockPipeline(DataFileWriterBase &writer, size_t threads, size_t maxPending,
+                  const ExecutorPtr &executor) : writer_(writer), codec_(writer.codec_),
+                                                 maxPending_(maxPending), writing_(false),
+                                                 tasks_(executor, threads) {
+    }
 
-void DataFileReaderBase::readDataBlock() {
-    decoder_->init(*stream_);
-    blockStart_ = stream_->byteCount();
-    const uint8_t *p = nullptr;
-    size_t n = 0;
-    if (!stream_->next(&p, &n)) {
-        eof_ = true;
-        return;
+    ~BlockPipeline() {
+        tasks_.wait();
     }
-    stream_->backup(n);
-    avro::decode(*decoder_, objectCount_);
-    int64_t byteCount;
-    avro::decode(*decoder_, byteCount);
-    decoder_->init(*stream_);
-    blockEnd_ = stream_->byteCount() + byteCount;
 
-    unique_ptr<InputStream> st = boundedInputStream(*stream_, static_cast<size_t>(byteCount));
-    if (codec_ == NULL_CODEC) {
-        dataDecoder_->init(*st);
-        dataStream_ = std::move(st);
-#ifdef SNAPPY_CODEC_AVAILABLE
-    } else if (codec_ == SNAPPY_CODEC) {
-        boost::crc_32_type crc;
-        uint32_t checksum = 0;
-        compressed_.clear();
-        uncompressed.clear();
-        const uint8_t *data;
-        size_t len;
-        while (st->next(&data, &len)) {
-            compressed_.insert(compressed_.end(), data, data + len);
-        }
-        len = compressed_.size();
-        int b1 = compressed_[len - 4] & 0xFF;
-        int b2 = compressed_[len - 3] & 0xFF;
-        int b3 = compressed_[len - 2] & 0xFF;
-        int b4 = compressed_[len - 1] & 0xFF;
-
-        checksum = (b1 << 24) + (b2 << 16) + (b3 << 8) + (b4);
-        if (!snappy::Uncompress(reinterpret_cast<const char *>(compressed_.data()),
-                                len - 4, &uncompressed)) {
-            throw Exception(
-                "Snappy Compression reported an error when decompressing");
-        }
-        crc.process_bytes(uncompressed.c_str(), uncompressed.size());
-        uint32_t c = crc();
-        if (checksum != c) {
-            throw Exception(
-                boost::format("Checksum did not match for Snappy compression: Expected: %1%, computed: %2%") % checksum
-                % c);
-        }
-        os_.reset(new boost::iostreams::filtering_istream());
-        os_->push(
-            boost::iostreams::basic_array_source<char>(uncompressed.c_str(),
-                                                       uncompressed.size()));
-        std::unique_ptr<InputStream> in = istreamInputStream(*os_);
-
-        dataDecoder_->init(*in);
-        dataStream_ = std::move(in);
-#endif
-    } else {
-        compressed_.clear();
-        const uint8_t *data;
-        size_t len;
-        while (st->next(&data, &len)) {
-            compressed_.insert(compressed_.end(), data, data + len);
+    /**
+     * Queues the filled block in \p raw, waiting while too many blocks are
+     * in flight, and leaves an empty buffer there for the next one.
+     * Reports any failure from earlier blocks, leaving \p raw as it is.
+     */
+    void push(std::unique_ptr<BlockBuffer> &raw, int64_t objectCount, int level,
+              std::unique_ptr<BlockStatistics> stats) {
+        BlockPtr b;
+        std::unique_ptr<BlockBuffer> next;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            waitFor(lock, [this] { return error_ || pending_.size() < maxPending_; });
+            rethrow();
+            b = std::make_shared<Block>(std::move(raw), objectCount, level, std::move(stats));
+            if (!spareBuffers_.empty()) {
+                next = std::move(spareBuffers_.back());
+                spareBuffers_.pop_back();
+            }
+            if (!spareCompressed_.empty()) {
+                b->compressed.swap(spareCompressed_.back());
+                spareCompressed_.pop_back();
+            }
+            pending_.push_back(b);
+        }
+        tasks_.run([this, b] { compress(b); });
+        if (!next) {
+            next.reset(BlockBuffer::make(writer_.bufferOptions_));
         }
-        os_.reset(new boost::iostreams::filtering_istream());
-        os_->push(boost::iostreams::zlib_decompressor(get_zlib_params()));
-        os_->push(boost::iostreams::basic_array_source<char>(
-            compressed_.data(), compressed_.size()));
+        raw = std::move(next);
+    }
 
-        std::unique_ptr<InputStream> in = nonSeekableIstreamInputStream(*os_);
-        dataDecoder_->init(*in);
-        dataStream_ = std::move(in);
+    /**
+     * Waits until every queued block has been written.
+     * Reports any failure, as every later call will.
+     */
+    void drain() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        waitFor(lock, [this] { return pending_.empty(); });
+        rethrow();
     }
+};
+
+DataFileWriterBase::DataFileWriterBase(const char *filename, const ValidSchema &schema, size_t syncInterval,
+                                       Codec codec) : DataFileWriterBase(filename, schema, syncInterval,
+                                                                         blockCodec(codec), StreamOptions()) {
 }
 
-void DataFileReaderBase::close() {
+DataFileWriterBase::DataFileWriterBase(std::unique_ptr<OutputStream> outputStream,
+                                       const ValidSchema &schema, size_t syncInterval, Codec codec)
+    : DataFileWriterBase(std::move(outputStream), schema, syncInterval, blockCodec(codec), StreamOptions()) {
+}
+
+DataFileWriterBase::DataFileWriterBase(const char *filename, const ValidSchema &schema, size_t syncInterval,
+                                       Codec codec, const StreamOptions &options)
+    : DataFileWriterBase(filename, schema, syncInterval, blockCodec(codec), options) {
+}
+
+DataFileWriterBase::DataFileWriterBase(std::unique_ptr<OutputStream> outputStream,
+                                       const ValidSchema &schema, size_t syncInterval, Codec codec,
+                                       const StreamOptions &options)
+    : DataFileWriterBase(std::move(outputStream), schema, syncInterval, blockCodec(codec), options) {
+}
+
+DataFileWriterBase::DataFileWriterBase(const char *filename, const ValidSchema &schema, size_t syncInterval,
+                                       const BlockCodecPtr &codec, const StreamOptions &options) : filename_(filename),
+                                                                                                   schema_(schema),
+                                                                                                   encoderPtr_(binaryEncoder()),
+                                                                                                   syncInterval_(syncInterval),
+                                                                                                   codec_(codec),
+                                                                                                   compressionLevel_(0),
+                                                                                                   bufferOptions_(options),
+                                                                                                   stream_(fileOutputStream(filename, options)),
+                                                                                                   buffer_(BlockBuffer::make(options)),
+                                                                                                   sync_(makeSync()),
+                                                                                                   objectCount_(0),
+                                                                                                   lastSync_(0) {
+    init(schema, syncInterval);
+}
+
+DataFileWriterBase::DataFileWriterBase(std::unique_ptr<OutputStream> outputStream,
+                                       const ValidSchema &schema, size_t syncInterval,
+                                       const BlockCodecPtr &codec, const StreamOptions &options) : filename_(),
+                                                                                                   schema_(schema),
+                                                                                                   encoderPtr_(binaryEncoder()),
+                                                                                                   syncInterval_(syncInterval),
+                                                                                                   codec_(codec),
+                                                                                                   compressionLevel_(0),
+                                                                                                   bufferOptions_(options),
+                                                                                                   stream_(std::move(outputStream)),
+                                                                                                   buffer_(BlockBuffer::make(options)),
+                                                                                                   sync_(makeSync()),
+                                                                                                   objectCount_(0),
+                                                                                                   lastSync_(0) {
+    init(schema, syncInterval);
+}
+
+void DataFileWriterBase::init(const ValidSchema &schema, size_t syncInterval) {
+    if (syncInterval < minSyncInterval || syncInterval > maxSyncInterval) {
+        throw Exception(boost::format("Invalid sync interval: %1%. "
+                                      "Should be between %2% and %3%")
+                        % syncInterval % minSyncInterval % maxSyncInterval);
+    }
+    if (!codec_) {
+        throw Exception("No codec given");
+    }
+    const string name = codec_->name();
+    setMetadata(AVRO_CODEC_KEY, name);
+    codec_->addMetadata(metadata_);
+    compressionLevel_ = codec_->defaultLevel();
+    setMetadata(AVRO_SCHEMA_KEY, schema.json(false));
+    if (name != AVRO_NULL_CODEC) {
+        compressor_ = codec_->newCompressor();
+    }
+    counters_.reset(new DataFileCounters());
+    syncThreshold_ = syncInterval;
+
+    writeHeader();
+    encoderPtr_->init(*buffer_);
+
+    lastSync_ = stream_->byteCount();
+    dataStart_ = lastSync_;
+}
+
+DataFileWriterBase::~DataFileWriterBase() {
+    if (stream_) {
+        try {
+            close();
+        } catch (...) {
+            // close() has nowhere to report a failed block from here.
+        }
+    }
+}
+
+void DataFileWriterBase::close() {
+    flush();
+    pipeline_.reset();
+    if (statisticsStream_) {
+        writeBlockStatistics(std::move(statisticsStream_), blockStatistics_);
+    }
+    if (indexStream_) {
+        writeDataFileIndex(std::move(indexStream_), blockIndex_);
+    }
+    stream_.reset();
+}
+
+void DataFileWriterBase::roll(const char *filename) {
+    if (!stream_) {
+        throw Exception("Cannot roll a closed data file writer");
+    }
+    flush();
+    rollTo(fileOutputStream(filename, bufferOptions_), filename);
+}
+
+void DataFileWriterBase::roll(std::unique_ptr<OutputStream> outputStream) {
+    if (!stream_) {
+        throw Exception("Cannot roll a closed data file writer");
+    }
+    flush();
+    rollTo(std::move(outputStream), string());
+}
+
+void DataFileWriterBase::rollTo(std::unique_ptr<OutputStream> outputStream, const string &filename) {
+    bool statistics = statisticsStream_ != nullptr;
+    bool index = indexStream_ != nullptr;
+    if (statistics) {
+        writeBlockStatistics(std::move(statisticsStream_), blockStatistics_);
+    }
+    if (index) {
+        writeDataFileIndex(std::move(indexStream_), blockIndex_);
+    }
+    stream_->flush();
+    stream_ = std::move(outputStream);
+    filename_ = filename;
+    blockStatistics_.clear();
+    blockIndex_ = DataFileIndex();
+    if (statistics && statisticsNamed_ && !filename_.empty()) {
+        statisticsStream_ = fileOutputStream((filename_ + ".stats").c_str());
+    } else {
+        statisticsCollector_.reset();
+        statisticsNamed_ = false;
+    }
+    if (index && indexNamed_ && !filename_.empty()) {
+        indexStream_ = fileOutputStream((filename_ + ".idx").c_str());
+    } else {
+        blockChecksums_ = false;
+        indexNamed_ = false;
+    }
+
+    if (codecSelector_ && codecSelector_->hasSamples()) {
+        changeCodec(codecSelector_->select());
+    }
+    sync_ = makeSync();
+    writeHeader();
+    encoderPtr_->init(*buffer_);
+    lastSync_ = stream_->byteCount();
+    dataStart_ = lastSync_;
+    rolledBytes_ = counters_->compressedBytes.load(std::memory_order_relaxed);
+    if (direct_) {
+        direct_ = canWriteDirect();
+    }
+}
+
+void DataFileWriterBase::changeCodec(const CodecSetting &setting) {
+    if (setting.codec != codec_) {
+        const string name = setting.codec->name();
+        Metadata previous;
+        codec_->addMetadata(previous);
+        for (Metadata::const_iterator it = previous.begin(); it != previous.end(); ++it) {
+            metadata_.erase(it->first);
+        }
+        codec_ = setting.codec;
+        setMetadata(AVRO_CODEC_KEY, name);
+        codec_->addMetadata(metadata_);
+        header_.clear();
+        compressor_.reset();
+        if (name != AVRO_NULL_CODEC) {
+            compressor_ = codec_->newCompressor();
+        }
+        // The pipeline keeps compressors of the old codec.
+        setCompressionThreads(compressionThreads_, maxPendingBlocks_);
+    }
+    compressionLevel_ = setting.level;
+}
+
+int64_t DataFileWriterBase::fileBytes() const {
+    return dataStart_ + counters_->compressedBytes.load(std::memory_order_relaxed) - rolledBytes_;
+}
+
+void DataFileWriterBase::sync() {
+    encoderPtr_->flush();
+
+    if (blockOpen_) {
+        size_t len = blockBytes();
+        {
+            ScopedTimer timer(*counters_, counters_->ioNanos);
+            array<uint8_t, 2 * directHeaderWidth> header;
+            encodePaddedLong(objectCount_, header.data(), directHeaderWidth);
+            encodePaddedLong(static_cast<int64_t>(len), header.data() + directHeaderWidth, directHeaderWidth);
+            if (!stream_->rewrite(blockData_ - header.size(), header.data(), header.size())) {
+                throw Exception("Output stream cannot rewrite the header of a direct block");
+            }
+            encoderPtr_->encodeFixed(sync_.data(), sync_.size());
+            encoderPtr_->flush();
+            stream_->flush();
+        }
+        if (indexStream_) {
+            blockIndex_.add(lastSync_, objectCount_);
+        }
+        counters_->block(objectCount_, len, len);
+        lastSync_ = stream_->byteCount();
+        blockOpen_ = false;
+        objectCount_ = 0;
+        updateSyncThreshold();
+        return;
+    }
+
+    std::unique_ptr<BlockStatistics> stats;
+    if (statisticsCollector_ && objectCount_ != 0) {
+        stats.reset(new BlockStatistics(statisticsCollector_->collect(buffer_->data(), buffer_->size(), objectCount_)));
+    }
+    if (codecSelector_ && objectCount_ != 0) {
+        codecSelector_->sample(buffer_->data(), buffer_->size());
+    }
+
+    if (pipeline_) {
+        pipeline_->push(buffer_, objectCount_, compressionLevel_, std::move(stats));
+        encoderPtr_->init(*buffer_);
+        objectCount_ = 0;
+        // The ratio lags behind by the blocks in flight.
+        updateSyncThreshold();
+        return;
+    }
+
+    const uint8_t *data = buffer_->data();
+    size_t len = buffer_->size();
+    if (compressor_) {
+        ScopedTimer timer(*counters_, counters_->compressNanos);
+        size_t capacity = compressed_.capacity();
+        len = compressor_->compress(data, len, compressionLevel_, compressed_);
+        counters_->grown(compressed_, capacity);
+        data = reinterpret_cast<const uint8_t *>(compressed_.data());
+    }
+
+    if (stats) {
+        stats->offset = lastSync_;
+        blockStatistics_.push_back(std::move(*stats));
+    }
+    if (blockChecksums_) {
+        blockIndex_.add(lastSync_, objectCount_, xxHash64(data, len));
+    } else if (indexStream_) {
+        blockIndex_.add(lastSync_, objectCount_);
+    }
+
+    {
+        ScopedTimer timer(*counters_, counters_->ioNanos);
+        writeBlock(*stream_, objectCount_, data, len, sync_);
+    }
+    counters_->block(objectCount_, buffer_->size(), len);
+    counters_->take(buffer_->counters());
+
+    lastSync_ = stream_->byteCount();
+
+    buffer_->clear();
+    encoderPtr_->init(*buffer_);
+    objectCount_ = 0;
+    updateSyncThreshold();
+}
+
+void DataFileWriterBase::syncIfNeeded() {
+    encoderPtr_->flush();
+    bool end = blockBytes() >= syncThreshold_ || (syncPolicy_.maxObjects != 0 && objectCount_ >= syncPolicy_.maxObjects);
+    if (syncPolicy_.maxLatency.count() != 0) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (objectCount_ == 0) {
+            blockOpened_ = now;
+        } else if (end || now - blockOpened_ >= syncPolicy_.maxLatency) {
+            sync();
+            blockOpened_ = now;
+            end = false;
+        }
+    }
+    if (end) {
+        sync();
+    }
+    if (direct_ && !blockOpen_) {
+        openBlock();
+    }
+    if (timing_) {
+        counters_->start = DataFileCounters::now();
+    }
+}
+
+void DataFileWriterBase::syncIfNeeded(size_t next) {
+    if (objectCount_ != 0) {
+        encoderPtr_->flush();
+        if (blockBytes() + next > syncThreshold_) {
+            sync();
+        }
+    }
+    syncIfNeeded();
+}
+
+void DataFileWriterBase::openBlock() {
+    encoderPtr_->init(*blockStream_);
+    const uint8_t slot[2 * directHeaderWidth] = {};
+    encoderPtr_->encodeFixed(slot, sizeof(slot));
+    encoderPtr_->flush();
+    blockData_ = stream_->byteCount();
+    blockOpen_ = true;
+}
+
+size_t DataFileWriterBase::blockBytes() const {
+    return blockOpen_ ? static_cast<size_t>(stream_->byteCount() - blockData_) : buffer_->size();
+}
+
+bool DataFileWriterBase::canWriteDirect() const {
+    // The last byte written is that of a sync marker, which is written
+    // over with itself to find out.
+    return !compressor_ && stream_->byteCount() != 0 && stream_->rewrite(stream_->byteCount() - 1, &sync_.back(), 1);
+}
+
+void DataFileWriterBase::setDirectBlocks() {
+    if (objectCount_ != 0 || blockOpen_) {
+        throw Exception("Direct blocks must be set up between blocks");
+    }
+    if (statisticsCollector_ || blockChecksums_) {
+        throw Exception("Direct blocks cannot have block statistics or checksums");
+    }
+    if (compressor_) {
+        throw Exception("Direct blocks need the null codec");
+    }
+    if (!canWriteDirect()) {
+        throw Exception("Direct blocks need an output stream that can rewrite");
+    }
+    if (!blockStream_) {
+        blockStream_.reset(new BlockStream(stream_));
+    }
+    direct_ = true;
+}
+
+void DataFileWriterBase::encoded() {
+    DataFileCounters::add(counters_->encodeNanos, DataFileCounters::now() - counters_->start);
+}
+
+void DataFileWriterBase::setTiming(bool enabled) {
+    timing_ = enabled;
+    counters_->timing = enabled;
+    counters_->start = DataFileCounters::now();
+}
+
+DataFileStats DataFileWriterBase::stats() const {
+    return counters_->stats();
+}
+
+size_t DataFileWriterBase::batchRoom(size_t n) const {
+    int64_t objects = counters_->objects.load(std::memory_order_relaxed);
+    int64_t bytes = counters_->rawBytes.load(std::memory_order_relaxed);
+    if (objectCount_ != 0) {
+        objects += objectCount_;
+        bytes += static_cast<int64_t>(blockBytes());
+    }
+    size_t room = 1;
+    if (objects != 0 && bytes != 0) {
+        size_t average = std::max(static_cast<size_t>(bytes / objects), static_cast<size_t>(1));
+        size_t used = blockBytes();
+        room = std::max((used < syncThreshold_ ? syncThreshold_ - used : 0) / average, static_cast<size_t>(1));
+    }
+    if (syncPolicy_.maxObjects != 0) {
+        int64_t left = syncPolicy_.maxObjects - objectCount_;
+        room = std::min(room, static_cast<size_t>(std::max(left, static_cast<int64_t>(1))));
+    }
+    return std::min(room, n);
+}
+
+void DataFileWriterBase::writeEncoded(const uint8_t *data, size_t len, int64_t n) {
+    encoderPtr_->flush();
+    if (direct_) {
+        if (!blockOpen_) {
+            openBlock();
+        }
+        encoderPtr_->encodeFixed(data, len);
+    } else {
+        buffer_->append(data, len);
+    }
+    incr(n);
+}
+
+void DataFileWriterBase::writeEncodedBlock(const uint8_t *data, size_t len, int64_t n) {
+    if (objectCount_ != 0) {
+        sync();
+    }
+    writeEncoded(data, len, n);
+    sync();
+}
+
+void DataFileWriterBase::appendEncodedBatch(const uint8_t *data, size_t len,
+                                            int64_t count, bool validate) {
+    if (count < 0) {
+        throw Exception(boost::format("Invalid object count: %1%") % count);
+    }
+    if (!validate) {
+        syncIfNeeded();
+        writeEncoded(data, len, count);
+        return;
+    }
+
+    if (!batchValidator_) {
+        batchValidator_.reset(new BinaryValidator(schema_));
+    }
+    // The whole batch is checked before any of it is written.
+    batchEnds_.clear();
+    std::unique_ptr<InputStream> in = memoryInputStream(data, len);
+    for (int64_t i = 0; i < count; ++i) {
+        batchValidator_->validate(*in);
+        batchEnds_.push_back(static_cast<size_t>(in->byteCount()));
+    }
+    if (static_cast<size_t>(in->byteCount()) != len) {
+        throw Exception(boost::format("Batch of %1% objects has %2% bytes past them")
+                        % count % (len - in->byteCount()));
+    }
+
+    size_t start = 0;
+    for (size_t done = 0; done < batchEnds_.size();) {
+        syncIfNeeded();
+        size_t n = batchRoom(batchEnds_.size() - done);
+        size_t end = batchEnds_[done + n - 1];
+        writeEncoded(data + start, end - start, static_cast<int64_t>(n));
+        start = end;
+        done += n;
+    }
+}
+
+void DataFileWriterBase::syncIfStale() {
+    if (syncPolicy_.maxLatency.count() != 0 && objectCount_ != 0 &&
+        std::chrono::steady_clock::now() - blockOpened_ >= syncPolicy_.maxLatency) {
+        sync();
+    }
+}
+
+void DataFileWriterBase::setSyncPolicy(const SyncPolicy &policy) {
+    if (policy.targetBlockSize != 0 && policy.targetBlockSize < minSyncInterval) {
+        throw Exception(boost::format("Invalid target block size: %1%. Should be at least %2%")
+                        % policy.targetBlockSize % minSyncInterval);
+    }
+    syncPolicy_ = policy;
+    blockOpened_ = std::chrono::steady_clock::now();
+    updateSyncThreshold();
+}
+
+void DataFileWriterBase::updateSyncThreshold() {
+    syncThreshold_ = syncInterval_;
+    if (syncPolicy_.targetBlockSize == 0) {
+        return;
+    }
+    int64_t raw = counters_->rawBytes.load(std::memory_order_relaxed);
+    int64_t stored = counters_->compressedBytes.load(std::memory_order_relaxed);
+    if (raw == 0 || stored == 0) {
+        return;
+    }
+    double threshold = static_cast<double>(syncPolicy_.targetBlockSize) * raw / stored;
+    syncThreshold_ = static_cast<size_t>(std::min(std::max(threshold, static_cast<double>(minSyncInterval)),
+                                                  static_cast<double>(maxSyncInterval)));
+}
+
+uint64_t DataFileWriterBase::getCurrentBlockStart() const {
+    if (pipeline_) {
+        pipeline_->drain();
+    }
+    return lastSync_;
+}
+
+void DataFileWriterBase::flush() {
+    sync();
+    if (pipeline_) {
+        pipeline_->drain();
+    }
+    if (committer_) {
+        committer_->commit(*stream_);
+    }
+}
+
+void DataFileWriterBase::setGroupCommitter(std::shared_ptr<GroupCommitter> committer) {
+    committer_ = std::move(committer);
+}
+
+void DataFileWriterBase::setCompressionLevel(int level) {
+    codec_->checkLevel(level);
+    compressionLevel_ = level;
+}
+
+void DataFileWriterBase::setCompressionThreads(size_t threads, size_t maxPendingBlocks) {
+    compressionThreads_ = threads;
+    maxPendingBlocks_ = maxPendingBlocks;
+    if (pipeline_) {
+        pipeline_->drain();
+        pipeline_.reset();
+    }
+    if (threads == 0 || !compressor_) {
+        return;
+    }
+    if (maxPendingBlocks == 0) {
+        maxPendingBlocks = 2 * threads;
+    }
+    pipeline_.reset(new BlockPipeline(*this, threads, maxPendingBlocks, executor_));
+}
+
+void DataFileWriterBase::setBlockStatistics(const std::vector<std::string> &fields,
+                                            std::unique_ptr<OutputStream> sidecar) {
+    if (statisticsCollector_) {
+        throw Exception("Block statistics are already enabled");
+    }
+    if (direct_) {
+        throw Exception("Direct blocks cannot have block statistics");
+    }
+    std::unique_ptr<BlockStatisticsCollector> collector(new BlockStatisticsCollector(schema_, fields));
+    if (!sidecar) {
+        if (filename_.empty()) {
+            throw Exception("Block statistics of a data file written to a stream need a stream of their own");
+        }
+        sidecar = fileOutputStream((filename_ + ".stats").c_str());
+        statisticsNamed_ = true;
+    }
+    statisticsCollector_ = std::move(collector);
+    statisticsStream_ = std::move(sidecar);
+}
+
+void DataFileWriterBase::setBlockStatistics(const std::vector<std::string> &fields) {
+    setBlockStatistics(fields, std::unique_ptr<OutputStream>());
+}
+
+void DataFileWriterBase::setBlockIndex(std::unique_ptr<OutputStream> sidecar) {
+    if (indexStream_) {
+        throw Exception("Block index is already enabled");
+    }
+    if (static_cast<int64_t>(getCurrentBlockStart()) != dataStart_) {
+        throw Exception("Block index must be enabled before the first block is written");
+    }
+    if (!sidecar) {
+        if (filename_.empty()) {
+            throw Exception("Block index of a data file written to a stream needs a stream of its own");
+        }
+        sidecar = fileOutputStream((filename_ + ".idx").c_str());
+        indexNamed_ = true;
+    }
+    indexStream_ = std::move(sidecar);
+}
+
+void DataFileWriterBase::setBlockIndex() {
+    setBlockIndex(std::unique_ptr<OutputStream>());
+}
+
+void DataFileWriterBase::setBlockChecksums() {
+    if (!indexStream_) {
+        throw Exception("Block checksums are kept in the block index, which is not enabled");
+    }
+    if (direct_) {
+        throw Exception("Direct blocks cannot have block checksums");
+    }
+    if (static_cast<int64_t>(getCurrentBlockStart()) != dataStart_) {
+        throw Exception("Block checksums must be enabled before the first block is written");
+    }
+    blockChecksums_ = true;
+}
+
+boost::mt19937 random(static_cast<uint32_t>(time(nullptr)));
+std::mutex randomMutex;
+
+DataFileSync DataFileWriterBase::makeSync() {
+    // The generator is passed by reference, for every marker to go on
+    // from the last; a copy would give every file the same one.
+    DataFileSync sync;
+    std::lock_guard<std::mutex> lock(randomMutex);
+    std::generate(sync.begin(), sync.end(), std::ref(random));
+    return sync;
+}
+
+typedef array<uint8_t, 4> Magic;
+static Magic magic = {{'O', 'b', 'j', '\x01'}};
+
+void DataFileWriterBase::writeHeader() {
+    if (header_.empty()) {
+        std::unique_ptr<OutputStream> out = memoryOutputStream();
+        encoderPtr_->init(*out);
+        avro::encode(*encoderPtr_, magic);
+        avro::encode(*encoderPtr_, metadata_);
+        encoderPtr_->flush();
+        header_ = *snapshot(*out);
+    }
+    encoderPtr_->init(*stream_);
+    encoderPtr_->encodeFixed(header_.data(), header_.size());
+    avro::encode(*encoderPtr_, sync_);
+    encoderPtr_->flush();
+}
+
+void DataFileWriterBase::setMetadata(const string &key, const string &value) {
+    vector<uint8_t> v(value.size());
+    copy(value.begin(), value.end(), v.begin());
+    metadata_[key] = v;
+}
+
+/**
+ * Reads raw blocks ahead of the consumer on the caller's thread and
+ * decompresses them in tasks on an executor.
+ */
+class DataFileReaderBase::BlockPrefetcher {
+    struct Block {
+        int64_t start;
+        int64_t end;
+        int64_t objectCount;
+        bool syncMatches;
+        std::vector<uint8_t> compressed;
+        std::vector<uint8_t> data;
+        // Whether compressed is checked against checksum, and whether the
+        // codec checks its own, as the reader had it when the block was read.
+        bool checked;
+        uint64_t checksum;
+        bool verify;
+        bool ready;
+        std::exception_ptr error;
+
+        Block() : start(0), end(0), objectCount(0), syncMatches(true), checked(false), checksum(0),
+                  verify(true), ready(false) {}
+    };
+    typedef std::shared_ptr<Block> BlockPtr;
+
+    DataFileReaderBase &reader_;
+    const BlockCodecPtr codec_;
+    const size_t readAhead_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    // Blocks read from the stream but not yet handed over, in file order.
+    std::deque<BlockPtr> queue_;
+    // The decompressors of the tasks that are done.
+    std::vector<std::unique_ptr<BlockDecompressor>> spareDecompressors_;
+
+    BlockPtr current_;
+    bool currentSyncMatches_;
+    bool streamEof_;
+    int64_t streamEnd_;
+
+    TaskGroup tasks_;
+
+    void decompress(const BlockPtr &b) {
+        std::unique_ptr<BlockDecompressor> decompressor;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!spareDecompressors_.empty()) {
+                decompressor = std::move(spareDecompressors_.back());
+                spareDecompressors_.pop_back();
+            }
+        }
+        try {
+            if (!decompressor) {
+                decompressor = codec_->newDecompressor();
+            }
+            if (b->checked && xxHash64(b->compressed.data(), b->compressed.size()) != b->checksum) {
+                throw Exception(boost::format("Block at %1% does not match its checksum in the index") % b->start);
+            }
+            decompressor->setChecksumVerification(b->verify);
+            size_t n;
+            {
+                ScopedTimer timer(*reader_.counters_, reader_.counters_->compressNanos);
+                size_t capacity = b->data.capacity();
+                n = decompressor->decompress(b->compressed.data(), b->compressed.size(), b->data);
+                reader_.counters_->grown(b->data, capacity);
+            }
+            b->data.resize(n);
+            reader_.counters_->block(b->objectCount, n, b->compressed.size());
+        } catch (...) {
+            b->error = std::current_exception();
+        }
+        b->compressed.clear();
+        b->compressed.shrink_to_fit();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (decompressor) {
+                spareDecompressors_.push_back(std::move(decompressor));
+            }
+            b->ready = true;
+        }
+        cond_.notify_all();
+    }
+
+    /**
+     * Reads the next block not rejected by the reader's block filter,
+     * including its trailing sync marker, from the underlying stream.
+     * Returns false at the end of the stream. A skipped block with a bad
+     * sync marker is returned as an empty block that is already ready.
+     */
+    bool readRawBlock(Block &b) {
+        Decoder &d = *reader_.decoder_;
+        InputStream &in = *reader_.stream_;
+        for (;;) {
+            d.init(in);
+            b.start = in.byteCount();
+            const uint8_t *p = nullptr;
+            size_t n = 0;
+            if (!in.next(&p, &n)) {
+                streamEnd_ = b.start;
+                return false;
+            }
+            in.backup(n);
+            avro::decode(d, b.objectCount);
+            int64_t byteCount;
+            avro::decode(d, byteCount);
+            d.init(in);
+            b.end = in.byteCount() + byteCount;
+            bool skipped = reader_.skipBlock(b.start);
+            if (skipped) {
+                in.skip(static_cast<size_t>(byteCount));
+            } else {
+                size_t capacity = b.compressed.capacity();
+                d.decodeFixed(static_cast<size_t>(byteCount), b.compressed);
+                reader_.counters_->copied(b.compressed.size(), b.compressed, capacity);
+                const DataFileIndexEntry *e = reader_.checkedBlock(b.start);
+                b.checked = e != nullptr;
+                b.checksum = e != nullptr ? e->checksum : 0;
+                b.verify = reader_.verification_ != TRUST_BLOCKS;
+            }
+            DataFileSync s;
+            avro::decode(d, s);
+            b.syncMatches = (s == reader_.sync_);
+            if (!skipped) {
+                return true;
+            } else if (!b.syncMatches) {
+                b.objectCount = 0;
+                b.ready = true;
+                return true;
+            }
+        }
+    }
+
+    void fill() {
+        while (!streamEof_) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (queue_.size() >= readAhead_) {
+                    return;
+                }
+            }
+            BlockPtr b = std::make_shared<Block>();
+            bool read;
+            {
+                ScopedTimer timer(*reader_.counters_, reader_.counters_->ioNanos);
+                read = readRawBlock(*b);
+            }
+            if (!read) {
+                streamEof_ = true;
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                queue_.push_back(b);
+            }
+            if (!b->ready) {
+                tasks_.run([this, b] { decompress(b); });
+            }
+            if (!b->syncMatches) {
+                // Whatever follows is not a block we can trust.
+                streamEof_ = true;
+                streamEnd_ = b->end + SyncSize;
+            }
+        }
+    }
+
+public:
+    BlockPrefetcher(DataFileReaderBase &reader, size_t threads, size_t readAhead,
+                    const ExecutorPtr &executor) : reader_(reader), codec_(reader.codec_), readAhead_(readAhead),
+                                                   currentSyncMatches_(true), streamEof_(false), streamEnd_(0),
+                                                   tasks_(executor, threads) {
+    }
+
+    ~BlockPrefetcher() {
+        tasks_.clear();
+        tasks_.wait();
+    }
+
+    /**
+     * Makes the next block in the file the current one and points the
+     * reader's data stream at its contents. Returns false at the end
+     * of the file.
+     */
+    bool next() {
+        if (!currentSyncMatches_) {
+            throw Exception("Sync mismatch");
+        }
+        fill();
+        BlockPtr b;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (queue_.empty()) {
+                reader_.blockStart_ = streamEnd_;
+                return false;
+            }
+            b = queue_.front();
+            queue_.pop_front();
+            // Blocks no task has started on yet are decompressed here,
+            // the oldest first.
+            while (!b->ready) {
+                lock.unlock();
+                bool ran = tasks_.runPending();
+                lock.lock();
+                if (!ran && !b->ready) {
+                    cond_.wait(lock);
+                }
+            }
+        }
+        if (b->error) {
+            std::rethrow_exception(b->error);
+        }
+        // Keep the next blocks coming while this one is decoded.
+        fill();
+
+        reader_.blockStart_ = b->start;
+        reader_.blockEnd_ = b->end;
+        reader_.objectCount_ = b->objectCount;
+        reader_.blockObjectCount_ = b->objectCount;
+        std::unique_ptr<InputStream> in = memoryInputStream(b->data.data(), b->data.size());
+        reader_.dataDecoder_->init(*in);
+        reader_.dataStream_ = std::move(in);
+        current_ = b;
+        currentSyncMatches_ = b->syncMatches;
+        return true;
+    }
+
+    /**
+     * Drops the blocks read so far, for use after the underlying stream
+     * has been repositioned.
+     */
+    void reset() {
+        tasks_.clear();
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.clear();
+        currentSyncMatches_ = true;
+        streamEof_ = false;
+    }
+};
+
+DataFileReaderBase::DataFileReaderBase(const char *filename) : filename_(filename), stream_(fileSeekableInputStream(filename)),
+                                                               decoder_(binaryDecoder()), memory_(nullptr), memorySize_(0),
+                                                               objectCount_(0), eof_(false), blockStart_(-1),
+                                                               blockEnd_(-1), prefetched_(false), counters_(new DataFileCounters()) {
+    readHeader();
+}
+
+DataFileReaderBase::DataFileReaderBase(const char *filename, const StreamOptions &options)
+    : filename_(filename), stream_(fileSeekableInputStream(filename, options)),
+      decoder_(binaryDecoder()), memory_(nullptr), memorySize_(0), objectCount_(0), eof_(false), blockStart_(-1),
+      blockEnd_(-1), prefetched_(false), counters_(new DataFileCounters()) {
+    readHeader();
+}
+
+DataFileReaderBase::DataFileReaderBase(const char *filename, DataFileSchemaCache &schemas)
+    : filename_(filename), stream_(fileSeekableInputStream(filename)),
+      decoder_(binaryDecoder()), memory_(nullptr), memorySize_(0), objectCount_(0), eof_(false), blockStart_(-1),
+      blockEnd_(-1), prefetched_(false), counters_(new DataFileCounters()) {
+    readHeader(&schemas);
+}
+
+#ifndef _WIN32
+DataFileReaderBase::DataFileReaderBase(const SharedDataFile &file)
+    : filename_(file.filename()), stream_(sharedFileInputStream(file.file())),
+      decoder_(binaryDecoder()), memory_(nullptr), memorySize_(0), objectCount_(0), eof_(false), blockStart_(-1),
+      blockEnd_(-1), metadata_(file.metadata()), sync_(file.syncMarker()), prefetched_(false),
+      counters_(new DataFileCounters()) {
+    dataSchema_ = file.dataSchema();
+    readerSchema_ = dataSchema_;
+    useCodec(file.codecName());
+    static_cast<SeekableInputStream &>(*stream_).seek(file.dataStart());
+    decoder_->init(*stream_);
+    blockStart_ = stream_->byteCount();
+}
+#endif
+
+DataFileReaderBase::DataFileReaderBase(std::unique_ptr<InputStream> inputStream) : stream_(std::move(inputStream)),
+                                                                                   decoder_(binaryDecoder()), memory_(nullptr), memorySize_(0),
+                                                                                   objectCount_(0), eof_(false),
+                                                                                   prefetched_(false), counters_(new DataFileCounters()) {
+    readHeader();
+}
+
+DataFileReaderBase::DataFileReaderBase(const uint8_t *data, size_t len) : stream_(memoryInputStream(data, len)),
+                                                                          decoder_(binaryDecoder()), memory_(data), memorySize_(len),
+                                                                          objectCount_(0), eof_(false),
+                                                                          prefetched_(false), counters_(new DataFileCounters()) {
+    readHeader();
+}
+
+DataFileReaderBase::~DataFileReaderBase() = default;
+
+void DataFileReaderBase::setDecompressionThreads(size_t threads, size_t readAhead) {
+    if (prefetched_ && !eof_) {
+        // The stream is already past the current block; it has to come
+        // from the prefetcher that read it.
+        throw Exception("Cannot change decompression threads in the middle of a prefetched block");
+    }
+    prefetcher_.reset();
+    decompressionThreads_ = threads;
+    readAhead_ = readAhead;
+    if (threads == 0 || !decompressor_) {
+        return;
+    }
+    if (readAhead == 0) {
+        readAhead = 2 * threads;
+    }
+    prefetcher_.reset(new BlockPrefetcher(*this, threads, readAhead, executor_));
+}
+
+void DataFileReaderBase::init() {
+    readerSchema_ = dataSchema_;
+    dataDecoder_ = binaryDecoder();
+    readDataBlock();
+}
+
+void DataFileReaderBase::init(const ValidSchema &readerSchema) {
+    readerSchema_ = readerSchema;
+    hasReaderSchema_ = true;
+    dataDecoder_ = readerSchema_.sameEncoding(dataSchema_) ? binaryDecoder() : compiledResolvingDecoder(dataSchema_, readerSchema_, binaryDecoder());
+    readDataBlock();
+}
+
+static void drain(InputStream &in) {
+    const uint8_t *p = nullptr;
+    size_t n = 0;
+    while (in.next(&p, &n))
+        ;
+}
+
+char hex(unsigned int x) {
+    return static_cast<char>(x + (x < 10 ? '0' : ('a' - 10)));
+}
+
+std::ostream &operator<<(std::ostream &os, const DataFileSync &s) {
+    for (uint8_t i : s) {
+        os << hex(i / 16) << hex(i % 16) << ' ';
+    }
+    os << std::endl;
+    return os;
+}
+
+bool DataFileReaderBase::hasMore() {
+    for (;;) {
+        if (eof_) {
+            return false;
+        } else if (objectCount_ != 0 && (!recordFilter_ || findAccepted())) {
+            return true;
+        }
+
+        if (!prefetched_) {
+            dataDecoder_->init(*dataStream_);
+            drain(*dataStream_);
+            finishCheck();
+            DataFileSync s;
+            decoder_->init(*stream_);
+            avro::decode(*decoder_, s);
+            if (s != sync_) {
+                throw Exception("Sync mismatch");
+            }
+        }
+        readDataBlock();
+    }
+}
+
+class BoundedInputStream : public InputStream {
+    InputStream &in_;
+    size_t limit_;
+
+    bool next(const uint8_t **data, size_t *len) override {
+        if (limit_ != 0 && in_.next(data, len)) {
+            if (*len > limit_) {
+                in_.backup(*len - limit_);
+                *len = limit_;
+            }
+            limit_ -= *len;
+            return true;
+        }
+        return false;
+    }
+
+    void backup(size_t len) override {
+        in_.backup(len);
+        limit_ += len;
+    }
+
+    void skip(size_t len) override {
+        if (len > limit_) {
+            len = limit_;
+        }
+        in_.skip(len);
+        limit_ -= len;
+    }
+
+    size_t byteCount() const override {
+        return in_.byteCount();
+    }
+
+public:
+    BoundedInputStream(InputStream &in, size_t limit) : in_(in), limit_(limit) {}
+};
+
+unique_ptr<InputStream> boundedInputStream(InputStream &in, size_t limit) {
+    return unique_ptr<InputStream>(new BoundedInputStream(in, limit));
+}
+
+/**
+ * Returns a pointer to the remaining bytes of \p in, which is expected
+ * to hold \p len of them, and sets \p actual to their number. They are
+ * copied into \p buf only if the stream does not hold them in one chunk.
+ */
+static const uint8_t *contiguousBlock(InputStream &in, size_t len, std::vector<char> &buf, size_t &actual,
+                                      DataFileCounters &counters) {
+    const uint8_t *data = nullptr;
+    size_t n = 0;
+    if (!in.next(&data, &n) || n >= len) {
+        actual = n;
+        return data;
+    }
+    buf.clear();
+    size_t capacity = buf.capacity();
+    do {
+        buf.insert(buf.end(), data, data + n);
+    } while (in.next(&data, &n));
+    counters.copied(buf.size(), buf, capacity);
+    actual = buf.size();
+    return reinterpret_cast<const uint8_t *>(buf.data());
+}
+
+void DataFileReaderBase::readDataBlock() {
+    AVRO_TRACE_SCOPE(TRACE_READ_DATA_BLOCK, static_cast<int64_t>(stream_->byteCount()));
+    accepted_ = false;
+    nextRecord_ = 0;
+    if (prefetcher_) {
+        prefetched_ = true;
+        if (!prefetcher_->next()) {
+            eof_ = true;
+        }
+        return;
+    }
+    prefetched_ = false;
+    finishCheck();
+    ScopedTimer reading(*counters_, counters_->ioNanos);
+    int64_t byteCount;
+    for (;;) {
+        decoder_->init(*stream_);
+        blockStart_ = stream_->byteCount();
+        const uint8_t *p = nullptr;
+        size_t n = 0;
+        if (!stream_->next(&p, &n)) {
+            objectCount_ = 0;
+            eof_ = true;
+            return;
+        }
+        stream_->backup(n);
+        avro::decode(*decoder_, objectCount_);
+        avro::decode(*decoder_, byteCount);
+        decoder_->init(*stream_);
+        blockEnd_ = stream_->byteCount() + byteCount;
+        if (!skipBlock(blockStart_)) {
+            if (objectCount_ > skipObjects_ || objectCount_ == 0) {
+                break;
+            }
+            // skip() wants none of this block's objects.
+            skipObjects_ -= objectCount_;
+        }
+        stream_->skip(static_cast<size_t>(byteCount));
+        DataFileSync s;
+        avro::decode(*decoder_, s);
+        if (s != sync_) {
+            throw Exception("Sync mismatch");
+        }
+    }
+
+    blockObjectCount_ = objectCount_;
+    size_t len = static_cast<size_t>(byteCount);
+    cachedBlock_.reset();
+    if (blockCache_ && decompressor_) {
+        cachedBlock_ = blockCache_->find(sync_, blockStart_);
+        if (cachedBlock_) {
+            stream_->skip(len);
+            counters_->block(objectCount_, cachedBlock_->size(), len);
+            std::unique_ptr<InputStream> in = memoryInputStream(cachedBlock_->data(), cachedBlock_->size());
+            dataDecoder_->init(*in);
+            dataStream_ = std::move(in);
+            return;
+        }
+    }
+    const uint8_t *block = nullptr;
+    const DataFileIndexEntry *checked = checkedBlock(blockStart_);
+    if (memory_ != nullptr) {
+        // The block lies in the file's memory.
+        auto offset = static_cast<size_t>(stream_->byteCount());
+        if (byteCount < 0 || len > memorySize_ - offset) {
+            throw Exception("Data file block runs past the end of the data");
+        }
+        block = memory_ + offset;
+        stream_->skip(len);
+    } else {
+        unique_ptr<InputStream> st = boundedInputStream(*stream_, len);
+        if (!decompressor_ && !recordFilter_ && !holdBlocks_ && checked == nullptr) {
+            // The data is read as it is decoded.
+            counters_->block(objectCount_, len, len);
+            dataDecoder_->init(*st);
+            dataStream_ = std::move(st);
+            return;
+        }
+        // Decompress straight out of the stream's buffer when the block
+        // is contiguous in it, into a buffer kept from block to block.
+        block = contiguousBlock(*st, len, compressed_, len, *counters_);
+    }
+    reading.stop();
+    if (checked != nullptr) {
+        checkBlock(block, len, *checked);
+    }
+    size_t used = len;
+    if (decompressor_ && blockCache_) {
+        // Decompressed into a block of its own, for the cache to keep.
+        std::shared_ptr<std::vector<uint8_t>> b = std::make_shared<std::vector<uint8_t>>();
+        {
+            ScopedTimer decompressing(*counters_, counters_->compressNanos);
+            used = decompressor_->decompress(block, len, *b);
+        }
+        DataFileCounters::add(counters_->bufferAllocations, 1);
+        b->resize(used);
+        block = b->data();
+        cachedBlock_ = b;
+        blockCache_->insert(sync_, blockStart_, cachedBlock_);
+    } else if (decompressor_) {
+        ScopedTimer decompressing(*counters_, counters_->compressNanos);
+        size_t capacity = decompressed_.capacity();
+        used = decompressor_->decompress(block, len, decompressed_);
+        counters_->grown(decompressed_, capacity);
+        block = decompressed_.data();
+    }
+    counters_->block(objectCount_, used, len);
+    std::unique_ptr<InputStream> in = memoryInputStream(block, used);
+    dataDecoder_->init(*in);
+    dataStream_ = std::move(in);
+}
+
+bool DataFileReaderBase::findAccepted() {
+    if (accepted_) {
+        return true;
+    }
+    // Whatever the decoder read of the record it decoded, the next one
+    // starts where the filter found it ends.
+    dataDecoder_->init(*dataStream_);
+    size_t pos = dataStream_->byteCount();
+    if (pos < nextRecord_) {
+        dataStream_->skip(nextRecord_ - pos);
+    }
+    while (objectCount_ != 0) {
+        size_t start = nextRecord_;
+        filterDecoder_->init(*dataStream_);
+        bool accepted = recordFilter_->accept(*filterDecoder_);
+        filterDecoder_->drain();
+        nextRecord_ = dataStream_->byteCount();
+        if (accepted) {
+            dataStream_->backup(nextRecord_ - start);
+            dataDecoder_->init(*dataStream_);
+            accepted_ = true;
+            return true;
+        }
+        --objectCount_;
+        DataFileCounters::add(counters_->filteredObjects, 1);
+    }
+    return false;
+}
+
+void DataFileReaderBase::holdBlock() {
+    if (decompressor_ || prefetched_ || eof_ || objectCount_ == 0) {
+        return;
+    }
+    // The current block is read as it is decoded; hold the rest of it in
+    // memory from the end of the last object decoded.
+    if (objectCount_ != blockObjectCount_) {
+        dataDecoder_->drain();
+    }
+    held_.clear();
+    size_t capacity = held_.capacity();
+    const uint8_t *p = nullptr;
+    size_t n = 0;
+    while (dataStream_->next(&p, &n)) {
+        held_.insert(held_.end(), p, p + n);
+    }
+    counters_->copied(held_.size(), held_, capacity);
+    std::unique_ptr<InputStream> in = memoryInputStream(held_.data(), held_.size());
+    dataDecoder_->init(*in);
+    dataStream_ = std::move(in);
+    blockObjectCount_ = objectCount_;
+}
+
+void DataFileReaderBase::setRecordFilter(const std::vector<std::string> &fields, RecordPredicate predicate) {
+    if (!predicate) {
+        recordFilter_.reset();
+        return;
+    }
+    std::unique_ptr<RecordFilter> filter(new RecordFilter(dataSchema_, fields, std::move(predicate)));
+    if (!filterDecoder_) {
+        filterDecoder_ = binaryDecoder();
+    }
+    if (!recordFilter_) {
+        holdBlock();
+        nextRecord_ = 0;
+    } else if (accepted_) {
+        // Scan the record the previous filter accepted again.
+        nextRecord_ = dataStream_->byteCount();
+    }
+    accepted_ = false;
+    recordFilter_ = std::move(filter);
+}
+
+int64_t DataFileReaderBase::skip(int64_t n) {
+    int64_t skipped = 0;
+    while (skipped < n) {
+        if (recordFilter_) {
+            if (!hasMore()) {
+                break;
+            }
+            // findAccepted() knows where the accepted record ends.
+            --objectCount_;
+            accepted_ = false;
+            ++skipped;
+        } else if (objectCount_ == 0) {
+            skipObjects_ = n - skipped;
+            bool more = hasMore();
+            skipped = n - skipObjects_;
+            skipObjects_ = 0;
+            if (!more) {
+                break;
+            }
+        } else if (objectCount_ <= n - skipped) {
+            skipped += objectCount_;
+            objectCount_ = 0;
+        } else {
+            skipInBlock(n - skipped);
+            skipped = n;
+        }
+    }
+    return skipped;
+}
+
+void DataFileReaderBase::skipInBlock(int64_t n) {
+    if (!skipper_) {
+        skipper_.reset(new BinaryValidator(dataSchema_));
+    }
+    // Hand back what the decoder read past the last object it decoded.
+    if (objectCount_ != blockObjectCount_) {
+        dataDecoder_->drain();
+    }
+    dataDecoder_->init(*dataStream_);
+    for (; n != 0; --n) {
+        skipper_->validate(*dataStream_);
+        --objectCount_;
+    }
+    dataDecoder_->init(*dataStream_);
+    blockObjectCount_ = objectCount_;
+}
+
+DecodeStatus DataFileReaderBase::checkNext() {
+    if (!holdBlocks_) {
+        if (!recordFilter_) {
+            holdBlock();
+        }
+        holdBlocks_ = true;
+    }
+    if (!skipper_) {
+        skipper_.reset(new BinaryValidator(dataSchema_));
+    }
+    if (objectCount_ != blockObjectCount_) {
+        dataDecoder_->drain();
+    }
+    size_t start = dataStream_->byteCount();
+    DecodeStatus result = skipper_->tryValidate(*dataStream_);
+    // The block is in memory, so the whole of the object can be read
+    // again.
+    dataStream_->backup(dataStream_->byteCount() - start);
+    dataDecoder_->init(*dataStream_);
+    blockObjectCount_ = objectCount_;
+    return result;
+}
+
+bool DataFileReaderBase::skipBlock(int64_t offset) const {
+    if (!blockFilter_) {
+        return false;
+    }
+    auto it = std::lower_bound(blockStatistics_.begin(), blockStatistics_.end(), offset,
+                               [](const BlockStatistics &b, int64_t o) { return b.offset < o; });
+    return it != blockStatistics_.end() && it->offset == offset && !blockFilter_(*it);
+}
+
+void DataFileReaderBase::setBlockFilter(std::vector<BlockStatistics> stats, BlockFilter filter) {
+    std::sort(stats.begin(), stats.end(),
+              [](const BlockStatistics &a, const BlockStatistics &b) { return a.offset < b.offset; });
+    blockStatistics_ = std::move(stats);
+    blockFilter_ = std::move(filter);
+    if (!eof_ && skipBlock(blockStart_)) {
+        // Nothing in the rest of the current block is wanted.
+        objectCount_ = 0;
+    }
+}
+
+void DataFileReaderBase::setBlockCache(std::shared_ptr<DataFileBlockCache> cache) {
+    blockCache_ = std::move(cache);
+}
+
+void DataFileReaderBase::setIndex(DataFileIndex index) {
+    index_ = std::move(index);
+    hasIndex_ = true;
+}
+
+void DataFileReaderBase::setBlockVerification(BlockVerification verification) {
+    verification_ = verification;
+    if (decompressor_) {
+        decompressor_->setChecksumVerification(verification != TRUST_BLOCKS);
+    }
+}
+
+const DataFileIndexEntry *DataFileReaderBase::checkedBlock(int64_t offset) const {
+    if (!hasIndex_ || verification_ == TRUST_BLOCKS) {
+        return nullptr;
+    }
+    const DataFileIndexEntry *e = index_.atOffset(offset);
+    return e != nullptr && e->hasChecksum ? e : nullptr;
+}
+
+void DataFileReaderBase::checkBlock(const uint8_t *data, size_t len, const DataFileIndexEntry &e) {
+    checkStart_ = blockStart_;
+    if (verification_ == VERIFY_BLOCKS_ASYNC) {
+        // The block stays where it is until the reader moves on from it,
+        // which waits for the check first.
+        uint64_t checksum = e.checksum;
+        check_ = std::async(std::launch::async, [data, len, checksum] {
+            return xxHash64(data, len) == checksum;
+        });
+    } else {
+        check_ = std::future<bool>();
+        if (xxHash64(data, len) != e.checksum) {
+            throw Exception(boost::format("Block at %1% does not match its checksum in the index") % checkStart_);
+        }
+    }
+}
+
+void DataFileReaderBase::finishCheck() {
+    if (check_.valid() && !check_.get()) {
+        throw Exception(boost::format("Block at %1% does not match its checksum in the index") % checkStart_);
+    }
+}
+
+int64_t DataFileReaderBase::seekToBlockOf(int64_t object) {
+    if (!hasIndex_) {
+        throw Exception("No index to seek with");
+    }
+    const DataFileIndexEntry *e = index_.find(object);
+    if (e == nullptr) {
+        return -1;
+    }
+    seek(e->offset);
+    return object - e->firstObject;
+}
+
+void DataFileReaderBase::startDecode() {
+    counters_->start = DataFileCounters::now();
+}
+
+void DataFileReaderBase::endDecode() {
+    DataFileCounters::add(counters_->decodeNanos, DataFileCounters::now() - counters_->start);
+}
+
+void DataFileReaderBase::setTiming(bool enabled) {
+    timing_ = enabled;
+    counters_->timing = enabled;
+}
+
+DataFileStats DataFileReaderBase::stats() const {
+    return counters_->stats();
+}
+
+void DataFileReaderBase::close() {
 }
 
 static string toString(const vector<uint8_t> &v) {
@@ -454,53 +2013,227 @@ static ValidSchema makeSchema(const vector<uint8_t> &v) {
     return ValidSchema(vs);
 }
 
-void DataFileReaderBase::readHeader() {
-    decoder_->init(*stream_);
+ValidSchema DataFileSchemaCache::schema(const vector<uint8_t> &json) {
+    string key = toString(json);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::map<string, ValidSchema>::const_iterator it = schemas_.find(key);
+        if (it != schemas_.end()) {
+            return it->second;
+        }
+    }
+    // Compiled outside the lock; if two threads race on the same schema,
+    // the first one inserted wins.
+    ValidSchema result = makeSchema(json);
+    std::lock_guard<std::mutex> lock(mutex_);
+    return schemas_.insert(std::make_pair(key, result)).first->second;
+}
+
+size_t DataFileSchemaCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return schemas_.size();
+}
+
+DataFileBlockCache::DataFileBlockCache(size_t capacity) : capacity_(capacity), size_(0), hits_(0), misses_(0) {}
+
+DataFileBlockCache::Block DataFileBlockCache::find(const DataFileSync &sync, int64_t offset) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<Key, Entries::iterator>::const_iterator it = index_.find(Key(sync, offset));
+    if (it == index_.end()) {
+        ++misses_;
+        return Block();
+    }
+    ++hits_;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->second;
+}
+
+void DataFileBlockCache::insert(const DataFileSync &sync, int64_t offset, Block block) {
+    if (block->size() > capacity_) {
+        return;
+    }
+    Key key(sync, offset);
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<Key, Entries::iterator>::iterator it = index_.find(key);
+    if (it != index_.end()) {
+        // Another reader got there first; keep the one already shared.
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return;
+    }
+    entries_.push_front(std::make_pair(key, block));
+    index_[key] = entries_.begin();
+    size_ += block->size();
+    while (size_ > capacity_) {
+        size_ -= entries_.back().second->size();
+        index_.erase(entries_.back().first);
+        entries_.pop_back();
+    }
+}
+
+void DataFileBlockCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    index_.clear();
+    size_ = 0;
+}
+
+size_t DataFileBlockCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+}
+
+int64_t DataFileBlockCache::hits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+int64_t DataFileBlockCache::misses() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+}
+
+// Reads the header of a data file: the magic, the metadata and the sync
+// marker. Returns the data schema and the name of the codec found in the
+// metadata. If the schema is byte for byte \p previous, dataSchema is
+// left as it is and false is returned.
+static bool readFileHeader(Decoder &decoder, const string &filename,
+                           std::map<string, vector<uint8_t>> &metadata,
+                           ValidSchema &dataSchema, string &codec,
+                           DataFileSync &sync, DataFileSchemaCache *schemas = nullptr,
+                           const vector<uint8_t> *previous = nullptr) {
     Magic m;
-    avro::decode(*decoder_, m);
+    avro::decode(decoder, m);
     if (magic != m) {
         throw Exception("Invalid data file. Magic does not match: "
-                        + filename_);
+                        + filename);
     }
-    avro::decode(*decoder_, metadata_);
-    Metadata::const_iterator it = metadata_.find(AVRO_SCHEMA_KEY);
-    if (it == metadata_.end()) {
+    avro::decode(decoder, metadata);
+    std::map<string, vector<uint8_t>>::const_iterator it = metadata.find(AVRO_SCHEMA_KEY);
+    if (it == metadata.end()) {
         throw Exception("No schema in metadata");
     }
 
-    dataSchema_ = makeSchema(it->second);
+    bool compiled = previous == nullptr || *previous != it->second;
+    if (compiled) {
+        dataSchema = schemas != nullptr ? schemas->schema(it->second) : makeSchema(it->second);
+    }
+
+    it = metadata.find(AVRO_CODEC_KEY);
+    codec = (it == metadata.end()) ? AVRO_NULL_CODEC : toString(it->second);
+
+    avro::decode(decoder, sync);
+    return compiled;
+}
+
+bool DataFileReaderBase::readHeader(DataFileSchemaCache *schemas, const vector<uint8_t> *previous) {
+    decoder_->init(*stream_);
+    string codecName;
+    bool compiled = readFileHeader(*decoder_, filename_, metadata_, dataSchema_, codecName, sync_, schemas, previous);
     if (!readerSchema_.root()) {
         readerSchema_ = dataSchema();
     }
 
-    it = metadata_.find(AVRO_CODEC_KEY);
-    if (it != metadata_.end() && toString(it->second) == AVRO_DEFLATE_CODEC) {
-        codec_ = DEFLATE_CODEC;
-#ifdef SNAPPY_CODEC_AVAILABLE
-    } else if (it != metadata_.end()
-               && toString(it->second) == AVRO_SNAPPY_CODEC) {
-        codec_ = SNAPPY_CODEC;
-#endif
-    } else {
-        codec_ = NULL_CODEC;
-        if (it != metadata_.end() && toString(it->second) != AVRO_NULL_CODEC) {
-            throw Exception("Unknown codec in data file: " + toString(it->second));
+    useCodec(codecName);
+
+    decoder_->init(*stream_);
+    blockStart_ = stream_->byteCount();
+    return compiled;
+}
+
+void DataFileReaderBase::useCodec(const string &codecName) {
+    BlockCodecPtr codec = findCodec(codecName, dataSchema_, metadata_);
+    if (!codec) {
+        throw Exception("Unknown codec in data file: " + codecName);
+    }
+    if (codec != codec_) {
+        codec_ = codec;
+        decompressor_.reset();
+        if (codecName != AVRO_NULL_CODEC) {
+            decompressor_ = codec_->newDecompressor();
+            decompressor_->setChecksumVerification(verification_ != TRUST_BLOCKS);
         }
     }
+}
 
-    avro::decode(*decoder_, sync_);
+void DataFileReaderBase::release() {
+    finishCheck();
+    if (dataStream_) {
+        dataDecoder_->init(*dataStream_);
+        if (filterDecoder_) {
+            filterDecoder_->init(*dataStream_);
+        }
+    }
     decoder_->init(*stream_);
-    blockStart_ = stream_->byteCount();
+    if (prefetcher_) {
+        prefetcher_->reset();
+    }
+    dataStream_.reset();
+}
+
+void DataFileReaderBase::restart() {
+    const vector<uint8_t> previous = metadata_[AVRO_SCHEMA_KEY];
+    const BlockCodecPtr codec = codec_;
+    bool compiled = readHeader(nullptr, &previous);
+    objectCount_ = 0;
+    eof_ = false;
+    blockEnd_ = -1;
+    prefetched_ = false;
+    accepted_ = false;
+    nextRecord_ = 0;
+    blockObjectCount_ = 0;
+    held_.clear();
+    blockStatistics_.clear();
+    blockFilter_ = BlockFilter();
+    index_ = DataFileIndex();
+    hasIndex_ = false;
+    if (compiled) {
+        if (!hasReaderSchema_) {
+            readerSchema_ = dataSchema_;
+        }
+        dataDecoder_ = readerSchema_.sameEncoding(dataSchema_) ? binaryDecoder() : compiledResolvingDecoder(dataSchema_, readerSchema_, binaryDecoder());
+        recordFilter_.reset();
+        skipper_.reset();
+    }
+    if (codec_ != codec) {
+        // The prefetcher decompresses with the codec it was made for.
+        setDecompressionThreads(decompressionThreads_, readAhead_);
+    }
+    readDataBlock();
+}
+
+void DataFileReaderBase::reopen(const char *filename) {
+    release();
+    if (memory_ != nullptr || !reopenFileInputStream(*stream_, filename)) {
+        stream_ = fileSeekableInputStream(filename);
+    }
+    memory_ = nullptr;
+    memorySize_ = 0;
+    filename_ = filename;
+    restart();
+}
+
+void DataFileReaderBase::reset(std::unique_ptr<InputStream> inputStream) {
+    release();
+    stream_ = std::move(inputStream);
+    memory_ = nullptr;
+    memorySize_ = 0;
+    filename_.clear();
+    restart();
 }
 
 void DataFileReaderBase::doSeek(int64_t position) {
+    finishCheck();
     if (auto *ss = dynamic_cast<SeekableInputStream *>(stream_.get())) {
-        if (!eof_) {
+        if (!eof_ && !prefetched_) {
             dataDecoder_->init(*dataStream_);
             drain(*dataStream_);
         }
         decoder_->init(*stream_);
         ss->seek(position);
+        if (prefetcher_) {
+            prefetcher_->reset();
+        }
+        prefetched_ = false;
         eof_ = false;
     } else {
         throw Exception("seek not supported on non-SeekableInputStream");
@@ -512,43 +2245,101 @@ void DataFileReaderBase::seek(int64_t position) {
     readDataBlock();
 }
 
+/**
+ * Returns the offset of the first occurrence of \p sync in the \p len
+ * bytes at \p data, or \p len if there is none. Candidates are found
+ * sixteen positions at a time by matching the first and last bytes of
+ * the marker, and only those are compared in full.
+ */
+static size_t findSync(const uint8_t *data, size_t len, const DataFileSync &sync) {
+    if (len < SyncSize) {
+        return len;
+    }
+    // The last position at which a marker can start.
+    const size_t last = len - SyncSize;
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i first = _mm_set1_epi8(static_cast<char>(sync[0]));
+    const __m128i final = _mm_set1_epi8(static_cast<char>(sync[SyncSize - 1]));
+    for (; i + 16 <= last + 1; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + SyncSize - 1));
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, final))));
+        for (; mask != 0; mask &= mask - 1) {
+            size_t k = i + static_cast<size_t>(__builtin_ctz(mask));
+            if (memcmp(data + k + 1, sync.data() + 1, SyncSize - 2) == 0) {
+                return k;
+            }
+        }
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t first = vdupq_n_u8(sync[0]);
+    const uint8x16_t final = vdupq_n_u8(sync[SyncSize - 1]);
+    for (; i + 16 <= last + 1; i += 16) {
+        uint8x16_t eq = vandq_u8(vceqq_u8(vld1q_u8(data + i), first),
+                                 vceqq_u8(vld1q_u8(data + i + SyncSize - 1), final));
+        // Four bits per position.
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        for (; mask != 0; mask &= ~(uint64_t(0xf) << (__builtin_ctzll(mask) & ~3))) {
+            size_t k = i + static_cast<size_t>(__builtin_ctzll(mask) / 4);
+            if (memcmp(data + k + 1, sync.data() + 1, SyncSize - 2) == 0) {
+                return k;
+            }
+        }
+    }
+#endif
+    while (i <= last) {
+        const void *q = memchr(data + i, sync[0], last + 1 - i);
+        if (q == nullptr) {
+            break;
+        }
+        i = static_cast<size_t>(static_cast<const uint8_t *>(q) - data);
+        if (memcmp(data + i, sync.data(), SyncSize) == 0) {
+            return i;
+        }
+        ++i;
+    }
+    return len;
+}
+
 void DataFileReaderBase::sync(int64_t position) {
+    AVRO_TRACE_SCOPE(TRACE_SYNC, position);
     doSeek(position);
-    DataFileSync sync_buffer;
+    // The last bytes seen, which may begin a marker that ends in the
+    // next chunk, followed by the start of that chunk.
+    uint8_t window[2 * SyncSize];
+    size_t carried = 0;
     const uint8_t *p = nullptr;
     size_t n = 0;
-    size_t i = 0;
-    while (i < SyncSize) {
-        if (n == 0 && !stream_->next(&p, &n)) {
+    for (;;) {
+        if (!stream_->next(&p, &n)) {
             eof_ = true;
             return;
         }
-        int len =
-            std::min(static_cast<size_t>(SyncSize - i), n);
-        memcpy(&sync_buffer[i], p, len);
-        p += len;
-        n -= len;
-        i += len;
-    }
-    for (;;) {
-        size_t j = 0;
-        for (; j < SyncSize; ++j) {
-            if (sync_[j] != sync_buffer[(i + j) % SyncSize]) {
+        size_t m = std::min(n, static_cast<size_t>(SyncSize - 1));
+        memcpy(window + carried, p, m);
+        if (carried != 0) {
+            size_t k = findSync(window, carried + m, sync_);
+            if (k < carried) {
+                stream_->backup(n - (k + SyncSize - carried));
                 break;
             }
         }
-        if (j == SyncSize) {
-            // Found the sync marker!
+        size_t k = findSync(p, n, sync_);
+        if (k < n) {
+            stream_->backup(n - (k + SyncSize));
             break;
         }
-        if (n == 0 && !stream_->next(&p, &n)) {
-            eof_ = true;
-            return;
+        if (n >= SyncSize - 1) {
+            memcpy(window, p + n - m, m);
+            carried = m;
+        } else {
+            size_t keep = std::min(carried + m, static_cast<size_t>(SyncSize - 1));
+            memmove(window, window + carried + m - keep, keep);
+            carried = keep;
         }
-        sync_buffer[i++ % SyncSize] = *p++;
-        --n;
     }
-    stream_->backup(n);
     readDataBlock();
 }
 
@@ -560,4 +2351,450 @@ int64_t DataFileReaderBase::previousSync() const {
     return blockStart_;
 }
 
+#ifndef _WIN32
+SharedDataFile::SharedDataFile(const char *filename, DataFileSchemaCache *schemas)
+    : filename_(filename), file_(std::make_shared<SharedFile>(filename)) {
+    std::unique_ptr<SeekableInputStream> in = sharedFileInputStream(file_);
+    DecoderPtr decoder = binaryDecoder();
+    decoder->init(*in);
+    readFileHeader(*decoder, filename_, metadata_, dataSchema_, codecName_, sync_, schemas);
+    if (!findCodec(codecName_, dataSchema_, metadata_)) {
+        throw Exception("Unknown codec in data file: " + codecName_);
+    }
+    // Hands back what the decoder read past the header.
+    decoder->init(*in);
+    dataStart_ = static_cast<int64_t>(in->byteCount());
+}
+#endif
+
+DataFileBlockReader::DataFileBlockReader(const char *filename) : filename_(filename), stream_(fileSeekableInputStream(filename)),
+                                                                 decoder_(binaryDecoder()), started_(false), unread_(false) {
+    readHeader();
+}
+
+DataFileBlockReader::DataFileBlockReader(std::unique_ptr<InputStream> inputStream) : stream_(std::move(inputStream)),
+                                                                                     decoder_(binaryDecoder()), started_(false), unread_(false) {
+    readHeader();
+}
+
+void DataFileBlockReader::readHeader() {
+    decoder_->init(*stream_);
+    readFileHeader(*decoder_, filename_, metadata_, dataSchema_, codecName_, sync_);
+    decoder_->init(*stream_);
+}
+
+Codec DataFileBlockReader::codec() const {
+    return builtinCodec(codecName_);
+}
+
+bool DataFileBlockReader::next(DataFileBlock &block) {
+    if (started_) {
+        if (unread_) {
+            stream_->skip(static_cast<size_t>(current_.byteSize));
+            unread_ = false;
+        }
+        DataFileSync s;
+        decoder_->init(*stream_);
+        avro::decode(*decoder_, s);
+        if (s != sync_) {
+            throw Exception("Sync mismatch");
+        }
+        decoder_->init(*stream_);
+        started_ = false;
+    }
+
+    const uint8_t *p = nullptr;
+    size_t n = 0;
+    if (!stream_->next(&p, &n)) {
+        return false;
+    }
+    stream_->backup(n);
+    current_.offset = stream_->byteCount();
+    avro::decode(*decoder_, current_.objectCount);
+    avro::decode(*decoder_, current_.byteSize);
+    decoder_->init(*stream_);
+    if (current_.objectCount < 0 || current_.byteSize < 0) {
+        throw Exception("Invalid block header");
+    }
+    started_ = true;
+    unread_ = true;
+    block = current_;
+    return true;
+}
+
+void DataFileBlockReader::readBlockRaw(std::vector<uint8_t> &data) {
+    if (!unread_) {
+        throw Exception("No block to read");
+    }
+    size_t size = static_cast<size_t>(current_.byteSize);
+    data.resize(size);
+    size_t done = 0;
+    while (done < size) {
+        const uint8_t *p;
+        size_t n;
+        if (!stream_->next(&p, &n)) {
+            throw Exception("EOF reached");
+        }
+        size_t len = std::min(n, size - done);
+        memcpy(&data[done], p, len);
+        stream_->backup(n - len);
+        done += len;
+    }
+    unread_ = false;
+}
+
+// The most bytes a block header, two varints, takes.
+static const size_t MaxBlockHeader = 20;
+
+// Reads a varint from [p, end), returning false if it does not end there.
+static bool readBufferedLong(const uint8_t *&p, const uint8_t *end, int64_t &value) {
+    uint64_t n = 0;
+    for (int shift = 0; p != end; shift += 7) {
+        if (shift >= 64) {
+            throw Exception("Invalid Avro varint");
+        }
+        uint8_t b = *p++;
+        n |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            value = decodeZigzag64(n);
+            return true;
+        }
+    }
+    return false;
+}
+
+AsyncDataFileReaderBase::AsyncDataFileReaderBase(AsyncInputStreamPtr stream, size_t minReadSize,
+                                                 size_t readDepth) : stream_(std::move(stream)),
+                                                                     minReadSize_(std::max(minReadSize, static_cast<size_t>(64))),
+                                                                     readDepth_(std::max(readDepth, static_cast<size_t>(1))),
+                                                                     hasReaderSchema_(false),
+                                                                     decoder_(binaryDecoder()),
+                                                                     bufferOffset_(0), pos_(0), requestedEnd_(0), startPosition_(-1),
+                                                                     headerRead_(false), eof_(false), finished_(false),
+                                                                     running_(false), inflight_(0) {}
+
+void AsyncDataFileReaderBase::start(BlockHandler onBlock, DoneHandler onDone) {
+    onBlock_ = std::move(onBlock);
+    onDone_ = std::move(onDone);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = true;
+    }
+    run();
+}
+
+void AsyncDataFileReaderBase::onRead(int64_t offset, size_t requested,
+                                     std::exception_ptr error, std::vector<uint8_t> data) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Arrival &a = arrivals_[offset];
+        a.requested = requested;
+        a.data = std::move(data);
+        a.error = error;
+        if (running_) {
+            // The thread handing blocks over picks it up.
+            return;
+        }
+        running_ = true;
+    }
+    run();
+}
+
+bool AsyncDataFileReaderBase::merge() {
+    bool merged = false;
+    for (;;) {
+        const int64_t bufferEnd = bufferOffset_ + static_cast<int64_t>(buffer_.size());
+        int64_t offset;
+        Arrival a;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::map<int64_t, Arrival>::iterator it = arrivals_.begin();
+            if (it == arrivals_.end() || (it->first > bufferEnd && !eof_ && !finished_)) {
+                return merged;
+            }
+            offset = it->first;
+            a = std::move(it->second);
+            arrivals_.erase(it);
+            --inflight_;
+        }
+        merged = true;
+        if (finished_ || eof_) {
+            continue;
+        } else if (a.error) {
+            finish(a.error);
+            continue;
+        }
+        eof_ = a.data.size() < a.requested;
+        const int64_t end = offset + static_cast<int64_t>(a.data.size());
+        if (end <= bufferEnd) {
+            continue;
+        }
+        // A read started before a seek may overlap the bytes held.
+        size_t from = static_cast<size_t>(bufferEnd - offset);
+        size_t used = static_cast<size_t>(pos_ - bufferOffset_);
+        if (used == buffer_.size() && from == 0) {
+            buffer_.swap(a.data);
+        } else {
+            buffer_.erase(buffer_.begin(), buffer_.begin() + used);
+            buffer_.insert(buffer_.end(), a.data.begin() + from, a.data.end());
+        }
+        bufferOffset_ = pos_;
+    }
+}
+
+void AsyncDataFileReaderBase::run() {
+    for (;;) {
+        merge();
+        bool progressed = false;
+        if (!finished_) {
+            try {
+                progressed = step();
+            } catch (...) {
+                finish(std::current_exception());
+            }
+        }
+        if (progressed) {
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const int64_t bufferEnd = bufferOffset_ + static_cast<int64_t>(buffer_.size());
+            if (!arrivals_.empty() && (arrivals_.begin()->first <= bufferEnd || eof_ || finished_)) {
+                continue;
+            }
+            running_ = false;
+            if (!finished_ || inflight_ != 0) {
+                return;
+            }
+        }
+        // Nothing refers to the reader once the handler is called.
+        DoneHandler onDone;
+        onDone.swap(onDone_);
+        if (onDone) {
+            onDone(error_);
+        }
+        return;
+    }
+}
+
+bool AsyncDataFileReaderBase::step() {
+    return headerRead_ ? readBlock() : readHeader();
+}
+
+bool AsyncDataFileReaderBase::readHeader() {
+    if (buffer_.size() >= magic.size() && !std::equal(magic.begin(), magic.end(), buffer_.begin())) {
+        throw Exception("Invalid data file. Magic does not match");
+    }
+    std::unique_ptr<InputStream> in = memoryInputStream(buffer_.data(), buffer_.size());
+    decoder_->init(*in);
+    Metadata metadata;
+    string codecName;
+    try {
+        readFileHeader(*decoder_, string(), metadata, dataSchema_, codecName, sync_);
+    } catch (Exception &) {
+        if (eof_) {
+            throw;
+        }
+        // The header is longer than what has been read so far.
+        fetch(bufferOffset_ + 2 * std::max(buffer_.size(), minReadSize_));
+        return false;
+    }
+    decoder_->drain();
+    pos_ = static_cast<int64_t>(in->byteCount());
+    metadata_.swap(metadata);
+
+    BlockCodecPtr codec = findCodec(codecName, dataSchema_, metadata_);
+    if (!codec) {
+        throw Exception("Unknown codec in data file: " + codecName);
+    }
+    if (codecName != AVRO_NULL_CODEC) {
+        decompressor_ = codec->newDecompressor();
+    }
+    if (!hasReaderSchema_) {
+        readerSchema_ = dataSchema_;
+    }
+    dataDecoder_ = readerSchema_.sameEncoding(dataSchema_) ? binaryDecoder() : compiledResolvingDecoder(dataSchema_, readerSchema_, binaryDecoder());
+
+    if (startPosition_ >= 0) {
+        if (startPosition_ < pos_) {
+            throw Exception("Cannot seek into the header of a data file");
+        } else if (startPosition_ <= bufferOffset_ + static_cast<int64_t>(buffer_.size())) {
+            pos_ = startPosition_;
+        } else {
+            buffer_.clear();
+            bufferOffset_ = pos_ = startPosition_;
+            requestedEnd_ = std::max(requestedEnd_, pos_);
+        }
+    }
+    headerRead_ = true;
+    return true;
+}
+
+bool AsyncDataFileReaderBase::readBlock() {
+    const uint8_t *begin = buffer_.data() + (pos_ - bufferOffset_);
+    const uint8_t *end = buffer_.data() + buffer_.size();
+    const int64_t bufferEnd = bufferOffset_ + static_cast<int64_t>(buffer_.size());
+    if (begin == end) {
+        if (eof_) {
+            finish(nullptr);
+            return true;
+        }
+        fetch(pos_ + MaxBlockHeader);
+        return false;
+    }
+
+    const uint8_t *p = begin;
+    int64_t objectCount;
+    int64_t byteSize;
+    if (!readBufferedLong(p, end, objectCount) || !readBufferedLong(p, end, byteSize)) {
+        if (eof_) {
+            throw Exception("Data file ends in a block header");
+        }
+        fetch(pos_ + MaxBlockHeader);
+        return false;
+    }
+    if (objectCount < 0 || byteSize < 0) {
+        throw Exception("Invalid block header");
+    }
+    const int64_t blockEnd = pos_ + (p - begin) + byteSize + SyncSize;
+    if (bufferEnd < blockEnd) {
+        if (eof_) {
+            throw Exception("Data file block runs past the end of the data");
+        }
+        fetch(blockEnd + MaxBlockHeader);
+        return false;
+    }
+    if (!std::equal(sync_.begin(), sync_.end(), p + byteSize)) {
+        throw Exception("Sync mismatch");
+    }
+
+    // The next blocks are on their way while this one is decoded.
+    fetch(blockEnd + MaxBlockHeader);
+
+    const uint8_t *data = p;
+    size_t len = static_cast<size_t>(byteSize);
+    if (decompressor_) {
+        len = decompressor_->decompress(p, len, decompressed_);
+        data = decompressed_.data();
+    }
+    std::unique_ptr<InputStream> in = memoryInputStream(data, len);
+    dataDecoder_->init(*in);
+    onBlock_(*dataDecoder_, objectCount);
+    // Lets a resolving decoder skip what is left of the last object.
+    dataDecoder_->init(*in);
+    pos_ = blockEnd;
+    return true;
+}
+
+void AsyncDataFileReaderBase::fetch(int64_t until) {
+    // The header is read one read at a time, as its size is not known.
+    const size_t depth = headerRead_ ? readDepth_ : 1;
+    while (!eof_ && (headerRead_ || until > requestedEnd_)) {
+        const int64_t offset = requestedEnd_;
+        const size_t len = std::max(minReadSize_, until > offset ? static_cast<size_t>(until - offset) : 0);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (inflight_ >= depth) {
+                return;
+            }
+            ++inflight_;
+        }
+        requestedEnd_ += static_cast<int64_t>(len);
+        try {
+            stream_->read(offset, len, [this, offset, len](std::exception_ptr error, std::vector<uint8_t> data) {
+                onRead(offset, len, error, std::move(data));
+            });
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --inflight_;
+            throw;
+        }
+    }
+}
+
+void AsyncDataFileReaderBase::finish(std::exception_ptr error) {
+    finished_ = true;
+    error_ = error;
+}
+
+DataFileAppender::DataFileAppender(const char *filename) : filename_(filename), encoder_(binaryEncoder()) {
+    {
+        DataFileBlockReader reader(filename);
+        schema_ = reader.dataSchema();
+        codecName_ = reader.codecName();
+        sync_ = reader.syncMarker();
+    }
+    stream_ = fileAppendOutputStream(filename);
+    encoder_->init(*stream_);
+}
+
+DataFileAppender::DataFileAppender(const char *filename, const ValidSchema &schema,
+                                   Codec codec) : DataFileAppender(filename, schema, avro::codecName(codec)) {
+}
+
+DataFileAppender::DataFileAppender(const char *filename, const ValidSchema &schema,
+                                   const string &codecName) : filename_(filename), schema_(schema), codecName_(codecName),
+                                                              sync_(DataFileWriterBase::makeSync()),
+                                                              stream_(fileOutputStream(filename)), encoder_(binaryEncoder()) {
+    std::map<string, vector<uint8_t>> metadata;
+    metadata[AVRO_CODEC_KEY].assign(codecName.begin(), codecName.end());
+    const string &json = schema.json(false);
+    metadata[AVRO_SCHEMA_KEY].assign(json.begin(), json.end());
+
+    encoder_->init(*stream_);
+    avro::encode(*encoder_, magic);
+    avro::encode(*encoder_, metadata);
+    avro::encode(*encoder_, sync_);
+}
+
+Codec DataFileAppender::codec() const {
+    return builtinCodec(codecName_);
+}
+
+DataFileAppender::~DataFileAppender() {
+    if (stream_) {
+        close();
+    }
+}
+
+void DataFileAppender::appendBlock(int64_t objectCount, const uint8_t *data, size_t len) {
+    avro::encode(*encoder_, objectCount);
+    avro::encode(*encoder_, static_cast<int64_t>(len));
+    encoder_->encodeFixed(data, len);
+    avro::encode(*encoder_, sync_);
+}
+
+int64_t DataFileAppender::append(DataFileBlockReader &reader) {
+    if (reader.codecName() != codecName_) {
+        throw Exception(boost::format("Cannot append blocks with codec %1% to %2%, which uses %3%")
+                        % reader.codecName() % filename_ % codecName_);
+    }
+    if (!reader.dataSchema().sameData(schema_)) {
+        throw Exception(boost::format("Cannot append blocks of schema %1% to %2%, whose schema is %3%")
+                        % reader.dataSchema().json(false) % filename_ % schema_.json(false));
+    }
+    int64_t count = 0;
+    DataFileBlock block;
+    while (reader.next(block)) {
+        reader.readBlockRaw(buffer_);
+        appendBlock(block.objectCount, buffer_.data(), buffer_.size());
+        count += block.objectCount;
+    }
+    return count;
+}
+
+int64_t DataFileAppender::append(const char *filename) {
+    DataFileBlockReader reader(filename);
+    return append(reader);
+}
+
+void DataFileAppender::flush() {
+    encoder_->flush();
+}
+
+void DataFileAppender::close() {
+    flush();
+    stream_.reset();
+}
+
 } // namespace avro
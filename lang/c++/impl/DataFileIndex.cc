@@ -0,0 +1,168 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DataFileIndex.hh"
+#include "Compiler.hh"
+#include "DataFile.hh"
+#include "Exception.hh"
+#include "Specific.hh"
+#include "XxHash.hh"
+
+#include <algorithm>
+#include <vector>
+
+namespace avro {
+
+using std::string;
+using std::unique_ptr;
+
+namespace {
+
+const char *const indexSchema = R"({
+    "type": "record",
+    "name": "BlockIndex",
+    "namespace": "org.apache.avro.file",
+    "fields": [
+        {"name": "offset", "type": "long"},
+        {"name": "objectCount", "type": "long"},
+        {"name": "checksum", "type": ["null", "long"], "default": null}
+    ]
+})";
+
+const ValidSchema &sidecarSchema() {
+    static const ValidSchema schema = compileJsonSchemaFromString(indexSchema);
+    return schema;
+}
+
+} // namespace
+
+template<>
+struct codec_traits<DataFileIndexEntry> {
+    static void encode(Encoder &e, const DataFileIndexEntry &b) {
+        avro::encode(e, b.offset);
+        avro::encode(e, b.objectCount);
+        if (b.hasChecksum) {
+            e.encodeUnionIndex(1);
+            e.encodeLong(static_cast<int64_t>(b.checksum));
+        } else {
+            e.encodeUnionIndex(0);
+            e.encodeNull();
+        }
+    }
+
+    static void decode(Decoder &d, DataFileIndexEntry &b) {
+        avro::decode(d, b.offset);
+        avro::decode(d, b.objectCount);
+        b.hasChecksum = d.decodeUnionIndex() == 1;
+        if (b.hasChecksum) {
+            b.checksum = static_cast<uint64_t>(d.decodeLong());
+        } else {
+            d.decodeNull();
+            b.checksum = 0;
+        }
+    }
+};
+
+void DataFileIndex::add(int64_t offset, int64_t objectCount) {
+    append(DataFileIndexEntry{offset, 0, objectCount, false, 0});
+}
+
+void DataFileIndex::add(int64_t offset, int64_t objectCount, uint64_t checksum) {
+    append(DataFileIndexEntry{offset, 0, objectCount, true, checksum});
+}
+
+void DataFileIndex::append(DataFileIndexEntry e) {
+    if (e.objectCount <= 0) {
+        return;
+    }
+    if (!entries_.empty() && e.offset <= entries_.back().offset) {
+        throw Exception(boost::format("Block at %1% is out of order in the index") % e.offset);
+    }
+    e.firstObject = objectCount();
+    entries_.push_back(e);
+}
+
+const DataFileIndexEntry *DataFileIndex::find(int64_t object) const {
+    if (object < 0) {
+        return nullptr;
+    }
+    // The first block starting past the object follows the one holding it.
+    auto it = std::upper_bound(entries_.begin(), entries_.end(), object,
+                               [](int64_t o, const DataFileIndexEntry &e) { return o < e.firstObject; });
+    if (it == entries_.begin()) {
+        return nullptr;
+    }
+    --it;
+    return object < it->firstObject + it->objectCount ? &*it : nullptr;
+}
+
+const DataFileIndexEntry *DataFileIndex::atOffset(int64_t offset) const {
+    auto it = std::lower_bound(entries_.begin(), entries_.end(), offset,
+                               [](const DataFileIndexEntry &e, int64_t o) { return e.offset < o; });
+    return it != entries_.end() && it->offset == offset ? &*it : nullptr;
+}
+
+int64_t DataFileIndex::objectCount() const {
+    return entries_.empty() ? 0 : entries_.back().firstObject + entries_.back().objectCount;
+}
+
+void writeDataFileIndex(unique_ptr<OutputStream> out, const DataFileIndex &index) {
+    DataFileWriter<DataFileIndexEntry> writer(std::move(out), sidecarSchema());
+    for (const auto &e : index.entries()) {
+        writer.write(e);
+    }
+    writer.close();
+}
+
+DataFileIndex readDataFileIndex(unique_ptr<InputStream> in) {
+    // Indexes written before checksums were kept are read with the
+    // checksums left out.
+    DataFileReader<DataFileIndexEntry> reader(std::move(in), sidecarSchema());
+    DataFileIndex result;
+    DataFileIndexEntry e{0, 0, 0, false, 0};
+    while (reader.read(e)) {
+        if (e.hasChecksum) {
+            result.add(e.offset, e.objectCount, e.checksum);
+        } else {
+            result.add(e.offset, e.objectCount);
+        }
+    }
+    return result;
+}
+
+DataFileIndex readDataFileIndex(const string &filename) {
+    return readDataFileIndex(fileInputStream(filename.c_str()));
+}
+
+DataFileIndex buildDataFileIndex(const char *filename, bool checksums) {
+    DataFileBlockReader reader(filename);
+    DataFileIndex result;
+    DataFileBlock block;
+    std::vector<uint8_t> data;
+    while (reader.next(block)) {
+        if (checksums) {
+            reader.readBlockRaw(data);
+            result.add(block.offset, block.objectCount, xxHash64(data.data(), data.size()));
+        } else {
+            result.add(block.offset, block.objectCount);
+        }
+    }
+    return result;
+}
+
+} // namespace avro
@@ -0,0 +1,415 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DataFileSorter.hh"
+#include "BinaryComparator.hh"
+#include "BinaryValidator.hh"
+#include "Codec.hh"
+#include "Compiler.hh"
+#include "DataFile.hh"
+#include "Exception.hh"
+#include "Executor.hh"
+#include "NodeImpl.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <memory>
+
+namespace avro {
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+typedef std::map<string, vector<uint8_t>> Metadata;
+
+// Runs are written uncompressed, in large blocks, since they are read
+// back only once.
+const size_t runSyncInterval = 64 * 1024;
+
+// The most files merged at once. More runs than that are first merged
+// in groups into longer runs.
+const size_t maxMergeWidth = 128;
+
+/**
+ * Reads the objects of a data file one at a time, as the binary
+ * encodings in its decompressed blocks. Objects are found by stepping
+ * over them with a BinaryValidator.
+ */
+class EncodedObjectReader {
+    DataFileBlockReader reader_;
+    // Null for the null codec, whose blocks are read as they are.
+    unique_ptr<BlockDecompressor> decompressor_;
+    BinaryValidator validator_;
+    vector<uint8_t> raw_;
+    vector<uint8_t> block_;
+    unique_ptr<InputStream> in_;
+    int64_t remaining_ = 0;
+    size_t position_ = 0;
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+
+public:
+    explicit EncodedObjectReader(const string &filename)
+        : reader_(filename.c_str()), validator_(reader_.dataSchema()) {
+        BlockCodecPtr codec = findCodec(reader_.codecName(), reader_.dataSchema(), reader_.metadata());
+        if (!codec) {
+            throw Exception(boost::format("Unknown codec in %1%: %2%") % filename % reader_.codecName());
+        }
+        if (codec->name() != "null") {
+            decompressor_ = codec->newDecompressor();
+        }
+    }
+
+    const ValidSchema &dataSchema() const { return reader_.dataSchema(); }
+
+    const Metadata &metadata() const { return reader_.metadata(); }
+
+    const string &codecName() const { return reader_.codecName(); }
+
+    /**
+     * Makes the next object of the file the current one; returns false
+     * at the end of the file.
+     */
+    bool next() {
+        while (remaining_ == 0) {
+            DataFileBlock b;
+            if (!reader_.next(b)) {
+                return false;
+            }
+            size_t size;
+            if (decompressor_) {
+                reader_.readBlockRaw(raw_);
+                size = decompressor_->decompress(raw_.data(), raw_.size(), block_);
+            } else {
+                reader_.readBlockRaw(block_);
+                size = block_.size();
+            }
+            in_ = memoryInputStream(block_.data(), size);
+            remaining_ = b.objectCount;
+            position_ = 0;
+        }
+        validator_.validate(*in_);
+        size_t end = static_cast<size_t>(in_->byteCount());
+        data_ = block_.data() + position_;
+        size_ = end - position_;
+        position_ = end;
+        --remaining_;
+        return true;
+    }
+
+    /// The encoding of the current object.
+    const uint8_t *data() const { return data_; }
+    size_t size() const { return size_; }
+};
+
+/**
+ * Picks the least of the current objects of a number of readers with
+ * a loser tree: each internal node keeps the reader that lost the match
+ * played there, so that replacing the winner takes one comparison per
+ * level. Readers at their end lose to every other, and ties go to the
+ * reader that comes first.
+ */
+class LoserTree {
+    const vector<unique_ptr<EncodedObjectReader>> &readers_;
+    const BinaryComparator &comparator_;
+    vector<bool> done_;
+    // tree_[0] is the winner; the readers are the leaves k..2k-1.
+    vector<size_t> tree_;
+
+    bool less(size_t a, size_t b) const {
+        if (done_[a] || done_[b]) {
+            return !done_[a] && (done_[b] || a < b);
+        }
+        const EncodedObjectReader &x = *readers_[a];
+        const EncodedObjectReader &y = *readers_[b];
+        int r = comparator_.compare(x.data(), x.size(), y.data(), y.size());
+        return r < 0 || (r == 0 && a < b);
+    }
+
+    // Plays the matches below node, returning its winner.
+    size_t play(size_t node) {
+        size_t k = readers_.size();
+        if (node >= k) {
+            return node - k;
+        }
+        size_t a = play(2 * node);
+        size_t b = play(2 * node + 1);
+        if (less(b, a)) {
+            std::swap(a, b);
+        }
+        tree_[node] = b;
+        return a;
+    }
+
+public:
+    LoserTree(const vector<unique_ptr<EncodedObjectReader>> &readers,
+              const BinaryComparator &comparator)
+        : readers_(readers), comparator_(comparator),
+          done_(readers.size()), tree_(readers.size()) {
+        for (size_t i = 0; i < readers.size(); ++i) {
+            done_[i] = !readers[i]->next();
+        }
+        tree_[0] = readers.size() == 1 ? 0 : play(1);
+    }
+
+    /**
+     * Sets \p reader to the reader with the least current object;
+     * returns false if every reader is at its end.
+     */
+    bool top(size_t &reader) const {
+        reader = tree_[0];
+        return !done_[reader];
+    }
+
+    /// Moves the winning reader to its next object.
+    void pop() {
+        size_t w = tree_[0];
+        done_[w] = !readers_[w]->next();
+        for (size_t t = (w + readers_.size()) / 2; t > 0; t /= 2) {
+            if (less(tree_[t], w)) {
+                std::swap(tree_[t], w);
+            }
+        }
+        tree_[0] = w;
+    }
+};
+
+// Objects held in memory while a run is being made.
+struct Run {
+    struct Object {
+        size_t offset;
+        size_t size;
+    };
+
+    vector<uint8_t> data;
+    vector<Object> objects;
+
+    void sort(const BinaryComparator &comparator) {
+        const uint8_t *base = data.data();
+        std::stable_sort(objects.begin(), objects.end(),
+                         [base, &comparator](const Object &a, const Object &b) {
+                             return comparator.compare(base + a.offset, a.size,
+                                                       base + b.offset, b.size)
+                                 < 0;
+                         });
+    }
+
+    void write(DataFileWriterBase &writer) const {
+        for (const Object &o : objects) {
+            writer.syncIfNeeded();
+            writer.writeEncoded(data.data() + o.offset, o.size, 1);
+        }
+        writer.close();
+    }
+};
+
+// The run files of a sort, removed when it is over.
+class RunFiles {
+    string prefix_;
+    size_t made_ = 0;
+
+public:
+    vector<string> names;
+
+    RunFiles(const string &directory, const string &output) {
+        string::size_type slash = output.find_last_of('/');
+        string base = slash == string::npos ? output : output.substr(slash + 1);
+        string dir = directory.empty()
+            ? (slash == string::npos ? string() : output.substr(0, slash + 1))
+            : directory + '/';
+        prefix_ = dir + base + ".run";
+    }
+
+    ~RunFiles() {
+        for (const string &n : names) {
+            std::remove(n.c_str());
+        }
+    }
+
+    string add() {
+        names.push_back(prefix_ + std::to_string(made_++));
+        return names.back();
+    }
+};
+
+ValidSchema sortSchema(const ValidSchema &schema, const string &keyField) {
+    if (keyField.empty()) {
+        return schema;
+    }
+    // A copy whose fields are all ignored, but for the key.
+    ValidSchema result = compileJsonSchemaFromString(schema.toJson(false));
+    const NodePtr &root = result.root();
+    size_t index;
+    if (root->type() != AVRO_RECORD || !root->nameIndex(keyField, index)) {
+        throw Exception(boost::format("No field to sort by named %1%") % keyField);
+    }
+    vector<SortOrder> orders(root->leaves(), ORDER_IGNORE);
+    orders[index] = root->fieldOrderAt(index) == ORDER_DESCENDING ? ORDER_DESCENDING : ORDER_ASCENDING;
+    std::static_pointer_cast<NodeRecord>(root)->setFieldOrders(std::move(orders));
+    return result;
+}
+
+// The metadata is that of the input the codec is taken from, which keeps
+// what the codec needs besides its name, if anything.
+BlockCodecPtr outputCodec(const string &name, const ValidSchema &schema,
+                          const Metadata &metadata) {
+    BlockCodecPtr result = findCodec(name, schema, metadata);
+    if (!result) {
+        throw Exception(boost::format("Unknown codec: %1%") % name);
+    }
+    return result;
+}
+
+int64_t merge(const vector<string> &inputs, DataFileWriterBase &writer,
+              const BinaryComparator &comparator) {
+    vector<unique_ptr<EncodedObjectReader>> readers;
+    for (const string &name : inputs) {
+        readers.emplace_back(new EncodedObjectReader(name));
+    }
+    LoserTree tree(readers, comparator);
+    int64_t count = 0;
+    size_t r;
+    while (tree.top(r)) {
+        writer.syncIfNeeded();
+        writer.writeEncoded(readers[r]->data(), readers[r]->size(), 1);
+        ++count;
+        tree.pop();
+    }
+    writer.close();
+    return count;
+}
+
+// Merges runs in consecutive groups until there are few enough to merge
+// at once, keeping the order of objects that compare equal.
+void narrow(RunFiles &runs, const ValidSchema &schema,
+            const BinaryComparator &comparator) {
+    while (runs.names.size() > maxMergeWidth) {
+        vector<string> merged;
+        vector<string> all;
+        all.swap(runs.names);
+        for (size_t i = 0; i < all.size(); i += maxMergeWidth) {
+            vector<string> group(all.begin() + i,
+                                 all.begin() + std::min(i + maxMergeWidth, all.size()));
+            string name = runs.add();
+            DataFileWriterBase writer(name.c_str(), schema, runSyncInterval, NULL_CODEC);
+            merge(group, writer, comparator);
+            for (const string &n : group) {
+                std::remove(n.c_str());
+            }
+            merged.push_back(name);
+        }
+        runs.names.swap(merged);
+    }
+}
+
+} // namespace
+
+int64_t sortDataFile(const string &input, const string &output,
+                     const SortOptions &options) {
+    EncodedObjectReader reader(input);
+    const ValidSchema schema = reader.dataSchema();
+    const BinaryComparator comparator(sortSchema(schema, options.keyField));
+    const BlockCodecPtr codec = options.codec.empty()
+        ? outputCodec(reader.codecName(), schema, reader.metadata())
+        : outputCodec(options.codec, schema, Metadata());
+    const size_t threads = std::max(options.threads, static_cast<size_t>(1));
+    const size_t runLimit = std::max(options.memoryLimit / (threads + 1), static_cast<size_t>(1));
+
+    // Declared first so that the runs are removed after the tasks that
+    // write them are done.
+    RunFiles runs(options.tempDirectory, output);
+    std::deque<std::unique_ptr<TaskGroup>> pending;
+    std::shared_ptr<Run> run = std::make_shared<Run>();
+    int64_t count = 0;
+    for (bool more = reader.next(); more;) {
+        Run::Object o = {run->data.size(), reader.size()};
+        run->data.insert(run->data.end(), reader.data(), reader.data() + reader.size());
+        run->objects.push_back(o);
+        ++count;
+        more = reader.next();
+        if (more && run->data.size() >= runLimit) {
+            if (pending.size() == threads) {
+                pending.front()->wait();
+                pending.pop_front();
+            }
+            string name = runs.add();
+            std::shared_ptr<Run> full = std::move(run);
+            run = std::make_shared<Run>();
+            run->data.reserve(full->data.size());
+            pending.emplace_back(new TaskGroup(options.executor, 1));
+            pending.back()->run([full, name, &schema, &comparator]() {
+                full->sort(comparator);
+                DataFileWriterBase writer(name.c_str(), schema, runSyncInterval, NULL_CODEC);
+                full->write(writer);
+            });
+        }
+    }
+
+    run->sort(comparator);
+    if (runs.names.empty()) {
+        // It all fit in memory.
+        DataFileWriterBase writer(output.c_str(), schema, options.syncInterval, codec);
+        run->write(writer);
+        return count;
+    }
+    {
+        DataFileWriterBase writer(runs.add().c_str(), schema, runSyncInterval, NULL_CODEC);
+        run->write(writer);
+    }
+    run.reset();
+    while (!pending.empty()) {
+        pending.front()->wait();
+        pending.pop_front();
+    }
+
+    narrow(runs, schema, comparator);
+    DataFileWriterBase writer(output.c_str(), schema, options.syncInterval, codec);
+    merge(runs.names, writer, comparator);
+    return count;
+}
+
+int64_t mergeDataFiles(const vector<string> &inputs, const string &output,
+                       const SortOptions &options) {
+    if (inputs.empty()) {
+        throw Exception("No data files to merge");
+    }
+    const ValidSchema schema = DataFileBlockReader(inputs.front().c_str()).dataSchema();
+    string codecName = options.codec;
+    Metadata codecMetadata;
+    for (const string &name : inputs) {
+        DataFileBlockReader r(name.c_str());
+        if (!r.dataSchema().sameData(schema)) {
+            throw Exception(boost::format("Cannot merge %1%: its schema differs from that of %2%") % name % inputs.front());
+        }
+        if (codecName.empty()) {
+            codecName = r.codecName();
+            codecMetadata = r.metadata();
+        }
+    }
+    const BinaryComparator comparator(sortSchema(schema, options.keyField));
+    DataFileWriterBase writer(output.c_str(), schema, options.syncInterval,
+                              outputCodec(codecName, schema, codecMetadata));
+    return merge(inputs, writer, comparator);
+}
+
+} // namespace avro
@@ -0,0 +1,148 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DatumVisitor.hh"
+#include "Exception.hh"
+#include "NodeImpl.hh"
+
+#include <utility>
+
+namespace avro {
+
+DatumVisitor::~DatumVisitor() = default;
+
+DatumReader::DatumReader(ValidSchema s, const DecoderPtr &decoder) : schema_(std::move(s)),
+                                                                     isResolving_(dynamic_cast<ResolvingDecoder *>(decoder.get()) != nullptr),
+                                                                     decoder_(decoder) {
+}
+
+DatumReader::DatumReader(const ValidSchema &writerSchema,
+                         const ValidSchema &readerSchema, const DecoderPtr &decoder) : schema_(readerSchema),
+                                                                                       isResolving_(!readerSchema.sameEncoding(writerSchema)),
+                                                                                       decoder_(isResolving_ ? compiledResolvingDecoder(writerSchema, readerSchema, decoder) : decoder) {
+}
+
+void DatumReader::read(DatumVisitor &visitor) {
+    read(resolvedNode(*schema_.root()), visitor);
+}
+
+void DatumReader::read(const Node &n, DatumVisitor &v) {
+    Decoder &d = *decoder_;
+    switch (n.type()) {
+        case AVRO_NULL:
+            d.decodeNull();
+            v.onNull();
+            break;
+        case AVRO_BOOL:
+            v.onBool(d.decodeBool());
+            break;
+        case AVRO_INT:
+            v.onInt(d.decodeInt());
+            break;
+        case AVRO_LONG:
+            v.onLong(d.decodeLong());
+            break;
+        case AVRO_FLOAT:
+            v.onFloat(d.decodeFloat());
+            break;
+        case AVRO_DOUBLE:
+            v.onDouble(d.decodeDouble());
+            break;
+        case AVRO_STRING: {
+            const char *data;
+            size_t len;
+            d.decodeStringView(data, len);
+            v.onString(data, len);
+        } break;
+        case AVRO_BYTES: {
+            const uint8_t *data;
+            size_t len;
+            d.decodeBytesView(data, len);
+            v.onBytes(data, len);
+        } break;
+        case AVRO_FIXED:
+            d.decodeFixed(n.fixedSize(), fixed_);
+            v.onFixed(fixed_.data(), fixed_.size());
+            break;
+        case AVRO_ENUM: {
+            size_t i = d.decodeEnum();
+            if (i >= n.names()) {
+                throw Exception(boost::format("Enum index %1% out of range for %2%") % i % n.name());
+            }
+            v.onEnum(i, n.nameAt(i));
+        } break;
+        case AVRO_RECORD: {
+            v.onRecordStart(n);
+            size_t c = n.leaves();
+            if (isResolving_) {
+                // Resolving decoders keep their field orders in their
+                // grammars or programs, which outlive the record.
+                const std::vector<size_t> &fo = static_cast<ResolvingDecoder &>(d).fieldOrder();
+                for (size_t i = 0; i < c; ++i) {
+                    v.onField(fo[i], n.nameAt(fo[i]));
+                    read(resolvedNode(*n.leafAt(fo[i])), v);
+                }
+            } else {
+                for (size_t i = 0; i < c; ++i) {
+                    v.onField(i, n.nameAt(i));
+                    read(resolvedNode(*n.leafAt(i)), v);
+                }
+            }
+            v.onRecordEnd(n);
+        } break;
+        case AVRO_ARRAY: {
+            const Node &item = resolvedNode(*n.leafAt(0));
+            v.onArrayStart(n);
+            size_t count = 0;
+            for (size_t m = d.arrayStart(); m != 0; m = d.arrayNext()) {
+                for (size_t end = count + m; count < end; ++count) {
+                    v.onArrayItem(count);
+                    read(item, v);
+                }
+            }
+            v.onArrayEnd(count);
+        } break;
+        case AVRO_MAP: {
+            const Node &value = resolvedNode(*n.leafAt(1));
+            v.onMapStart(n);
+            size_t count = 0;
+            for (size_t m = d.mapStart(); m != 0; m = d.mapNext()) {
+                for (size_t end = count + m; count < end; ++count) {
+                    const char *data;
+                    size_t len;
+                    d.decodeStringView(data, len);
+                    v.onMapKey(data, len);
+                    read(value, v);
+                }
+            }
+            v.onMapEnd(count);
+        } break;
+        case AVRO_UNION: {
+            size_t i = d.decodeUnionIndex();
+            if (i >= n.leaves()) {
+                throw Exception(boost::format("Union index %1% out of range") % i);
+            }
+            v.onUnionBranch(i);
+            read(resolvedNode(*n.leafAt(i)), v);
+        } break;
+        default:
+            throw Exception(boost::format("Unknown schema type %1%") % toString(n.type()));
+    }
+}
+
+} // namespace avro
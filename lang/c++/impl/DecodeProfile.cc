@@ -0,0 +1,611 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DecodeProfile.hh"
+#include "Exception.hh"
+#include "NodeImpl.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <ostream>
+
+namespace avro {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+const size_t npos = static_cast<size_t>(-1);
+
+const Node *actual(const NodePtr &n) {
+    return n->type() == AVRO_SYMBOLIC
+        ? std::static_pointer_cast<NodeSymbolic>(n)->getNode().get()
+        : n.get();
+}
+
+// The size of a long in the binary encoding.
+uint64_t longSize(int64_t n) {
+    uint64_t z = (static_cast<uint64_t>(n) << 1) ^ static_cast<uint64_t>(n >> 63);
+    uint64_t size = 1;
+    while (z >= 0x80) {
+        z >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+uint64_t encodedSize(int32_t n) {
+    return longSize(n);
+}
+
+uint64_t encodedSize(int64_t n) {
+    return longSize(n);
+}
+
+uint64_t encodedSize(float) {
+    return sizeof(float);
+}
+
+uint64_t encodedSize(double) {
+    return sizeof(double);
+}
+
+uint64_t lengthSize(size_t len) {
+    return longSize(static_cast<int64_t>(len)) + len;
+}
+
+} // namespace
+
+size_t DecodeProfile::intern(const string &path) {
+    std::map<string, size_t>::const_iterator it = index_.find(path);
+    if (it != index_.end()) {
+        return it->second;
+    }
+    size_t result = entries_.size();
+    entries_.emplace_back();
+    entries_.back().cost.path = path;
+    index_[path] = result;
+    return result;
+}
+
+vector<DecodeCost> DecodeProfile::costs() const {
+    vector<DecodeCost> result;
+    result.reserve(entries_.size());
+    for (const Entry &e : entries_) {
+        // Records, and the top level, have paths but no calls.
+        if (e.calls == 0) {
+            continue;
+        }
+        result.push_back(e.cost);
+        // Scale the sampled time up to all the calls.
+        if (e.cost.samples != 0) {
+            result.back().nanos = static_cast<uint64_t>(static_cast<double>(e.cost.nanos) * e.calls / e.cost.samples);
+        }
+    }
+    std::stable_sort(result.begin(), result.end(), [](const DecodeCost &a, const DecodeCost &b) {
+        return a.nanos != b.nanos ? a.nanos > b.nanos : a.bytes > b.bytes;
+    });
+    return result;
+}
+
+void DecodeProfile::merge(const DecodeProfile &other) {
+    for (const Entry &e : other.entries_) {
+        Entry &mine = entries_[intern(e.cost.path)];
+        mine.cost.values += e.cost.values;
+        mine.cost.bytes += e.cost.bytes;
+        mine.cost.allocations += e.cost.allocations;
+        mine.cost.nanos += e.cost.nanos;
+        mine.cost.samples += e.cost.samples;
+        mine.calls += e.calls;
+    }
+}
+
+void DecodeProfile::clear() {
+    entries_.clear();
+    index_.clear();
+}
+
+void DecodeProfile::report(std::ostream &os, size_t limit) const {
+    vector<DecodeCost> c = costs();
+    uint64_t nanos = 0, bytes = 0;
+    for (const DecodeCost &e : c) {
+        nanos += e.nanos;
+        bytes += e.bytes;
+    }
+    if (limit != 0 && c.size() > limit) {
+        c.resize(limit);
+    }
+    std::ios::fmtflags flags = os.flags();
+    os << std::setw(7) << "time%" << std::setw(12) << "us" << std::setw(7) << "bytes%"
+       << std::setw(14) << "bytes" << std::setw(12) << "values" << std::setw(8) << "allocs"
+       << "  path\n";
+    for (const DecodeCost &e : c) {
+        os << std::fixed << std::setprecision(1)
+           << std::setw(7) << (nanos != 0 ? 100.0 * e.nanos / nanos : 0.0)
+           << std::setw(12) << e.nanos / 1000
+           << std::setw(7) << (bytes != 0 ? 100.0 * e.bytes / bytes : 0.0)
+           << std::setw(14) << e.bytes << std::setw(12) << e.values
+           << std::setw(8) << e.allocations
+           << "  " << (e.path.empty() ? "(top level)" : e.path) << '\n';
+    }
+    os.flags(flags);
+}
+
+/**
+ * Follows the calls of a decoder through its schema, to tell the path of
+ * the value each one decodes, and charges their costs to the profile.
+ *
+ * The stack holds the records, arrays, maps and unions being decoded.
+ * Records have no calls of their own, so they are entered on the way to
+ * their first field that has, and left after their last.
+ */
+class DecodeProfiler {
+public:
+    struct Frame {
+        const Node *node;
+        size_t path;
+        // Records: the fields taken; maps: 1 when a key is next; unions:
+        // the branch.
+        size_t next;
+        // The field order of a resolving decoder, if any.
+        vector<size_t> order;
+
+        Frame(const Node *n, size_t p, size_t x) : node(n), path(p), next(x) {}
+    };
+
+private:
+    const ValidSchema schema_;
+    const DecodeProfilePtr profile_;
+    const size_t sampleInterval_;
+    const size_t root_;
+    size_t untilSample_;
+    vector<Frame> stack_;
+    // The paths of the leaves of each path, as they are met.
+    vector<vector<size_t>> leaves_;
+
+    size_t leafPath(const Frame &f, size_t leaf) {
+        if (leaves_.size() <= f.path) {
+            leaves_.resize(f.path + 1);
+        }
+        vector<size_t> &l = leaves_[f.path];
+        if (l.size() <= leaf) {
+            l.resize(leaf + 1, npos);
+        }
+        if (l[leaf] == npos) {
+            string path = profile_->entries_[f.path].cost.path;
+            switch (f.node->type()) {
+                case AVRO_RECORD:
+                    if (!path.empty()) {
+                        path += '.';
+                    }
+                    path += f.node->nameAt(leaf);
+                    break;
+                case AVRO_ARRAY:
+                    path += "[]";
+                    break;
+                case AVRO_MAP:
+                    path += "{}";
+                    break;
+                default:
+                    break;
+            }
+            size_t p = profile_->intern(path);
+            // Interning may have grown the entries, not the leaves.
+            leaves_[f.path][leaf] = p;
+        }
+        return leaves_[f.path][leaf];
+    }
+
+    // The next value of the innermost frame, or the top-level one.
+    Frame child() {
+        if (stack_.empty()) {
+            return Frame(actual(schema_.root()), root_, 0);
+        }
+        Frame &f = stack_.back();
+        switch (f.node->type()) {
+            case AVRO_RECORD: {
+                if (f.next == f.node->leaves()) {
+                    throw Exception(boost::format("Decoding past the last field of %1%") % f.node->name());
+                }
+                size_t i = f.order.empty() ? f.next : f.order[f.next];
+                ++f.next;
+                return Frame(actual(f.node->leafAt(i)), leafPath(f, i), 0);
+            }
+            case AVRO_ARRAY:
+                return Frame(actual(f.node->leafAt(0)), leafPath(f, 0), 0);
+            case AVRO_MAP:
+                if (f.next != 0) {
+                    f.next = 0;
+                    return Frame(f.node, f.path, 0);
+                }
+                f.next = 1;
+                return Frame(actual(f.node->leafAt(1)), leafPath(f, 1), 0);
+            default:
+                return Frame(actual(f.node->leafAt(f.next)), f.path, 0);
+        }
+    }
+
+    void enterRecord(Frame &&f) {
+        stack_.push_back(std::move(f));
+        if (stack_.back().node->leaves() == 0) {
+            ended();
+        }
+    }
+
+public:
+    DecodeProfiler(const ValidSchema &schema, const DecodeProfilePtr &profile, size_t sampleInterval) : schema_(schema), profile_(profile),
+                                                                                                      sampleInterval_(std::max<size_t>(sampleInterval, 1)),
+                                                                                                      root_(profile->intern(string())),
+                                                                                                      untilSample_(1) {}
+
+    void reset() {
+        stack_.clear();
+    }
+
+    /**
+     * Returns the node and path of the value the next call decodes,
+     * entering the records on the way.
+     */
+    Frame value() {
+        for (;;) {
+            Frame f = child();
+            if (f.node->type() != AVRO_RECORD || (stack_.empty() && f.node->leaves() == 0)) {
+                return f;
+            }
+            enterRecord(std::move(f));
+        }
+    }
+
+    /**
+     * Enters the record the next call decodes a field of, in \p order.
+     */
+    void record(const vector<size_t> &order) {
+        Frame f = child();
+        if (f.node->type() != AVRO_RECORD) {
+            throw Exception(boost::format("Asked for the field order of %1%") % f.node->type());
+        }
+        f.order = order;
+        enterRecord(std::move(f));
+    }
+
+    /**
+     * Enters \p v, an array, map or union just started, with \p next as
+     * the state of its frame.
+     */
+    void enter(const Frame &v, size_t next) {
+        stack_.push_back(Frame(v.node, v.path, next));
+    }
+
+    /**
+     * The path of the innermost array or map, for its later blocks.
+     */
+    Frame current() const {
+        return stack_.empty() ? Frame(actual(schema_.root()), root_, 0) : Frame(stack_.back().node, stack_.back().path, 0);
+    }
+
+    /**
+     * Leaves the innermost array or map, after its last block.
+     */
+    void leave() {
+        if (!stack_.empty()) {
+            stack_.pop_back();
+        }
+        ended();
+    }
+
+    /**
+     * Leaves the records and unions that the value just decoded ends.
+     */
+    void ended() {
+        while (!stack_.empty()) {
+            const Frame &f = stack_.back();
+            if (f.node->type() == AVRO_RECORD ? f.next < f.node->leaves() : f.node->type() != AVRO_UNION) {
+                return;
+            }
+            stack_.pop_back();
+        }
+    }
+
+    /**
+     * Times one call if it is a sampled one.
+     */
+    class Call {
+        DecodeProfiler &p_;
+        const size_t path_;
+        const bool timed_;
+        std::chrono::steady_clock::time_point start_;
+
+    public:
+        Call(DecodeProfiler &p, const Frame &v) : p_(p), path_(v.path), timed_(--p.untilSample_ == 0) {
+            if (timed_) {
+                p_.untilSample_ = p_.sampleInterval_;
+                start_ = std::chrono::steady_clock::now();
+            }
+        }
+
+        void done(uint64_t values, uint64_t bytes, uint64_t allocations = 0) {
+            DecodeProfile::Entry &e = p_.profile_->entries_[path_];
+            if (timed_) {
+                e.cost.nanos += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count());
+                ++e.cost.samples;
+            }
+            ++e.calls;
+            e.cost.values += values;
+            e.cost.bytes += bytes;
+            e.cost.allocations += allocations;
+        }
+    };
+};
+
+namespace {
+
+template<typename Base>
+class ProfilingDecoder : public Base {
+protected:
+    const DecoderPtr base_;
+    DecodeProfiler p_;
+
+    typedef DecodeProfiler::Call Call;
+
+    template<typename T>
+    T primitive(T (Decoder::*decode)(), uint64_t size) {
+        Call c(p_, p_.value());
+        T result = (base_.get()->*decode)();
+        c.done(1, size);
+        p_.ended();
+        return result;
+    }
+
+    template<typename T>
+    void decodeArray(T *values, size_t n, void (Decoder::*decode)(T *, size_t)) {
+        Call c(p_, p_.value());
+        (base_.get()->*decode)(values, n);
+        uint64_t bytes = 0;
+        for (size_t i = 0; i < n; ++i) {
+            bytes += encodedSize(values[i]);
+        }
+        c.done(n, bytes);
+        p_.ended();
+    }
+
+    // The first block of an array or map, entering it unless it is empty.
+    size_t start(size_t (Decoder::*start)()) {
+        DecodeProfiler::Frame v = p_.value();
+        Call c(p_, v);
+        size_t n = (base_.get()->*start)();
+        c.done(0, longSize(static_cast<int64_t>(n)));
+        if (n != 0) {
+            p_.enter(v, 1);
+        } else {
+            p_.ended();
+        }
+        return n;
+    }
+
+    size_t next(size_t (Decoder::*next)()) {
+        Call c(p_, p_.current());
+        size_t n = (base_.get()->*next)();
+        c.done(0, longSize(static_cast<int64_t>(n)));
+        if (n == 0) {
+            p_.leave();
+        }
+        return n;
+    }
+
+public:
+    ProfilingDecoder(const ValidSchema &schema, const DecoderPtr &base, const DecodeProfilePtr &profile, size_t sampleInterval) : base_(base), p_(schema, profile, sampleInterval) {}
+
+    void init(InputStream &is) override {
+        p_.reset();
+        base_->init(is);
+    }
+
+    void decodeNull() override {
+        Call c(p_, p_.value());
+        base_->decodeNull();
+        c.done(1, 0);
+        p_.ended();
+    }
+
+    bool decodeBool() override {
+        return primitive(&Decoder::decodeBool, 1);
+    }
+
+    int32_t decodeInt() override {
+        Call c(p_, p_.value());
+        int32_t result = base_->decodeInt();
+        c.done(1, longSize(result));
+        p_.ended();
+        return result;
+    }
+
+    int64_t decodeLong() override {
+        Call c(p_, p_.value());
+        int64_t result = base_->decodeLong();
+        c.done(1, longSize(result));
+        p_.ended();
+        return result;
+    }
+
+    float decodeFloat() override {
+        return primitive(&Decoder::decodeFloat, sizeof(float));
+    }
+
+    double decodeDouble() override {
+        return primitive(&Decoder::decodeDouble, sizeof(double));
+    }
+
+    void decodeIntArray(int32_t *values, size_t n) override {
+        decodeArray(values, n, &Decoder::decodeIntArray);
+    }
+
+    void decodeLongArray(int64_t *values, size_t n) override {
+        decodeArray(values, n, &Decoder::decodeLongArray);
+    }
+
+    void decodeFloatArray(float *values, size_t n) override {
+        decodeArray(values, n, &Decoder::decodeFloatArray);
+    }
+
+    void decodeDoubleArray(double *values, size_t n) override {
+        decodeArray(values, n, &Decoder::decodeDoubleArray);
+    }
+
+    void decodeString(string &value) override {
+        Call c(p_, p_.value());
+        size_t capacity = value.capacity();
+        base_->decodeString(value);
+        c.done(1, lengthSize(value.size()), value.capacity() != capacity ? 1 : 0);
+        p_.ended();
+    }
+
+    // Skipping reads a view, to learn the length.
+    void skipString() override {
+        const char *data;
+        size_t len;
+        decodeStringView(data, len);
+    }
+
+    void decodeStringView(const char *&data, size_t &len) override {
+        Call c(p_, p_.value());
+        base_->decodeStringView(data, len);
+        c.done(1, lengthSize(len));
+        p_.ended();
+    }
+
+    void decodeBytes(vector<uint8_t> &value) override {
+        Call c(p_, p_.value());
+        size_t capacity = value.capacity();
+        base_->decodeBytes(value);
+        c.done(1, lengthSize(value.size()), value.capacity() != capacity ? 1 : 0);
+        p_.ended();
+    }
+
+    void skipBytes() override {
+        const uint8_t *data;
+        size_t len;
+        decodeBytesView(data, len);
+    }
+
+    void decodeBytesView(const uint8_t *&data, size_t &len) override {
+        Call c(p_, p_.value());
+        base_->decodeBytesView(data, len);
+        c.done(1, lengthSize(len));
+        p_.ended();
+    }
+
+    void decodeFixed(size_t n, vector<uint8_t> &value) override {
+        Call c(p_, p_.value());
+        size_t capacity = value.capacity();
+        base_->decodeFixed(n, value);
+        c.done(1, n, value.capacity() != capacity ? 1 : 0);
+        p_.ended();
+    }
+
+    void decodeFixedView(size_t n, const uint8_t *&data) override {
+        Call c(p_, p_.value());
+        base_->decodeFixedView(n, data);
+        c.done(1, n);
+        p_.ended();
+    }
+
+    void skipFixed(size_t n) override {
+        Call c(p_, p_.value());
+        base_->skipFixed(n);
+        c.done(1, n);
+        p_.ended();
+    }
+
+    size_t decodeEnum() override {
+        Call c(p_, p_.value());
+        size_t result = base_->decodeEnum();
+        c.done(1, longSize(static_cast<int64_t>(result)));
+        p_.ended();
+        return result;
+    }
+
+    size_t arrayStart() override {
+        return start(&Decoder::arrayStart);
+    }
+
+    size_t arrayNext() override {
+        return next(&Decoder::arrayNext);
+    }
+
+    size_t skipArray() override {
+        return start(&Decoder::skipArray);
+    }
+
+    size_t mapStart() override {
+        return start(&Decoder::mapStart);
+    }
+
+    size_t mapNext() override {
+        return next(&Decoder::mapNext);
+    }
+
+    size_t skipMap() override {
+        return start(&Decoder::skipMap);
+    }
+
+    size_t decodeUnionIndex() override {
+        DecodeProfiler::Frame v = p_.value();
+        Call c(p_, v);
+        size_t result = base_->decodeUnionIndex();
+        c.done(1, longSize(static_cast<int64_t>(result)));
+        p_.enter(v, result);
+        return result;
+    }
+
+    void drain() override {
+        base_->drain();
+    }
+
+    void setUtf8Validation(bool validate) override {
+        base_->setUtf8Validation(validate);
+    }
+};
+
+class ProfilingResolvingDecoder : public ProfilingDecoder<ResolvingDecoder> {
+    ResolvingDecoder &resolving_;
+
+public:
+    ProfilingResolvingDecoder(const ValidSchema &schema, const ResolvingDecoderPtr &base, const DecodeProfilePtr &profile, size_t sampleInterval) : ProfilingDecoder<ResolvingDecoder>(schema, base, profile, sampleInterval), resolving_(*base) {}
+
+    const vector<size_t> &fieldOrder() override {
+        const vector<size_t> &result = resolving_.fieldOrder();
+        p_.record(result);
+        return result;
+    }
+};
+
+} // namespace
+
+DecoderPtr profilingDecoder(const ValidSchema &schema, const DecoderPtr &base,
+                            const DecodeProfilePtr &profile, size_t sampleInterval) {
+    return std::make_shared<ProfilingDecoder<Decoder>>(schema, base, profile, sampleInterval);
+}
+
+ResolvingDecoderPtr profilingDecoder(const ValidSchema &readerSchema, const ResolvingDecoderPtr &base,
+                                     const DecodeProfilePtr &profile, size_t sampleInterval) {
+    return std::make_shared<ProfilingResolvingDecoder>(readerSchema, base, profile, sampleInterval);
+}
+
+} // namespace avro
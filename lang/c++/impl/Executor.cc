@@ -0,0 +1,401 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Executor.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace avro {
+
+Executor::~Executor() = default;
+
+struct WorkStealingExecutor::Impl {
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    // The CPUs the threads run on; any if empty.
+    std::vector<int> cpus;
+    // Spreads the tasks submitted from other threads over the queues.
+    std::atomic<size_t> next;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    // The tasks in all the queues.
+    size_t queued;
+    bool stopping;
+
+    // The executor and queue of the thread, if it is one of an executor's.
+    static thread_local Impl *current;
+    static thread_local size_t currentQueue;
+
+    explicit Impl(size_t n) : next(0), queued(0), stopping(false) {
+        for (size_t i = 0; i < n; ++i) {
+            queues.emplace_back(new Queue());
+        }
+    }
+
+    // Takes the newest task of queue i, or else the oldest of another.
+    bool take(size_t i, std::function<void()> &task) {
+        for (size_t k = 0; k < queues.size(); ++k) {
+            Queue &q = *queues[(i + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (!q.tasks.empty()) {
+                if (k == 0) {
+                    task = std::move(q.tasks.back());
+                    q.tasks.pop_back();
+                } else {
+                    task = std::move(q.tasks.front());
+                    q.tasks.pop_front();
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Keeps the calling thread to the CPUs, if it can.
+    void pin() {
+#ifdef __linux__
+        if (cpus.empty()) {
+            return;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+#endif
+    }
+
+    void run(size_t i) {
+        current = this;
+        currentQueue = i;
+        pin();
+        for (;;) {
+            std::function<void()> task;
+            if (take(i, task)) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    --queued;
+                }
+                try {
+                    task();
+                } catch (...) {
+                }
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [this] { return queued != 0 || stopping; });
+            if (queued == 0) {
+                return;
+            }
+        }
+    }
+};
+
+thread_local WorkStealingExecutor::Impl *WorkStealingExecutor::Impl::current = nullptr;
+thread_local size_t WorkStealingExecutor::Impl::currentQueue = 0;
+
+WorkStealingExecutor::WorkStealingExecutor(size_t threads) : WorkStealingExecutor(threads, std::vector<int>()) {
+}
+
+WorkStealingExecutor::WorkStealingExecutor(size_t threads, const std::vector<int> &cpus) {
+    if (threads == 0) {
+        threads = cpus.empty() ? std::thread::hardware_concurrency() : cpus.size();
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+    impl_.reset(new Impl(threads));
+    impl_->cpus = cpus;
+    for (size_t i = 0; i < threads; ++i) {
+        impl_->threads.emplace_back(&Impl::run, impl_.get(), i);
+    }
+}
+
+WorkStealingExecutor::~WorkStealingExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        impl_->stopping = true;
+    }
+    impl_->cond.notify_all();
+    for (std::thread &t : impl_->threads) {
+        t.join();
+    }
+}
+
+void WorkStealingExecutor::submit(std::function<void()> task) {
+    size_t i = Impl::current == impl_.get()
+        ? Impl::currentQueue
+        : impl_->next++ % impl_->queues.size();
+    {
+        Impl::Queue &q = *impl_->queues[i];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        q.tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        ++impl_->queued;
+    }
+    impl_->cond.notify_one();
+}
+
+size_t WorkStealingExecutor::concurrency() const {
+    return impl_->threads.size();
+}
+
+namespace {
+
+std::mutex defaultMutex;
+ExecutorPtr defaultInstance;
+
+#ifdef __linux__
+// Reads a list such as "0-3,8,10-11", as the kernel writes them.
+std::vector<int> readList(const std::string &path) {
+    std::vector<int> result;
+    std::ifstream in(path.c_str());
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        int from;
+        int to;
+        char dash;
+        std::istringstream is(item);
+        if (!(is >> from)) {
+            continue;
+        }
+        if (!(is >> dash >> to) || dash != '-') {
+            to = from;
+        }
+        for (int i = from; i <= to; ++i) {
+            result.push_back(i);
+        }
+    }
+    return result;
+}
+#endif
+
+} // namespace
+
+std::vector<std::vector<int>> numaNodes() {
+    std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+    const std::string root = "/sys/devices/system/node/";
+    for (int node : readList(root + "online")) {
+        std::vector<int> cpus = readList(root + "node" + std::to_string(node) + "/cpulist");
+        // Nodes with memory only have nothing to run.
+        if (!cpus.empty()) {
+            nodes.push_back(std::move(cpus));
+        }
+    }
+#endif
+    if (nodes.empty()) {
+        nodes.emplace_back();
+    }
+    return nodes;
+}
+
+NumaExecutor::NumaExecutor(size_t threadsPerNode) : NumaExecutor(numaNodes(), threadsPerNode) {
+}
+
+NumaExecutor::NumaExecutor(const std::vector<std::vector<int>> &nodes, size_t threadsPerNode) : next_(0) {
+    for (const std::vector<int> &cpus : nodes) {
+        nodes_.push_back(std::make_shared<WorkStealingExecutor>(threadsPerNode, cpus));
+    }
+    if (nodes_.empty()) {
+        nodes_.push_back(std::make_shared<WorkStealingExecutor>(threadsPerNode));
+    }
+}
+
+void NumaExecutor::submit(std::function<void()> task) {
+    nodes_[next_++ % nodes_.size()]->submit(std::move(task));
+}
+
+size_t NumaExecutor::concurrency() const {
+    size_t n = 0;
+    for (const ExecutorPtr &e : nodes_) {
+        n += e->concurrency();
+    }
+    return n;
+}
+
+ExecutorPtr defaultExecutor() {
+    std::lock_guard<std::mutex> lock(defaultMutex);
+    if (!defaultInstance) {
+        defaultInstance = std::make_shared<WorkStealingExecutor>();
+    }
+    return defaultInstance;
+}
+
+void setDefaultExecutor(ExecutorPtr executor) {
+    std::lock_guard<std::mutex> lock(defaultMutex);
+    defaultInstance = std::move(executor);
+}
+
+struct TaskGroup::State {
+    std::mutex mutex;
+    std::condition_variable cond;
+    // Tasks not yet started, oldest first.
+    std::deque<std::function<void()>> tasks;
+    // Tasks being run, and tasks submitted to the executor that have
+    // not yet found the queue empty.
+    size_t running;
+    size_t runners;
+    std::exception_ptr error;
+    std::atomic<bool> failed;
+
+    State() : running(0), runners(0), failed(false) {}
+};
+
+TaskGroup::TaskGroup(ExecutorPtr executor, size_t maxConcurrency)
+    : executor_(executor ? std::move(executor) : defaultExecutor()),
+      maxConcurrency_(maxConcurrency != 0 ? maxConcurrency : std::max(executor_->concurrency(), static_cast<size_t>(1))),
+      state_(std::make_shared<State>()) {}
+
+TaskGroup::~TaskGroup() {
+    try {
+        wait();
+    } catch (...) {
+    }
+}
+
+bool TaskGroup::runOne(State &s) {
+    std::function<void()> task;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (s.tasks.empty()) {
+            return false;
+        }
+        task = std::move(s.tasks.front());
+        s.tasks.pop_front();
+        ++s.running;
+    }
+    std::exception_ptr error;
+    try {
+        task();
+    } catch (...) {
+        error = std::current_exception();
+    }
+    // Whatever the task holds goes before anyone is told it is done.
+    task = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (error && !s.error) {
+            s.error = error;
+        }
+        if (error) {
+            s.failed = true;
+        }
+        --s.running;
+    }
+    s.cond.notify_all();
+    return true;
+}
+
+void TaskGroup::run(std::function<void()> task) {
+    bool submit;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->tasks.push_back(std::move(task));
+        submit = state_->runners < maxConcurrency_;
+        if (submit) {
+            ++state_->runners;
+        }
+    }
+    if (!submit) {
+        return;
+    }
+    // The runner keeps the state alive, for it may start after the group
+    // is gone; it then finds no tasks.
+    std::shared_ptr<State> s = state_;
+    auto runner = [s]() {
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> lock(s->mutex);
+                if (s->tasks.empty()) {
+                    --s->runners;
+                    return;
+                }
+            }
+            runOne(*s);
+        }
+    };
+    try {
+        executor_->submit(runner);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        --state_->runners;
+        // The task is run by wait().
+    }
+}
+
+bool TaskGroup::runPending() {
+    return runOne(*state_);
+}
+
+void TaskGroup::clear() {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->tasks.clear();
+}
+
+bool TaskGroup::failed() const {
+    return state_->failed;
+}
+
+void TaskGroup::wait() {
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    for (;;) {
+        if (!state_->tasks.empty()) {
+            lock.unlock();
+            runOne(*state_);
+            lock.lock();
+        } else if (state_->running != 0) {
+            state_->cond.wait(lock);
+        } else {
+            break;
+        }
+    }
+    if (state_->error) {
+        std::exception_ptr e = state_->error;
+        state_->error = nullptr;
+        state_->failed = false;
+        std::rethrow_exception(e);
+    }
+}
+
+} // namespace avro
@@ -0,0 +1,202 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FieldPathExtractor.hh"
+#include "BinarySkip.hh"
+#include "Decoder.hh"
+#include "Encoder.hh"
+#include "Generic.hh"
+#include "Stream.hh"
+
+#include <cstring>
+
+namespace avro {
+
+using std::string;
+using std::vector;
+
+struct FieldPathExtractor::Program {
+    // One record on the path.
+    struct Hop {
+        // The branch the record is of the union it comes in, if it does,
+        // and the number of branches.
+        size_t branch;
+        size_t branches;
+        // Skip the fields before the one on the path.
+        vector<size_t> skips;
+    };
+
+    vector<Hop> hops;
+    // Skips the field itself.
+    size_t field;
+    NodePtr fieldSchema;
+    SkipProgram skips;
+};
+
+namespace {
+
+NodePtr resolved(const NodePtr &n) {
+    return n->type() == AVRO_SYMBOLIC ? resolveSymbol(n) : n;
+}
+
+const size_t noUnion = static_cast<size_t>(-1);
+
+} // namespace
+
+FieldPathExtractor::FieldPathExtractor(const ValidSchema &schema, const string &path) {
+    std::shared_ptr<Program> p = std::make_shared<Program>();
+    NodePtr n = resolved(schema.root());
+    size_t begin = 0;
+    for (;;) {
+        size_t end = path.find('.', begin);
+        string name = path.substr(begin, end == string::npos ? string::npos : end - begin);
+        Program::Hop hop = {noUnion, 0, vector<size_t>()};
+        if (n->type() == AVRO_UNION) {
+            // The first record branch with the field.
+            size_t pos;
+            for (size_t j = 0; j < n->leaves(); ++j) {
+                NodePtr b = resolved(n->leafAt(j));
+                if (b->type() == AVRO_RECORD && b->nameIndex(name, pos)) {
+                    hop.branch = j;
+                    break;
+                }
+            }
+            if (hop.branch == noUnion) {
+                throw Exception(boost::format("No branch of the union on path %1% has a field named %2%") % path % name);
+            }
+            hop.branches = n->leaves();
+            n = resolved(n->leafAt(hop.branch));
+        }
+        size_t pos;
+        if (n->type() != AVRO_RECORD || !n->nameIndex(name, pos)) {
+            throw Exception(boost::format("No field named %1% on path %2%") % name % path);
+        }
+        // Runs of fields of a fixed width are skipped in one go.
+        for (size_t i = 0; i < pos;) {
+            size_t size = 0;
+            size_t j = i;
+            while (j < pos && SkipProgram::fixedWidth(n->leafAt(j), size)) {
+                ++j;
+            }
+            if (j > i) {
+                hop.skips.push_back(p->skips.bytes(size));
+                i = j;
+            } else {
+                hop.skips.push_back(p->skips.compile(n->leafAt(i)));
+                ++i;
+            }
+        }
+        p->hops.push_back(hop);
+        n = resolved(n->leafAt(pos));
+        if (end == string::npos) {
+            break;
+        }
+        begin = end + 1;
+    }
+    p->field = p->skips.compile(n);
+    p->fieldSchema = n;
+    program_ = p;
+}
+
+const NodePtr &FieldPathExtractor::fieldSchema() const {
+    return program_->fieldSchema;
+}
+
+FieldSpan FieldPathExtractor::find(const uint8_t *data, size_t len) const {
+    const Program &p = *program_;
+    BinaryCursor c = {data, data + len};
+    for (const Program::Hop &hop : p.hops) {
+        if (hop.branch != noUnion && c.branch(hop.branches) != hop.branch) {
+            FieldSpan absent = {nullptr, 0};
+            return absent;
+        }
+        for (size_t s : hop.skips) {
+            p.skips.skip(s, c);
+        }
+    }
+    const uint8_t *begin = c.p;
+    p.skips.skip(p.field, c);
+    FieldSpan result = {begin, static_cast<size_t>(c.p - begin)};
+    return result;
+}
+
+void FieldPathExtractor::find(const uint8_t *const *data, const size_t *lengths,
+                              size_t count, FieldSpan *spans) const {
+    for (size_t i = 0; i < count; ++i) {
+        spans[i] = find(data[i], lengths[i]);
+    }
+}
+
+bool FieldPathExtractor::extract(const uint8_t *data, size_t len, GenericDatum &value) const {
+    FieldSpan span = find(data, len);
+    if (span.data == nullptr) {
+        return false;
+    }
+    std::unique_ptr<InputStream> in = memoryInputStream(span.data, span.size);
+    DecoderPtr d = binaryDecoder();
+    d->init(*in);
+    GenericDatum result(program_->fieldSchema);
+    GenericReader::readInPlace(*d, result);
+    value = std::move(result);
+    return true;
+}
+
+bool FieldPathExtractor::patch(const uint8_t *data, size_t len,
+                               const uint8_t *value, size_t valueLen,
+                               vector<uint8_t> &out) const {
+    FieldSpan span = find(data, len);
+    if (span.data == nullptr) {
+        return false;
+    }
+    out.reserve(out.size() + len - span.size + valueLen);
+    out.insert(out.end(), data, span.data);
+    out.insert(out.end(), value, value + valueLen);
+    out.insert(out.end(), span.data + span.size, data + len);
+    return true;
+}
+
+bool FieldPathExtractor::patch(const uint8_t *data, size_t len, const GenericDatum &value,
+                               vector<uint8_t> &out) const {
+    std::unique_ptr<OutputStream> os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    GenericWriter::write(*e, value);
+    e->flush();
+    std::shared_ptr<vector<uint8_t>> encoded = snapshot(*os);
+    return patch(data, len, encoded->data(), encoded->size(), out);
+}
+
+bool FieldPathExtractor::patchInPlace(vector<uint8_t> &datum,
+                                      const uint8_t *value, size_t valueLen) const {
+    FieldSpan span = find(datum.data(), datum.size());
+    if (span.data == nullptr) {
+        return false;
+    }
+    size_t begin = static_cast<size_t>(span.data - datum.data());
+    if (valueLen > span.size) {
+        datum.insert(datum.begin() + begin + span.size, valueLen - span.size, 0);
+    } else if (valueLen < span.size) {
+        datum.erase(datum.begin() + begin + valueLen, datum.begin() + begin + span.size);
+    }
+    if (valueLen != 0) {
+        std::memcpy(&datum[begin], value, valueLen);
+    }
+    return true;
+}
+
+} // namespace avro
@@ -17,21 +17,39 @@
  */
 
 #include "Stream.hh"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
 #include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
 #ifndef _WIN32
 #include "fcntl.h"
+#include "sys/mman.h"
+#include "sys/stat.h"
+#include "sys/uio.h"
 #include "unistd.h"
 #include <cerrno>
 
 #ifndef O_BINARY
 #define O_BINARY 0
 #endif
+
+#ifdef AVRO_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
 #else
 #include "Windows.h"
 
 #ifdef min
 #undef min
 #endif
+#ifdef max
+#undef max
+#endif
 #endif
 
 using std::istream;
@@ -40,6 +58,18 @@ using std::unique_ptr;
 
 namespace avro {
 namespace {
+// Buffers are aligned for O_DIRECT, which wants both the memory and the
+// file offsets and sizes aligned to the logical block size.
+const size_t asyncAlignment = 4096;
+
+uint8_t *allocateBuffer(MemoryResource &resource, size_t size, bool aligned) {
+    return static_cast<uint8_t *>(resource.allocate(size, aligned ? asyncAlignment : defaultAlignment));
+}
+
+void freeBuffer(MemoryResource &resource, uint8_t *p, size_t size, bool aligned) {
+    resource.deallocate(p, size, aligned ? asyncAlignment : defaultAlignment);
+}
+
 struct BufferCopyIn {
     virtual ~BufferCopyIn() = default;
     virtual void seek(size_t len) = 0;
@@ -49,7 +79,9 @@ struct BufferCopyIn {
 struct FileBufferCopyIn : public BufferCopyIn {
 #ifdef _WIN32
     HANDLE h_;
-    FileBufferCopyIn(const char *filename) : h_(::CreateFileA(filename, GENERIC_READ, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL)) {
+    FileBufferCopyIn(const char *filename,
+                     StreamOptions::CacheMode cache = StreamOptions::CACHE_NORMAL) : h_(::CreateFileA(filename, GENERIC_READ, 0, NULL, OPEN_ALWAYS,
+                                                                                                       cache == StreamOptions::CACHE_NORMAL ? FILE_ATTRIBUTE_NORMAL : FILE_FLAG_SEQUENTIAL_SCAN, NULL)) {
         if (h_ == INVALID_HANDLE_VALUE) {
             throw Exception(boost::format("Cannot open file: %1%") % ::GetLastError());
         }
@@ -74,12 +106,48 @@ struct FileBufferCopyIn : public BufferCopyIn {
         return actual != 0;
     }
 #else
+    // How many bytes are read between dropping them from the cache.
+    static const size_t dropInterval = 1024 * 1024;
+
     const int fd_;
+    bool direct_;
+    bool dropBehind_;
+    // The position in the file, and the end of the part already dropped
+    // from the cache. With O_DIRECT the file is read with pread() from
+    // pos_, rounded down to the alignment.
+    size_t pos_;
+    size_t dropped_;
+
+    static int open(const char *filename, bool direct) {
+        int flags = O_RDONLY | O_BINARY;
+#ifdef O_DIRECT
+        if (direct) {
+            int fd = ::open(filename, flags | O_DIRECT);
+            if (fd >= 0 || errno != EINVAL) {
+                return fd;
+            }
+        }
+#endif
+        return ::open(filename, flags);
+    }
 
-    explicit FileBufferCopyIn(const char *filename) : fd_(open(filename, O_RDONLY | O_BINARY)) {
+    explicit FileBufferCopyIn(const char *filename,
+                              StreamOptions::CacheMode cache = StreamOptions::CACHE_NORMAL)
+        : fd_(open(filename, cache == StreamOptions::CACHE_DIRECT)), direct_(false),
+          dropBehind_(false), pos_(0), dropped_(0) {
         if (fd_ < 0) {
             throw Exception(boost::format("Cannot open file: %1%") % ::strerror(errno));
         }
+#ifdef O_DIRECT
+        direct_ = cache == StreamOptions::CACHE_DIRECT && (::fcntl(fd_, F_GETFL) & O_DIRECT) != 0;
+#endif
+#ifdef POSIX_FADV_SEQUENTIAL
+        if (cache != StreamOptions::CACHE_NORMAL && !direct_) {
+            ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+            ::posix_fadvise(fd_, 0, 0, POSIX_FADV_NOREUSE);
+            dropBehind_ = true;
+        }
+#endif
     }
 
     ~FileBufferCopyIn() override {
@@ -87,23 +155,77 @@ struct FileBufferCopyIn : public BufferCopyIn {
     }
 
     void seek(size_t len) override {
+        if (direct_) {
+            pos_ += len;
+            return;
+        }
         off_t r = ::lseek(fd_, len, SEEK_CUR);
         if (r == static_cast<off_t>(-1)) {
             throw Exception(boost::format("Cannot skip file: %1%") % strerror(errno));
         }
+        pos_ = static_cast<size_t>(r);
     }
 
+    // With O_DIRECT, b and toRead must be aligned; a read from an
+    // unaligned position reads from the aligned one before it and moves
+    // the rest down.
     bool read(uint8_t *b, size_t toRead, size_t &actual) override {
-        int n = ::read(fd_, b, toRead);
+        if (direct_) {
+            size_t skew = pos_ % asyncAlignment;
+            ssize_t n = ::pread(fd_, b, toRead, static_cast<off_t>(pos_ - skew));
+            if (n <= static_cast<ssize_t>(skew)) {
+                return false;
+            }
+            actual = static_cast<size_t>(n) - skew;
+            if (skew != 0) {
+                memmove(b, b + skew, actual);
+            }
+            pos_ += actual;
+            return true;
+        }
+        ssize_t n = ::read(fd_, b, toRead);
         if (n > 0) {
-            actual = n;
+            actual = static_cast<size_t>(n);
+            pos_ += actual;
+            dropBehind();
             return true;
         }
         return false;
     }
+
+    void dropBehind() {
+#ifdef POSIX_FADV_DONTNEED
+        if (dropBehind_ && pos_ >= dropped_ + dropInterval) {
+            ::posix_fadvise(fd_, static_cast<off_t>(dropped_), static_cast<off_t>(pos_ - dropped_), POSIX_FADV_DONTNEED);
+            dropped_ = pos_;
+        } else if (pos_ < dropped_) {
+            // Seeking backwards; drop from here on.
+            dropped_ = pos_ / dropInterval * dropInterval;
+        }
+#endif
+    }
 #endif
 };
 
+#ifndef _WIN32
+struct SharedFileBufferCopyIn : public BufferCopyIn {
+    const SharedFilePtr file_;
+    size_t pos_;
+
+    explicit SharedFileBufferCopyIn(SharedFilePtr file) : file_(std::move(file)), pos_(0) {}
+
+    void seek(size_t len) override {
+        pos_ += len;
+    }
+
+    bool read(uint8_t *b, size_t toRead, size_t &actual) override {
+        actual = file_->read(static_cast<int64_t>(pos_), b, toRead);
+        pos_ += actual;
+        return actual != 0;
+    }
+};
+#endif
+
 struct IStreamBufferCopyIn : public BufferCopyIn {
     istream &is_;
 
@@ -151,6 +273,9 @@ struct NonSeekableIStreamBufferCopyIn : public IStreamBufferCopyIn {
 
 class BufferCopyInInputStream : public SeekableInputStream {
     const size_t bufferSize_;
+    // With CACHE_DIRECT the buffer is aligned, and so is its size.
+    const StreamOptions::CacheMode cache_;
+    MemoryResource &resource_;
     uint8_t *const buffer_;
     unique_ptr<BufferCopyIn> in_;
     size_t byteCount_;
@@ -194,6 +319,7 @@ class BufferCopyInInputStream : public SeekableInputStream {
 
     bool fill() {
         size_t n = 0;
+        AVRO_STREAM_COUNT(counters_, refills, 1);
         if (in_->read(buffer_, bufferSize_, n)) {
             next_ = buffer_;
             available_ = n;
@@ -211,28 +337,295 @@ class BufferCopyInInputStream : public SeekableInputStream {
     }
 
 public:
-    BufferCopyInInputStream(unique_ptr<BufferCopyIn> in, size_t bufferSize) : bufferSize_(bufferSize),
-                                                                              buffer_(new uint8_t[bufferSize]),
-                                                                              in_(std::move(in)),
-                                                                              byteCount_(0),
-                                                                              next_(buffer_),
-                                                                              available_(0) {}
+    BufferCopyInInputStream(unique_ptr<BufferCopyIn> in, size_t bufferSize,
+                            StreamOptions::CacheMode cache = StreamOptions::CACHE_NORMAL,
+                            MemoryResource *resource = nullptr) : bufferSize_(bufferSize),
+                                                                  cache_(cache),
+                                                                  resource_(resource != nullptr ? *resource : *defaultMemoryResource()),
+                                                                  buffer_(allocateBuffer(resource_, bufferSize, cache == StreamOptions::CACHE_DIRECT)),
+                                                                  in_(std::move(in)),
+                                                                  byteCount_(0),
+                                                                  next_(buffer_),
+                                                                  available_(0) {
+        AVRO_STREAM_COUNT(counters_, chunksAllocated, 1);
+    }
 
     ~BufferCopyInInputStream() override {
-        delete[] buffer_;
+        freeBuffer(resource_, buffer_, bufferSize_, cache_ == StreamOptions::CACHE_DIRECT);
+    }
+
+    StreamOptions::CacheMode cacheMode() const { return cache_; }
+
+    /**
+     * Reads from \p in from now on, starting with an empty buffer.
+     */
+    void reopen(unique_ptr<BufferCopyIn> in) {
+        in_ = std::move(in);
+        byteCount_ = 0;
+        next_ = buffer_;
+        available_ = 0;
+    }
+};
+
+class MappedFileInputStream : public SeekableInputStream {
+    // How far ahead of the read position pages are requested.
+    static const size_t readAhead = 4 * 1024 * 1024;
+
+    const uint8_t *data_;
+    size_t size_;
+    size_t pos_;
+    // The end of the range requested so far.
+    size_t advised_;
+#ifdef _WIN32
+    HANDLE file_;
+    HANDLE mapping_;
+#else
+    size_t pageSize_;
+#endif
+
+    void advise() {
+#ifndef _WIN32
+        if (advised_ < size_ && pos_ + readAhead / 2 > advised_) {
+            size_t from = std::max(pos_, advised_) / pageSize_ * pageSize_;
+            size_t to = std::min(pos_ + readAhead, size_);
+            ::madvise(const_cast<uint8_t *>(data_) + from, to - from, MADV_WILLNEED);
+            advised_ = to;
+        }
+#endif
+    }
+
+    bool next(const uint8_t **data, size_t *len) override {
+        if (pos_ >= size_) {
+            return false;
+        }
+        advise();
+        *data = data_ + pos_;
+        *len = size_ - pos_;
+        pos_ = size_;
+        return true;
+    }
+
+    void backup(size_t len) override {
+        pos_ -= len;
+    }
+
+    void skip(size_t len) override {
+        pos_ = std::min(pos_ + len, size_);
+    }
+
+    size_t byteCount() const override { return pos_; }
+
+    void seek(int64_t position) override {
+        if (position < 0) {
+            throw Exception(boost::format("Cannot seek to negative position: %1%") % position);
+        }
+        pos_ = static_cast<size_t>(position);
+        if (pos_ < advised_) {
+            // Seeking backwards; start asking for pages again from here.
+            advised_ = pos_;
+        }
+    }
+
+public:
+    explicit MappedFileInputStream(const char *filename) : data_(nullptr), size_(0), pos_(0), advised_(0) {
+#ifdef _WIN32
+        file_ = ::CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file_ == INVALID_HANDLE_VALUE) {
+            throw Exception(boost::format("Cannot open file: %1%") % ::GetLastError());
+        }
+        LARGE_INTEGER size;
+        if (!::GetFileSizeEx(file_, &size)) {
+            DWORD e = ::GetLastError();
+            ::CloseHandle(file_);
+            throw Exception(boost::format("Cannot get file size: %1%") % e);
+        }
+        size_ = static_cast<size_t>(size.QuadPart);
+        mapping_ = NULL;
+        if (size_ != 0) {
+            mapping_ = ::CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+            const void *view = (mapping_ == NULL) ? NULL : ::MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+            if (view == NULL) {
+                DWORD e = ::GetLastError();
+                if (mapping_ != NULL) {
+                    ::CloseHandle(mapping_);
+                }
+                ::CloseHandle(file_);
+                throw Exception(boost::format("Cannot map file: %1%") % e);
+            }
+            data_ = static_cast<const uint8_t *>(view);
+        }
+#else
+        pageSize_ = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        int fd = ::open(filename, O_RDONLY | O_BINARY);
+        if (fd < 0) {
+            throw Exception(boost::format("Cannot open file: %1%") % ::strerror(errno));
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            int e = errno;
+            ::close(fd);
+            throw Exception(boost::format("Cannot stat file: %1%") % ::strerror(e));
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ != 0) {
+            void *p = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED) {
+                int e = errno;
+                ::close(fd);
+                throw Exception(boost::format("Cannot map file: %1%") % ::strerror(e));
+            }
+            ::madvise(p, size_, MADV_SEQUENTIAL);
+            data_ = static_cast<const uint8_t *>(p);
+        }
+        // The mapping stays valid after the descriptor is closed.
+        ::close(fd);
+#endif
+    }
+
+    ~MappedFileInputStream() override {
+#ifdef _WIN32
+        if (data_ != NULL) {
+            ::UnmapViewOfFile(data_);
+            ::CloseHandle(mapping_);
+        }
+        ::CloseHandle(file_);
+#else
+        if (data_ != nullptr) {
+            ::munmap(const_cast<uint8_t *>(data_), size_);
+        }
+#endif
     }
 };
 
+#ifndef _WIN32
+class MappedFileOutputStream : public OutputStream {
+    uint8_t *data_;
+    const size_t size_;
+    size_t pos_;
+    // Where the data not yet handed to the system for writing starts.
+    size_t flushed_;
+    int fd_;
+    size_t pageSize_;
+
+    bool next(uint8_t **data, size_t *len) override {
+        if (pos_ >= size_) {
+            throw Exception(boost::format("Mapped file of %1% bytes is full") % size_);
+        }
+        *data = data_ + pos_;
+        *len = size_ - pos_;
+        pos_ = size_;
+        return true;
+    }
+
+    void backup(size_t len) override {
+        pos_ -= len;
+    }
+
+    uint64_t byteCount() const override {
+        return pos_;
+    }
+
+    // Starts writing the pages filled since the last flush back to the
+    // file, without waiting for them.
+    void flush() override {
+        if (pos_ <= flushed_) {
+            return;
+        }
+        size_t from = flushed_ / pageSize_ * pageSize_;
+#ifdef __linux__
+        // MS_ASYNC does nothing on Linux; this starts the writeback.
+        ::sync_file_range(fd_, static_cast<off_t>(from), static_cast<off_t>(pos_ - from), SYNC_FILE_RANGE_WRITE);
+#else
+        ::msync(data_ + from, pos_ - from, MS_ASYNC);
+#endif
+        flushed_ = pos_;
+    }
+
+    bool rewrite(uint64_t position, const uint8_t *data, size_t len) override {
+        ::memcpy(data_ + position, data, len);
+        return true;
+    }
+
+    bool sync() override {
+        if (pos_ != 0 && ::msync(data_, pos_, MS_SYNC) != 0) {
+            throw Exception(boost::format("Cannot sync file: %1%") % ::strerror(errno));
+        }
+        return true;
+    }
+
+public:
+    MappedFileOutputStream(const char *filename, size_t size) : data_(nullptr), size_(size), pos_(0), flushed_(0),
+                                                                fd_(-1), pageSize_(static_cast<size_t>(::sysconf(_SC_PAGESIZE))) {
+        if (size_ == 0) {
+            throw Exception("Cannot map a file of 0 bytes for writing");
+        }
+        fd_ = ::open(filename, O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0644);
+        if (fd_ < 0) {
+            throw Exception(boost::format("Cannot open file: %1%") % ::strerror(errno));
+        }
+        // The blocks are allocated up front, so that running out of
+        // space fails here rather than with SIGBUS while writing.
+#ifdef __linux__
+        int e = ::posix_fallocate(fd_, 0, static_cast<off_t>(size_));
+        if (e == EOPNOTSUPP || e == EINVAL) {
+            e = ::ftruncate(fd_, static_cast<off_t>(size_)) == 0 ? 0 : errno;
+        }
+#else
+        int e = ::ftruncate(fd_, static_cast<off_t>(size_)) == 0 ? 0 : errno;
+#endif
+        void *p = e != 0 ? MAP_FAILED : ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED) {
+            if (e == 0) {
+                e = errno;
+            }
+            ::close(fd_);
+            ::unlink(filename);
+            throw Exception(boost::format("Cannot map file: %1%") % ::strerror(e));
+        }
+        ::madvise(p, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<uint8_t *>(p);
+    }
+
+    ~MappedFileOutputStream() override {
+        ::munmap(data_, size_);
+        // The file ends where the data does; the reserved blocks past it
+        // are given back. Errors cannot be reported from here.
+        int r = ::ftruncate(fd_, static_cast<off_t>(pos_));
+        (void) r;
+        ::close(fd_);
+    }
+};
+#endif
+
 namespace {
 struct BufferCopyOut {
     virtual ~BufferCopyOut() = default;
     virtual void write(const uint8_t *b, size_t len) = 0;
+
+    // Syncs what was written to the device; false if there is none.
+    virtual bool sync() { return false; }
+
+    // Writes over the len bytes written at offset from the start;
+    // false if it cannot, whatever len is.
+    virtual bool rewrite(uint64_t, const uint8_t *, size_t) { return false; }
+
+    // Writes the chunks one after the other; file descriptors do it
+    // with writev().
+    virtual void write(const OutputChunk *chunks, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            write(chunks[i].data, chunks[i].len);
+        }
+    }
 };
 
 struct FileBufferCopyOut : public BufferCopyOut {
 #ifdef _WIN32
     HANDLE h_;
-    FileBufferCopyOut(const char *filename) : h_(::CreateFileA(filename, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL)) {
+    // direct is not supported here, since FILE_FLAG_NO_BUFFERING also
+    // needs sector aligned file sizes.
+    FileBufferCopyOut(const char *filename, bool append, bool direct = false) : h_(::CreateFileA(filename, append ? FILE_APPEND_DATA : GENERIC_WRITE, 0, NULL,
+                                                                                                append ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL)) {
         if (h_ == INVALID_HANDLE_VALUE) {
             throw Exception(boost::format("Cannot open file: %1%") % ::GetLastError());
         }
@@ -252,18 +645,59 @@ struct FileBufferCopyOut : public BufferCopyOut {
             len -= dw;
         }
     }
+
+    bool sync() {
+        if (!::FlushFileBuffers(h_)) {
+            throw Exception(boost::format("Cannot sync file: %1%") % ::GetLastError());
+        }
+        return true;
+    }
+
+    void clearDirect() {}
+
+    void preallocate(size_t) {}
 #else
-    const int fd_;
+    int fd_;
+    bool owned_;
+    // Where in the file the writes started, or -1 for descriptors that
+    // cannot be written at an offset: pipes, sockets and appended files,
+    // which pwrite() appends to on Linux.
+    off_t start_;
+
+    static int open(const char *filename, bool append, bool direct) {
+        int flags = O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC) | O_BINARY;
+#ifdef O_DIRECT
+        if (direct) {
+            int fd = ::open(filename, flags | O_DIRECT, 0644);
+            // File systems without O_DIRECT, such as tmpfs, refuse it
+            // with EINVAL; the file is then written through the cache.
+            if (fd >= 0 || errno != EINVAL) {
+                return fd;
+            }
+        }
+#endif
+        return ::open(filename, flags, 0644);
+    }
 
-    explicit FileBufferCopyOut(const char *filename) : fd_(::open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644)) {
+    FileBufferCopyOut(const char *filename, bool append, bool direct = false) : fd_(open(filename, append, direct)), owned_(true),
+                                                                               start_(append ? -1 : 0) {
 
         if (fd_ < 0) {
             throw Exception(boost::format("Cannot open file: %1%") % ::strerror(errno));
         }
     }
 
+    explicit FileBufferCopyOut(int fd) : fd_(fd), owned_(false), start_(::lseek(fd, 0, SEEK_CUR)) {
+        int flags = ::fcntl(fd, F_GETFL);
+        if (flags < 0 || (flags & O_APPEND) != 0) {
+            start_ = -1;
+        }
+    }
+
     ~FileBufferCopyOut() override {
-        ::close(fd_);
+        if (owned_) {
+            ::close(fd_);
+        }
     }
 
     void write(const uint8_t *b, size_t len) override {
@@ -271,6 +705,98 @@ struct FileBufferCopyOut : public BufferCopyOut {
             throw Exception(boost::format("Cannot write file: %1%") % ::strerror(errno));
         }
     }
+
+    void write(const OutputChunk *chunks, size_t count) override {
+        // Pipes and sockets may take less than asked for, so the
+        // vector is advanced past whatever each call wrote.
+        const size_t maxIov = 64;
+        struct iovec iov[maxIov];
+        size_t n = 0;
+        for (size_t i = 0; i < count || n > 0;) {
+            for (; i < count && n < maxIov; ++i) {
+                if (chunks[i].len > 0) {
+                    iov[n].iov_base = const_cast<uint8_t *>(chunks[i].data);
+                    iov[n].iov_len = chunks[i].len;
+                    ++n;
+                }
+            }
+            if (n == 0) {
+                break;
+            }
+            ssize_t w = ::writev(fd_, iov, static_cast<int>(n));
+            if (w < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw Exception(boost::format("Cannot write file: %1%") % ::strerror(errno));
+            }
+            size_t done = static_cast<size_t>(w);
+            size_t k = 0;
+            for (; k < n && done >= iov[k].iov_len; ++k) {
+                done -= iov[k].iov_len;
+            }
+            if (k < n) {
+                iov[k].iov_base = static_cast<uint8_t *>(iov[k].iov_base) + done;
+                iov[k].iov_len -= done;
+            }
+            std::copy(iov + k, iov + n, iov);
+            n -= k;
+        }
+    }
+
+    bool rewrite(uint64_t offset, const uint8_t *data, size_t len) override {
+        if (start_ < 0) {
+            return false;
+        }
+        while (len > 0) {
+            ssize_t w = ::pwrite(fd_, data, len, start_ + static_cast<off_t>(offset));
+            if (w < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw Exception(boost::format("Cannot write file: %1%") % ::strerror(errno));
+            }
+            data += w;
+            len -= static_cast<size_t>(w);
+            offset += static_cast<uint64_t>(w);
+        }
+        return true;
+    }
+
+    bool sync() override {
+#ifdef __APPLE__
+        if (::fsync(fd_) < 0) {
+#else
+        if (::fdatasync(fd_) < 0) {
+#endif
+            if (errno == EINVAL) {
+                // A pipe, a socket or another file that cannot be synced.
+                return false;
+            }
+            throw Exception(boost::format("Cannot sync file: %1%") % ::strerror(errno));
+        }
+        return true;
+    }
+
+    // Reserves the first len bytes of the file without changing its size.
+    // File systems that cannot are left to allocate as the file grows.
+    void preallocate(size_t len) {
+#ifdef __linux__
+        ::fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(len));
+#else
+        (void) len;
+#endif
+    }
+
+    // Turns O_DIRECT off so that a last, unaligned piece can be written.
+    void clearDirect() {
+#ifdef O_DIRECT
+        int flags = ::fcntl(fd_, F_GETFL);
+        if (flags >= 0 && (flags & O_DIRECT) != 0) {
+            ::fcntl(fd_, F_SETFL, flags & ~O_DIRECT);
+        }
+#endif
+    }
 #endif
 };
 
@@ -289,6 +815,7 @@ struct OStreamBufferCopyOut : public BufferCopyOut {
 
 class BufferCopyOutputStream : public OutputStream {
     size_t bufferSize_;
+    MemoryResource &resource_;
     uint8_t *const buffer_;
     unique_ptr<BufferCopyOut> out_;
     uint8_t *next_;
@@ -319,20 +846,466 @@ class BufferCopyOutputStream : public OutputStream {
     }
 
     void flush() override {
+        if (available_ != bufferSize_) {
+            AVRO_STREAM_COUNT(counters_, refills, 1);
+        }
         out_->write(buffer_, bufferSize_ - available_);
         next_ = buffer_;
         available_ = bufferSize_;
     }
 
+    void writeChunks(const OutputChunk *chunks, size_t count) override {
+        size_t total = 0;
+        for (size_t i = 0; i < count; ++i) {
+            total += chunks[i].len;
+        }
+        // Small pieces are cheaper to copy than to write on their own.
+        if (total <= available_) {
+            OutputStream::writeChunks(chunks, count);
+            return;
+        }
+        std::vector<OutputChunk> all;
+        all.reserve(count + 1);
+        all.push_back(OutputChunk{buffer_, bufferSize_ - available_});
+        all.insert(all.end(), chunks, chunks + count);
+        out_->write(all.data(), all.size());
+        AVRO_STREAM_COUNT(counters_, refills, 1);
+        next_ = buffer_;
+        available_ = bufferSize_;
+        byteCount_ += total;
+    }
+
+    bool sync() override {
+        return out_->sync();
+    }
+
+    // What is still in the buffer is written over there, the rest in
+    // the file. Streams whose file cannot be rewritten refuse even the
+    // bytes still buffered, so that what they answer does not depend on
+    // when the buffer was last flushed.
+    bool rewrite(uint64_t position, const uint8_t *data, size_t len) override {
+        const uint64_t flushed = byteCount_ - (bufferSize_ - available_);
+        size_t n = position < flushed ? static_cast<size_t>(std::min(static_cast<uint64_t>(len), flushed - position)) : 0;
+        if (!out_->rewrite(position, data, n)) {
+            return false;
+        }
+        ::memcpy(buffer_ + (position + n - flushed), data + n, len - n);
+        return true;
+    }
+
 public:
-    BufferCopyOutputStream(unique_ptr<BufferCopyOut> out, size_t bufferSize) : bufferSize_(bufferSize),
-                                                                               buffer_(new uint8_t[bufferSize]),
-                                                                               out_(std::move(out)),
-                                                                               next_(buffer_),
-                                                                               available_(bufferSize_), byteCount_(0) {}
+    BufferCopyOutputStream(unique_ptr<BufferCopyOut> out, size_t bufferSize,
+                           MemoryResource *resource = nullptr) : bufferSize_(bufferSize),
+                                                                 resource_(resource != nullptr ? *resource : *defaultMemoryResource()),
+                                                                 buffer_(allocateBuffer(resource_, bufferSize, false)),
+                                                                 out_(std::move(out)),
+                                                                 next_(buffer_),
+                                                                 available_(bufferSize_), byteCount_(0) {
+        AVRO_STREAM_COUNT(counters_, chunksAllocated, 1);
+    }
 
     ~BufferCopyOutputStream() override {
-        delete[] buffer_;
+        freeBuffer(resource_, buffer_, bufferSize_, false);
+    }
+};
+
+namespace {
+
+// Writes one buffer at a time in the background for
+// AsyncFileOutputStream.
+class AsyncWriter {
+public:
+    virtual ~AsyncWriter() = default;
+
+    // Starts writing len bytes at b, which stay untouched until wait()
+    // returns, and then syncing the file's data if sync is set. The
+    // previous write must have been waited for.
+    virtual void submit(const uint8_t *b, size_t len, bool sync) = 0;
+
+    // Waits for the write submitted last, throwing if it failed.
+    virtual void wait() = 0;
+};
+
+class ThreadAsyncWriter : public AsyncWriter {
+    FileBufferCopyOut &out_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    const uint8_t *data_;
+    size_t len_;
+    bool sync_;
+    // True from submit() until the writer thread picks the write up.
+    bool pending_;
+    // True from submit() until the write is done.
+    bool busy_;
+    bool stopping_;
+    std::exception_ptr error_;
+    std::thread thread_;
+
+    void run() {
+        for (;;) {
+            const uint8_t *data;
+            size_t len;
+            bool sync;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [this]() { return pending_ || stopping_; });
+                if (!pending_) {
+                    return;
+                }
+                pending_ = false;
+                data = data_;
+                len = len_;
+                sync = sync_;
+            }
+            std::exception_ptr error;
+            try {
+                out_.write(data, len);
+                if (sync) {
+                    out_.sync();
+                }
+            } catch (...) {
+                error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            error_ = error;
+            busy_ = false;
+            cond_.notify_all();
+        }
+    }
+
+public:
+    explicit ThreadAsyncWriter(FileBufferCopyOut &out) : out_(out), data_(nullptr), len_(0), sync_(false),
+                                                         pending_(false), busy_(false), stopping_(false) {
+        thread_ = std::thread(&ThreadAsyncWriter::run, this);
+    }
+
+    ~ThreadAsyncWriter() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+            cond_.notify_all();
+        }
+        thread_.join();
+    }
+
+    void submit(const uint8_t *b, size_t len, bool sync) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        data_ = b;
+        len_ = len;
+        sync_ = sync;
+        pending_ = true;
+        busy_ = true;
+        cond_.notify_all();
+    }
+
+    void wait() override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this]() { return !busy_; });
+        if (error_) {
+            std::exception_ptr error = error_;
+            error_ = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+#ifdef AVRO_HAVE_IO_URING
+// Submits the writes to an io_uring of its own, driven through the raw
+// system calls so that liburing is not needed.
+class IoUringAsyncWriter : public AsyncWriter {
+    const int fd_;
+    const int ring_;
+    void *sqRing_;
+    size_t sqRingSize_;
+    void *cqRing_;
+    size_t cqRingSize_;
+    io_uring_sqe *sqes_;
+    size_t sqesSize_;
+
+    unsigned *sqTail_;
+    unsigned *sqMask_;
+    unsigned *sqArray_;
+    unsigned *cqHead_;
+    unsigned *cqTail_;
+    unsigned *cqMask_;
+    io_uring_cqe *cqes_;
+
+    struct iovec iov_;
+    uint64_t offset_;
+    bool sync_;
+    bool syncing_;
+    bool busy_;
+
+    IoUringAsyncWriter(int fd, int ring, const io_uring_params &p) : fd_(fd), ring_(ring), sqRing_(MAP_FAILED), cqRing_(MAP_FAILED),
+                                                                     sqes_(static_cast<io_uring_sqe *>(MAP_FAILED)), iov_(), sync_(false),
+                                                                     syncing_(false), busy_(false) {
+        sqRingSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cqRingSize_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        if ((p.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+            sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+        }
+        sqesSize_ = p.sq_entries * sizeof(io_uring_sqe);
+        sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_SQ_RING);
+        if (sqRing_ == MAP_FAILED) {
+            return;
+        }
+        if ((p.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+            cqRing_ = sqRing_;
+        } else {
+            cqRing_ = ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_CQ_RING);
+            if (cqRing_ == MAP_FAILED) {
+                return;
+            }
+        }
+        sqes_ = static_cast<io_uring_sqe *>(::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_SQES));
+        if (sqes_ == MAP_FAILED) {
+            return;
+        }
+        uint8_t *sq = static_cast<uint8_t *>(sqRing_);
+        sqTail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+        sqMask_ = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+        sqArray_ = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+        uint8_t *cq = static_cast<uint8_t *>(cqRing_);
+        cqHead_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+        cqTail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+        cqMask_ = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+
+        off_t offset = ::lseek(fd_, 0, SEEK_CUR);
+        offset_ = offset < 0 ? 0 : static_cast<uint64_t>(offset);
+    }
+
+    bool mapped() const {
+        return sqRing_ != MAP_FAILED && cqRing_ != MAP_FAILED && sqes_ != MAP_FAILED;
+    }
+
+    void push(uint8_t opcode) {
+        unsigned tail = *sqTail_;
+        unsigned index = tail & *sqMask_;
+        io_uring_sqe &sqe = sqes_[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = opcode;
+        sqe.fd = fd_;
+        if (opcode == IORING_OP_WRITEV) {
+            sqe.addr = reinterpret_cast<uint64_t>(&iov_);
+            sqe.len = 1;
+            sqe.off = offset_;
+        } else {
+            sqe.fsync_flags = IORING_FSYNC_DATASYNC;
+        }
+        sqArray_[index] = index;
+        __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+        if (::syscall(__NR_io_uring_enter, ring_, 1, 0, 0, nullptr, 0) < 0) {
+            throw Exception(boost::format("Cannot submit write: %1%") % ::strerror(errno));
+        }
+    }
+
+    int reap() {
+        for (;;) {
+            unsigned head = *cqHead_;
+            if (head != __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+                int res = cqes_[head & *cqMask_].res;
+                __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+                return res;
+            }
+            if (::syscall(__NR_io_uring_enter, ring_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) {
+                throw Exception(boost::format("Cannot wait for write: %1%") % ::strerror(errno));
+            }
+        }
+    }
+
+public:
+    // Returns null if the kernel does not offer io_uring.
+    static unique_ptr<AsyncWriter> create(int fd) {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        int ring = static_cast<int>(::syscall(__NR_io_uring_setup, 2, &p));
+        if (ring < 0) {
+            return unique_ptr<AsyncWriter>();
+        }
+        unique_ptr<IoUringAsyncWriter> w(new IoUringAsyncWriter(fd, ring, p));
+        if (!w->mapped()) {
+            return unique_ptr<AsyncWriter>();
+        }
+        return unique_ptr<AsyncWriter>(w.release());
+    }
+
+    ~IoUringAsyncWriter() override {
+        if (busy_) {
+            try {
+                wait();
+            } catch (...) {
+            }
+        }
+        if (sqes_ != MAP_FAILED) {
+            ::munmap(sqes_, sqesSize_);
+        }
+        if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_) {
+            ::munmap(cqRing_, cqRingSize_);
+        }
+        if (sqRing_ != MAP_FAILED) {
+            ::munmap(sqRing_, sqRingSize_);
+        }
+        ::close(ring_);
+    }
+
+    void submit(const uint8_t *b, size_t len, bool sync) override {
+        iov_.iov_base = const_cast<uint8_t *>(b);
+        iov_.iov_len = len;
+        sync_ = sync;
+        syncing_ = false;
+        busy_ = true;
+        push(IORING_OP_WRITEV);
+    }
+
+    void wait() override {
+        while (busy_) {
+            int res = reap();
+            if (res == -EINTR || res == -EAGAIN) {
+                push(syncing_ ? IORING_OP_FSYNC : IORING_OP_WRITEV);
+                continue;
+            }
+            if (res < 0) {
+                busy_ = false;
+                throw Exception(boost::format(syncing_ ? "Cannot sync file: %1%" : "Cannot write file: %1%") % ::strerror(-res));
+            }
+            if (syncing_) {
+                busy_ = false;
+                continue;
+            }
+            // Short writes carry on from where they stopped.
+            size_t n = static_cast<size_t>(res);
+            offset_ += n;
+            iov_.iov_base = static_cast<uint8_t *>(iov_.iov_base) + n;
+            iov_.iov_len -= n;
+            if (iov_.iov_len > 0 && n > 0) {
+                push(IORING_OP_WRITEV);
+            } else if (iov_.iov_len > 0) {
+                busy_ = false;
+                throw Exception("Cannot write file: no progress");
+            } else if (sync_) {
+                syncing_ = true;
+                push(IORING_OP_FSYNC);
+            } else {
+                busy_ = false;
+            }
+        }
+    }
+};
+#endif
+
+} // namespace
+
+/**
+ * An output stream with two buffers: while one is being written to the
+ * file in the background, the other is handed out by next().
+ */
+class AsyncFileOutputStream : public OutputStream {
+    const AsyncFileOptions options_;
+    const size_t bufferSize_;
+    MemoryResource &resource_;
+    unique_ptr<FileBufferCopyOut> out_;
+    unique_ptr<AsyncWriter> writer_;
+    uint8_t *buffers_[2];
+    int current_;
+    uint8_t *next_;
+    size_t available_;
+    size_t byteCount_;
+
+    // Hands the filled part of the current buffer to the writer and
+    // switches to the other buffer. With O_DIRECT only whole aligned
+    // pieces are written; the rest moves on to the other buffer.
+    void submit(bool all) {
+        size_t len = bufferSize_ - available_;
+        size_t keep = (options_.direct && !all) ? len % asyncAlignment : 0;
+        len -= keep;
+        if (len == 0) {
+            return;
+        }
+        writer_->wait();
+        if (options_.direct && len % asyncAlignment != 0) {
+            out_->clearDirect();
+        }
+        writer_->submit(buffers_[current_], len, options_.sync == AsyncFileOptions::SYNC_EACH_WRITE);
+        AVRO_STREAM_COUNT(counters_, refills, 1);
+        int other = 1 - current_;
+        memcpy(buffers_[other], buffers_[current_] + len, keep);
+        AVRO_STREAM_COUNT(counters_, copiedBytes, keep);
+        current_ = other;
+        next_ = buffers_[current_] + keep;
+        available_ = bufferSize_ - keep;
+    }
+
+    bool next(uint8_t **data, size_t *len) override {
+        if (available_ == 0) {
+            submit(false);
+        }
+        *data = next_;
+        *len = available_;
+        next_ += available_;
+        byteCount_ += available_;
+        available_ = 0;
+        return true;
+    }
+
+    void backup(size_t len) override {
+        available_ += len;
+        next_ -= len;
+        byteCount_ -= len;
+    }
+
+    uint64_t byteCount() const override {
+        return byteCount_;
+    }
+
+    void flush() override {
+        submit(false);
+    }
+
+    bool sync() override {
+        writer_->wait();
+        return out_->sync();
+    }
+
+public:
+    AsyncFileOutputStream(const char *filename, const AsyncFileOptions &options) : options_(options),
+                                                                                   bufferSize_((std::max(options.bufferSize, asyncAlignment) + asyncAlignment - 1) / asyncAlignment * asyncAlignment),
+                                                                                   resource_(options.memoryResource != nullptr ? *options.memoryResource : *defaultMemoryResource()),
+                                                                                   out_(new FileBufferCopyOut(filename, false, options.direct)),
+                                                                                   current_(0), available_(bufferSize_), byteCount_(0) {
+#ifdef AVRO_HAVE_IO_URING
+        if (options.ioUring) {
+            writer_ = IoUringAsyncWriter::create(out_->fd_);
+        }
+#endif
+        if (!writer_) {
+            writer_.reset(new ThreadAsyncWriter(*out_));
+        }
+        buffers_[0] = allocateBuffer(resource_, bufferSize_, true);
+        try {
+            buffers_[1] = allocateBuffer(resource_, bufferSize_, true);
+        } catch (...) {
+            freeBuffer(resource_, buffers_[0], bufferSize_, true);
+            throw;
+        }
+        AVRO_STREAM_COUNT(counters_, chunksAllocated, 2);
+        next_ = buffers_[0];
+    }
+
+    ~AsyncFileOutputStream() override {
+        // A failed write is reported by the flush() or next() after it,
+        // but errors of the last writes cannot be reported from here.
+        try {
+            submit(true);
+            writer_->wait();
+            if (options_.sync == AsyncFileOptions::SYNC_ON_CLOSE) {
+                out_->sync();
+            }
+        } catch (...) {
+        }
+        writer_.reset();
+        freeBuffer(resource_, buffers_[0], bufferSize_, true);
+        freeBuffer(resource_, buffers_[1], bufferSize_, true);
     }
 };
 
@@ -349,6 +1322,58 @@ unique_ptr<SeekableInputStream> fileSeekableInputStream(const char *filename,
                                                                        bufferSize));
 }
 
+bool reopenFileInputStream(InputStream &stream, const char *filename) {
+    auto *s = dynamic_cast<BufferCopyInInputStream *>(&stream);
+    if (s == nullptr) {
+        return false;
+    }
+    s->reopen(unique_ptr<BufferCopyIn>(new FileBufferCopyIn(filename, s->cacheMode())));
+    return true;
+}
+
+unique_ptr<SeekableInputStream> mappedFileInputStream(const char *filename) {
+    return unique_ptr<SeekableInputStream>(new MappedFileInputStream(filename));
+}
+
+#ifndef _WIN32
+unique_ptr<OutputStream> mappedFileOutputStream(const char *filename, size_t size) {
+    return unique_ptr<OutputStream>(new MappedFileOutputStream(filename, size));
+}
+
+SharedFile::SharedFile(const char *filename) : fd_(::open(filename, O_RDONLY | O_BINARY)) {
+    if (fd_ < 0) {
+        throw Exception(boost::format("Cannot open file: %1%") % ::strerror(errno));
+    }
+}
+
+SharedFile::~SharedFile() {
+    ::close(fd_);
+}
+
+size_t SharedFile::read(int64_t offset, uint8_t *data, size_t len) const {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = ::pread(fd_, data + done, len - done, static_cast<off_t>(offset + done));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw Exception(boost::format("Cannot read file: %1%") % ::strerror(errno));
+        }
+        if (n == 0) {
+            break;
+        }
+        done += static_cast<size_t>(n);
+    }
+    return done;
+}
+
+unique_ptr<SeekableInputStream> sharedFileInputStream(const SharedFilePtr &file, size_t bufferSize) {
+    unique_ptr<BufferCopyIn> in(new SharedFileBufferCopyIn(file));
+    return unique_ptr<SeekableInputStream>(new BufferCopyInInputStream(std::move(in), bufferSize));
+}
+#endif
+
 unique_ptr<InputStream> istreamInputStream(istream &is, size_t bufferSize) {
     unique_ptr<BufferCopyIn> in(new IStreamBufferCopyIn(is));
     return unique_ptr<InputStream>(new BufferCopyInInputStream(std::move(in), bufferSize));
@@ -362,10 +1387,58 @@ unique_ptr<InputStream> nonSeekableIstreamInputStream(
 
 unique_ptr<OutputStream> fileOutputStream(const char *filename,
                                           size_t bufferSize) {
-    unique_ptr<BufferCopyOut> out(new FileBufferCopyOut(filename));
+    unique_ptr<BufferCopyOut> out(new FileBufferCopyOut(filename, false));
     return unique_ptr<OutputStream>(new BufferCopyOutputStream(std::move(out), bufferSize));
 }
 
+#ifndef _WIN32
+unique_ptr<OutputStream> fdOutputStream(int fd, size_t bufferSize) {
+    unique_ptr<BufferCopyOut> out(new FileBufferCopyOut(fd));
+    return unique_ptr<OutputStream>(new BufferCopyOutputStream(std::move(out), bufferSize));
+}
+#endif
+
+unique_ptr<OutputStream> fileAppendOutputStream(const char *filename,
+                                                size_t bufferSize) {
+    unique_ptr<BufferCopyOut> out(new FileBufferCopyOut(filename, true));
+    return unique_ptr<OutputStream>(new BufferCopyOutputStream(std::move(out), bufferSize));
+}
+
+static size_t bufferSizeOf(const StreamOptions &options) {
+    return options.chunkSize != 0 ? options.chunkSize : 8 * 1024;
+}
+
+unique_ptr<OutputStream> fileOutputStream(const char *filename,
+                                          const StreamOptions &options) {
+    unique_ptr<FileBufferCopyOut> out(new FileBufferCopyOut(filename, false));
+    if (options.preallocate != 0) {
+        out->preallocate(options.preallocate);
+    }
+    return unique_ptr<OutputStream>(new BufferCopyOutputStream(std::move(out), bufferSizeOf(options), options.memoryResource));
+}
+
+unique_ptr<InputStream> fileInputStream(const char *filename,
+                                        const StreamOptions &options) {
+    return fileSeekableInputStream(filename, options);
+}
+
+unique_ptr<SeekableInputStream> fileSeekableInputStream(const char *filename,
+                                                        const StreamOptions &options) {
+    size_t bufferSize = bufferSizeOf(options);
+    if (options.cache == StreamOptions::CACHE_DIRECT) {
+        // Direct reads want large, aligned buffers.
+        bufferSize = options.chunkSize != 0 ? options.chunkSize : 1024 * 1024;
+        bufferSize = (bufferSize + asyncAlignment - 1) / asyncAlignment * asyncAlignment;
+    }
+    unique_ptr<BufferCopyIn> in(new FileBufferCopyIn(filename, options.cache));
+    return unique_ptr<SeekableInputStream>(new BufferCopyInInputStream(std::move(in), bufferSize, options.cache, options.memoryResource));
+}
+
+unique_ptr<OutputStream> asyncFileOutputStream(const char *filename,
+                                               const AsyncFileOptions &options) {
+    return unique_ptr<OutputStream>(new AsyncFileOutputStream(filename, options));
+}
+
 unique_ptr<OutputStream> ostreamOutputStream(ostream &os,
                                              size_t bufferSize) {
     unique_ptr<BufferCopyOut> out(new OStreamBufferCopyOut(os));
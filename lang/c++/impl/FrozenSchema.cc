@@ -0,0 +1,184 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Arena.hh"
+#include "GenericDatum.hh"
+#include "NodeImpl.hh"
+#include "ValidSchema.hh"
+
+#include <map>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace avro {
+
+struct ValidSchema::Frozen {
+    Arena arena;
+    std::vector<Node *> nodes;
+
+    Frozen() : arena(16 * 1024) {}
+
+    ~Frozen() {
+        for (auto it = nodes.rbegin(); it != nodes.rend(); ++it) {
+            (*it)->~Node();
+        }
+    }
+};
+
+namespace {
+
+template<typename T>
+concepts::SingleAttribute<T> asSingleAttribute(const T &t) {
+    concepts::SingleAttribute<T> n;
+    n.add(t);
+    return n;
+}
+
+/**
+ * Copies a schema into the arena of a frozen one, depth first. The leaves
+ * of the copies are NodePtrs that own nothing; symbolic nodes point to
+ * the copies of their targets directly.
+ */
+class Freezer {
+    Arena &arena_;
+    std::vector<Node *> &nodes_;
+    // The copies of the named nodes seen so far.
+    std::map<const Node *, Node *> copies_;
+
+    template<typename T, typename... Args>
+    T *make(Args &&...args) {
+        void *p = arena_.allocate(sizeof(T), alignof(T));
+        T *result = new (p) T(std::forward<Args>(args)...);
+        nodes_.push_back(result);
+        return result;
+    }
+
+    static NodePtr unowned(Node *n) {
+        return NodePtr(NodePtr(), n);
+    }
+
+    Node *symbolic(const Node &n, Node *target) {
+        NodeSymbolic *result = make<NodeSymbolic>(asSingleAttribute(n.name()), unowned(target));
+        if (!n.getDoc().empty()) {
+            result->setDoc(n.getDoc());
+        }
+        return result;
+    }
+
+public:
+    Freezer(Arena &arena, std::vector<Node *> &nodes) : arena_(arena), nodes_(nodes) {}
+
+    Node *copy(const Node &n) {
+        if (n.type() == AVRO_SYMBOLIC) {
+            const Node &target = static_cast<const NodeSymbolic &>(n).actualNode();
+            auto it = copies_.find(&target);
+            // A reference that comes before its definition takes it.
+            return it != copies_.end() ? symbolic(n, it->second) : copy(target);
+        }
+        if (n.hasName()) {
+            auto it = copies_.find(&n);
+            if (it != copies_.end()) {
+                return symbolic(n, it->second);
+            }
+        }
+
+        Type t = n.type();
+        NodeRecord *record = nullptr;
+        if (t == AVRO_RECORD) {
+            // Made first so that the fields can refer to it.
+            record = make<NodeRecord>();
+            copies_[&n] = record;
+        }
+
+        concepts::MultiAttribute<NodePtr> leaves;
+        for (size_t i = (t == AVRO_MAP) ? 1 : 0; i < n.leaves(); ++i) {
+            leaves.add(unowned(copy(*n.leafAt(i))));
+        }
+        concepts::MultiAttribute<std::string> names;
+        for (size_t i = 0; i < n.names(); ++i) {
+            names.add(n.nameAt(i));
+        }
+
+        const std::string &doc = n.getDoc();
+        Node *result;
+        switch (t) {
+            case AVRO_RECORD: {
+                // Defaults keep the nodes of the schema they were made for,
+                // which are only looked at when building grammars.
+                Node &orig = const_cast<Node &>(n);
+                std::vector<GenericDatum> defaultValues;
+                std::vector<SortOrder> fieldOrders;
+                for (size_t i = 0; i < n.leaves(); ++i) {
+                    defaultValues.push_back(orig.defaultValueAt(i));
+                    fieldOrders.push_back(n.fieldOrderAt(i));
+                }
+                std::unique_ptr<NodeRecord> r(doc.empty()
+                                                  ? new NodeRecord(asSingleAttribute(n.name()), leaves,
+                                                                   names, defaultValues)
+                                                  : new NodeRecord(asSingleAttribute(n.name()), asSingleAttribute(doc),
+                                                                   leaves, names, defaultValues));
+                r->setFieldOrders(std::move(fieldOrders));
+                record->swap(*r);
+                result = record;
+                break;
+            }
+            case AVRO_ENUM:
+                result = make<NodeEnum>(asSingleAttribute(n.name()), names);
+                break;
+            case AVRO_FIXED:
+                result = make<NodeFixed>(asSingleAttribute(n.name()),
+                                         asSingleAttribute(static_cast<int>(n.fixedSize())));
+                break;
+            case AVRO_ARRAY:
+                result = make<NodeArray>(asSingleAttribute(leaves.get(0)));
+                break;
+            case AVRO_MAP:
+                result = make<NodeMap>(asSingleAttribute(leaves.get(0)));
+                break;
+            case AVRO_UNION:
+                result = make<NodeUnion>(leaves);
+                break;
+            default:
+                result = make<NodePrimitive>(t);
+                break;
+        }
+        if (t != AVRO_RECORD && !doc.empty()) {
+            result->setDoc(doc);
+        }
+        result->setLogicalType(n.logicalType());
+        if (n.hasName()) {
+            copies_[&n] = result;
+        }
+        return result;
+    }
+};
+
+} // namespace
+
+ValidSchema ValidSchema::frozen() const {
+    std::shared_ptr<Frozen> f = std::make_shared<Frozen>();
+    Node *root = Freezer(f->arena, f->nodes).copy(*root_);
+    ValidSchema result(NodePtr(NodePtr(), root));
+    result.fingerprints_ = fingerprints_;
+    result.frozen_ = std::move(f);
+    return result;
+}
+
+} // namespace avro
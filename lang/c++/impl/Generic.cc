@@ -17,6 +17,11 @@
  */
 
 #include "Generic.hh"
+#include "BinaryCodec.hh"
+#include "Fingerprint.hh"
+#include "NodeImpl.hh"
+
+#include <algorithm>
 #include <utility>
 
 namespace avro {
@@ -34,21 +39,36 @@ void GenericContainer::assertType(const NodePtr &schema, Type type) {
 }
 
 GenericReader::GenericReader(ValidSchema s, const DecoderPtr &decoder) : schema_(std::move(s)), isResolving_(dynamic_cast<ResolvingDecoder *>(&(*decoder)) != nullptr),
-                                                                         decoder_(decoder) {
+                                                                         decoder_(decoder),
+                                                                         compiled_(new CompiledGenericReader(schema_, decoder_)) {
 }
 
 GenericReader::GenericReader(const ValidSchema &writerSchema,
                              const ValidSchema &readerSchema, const DecoderPtr &decoder) : schema_(readerSchema),
-                                                                                           isResolving_(true),
-                                                                                           decoder_(resolvingDecoder(writerSchema, readerSchema, decoder)) {
+                                                                                           isResolving_(!readerSchema.sameEncoding(writerSchema)),
+                                                                                           decoder_(isResolving_ ? resolvingDecoder(writerSchema, readerSchema, decoder) : decoder),
+                                                                                           compiled_(new CompiledGenericReader(schema_, decoder_)) {
 }
 
+GenericReader::~GenericReader() = default;
+
 void GenericReader::read(GenericDatum &datum) const {
-    datum = GenericDatum(schema_.root());
-    read(datum, *decoder_, isResolving_);
+    compiled_->read(datum);
+}
+
+void GenericReader::read(GenericDatum &datum, Arena &arena) const {
+    compiled_->read(datum, arena);
+}
+
+void GenericReader::readInPlace(GenericDatum &datum) const {
+    compiled_->readInPlace(datum);
 }
 
-void GenericReader::read(GenericDatum &datum, Decoder &d, bool isResolving) {
+const StringDictionary &GenericReader::internStrings(const std::string &path, size_t capacity) {
+    return compiled_->internStrings(path, capacity);
+}
+
+void GenericReader::read(GenericDatum &datum, Decoder &d, bool isResolving, bool inPlace) {
     if (datum.isUnion()) {
         datum.selectBranch(d.decodeUnionIndex());
     }
@@ -88,11 +108,11 @@ void GenericReader::read(GenericDatum &datum, Decoder &d, bool isResolving) {
                 std::vector<size_t> fo =
                     static_cast<ResolvingDecoder &>(d).fieldOrder();
                 for (size_t i = 0; i < c; ++i) {
-                    read(r.fieldAt(fo[i]), d, isResolving);
+                    read(r.fieldAt(fo[i]), d, isResolving, inPlace);
                 }
             } else {
                 for (size_t i = 0; i < c; ++i) {
-                    read(r.fieldAt(i), d, isResolving);
+                    read(r.fieldAt(i), d, isResolving, inPlace);
                 }
             }
         } break;
@@ -103,30 +123,46 @@ void GenericReader::read(GenericDatum &datum, Decoder &d, bool isResolving) {
             auto &v = datum.value<GenericArray>();
             vector<GenericDatum> &r = v.value();
             const NodePtr &nn = v.schema()->leafAt(0);
-            r.resize(0);
+            // In place, the items already there are read into; otherwise
+            // each one starts afresh.
+            size_t reusable = inPlace ? r.size() : 0;
             size_t start = 0;
             for (size_t m = d.arrayStart(); m != 0; m = d.arrayNext()) {
-                r.resize(r.size() + m);
-                for (; start < r.size(); ++start) {
-                    r[start] = GenericDatum(nn);
-                    read(r[start], d, isResolving);
+                if (r.size() < start + m) {
+                    r.reserve(detail::reserveFor(r.size(), r.capacity(), start + m - r.size()));
+                }
+                for (size_t end = start + m; start < end; ++start) {
+                    if (start == r.size()) {
+                        r.emplace_back(nn, datum.arena());
+                    } else if (start >= reusable) {
+                        r[start] = GenericDatum(nn, datum.arena());
+                    }
+                    read(r[start], d, isResolving, inPlace);
                 }
             }
+            r.resize(start);
         } break;
         case AVRO_MAP: {
             auto &v = datum.value<GenericMap>();
             GenericMap::Value &r = v.value();
             const NodePtr &nn = v.schema()->leafAt(1);
-            r.resize(0);
+            size_t reusable = inPlace ? r.size() : 0;
             size_t start = 0;
             for (size_t m = d.mapStart(); m != 0; m = d.mapNext()) {
-                r.resize(r.size() + m);
-                for (; start < r.size(); ++start) {
+                if (r.size() < start + m) {
+                    r.reserve(detail::reserveFor(r.size(), r.capacity(), start + m - r.size()));
+                }
+                for (size_t end = start + m; start < end; ++start) {
+                    if (start == r.size()) {
+                        r.emplace_back(std::string(), GenericDatum(nn, datum.arena()));
+                    } else if (start >= reusable) {
+                        r[start].second = GenericDatum(nn, datum.arena());
+                    }
                     d.decodeString(r[start].first);
-                    r[start].second = GenericDatum(nn);
-                    read(r[start].second, d, isResolving);
+                    read(r[start].second, d, isResolving, inPlace);
                 }
             }
+            r.resize(start);
         } break;
         default:
             throw Exception(boost::format("Unknown schema type %1%") % toString(datum.type()));
@@ -139,14 +175,493 @@ void GenericReader::read(Decoder &d, GenericDatum &g, const ValidSchema &s) {
 }
 
 void GenericReader::read(Decoder &d, GenericDatum &g) {
-    read(g, d, dynamic_cast<ResolvingDecoder *>(&d) != nullptr);
+    read(g, d, dynamic_cast<ResolvingDecoder *>(&d) != nullptr, false);
+}
+
+void GenericReader::readInPlace(Decoder &d, GenericDatum &g) {
+    read(g, d, dynamic_cast<ResolvingDecoder *>(&d) != nullptr, true);
+}
+
+struct CompiledGenericReader::Step {
+    typedef void (*Reader)(const Step &step, GenericDatum &datum, Decoder &d, bool inPlace);
+
+    Reader read;
+    // The node of array items and map values, for the datums made for them.
+    NodePtr node;
+    size_t size;
+    bool isResolving;
+    bool copyFieldOrder;
+    // The steps of union branches, record fields, array items or map values.
+    std::vector<const Step *> children;
+    // The values of a string, if they are interned.
+    std::unique_ptr<StringDictionary> strings;
+
+    Step() : read(nullptr), size(0), isResolving(false), copyFieldOrder(false) {}
+};
+
+namespace {
+
+typedef CompiledGenericReader::Step Step;
+
+void readNull(const Step &, GenericDatum &, Decoder &d, bool) {
+    d.decodeNull();
+}
+
+void readBool(const Step &, GenericDatum &datum, Decoder &d, bool) {
+    datum.value<bool>() = d.decodeBool();
+}
+
+void readInt(const Step &, GenericDatum &datum, Decoder &d, bool) {
+    datum.value<int32_t>() = d.decodeInt();
+}
+
+void readLong(const Step &, GenericDatum &datum, Decoder &d, bool) {
+    datum.value<int64_t>() = d.decodeLong();
+}
+
+void readFloat(const Step &, GenericDatum &datum, Decoder &d, bool) {
+    datum.value<float>() = d.decodeFloat();
+}
+
+void readDouble(const Step &, GenericDatum &datum, Decoder &d, bool) {
+    datum.value<double>() = d.decodeDouble();
+}
+
+void readString(const Step &, GenericDatum &datum, Decoder &d, bool) {
+    d.decodeString(datum.value<string>());
+}
+
+void readInternedString(const Step &step, GenericDatum &datum, Decoder &d, bool) {
+    const char *data;
+    size_t length;
+    d.decodeStringView(data, length);
+    SharedString *s = step.strings->intern(data, length);
+    if (s != nullptr) {
+        datum.shareString(s);
+    } else {
+        datum.value<string>().assign(data, length);
+    }
+}
+
+void readBytes(const Step &, GenericDatum &datum, Decoder &d, bool) {
+    d.decodeBytes(datum.value<bytes>());
+}
+
+void readFixed(const Step &step, GenericDatum &datum, Decoder &d, bool) {
+    d.decodeFixed(step.size, datum.value<GenericFixed>().value());
+}
+
+void readEnum(const Step &, GenericDatum &datum, Decoder &d, bool) {
+    datum.value<GenericEnum>().set(d.decodeEnum());
+}
+
+void readUnion(const Step &step, GenericDatum &datum, Decoder &d, bool inPlace) {
+    size_t branch = d.decodeUnionIndex();
+    if (branch >= step.children.size()) {
+        throw Exception(boost::format("Union index %1% out of range") % branch);
+    }
+    datum.selectBranch(branch);
+    const Step &s = *step.children[branch];
+    s.read(s, datum, d, inPlace);
+}
+
+void readRecord(const Step &step, GenericDatum &datum, Decoder &d, bool inPlace) {
+    GenericRecord &r = datum.value<GenericRecord>();
+    if (step.isResolving) {
+        const vector<size_t> &order = static_cast<ResolvingDecoder &>(d).fieldOrder();
+        // The grammar based decoder reuses the order for nested records.
+        vector<size_t> copy;
+        const vector<size_t> &fo = step.copyFieldOrder ? (copy = order) : order;
+        for (size_t i : fo) {
+            const Step &s = *step.children[i];
+            s.read(s, r.fieldAt(i), d, inPlace);
+        }
+    } else {
+        for (size_t i = 0; i < step.children.size(); ++i) {
+            const Step &s = *step.children[i];
+            s.read(s, r.fieldAt(i), d, inPlace);
+        }
+    }
+}
+
+void readArray(const Step &step, GenericDatum &datum, Decoder &d, bool inPlace) {
+    vector<GenericDatum> &r = datum.value<GenericArray>().value();
+    const Step &item = *step.children[0];
+    size_t reusable = inPlace ? r.size() : 0;
+    size_t start = 0;
+    for (size_t m = d.arrayStart(); m != 0; m = d.arrayNext()) {
+        if (r.size() < start + m) {
+            r.reserve(detail::reserveFor(r.size(), r.capacity(), start + m - r.size()));
+        }
+        for (size_t end = start + m; start < end; ++start) {
+            if (start == r.size()) {
+                r.emplace_back(step.node, datum.arena());
+            } else if (start >= reusable) {
+                r[start] = GenericDatum(step.node, datum.arena());
+            }
+            item.read(item, r[start], d, inPlace);
+        }
+    }
+    r.resize(start);
+}
+
+void readMap(const Step &step, GenericDatum &datum, Decoder &d, bool inPlace) {
+    GenericMap::Value &r = datum.value<GenericMap>().value();
+    const Step &value = *step.children[0];
+    size_t reusable = inPlace ? r.size() : 0;
+    size_t start = 0;
+    for (size_t m = d.mapStart(); m != 0; m = d.mapNext()) {
+        if (r.size() < start + m) {
+            r.reserve(detail::reserveFor(r.size(), r.capacity(), start + m - r.size()));
+        }
+        for (size_t end = start + m; start < end; ++start) {
+            if (start == r.size()) {
+                r.emplace_back(std::string(), GenericDatum(step.node, datum.arena()));
+            } else if (start >= reusable) {
+                r[start].second = GenericDatum(step.node, datum.arena());
+            }
+            d.decodeString(r[start].first);
+            value.read(value, r[start].second, d, inPlace);
+        }
+    }
+    r.resize(start);
+}
+
+} // namespace
+
+CompiledGenericReader::CompiledGenericReader(const ValidSchema &schema, const DecoderPtr &decoder)
+    : schema_(schema), isResolving_(dynamic_cast<ResolvingDecoder *>(&(*decoder)) != nullptr),
+      compiledResolution_(false), decoder_(decoder), prototype_(schema_) {
+    std::map<const Node *, const Step *> named;
+    root_ = compile(schema_.root(), named);
+}
+
+CompiledGenericReader::CompiledGenericReader(const ValidSchema &writerSchema,
+                                             const ValidSchema &readerSchema, const DecoderPtr &decoder)
+    : schema_(readerSchema), isResolving_(!readerSchema.sameEncoding(writerSchema)),
+      compiledResolution_(isResolving_),
+      decoder_(isResolving_ ? compiledResolvingDecoder(writerSchema, readerSchema, decoder) : decoder),
+      prototype_(schema_) {
+    std::map<const Node *, const Step *> named;
+    root_ = compile(schema_.root(), named);
+}
+
+CompiledGenericReader::~CompiledGenericReader() = default;
+
+const Step *CompiledGenericReader::compile(const NodePtr &n, std::map<const Node *, const Step *> &named) {
+    NodePtr node = n->type() == AVRO_SYMBOLIC ? resolveSymbol(n) : n;
+    std::map<const Node *, const Step *>::const_iterator it = named.find(node.get());
+    if (it != named.end()) {
+        return it->second;
+    }
+    steps_.emplace_back(new Step());
+    Step &step = *steps_.back();
+    if (node->hasName()) {
+        named[node.get()] = &step;
+    }
+    switch (node->type()) {
+        case AVRO_NULL:
+            step.read = readNull;
+            break;
+        case AVRO_BOOL:
+            step.read = readBool;
+            break;
+        case AVRO_INT:
+            step.read = readInt;
+            break;
+        case AVRO_LONG:
+            step.read = readLong;
+            break;
+        case AVRO_FLOAT:
+            step.read = readFloat;
+            break;
+        case AVRO_DOUBLE:
+            step.read = readDouble;
+            break;
+        case AVRO_STRING:
+            step.read = readString;
+            break;
+        case AVRO_BYTES:
+            step.read = readBytes;
+            break;
+        case AVRO_FIXED:
+            step.read = readFixed;
+            step.size = node->fixedSize();
+            break;
+        case AVRO_ENUM:
+            step.read = readEnum;
+            break;
+        case AVRO_UNION:
+        case AVRO_RECORD:
+            step.read = node->type() == AVRO_UNION ? readUnion : readRecord;
+            step.isResolving = isResolving_;
+            step.copyFieldOrder = !compiledResolution_;
+            for (size_t i = 0; i < node->leaves(); ++i) {
+                step.children.push_back(compile(node->leafAt(i), named));
+            }
+            break;
+        case AVRO_ARRAY:
+        case AVRO_MAP: {
+            const NodePtr &item = node->leafAt(node->type() == AVRO_ARRAY ? 0 : 1);
+            step.read = node->type() == AVRO_ARRAY ? readArray : readMap;
+            step.node = item;
+            step.children.push_back(compile(item, named));
+        } break;
+        default:
+            throw Exception(boost::format("Unknown schema type %1%") % toString(node->type()));
+    }
+    return &step;
+}
+
+void CompiledGenericReader::read(GenericDatum &datum) const {
+    datum = prototype_.make();
+    root_->read(*root_, datum, *decoder_, false);
+}
+
+void CompiledGenericReader::read(GenericDatum &datum, Arena &arena) const {
+    datum = GenericDatum(schema_.root(), &arena);
+    root_->read(*root_, datum, *decoder_, false);
+}
+
+void CompiledGenericReader::readInPlace(GenericDatum &datum) const {
+    root_->read(*root_, datum, *decoder_, true);
+}
+
+const StringDictionary &CompiledGenericReader::internStrings(const std::string &path, size_t capacity) {
+    NodePtr node = schema_.root();
+    const Step *step = root_;
+    // Goes into the branch of a union that is of the given type, and
+    // for records, has the field.
+    auto branch = [&](Type t, const std::string &field) {
+        if (node->type() == AVRO_SYMBOLIC) {
+            node = resolveSymbol(node);
+        }
+        if (node->type() != AVRO_UNION) {
+            return;
+        }
+        for (size_t i = 0; i < node->leaves(); ++i) {
+            NodePtr n = node->leafAt(i);
+            if (n->type() == AVRO_SYMBOLIC) {
+                n = resolveSymbol(n);
+            }
+            size_t pos;
+            if (n->type() == t && (t != AVRO_RECORD || n->nameIndex(field, pos))) {
+                node = n;
+                step = step->children[i];
+                return;
+            }
+        }
+    };
+    size_t i = 0;
+    while (i < path.size()) {
+        if (path[i] == '.' && i != 0) {
+            ++i;
+        }
+        if (path.compare(i, 2, "[]") == 0 || path.compare(i, 2, "{}") == 0) {
+            Type t = path[i] == '[' ? AVRO_ARRAY : AVRO_MAP;
+            branch(t, std::string());
+            if (node->type() != t) {
+                throw Exception(boost::format("No %1% at %2% in %3%") % toString(t) % path.substr(0, i) % path);
+            }
+            node = node->leafAt(t == AVRO_ARRAY ? 0 : 1);
+            step = step->children[0];
+            i += 2;
+            continue;
+        }
+        size_t end = path.find_first_of(".[{", i);
+        if (end == std::string::npos) {
+            end = path.size();
+        }
+        std::string field = path.substr(i, end - i);
+        branch(AVRO_RECORD, field);
+        size_t pos;
+        if (node->type() != AVRO_RECORD || !node->nameIndex(field, pos)) {
+            throw Exception(boost::format("No field %1% in %2%") % field % path);
+        }
+        node = node->leafAt(pos);
+        step = step->children[pos];
+        i = end;
+    }
+    branch(AVRO_STRING, std::string());
+    if (node->type() != AVRO_STRING) {
+        throw Exception(boost::format("Not a string: %1%") % path);
+    }
+    Step &s = const_cast<Step &>(*step);
+    s.strings.reset(new StringDictionary(capacity));
+    s.read = readInternedString;
+    return *s.strings;
+}
+
+namespace {
+
+/**
+ * Returns the number of bytes every value of \p n is encoded in, or -1 if
+ * values of \p n vary in length.
+ */
+int64_t fixedWidth(const NodePtr &n) {
+    switch (n->type()) {
+        case AVRO_NULL:
+            return 0;
+        case AVRO_BOOL:
+            return 1;
+        case AVRO_FLOAT:
+            return 4;
+        case AVRO_DOUBLE:
+            return 8;
+        case AVRO_FIXED:
+            return static_cast<int64_t>(n->fixedSize());
+        case AVRO_RECORD: {
+            int64_t width = 0;
+            for (size_t i = 0; i < n->leaves(); ++i) {
+                int64_t w = fixedWidth(n->leafAt(i));
+                if (w < 0) {
+                    return -1;
+                }
+                width += w;
+            }
+            return width;
+        }
+        default:
+            return -1;
+    }
+}
+
+void skip(Decoder &d, const NodePtr &n) {
+    switch (n->type()) {
+        case AVRO_NULL:
+            d.decodeNull();
+            break;
+        case AVRO_BOOL:
+            d.decodeBool();
+            break;
+        case AVRO_INT:
+            d.decodeInt();
+            break;
+        case AVRO_LONG:
+            d.decodeLong();
+            break;
+        case AVRO_FLOAT:
+            d.decodeFloat();
+            break;
+        case AVRO_DOUBLE:
+            d.decodeDouble();
+            break;
+        case AVRO_STRING:
+            d.skipString();
+            break;
+        case AVRO_BYTES:
+            d.skipBytes();
+            break;
+        case AVRO_FIXED:
+            d.skipFixed(n->fixedSize());
+            break;
+        case AVRO_ENUM:
+            d.decodeEnum();
+            break;
+        case AVRO_RECORD:
+            for (size_t i = 0; i < n->leaves(); ++i) {
+                skip(d, n->leafAt(i));
+            }
+            break;
+        case AVRO_ARRAY:
+            for (size_t m = d.skipArray(); m != 0; m = d.skipArray()) {
+                for (size_t i = 0; i < m; ++i) {
+                    skip(d, n->leafAt(0));
+                }
+            }
+            break;
+        case AVRO_MAP:
+            for (size_t m = d.skipMap(); m != 0; m = d.skipMap()) {
+                for (size_t i = 0; i < m; ++i) {
+                    d.skipString();
+                    skip(d, n->leafAt(1));
+                }
+            }
+            break;
+        case AVRO_UNION:
+            skip(d, n->leafAt(d.decodeUnionIndex()));
+            break;
+        case AVRO_SYMBOLIC:
+            skip(d, resolveSymbol(n));
+            break;
+        default:
+            throw Exception(boost::format("Cannot skip a value of type %1%") % n->type());
+    }
+}
+
+} // namespace
+
+LazyGenericRecord::LazyGenericRecord(const NodePtr &schema, vector<uint8_t> data)
+    : schema_(schema), data_(std::move(data)), in_(memoryInputStream(data_.data(), data_.size())),
+      decoder_(binaryDecoder()), fields_(schema->leaves()), decoded_(schema->leaves(), false) {
+    if (schema_->type() != AVRO_RECORD) {
+        throw Exception(boost::format("Lazy record of a %1% schema") % toString(schema_->type()));
+    }
+    offsets_.push_back(0);
+    for (size_t i = 0; i + 1 < schema_->leaves(); ++i) {
+        int64_t w = fixedWidth(schema_->leafAt(i));
+        if (w < 0) {
+            break;
+        }
+        offsets_.push_back(offsets_.back() + static_cast<size_t>(w));
+    }
+}
+
+LazyGenericRecord::LazyGenericRecord(const ValidSchema &schema, vector<uint8_t> data)
+    : LazyGenericRecord(schema.root(), std::move(data)) {
+}
+
+size_t LazyGenericRecord::offsetAt(size_t pos) const {
+    if (pos >= offsets_.size()) {
+        // Skip from the last field found up to the one asked for.
+        static_cast<SeekableInputStream &>(*in_).seek(static_cast<int64_t>(offsets_.back()));
+        decoder_->init(*in_);
+        while (offsets_.size() <= pos) {
+            skip(*decoder_, schema_->leafAt(offsets_.size() - 1));
+            decoder_->drain();
+            offsets_.push_back(in_->byteCount());
+        }
+    }
+    return offsets_[pos];
+}
+
+const GenericDatum &LazyGenericRecord::fieldAt(size_t pos) const {
+    if (pos >= fields_.size()) {
+        throw Exception(boost::format("Invalid field index %1% of %2%") % pos % fields_.size());
+    }
+    if (!decoded_[pos]) {
+        size_t offset = offsetAt(pos);
+        static_cast<SeekableInputStream &>(*in_).seek(static_cast<int64_t>(offset));
+        decoder_->init(*in_);
+        GenericDatum datum(schema_->leafAt(pos));
+        GenericReader::read(*decoder_, datum);
+        decoder_->drain();
+        fields_[pos] = std::move(datum);
+        decoded_[pos] = true;
+        // Reading the field found where the next one starts.
+        if (pos + 1 == offsets_.size() && pos + 1 < fields_.size()) {
+            offsets_.push_back(in_->byteCount());
+        }
+    }
+    return fields_[pos];
+}
+
+GenericRecord LazyGenericRecord::record() const {
+    GenericRecord result(schema_);
+    for (size_t i = 0; i < fields_.size(); ++i) {
+        result.fieldAt(i) = fieldAt(i);
+    }
+    return result;
 }
 
-GenericWriter::GenericWriter(ValidSchema s, EncoderPtr encoder) : schema_(std::move(s)), encoder_(std::move(encoder)) {
+GenericWriter::GenericWriter(ValidSchema s, EncoderPtr encoder) : schema_(std::move(s)), encoder_(std::move(encoder)),
+                                                                   compiled_(new CompiledGenericWriter(schema_, encoder_)) {
 }
 
+GenericWriter::~GenericWriter() = default;
+
 void GenericWriter::write(const GenericDatum &datum) const {
-    write(datum, *encoder_);
+    compiled_->write(datum);
 }
 
 void GenericWriter::write(const GenericDatum &datum, Encoder &e) {
@@ -225,4 +740,445 @@ void GenericWriter::write(Encoder &e, const GenericDatum &g) {
     write(g, e);
 }
 
+struct CompiledGenericWriter::Step {
+    typedef void (*Writer)(const Step &step, const GenericDatum &datum, Encoder &e);
+
+    Writer write;
+    // The steps of union branches, record fields, array items or map values.
+    std::vector<const Step *> children;
+
+    Step() : write(nullptr) {}
+};
+
+namespace {
+
+typedef CompiledGenericWriter::Step WriteStep;
+
+// E is the type of the encoder: BinaryEncoder, whose primitives are
+// final and so called directly, or Encoder.
+
+template<typename E>
+void writeNull(const WriteStep &, const GenericDatum &, Encoder &e) {
+    static_cast<E &>(e).encodeNull();
+}
+
+template<typename E>
+void writeBool(const WriteStep &, const GenericDatum &datum, Encoder &e) {
+    static_cast<E &>(e).encodeBool(datum.value<bool>());
+}
+
+template<typename E>
+void writeInt(const WriteStep &, const GenericDatum &datum, Encoder &e) {
+    static_cast<E &>(e).encodeInt(datum.value<int32_t>());
+}
+
+template<typename E>
+void writeLong(const WriteStep &, const GenericDatum &datum, Encoder &e) {
+    static_cast<E &>(e).encodeLong(datum.value<int64_t>());
+}
+
+template<typename E>
+void writeFloat(const WriteStep &, const GenericDatum &datum, Encoder &e) {
+    static_cast<E &>(e).encodeFloat(datum.value<float>());
+}
+
+template<typename E>
+void writeDouble(const WriteStep &, const GenericDatum &datum, Encoder &e) {
+    static_cast<E &>(e).encodeDouble(datum.value<double>());
+}
+
+template<typename E>
+void writeString(const WriteStep &, const GenericDatum &datum, Encoder &e) {
+    static_cast<E &>(e).encodeString(datum.value<string>());
+}
+
+template<typename E>
+void writeBytes(const WriteStep &, const GenericDatum &datum, Encoder &e) {
+    const bytes &b = datum.value<bytes>();
+    static_cast<E &>(e).encodeBytes(b.data(), b.size());
+}
+
+template<typename E>
+void writeFixed(const WriteStep &, const GenericDatum &datum, Encoder &e) {
+    const bytes &b = datum.value<GenericFixed>().value();
+    static_cast<E &>(e).encodeFixed(b.data(), b.size());
+}
+
+template<typename E>
+void writeEnum(const WriteStep &, const GenericDatum &datum, Encoder &e) {
+    static_cast<E &>(e).encodeEnum(datum.value<GenericEnum>().value());
+}
+
+template<typename E>
+void writeUnion(const WriteStep &step, const GenericDatum &datum, Encoder &e) {
+    size_t branch = datum.unionBranch();
+    static_cast<E &>(e).encodeUnionIndex(branch);
+    // The datum hands out the value of its branch.
+    const WriteStep &s = *step.children[branch];
+    s.write(s, datum, e);
+}
+
+template<typename E>
+void writeRecord(const WriteStep &step, const GenericDatum &datum, Encoder &e) {
+    const GenericRecord &r = datum.value<GenericRecord>();
+    for (size_t i = 0; i < step.children.size(); ++i) {
+        const WriteStep &s = *step.children[i];
+        s.write(s, r.fieldAt(i), e);
+    }
+}
+
+template<typename E>
+void writeArray(const WriteStep &step, const GenericDatum &datum, Encoder &e) {
+    const GenericArray::Value &r = datum.value<GenericArray>().value();
+    const WriteStep &item = *step.children[0];
+    E &enc = static_cast<E &>(e);
+    enc.arrayStart();
+    if (!r.empty()) {
+        enc.setItemCount(r.size());
+        for (const GenericDatum &it : r) {
+            enc.startItem();
+            item.write(item, it, e);
+        }
+    }
+    enc.arrayEnd();
+}
+
+template<typename E>
+void writeMap(const WriteStep &step, const GenericDatum &datum, Encoder &e) {
+    const GenericMap::Value &r = datum.value<GenericMap>().value();
+    const WriteStep &value = *step.children[0];
+    E &enc = static_cast<E &>(e);
+    enc.mapStart();
+    if (!r.empty()) {
+        enc.setItemCount(r.size());
+        for (const auto &it : r) {
+            enc.startItem();
+            enc.encodeString(it.first);
+            value.write(value, it.second, e);
+        }
+    }
+    enc.mapEnd();
+}
+
+} // namespace
+
+CompiledGenericWriter::CompiledGenericWriter(const ValidSchema &schema, const EncoderPtr &encoder)
+    : schema_(schema), encoder_(encoder) {
+    std::map<const Node *, const Step *> named;
+    root_ = dynamic_cast<BinaryEncoder *>(encoder_.get()) != nullptr
+        ? compile<BinaryEncoder>(schema_.root(), named)
+        : compile<Encoder>(schema_.root(), named);
+}
+
+CompiledGenericWriter::~CompiledGenericWriter() = default;
+
+template<typename E>
+const WriteStep *CompiledGenericWriter::compile(const NodePtr &n, std::map<const Node *, const Step *> &named) {
+    NodePtr node = n->type() == AVRO_SYMBOLIC ? resolveSymbol(n) : n;
+    std::map<const Node *, const Step *>::const_iterator it = named.find(node.get());
+    if (it != named.end()) {
+        return it->second;
+    }
+    steps_.emplace_back(new Step());
+    Step &step = *steps_.back();
+    if (node->hasName()) {
+        named[node.get()] = &step;
+    }
+    switch (node->type()) {
+        case AVRO_NULL:
+            step.write = writeNull<E>;
+            break;
+        case AVRO_BOOL:
+            step.write = writeBool<E>;
+            break;
+        case AVRO_INT:
+            step.write = writeInt<E>;
+            break;
+        case AVRO_LONG:
+            step.write = writeLong<E>;
+            break;
+        case AVRO_FLOAT:
+            step.write = writeFloat<E>;
+            break;
+        case AVRO_DOUBLE:
+            step.write = writeDouble<E>;
+            break;
+        case AVRO_STRING:
+            step.write = writeString<E>;
+            break;
+        case AVRO_BYTES:
+            step.write = writeBytes<E>;
+            break;
+        case AVRO_FIXED:
+            step.write = writeFixed<E>;
+            break;
+        case AVRO_ENUM:
+            step.write = writeEnum<E>;
+            break;
+        case AVRO_UNION:
+        case AVRO_RECORD:
+            step.write = node->type() == AVRO_UNION ? writeUnion<E> : writeRecord<E>;
+            for (size_t i = 0; i < node->leaves(); ++i) {
+                step.children.push_back(compile<E>(node->leafAt(i), named));
+            }
+            break;
+        case AVRO_ARRAY:
+        case AVRO_MAP:
+            step.write = node->type() == AVRO_ARRAY ? writeArray<E> : writeMap<E>;
+            step.children.push_back(compile<E>(node->leafAt(node->type() == AVRO_ARRAY ? 0 : 1), named));
+            break;
+        default:
+            throw Exception(boost::format("Unknown schema type %1%") % toString(node->type()));
+    }
+    return &step;
+}
+
+void CompiledGenericWriter::write(const GenericDatum &datum) const {
+    root_->write(*root_, datum, *encoder_);
+}
+
+struct GenericSizeEstimator::Step {
+    typedef size_t (*Sizer)(const Step &step, const GenericDatum &datum);
+
+    // Null if every datum of the step has the size in fixed.
+    Sizer size;
+    // The size of what does not vary: all of it without a sizer, and
+    // of records, the fields that do not vary.
+    size_t fixed;
+    // The fields of records that vary, by index; the branches of unions;
+    // the items of arrays or values of maps.
+    std::vector<std::pair<size_t, const Step *>> children;
+
+    Step() : size(nullptr), fixed(0) {}
+
+    size_t of(const GenericDatum &datum) const {
+        return size != nullptr ? size(*this, datum) : fixed;
+    }
+};
+
+namespace {
+
+typedef GenericSizeEstimator::Step SizeStep;
+
+size_t varintSize(int64_t n) {
+    uint64_t z = (static_cast<uint64_t>(n) << 1) ^ static_cast<uint64_t>(n >> 63);
+    size_t size = 1;
+    for (; z >= 0x80; z >>= 7) {
+        ++size;
+    }
+    return size;
+}
+
+size_t sizeInt(const SizeStep &, const GenericDatum &datum) {
+    return varintSize(datum.value<int32_t>());
+}
+
+size_t sizeLong(const SizeStep &, const GenericDatum &datum) {
+    return varintSize(datum.value<int64_t>());
+}
+
+size_t sizeString(const SizeStep &, const GenericDatum &datum) {
+    size_t n = datum.value<string>().size();
+    return varintSize(static_cast<int64_t>(n)) + n;
+}
+
+size_t sizeBytes(const SizeStep &, const GenericDatum &datum) {
+    size_t n = datum.value<bytes>().size();
+    return varintSize(static_cast<int64_t>(n)) + n;
+}
+
+size_t sizeEnum(const SizeStep &, const GenericDatum &datum) {
+    return varintSize(static_cast<int64_t>(datum.value<GenericEnum>().value()));
+}
+
+size_t sizeUnion(const SizeStep &step, const GenericDatum &datum) {
+    size_t branch = datum.unionBranch();
+    return varintSize(static_cast<int64_t>(branch)) + step.children[branch].second->of(datum);
+}
+
+size_t sizeRecord(const SizeStep &step, const GenericDatum &datum) {
+    const GenericRecord &r = datum.value<GenericRecord>();
+    size_t size = step.fixed;
+    for (const auto &field : step.children) {
+        size += field.second->of(r.fieldAt(field.first));
+    }
+    return size;
+}
+
+// Arrays and maps are written as one block: the count, the items and
+// the zero count that ends them, or that zero alone if empty.
+
+size_t sizeArray(const SizeStep &step, const GenericDatum &datum) {
+    const GenericArray::Value &r = datum.value<GenericArray>().value();
+    if (r.empty()) {
+        return 1;
+    }
+    const SizeStep &item = *step.children[0].second;
+    size_t size = varintSize(static_cast<int64_t>(r.size())) + 1;
+    if (item.size == nullptr) {
+        return size + r.size() * item.fixed;
+    }
+    for (const GenericDatum &it : r) {
+        size += item.size(item, it);
+    }
+    return size;
+}
+
+size_t sizeMap(const SizeStep &step, const GenericDatum &datum) {
+    const GenericMap::Value &r = datum.value<GenericMap>().value();
+    if (r.empty()) {
+        return 1;
+    }
+    const SizeStep &value = *step.children[0].second;
+    size_t size = varintSize(static_cast<int64_t>(r.size())) + 1;
+    for (const auto &it : r) {
+        size += varintSize(static_cast<int64_t>(it.first.size())) + it.first.size() + value.of(it.second);
+    }
+    return size;
+}
+
+} // namespace
+
+GenericSizeEstimator::GenericSizeEstimator(const ValidSchema &schema) : schema_(schema) {
+    std::map<const Node *, const Step *> named;
+    root_ = compile(schema_.root(), named);
+}
+
+GenericSizeEstimator::~GenericSizeEstimator() = default;
+
+const SizeStep *GenericSizeEstimator::compile(const NodePtr &n, std::map<const Node *, const Step *> &named) {
+    NodePtr node = n->type() == AVRO_SYMBOLIC ? resolveSymbol(n) : n;
+    std::map<const Node *, const Step *>::const_iterator it = named.find(node.get());
+    if (it != named.end()) {
+        return it->second;
+    }
+    steps_.emplace_back(new Step());
+    Step &step = *steps_.back();
+    if (node->hasName()) {
+        named[node.get()] = &step;
+    }
+    switch (node->type()) {
+        case AVRO_NULL:
+            break;
+        case AVRO_BOOL:
+            step.fixed = 1;
+            break;
+        case AVRO_INT:
+            step.size = sizeInt;
+            break;
+        case AVRO_LONG:
+            step.size = sizeLong;
+            break;
+        case AVRO_FLOAT:
+            step.fixed = 4;
+            break;
+        case AVRO_DOUBLE:
+            step.fixed = 8;
+            break;
+        case AVRO_STRING:
+            step.size = sizeString;
+            break;
+        case AVRO_BYTES:
+            step.size = sizeBytes;
+            break;
+        case AVRO_FIXED:
+            step.fixed = node->fixedSize();
+            break;
+        case AVRO_ENUM:
+            // Indices below 64 take one byte.
+            if (node->names() <= 64) {
+                step.fixed = 1;
+            } else {
+                step.size = sizeEnum;
+            }
+            break;
+        case AVRO_UNION: {
+            // The step is taken to vary while its branches are compiled,
+            // for those that refer back to it.
+            step.size = sizeUnion;
+            bool same = node->leaves() <= 64;
+            for (size_t i = 0; i < node->leaves(); ++i) {
+                const Step *branch = compile(node->leafAt(i), named);
+                step.children.emplace_back(i, branch);
+                same = same && branch->size == nullptr && branch->fixed == step.children[0].second->fixed;
+            }
+            if (same && !step.children.empty()) {
+                step.size = nullptr;
+                step.fixed = 1 + step.children[0].second->fixed;
+            }
+        } break;
+        case AVRO_RECORD:
+            step.size = sizeRecord;
+            for (size_t i = 0; i < node->leaves(); ++i) {
+                const Step *field = compile(node->leafAt(i), named);
+                if (field->size == nullptr) {
+                    step.fixed += field->fixed;
+                } else {
+                    step.children.emplace_back(i, field);
+                }
+            }
+            if (step.children.empty()) {
+                step.size = nullptr;
+            }
+            break;
+        case AVRO_ARRAY:
+        case AVRO_MAP:
+            step.size = node->type() == AVRO_ARRAY ? sizeArray : sizeMap;
+            step.children.emplace_back(0, compile(node->leafAt(node->type() == AVRO_ARRAY ? 0 : 1), named));
+            break;
+        default:
+            throw Exception(boost::format("Unknown schema type %1%") % toString(node->type()));
+    }
+    return &step;
+}
+
+bool GenericSizeEstimator::fixedSize() const {
+    return root_->size == nullptr;
+}
+
+size_t GenericSizeEstimator::size(const GenericDatum &datum) const {
+    return root_->of(datum);
+}
+
+namespace {
+
+/// Collects an encoding in one contiguous vector, so that it can be
+/// hashed in a single pass. The vector keeps its capacity from datum to
+/// datum.
+class HashBuffer : public OutputStream {
+    std::vector<uint8_t> &data_;
+    size_t used_;
+
+public:
+    explicit HashBuffer(std::vector<uint8_t> &data) : data_(data), used_(0) {}
+
+    bool next(uint8_t **data, size_t *len) final {
+        if (used_ == data_.size()) {
+            data_.resize(std::max<size_t>(256, data_.size() * 2));
+        }
+        *data = data_.data() + used_;
+        *len = data_.size() - used_;
+        used_ = data_.size();
+        return true;
+    }
+
+    void backup(size_t len) final { used_ -= len; }
+
+    uint64_t byteCount() const final { return used_; }
+
+    void flush() final {}
+};
+
+} // namespace
+
+uint64_t hashDatum(const GenericDatum &datum, uint64_t seed) {
+    thread_local std::vector<uint8_t> buffer;
+    HashBuffer out(buffer);
+    EncoderPtr e = binaryEncoder();
+    e->init(out);
+    GenericWriter::write(*e, datum);
+    e->flush();
+    return hash64(buffer.data(), static_cast<size_t>(out.byteCount()), seed);
+}
+
 } // namespace avro
@@ -34,65 +34,193 @@ GenericDatum::GenericDatum(const NodePtr &schema) : type_(schema->type()),
     init(schema);
 }
 
+GenericDatum::GenericDatum(const NodePtr &schema, Arena *arena) : type_(schema->type()),
+                                                                  logicalType_(schema->logicalType()),
+                                                                  value_(arena) {
+    init(schema);
+}
+
+GenericDatum::GenericDatum(const ValidSchema &schema, Arena &arena) : type_(schema.root()->type()),
+                                                                      logicalType_(schema.root()->logicalType()),
+                                                                      value_(&arena) {
+    init(schema.root());
+}
+
+void GenericDatum::throwTypeMismatch(Type requested) const {
+    throw Exception(boost::format("Datum of type %1% read as %2%")
+                    % toString(type_) % toString(requested));
+}
+
 void GenericDatum::init(const NodePtr &schema) {
-    NodePtr sc = schema;
     if (type_ == AVRO_SYMBOLIC) {
-        sc = resolveSymbol(schema);
+        NodePtr sc = resolveSymbol(schema);
         type_ = sc->type();
         logicalType_ = sc->logicalType();
+        init(sc);
+        return;
     }
     switch (type_) {
         case AVRO_NULL: break;
         case AVRO_BOOL:
-            value_ = bool();
+            value_.set(bool());
             break;
         case AVRO_INT:
-            value_ = int32_t();
+            value_.set(int32_t());
             break;
         case AVRO_LONG:
-            value_ = int64_t();
+            value_.set(int64_t());
             break;
         case AVRO_FLOAT:
-            value_ = float();
+            value_.set(float());
             break;
         case AVRO_DOUBLE:
-            value_ = double();
+            value_.set(double());
             break;
         case AVRO_STRING:
-            value_ = string();
+            value_.set(string());
             break;
         case AVRO_BYTES:
-            value_ = vector<uint8_t>();
+            value_.set(vector<uint8_t>());
             break;
         case AVRO_FIXED:
-            value_ = GenericFixed(sc);
+            value_.set(GenericFixed(schema));
             break;
         case AVRO_RECORD:
-            value_ = GenericRecord(sc);
+            value_.set(GenericRecord(schema, value_.arena()));
             break;
         case AVRO_ENUM:
-            value_ = GenericEnum(sc);
+            value_.set(GenericEnum(schema));
             break;
         case AVRO_ARRAY:
-            value_ = GenericArray(sc);
+            value_.set(GenericArray(schema));
             break;
         case AVRO_MAP:
-            value_ = GenericMap(sc);
+            value_.set(GenericMap(schema));
             break;
         case AVRO_UNION:
-            value_ = GenericUnion(sc);
+            value_.set(GenericUnion(schema, value_.arena()));
             break;
         default:
             throw Exception(boost::format("Unknown schema type %1%") % toString(type_));
     }
 }
 
+void GenericDatum::share() {
+    if (value_.isShared()) {
+        return;
+    }
+    // The values within are shared first, so that a copy made into a
+    // value of its own copies only one level.
+    switch (type_) {
+        case AVRO_STRING:
+            value_.share<string>();
+            break;
+        case AVRO_BYTES:
+            value_.share<vector<uint8_t>>();
+            break;
+        case AVRO_FIXED:
+            value_.share<GenericFixed>();
+            break;
+        case AVRO_RECORD: {
+            GenericRecord &r = value_.get<GenericRecord>();
+            for (size_t i = 0; i < r.fieldCount(); ++i) {
+                r.fieldAt(i).share();
+            }
+            value_.share<GenericRecord>();
+        } break;
+        case AVRO_ARRAY:
+            for (GenericDatum &d : value_.get<GenericArray>().value()) {
+                d.share();
+            }
+            value_.share<GenericArray>();
+            break;
+        case AVRO_MAP:
+            for (std::pair<string, GenericDatum> &e : value_.get<GenericMap>().value()) {
+                e.second.share();
+            }
+            value_.share<GenericMap>();
+            break;
+        case AVRO_UNION:
+            value_.get<GenericUnion>().datum().share();
+            value_.share<GenericUnion>();
+            break;
+        default:
+            break;
+    }
+}
+
 GenericRecord::GenericRecord(const NodePtr &schema) : GenericContainer(AVRO_RECORD, schema) {
-    fields_.resize(schema->leaves());
+    size_t n = schema->leaves();
+    fields_.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        fields_.emplace_back(schema->leafAt(i));
+    }
+}
+
+GenericRecord::GenericRecord(const NodePtr &schema, Arena *arena) : GenericContainer(AVRO_RECORD, schema) {
+    fields_.reserve(schema->leaves());
     for (size_t i = 0; i < schema->leaves(); ++i) {
-        fields_[i] = GenericDatum(schema->leafAt(i));
+        fields_.push_back(GenericDatum(schema->leafAt(i), arena));
     }
 }
 
 GenericFixed::GenericFixed(const NodePtr &schema, const vector<uint8_t> &v) : GenericContainer(AVRO_FIXED, schema), value_(v) {}
+
+static void resetDatum(GenericDatum &datum, const GenericDatum &prototype) {
+    if (prototype.isUnion() && datum.unionBranch() != prototype.unionBranch()) {
+        datum = prototype;
+        return;
+    }
+    switch (prototype.type()) {
+        case AVRO_NULL:
+            break;
+        case AVRO_BOOL:
+            datum.value<bool>() = prototype.value<bool>();
+            break;
+        case AVRO_INT:
+            datum.value<int32_t>() = prototype.value<int32_t>();
+            break;
+        case AVRO_LONG:
+            datum.value<int64_t>() = prototype.value<int64_t>();
+            break;
+        case AVRO_FLOAT:
+            datum.value<float>() = prototype.value<float>();
+            break;
+        case AVRO_DOUBLE:
+            datum.value<double>() = prototype.value<double>();
+            break;
+        case AVRO_STRING:
+            datum.value<string>().clear();
+            break;
+        case AVRO_BYTES:
+            datum.value<vector<uint8_t>>().clear();
+            break;
+        case AVRO_FIXED:
+            datum.value<GenericFixed>().value() = prototype.value<GenericFixed>().value();
+            break;
+        case AVRO_ENUM:
+            datum.value<GenericEnum>().set(prototype.value<GenericEnum>().value());
+            break;
+        case AVRO_RECORD: {
+            GenericRecord &r = datum.value<GenericRecord>();
+            const GenericRecord &p = prototype.value<GenericRecord>();
+            for (size_t i = 0; i < p.fieldCount(); ++i) {
+                resetDatum(r.fieldAt(i), p.fieldAt(i));
+            }
+        } break;
+        case AVRO_ARRAY:
+            datum.value<GenericArray>().value().clear();
+            break;
+        case AVRO_MAP:
+            datum.value<GenericMap>().value().clear();
+            break;
+        default:
+            throw Exception(boost::format("Unknown schema type %1%") % toString(prototype.type()));
+    }
+}
+
+void GenericDatumPrototype::reset(GenericDatum &datum) const {
+    resetDatum(datum, prototype_);
+}
+
 } // namespace avro
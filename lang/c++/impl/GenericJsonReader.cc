@@ -0,0 +1,406 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GenericJsonReader.hh"
+#include "Exception.hh"
+#include "NodeImpl.hh"
+#include "json/JsonIO.hh"
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+
+namespace avro {
+
+using json::JsonParser;
+using std::map;
+using std::string;
+using std::vector;
+
+namespace {
+
+/**
+ * A perfect hash table of names: the seed is searched for, when the
+ * table is made, under which every name has a slot of its own, so that
+ * finding a name takes one hash and one comparison.
+ */
+class NameTable {
+    vector<string> names_;
+    // The index of the name in each slot, plus one; zero if empty.
+    vector<size_t> slots_;
+    uint64_t seed_;
+    size_t mask_;
+
+    static uint64_t hash(const char *p, size_t n, uint64_t seed) {
+        uint64_t h = 14695981039346656037ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+        for (size_t i = 0; i < n; ++i) {
+            h ^= static_cast<uint8_t>(p[i]);
+            h *= 1099511628211ULL;
+        }
+        return h ^ (h >> 29);
+    }
+
+    bool place(uint64_t seed) {
+        std::fill(slots_.begin(), slots_.end(), 0);
+        for (size_t i = 0; i < names_.size(); ++i) {
+            size_t &s = slots_[hash(names_[i].data(), names_[i].size(), seed) & mask_];
+            if (s != 0) {
+                return false;
+            }
+            s = i + 1;
+        }
+        seed_ = seed;
+        return true;
+    }
+
+public:
+    NameTable() : slots_(1, 0), seed_(0), mask_(0) {}
+
+    explicit NameTable(vector<string> names) : names_(std::move(names)), seed_(0) {
+        size_t size = 1;
+        while (size < 2 * names_.size()) {
+            size *= 2;
+        }
+        for (;;) {
+            slots_.assign(size, 0);
+            mask_ = size - 1;
+            for (uint64_t seed = 0; seed < 64; ++seed) {
+                if (place(seed)) {
+                    return;
+                }
+            }
+            if (size > 64 * names_.size()) {
+                throw Exception("Names are not unique");
+            }
+            size *= 2;
+        }
+    }
+
+    /// Returns the index of the name \p p of \p n bytes, or size() if
+    /// it is not in the table.
+    size_t find(const char *p, size_t n) const {
+        size_t s = slots_[hash(p, n, seed_) & mask_];
+        return s != 0 && is(s - 1, p, n) ? s - 1 : names_.size();
+    }
+
+    /// Whether the name at \p i is the \p n bytes at \p p.
+    bool is(size_t i, const char *p, size_t n) const {
+        const string &name = names_[i];
+        return name.size() == n && std::memcmp(name.data(), p, n) == 0;
+    }
+
+    size_t size() const {
+        return names_.size();
+    }
+};
+
+struct Step {
+    Type type;
+    // The size of fixeds.
+    size_t size;
+    // Fields of records, branches of unions, the items of arrays and the
+    // values of maps.
+    vector<size_t> leaves;
+    // The names of the fields of records, the symbols of enums and the
+    // names of the branches of unions.
+    NameTable names;
+    // The branch of a union that is null, or the number of branches.
+    size_t nullBranch;
+};
+
+// The name JSON gives a branch of a union, as the JSON encoder has it.
+string branchName(const NodePtr &n) {
+    if (n->hasName()) {
+        return std::string(n->name());
+    }
+    std::ostringstream oss;
+    oss << n->type();
+    return oss.str();
+}
+
+} // namespace
+
+class GenericJsonReader::Impl {
+    vector<Step> steps_;
+    map<const Node *, size_t> records_;
+    JsonParser in_;
+    // Keys with escapes in them, unescaped.
+    string key_;
+    // Which fields of the records being read have been seen, those of
+    // the innermost last.
+    vector<uint8_t> seen_;
+
+    size_t compile(const NodePtr &node) {
+        NodePtr n = node->type() == AVRO_SYMBOLIC
+            ? std::static_pointer_cast<NodeSymbolic>(node)->getNode()
+            : node;
+        if (n->type() == AVRO_RECORD) {
+            map<const Node *, size_t>::const_iterator it = records_.find(n.get());
+            if (it != records_.end()) {
+                return it->second;
+            }
+        }
+        size_t result = steps_.size();
+        steps_.emplace_back();
+        steps_[result].type = n->type();
+        steps_[result].size = n->type() == AVRO_FIXED ? n->fixedSize() : 0;
+        vector<size_t> leaves;
+        vector<string> names;
+        size_t nullBranch = 0;
+        switch (n->type()) {
+            case AVRO_RECORD:
+                records_[n.get()] = result;
+                for (size_t i = 0; i < n->leaves(); ++i) {
+                    names.push_back(n->nameAt(i));
+                    leaves.push_back(compile(n->leafAt(i)));
+                }
+                break;
+            case AVRO_ENUM:
+                for (size_t i = 0; i < n->names(); ++i) {
+                    names.push_back(n->nameAt(i));
+                }
+                break;
+            case AVRO_UNION:
+                nullBranch = n->leaves();
+                for (size_t i = 0; i < n->leaves(); ++i) {
+                    const NodePtr &b = n->leafAt(i);
+                    if (b->type() == AVRO_NULL) {
+                        nullBranch = i;
+                    }
+                    names.push_back(branchName(b));
+                    leaves.push_back(compile(b));
+                }
+                break;
+            case AVRO_ARRAY:
+                leaves.push_back(compile(n->leafAt(0)));
+                break;
+            case AVRO_MAP:
+                leaves.push_back(compile(n->leafAt(1)));
+                break;
+            default:
+                break;
+        }
+        // Compiling the leaves may have moved the steps.
+        Step &step = steps_[result];
+        step.leaves.swap(leaves);
+        step.names = NameTable(std::move(names));
+        step.nullBranch = nullBranch;
+        return result;
+    }
+
+    // Finds the string just read among the names of the step, straight
+    // from the bytes of the input unless it has escapes. The name at
+    // \p expected, if there is one, is tried before hashing.
+    size_t findName(const NameTable &names, const char *what, size_t expected = SIZE_MAX) {
+        const string &raw = in_.rawString();
+        size_t i;
+        if (std::memchr(raw.data(), '\\', raw.size()) == nullptr) {
+            if (expected < names.size() && names.is(expected, raw.data(), raw.size())) {
+                return expected;
+            }
+            i = names.find(raw.data(), raw.size());
+        } else {
+            in_.stringValue(key_);
+            i = names.find(key_.data(), key_.size());
+        }
+        if (i == names.size()) {
+            throw Exception(boost::format("Unknown %1% in JSON: %2%") % what % in_.stringValue());
+        }
+        return i;
+    }
+
+    void read(size_t s, GenericDatum &d) {
+        const Step &step = steps_[s];
+        if (step.type != AVRO_UNION) {
+            readValue(step, d);
+            return;
+        }
+        size_t b;
+        if (in_.peek() == JsonParser::tkNull && step.nullBranch != step.leaves.size()) {
+            b = step.nullBranch;
+        } else {
+            in_.expectToken(JsonParser::tkObjectStart);
+            in_.expectToken(JsonParser::tkString);
+            b = findName(step.names, "union branch");
+        }
+        if (!d.isUnion()) {
+            throw Exception(boost::format("Datum of type %1% where the schema has a union") % d.type());
+        }
+        d.selectBranch(b);
+        readValue(steps_[step.leaves[b]], d);
+        if (b != step.nullBranch) {
+            in_.expectToken(JsonParser::tkObjectEnd);
+        }
+    }
+
+    void readBytes(vector<uint8_t> &v) {
+        in_.expectToken(JsonParser::tkString);
+        // Bytes are written as ISO-8859-1, one character per byte.
+        string b = JsonParser::toBytesValue(in_.rawString());
+        v.assign(b.begin(), b.end());
+    }
+
+    void readValue(const Step &step, GenericDatum &d) {
+        if (d.type() != step.type) {
+            throw Exception(boost::format("Datum of type %1% where the schema has %2%") % d.type() % step.type);
+        }
+        switch (step.type) {
+            case AVRO_NULL:
+                in_.expectToken(JsonParser::tkNull);
+                break;
+            case AVRO_BOOL:
+                in_.expectToken(JsonParser::tkBool);
+                d.value<bool>() = in_.boolValue();
+                break;
+            case AVRO_INT: {
+                in_.expectToken(JsonParser::tkLong);
+                int64_t v = in_.longValue();
+                if (v < INT32_MIN || v > INT32_MAX) {
+                    throw Exception(boost::format("Value out of range for Avro int: %1%") % v);
+                }
+                d.value<int32_t>() = static_cast<int32_t>(v);
+            } break;
+            case AVRO_LONG:
+                in_.expectToken(JsonParser::tkLong);
+                d.value<int64_t>() = in_.longValue();
+                break;
+            case AVRO_FLOAT:
+                in_.expectToken(JsonParser::tkDouble);
+                d.value<float>() = static_cast<float>(in_.doubleValue());
+                break;
+            case AVRO_DOUBLE:
+                in_.expectToken(JsonParser::tkDouble);
+                d.value<double>() = in_.doubleValue();
+                break;
+            case AVRO_STRING:
+                in_.expectToken(JsonParser::tkString);
+                in_.stringValue(d.value<string>());
+                break;
+            case AVRO_BYTES:
+                readBytes(d.value<vector<uint8_t>>());
+                break;
+            case AVRO_FIXED: {
+                vector<uint8_t> &v = d.value<GenericFixed>().value();
+                readBytes(v);
+                if (v.size() != step.size) {
+                    throw Exception("Incorrect value for fixed");
+                }
+            } break;
+            case AVRO_ENUM:
+                in_.expectToken(JsonParser::tkString);
+                d.value<GenericEnum>().set(findName(step.names, "enum symbol"));
+                break;
+            case AVRO_RECORD: {
+                GenericRecord &r = d.value<GenericRecord>();
+                size_t n = step.leaves.size();
+                if (r.fieldCount() != n) {
+                    throw Exception(boost::format("Record of %1% fields where the schema has %2%") % r.fieldCount() % n);
+                }
+                in_.expectToken(JsonParser::tkObjectStart);
+                size_t base = seen_.size();
+                seen_.resize(base + n, 0);
+                size_t count = 0;
+                // Writers put the fields in the order of the schema, so
+                // the one after the last is the likely next.
+                size_t f = SIZE_MAX;
+                while (in_.advance() != JsonParser::tkObjectEnd) {
+                    if (in_.cur() != JsonParser::tkString) {
+                        throw Exception("Expected a field name in JSON");
+                    }
+                    f = findName(step.names, "field", f + 1);
+                    if (seen_[base + f] != 0) {
+                        throw Exception(boost::format("Field %1% is repeated in JSON") % in_.stringValue());
+                    }
+                    seen_[base + f] = 1;
+                    ++count;
+                    read(step.leaves[f], r.fieldAt(f));
+                }
+                seen_.resize(base);
+                if (count != n) {
+                    throw Exception(boost::format("%1% of %2% fields are missing in JSON") % (n - count) % n);
+                }
+            } break;
+            case AVRO_ARRAY: {
+                GenericArray &a = d.value<GenericArray>();
+                vector<GenericDatum> &items = a.value();
+                const NodePtr &nn = a.schema()->leafAt(0);
+                in_.expectToken(JsonParser::tkArrayStart);
+                size_t i = 0;
+                for (; in_.peek() != JsonParser::tkArrayEnd; ++i) {
+                    if (i == items.size()) {
+                        items.emplace_back(nn, d.arena());
+                    }
+                    read(step.leaves[0], items[i]);
+                }
+                in_.advance();
+                items.resize(i);
+            } break;
+            case AVRO_MAP: {
+                GenericMap &m = d.value<GenericMap>();
+                GenericMap::Value &entries = m.value();
+                const NodePtr &nn = m.schema()->leafAt(1);
+                in_.expectToken(JsonParser::tkObjectStart);
+                size_t i = 0;
+                for (; in_.advance() != JsonParser::tkObjectEnd; ++i) {
+                    if (in_.cur() != JsonParser::tkString) {
+                        throw Exception("Expected a map key in JSON");
+                    }
+                    if (i == entries.size()) {
+                        entries.emplace_back(string(), GenericDatum(nn, d.arena()));
+                    }
+                    in_.stringValue(entries[i].first);
+                    read(step.leaves[0], entries[i].second);
+                }
+                entries.resize(i);
+            } break;
+            default:
+                throw Exception(boost::format("Cannot read %1% from JSON") % step.type);
+        }
+    }
+
+public:
+    explicit Impl(const ValidSchema &schema) {
+        compile(schema.root());
+    }
+
+    void read(InputStream &is, GenericDatum &datum) {
+        in_.init(is);
+        seen_.clear();
+        try {
+            read(0, datum);
+        } catch (...) {
+            // Hands back the rest of the chunk while the stream is known
+            // to be alive.
+            in_.init(is);
+            throw;
+        }
+        in_.drain();
+    }
+};
+
+GenericJsonReader::GenericJsonReader(const ValidSchema &schema) : impl_(new Impl(schema)) {
+}
+
+GenericJsonReader::~GenericJsonReader() = default;
+
+void GenericJsonReader::read(InputStream &in, GenericDatum &datum) {
+    impl_->read(in, datum);
+}
+
+} // namespace avro
@@ -0,0 +1,294 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GenericJsonWriter.hh"
+#include "Exception.hh"
+#include "NodeImpl.hh"
+#include "json/JsonIO.hh"
+
+#include <cmath>
+#include <map>
+#include <string>
+
+namespace avro {
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace {
+
+struct Step {
+    Type type;
+    // Fields of records, branches of unions, the items of arrays and the
+    // values of maps.
+    vector<size_t> leaves;
+    // The JSON that comes before each field of a record, its quoted name
+    // with the opening brace or a comma; the quoted symbols of an enum;
+    // the opening of each branch of a union, empty for null.
+    vector<string> texts;
+};
+
+typedef json::JsonGenerator<json::JsonNullFormatter> Generator;
+
+string quote(const string &s) {
+    std::unique_ptr<OutputStream> out = memoryOutputStream();
+    Generator g;
+    g.init(*out);
+    g.encodeString(s);
+    g.flush();
+    std::shared_ptr<vector<uint8_t>> b = snapshot(*out);
+    return string(b->begin(), b->end());
+}
+
+// The name JSON gives a branch of a union, as the JSON encoder has it.
+string branchName(const NodePtr &n) {
+    if (n->hasName()) {
+        return std::string(n->name());
+    }
+    std::ostringstream oss;
+    oss << n->type();
+    return oss.str();
+}
+
+} // namespace
+
+class GenericJsonWriter::Impl {
+    vector<Step> steps_;
+    map<const Node *, size_t> records_;
+    Generator out_;
+
+    size_t compile(const NodePtr &node) {
+        NodePtr n = node->type() == AVRO_SYMBOLIC
+            ? std::static_pointer_cast<NodeSymbolic>(node)->getNode()
+            : node;
+        if (n->type() == AVRO_RECORD) {
+            map<const Node *, size_t>::const_iterator it = records_.find(n.get());
+            if (it != records_.end()) {
+                return it->second;
+            }
+        }
+        size_t result = steps_.size();
+        steps_.emplace_back();
+        steps_[result].type = n->type();
+        vector<size_t> leaves;
+        vector<string> texts;
+        switch (n->type()) {
+            case AVRO_RECORD:
+                records_[n.get()] = result;
+                for (size_t i = 0; i < n->leaves(); ++i) {
+                    texts.push_back((i == 0 ? "{" : ",") + quote(n->nameAt(i)) + ":");
+                    leaves.push_back(compile(n->leafAt(i)));
+                }
+                break;
+            case AVRO_ENUM:
+                for (size_t i = 0; i < n->names(); ++i) {
+                    texts.push_back(quote(n->nameAt(i)));
+                }
+                break;
+            case AVRO_UNION:
+                for (size_t i = 0; i < n->leaves(); ++i) {
+                    const NodePtr &b = n->leafAt(i);
+                    texts.push_back(b->type() == AVRO_NULL ? string() : "{" + quote(branchName(b)) + ":");
+                    leaves.push_back(compile(b));
+                }
+                break;
+            case AVRO_ARRAY:
+                leaves.push_back(compile(n->leafAt(0)));
+                break;
+            case AVRO_MAP:
+                leaves.push_back(compile(n->leafAt(1)));
+                break;
+            default:
+                break;
+        }
+        // Compiling the leaves may have moved the steps.
+        steps_[result].leaves.swap(leaves);
+        steps_[result].texts.swap(texts);
+        return result;
+    }
+
+    void raw(const string &s) {
+        out_.writeRaw(reinterpret_cast<const uint8_t *>(s.data()), s.size());
+    }
+
+    void raw(char c) {
+        out_.writeRaw(reinterpret_cast<const uint8_t *>(&c), 1);
+    }
+
+    // Non-finite numbers are written as the strings the JSON encoder
+    // writes for them.
+    template<typename T>
+    void writeFloating(T t) {
+        if (std::isnan(t)) {
+            out_.encodeString("NaN");
+        } else if (std::isinf(t)) {
+            out_.encodeString(t > 0 ? "Infinity" : "-Infinity");
+        } else {
+            out_.encodeNumber(t);
+        }
+    }
+
+    void write(size_t s, const GenericDatum &d) {
+        const Step &step = steps_[s];
+        if (step.type != AVRO_UNION) {
+            writeValue(step, d);
+            return;
+        }
+        if (!d.isUnion()) {
+            throw Exception(boost::format("Datum of type %1% where the schema has a union") % d.type());
+        }
+        size_t b = d.unionBranch();
+        if (b >= step.leaves.size()) {
+            throw Exception(boost::format("Union branch %1% out of range; there are %2%") % b % step.leaves.size());
+        }
+        raw(step.texts[b]);
+        writeValue(steps_[step.leaves[b]], d);
+        if (!step.texts[b].empty()) {
+            raw('}');
+        }
+    }
+
+    void writeValue(const Step &step, const GenericDatum &d) {
+        if (d.type() != step.type) {
+            throw Exception(boost::format("Datum of type %1% where the schema has %2%") % d.type() % step.type);
+        }
+        switch (step.type) {
+            case AVRO_NULL:
+                out_.encodeNull();
+                break;
+            case AVRO_BOOL:
+                out_.encodeBool(d.value<bool>());
+                break;
+            case AVRO_INT:
+                out_.encodeNumber(d.value<int32_t>());
+                break;
+            case AVRO_LONG:
+                out_.encodeNumber(d.value<int64_t>());
+                break;
+            case AVRO_FLOAT:
+                writeFloating(d.value<float>());
+                break;
+            case AVRO_DOUBLE:
+                writeFloating(d.value<double>());
+                break;
+            case AVRO_STRING:
+                out_.encodeString(d.value<string>());
+                break;
+            case AVRO_BYTES: {
+                const vector<uint8_t> &v = d.value<vector<uint8_t>>();
+                out_.encodeBinary(v.data(), v.size());
+            } break;
+            case AVRO_FIXED: {
+                const vector<uint8_t> &v = d.value<GenericFixed>().value();
+                out_.encodeBinary(v.data(), v.size());
+            } break;
+            case AVRO_ENUM: {
+                size_t e = d.value<GenericEnum>().value();
+                if (e >= step.texts.size()) {
+                    throw Exception(boost::format("Enum value %1% out of range; there are %2%") % e % step.texts.size());
+                }
+                raw(step.texts[e]);
+            } break;
+            case AVRO_RECORD: {
+                const GenericRecord &r = d.value<GenericRecord>();
+                if (r.fieldCount() != step.leaves.size()) {
+                    throw Exception(boost::format("Record of %1% fields where the schema has %2%") % r.fieldCount() % step.leaves.size());
+                }
+                if (step.leaves.empty()) {
+                    raw('{');
+                }
+                for (size_t i = 0; i < step.leaves.size(); ++i) {
+                    raw(step.texts[i]);
+                    write(step.leaves[i], r.fieldAt(i));
+                }
+                raw('}');
+            } break;
+            case AVRO_ARRAY: {
+                const GenericArray::Value &items = d.value<GenericArray>().value();
+                raw('[');
+                for (size_t i = 0; i < items.size(); ++i) {
+                    if (i != 0) {
+                        raw(',');
+                    }
+                    write(step.leaves[0], items[i]);
+                }
+                raw(']');
+            } break;
+            case AVRO_MAP: {
+                const GenericMap::Value &entries = d.value<GenericMap>().value();
+                raw('{');
+                for (size_t i = 0; i < entries.size(); ++i) {
+                    if (i != 0) {
+                        raw(',');
+                    }
+                    out_.encodeString(entries[i].first);
+                    raw(':');
+                    write(step.leaves[0], entries[i].second);
+                }
+                raw('}');
+            } break;
+            default:
+                throw Exception(boost::format("Cannot write %1% as JSON") % step.type);
+        }
+    }
+
+public:
+    explicit Impl(const ValidSchema &schema) {
+        compile(schema.root());
+    }
+
+    void write(const GenericDatum *data, size_t n, bool array, OutputStream &os) {
+        out_.init(os);
+        try {
+            if (array) {
+                raw('[');
+            }
+            for (size_t i = 0; i < n; ++i) {
+                if (i != 0) {
+                    raw(',');
+                }
+                write(0, data[i]);
+            }
+            if (array) {
+                raw(']');
+            }
+        } catch (...) {
+            // Hands back the rest of the chunk while the stream is known
+            // to be alive.
+            out_.flush();
+            throw;
+        }
+        out_.flush();
+    }
+};
+
+GenericJsonWriter::GenericJsonWriter(const ValidSchema &schema) : impl_(new Impl(schema)) {
+}
+
+GenericJsonWriter::~GenericJsonWriter() = default;
+
+void GenericJsonWriter::write(const GenericDatum &datum, OutputStream &out) {
+    impl_->write(&datum, 1, false, out);
+}
+
+void GenericJsonWriter::writeArray(const vector<GenericDatum> &data, OutputStream &out) {
+    impl_->write(data.data(), data.size(), true, out);
+}
+
+} // namespace avro
@@ -0,0 +1,122 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GroupCommitter.hh"
+
+#include <algorithm>
+#include <exception>
+
+namespace avro {
+
+struct GroupCommitter::Request {
+    OutputStream *stream;
+    bool done;
+    std::exception_ptr error;
+
+    explicit Request(OutputStream *s) : stream(s), done(false) {}
+};
+
+GroupCommitter::GroupCommitter(std::chrono::steady_clock::duration window)
+    : window_(window), stopping_(false), commits_(0), syncs_(0) {
+    thread_ = std::thread(&GroupCommitter::run, this);
+}
+
+GroupCommitter::~GroupCommitter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    thread_.join();
+}
+
+void GroupCommitter::commit(OutputStream &stream) {
+    RequestPtr r = std::make_shared<Request>(&stream);
+    std::unique_lock<std::mutex> lock(mutex_);
+    pending_.push_back(r);
+    wake_.notify_all();
+    done_.wait(lock, [&r] { return r->done; });
+    if (r->error) {
+        std::rethrow_exception(r->error);
+    }
+}
+
+int64_t GroupCommitter::commits() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return commits_;
+}
+
+int64_t GroupCommitter::syncs() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return syncs_;
+}
+
+void GroupCommitter::run() {
+    std::vector<RequestPtr> batch;
+    std::vector<OutputStream *> streams;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        wake_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+        if (pending_.empty()) {
+            return;
+        }
+        if (window_.count() != 0 && !stopping_) {
+            // Let the commits of the window join the first.
+            wake_.wait_for(lock, window_, [this] { return stopping_; });
+        }
+        batch.swap(pending_);
+        lock.unlock();
+
+        // Each stream is synced once, however many commits it has.
+        streams.clear();
+        for (const RequestPtr &r : batch) {
+            streams.push_back(r->stream);
+        }
+        std::sort(streams.begin(), streams.end());
+        streams.erase(std::unique(streams.begin(), streams.end()), streams.end());
+        int64_t synced = 0;
+        for (OutputStream *s : streams) {
+            std::exception_ptr error;
+            try {
+                if (s->sync()) {
+                    ++synced;
+                }
+            } catch (...) {
+                error = std::current_exception();
+            }
+            if (error) {
+                for (const RequestPtr &r : batch) {
+                    if (r->stream == s) {
+                        r->error = error;
+                    }
+                }
+            }
+        }
+
+        lock.lock();
+        for (const RequestPtr &r : batch) {
+            r->done = true;
+        }
+        commits_ += static_cast<int64_t>(batch.size());
+        syncs_ += synced;
+        batch.clear();
+        done_.notify_all();
+    }
+}
+
+} // namespace avro
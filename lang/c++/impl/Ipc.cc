@@ -0,0 +1,413 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "Ipc.hh"
+#include "Compiler.hh"
+#include "Generic.hh"
+
+#include <algorithm>
+#include <cstring>
+
+namespace avro {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+typedef HandshakeCache::Hash Hash;
+
+// The values of the match enum of the handshake response.
+enum HandshakeMatch {
+    MATCH_BOTH = 0,
+    MATCH_CLIENT = 1,
+    MATCH_NONE = 2,
+};
+
+// Reads up to n bytes, and returns how many there were before in ended.
+size_t readBytes(InputStream &in, uint8_t *b, size_t n) {
+    size_t done = 0;
+    const uint8_t *data;
+    size_t len;
+    while (done < n && in.next(&data, &len)) {
+        size_t m = std::min(len, n - done);
+        std::memcpy(b + done, data, m);
+        done += m;
+        if (m < len) {
+            in.backup(len - m);
+        }
+    }
+    return done;
+}
+
+void encodeHash(Encoder &e, const Hash &h) {
+    e.encodeFixed(h.data(), h.size());
+}
+
+Hash decodeHash(Decoder &d) {
+    vector<uint8_t> v;
+    d.decodeFixed(16, v);
+    Hash result{};
+    std::copy(v.begin(), v.end(), result.begin());
+    return result;
+}
+
+// The empty map<bytes> of metadata that calls and responses begin with.
+void encodeMeta(Encoder &e) {
+    e.mapStart();
+    e.mapEnd();
+}
+
+void skipMeta(Decoder &d) {
+    for (size_t n = d.mapStart(); n != 0; n = d.mapNext()) {
+        for (size_t i = 0; i < n; ++i) {
+            d.skipString();
+            d.skipBytes();
+        }
+    }
+}
+
+// Sends what e has written to buffer as one framed message.
+void sendBuffer(Encoder &e, OutputStream &buffer, OutputStream &out) {
+    e.flush();
+    InputStreamPtr in = memoryInputStream(buffer);
+    writeFrames(out, *in);
+}
+
+} // namespace
+
+void writeFrames(OutputStream &out, InputStream &message, size_t frameSize) {
+    if (frameSize == 0) {
+        throw Exception("Frames cannot be empty");
+    }
+    // A null chunk stands for the length of the frame after it, until the
+    // lengths have somewhere to live.
+    vector<OutputChunk> chunks;
+    const uint8_t *data;
+    size_t len;
+    while (message.next(&data, &len)) {
+        while (len > 0) {
+            size_t n = std::min(len, frameSize);
+            chunks.push_back(OutputChunk{nullptr, 4});
+            chunks.push_back(OutputChunk{data, n});
+            data += n;
+            len -= n;
+        }
+    }
+    chunks.push_back(OutputChunk{nullptr, 4});
+
+    vector<std::array<uint8_t, 4>> lengths(chunks.size() / 2 + 1);
+    size_t k = 0;
+    for (size_t i = 0; i < chunks.size(); i += 2) {
+        uint32_t n = i + 1 < chunks.size() ? static_cast<uint32_t>(chunks[i + 1].len) : 0;
+        std::array<uint8_t, 4> &b = lengths[k++];
+        b[0] = static_cast<uint8_t>(n >> 24);
+        b[1] = static_cast<uint8_t>(n >> 16);
+        b[2] = static_cast<uint8_t>(n >> 8);
+        b[3] = static_cast<uint8_t>(n);
+        chunks[i].data = b.data();
+    }
+    out.writeChunks(chunks.data(), chunks.size());
+}
+
+bool readFrames(InputStream &in, vector<uint8_t> &message) {
+    message.clear();
+    for (bool first = true;; first = false) {
+        uint8_t b[4];
+        size_t n = readBytes(in, b, 4);
+        if (n == 0 && first) {
+            return false;
+        }
+        if (n < 4) {
+            throw Exception("Stream ends within a framed message");
+        }
+        size_t len = (static_cast<size_t>(b[0]) << 24) | (static_cast<size_t>(b[1]) << 16)
+            | (static_cast<size_t>(b[2]) << 8) | b[3];
+        if (len == 0) {
+            return true;
+        }
+        size_t old = message.size();
+        message.resize(old + len);
+        if (readBytes(in, message.data() + old, len) < len) {
+            throw Exception("Stream ends within a framed message");
+        }
+    }
+}
+
+bool HandshakeCache::lookup(const string &server, const Hash &client, Hash &serverHash) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = servers_.find(std::make_pair(server, client));
+    if (it == servers_.end()) {
+        return false;
+    }
+    serverHash = it->second;
+    return true;
+}
+
+void HandshakeCache::store(const string &server, const Hash &client, const Hash &serverHash) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    servers_[std::make_pair(server, client)] = serverHash;
+}
+
+void HandshakeCache::forget(const string &server, const Hash &client) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    servers_.erase(std::make_pair(server, client));
+}
+
+RpcClient::RpcClient(const Protocol &protocol, InputStream &in, OutputStream &out,
+                     std::shared_ptr<HandshakeCache> cache, string server)
+    : protocol_(protocol), in_(in), out_(out), cache_(std::move(cache)),
+      server_(std::move(server)), connected_(false),
+      buffer_(memoryOutputStream()), encoder_(binaryEncoder()),
+      decoder_(binaryDecoder()), haveFirst_(false) {
+}
+
+void RpcClient::send(const string &message, const GenericDatum &request) {
+    const Message *m = protocol_.message(message);
+    if (m == nullptr) {
+        throw Exception(boost::format("Protocol %1% has no message %2%") % protocol_.name() % message);
+    }
+    if (request.type() != AVRO_RECORD
+        || request.value<GenericRecord>().schema().get() != m->request.get()) {
+        throw Exception(boost::format("Request of %1% is not a datum of its request record") % message);
+    }
+    if (connected_) {
+        resetMemoryOutputStream(*buffer_);
+        encoder_->init(*buffer_);
+        writeCall(*m, request);
+        sendMessage();
+    } else {
+        handshake(*m, request);
+    }
+    if (!m->oneWay) {
+        pending_.push_back(m);
+    }
+}
+
+void RpcClient::flush() {
+    out_.flush();
+}
+
+void RpcClient::receive(GenericDatum &response) {
+    if (pending_.empty()) {
+        throw Exception("No call is waiting for its response");
+    }
+    flush();
+    const Message &m = *pending_.front();
+    pending_.pop_front();
+    if (haveFirst_) {
+        haveFirst_ = false;
+    } else {
+        if (!readFrames(in_, response_)) {
+            throw Exception(boost::format("Connection closed before the response to %1%") % m.name);
+        }
+        responseIn_ = memoryInputStream(response_.data(), response_.size());
+        decoder_->init(*responseIn_);
+    }
+    skipMeta(*decoder_);
+    if (!decoder_->decodeBool()) {
+        response = GenericDatum(m.response);
+        GenericReader::read(*decoder_, response);
+        return;
+    }
+    GenericDatum error(m.errors);
+    GenericReader::read(*decoder_, error);
+    string what = error.unionBranch() == 0
+        ? error.value<string>()
+        : "Remote error " + m.errors->leafAt(error.unionBranch())->name().fullname();
+    throw RpcError(what, std::move(error));
+}
+
+GenericDatum RpcClient::call(const string &message, const GenericDatum &request) {
+    send(message, request);
+    GenericDatum result;
+    receive(result);
+    return result;
+}
+
+void RpcClient::handshake(const Message &message, const GenericDatum &request) {
+    const Hash &clientHash = protocol_.md5();
+    Hash serverHash = clientHash;
+    bool withProtocol = !cache_ || !cache_->lookup(server_, clientHash, serverHash);
+    for (;;) {
+        resetMemoryOutputStream(*buffer_);
+        encoder_->init(*buffer_);
+        encodeHash(*encoder_, clientHash);
+        if (withProtocol) {
+            encoder_->encodeUnionIndex(1);
+            encoder_->encodeString(protocol_.json());
+        } else {
+            encoder_->encodeUnionIndex(0);
+        }
+        encodeHash(*encoder_, serverHash);
+        encoder_->encodeUnionIndex(0);
+        writeCall(message, request);
+        sendMessage();
+        out_.flush();
+
+        if (!readFrames(in_, response_)) {
+            throw Exception("Connection closed during the handshake");
+        }
+        responseIn_ = memoryInputStream(response_.data(), response_.size());
+        decoder_->init(*responseIn_);
+        size_t match = decoder_->decodeEnum();
+        if (decoder_->decodeUnionIndex() == 1) {
+            decoder_->skipString();
+        }
+        if (decoder_->decodeUnionIndex() == 1) {
+            serverHash = decodeHash(*decoder_);
+        }
+        if (decoder_->decodeUnionIndex() == 1) {
+            skipMeta(*decoder_);
+        }
+        if (match == MATCH_BOTH || match == MATCH_CLIENT) {
+            if (cache_) {
+                cache_->store(server_, clientHash, serverHash);
+            }
+            connected_ = true;
+            haveFirst_ = !message.oneWay;
+            return;
+        }
+        if (match != MATCH_NONE || withProtocol) {
+            throw Exception(boost::format("Server refuses protocol %1%") % protocol_.name());
+        }
+        if (cache_) {
+            cache_->forget(server_, clientHash);
+        }
+        withProtocol = true;
+    }
+}
+
+void RpcClient::writeCall(const Message &message, const GenericDatum &request) {
+    encodeMeta(*encoder_);
+    encoder_->encodeString(message.name);
+    GenericWriter::write(*encoder_, request);
+}
+
+void RpcClient::sendMessage() {
+    sendBuffer(*encoder_, *buffer_, out_);
+}
+
+RpcResponder::RpcResponder(const Protocol &protocol) : protocol_(protocol) {
+}
+
+RpcResponder::~RpcResponder() = default;
+
+void RpcResponder::serve(InputStream &in, OutputStream &out) {
+    OutputStreamPtr buffer = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    DecoderPtr d = binaryDecoder();
+    vector<uint8_t> message;
+    bool connected = false;
+    while (readFrames(in, message)) {
+        InputStreamPtr mi = memoryInputStream(message.data(), message.size());
+        d->init(*mi);
+        resetMemoryOutputStream(*buffer);
+        e->init(*buffer);
+        bool answer = false;
+
+        if (!connected) {
+            Hash clientHash = decodeHash(*d);
+            string clientProtocol;
+            if (d->decodeUnionIndex() == 1) {
+                clientProtocol = d->decodeString();
+            }
+            Hash serverHash = decodeHash(*d);
+            if (d->decodeUnionIndex() == 1) {
+                skipMeta(*d);
+            }
+            connected = clientHash == protocol_.md5();
+            if (!connected && !clientProtocol.empty()) {
+                try {
+                    connected = compileJsonProtocolFromString(clientProtocol).md5() == protocol_.md5();
+                } catch (Exception &) {
+                }
+            }
+            HandshakeMatch match = !connected ? MATCH_NONE
+                : serverHash == protocol_.md5() ? MATCH_BOTH : MATCH_CLIENT;
+            e->encodeEnum(match);
+            if (match == MATCH_BOTH) {
+                e->encodeUnionIndex(0);
+                e->encodeUnionIndex(0);
+            } else {
+                e->encodeUnionIndex(1);
+                e->encodeString(protocol_.json());
+                e->encodeUnionIndex(1);
+                encodeHash(*e, protocol_.md5());
+            }
+            e->encodeUnionIndex(0);
+            answer = true;
+        }
+
+        if (connected) {
+            skipMeta(*d);
+            string name = d->decodeString();
+            const Message *m = name.empty() ? nullptr : protocol_.message(name);
+            if (m != nullptr) {
+                GenericDatum request(m->request);
+                GenericReader::read(*d, request);
+                GenericDatum response(m->response);
+                GenericDatum error(m->errors);
+                bool failed = true;
+                try {
+                    respond(*m, request, response);
+                    failed = false;
+                } catch (RpcError &ex) {
+                    const GenericDatum &g = ex.error();
+                    if (g.isUnion()) {
+                        error = g;
+                    } else if (g.type() == AVRO_RECORD) {
+                        const string &errorName = g.value<GenericRecord>().schema()->name().fullname();
+                        for (size_t i = 1; i < m->errors->leaves(); ++i) {
+                            if (m->errors->leafAt(i)->name().fullname() == errorName) {
+                                error.selectBranch(i);
+                                error.value<GenericRecord>() = g.value<GenericRecord>();
+                                break;
+                            }
+                        }
+                    }
+                    if (error.unionBranch() == 0) {
+                        error.value<string>() = ex.what();
+                    }
+                } catch (std::exception &ex) {
+                    error.value<string>() = ex.what();
+                }
+                if (!m->oneWay) {
+                    encodeMeta(*e);
+                    e->encodeBool(failed);
+                    GenericWriter::write(*e, failed ? error : response);
+                    answer = true;
+                }
+            } else if (!name.empty()) {
+                encodeMeta(*e);
+                e->encodeBool(true);
+                e->encodeUnionIndex(0);
+                e->encodeString("Unknown message: " + name);
+                answer = true;
+            }
+        }
+
+        if (answer) {
+            sendBuffer(*e, *buffer, out);
+            out.flush();
+        }
+    }
+}
+
+} // namespace avro
@@ -0,0 +1,187 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "JsonLines.hh"
+#include "Codec.hh"
+#include "DataFile.hh"
+#include "Encoder.hh"
+#include "Exception.hh"
+#include "Generic.hh"
+#include "GenericJsonReader.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <memory>
+
+namespace avro {
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+/**
+ * The objects encoded from a batch of lines, cut into blocks of about
+ * the sync interval.
+ */
+struct Batch {
+    vector<uint8_t> data;
+    // The end of each block in data, and the number of objects in it.
+    vector<std::pair<size_t, int64_t>> blocks;
+};
+
+bool blank(const char *b, const char *e) {
+    for (; b != e; ++b) {
+        if (*b != ' ' && *b != '\t' && *b != '\r') {
+            return false;
+        }
+    }
+    return true;
+}
+
+Batch encodeLines(const string &text, int64_t firstLine, const ValidSchema &schema,
+                  size_t blockSize) {
+    GenericJsonReader reader(schema);
+    GenericDatum datum(schema);
+    unique_ptr<OutputStream> out = memoryOutputStream(64 * 1024);
+    EncoderPtr e = binaryEncoder();
+    e->init(*out);
+
+    Batch result;
+    size_t blockStart = 0;
+    int64_t inBlock = 0;
+    int64_t line = firstLine;
+    const char *end = text.data() + text.size();
+    for (const char *p = text.data(); p != end; ++line) {
+        const char *nl = static_cast<const char *>(std::memchr(p, '\n', end - p));
+        const char *lineEnd = nl != nullptr ? nl : end;
+        if (!blank(p, lineEnd)) {
+            try {
+                unique_ptr<InputStream> in = memoryInputStream(reinterpret_cast<const uint8_t *>(p), lineEnd - p);
+                reader.read(*in, datum);
+                const uint8_t *rest;
+                size_t n;
+                while (in->next(&rest, &n)) {
+                    const char *r = reinterpret_cast<const char *>(rest);
+                    if (!blank(r, r + n)) {
+                        throw Exception("Text after the JSON value");
+                    }
+                }
+                GenericWriter::write(*e, datum);
+                e->flush();
+            } catch (const Exception &ex) {
+                throw Exception(boost::format("Line %1%: %2%") % line % ex.what());
+            }
+            ++inBlock;
+            size_t size = static_cast<size_t>(out->byteCount());
+            if (size - blockStart >= blockSize) {
+                result.blocks.emplace_back(size, inBlock);
+                blockStart = size;
+                inBlock = 0;
+            }
+        }
+        p = nl != nullptr ? nl + 1 : end;
+    }
+    if (inBlock != 0) {
+        result.blocks.emplace_back(static_cast<size_t>(out->byteCount()), inBlock);
+    }
+    result.data.swap(*snapshot(*out));
+    return result;
+}
+
+} // namespace
+
+int64_t jsonLinesToDataFile(InputStream &input, const ValidSchema &schema,
+                            const string &output, const JsonLinesOptions &options) {
+    BlockCodecPtr codec = findCodec(options.codec, schema);
+    if (!codec) {
+        throw Exception(boost::format("Unknown codec: %1%") % options.codec);
+    }
+    const size_t threads = std::max(options.threads, static_cast<size_t>(1));
+    const size_t batchSize = std::max(options.batchSize, static_cast<size_t>(1));
+    const size_t blockSize = options.syncInterval;
+
+    DataFileWriterBase writer(output.c_str(), schema, options.syncInterval, codec);
+    int64_t count = 0;
+    // The blocks are encoded already, and are trusted to be of the schema.
+    auto append = [&writer, &count](const Batch &b) {
+        size_t start = 0;
+        for (const auto &block : b.blocks) {
+            writer.appendEncodedBatch(b.data.data() + start, block.first - start, block.second, false);
+            start = block.first;
+            count += block.second;
+        }
+    };
+
+    std::deque<std::future<Batch>> pending;
+    string carry;
+    int64_t line = 1;
+    for (bool more = true; more || !carry.empty();) {
+        std::shared_ptr<string> text = std::make_shared<string>();
+        text->swap(carry);
+        // The carried over text has no newline in it.
+        size_t lastNewline = string::npos;
+        while (more && (text->size() < batchSize || lastNewline == string::npos)) {
+            const uint8_t *p;
+            size_t n;
+            if (!input.next(&p, &n)) {
+                more = false;
+                break;
+            }
+            size_t from = text->size();
+            text->append(reinterpret_cast<const char *>(p), n);
+            for (size_t i = text->size(); i-- > from;) {
+                if ((*text)[i] == '\n') {
+                    lastNewline = i;
+                    break;
+                }
+            }
+        }
+        if (more) {
+            carry.assign(*text, lastNewline + 1, string::npos);
+            text->resize(lastNewline + 1);
+        }
+        int64_t first = line;
+        line += std::count(text->begin(), text->end(), '\n');
+
+        if (pending.size() == threads) {
+            append(pending.front().get());
+            pending.pop_front();
+        }
+        pending.push_back(std::async(std::launch::async, [text, first, &schema, blockSize]() {
+            return encodeLines(*text, first, schema, blockSize);
+        }));
+    }
+    while (!pending.empty()) {
+        append(pending.front().get());
+        pending.pop_front();
+    }
+    writer.close();
+    return count;
+}
+
+int64_t jsonLinesToDataFile(const string &input, const ValidSchema &schema,
+                            const string &output, const JsonLinesOptions &options) {
+    unique_ptr<InputStream> in = fileInputStream(input.c_str());
+    return jsonLinesToDataFile(*in, schema, output, options);
+}
+
+} // namespace avro
@@ -0,0 +1,95 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MemoryResource.hh"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace avro {
+
+MemoryResource::~MemoryResource() = default;
+
+namespace {
+
+class NewDeleteResource : public MemoryResource {
+public:
+    void *allocate(size_t bytes, size_t alignment) override {
+        if (alignment <= defaultAlignment) {
+            return ::operator new(bytes);
+        }
+        void *p = nullptr;
+#ifdef _WIN32
+        p = ::_aligned_malloc(bytes, alignment);
+#else
+        if (::posix_memalign(&p, alignment, bytes) != 0) {
+            p = nullptr;
+        }
+#endif
+        if (p == nullptr) {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+
+    void deallocate(void *p, size_t, size_t alignment) override {
+        if (alignment <= defaultAlignment) {
+            ::operator delete(p);
+        } else {
+#ifdef _WIN32
+            ::_aligned_free(p);
+#else
+            ::free(p);
+#endif
+        }
+    }
+};
+
+std::atomic<MemoryResource *> processResource(nullptr);
+thread_local MemoryResource *threadResource = nullptr;
+
+} // namespace
+
+MemoryResource *newDeleteResource() {
+    static NewDeleteResource resource;
+    return &resource;
+}
+
+MemoryResource *defaultMemoryResource() {
+    if (threadResource != nullptr) {
+        return threadResource;
+    }
+    MemoryResource *r = processResource.load();
+    return r != nullptr ? r : newDeleteResource();
+}
+
+MemoryResource *setDefaultMemoryResource(MemoryResource *resource) {
+    MemoryResource *previous = processResource.exchange(resource);
+    return previous != nullptr ? previous : newDeleteResource();
+}
+
+ScopedMemoryResource::ScopedMemoryResource(MemoryResource *resource) : previous_(threadResource) {
+    threadResource = resource;
+}
+
+ScopedMemoryResource::~ScopedMemoryResource() {
+    threadResource = previous_;
+}
+
+} // namespace avro
@@ -17,7 +17,11 @@
  */
 
 #include "NodeImpl.hh"
+#include <array>
+#include <map>
+#include <mutex>
 #include <sstream>
+#include <tuple>
 #include <utility>
 
 using std::string;
@@ -125,6 +129,10 @@ NodePrimitive::resolve(const Node &reader) const {
 
 SchemaResolution
 NodeRecord::resolve(const Node &reader) const {
+    // Schemas from a SchemaPool share the nodes of equal subtrees.
+    if (&reader == this) {
+        return RESOLVE_MATCH;
+    }
     if (reader.type() == AVRO_RECORD) {
         if (name() == reader.name()) {
             return RESOLVE_MATCH;
@@ -135,6 +143,9 @@ NodeRecord::resolve(const Node &reader) const {
 
 SchemaResolution
 NodeEnum::resolve(const Node &reader) const {
+    if (&reader == this) {
+        return RESOLVE_MATCH;
+    }
     if (reader.type() == AVRO_ENUM) {
         return (name() == reader.name()) ? RESOLVE_MATCH : RESOLVE_NO_MATCH;
     }
@@ -143,6 +154,9 @@ NodeEnum::resolve(const Node &reader) const {
 
 SchemaResolution
 NodeArray::resolve(const Node &reader) const {
+    if (&reader == this) {
+        return RESOLVE_MATCH;
+    }
     if (reader.type() == AVRO_ARRAY) {
         const NodePtr &arrayType = leafAt(0);
         return arrayType->resolve(*reader.leafAt(0));
@@ -152,6 +166,9 @@ NodeArray::resolve(const Node &reader) const {
 
 SchemaResolution
 NodeMap::resolve(const Node &reader) const {
+    if (&reader == this) {
+        return RESOLVE_MATCH;
+    }
     if (reader.type() == AVRO_MAP) {
         const NodePtr &mapType = leafAt(1);
         return mapType->resolve(*reader.leafAt(1));
@@ -186,6 +203,9 @@ NodeUnion::resolve(const Node &reader) const {
 
 SchemaResolution
 NodeFixed::resolve(const Node &reader) const {
+    if (&reader == this) {
+        return RESOLVE_MATCH;
+    }
     if (reader.type() == AVRO_FIXED) {
         return (
                    (reader.fixedSize() == fixedSize()) && (reader.name() == name()))
@@ -274,6 +294,12 @@ void NodeRecord::printJson(std::ostream &os, size_t depth) const {
                                                            depth);
             }
         }
+        SortOrder order = fieldOrderAt(i);
+        if (order != ORDER_ASCENDING) {
+            os << ",\n"
+               << indent(depth) << "\"order\": \""
+               << (order == ORDER_DESCENDING ? "descending" : "ignore") << '"';
+        }
         os << '\n';
         os << indent(--depth) << '}';
     }
@@ -414,13 +440,29 @@ NodeRecord::NodeRecord(const HasName &name,
                        const LeafNames &fieldsNames,
                        std::vector<GenericDatum> dv) : NodeImplRecord(AVRO_RECORD, name, fields, fieldsNames, NoSize()),
                                                        defaultValues(std::move(dv)) {
+    indexFields();
+}
+
+void NodeRecord::indexFields() {
     for (size_t i = 0; i < leafNameAttributes_.size(); ++i) {
-        if (!nameIndex_.add(leafNameAttributes_.get(i), i)) {
+        if (!nameIndex_.add(leafNameAttributes_)) {
             throw Exception(boost::format(
                                 "Cannot add duplicate field: %1%")
                             % leafNameAttributes_.get(i));
         }
     }
+    // Without a single default, the field defaults need not be kept:
+    // defaultValueAt() answers for absent ones.
+    bool any = false;
+    for (const GenericDatum &d : defaultValues) {
+        if (d.isUnion() || d.type() != AVRO_NULL) {
+            any = true;
+            break;
+        }
+    }
+    if (!any) {
+        std::vector<GenericDatum>().swap(defaultValues);
+    }
 }
 
 void NodeMap::printDefaultToJson(const GenericDatum &g, std::ostream &os,
@@ -498,8 +540,41 @@ void NodeMap::printJson(std::ostream &os, size_t depth) const {
 }
 
 NodeMap::NodeMap() : NodeImplMap(AVRO_MAP) {
-    NodePtr key(new NodePrimitive(AVRO_STRING));
-    doAddLeaf(key);
+    doAddLeaf(primitiveNode(AVRO_STRING));
+}
+
+const NodePtr &primitiveNode(Type type) {
+    static const std::array<NodePtr, AVRO_NULL + 1> nodes = [] {
+        std::array<NodePtr, AVRO_NULL + 1> result;
+        for (int t = AVRO_STRING; t <= AVRO_NULL; ++t) {
+            result[t] = std::make_shared<NodePrimitive>(static_cast<Type>(t));
+            result[t]->lock();
+        }
+        return result;
+    }();
+    if (!isPrimitive(type)) {
+        throw Exception(boost::format("Not a primitive type: %1%") % type);
+    }
+    return nodes[type];
+}
+
+NodePtr primitiveNode(Type type, const LogicalType &logicalType) {
+    if (logicalType.type() == LogicalType::NONE) {
+        return primitiveNode(type);
+    }
+    static std::mutex mutex;
+    static std::map<std::tuple<int, int, int, int>, NodePtr> nodes;
+    auto key = std::make_tuple(static_cast<int>(type), static_cast<int>(logicalType.type()),
+                               logicalType.precision(), logicalType.scale());
+    std::lock_guard<std::mutex> lock(mutex);
+    NodePtr &result = nodes[key];
+    if (!result) {
+        NodePtr n = std::make_shared<NodePrimitive>(primitiveNode(type)->type());
+        n->setLogicalType(logicalType);
+        n->lock();
+        result = n;
+    }
+    return result;
 }
 
 void NodeUnion::printJson(std::ostream &os, size_t depth) const {
@@ -0,0 +1,46 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Protocol.hh"
+#include "Fingerprint.hh"
+
+#include <utility>
+
+namespace avro {
+
+Protocol::Protocol(std::string name, std::string ns, std::string json,
+                   ValidSchema schema, std::vector<NodePtr> types,
+                   std::vector<Message> messages) : name_(std::move(name)),
+                                                    ns_(std::move(ns)),
+                                                    json_(std::move(json)),
+                                                    md5_(md5Fingerprint(reinterpret_cast<const uint8_t *>(json_.data()), json_.size())),
+                                                    schema_(std::move(schema)),
+                                                    types_(std::move(types)),
+                                                    messages_(std::move(messages)) {
+}
+
+const Message *Protocol::message(const std::string &name) const {
+    for (const Message &m : messages_) {
+        if (m.name == name) {
+            return &m;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace avro
@@ -23,7 +23,9 @@
 #include "NodeImpl.hh"
 #include "Reader.hh"
 #include "ValidSchema.hh"
+#include <map>
 #include <memory>
+#include <utility>
 
 namespace avro {
 using std::unique_ptr;
@@ -445,7 +447,42 @@ protected:
     size_t offset_;
 };
 
+namespace {
+
+// assumes the writer is NOT a union, and the reader IS a union
+
+SchemaResolution
+checkUnionMatch(const NodePtr &writer, const NodePtr &reader, size_t &index) {
+    SchemaResolution bestMatch = RESOLVE_NO_MATCH;
+
+    index = 0;
+    size_t leaves = reader->leaves();
+
+    for (size_t i = 0; i < leaves; ++i) {
+
+        const NodePtr &leaf = reader->leafAt(i);
+        SchemaResolution newMatch = writer->resolve(*leaf);
+
+        if (newMatch == RESOLVE_MATCH) {
+            bestMatch = newMatch;
+            index = i;
+            break;
+        }
+        if (bestMatch == RESOLVE_NO_MATCH) {
+            bestMatch = newMatch;
+            index = i;
+        }
+    }
+
+    return bestMatch;
+}
+
+} // namespace
+
 class ResolverFactory : private boost::noncopyable {
+    // The results of checkUnionMatch() by writer and reader, since the
+    // same unions meet the same writers many times over in large schemas.
+    std::map<std::pair<const Node *, const Node *>, std::pair<SchemaResolution, size_t>> unionMatches_;
 
     template<typename T>
     unique_ptr<Resolver>
@@ -517,9 +554,12 @@ public:
 
         typedef unique_ptr<Resolver> (ResolverFactory::*BuilderFunc)(const NodePtr &writer, const NodePtr &reader, const Layout &offset);
 
-        NodePtr currentWriter = (writer->type() == AVRO_SYMBOLIC) ? resolveSymbol(writer) : writer;
-
-        NodePtr currentReader = (reader->type() == AVRO_SYMBOLIC) ? resolveSymbol(reader) : reader;
+        if (writer->type() == AVRO_SYMBOLIC) {
+            return construct(resolveSymbol(writer), reader, offset);
+        }
+        if (reader->type() == AVRO_SYMBOLIC) {
+            return construct(writer, resolveSymbol(reader), offset);
+        }
 
         static const BuilderFunc funcs[] = {
             &ResolverFactory::constructPrimitive<std::string>,
@@ -540,10 +580,10 @@ public:
         static_assert((sizeof(funcs) / sizeof(BuilderFunc)) == (AVRO_NUM_TYPES),
                       "Invalid number of builder functions");
 
-        BuilderFunc func = funcs[currentWriter->type()];
+        BuilderFunc func = funcs[writer->type()];
         assert(func);
 
-        return ((this)->*(func))(currentWriter, currentReader, offset);
+        return ((this)->*(func))(writer, reader, offset);
     }
 
     unique_ptr<Resolver>
@@ -577,6 +617,18 @@ public:
 
         return ((this)->*(func))(currentWriter);
     }
+
+    SchemaResolution unionMatch(const NodePtr &writer, const NodePtr &reader, size_t &index) {
+        std::pair<const Node *, const Node *> key(writer.get(), reader.get());
+        auto it = unionMatches_.find(key);
+        if (it == unionMatches_.end()) {
+            size_t i = 0;
+            SchemaResolution match = checkUnionMatch(writer, reader, i);
+            it = unionMatches_.insert(std::make_pair(key, std::make_pair(match, i))).first;
+        }
+        index = it->second.second;
+        return it->second.first;
+    }
 };
 
 RecordSkipper::RecordSkipper(ResolverFactory &factory, const NodePtr &writer) : Resolver() {
@@ -643,37 +695,6 @@ UnionSkipper::UnionSkipper(ResolverFactory &factory, const NodePtr &writer) : Re
     }
 }
 
-namespace {
-
-// assumes the writer is NOT a union, and the reader IS a union
-
-SchemaResolution
-checkUnionMatch(const NodePtr &writer, const NodePtr &reader, size_t &index) {
-    SchemaResolution bestMatch = RESOLVE_NO_MATCH;
-
-    index = 0;
-    size_t leaves = reader->leaves();
-
-    for (size_t i = 0; i < leaves; ++i) {
-
-        const NodePtr &leaf = reader->leafAt(i);
-        SchemaResolution newMatch = writer->resolve(*leaf);
-
-        if (newMatch == RESOLVE_MATCH) {
-            bestMatch = newMatch;
-            index = i;
-            break;
-        }
-        if (bestMatch == RESOLVE_NO_MATCH) {
-            bestMatch = newMatch;
-            index = i;
-        }
-    }
-
-    return bestMatch;
-}
-
-} // namespace
 
 UnionParser::UnionParser(ResolverFactory &factory,
                          const NodePtr &writer,
@@ -692,7 +713,7 @@ UnionParser::UnionParser(ResolverFactory &factory,
         const NodePtr &w = writer->leafAt(i);
         size_t index = 0;
 
-        SchemaResolution match = checkUnionMatch(w, reader, index);
+        SchemaResolution match = factory.unionMatch(w, reader, index);
 
         if (match == RESOLVE_NO_MATCH) {
             resolvers_.push_back(factory.skipper(w));
@@ -717,7 +738,7 @@ NonUnionToUnionParser::NonUnionToUnionParser(ResolverFactory &factory,
 #ifndef NDEBUG
     SchemaResolution bestMatch =
 #endif
-        checkUnionMatch(writer, reader, choice_);
+        factory.unionMatch(writer, reader, choice_);
     assert(bestMatch != RESOLVE_NO_MATCH);
     resolver_ = factory.construct(writer, reader->leafAt(choice_), offsets.at(choice_ + 2));
 }
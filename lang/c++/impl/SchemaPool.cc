@@ -0,0 +1,312 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SchemaPool.hh"
+#include "Decoder.hh"
+#include "Encoder.hh"
+#include "Fingerprint.hh"
+#include "Generic.hh"
+#include "NodeImpl.hh"
+#include "Stream.hh"
+
+#include <array>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace avro {
+
+using std::string;
+using std::vector;
+
+typedef std::array<uint8_t, 32> Digest;
+
+struct SchemaPool::Impl {
+    std::mutex mutex;
+    // Closed subtrees by the digest of their description.
+    std::map<Digest, NodePtr> nodes;
+};
+
+namespace {
+
+template<typename T>
+concepts::SingleAttribute<T> asSingleAttribute(const T &t) {
+    concepts::SingleAttribute<T> n;
+    n.add(t);
+    return n;
+}
+
+void addString(string &key, const string &s) {
+    key += std::to_string(s.size());
+    key += ':';
+    key += s;
+}
+
+string encodeDatum(const GenericDatum &d) {
+    std::unique_ptr<OutputStream> out = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*out);
+    GenericWriter::write(*e, d);
+    e->flush();
+    std::shared_ptr<vector<uint8_t>> bytes = snapshot(*out);
+    return string(bytes->begin(), bytes->end());
+}
+
+GenericDatum decodeDatum(const NodePtr &n, const string &bytes) {
+    std::unique_ptr<InputStream> in = memoryInputStream(
+        reinterpret_cast<const uint8_t *>(bytes.data()), bytes.size());
+    DecoderPtr d = binaryDecoder();
+    d->init(*in);
+    GenericDatum result(n);
+    GenericReader::read(*d, result);
+    return result;
+}
+
+/**
+ * Copies one schema into the pool, bottom up. A subtree is closed if it
+ * refers to no record that is still being copied; closed subtrees are
+ * looked up in the pool by a description of their contents in which
+ * closed children appear as their pooled nodes. References out of a
+ * subtree that is not closed appear by name instead, which is unique
+ * within the enclosing record that closes it.
+ */
+class Interner {
+    static const size_t none = std::numeric_limits<size_t>::max();
+
+    struct Built {
+        NodePtr node;
+        string key;
+        // The outermost record in progress the subtree refers to.
+        size_t minRef;
+    };
+
+    struct Done {
+        NodePtr node;
+        size_t minRef;
+    };
+
+    std::map<Digest, NodePtr> &pool_;
+    // The records being copied, outermost first, with their copies.
+    vector<std::pair<const Node *, NodePtr>> stack_;
+    // The named nodes copied so far.
+    std::map<const Node *, Done> done_;
+    // The nodes whose copy was not closed.
+    std::set<const Node *> open_;
+
+    static string pointerKey(char tag, const NodePtr &n) {
+        return tag + std::to_string(reinterpret_cast<uintptr_t>(n.get()));
+    }
+
+    // Records the named nodes in the not yet closed parts of the copy of
+    // orig, which are final now that the copy is pooled.
+    void settle(const NodePtr &orig, const NodePtr &copy) {
+        if (orig->type() == AVRO_SYMBOLIC) {
+            return;
+        }
+        if (orig->hasName()) {
+            done_[orig.get()] = Done{copy, none};
+        }
+        for (size_t i = 0; i < orig->leaves(); ++i) {
+            if (open_.count(orig->leafAt(i).get()) != 0) {
+                settle(orig->leafAt(i), copy->leafAt(i));
+            }
+        }
+    }
+
+    Built buildSymbolic(const NodePtr &n) {
+        NodePtr target = std::static_pointer_cast<NodeSymbolic>(n)->getNode();
+        Built b{NodePtr(), string(), none};
+        NodePtr copy;
+        for (size_t i = 0; i < stack_.size(); ++i) {
+            if (stack_[i].first == target.get()) {
+                copy = stack_[i].second;
+                b.minRef = i;
+                break;
+            }
+        }
+        if (!copy) {
+            auto it = done_.find(target.get());
+            if (it == done_.end()) {
+                // The reference came first; copy the definition here.
+                return build(target);
+            }
+            copy = it->second.node;
+            b.minRef = it->second.minRef;
+        }
+        if (b.minRef == none) {
+            b.key = pointerKey('s', copy);
+        } else {
+            b.key = 'r';
+            addString(b.key, n->name().fullname());
+        }
+        addString(b.key, n->getDoc());
+        b.node = NodePtr(new NodeSymbolic(asSingleAttribute(n->name()), copy));
+        if (!n->getDoc().empty()) {
+            b.node->setDoc(n->getDoc());
+        }
+        return b;
+    }
+
+public:
+    explicit Interner(std::map<Digest, NodePtr> &pool) : pool_(pool) {}
+
+    Built build(const NodePtr &n) {
+        if (n->type() == AVRO_SYMBOLIC) {
+            return buildSymbolic(n);
+        }
+
+        Type t = n->type();
+        LogicalType lt = n->logicalType();
+        string key = std::to_string(t);
+        key += ',';
+        key += std::to_string(lt.type());
+        if (lt.type() == LogicalType::DECIMAL) {
+            key += ',' + std::to_string(lt.precision()) + ',' + std::to_string(lt.scale());
+        }
+        const string &doc = n->getDoc();
+        addString(key, doc);
+        if (n->hasName()) {
+            addString(key, n->name().fullname());
+        }
+
+        size_t depth = stack_.size();
+        NodePtr result;
+        if (t == AVRO_RECORD) {
+            result = NodePtr(new NodeRecord());
+            stack_.emplace_back(n.get(), result);
+        }
+
+        size_t minRef = none;
+        concepts::MultiAttribute<NodePtr> leaves;
+        for (size_t i = (t == AVRO_MAP) ? 1 : 0; i < n->leaves(); ++i) {
+            Built c = build(n->leafAt(i));
+            key += '(';
+            key += c.key;
+            key += ')';
+            minRef = std::min(minRef, c.minRef);
+            leaves.add(c.node);
+        }
+        concepts::MultiAttribute<string> names;
+        for (size_t i = 0; i < n->names(); ++i) {
+            addString(key, n->nameAt(i));
+            names.add(n->nameAt(i));
+        }
+
+        switch (t) {
+            case AVRO_RECORD: {
+                vector<GenericDatum> defaultValues;
+                vector<SortOrder> fieldOrders;
+                for (size_t i = 0; i < n->leaves(); ++i) {
+                    fieldOrders.push_back(n->fieldOrderAt(i));
+                    key += static_cast<char>('0' + fieldOrders.back());
+                    const GenericDatum &d = n->defaultValueAt(i);
+                    if (d.isUnion() || d.type() != AVRO_NULL) {
+                        string bytes = encodeDatum(d);
+                        addString(key, bytes);
+                        defaultValues.push_back(decodeDatum(leaves.get(i), bytes));
+                    } else {
+                        key += '-';
+                        defaultValues.emplace_back();
+                    }
+                }
+                std::unique_ptr<NodeRecord> r(doc.empty()
+                                                  ? new NodeRecord(asSingleAttribute(n->name()), leaves,
+                                                                   names, defaultValues)
+                                                  : new NodeRecord(asSingleAttribute(n->name()), asSingleAttribute(doc),
+                                                                   leaves, names, defaultValues));
+                r->setFieldOrders(std::move(fieldOrders));
+                std::static_pointer_cast<NodeRecord>(result)->swap(*r);
+                stack_.pop_back();
+                if (minRef != none && minRef >= depth) {
+                    minRef = none;
+                }
+                break;
+            }
+            case AVRO_ENUM:
+                result = NodePtr(new NodeEnum(asSingleAttribute(n->name()), names));
+                break;
+            case AVRO_FIXED:
+                key += ',' + std::to_string(n->fixedSize());
+                result = NodePtr(new NodeFixed(asSingleAttribute(n->name()),
+                                               asSingleAttribute(static_cast<int>(n->fixedSize()))));
+                break;
+            case AVRO_ARRAY:
+                result = NodePtr(new NodeArray(asSingleAttribute(leaves.get(0))));
+                break;
+            case AVRO_MAP:
+                result = NodePtr(new NodeMap(asSingleAttribute(leaves.get(0))));
+                break;
+            case AVRO_UNION:
+                result = NodePtr(new NodeUnion(leaves));
+                break;
+            default:
+                result = doc.empty() && lt.type() == LogicalType::NONE
+                    ? primitiveNode(t)
+                    : NodePtr(new NodePrimitive(t));
+                break;
+        }
+        if (t != AVRO_RECORD && !doc.empty()) {
+            result->setDoc(doc);
+        }
+        if (!result->locked()) {
+            result->setLogicalType(lt);
+        }
+
+        Built b{result, string(), minRef};
+        if (minRef == none) {
+            Digest digest = sha256Fingerprint(reinterpret_cast<const uint8_t *>(key.data()), key.size());
+            auto it = pool_.emplace(digest, result).first;
+            b.node = it->second;
+            settle(n, b.node);
+            b.key = pointerKey('p', b.node);
+        } else {
+            open_.insert(n.get());
+            if (n->hasName()) {
+                done_[n.get()] = Done{result, minRef};
+            }
+            b.key = std::move(key);
+        }
+        return b;
+    }
+};
+
+} // namespace
+
+SchemaPool::SchemaPool() : impl_(new Impl()) {}
+
+SchemaPool::~SchemaPool() = default;
+
+ValidSchema SchemaPool::intern(const ValidSchema &schema) {
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    return ValidSchema(Interner(impl_->nodes).build(schema.root()).node);
+}
+
+size_t SchemaPool::size() const {
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    return impl_->nodes.size();
+}
+
+void SchemaPool::clear() {
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    impl_->nodes.clear();
+}
+
+} // namespace avro
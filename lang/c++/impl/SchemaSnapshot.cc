@@ -0,0 +1,277 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SchemaSnapshot.hh"
+#include "Decoder.hh"
+#include "Encoder.hh"
+#include "Exception.hh"
+#include "Generic.hh"
+#include "NodeImpl.hh"
+#include "Stream.hh"
+
+#include <cstring>
+#include <map>
+
+namespace avro {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+// "Avs" and the version of the format.
+const uint8_t magic[] = {'A', 'v', 's', 1};
+
+template<typename T>
+concepts::SingleAttribute<T> asSingleAttribute(const T &t) {
+    concepts::SingleAttribute<T> n;
+    n.add(t);
+    return n;
+}
+
+class SnapshotWriter {
+    Encoder &e_;
+    // The named nodes written so far, numbered in the order they appear.
+    std::map<const Node *, int64_t> named_;
+
+public:
+    explicit SnapshotWriter(Encoder &e) : e_(e) {}
+
+    void write(const NodePtr &n) {
+        if (n->type() == AVRO_SYMBOLIC) {
+            NodePtr target = std::static_pointer_cast<NodeSymbolic>(n)->getNode();
+            auto it = named_.find(target.get());
+            if (it != named_.end()) {
+                e_.encodeInt(AVRO_SYMBOLIC);
+                e_.encodeLong(it->second);
+                e_.encodeString(n->getDoc());
+                return;
+            }
+            // The reference came first; define the node here instead.
+            write(target);
+            return;
+        }
+
+        e_.encodeInt(n->type());
+        LogicalType lt = n->logicalType();
+        e_.encodeInt(lt.type());
+        if (lt.type() == LogicalType::DECIMAL) {
+            e_.encodeInt(lt.precision());
+            e_.encodeInt(lt.scale());
+        }
+        e_.encodeString(n->getDoc());
+        if (n->hasName()) {
+            e_.encodeString(n->name().ns());
+            e_.encodeString(n->name().simpleName());
+            int64_t index = static_cast<int64_t>(named_.size());
+            named_[n.get()] = index;
+        }
+
+        switch (n->type()) {
+            case AVRO_RECORD:
+                e_.encodeLong(n->leaves());
+                for (size_t i = 0; i < n->leaves(); ++i) {
+                    e_.encodeString(n->nameAt(i));
+                    write(n->leafAt(i));
+                    const GenericDatum &d = n->defaultValueAt(i);
+                    bool hasDefault = d.isUnion() || d.type() != AVRO_NULL;
+                    e_.encodeBool(hasDefault);
+                    if (hasDefault) {
+                        GenericWriter::write(e_, d);
+                    }
+                }
+                break;
+            case AVRO_ENUM:
+                e_.encodeLong(n->names());
+                for (size_t i = 0; i < n->names(); ++i) {
+                    e_.encodeString(n->nameAt(i));
+                }
+                break;
+            case AVRO_FIXED:
+                e_.encodeLong(n->fixedSize());
+                break;
+            case AVRO_ARRAY:
+                write(n->leafAt(0));
+                break;
+            case AVRO_MAP:
+                write(n->leafAt(1));
+                break;
+            case AVRO_UNION:
+                e_.encodeLong(n->leaves());
+                for (size_t i = 0; i < n->leaves(); ++i) {
+                    write(n->leafAt(i));
+                }
+                break;
+            default:
+                break;
+        }
+    }
+};
+
+class SnapshotReader {
+    Decoder &d_;
+    // A record is placed here before its fields, whose references to it
+    // cannot take the name from the still empty node.
+    vector<std::pair<Name, NodePtr>> named_;
+
+    size_t count() {
+        int64_t n = d_.decodeLong();
+        if (n < 0) {
+            throw Exception(boost::format("Invalid count in schema snapshot: %1%") % n);
+        }
+        return static_cast<size_t>(n);
+    }
+
+    Name name() {
+        string ns = d_.decodeString();
+        return Name(d_.decodeString(), ns);
+    }
+
+public:
+    explicit SnapshotReader(Decoder &d) : d_(d) {}
+
+    NodePtr read() {
+        int32_t t = d_.decodeInt();
+        if (t == AVRO_SYMBOLIC) {
+            int64_t index = d_.decodeLong();
+            if (index < 0 || index >= static_cast<int64_t>(named_.size())) {
+                throw Exception(boost::format("Invalid reference in schema snapshot: %1%") % index);
+            }
+            const auto &target = named_[index];
+            NodePtr result(new NodeSymbolic(asSingleAttribute(target.first), target.second));
+            string doc = d_.decodeString();
+            if (!doc.empty()) {
+                result->setDoc(doc);
+            }
+            return result;
+        }
+        if (t < AVRO_STRING || t >= AVRO_NUM_TYPES) {
+            throw Exception(boost::format("Invalid type in schema snapshot: %1%") % t);
+        }
+
+        int32_t lt = d_.decodeInt();
+        if (lt < LogicalType::NONE || lt > LogicalType::UUID) {
+            throw Exception(boost::format("Invalid logical type in schema snapshot: %1%") % lt);
+        }
+        LogicalType logicalType(static_cast<LogicalType::Type>(lt));
+        if (lt == LogicalType::DECIMAL) {
+            logicalType.setPrecision(d_.decodeInt());
+            logicalType.setScale(d_.decodeInt());
+        }
+        string doc = d_.decodeString();
+
+        NodePtr result;
+        switch (static_cast<Type>(t)) {
+            case AVRO_RECORD: {
+                Name nm = name();
+                result = NodePtr(new NodeRecord());
+                named_.emplace_back(nm, result);
+                concepts::MultiAttribute<string> fieldNames;
+                concepts::MultiAttribute<NodePtr> fieldValues;
+                vector<GenericDatum> defaultValues;
+                for (size_t i = count(); i != 0; --i) {
+                    fieldNames.add(d_.decodeString());
+                    NodePtr field = read();
+                    fieldValues.add(field);
+                    if (d_.decodeBool()) {
+                        GenericDatum d(field);
+                        GenericReader::read(d_, d);
+                        defaultValues.push_back(d);
+                    } else {
+                        defaultValues.emplace_back();
+                    }
+                }
+                std::unique_ptr<NodeRecord> r(doc.empty()
+                                                  ? new NodeRecord(asSingleAttribute(nm), fieldValues,
+                                                                   fieldNames, defaultValues)
+                                                  : new NodeRecord(asSingleAttribute(nm), asSingleAttribute(doc),
+                                                                   fieldValues, fieldNames, defaultValues));
+                std::static_pointer_cast<NodeRecord>(result)->swap(*r);
+                doc.clear();
+                break;
+            }
+            case AVRO_ENUM: {
+                Name nm = name();
+                concepts::MultiAttribute<string> symbols;
+                for (size_t i = count(); i != 0; --i) {
+                    symbols.add(d_.decodeString());
+                }
+                result = NodePtr(new NodeEnum(asSingleAttribute(nm), symbols));
+                named_.emplace_back(nm, result);
+                break;
+            }
+            case AVRO_FIXED: {
+                Name nm = name();
+                int size = static_cast<int>(count());
+                result = NodePtr(new NodeFixed(asSingleAttribute(nm), asSingleAttribute(size)));
+                named_.emplace_back(nm, result);
+                break;
+            }
+            case AVRO_ARRAY:
+                result = NodePtr(new NodeArray(asSingleAttribute(read())));
+                break;
+            case AVRO_MAP:
+                result = NodePtr(new NodeMap(asSingleAttribute(read())));
+                break;
+            case AVRO_UNION: {
+                concepts::MultiAttribute<NodePtr> branches;
+                for (size_t i = count(); i != 0; --i) {
+                    branches.add(read());
+                }
+                result = NodePtr(new NodeUnion(branches));
+                break;
+            }
+            default:
+                result = doc.empty() && logicalType.type() == LogicalType::NONE
+                    ? primitiveNode(static_cast<Type>(t))
+                    : NodePtr(new NodePrimitive(static_cast<Type>(t)));
+                break;
+        }
+        if (!doc.empty()) {
+            result->setDoc(doc);
+        }
+        if (!result->locked()) {
+            result->setLogicalType(logicalType);
+        }
+        return result;
+    }
+};
+
+} // namespace
+
+vector<uint8_t> snapshotSchema(const ValidSchema &schema) {
+    std::unique_ptr<OutputStream> out = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*out);
+    e->encodeFixed(magic, sizeof(magic));
+    SnapshotWriter(*e).write(schema.root());
+    e->flush();
+    return *snapshot(*out);
+}
+
+ValidSchema loadSchemaSnapshot(const uint8_t *data, size_t len) {
+    if (len < sizeof(magic) || memcmp(data, magic, sizeof(magic)) != 0) {
+        throw Exception("Not an Avro schema snapshot");
+    }
+    std::unique_ptr<InputStream> in = memoryInputStream(data + sizeof(magic), len - sizeof(magic));
+    DecoderPtr d = binaryDecoder();
+    d->init(*in);
+    return ValidSchema(SnapshotReader(*d).read());
+}
+
+} // namespace avro
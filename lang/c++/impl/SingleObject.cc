@@ -0,0 +1,256 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SingleObject.hh"
+
+#include <algorithm>
+#include <boost/format.hpp>
+#include <limits>
+
+namespace avro {
+
+namespace {
+
+void writeFingerprint(uint8_t *header, uint8_t marker, uint64_t fp) {
+    header[0] = 0xC3;
+    header[1] = marker;
+    for (size_t i = 0; i < 8; ++i) {
+        header[2 + i] = static_cast<uint8_t>(fp >> (8 * i));
+    }
+}
+
+uint64_t readFingerprint(const uint8_t *header) {
+    uint64_t fp = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        fp |= static_cast<uint64_t>(header[2 + i]) << (8 * i);
+    }
+    return fp;
+}
+
+void writeUint32(uint8_t *p, uint32_t n) {
+    for (size_t i = 0; i < 4; ++i) {
+        p[i] = static_cast<uint8_t>(n >> (8 * i));
+    }
+}
+
+uint32_t readUint32(const uint8_t *p) {
+    uint32_t n = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        n |= static_cast<uint32_t>(p[i]) << (8 * i);
+    }
+    return n;
+}
+
+// A decoder of data written with the schema of fingerprint fp into the
+// reader's schema.
+DecoderPtr makeDecoder(uint64_t fp, const ValidSchema &readerSchema,
+                       const SchemaStorePtr &store) {
+    if (fp == readerSchema.rabinFingerprint()) {
+        return binaryDecoder();
+    }
+    ValidSchema writer;
+    if (!store || !store->find(fp, writer)) {
+        throw Exception(boost::format("Unknown schema fingerprint: %1$016x") % fp);
+    }
+    return compiledResolvingDecoder(writer, readerSchema, binaryDecoder());
+}
+
+} // namespace
+
+void MemorySchemaStore::add(const ValidSchema &schema) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    schemas_[schema.rabinFingerprint()] = schema;
+}
+
+bool MemorySchemaStore::find(uint64_t fingerprint, ValidSchema &schema) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<uint64_t, ValidSchema>::const_iterator it = schemas_.find(fingerprint);
+    if (it == schemas_.end()) {
+        return false;
+    }
+    schema = it->second;
+    return true;
+}
+
+SingleObjectEncoder::SingleObjectEncoder(const ValidSchema &schema) : schema_(schema),
+                                                                      encoder_(binaryEncoder()) {
+    writeFingerprint(header_, 0x01, schema_.rabinFingerprint());
+}
+
+SingleObjectDecoder::SingleObjectDecoder(const ValidSchema &readerSchema,
+                                         const SchemaStorePtr &store) : readerSchema_(readerSchema),
+                                                                        store_(store) {
+}
+
+uint64_t SingleObjectDecoder::fingerprint(const uint8_t *data, size_t len) {
+    if (len < singleObjectHeaderSize || data[0] != 0xC3 || data[1] != 0x01) {
+        throw Exception("Not a single-object encoded message");
+    }
+    return readFingerprint(data);
+}
+
+Decoder &SingleObjectDecoder::start(const uint8_t *data, size_t len) {
+    uint64_t fp = fingerprint(data, len);
+    std::unordered_map<uint64_t, Reader>::iterator it = readers_.find(fp);
+    if (it == readers_.end()) {
+        Reader r;
+        r.decoder = makeDecoder(fp, readerSchema_, store_);
+        it = readers_.insert(std::make_pair(fp, std::move(r))).first;
+    }
+
+    Reader &r = it->second;
+    std::unique_ptr<InputStream> in = memoryInputStream(data + singleObjectHeaderSize,
+                                                        len - singleObjectHeaderSize);
+    r.decoder->init(*in);
+    r.in = std::move(in);
+    return *r.decoder;
+}
+
+BatchEncoder::BatchEncoder(const ValidSchema &schema, bool offsets) : schema_(schema),
+                                                                      offsets_(offsets),
+                                                                      values_(memoryOutputStream()),
+                                                                      encoder_(binaryEncoder()),
+                                                                      count_(0) {
+    writeFingerprint(header_, 0x02, schema_.rabinFingerprint());
+    encoder_->init(*values_);
+}
+
+void BatchEncoder::endValue() {
+    ++count_;
+    if (offsets_) {
+        // The count is only exact once the encoder has given back the
+        // rest of its chunk.
+        encoder_->flush();
+        int64_t end = encoder_->byteCount();
+        if (end > std::numeric_limits<uint32_t>::max()) {
+            throw Exception("Batch with offsets is larger than 4 GiB");
+        }
+        ends_.push_back(static_cast<uint32_t>(end));
+    }
+}
+
+void BatchEncoder::write(OutputStream &os) {
+    encoder_->flush();
+    if (count_ > std::numeric_limits<uint32_t>::max()) {
+        throw Exception("Batch has too many values");
+    }
+    std::vector<uint8_t> head(batchHeaderSize + 4 * ends_.size());
+    std::copy(header_, header_ + singleObjectHeaderSize, head.begin());
+    writeUint32(&head[singleObjectHeaderSize], static_cast<uint32_t>(count_));
+    head[singleObjectHeaderSize + 4] = offsets_ ? 1 : 0;
+    for (size_t i = 0; i < ends_.size(); ++i) {
+        writeUint32(&head[batchHeaderSize + 4 * i], ends_[i]);
+    }
+
+    std::vector<OutputChunk> chunks;
+    chunks.push_back(OutputChunk{head.data(), head.size()});
+    std::unique_ptr<InputStream> in = memoryInputStream(*values_);
+    const uint8_t *data;
+    size_t len;
+    while (in->next(&data, &len)) {
+        chunks.push_back(OutputChunk{data, len});
+    }
+    os.writeChunks(chunks.data(), chunks.size());
+    clear();
+}
+
+std::shared_ptr<std::vector<uint8_t>> BatchEncoder::finish() {
+    OutputStreamPtr os = memoryOutputStream();
+    write(*os);
+    return snapshot(*os);
+}
+
+void BatchEncoder::clear() {
+    resetMemoryOutputStream(*values_);
+    encoder_->init(*values_);
+    ends_.clear();
+    count_ = 0;
+}
+
+BatchDecoder::BatchDecoder(const ValidSchema &readerSchema,
+                           const SchemaStorePtr &store) : readerSchema_(readerSchema),
+                                                          store_(store),
+                                                          decoder_(nullptr),
+                                                          fingerprint_(0),
+                                                          count_(0),
+                                                          ends_(nullptr),
+                                                          values_(nullptr),
+                                                          valuesLen_(0),
+                                                          next_(0) {
+}
+
+void BatchDecoder::reset(const uint8_t *data, size_t len) {
+    count_ = 0;
+    if (len < batchHeaderSize || data[0] != 0xC3 || data[1] != 0x02) {
+        throw Exception("Not a batch");
+    }
+    uint64_t fp = readFingerprint(data);
+    size_t count = readUint32(data + singleObjectHeaderSize);
+    bool offsets = (data[singleObjectHeaderSize + 4] & 1) != 0;
+    size_t headLen = batchHeaderSize + (offsets ? 4 * count : 0);
+    if (len < headLen) {
+        throw Exception("Batch ends within its offsets");
+    }
+
+    std::unordered_map<uint64_t, DecoderPtr>::iterator it = decoders_.find(fp);
+    if (it == decoders_.end()) {
+        it = decoders_.insert(std::make_pair(fp, makeDecoder(fp, readerSchema_, store_))).first;
+    }
+    decoder_ = it->second.get();
+    fingerprint_ = fp;
+    ends_ = offsets ? data + batchHeaderSize : nullptr;
+    values_ = data + headLen;
+    valuesLen_ = len - headLen;
+    count_ = count;
+    next_ = 0;
+    if (!offsets) {
+        in_ = memoryInputStream(values_, valuesLen_);
+        decoder_->init(*in_);
+    }
+}
+
+Decoder &BatchDecoder::seek(size_t i) {
+    if (ends_ == nullptr) {
+        throw Exception("Batch has no offsets");
+    }
+    if (i >= count_) {
+        throw Exception(boost::format("Value %1% is beyond the %2% of the batch") % i % count_);
+    }
+    size_t begin = i == 0 ? 0 : readUint32(ends_ + 4 * (i - 1));
+    size_t end = readUint32(ends_ + 4 * i);
+    if (begin > end || end > valuesLen_) {
+        throw Exception(boost::format("Invalid offsets of value %1% of the batch") % i);
+    }
+    in_ = memoryInputStream(values_ + begin, end - begin);
+    decoder_->init(*in_);
+    next_ = i + 1;
+    return *decoder_;
+}
+
+Decoder &BatchDecoder::advance() {
+    if (next_ >= count_) {
+        throw Exception("No more values in the batch");
+    }
+    if (ends_ != nullptr) {
+        return seek(next_);
+    }
+    ++next_;
+    return *decoder_;
+}
+
+} // namespace avro
@@ -0,0 +1,352 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Stream.hh"
+
+#ifndef _WIN32
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include "poll.h"
+#include "sys/socket.h"
+#include "sys/uio.h"
+#include "unistd.h"
+
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#define AVRO_HAVE_MSG_ZEROCOPY
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+using std::unique_ptr;
+
+namespace avro {
+namespace {
+
+// The most iovecs handed to the system in one call; IOV_MAX is at
+// least this much everywhere.
+const size_t maxIov = 1024;
+
+// Waits for a non-blocking socket to become ready.
+void waitFor(int fd, short events) {
+    struct pollfd p;
+    p.fd = fd;
+    p.events = events;
+    p.revents = 0;
+    if (::poll(&p, 1, -1) < 0 && errno != EINTR) {
+        throw Exception(boost::format("Cannot poll socket: %1%") % ::strerror(errno));
+    }
+}
+
+class SocketOutputStream : public OutputStream {
+    const int fd_;
+    const size_t chunkSize_;
+    std::vector<unique_ptr<uint8_t[]>> chunks_;
+    // Chunks before cur_ are full; used_ bytes of cur_ are handed out.
+    size_t cur_;
+    size_t used_;
+    uint64_t byteCount_;
+    bool zeroCopy_;
+    const size_t zeroCopyThreshold_;
+    // The zero-copy sends made and those the kernel is done with.
+    uint32_t zeroCopySent_;
+    uint32_t zeroCopyDone_;
+
+    void buffered(std::vector<struct iovec> &iov) {
+        for (size_t i = 0; i <= cur_; ++i) {
+            size_t n = i < cur_ ? chunkSize_ : used_;
+            if (n > 0) {
+                struct iovec v;
+                v.iov_base = chunks_[i].get();
+                v.iov_len = n;
+                iov.push_back(v);
+            }
+        }
+        cur_ = 0;
+        used_ = 0;
+    }
+
+    void send(std::vector<struct iovec> &iov) {
+        size_t total = 0;
+        for (const struct iovec &v : iov) {
+            total += v.iov_len;
+        }
+        bool zeroCopy = zeroCopy_ && total >= zeroCopyThreshold_;
+        size_t first = 0;
+        while (first < iov.size()) {
+            struct msghdr msg;
+            ::memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov[first];
+            msg.msg_iovlen = std::min(iov.size() - first, maxIov);
+            int flags = MSG_NOSIGNAL;
+#ifdef AVRO_HAVE_MSG_ZEROCOPY
+            if (zeroCopy) {
+                flags |= MSG_ZEROCOPY;
+            }
+#endif
+            ssize_t w = ::sendmsg(fd_, &msg, flags);
+            if (w < 0) {
+                if (errno == EINTR) {
+                    continue;
+                } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    waitFor(fd_, POLLOUT);
+                    continue;
+                } else if (errno == ENOBUFS && zeroCopy) {
+                    // Out of locked memory for pinning pages.
+                    zeroCopy = false;
+                    continue;
+                }
+                throw Exception(boost::format("Cannot send to socket: %1%") % ::strerror(errno));
+            }
+            if (zeroCopy) {
+                ++zeroCopySent_;
+            }
+            size_t done = static_cast<size_t>(w);
+            for (; first < iov.size() && done >= iov[first].iov_len; ++first) {
+                done -= iov[first].iov_len;
+            }
+            if (first < iov.size()) {
+                iov[first].iov_base = static_cast<uint8_t *>(iov[first].iov_base) + done;
+                iov[first].iov_len -= done;
+            }
+        }
+        reap();
+    }
+
+    // Waits until the kernel no longer reads from the memory of any
+    // zero-copy send, so that it can be reused or handed back.
+    void reap() {
+#ifdef AVRO_HAVE_MSG_ZEROCOPY
+        while (zeroCopyDone_ != zeroCopySent_) {
+            char control[128];
+            struct msghdr msg;
+            ::memset(&msg, 0, sizeof(msg));
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            if (::recvmsg(fd_, &msg, MSG_ERRQUEUE) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    // POLLERR is reported once the error queue has an entry.
+                    waitFor(fd_, 0);
+                    continue;
+                }
+                throw Exception(boost::format("Cannot read socket error queue: %1%") % ::strerror(errno));
+            }
+            for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+                if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                      || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+                    continue;
+                }
+                const struct sock_extended_err *e = reinterpret_cast<const struct sock_extended_err *>(CMSG_DATA(cm));
+                if (e->ee_errno == 0 && e->ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                    // ee_info to ee_data is the range of sends completed.
+                    zeroCopyDone_ += e->ee_data - e->ee_info + 1;
+                }
+            }
+        }
+#endif
+    }
+
+    bool next(uint8_t **data, size_t *len) override {
+        if (used_ == chunkSize_) {
+            if (cur_ + 1 == chunks_.size()) {
+                flush();
+            } else {
+                ++cur_;
+                used_ = 0;
+            }
+        }
+        *data = chunks_[cur_].get() + used_;
+        *len = chunkSize_ - used_;
+        byteCount_ += *len;
+        used_ = chunkSize_;
+        return true;
+    }
+
+    void backup(size_t len) override {
+        used_ -= len;
+        byteCount_ -= len;
+    }
+
+    uint64_t byteCount() const override {
+        return byteCount_;
+    }
+
+    void flush() override {
+        std::vector<struct iovec> iov;
+        buffered(iov);
+        send(iov);
+    }
+
+    void writeChunks(const OutputChunk *chunks, size_t count) override {
+        size_t total = 0;
+        for (size_t i = 0; i < count; ++i) {
+            total += chunks[i].len;
+        }
+        if (total <= chunkSize_ - used_) {
+            OutputStream::writeChunks(chunks, count);
+            return;
+        }
+        std::vector<struct iovec> iov;
+        iov.reserve(cur_ + 1 + count);
+        buffered(iov);
+        for (size_t i = 0; i < count; ++i) {
+            if (chunks[i].len > 0) {
+                struct iovec v;
+                v.iov_base = const_cast<uint8_t *>(chunks[i].data);
+                v.iov_len = chunks[i].len;
+                iov.push_back(v);
+            }
+        }
+        send(iov);
+        byteCount_ += total;
+    }
+
+public:
+    SocketOutputStream(int fd, const SocketOptions &options) : fd_(fd),
+                                                               chunkSize_(options.chunkSize),
+                                                               cur_(0), used_(0), byteCount_(0),
+                                                               zeroCopy_(false),
+                                                               zeroCopyThreshold_(options.zeroCopyThreshold),
+                                                               zeroCopySent_(0), zeroCopyDone_(0) {
+        if (options.chunkSize == 0 || options.chunkCount == 0) {
+            throw Exception("Socket stream needs at least one non-empty chunk");
+        }
+        for (size_t i = 0; i < options.chunkCount; ++i) {
+            chunks_.emplace_back(new uint8_t[chunkSize_]);
+        }
+#ifdef AVRO_HAVE_MSG_ZEROCOPY
+        if (options.zeroCopy) {
+            // Fails on kernels and socket types without zero-copy
+            // support, which then get ordinary sends.
+            int one = 1;
+            zeroCopy_ = ::setsockopt(fd_, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+        }
+#endif
+    }
+};
+
+class SocketInputStream : public InputStream {
+    const int fd_;
+    const size_t chunkSize_;
+    std::vector<unique_ptr<uint8_t[]>> chunks_;
+    // The bytes read into each of the first filled_ chunks.
+    std::vector<size_t> lens_;
+    size_t filled_;
+    size_t cur_;
+    size_t pos_;
+    size_t byteCount_;
+
+    bool fill() {
+        std::vector<struct iovec> iov(chunks_.size());
+        for (size_t i = 0; i < chunks_.size(); ++i) {
+            iov[i].iov_base = chunks_[i].get();
+            iov[i].iov_len = chunkSize_;
+        }
+        ssize_t n;
+        for (;;) {
+            n = ::readv(fd_, iov.data(), static_cast<int>(std::min(iov.size(), maxIov)));
+            if (n >= 0) {
+                break;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                waitFor(fd_, POLLIN);
+            } else if (errno != EINTR) {
+                throw Exception(boost::format("Cannot read from socket: %1%") % ::strerror(errno));
+            }
+        }
+        size_t left = static_cast<size_t>(n);
+        filled_ = 0;
+        while (left > 0) {
+            lens_[filled_] = std::min(left, chunkSize_);
+            left -= lens_[filled_++];
+        }
+        cur_ = 0;
+        pos_ = 0;
+        return n > 0;
+    }
+
+    bool next(const uint8_t **data, size_t *len) override {
+        while (cur_ < filled_ && pos_ == lens_[cur_]) {
+            ++cur_;
+            pos_ = 0;
+        }
+        if (cur_ == filled_ && !fill()) {
+            return false;
+        }
+        *data = chunks_[cur_].get() + pos_;
+        *len = lens_[cur_] - pos_;
+        pos_ = lens_[cur_];
+        byteCount_ += *len;
+        return true;
+    }
+
+    void backup(size_t len) override {
+        pos_ -= len;
+        byteCount_ -= len;
+    }
+
+    void skip(size_t len) override {
+        const uint8_t *data;
+        size_t n;
+        while (len > 0 && next(&data, &n)) {
+            if (n > len) {
+                backup(n - len);
+                n = len;
+            }
+            len -= n;
+        }
+    }
+
+    size_t byteCount() const override {
+        return byteCount_;
+    }
+
+public:
+    SocketInputStream(int fd, const SocketOptions &options) : fd_(fd),
+                                                              chunkSize_(options.chunkSize),
+                                                              lens_(options.chunkCount),
+                                                              filled_(0), cur_(0), pos_(0), byteCount_(0) {
+        if (options.chunkSize == 0 || options.chunkCount == 0) {
+            throw Exception("Socket stream needs at least one non-empty chunk");
+        }
+        for (size_t i = 0; i < options.chunkCount; ++i) {
+            chunks_.emplace_back(new uint8_t[chunkSize_]);
+        }
+    }
+};
+
+} // namespace
+
+unique_ptr<OutputStream> socketOutputStream(int fd, const SocketOptions &options) {
+    return unique_ptr<OutputStream>(new SocketOutputStream(fd, options));
+}
+
+unique_ptr<InputStream> socketInputStream(int fd, const SocketOptions &options) {
+    return unique_ptr<InputStream>(new SocketInputStream(fd, options));
+}
+
+} // namespace avro
+
+#endif
@@ -17,28 +17,44 @@
  */
 
 #include "Stream.hh"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <utility>
 #include <vector>
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#else
+#include <malloc.h>
+#endif
+
 namespace avro {
 
 using std::vector;
 
 class MemoryInputStream : public InputStream {
     const std::vector<uint8_t *> &data_;
-    const size_t chunkSize_;
+    const std::vector<size_t> &chunkSizes_;
     const size_t size_;
     const size_t available_;
     size_t cur_;
     size_t curLen_;
+    size_t consumed_;
+
+    size_t chunkLen() const {
+        return (cur_ == (size_ - 1)) ? available_ : chunkSizes_[cur_];
+    }
 
     size_t maxLen() {
-        size_t n = (cur_ == (size_ - 1)) ? available_ : chunkSize_;
+        size_t n = chunkLen();
         if (n == curLen_) {
             if (cur_ == (size_ - 1)) {
                 return 0;
             }
+            consumed_ += chunkSizes_[cur_];
             ++cur_;
-            n = (cur_ == (size_ - 1)) ? available_ : chunkSize_;
+            n = chunkLen();
             curLen_ = 0;
         }
         return n;
@@ -46,8 +62,8 @@ class MemoryInputStream : public InputStream {
 
 public:
     MemoryInputStream(const std::vector<uint8_t *> &b,
-                      size_t chunkSize, size_t available) : data_(b), chunkSize_(chunkSize), size_(b.size()),
-                                                            available_(available), cur_(0), curLen_(0) {}
+                      const std::vector<size_t> &chunkSizes, size_t available) : data_(b), chunkSizes_(chunkSizes), size_(b.size()),
+                                                                                  available_(available), cur_(0), curLen_(0), consumed_(0) {}
 
     bool next(const uint8_t **data, size_t *len) override {
         if (size_t n = maxLen()) {
@@ -78,11 +94,11 @@ public:
     }
 
     size_t byteCount() const override {
-        return cur_ * chunkSize_ + curLen_;
+        return consumed_ + curLen_;
     }
 };
 
-class MemoryInputStream2 : public InputStream {
+class MemoryInputStream2 : public SeekableInputStream {
     const uint8_t *const data_;
     const size_t size_;
     size_t curLen_;
@@ -115,36 +131,139 @@ public:
     size_t byteCount() const override {
         return curLen_;
     }
+
+    void seek(int64_t position) override {
+        if (position < 0 || static_cast<size_t>(position) > size_) {
+            throw Exception("Cannot seek past the end of the data");
+        }
+        curLen_ = static_cast<size_t>(position);
+    }
 };
 
+namespace {
+
+const size_t hugePageSize = 2 * 1024 * 1024;
+
+size_t chunkAlignment(size_t size, bool hugePages) {
+    if (!hugePages) {
+        return defaultAlignment;
+    }
+    return size >= hugePageSize ? hugePageSize : 64;
+}
+
+uint8_t *allocateChunk(MemoryResource &resource, size_t size, bool hugePages) {
+    size_t alignment = chunkAlignment(size, hugePages);
+    void *p = resource.allocate(size, alignment);
+#ifdef MADV_HUGEPAGE
+    if (alignment == hugePageSize) {
+        ::madvise(p, size, MADV_HUGEPAGE);
+    }
+#endif
+    return static_cast<uint8_t *>(p);
+}
+
+void freeChunk(MemoryResource &resource, uint8_t *p, size_t size, bool hugePages) {
+    resource.deallocate(p, size, chunkAlignment(size, hugePages));
+}
+
+} // namespace
+
 class MemoryOutputStream : public OutputStream {
 public:
     const size_t chunkSize_;
+    const size_t maxChunkSize_;
+    const bool geometric_;
+    const bool hugePages_;
+    MemoryResource &resource_;
     std::vector<uint8_t *> data_;
+    std::vector<size_t> chunkSizes_;
+    // Chunks kept by reset() for the writes that follow, the next to use
+    // last.
+    std::vector<std::pair<uint8_t *, size_t>> spare_;
     size_t available_;
     size_t byteCount_;
 
-    explicit MemoryOutputStream(size_t chunkSize) : chunkSize_(chunkSize),
+    explicit MemoryOutputStream(size_t chunkSize) : chunkSize_(chunkSize), maxChunkSize_(chunkSize),
+                                                    geometric_(false), hugePages_(false),
+                                                    resource_(*defaultMemoryResource()),
                                                     available_(0), byteCount_(0) {}
+
+    explicit MemoryOutputStream(const StreamOptions &options)
+        : chunkSize_(options.chunkSize != 0 ? options.chunkSize : 4 * 1024),
+          maxChunkSize_(std::max(chunkSize_, options.maxChunkSize)),
+          geometric_(options.growth == StreamOptions::GEOMETRIC_CHUNKS),
+          hugePages_(options.hugePages),
+          resource_(options.memoryResource != nullptr ? *options.memoryResource : *defaultMemoryResource()),
+          available_(0), byteCount_(0) {}
+
     ~MemoryOutputStream() override {
-        for (std::vector<uint8_t *>::const_iterator it = data_.begin();
-             it != data_.end(); ++it) {
-            delete[] * it;
+        for (size_t i = 0; i < data_.size(); ++i) {
+            freeChunk(resource_, data_[i], chunkSizes_[i], hugePages_);
+        }
+        for (const auto &c : spare_) {
+            freeChunk(resource_, c.first, c.second, hugePages_);
         }
     }
 
+    void reset() {
+        spare_.reserve(spare_.size() + data_.size());
+        for (size_t i = data_.size(); i-- > 0;) {
+            spare_.emplace_back(data_[i], chunkSizes_[i]);
+        }
+        data_.clear();
+        chunkSizes_.clear();
+        available_ = 0;
+        byteCount_ = 0;
+    }
+
+    size_t nextChunkSize() const {
+        if (!geometric_ || chunkSizes_.empty()) {
+            return chunkSize_;
+        }
+        size_t last = chunkSizes_.back();
+        return last >= maxChunkSize_ / 2 ? maxChunkSize_ : 2 * last;
+    }
+
     bool next(uint8_t **data, size_t *len) override {
         if (available_ == 0) {
-            data_.push_back(new uint8_t[chunkSize_]);
-            available_ = chunkSize_;
+            data_.reserve(data_.size() + 1);
+            chunkSizes_.reserve(chunkSizes_.size() + 1);
+            if (spare_.empty()) {
+                size_t n = nextChunkSize();
+                data_.push_back(allocateChunk(resource_, n, hugePages_));
+                chunkSizes_.push_back(n);
+                AVRO_STREAM_COUNT(counters_, chunksAllocated, 1);
+            } else {
+                // The chunks come back in the order, and so with the
+                // sizes, they were first allocated in.
+                data_.push_back(spare_.back().first);
+                chunkSizes_.push_back(spare_.back().second);
+                spare_.pop_back();
+            }
+            available_ = chunkSizes_.back();
         }
-        *data = &data_.back()[chunkSize_ - available_];
+        *data = &data_.back()[chunkSizes_.back() - available_];
         *len = available_;
         byteCount_ += available_;
         available_ = 0;
         return true;
     }
 
+    bool rewrite(uint64_t position, const uint8_t *data, size_t len) override {
+        for (size_t i = 0; i < data_.size() && len > 0; ++i) {
+            if (position < chunkSizes_[i]) {
+                size_t n = std::min(len, static_cast<size_t>(chunkSizes_[i] - position));
+                ::memcpy(data_[i] + position, data, n);
+                data += n;
+                len -= n;
+                position = 0;
+            } else {
+                position -= chunkSizes_[i];
+            }
+        }
+        return true;
+    }
+
     void backup(size_t len) override {
         available_ += len;
         byteCount_ -= len;
@@ -157,10 +276,44 @@ public:
     void flush() override {}
 };
 
+void OutputStream::writeChunks(const OutputChunk *chunks, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t *p = chunks[i].data;
+        size_t len = chunks[i].len;
+        while (len > 0) {
+            uint8_t *d;
+            size_t n;
+            if (!next(&d, &n)) {
+                throw Exception("EOF reached");
+            }
+            size_t q = std::min(n, len);
+            ::memcpy(d, p, q);
+            AVRO_STREAM_COUNT(counters_, copiedBytes, q);
+            p += q;
+            len -= q;
+            if (q < n) {
+                backup(n - q);
+            }
+        }
+    }
+}
+
+bool OutputStream::rewrite(uint64_t, const uint8_t *, size_t) {
+    return false;
+}
+
+bool OutputStream::sync() {
+    return false;
+}
+
 std::unique_ptr<OutputStream> memoryOutputStream(size_t chunkSize) {
     return std::unique_ptr<OutputStream>(new MemoryOutputStream(chunkSize));
 }
 
+std::unique_ptr<OutputStream> memoryOutputStream(const StreamOptions &options) {
+    return std::unique_ptr<OutputStream>(new MemoryOutputStream(options));
+}
+
 std::unique_ptr<InputStream> memoryInputStream(const uint8_t *data, size_t len) {
     return std::unique_ptr<InputStream>(new MemoryInputStream2(data, len));
 }
@@ -168,7 +321,7 @@ std::unique_ptr<InputStream> memoryInputStream(const uint8_t *data, size_t len)
 std::unique_ptr<InputStream> memoryInputStream(const OutputStream &source) {
     const auto &mos =
         dynamic_cast<const MemoryOutputStream &>(source);
-    return (mos.data_.empty()) ? std::unique_ptr<InputStream>(new MemoryInputStream2(nullptr, 0)) : std::unique_ptr<InputStream>(new MemoryInputStream(mos.data_, mos.chunkSize_, (mos.chunkSize_ - mos.available_)));
+    return (mos.data_.empty()) ? std::unique_ptr<InputStream>(new MemoryInputStream2(nullptr, 0)) : std::unique_ptr<InputStream>(new MemoryInputStream(mos.data_, mos.chunkSizes_, (mos.chunkSizes_.back() - mos.available_)));
 }
 
 std::shared_ptr<std::vector<uint8_t>> snapshot(const OutputStream &source) {
@@ -179,11 +332,47 @@ std::shared_ptr<std::vector<uint8_t>> snapshot(const OutputStream &source) {
     result->reserve(mos.byteCount_);
     for (auto it = mos.data_.begin();
          it != mos.data_.end(); ++it) {
-        size_t n = std::min(c, mos.chunkSize_);
-        std::copy(*it, *it + n, std::back_inserter(*result));
+        size_t n = std::min(c, mos.chunkSizes_[it - mos.data_.begin()]);
+        result->insert(result->end(), *it, *it + n);
         c -= n;
     }
     return result;
 }
 
+void resetMemoryOutputStream(OutputStream &source) {
+    dynamic_cast<MemoryOutputStream &>(source).reset();
+}
+
+class SyncAsyncInputStream : public AsyncInputStream {
+    const SeekableInputStreamPtr in_;
+
+public:
+    explicit SyncAsyncInputStream(SeekableInputStreamPtr in) : in_(std::move(in)) {}
+
+    void read(int64_t offset, size_t len, ReadHandler handler) override {
+        std::vector<uint8_t> data;
+        try {
+            in_->seek(offset);
+            data.reserve(len);
+            const uint8_t *p;
+            size_t n;
+            while (data.size() < len && in_->next(&p, &n)) {
+                size_t q = std::min(n, len - data.size());
+                data.insert(data.end(), p, p + q);
+                if (q < n) {
+                    in_->backup(n - q);
+                }
+            }
+        } catch (...) {
+            handler(std::current_exception(), std::vector<uint8_t>());
+            return;
+        }
+        handler(nullptr, std::move(data));
+    }
+};
+
+AsyncInputStreamPtr asyncInputStream(SeekableInputStreamPtr in) {
+    return std::make_shared<SyncAsyncInputStream>(std::move(in));
+}
+
 } // namespace avro
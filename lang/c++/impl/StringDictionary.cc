@@ -0,0 +1,92 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "StringDictionary.hh"
+
+#include <cstring>
+
+namespace avro {
+
+namespace {
+
+// FNV-1a, as the name indexes of schema nodes use.
+uint64_t hashBytes(const char *data, size_t length) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; ++i) {
+        h = (h ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+    }
+    return h;
+}
+
+} // namespace
+
+StringDictionary::StringDictionary(size_t capacity) : capacity_(capacity), size_(0), hits_(0), misses_(0) {
+}
+
+StringDictionary::~StringDictionary() {
+    for (const Slot &s : slots_) {
+        if (s.value != nullptr) {
+            s.value->release();
+        }
+    }
+}
+
+void StringDictionary::insert(uint64_t hash, SharedString *value) {
+    const size_t mask = slots_.size() - 1;
+    size_t i = static_cast<size_t>(hash) & mask;
+    while (slots_[i].value != nullptr) {
+        i = (i + 1) & mask;
+    }
+    slots_[i].hash = hash;
+    slots_[i].value = value;
+}
+
+SharedString *StringDictionary::intern(const char *data, size_t length) {
+    const uint64_t hash = hashBytes(data, length);
+    if (!slots_.empty()) {
+        const size_t mask = slots_.size() - 1;
+        for (size_t i = static_cast<size_t>(hash) & mask; slots_[i].value != nullptr; i = (i + 1) & mask) {
+            const std::string &s = slots_[i].value->str();
+            if (slots_[i].hash == hash && s.size() == length && std::memcmp(s.data(), data, length) == 0) {
+                ++hits_;
+                return slots_[i].value;
+            }
+        }
+    }
+    ++misses_;
+    if (size_ == capacity_) {
+        return nullptr;
+    }
+    ++size_;
+    // Keep the table at most half full, growing it as values come.
+    if (2 * size_ > slots_.size()) {
+        std::vector<Slot> old;
+        old.swap(slots_);
+        slots_.assign(old.empty() ? 16 : 2 * old.size(), Slot{0, nullptr});
+        for (const Slot &s : old) {
+            if (s.value != nullptr) {
+                insert(s.hash, s.value);
+            }
+        }
+    }
+    SharedString *result = SharedString::make(data, length);
+    insert(hash, result);
+    return result;
+}
+
+} // namespace avro
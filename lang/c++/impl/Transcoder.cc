@@ -0,0 +1,555 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Transcoder.hh"
+#include "BinarySkip.hh"
+#include "Encoder.hh"
+#include "Exception.hh"
+#include "Generic.hh"
+#include "Stream.hh"
+#include "Zigzag.hh"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <map>
+#include <sstream>
+
+namespace avro {
+
+using std::map;
+using std::pair;
+using std::string;
+using std::vector;
+
+/**
+ * A writer/reader schema pair compiled into an array of steps; a step
+ * refers to those of its items, fields or branches by index, so that
+ * recursive schemas compile to finite programs. The writer's schemas are
+ * also compiled on their own, into skips, to step over the values that
+ * are copied or dropped.
+ */
+struct Transcoder::Program {
+    enum Op {
+        opCopy,        // Copies the value skipped by skips step leaves[0].
+        opPromote,     // From a number of type to one of type to.
+        opEnum,        // Renumbers the symbol.
+        opRecord,      // Runs fields.
+        opArray,       // Items are leaves[0].
+        opMap,         // Values are leaves[0].
+        opWriterUnion, // The step for each of the writer's branches.
+        opReaderUnion, // Writes branch, then leaves[0].
+        opError        // Throws error.
+    };
+
+    struct Field {
+        enum Kind {
+            copy,      // Skips with skips, then copies what was skipped.
+            drop,      // Skips with skips.
+            transcode, // Runs step.
+            constant   // Writes bytes, a default.
+        };
+        Kind kind;
+        size_t step;
+        vector<size_t> skips;
+        // The first of the reader's fields the output is for.
+        size_t field;
+        vector<uint8_t> bytes;
+    };
+
+    struct Step {
+        Op op;
+        // The writer's type.
+        Type type;
+        // The reader's type of promotions.
+        Type to;
+        // The size of fixeds, and the branch of reader's unions.
+        size_t size;
+        // Fields of records, branches of unions, the items of arrays and
+        // the values of maps.
+        vector<size_t> leaves;
+        // The reader's symbol for each of the writer's, -1 if it has none,
+        // and the writer's names of them.
+        vector<int64_t> symbols;
+        vector<string> names;
+        // The fields of records, in the writer's order, with the defaults
+        // interleaved if the reader's order is the same and after them if
+        // not.
+        vector<Field> fields;
+        bool ordered;
+        string error;
+    };
+
+    vector<Step> steps;
+    size_t entry;
+    SkipProgram skips;
+};
+
+namespace {
+
+typedef Transcoder::Program Program;
+
+NodePtr resolved(const NodePtr &n) {
+    return n->type() == AVRO_SYMBOLIC ? resolveSymbol(n) : n;
+}
+
+class TranscoderCompiler {
+    Program &p_;
+    map<pair<const Node *, const Node *>, size_t> records_;
+
+    size_t add(Program::Op op, Type type) {
+        size_t result = p_.steps.size();
+        p_.steps.emplace_back();
+        Program::Step &s = p_.steps.back();
+        s.op = op;
+        s.type = type;
+        s.to = type;
+        s.size = 0;
+        s.ordered = true;
+        return result;
+    }
+
+    bool isCopy(size_t s) const {
+        return p_.steps[s].op == Program::opCopy;
+    }
+
+    size_t skip(const NodePtr &node) {
+        return p_.skips.compile(node);
+    }
+
+    size_t copy(const NodePtr &w) {
+        size_t leaf = skip(w);
+        size_t result = add(Program::opCopy, w->type());
+        p_.steps[result].leaves.push_back(leaf);
+        return result;
+    }
+
+    size_t error(const NodePtr &w, const NodePtr &r) {
+        std::ostringstream oss;
+        oss << "Cannot resolve: " << std::endl;
+        w->printJson(oss, 0);
+        oss << std::endl
+            << "with" << std::endl;
+        r->printJson(oss, 0);
+        size_t result = add(Program::opError, w->type());
+        p_.steps[result].error = oss.str();
+        return result;
+    }
+
+    size_t promote(const NodePtr &w, Type to) {
+        size_t result = add(Program::opPromote, w->type());
+        p_.steps[result].to = to;
+        return result;
+    }
+
+    size_t enumeration(const NodePtr &w, const NodePtr &r) {
+        vector<int64_t> symbols;
+        vector<string> names;
+        bool same = true;
+        for (size_t i = 0; i < w->names(); ++i) {
+            size_t j;
+            if (r->nameIndex(w->nameAt(i), j)) {
+                symbols.push_back(static_cast<int64_t>(j));
+            } else {
+                symbols.push_back(-1);
+            }
+            same = same && symbols.back() == static_cast<int64_t>(i);
+            names.push_back(w->nameAt(i));
+        }
+        if (same) {
+            return copy(w);
+        }
+        size_t result = add(Program::opEnum, AVRO_ENUM);
+        p_.steps[result].symbols.swap(symbols);
+        p_.steps[result].names.swap(names);
+        return result;
+    }
+
+    size_t repeated(Program::Op op, const NodePtr &w, const NodePtr &r) {
+        size_t leaf = op == Program::opArray ? 0 : 1;
+        size_t item = compile(w->leafAt(leaf), r->leafAt(leaf));
+        if (isCopy(item)) {
+            return copy(w);
+        }
+        size_t result = add(op, w->type());
+        p_.steps[result].leaves.push_back(item);
+        return result;
+    }
+
+    // The branch of the reader's union r that a writer's value of the type
+    // of w resolves to, as a resolving decoder has it: the first of the
+    // same type and name, or else the first the value promotes to.
+    static int branch(const NodePtr &w, const NodePtr &r) {
+        int promoted = -1;
+        for (size_t j = 0; j < r->leaves(); ++j) {
+            NodePtr b = resolved(r->leafAt(j));
+            if (b->type() == w->type() && (!w->hasName() || b->name() == w->name())) {
+                return static_cast<int>(j);
+            }
+            if (promoted < 0) {
+                switch (b->type()) {
+                    case AVRO_DOUBLE:
+                        if (w->type() == AVRO_LONG || w->type() == AVRO_FLOAT) {
+                            promoted = static_cast<int>(j);
+                        }
+                        // Fall through.
+                    case AVRO_LONG:
+                    case AVRO_FLOAT:
+                        if (w->type() == AVRO_INT) {
+                            promoted = static_cast<int>(j);
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+        return promoted;
+    }
+
+    size_t writerUnion(const NodePtr &w, const NodePtr &r) {
+        vector<size_t> leaves;
+        // The writer's branches are copied if each resolves to the same
+        // branch of the reader's, and is copied itself.
+        bool same = r->type() == AVRO_UNION && r->leaves() >= w->leaves();
+        for (size_t i = 0; i < w->leaves(); ++i) {
+            size_t s = compile(w->leafAt(i), r);
+            const Program::Step &step = p_.steps[s];
+            same = same && step.op == Program::opReaderUnion && step.size == i && isCopy(step.leaves[0]);
+            leaves.push_back(s);
+        }
+        if (same) {
+            return copy(w);
+        }
+        size_t result = add(Program::opWriterUnion, AVRO_UNION);
+        p_.steps[result].leaves.swap(leaves);
+        return result;
+    }
+
+    static vector<uint8_t> encodedDefault(const GenericDatum &d) {
+        EncoderPtr e = binaryEncoder();
+        std::unique_ptr<OutputStream> os = memoryOutputStream();
+        e->init(*os);
+        GenericWriter::write(*e, d);
+        e->flush();
+        return *snapshot(*os);
+    }
+
+    size_t record(const NodePtr &w, const NodePtr &r) {
+        pair<const Node *, const Node *> key(w.get(), r.get());
+        map<pair<const Node *, const Node *>, size_t>::const_iterator it = records_.find(key);
+        if (it != records_.end()) {
+            return it->second;
+        }
+        size_t result = add(Program::opRecord, AVRO_RECORD);
+        records_[key] = result;
+
+        size_t rc = r->leaves();
+        vector<bool> seen(rc, false);
+        vector<Program::Field> fields;
+        bool ordered = true;
+        bool copied = true;
+        bool wanted = false;
+        size_t last = 0;
+        for (size_t i = 0; i < w->leaves(); ++i) {
+            size_t j;
+            if (!r->nameIndex(w->nameAt(i), j)) {
+                copied = false;
+                if (fields.empty() || fields.back().kind != Program::Field::drop) {
+                    Program::Field f = {Program::Field::drop, 0, vector<size_t>(), 0, vector<uint8_t>()};
+                    fields.push_back(f);
+                }
+                fields.back().skips.push_back(skip(w->leafAt(i)));
+                continue;
+            }
+            size_t s = compile(w->leafAt(i), r->leafAt(j));
+            bool follows = wanted && j == last + 1;
+            ordered = ordered && (!wanted || j > last);
+            seen[j] = true;
+            wanted = true;
+            last = j;
+            if (!isCopy(s)) {
+                copied = false;
+                Program::Field f = {Program::Field::transcode, s, vector<size_t>(), j, vector<uint8_t>()};
+                fields.push_back(f);
+            } else if (follows && fields.back().kind == Program::Field::copy) {
+                // Runs of fields the reader wants as they are, in the same
+                // order, are copied together.
+                fields.back().skips.push_back(p_.steps[s].leaves[0]);
+            } else {
+                Program::Field f = {Program::Field::copy, 0, vector<size_t>(1, p_.steps[s].leaves[0]), j, vector<uint8_t>()};
+                fields.push_back(f);
+            }
+        }
+        copied = copied && ordered && w->leaves() == rc;
+
+        vector<Program::Field> defaults;
+        for (size_t j = 0; j < rc; ++j) {
+            if (!seen[j]) {
+                Program::Field f = {Program::Field::constant, 0, vector<size_t>(), j, encodedDefault(r->defaultValueAt(j))};
+                defaults.push_back(f);
+            }
+        }
+        if (ordered) {
+            // Each default goes before the first field that comes after it.
+            vector<Program::Field> merged;
+            vector<Program::Field>::iterator d = defaults.begin();
+            for (size_t i = 0; i < fields.size(); ++i) {
+                for (; d != defaults.end() && fields[i].kind != Program::Field::drop && d->field < fields[i].field; ++d) {
+                    merged.push_back(*d);
+                }
+                merged.push_back(fields[i]);
+            }
+            merged.insert(merged.end(), d, defaults.end());
+            fields.swap(merged);
+        } else {
+            fields.insert(fields.end(), defaults.begin(), defaults.end());
+        }
+
+        if (copied) {
+            // Not recursive, or some field would not be a copy; nothing
+            // refers to the step yet.
+            size_t leaf = skip(w);
+            Program::Step &s = p_.steps[result];
+            s.op = Program::opCopy;
+            s.leaves.assign(1, leaf);
+        } else {
+            Program::Step &s = p_.steps[result];
+            s.fields.swap(fields);
+            s.ordered = ordered;
+        }
+        return result;
+    }
+
+public:
+    explicit TranscoderCompiler(Program &p) : p_(p) {}
+
+    size_t compile(const NodePtr &writer, const NodePtr &reader) {
+        NodePtr w = resolved(writer);
+        NodePtr r = resolved(reader);
+        Type wt = w->type();
+        Type rt = r->type();
+        if (wt == rt) {
+            switch (wt) {
+                case AVRO_FIXED:
+                    if (w->name() == r->name() && w->fixedSize() == r->fixedSize()) {
+                        return copy(w);
+                    }
+                    break;
+                case AVRO_ENUM:
+                    if (w->name() == r->name()) {
+                        return enumeration(w, r);
+                    }
+                    break;
+                case AVRO_RECORD:
+                    if (w->name() == r->name()) {
+                        return record(w, r);
+                    }
+                    break;
+                case AVRO_ARRAY:
+                    return repeated(Program::opArray, w, r);
+                case AVRO_MAP:
+                    return repeated(Program::opMap, w, r);
+                case AVRO_UNION:
+                    return writerUnion(w, r);
+                default:
+                    return copy(w);
+            }
+        } else if (wt == AVRO_UNION) {
+            return writerUnion(w, r);
+        } else {
+            switch (rt) {
+                case AVRO_LONG:
+                    if (wt == AVRO_INT) {
+                        // Ints and longs are encoded alike.
+                        return copy(w);
+                    }
+                    break;
+                case AVRO_FLOAT:
+                    if (wt == AVRO_INT || wt == AVRO_LONG) {
+                        return promote(w, rt);
+                    }
+                    break;
+                case AVRO_DOUBLE:
+                    if (wt == AVRO_INT || wt == AVRO_LONG || wt == AVRO_FLOAT) {
+                        return promote(w, rt);
+                    }
+                    break;
+                case AVRO_UNION: {
+                    int j = branch(w, r);
+                    if (j >= 0) {
+                        size_t leaf = compile(w, r->leafAt(j));
+                        size_t result = add(Program::opReaderUnion, wt);
+                        p_.steps[result].size = static_cast<size_t>(j);
+                        p_.steps[result].leaves.push_back(leaf);
+                        return result;
+                    }
+                } break;
+                default:
+                    break;
+            }
+        }
+        return error(w, r);
+    }
+};
+
+void writeLong(int64_t n, vector<uint8_t> &out) {
+    std::array<uint8_t, 10> buf;
+    size_t len = encodeInt64(n, buf);
+    out.insert(out.end(), buf.begin(), buf.begin() + len);
+}
+
+template<typename T>
+void writeFloating(T value, vector<uint8_t> &out) {
+    uint8_t buf[sizeof(T)];
+    std::memcpy(buf, &value, sizeof(T));
+    out.insert(out.end(), buf, buf + sizeof(T));
+}
+
+} // namespace
+
+void Transcoder::transcode(size_t s, BinaryCursor &c, vector<uint8_t> &out) {
+    const Program::Step &step = program_->steps[s];
+    switch (step.op) {
+        case Program::opCopy: {
+            const uint8_t *begin = c.p;
+            program_->skips.skip(step.leaves[0], c);
+            out.insert(out.end(), begin, c.p);
+        } break;
+        case Program::opPromote: {
+            double d;
+            float f;
+            int64_t n;
+            if (step.type == AVRO_FLOAT) {
+                std::memcpy(&f, c.take(sizeof(float)), sizeof(float));
+                d = f;
+                n = 0;
+            } else {
+                n = c.readLong();
+                d = static_cast<double>(n);
+            }
+            if (step.to == AVRO_FLOAT) {
+                writeFloating(static_cast<float>(n), out);
+            } else {
+                writeFloating(d, out);
+            }
+        } break;
+        case Program::opEnum: {
+            int64_t n = c.readLong();
+            if (n < 0 || static_cast<uint64_t>(n) >= step.symbols.size()) {
+                throw Exception(boost::format("Enum symbol %1% out of range; there are %2%") % n % step.symbols.size());
+            }
+            if (step.symbols[n] < 0) {
+                throw Exception(boost::format("Cannot resolve symbol: %1%") % step.names[n]);
+            }
+            writeLong(step.symbols[n], out);
+        } break;
+        case Program::opRecord:
+            transcodeRecord(s, c, out);
+            break;
+        case Program::opArray:
+        case Program::opMap: {
+            int64_t bytes;
+            for (int64_t n = c.readBlockCount(bytes); n != 0; n = c.readBlockCount(bytes)) {
+                writeLong(n, out);
+                for (; n != 0; --n) {
+                    if (step.op == Program::opMap) {
+                        const uint8_t *begin = c.p;
+                        c.take(c.readSize());
+                        out.insert(out.end(), begin, c.p);
+                    }
+                    transcode(step.leaves[0], c, out);
+                }
+            }
+            writeLong(0, out);
+        } break;
+        case Program::opWriterUnion:
+            transcode(step.leaves[c.branch(step.leaves.size())], c, out);
+            break;
+        case Program::opReaderUnion:
+            writeLong(static_cast<int64_t>(step.size), out);
+            transcode(step.leaves[0], c, out);
+            break;
+        case Program::opError:
+            throw Exception(step.error);
+    }
+}
+
+void Transcoder::transcodeRecord(size_t s, BinaryCursor &c, vector<uint8_t> &out) {
+    const Program::Step &step = program_->steps[s];
+    size_t base = segments_.size();
+    size_t start = out.size();
+    for (const Program::Field &f : step.fields) {
+        size_t begin = out.size();
+        switch (f.kind) {
+            case Program::Field::copy: {
+                const uint8_t *p = c.p;
+                for (size_t k : f.skips) {
+                    program_->skips.skip(k, c);
+                }
+                out.insert(out.end(), p, c.p);
+            } break;
+            case Program::Field::drop:
+                for (size_t k : f.skips) {
+                    program_->skips.skip(k, c);
+                }
+                continue;
+            case Program::Field::transcode:
+                transcode(f.step, c, out);
+                break;
+            case Program::Field::constant:
+                out.insert(out.end(), f.bytes.begin(), f.bytes.end());
+                break;
+        }
+        if (!step.ordered) {
+            Segment seg = {f.field, begin, out.size()};
+            segments_.push_back(seg);
+        }
+    }
+    if (!step.ordered) {
+        // Put the fields in the reader's order.
+        std::sort(segments_.begin() + base, segments_.end(),
+                  [](const Segment &a, const Segment &b) { return a.field < b.field; });
+        scratch_.assign(out.begin() + start, out.end());
+        out.resize(start);
+        for (size_t i = base; i < segments_.size(); ++i) {
+            const Segment &seg = segments_[i];
+            out.insert(out.end(), scratch_.begin() + (seg.begin - start), scratch_.begin() + (seg.end - start));
+        }
+        segments_.resize(base);
+    }
+}
+
+Transcoder::Transcoder(const ValidSchema &writer, const ValidSchema &reader) {
+    std::shared_ptr<Program> p = std::make_shared<Program>();
+    p->entry = TranscoderCompiler(*p).compile(writer.root(), reader.root());
+    program_ = p;
+}
+
+size_t Transcoder::transcode(const uint8_t *data, size_t len, vector<uint8_t> &out) {
+    BinaryCursor c = {data, data + len};
+    transcode(program_->entry, c, out);
+    return static_cast<size_t>(c.p - data);
+}
+
+size_t transcodeBinary(const ValidSchema &writer, const ValidSchema &reader,
+                       const uint8_t *data, size_t len, vector<uint8_t> &out) {
+    return Transcoder(writer, reader).transcode(data, len, out);
+}
+
+} // namespace avro
@@ -0,0 +1,525 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Codec.hh"
+#include "Exception.hh"
+#include "NodeImpl.hh"
+#include "ValidSchema.hh"
+#include "Zigzag.hh"
+
+#include <array>
+#include <cstring>
+#include <map>
+
+namespace avro {
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace {
+
+const string transposedPrefix("transposed-");
+
+// The first byte of a block says how the rest is laid out.
+const uint8_t rowBlock = 0;
+const uint8_t transposedBlock = 1;
+
+/**
+ * A schema compiled into steps, one per schema, as BinaryComparator does.
+ * Each step has the streams its bytes go to, numbered from stream:
+ * \li booleans, ints, longs, enums, floats, doubles, fixeds and union
+ * indexes go to one stream;
+ * \li strings and bytes put their lengths in one and their contents in
+ * the next;
+ * \li arrays put their block counts and sizes in one; maps do too, and
+ * put the lengths of their keys in the next and the keys in the one
+ * after.
+ */
+struct Program {
+    struct Step {
+        Type type;
+        // The size of fixeds.
+        size_t size;
+        // Fields of records, branches of unions, the items of arrays and
+        // the values of maps.
+        vector<size_t> leaves;
+        size_t stream;
+    };
+
+    vector<Step> steps;
+    size_t streams = 0;
+};
+
+class ProgramCompiler {
+    Program &p_;
+    map<const Node *, size_t> records_;
+
+    static size_t streamsOf(Type t) {
+        switch (t) {
+            case AVRO_NULL:
+            case AVRO_RECORD:
+                return 0;
+            case AVRO_STRING:
+            case AVRO_BYTES:
+                return 2;
+            case AVRO_MAP:
+                return 3;
+            default:
+                return 1;
+        }
+    }
+
+public:
+    explicit ProgramCompiler(Program &p) : p_(p) {}
+
+    size_t compile(const NodePtr &node) {
+        NodePtr n = node->type() == AVRO_SYMBOLIC
+            ? std::static_pointer_cast<NodeSymbolic>(node)->getNode()
+            : node;
+        if (n->type() == AVRO_RECORD) {
+            map<const Node *, size_t>::const_iterator it = records_.find(n.get());
+            if (it != records_.end()) {
+                return it->second;
+            }
+        }
+        size_t result = p_.steps.size();
+        p_.steps.emplace_back();
+        p_.steps[result].type = n->type();
+        p_.steps[result].size = n->type() == AVRO_FIXED ? n->fixedSize() : 0;
+        p_.steps[result].stream = p_.streams;
+        p_.streams += streamsOf(n->type());
+        vector<size_t> leaves;
+        switch (n->type()) {
+            case AVRO_RECORD:
+                records_[n.get()] = result;
+                for (size_t i = 0; i < n->leaves(); ++i) {
+                    leaves.push_back(compile(n->leafAt(i)));
+                }
+                break;
+            case AVRO_UNION:
+                for (size_t i = 0; i < n->leaves(); ++i) {
+                    leaves.push_back(compile(n->leafAt(i)));
+                }
+                break;
+            case AVRO_ARRAY:
+                leaves.push_back(compile(n->leafAt(0)));
+                break;
+            case AVRO_MAP:
+                leaves.push_back(compile(n->leafAt(1)));
+                break;
+            default:
+                break;
+        }
+        // Compiling the leaves may have moved the steps.
+        p_.steps[result].leaves.swap(leaves);
+        return result;
+    }
+};
+
+/**
+ * Walks objects in their binary encoding, as the steps of a program have
+ * them. Source says where the bytes come from and Sink where they go, so
+ * that the same walk splits a block into streams and joins it back.
+ */
+template<typename Source>
+class Walker {
+    const vector<Program::Step> &steps_;
+    Source &source_;
+
+    int64_t count(size_t s) {
+        int64_t n = source_.varint(s);
+        if (n < 0) {
+            if (n == INT64_MIN) {
+                throw Exception(boost::format("Invalid block count: %1%") % n);
+            }
+            n = -n;
+            source_.varint(s);
+        }
+        return n;
+    }
+
+    size_t length(size_t s) {
+        int64_t n = source_.varint(s);
+        if (n < 0) {
+            throw Exception(boost::format("Cannot have negative length: %1%") % n);
+        }
+        return static_cast<size_t>(n);
+    }
+
+public:
+    Walker(const Program &p, Source &source) : steps_(p.steps), source_(source) {}
+
+    void walk(size_t s) {
+        const Program::Step &step = steps_[s];
+        switch (step.type) {
+            case AVRO_NULL:
+                break;
+            case AVRO_BOOL:
+                source_.bytes(step.stream, 1);
+                break;
+            case AVRO_INT:
+            case AVRO_LONG:
+            case AVRO_ENUM:
+                source_.varint(step.stream);
+                break;
+            case AVRO_FLOAT:
+                source_.bytes(step.stream, sizeof(float));
+                break;
+            case AVRO_DOUBLE:
+                source_.bytes(step.stream, sizeof(double));
+                break;
+            case AVRO_STRING:
+            case AVRO_BYTES:
+                source_.bytes(step.stream + 1, length(step.stream));
+                break;
+            case AVRO_FIXED:
+                source_.bytes(step.stream, step.size);
+                break;
+            case AVRO_RECORD:
+                for (size_t f : step.leaves) {
+                    walk(f);
+                }
+                break;
+            case AVRO_UNION: {
+                int64_t b = source_.varint(step.stream);
+                if (b < 0 || static_cast<uint64_t>(b) >= step.leaves.size()) {
+                    throw Exception(boost::format("Union branch %1% out of range; there are %2%") % b % step.leaves.size());
+                }
+                walk(step.leaves[static_cast<size_t>(b)]);
+                break;
+            }
+            case AVRO_ARRAY:
+            case AVRO_MAP:
+                for (int64_t n = count(step.stream); n != 0; n = count(step.stream)) {
+                    for (; n != 0; --n) {
+                        if (step.type == AVRO_MAP) {
+                            source_.bytes(step.stream + 2, length(step.stream + 1));
+                        }
+                        walk(step.leaves[0]);
+                    }
+                }
+                break;
+            default:
+                throw Exception(boost::format("Cannot transpose %1%") % step.type);
+        }
+    }
+};
+
+// Reads the varint at p, moving p past it.
+uint64_t readVarint(const uint8_t *&p, const uint8_t *end) {
+    uint64_t encoded = 0;
+    int shift = 0;
+    uint8_t u;
+    do {
+        if (shift >= 64) {
+            throw Exception("Invalid Avro varint");
+        }
+        if (p == end) {
+            throw Exception("Transposed block is truncated");
+        }
+        u = *p++;
+        encoded |= static_cast<uint64_t>(u & 0x7f) << shift;
+        shift += 7;
+    } while (u & 0x80);
+    return encoded;
+}
+
+void writeVarint(vector<uint8_t> &out, uint64_t v) {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-member-init)
+    std::array<uint8_t, 10> bytes;
+    size_t n = encodeVarint(v, bytes.data());
+    out.insert(out.end(), bytes.data(), bytes.data() + n);
+}
+
+// Cuts a block in its binary encoding into the streams.
+class Splitter {
+    const uint8_t *p_;
+    const uint8_t *end_;
+    vector<vector<uint8_t>> &streams_;
+
+public:
+    Splitter(const uint8_t *data, size_t len, vector<vector<uint8_t>> &streams)
+        : p_(data), end_(data + len), streams_(streams) {}
+
+    const uint8_t *position() const { return p_; }
+
+    bool done() const { return p_ == end_; }
+
+    int64_t varint(size_t s) {
+        const uint8_t *start = p_;
+        uint64_t v = readVarint(p_, end_);
+        streams_[s].insert(streams_[s].end(), start, p_);
+        return decodeZigzag64(v);
+    }
+
+    void bytes(size_t s, size_t n) {
+        if (static_cast<size_t>(end_ - p_) < n) {
+            throw Exception("Block ends inside an object");
+        }
+        streams_[s].insert(streams_[s].end(), p_, p_ + n);
+        p_ += n;
+    }
+};
+
+// Puts the streams back together, in the order the splitter took them.
+class Joiner {
+    struct Stream {
+        const uint8_t *p;
+        const uint8_t *end;
+    };
+
+    vector<Stream> streams_;
+    uint8_t *out_;
+
+public:
+    explicit Joiner(uint8_t *out) : out_(out) {}
+
+    void add(const uint8_t *data, size_t len) {
+        Stream s = {data, data + len};
+        streams_.push_back(s);
+    }
+
+    bool done() const {
+        for (const Stream &s : streams_) {
+            if (s.p != s.end) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int64_t varint(size_t s) {
+        Stream &stream = streams_[s];
+        const uint8_t *start = stream.p;
+        uint64_t v = readVarint(stream.p, stream.end);
+        size_t n = stream.p - start;
+        std::memcpy(out_, start, n);
+        out_ += n;
+        return decodeZigzag64(v);
+    }
+
+    void bytes(size_t s, size_t n) {
+        Stream &stream = streams_[s];
+        if (static_cast<size_t>(stream.end - stream.p) < n) {
+            throw Exception("Transposed block is truncated");
+        }
+        std::memcpy(out_, stream.p, n);
+        stream.p += n;
+        out_ += n;
+    }
+};
+
+typedef std::shared_ptr<const Program> ProgramPtr;
+
+/**
+ * Lays a block out as a byte saying which layout it has, and then either
+ * the block as it is, or the number of objects in it, the number of
+ * streams, their sizes and the streams. Blocks that do not hold objects
+ * of the schema keep their layout.
+ */
+class TransposingCompressor : public BlockCompressor {
+    const ProgramPtr program_;
+    const std::unique_ptr<BlockCompressor> compressor_;
+    vector<vector<uint8_t>> streams_;
+    vector<uint8_t> block_;
+
+    bool transpose(const uint8_t *in, size_t len) {
+        streams_.resize(program_->streams);
+        for (vector<uint8_t> &s : streams_) {
+            s.clear();
+        }
+        Splitter splitter(in, len, streams_);
+        Walker<Splitter> walker(*program_, splitter);
+        uint64_t objects = 0;
+        try {
+            for (; !splitter.done(); ++objects) {
+                const uint8_t *start = splitter.position();
+                walker.walk(0);
+                // Objects that take no bytes cannot be counted.
+                if (splitter.position() == start) {
+                    return false;
+                }
+            }
+        } catch (Exception &) {
+            return false;
+        }
+        block_.push_back(transposedBlock);
+        writeVarint(block_, objects);
+        writeVarint(block_, streams_.size());
+        for (const vector<uint8_t> &s : streams_) {
+            writeVarint(block_, s.size());
+        }
+        for (const vector<uint8_t> &s : streams_) {
+            block_.insert(block_.end(), s.begin(), s.end());
+        }
+        return true;
+    }
+
+public:
+    TransposingCompressor(const ProgramPtr &program, std::unique_ptr<BlockCompressor> compressor)
+        : program_(program), compressor_(std::move(compressor)) {}
+
+    size_t compress(const uint8_t *in, size_t len, int level, std::vector<char> &out) override {
+        block_.clear();
+        if (!transpose(in, len)) {
+            block_.clear();
+            block_.push_back(rowBlock);
+            block_.insert(block_.end(), in, in + len);
+        }
+        return compressor_->compress(block_.data(), block_.size(), level, out);
+    }
+};
+
+class TransposingDecompressor : public BlockDecompressor {
+    const ProgramPtr program_;
+    const std::unique_ptr<BlockDecompressor> decompressor_;
+    vector<uint8_t> block_;
+
+public:
+    TransposingDecompressor(const ProgramPtr &program, std::unique_ptr<BlockDecompressor> decompressor)
+        : program_(program), decompressor_(std::move(decompressor)) {}
+
+    void setChecksumVerification(bool verify) override {
+        decompressor_->setChecksumVerification(verify);
+    }
+
+    size_t decompress(const uint8_t *in, size_t len, std::vector<uint8_t> &out) override {
+        size_t n = decompressor_->decompress(in, len, block_);
+        if (n == 0) {
+            throw Exception("Transposed block is empty");
+        }
+        const uint8_t *p = block_.data() + 1;
+        const uint8_t *end = block_.data() + n;
+        if (block_[0] == rowBlock) {
+            if (out.size() < n - 1) {
+                out.resize(n - 1);
+            }
+            std::copy(p, end, out.begin());
+            return n - 1;
+        } else if (block_[0] != transposedBlock) {
+            throw Exception(boost::format("Unknown block layout: %1%") % static_cast<int>(block_[0]));
+        }
+
+        uint64_t objects = readVarint(p, end);
+        uint64_t streams = readVarint(p, end);
+        if (streams != program_->streams) {
+            throw Exception(boost::format("Transposed block has %1% streams; the schema has %2%") % streams % program_->streams);
+        }
+        vector<uint64_t> sizes(static_cast<size_t>(streams));
+        uint64_t total = 0;
+        for (uint64_t &size : sizes) {
+            size = readVarint(p, end);
+            if (size > static_cast<uint64_t>(end - p)) {
+                throw Exception("Transposed block is truncated");
+            }
+            total += size;
+        }
+        if (total != static_cast<uint64_t>(end - p)) {
+            throw Exception("Transposed block does not add up");
+        }
+        if (out.size() < total) {
+            out.resize(static_cast<size_t>(total));
+        }
+        Joiner joiner(out.data());
+        for (uint64_t size : sizes) {
+            joiner.add(p, static_cast<size_t>(size));
+            p += size;
+        }
+        Walker<Joiner> walker(*program_, joiner);
+        for (uint64_t i = 0; i < objects; ++i) {
+            walker.walk(0);
+        }
+        if (!joiner.done()) {
+            throw Exception("Transposed block has bytes left over");
+        }
+        return static_cast<size_t>(total);
+    }
+};
+
+class TransposingCodec : public BlockCodec {
+    const ProgramPtr program_;
+    const BlockCodecPtr codec_;
+
+public:
+    TransposingCodec(const ProgramPtr &program, const BlockCodecPtr &codec)
+        : program_(program), codec_(codec) {}
+
+    std::string name() const override { return transposedPrefix + codec_->name(); }
+
+    int defaultLevel() const override { return codec_->defaultLevel(); }
+
+    void checkLevel(int level) const override {
+        codec_->checkLevel(level);
+    }
+
+    std::unique_ptr<BlockCompressor> newCompressor() const override {
+        return std::unique_ptr<BlockCompressor>(new TransposingCompressor(program_, codec_->newCompressor()));
+    }
+
+    std::unique_ptr<BlockDecompressor> newDecompressor() const override {
+        return std::unique_ptr<BlockDecompressor>(new TransposingDecompressor(program_, codec_->newDecompressor()));
+    }
+
+    void addMetadata(std::map<std::string, std::vector<uint8_t>> &metadata) const override {
+        codec_->addMetadata(metadata);
+    }
+};
+
+} // namespace
+
+BlockCodecPtr transposingCodec(const ValidSchema &schema, const BlockCodecPtr &codec) {
+    if (!codec) {
+        throw Exception("No codec given");
+    }
+    std::shared_ptr<Program> p = std::make_shared<Program>();
+    ProgramCompiler(*p).compile(schema.root());
+    return std::make_shared<TransposingCodec>(p, codec);
+}
+
+namespace {
+
+BlockCodecPtr findCodec(const std::string &name, const ValidSchema &schema,
+                        const std::map<std::string, std::vector<uint8_t>> *metadata) {
+    BlockCodecPtr result = avro::findCodec(name);
+    if (!result && name.compare(0, transposedPrefix.size(), transposedPrefix) == 0) {
+        BlockCodecPtr codec = findCodec(name.substr(transposedPrefix.size()), schema, metadata);
+        if (codec) {
+            result = transposingCodec(schema, codec);
+        }
+    } else if (result && metadata && result->name() == "zstandard") {
+        std::map<std::string, std::vector<uint8_t>>::const_iterator it = metadata->find(ZSTD_DICTIONARY_KEY);
+        if (it != metadata->end()) {
+            result = zstdDictionaryCodec(it->second);
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+BlockCodecPtr findCodec(const std::string &name, const ValidSchema &schema) {
+    return findCodec(name, schema, nullptr);
+}
+
+BlockCodecPtr findCodec(const std::string &name, const ValidSchema &schema,
+                        const std::map<std::string, std::vector<uint8_t>> &metadata) {
+    return findCodec(name, schema, &metadata);
+}
+
+} // namespace avro
@@ -0,0 +1,242 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "Utf8.hh"
+
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define AVRO_UTF8_SSSE3
+#include <immintrin.h>
+#endif
+
+namespace avro {
+
+namespace {
+
+const uint64_t highBits = 0x8080808080808080ULL;
+
+/// Checks one byte at a time, as table 3-7 of the Unicode standard has
+/// it, but steps over runs of ASCII eight bytes at a time.
+bool validUtf8Scalar(const uint8_t *p, size_t len) {
+    const uint8_t *const end = p + len;
+    while (p != end) {
+        if (end - p >= 8) {
+            uint64_t w;
+            std::memcpy(&w, p, sizeof(w));
+            if ((w & highBits) == 0) {
+                p += 8;
+                continue;
+            }
+        }
+        uint8_t b = *p;
+        if (b < 0x80) {
+            ++p;
+            continue;
+        }
+        size_t n;
+        uint8_t lo = 0x80, hi = 0xBF;
+        if (b >= 0xC2 && b <= 0xDF) {
+            n = 2;
+        } else if (b >= 0xE0 && b <= 0xEF) {
+            n = 3;
+            if (b == 0xE0) {
+                lo = 0xA0;
+            } else if (b == 0xED) {
+                hi = 0x9F;
+            }
+        } else if (b >= 0xF0 && b <= 0xF4) {
+            n = 4;
+            if (b == 0xF0) {
+                lo = 0x90;
+            } else if (b == 0xF4) {
+                hi = 0x8F;
+            }
+        } else {
+            return false;
+        }
+        if (static_cast<size_t>(end - p) < n || p[1] < lo || p[1] > hi) {
+            return false;
+        }
+        for (size_t i = 2; i < n; ++i) {
+            if ((p[i] & 0xC0) != 0x80) {
+                return false;
+            }
+        }
+        p += n;
+    }
+    return true;
+}
+
+#ifdef AVRO_UTF8_SSSE3
+
+// The errors a byte and the one before it can show, as in Keiser and
+// Lemire's "Validating UTF-8 In Less Than One Instruction Per Byte".
+// Each of the three tables below gives the errors that the high nibble of
+// the first byte, its low nibble or the high nibble of the second byte
+// allow; the pair is in error where all three agree.
+const uint8_t tooShort = 1 << 0;   // 11______ 0_______ or 11______ 11______
+const uint8_t tooLong = 1 << 1;    // 0_______ 10______
+const uint8_t overlong3 = 1 << 2;  // 11100000 100_____
+const uint8_t tooLarge = 1 << 3;   // 11110100 1001____ and above
+const uint8_t surrogate = 1 << 4;  // 11101101 101_____
+const uint8_t overlong2 = 1 << 5;  // 1100000_ 10______
+const uint8_t tooLarge1000 = 1 << 6; // 11110101 1000____ and above
+const uint8_t overlong4 = 1 << 6;  // 11110000 1000____
+const uint8_t twoConts = 1 << 7;   // 10______ 10______
+const uint8_t carry = tooShort | tooLong | twoConts;
+
+__attribute__((target("ssse3"))) inline __m128i table(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3,
+                                                     uint8_t b4, uint8_t b5, uint8_t b6, uint8_t b7,
+                                                     uint8_t b8, uint8_t b9, uint8_t b10, uint8_t b11,
+                                                     uint8_t b12, uint8_t b13, uint8_t b14, uint8_t b15) {
+    return _mm_setr_epi8(static_cast<char>(b0), static_cast<char>(b1), static_cast<char>(b2), static_cast<char>(b3),
+                         static_cast<char>(b4), static_cast<char>(b5), static_cast<char>(b6), static_cast<char>(b7),
+                         static_cast<char>(b8), static_cast<char>(b9), static_cast<char>(b10), static_cast<char>(b11),
+                         static_cast<char>(b12), static_cast<char>(b13), static_cast<char>(b14), static_cast<char>(b15));
+}
+
+__attribute__((target("ssse3"))) inline __m128i highNibbles(__m128i v) {
+    return _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F));
+}
+
+/// Returns non-zero bytes where \p input, following \p prev, is not
+/// well-formed.
+__attribute__((target("ssse3"))) __m128i checkBlock(__m128i input, __m128i prev) {
+    const __m128i byte1High = table(
+        // 0_______: ASCII.
+        tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong,
+        // 10______: a continuation.
+        twoConts, twoConts, twoConts, twoConts,
+        // 1100____ and 1101____: a two byte lead.
+        tooShort | overlong2, tooShort,
+        // 1110____: a three byte lead.
+        tooShort | overlong3 | surrogate,
+        // 1111____: a four byte lead.
+        tooShort | tooLarge | tooLarge1000 | overlong4);
+    const __m128i byte1Low = table(
+        carry | overlong3 | overlong2 | overlong4, // ____0000
+        carry | overlong2,                         // ____0001
+        carry, carry,                              // ____001_
+        carry | tooLarge,                          // ____0100
+        carry | tooLarge | tooLarge1000,           // ____0101
+        carry | tooLarge | tooLarge1000,           // ____011_
+        carry | tooLarge | tooLarge1000,
+        carry | tooLarge | tooLarge1000, // ____1___
+        carry | tooLarge | tooLarge1000,
+        carry | tooLarge | tooLarge1000,
+        carry | tooLarge | tooLarge1000,
+        carry | tooLarge | tooLarge1000,
+        carry | tooLarge | tooLarge1000 | surrogate, // ____1101
+        carry | tooLarge | tooLarge1000,
+        carry | tooLarge | tooLarge1000);
+    const __m128i byte2High = table(
+        // ________ 0_______: ASCII.
+        tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort,
+        // ________ 1000____
+        tooLong | overlong2 | twoConts | overlong3 | tooLarge1000 | overlong4,
+        // ________ 1001____
+        tooLong | overlong2 | twoConts | overlong3 | tooLarge,
+        // ________ 101_____
+        tooLong | overlong2 | twoConts | surrogate | tooLarge,
+        tooLong | overlong2 | twoConts | surrogate | tooLarge,
+        // ________ 11______
+        tooShort, tooShort, tooShort, tooShort);
+
+    __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+    __m128i special = _mm_and_si128(
+        _mm_and_si128(_mm_shuffle_epi8(byte1High, highNibbles(prev1)),
+                      _mm_shuffle_epi8(byte1Low, _mm_and_si128(prev1, _mm_set1_epi8(0x0F)))),
+        _mm_shuffle_epi8(byte2High, highNibbles(input)));
+    // The third and fourth bytes of a sequence must be continuations,
+    // which the tables let pass as two in a row.
+    __m128i prev2 = _mm_alignr_epi8(input, prev, 14);
+    __m128i prev3 = _mm_alignr_epi8(input, prev, 13);
+    __m128i third = _mm_subs_epu8(prev2, _mm_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+    __m128i fourth = _mm_subs_epu8(prev3, _mm_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+    __m128i must23 = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8(static_cast<char>(0x80)));
+    return _mm_xor_si128(must23, special);
+}
+
+/// Returns non-zero bytes if \p input ends within a sequence.
+__attribute__((target("ssse3"))) inline __m128i incomplete(__m128i input) {
+    const __m128i max = table(0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                              0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1);
+    return _mm_subs_epu8(input, max);
+}
+
+__attribute__((target("ssse3"))) bool validUtf8Ssse3(const uint8_t *p, size_t len) {
+    __m128i error = _mm_setzero_si128();
+    __m128i prev = _mm_setzero_si128();
+    __m128i prevIncomplete = _mm_setzero_si128();
+    for (;; p += 16, len -= 16) {
+        __m128i input;
+        if (len >= 16) {
+            input = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        } else if (len != 0) {
+            // The tail is padded with ASCII, after which a sequence cut
+            // short shows as one.
+            uint8_t tail[16] = {};
+            std::memcpy(tail, p, len);
+            input = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tail));
+        } else {
+            break;
+        }
+        if (_mm_movemask_epi8(input) == 0) {
+            error = _mm_or_si128(error, prevIncomplete);
+            prevIncomplete = _mm_setzero_si128();
+        } else {
+            error = _mm_or_si128(error, checkBlock(input, prev));
+            prevIncomplete = incomplete(input);
+        }
+        prev = input;
+        if (len <= 16) {
+            break;
+        }
+    }
+    error = _mm_or_si128(error, prevIncomplete);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xFFFF;
+}
+
+bool hasAcceleration() {
+    return __builtin_cpu_supports("ssse3");
+}
+
+#endif
+
+typedef bool (*Utf8Function)(const uint8_t *, size_t);
+
+Utf8Function selectUtf8() {
+#ifdef AVRO_UTF8_SSSE3
+    if (hasAcceleration()) {
+        return validUtf8Ssse3;
+    }
+#endif
+    return validUtf8Scalar;
+}
+
+} // namespace
+
+bool isValidUtf8(const uint8_t *data, size_t len) noexcept {
+    static const Utf8Function f = selectUtf8();
+    // Short strings are not worth the setting up of the vectors.
+    return len < 16 ? validUtf8Scalar(data, len) : f(data, len);
+}
+
+} // namespace avro
@@ -18,9 +18,12 @@
 
 #include <boost/format.hpp>
 #include <cctype>
+#include <mutex>
+#include <set>
 #include <sstream>
 #include <utility>
 
+#include "Fingerprint.hh"
 #include "Node.hh"
 #include "Schema.hh"
 #include "ValidSchema.hh"
@@ -54,12 +57,9 @@ static bool validate(const NodePtr &node, SymbolMap &symbolMap) {
                 throw Exception(format("Symbolic name \"%1%\" is unknown") % node->name());
             }
 
-            shared_ptr<NodeSymbolic> symNode =
-                static_pointer_cast<NodeSymbolic>(node);
-
             // if the symbolic link is already resolved, we return true,
             // otherwise returning false will force it to be resolved
-            return symNode->isSet();
+            return static_cast<const NodeSymbolic &>(*node).isSet();
         }
 
         if (found) {
@@ -93,42 +93,218 @@ static void validate(const NodePtr &p) {
     validate(p, m);
 }
 
-ValidSchema::ValidSchema(NodePtr root) : root_(std::move(root)) {
+struct ValidSchema::Fingerprints {
+    std::once_flag once;
+    string canonicalForm;
+    uint64_t rabin;
+    std::array<uint8_t, 16> md5;
+    std::array<uint8_t, 32> sha256;
+
+    // The JSON of the schema, pretty and compact, made on first use.
+    std::once_flag prettyOnce;
+    string pretty;
+    std::once_flag compactOnce;
+    string compact;
+};
+
+ValidSchema::ValidSchema(NodePtr root) : root_(std::move(root)),
+                                         fingerprints_(std::make_shared<Fingerprints>()) {
     validate(root_);
 }
 
-ValidSchema::ValidSchema(const Schema &schema) : root_(schema.root()) {
+ValidSchema::ValidSchema(const Schema &schema) : root_(schema.root()),
+                                                 fingerprints_(std::make_shared<Fingerprints>()) {
     validate(root_);
 }
 
-ValidSchema::ValidSchema() : root_(NullSchema().root()) {
+ValidSchema::ValidSchema() : root_(NullSchema().root()),
+                             fingerprints_(std::make_shared<Fingerprints>()) {
     validate(root_);
 }
 
 void ValidSchema::setSchema(const Schema &schema) {
     root_ = schema.root();
     validate(root_);
+    fingerprints_ = std::make_shared<Fingerprints>();
+    frozen_.reset();
 }
 
 void ValidSchema::toJson(std::ostream &os) const {
-    root_->printJson(os, 0);
-    os << '\n';
+    os << json(true);
 }
 
 string
 ValidSchema::toJson(bool prettyPrint) const {
-    ostringstream oss;
-    toJson(oss);
+    return json(prettyPrint);
+}
+
+const string &ValidSchema::json(bool prettyPrint) const {
+    Fingerprints &f = *fingerprints_;
+    std::call_once(f.prettyOnce, [&]() {
+        ostringstream oss;
+        root_->printJson(oss, 0);
+        oss << '\n';
+        f.pretty = oss.str();
+    });
     if (!prettyPrint) {
-        return compactSchema(oss.str());
+        std::call_once(f.compactOnce, [&]() {
+            f.compact = compactSchema(f.pretty);
+        });
+        return f.compact;
     }
-    return oss.str();
+    return f.pretty;
 }
 
 void ValidSchema::toFlatList(std::ostream &os) const {
     root_->printBasicInfo(os);
 }
 
+/*
+ * Writes n in Parsing Canonical Form: only the attributes that affect
+ * parsing, in a fixed order, with full names and no white space. A named
+ * type is spelled out where it first occurs and referred to by its full
+ * name after that.
+ */
+static void printCanonical(const Node &n, std::set<string> &defined,
+                           std::ostream &os) {
+    Type t = n.type();
+    if (t == AVRO_SYMBOLIC) {
+        if (defined.find(n.name().fullname()) != defined.end()) {
+            os << '"' << n.name().fullname() << '"';
+        } else {
+            printCanonical(resolvedNode(n), defined, os);
+        }
+        return;
+    }
+    if (n.hasName()) {
+        const string name = n.name().fullname();
+        if (!defined.insert(name).second) {
+            os << '"' << name << '"';
+            return;
+        }
+        os << "{\"name\":\"" << name << "\",\"type\":\"" << t << '"';
+    }
+
+    switch (t) {
+        case AVRO_RECORD:
+            os << ",\"fields\":[";
+            for (size_t i = 0; i < n.leaves(); ++i) {
+                if (i != 0) {
+                    os << ',';
+                }
+                os << "{\"name\":\"" << n.nameAt(i) << "\",\"type\":";
+                printCanonical(*n.leafAt(i), defined, os);
+                os << '}';
+            }
+            os << "]}";
+            break;
+        case AVRO_ENUM:
+            os << ",\"symbols\":[";
+            for (size_t i = 0; i < n.names(); ++i) {
+                if (i != 0) {
+                    os << ',';
+                }
+                os << '"' << n.nameAt(i) << '"';
+            }
+            os << "]}";
+            break;
+        case AVRO_FIXED:
+            os << ",\"size\":" << n.fixedSize() << '}';
+            break;
+        case AVRO_ARRAY:
+            os << "{\"type\":\"array\",\"items\":";
+            printCanonical(*n.leafAt(0), defined, os);
+            os << '}';
+            break;
+        case AVRO_MAP:
+            os << "{\"type\":\"map\",\"values\":";
+            printCanonical(*n.leafAt(1), defined, os);
+            os << '}';
+            break;
+        case AVRO_UNION:
+            os << '[';
+            for (size_t i = 0; i < n.leaves(); ++i) {
+                if (i != 0) {
+                    os << ',';
+                }
+                printCanonical(*n.leafAt(i), defined, os);
+            }
+            os << ']';
+            break;
+        default:
+            os << '"' << t << '"';
+            break;
+    }
+}
+
+const ValidSchema::Fingerprints &ValidSchema::fingerprints() const {
+    Fingerprints &f = *fingerprints_;
+    std::call_once(f.once, [&]() {
+        ostringstream oss;
+        std::set<string> defined;
+        printCanonical(*root_, defined, oss);
+        f.canonicalForm = oss.str();
+        const uint8_t *data = reinterpret_cast<const uint8_t *>(f.canonicalForm.data());
+        size_t len = f.canonicalForm.size();
+        f.rabin = avro::rabinFingerprint(data, len);
+        f.md5 = avro::md5Fingerprint(data, len);
+        f.sha256 = avro::sha256Fingerprint(data, len);
+    });
+    return f;
+}
+
+const string &ValidSchema::canonicalForm() const {
+    return fingerprints().canonicalForm;
+}
+
+uint64_t ValidSchema::rabinFingerprint() const {
+    return fingerprints().rabin;
+}
+
+const std::array<uint8_t, 16> &ValidSchema::md5Fingerprint() const {
+    return fingerprints().md5;
+}
+
+bool ValidSchema::sameEncoding(const ValidSchema &other) const {
+    if (root_ == other.root_) {
+        return true;
+    }
+    // The fingerprints tell most schemas apart; the forms rule out
+    // collisions.
+    return rabinFingerprint() == other.rabinFingerprint()
+        && canonicalForm() == other.canonicalForm();
+}
+
+// Walks two nodes of the same canonical form, comparing the logical
+// types it leaves out. A named type is compared where it is defined.
+static bool sameLogicalTypes(const NodePtr &a, const NodePtr &b) {
+    LogicalType la = a->logicalType();
+    LogicalType lb = b->logicalType();
+    if (la.type() != lb.type() || la.precision() != lb.precision() || la.scale() != lb.scale()) {
+        return false;
+    }
+    if (a->type() != b->type() || a->leaves() != b->leaves()) {
+        return false;
+    }
+    if (a->type() == AVRO_SYMBOLIC) {
+        return true;
+    }
+    for (size_t i = 0; i < a->leaves(); ++i) {
+        if (!sameLogicalTypes(a->leafAt(i), b->leafAt(i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ValidSchema::sameData(const ValidSchema &other) const {
+    return sameEncoding(other) && (root_ == other.root_ || sameLogicalTypes(root_, other.root_));
+}
+
+const std::array<uint8_t, 32> &ValidSchema::sha256Fingerprint() const {
+    return fingerprints().sha256;
+}
+
 /*
  * compactSchema compacts and returns a formatted string representation
  * of a ValidSchema object by removing the whitespaces outside of the quoted
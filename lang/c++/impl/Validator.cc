@@ -24,13 +24,78 @@
 
 namespace avro {
 
+namespace {
+
+// Use flags instead of strictly types, so that we can be more lax about the
+// type (for example, a long should be able to accept an int type, but not
+// vice versa).
+uint32_t flagsOf(Type type) {
+    static const uint32_t flags[] = {
+        (1U << AVRO_STRING) | (1U << AVRO_BYTES),
+        (1U << AVRO_STRING) | (1U << AVRO_BYTES),
+        (1U << AVRO_INT),
+        (1U << AVRO_INT) | (1U << AVRO_LONG),
+        (1U << AVRO_FLOAT),
+        (1U << AVRO_DOUBLE),
+        (1U << AVRO_BOOL),
+        (1U << AVRO_NULL),
+        (1U << AVRO_RECORD),
+        (1U << AVRO_ENUM),
+        (1U << AVRO_ARRAY),
+        (1U << AVRO_MAP),
+        (1U << AVRO_UNION),
+        (1U << AVRO_FIXED)};
+    static_assert((sizeof(flags) / sizeof(uint32_t)) == (AVRO_NUM_TYPES),
+                  "Invalid number of avro type flags");
+    return flags[type];
+}
+
+} // namespace
+
 Validator::Validator(ValidSchema schema) : schema_(std::move(schema)),
                                            nextType_(AVRO_NULL),
                                            expectedTypesFlag_(0),
                                            compoundStarted_(false),
                                            waitingForCount_(false),
                                            count_(0) {
-    setupOperation(schema_.root());
+    std::vector<std::pair<const Node *, size_t>> records;
+    compile(schema_.root(), records);
+    compoundStack_.reserve(16);
+    counters_.reserve(16);
+    setupOperation(0);
+}
+
+size_t Validator::compile(const NodePtr &node, std::vector<std::pair<const Node *, size_t>> &records) {
+    if (node->type() == AVRO_SYMBOLIC) {
+        NodePtr actualNode = resolveSymbol(node);
+        assert(actualNode);
+        return compile(actualNode, records);
+    }
+    assert(node->type() < AVRO_SYMBOLIC);
+
+    if (node->type() == AVRO_RECORD) {
+        for (const auto &r : records) {
+            if (r.first == node.get()) {
+                return r.second;
+            }
+        }
+    }
+    size_t result = steps_.size();
+    steps_.push_back(Step{node->type(), flagsOf(node->type()),
+                          node->type() == AVRO_FIXED ? static_cast<int>(node->fixedSize()) : 0,
+                          node.get(), {}});
+    if (node->type() == AVRO_RECORD) {
+        records.emplace_back(node.get(), result);
+    }
+    std::vector<size_t> leaves;
+    if (node->type() != AVRO_ENUM && node->type() != AVRO_FIXED) {
+        for (size_t i = 0; i < node->leaves(); ++i) {
+            leaves.push_back(compile(node->leafAt(i), records));
+        }
+    }
+    // Compiling the leaves may have moved the steps.
+    steps_[result].leaves.swap(leaves);
+    return result;
 }
 
 void Validator::setWaitingForCount() {
@@ -72,21 +137,21 @@ bool Validator::countingSetup() {
 void Validator::countingAdvance() {
     if (countingSetup()) {
         auto index = (compoundStack_.back().pos)++;
-        const NodePtr &node = compoundStack_.back().node;
+        const Step &step = steps_[compoundStack_.back().step];
 
-        if (index < node->leaves()) {
-            setupOperation(node->leafAt(index));
+        if (index < step.leaves.size()) {
+            setupOperation(step.leaves[index]);
         } else {
             compoundStack_.back().pos = 0;
             int count = --counters_.back();
             if (count == 0) {
                 counters_.pop_back();
                 compoundStarted_ = true;
-                nextType_ = node->type();
+                nextType_ = step.type;
                 expectedTypesFlag_ = typeToFlag(nextType_);
             } else {
                 index = (compoundStack_.back().pos)++;
-                setupOperation(node->leafAt(index));
+                setupOperation(step.leaves[index]);
             }
         }
     }
@@ -98,16 +163,16 @@ void Validator::unionAdvance() {
         compoundStarted_ = false;
     } else {
         waitingForCount_ = false;
-        NodePtr node = compoundStack_.back().node;
+        const Step &step = steps_[compoundStack_.back().step];
 
-        if (count_ < static_cast<int64_t>(node->leaves())) {
+        if (count_ < static_cast<int64_t>(step.leaves.size())) {
             compoundStack_.pop_back();
-            setupOperation(node->leafAt(static_cast<int>(count_)));
+            setupOperation(step.leaves[static_cast<size_t>(count_)]);
         } else {
             throw Exception(
                 boost::format("Union selection out of range, got %1%,"
                               " expecting 0-%2%")
-                % count_ % (node->leaves() - 1));
+                % count_ % (step.leaves.size() - 1));
         }
     }
 }
@@ -118,7 +183,7 @@ void Validator::fixedAdvance() {
 }
 
 int Validator::nextSizeExpected() const {
-    return compoundStack_.back().node->fixedSize();
+    return steps_[compoundStack_.back().step].fixedSize;
 }
 
 void Validator::doAdvance() {
@@ -147,7 +212,7 @@ void Validator::doAdvance() {
     // loop until we encounter a next expected type, or we've exited all compound types
     while (!expectedTypesFlag_ && !compoundStack_.empty()) {
 
-        Type type = compoundStack_.back().node->type();
+        Type type = steps_[compoundStack_.back().step].type;
 
         AdvanceFunc func = funcs[type];
 
@@ -180,46 +245,13 @@ void Validator::setCount(int64_t count) {
     doAdvance();
 }
 
-void Validator::setupFlag(Type type) {
-    // use flags instead of strictly types, so that we can be more lax about the type
-    // (for example, a long should be able to accept an int type, but not vice versa)
-    static const flag_t flags[] = {
-        typeToFlag(AVRO_STRING) | typeToFlag(AVRO_BYTES),
-        typeToFlag(AVRO_STRING) | typeToFlag(AVRO_BYTES),
-        typeToFlag(AVRO_INT),
-        typeToFlag(AVRO_INT) | typeToFlag(AVRO_LONG),
-        typeToFlag(AVRO_FLOAT),
-        typeToFlag(AVRO_DOUBLE),
-        typeToFlag(AVRO_BOOL),
-        typeToFlag(AVRO_NULL),
-        typeToFlag(AVRO_RECORD),
-        typeToFlag(AVRO_ENUM),
-        typeToFlag(AVRO_ARRAY),
-        typeToFlag(AVRO_MAP),
-        typeToFlag(AVRO_UNION),
-        typeToFlag(AVRO_FIXED)};
-    static_assert((sizeof(flags) / sizeof(flag_t)) == (AVRO_NUM_TYPES),
-                  "Invalid number of avro type flags");
-
-    expectedTypesFlag_ = flags[type];
-}
-
-void Validator::setupOperation(const NodePtr &node) {
-    nextType_ = node->type();
-
-    if (nextType_ == AVRO_SYMBOLIC) {
-        NodePtr actualNode = resolveSymbol(node);
-        assert(actualNode);
-        setupOperation(actualNode);
-        return;
-    }
-
-    assert(nextType_ < AVRO_SYMBOLIC);
-
-    setupFlag(nextType_);
+void Validator::setupOperation(size_t step) {
+    const Step &s = steps_[step];
+    nextType_ = s.type;
+    expectedTypesFlag_ = s.flags;
 
     if (!isPrimitive(nextType_)) {
-        compoundStack_.emplace_back(node);
+        compoundStack_.emplace_back(step);
         compoundStarted_ = true;
     }
 }
@@ -231,8 +263,8 @@ bool Validator::getCurrentRecordName(std::string &name) const {
     // if the top of the stack is a record I want this record name
     auto idx = static_cast<int>(compoundStack_.size() - ((!compoundStack_.empty() && (isPrimitive(nextType_) || nextType_ == AVRO_RECORD)) ? 1 : 2));
 
-    if (idx >= 0 && compoundStack_[idx].node->type() == AVRO_RECORD) {
-        name = compoundStack_[idx].node->name().simpleName();
+    if (idx >= 0 && steps_[compoundStack_[idx].step].type == AVRO_RECORD) {
+        name = steps_[compoundStack_[idx].step].node->name().simpleName();
         found = true;
     }
     return found;
@@ -242,9 +274,9 @@ bool Validator::getNextFieldName(std::string &name) const {
     auto found = false;
     name.clear();
     auto idx = static_cast<int>(compoundStack_.size() - (isCompound(nextType_) ? 2 : 1));
-    if (idx >= 0 && compoundStack_[idx].node->type() == AVRO_RECORD) {
+    if (idx >= 0 && steps_[compoundStack_[idx].step].type == AVRO_RECORD) {
         size_t pos = compoundStack_[idx].pos - 1;
-        const NodePtr &node = compoundStack_[idx].node;
+        const Node *node = steps_[compoundStack_[idx].step].node;
         if (pos < node->leaves()) {
             name = node->nameAt(pos);
             found = true;
@@ -19,39 +19,14 @@
 #include "Zigzag.hh"
 
 namespace avro {
-// TODO: The following two functions have exactly the same code except for the type.
-// They should be implemented as a template.
 size_t
 encodeInt64(int64_t input, std::array<uint8_t, 10> &output) noexcept {
-    auto val = encodeZigzag64(input);
-
-    // put values in an array of bytes with variable length encoding
-    const int mask = 0x7F;
-    auto v = val & mask;
-    size_t bytesOut = 0;
-    while (val >>= 7) {
-        output[bytesOut++] = (v | 0x80);
-        v = val & mask;
-    }
-
-    output[bytesOut++] = v;
-    return bytesOut;
+    return encodeVarint(encodeZigzag64(input), output.data());
 }
+
 size_t
 encodeInt32(int32_t input, std::array<uint8_t, 5> &output) noexcept {
-    auto val = encodeZigzag32(input);
-
-    // put values in an array of bytes with variable length encoding
-    const int mask = 0x7F;
-    auto v = val & mask;
-    size_t bytesOut = 0;
-    while (val >>= 7) {
-        output[bytesOut++] = (v | 0x80);
-        v = val & mask;
-    }
-
-    output[bytesOut++] = v;
-    return bytesOut;
+    return encodeVarint(encodeZigzag32(input), output.data());
 }
 
 } // namespace avro
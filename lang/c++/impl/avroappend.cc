@@ -0,0 +1,87 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+#include <sys/stat.h>
+
+#include "DataFile.hh"
+
+using std::string;
+using std::vector;
+
+namespace po = boost::program_options;
+
+static bool exists(const string &filename) {
+    struct stat st;
+    return ::stat(filename.c_str(), &st) == 0;
+}
+
+// Appends the blocks of the input data files to the output file, creating
+// it with the schema and codec of the first input if it does not exist.
+int main(int argc, char **argv) {
+    const string OUT("output");
+    const string IN("input");
+
+    po::options_description desc("Allowed options");
+    desc.add_options()("help,h", "produce help message")("output,o", po::value<string>(), "data file to append to, created if missing")("input,i", po::value<vector<string>>(), "data files to append");
+    po::positional_options_description pos;
+    pos.add(IN.c_str(), -1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(desc).positional(pos).run(), vm);
+        po::notify(vm);
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    if (vm.count("help") || vm.count(IN) == 0 || vm.count(OUT) == 0) {
+        std::cout << "Usage: avroappend -o output input...\n"
+                  << desc << std::endl;
+        return 1;
+    }
+
+    const string outf = vm[OUT].as<string>();
+    const vector<string> &inputs = vm[IN].as<vector<string>>();
+
+    try {
+        std::unique_ptr<avro::DataFileAppender> appender;
+        if (exists(outf)) {
+            appender.reset(new avro::DataFileAppender(outf.c_str()));
+        } else {
+            avro::DataFileBlockReader first(inputs.front().c_str());
+            appender.reset(new avro::DataFileAppender(outf.c_str(), first.dataSchema(), first.codecName()));
+        }
+        int64_t count = 0;
+        for (vector<string>::const_iterator it = inputs.begin(); it != inputs.end(); ++it) {
+            count += appender->append(it->c_str());
+        }
+        appender->close();
+        std::cout << "Appended " << count << " objects to " << outf << std::endl;
+        return 0;
+    } catch (std::exception &e) {
+        std::cerr << "Failed to append: " << e.what() << std::endl;
+        return 1;
+    }
+}
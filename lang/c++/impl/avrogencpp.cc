@@ -16,7 +16,9 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <cctype>
+#include <cmath>
 #ifndef _WIN32
 #include <ctime>
 #endif
@@ -35,9 +37,14 @@
 #include <boost/algorithm/string_regex.hpp>
 
 #include "Compiler.hh"
+#include "Generic.hh"
+#include "GenericDatum.hh"
 #include "NodeImpl.hh"
+#include "SchemaSnapshot.hh"
+#include "Stream.hh"
 #include "ValidSchema.hh"
 
+using avro::GenericDatum;
 using avro::NodePtr;
 using avro::resolveSymbol;
 using std::ifstream;
@@ -84,22 +91,56 @@ class CodeGen {
     const std::string headerFile_;
     const std::string includePrefix_;
     const bool noUnion_;
+    const bool directCodec_;
+    const bool snapshot_;
+    const bool logicalTypes_;
+    const bool optional_;
+    const bool variant_;
+    const bool pmr_;
+    // ordered, unordered or flat: the container Avro maps are generated as.
+    const std::string mapContainer_;
+    const map<string, set<string>> projections_;
+    const map<string, map<string, size_t>> inlineCapacities_;
+    const vector<ValidSchema> writers_;
     const std::string guardString_;
     boost::mt19937 random_;
 
     vector<PendingSetterGetter> pendingGettersAndSetters;
     vector<PendingConstructor> pendingConstructors;
+    vector<NodePtr> pendingProjections;
+
+    // The reader and writer records, and the writer-only records, of the
+    // writer schema being resolved that still need read_ or skip_
+    // functions.
+    vector<std::pair<NodePtr, NodePtr>> pendingReads_;
+    set<string> reads_;
+    vector<NodePtr> pendingSkips_;
+    set<string> skips_;
 
     map<NodePtr, string> done;
     set<NodePtr> doing;
+    // Unions generated as std::optional rather than as a union struct.
+    set<NodePtr> optionals_;
+    // Unions whose traits are out; the compiler makes identical unions one
+    // node, which several fields may have.
+    set<NodePtr> unionTraits_;
+    set<string> inlined_;
 
     std::string guard();
     std::string fullname(const string &name) const;
     std::string generateEnumType(const NodePtr &n);
     std::string cppTypeOf(const NodePtr &n);
+    std::string arrayType(const std::string &item) const;
+    std::string mapType(const std::string &value) const;
+    bool allocatorAware(const NodePtr &n) const;
     std::string generateRecordType(const NodePtr &n);
+    void generateAllocatorConstructors(const NodePtr &n, const vector<string> &types,
+                                       const vector<bool> &inlineFields);
     std::string unionName();
     std::string generateUnionType(const NodePtr &n);
+    std::string generateVariantType(const NodePtr &n, const vector<string> &types, const vector<string> &names);
+    std::string setBranch(const NodePtr &u, size_t branch, const std::string &target, const std::string &value);
+    const map<string, size_t> *inlineCapacitiesOf(const NodePtr &n) const;
     std::string generateType(const NodePtr &n);
     std::string generateDeclaration(const NodePtr &n);
     std::string doGenerateType(const NodePtr &n);
@@ -107,15 +148,43 @@ class CodeGen {
     void generateTraits(const NodePtr &n);
     void generateRecordTraits(const NodePtr &n);
     void generateUnionTraits(const NodePtr &n);
+    void generateDirectEnumTraits(const std::string &fn, const std::string &last);
+    void generateDirectRecordTraits(const NodePtr &n, const std::string &fn);
+    void generateDirectUnionTraits(const NodePtr &n, const std::string &fn);
+    const set<string> *projectionOf(const NodePtr &n) const;
+    void generateSkip(const NodePtr &n, const std::string &indent, size_t depth, bool writer = false);
+    void generateSkipTraits(const NodePtr &n, const std::string &fn);
+    void generateProjectionTraits(const NodePtr &n);
+    void generateSnapshot(const ValidSchema &schema, const std::string &type);
+    void generateResolve(const NodePtr &w, const NodePtr &r, const std::string &target,
+                         const std::string &indent, size_t depth);
+    void generateResolveBranch(const NodePtr &w, const NodePtr &r, size_t branch, const std::string &target,
+                               const std::string &indent, size_t depth);
+    void generateDefault(const NodePtr &r, const GenericDatum &g, const std::string &target,
+                         const std::string &indent, size_t depth);
+    void generateResolvingTraits(const NodePtr &root, const ValidSchema &writer, size_t index);
+    void generateResolvingWriters(const NodePtr &root);
     void emitCopyright();
 
 public:
     CodeGen(std::ostream &os, std::string ns,
             std::string schemaFile, std::string headerFile,
             std::string guardString,
-            std::string includePrefix, bool noUnion) : unionNumber_(0), os_(os), inNamespace_(false), ns_(std::move(ns)),
-                                                       schemaFile_(std::move(schemaFile)), headerFile_(std::move(headerFile)),
-                                                       includePrefix_(std::move(includePrefix)), noUnion_(noUnion),
+            std::string includePrefix, bool noUnion,
+            bool directCodec, bool snapshot, bool logicalTypes,
+            bool optional, bool variant, bool pmr, std::string mapContainer,
+            map<string, set<string>> projections,
+            map<string, map<string, size_t>> inlineCapacities,
+            vector<ValidSchema> writers) : unionNumber_(0), os_(os), inNamespace_(false), ns_(std::move(ns)),
+                                           schemaFile_(std::move(schemaFile)), headerFile_(std::move(headerFile)),
+                                           includePrefix_(std::move(includePrefix)), noUnion_(noUnion),
+                                           directCodec_(directCodec), snapshot_(snapshot),
+                                           logicalTypes_(logicalTypes),
+                                           optional_(optional), variant_(variant), pmr_(pmr),
+                                           mapContainer_(std::move(mapContainer)),
+                                           projections_(std::move(projections)),
+                                           inlineCapacities_(std::move(inlineCapacities)),
+                                           writers_(std::move(writers)),
                                                        guardString_(std::move(guardString)),
                                                        random_(static_cast<uint32_t>(::time(nullptr))) {}
     void generate(const ValidSchema &schema);
@@ -160,12 +229,53 @@ string CodeGen::generateEnumType(const NodePtr &n) {
     return s;
 }
 
+// Returns the native type of the logical type of n, for --logical-types,
+// or an empty string if n has none.
+static string logicalCppTypeOf(const NodePtr &n) {
+    const avro::LogicalType lt = n->logicalType();
+    switch (lt.type()) {
+        case avro::LogicalType::DECIMAL:
+            if (lt.precision() > 38) {
+                throw avro::Exception(boost::format("Decimal precision %1% is too large for a native type") % lt.precision());
+            }
+            if (n->type() == avro::AVRO_BYTES) {
+                return lt.precision() <= 18 ? "avro::Decimal" : "avro::Decimal128";
+            } else if (n->type() == avro::AVRO_FIXED) {
+                return string(lt.precision() <= 18 ? "avro::FixedDecimal<" : "avro::FixedDecimal128<")
+                    + lexical_cast<string>(n->fixedSize()) + ">";
+            }
+            break;
+        case avro::LogicalType::TIMESTAMP_MILLIS:
+            return "avro::TimestampMillis";
+        case avro::LogicalType::TIMESTAMP_MICROS:
+            return "avro::TimestampMicros";
+        case avro::LogicalType::UUID:
+            if (n->type() == avro::AVRO_STRING) {
+                return "avro::Uuid";
+            }
+            break;
+        default:
+            break;
+    }
+    return string();
+}
+
+static NodePtr resolved(const NodePtr &n) {
+    return (n->type() == avro::AVRO_SYMBOLIC) ? resolveSymbol(n) : n;
+}
+
 string CodeGen::cppTypeOf(const NodePtr &n) {
+    if (logicalTypes_) {
+        string t = logicalCppTypeOf(n);
+        if (!t.empty()) {
+            return t;
+        }
+    }
     switch (n->type()) {
         case avro::AVRO_STRING:
-            return "std::string";
+            return pmr_ ? "std::pmr::string" : "std::string";
         case avro::AVRO_BYTES:
-            return "std::vector<uint8_t>";
+            return pmr_ ? "std::pmr::vector<uint8_t>" : "std::vector<uint8_t>";
         case avro::AVRO_INT:
             return "int32_t";
         case avro::AVRO_LONG:
@@ -182,14 +292,17 @@ string CodeGen::cppTypeOf(const NodePtr &n) {
             return inNamespace_ ? nm : fullname(nm);
         }
         case avro::AVRO_ARRAY:
-            return "std::vector<" + cppTypeOf(n->leafAt(0)) + " >";
+            return arrayType(cppTypeOf(n->leafAt(0)));
         case avro::AVRO_MAP:
-            return "std::map<std::string, " + cppTypeOf(n->leafAt(1)) + " >";
+            return mapType(cppTypeOf(n->leafAt(1)));
         case avro::AVRO_FIXED:
             return "std::array<uint8_t, " + lexical_cast<string>(n->fixedSize()) + ">";
         case avro::AVRO_SYMBOLIC:
             return cppTypeOf(resolveSymbol(n));
         case avro::AVRO_UNION:
+            if (optionals_.count(n) != 0) {
+                return "std::optional<" + cppTypeOf(n->leafAt(1)) + " >";
+            }
             return fullname(done[n]);
         case avro::AVRO_NULL:
             return "avro::null";
@@ -198,6 +311,40 @@ string CodeGen::cppTypeOf(const NodePtr &n) {
     }
 }
 
+string CodeGen::arrayType(const std::string &item) const {
+    return (pmr_ ? "std::pmr::vector<" : "std::vector<") + item + " >";
+}
+
+string CodeGen::mapType(const std::string &value) const {
+    if (pmr_) {
+        return "std::pmr::map<std::pmr::string, " + value + " >";
+    } else if (mapContainer_ == "unordered") {
+        return "std::unordered_map<std::string, " + value + " >";
+    } else if (mapContainer_ == "flat") {
+        return "avro::FlatMap<" + value + " >";
+    }
+    return "std::map<std::string, " + value + " >";
+}
+
+// Whether the type generated for n is constructed with an allocator,
+// with --pmr.
+bool CodeGen::allocatorAware(const NodePtr &n) const {
+    NodePtr nn = resolved(n);
+    if (!pmr_ || (logicalTypes_ && !logicalCppTypeOf(nn).empty())) {
+        return false;
+    }
+    switch (nn->type()) {
+        case avro::AVRO_STRING:
+        case avro::AVRO_BYTES:
+        case avro::AVRO_ARRAY:
+        case avro::AVRO_MAP:
+        case avro::AVRO_RECORD:
+            return true;
+        default:
+            return false;
+    }
+}
+
 static string cppNameOf(const NodePtr &n) {
     switch (n->type()) {
         case avro::AVRO_NULL:
@@ -244,6 +391,28 @@ string CodeGen::generateRecordType(const NodePtr &n) {
         return it->second;
     }
 
+    vector<bool> inlineFields(c, false);
+    if (const map<string, size_t> *capacities = inlineCapacitiesOf(n)) {
+        for (map<string, size_t>::const_iterator ct = capacities->begin(); ct != capacities->end(); ++ct) {
+            size_t pos;
+            if (!n->nameIndex(ct->first, pos) || resolved(n->leafAt(pos))->type() != avro::AVRO_ARRAY) {
+                throw avro::Exception(boost::format("No array field named %1% in record %2%") % ct->first % n->name());
+            }
+            // The items are held inline, so they must be complete here.
+            NodePtr item = resolved(resolved(n->leafAt(pos))->leafAt(0));
+            if ((item->type() == avro::AVRO_RECORD || item->type() == avro::AVRO_UNION)
+                && done.find(item) == done.end()) {
+                throw avro::Exception(boost::format("Cannot hold the items of %1%.%2% inline in their own type")
+                                      % n->name() % ct->first);
+            }
+            types[pos] = "avro::SmallVector<" + generateType(item) + ", "
+                + lexical_cast<string>(ct->second) + ">";
+            inlineFields[pos] = true;
+        }
+        inlined_.insert(n->name().fullname());
+        inlined_.insert(n->name().simpleName());
+    }
+
     os_ << "struct " << decoratedName << " {\n";
     if (!noUnion_) {
         for (size_t i = 0; i < c; ++i) {
@@ -265,6 +434,12 @@ string CodeGen::generateRecordType(const NodePtr &n) {
         os_ << ' ' << decoratedNameAt << ";\n";
     }
 
+    if (pmr_) {
+        generateAllocatorConstructors(n, types, inlineFields);
+        os_ << "};\n\n";
+        return decoratedName;
+    }
+
     os_ << "    " << decoratedName << "()";
     if (c > 0) {
         os_ << " :";
@@ -293,6 +468,54 @@ string CodeGen::generateRecordType(const NodePtr &n) {
     return decoratedName;
 }
 
+// Emits the constructors of a record generated with --pmr: the fields that
+// take an allocator get the record's, so that std::pmr containers of the
+// record pass theirs down to its strings, vectors and maps.
+void CodeGen::generateAllocatorConstructors(const NodePtr &n, const vector<string> &types,
+                                            const vector<bool> &inlineFields) {
+    size_t c = n->leaves();
+    string decoratedName = decorate(n->name());
+    vector<string> names;
+    vector<bool> aware;
+    for (size_t i = 0; i < c; ++i) {
+        names.push_back(decorate(n->nameAt(i)));
+        aware.push_back(!inlineFields[i] && allocatorAware(n->leafAt(i)));
+    }
+    const char *a = std::find(aware.begin(), aware.end(), true) == aware.end() ? "" : "a";
+    const char *other = c == 0 ? "" : "other";
+
+    os_ << "    typedef std::pmr::polymorphic_allocator<char> allocator_type;\n"
+        << "    " << decoratedName << "() : " << decoratedName << "(allocator_type()) { }\n"
+        << "    explicit " << decoratedName << "(const allocator_type &" << a << ")";
+    for (size_t i = 0; i < c; ++i) {
+        os_ << (i == 0 ? " :\n" : ",\n") << "        " << names[i] << "(";
+        if (aware[i]) {
+            os_ << "a";
+        } else if (!noUnion_ && n->leafAt(i)->type() == avro::AVRO_UNION) {
+            os_ << names[i] << "_t()";
+        } else {
+            os_ << types[i] << "()";
+        }
+        os_ << ")";
+    }
+    os_ << "\n        { }\n";
+
+    for (int move = 0; move < 2; ++move) {
+        os_ << "    " << decoratedName << "(" << (move ? "" : "const ") << decoratedName
+            << (move ? " &&" : " &") << other << ", const allocator_type &" << a << ")";
+        for (size_t i = 0; i < c; ++i) {
+            string value = move ? "std::move(other." + names[i] + ")" : "other." + names[i];
+            os_ << (i == 0 ? " :\n" : ",\n") << "        " << names[i] << "(" << value
+                << (aware[i] ? ", a" : "") << ")";
+        }
+        os_ << "\n        { }\n";
+    }
+    os_ << "    " << decoratedName << "(const " << decoratedName << " &) = default;\n"
+        << "    " << decoratedName << "(" << decoratedName << " &&) = default;\n"
+        << "    " << decoratedName << " &operator=(const " << decoratedName << " &) = default;\n"
+        << "    " << decoratedName << " &operator=(" << decoratedName << " &&) = default;\n";
+}
+
 void makeCanonical(string &s, bool foldCase) {
     for (char &c : s) {
         if (isalpha(c)) {
@@ -305,6 +528,103 @@ void makeCanonical(string &s, bool foldCase) {
     }
 }
 
+// Returns the name of the generated function for the named type n.
+static string functionName(const char *prefix, const NodePtr &n) {
+    string s = n->name().fullname();
+    makeCanonical(s, false);
+    return prefix + s;
+}
+
+// Whether data written as w can be read as r, which are not unions.
+// With exact, primitive promotions do not count.
+static bool resolvable(const NodePtr &writer, const NodePtr &reader, bool exact) {
+    NodePtr w = resolved(writer);
+    NodePtr r = resolved(reader);
+    if (w->type() == r->type()) {
+        switch (w->type()) {
+            case avro::AVRO_RECORD:
+            case avro::AVRO_ENUM:
+                return w->name() == r->name();
+            case avro::AVRO_FIXED:
+                return w->name() == r->name() && w->fixedSize() == r->fixedSize();
+            default:
+                return true;
+        }
+    }
+    if (exact) {
+        return false;
+    }
+    switch (w->type()) {
+        case avro::AVRO_INT:
+            return r->type() == avro::AVRO_LONG || r->type() == avro::AVRO_FLOAT || r->type() == avro::AVRO_DOUBLE;
+        case avro::AVRO_LONG:
+            return r->type() == avro::AVRO_FLOAT || r->type() == avro::AVRO_DOUBLE;
+        case avro::AVRO_FLOAT:
+            return r->type() == avro::AVRO_DOUBLE;
+        case avro::AVRO_STRING:
+            return r->type() == avro::AVRO_BYTES;
+        case avro::AVRO_BYTES:
+            return r->type() == avro::AVRO_STRING;
+        default:
+            return false;
+    }
+}
+
+// Returns the branch of reader union r that data written as w is read
+// into: the first one of the same type, else the first promotion.
+static bool findBranch(const NodePtr &w, const NodePtr &r, size_t &branch) {
+    for (int exact = 1; exact >= 0; --exact) {
+        for (size_t i = 0; i < r->leaves(); ++i) {
+            if (resolvable(w, r->leafAt(i), exact != 0)) {
+                branch = i;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static const char *decodeCall(avro::Type t) {
+    switch (t) {
+        case avro::AVRO_BOOL:
+            return "d.decodeBool()";
+        case avro::AVRO_INT:
+            return "d.decodeInt()";
+        case avro::AVRO_LONG:
+            return "d.decodeLong()";
+        case avro::AVRO_FLOAT:
+            return "d.decodeFloat()";
+        case avro::AVRO_DOUBLE:
+            return "d.decodeDouble()";
+        default:
+            return "$Undefined$";
+    }
+}
+
+static string cppStringLiteral(const string &s) {
+    string result = "\"";
+    for (char ch : s) {
+        unsigned char c = static_cast<unsigned char>(ch);
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += ch;
+        } else if (c < 0x20 || c >= 0x7f) {
+            result += (boost::format("\\%03o") % static_cast<unsigned int>(c)).str();
+        } else {
+            result += ch;
+        }
+    }
+    return result + "\"";
+}
+
+static string byteList(const vector<uint8_t> &bytes) {
+    string result;
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        result += (boost::format(i == 0 ? "0x%02x" : ", 0x%02x") % static_cast<unsigned int>(bytes[i])).str();
+    }
+    return result;
+}
+
 string CodeGen::unionName() {
     string s = schemaFile_;
     string::size_type n = s.find_last_of("/\\");
@@ -360,6 +680,9 @@ string CodeGen::generateUnionType(const NodePtr &n) {
     vector<string> types;
     vector<string> names;
 
+    // Only the types of branches generated here are complete, which
+    // std::optional and std::variant need.
+    bool complete = false;
     auto it = doing.find(n);
     if (it != doing.end()) {
         for (size_t i = 0; i < c; ++i) {
@@ -375,11 +698,21 @@ string CodeGen::generateUnionType(const NodePtr &n) {
             names.push_back(cppNameOf(nn));
         }
         doing.erase(n);
+        complete = true;
     }
     if (done.find(n) != done.end()) {
         return done[n];
     }
 
+    if (complete && optional_ && c == 2 && n->leafAt(0)->type() == avro::AVRO_NULL
+        && n->leafAt(1)->type() != avro::AVRO_NULL) {
+        optionals_.insert(n);
+        return "std::optional<" + types[1] + " >";
+    }
+    if (complete && variant_) {
+        return generateVariantType(n, types, names);
+    }
+
     auto result = unionName();
 
     os_ << "struct " << result << " {\n"
@@ -417,6 +750,60 @@ string CodeGen::generateUnionType(const NodePtr &n) {
     return result;
 }
 
+/**
+ * Generates a union struct with the accessors of generateUnionType(), over
+ * a std::variant of the branches' types, null being std::monostate.
+ */
+string CodeGen::generateVariantType(const NodePtr &n, const vector<string> &types, const vector<string> &names) {
+    size_t c = n->leaves();
+    string variant = "std::variant<";
+    for (size_t i = 0; i < c; ++i) {
+        variant += i == 0 ? "" : ", ";
+        variant += n->leafAt(i)->type() == avro::AVRO_NULL ? "std::monostate" : types[i];
+    }
+    variant += " >";
+
+    auto result = unionName();
+
+    os_ << "struct " << result << " {\n"
+        << "private:\n"
+        << "    " << variant << " value_;\n"
+        << "public:\n"
+        << "    size_t idx() const { return value_.index(); }\n"
+        << "    const " << variant << " &value() const { return value_; }\n"
+        << "    " << variant << " &value() { return value_; }\n";
+
+    for (size_t i = 0; i < c; ++i) {
+        const NodePtr &nn = n->leafAt(i);
+        if (nn->type() == avro::AVRO_NULL) {
+            os_ << "    bool is_null() const {\n"
+                << "        return (value_.index() == " << i << ");\n"
+                << "    }\n"
+                << "    void set_null() {\n"
+                << "        value_.emplace<" << i << ">();\n"
+                << "    }\n";
+        } else {
+            const string &type = types[i];
+            const string &name = names[i];
+            os_ << "    const " << type << " &get_" << name << "() const {\n"
+                << "        if (value_.index() != " << i << ") {\n"
+                << "            throw avro::Exception(\"Invalid type for union\");\n"
+                << "        }\n"
+                << "        return std::get<" << i << ">(value_);\n"
+                << "    }\n"
+                << "    void set_" << name << "(const " << type << " &v) {\n"
+                << "        value_.emplace<" << i << ">(v);\n"
+                << "    }\n"
+                << "    void set_" << name << "(" << type << " &&v) {\n"
+                << "        value_.emplace<" << i << ">(std::move(v));\n"
+                << "    }\n";
+        }
+    }
+    os_ << "};\n\n";
+
+    return result;
+}
+
 /**
  * Returns the type for the given schema node and emits code to os.
  */
@@ -454,7 +841,7 @@ string CodeGen::doGenerateType(const NodePtr &n) {
             } else {
                 dn = generateDeclaration(ln);
             }
-            return "std::vector<" + dn + " >";
+            return arrayType(dn);
         }
         case avro::AVRO_MAP: {
             const NodePtr &ln = n->leafAt(1);
@@ -466,7 +853,7 @@ string CodeGen::doGenerateType(const NodePtr &n) {
             } else {
                 dn = generateDeclaration(ln);
             }
-            return "std::map<std::string, " + dn + " >";
+            return mapType(dn);
         }
         case avro::AVRO_RECORD:
             return generateRecordType(n);
@@ -494,9 +881,9 @@ string CodeGen::generateDeclaration(const NodePtr &n) {
         case avro::AVRO_FIXED:
             return cppTypeOf(nn);
         case avro::AVRO_ARRAY:
-            return "std::vector<" + generateDeclaration(nn->leafAt(0)) + " >";
+            return arrayType(generateDeclaration(nn->leafAt(0)));
         case avro::AVRO_MAP:
-            return "std::map<std::string, " + generateDeclaration(nn->leafAt(1)) + " >";
+            return mapType(generateDeclaration(nn->leafAt(1)));
         case avro::AVRO_RECORD:
             os_ << "struct " << cppTypeOf(nn) << ";\n";
             return cppTypeOf(nn);
@@ -542,6 +929,27 @@ void CodeGen::generateEnumTraits(const NodePtr &n) {
         << "        v = static_cast<" << fn << ">(index);\n"
         << "    }\n"
         << "};\n\n";
+
+    if (directCodec_) {
+        generateDirectEnumTraits(fn, last);
+    }
+}
+
+void CodeGen::generateDirectEnumTraits(const std::string &fn, const std::string &last) {
+    os_ << "template<> struct direct_codec_traits<" << fn << "> {\n"
+        << "    template<typename E>\n"
+        << "    static void encode(E& e, " << fn << " v) {\n"
+        << "        e.encodeEnum(static_cast<size_t>(v));\n"
+        << "    }\n"
+        << "    template<typename D>\n"
+        << "    static void decode(D& d, " << fn << "& v) {\n"
+        << "        size_t index = d.decodeEnum();\n"
+        << "        if (index > static_cast<size_t>(" << fn << "::" << last << ")) {\n"
+        << "            throw avro::Exception(\"Enum value out of bound for " << fn << "\");\n"
+        << "        }\n"
+        << "        v = static_cast<" << fn << ">(index);\n"
+        << "    }\n"
+        << "};\n\n";
 }
 
 void CodeGen::generateRecordTraits(const NodePtr &n) {
@@ -593,21 +1001,199 @@ void CodeGen::generateRecordTraits(const NodePtr &n) {
 
     os_ << "    }\n"
         << "};\n\n";
+
+    if (directCodec_) {
+        generateDirectRecordTraits(n, fn);
+    }
+    if (!projections_.empty()) {
+        generateSkipTraits(n, fn);
+        if (projectionOf(n) != nullptr) {
+            pendingProjections.push_back(n);
+        }
+    }
+}
+
+const set<string> *CodeGen::projectionOf(const NodePtr &n) const {
+    map<string, set<string>>::const_iterator it = projections_.find(n->name().fullname());
+    if (it == projections_.end()) {
+        it = projections_.find(n->name().simpleName());
+    }
+    return it == projections_.end() ? nullptr : &it->second;
+}
+
+const map<string, size_t> *CodeGen::inlineCapacitiesOf(const NodePtr &n) const {
+    map<string, map<string, size_t>>::const_iterator it = inlineCapacities_.find(n->name().fullname());
+    if (it == inlineCapacities_.end()) {
+        it = inlineCapacities_.find(n->name().simpleName());
+    }
+    return it == inlineCapacities_.end() ? nullptr : &it->second;
+}
+
+// Emits statements that skip over a value of schema n in decoder d.
+// depth keeps the loop variables of nested arrays and maps apart.
+void CodeGen::generateSkip(const NodePtr &n, const std::string &indent, size_t depth, bool writer) {
+    const string count = "n" + lexical_cast<string>(depth);
+    const string index = "i" + lexical_cast<string>(depth);
+    switch (n->type()) {
+        case avro::AVRO_NULL:
+            break;
+        case avro::AVRO_BOOL:
+            os_ << indent << "d.decodeBool();\n";
+            break;
+        case avro::AVRO_INT:
+        case avro::AVRO_LONG:
+            os_ << indent << "d.decodeLong();\n";
+            break;
+        case avro::AVRO_FLOAT:
+            os_ << indent << "d.decodeFloat();\n";
+            break;
+        case avro::AVRO_DOUBLE:
+            os_ << indent << "d.decodeDouble();\n";
+            break;
+        case avro::AVRO_STRING:
+            os_ << indent << "d.skipString();\n";
+            break;
+        case avro::AVRO_BYTES:
+            os_ << indent << "d.skipBytes();\n";
+            break;
+        case avro::AVRO_FIXED:
+            os_ << indent << "d.skipFixed(" << n->fixedSize() << ");\n";
+            break;
+        case avro::AVRO_ENUM:
+            os_ << indent << "d.decodeEnum();\n";
+            break;
+        case avro::AVRO_ARRAY:
+        case avro::AVRO_MAP: {
+            bool isArray = n->type() == avro::AVRO_ARRAY;
+            const char *skip = isArray ? "skipArray" : "skipMap";
+            os_ << indent << "for (size_t " << count << " = d." << skip << "(); "
+                << count << " != 0; " << count << " = d." << skip << "()) {\n"
+                << indent << "    for (size_t " << index << " = 0; " << index << " < "
+                << count << "; ++" << index << ") {\n";
+            if (!isArray) {
+                os_ << indent << "        d.skipString();\n";
+            }
+            generateSkip(n->leafAt(isArray ? 0 : 1), indent + "        ", depth + 1, writer);
+            os_ << indent << "    }\n"
+                << indent << "}\n";
+            break;
+        }
+        case avro::AVRO_UNION:
+            os_ << indent << "switch (d.decodeUnionIndex()) {\n";
+            for (size_t i = 0; i < n->leaves(); ++i) {
+                os_ << indent << "case " << i << ":\n";
+                generateSkip(n->leafAt(i), indent + "    ", depth, writer);
+                os_ << indent << "    break;\n";
+            }
+            os_ << indent << "default:\n"
+                << indent << "    throw avro::Exception(\"Union index too big\");\n"
+                << indent << "}\n";
+            break;
+        case avro::AVRO_RECORD:
+        case avro::AVRO_SYMBOLIC:
+            if (writer) {
+                // Writer records have no C++ type; each gets a skip_
+                // function in the resolving_traits being generated.
+                NodePtr nn = (n->type() == avro::AVRO_SYMBOLIC) ? resolveSymbol(n) : n;
+                os_ << indent << functionName("skip_", nn) << "(d);\n";
+                if (skips_.insert(nn->name().fullname()).second) {
+                    pendingSkips_.push_back(nn);
+                }
+            } else {
+                os_ << indent << "avro::skip_traits<" << cppTypeOf(n) << " >::skip(d);\n";
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void CodeGen::generateSkipTraits(const NodePtr &n, const std::string &fn) {
+    os_ << "template<> struct skip_traits<" << fn << "> {\n"
+        << "    template<typename D>\n"
+        << "    static void skip(D& d) {\n";
+    for (size_t i = 0; i < n->leaves(); ++i) {
+        generateSkip(n->leafAt(i), "        ", 0);
+    }
+    if (n->leaves() == 0) {
+        os_ << "        (void) d;\n";
+    }
+    os_ << "    }\n"
+        << "};\n\n";
+}
+
+void CodeGen::generateProjectionTraits(const NodePtr &n) {
+    const set<string> &fields = *projectionOf(n);
+    for (set<string>::const_iterator it = fields.begin(); it != fields.end(); ++it) {
+        size_t pos;
+        if (!n->nameIndex(*it, pos)) {
+            throw avro::Exception(boost::format("No field named %1% in record %2%") % *it % n->name());
+        }
+    }
+
+    string fn = fullname(decorate(n->name()));
+    os_ << "template<> struct projection_traits<" << fn << "> {\n"
+        << "    static void decode(Decoder& d, " << fn << "& v) {\n";
+    for (size_t i = 0; i < n->leaves(); ++i) {
+        if (fields.count(n->nameAt(i)) == 0) {
+            generateSkip(n->leafAt(i), "        ", 0);
+            continue;
+        }
+        const NodePtr &leaf = n->leafAt(i);
+        NodePtr nn = (leaf->type() == avro::AVRO_SYMBOLIC) ? resolveSymbol(leaf) : leaf;
+        bool nested = nn->type() == avro::AVRO_RECORD && projectionOf(nn) != nullptr;
+        os_ << "        avro::" << (nested ? "decodeProjected" : "decode")
+            << "(d, v." << decorate(n->nameAt(i)) << ");\n";
+    }
+    os_ << "    }\n"
+        << "};\n\n";
+}
+
+void CodeGen::generateDirectRecordTraits(const NodePtr &n, const std::string &fn) {
+    size_t c = n->leaves();
+    os_ << "template<> struct direct_codec_traits<" << fn << "> {\n"
+        << "    template<typename E>\n"
+        << "    static void encode(E& e, const " << fn << "& v) {\n";
+    for (size_t i = 0; i < c; ++i) {
+        os_ << "        avro::directEncode(e, v." << decorate(n->nameAt(i)) << ");\n";
+    }
+    if (c == 0) {
+        os_ << "        (void) e;\n"
+            << "        (void) v;\n";
+    }
+    os_ << "    }\n"
+        << "    template<typename D>\n"
+        << "    static void decode(D& d, " << fn << "& v) {\n";
+    for (size_t i = 0; i < c; ++i) {
+        os_ << "        avro::directDecode(d, v." << decorate(n->nameAt(i)) << ");\n";
+    }
+    if (c == 0) {
+        os_ << "        (void) d;\n"
+            << "        (void) v;\n";
+    }
+    os_ << "    }\n"
+        << "};\n\n";
 }
 
 void CodeGen::generateUnionTraits(const NodePtr &n) {
+    if (!unionTraits_.insert(n).second) {
+        return;
+    }
     size_t c = n->leaves();
 
     for (size_t i = 0; i < c; ++i) {
         const NodePtr &nn = n->leafAt(i);
         generateTraits(nn);
     }
+    if (optionals_.count(n) != 0) {
+        return;
+    }
 
     string name = done[n];
     string fn = fullname(name);
 
     os_ << "template<> struct codec_traits<" << fn << "> {\n"
-        << "    static void encode(Encoder& e, " << fn << " v) {\n"
+        << "    static void encode(Encoder& e, const " << fn << "& v) {\n"
         << "        e.encodeUnionIndex(v.idx());\n"
         << "        switch (v.idx()) {\n";
 
@@ -649,6 +1235,54 @@ void CodeGen::generateUnionTraits(const NodePtr &n) {
     os_ << "        }\n"
         << "    }\n"
         << "};\n\n";
+
+    if (directCodec_) {
+        generateDirectUnionTraits(n, fn);
+    }
+}
+
+void CodeGen::generateDirectUnionTraits(const NodePtr &n, const std::string &fn) {
+    size_t c = n->leaves();
+    os_ << "template<> struct direct_codec_traits<" << fn << "> {\n"
+        << "    template<typename E>\n"
+        << "    static void encode(E& e, const " << fn << "& v) {\n"
+        << "        e.encodeUnionIndex(v.idx());\n"
+        << "        switch (v.idx()) {\n";
+    for (size_t i = 0; i < c; ++i) {
+        const NodePtr &nn = n->leafAt(i);
+        os_ << "        case " << i << ":\n";
+        if (nn->type() == avro::AVRO_NULL) {
+            os_ << "            e.encodeNull();\n";
+        } else {
+            os_ << "            avro::directEncode(e, v.get_" << cppNameOf(nn) << "());\n";
+        }
+        os_ << "            break;\n";
+    }
+    os_ << "        }\n"
+        << "    }\n"
+        << "    template<typename D>\n"
+        << "    static void decode(D& d, " << fn << "& v) {\n"
+        << "        size_t n = d.decodeUnionIndex();\n"
+        << "        if (n >= " << c << ") { throw avro::Exception(\"Union index too big\"); }\n"
+        << "        switch (n) {\n";
+    for (size_t i = 0; i < c; ++i) {
+        const NodePtr &nn = n->leafAt(i);
+        os_ << "        case " << i << ":\n";
+        if (nn->type() == avro::AVRO_NULL) {
+            os_ << "            d.decodeNull();\n"
+                << "            v.set_null();\n";
+        } else {
+            os_ << "            {\n"
+                << "                " << cppTypeOf(nn) << " vv;\n"
+                << "                avro::directDecode(d, vv);\n"
+                << "                v.set_" << cppNameOf(nn) << "(std::move(vv));\n"
+                << "            }\n";
+        }
+        os_ << "            break;\n";
+    }
+    os_ << "        }\n"
+        << "    }\n"
+        << "};\n\n";
 }
 
 void CodeGen::generateTraits(const NodePtr &n) {
@@ -681,6 +1315,443 @@ void CodeGen::generateTraits(const NodePtr &n) {
     }
 }
 
+// Emits statements that read a value written with schema w from decoder
+// d into target, whose type is generated for the reader's schema r.
+// depth keeps the local variables of nested values apart.
+void CodeGen::generateResolve(const NodePtr &writer, const NodePtr &reader, const std::string &target,
+                              const std::string &indent, size_t depth) {
+    NodePtr w = resolved(writer);
+    NodePtr r = resolved(reader);
+    const string suffix = lexical_cast<string>(depth);
+    size_t branch;
+    if (w->type() == avro::AVRO_UNION) {
+        os_ << indent << "switch (d.decodeUnionIndex()) {\n";
+        for (size_t i = 0; i < w->leaves(); ++i) {
+            const NodePtr &wb = w->leafAt(i);
+            os_ << indent << "case " << i << ": {\n";
+            if (r->type() == avro::AVRO_UNION) {
+                if (findBranch(wb, r, branch)) {
+                    generateResolveBranch(wb, r, branch, target, indent + "    ", depth);
+                } else {
+                    os_ << indent << "    throw avro::Exception(\"Writer union branch " << i
+                        << " has no match in the reader's union\");\n";
+                }
+            } else if (resolvable(wb, r, false)) {
+                generateResolve(wb, r, target, indent + "    ", depth);
+            } else {
+                os_ << indent << "    throw avro::Exception(\"Writer union branch " << i
+                    << " does not match the reader's schema\");\n";
+            }
+            os_ << indent << "    break;\n"
+                << indent << "}\n";
+        }
+        os_ << indent << "default:\n"
+            << indent << "    throw avro::Exception(\"Union index too big\");\n"
+            << indent << "}\n";
+        return;
+    }
+    if (r->type() == avro::AVRO_UNION) {
+        if (!findBranch(w, r, branch)) {
+            throw avro::Exception(boost::format("No branch of reader union %1% matches writer's %2%")
+                                  % cppTypeOf(r) % avro::toString(w->type()));
+        }
+        generateResolveBranch(w, r, branch, target, indent, depth);
+        return;
+    }
+    if (!resolvable(w, r, false)) {
+        throw avro::Exception(boost::format("Cannot read writer's %1% as reader's %2%")
+                              % avro::toString(w->type()) % cppTypeOf(r));
+    }
+    if (logicalTypes_ && !logicalCppTypeOf(r).empty()) {
+        if (w->type() != r->type()) {
+            throw avro::Exception(boost::format("Cannot read writer's %1% as reader's %2%")
+                                  % avro::toString(w->type()) % cppTypeOf(r));
+        }
+        os_ << indent << "avro::directDecode(d, " << target << ");\n";
+        return;
+    }
+    switch (r->type()) {
+        case avro::AVRO_NULL:
+            os_ << indent << "d.decodeNull();\n";
+            break;
+        case avro::AVRO_BOOL:
+        case avro::AVRO_INT:
+        case avro::AVRO_LONG:
+        case avro::AVRO_FLOAT:
+        case avro::AVRO_DOUBLE:
+            if (w->type() == r->type()) {
+                os_ << indent << target << " = " << decodeCall(w->type()) << ";\n";
+            } else {
+                os_ << indent << target << " = static_cast<" << cppTypeOf(r) << ">("
+                    << decodeCall(w->type()) << ");\n";
+            }
+            break;
+        case avro::AVRO_STRING:
+        case avro::AVRO_BYTES:
+            if (w->type() == r->type() && pmr_) {
+                os_ << indent << "avro::directDecode(d, " << target << ");\n";
+            } else if (w->type() == r->type()) {
+                os_ << indent << "d.decode" << (r->type() == avro::AVRO_STRING ? "String" : "Bytes")
+                    << "(" << target << ");\n";
+            } else {
+                os_ << indent << "{\n"
+                    << indent << "    " << (w->type() == avro::AVRO_STRING ? "std::string" : "std::vector<uint8_t>")
+                    << " vv" << suffix << ";\n"
+                    << indent << "    d.decode" << (w->type() == avro::AVRO_STRING ? "String" : "Bytes")
+                    << "(vv" << suffix << ");\n"
+                    << indent << "    " << target << ".assign(vv" << suffix << ".begin(), vv" << suffix << ".end());\n"
+                    << indent << "}\n";
+            }
+            break;
+        case avro::AVRO_FIXED:
+            os_ << indent << "d.decodeFixed(" << r->fixedSize() << ", " << target << ".data());\n";
+            break;
+        case avro::AVRO_ENUM: {
+            const string t = cppTypeOf(r);
+            os_ << indent << "switch (d.decodeEnum()) {\n";
+            for (size_t i = 0; i < w->names(); ++i) {
+                os_ << indent << "case " << i << ":\n";
+                size_t pos;
+                if (r->nameIndex(w->nameAt(i), pos)) {
+                    os_ << indent << "    " << target << " = static_cast<" << t << ">(" << pos << ");\n"
+                        << indent << "    break;\n";
+                } else {
+                    os_ << indent << "    throw avro::Exception(\"Enum symbol " << w->nameAt(i)
+                        << " is not in " << t << "\");\n";
+                }
+            }
+            os_ << indent << "default:\n"
+                << indent << "    throw avro::Exception(\"Enum value out of bound for " << t << "\");\n"
+                << indent << "}\n";
+            break;
+        }
+        case avro::AVRO_ARRAY: {
+            const string count = "n" + suffix;
+            const string index = "i" + suffix;
+            os_ << indent << target << ".clear();\n"
+                << indent << "for (size_t " << count << " = d.arrayStart(); " << count << " != 0; "
+                << count << " = d.arrayNext()) {\n"
+                << indent << "    " << target << ".reserve(avro::detail::reserveFor(" << target << ".size(), "
+                << target << ".capacity(), " << count << "));\n"
+                << indent << "    for (size_t " << index << " = 0; " << index << " < " << count
+                << "; ++" << index << ") {\n"
+                << indent << "        " << target << ".emplace_back();\n";
+            generateResolve(w->leafAt(0), r->leafAt(0), target + ".back()", indent + "        ", depth + 1);
+            os_ << indent << "    }\n"
+                << indent << "}\n";
+            break;
+        }
+        case avro::AVRO_MAP: {
+            const string count = "n" + suffix;
+            const string index = "i" + suffix;
+            const string key = "k" + suffix;
+            if (mapContainer_ == "flat") {
+                // Entries are decoded into the flat map's vector, which is
+                // sorted once at the end.
+                const string items = "e" + suffix;
+                os_ << indent << "{\n"
+                    << indent << "    auto " << items << " = " << target << ".extract();\n"
+                    << indent << "    " << items << ".clear();\n"
+                    << indent << "    for (size_t " << count << " = d.mapStart(); " << count << " != 0; "
+                    << count << " = d.mapNext()) {\n"
+                    << indent << "        " << items << ".reserve(avro::detail::reserveFor(" << items << ".size(), "
+                    << items << ".capacity(), " << count << "));\n"
+                    << indent << "        for (size_t " << index << " = 0; " << index << " < " << count << "; ++"
+                    << index << ") {\n"
+                    << indent << "            " << items << ".emplace_back();\n"
+                    << indent << "            d.decodeString(" << items << ".back().first);\n";
+                generateResolve(w->leafAt(1), r->leafAt(1), items + ".back().second", indent + "            ", depth + 1);
+                os_ << indent << "        }\n"
+                    << indent << "    }\n"
+                    << indent << "    " << target << ".assign(std::move(" << items << "));\n"
+                    << indent << "}\n";
+                break;
+            }
+            os_ << indent << target << ".clear();\n"
+                << indent << "for (size_t " << count << " = d.mapStart(); " << count << " != 0; "
+                << count << " = d.mapNext()) {\n";
+            if (mapContainer_ == "unordered") {
+                os_ << indent << "    " << target << ".reserve(avro::detail::reserveFor(" << target << ".size(), "
+                    << "static_cast<size_t>(" << target << ".bucket_count() * " << target << ".max_load_factor()), "
+                    << count << "));\n";
+            }
+            os_ << indent << "    for (size_t " << index << " = 0; " << index << " < " << count << "; ++"
+                << index << ") {\n";
+            if (pmr_) {
+                os_ << indent << "        std::pmr::string " << key << "(" << target << ".get_allocator());\n"
+                    << indent << "        avro::directDecode(d, " << key << ");\n";
+            } else {
+                os_ << indent << "        std::string " << key << ";\n"
+                    << indent << "        d.decodeString(" << key << ");\n";
+            }
+            generateResolve(w->leafAt(1), r->leafAt(1), target + "[" + key + "]", indent + "        ", depth + 1);
+            os_ << indent << "    }\n"
+                << indent << "}\n";
+            break;
+        }
+        case avro::AVRO_RECORD:
+            os_ << indent << functionName("read_", r) << "(d, " << target << ");\n";
+            if (reads_.insert(r->name().fullname()).second) {
+                pendingReads_.emplace_back(w, r);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Emits statements that read a value written as w into the given branch
+// of target, a reader union of schema r.
+void CodeGen::generateResolveBranch(const NodePtr &w, const NodePtr &r, size_t branch, const std::string &target,
+                                    const std::string &indent, size_t depth) {
+    const NodePtr &rb = r->leafAt(branch);
+    if (rb->type() == avro::AVRO_NULL) {
+        os_ << indent << "d.decodeNull();\n"
+            << indent << setBranch(r, branch, target, string()) << "\n";
+        return;
+    }
+    const string value = "vv" + lexical_cast<string>(depth);
+    os_ << indent << "{\n"
+        << indent << "    " << cppTypeOf(rb) << " " << value << ";\n";
+    generateResolve(w, rb, value, indent + "    ", depth + 1);
+    os_ << indent << "    " << setBranch(r, branch, target, value) << "\n"
+        << indent << "}\n";
+}
+
+// Returns the statement that moves value into the given branch of target,
+// a reader union of schema u; value is empty for the null branch.
+string CodeGen::setBranch(const NodePtr &u, size_t branch, const std::string &target, const std::string &value) {
+    const NodePtr &b = u->leafAt(branch);
+    if (optionals_.count(u) != 0) {
+        return b->type() == avro::AVRO_NULL ? target + ".reset();" : target + " = std::move(" + value + ");";
+    }
+    return b->type() == avro::AVRO_NULL ? target + ".set_null();"
+                                        : target + ".set_" + cppNameOf(b) + "(std::move(" + value + "));";
+}
+
+// Emits statements that set target, of reader schema r, to the default
+// value g of a field the writer does not have. Fields without a default
+// are reset to their type's value-initialized state.
+void CodeGen::generateDefault(const NodePtr &reader, const GenericDatum &g, const std::string &target,
+                              const std::string &indent, size_t depth) {
+    NodePtr r = resolved(reader);
+    if ((r->type() == avro::AVRO_UNION && !g.isUnion())
+        || (r->type() != avro::AVRO_UNION && r->type() != avro::AVRO_NULL && g.type() == avro::AVRO_NULL)) {
+        os_ << indent << target << " = " << cppTypeOf(r) << "();\n";
+        return;
+    }
+    if (logicalTypes_ && !logicalCppTypeOf(r).empty()) {
+        // Native types of logical types are decoded from the encoded
+        // default.
+        std::unique_ptr<avro::OutputStream> os = avro::memoryOutputStream();
+        avro::EncoderPtr e = avro::binaryEncoder();
+        e->init(*os);
+        avro::GenericWriter::write(*e, g);
+        e->flush();
+        const string value = "dv" + lexical_cast<string>(depth);
+        os_ << indent << "{\n"
+            << indent << "    static const uint8_t " << value << "[] = {" << byteList(*avro::snapshot(*os)) << "};\n"
+            << indent << "    avro::DirectBinaryDecoder d" << value << "(" << value << ", sizeof(" << value << "));\n"
+            << indent << "    avro::directDecode(d" << value << ", " << target << ");\n"
+            << indent << "}\n";
+        return;
+    }
+    switch (r->type()) {
+        case avro::AVRO_UNION: {
+            const NodePtr &rb = r->leafAt(g.unionBranch());
+            if (rb->type() == avro::AVRO_NULL) {
+                os_ << indent << setBranch(r, g.unionBranch(), target, string()) << "\n";
+                break;
+            }
+            const string value = "vv" + lexical_cast<string>(depth);
+            os_ << indent << "{\n"
+                << indent << "    " << cppTypeOf(rb) << " " << value << ";\n";
+            generateDefault(rb, g, value, indent + "    ", depth + 1);
+            os_ << indent << "    " << setBranch(r, g.unionBranch(), target, value) << "\n"
+                << indent << "}\n";
+            break;
+        }
+        case avro::AVRO_NULL:
+            break;
+        case avro::AVRO_BOOL:
+            os_ << indent << target << " = " << (g.value<bool>() ? "true" : "false") << ";\n";
+            break;
+        case avro::AVRO_INT:
+            os_ << indent << target << " = " << g.value<int32_t>() << ";\n";
+            break;
+        case avro::AVRO_LONG: {
+            int64_t l = g.value<int64_t>();
+            os_ << indent << target << " = ";
+            if (l == INT64_MIN) {
+                os_ << "(-9223372036854775807LL - 1)";
+            } else {
+                os_ << l << "LL";
+            }
+            os_ << ";\n";
+            break;
+        }
+        case avro::AVRO_FLOAT:
+        case avro::AVRO_DOUBLE: {
+            double v = r->type() == avro::AVRO_FLOAT ? g.value<float>() : g.value<double>();
+            if (!std::isfinite(v)) {
+                throw avro::Exception(boost::format("Cannot generate the default value of %1%") % target);
+            }
+            os_ << indent << target << " = static_cast<" << cppTypeOf(r) << ">("
+                << boost::format("%.17g") % v << ");\n";
+            break;
+        }
+        case avro::AVRO_STRING:
+            os_ << indent << target << " = " << cppStringLiteral(g.value<string>()) << ";\n";
+            break;
+        case avro::AVRO_BYTES:
+            os_ << indent << target << ".assign({" << byteList(g.value<vector<uint8_t>>()) << "});\n";
+            break;
+        case avro::AVRO_FIXED:
+            os_ << indent << target << " = " << cppTypeOf(r) << "{{"
+                << byteList(g.value<avro::GenericFixed>().value()) << "}};\n";
+            break;
+        case avro::AVRO_ENUM:
+            os_ << indent << target << " = static_cast<" << cppTypeOf(r) << ">("
+                << g.value<avro::GenericEnum>().value() << ");\n";
+            break;
+        case avro::AVRO_RECORD: {
+            const avro::GenericRecord &rec = g.value<avro::GenericRecord>();
+            for (size_t i = 0; i < r->leaves(); ++i) {
+                generateDefault(r->leafAt(i), rec.fieldAt(i), target + "." + decorate(r->nameAt(i)), indent, depth);
+            }
+            break;
+        }
+        case avro::AVRO_ARRAY: {
+            const vector<GenericDatum> &items = g.value<avro::GenericArray>().value();
+            os_ << indent << target << ".clear();\n";
+            if (!items.empty()) {
+                os_ << indent << target << ".resize(" << items.size() << ");\n";
+            }
+            for (size_t i = 0; i < items.size(); ++i) {
+                generateDefault(r->leafAt(0), items[i], target + "[" + lexical_cast<string>(i) + "]", indent, depth);
+            }
+            break;
+        }
+        case avro::AVRO_MAP: {
+            const avro::GenericMap::Value &entries = g.value<avro::GenericMap>().value();
+            os_ << indent << target << ".clear();\n";
+            for (avro::GenericMap::Value::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+                generateDefault(r->leafAt(1), it->second, target + "[" + cppStringLiteral(it->first) + "]", indent, depth);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Emits resolving_traits<T, index>, whose decode() reads data written with
+// the given writer schema into the type generated for root. Every reader
+// record met gets a read_ function and every writer-only record a skip_
+// function, all static members of the traits so that they may recurse.
+void CodeGen::generateResolvingTraits(const NodePtr &root, const ValidSchema &writer, size_t index) {
+    pendingReads_.clear();
+    reads_.clear();
+    pendingSkips_.clear();
+    skips_.clear();
+
+    string fn = cppTypeOf(root);
+    os_ << "template<> struct resolving_traits<" << fn << ", " << index << "> {\n"
+        << "    static uint64_t fingerprint() {\n"
+        << "        return " << boost::format("0x%016xULL") % writer.rabinFingerprint() << ";\n"
+        << "    }\n\n"
+        << "    template<typename D>\n"
+        << "    static void decode(D& d, " << fn << "& v) {\n";
+    generateResolve(writer.root(), root, "v", "        ", 0);
+    os_ << "    }\n";
+
+    while (!pendingReads_.empty() || !pendingSkips_.empty()) {
+        if (!pendingReads_.empty()) {
+            NodePtr w = pendingReads_.back().first;
+            NodePtr r = pendingReads_.back().second;
+            pendingReads_.pop_back();
+            os_ << "\n"
+                << "    template<typename D>\n"
+                << "    static void " << functionName("read_", r) << "(D& d, " << cppTypeOf(r) << "& v) {\n";
+            vector<bool> written(r->leaves(), false);
+            for (size_t i = 0; i < w->leaves(); ++i) {
+                size_t pos;
+                if (r->nameIndex(w->nameAt(i), pos)) {
+                    written[pos] = true;
+                    generateResolve(w->leafAt(i), r->leafAt(pos), "v." + decorate(r->nameAt(pos)), "        ", 0);
+                } else {
+                    generateSkip(w->leafAt(i), "        ", 0, true);
+                }
+            }
+            bool set = false;
+            for (size_t i = 0; i < r->leaves(); ++i) {
+                if (!written[i]) {
+                    generateDefault(r->leafAt(i), r->defaultValueAt(i), "v." + decorate(r->nameAt(i)), "        ", 0);
+                    set = true;
+                }
+            }
+            if (w->leaves() == 0) {
+                os_ << "        (void) d;\n";
+            }
+            if (std::find(written.begin(), written.end(), true) == written.end() && !set) {
+                os_ << "        (void) v;\n";
+            }
+            os_ << "    }\n";
+        } else {
+            NodePtr w = pendingSkips_.back();
+            pendingSkips_.pop_back();
+            os_ << "\n"
+                << "    template<typename D>\n"
+                << "    static void " << functionName("skip_", w) << "(D& d) {\n";
+            for (size_t i = 0; i < w->leaves(); ++i) {
+                generateSkip(w->leafAt(i), "        ", 0, true);
+            }
+            if (w->leaves() == 0) {
+                os_ << "        (void) d;\n";
+            }
+            os_ << "    }\n";
+        }
+    }
+    os_ << "};\n\n";
+}
+
+// Emits resolving_writers<T>, which picks the resolving_traits for a writer
+// schema by its index or fingerprint.
+void CodeGen::generateResolvingWriters(const NodePtr &root) {
+    string fn = cppTypeOf(root);
+    os_ << "template<> struct resolving_writers<" << fn << "> {\n"
+        << "    static size_t count() {\n"
+        << "        return " << writers_.size() << ";\n"
+        << "    }\n\n"
+        << "    static size_t find(uint64_t fingerprint) {\n"
+        << "        switch (fingerprint) {\n";
+    set<uint64_t> fingerprints;
+    for (size_t i = 0; i < writers_.size(); ++i) {
+        if (!fingerprints.insert(writers_[i].rabinFingerprint()).second) {
+            throw avro::Exception(boost::format("Writer schema %1% is given more than once") % i);
+        }
+        os_ << "        case " << boost::format("0x%016xULL") % writers_[i].rabinFingerprint() << ":\n"
+            << "            return " << i << ";\n";
+    }
+    os_ << "        default:\n"
+        << "            throw avro::Exception(\"Unknown writer schema fingerprint for " << fn << "\");\n"
+        << "        }\n"
+        << "    }\n\n"
+        << "    template<typename D>\n"
+        << "    static void decode(D& d, size_t writer, " << fn << "& v) {\n"
+        << "        switch (writer) {\n";
+    for (size_t i = 0; i < writers_.size(); ++i) {
+        os_ << "        case " << i << ":\n"
+            << "            resolving_traits<" << fn << ", " << i << ">::decode(d, v);\n"
+            << "            break;\n";
+    }
+    os_ << "        default:\n"
+        << "            throw avro::Exception(\"Writer schema index out of range for " << fn << "\");\n"
+        << "        }\n"
+        << "    }\n"
+        << "};\n\n";
+}
+
 void CodeGen::emitCopyright() {
     os_ << "/**\n"
            " * Licensed to the Apache Software Foundation (ASF) under one\n"
@@ -711,6 +1782,26 @@ string CodeGen::guard() {
     return h + "_" + lexical_cast<string>(random_()) + "__H_";
 }
 
+// Emits <type>_schema(), which returns the schema loaded from a snapshot
+// embedded in the header.
+void CodeGen::generateSnapshot(const ValidSchema &schema, const std::string &type) {
+    if (type.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_") != string::npos) {
+        throw avro::Exception(boost::format("Cannot name the schema snapshot of %1%") % type);
+    }
+    vector<uint8_t> bytes = snapshotSchema(schema);
+    os_ << "inline const avro::ValidSchema &" << type << "_schema() {\n"
+        << "    static const uint8_t snapshot[] = {";
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        os_ << (i % 16 == 0 ? "\n        " : " ")
+            << boost::format("0x%02x,") % static_cast<unsigned int>(bytes[i]);
+    }
+    os_ << "\n    };\n"
+        << "    static const avro::ValidSchema schema =\n"
+        << "        avro::loadSchemaSnapshot(snapshot, sizeof(snapshot));\n"
+        << "    return schema;\n"
+        << "}\n\n";
+}
+
 void CodeGen::generate(const ValidSchema &schema) {
     emitCopyright();
 
@@ -727,8 +1818,32 @@ void CodeGen::generate(const ValidSchema &schema) {
 #endif
         << "#include \"" << includePrefix_ << "Specific.hh\"\n"
         << "#include \"" << includePrefix_ << "Encoder.hh\"\n"
-        << "#include \"" << includePrefix_ << "Decoder.hh\"\n"
-        << "\n";
+        << "#include \"" << includePrefix_ << "Decoder.hh\"\n";
+    if (directCodec_ || !writers_.empty()) {
+        os_ << "#include \"" << includePrefix_ << "DirectCodec.hh\"\n";
+    }
+    if (snapshot_) {
+        os_ << "#include \"" << includePrefix_ << "SchemaSnapshot.hh\"\n";
+    }
+    if (logicalTypes_) {
+        os_ << "#include \"" << includePrefix_ << "LogicalValues.hh\"\n";
+    }
+    if (!inlineCapacities_.empty()) {
+        os_ << "#include \"" << includePrefix_ << "SmallVector.hh\"\n";
+    }
+    if (optional_) {
+        os_ << "#include <optional>\n";
+    }
+    if (variant_) {
+        os_ << "#include <variant>\n";
+    }
+    if (pmr_) {
+        os_ << "#include \"" << includePrefix_ << "PmrTypes.hh\"\n";
+    }
+    if (mapContainer_ == "flat") {
+        os_ << "#include \"" << includePrefix_ << "FlatMap.hh\"\n";
+    }
+    os_ << "\n";
 
     vector<string> nsVector;
     if (!ns_.empty()) {
@@ -742,7 +1857,7 @@ void CodeGen::generate(const ValidSchema &schema) {
     }
 
     const NodePtr &root = schema.root();
-    generateType(root);
+    string rootType = generateType(root);
 
     for (vector<PendingSetterGetter>::const_iterator it =
              pendingGettersAndSetters.begin();
@@ -758,6 +1873,10 @@ void CodeGen::generate(const ValidSchema &schema) {
                             it->initMember, it->memberName);
     }
 
+    if (snapshot_) {
+        generateSnapshot(schema, rootType);
+    }
+
     if (!ns_.empty()) {
         inNamespace_ = false;
         for (vector<string>::const_iterator it =
@@ -773,6 +1892,33 @@ void CodeGen::generate(const ValidSchema &schema) {
 
     generateTraits(root);
 
+    set<string> projected;
+    for (vector<NodePtr>::const_iterator it = pendingProjections.begin();
+         it != pendingProjections.end(); ++it) {
+        generateProjectionTraits(*it);
+        projected.insert((*it)->name().fullname());
+        projected.insert((*it)->name().simpleName());
+    }
+    for (map<string, set<string>>::const_iterator it = projections_.begin();
+         it != projections_.end(); ++it) {
+        if (projected.count(it->first) == 0) {
+            throw avro::Exception(boost::format("No record named %1% to project") % it->first);
+        }
+    }
+    for (map<string, map<string, size_t>>::const_iterator it = inlineCapacities_.begin();
+         it != inlineCapacities_.end(); ++it) {
+        if (inlined_.count(it->first) == 0) {
+            throw avro::Exception(boost::format("No record named %1% to hold arrays inline") % it->first);
+        }
+    }
+
+    for (size_t i = 0; i < writers_.size(); ++i) {
+        generateResolvingTraits(root, writers_[i], i);
+    }
+    if (!writers_.empty()) {
+        generateResolvingWriters(root);
+    }
+
     os_ << "}\n";
 
     os_ << "#endif\n";
@@ -808,10 +1954,20 @@ int main(int argc, char **argv) {
     const string IN("input");
     const string INCLUDE_PREFIX("include-prefix");
     const string NO_UNION_TYPEDEF("no-union-typedef");
+    const string DIRECT_CODEC("direct-codec");
+    const string SNAPSHOT("snapshot");
+    const string LOGICAL_TYPES("logical-types");
+    const string OPTIONAL("optional");
+    const string VARIANT("variant");
+    const string PMR("pmr");
+    const string MAP_CONTAINER("map-container");
+    const string INLINE_CAPACITY("inline-capacity");
+    const string PROJECT("project");
+    const string WRITER("writer");
 
     po::options_description desc("Allowed options");
     desc.add_options()("help,h", "produce help message")("include-prefix,p", po::value<string>()->default_value("avro"),
-                                                         "prefix for include headers, - for none, default: avro")("no-union-typedef,U", "do not generate typedefs for unions in records")("namespace,n", po::value<string>(), "set namespace for generated code")("input,i", po::value<string>(), "input file")("output,o", po::value<string>(), "output file to generate");
+                                                         "prefix for include headers, - for none, default: avro")("no-union-typedef,U", "do not generate typedefs for unions in records")("direct-codec,D", "also generate direct_codec_traits for non-virtual binary coding")("snapshot,S", "also generate <Type>_schema() returning the schema loaded from an embedded snapshot")("logical-types,L", "map decimals, timestamps and uuids to the native types of LogicalValues.hh")("optional,O", "generate unions of null and another type as std::optional; the code needs C++17")("variant,V", "hold the values of other unions in a std::variant rather than an any; the code needs C++17")("pmr,M", "generate std::pmr strings, vectors and maps and records constructed with an allocator; the code needs C++17")("map-container,C", po::value<string>()->default_value("ordered"), "generate maps as ordered std::map, unordered std::unordered_map or flat avro::FlatMap, default: ordered")("inline-capacity,A", po::value<vector<string>>(), "hold up to N items of an array field inline in an avro::SmallVector, as Record.field=N; may be repeated")("project,P", po::value<vector<string>>(), "generate projection_traits decoding only the given field, as Record.field; may be repeated")("writer,W", po::value<vector<string>>(), "generate resolving_traits reading data written with the schema in the given file; may be repeated")("namespace,n", po::value<string>(), "set namespace for generated code")("input,i", po::value<string>(), "input file")("output,o", po::value<string>(), "output file to generate");
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -827,6 +1983,58 @@ int main(int argc, char **argv) {
     string inf = vm.count(IN) > 0 ? vm[IN].as<string>() : string();
     string incPrefix = vm[INCLUDE_PREFIX].as<string>();
     bool noUnion = vm.count(NO_UNION_TYPEDEF) != 0;
+    bool directCodec = vm.count(DIRECT_CODEC) != 0;
+    bool snapshot = vm.count(SNAPSHOT) != 0;
+    bool logicalTypes = vm.count(LOGICAL_TYPES) != 0;
+    bool optional = vm.count(OPTIONAL) != 0;
+    bool variant = vm.count(VARIANT) != 0;
+    bool pmr = vm.count(PMR) != 0;
+    string mapContainer = vm[MAP_CONTAINER].as<string>();
+    if (mapContainer != "ordered" && mapContainer != "unordered" && mapContainer != "flat") {
+        std::cerr << "Invalid map container " << mapContainer << ", expected ordered, unordered or flat" << std::endl;
+        return 1;
+    }
+    if (pmr && mapContainer != "ordered") {
+        std::cerr << "--pmr generates ordered maps only" << std::endl;
+        return 1;
+    }
+    map<string, set<string>> projections;
+    if (vm.count(PROJECT) > 0) {
+        const vector<string> &fields = vm[PROJECT].as<vector<string>>();
+        for (vector<string>::const_iterator it = fields.begin(); it != fields.end(); ++it) {
+            size_t dot = it->rfind('.');
+            if (dot == string::npos || dot == 0 || dot + 1 == it->size()) {
+                std::cerr << "Invalid projection " << *it << ", expected Record.field" << std::endl;
+                return 1;
+            }
+            projections[it->substr(0, dot)].insert(it->substr(dot + 1));
+        }
+    }
+    map<string, map<string, size_t>> inlineCapacities;
+    if (vm.count(INLINE_CAPACITY) > 0) {
+        const vector<string> &fields = vm[INLINE_CAPACITY].as<vector<string>>();
+        for (vector<string>::const_iterator it = fields.begin(); it != fields.end(); ++it) {
+            size_t eq = it->find('=');
+            size_t dot = it->rfind('.', eq);
+            size_t capacity = 0;
+            if (eq != string::npos) {
+                try {
+                    capacity = lexical_cast<size_t>(it->substr(eq + 1));
+                } catch (boost::bad_lexical_cast &) {
+                    capacity = 0;
+                }
+            }
+            if (capacity == 0 || dot == string::npos || dot == 0 || dot + 1 == eq) {
+                std::cerr << "Invalid inline capacity " << *it << ", expected Record.field=N" << std::endl;
+                return 1;
+            }
+            inlineCapacities[it->substr(0, dot)][it->substr(dot + 1, eq - dot - 1)] = capacity;
+        }
+    }
+    vector<string> writerFiles;
+    if (vm.count(WRITER) > 0) {
+        writerFiles = vm[WRITER].as<vector<string>>();
+    }
     if (incPrefix == "-") {
         incPrefix.clear();
     } else if (*incPrefix.rbegin() != '/') {
@@ -843,12 +2051,20 @@ int main(int argc, char **argv) {
             compileJsonSchema(std::cin, schema);
         }
 
+        vector<ValidSchema> writers;
+        for (vector<string>::const_iterator it = writerFiles.begin(); it != writerFiles.end(); ++it) {
+            ifstream in(it->c_str());
+            ValidSchema writer;
+            compileJsonSchema(in, writer);
+            writers.push_back(writer);
+        }
+
         if (!outf.empty()) {
             string g = readGuard(outf);
             ofstream out(outf.c_str());
-            CodeGen(out, ns, inf, outf, g, incPrefix, noUnion).generate(schema);
+            CodeGen(out, ns, inf, outf, g, incPrefix, noUnion, directCodec, snapshot, logicalTypes, optional, variant, pmr, mapContainer, projections, inlineCapacities, writers).generate(schema);
         } else {
-            CodeGen(std::cout, ns, inf, outf, "", incPrefix, noUnion).generate(schema);
+            CodeGen(std::cout, ns, inf, outf, "", incPrefix, noUnion, directCodec, snapshot, logicalTypes, optional, variant, pmr, mapContainer, projections, inlineCapacities, writers).generate(schema);
         }
         return 0;
     } catch (std::exception &e) {
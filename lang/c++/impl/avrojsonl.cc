@@ -0,0 +1,73 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iostream>
+#include <string>
+
+#include <boost/program_options.hpp>
+
+#include "Compiler.hh"
+#include "JsonLines.hh"
+
+using std::string;
+
+namespace po = boost::program_options;
+
+// Converts newline-delimited JSON into a data file.
+int main(int argc, char **argv) {
+    const string OUT("output");
+    const string IN("input");
+    const string SCHEMA("schema");
+
+    po::options_description desc("Allowed options");
+    desc.add_options()("help,h", "produce help message")("output,o", po::value<string>(), "data file to write")("input,i", po::value<string>(), "file of JSON values, one per line")("schema,s", po::value<string>(), "file of the schema of the values")("jobs,j", po::value<size_t>()->default_value(1), "threads parsing lines")("batch", po::value<size_t>()->default_value(4), "megabytes of lines given to a thread at a time")("codec,c", po::value<string>()->default_value("null"), "codec of the output")("sync-interval", po::value<size_t>()->default_value(16 * 1024), "sync interval of the output");
+    po::positional_options_description pos;
+    pos.add(IN.c_str(), 1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(desc).positional(pos).run(), vm);
+        po::notify(vm);
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    if (vm.count("help") || vm.count(IN) == 0 || vm.count(OUT) == 0 || vm.count(SCHEMA) == 0) {
+        std::cout << "Usage: avrojsonl -s schema -o output input\n"
+                  << desc << std::endl;
+        return 1;
+    }
+
+    avro::JsonLinesOptions options;
+    options.threads = vm["jobs"].as<size_t>();
+    options.batchSize = vm["batch"].as<size_t>() * 1024 * 1024;
+    options.codec = vm["codec"].as<string>();
+    options.syncInterval = vm["sync-interval"].as<size_t>();
+
+    const string outf = vm[OUT].as<string>();
+    try {
+        avro::ValidSchema schema = avro::compileJsonSchemaFromFile(vm[SCHEMA].as<string>().c_str());
+        int64_t count = avro::jsonLinesToDataFile(vm[IN].as<string>(), schema, outf, options);
+        std::cout << "Wrote " << count << " objects into " << outf << std::endl;
+        return 0;
+    } catch (std::exception &e) {
+        std::cerr << "Failed to convert: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,297 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "Codec.hh"
+#include "Compiler.hh"
+#include "DataFile.hh"
+#include "Generic.hh"
+#include "GenericJsonWriter.hh"
+
+using std::string;
+using std::vector;
+
+namespace po = boost::program_options;
+
+namespace {
+
+vector<string> split(const string &list) {
+    vector<string> result;
+    std::istringstream is(list);
+    string item;
+    while (std::getline(is, item, ',')) {
+        if (!item.empty()) {
+            result.push_back(item);
+        }
+    }
+    return result;
+}
+
+// The processor time of the process so far, user and system, in seconds.
+void cpuTimes(double &user, double &sys) {
+#ifndef _WIN32
+    struct rusage ru;
+    ::getrusage(RUSAGE_SELF, &ru);
+    user = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6;
+    sys = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+#else
+    user = sys = 0;
+#endif
+}
+
+/**
+ * Times one run, and prints it as a row of the report.
+ */
+class Run {
+    const string name_;
+    const std::chrono::steady_clock::time_point start_;
+    double user_, sys_;
+
+public:
+    explicit Run(string name) : name_(std::move(name)), start_(std::chrono::steady_clock::now()) {
+        cpuTimes(user_, sys_);
+    }
+
+    static void header() {
+        std::cout << std::left << std::setw(28) << "mode" << std::right
+                  << std::setw(9) << "seconds" << std::setw(10) << "MB/s" << std::setw(13) << "records/s"
+                  << std::setw(10) << "stored MB" << std::setw(8) << "user s" << std::setw(8) << "sys s"
+                  << std::setw(8) << "io s" << std::setw(8) << "codec s" << std::setw(8) << "avro s" << std::endl;
+    }
+
+    /**
+     * Ends the run, which went through \p bytes of data, \p stored of
+     * them as stored, in \p records objects; \p stats gives the split of
+     * the time if the run had a reader or writer.
+     */
+    void done(int64_t records, int64_t bytes, int64_t stored, const avro::DataFileStats *stats = nullptr) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+        double user, sys;
+        cpuTimes(user, sys);
+        std::cout << std::left << std::setw(28) << name_ << std::right << std::fixed
+                  << std::setprecision(3) << std::setw(9) << seconds
+                  << std::setprecision(1) << std::setw(10) << bytes / seconds / 1e6
+                  << std::setprecision(0) << std::setw(13) << records / seconds
+                  << std::setprecision(1) << std::setw(10) << stored / 1e6
+                  << std::setprecision(2) << std::setw(8) << user - user_ << std::setw(8) << sys - sys_;
+        if (stats != nullptr) {
+            std::cout << std::setw(8) << stats->ioNanos / 1e9 << std::setw(8) << stats->compressNanos / 1e9
+                      << std::setw(8) << (stats->encodeNanos + stats->decodeNanos) / 1e9;
+        }
+        std::cout << std::endl;
+    }
+};
+
+void scan(const string &input) {
+    Run run("scan");
+    avro::DataFileBlockReader reader(input.c_str());
+    avro::DataFileBlock block;
+    vector<uint8_t> data;
+    int64_t records = 0, stored = 0;
+    while (reader.next(block)) {
+        reader.readBlockRaw(data);
+        records += block.objectCount;
+        stored += block.byteSize;
+    }
+    run.done(records, stored, stored);
+}
+
+void decompress(const string &input) {
+    Run run("decompress");
+    avro::DataFileBlockReader reader(input.c_str());
+    std::unique_ptr<avro::BlockDecompressor> decompressor;
+    if (reader.codecName() != "null") {
+        avro::BlockCodecPtr codec = avro::findCodec(reader.codecName(), reader.dataSchema(), reader.metadata());
+        if (!codec) {
+            throw avro::Exception(boost::format("Unknown codec: %1%") % reader.codecName());
+        }
+        decompressor = codec->newDecompressor();
+    }
+    avro::DataFileBlock block;
+    vector<uint8_t> data, out;
+    int64_t records = 0, bytes = 0, stored = 0;
+    while (reader.next(block)) {
+        reader.readBlockRaw(data);
+        records += block.objectCount;
+        stored += block.byteSize;
+        bytes += decompressor ? decompressor->decompress(data.data(), data.size(), out) : data.size();
+    }
+    run.done(records, bytes, stored);
+}
+
+// Decodes every object of the input, as the reader's schema has them if
+// there is one, writing them as JSON if asked to; returns the objects
+// when they are to be kept, up to keep of them.
+void decode(const string &name, const string &input, const avro::ValidSchema *readerSchema,
+            bool json, size_t threads, vector<avro::GenericDatum> *kept, size_t keep) {
+    Run run(name);
+    std::unique_ptr<avro::DataFileReader<avro::GenericDatum>> reader(readerSchema != nullptr
+                                                                         ? new avro::DataFileReader<avro::GenericDatum>(input.c_str(), *readerSchema)
+                                                                         : new avro::DataFileReader<avro::GenericDatum>(input.c_str()));
+    reader->setTiming(true);
+    if (threads > 1) {
+        reader->setDecompressionThreads(threads);
+    }
+    const avro::ValidSchema &schema = readerSchema != nullptr ? *readerSchema : reader->dataSchema();
+    std::unique_ptr<avro::GenericJsonWriter> writer(json ? new avro::GenericJsonWriter(schema) : nullptr);
+    avro::OutputStreamPtr out = avro::memoryOutputStream();
+    avro::GenericDatum datum(schema);
+    int64_t jsonBytes = 0;
+    while (reader->read(datum)) {
+        if (writer) {
+            writer->write(datum, *out);
+            if (out->byteCount() > 1024 * 1024) {
+                jsonBytes += out->byteCount();
+                avro::resetMemoryOutputStream(*out);
+            }
+        }
+        if (kept != nullptr && kept->size() < keep) {
+            kept->push_back(datum);
+        }
+    }
+    jsonBytes += out->byteCount();
+    avro::DataFileStats stats = reader->stats();
+    run.done(stats.objects, json ? jsonBytes : stats.rawBytes, stats.compressedBytes, &stats);
+}
+
+void write(const vector<avro::GenericDatum> &data, const avro::ValidSchema &schema,
+           const string &codecName, size_t syncInterval, size_t threads, const string &output) {
+    avro::BlockCodecPtr codec = avro::findCodec(codecName, schema);
+    if (!codec) {
+        throw avro::Exception(boost::format("Unknown codec: %1%") % codecName);
+    }
+    std::ostringstream name;
+    name << "write " << codecName << " sync=" << syncInterval / 1024 << "K";
+    Run run(name.str());
+    avro::DataFileStats stats;
+    {
+        avro::DataFileWriter<avro::GenericDatum> writer(output.c_str(), schema, syncInterval, codec);
+        writer.setTiming(true);
+        if (threads > 1) {
+            writer.setCompressionThreads(threads);
+        }
+        for (const avro::GenericDatum &datum : data) {
+            writer.write(datum);
+        }
+        writer.close();
+        stats = writer.stats();
+    }
+    run.done(stats.objects, stats.rawBytes, stats.compressedBytes, &stats);
+    std::remove(output.c_str());
+}
+
+} // namespace
+
+// Measures how fast the data of a data file reads and writes in various
+// ways, so that codecs and sync intervals can be chosen for it.
+int main(int argc, char **argv) {
+    const string IN("input");
+
+    po::options_description desc("Allowed options");
+    desc.add_options()("help,h", "produce help message")("input,i", po::value<string>(), "data file to measure with")("read,r", po::value<string>()->default_value("scan,decompress,decode,resolve,json"), "read modes: scan, decompress, decode, resolve and json")("reader-schema,s", po::value<string>(), "file of the reader's schema for the resolve mode")("write,w", po::value<string>(), "codecs to write the objects with, such as null,deflate")("sync-interval", po::value<string>()->default_value("16,64,1024"), "sync intervals to write with, in KB")("records", po::value<size_t>()->default_value(1000000), "the most objects held in memory to write")("jobs,j", po::value<size_t>()->default_value(1), "threads decompressing or compressing blocks")("repeat", po::value<size_t>()->default_value(1), "times to run each mode")("temp", po::value<string>(), "file to write to, the input with .avroperf appended by default");
+    po::positional_options_description pos;
+    pos.add(IN.c_str(), 1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(desc).positional(pos).run(), vm);
+        po::notify(vm);
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    if (vm.count("help") || vm.count(IN) == 0) {
+        std::cout << "Usage: avroperf [-r modes] [-w codecs] [-j threads] input\n"
+                  << "MB/s is of the data as the mode handles it: stored for scan,\n"
+                  << "JSON for json, and uncompressed otherwise.\n"
+                  << desc << std::endl;
+        return 1;
+    }
+
+    const string input = vm[IN].as<string>();
+    const vector<string> modes = split(vm["read"].as<string>());
+    const vector<string> codecs = vm.count("write") ? split(vm["write"].as<string>()) : vector<string>();
+    const size_t threads = vm["jobs"].as<size_t>();
+    const size_t repeat = vm["repeat"].as<size_t>();
+    const string temp = vm.count("temp") ? vm["temp"].as<string>() : input + ".avroperf";
+
+    try {
+        std::unique_ptr<avro::ValidSchema> readerSchema;
+        if (vm.count("reader-schema")) {
+            readerSchema.reset(new avro::ValidSchema(avro::compileJsonSchemaFromFile(vm["reader-schema"].as<string>().c_str())));
+        }
+        vector<size_t> intervals;
+        for (const string &s : split(vm["sync-interval"].as<string>())) {
+            intervals.push_back(std::stoul(s) * 1024);
+        }
+
+        Run::header();
+        for (size_t i = 0; i < repeat; ++i) {
+            for (const string &mode : modes) {
+                if (mode == "scan") {
+                    scan(input);
+                } else if (mode == "decompress") {
+                    decompress(input);
+                } else if (mode == "decode") {
+                    decode(mode, input, nullptr, false, threads, nullptr, 0);
+                } else if (mode == "resolve") {
+                    // Only with a reader's schema to resolve against.
+                    if (readerSchema) {
+                        decode(mode, input, readerSchema.get(), false, threads, nullptr, 0);
+                    }
+                } else if (mode == "json") {
+                    decode(mode, input, nullptr, true, threads, nullptr, 0);
+                } else {
+                    std::cerr << "Unknown read mode: " << mode << std::endl;
+                    return 1;
+                }
+            }
+        }
+
+        if (!codecs.empty()) {
+            vector<avro::GenericDatum> data;
+            avro::ValidSchema schema = avro::DataFileReader<avro::GenericDatum>(input.c_str()).dataSchema();
+            decode("load", input, nullptr, false, threads, &data, vm["records"].as<size_t>());
+            for (size_t i = 0; i < repeat; ++i) {
+                for (const string &codec : codecs) {
+                    for (size_t interval : intervals) {
+                        write(data, schema, codec, interval, threads, temp);
+                    }
+                }
+            }
+        }
+        return 0;
+    } catch (std::exception &e) {
+        std::cerr << "Failed: " << e.what() << std::endl;
+        return 1;
+    }
+}
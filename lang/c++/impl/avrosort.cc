@@ -0,0 +1,86 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "DataFileSorter.hh"
+
+using std::string;
+using std::vector;
+
+namespace po = boost::program_options;
+
+// Sorts a data file in the sort order of its schema, or merges data files
+// that are already sorted.
+int main(int argc, char **argv) {
+    const string OUT("output");
+    const string IN("input");
+
+    po::options_description desc("Allowed options");
+    desc.add_options()("help,h", "produce help message")("output,o", po::value<string>(), "sorted data file to write")("input,i", po::value<vector<string>>(), "data file to sort, or sorted data files to merge")("merge,m", "merge sorted data files instead of sorting one")("key,k", po::value<string>(), "top-level field to sort by instead of the whole object")("memory", po::value<size_t>()->default_value(64), "megabytes of objects to hold in memory")("jobs,j", po::value<size_t>()->default_value(1), "threads sorting runs")("temp-dir,T", po::value<string>(), "directory for runs, that of the output by default")("codec,c", po::value<string>(), "codec of the output, that of the input by default");
+    po::positional_options_description pos;
+    pos.add(IN.c_str(), -1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(desc).positional(pos).run(), vm);
+        po::notify(vm);
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    bool merge = vm.count("merge") != 0;
+    if (vm.count("help") || vm.count(IN) == 0 || vm.count(OUT) == 0 || (!merge && vm[IN].as<vector<string>>().size() != 1)) {
+        std::cout << "Usage: avrosort [-k field] -o output input\n"
+                  << "       avrosort -m [-k field] -o output input...\n"
+                  << desc << std::endl;
+        return 1;
+    }
+
+    avro::SortOptions options;
+    options.memoryLimit = vm["memory"].as<size_t>() * 1024 * 1024;
+    options.threads = vm["jobs"].as<size_t>();
+    if (vm.count("key")) {
+        options.keyField = vm["key"].as<string>();
+    }
+    if (vm.count("temp-dir")) {
+        options.tempDirectory = vm["temp-dir"].as<string>();
+    }
+    if (vm.count("codec")) {
+        options.codec = vm["codec"].as<string>();
+    }
+
+    const string outf = vm[OUT].as<string>();
+    const vector<string> &inputs = vm[IN].as<vector<string>>();
+
+    try {
+        int64_t count = merge
+            ? avro::mergeDataFiles(inputs, outf, options)
+            : avro::sortDataFile(inputs.front(), outf, options);
+        std::cout << (merge ? "Merged " : "Sorted ") << count << " objects into " << outf << std::endl;
+        return 0;
+    } catch (std::exception &e) {
+        std::cerr << "Failed to " << (merge ? "merge: " : "sort: ") << e.what() << std::endl;
+        return 1;
+    }
+}
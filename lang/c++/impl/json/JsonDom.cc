@@ -78,7 +78,7 @@ Entity readEntity(JsonParser &p) {
                 p.advance();
                 std::string k = p.stringValue();
                 Entity n = readEntity(p);
-                v->insert(std::make_pair(k, n));
+                v->emplace(std::move(k), std::move(n));
             }
             p.advance();
             return Entity(v, l);
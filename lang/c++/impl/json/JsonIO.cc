@@ -18,6 +18,16 @@
 
 #include "JsonIO.hh"
 
+#include <clocale>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace avro {
 namespace json {
 
@@ -37,16 +47,228 @@ const char *const
         "Object end",
 };
 
+namespace {
+
+/**
+ * Returns the first quote or backslash in [p, end), or end if there is
+ * none. With SSE2 sixteen characters are checked at a time.
+ */
+const uint8_t *findStringSpecial(const uint8_t *p, const uint8_t *end) {
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                                                  _mm_cmpeq_epi8(v, backslash)));
+        if (mask != 0) {
+            return p + __builtin_ctz(static_cast<unsigned>(mask));
+        }
+    }
+#endif
+    for (; p != end; ++p) {
+        if (*p == '"' || *p == '\\') {
+            break;
+        }
+    }
+    return p;
+}
+
+size_t formatFinite(double v, int precision, char *buf) {
+    return static_cast<size_t>(snprintf(buf, maxNumberLength, "%.*g", precision, v));
+}
+
+/**
+ * Replaces the C locale's decimal point, which snprintf() and strtod()
+ * use, with the '.' that JSON needs.
+ */
+size_t fixDecimalPoint(char *buf, size_t n) {
+    const char *point = localeconv()->decimal_point;
+    if (point[0] != '.' || point[1] != 0) {
+        char *p = strstr(buf, point);
+        if (p != nullptr) {
+            size_t len = strlen(point);
+            *p = '.';
+            memmove(p + 1, p + len, buf + n - (p + len) + 1);
+            n -= len - 1;
+        }
+    }
+    return n;
+}
+
+size_t formatSpecial(double v, char *buf) {
+    const char *s = std::isnan(v) ? "NaN" : (v > 0 ? "Infinity" : "-Infinity");
+    size_t n = strlen(s);
+    memcpy(buf, s, n + 1);
+    return n;
+}
+
+// The powers of ten that doubles represent exactly.
+const double exactPowersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+/**
+ * Converts a JSON number whose digits fit a double's mantissa and whose
+ * decimal exponent is a power of ten that a double holds exactly. Such a
+ * conversion is a single correctly rounded multiplication or division.
+ * Returns false for any other number, which is left to the slow path.
+ */
+bool fastDouble(const std::string &s, double &result) {
+    const char *p = s.c_str();
+    bool negative = (*p == '-');
+    if (negative) {
+        ++p;
+    }
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    for (; isdigit(*p); ++p) {
+        if (digits == 19) {
+            return false;
+        }
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += (mantissa != 0);
+    }
+    if (*p == '.') {
+        for (++p; isdigit(*p); ++p) {
+            if (digits == 19) {
+                return false;
+            }
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += (mantissa != 0);
+            --exponent;
+        }
+    }
+    if (*p == 'e' || *p == 'E') {
+        ++p;
+        bool negativeExponent = (*p == '-');
+        if (*p == '-' || *p == '+') {
+            ++p;
+        }
+        int e = 0;
+        for (; isdigit(*p); ++p) {
+            if (e > 1000) {
+                return false;
+            }
+            e = e * 10 + (*p - '0');
+        }
+        exponent += negativeExponent ? -e : e;
+    }
+    if (mantissa > (uint64_t(1) << 53) || exponent < -22 || exponent > 22) {
+        return false;
+    }
+    double v = static_cast<double>(mantissa);
+    v = exponent < 0 ? v / exactPowersOfTen[-exponent] : v * exactPowersOfTen[exponent];
+    result = negative ? -v : v;
+    return true;
+}
+
+/**
+ * Converts a JSON integer, returning false if it overflows a long.
+ */
+bool fastLong(const std::string &s, int64_t &result) {
+    const char *p = s.c_str();
+    bool negative = (*p == '-');
+    if (negative) {
+        ++p;
+    }
+    uint64_t v = 0;
+    const uint64_t limit = negative ? uint64_t(1) << 63 : (uint64_t(1) << 63) - 1;
+    for (; *p != 0; ++p) {
+        uint64_t d = *p - '0';
+        if (v > (limit - d) / 10) {
+            return false;
+        }
+        v = v * 10 + d;
+    }
+    result = negative ? static_cast<int64_t>(0 - v) : static_cast<int64_t>(v);
+    return true;
+}
+
+} // namespace
+
+const char *findEscapable(const char *b, const char *e) {
+#if defined(__SSE2__)
+    // Signed comparison puts both control characters and bytes from
+    // 0x80 up below the space.
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i del = _mm_set1_epi8(0x7f);
+    for (; e - b >= 16; b += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b));
+        __m128i special = _mm_or_si128(
+            _mm_or_si128(_mm_cmplt_epi8(v, space), _mm_cmpeq_epi8(v, quote)),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, backslash), _mm_cmpeq_epi8(v, slash)),
+                         _mm_cmpeq_epi8(v, del)));
+        int mask = _mm_movemask_epi8(special);
+        if (mask != 0) {
+            return b + __builtin_ctz(static_cast<unsigned>(mask));
+        }
+    }
+#endif
+    for (; b != e; ++b) {
+        auto c = static_cast<unsigned char>(*b);
+        if (c < 0x20 || c >= 0x7f || c == '"' || c == '\\' || c == '/') {
+            break;
+        }
+    }
+    return b;
+}
+
+size_t formatDouble(double v, char *buf) {
+    if (!std::isfinite(v)) {
+        return formatSpecial(v, buf);
+    }
+    // Most values read back from 15 digits; 17 always do.
+    for (int precision = 15; precision < 17; ++precision) {
+        size_t n = formatFinite(v, precision, buf);
+        if (strtod(buf, nullptr) == v) {
+            return fixDecimalPoint(buf, n);
+        }
+    }
+    return fixDecimalPoint(buf, formatFinite(v, 17, buf));
+}
+
+size_t formatFloat(float v, char *buf) {
+    if (!std::isfinite(v)) {
+        return formatSpecial(v, buf);
+    }
+    for (int precision = 6; precision < 9; ++precision) {
+        size_t n = formatFinite(v, precision, buf);
+        if (strtof(buf, nullptr) == v) {
+            return fixDecimalPoint(buf, n);
+        }
+    }
+    return fixDecimalPoint(buf, formatFinite(v, 9, buf));
+}
+
 char JsonParser::next() {
     char ch = hasNext ? nextChar : ' ';
-    while (isspace(ch)) {
-        if (ch == '\n') {
-            line_++;
+    hasNext = false;
+    if (!isspace(ch)) {
+        return ch;
+    }
+    // Skip whitespace straight out of the stream's buffer.
+    for (;;) {
+        if (in_.next_ == in_.end_) {
+            in_.more();
+        }
+        const uint8_t *p = in_.next_;
+        const uint8_t *end = in_.end_;
+        while (p != end && isspace(*p)) {
+            if (*p == '\n') {
+                line_++;
+            }
+            ++p;
+        }
+        in_.next_ = p;
+        if (p != end) {
+            return static_cast<char>(*in_.next_++);
         }
-        ch = in_.read();
     }
-    hasNext = false;
-    return ch;
 }
 
 void JsonParser::expectToken(Token tk) {
@@ -249,12 +471,17 @@ JsonParser::Token JsonParser::tryNumber(char ch) {
             if (hasNext) {
                 nextChar = ch;
             }
-            std::istringstream iss(sv);
             if (state == 1 || state == 2) {
-                iss >> lv;
+                if (!fastLong(sv, lv)) {
+                    std::istringstream iss(sv);
+                    iss >> lv;
+                }
                 return tkLong;
             } else {
-                iss >> dv;
+                if (!fastDouble(sv, dv)) {
+                    std::istringstream iss(sv);
+                    iss >> dv;
+                }
                 return tkDouble;
             }
         } else {
@@ -270,7 +497,17 @@ JsonParser::Token JsonParser::tryNumber(char ch) {
 JsonParser::Token JsonParser::tryString() {
     sv.clear();
     for (;;) {
-        char ch = in_.read();
+        // Copy the run of plain characters in one go.
+        if (in_.next_ == in_.end_) {
+            in_.more();
+        }
+        const uint8_t *special = findStringSpecial(in_.next_, in_.end_);
+        sv.append(reinterpret_cast<const char *>(in_.next_), special - in_.next_);
+        in_.next_ = special;
+        if (special == in_.end_) {
+            continue;
+        }
+        char ch = static_cast<char>(*in_.next_++);
         if (ch == '"') {
             return tkString;
         } else if (ch == '\\') {
@@ -315,6 +552,16 @@ JsonParser::Token JsonParser::tryString() {
 
 string JsonParser::decodeString(const string &s, bool binary) {
     string result;
+    decodeString(s, binary, result);
+    return result;
+}
+
+void JsonParser::decodeString(const string &s, bool binary, string &result) {
+    if (s.find('\\') == string::npos) {
+        result.assign(s);
+        return;
+    }
+    result.clear();
     for (string::const_iterator it = s.begin(); it != s.end(); ++it) {
         char ch = *it;
         if (ch == '\\') {
@@ -392,7 +639,6 @@ string JsonParser::decodeString(const string &s, bool binary) {
             result.push_back(ch);
         }
     }
-    return result;
 }
 
 Exception JsonParser::unexpected(unsigned char c) {
@@ -26,6 +26,7 @@
 #include <sstream>
 #include <stack>
 #include <string>
+#include <type_traits>
 
 #include "Config.hh"
 #include "Stream.hh"
@@ -37,6 +38,26 @@ inline char toHex(unsigned int n) {
     return (n < 10) ? (n + '0') : (n + 'a' - 10);
 }
 
+/**
+ * Returns the first character in [b, e) that cannot be copied as it is
+ * into a JSON string: a quote, a backslash, a slash, a control character
+ * or a non-ASCII byte. Returns e if there is none.
+ */
+AVRO_DECL const char *findEscapable(const char *b, const char *e);
+
+/**
+ * The size of the buffers given to formatDouble() and formatFloat().
+ */
+const size_t maxNumberLength = 32;
+
+/**
+ * Writes the shortest decimal form of \p v that reads back as the same
+ * value into \p buf, which holds maxNumberLength characters, and returns
+ * its length. Non-finite values become NaN, Infinity or -Infinity.
+ */
+AVRO_DECL size_t formatDouble(double v, char *buf);
+AVRO_DECL size_t formatFloat(float v, char *buf);
+
 class AVRO_DECL JsonParser : boost::noncopyable {
 public:
     enum Token {
@@ -84,6 +105,7 @@ private:
     char next();
 
     static std::string decodeString(const std::string &s, bool binary);
+    static void decodeString(const std::string &s, bool binary, std::string &out);
 
 public:
     JsonParser() : curState(stValue), hasNext(false), peeked(false), line_(1) {}
@@ -141,6 +163,13 @@ public:
         return decodeString(sv, false);
     }
 
+    /**
+     * Decodes the string value into \p out, reusing its storage.
+     */
+    void stringValue(std::string &out) const {
+        decodeString(sv, false, out);
+    }
+
     std::string bytesValue() const {
         return decodeString(sv, true);
     }
@@ -271,7 +300,7 @@ class AVRO_DECL JsonGenerator {
     void doEncodeString(const char *b, size_t len, bool binary) {
         const char *e = b + len;
         out_.write('"');
-        for (const char *p = b; p != e; p++) {
+        for (const char *p = findEscapable(b, e); p != e; p = findEscapable(p + 1, e)) {
             if ((*p & 0x80) != 0) {
                 write(b, p);
                 if (binary) {
@@ -328,13 +357,9 @@ class AVRO_DECL JsonGenerator {
                         escape('t', b, p);
                         break;
                     default:
-                        if (std::iscntrl(*p, std::locale::classic())) {
-                            write(b, p);
-                            escapeCtl(*p);
-                            break;
-                        } else {
-                            continue;
-                        }
+                        write(b, p);
+                        escapeCtl(*p);
+                        break;
                 }
             }
             b = p + 1;
@@ -373,6 +398,12 @@ public:
         return out_.byteCount();
     }
 
+    /// Writes bytes that are JSON already, as they are, between values
+    /// the generator is not keeping the structure of.
+    void writeRaw(const uint8_t *b, size_t len) {
+        out_.writeBytes(b, len);
+    }
+
     void encodeNull() {
         sep();
         out_.writeBytes(reinterpret_cast<const uint8_t *>("null"), 4);
@@ -392,31 +423,44 @@ public:
     template<typename T>
     void encodeNumber(T t) {
         sep();
-        std::ostringstream oss;
-        oss << boost::lexical_cast<std::string>(t);
-        const std::string s = oss.str();
-        out_.writeBytes(reinterpret_cast<const uint8_t *>(s.data()), s.size());
+        // Digits are produced backwards from the end of the buffer.
+        uint8_t buf[24];
+        uint8_t *const end = buf + sizeof(buf);
+        uint8_t *p = end;
+        typedef typename std::make_unsigned<T>::type U;
+        U u = t < 0 ? U(0) - static_cast<U>(t) : static_cast<U>(t);
+        do {
+            *--p = static_cast<uint8_t>('0' + u % 10);
+            u /= 10;
+        } while (u != 0);
+        if (t < 0) {
+            *--p = '-';
+        }
+        out_.writeBytes(p, end - p);
         sep2();
     }
 
     void encodeNumber(double t) {
         sep();
-        std::ostringstream oss;
-        if (boost::math::isfinite(t)) {
-            oss << boost::lexical_cast<std::string>(t);
-        } else if (boost::math::isnan(t)) {
-            oss << "NaN";
-        } else if (t == std::numeric_limits<double>::infinity()) {
-            oss << "Infinity";
-        } else {
-            oss << "-Infinity";
-        }
-        const std::string s = oss.str();
-        out_.writeBytes(reinterpret_cast<const uint8_t *>(s.data()), s.size());
+        char buf[maxNumberLength];
+        size_t n = formatDouble(t, buf);
+        out_.writeBytes(reinterpret_cast<const uint8_t *>(buf), n);
+        sep2();
+    }
+
+    void encodeNumber(float t) {
+        sep();
+        char buf[maxNumberLength];
+        size_t n = formatFloat(t, buf);
+        out_.writeBytes(reinterpret_cast<const uint8_t *>(buf), n);
         sep2();
     }
 
     void encodeString(const std::string &s) {
+        encodeString(s.data(), s.size());
+    }
+
+    void encodeString(const char *s, size_t len) {
         if (top == stMap0) {
             top = stKey;
         } else if (top == stMapN) {
@@ -428,7 +472,7 @@ public:
         } else {
             sep();
         }
-        doEncodeString(s.c_str(), s.size(), false);
+        doEncodeString(s, len, false);
         if (top == stKey) {
             out_.write(':');
             formatter_.handleColon();
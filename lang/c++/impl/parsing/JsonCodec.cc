@@ -21,7 +21,6 @@
 #include <algorithm>
 #include <boost/math/special_functions/fpclassify.hpp>
 #include <cctype>
-#include <map>
 #include <memory>
 #include <string>
 
@@ -29,6 +28,7 @@
 #include "Encoder.hh"
 #include "NodeImpl.hh"
 #include "Symbol.hh"
+#include "Utf8.hh"
 #include "ValidSchema.hh"
 #include "ValidatingCodec.hh"
 
@@ -41,7 +41,6 @@ namespace parsing {
 using std::make_shared;
 
 using std::istringstream;
-using std::map;
 using std::ostringstream;
 using std::reverse;
 using std::string;
@@ -52,8 +51,7 @@ using avro::json::JsonNullFormatter;
 using avro::json::JsonParser;
 
 class JsonGrammarGenerator : public ValidatingGrammarGenerator {
-    ProductionPtr doGenerate(const NodePtr &n,
-                             std::map<NodePtr, ProductionPtr> &m);
+    ProductionPtr doGenerate(const NodePtr &n, NodeProductions &m);
 };
 
 static std::string nameOf(const NodePtr &n) {
@@ -66,7 +64,7 @@ static std::string nameOf(const NodePtr &n) {
 }
 
 ProductionPtr JsonGrammarGenerator::doGenerate(const NodePtr &n,
-                                               std::map<NodePtr, ProductionPtr> &m) {
+                                               NodeProductions &m) {
     switch (n->type()) {
         case AVRO_NULL:
         case AVRO_BOOL:
@@ -82,6 +80,11 @@ ProductionPtr JsonGrammarGenerator::doGenerate(const NodePtr &n,
         case AVRO_SYMBOLIC:
             return ValidatingGrammarGenerator::doGenerate(n, m);
         case AVRO_RECORD: {
+            NodeProductions::const_iterator it = m.find(n);
+            if (it != m.end() && it->second) {
+                // The record is shared by several parents.
+                return make_shared<Production>(1, Symbol::indirect(it->second));
+            }
             ProductionPtr result = make_shared<Production>();
 
             m.erase(n);
@@ -181,6 +184,7 @@ class JsonDecoder : public Decoder {
     JsonParser in_;
     JsonDecoderHandler handler_;
     P parser_;
+    bool validateUtf8_ = false;
 
     void init(InputStream &is);
     void decodeNull();
@@ -207,6 +211,9 @@ class JsonDecoder : public Decoder {
     void expect(JsonParser::Token tk);
     void skipComposite();
     void drain();
+    void setUtf8Validation(bool validate) {
+        validateUtf8_ = validate;
+    }
 
 public:
     JsonDecoder(const ValidSchema &s) : handler_(in_),
@@ -278,7 +285,11 @@ template<typename P>
 void JsonDecoder<P>::decodeString(string &value) {
     parser_.advance(Symbol::sString);
     expect(JsonParser::tkString);
-    value = in_.stringValue();
+    in_.stringValue(value);
+    // Escapes can spell lone surrogates, and the text itself any bytes.
+    if (validateUtf8_ && !isValidUtf8(value.data(), value.size())) {
+        throw Exception(boost::format("Invalid UTF-8 in a string of %1% bytes") % value.size());
+    }
 }
 
 template<typename P>
@@ -480,6 +491,7 @@ class JsonEncoder : public Encoder {
     void encodeFloat(float f);
     void encodeDouble(double d);
     void encodeString(const std::string &s);
+    void encodeStringView(const char *data, size_t len);
     void encodeBytes(const uint8_t *bytes, size_t len);
     void encodeFixed(const uint8_t *bytes, size_t len);
     void encodeEnum(size_t e);
@@ -570,6 +582,12 @@ void JsonEncoder<P, F>::encodeString(const std::string &s) {
     out_.encodeString(s);
 }
 
+template<typename P, typename F>
+void JsonEncoder<P, F>::encodeStringView(const char *data, size_t len) {
+    parser_.advance(Symbol::sString);
+    out_.encodeString(data, len);
+}
+
 template<typename P, typename F>
 void JsonEncoder<P, F>::encodeBytes(const uint8_t *bytes, size_t len) {
     parser_.advance(Symbol::sBytes);
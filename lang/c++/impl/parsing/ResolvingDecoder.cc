@@ -19,18 +19,24 @@
 #define __STDC_LIMIT_MACROS
 
 #include <algorithm>
+#include <array>
 #include <ctype.h>
+#include <functional>
 #include <map>
 #include <memory>
 #include <stack>
 #include <string>
+#include <typeinfo>
+#include <unordered_map>
 
 #include "Decoder.hh"
 #include "Encoder.hh"
 #include "Generic.hh"
 #include "NodeImpl.hh"
+#include "SchemaCache.hh"
 #include "Stream.hh"
 #include "Symbol.hh"
+#include "Trace.hh"
 #include "Types.hh"
 #include "ValidSchema.hh"
 #include "ValidatingCodec.hh"
@@ -59,16 +65,96 @@ using std::vector;
 
 typedef pair<NodePtr, NodePtr> NodePair;
 
+struct NodePairHash {
+    size_t operator()(const NodePair &p) const {
+        std::hash<NodePtr> h;
+        return h(p.first) * 31 + h(p.second);
+    }
+};
+
+/// The productions of pairs of writer's and reader's nodes.
+typedef std::unordered_map<NodePair, ProductionPtr, NodePairHash> PairProductions;
+
+/**
+ * Finds the branch of a reader's union that a writer's value of another
+ * type resolves to: the first branch of the same type, and name if it has
+ * one, or else the first one the value promotes to. The branches of each
+ * union are indexed once, so that schemas with many unions do not scan
+ * them for every value that meets them.
+ */
+class BranchIndex {
+    struct Branches {
+        // The first branch of each type, and name for named types.
+        map<pair<Type, string>, int> exact;
+        // The first branch an int promotes to, and that a long or float
+        // promotes to.
+        int fromInt;
+        int toDouble;
+    };
+
+    map<const Node *, Branches> unions_;
+
+    const Branches &branches(const NodePtr &reader) {
+        map<const Node *, Branches>::iterator it = unions_.find(reader.get());
+        if (it != unions_.end()) {
+            return it->second;
+        }
+        Branches &b = unions_[reader.get()];
+        b.fromInt = -1;
+        b.toDouble = -1;
+        for (size_t j = reader->leaves(); j-- > 0;) {
+            const Node &r = resolvedNode(*reader->leafAt(j));
+            int branch = static_cast<int>(j);
+            b.exact[make_pair(r.type(), r.hasName() ? r.name().fullname() : string())] = branch;
+            switch (r.type()) {
+                case AVRO_DOUBLE:
+                    b.toDouble = branch;
+                    b.fromInt = branch;
+                    break;
+                case AVRO_LONG:
+                case AVRO_FLOAT:
+                    b.fromInt = branch;
+                    break;
+                default:
+                    break;
+            }
+        }
+        return b;
+    }
+
+public:
+    int best(const NodePtr &writer, const NodePtr &reader) {
+        const Branches &b = branches(reader);
+        Type t = writer->type();
+        map<pair<Type, string>, int>::const_iterator it =
+            b.exact.find(make_pair(t, writer->hasName() ? writer->name().fullname() : string()));
+        if (it != b.exact.end()) {
+            return it->second;
+        }
+        switch (t) {
+            case AVRO_INT:
+                return b.fromInt;
+            case AVRO_LONG:
+            case AVRO_FLOAT:
+                return b.toDouble;
+            default:
+                return -1;
+        }
+    }
+};
+
 class ResolvingGrammarGenerator : public ValidatingGrammarGenerator {
+    BranchIndex branches_;
+
     ProductionPtr doGenerate2(const NodePtr &writer,
-                              const NodePtr &reader, map<NodePair, ProductionPtr> &m,
-                              map<NodePtr, ProductionPtr> &m2);
+                              const NodePtr &reader, PairProductions &m,
+                              NodeProductions &m2);
     ProductionPtr resolveRecords(const NodePtr &writer,
-                                 const NodePtr &reader, map<NodePair, ProductionPtr> &m,
-                                 map<NodePtr, ProductionPtr> &m2);
+                                 const NodePtr &reader, PairProductions &m,
+                                 NodeProductions &m2);
     ProductionPtr resolveUnion(const NodePtr &writer,
-                               const NodePtr &reader, map<NodePair, ProductionPtr> &m,
-                               map<NodePtr, ProductionPtr> &m2);
+                               const NodePtr &reader, PairProductions &m,
+                               NodeProductions &m2);
 
     static vector<pair<string, size_t>> fields(const NodePtr &n) {
         vector<pair<string, size_t>> result;
@@ -79,10 +165,8 @@ class ResolvingGrammarGenerator : public ValidatingGrammarGenerator {
         return result;
     }
 
-    static int bestBranch(const NodePtr &writer, const NodePtr &reader);
-
     ProductionPtr getWriterProduction(const NodePtr &n,
-                                      map<NodePtr, ProductionPtr> &m2);
+                                      NodeProductions &m2);
 
 public:
     Symbol generate(
@@ -91,61 +175,19 @@ public:
 
 Symbol ResolvingGrammarGenerator::generate(
     const ValidSchema &writer, const ValidSchema &reader) {
-    map<NodePtr, ProductionPtr> m2;
+    NodeProductions m2;
 
     const NodePtr &rr = reader.root();
     const NodePtr &rw = writer.root();
     ProductionPtr backup = ValidatingGrammarGenerator::doGenerate(rw, m2);
     fixup(backup, m2);
 
-    map<NodePair, ProductionPtr> m;
+    PairProductions m;
     ProductionPtr main = doGenerate2(rw, rr, m, m2);
     fixup(main, m);
     return Symbol::rootSymbol(main, backup);
 }
 
-int ResolvingGrammarGenerator::bestBranch(const NodePtr &writer,
-                                          const NodePtr &reader) {
-    Type t = writer->type();
-
-    const size_t c = reader->leaves();
-    for (size_t j = 0; j < c; ++j) {
-        NodePtr r = reader->leafAt(j);
-        if (r->type() == AVRO_SYMBOLIC) {
-            r = resolveSymbol(r);
-        }
-        if (t == r->type()) {
-            if (r->hasName()) {
-                if (r->name() == writer->name()) {
-                    return j;
-                }
-            } else {
-                return j;
-            }
-        }
-    }
-
-    for (size_t j = 0; j < c; ++j) {
-        const NodePtr &r = reader->leafAt(j);
-        Type rt = r->type();
-        switch (t) {
-            case AVRO_INT:
-                if (rt == AVRO_LONG || rt == AVRO_DOUBLE || rt == AVRO_FLOAT) {
-                    return j;
-                }
-                break;
-            case AVRO_LONG:
-            case AVRO_FLOAT:
-                if (rt == AVRO_DOUBLE) {
-                    return j;
-                }
-                break;
-            default:
-                break;
-        }
-    }
-    return -1;
-}
 
 static shared_ptr<vector<uint8_t>> getAvroBinary(
     const GenericDatum &defaultValue) {
@@ -167,9 +209,9 @@ struct equalsFirst {
 };
 
 ProductionPtr ResolvingGrammarGenerator::getWriterProduction(
-    const NodePtr &n, map<NodePtr, ProductionPtr> &m2) {
+    const NodePtr &n, NodeProductions &m2) {
     const NodePtr &nn = (n->type() == AVRO_SYMBOLIC) ? static_cast<const NodeSymbolic &>(*n).getNode() : n;
-    map<NodePtr, ProductionPtr>::const_iterator it2 = m2.find(nn);
+    NodeProductions::const_iterator it2 = m2.find(nn);
     if (it2 != m2.end()) {
         return it2->second;
     } else {
@@ -181,8 +223,8 @@ ProductionPtr ResolvingGrammarGenerator::getWriterProduction(
 
 ProductionPtr ResolvingGrammarGenerator::resolveRecords(
     const NodePtr &writer, const NodePtr &reader,
-    map<NodePair, ProductionPtr> &m,
-    map<NodePtr, ProductionPtr> &m2) {
+    PairProductions &m,
+    NodeProductions &m2) {
     ProductionPtr result = make_shared<Production>();
 
     vector<pair<string, size_t>> wf = fields(writer);
@@ -235,7 +277,7 @@ ProductionPtr ResolvingGrammarGenerator::resolveRecords(
         shared_ptr<vector<uint8_t>> defaultBinary =
             getAvroBinary(reader->defaultValueAt(it->second));
         result->push_back(Symbol::defaultStartAction(defaultBinary));
-        map<NodePair, shared_ptr<Production>>::const_iterator it2 =
+        PairProductions::const_iterator it2 =
             m.find(NodePair(s, s));
         ProductionPtr p = (it2 == m.end()) ? doGenerate2(s, s, m, m2) : it2->second;
         copy(p->rbegin(), p->rend(), back_inserter(*result));
@@ -250,8 +292,8 @@ ProductionPtr ResolvingGrammarGenerator::resolveRecords(
 
 ProductionPtr ResolvingGrammarGenerator::resolveUnion(
     const NodePtr &writer, const NodePtr &reader,
-    map<NodePair, ProductionPtr> &m,
-    map<NodePtr, ProductionPtr> &m2) {
+    PairProductions &m,
+    NodeProductions &m2) {
     vector<ProductionPtr> v;
     size_t c = writer->leaves();
     v.reserve(c);
@@ -267,8 +309,8 @@ ProductionPtr ResolvingGrammarGenerator::resolveUnion(
 
 ProductionPtr ResolvingGrammarGenerator::doGenerate2(
     const NodePtr &w, const NodePtr &r,
-    map<NodePair, ProductionPtr> &m,
-    map<NodePtr, ProductionPtr> &m2) {
+    PairProductions &m,
+    NodeProductions &m2) {
     const NodePtr writer = w->type() == AVRO_SYMBOLIC ? resolveSymbol(w) : w;
     const NodePtr reader = r->type() == AVRO_SYMBOLIC ? resolveSymbol(r) : r;
     Type writerType = writer->type();
@@ -304,7 +346,7 @@ ProductionPtr ResolvingGrammarGenerator::doGenerate2(
             case AVRO_RECORD:
                 if (writer->name() == reader->name()) {
                     const pair<NodePtr, NodePtr> key(writer, reader);
-                    map<NodePair, ProductionPtr>::const_iterator kp = m.find(key);
+                    PairProductions::const_iterator kp = m.find(key);
                     if (kp != m.end()) {
                         return (kp->second) ? kp->second : make_shared<Production>(1, Symbol::placeholder(key));
                     }
@@ -358,7 +400,7 @@ ProductionPtr ResolvingGrammarGenerator::doGenerate2(
                 shared_ptr<NodeSymbolic> r =
                     static_pointer_cast<NodeSymbolic>(reader);
                 NodePair p(w->getNode(), r->getNode());
-                map<NodePair, ProductionPtr>::iterator it = m.find(p);
+                PairProductions::iterator it = m.find(p);
                 if (it != m.end() && it->second) {
                     return it->second;
                 } else {
@@ -394,7 +436,7 @@ ProductionPtr ResolvingGrammarGenerator::doGenerate2(
                 break;
 
             case AVRO_UNION: {
-                int j = bestBranch(writer, reader);
+                int j = branches_.best(writer, reader);
                 if (j >= 0) {
                     ProductionPtr p = doGenerate2(writer, reader->leafAt(j), m, m2);
                     ProductionPtr result = make_shared<Production>();
@@ -490,13 +532,15 @@ class ResolvingDecoderImpl : public ResolvingDecoder {
         parser_.processImplicitActions();
         base_->drain();
     }
+    void setUtf8Validation(bool validate) {
+        base_->setUtf8Validation(validate);
+    }
 
 public:
-    ResolvingDecoderImpl(const ValidSchema &writer, const ValidSchema &reader,
+    ResolvingDecoderImpl(const Symbol &grammar,
                          const DecoderPtr &base) : base_(base),
                                                    handler_(base_),
-                                                   parser_(ResolvingGrammarGenerator().generate(writer, reader),
-                                                           &(*base_), handler_) {
+                                                   parser_(grammar, &(*base_), handler_) {
     }
 };
 
@@ -676,12 +720,1218 @@ const vector<size_t> &ResolvingDecoderImpl<P>::fieldOrder() {
     return parser_.sizeList();
 }
 
+/**
+ * A writer/reader schema pair compiled into one flat array of
+ * instructions. Values are laid out inline in the order they are decoded;
+ * records become routines that are called, so that recursive schemas
+ * compile to finite programs. Writer data that the reader does not want is
+ * described by separate skip routines. The program is immutable and can be
+ * shared between decoders.
+ */
+class ResolvingProgram {
+public:
+    enum Op {
+        // Consumed by the Decoder call of the same name.
+        opNull,
+        opBool,
+        opInt,
+        opLong,
+        opFloat,
+        opDouble,
+        opString,
+        opBytes,
+        opFixed,      // arg is the size.
+        opEnum,       // arg indexes enums.
+        opArrayStart, // arg is the distance to the opLoop, arg2 the routine skipping the whole array.
+        opMapStart,   // Like opArrayStart.
+        opUnion,      // arg is the reader's branch.
+        // End of an array or map item; from is opArrayStart or opMapStart.
+        opLoop,
+        // Handled without any call from the client.
+        opRecord,       // arg indexes fieldOrders. Consumed by fieldOrder(), if called.
+        opSkip,         // arg is the routine skipping the writer's value.
+        // In skip routines, a run of values that take arg bytes in the
+        // binary encoding, described by the arg2 instructions after it.
+        opSkipBytes,
+        opWriterUnion,  // arg indexes unions, one routine per writer branch.
+        opDefaultStart, // arg indexes defaults.
+        opDefaultEnd,
+        opCall, // arg is the routine.
+        opReturn,
+        opRestart, // Starts over with the next top-level value.
+        opError,   // arg indexes errors.
+        // As the from of the instruction of a default of a primitive type,
+        // the value is constants[arg2] and is not read from the base.
+        opConstant
+    };
+
+    struct Instruction {
+        Op op;
+        // For numbers, the writer's type, which differs under promotion.
+        Op from;
+        size_t arg;
+        size_t arg2;
+    };
+
+    // A default of a primitive type, decoded once.
+    struct Constant {
+        int64_t integer;
+        double real;
+        string text;
+        vector<uint8_t> bytes;
+    };
+
+    vector<Instruction> code;
+    size_t entry;
+    vector<vector<size_t>> fieldOrders;
+    vector<vector<size_t>> unions;
+    vector<pair<vector<int>, vector<string>>> enums;
+    vector<shared_ptr<vector<uint8_t>>> defaults;
+    vector<Constant> constants;
+    vector<string> errors;
+
+    static const char *name(Op op) {
+        static const char *const names[] = {
+            "Null", "Bool", "Int", "Long", "Float", "Double", "String",
+            "Bytes", "Fixed", "Enum", "ArrayStart", "MapStart", "Union",
+            "Loop", "Record", "Skip", "SkipBytes", "WriterUnion", "DefaultStart",
+            "DefaultEnd", "Call", "Return", "Restart", "Error", "Constant"};
+        return names[op];
+    }
+};
+
+class ResolvingProgramCompiler {
+    typedef ResolvingProgram::Instruction Instruction;
+    typedef vector<Instruction> Code;
+
+    ResolvingProgram &p_;
+    map<NodePair, size_t> routines_;
+    map<NodePtr, size_t> skipRoutines_;
+    // The index in unions of each pair of a writer's union and a reader's
+    // schema, or a null one for skipping.
+    map<NodePair, size_t> unions_;
+    BranchIndex branches_;
+    // Entry points by routine id; calls refer to the ids until fixup().
+    vector<size_t> routinePcs_;
+
+    static NodePtr resolved(const NodePtr &n) {
+        return (n->type() == AVRO_SYMBOLIC) ? resolveSymbol(n) : n;
+    }
+
+    static Instruction instr(ResolvingProgram::Op op, size_t arg = 0, size_t arg2 = 0) {
+        Instruction result = {op, op, arg, arg2};
+        return result;
+    }
+
+    static Instruction promote(ResolvingProgram::Op op, ResolvingProgram::Op from) {
+        Instruction result = {op, from, 0, 0};
+        return result;
+    }
+
+    static ResolvingProgram::Op primitive(Type t) {
+        switch (t) {
+            case AVRO_NULL:
+                return ResolvingProgram::opNull;
+            case AVRO_BOOL:
+                return ResolvingProgram::opBool;
+            case AVRO_INT:
+                return ResolvingProgram::opInt;
+            case AVRO_LONG:
+                return ResolvingProgram::opLong;
+            case AVRO_FLOAT:
+                return ResolvingProgram::opFloat;
+            case AVRO_DOUBLE:
+                return ResolvingProgram::opDouble;
+            case AVRO_STRING:
+                return ResolvingProgram::opString;
+            case AVRO_BYTES:
+                return ResolvingProgram::opBytes;
+            default:
+                throw Exception("Unknown node type");
+        }
+    }
+
+    size_t append(const Code &c) {
+        size_t pc = p_.code.size();
+        p_.code.insert(p_.code.end(), c.begin(), c.end());
+        return pc;
+    }
+
+    void error(const NodePtr &w, const NodePtr &r, Code &out) {
+        out.push_back(instr(ResolvingProgram::opError, p_.errors.size()));
+        p_.errors.push_back(Symbol::error(w, r).extra<string>());
+    }
+
+    size_t routine(const NodePtr &w, const NodePtr &r) {
+        NodePair key(w, r);
+        map<NodePair, size_t>::const_iterator it = routines_.find(key);
+        if (it != routines_.end()) {
+            return it->second;
+        }
+        size_t id = routinePcs_.size();
+        routinePcs_.push_back(0);
+        routines_[key] = id;
+
+        Code c;
+        if (w->type() == AVRO_RECORD && r->type() == AVRO_RECORD && w->name() == r->name()) {
+            emitRecord(w, r, c);
+        } else {
+            emit(w, r, c);
+        }
+        c.push_back(instr(ResolvingProgram::opReturn));
+        routinePcs_[id] = append(c);
+        return id;
+    }
+
+    size_t skipRoutine(const NodePtr &w) {
+        map<NodePtr, size_t>::const_iterator it = skipRoutines_.find(w);
+        if (it != skipRoutines_.end()) {
+            return it->second;
+        }
+        size_t id = routinePcs_.size();
+        routinePcs_.push_back(0);
+        skipRoutines_[w] = id;
+
+        Code c;
+        if (w->type() == AVRO_RECORD) {
+            emitSkipFields(w, 0, w->leaves(), c);
+        } else {
+            emitSkip(w, c);
+        }
+        c.push_back(instr(ResolvingProgram::opReturn));
+        routinePcs_[id] = append(c);
+        return id;
+    }
+
+    // A routine skipping the fields [begin, end) of the writer's record w.
+    size_t skipFieldsRoutine(const NodePtr &w, size_t begin, size_t end) {
+        if (end - begin == 1) {
+            return skipRoutine(resolved(w->leafAt(begin)));
+        }
+        size_t id = routinePcs_.size();
+        routinePcs_.push_back(0);
+
+        Code c;
+        emitSkipFields(w, begin, end, c);
+        c.push_back(instr(ResolvingProgram::opReturn));
+        routinePcs_[id] = append(c);
+        return id;
+    }
+
+    // Tells whether the binary encoding of w always takes the same number
+    // of bytes, and adds that number to size if so. Records nested too
+    // deep, which a record that contains itself would be, are not.
+    static bool fixedWidth(const NodePtr &w, size_t &size, size_t depth = 0) {
+        switch (w->type()) {
+            case AVRO_NULL:
+                return true;
+            case AVRO_FLOAT:
+                size += 4;
+                return true;
+            case AVRO_DOUBLE:
+                size += 8;
+                return true;
+            case AVRO_FIXED:
+                size += w->fixedSize();
+                return true;
+            case AVRO_RECORD:
+                if (depth == 32) {
+                    return false;
+                }
+                for (size_t i = 0; i < w->leaves(); ++i) {
+                    if (!fixedWidth(resolved(w->leafAt(i)), size, depth + 1)) {
+                        return false;
+                    }
+                }
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Skips the fields [begin, end) of w. Runs of fixed-width fields are
+    // preceded by an opSkipBytes covering all of them.
+    void emitSkipFields(const NodePtr &w, size_t begin, size_t end, Code &out) {
+        size_t i = begin;
+        while (i < end) {
+            size_t size = 0;
+            size_t j = i;
+            while (j < end && fixedWidth(resolved(w->leafAt(j)), size)) {
+                ++j;
+            }
+            if (j - i > 1 || (j > i && resolved(w->leafAt(i))->type() == AVRO_RECORD)) {
+                size_t s = out.size();
+                out.push_back(instr(ResolvingProgram::opSkipBytes, size));
+                for (; i < j; ++i) {
+                    emitSkip(resolved(w->leafAt(i)), out);
+                }
+                out[s].arg2 = out.size() - s - 1;
+            } else {
+                if (j == i) {
+                    ++j;
+                }
+                for (; i < j; ++i) {
+                    emitSkip(resolved(w->leafAt(i)), out);
+                }
+            }
+        }
+    }
+
+    void emitRepeated(ResolvingProgram::Op start, size_t skipId,
+                      const NodePtr &w, const NodePtr &r, Code &out) {
+        size_t s = out.size();
+        out.push_back(instr(start, 0, skipId));
+        if (start == ResolvingProgram::opMapStart) {
+            out.push_back(instr(ResolvingProgram::opString));
+        }
+        if (r) {
+            emit(w, r, out);
+        } else {
+            emitSkip(w, out);
+        }
+        Instruction loop = instr(ResolvingProgram::opLoop);
+        loop.from = start;
+        out[s].arg = out.size() - s;
+        out.push_back(loop);
+    }
+
+    void emitWriterUnion(const NodePtr &w, const NodePtr &r, Code &out) {
+        NodePair key(w, r);
+        map<NodePair, size_t>::const_iterator it = unions_.find(key);
+        if (it != unions_.end()) {
+            out.push_back(instr(ResolvingProgram::opWriterUnion, it->second));
+            return;
+        }
+        vector<size_t> branches;
+        for (size_t i = 0; i < w->leaves(); ++i) {
+            NodePtr b = resolved(w->leafAt(i));
+            branches.push_back(r ? routine(b, r) : skipRoutine(b));
+        }
+        size_t index = p_.unions.size();
+        unions_[key] = index;
+        out.push_back(instr(ResolvingProgram::opWriterUnion, index));
+        p_.unions.push_back(branches);
+    }
+
+    void emitEnum(const NodePtr &w, const NodePtr &r, Code &out) {
+        vector<int> adj;
+        vector<string> err;
+        for (size_t i = 0; i < w->names(); ++i) {
+            size_t j;
+            if (r->nameIndex(w->nameAt(i), j)) {
+                adj.push_back(static_cast<int>(j));
+            } else {
+                err.push_back(w->nameAt(i));
+                adj.push_back(-static_cast<int>(err.size()));
+            }
+        }
+        out.push_back(instr(ResolvingProgram::opEnum, p_.enums.size()));
+        p_.enums.push_back(make_pair(adj, err));
+    }
+
+    void emitRecord(const NodePtr &w, const NodePtr &r, Code &out) {
+        size_t rc = r->leaves();
+        size_t order = p_.fieldOrders.size();
+        p_.fieldOrders.push_back(vector<size_t>());
+        out.push_back(instr(ResolvingProgram::opRecord, order));
+
+        vector<size_t> fieldOrder;
+        vector<bool> seen(rc, false);
+        size_t wc = w->leaves();
+        for (size_t i = 0; i < wc;) {
+            size_t j;
+            if (r->nameIndex(w->nameAt(i), j)) {
+                emit(resolved(w->leafAt(i)), resolved(r->leafAt(j)), out);
+                fieldOrder.push_back(j);
+                seen[j] = true;
+                ++i;
+            } else {
+                // Consecutive fields the reader does not want are skipped
+                // together.
+                size_t end = i + 1;
+                while (end < wc && !r->nameIndex(w->nameAt(end), j)) {
+                    ++end;
+                }
+                out.push_back(instr(ResolvingProgram::opSkip, skipFieldsRoutine(w, i, end)));
+                i = end;
+            }
+        }
+        for (size_t j = 0; j < rc; ++j) {
+            if (seen[j]) {
+                continue;
+            }
+            NodePtr s = resolved(r->leafAt(j));
+            fieldOrder.push_back(j);
+            shared_ptr<vector<uint8_t>> value = getAvroBinary(r->defaultValueAt(j));
+            if (!emitConstant(s, *value, out)) {
+                out.push_back(instr(ResolvingProgram::opDefaultStart, p_.defaults.size()));
+                p_.defaults.push_back(value);
+                emit(s, s, out);
+                out.push_back(instr(ResolvingProgram::opDefaultEnd));
+            }
+        }
+        p_.fieldOrders[order] = fieldOrder;
+    }
+
+    // Emits the one instruction that answers with the default of binary
+    // encoding value, if s is of a primitive type, enum or fixed.
+    bool emitConstant(const NodePtr &s, const vector<uint8_t> &value, Code &out) {
+        ResolvingProgram::Constant c = {0, 0, string(), vector<uint8_t>()};
+        Instruction in = {ResolvingProgram::opNull, ResolvingProgram::opConstant, 0, p_.constants.size()};
+        unique_ptr<InputStream> is = memoryInputStream(value.data(), value.size());
+        DecoderPtr d = binaryDecoder();
+        d->init(*is);
+        switch (s->type()) {
+            case AVRO_NULL:
+                break;
+            case AVRO_BOOL:
+                c.integer = d->decodeBool();
+                break;
+            case AVRO_INT:
+            case AVRO_LONG:
+                c.integer = d->decodeLong();
+                break;
+            case AVRO_FLOAT:
+                c.real = d->decodeFloat();
+                break;
+            case AVRO_DOUBLE:
+                c.real = d->decodeDouble();
+                break;
+            case AVRO_STRING:
+                d->decodeString(c.text);
+                break;
+            case AVRO_BYTES:
+                d->decodeBytes(c.bytes);
+                break;
+            case AVRO_FIXED:
+                in.arg = s->fixedSize();
+                d->decodeFixed(s->fixedSize(), c.bytes);
+                break;
+            case AVRO_ENUM:
+                c.integer = static_cast<int64_t>(d->decodeEnum());
+                break;
+            default:
+                return false;
+        }
+        in.op = s->type() == AVRO_FIXED ? ResolvingProgram::opFixed
+            : s->type() == AVRO_ENUM    ? ResolvingProgram::opEnum
+                                        : primitive(s->type());
+        p_.constants.push_back(c);
+        out.push_back(in);
+        return true;
+    }
+
+    void emitSkip(const NodePtr &w, Code &out) {
+        switch (w->type()) {
+            case AVRO_FIXED:
+                out.push_back(instr(ResolvingProgram::opFixed, w->fixedSize()));
+                break;
+            case AVRO_ENUM:
+                out.push_back(instr(ResolvingProgram::opEnum));
+                break;
+            case AVRO_RECORD:
+                out.push_back(instr(ResolvingProgram::opCall, skipRoutine(w)));
+                break;
+            case AVRO_ARRAY:
+                emitRepeated(ResolvingProgram::opArrayStart, 0,
+                             resolved(w->leafAt(0)), NodePtr(), out);
+                break;
+            case AVRO_MAP:
+                emitRepeated(ResolvingProgram::opMapStart, 0,
+                             resolved(w->leafAt(1)), NodePtr(), out);
+                break;
+            case AVRO_UNION:
+                emitWriterUnion(w, NodePtr(), out);
+                break;
+            default:
+                out.push_back(instr(primitive(w->type())));
+                break;
+        }
+    }
+
+    void emit(const NodePtr &w, const NodePtr &r, Code &out) {
+        Type wt = w->type();
+        Type rt = r->type();
+        if (wt == rt) {
+            switch (wt) {
+                case AVRO_FIXED:
+                    if (w->name() == r->name() && w->fixedSize() == r->fixedSize()) {
+                        out.push_back(instr(ResolvingProgram::opFixed, r->fixedSize()));
+                        return;
+                    }
+                    break;
+                case AVRO_RECORD:
+                    if (w->name() == r->name()) {
+                        out.push_back(instr(ResolvingProgram::opCall, routine(w, r)));
+                        return;
+                    }
+                    break;
+                case AVRO_ENUM:
+                    if (w->name() == r->name()) {
+                        emitEnum(w, r, out);
+                        return;
+                    }
+                    break;
+                case AVRO_ARRAY:
+                    emitRepeated(ResolvingProgram::opArrayStart, skipRoutine(w),
+                                 resolved(w->leafAt(0)), resolved(r->leafAt(0)), out);
+                    return;
+                case AVRO_MAP:
+                    emitRepeated(ResolvingProgram::opMapStart, skipRoutine(w),
+                                 resolved(w->leafAt(1)), resolved(r->leafAt(1)), out);
+                    return;
+                case AVRO_UNION:
+                    emitWriterUnion(w, r, out);
+                    return;
+                default:
+                    out.push_back(instr(primitive(wt)));
+                    return;
+            }
+        } else if (wt == AVRO_UNION) {
+            emitWriterUnion(w, r, out);
+            return;
+        } else {
+            switch (rt) {
+                case AVRO_LONG:
+                    if (wt == AVRO_INT) {
+                        out.push_back(promote(ResolvingProgram::opLong, primitive(wt)));
+                        return;
+                    }
+                    break;
+                case AVRO_FLOAT:
+                    if (wt == AVRO_INT || wt == AVRO_LONG) {
+                        out.push_back(promote(ResolvingProgram::opFloat, primitive(wt)));
+                        return;
+                    }
+                    break;
+                case AVRO_DOUBLE:
+                    if (wt == AVRO_INT || wt == AVRO_LONG || wt == AVRO_FLOAT) {
+                        out.push_back(promote(ResolvingProgram::opDouble, primitive(wt)));
+                        return;
+                    }
+                    break;
+                case AVRO_UNION: {
+                    int j = branches_.best(w, r);
+                    if (j >= 0) {
+                        out.push_back(instr(ResolvingProgram::opUnion, j));
+                        emit(w, resolved(r->leafAt(j)), out);
+                        return;
+                    }
+                } break;
+                default:
+                    break;
+            }
+        }
+        error(w, r, out);
+    }
+
+    // Replaces routine ids by their entry points.
+    void fixup() {
+        for (vector<Instruction>::iterator it = p_.code.begin(); it != p_.code.end(); ++it) {
+            switch (it->op) {
+                case ResolvingProgram::opCall:
+                case ResolvingProgram::opSkip:
+                    it->arg = routinePcs_[it->arg];
+                    break;
+                case ResolvingProgram::opArrayStart:
+                case ResolvingProgram::opMapStart:
+                    it->arg2 = routinePcs_[it->arg2];
+                    break;
+                default:
+                    break;
+            }
+        }
+        for (vector<vector<size_t>>::iterator it = p_.unions.begin(); it != p_.unions.end(); ++it) {
+            for (vector<size_t>::iterator it2 = it->begin(); it2 != it->end(); ++it2) {
+                *it2 = routinePcs_[*it2];
+            }
+        }
+    }
+
+public:
+    explicit ResolvingProgramCompiler(ResolvingProgram &p) : p_(p) {}
+
+    void compile(const ValidSchema &writer, const ValidSchema &reader) {
+        Code main;
+        emit(resolved(writer.root()), resolved(reader.root()), main);
+        main.push_back(instr(ResolvingProgram::opRestart));
+        p_.entry = append(main);
+        fixup();
+    }
+};
+
+/**
+ * Runs a ResolvingProgram. Each Decoder call first executes the implicit
+ * instructions ahead of it, such as skipping writer-only fields, and then
+ * the one instruction that it consumes; the state is a program counter and
+ * a stack of return points and item counts.
+ */
+class CompiledResolvingDecoder : public ResolvingDecoder {
+    typedef ResolvingProgram::Instruction Instruction;
+
+    struct Frame {
+        // The return point for calls, the first item instruction for loops.
+        size_t pc;
+        // Items left in the current block, for loops.
+        size_t remaining;
+    };
+
+    const shared_ptr<const ResolvingProgram> program_;
+    const Instruction *const code_;
+    const DecoderPtr in_;
+    Decoder *base_;
+    const DecoderPtr defaultDecoder_;
+    // Whether in_ is a binary decoder, which can skip runs of fixed-width
+    // values as bytes.
+    const bool binaryIn_;
+    unique_ptr<InputStream> defaultStream_;
+    size_t pc_;
+    vector<Frame> frames_;
+    vector<Frame> skipFrames_;
+
+    static void throwMismatch(ResolvingProgram::Op expected, ResolvingProgram::Op actual) {
+        std::ostringstream oss;
+        oss << "Invalid operation. Schema requires: " << ResolvingProgram::name(expected)
+            << ", got: " << ResolvingProgram::name(actual);
+        throw Exception(oss.str());
+    }
+
+    void push(size_t pc, size_t remaining) {
+        Frame f = {pc, remaining};
+        frames_.push_back(f);
+    }
+
+    // Executes the instruction at pc_ if it needs no client call.
+    bool implicitStep(const Instruction &in) {
+        switch (in.op) {
+            case ResolvingProgram::opRecord:
+                ++pc_;
+                return true;
+            case ResolvingProgram::opSkip:
+                skip(in.arg);
+                ++pc_;
+                return true;
+            case ResolvingProgram::opWriterUnion: {
+                size_t n = base_->decodeUnionIndex();
+                const vector<size_t> &branches = program_->unions[in.arg];
+                if (n >= branches.size()) {
+                    throw Exception("Not that many branches");
+                }
+                push(pc_ + 1, 0);
+                pc_ = branches[n];
+            }
+                return true;
+            case ResolvingProgram::opDefaultStart: {
+                const vector<uint8_t> &d = *program_->defaults[in.arg];
+                unique_ptr<InputStream> is = memoryInputStream(d.data(), d.size());
+                defaultDecoder_->init(*is);
+                defaultStream_ = std::move(is);
+                base_ = defaultDecoder_.get();
+                ++pc_;
+            }
+                return true;
+            case ResolvingProgram::opDefaultEnd:
+                base_ = in_.get();
+                ++pc_;
+                return true;
+            case ResolvingProgram::opCall:
+                push(pc_ + 1, 0);
+                pc_ = in.arg;
+                return true;
+            case ResolvingProgram::opReturn:
+                pc_ = frames_.back().pc;
+                frames_.pop_back();
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Runs the implicit instructions up to the one consuming a call to
+    // the client's \p op and returns that one.
+    const Instruction &advance(ResolvingProgram::Op op) {
+        for (;;) {
+            const Instruction &in = code_[pc_];
+            if (in.op == op) {
+                return in;
+            }
+            if (implicitStep(in)) {
+                continue;
+            }
+            switch (in.op) {
+                case ResolvingProgram::opLoop:
+                    if (frames_.back().remaining > 0) {
+                        --frames_.back().remaining;
+                        pc_ = frames_.back().pc;
+                        continue;
+                    }
+                    break;
+                case ResolvingProgram::opRestart:
+                    pc_ = program_->entry;
+                    continue;
+                case ResolvingProgram::opError:
+                    throw Exception(program_->errors[in.arg]);
+                default:
+                    break;
+            }
+            throwMismatch(in.op, op);
+        }
+    }
+
+    // Runs the implicit instructions at pc_.
+    void settle() {
+        while (implicitStep(code_[pc_])) {
+        }
+    }
+
+    void enterItems(const Instruction &in, size_t n) {
+        if (n == 0) {
+            pc_ += in.arg + 1;
+        } else {
+            push(pc_ + 1, n - 1);
+            ++pc_;
+        }
+    }
+
+    size_t nextItems(ResolvingProgram::Op op) {
+        settle();
+        const Instruction &in = code_[pc_];
+        if (in.op != ResolvingProgram::opLoop || in.from != op || frames_.back().remaining != 0) {
+            throw Exception("Wrong number of items");
+        }
+        size_t n = (op == ResolvingProgram::opArrayStart) ? base_->arrayNext() : base_->mapNext();
+        if (n == 0) {
+            frames_.pop_back();
+            ++pc_;
+        } else {
+            frames_.back().remaining = n - 1;
+            pc_ = frames_.back().pc;
+        }
+        return n;
+    }
+
+    // Skips the writer's value described by the routine at pc.
+    void skip(size_t pc) {
+        const size_t depth = skipFrames_.size();
+        Frame top = {0, 0};
+        skipFrames_.push_back(top);
+        for (;;) {
+            const Instruction &in = code_[pc];
+            switch (in.op) {
+                case ResolvingProgram::opNull:
+                    base_->decodeNull();
+                    break;
+                case ResolvingProgram::opBool:
+                    base_->decodeBool();
+                    break;
+                case ResolvingProgram::opInt:
+                    base_->decodeInt();
+                    break;
+                case ResolvingProgram::opLong:
+                    base_->decodeLong();
+                    break;
+                case ResolvingProgram::opFloat:
+                    base_->decodeFloat();
+                    break;
+                case ResolvingProgram::opDouble:
+                    base_->decodeDouble();
+                    break;
+                case ResolvingProgram::opString:
+                    base_->skipString();
+                    break;
+                case ResolvingProgram::opBytes:
+                    base_->skipBytes();
+                    break;
+                case ResolvingProgram::opFixed:
+                    base_->skipFixed(in.arg);
+                    break;
+                case ResolvingProgram::opEnum:
+                    base_->decodeEnum();
+                    break;
+                case ResolvingProgram::opSkipBytes:
+                    // Defaults are always binary.
+                    if (binaryIn_ || base_ != in_.get()) {
+                        base_->skipFixed(in.arg);
+                        pc += in.arg2;
+                    }
+                    break;
+                case ResolvingProgram::opArrayStart:
+                case ResolvingProgram::opMapStart: {
+                    size_t n = (in.op == ResolvingProgram::opArrayStart) ? base_->skipArray() : base_->skipMap();
+                    if (n == 0) {
+                        pc += in.arg + 1;
+                    } else {
+                        Frame f = {pc + 1, n - 1};
+                        skipFrames_.push_back(f);
+                        ++pc;
+                    }
+                }
+                    continue;
+                case ResolvingProgram::opLoop: {
+                    Frame &f = skipFrames_.back();
+                    if (f.remaining == 0) {
+                        f.remaining = (in.from == ResolvingProgram::opArrayStart) ? base_->arrayNext() : base_->mapNext();
+                        if (f.remaining == 0) {
+                            skipFrames_.pop_back();
+                            break;
+                        }
+                    }
+                    --f.remaining;
+                    pc = f.pc;
+                }
+                    continue;
+                case ResolvingProgram::opWriterUnion: {
+                    size_t n = base_->decodeUnionIndex();
+                    const vector<size_t> &branches = program_->unions[in.arg];
+                    if (n >= branches.size()) {
+                        throw Exception("Not that many branches");
+                    }
+                    Frame f = {pc + 1, 0};
+                    skipFrames_.push_back(f);
+                    pc = branches[n];
+                }
+                    continue;
+                case ResolvingProgram::opCall: {
+                    Frame f = {pc + 1, 0};
+                    skipFrames_.push_back(f);
+                    pc = in.arg;
+                }
+                    continue;
+                case ResolvingProgram::opReturn:
+                    pc = skipFrames_.back().pc;
+                    skipFrames_.pop_back();
+                    if (skipFrames_.size() == depth) {
+                        return;
+                    }
+                    continue;
+                default:
+                    throw Exception(boost::format("Don't know how to skip %1%") % ResolvingProgram::name(in.op));
+            }
+            ++pc;
+        }
+    }
+
+    void init(InputStream &is) override {
+        base_ = in_.get();
+        in_->init(is);
+        pc_ = program_->entry;
+        frames_.clear();
+        skipFrames_.clear();
+    }
+
+    static bool isConstant(const Instruction &in) {
+        return in.from == ResolvingProgram::opConstant;
+    }
+
+    const ResolvingProgram::Constant &constant(const Instruction &in) const {
+        return program_->constants[in.arg2];
+    }
+
+    void decodeNull() override {
+        const Instruction &in = advance(ResolvingProgram::opNull);
+        ++pc_;
+        if (!isConstant(in)) {
+            base_->decodeNull();
+        }
+    }
+
+    bool decodeBool() override {
+        const Instruction &in = advance(ResolvingProgram::opBool);
+        ++pc_;
+        return isConstant(in) ? constant(in).integer != 0 : base_->decodeBool();
+    }
+
+    int32_t decodeInt() override {
+        const Instruction &in = advance(ResolvingProgram::opInt);
+        ++pc_;
+        return isConstant(in) ? static_cast<int32_t>(constant(in).integer) : base_->decodeInt();
+    }
+
+    int64_t decodeLong() override {
+        const Instruction &in = advance(ResolvingProgram::opLong);
+        ++pc_;
+        switch (in.from) {
+            case ResolvingProgram::opInt:
+                return base_->decodeInt();
+            case ResolvingProgram::opConstant:
+                return constant(in).integer;
+            default:
+                return base_->decodeLong();
+        }
+    }
+
+    float decodeFloat() override {
+        const Instruction &in = advance(ResolvingProgram::opFloat);
+        ++pc_;
+        switch (in.from) {
+            case ResolvingProgram::opInt:
+                return static_cast<float>(base_->decodeInt());
+            case ResolvingProgram::opLong:
+                return static_cast<float>(base_->decodeLong());
+            case ResolvingProgram::opConstant:
+                return static_cast<float>(constant(in).real);
+            default:
+                return base_->decodeFloat();
+        }
+    }
+
+    double decodeDouble() override {
+        const Instruction &in = advance(ResolvingProgram::opDouble);
+        ++pc_;
+        switch (in.from) {
+            case ResolvingProgram::opInt:
+                return base_->decodeInt();
+            case ResolvingProgram::opLong:
+                return static_cast<double>(base_->decodeLong());
+            case ResolvingProgram::opFloat:
+                return base_->decodeFloat();
+            case ResolvingProgram::opConstant:
+                return constant(in).real;
+            default:
+                return base_->decodeDouble();
+        }
+    }
+
+    // If the next n values are items of the current array block, each the
+    // one instruction for op, steps past all of them and returns that
+    // instruction. Returns null otherwise, leaving the values to be
+    // decoded one by one.
+    const Instruction *takeItems(ResolvingProgram::Op op, size_t n) {
+        if (n == 0) {
+            return nullptr;
+        }
+        const Instruction &in = advance(op);
+        const Instruction &next = code_[pc_ + 1];
+        if (frames_.empty() || frames_.back().pc != pc_ || next.op != ResolvingProgram::opLoop
+            || next.from != ResolvingProgram::opArrayStart || frames_.back().remaining < n - 1) {
+            return nullptr;
+        }
+        frames_.back().remaining -= n - 1;
+        ++pc_;
+        return &in;
+    }
+
+    // Decodes n values of the writer's type with the bulk call decode of
+    // the base, and converts them to the reader's, a block at a time so
+    // that the conversion loops vectorize.
+    template<typename From, typename To>
+    void promote(void (Decoder::*decode)(From *, size_t), To *values, size_t n) {
+        std::array<From, 256> block;
+        while (n > 0) {
+            size_t m = std::min(n, block.size());
+            (base_->*decode)(block.data(), m);
+            for (size_t i = 0; i < m; ++i) {
+                values[i] = static_cast<To>(block[i]);
+            }
+            values += m;
+            n -= m;
+        }
+    }
+
+    void decodeIntArray(int32_t *values, size_t n) override {
+        if (takeItems(ResolvingProgram::opInt, n) == nullptr) {
+            ResolvingDecoder::decodeIntArray(values, n);
+            return;
+        }
+        base_->decodeIntArray(values, n);
+    }
+
+    void decodeLongArray(int64_t *values, size_t n) override {
+        const Instruction *in = takeItems(ResolvingProgram::opLong, n);
+        if (in == nullptr) {
+            ResolvingDecoder::decodeLongArray(values, n);
+        } else if (in->from == ResolvingProgram::opInt) {
+            promote(&Decoder::decodeIntArray, values, n);
+        } else {
+            base_->decodeLongArray(values, n);
+        }
+    }
+
+    void decodeFloatArray(float *values, size_t n) override {
+        const Instruction *in = takeItems(ResolvingProgram::opFloat, n);
+        if (in == nullptr) {
+            ResolvingDecoder::decodeFloatArray(values, n);
+            return;
+        }
+        switch (in->from) {
+            case ResolvingProgram::opInt:
+                promote(&Decoder::decodeIntArray, values, n);
+                break;
+            case ResolvingProgram::opLong:
+                promote(&Decoder::decodeLongArray, values, n);
+                break;
+            default:
+                base_->decodeFloatArray(values, n);
+                break;
+        }
+    }
+
+    void decodeDoubleArray(double *values, size_t n) override {
+        const Instruction *in = takeItems(ResolvingProgram::opDouble, n);
+        if (in == nullptr) {
+            ResolvingDecoder::decodeDoubleArray(values, n);
+            return;
+        }
+        switch (in->from) {
+            case ResolvingProgram::opInt:
+                promote(&Decoder::decodeIntArray, values, n);
+                break;
+            case ResolvingProgram::opLong:
+                promote(&Decoder::decodeLongArray, values, n);
+                break;
+            case ResolvingProgram::opFloat:
+                promote(&Decoder::decodeFloatArray, values, n);
+                break;
+            default:
+                base_->decodeDoubleArray(values, n);
+                break;
+        }
+    }
+
+    void decodeString(string &value) override {
+        const Instruction &in = advance(ResolvingProgram::opString);
+        ++pc_;
+        if (isConstant(in)) {
+            value = constant(in).text;
+        } else {
+            base_->decodeString(value);
+        }
+    }
+
+    void skipString() override {
+        const Instruction &in = advance(ResolvingProgram::opString);
+        ++pc_;
+        if (!isConstant(in)) {
+            base_->skipString();
+        }
+    }
+
+    void decodeStringView(const char *&data, size_t &len) override {
+        const Instruction &in = advance(ResolvingProgram::opString);
+        ++pc_;
+        if (isConstant(in)) {
+            data = constant(in).text.data();
+            len = constant(in).text.size();
+        } else {
+            base_->decodeStringView(data, len);
+        }
+    }
+
+    void decodeBytes(vector<uint8_t> &value) override {
+        const Instruction &in = advance(ResolvingProgram::opBytes);
+        ++pc_;
+        if (isConstant(in)) {
+            value = constant(in).bytes;
+        } else {
+            base_->decodeBytes(value);
+        }
+    }
+
+    void skipBytes() override {
+        const Instruction &in = advance(ResolvingProgram::opBytes);
+        ++pc_;
+        if (!isConstant(in)) {
+            base_->skipBytes();
+        }
+    }
+
+    void decodeBytesView(const uint8_t *&data, size_t &len) override {
+        const Instruction &in = advance(ResolvingProgram::opBytes);
+        ++pc_;
+        if (isConstant(in)) {
+            data = constant(in).bytes.data();
+            len = constant(in).bytes.size();
+        } else {
+            base_->decodeBytesView(data, len);
+        }
+    }
+
+    void checkFixedSize(const Instruction &in, size_t n) {
+        if (in.arg != n) {
+            std::ostringstream oss;
+            oss << "Incorrect size. Expected: " << in.arg << " found " << n;
+            throw Exception(oss.str());
+        }
+    }
+
+    void decodeFixed(size_t n, vector<uint8_t> &value) override {
+        const Instruction &in = advance(ResolvingProgram::opFixed);
+        checkFixedSize(in, n);
+        ++pc_;
+        if (isConstant(in)) {
+            value = constant(in).bytes;
+        } else {
+            base_->decodeFixed(n, value);
+        }
+    }
+
+    void decodeFixedView(size_t n, const uint8_t *&data) override {
+        const Instruction &in = advance(ResolvingProgram::opFixed);
+        checkFixedSize(in, n);
+        ++pc_;
+        if (isConstant(in)) {
+            data = constant(in).bytes.data();
+        } else {
+            base_->decodeFixedView(n, data);
+        }
+    }
+
+    void skipFixed(size_t n) override {
+        const Instruction &in = advance(ResolvingProgram::opFixed);
+        checkFixedSize(in, n);
+        ++pc_;
+        if (!isConstant(in)) {
+            base_->skipFixed(n);
+        }
+    }
+
+    size_t decodeEnum() override {
+        const Instruction &in = advance(ResolvingProgram::opEnum);
+        ++pc_;
+        if (isConstant(in)) {
+            return static_cast<size_t>(constant(in).integer);
+        }
+        size_t n = base_->decodeEnum();
+        const pair<vector<int>, vector<string>> &adj = program_->enums[in.arg];
+        if (n >= adj.first.size()) {
+            std::ostringstream oss;
+            oss << "Size max value. Upper bound: " << adj.first.size() << " found " << n;
+            throw Exception(oss.str());
+        }
+        int result = adj.first[n];
+        if (result < 0) {
+            std::ostringstream oss;
+            oss << "Cannot resolve symbol: " << adj.second[-result - 1]
+                << std::endl;
+            throw Exception(oss.str());
+        }
+        return result;
+    }
+
+    size_t arrayStart() override {
+        const Instruction &in = advance(ResolvingProgram::opArrayStart);
+        size_t n = base_->arrayStart();
+        enterItems(in, n);
+        return n;
+    }
+
+    size_t arrayNext() override {
+        return nextItems(ResolvingProgram::opArrayStart);
+    }
+
+    size_t skipArray() override {
+        const Instruction &in = advance(ResolvingProgram::opArrayStart);
+        skip(in.arg2);
+        pc_ += in.arg + 1;
+        return 0;
+    }
+
+    size_t mapStart() override {
+        const Instruction &in = advance(ResolvingProgram::opMapStart);
+        size_t n = base_->mapStart();
+        enterItems(in, n);
+        return n;
+    }
+
+    size_t mapNext() override {
+        return nextItems(ResolvingProgram::opMapStart);
+    }
+
+    size_t skipMap() override {
+        const Instruction &in = advance(ResolvingProgram::opMapStart);
+        skip(in.arg2);
+        pc_ += in.arg + 1;
+        return 0;
+    }
+
+    size_t decodeUnionIndex() override {
+        const Instruction &in = advance(ResolvingProgram::opUnion);
+        ++pc_;
+        return in.arg;
+    }
+
+    const vector<size_t> &fieldOrder() override {
+        const Instruction &in = advance(ResolvingProgram::opRecord);
+        ++pc_;
+        return program_->fieldOrders[in.arg];
+    }
+
+    void drain() override {
+        settle();
+        in_->drain();
+    }
+
+    void setUtf8Validation(bool validate) override {
+        in_->setUtf8Validation(validate);
+    }
+
+public:
+    CompiledResolvingDecoder(const shared_ptr<const ResolvingProgram> &program,
+                             const DecoderPtr &base) : program_(program),
+                                                       code_(program_->code.data()),
+                                                       in_(base),
+                                                       base_(base.get()),
+                                                       defaultDecoder_(binaryDecoder()),
+                                                       binaryIn_(typeid(*base) == typeid(*defaultDecoder_)),
+                                                       pc_(program_->entry) {
+    }
+};
+
+static shared_ptr<const Symbol> buildGrammar(const ValidSchema &writer,
+                                             const ValidSchema &reader) {
+    AVRO_TRACE_SCOPE(TRACE_RESOLVE, 0);
+    return make_shared<Symbol>(ResolvingGrammarGenerator().generate(writer, reader));
+}
+
+static shared_ptr<const ResolvingProgram> buildProgram(const ValidSchema &writer,
+                                                       const ValidSchema &reader) {
+    AVRO_TRACE_SCOPE(TRACE_RESOLVE, 0);
+    shared_ptr<ResolvingProgram> result = make_shared<ResolvingProgram>();
+    ResolvingProgramCompiler(*result).compile(writer, reader);
+    return result;
+}
+
+static const size_t defaultResolutionCacheCapacity = 64;
+
+static SchemaCache<Symbol> &grammarCache() {
+    static SchemaCache<Symbol> cache(defaultResolutionCacheCapacity);
+    return cache;
+}
+
+static SchemaCache<ResolvingProgram> &programCache() {
+    static SchemaCache<ResolvingProgram> cache(defaultResolutionCacheCapacity);
+    return cache;
+}
+
+// Parsing Canonical Form leaves out defaults, which matter on the reader's
+// side, so only the writer is known by its fingerprint.
+template<typename T>
+static shared_ptr<const T> resolution(SchemaCache<T> &cache,
+                                      const ValidSchema &writer, const ValidSchema &reader,
+                                      shared_ptr<const T> (*build)(const ValidSchema &, const ValidSchema &)) {
+    typename SchemaCache<T>::Key key(writer.sha256Fingerprint(), reader.toJson(false));
+    return cache.get(key, std::bind(build, std::cref(writer), std::cref(reader)));
+}
+
 } // namespace parsing
 
 ResolvingDecoderPtr resolvingDecoder(const ValidSchema &writer,
                                      const ValidSchema &reader, const DecoderPtr &base) {
+    std::shared_ptr<const parsing::Symbol> grammar =
+        parsing::resolution(parsing::grammarCache(), writer, reader, parsing::buildGrammar);
     return make_shared<parsing::ResolvingDecoderImpl<parsing::SimpleParser<parsing::ResolvingDecoderHandler>>>(
-        writer, reader, base);
+        *grammar, base);
+}
+
+ResolvingDecoderPtr compiledResolvingDecoder(const ValidSchema &writer,
+                                             const ValidSchema &reader, const DecoderPtr &base) {
+    return make_shared<parsing::CompiledResolvingDecoder>(
+        parsing::resolution(parsing::programCache(), writer, reader, parsing::buildProgram), base);
+}
+
+void setResolvingDecoderCacheCapacity(size_t capacity) {
+    parsing::grammarCache().setCapacity(capacity);
+    parsing::programCache().setCapacity(capacity);
 }
 
 } // namespace avro
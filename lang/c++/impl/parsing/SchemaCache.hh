@@ -0,0 +1,106 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef avro_parsing_SchemaCache_hh__
+#define avro_parsing_SchemaCache_hh__
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace avro {
+namespace parsing {
+
+/**
+ * A bounded, least recently used cache of what is built from schemas, such
+ * as grammars and programs. What is cached must be immutable once built,
+ * so that one copy can back any number of decoders and encoders, in any
+ * number of threads, at the same time. Building happens outside the lock;
+ * if two threads race on the same key, the first one inserted wins.
+ */
+template<typename T>
+class SchemaCache {
+public:
+    /**
+     * A schema's SHA-256 fingerprint, and whatever the fingerprint leaves
+     * out that matters, such as the JSON of a reader's schema.
+     */
+    typedef std::pair<std::array<uint8_t, 32>, std::string> Key;
+    typedef std::function<std::shared_ptr<const T>()> Builder;
+
+private:
+    typedef std::list<std::pair<Key, std::shared_ptr<const T>>> Entries;
+
+    std::mutex mutex_;
+    size_t capacity_;
+    Entries entries_;
+    std::map<Key, typename Entries::iterator> index_;
+
+    void trim() {
+        while (entries_.size() > capacity_) {
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+        }
+    }
+
+public:
+    explicit SchemaCache(size_t capacity) : capacity_(capacity) {}
+
+    std::shared_ptr<const T> get(const Key &key, const Builder &build) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            typename std::map<Key, typename Entries::iterator>::iterator it = index_.find(key);
+            if (it != index_.end()) {
+                entries_.splice(entries_.begin(), entries_, it->second);
+                return it->second->second;
+            }
+        }
+
+        std::shared_ptr<const T> result = build();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (capacity_ == 0) {
+            return result;
+        }
+        typename std::map<Key, typename Entries::iterator>::iterator it = index_.find(key);
+        if (it != index_.end()) {
+            return it->second->second;
+        }
+        entries_.push_front(std::make_pair(key, result));
+        index_[key] = entries_.begin();
+        trim();
+        return result;
+    }
+
+    void setCapacity(size_t capacity) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        capacity_ = capacity;
+        trim();
+    }
+};
+
+} // namespace parsing
+} // namespace avro
+
+#endif
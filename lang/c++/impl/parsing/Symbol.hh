@@ -31,12 +31,60 @@
 #include "Decoder.hh"
 #include "Exception.hh"
 #include "Node.hh"
+#include "NodeConcepts.hh"
 
 namespace avro {
 namespace parsing {
 
 class Symbol;
 
+/**
+ * The names JSON gives to the symbols of an enum or the branches of a
+ * union, indexed by hash as the names of an enum node are, so that
+ * decoding finds a name without comparing it with those before it.
+ */
+class NameList {
+    typedef concepts::MultiAttribute<std::string> Names;
+
+    Names names_;
+    concepts::NameIndexConcept<Names> index_;
+    // False if a name comes twice, which unions do not guard against;
+    // the first of them is then found by going through the names.
+    bool indexed_;
+
+public:
+    explicit NameList(const std::vector<std::string> &names) : indexed_(true) {
+        for (std::vector<std::string>::const_iterator it = names.begin();
+             it != names.end(); ++it) {
+            names_.add(*it);
+            if (indexed_ && !index_.add(names_)) {
+                indexed_ = false;
+            }
+        }
+    }
+
+    size_t size() const {
+        return names_.size();
+    }
+
+    const std::string &nameAt(size_t index) const {
+        return names_.get(index);
+    }
+
+    bool index(const std::string &name, size_t &index) const {
+        if (indexed_) {
+            return index_.lookup(names_, name.data(), name.size(), index);
+        }
+        for (size_t i = 0; i < names_.size(); ++i) {
+            if (names_.get(i) == name) {
+                index = i;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
 typedef std::vector<Symbol> Production;
 typedef std::shared_ptr<Production> ProductionPtr;
 typedef boost::tuple<std::stack<ssize_t>, bool, ProductionPtr, ProductionPtr> RepeaterInfo;
@@ -63,7 +111,7 @@ public:
         sUnion,
         sTerminalHigh,
         sSizeCheck,   // Extra has size
-        sNameList,    // Extra has a vector<string>
+        sNameList,    // Extra has a shared_ptr<const NameList>
         sRoot,        // Root for a schema, extra is Symbol
         sRepeater,    // Array or Map, extra is symbol
         sAlternative, // One of many (union), extra is Union
@@ -250,7 +298,7 @@ public:
 
     static Symbol nameListSymbol(
         const std::vector<std::string> &v) {
-        return Symbol(sNameList, v);
+        return Symbol(sNameList, std::shared_ptr<const NameList>(std::make_shared<NameList>(v)));
     }
 
     template<typename T>
@@ -295,11 +343,11 @@ public:
 
 /**
  * Recursively replaces all placeholders in the production with the
- * corresponding values.
+ * corresponding values. \p m is a map, ordered or hashed, from the keys
+ * of the placeholders to their productions.
  */
-template<typename T>
-void fixup(const ProductionPtr &p,
-           const std::map<T, ProductionPtr> &m) {
+template<typename M>
+void fixup(const ProductionPtr &p, const M &m) {
     std::set<ProductionPtr> seen;
     for (Production::iterator it = p->begin(); it != p->end(); ++it) {
         fixup(*it, m, seen);
@@ -310,9 +358,8 @@ void fixup(const ProductionPtr &p,
  * Recursively replaces all placeholders in the symbol with the values with the
  * corresponding values.
  */
-template<typename T>
-void fixup_internal(const ProductionPtr &p,
-                    const std::map<T, ProductionPtr> &m,
+template<typename M>
+void fixup_internal(const ProductionPtr &p, const M &m,
                     std::set<ProductionPtr> &seen) {
     if (seen.find(p) == seen.end()) {
         seen.insert(p);
@@ -322,9 +369,8 @@ void fixup_internal(const ProductionPtr &p,
     }
 }
 
-template<typename T>
-void fixup(Symbol &s, const std::map<T, ProductionPtr> &m,
-           std::set<ProductionPtr> &seen) {
+template<typename M>
+void fixup(Symbol &s, const M &m, std::set<ProductionPtr> &seen) {
     switch (s.kind()) {
         case Symbol::sIndirect:
             fixup_internal(s.extra<ProductionPtr>(), m, seen);
@@ -343,8 +389,8 @@ void fixup(Symbol &s, const std::map<T, ProductionPtr> &m,
             fixup_internal(boost::tuples::get<3>(ri), m, seen);
         } break;
         case Symbol::sPlaceholder: {
-            typename std::map<T, std::shared_ptr<Production>>::const_iterator it =
-                m.find(s.extra<T>());
+            typename M::const_iterator it =
+                m.find(s.extra<typename M::key_type>());
             if (it == m.end()) {
                 throw Exception("Placeholder symbol cannot be resolved");
             }
@@ -647,12 +693,11 @@ public:
     std::string nameForIndex(size_t e) {
         const Symbol &s = parsingStack.top();
         assertMatch(Symbol::sNameList, s.kind());
-        const std::vector<std::string> names =
-            s.extra<std::vector<std::string>>();
+        const NameList &names = *s.extra<std::shared_ptr<const NameList>>();
         if (e >= names.size()) {
             throw Exception("Not that many names");
         }
-        std::string result = names[e];
+        std::string result = names.nameAt(e);
         parsingStack.pop();
         return result;
     }
@@ -660,14 +705,10 @@ public:
     size_t indexForName(const std::string &name) {
         const Symbol &s = parsingStack.top();
         assertMatch(Symbol::sNameList, s.kind());
-        const std::vector<std::string> names =
-            s.extra<std::vector<std::string>>();
-        std::vector<std::string>::const_iterator it =
-            std::find(names.begin(), names.end(), name);
-        if (it == names.end()) {
+        size_t result;
+        if (!s.extra<std::shared_ptr<const NameList>>()->index(name, result)) {
             throw Exception("No such enum symbol");
         }
-        size_t result = it - names.begin();
         parsingStack.pop();
         return result;
     }
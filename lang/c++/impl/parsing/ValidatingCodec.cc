@@ -20,13 +20,15 @@
 
 #include <algorithm>
 #include <boost/any.hpp>
-#include <map>
+#include <functional>
 #include <memory>
 #include <string>
+#include <unordered_map>
 
 #include "Decoder.hh"
 #include "Encoder.hh"
 #include "NodeImpl.hh"
+#include "SchemaCache.hh"
 #include "ValidSchema.hh"
 
 namespace avro {
@@ -38,7 +40,6 @@ namespace parsing {
 using std::shared_ptr;
 using std::static_pointer_cast;
 
-using std::map;
 using std::ostringstream;
 using std::pair;
 using std::reverse;
@@ -47,7 +48,7 @@ using std::vector;
 
 /** Follows the design of Avro Parser in Java. */
 ProductionPtr ValidatingGrammarGenerator::generate(const NodePtr &n) {
-    map<NodePtr, ProductionPtr> m;
+    NodeProductions m;
     ProductionPtr result = doGenerate(n, m);
     fixup(result, m);
     return result;
@@ -59,7 +60,7 @@ Symbol ValidatingGrammarGenerator::generate(const ValidSchema &schema) {
 }
 
 ProductionPtr ValidatingGrammarGenerator::doGenerate(const NodePtr &n,
-                                                     map<NodePtr, ProductionPtr> &m) {
+                                                     NodeProductions &m) {
     switch (n->type()) {
         case AVRO_NULL:
             return make_shared<Production>(1, Symbol::nullSymbol());
@@ -85,6 +86,11 @@ ProductionPtr ValidatingGrammarGenerator::doGenerate(const NodePtr &n,
             return result;
         }
         case AVRO_RECORD: {
+            NodeProductions::const_iterator it = m.find(n);
+            if (it != m.end() && it->second) {
+                // The record is shared by several parents.
+                return make_shared<Production>(1, Symbol::indirect(it->second));
+            }
             ProductionPtr result = make_shared<Production>();
 
             m.erase(n);
@@ -136,10 +142,8 @@ ProductionPtr ValidatingGrammarGenerator::doGenerate(const NodePtr &n,
             return result;
         }
         case AVRO_SYMBOLIC: {
-            shared_ptr<NodeSymbolic> ns = static_pointer_cast<NodeSymbolic>(n);
-            NodePtr nn = ns->getNode();
-            map<NodePtr, ProductionPtr>::iterator it =
-                m.find(nn);
+            NodePtr nn = static_cast<const NodeSymbolic &>(*n).getNode();
+            NodeProductions::iterator it = m.find(nn);
             if (it != m.end() && it->second) {
                 return it->second;
             } else {
@@ -152,16 +156,384 @@ ProductionPtr ValidatingGrammarGenerator::doGenerate(const NodePtr &n,
     }
 }
 
-struct DummyHandler {
-    size_t handle(const Symbol &s) {
-        return 0;
+/**
+ * The validating grammar of a schema flattened into tables of plain
+ * values. Productions are contiguous ranges of items, kept in stack order
+ * like Production, and items refer to other productions by index, so
+ * that recursive schemas flatten to finite tables.
+ */
+class FlatGrammar {
+public:
+    struct Item {
+        Symbol::Kind kind;
+        // The size for sSizeCheck; the production for sRoot, sIndirect,
+        // sSymbolic and sRepeater; the first entry in branches for
+        // sAlternative.
+        size_t arg;
+        // The number of branches for sAlternative; for sRepeater, whether
+        // it repeats array items.
+        size_t arg2;
+    };
+
+    std::vector<Item> items;
+    // The [begin, end) ranges of the productions in items.
+    std::vector<std::pair<size_t, size_t>> productions;
+    // The productions of the branches of the unions.
+    std::vector<size_t> branches;
+    // The item standing for the schema as a whole.
+    size_t root;
+
+    explicit FlatGrammar(const Symbol &s) {
+        if (s.kind() != Symbol::sRoot) {
+            throw Exception("Grammar has no root");
+        }
+        Item r = {Symbol::sRoot, production(boost::tuples::get<0>(*s.extrap<RootInfo>())), 0};
+        root = items.size();
+        items.push_back(r);
+        std::unordered_map<const Production *, size_t>().swap(indexes_);
+    }
+
+private:
+    std::unordered_map<const Production *, size_t> indexes_;
+
+    size_t production(const ProductionPtr &p) {
+        std::unordered_map<const Production *, size_t>::const_iterator it = indexes_.find(p.get());
+        if (it != indexes_.end()) {
+            return it->second;
+        }
+        // Numbered before its items, so that cycles through it close.
+        size_t result = productions.size();
+        indexes_[p.get()] = result;
+        productions.push_back(std::make_pair(size_t(0), size_t(0)));
+        std::vector<Item> v;
+        v.reserve(p->size());
+        for (Production::const_iterator it2 = p->begin(); it2 != p->end(); ++it2) {
+            v.push_back(item(*it2));
+        }
+        productions[result] = std::make_pair(items.size(), items.size() + v.size());
+        items.insert(items.end(), v.begin(), v.end());
+        return result;
+    }
+
+    Item item(const Symbol &s) {
+        Item result = {s.kind(), 0, 0};
+        switch (s.kind()) {
+            case Symbol::sSizeCheck:
+                result.arg = s.extra<size_t>();
+                break;
+            case Symbol::sIndirect:
+                result.arg = production(s.extra<ProductionPtr>());
+                break;
+            case Symbol::sSymbolic:
+                result.arg = production(ProductionPtr(s.extra<std::weak_ptr<Production>>()));
+                break;
+            case Symbol::sRepeater: {
+                // Validating repeaters read and skip items alike.
+                const RepeaterInfo &ri = *s.extrap<RepeaterInfo>();
+                result.arg = production(boost::tuples::get<2>(ri));
+                result.arg2 = boost::tuples::get<1>(ri);
+            } break;
+            case Symbol::sAlternative: {
+                const std::vector<ProductionPtr> &vv = *s.extrap<std::vector<ProductionPtr>>();
+                std::vector<size_t> b;
+                b.reserve(vv.size());
+                for (std::vector<ProductionPtr>::const_iterator it = vv.begin(); it != vv.end(); ++it) {
+                    b.push_back(production(*it));
+                }
+                result.arg = branches.size();
+                result.arg2 = b.size();
+                branches.insert(branches.end(), b.begin(), b.end());
+            } break;
+            default:
+                if (!s.isTerminal()) {
+                    std::ostringstream oss;
+                    oss << "Cannot flatten " << Symbol::toString(s.kind());
+                    throw Exception(oss.str());
+                }
+                break;
+        }
+        return result;
+    }
+};
+
+static const size_t defaultGrammarCacheCapacity = 64;
+
+static SchemaCache<FlatGrammar> &grammarCache() {
+    static SchemaCache<FlatGrammar> cache(defaultGrammarCacheCapacity);
+    return cache;
+}
+
+static shared_ptr<const FlatGrammar> buildGrammar(const ValidSchema &schema) {
+    return make_shared<FlatGrammar>(ValidatingGrammarGenerator().generate(schema));
+}
+
+/**
+ * A SimpleParser for validating grammars that runs on a FlatGrammar. The
+ * parsing stack holds item indexes and repeat counts only, and keeps its
+ * capacity, so that once it has grown to the depth of the data, parsing
+ * neither allocates nor touches reference counts. The grammar is never
+ * modified, so parsers of one schema share it, through grammarCache().
+ */
+class FlatParser {
+    struct Entry {
+        size_t item;
+        // Items left in the current block, for repeaters; negative until
+        // the count is known.
+        ssize_t count;
+    };
+
+    const shared_ptr<const FlatGrammar> grammar_;
+    std::vector<Entry> stack_;
+
+    static void throwMismatch(Symbol::Kind actual, Symbol::Kind expected) {
+        std::ostringstream oss;
+        oss << "Invalid operation. Schema requires: " << Symbol::toString(expected) << ", got: " << Symbol::toString(actual);
+        throw Exception(oss.str());
+    }
+
+    static void assertMatch(Symbol::Kind actual, Symbol::Kind expected) {
+        if (expected != actual) {
+            throwMismatch(actual, expected);
+        }
+    }
+
+    static void assertLessThan(size_t n, size_t s) {
+        if (n >= s) {
+            std::ostringstream oss;
+            oss << "Size max value. Upper bound: " << s << " found " << n;
+            throw Exception(oss.str());
+        }
+    }
+
+    const FlatGrammar::Item &item(const Entry &e) const {
+        return grammar_->items[e.item];
+    }
+
+    void append(size_t production) {
+        const std::pair<size_t, size_t> &p = grammar_->productions[production];
+        for (size_t i = p.first; i != p.second; ++i) {
+            Entry e = {i, -1};
+            stack_.push_back(e);
+        }
+    }
+
+    size_t popSize() {
+        const FlatGrammar::Item &s = item(stack_.back());
+        assertMatch(Symbol::sSizeCheck, s.kind);
+        stack_.pop_back();
+        return s.arg;
+    }
+
+    Entry &repeater() {
+        Entry &e = stack_.back();
+        assertMatch(Symbol::sRepeater, item(e).kind);
+        return e;
+    }
+
+public:
+    // Validating grammars depend on nothing that Parsing Canonical Form
+    // leaves out.
+    explicit FlatParser(const ValidSchema &schema)
+        : grammar_(grammarCache().get(SchemaCache<FlatGrammar>::Key(schema.sha256Fingerprint(), string()),
+                                      std::bind(buildGrammar, std::cref(schema)))) {
+        stack_.reserve(64);
+        Entry e = {grammar_->root, -1};
+        stack_.push_back(e);
+    }
+
+    void reset() {
+        stack_.resize(1);
+    }
+
+    Symbol::Kind advance(Symbol::Kind k) {
+        for (;;) {
+            Entry &e = stack_.back();
+            const FlatGrammar::Item &s = item(e);
+            if (s.kind == k) {
+                stack_.pop_back();
+                return k;
+            }
+            switch (s.kind) {
+                case Symbol::sRoot:
+                    append(s.arg);
+                    continue;
+                case Symbol::sIndirect:
+                case Symbol::sSymbolic:
+                    stack_.pop_back();
+                    append(s.arg);
+                    continue;
+                case Symbol::sRepeater:
+                    if (e.count < 0) {
+                        throw Exception("Empty item count stack in repeater advance");
+                    }
+                    if (e.count == 0) {
+                        throw Exception("Zero item count in repeater advance");
+                    }
+                    --e.count;
+                    append(s.arg);
+                    continue;
+                default:
+                    if (s.kind > Symbol::sTerminalLow && s.kind < Symbol::sTerminalHigh) {
+                        throwMismatch(k, s.kind);
+                    } else {
+                        std::ostringstream oss;
+                        oss << "Encountered " << Symbol::toString(s.kind)
+                            << " while looking for " << Symbol::toString(k);
+                        throw Exception(oss.str());
+                    }
+            }
+        }
+    }
+
+    void skip(Decoder &d) {
+        const size_t sz = stack_.size();
+        if (sz == 0) {
+            throw Exception("Nothing to skip!");
+        }
+        while (stack_.size() >= sz) {
+            Entry &t = stack_.back();
+            const FlatGrammar::Item &s = item(t);
+            switch (s.kind) {
+                case Symbol::sNull:
+                    d.decodeNull();
+                    break;
+                case Symbol::sBool:
+                    d.decodeBool();
+                    break;
+                case Symbol::sInt:
+                    d.decodeInt();
+                    break;
+                case Symbol::sLong:
+                    d.decodeLong();
+                    break;
+                case Symbol::sFloat:
+                    d.decodeFloat();
+                    break;
+                case Symbol::sDouble:
+                    d.decodeDouble();
+                    break;
+                case Symbol::sString:
+                    d.skipString();
+                    break;
+                case Symbol::sBytes:
+                    d.skipBytes();
+                    break;
+                case Symbol::sArrayStart:
+                case Symbol::sMapStart: {
+                    stack_.pop_back();
+                    size_t n = (s.kind == Symbol::sArrayStart) ? d.skipArray() : d.skipMap();
+                    Entry &r = repeater();
+                    if (n == 0) {
+                        break;
+                    }
+                    r.count = n;
+                    continue;
+                }
+                case Symbol::sArrayEnd:
+                case Symbol::sMapEnd:
+                    break;
+                case Symbol::sFixed:
+                    stack_.pop_back();
+                    d.skipFixed(item(stack_.back()).arg);
+                    break;
+                case Symbol::sEnum:
+                    stack_.pop_back();
+                    d.decodeEnum();
+                    break;
+                case Symbol::sUnion: {
+                    stack_.pop_back();
+                    size_t n = d.decodeUnionIndex();
+                    selectBranch(n);
+                    continue;
+                }
+                case Symbol::sRepeater:
+                    if (t.count < 0) {
+                        throw Exception("Empty item count stack in repeater skip");
+                    }
+                    if (t.count == 0) {
+                        t.count = s.arg2 ? d.arrayNext() : d.mapNext();
+                    }
+                    if (t.count != 0) {
+                        --t.count;
+                        append(s.arg);
+                        continue;
+                    }
+                    break;
+                case Symbol::sIndirect:
+                case Symbol::sSymbolic:
+                    stack_.pop_back();
+                    append(s.arg);
+                    continue;
+                default: {
+                    std::ostringstream oss;
+                    oss << "Don't know how to skip "
+                        << Symbol::toString(s.kind);
+                    throw Exception(oss.str());
+                }
+            }
+            stack_.pop_back();
+        }
+    }
+
+    void assertSize(size_t n) {
+        size_t s = popSize();
+        if (s != n) {
+            std::ostringstream oss;
+            oss << "Incorrect size. Expected: " << s << " found " << n;
+            throw Exception(oss.str());
+        }
+    }
+
+    void assertLessThanSize(size_t n) {
+        assertLessThan(n, popSize());
+    }
+
+    void pushRepeatCount(size_t n) {
+        repeater().count = n;
+    }
+
+    void nextRepeatCount(size_t n) {
+        Entry &e = repeater();
+        if (e.count != 0) {
+            throw Exception("Wrong number of items");
+        }
+        e.count = n;
+    }
+
+    void popRepeater() {
+        Entry &e = repeater();
+        if (e.count < 0) {
+            throw Exception("Incorrect number of items (empty)");
+        }
+        if (e.count > 0) {
+            throw Exception("Incorrect number of items (non-zero)");
+        }
+        stack_.pop_back();
+    }
+
+    void selectBranch(size_t n) {
+        const FlatGrammar::Item &s = item(stack_.back());
+        assertMatch(Symbol::sAlternative, s.kind);
+        if (n >= s.arg2) {
+            throw Exception("Not that many branches");
+        }
+        size_t p = grammar_->branches[s.arg + n];
+        stack_.pop_back();
+        append(p);
+    }
+
+    Symbol::Kind top() const {
+        return item(stack_.back()).kind;
+    }
+
+    void pop() {
+        stack_.pop_back();
     }
 };
 
 template<typename P>
 class ValidatingDecoder : public Decoder {
     const shared_ptr<Decoder> base;
-    DummyHandler handler_;
     P parser;
 
     void init(InputStream &is);
@@ -173,9 +545,12 @@ class ValidatingDecoder : public Decoder {
     double decodeDouble();
     void decodeString(string &value);
     void skipString();
+    void decodeStringView(const char *&data, size_t &len);
     void decodeBytes(vector<uint8_t> &value);
     void skipBytes();
+    void decodeBytesView(const uint8_t *&data, size_t &len);
     void decodeFixed(size_t n, vector<uint8_t> &value);
+    void decodeFixedView(size_t n, const uint8_t *&data);
     void skipFixed(size_t n);
     size_t decodeEnum();
     size_t arrayStart();
@@ -188,15 +563,19 @@ class ValidatingDecoder : public Decoder {
     void drain() {
         base->drain();
     }
+    void setUtf8Validation(bool validate) {
+        base->setUtf8Validation(validate);
+    }
 
 public:
     ValidatingDecoder(const ValidSchema &s, const shared_ptr<Decoder> b) : base(b),
-                                                                           parser(ValidatingGrammarGenerator().generate(s), NULL, handler_) {}
+                                                                           parser(s) {}
 };
 
 template<typename P>
 void ValidatingDecoder<P>::init(InputStream &is) {
     base->init(is);
+    parser.reset();
 }
 
 template<typename P>
@@ -241,6 +620,12 @@ void ValidatingDecoder<P>::decodeString(string &value) {
     base->decodeString(value);
 }
 
+template<typename P>
+void ValidatingDecoder<P>::decodeStringView(const char *&data, size_t &len) {
+    parser.advance(Symbol::sString);
+    base->decodeStringView(data, len);
+}
+
 template<typename P>
 void ValidatingDecoder<P>::skipString() {
     parser.advance(Symbol::sString);
@@ -253,6 +638,12 @@ void ValidatingDecoder<P>::decodeBytes(vector<uint8_t> &value) {
     base->decodeBytes(value);
 }
 
+template<typename P>
+void ValidatingDecoder<P>::decodeBytesView(const uint8_t *&data, size_t &len) {
+    parser.advance(Symbol::sBytes);
+    base->decodeBytesView(data, len);
+}
+
 template<typename P>
 void ValidatingDecoder<P>::skipBytes() {
     parser.advance(Symbol::sBytes);
@@ -266,6 +657,13 @@ void ValidatingDecoder<P>::decodeFixed(size_t n, vector<uint8_t> &value) {
     base->decodeFixed(n, value);
 }
 
+template<typename P>
+void ValidatingDecoder<P>::decodeFixedView(size_t n, const uint8_t *&data) {
+    parser.advance(Symbol::sFixed);
+    parser.assertSize(n);
+    base->decodeFixedView(n, data);
+}
+
 template<typename P>
 void ValidatingDecoder<P>::skipFixed(size_t n) {
     parser.advance(Symbol::sFixed);
@@ -365,7 +763,6 @@ size_t ValidatingDecoder<P>::decodeUnionIndex() {
 
 template<typename P>
 class ValidatingEncoder : public Encoder {
-    DummyHandler handler_;
     P parser_;
     EncoderPtr base_;
 
@@ -379,6 +776,7 @@ class ValidatingEncoder : public Encoder {
     void encodeFloat(float f);
     void encodeDouble(double d);
     void encodeString(const std::string &s);
+    void encodeStringView(const char *data, size_t len);
     void encodeBytes(const uint8_t *bytes, size_t len);
     void encodeFixed(const uint8_t *bytes, size_t len);
     void encodeEnum(size_t e);
@@ -391,13 +789,14 @@ class ValidatingEncoder : public Encoder {
     void encodeUnionIndex(size_t e);
 
 public:
-    ValidatingEncoder(const ValidSchema &schema, const EncoderPtr &base) : parser_(ValidatingGrammarGenerator().generate(schema), NULL, handler_),
+    ValidatingEncoder(const ValidSchema &schema, const EncoderPtr &base) : parser_(schema),
                                                                            base_(base) {}
 };
 
 template<typename P>
 void ValidatingEncoder<P>::init(OutputStream &os) {
     base_->init(os);
+    parser_.reset();
 }
 
 template<typename P>
@@ -447,6 +846,12 @@ void ValidatingEncoder<P>::encodeString(const std::string &s) {
     base_->encodeString(s);
 }
 
+template<typename P>
+void ValidatingEncoder<P>::encodeStringView(const char *data, size_t len) {
+    parser_.advance(Symbol::sString);
+    base_->encodeStringView(data, len);
+}
+
 template<typename P>
 void ValidatingEncoder<P>::encodeBytes(const uint8_t *bytes, size_t len) {
     parser_.advance(Symbol::sBytes);
@@ -525,11 +930,15 @@ int64_t ValidatingEncoder<P>::byteCount() const {
 
 DecoderPtr validatingDecoder(const ValidSchema &s,
                              const DecoderPtr &base) {
-    return make_shared<parsing::ValidatingDecoder<parsing::SimpleParser<parsing::DummyHandler>>>(s, base);
+    return make_shared<parsing::ValidatingDecoder<parsing::FlatParser>>(s, base);
 }
 
 EncoderPtr validatingEncoder(const ValidSchema &schema, const EncoderPtr &base) {
-    return make_shared<parsing::ValidatingEncoder<parsing::SimpleParser<parsing::DummyHandler>>>(schema, base);
+    return make_shared<parsing::ValidatingEncoder<parsing::FlatParser>>(schema, base);
+}
+
+void setValidatingCodecCacheCapacity(size_t capacity) {
+    parsing::grammarCache().setCapacity(capacity);
 }
 
 } // namespace avro
@@ -20,6 +20,7 @@
 #define avro_parsing_ValidatingCodec_hh__
 
 #include <map>
+#include <unordered_map>
 #include <vector>
 
 #include "NodeImpl.hh"
@@ -29,6 +30,12 @@
 namespace avro {
 namespace parsing {
 
+/**
+ * The productions of schema nodes, hashed by node, that grammar generators
+ * memoize named types in.
+ */
+typedef std::unordered_map<NodePtr, ProductionPtr> NodeProductions;
+
 class ValidatingGrammarGenerator {
 protected:
     template<typename T>
@@ -36,8 +43,7 @@ protected:
 
     template<typename T>
     static void doFixup(Symbol &s, const std::map<T, ProductionPtr> &m);
-    virtual ProductionPtr doGenerate(const NodePtr &n,
-                                     std::map<NodePtr, ProductionPtr> &m);
+    virtual ProductionPtr doGenerate(const NodePtr &n, NodeProductions &m);
 
     ProductionPtr generate(const NodePtr &schema);
 
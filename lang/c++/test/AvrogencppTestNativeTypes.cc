@@ -0,0 +1,361 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "native_types.hh"
+#include "pmr_types.hh"
+
+#include "Compiler.hh"
+#include "Generic.hh"
+
+#include <boost/test/included/unit_test_framework.hpp>
+#include <fstream>
+#include <memory_resource>
+
+using std::ifstream;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+using avro::binaryDecoder;
+using avro::binaryEncoder;
+using avro::DecoderPtr;
+using avro::EncoderPtr;
+using avro::InputStream;
+using avro::memoryInputStream;
+using avro::memoryOutputStream;
+using avro::OutputStream;
+using avro::validatingDecoder;
+using avro::validatingEncoder;
+using avro::ValidSchema;
+
+static nt::Leg makeLeg(int32_t qty, const string &venue) {
+    nt::Leg leg;
+    leg.qty = qty;
+    leg.venue = venue;
+    return leg;
+}
+
+static void checkLeg(const nt::Leg &actual, const nt::Leg &expected) {
+    BOOST_CHECK_EQUAL(actual.qty, expected.qty);
+    BOOST_CHECK_EQUAL(actual.venue, expected.venue);
+}
+
+static void checkOrder(const nt::Order &actual, const nt::Order &expected) {
+    BOOST_CHECK_EQUAL(actual.id, expected.id);
+    BOOST_CHECK(actual.price == expected.price);
+    BOOST_REQUIRE_EQUAL(actual.leg.has_value(), expected.leg.has_value());
+    if (expected.leg) {
+        checkLeg(*actual.leg, *expected.leg);
+    }
+    BOOST_REQUIRE_EQUAL(actual.extra.idx(), expected.extra.idx());
+    if (expected.extra.idx() == 2) {
+        checkLeg(actual.extra.get_Leg(), expected.extra.get_Leg());
+    }
+    BOOST_CHECK(actual.tags == expected.tags);
+    BOOST_REQUIRE_EQUAL(actual.legs.size(), expected.legs.size());
+    for (size_t i = 0; i < expected.legs.size(); ++i) {
+        checkLeg(actual.legs[i], expected.legs[i]);
+    }
+    BOOST_REQUIRE_EQUAL(actual.parent.idx(), expected.parent.idx());
+}
+
+static nt::Order makeOrder() {
+    nt::Order o;
+    o.id = 42;
+    o.note = string("rush");
+    o.price = 101.25;
+    o.leg = makeLeg(7, "XLON");
+    o.ref.set_long(9);
+    o.extra.set_Leg(makeLeg(3, "XPAR"));
+    o.tags = {"a", "b", "c", "d", "e"};
+    o.legs.push_back(makeLeg(1, "XNYS"));
+    nt::Order parent;
+    parent.id = 41;
+    o.parent.set_Order(parent);
+    return o;
+}
+
+void testSmallVector() {
+    avro::SmallVector<string, 2> v;
+    BOOST_CHECK(v.empty());
+    BOOST_CHECK_EQUAL(v.capacity(), 2);
+    v.push_back("one");
+    v.emplace_back("two");
+    BOOST_CHECK_EQUAL(v.capacity(), 2);
+    v.push_back("three");
+    BOOST_CHECK_GT(v.capacity(), 2);
+    BOOST_CHECK_EQUAL(v.size(), 3);
+    BOOST_CHECK_EQUAL(v.back(), "three");
+
+    avro::SmallVector<string, 2> copy(v);
+    BOOST_CHECK(copy == v);
+    avro::SmallVector<string, 2> moved(std::move(v));
+    BOOST_CHECK(moved == copy);
+    BOOST_CHECK(v.empty());
+
+    moved.resize(1);
+    BOOST_CHECK_EQUAL(moved.size(), 1);
+    BOOST_CHECK_EQUAL(moved[0], "one");
+    avro::SmallVector<string, 2> inlined;
+    inlined.push_back("x");
+    moved = std::move(inlined);
+    BOOST_CHECK_EQUAL(moved.size(), 1);
+    BOOST_CHECK_EQUAL(moved.capacity(), 2);
+    BOOST_CHECK_EQUAL(moved.front(), "x");
+    moved.resize(3);
+    BOOST_CHECK(moved[2].empty());
+    BOOST_CHECK(moved != copy);
+}
+
+void testNativeTypes() {
+    ValidSchema s;
+    ifstream ifs("jsonschemas/native_types");
+    compileJsonSchema(ifs, s);
+
+    nt::Order o1 = makeOrder();
+    BOOST_CHECK(std::holds_alternative<nt::Leg>(o1.extra.value()));
+
+    unique_ptr<OutputStream> os = memoryOutputStream();
+    EncoderPtr e = validatingEncoder(s, binaryEncoder());
+    e->init(*os);
+    avro::encode(*e, o1);
+    e->flush();
+
+    unique_ptr<InputStream> is = memoryInputStream(*os);
+    DecoderPtr d = validatingDecoder(s, binaryDecoder());
+    d->init(*is);
+    avro::GenericDatum datum(s);
+    avro::GenericReader::read(*d, datum, s);
+    const avro::GenericRecord &r = datum.value<avro::GenericRecord>();
+    BOOST_CHECK_EQUAL(r.field("note").unionBranch(), 1);
+    BOOST_CHECK_EQUAL(r.field("note").value<string>(), "rush");
+    BOOST_CHECK_EQUAL(r.field("ref").value<int64_t>(), 9);
+    BOOST_CHECK_EQUAL(r.field("tags").value<avro::GenericArray>().value().size(), 5);
+
+    unique_ptr<InputStream> is2 = memoryInputStream(*os);
+    d->init(*is2);
+    nt::Order o2;
+    o2.leg.reset();
+    avro::decode(*d, o2);
+    checkOrder(o2, o1);
+    BOOST_CHECK(o2.note == o1.note);
+    BOOST_CHECK_EQUAL(o2.ref.get_long(), 9);
+    BOOST_CHECK_EQUAL(o2.legs.capacity(), 2);
+
+    std::shared_ptr<vector<uint8_t>> data = avro::snapshot(*os);
+    avro::DirectBinaryEncoder de;
+    avro::directEncode(de, o1);
+    BOOST_CHECK_EQUAL_COLLECTIONS(de.data(), de.data() + de.size(), data->begin(), data->end());
+
+    avro::DirectBinaryDecoder dd(data->data(), data->size());
+    nt::Order o3;
+    o3.note = string("stale");
+    avro::directDecode(dd, o3);
+    checkOrder(o3, o1);
+    BOOST_CHECK(o3.note == o1.note);
+
+    // Data of a writer without the note and the reference gets their
+    // defaults.
+    ValidSchema w;
+    ifstream ifs_w("jsonschemas/native_types_w");
+    compileJsonSchema(ifs_w, w);
+    unique_ptr<InputStream> is3 = memoryInputStream(*os);
+    DecoderPtr rd = avro::resolvingDecoder(s, w, binaryDecoder());
+    rd->init(*is3);
+    avro::GenericDatum wd(w);
+    avro::GenericReader::read(*rd, wd, w);
+    unique_ptr<OutputStream> wos = memoryOutputStream();
+    EncoderPtr we = binaryEncoder();
+    we->init(*wos);
+    avro::GenericWriter::write(*we, wd);
+    we->flush();
+    std::shared_ptr<vector<uint8_t>> wdata = avro::snapshot(*wos);
+
+    avro::DirectBinaryDecoder wdd(wdata->data(), wdata->size());
+    nt::Order o4;
+    o4.note = string("stale");
+    avro::resolvingDecode(wdd, 0, o4);
+    BOOST_CHECK(wdd.position() == wdata->data() + wdata->size());
+    checkOrder(o4, o1);
+    BOOST_CHECK(!o4.note.has_value());
+    BOOST_CHECK_EQUAL(o4.ref.get_string(), "none");
+}
+
+static void setRequest(pt_pmr::Request &r) {
+    r.id = "request-1";
+    r.payload.assign({1, 2, 3});
+    r.headers["host"] = "example.org";
+    r.headers["accept"] = "*/*";
+    r.items.resize(2);
+    r.items[0].name = "first item, too long for the small string buffer";
+    r.items[0].counts.assign({1, 2, 3});
+    r.items[0].attrs["k"].assign({9});
+    r.items[1].name = "second";
+    r.main.name = "main";
+    r.main.counts.push_back(7);
+    r.retries.set_int(3);
+    r.origin = "edge";
+    r.token.assign({5});
+}
+
+static void checkRequest(const pt_pmr::Request &actual, const pt_pmr::Request &expected) {
+    BOOST_CHECK(actual.id == expected.id);
+    BOOST_CHECK(actual.payload == expected.payload);
+    BOOST_CHECK(actual.headers == expected.headers);
+    BOOST_REQUIRE_EQUAL(actual.items.size(), expected.items.size());
+    for (size_t i = 0; i < expected.items.size(); ++i) {
+        BOOST_CHECK(actual.items[i].name == expected.items[i].name);
+        BOOST_CHECK(actual.items[i].counts == expected.items[i].counts);
+        BOOST_CHECK(actual.items[i].attrs == expected.items[i].attrs);
+    }
+    BOOST_CHECK(actual.main.name == expected.main.name);
+    BOOST_CHECK(actual.main.counts == expected.main.counts);
+    BOOST_CHECK_EQUAL(actual.retries.get_int(), expected.retries.get_int());
+}
+
+// Writes item as the writer schema's Item, with int counts.
+static void encodeItem(avro::Encoder &e, const pt_pmr::Item &item) {
+    e.encodeString(item.name.c_str());
+    e.arrayStart();
+    if (!item.counts.empty()) {
+        e.setItemCount(item.counts.size());
+        for (int64_t count : item.counts) {
+            e.startItem();
+            e.encodeInt(static_cast<int32_t>(count));
+        }
+    }
+    e.arrayEnd();
+    e.mapStart();
+    if (!item.attrs.empty()) {
+        e.setItemCount(item.attrs.size());
+        for (const auto &attr : item.attrs) {
+            e.startItem();
+            e.encodeString(attr.first.c_str());
+            e.encodeBytes(attr.second.data(), attr.second.size());
+        }
+    }
+    e.mapEnd();
+}
+
+// Fails any allocation from the default resource while it is in scope.
+struct NoDefaultResource {
+    std::pmr::memory_resource *previous;
+    NoDefaultResource() : previous(std::pmr::set_default_resource(std::pmr::null_memory_resource())) {}
+    ~NoDefaultResource() { std::pmr::set_default_resource(previous); }
+};
+
+void testPmrTypes() {
+    ValidSchema s;
+    ifstream ifs("jsonschemas/pmr_types");
+    compileJsonSchema(ifs, s);
+
+    pt_pmr::Request r1;
+    setRequest(r1);
+
+    unique_ptr<OutputStream> os = memoryOutputStream();
+    EncoderPtr e = validatingEncoder(s, binaryEncoder());
+    e->init(*os);
+    avro::encode(*e, r1);
+    e->flush();
+
+    std::pmr::monotonic_buffer_resource arena;
+    unique_ptr<InputStream> is = memoryInputStream(*os);
+    DecoderPtr d = binaryDecoder();
+    d->init(*is);
+    pt_pmr::Request r2(&arena);
+    {
+        // The whole tree is decoded into the arena, down to the strings
+        // of the items.
+        NoDefaultResource guard;
+        avro::decode(*d, r2);
+    }
+    checkRequest(r2, r1);
+    BOOST_CHECK(r2.items.get_allocator().resource() == &arena);
+    BOOST_CHECK(r2.items[0].name.get_allocator().resource() == &arena);
+    BOOST_CHECK(r2.items[0].attrs.begin()->second.get_allocator().resource() == &arena);
+
+    std::shared_ptr<vector<uint8_t>> data = avro::snapshot(*os);
+    avro::DirectBinaryEncoder de;
+    avro::directEncode(de, r1);
+    BOOST_CHECK_EQUAL_COLLECTIONS(de.data(), de.data() + de.size(), data->begin(), data->end());
+
+    std::pmr::monotonic_buffer_resource arena2;
+    pt_pmr::Request r3(&arena2);
+    {
+        NoDefaultResource guard;
+        avro::DirectBinaryDecoder dd(data->data(), data->size());
+        avro::directDecode(dd, r3);
+    }
+    checkRequest(r3, r1);
+
+    // A copy with an allocator moves the tree to that allocator's resource.
+    std::pmr::monotonic_buffer_resource arena3;
+    pt_pmr::Request r4(r3, &arena3);
+    checkRequest(r4, r1);
+    BOOST_CHECK(r4.items[1].name.get_allocator().resource() == &arena3);
+
+    // Data of a writer with a string payload, int counts and without the
+    // origin and token gets them promoted and defaulted.
+    ValidSchema w;
+    ifstream ifs_w("jsonschemas/pmr_types_w");
+    compileJsonSchema(ifs_w, w);
+    unique_ptr<OutputStream> wos = memoryOutputStream();
+    EncoderPtr we = validatingEncoder(w, binaryEncoder());
+    we->init(*wos);
+    we->encodeString(r1.id.c_str());
+    we->encodeString("\x01\x02\x03");
+    we->mapStart();
+    we->setItemCount(2);
+    we->startItem();
+    we->encodeString("accept");
+    we->encodeString("*/*");
+    we->startItem();
+    we->encodeString("host");
+    we->encodeString("example.org");
+    we->mapEnd();
+    we->arrayStart();
+    we->setItemCount(r1.items.size());
+    for (const pt_pmr::Item &item : r1.items) {
+        we->startItem();
+        encodeItem(*we, item);
+    }
+    we->arrayEnd();
+    encodeItem(*we, r1.main);
+    we->encodeUnionIndex(1);
+    we->encodeInt(3);
+    we->flush();
+    std::shared_ptr<vector<uint8_t>> wdata = avro::snapshot(*wos);
+
+    std::pmr::monotonic_buffer_resource arena4;
+    pt_pmr::Request r5(&arena4);
+    avro::DirectBinaryDecoder wdd(wdata->data(), wdata->size());
+    avro::resolvingDecode(wdd, 0, r5);
+    BOOST_CHECK(wdd.position() == wdata->data() + wdata->size());
+    checkRequest(r5, r1);
+    BOOST_CHECK(r5.origin == "unknown");
+    BOOST_CHECK(r5.token == (std::pmr::vector<uint8_t>{1, 2}));
+    BOOST_CHECK(r5.origin.get_allocator().resource() == &arena4);
+}
+
+boost::unit_test::test_suite *
+init_unit_test_suite(int argc, char *argv[]) {
+    boost::unit_test::test_suite *ts = BOOST_TEST_SUITE("Code generator tests");
+    ts->add(BOOST_TEST_CASE(testSmallVector));
+    ts->add(BOOST_TEST_CASE(testNativeTypes));
+    ts->add(BOOST_TEST_CASE(testPmrTypes));
+    return ts;
+}
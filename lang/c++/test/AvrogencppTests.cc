@@ -17,14 +17,19 @@
  */
 
 #include "Compiler.hh"
+#include "DataFile.hh"
+#include "Generic.hh"
 #include "bigrecord.hh"
 #include "bigrecord2.hh"
 #include "bigrecord_r.hh"
 #include "circulardep.hh"
 #include "crossref.hh"
 #include "empty_record.hh"
+#include "logical_types.hh"
 #include "primitivetypes.hh"
 #include "recursive.hh"
+#include "tags.hh"
+#include "tags_w.hh"
 #include "reuse.hh"
 #include "tree1.hh"
 #include "tree2.hh"
@@ -214,6 +219,314 @@ void testResolution() {
     s_r.toJson(oss_r);
     s_rs.toJson(oss_rs);
     BOOST_CHECK_EQUAL(oss_r.str(), oss_rs.str());
+
+    // The schema embedded by avrogencpp --snapshot resolves the same way.
+    const ValidSchema &s_snap = testgen_r::RootRecord_schema();
+    BOOST_CHECK_EQUAL(s_snap.toJson(), oss_r.str());
+    std::unique_ptr<InputStream> is3 = memoryInputStream(*os);
+    dd->init(*is3);
+    rd = resolvingDecoder(s_w, s_snap, dd);
+    testgen_r::RootRecord t5;
+    avro::decode(*rd, t5);
+    checkRecord(t5, t1);
+    checkDefaultValues(t5);
+}
+
+void testDirectCodec() {
+    testgen::RootRecord t1;
+    setRecord(t1);
+
+    unique_ptr<OutputStream> os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    avro::encode(*e, t1);
+    e->flush();
+    std::shared_ptr<vector<uint8_t>> expected = avro::snapshot(*os);
+
+    avro::DirectBinaryEncoder de;
+    avro::directEncode(de, t1);
+    BOOST_CHECK_EQUAL_COLLECTIONS(de.data(), de.data() + de.size(),
+                                  expected->begin(), expected->end());
+
+    avro::DirectBinaryDecoder dd(expected->data(), expected->size());
+    testgen::RootRecord t2;
+    avro::directDecode(dd, t2);
+    BOOST_CHECK(dd.position() == expected->data() + expected->size());
+    checkRecord(t2, t1);
+
+    avro::DirectBinaryDecoder truncated(expected->data(), expected->size() - 1);
+    testgen::RootRecord t3;
+    BOOST_CHECK_THROW(avro::directDecode(truncated, t3), avro::Exception);
+}
+
+void testGeneratedResolution() {
+    ValidSchema s_w;
+    ifstream ifs_w("jsonschemas/bigrecord");
+    compileJsonSchema(ifs_w, s_w);
+
+    testgen::RootRecord t1;
+    setRecord(t1);
+    avro::DirectBinaryEncoder de;
+    avro::directEncode(de, t1);
+
+    typedef avro::resolving_writers<testgen_r::RootRecord> writers;
+    BOOST_CHECK_EQUAL(writers::count(), 2u);
+    size_t writer = writers::find(s_w.rabinFingerprint());
+    BOOST_CHECK_EQUAL(writer, 0u);
+    BOOST_CHECK_EQUAL((avro::resolving_traits<testgen_r::RootRecord, 0>::fingerprint()), s_w.rabinFingerprint());
+
+    avro::DirectBinaryDecoder dd(de.data(), de.size());
+    testgen_r::RootRecord t2;
+    avro::resolvingDecode(dd, writer, t2);
+    BOOST_CHECK(dd.position() == de.data() + de.size());
+    checkRecord(t2, t1);
+    checkDefaultValues(t2);
+
+    // Data written with the reader's own schema goes through the second
+    // writer.
+    unique_ptr<OutputStream> os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    avro::encode(*e, t2);
+    e->flush();
+    std::shared_ptr<vector<uint8_t>> data = avro::snapshot(*os);
+    writer = writers::find(testgen_r::RootRecord_schema().rabinFingerprint());
+    BOOST_CHECK_EQUAL(writer, 1u);
+    avro::DirectBinaryDecoder dd2(data->data(), data->size());
+    testgen_r::RootRecord t3;
+    avro::resolvingDecode(dd2, writer, t3);
+    BOOST_CHECK(dd2.position() == data->data() + data->size());
+    checkRecord(t3, t1);
+    checkDefaultValues(t3);
+
+    BOOST_CHECK_THROW(writers::find(0), avro::Exception);
+}
+
+void testMapContainers() {
+    tags_u::Event t1;
+    t1.id = 7;
+    t1.tags["zone"] = "eu";
+    t1.tags["host"] = "a1";
+    t1.counters["hits"] = 3;
+    t1.counters["misses"] = -1;
+    t1.groups["g"]["x"] = 1;
+    t1.groups["g"]["y"] = 2;
+    t1.groups["h"];
+    std::unordered_map<std::string, std::string> extra;
+    extra["k"] = "v";
+    t1.extra.set_map(extra);
+
+    avro::DirectBinaryEncoder de;
+    avro::directEncode(de, t1);
+
+    avro::DirectBinaryDecoder dd(de.data(), de.size());
+    tags_u::Event t2;
+    t2.tags["stale"] = "gone";
+    avro::resolvingDecode(dd, 0, t2);
+    BOOST_CHECK(dd.position() == de.data() + de.size());
+    BOOST_CHECK(t2.tags == t1.tags);
+    BOOST_CHECK(t2.counters == t1.counters);
+    BOOST_CHECK(t2.groups == t1.groups);
+    BOOST_CHECK(t2.extra.get_map() == extra);
+
+    avro::DirectBinaryDecoder dd2(de.data(), de.size());
+    tags_flat::Event t3;
+    t3.tags["stale"] = "gone";
+    avro::resolvingDecode(dd2, 0, t3);
+    BOOST_CHECK(dd2.position() == de.data() + de.size());
+    BOOST_CHECK_EQUAL(t3.id, 7);
+    BOOST_REQUIRE_EQUAL(t3.tags.size(), 2u);
+    BOOST_CHECK_EQUAL(t3.tags.begin()->first, "host");
+    BOOST_CHECK_EQUAL(t3.tags.at("zone"), "eu");
+    BOOST_CHECK_EQUAL(t3.counters.at("hits"), 3);
+    BOOST_CHECK_EQUAL(t3.counters.at("misses"), -1);
+    BOOST_REQUIRE_EQUAL(t3.groups.size(), 2u);
+    BOOST_CHECK_EQUAL(t3.groups.at("g").at("y"), 2);
+    BOOST_CHECK(t3.groups.at("h").empty());
+    BOOST_CHECK_EQUAL(t3.extra.get_map().at("k"), "v");
+    BOOST_REQUIRE_EQUAL(t3.labels.size(), 1u);
+    BOOST_CHECK_EQUAL(t3.labels.at("source"), "default");
+
+    // The flat maps round-trip through their own schema.
+    avro::DirectBinaryEncoder de2;
+    avro::directEncode(de2, t3);
+    avro::DirectBinaryDecoder dd3(de2.data(), de2.size());
+    tags_flat::Event t4;
+    avro::directDecode(dd3, t4);
+    BOOST_CHECK(t4.tags == t3.tags);
+    BOOST_CHECK(t4.counters == t3.counters);
+    BOOST_CHECK(t4.groups == t3.groups);
+    BOOST_CHECK(t4.labels == t3.labels);
+}
+
+void testWriteBatch() {
+    static_assert(avro::has_direct_codec<testgen::RootRecord>::value, "RootRecord has direct codec traits");
+    static_assert(!avro::has_direct_codec<testgen_r::RootRecord>::value, "RootRecord_r has no direct codec traits");
+
+    vector<testgen::RootRecord> records(1000);
+    for (size_t i = 0; i < records.size(); ++i) {
+        setRecord(records[i]);
+        records[i].mylong = static_cast<int64_t>(i);
+    }
+    ValidSchema s;
+    ifstream ifs("jsonschemas/bigrecord");
+    compileJsonSchema(ifs, s);
+    const char *filename = "test_writeBatch.df";
+    {
+        avro::DataFileWriter<testgen::RootRecord> df(filename, s, 4096);
+        df.writeBatch(records.data(), records.data() + 1);
+        df.writeBatch(records.data() + 1, records.data() + records.size());
+        df.close();
+        BOOST_CHECK_EQUAL(df.stats().objects, 1000);
+        BOOST_CHECK_GT(df.stats().blocks, 10);
+    }
+    avro::DataFileReader<testgen::RootRecord> df(filename);
+    testgen::RootRecord r;
+    size_t n = 0;
+    while (df.read(r)) {
+        BOOST_REQUIRE_LT(n, records.size());
+        checkRecord(r, records[n]);
+        ++n;
+    }
+    BOOST_CHECK_EQUAL(n, records.size());
+    df.close();
+    std::remove(filename);
+}
+
+static void checkTrade(const lt::Trade &t1, const lt::Trade &t2) {
+    BOOST_CHECK_EQUAL(t1.price.unscaled, t2.price.unscaled);
+    BOOST_CHECK(t1.notional.unscaled == t2.notional.unscaled);
+    BOOST_CHECK_EQUAL(t1.fee.unscaled, t2.fee.unscaled);
+    BOOST_CHECK(t1.bigFee.unscaled == t2.bigFee.unscaled);
+    BOOST_CHECK(t1.tradeTime == t2.tradeTime);
+    BOOST_CHECK(t1.settled == t2.settled);
+    BOOST_CHECK(t1.id == t2.id);
+    BOOST_REQUIRE_EQUAL(t1.limit.idx(), t2.limit.idx());
+    BOOST_CHECK_EQUAL(t1.limit.get_bytes().unscaled, t2.limit.get_bytes().unscaled);
+    BOOST_CHECK(t1.fills == t2.fills);
+}
+
+void testLogicalTypes() {
+    ValidSchema s;
+    ifstream ifs("jsonschemas/logical_types");
+    compileJsonSchema(ifs, s);
+
+    lt::Trade t1;
+    t1.price.unscaled = 12345;
+    t1.notional.unscaled = static_cast<avro::int128_t>(INT64_MAX) * 10000 + 1;
+    t1.fee.unscaled = -1500;
+    t1.bigFee.unscaled = -static_cast<avro::int128_t>(INT64_MAX) * 1000000;
+    t1.tradeTime = avro::TimestampMicros(std::chrono::microseconds(1700000000123456LL));
+    t1.settled = avro::TimestampMillis(std::chrono::milliseconds(1700000000123LL));
+    t1.id.bytes = {{0x12, 0x3e, 0x45, 0x67, 0xe8, 0x9b, 0x12, 0xd3,
+                    0xa4, 0x56, 0x42, 0x66, 0x14, 0x17, 0x40, 0x00}};
+    avro::Decimal limit;
+    limit.unscaled = -99;
+    t1.limit.set_bytes(limit);
+    t1.fills.push_back(avro::TimestampMillis(std::chrono::milliseconds(1)));
+    t1.fills.push_back(avro::TimestampMillis(std::chrono::milliseconds(2)));
+    t1.rebate.unscaled = 7;
+
+    unique_ptr<OutputStream> os = memoryOutputStream();
+    EncoderPtr e = validatingEncoder(s, binaryEncoder());
+    e->init(*os);
+    avro::encode(*e, t1);
+    e->flush();
+
+    // The native types are written as the logical types' bytes, longs
+    // and strings.
+    unique_ptr<InputStream> is = memoryInputStream(*os);
+    DecoderPtr d = validatingDecoder(s, binaryDecoder());
+    d->init(*is);
+    avro::GenericDatum datum(s);
+    avro::GenericReader::read(*d, datum, s);
+    const avro::GenericRecord &r = datum.value<avro::GenericRecord>();
+    BOOST_CHECK(r.field("price").value<vector<uint8_t>>() == (vector<uint8_t>{0x30, 0x39}));
+    BOOST_CHECK(r.field("fee").value<avro::GenericFixed>().value()
+                == (vector<uint8_t>{0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfa, 0x24}));
+    BOOST_CHECK_EQUAL(r.field("tradeTime").value<int64_t>(), 1700000000123456LL);
+    BOOST_CHECK_EQUAL(r.field("id").value<string>(), "123e4567-e89b-12d3-a456-426614174000");
+
+    unique_ptr<InputStream> is2 = memoryInputStream(*os);
+    d->init(*is2);
+    lt::Trade t2;
+    avro::decode(*d, t2);
+    checkTrade(t2, t1);
+    BOOST_CHECK_EQUAL(t2.rebate.unscaled, 7);
+
+    std::shared_ptr<vector<uint8_t>> data = avro::snapshot(*os);
+    avro::DirectBinaryEncoder de;
+    avro::directEncode(de, t1);
+    BOOST_CHECK_EQUAL_COLLECTIONS(de.data(), de.data() + de.size(), data->begin(), data->end());
+
+    // Data of a writer without the rebate gets the default.
+    ValidSchema w;
+    ifstream ifs_w("jsonschemas/logical_types_w");
+    compileJsonSchema(ifs_w, w);
+    unique_ptr<InputStream> is3 = memoryInputStream(*os);
+    DecoderPtr rd = avro::resolvingDecoder(s, w, binaryDecoder());
+    rd->init(*is3);
+    avro::GenericDatum wd(w);
+    avro::GenericReader::read(*rd, wd, w);
+    unique_ptr<OutputStream> wos = memoryOutputStream();
+    EncoderPtr we = binaryEncoder();
+    we->init(*wos);
+    avro::GenericWriter::write(*we, wd);
+    we->flush();
+    std::shared_ptr<vector<uint8_t>> wdata = avro::snapshot(*wos);
+
+    size_t writer = avro::resolving_writers<lt::Trade>::find(w.rabinFingerprint());
+    avro::DirectBinaryDecoder dd(wdata->data(), wdata->size());
+    lt::Trade t3;
+    avro::resolvingDecode(dd, writer, t3);
+    BOOST_CHECK(dd.position() == wdata->data() + wdata->size());
+    checkTrade(t3, t1);
+    BOOST_CHECK_EQUAL(t3.rebate.unscaled, 1234);
+}
+
+void testProjection() {
+    testgen::RootRecord t1;
+    setRecord(t1);
+    t1.recordmap["r"] = t1.nestedrecord;
+
+    unique_ptr<OutputStream> os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    avro::encode(*e, t1);
+    t1.anotherint = 17;
+    avro::encode(*e, t1);
+    avro::encode(*e, t1);
+    e->flush();
+
+    DecoderPtr d = binaryDecoder();
+    unique_ptr<InputStream> is = memoryInputStream(*os);
+    d->init(*is);
+    testgen::RootRecord t2;
+    avro::decodeProjected(*d, t2);
+    BOOST_CHECK_EQUAL(t2.nestedrecord.inval2, t1.nestedrecord.inval2);
+    BOOST_CHECK_EQUAL(t2.nestedrecord.inval1, 0.0);
+    BOOST_CHECK_EQUAL(t2.nestedrecord.inval3, 0);
+    BOOST_CHECK_EQUAL(t2.myunion.idx(), t1.myunion.idx());
+    BOOST_CHECK(t2.myunion.get_map() == t1.myunion.get_map());
+    BOOST_CHECK_EQUAL(t2.anotherint, 4534);
+    BOOST_CHECK_EQUAL(t2.mylong, 0);
+    BOOST_CHECK(t2.mymap.empty());
+    BOOST_CHECK(t2.recordmap.empty());
+    BOOST_CHECK(t2.anothernested.inval2.empty());
+
+    // The second record is skipped whole and the third starts where
+    // skipping left off.
+    avro::skip_traits<testgen::RootRecord>::skip(*d);
+    testgen::RootRecord t3;
+    avro::decodeProjected(*d, t3);
+    BOOST_CHECK_EQUAL(t3.anotherint, 17);
+
+    std::shared_ptr<vector<uint8_t>> data = avro::snapshot(*os);
+    avro::DirectBinaryDecoder dd(data->data(), data->size());
+    for (int i = 0; i < 3; ++i) {
+        avro::skip_traits<testgen::RootRecord>::skip(dd);
+    }
+    BOOST_CHECK(dd.position() == data->data() + data->size());
 }
 
 void testNamespace() {
@@ -283,6 +596,12 @@ init_unit_test_suite(int argc, char *argv[]) {
     boost::unit_test::test_suite *ts = BOOST_TEST_SUITE("Code generator tests");
     ts->add(BOOST_TEST_CASE(testEncoding));
     ts->add(BOOST_TEST_CASE(testResolution));
+    ts->add(BOOST_TEST_CASE(testDirectCodec));
+    ts->add(BOOST_TEST_CASE(testGeneratedResolution));
+    ts->add(BOOST_TEST_CASE(testMapContainers));
+    ts->add(BOOST_TEST_CASE(testProjection));
+    ts->add(BOOST_TEST_CASE(testWriteBatch));
+    ts->add(BOOST_TEST_CASE(testLogicalTypes));
     ts->add(BOOST_TEST_CASE(testEncoding2<uau::r1>));
     ts->add(BOOST_TEST_CASE(testEncoding2<umu::r1>));
     ts->add(BOOST_TEST_CASE(testNamespace));
@@ -18,18 +18,38 @@
 
 #include <iostream>
 
+#include "Arena.hh"
+#include "BinaryComparator.hh"
+#include "BinaryValidator.hh"
+#include "CodecPool.hh"
 #include "Compiler.hh"
+#include "DatumVisitor.hh"
+#include "DecodeProfile.hh"
 #include "Decoder.hh"
 #include "Encoder.hh"
+#include "FieldPathExtractor.hh"
+#include "Fingerprint.hh"
 #include "Generic.hh"
+#include "GenericJsonReader.hh"
+#include "GenericJsonWriter.hh"
+#include "LogicalValues.hh"
+#include "SingleObject.hh"
 #include "Specific.hh"
+#include "Transcoder.hh"
+#include "Utf8.hh"
 #include "ValidSchema.hh"
+#include "Zigzag.hh"
 
+#include <algorithm>
+#include <array>
 #include <boost/bind.hpp>
 #include <functional>
+#include <map>
+#include <sstream>
 #include <stack>
 #include <stdint.h>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <boost/math/special_functions/fpclassify.hpp>
@@ -648,6 +668,24 @@ void testCodec(const TestData &td) {
     }
 }
 
+template<typename CodecFactory>
+void testValidateBinary(const TestData &td) {
+    ValidSchema vs = makeValidSchema(td.schema);
+    BinaryValidator validator(vs);
+
+    for (unsigned int i = 0; i < count; ++i) {
+        vector<string> v;
+        unique_ptr<OutputStream> p;
+        testEncoder(CodecFactory::newEncoder(vs), td.calls, v, p);
+        appendSentinel(*p);
+
+        BOOST_TEST_CHECKPOINT("schema: " << td.schema << " calls: " << td.calls);
+        unique_ptr<InputStream> in = memoryInputStream(*p);
+        validator.validate(*in);
+        assertSentinel(*in);
+    }
+}
+
 template<typename CodecFactory>
 void testCodecResolving(const TestData3 &td) {
     static int testNo = 0;
@@ -897,6 +935,84 @@ void testGenericResolving2(const TestData4 &td) {
     // the "normal" data.
 }
 
+// Transcodes every datum in p, up to the sentinel, and checks that the
+// result reads as decoding with the resolving decoder and encoding again
+// gives.
+static void checkTranscode(const ValidSchema &wvs, const ValidSchema &rvs, const OutputStream &p) {
+    std::shared_ptr<vector<uint8_t>> data = snapshot(p);
+    Transcoder transcoder(wvs, rvs);
+    vector<uint8_t> transcoded;
+    vector<uint8_t> expected;
+    DecoderPtr d = binaryDecoder();
+    unique_ptr<InputStream> in = memoryInputStream(data->data(), data->size());
+    d->init(*in);
+    GenericReader gr(wvs, rvs, d);
+    size_t pos = 0;
+    size_t count = 0;
+    while (pos + 1 < data->size()) {
+        pos += transcoder.transcode(data->data() + pos, data->size() - pos, transcoded);
+        GenericDatum datum;
+        gr.read(datum);
+        EncoderPtr e = binaryEncoder();
+        unique_ptr<OutputStream> ob = memoryOutputStream();
+        e->init(*ob);
+        avro::encode(*e, datum);
+        e->flush();
+        std::shared_ptr<vector<uint8_t>> encoded = snapshot(*ob);
+        expected.insert(expected.end(), encoded->begin(), encoded->end());
+        ++count;
+    }
+    BOOST_CHECK_EQUAL(pos + 1, data->size());
+
+    // Arrays and maps may be blocked differently; read the result back.
+    vector<uint8_t> actual;
+    DecoderPtr d2 = binaryDecoder();
+    unique_ptr<InputStream> in2 = memoryInputStream(transcoded.data(), transcoded.size());
+    d2->init(*in2);
+    GenericReader gr2(rvs, d2);
+    for (size_t i = 0; i < count; ++i) {
+        GenericDatum datum;
+        gr2.read(datum);
+        EncoderPtr e = binaryEncoder();
+        unique_ptr<OutputStream> ob = memoryOutputStream();
+        e->init(*ob);
+        avro::encode(*e, datum);
+        e->flush();
+        std::shared_ptr<vector<uint8_t>> encoded = snapshot(*ob);
+        actual.insert(actual.end(), encoded->begin(), encoded->end());
+    }
+    BOOST_CHECK_EQUAL(in2->byteCount(), transcoded.size());
+    BOOST_CHECK(actual == expected);
+}
+
+template<typename CodecFactory>
+void testTranscode(const TestData3 &td) {
+    BOOST_TEST_CHECKPOINT(" writer schema: " << td.writerSchema
+                                             << " writer calls: " << td.writerCalls
+                                             << " reader schema: " << td.readerSchema);
+    ValidSchema wvs = makeValidSchema(td.writerSchema);
+    ValidSchema rvs = makeValidSchema(td.readerSchema);
+    vector<string> v;
+    unique_ptr<OutputStream> p;
+    testEncoder(CodecFactory::newEncoder(wvs), td.writerCalls, v, p);
+    appendSentinel(*p);
+    checkTranscode(wvs, rvs, *p);
+}
+
+template<typename CodecFactory>
+void testTranscode2(const TestData4 &td) {
+    BOOST_TEST_CHECKPOINT(" writer schema: " << td.writerSchema
+                                             << " writer calls: " << td.writerCalls
+                                             << " reader schema: " << td.readerSchema);
+    ValidSchema wvs = makeValidSchema(td.writerSchema);
+    ValidSchema rvs = makeValidSchema(td.readerSchema);
+    const vector<string> wd = mkValues(td.writerValues);
+    unique_ptr<OutputStream> p = generate(*CodecFactory::newEncoder(wvs),
+                                          td.writerCalls, wd);
+    appendSentinel(*p);
+    checkTranscode(wvs, rvs, *p);
+}
+
 static const TestData data[] = {
     {"\"null\"", "N", 1},
     {"\"boolean\"", "B", 1},
@@ -1539,6 +1655,12 @@ struct BinaryCodecFactory : public BinaryEncoderFactory,
                             public BinaryDecoderFactory {
 };
 
+struct BlockingBinaryCodecFactory : public BinaryDecoderFactory {
+    static EncoderPtr newEncoder(const ValidSchema &schema) {
+        return validatingEncoder(schema, blockingBinaryEncoder());
+    }
+};
+
 struct ValidatingEncoderFactory {
     static EncoderPtr newEncoder(const ValidSchema &schema) {
         return validatingEncoder(schema, binaryEncoder());
@@ -1612,9 +1734,50 @@ struct ValidatingEncoderResolvingDecoderFactory : public ValidatingEncoderFactor
     }
 };
 
+struct BinaryEncoderCompiledResolvingDecoderFactory : public BinaryEncoderFactory {
+    static DecoderPtr newDecoder(const ValidSchema &schema) {
+        return compiledResolvingDecoder(schema, schema, binaryDecoder());
+    }
+
+    static DecoderPtr newDecoder(const ValidSchema &writer,
+                                 const ValidSchema &reader) {
+        return compiledResolvingDecoder(writer, reader, binaryDecoder());
+    }
+};
+
+struct JsonEncoderCompiledResolvingDecoderFactory {
+    static EncoderPtr newEncoder(const ValidSchema &schema) {
+        return jsonEncoder(schema);
+    }
+
+    static DecoderPtr newDecoder(const ValidSchema &schema) {
+        return compiledResolvingDecoder(schema, schema, jsonDecoder(schema));
+    }
+
+    static DecoderPtr newDecoder(const ValidSchema &writer,
+                                 const ValidSchema &reader) {
+        return compiledResolvingDecoder(writer, reader, jsonDecoder(writer));
+    }
+};
+
+struct ValidatingEncoderCompiledResolvingDecoderFactory : public ValidatingEncoderFactory {
+    static DecoderPtr newDecoder(const ValidSchema &schema) {
+        return compiledResolvingDecoder(schema, schema,
+                                        validatingDecoder(schema, binaryDecoder()));
+    }
+
+    static DecoderPtr newDecoder(const ValidSchema &writer,
+                                 const ValidSchema &reader) {
+        return compiledResolvingDecoder(writer, reader,
+                                        validatingDecoder(writer, binaryDecoder()));
+    }
+};
+
 void add_tests(boost::unit_test::test_suite &ts) {
     ADD_TESTS(ts, BinaryCodecFactory, testCodec, data);
     ADD_TESTS(ts, ValidatingCodecFactory, testCodec, data);
+    ADD_TESTS(ts, BlockingBinaryCodecFactory, testCodec, data);
+    ADD_TESTS(ts, BinaryCodecFactory, testValidateBinary, data);
     ADD_TESTS(ts, JsonCodec, testCodec, data);
     ADD_TESTS(ts, JsonPrettyCodec, testCodec, data);
     ADD_TESTS(ts, BinaryEncoderResolvingDecoderFactory, testCodec, data);
@@ -1633,10 +1796,27 @@ void add_tests(boost::unit_test::test_suite &ts) {
               testCodecResolving2, data4);
     ADD_TESTS(ts, BinaryEncoderResolvingDecoderFactory,
               testCodecResolving2, data4BinaryOnly);
+    ADD_TESTS(ts, BinaryEncoderCompiledResolvingDecoderFactory, testCodec, data);
+    ADD_TESTS(ts, JsonEncoderCompiledResolvingDecoderFactory, testCodec, data);
+    ADD_TESTS(ts, BinaryEncoderCompiledResolvingDecoderFactory,
+              testCodecResolving, data3);
+    ADD_TESTS(ts, JsonEncoderCompiledResolvingDecoderFactory,
+              testCodecResolving, data3);
+    ADD_TESTS(ts, BinaryEncoderCompiledResolvingDecoderFactory,
+              testCodecResolving2, data4);
+    ADD_TESTS(ts, JsonEncoderCompiledResolvingDecoderFactory,
+              testCodecResolving2, data4);
+    ADD_TESTS(ts, ValidatingEncoderCompiledResolvingDecoderFactory,
+              testCodecResolving2, data4);
+    ADD_TESTS(ts, BinaryEncoderCompiledResolvingDecoderFactory,
+              testCodecResolving2, data4BinaryOnly);
 
     ADD_TESTS(ts, ValidatingCodecFactory, testGeneric, data);
     ADD_TESTS(ts, ValidatingCodecFactory, testGenericResolving, data3);
     ADD_TESTS(ts, ValidatingCodecFactory, testGenericResolving2, data4);
+    ADD_TESTS(ts, BinaryCodecFactory, testTranscode, data3);
+    ADD_TESTS(ts, BinaryCodecFactory, testTranscode2, data4);
+    ADD_TESTS(ts, BinaryCodecFactory, testTranscode2, data4BinaryOnly);
 }
 
 } // namespace parsing
@@ -1788,6 +1968,2479 @@ static void testByteCount() {
     BOOST_CHECK_EQUAL(os1->byteCount(), 3);
 }
 
+static void testBlockingEncoder() {
+    EncoderPtr e = blockingBinaryEncoder(2);
+    std::unique_ptr<OutputStream> os = memoryOutputStream();
+    e->init(*os);
+    const int32_t values[] = {1, 2, 3, 4, 5};
+    e->arrayStart();
+    e->setItemCount(5);
+    e->encodeIntArray(values, 5);
+    e->arrayEnd();
+    // A map of one array, then a long after both.
+    e->mapStart();
+    e->setItemCount(1);
+    e->startItem();
+    e->encodeString("k");
+    e->arrayStart();
+    e->setItemCount(1);
+    e->startItem();
+    e->encodeLong(-1);
+    e->arrayEnd();
+    e->mapEnd();
+    e->encodeLong(7);
+    e->flush();
+
+    // Blocks of 2, 2 and 1 ints, each with its negated count and size.
+    const uint8_t expected[] = {0x03, 0x04, 0x02, 0x04, 0x03, 0x04, 0x06, 0x08,
+                                0x01, 0x02, 0x0a, 0x00};
+    std::shared_ptr<std::vector<uint8_t>> data = snapshot(*os);
+    BOOST_REQUIRE_GE(data->size(), sizeof(expected));
+    BOOST_CHECK(std::equal(expected, expected + sizeof(expected), data->begin()));
+    BOOST_CHECK_EQUAL(e->byteCount(), static_cast<int64_t>(data->size()));
+
+    std::unique_ptr<InputStream> is = memoryInputStream(*os);
+    DecoderPtr d = binaryDecoder();
+    d->init(*is);
+    std::vector<int32_t> decoded;
+    for (size_t n = d->arrayStart(); n != 0; n = d->arrayNext()) {
+        for (size_t i = 0; i < n; ++i) {
+            decoded.push_back(d->decodeInt());
+        }
+    }
+    BOOST_CHECK(std::equal(values, values + 5, decoded.begin()));
+    BOOST_CHECK_EQUAL(decoded.size(), 5u);
+    // The map is skipped by its byte size.
+    BOOST_CHECK_EQUAL(d->skipMap(), 0u);
+    BOOST_CHECK_EQUAL(d->decodeLong(), 7);
+
+    BOOST_CHECK_THROW(blockingBinaryEncoder(0), Exception);
+}
+
+static void testVarintBoundaries() {
+    const int64_t values[] = {
+        0, -1, 1, 63, -64, 64, 8191, -8192, 8192,
+        std::numeric_limits<int32_t>::max(),
+        std::numeric_limits<int32_t>::min(),
+        std::numeric_limits<int64_t>::max(),
+        std::numeric_limits<int64_t>::min()};
+    const size_t n = sizeof(values) / sizeof(values[0]);
+
+    OutputStreamPtr os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    for (size_t i = 0; i < n; ++i) {
+        e->encodeLong(values[i]);
+    }
+    e->flush();
+
+    // Different chunk sizes put varints across chunk boundaries, which
+    // exercises both the in-chunk and the byte-at-a-time decoding.
+    for (size_t chunk = 1; chunk <= 12; ++chunk) {
+        InputStreamPtr is = memoryInputStream(*os);
+        std::unique_ptr<OutputStream> os2 = memoryOutputStream(chunk);
+        copy(*is, *os2);
+        os2->flush();
+        InputStreamPtr is2 = memoryInputStream(*os2);
+        DecoderPtr d = binaryDecoder();
+        d->init(*is2);
+        for (size_t i = 0; i < n; ++i) {
+            BOOST_CHECK_EQUAL(d->decodeLong(), values[i]);
+        }
+    }
+
+    // Encoding in place, one by one or in a batch, gives the same bytes as
+    // encodeInt64() for every length and wherever the chunks end.
+    std::vector<int64_t> all(values, values + n);
+    for (int k = 0; k < 63; ++k) {
+        all.push_back(int64_t(1) << k);
+        all.push_back((int64_t(1) << k) - 1);
+        all.push_back(-(int64_t(1) << k));
+    }
+    std::vector<uint8_t> expected;
+    for (size_t i = 0; i < all.size(); ++i) {
+        std::array<uint8_t, 10> bytes;
+        size_t len = encodeInt64(all[i], bytes);
+        expected.insert(expected.end(), bytes.begin(), bytes.begin() + len);
+    }
+    for (size_t chunk = 1; chunk <= 24; ++chunk) {
+        for (int batch = 0; batch < 2; ++batch) {
+            std::unique_ptr<OutputStream> os2 = memoryOutputStream(chunk);
+            EncoderPtr e2 = binaryEncoder();
+            e2->init(*os2);
+            if (batch) {
+                e2->encodeLongArray(all.data(), all.size());
+            } else {
+                for (size_t i = 0; i < all.size(); ++i) {
+                    e2->encodeLong(all[i]);
+                }
+            }
+            e2->flush();
+            std::vector<uint8_t> actual = *snapshot(*os2);
+            BOOST_CHECK(actual == expected);
+        }
+    }
+
+    // Eleven continuation bytes is never a valid varint.
+    std::vector<uint8_t> bad(16, 0x80);
+    InputStreamPtr is = memoryInputStream(&bad[0], bad.size());
+    DecoderPtr d = binaryDecoder();
+    d->init(*is);
+    BOOST_CHECK_THROW(d->decodeLong(), Exception);
+}
+
+// Decodes the blocks of an array with bulk calls, each block in two, the
+// first of them for 7 items.
+template<typename T>
+static void takeItems(Decoder &d, std::vector<T> &out, void (Decoder::*decode)(T *, size_t)) {
+    for (size_t n = d.arrayStart(); n != 0; n = d.arrayNext()) {
+        size_t old = out.size();
+        out.resize(old + n);
+        (d.*decode)(&out[old], 7);
+        (d.*decode)(&out[old + 7], n - 7);
+    }
+}
+
+static void testResolvingBulkArrays() {
+    ValidSchema writer = compileJsonSchemaFromString(
+        R"({"type": "record", "name": "R", "fields": [
+            {"name": "f", "type": {"type": "array", "items": "float"}},
+            {"name": "i", "type": {"type": "array", "items": "int"}},
+            {"name": "l", "type": {"type": "array", "items": "long"}},
+            {"name": "u", "type": {"type": "array", "items": ["null", "int"]}}
+        ]})");
+    ValidSchema reader = compileJsonSchemaFromString(
+        R"({"type": "record", "name": "R", "fields": [
+            {"name": "f", "type": {"type": "array", "items": "double"}},
+            {"name": "i", "type": {"type": "array", "items": "long"}},
+            {"name": "l", "type": {"type": "array", "items": "float"}},
+            {"name": "u", "type": {"type": "array", "items": "long"}},
+            {"name": "x", "type": "int", "default": 5}
+        ]})");
+
+    // Each array comes in blocks of 1000 and 300 items.
+    const size_t blocks[] = {1000, 300};
+    OutputStreamPtr os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    for (int field = 0; field < 4; ++field) {
+        e->arrayStart();
+        size_t k = 0;
+        for (size_t b : blocks) {
+            e->setItemCount(b);
+            for (size_t j = 0; j < b; ++j, ++k) {
+                e->startItem();
+                switch (field) {
+                    case 0:
+                        e->encodeFloat(static_cast<float>(k) + 0.5f);
+                        break;
+                    case 1:
+                        e->encodeInt(-static_cast<int32_t>(k));
+                        break;
+                    case 2:
+                        e->encodeLong(static_cast<int64_t>(k) * 3);
+                        break;
+                    default:
+                        e->encodeUnionIndex(1);
+                        e->encodeInt(static_cast<int32_t>(k));
+                        break;
+                }
+            }
+        }
+        e->arrayEnd();
+    }
+    e->flush();
+
+    InputStreamPtr is = memoryInputStream(*os);
+    ResolvingDecoderPtr d = compiledResolvingDecoder(writer, reader, binaryDecoder());
+    d->init(*is);
+    d->fieldOrder();
+
+    std::vector<double> doubles;
+    std::vector<int64_t> longs;
+    std::vector<float> floats;
+    std::vector<int64_t> unions;
+    takeItems(*d, doubles, &Decoder::decodeDoubleArray);
+    takeItems(*d, longs, &Decoder::decodeLongArray);
+    takeItems(*d, floats, &Decoder::decodeFloatArray);
+    takeItems(*d, unions, &Decoder::decodeLongArray);
+    BOOST_CHECK_EQUAL(d->decodeInt(), 5);
+
+    BOOST_REQUIRE_EQUAL(doubles.size(), 1300);
+    BOOST_REQUIRE_EQUAL(longs.size(), 1300);
+    BOOST_REQUIRE_EQUAL(floats.size(), 1300);
+    BOOST_REQUIRE_EQUAL(unions.size(), 1300);
+    for (size_t k = 0; k < 1300; ++k) {
+        BOOST_CHECK_EQUAL(doubles[k], static_cast<double>(k) + 0.5);
+        BOOST_CHECK_EQUAL(longs[k], -static_cast<int64_t>(k));
+        BOOST_CHECK_EQUAL(floats[k], static_cast<float>(k * 3));
+        BOOST_CHECK_EQUAL(unions[k], static_cast<int64_t>(k));
+    }
+}
+
+static void testStringView() {
+    const std::string strings[] = {"", "a", "hello world", std::string(300, 'x')};
+    const size_t n = sizeof(strings) / sizeof(strings[0]);
+
+    OutputStreamPtr os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    for (size_t i = 0; i < n; ++i) {
+        e->encodeString(strings[i]);
+        e->encodeBytes(reinterpret_cast<const uint8_t *>(strings[i].data()),
+                       strings[i].size());
+    }
+    e->flush();
+
+    std::vector<uint8_t> flat(static_cast<size_t>(os->byteCount()));
+    {
+        InputStreamPtr is = memoryInputStream(*os);
+        StreamReader r(*is);
+        r.readBytes(flat.data(), flat.size());
+    }
+
+    // With the whole input in one chunk the views point straight into it.
+    {
+        InputStreamPtr is = memoryInputStream(flat.data(), flat.size());
+        DecoderPtr d = binaryDecoder();
+        d->init(*is);
+        for (size_t i = 0; i < n; ++i) {
+            const char *s;
+            const uint8_t *b;
+            size_t len;
+            d->decodeStringView(s, len);
+            BOOST_CHECK_EQUAL(std::string(s, len), strings[i]);
+            if (len > 0) {
+                BOOST_CHECK(reinterpret_cast<const uint8_t *>(s) >= flat.data());
+                BOOST_CHECK(reinterpret_cast<const uint8_t *>(s) + len <= flat.data() + flat.size());
+            }
+            d->decodeBytesView(b, len);
+            BOOST_CHECK_EQUAL(std::string(reinterpret_cast<const char *>(b), len), strings[i]);
+        }
+    }
+
+    // Small chunks make values straddle chunks; validating on top goes
+    // through to the same calls.
+    ValidSchema schema = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"s\", \"type\":\"string\"},"
+        "{\"name\":\"b\", \"type\":\"bytes\"}"
+        "]}");
+    std::unique_ptr<OutputStream> chunked = memoryOutputStream(7);
+    {
+        InputStreamPtr is = memoryInputStream(flat.data(), flat.size());
+        copy(*is, *chunked);
+        chunked->flush();
+    }
+    InputStreamPtr is = memoryInputStream(*chunked);
+    DecoderPtr d = validatingDecoder(schema, binaryDecoder());
+    d->init(*is);
+    for (size_t i = 0; i < n; ++i) {
+        const char *s;
+        const uint8_t *b;
+        size_t len;
+        d->decodeStringView(s, len);
+        BOOST_CHECK_EQUAL(std::string(s, len), strings[i]);
+        d->decodeBytesView(b, len);
+        BOOST_CHECK_EQUAL(std::string(reinterpret_cast<const char *>(b), len), strings[i]);
+    }
+}
+
+
+static void decodeResolved(const DecoderPtr &d, const std::vector<uint8_t> &data,
+                           size_t count) {
+    InputStreamPtr is = memoryInputStream(data.data(), data.size());
+    d->init(*is);
+    for (size_t i = 0; i < count; ++i) {
+        BOOST_CHECK_EQUAL(d->decodeLong(), static_cast<int64_t>(i));
+        size_t n = d->arrayStart();
+        BOOST_CHECK_EQUAL(n, 2U);
+        BOOST_CHECK_EQUAL(d->decodeDouble(), 1.0);
+        BOOST_CHECK_EQUAL(d->decodeDouble(), 2.0);
+        BOOST_CHECK_EQUAL(d->arrayNext(), 0U);
+        std::string str;
+        d->decodeString(str);
+        BOOST_CHECK_EQUAL(str, "x");
+    }
+}
+
+static void testResolvingDecoderCache() {
+    ValidSchema writer = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"a\", \"type\":\"int\"},"
+        "{\"name\":\"b\", \"type\":{\"type\":\"array\", \"items\":\"long\"}},"
+        "{\"name\":\"c\", \"type\":\"string\"}"
+        "]}");
+    ValidSchema reader = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"a\", \"type\":\"long\"},"
+        "{\"name\":\"b\", \"type\":{\"type\":\"array\", \"items\":\"double\"}},"
+        "{\"name\":\"d\", \"type\":\"string\", \"default\":\"x\"}"
+        "]}");
+    ValidSchema other = parsing::makeValidSchema("\"long\"");
+
+    const size_t count = 100;
+    OutputStreamPtr os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    for (size_t i = 0; i < count; ++i) {
+        e->encodeInt(static_cast<int32_t>(i));
+        e->arrayStart();
+        e->setItemCount(2);
+        e->startItem();
+        e->encodeLong(1);
+        e->startItem();
+        e->encodeLong(2);
+        e->arrayEnd();
+        e->encodeString("ignored");
+    }
+    e->flush();
+    std::vector<uint8_t> data(static_cast<size_t>(os->byteCount()));
+    {
+        InputStreamPtr is = memoryInputStream(*os);
+        StreamReader r(*is);
+        r.readBytes(data.data(), data.size());
+    }
+
+    // Decoders built from the same cache entry do not share state.
+    DecoderPtr d1 = resolvingDecoder(writer, reader, binaryDecoder());
+    DecoderPtr d2 = resolvingDecoder(writer, reader, binaryDecoder());
+    DecoderPtr d3 = compiledResolvingDecoder(writer, reader, binaryDecoder());
+    DecoderPtr d4 = compiledResolvingDecoder(writer, reader, binaryDecoder());
+    decodeResolved(d1, data, count);
+    decodeResolved(d3, data, count);
+    decodeResolved(d2, data, count);
+    decodeResolved(d4, data, count);
+
+    // Evicted and uncached pairs are rebuilt.
+    setResolvingDecoderCacheCapacity(1);
+    resolvingDecoder(other, other, binaryDecoder());
+    compiledResolvingDecoder(other, other, binaryDecoder());
+    decodeResolved(resolvingDecoder(writer, reader, binaryDecoder()), data, count);
+    decodeResolved(compiledResolvingDecoder(writer, reader, binaryDecoder()), data, count);
+    setResolvingDecoderCacheCapacity(0);
+    decodeResolved(resolvingDecoder(writer, reader, binaryDecoder()), data, count);
+    decodeResolved(compiledResolvingDecoder(writer, reader, binaryDecoder()), data, count);
+    setResolvingDecoderCacheCapacity(64);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.push_back(std::thread([&]() {
+            for (int i = 0; i < 20; ++i) {
+                decodeResolved(resolvingDecoder(writer, reader, binaryDecoder()), data, count);
+                decodeResolved(compiledResolvingDecoder(writer, reader, binaryDecoder()), data, count);
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+}
+
+
+static void validateRecords(const ValidSchema &schema, size_t count) {
+    OutputStreamPtr os = memoryOutputStream();
+    EncoderPtr e = validatingEncoder(schema, binaryEncoder());
+    e->init(*os);
+    for (size_t i = 0; i < count; ++i) {
+        e->encodeInt(static_cast<int32_t>(i));
+        e->encodeUnionIndex(1);
+        e->encodeString("x");
+    }
+    e->flush();
+
+    InputStreamPtr is = memoryInputStream(*os);
+    DecoderPtr d = validatingDecoder(schema, binaryDecoder());
+    d->init(*is);
+    for (size_t i = 0; i < count; ++i) {
+        BOOST_CHECK_EQUAL(d->decodeInt(), static_cast<int32_t>(i));
+        BOOST_CHECK_EQUAL(d->decodeUnionIndex(), 1U);
+        BOOST_CHECK_EQUAL(d->decodeString(), "x");
+    }
+}
+
+static void testValidatingCodecCache() {
+    ValidSchema schema = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"a\", \"type\":\"int\"},"
+        "{\"name\":\"b\", \"type\":[\"null\", \"string\"]}"
+        "]}");
+
+    // Decoders sharing a grammar do not share state.
+    OutputStreamPtr os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    e->encodeInt(1);
+    e->encodeUnionIndex(0);
+    e->flush();
+    InputStreamPtr is1 = memoryInputStream(*os);
+    InputStreamPtr is2 = memoryInputStream(*os);
+    DecoderPtr d1 = validatingDecoder(schema, binaryDecoder());
+    DecoderPtr d2 = validatingDecoder(schema, binaryDecoder());
+    d1->init(*is1);
+    d2->init(*is2);
+    BOOST_CHECK_EQUAL(d1->decodeInt(), 1);
+    BOOST_CHECK_EQUAL(d2->decodeInt(), 1);
+    BOOST_CHECK_EQUAL(d1->decodeUnionIndex(), 0U);
+    BOOST_CHECK_THROW(d2->decodeInt(), Exception);
+
+    setValidatingCodecCacheCapacity(0);
+    validateRecords(schema, 10);
+    setValidatingCodecCacheCapacity(64);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.push_back(std::thread([&]() {
+            for (int i = 0; i < 20; ++i) {
+                validateRecords(schema, 100);
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+}
+
+
+static const char *projectionWriter =
+    "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+    "{\"name\":\"a\", \"type\":\"long\"},"
+    "{\"name\":\"b\", \"type\":\"float\"},"
+    "{\"name\":\"c\", \"type\":\"double\"},"
+    "{\"name\":\"d\", \"type\":{\"type\":\"fixed\", \"name\":\"f3\", \"size\":3}},"
+    "{\"name\":\"e\", \"type\":{\"type\":\"record\", \"name\":\"p\", \"fields\":["
+    "{\"name\":\"x\", \"type\":\"double\"}, {\"name\":\"y\", \"type\":\"null\"}]}},"
+    "{\"name\":\"f\", \"type\":\"string\"},"
+    "{\"name\":\"g\", \"type\":{\"type\":\"array\", \"items\":\"p\"}},"
+    "{\"name\":\"h\", \"type\":\"int\"},"
+    "{\"name\":\"i\", \"type\":\"p\"},"
+    "{\"name\":\"j\", \"type\":\"string\"}"
+    "]}";
+
+static void encodeProjected(Encoder &e, size_t count) {
+    std::vector<uint8_t> f3(3, 7);
+    for (size_t i = 0; i < count; ++i) {
+        e.encodeLong(static_cast<int64_t>(i));
+        e.encodeFloat(1.5f);
+        e.encodeDouble(2.5);
+        e.encodeFixed(f3);
+        e.encodeDouble(3.5);
+        e.encodeNull();
+        e.encodeString("skipped");
+        e.arrayStart();
+        if (i % 3 != 0) {
+            e.setItemCount(i % 3);
+        }
+        for (size_t k = 0; k < i % 3; ++k) {
+            e.startItem();
+            e.encodeDouble(4.5);
+            e.encodeNull();
+        }
+        e.arrayEnd();
+        e.encodeInt(static_cast<int32_t>(2 * i));
+        e.encodeDouble(5.5);
+        e.encodeNull();
+        e.encodeString("j");
+    }
+    e.flush();
+}
+
+static void decodeProjected(const DecoderPtr &d, InputStream &is, size_t count) {
+    d->init(is);
+    for (size_t i = 0; i < count; ++i) {
+        BOOST_CHECK_EQUAL(d->decodeLong(), static_cast<int64_t>(i));
+        BOOST_CHECK_EQUAL(d->decodeInt(), static_cast<int32_t>(2 * i));
+        std::string str;
+        d->decodeString(str);
+        BOOST_CHECK_EQUAL(str, "j");
+    }
+    d->drain();
+}
+
+// Readers that leave out most of the writer's fields skip runs of
+// fixed-width ones at once.
+static void testProjectionSkip() {
+    ValidSchema writer = parsing::makeValidSchema(projectionWriter);
+    ValidSchema reader = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"a\", \"type\":\"long\"},"
+        "{\"name\":\"h\", \"type\":\"int\"},"
+        "{\"name\":\"j\", \"type\":\"string\"}"
+        "]}");
+    const size_t count = 50;
+
+    OutputStreamPtr os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    encodeProjected(*e, count);
+    InputStreamPtr is = memoryInputStream(*os);
+    decodeProjected(compiledResolvingDecoder(writer, reader, binaryDecoder()), *is, count);
+    is = memoryInputStream(*os);
+    decodeProjected(resolvingDecoder(writer, reader, binaryDecoder()), *is, count);
+
+    // Other encodings go through the skip routines value by value.
+    os = memoryOutputStream();
+    e = jsonEncoder(writer);
+    e->init(*os);
+    encodeProjected(*e, count);
+    is = memoryInputStream(*os);
+    decodeProjected(compiledResolvingDecoder(writer, reader, jsonDecoder(writer)), *is, count);
+}
+
+// Writes down the events of the values it visits.
+class TracingVisitor : public DatumVisitor {
+public:
+    std::ostringstream trace;
+
+    void onNull() override { trace << "null "; }
+    void onBool(bool b) override { trace << (b ? "true " : "false "); }
+    void onInt(int32_t i) override { trace << "i" << i << ' '; }
+    void onLong(int64_t l) override { trace << "l" << l << ' '; }
+    void onFloat(float f) override { trace << "f" << f << ' '; }
+    void onDouble(double d) override { trace << "d" << d << ' '; }
+    void onString(const char *s, size_t n) override { trace << '"' << std::string(s, n) << "\" "; }
+    void onBytes(const uint8_t *, size_t n) override { trace << "bytes" << n << ' '; }
+    void onFixed(const uint8_t *, size_t n) override { trace << "fixed" << n << ' '; }
+    void onEnum(size_t i, const std::string &s) override { trace << "enum" << i << ':' << s << ' '; }
+    void onRecordStart(const Node &n) override { trace << n.name().simpleName() << "{ "; }
+    void onField(size_t i, const std::string &name) override { trace << i << ':' << name << ' '; }
+    void onRecordEnd(const Node &) override { trace << "} "; }
+    void onArrayStart(const Node &) override { trace << "[ "; }
+    void onArrayItem(size_t i) override { trace << '#' << i << ' '; }
+    void onArrayEnd(size_t n) override { trace << "]" << n << ' '; }
+    void onMapStart(const Node &) override { trace << "< "; }
+    void onMapKey(const char *k, size_t n) override { trace << std::string(k, n) << "= "; }
+    void onMapEnd(size_t n) override { trace << ">" << n << ' '; }
+    void onUnionBranch(size_t i) override { trace << '|' << i << ' '; }
+};
+
+static void testDatumVisitor() {
+    ValidSchema writer = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"n\", \"type\":\"null\"},"
+        "{\"name\":\"b\", \"type\":\"boolean\"},"
+        "{\"name\":\"i\", \"type\":\"int\"},"
+        "{\"name\":\"l\", \"type\":\"long\"},"
+        "{\"name\":\"f\", \"type\":\"float\"},"
+        "{\"name\":\"d\", \"type\":\"double\"},"
+        "{\"name\":\"s\", \"type\":\"string\"},"
+        "{\"name\":\"y\", \"type\":\"bytes\"},"
+        "{\"name\":\"x\", \"type\":{\"type\":\"fixed\", \"name\":\"f2\", \"size\":2}},"
+        "{\"name\":\"e\", \"type\":{\"type\":\"enum\", \"name\":\"e\", \"symbols\":[\"A\", \"B\"]}},"
+        "{\"name\":\"a\", \"type\":{\"type\":\"array\", \"items\":\"int\"}},"
+        "{\"name\":\"m\", \"type\":{\"type\":\"map\", \"values\":"
+        "{\"type\":\"record\", \"name\":\"p\", \"fields\":[{\"name\":\"v\", \"type\":\"int\"}]}}},"
+        "{\"name\":\"u\", \"type\":[\"null\", \"p\"]}"
+        "]}");
+    OutputStreamPtr os = memoryOutputStream();
+    EncoderPtr e = validatingEncoder(writer, binaryEncoder());
+    e->init(*os);
+    e->encodeNull();
+    e->encodeBool(true);
+    e->encodeInt(1);
+    e->encodeLong(2);
+    e->encodeFloat(3.5f);
+    e->encodeDouble(4.5);
+    e->encodeString("s");
+    e->encodeBytes(std::vector<uint8_t>(3, 0));
+    e->encodeFixed(std::vector<uint8_t>(2, 0));
+    e->encodeEnum(1);
+    e->arrayStart();
+    e->setItemCount(2);
+    e->startItem();
+    e->encodeInt(5);
+    e->startItem();
+    e->encodeInt(6);
+    e->arrayEnd();
+    e->mapStart();
+    e->setItemCount(1);
+    e->startItem();
+    e->encodeString("k");
+    e->encodeInt(7);
+    e->mapEnd();
+    e->encodeUnionIndex(1);
+    e->encodeInt(8);
+    e->flush();
+
+    {
+        InputStreamPtr is = memoryInputStream(*os);
+        DecoderPtr d = validatingDecoder(writer, binaryDecoder());
+        d->init(*is);
+        DatumReader reader(writer, d);
+        TracingVisitor v;
+        reader.read(v);
+        BOOST_CHECK_EQUAL(v.trace.str(),
+                          "r{ 0:n null 1:b true 2:i i1 3:l l2 4:f f3.5 5:d d4.5 "
+                          "6:s \"s\" 7:y bytes3 8:x fixed2 9:e enum1:B "
+                          "10:a [ #0 i5 #1 i6 ]2 11:m < k= p{ 0:v i7 } >1 "
+                          "12:u |1 p{ 0:v i8 } } ");
+    }
+
+    // Under resolution, fields come in the writer's order and defaults
+    // last.
+    ValidSchema readerSchema = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"z\", \"type\":\"int\", \"default\":9},"
+        "{\"name\":\"u\", \"type\":[\"null\", "
+        "{\"type\":\"record\", \"name\":\"p\", \"fields\":[{\"name\":\"v\", \"type\":\"long\"}]}]},"
+        "{\"name\":\"l\", \"type\":\"double\"}"
+        "]}");
+    InputStreamPtr is = memoryInputStream(*os);
+    DecoderPtr d = binaryDecoder();
+    DatumReader reader(writer, readerSchema, d);
+    d->init(*is);
+    TracingVisitor v;
+    reader.read(v);
+    BOOST_CHECK_EQUAL(v.trace.str(), "r{ 2:l d2 1:u |1 p{ 0:v l8 } 0:z i9 } ");
+}
+
+// Encodes the decimal, then checks its bytes and that it decodes back.
+static void checkDecimal(int64_t v, const std::vector<uint8_t> &bytes) {
+    OutputStreamPtr os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    encodeDecimal(*e, v);
+    encodeFixedDecimal(*e, v, 12);
+    e->flush();
+    InputStreamPtr is = memoryInputStream(*os);
+    DecoderPtr d = binaryDecoder();
+    d->init(*is);
+    BOOST_CHECK(d->decodeBytes() == bytes);
+    std::vector<uint8_t> fixed = d->decodeFixed(12);
+    BOOST_CHECK_EQUAL_COLLECTIONS(fixed.end() - bytes.size(), fixed.end(), bytes.begin(), bytes.end());
+    for (size_t i = 0; i < fixed.size() - bytes.size(); ++i) {
+        BOOST_CHECK_EQUAL(fixed[i], v < 0 ? 0xff : 0);
+    }
+
+    InputStreamPtr is2 = memoryInputStream(*os);
+    d->init(*is2);
+    BOOST_CHECK_EQUAL(decodeDecimal(*d), v);
+    BOOST_CHECK_EQUAL(decodeFixedDecimal(*d, 12), v);
+
+    std::shared_ptr<std::vector<uint8_t>> data = snapshot(*os);
+    DirectBinaryDecoder dd(data->data(), data->size());
+#ifdef AVRO_HAVE_INT128
+    BOOST_CHECK(decodeDecimal128(dd) == v);
+    BOOST_CHECK(decodeFixedDecimal128(dd, 12) == v);
+#else
+    BOOST_CHECK_EQUAL(decodeDecimal(dd), v);
+    BOOST_CHECK_EQUAL(decodeFixedDecimal(dd, 12), v);
+#endif
+}
+
+static void testLogicalValues() {
+    checkDecimal(0, {0});
+    checkDecimal(1, {1});
+    checkDecimal(-1, {0xff});
+    checkDecimal(127, {0x7f});
+    checkDecimal(128, {0x00, 0x80});
+    checkDecimal(-128, {0x80});
+    checkDecimal(-129, {0xff, 0x7f});
+    checkDecimal(123456789, {0x07, 0x5b, 0xcd, 0x15});
+    checkDecimal(INT64_MAX, {0x7f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff});
+    checkDecimal(INT64_MIN, {0x80, 0, 0, 0, 0, 0, 0, 0});
+
+    // Sign extension beyond 64 bits is accepted, anything else is not.
+    const uint8_t wide[] = {0xff, 0xff, 0xfe};
+    const uint8_t tooWide[] = {0x01, 0, 0, 0, 0, 0, 0, 0, 0};
+    const uint8_t flipped[] = {0xff, 0x7f, 0, 0, 0, 0, 0, 0, 0};
+    DirectBinaryEncoder de;
+    de.encodeBytes(wide, sizeof(wide));
+    de.encodeBytes(tooWide, sizeof(tooWide));
+    de.encodeBytes(flipped, sizeof(flipped));
+    DirectBinaryDecoder dd(de.data(), de.size());
+    BOOST_CHECK_EQUAL(decodeDecimal(dd), -2);
+    BOOST_CHECK_THROW(decodeDecimal(dd), Exception);
+    BOOST_CHECK_THROW(decodeDecimal(dd), Exception);
+    BOOST_CHECK_THROW(encodeFixedDecimal(de, 1000, 1), Exception);
+
+#ifdef AVRO_HAVE_INT128
+    int128_t big = static_cast<int128_t>(INT64_MAX) * 1000000 + 7;
+    de.clear();
+    encodeDecimal128(de, big);
+    encodeDecimal128(de, -big);
+    DirectBinaryDecoder dd128(de.data(), de.size());
+    BOOST_CHECK(decodeDecimal128(dd128) == big);
+    BOOST_CHECK(decodeDecimal128(dd128) == -big);
+#endif
+
+    std::array<uint8_t, 16> uuid = {{0x12, 0x3e, 0x45, 0x67, 0xe8, 0x9b, 0x12, 0xd3,
+                                     0xa4, 0x56, 0x42, 0x66, 0x14, 0x17, 0x40, 0x00}};
+    OutputStreamPtr os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    encodeUuid(*e, uuid);
+    e->encodeString("123E4567-E89B-12D3-A456-426614174000");
+    e->encodeString("123e4567-e89b-12d3-a456-42661417400");
+    e->encodeString("123e4567-e89b-12d3-a456_426614174000");
+    e->encodeString("123e4567-e89b-12d3-a456-42661417400g");
+    encodeTimestamp(*e, TimestampMicros(std::chrono::microseconds(1700000000123456LL)));
+    encodeTimestamp(*e, TimestampMillis(std::chrono::milliseconds(-1)));
+    e->flush();
+    InputStreamPtr is = memoryInputStream(*os);
+    DecoderPtr d = binaryDecoder();
+    d->init(*is);
+    BOOST_CHECK_EQUAL(d->decodeString(), "123e4567-e89b-12d3-a456-426614174000");
+    InputStreamPtr is2 = memoryInputStream(*os);
+    d->init(*is2);
+    std::array<uint8_t, 16> decoded{};
+    decodeUuid(*d, decoded);
+    BOOST_CHECK(decoded == uuid);
+    decoded = std::array<uint8_t, 16>();
+    decodeUuid(*d, decoded);
+    BOOST_CHECK(decoded == uuid);
+    BOOST_CHECK_THROW(decodeUuid(*d, decoded), Exception);
+    BOOST_CHECK_THROW(decodeUuid(*d, decoded), Exception);
+    BOOST_CHECK_THROW(decodeUuid(*d, decoded), Exception);
+    BOOST_CHECK_EQUAL(decodeTimestampMicros(*d).time_since_epoch().count(), 1700000000123456LL);
+    BOOST_CHECK_EQUAL(decodeTimestampMillis(*d).time_since_epoch().count(), -1);
+}
+
+static std::vector<uint8_t> singleObject(SingleObjectEncoder &e, const GenericDatum &datum) {
+    OutputStreamPtr os = memoryOutputStream();
+    e.encode(*os, datum);
+    std::vector<uint8_t> result(static_cast<size_t>(os->byteCount()));
+    InputStreamPtr is = memoryInputStream(*os);
+    StreamReader r(*is);
+    r.readBytes(result.data(), result.size());
+    return result;
+}
+
+static void testSingleObject() {
+    ValidSchema v1 = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"a\", \"type\":\"int\"},"
+        "{\"name\":\"b\", \"type\":\"string\"}"
+        "]}");
+    ValidSchema v2 = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"a\", \"type\":\"long\"},"
+        "{\"name\":\"b\", \"type\":\"string\"},"
+        "{\"name\":\"c\", \"type\":\"double\", \"default\":1.5}"
+        "]}");
+
+    GenericDatum d1(v1);
+    d1.value<GenericRecord>().fieldAt(0) = GenericDatum(int32_t(7));
+    d1.value<GenericRecord>().fieldAt(1) = GenericDatum(std::string("one"));
+    GenericDatum d2(v2);
+    d2.value<GenericRecord>().fieldAt(0) = GenericDatum(int64_t(8));
+    d2.value<GenericRecord>().fieldAt(1) = GenericDatum(std::string("two"));
+    d2.value<GenericRecord>().fieldAt(2) = GenericDatum(2.5);
+
+    SingleObjectEncoder e1(v1);
+    SingleObjectEncoder e2(v2);
+    std::vector<uint8_t> m1 = singleObject(e1, d1);
+    std::vector<uint8_t> m2 = singleObject(e2, d2);
+
+    BOOST_REQUIRE(m1.size() > singleObjectHeaderSize);
+    BOOST_CHECK_EQUAL(m1[0], 0xC3);
+    BOOST_CHECK_EQUAL(m1[1], 0x01);
+    BOOST_CHECK_EQUAL(SingleObjectDecoder::fingerprint(m1.data(), m1.size()),
+                      v1.rabinFingerprint());
+    BOOST_CHECK_EQUAL(SingleObjectDecoder::fingerprint(m2.data(), m2.size()),
+                      v2.rabinFingerprint());
+
+    std::shared_ptr<MemorySchemaStore> store = std::make_shared<MemorySchemaStore>();
+    SingleObjectDecoder d(v2, store);
+    GenericDatum result(v2);
+    BOOST_CHECK_THROW(d.decode(m1.data(), m1.size(), result), Exception);
+    store->add(v1);
+
+    // Alternating writers switch between the decoders kept per schema.
+    for (int i = 0; i < 3; ++i) {
+        d.decode(m1.data(), m1.size(), result);
+        const GenericRecord &r1 = result.value<GenericRecord>();
+        BOOST_CHECK_EQUAL(r1.fieldAt(0).value<int64_t>(), 7);
+        BOOST_CHECK_EQUAL(r1.fieldAt(1).value<std::string>(), "one");
+        BOOST_CHECK_EQUAL(r1.fieldAt(2).value<double>(), 1.5);
+
+        d.decode(m2.data(), m2.size(), result);
+        const GenericRecord &r2 = result.value<GenericRecord>();
+        BOOST_CHECK_EQUAL(r2.fieldAt(0).value<int64_t>(), 8);
+        BOOST_CHECK_EQUAL(r2.fieldAt(1).value<std::string>(), "two");
+        BOOST_CHECK_EQUAL(r2.fieldAt(2).value<double>(), 2.5);
+    }
+
+    std::vector<uint8_t> bad = m1;
+    bad[1] = 0x02;
+    BOOST_CHECK_THROW(d.decode(bad.data(), bad.size(), result), Exception);
+    BOOST_CHECK_THROW(d.decode(m1.data(), 5, result), Exception);
+}
+
+static void testBatch() {
+    ValidSchema v1 = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"a\", \"type\":\"int\"},"
+        "{\"name\":\"b\", \"type\":\"string\"}"
+        "]}");
+    ValidSchema v2 = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"a\", \"type\":\"long\"},"
+        "{\"name\":\"b\", \"type\":\"string\"}"
+        "]}");
+    std::shared_ptr<MemorySchemaStore> store = std::make_shared<MemorySchemaStore>();
+    store->add(v1);
+
+    for (bool offsets : {true, false}) {
+        BatchEncoder e(v1, offsets);
+        GenericDatum d(v1);
+        for (int32_t i = 0; i < 100; ++i) {
+            d.value<GenericRecord>().fieldAt(0) = GenericDatum(i);
+            d.value<GenericRecord>().fieldAt(1) = GenericDatum(std::string(static_cast<size_t>(i), 'x'));
+            e.add(d);
+        }
+        BOOST_CHECK_EQUAL(e.size(), 100);
+        std::shared_ptr<std::vector<uint8_t>> batch = e.finish();
+        BOOST_CHECK_EQUAL(e.size(), 0);
+        BOOST_CHECK_EQUAL(e.finish()->size(), batchHeaderSize);
+
+        BatchDecoder b(v2, store);
+        b.reset(batch->data(), batch->size());
+        BOOST_CHECK_EQUAL(b.size(), 100);
+        BOOST_CHECK_EQUAL(b.fingerprint(), v1.rabinFingerprint());
+        BOOST_CHECK_EQUAL(b.hasOffsets(), offsets);
+        GenericDatum result(v2);
+        if (offsets) {
+            for (size_t i : {57, 3, 99, 0}) {
+                b.decode(i, result);
+                BOOST_CHECK_EQUAL(result.value<GenericRecord>().fieldAt(0).value<int64_t>(), static_cast<int64_t>(i));
+                BOOST_CHECK_EQUAL(result.value<GenericRecord>().fieldAt(1).value<std::string>().size(), i);
+            }
+            BOOST_CHECK_THROW(b.decode(100, result), Exception);
+            b.next(result);
+            BOOST_CHECK_EQUAL(result.value<GenericRecord>().fieldAt(0).value<int64_t>(), 1);
+        } else {
+            BOOST_CHECK_THROW(b.decode(3, result), Exception);
+            for (int64_t i = 0; i < 100; ++i) {
+                b.next(result);
+                BOOST_CHECK_EQUAL(result.value<GenericRecord>().fieldAt(0).value<int64_t>(), i);
+            }
+            BOOST_CHECK_THROW(b.next(result), Exception);
+        }
+
+        std::vector<uint8_t> bad(*batch);
+        bad[1] = 0x01;
+        BOOST_CHECK_THROW(b.reset(bad.data(), bad.size()), Exception);
+        if (offsets) {
+            BOOST_CHECK_THROW(b.reset(batch->data(), batchHeaderSize + 10), Exception);
+        }
+    }
+}
+
+
+static std::vector<uint8_t> encodeGenericDatum(const GenericDatum &datum) {
+    OutputStreamPtr os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    GenericWriter::write(*e, datum);
+    e->flush();
+    std::vector<uint8_t> result(static_cast<size_t>(os->byteCount()));
+    InputStreamPtr is = memoryInputStream(*os);
+    StreamReader r(*is);
+    r.readBytes(result.data(), result.size());
+    return result;
+}
+
+static void testArena() {
+    Arena arena(256);
+    void *a = arena.allocate(3, 1);
+    void *b = arena.allocate(8, 8);
+    BOOST_CHECK(a != b);
+    BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(b) % 8, 0U);
+    void *big = arena.allocate(1000, 16);
+    BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(big) % 16, 0U);
+    size_t capacity = arena.capacity();
+    arena.reset();
+    BOOST_CHECK(arena.allocate(1000, 16) != nullptr);
+    BOOST_CHECK(arena.allocate(3, 1) != nullptr);
+    BOOST_CHECK_EQUAL(arena.capacity(), capacity);
+    arena.reset();
+
+    ValidSchema schema = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"i\", \"type\":\"int\"},"
+        "{\"name\":\"s\", \"type\":\"string\"},"
+        "{\"name\":\"u\", \"type\":[\"null\", \"r\"]},"
+        "{\"name\":\"a\", \"type\":{\"type\":\"array\", \"items\":\"long\"}},"
+        "{\"name\":\"m\", \"type\":{\"type\":\"map\", \"values\":\"double\"}}"
+        "]}");
+
+    GenericDatum datum(schema);
+    GenericRecord &outer = datum.value<GenericRecord>();
+    outer.fieldAt(0) = GenericDatum(int32_t(1));
+    outer.fieldAt(1) = GenericDatum(std::string(100, 'x'));
+    outer.fieldAt(2).selectBranch(1);
+    GenericRecord &inner = outer.fieldAt(2).value<GenericRecord>();
+    inner.fieldAt(0) = GenericDatum(int32_t(2));
+    inner.fieldAt(1) = GenericDatum(std::string("short"));
+    for (int64_t i = 0; i < 10; ++i) {
+        inner.fieldAt(3).value<GenericArray>().value().push_back(GenericDatum(i));
+        outer.fieldAt(4).value<GenericMap>().value().push_back(
+            std::make_pair(std::string(1, static_cast<char>('a' + i)), GenericDatum(i * 0.5)));
+    }
+    const std::vector<uint8_t> encoded = encodeGenericDatum(datum);
+
+    // Reading in a loop reuses the same chunks.
+    for (int n = 0; n < 3; ++n) {
+        InputStreamPtr is = memoryInputStream(encoded.data(), encoded.size());
+        DecoderPtr d = binaryDecoder();
+        d->init(*is);
+        GenericReader reader(schema, d);
+        {
+            GenericDatum result;
+            reader.read(result, arena);
+            BOOST_CHECK(result.arena() == &arena);
+            const GenericRecord &r = result.value<GenericRecord>();
+            BOOST_CHECK(r.fieldAt(2).arena() == &arena);
+            BOOST_CHECK(r.fieldAt(2).value<GenericRecord>().fieldAt(3).value<GenericArray>().value()[9].arena() == &arena);
+            BOOST_CHECK(encodeGenericDatum(result) == encoded);
+
+            // Copies are on the heap and outlive the arena's contents.
+            GenericDatum copy = result;
+            BOOST_CHECK(copy.arena() == nullptr);
+            result = GenericDatum();
+            arena.reset();
+            BOOST_CHECK(encodeGenericDatum(copy) == encoded);
+        }
+        if (n == 0) {
+            capacity = arena.capacity();
+        } else {
+            BOOST_CHECK_EQUAL(arena.capacity(), capacity);
+        }
+    }
+}
+
+
+static void testReadInPlace() {
+    ValidSchema schema = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"s\", \"type\":\"string\"},"
+        "{\"name\":\"u\", \"type\":[\"null\", \"string\"]},"
+        "{\"name\":\"a\", \"type\":{\"type\":\"array\", \"items\":\"string\"}},"
+        "{\"name\":\"m\", \"type\":{\"type\":\"map\", \"values\":\"long\"}}"
+        "]}");
+
+    // Long values first, so that the later ones fit in what they leave.
+    const size_t sizes[] = {5, 2, 0, 3};
+    std::vector<GenericDatum> values;
+    OutputStreamPtr os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    for (size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); ++n) {
+        GenericDatum datum(schema);
+        GenericRecord &r = datum.value<GenericRecord>();
+        r.fieldAt(0) = GenericDatum(std::string(100 - n, 's'));
+        if (n % 2 == 0) {
+            r.fieldAt(1).selectBranch(1);
+            r.fieldAt(1).value<std::string>() = std::string(50, 'u');
+        }
+        for (size_t i = 0; i < sizes[n]; ++i) {
+            r.fieldAt(2).value<GenericArray>().value().push_back(GenericDatum(std::string(40, static_cast<char>('a' + i))));
+            r.fieldAt(3).value<GenericMap>().value().push_back(
+                std::make_pair(std::string(1, static_cast<char>('a' + i)), GenericDatum(static_cast<int64_t>(i))));
+        }
+        GenericWriter::write(*e, datum);
+        values.push_back(datum);
+    }
+    e->flush();
+
+    InputStreamPtr is = memoryInputStream(*os);
+    DecoderPtr d = binaryDecoder();
+    d->init(*is);
+    GenericReader reader(schema, d);
+    GenericDatum datum(schema);
+    const char *text = nullptr;
+    for (size_t n = 0; n < values.size(); ++n) {
+        reader.readInPlace(datum);
+        const GenericRecord &r = datum.value<GenericRecord>();
+        const GenericRecord &expected = values[n].value<GenericRecord>();
+        BOOST_CHECK_EQUAL(r.fieldAt(0).value<std::string>(), expected.fieldAt(0).value<std::string>());
+        BOOST_CHECK_EQUAL(r.fieldAt(1).unionBranch(), expected.fieldAt(1).unionBranch());
+        const GenericArray::Value &a = r.fieldAt(2).value<GenericArray>().value();
+        const GenericMap::Value &m = r.fieldAt(3).value<GenericMap>().value();
+        BOOST_REQUIRE_EQUAL(a.size(), sizes[n]);
+        BOOST_REQUIRE_EQUAL(m.size(), sizes[n]);
+        for (size_t i = 0; i < sizes[n]; ++i) {
+            BOOST_CHECK_EQUAL(a[i].value<std::string>(), std::string(40, static_cast<char>('a' + i)));
+            BOOST_CHECK_EQUAL(m[i].first, std::string(1, static_cast<char>('a' + i)));
+            BOOST_CHECK_EQUAL(m[i].second.value<int64_t>(), static_cast<int64_t>(i));
+        }
+
+        // The string keeps its buffer from one value to the next.
+        const char *p = r.fieldAt(0).value<std::string>().data();
+        if (text != nullptr) {
+            BOOST_CHECK(p == text);
+        }
+        text = p;
+    }
+}
+
+static void testCompiledGenericReader() {
+    ValidSchema schema = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"i\", \"type\":\"int\"},"
+        "{\"name\":\"b\", \"type\":\"boolean\"},"
+        "{\"name\":\"f\", \"type\":\"float\"},"
+        "{\"name\":\"s\", \"type\":\"string\"},"
+        "{\"name\":\"x\", \"type\":{\"type\":\"fixed\", \"name\":\"x\", \"size\":3}},"
+        "{\"name\":\"e\", \"type\":{\"type\":\"enum\", \"name\":\"e\", \"symbols\":[\"p\", \"q\"]}},"
+        "{\"name\":\"u\", \"type\":[\"null\", \"r\"]},"
+        "{\"name\":\"a\", \"type\":{\"type\":\"array\", \"items\":\"long\"}},"
+        "{\"name\":\"m\", \"type\":{\"type\":\"map\", \"values\":\"double\"}}"
+        "]}");
+
+    GenericDatum datum(schema);
+    GenericRecord &outer = datum.value<GenericRecord>();
+    outer.fieldAt(0) = GenericDatum(int32_t(1));
+    outer.fieldAt(1) = GenericDatum(true);
+    outer.fieldAt(2) = GenericDatum(1.5f);
+    outer.fieldAt(3) = GenericDatum(std::string("outer"));
+    outer.fieldAt(4).value<GenericFixed>().value() = {1, 2, 3};
+    outer.fieldAt(5).value<GenericEnum>().set(1);
+    outer.fieldAt(6).selectBranch(1);
+    GenericRecord &inner = outer.fieldAt(6).value<GenericRecord>();
+    inner.fieldAt(0) = GenericDatum(int32_t(2));
+    inner.fieldAt(3) = GenericDatum(std::string("inner"));
+    for (int64_t i = 0; i < 10; ++i) {
+        inner.fieldAt(7).value<GenericArray>().value().push_back(GenericDatum(i));
+        outer.fieldAt(8).value<GenericMap>().value().push_back(
+            std::make_pair(std::string(1, static_cast<char>('a' + i)), GenericDatum(i * 0.5)));
+    }
+    const std::vector<uint8_t> encoded = encodeGenericDatum(datum);
+
+    InputStreamPtr is = memoryInputStream(encoded.data(), encoded.size());
+    DecoderPtr d = binaryDecoder();
+    d->init(*is);
+    CompiledGenericReader reader(schema, d);
+    GenericDatum result;
+    reader.read(result);
+    BOOST_CHECK(encodeGenericDatum(result) == encoded);
+
+    // Read in place over the previous value.
+    is = memoryInputStream(encoded.data(), encoded.size());
+    d->init(*is);
+    reader.readInPlace(result);
+    BOOST_CHECK(encodeGenericDatum(result) == encoded);
+
+    // With a writer's schema, the result is the one of GenericReader.
+    ValidSchema readerSchema = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"m\", \"type\":{\"type\":\"map\", \"values\":\"double\"}},"
+        "{\"name\":\"i\", \"type\":\"long\"},"
+        "{\"name\":\"s\", \"type\":\"string\"},"
+        "{\"name\":\"n\", \"type\":\"string\", \"default\":\"none\"},"
+        "{\"name\":\"u\", \"type\":[\"null\", \"r\"]},"
+        "{\"name\":\"a\", \"type\":{\"type\":\"array\", \"items\":\"double\"}}"
+        "]}");
+    is = memoryInputStream(encoded.data(), encoded.size());
+    d = binaryDecoder();
+    d->init(*is);
+    CompiledGenericReader resolving(schema, readerSchema, d);
+    GenericDatum resolved;
+    resolving.read(resolved);
+    resolving.drain();
+
+    InputStreamPtr is2 = memoryInputStream(encoded.data(), encoded.size());
+    DecoderPtr d2 = binaryDecoder();
+    d2->init(*is2);
+    GenericReader expected(schema, readerSchema, d2);
+    GenericDatum reference;
+    expected.read(reference);
+    BOOST_CHECK(encodeGenericDatum(resolved) == encodeGenericDatum(reference));
+    const GenericRecord &r = resolved.value<GenericRecord>();
+    BOOST_CHECK_EQUAL(r.field("i").value<int64_t>(), 1);
+    BOOST_CHECK_EQUAL(r.field("n").value<std::string>(), "none");
+    BOOST_CHECK_EQUAL(r.field("u").value<GenericRecord>().field("a").value<GenericArray>().value()[9].value<double>(), 9.0);
+}
+
+static std::vector<uint8_t> toBytes(const OutputStream &os) {
+    std::vector<uint8_t> result(static_cast<size_t>(os.byteCount()));
+    InputStreamPtr is = memoryInputStream(os);
+    StreamReader r(*is);
+    r.readBytes(result.data(), result.size());
+    return result;
+}
+
+static void testGenericSizeEstimator() {
+    ValidSchema schema = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"i\", \"type\":\"int\"},"
+        "{\"name\":\"l\", \"type\":\"long\"},"
+        "{\"name\":\"d\", \"type\":\"double\"},"
+        "{\"name\":\"s\", \"type\":\"string\"},"
+        "{\"name\":\"y\", \"type\":\"bytes\"},"
+        "{\"name\":\"x\", \"type\":{\"type\":\"fixed\", \"name\":\"x\", \"size\":2}},"
+        "{\"name\":\"u\", \"type\":[\"null\", \"r\"]},"
+        "{\"name\":\"a\", \"type\":{\"type\":\"array\", \"items\":\"x\"}},"
+        "{\"name\":\"m\", \"type\":{\"type\":\"map\", \"values\":[\"string\", \"long\"]}}"
+        "]}");
+    GenericSizeEstimator estimator(schema);
+    BOOST_CHECK(!estimator.fixedSize());
+
+    GenericDatum datum(schema);
+    BOOST_CHECK_EQUAL(estimator.size(datum), encodeGenericDatum(datum).size());
+    GenericRecord &outer = datum.value<GenericRecord>();
+    outer.fieldAt(0) = GenericDatum(int32_t(-65));
+    outer.fieldAt(1) = GenericDatum(std::numeric_limits<int64_t>::min());
+    outer.fieldAt(3) = GenericDatum(std::string(200, 's'));
+    outer.fieldAt(4) = GenericDatum(std::vector<uint8_t>(3, 7));
+    outer.fieldAt(6).selectBranch(1);
+    GenericRecord &inner = outer.fieldAt(6).value<GenericRecord>();
+    inner.fieldAt(1) = GenericDatum(int64_t(1) << 40);
+    for (int i = 0; i < 100; ++i) {
+        GenericDatum item(schema.root()->leafAt(7)->leafAt(0));
+        item.value<GenericFixed>().value() = {uint8_t(i), uint8_t(i + 1)};
+        outer.fieldAt(7).value<GenericArray>().value().push_back(item);
+        GenericDatum value(schema.root()->leafAt(8)->leafAt(1));
+        value.selectBranch(i % 2);
+        if (i % 2 == 0) {
+            value.value<std::string>() = std::string(static_cast<size_t>(i), 'v');
+        } else {
+            value.value<int64_t>() = -i * 1000;
+        }
+        inner.fieldAt(8).value<GenericMap>().value().push_back(
+            std::make_pair(std::string(static_cast<size_t>(i % 3), 'k'), value));
+    }
+    BOOST_CHECK_EQUAL(estimator.size(datum), encodeGenericDatum(datum).size());
+
+    // Fixed-width schemas, with unions of branches of one size and
+    // small enums, are sized without looking at the datum.
+    ValidSchema fixed = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"f\",\"fields\":["
+        "{\"name\":\"b\", \"type\":\"boolean\"},"
+        "{\"name\":\"v\", \"type\":\"float\"},"
+        "{\"name\":\"u\", \"type\":[\"double\", {\"type\":\"fixed\", \"name\":\"e\", \"size\":8}]},"
+        "{\"name\":\"e\", \"type\":{\"type\":\"enum\", \"name\":\"n\", \"symbols\":[\"p\", \"q\"]}}"
+        "]}");
+    GenericSizeEstimator fixedEstimator(fixed);
+    BOOST_CHECK(fixedEstimator.fixedSize());
+    GenericDatum f(fixed);
+    f.value<GenericRecord>().fieldAt(2).selectBranch(1);
+    BOOST_CHECK_EQUAL(fixedEstimator.size(f), 15U);
+    BOOST_CHECK_EQUAL(fixedEstimator.size(f), encodeGenericDatum(f).size());
+}
+
+static void testCompiledGenericWriter() {
+    ValidSchema schema = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"i\", \"type\":\"int\"},"
+        "{\"name\":\"l\", \"type\":\"long\"},"
+        "{\"name\":\"d\", \"type\":\"double\"},"
+        "{\"name\":\"s\", \"type\":\"string\"},"
+        "{\"name\":\"y\", \"type\":\"bytes\"},"
+        "{\"name\":\"x\", \"type\":{\"type\":\"fixed\", \"name\":\"x\", \"size\":2}},"
+        "{\"name\":\"e\", \"type\":{\"type\":\"enum\", \"name\":\"e\", \"symbols\":[\"p\", \"q\"]}},"
+        "{\"name\":\"u\", \"type\":[\"null\", \"r\"]},"
+        "{\"name\":\"a\", \"type\":{\"type\":\"array\", \"items\":\"x\"}},"
+        "{\"name\":\"m\", \"type\":{\"type\":\"map\", \"values\":[\"string\", \"boolean\"]}}"
+        "]}");
+
+    GenericDatum datum(schema);
+    GenericRecord &outer = datum.value<GenericRecord>();
+    outer.fieldAt(0) = GenericDatum(int32_t(-3));
+    outer.fieldAt(1) = GenericDatum(int64_t(1) << 40);
+    outer.fieldAt(2) = GenericDatum(2.25);
+    outer.fieldAt(3) = GenericDatum(std::string("outer"));
+    outer.fieldAt(4) = GenericDatum(std::vector<uint8_t>{7, 8, 9});
+    outer.fieldAt(5).value<GenericFixed>().value() = {1, 2};
+    outer.fieldAt(6).value<GenericEnum>().set(1);
+    outer.fieldAt(7).selectBranch(1);
+    GenericRecord &inner = outer.fieldAt(7).value<GenericRecord>();
+    inner.fieldAt(3) = GenericDatum(std::string("inner"));
+    inner.fieldAt(5).value<GenericFixed>().value() = {3, 4};
+    for (int i = 0; i < 5; ++i) {
+        GenericDatum item(schema.root()->leafAt(8)->leafAt(0));
+        item.value<GenericFixed>().value() = {uint8_t(i), uint8_t(i + 1)};
+        outer.fieldAt(8).value<GenericArray>().value().push_back(item);
+        GenericDatum value(schema.root()->leafAt(9)->leafAt(1));
+        value.selectBranch(i % 2);
+        if (i % 2 == 0) {
+            value.value<std::string>() = std::string(static_cast<size_t>(i), 'v');
+        } else {
+            value.value<bool>() = true;
+        }
+        inner.fieldAt(9).value<GenericMap>().value().push_back(
+            std::make_pair(std::string(1, static_cast<char>('a' + i)), value));
+    }
+    const std::vector<uint8_t> encoded = encodeGenericDatum(datum);
+
+    // The steps for a binary encoder, written twice to check that the
+    // writer can be reused.
+    OutputStreamPtr os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    CompiledGenericWriter writer(schema, e);
+    writer.write(datum);
+    e->flush();
+    BOOST_CHECK(toBytes(*os) == encoded);
+    writer.write(datum);
+    e->flush();
+    std::vector<uint8_t> twice = encoded;
+    twice.insert(twice.end(), encoded.begin(), encoded.end());
+    BOOST_CHECK(toBytes(*os) == twice);
+
+    // The steps for any other encoder, through GenericWriter.
+    os = memoryOutputStream();
+    e = validatingEncoder(schema, binaryEncoder());
+    e->init(*os);
+    GenericWriter validating(schema, e);
+    validating.write(datum);
+    e->flush();
+    BOOST_CHECK(toBytes(*os) == encoded);
+}
+
+static void testInternedStrings() {
+    ValidSchema schema = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"region\", \"type\":\"string\"},"
+        "{\"name\":\"note\", \"type\":[\"null\", \"string\"]},"
+        "{\"name\":\"tags\", \"type\":{\"type\":\"array\", \"items\":\"string\"}},"
+        "{\"name\":\"id\", \"type\":\"long\"}"
+        "]}");
+    const char *const regions[] = {"europe-west-and-a-long-name", "asia-east-and-a-long-name", "us"};
+
+    std::unique_ptr<OutputStream> os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    const int64_t count = 30;
+    for (int64_t i = 0; i < count; ++i) {
+        e->encodeString(regions[i % 3]);
+        e->encodeUnionIndex(1);
+        e->encodeString(i % 2 == 0 ? "even" : "odd");
+        e->arrayStart();
+        e->setItemCount(1);
+        e->startItem();
+        e->encodeString("t" + std::to_string(i % 5));
+        e->arrayEnd();
+        e->encodeLong(i);
+    }
+    e->flush();
+
+    std::shared_ptr<InputStream> is = memoryInputStream(*os);
+    DecoderPtr d = binaryDecoder();
+    d->init(*is);
+    std::unique_ptr<GenericReader> reader(new GenericReader(schema, d));
+    const StringDictionary &regionValues = reader->internStrings("region");
+    reader->internStrings("note");
+    const StringDictionary &tagValues = reader->internStrings("tags[]", 2);
+    BOOST_CHECK_THROW(reader->internStrings("id"), Exception);
+    BOOST_CHECK_THROW(reader->internStrings("missing"), Exception);
+    BOOST_CHECK_THROW(reader->internStrings("region[]"), Exception);
+
+    std::vector<GenericDatum> datums(count);
+    for (int64_t i = 0; i < count; ++i) {
+        reader->read(datums[i]);
+        const GenericRecord &r = datums[i].value<GenericRecord>();
+        BOOST_CHECK_EQUAL(r.field("region").value<std::string>(), regions[i % 3]);
+        BOOST_CHECK_EQUAL(r.field("note").value<std::string>(), i % 2 == 0 ? "even" : "odd");
+        BOOST_CHECK_EQUAL(r.field("tags").value<GenericArray>().value()[0].value<std::string>(),
+                          "t" + std::to_string(i % 5));
+        BOOST_CHECK_EQUAL(r.field("id").value<int64_t>(), i);
+    }
+    BOOST_CHECK_EQUAL(regionValues.size(), 3U);
+    BOOST_CHECK_EQUAL(regionValues.hits(), static_cast<uint64_t>(count - 3));
+    BOOST_CHECK_EQUAL(tagValues.size(), 2U);
+
+    // Values of one string share it, until one is changed.
+    const GenericDatum &a = datums[0].value<GenericRecord>().field("region");
+    const GenericDatum &b = datums[3].value<GenericRecord>().field("region");
+    BOOST_CHECK_EQUAL(&a.value<std::string>(), &b.value<std::string>());
+    const GenericDatum copy = datums[3];
+    BOOST_CHECK_EQUAL(&copy.value<GenericRecord>().field("region").value<std::string>(), &a.value<std::string>());
+    datums[3].value<GenericRecord>().field("region").value<std::string>() += "!";
+    BOOST_CHECK_EQUAL(a.value<std::string>(), regions[0]);
+    BOOST_CHECK_EQUAL(b.value<std::string>(), std::string(regions[0]) + "!");
+    BOOST_CHECK_EQUAL(copy.value<GenericRecord>().field("region").value<std::string>(), regions[0]);
+
+    // The strings outlive the reader and its dictionaries.
+    reader.reset();
+    datums.resize(1);
+    BOOST_CHECK_EQUAL(datums[0].value<GenericRecord>().field("region").value<std::string>(), regions[0]);
+}
+
+static void testSharedDatums() {
+    ValidSchema schema = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"name\", \"type\":\"string\"},"
+        "{\"name\":\"inner\", \"type\":{\"type\":\"record\",\"name\":\"i\",\"fields\":["
+        "{\"name\":\"tags\", \"type\":{\"type\":\"array\", \"items\":\"string\"}},"
+        "{\"name\":\"attrs\", \"type\":{\"type\":\"map\", \"values\":\"long\"}}]}},"
+        "{\"name\":\"opt\", \"type\":[\"null\", \"bytes\"]},"
+        "{\"name\":\"n\", \"type\":\"int\"}"
+        "]}");
+
+    // Built in place and from moved values.
+    GenericDatum datum(schema);
+    GenericRecord &r = datum.value<GenericRecord>();
+    std::string name(100, 'x');
+    const char *nameData = name.data();
+    r.setFieldAt(0, GenericDatum(std::move(name)));
+    BOOST_CHECK_EQUAL(static_cast<const void *>(r.fieldAt(0).value<std::string>().data()),
+                      static_cast<const void *>(nameData));
+    GenericRecord &inner = r.fieldAt(1).value<GenericRecord>();
+    for (int i = 0; i < 3; ++i) {
+        inner.fieldAt(0).value<GenericArray>().emplace().value<std::string>() = "tag" + std::to_string(i);
+        inner.fieldAt(1).value<GenericMap>().emplace("k" + std::to_string(i)).value<int64_t>() = i;
+    }
+    r.fieldAt(2).selectBranch(1);
+    r.fieldAt(2).value<std::vector<uint8_t>>() = {1, 2, 3};
+    r.fieldAt(3).value<int32_t>() = 7;
+    const std::vector<uint8_t> encoded = encodeGenericDatum(datum);
+
+    // Shared, copies take no copy of the values.
+    datum.share();
+    BOOST_CHECK(datum.isShared());
+    const GenericDatum &original = datum;
+    const std::string *shared = &original.value<GenericRecord>().fieldAt(0).value<std::string>();
+    std::vector<GenericDatum> sinks(4, datum);
+    for (const GenericDatum &sink : sinks) {
+        BOOST_CHECK(sink.isShared());
+        BOOST_CHECK_EQUAL(&sink.value<GenericRecord>().fieldAt(0).value<std::string>(), shared);
+        BOOST_CHECK(encodeGenericDatum(sink) == encoded);
+    }
+
+    // Changing one copy leaves the others as they were.
+    GenericRecord &changed = sinks[0].value<GenericRecord>();
+    BOOST_CHECK(!sinks[0].isShared());
+    changed.fieldAt(1).value<GenericRecord>().fieldAt(0).value<GenericArray>().value()[1].value<std::string>() = "changed";
+    changed.fieldAt(3).value<int32_t>() = 8;
+    BOOST_CHECK(&changed.fieldAt(0).value<std::string>() != shared);
+    BOOST_CHECK(sinks[1].value<GenericRecord>().fieldAt(1).isShared());
+    BOOST_CHECK(encodeGenericDatum(sinks[1]) == encoded);
+    BOOST_CHECK(encodeGenericDatum(datum) == encoded);
+    BOOST_CHECK(encodeGenericDatum(sinks[0]) != encoded);
+    const GenericDatum &tags = static_cast<const GenericDatum &>(sinks[0]).value<GenericRecord>().fieldAt(1).value<GenericRecord>().fieldAt(0);
+    BOOST_CHECK_EQUAL(tags.value<GenericArray>().value()[0].value<std::string>(), "tag0");
+    BOOST_CHECK_EQUAL(tags.value<GenericArray>().value()[1].value<std::string>(), "changed");
+
+    // The shared values outlive the datum they came from.
+    datum = GenericDatum();
+    sinks.erase(sinks.begin());
+    BOOST_CHECK(encodeGenericDatum(sinks.back()) == encoded);
+}
+
+static void testUnionBranchChoice() {
+    ValidSchema writer = compileJsonSchemaFromString(
+        R"({"type": "record", "name": "R", "fields": [
+            {"name": "a", "type": "int"},
+            {"name": "b", "type": {"type": "record", "name": "S", "fields": [{"name": "x", "type": "int"}]}},
+            {"name": "c", "type": "float"},
+            {"name": "d", "type": "S"}
+        ]})");
+    ValidSchema reader = compileJsonSchemaFromString(
+        R"({"type": "record", "name": "R", "fields": [
+            {"name": "a", "type": ["string", "float", "long"]},
+            {"name": "b", "type": ["null", {"type": "record", "name": "T", "fields": [{"name": "x", "type": "int"}]},
+                                   {"type": "record", "name": "S", "fields": [{"name": "x", "type": "long"}]}]},
+            {"name": "c", "type": ["long", "double"]},
+            {"name": "d", "type": ["T", "S"]}
+        ]})");
+    OutputStreamPtr os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    for (int32_t v : {1, 2}) {
+        e->encodeInt(v);
+    }
+    e->encodeFloat(4.5f);
+    e->encodeInt(5);
+    e->flush();
+    std::vector<uint8_t> encoded = *snapshot(*os);
+
+    for (int compiled = 0; compiled < 2; ++compiled) {
+        InputStreamPtr is = memoryInputStream(encoded.data(), encoded.size());
+        DecoderPtr d = binaryDecoder();
+        d->init(*is);
+        GenericDatum result;
+        if (compiled) {
+            CompiledGenericReader(writer, reader, d).read(result);
+        } else {
+            GenericReader(writer, reader, d).read(result);
+        }
+        const GenericRecord &r = result.value<GenericRecord>();
+        BOOST_CHECK_EQUAL(r.fieldAt(0).unionBranch(), 1);
+        BOOST_CHECK_EQUAL(r.fieldAt(0).value<float>(), 1.0f);
+        BOOST_CHECK_EQUAL(r.fieldAt(1).unionBranch(), 2);
+        BOOST_CHECK_EQUAL(r.fieldAt(1).value<GenericRecord>().fieldAt(0).value<int64_t>(), 2);
+        BOOST_CHECK_EQUAL(r.fieldAt(2).unionBranch(), 1);
+        BOOST_CHECK_EQUAL(r.fieldAt(2).value<double>(), 4.5);
+        BOOST_CHECK_EQUAL(r.fieldAt(3).unionBranch(), 1);
+        BOOST_CHECK_EQUAL(r.fieldAt(3).value<GenericRecord>().fieldAt(0).value<int64_t>(), 5);
+    }
+}
+
+static void testCompiledDefaults() {
+    ValidSchema writer = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"i\", \"type\":\"int\"}"
+        "]}");
+    ValidSchema reader = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"z\", \"type\":\"null\", \"default\":null},"
+        "{\"name\":\"b\", \"type\":\"boolean\", \"default\":true},"
+        "{\"name\":\"i\", \"type\":\"int\"},"
+        "{\"name\":\"n\", \"type\":\"int\", \"default\":-3},"
+        "{\"name\":\"l\", \"type\":\"long\", \"default\":12345678901},"
+        "{\"name\":\"f\", \"type\":\"float\", \"default\":1.5},"
+        "{\"name\":\"d\", \"type\":\"double\", \"default\":-2.25},"
+        "{\"name\":\"s\", \"type\":\"string\", \"default\":\"none\"},"
+        "{\"name\":\"y\", \"type\":\"bytes\", \"default\":\"\\u0001\\u0002\"},"
+        "{\"name\":\"x\", \"type\":{\"type\":\"fixed\", \"name\":\"x\", \"size\":2}, \"default\":\"ab\"},"
+        "{\"name\":\"e\", \"type\":{\"type\":\"enum\", \"name\":\"e\", \"symbols\":[\"p\", \"q\"]}, \"default\":\"q\"},"
+        "{\"name\":\"a\", \"type\":{\"type\":\"array\", \"items\":\"int\"}, \"default\":[4, 5]}"
+        "]}");
+
+    OutputStreamPtr os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    e->encodeInt(7);
+    e->encodeInt(8);
+    e->flush();
+    std::vector<uint8_t> encoded = *snapshot(*os);
+
+    // Defaults of primitive types, enums and fixeds are constants of the
+    // program; the array still reads its encoded default.
+    InputStreamPtr is = memoryInputStream(encoded.data(), encoded.size());
+    DecoderPtr d = binaryDecoder();
+    d->init(*is);
+    CompiledGenericReader compiled(writer, reader, d);
+    InputStreamPtr is2 = memoryInputStream(encoded.data(), encoded.size());
+    DecoderPtr d2 = binaryDecoder();
+    d2->init(*is2);
+    GenericReader expected(writer, reader, d2);
+    for (int32_t i = 7; i <= 8; ++i) {
+        GenericDatum result;
+        compiled.read(result);
+        GenericDatum reference;
+        expected.read(reference);
+        BOOST_CHECK(encodeGenericDatum(result) == encodeGenericDatum(reference));
+        const GenericRecord &r = result.value<GenericRecord>();
+        BOOST_CHECK_EQUAL(r.field("b").value<bool>(), true);
+        BOOST_CHECK_EQUAL(r.field("i").value<int32_t>(), i);
+        BOOST_CHECK_EQUAL(r.field("n").value<int32_t>(), -3);
+        BOOST_CHECK_EQUAL(r.field("l").value<int64_t>(), 12345678901LL);
+        BOOST_CHECK_EQUAL(r.field("f").value<float>(), 1.5f);
+        BOOST_CHECK_EQUAL(r.field("d").value<double>(), -2.25);
+        BOOST_CHECK_EQUAL(r.field("s").value<std::string>(), "none");
+        BOOST_CHECK(r.field("y").value<std::vector<uint8_t>>() == std::vector<uint8_t>({1, 2}));
+        BOOST_CHECK(r.field("x").value<GenericFixed>().value() == std::vector<uint8_t>({'a', 'b'}));
+        BOOST_CHECK_EQUAL(r.field("e").value<GenericEnum>().symbol(), "q");
+        BOOST_CHECK_EQUAL(r.field("a").value<GenericArray>().value().size(), 2);
+    }
+}
+
+// Copies and moves d, which holds v, checking that copies are values of
+// their own and that a move keeps a value held behind a pointer in place.
+template<typename T>
+static void checkDatumCopies(const GenericDatum &d, const T &v, const T &other) {
+    GenericDatum copy(d);
+    BOOST_CHECK_EQUAL(copy.type(), d.type());
+    BOOST_CHECK(copy.value<T>() == v);
+    copy.value<T>() = other;
+    BOOST_CHECK(d.value<T>() == v);
+
+    GenericDatum assigned(std::string("another kind"));
+    assigned = d;
+    BOOST_CHECK_EQUAL(assigned.type(), d.type());
+    BOOST_CHECK(assigned.value<T>() == v);
+    assigned = copy;
+    BOOST_CHECK(assigned.value<T>() == other);
+    assigned = static_cast<const GenericDatum &>(assigned);
+    BOOST_CHECK(assigned.value<T>() == other);
+
+    const T *held = &copy.value<T>();
+    GenericDatum moved(std::move(copy));
+    BOOST_CHECK(moved.value<T>() == other);
+    GenericDatum moveAssigned(int64_t(1));
+    moveAssigned = std::move(moved);
+    BOOST_CHECK_EQUAL(moveAssigned.type(), d.type());
+    BOOST_CHECK(moveAssigned.value<T>() == other);
+    if (!detail::IsInlineDatumValue<T>::value) {
+        BOOST_CHECK_EQUAL(&moveAssigned.value<T>(), held);
+    }
+    BOOST_CHECK(d.value<T>() == v);
+}
+
+static void testDatumValues() {
+    // Held inline.
+    checkDatumCopies(GenericDatum(true), true, false);
+    checkDatumCopies(GenericDatum(int32_t(7)), int32_t(7), int32_t(-8));
+    checkDatumCopies(GenericDatum(int64_t(1) << 40), int64_t(1) << 40, int64_t(-9));
+    checkDatumCopies(GenericDatum(1.5f), 1.5f, -2.5f);
+    checkDatumCopies(GenericDatum(3.25), 3.25, -4.75);
+
+    // Held behind a pointer.
+    const std::string text(100, 's');
+    checkDatumCopies(GenericDatum(text), text, std::string("short"));
+    const std::vector<uint8_t> bytes = {1, 2, 3};
+    checkDatumCopies(GenericDatum(bytes), bytes, std::vector<uint8_t>(50, 4));
+
+    ValidSchema schema = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"l\", \"type\":\"long\"},"
+        "{\"name\":\"u\", \"type\":[\"null\", \"string\"]}"
+        "]}");
+    GenericDatum record(schema);
+    record.value<GenericRecord>().fieldAt(0).value<int64_t>() = 5;
+    record.value<GenericRecord>().fieldAt(1).selectBranch(1);
+    record.value<GenericRecord>().fieldAt(1).value<std::string>() = text;
+    const std::vector<uint8_t> encoded = encodeGenericDatum(record);
+
+    GenericDatum copy(record);
+    BOOST_CHECK(encodeGenericDatum(copy) == encoded);
+    copy.value<GenericRecord>().fieldAt(0).value<int64_t>() = 6;
+    copy.value<GenericRecord>().fieldAt(1).value<std::string>() = "changed";
+    BOOST_CHECK(encodeGenericDatum(record) == encoded);
+    GenericDatum assigned(3.0);
+    assigned = record;
+    BOOST_CHECK(encodeGenericDatum(assigned) == encoded);
+
+    const GenericRecord *held = &assigned.value<GenericRecord>();
+    GenericDatum moved(std::move(assigned));
+    BOOST_CHECK_EQUAL(&moved.value<GenericRecord>(), held);
+    GenericDatum moveAssigned(text);
+    moveAssigned = std::move(moved);
+    BOOST_CHECK_EQUAL(&moveAssigned.value<GenericRecord>(), held);
+    BOOST_CHECK(encodeGenericDatum(moveAssigned) == encoded);
+
+    // A union hands out the value of its branch.
+    const GenericDatum &branch = record.value<GenericRecord>().fieldAt(1);
+    BOOST_CHECK(branch.isUnion());
+    GenericDatum branchCopy(branch);
+    BOOST_CHECK_EQUAL(branchCopy.type(), AVRO_STRING);
+    BOOST_CHECK_EQUAL(branchCopy.value<std::string>(), text);
+
+    // Asking for the wrong type throws rather than reinterpreting the value.
+    BOOST_CHECK_THROW(GenericDatum(int64_t(1)).value<std::string>(), Exception);
+    BOOST_CHECK_THROW(GenericDatum(text).value<int64_t>(), Exception);
+    BOOST_CHECK_THROW(branch.value<int32_t>(), Exception);
+    BOOST_CHECK_THROW(record.value<GenericArray>(), Exception);
+}
+
+static void testDatumPrototype() {
+    ValidSchema schema = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"i\", \"type\":\"int\"},"
+        "{\"name\":\"s\", \"type\":\"string\"},"
+        "{\"name\":\"e\", \"type\":{\"type\":\"enum\", \"name\":\"e\", \"symbols\":[\"p\", \"q\"]}},"
+        "{\"name\":\"u\", \"type\":[\"null\", \"r\"]},"
+        "{\"name\":\"a\", \"type\":{\"type\":\"array\", \"items\":\"long\"}},"
+        "{\"name\":\"m\", \"type\":{\"type\":\"map\", \"values\":\"double\"}}"
+        "]}");
+    const std::vector<uint8_t> fresh = encodeGenericDatum(GenericDatum(schema));
+
+    GenericDatumPrototype prototype(schema);
+    GenericDatum datum = prototype.make();
+    BOOST_CHECK(encodeGenericDatum(datum) == fresh);
+
+    GenericRecord &r = datum.value<GenericRecord>();
+    r.fieldAt(0) = GenericDatum(int32_t(7));
+    r.fieldAt(1).value<std::string>() = std::string(100, 's');
+    r.fieldAt(2).value<GenericEnum>().set(1);
+    r.fieldAt(4).value<GenericArray>().value().push_back(GenericDatum(int64_t(1)));
+    r.fieldAt(5).value<GenericMap>().value().push_back(std::make_pair(std::string("k"), GenericDatum(1.0)));
+    const char *text = r.fieldAt(1).value<std::string>().data();
+    BOOST_CHECK(encodeGenericDatum(datum) != fresh);
+
+    prototype.reset(datum);
+    BOOST_CHECK(encodeGenericDatum(datum) == fresh);
+    // The string keeps its buffer.
+    r.fieldAt(1).value<std::string>().assign(50, 't');
+    BOOST_CHECK(r.fieldAt(1).value<std::string>().data() == text);
+
+    // A union on another branch is put back too.
+    r.fieldAt(3).selectBranch(1);
+    r.fieldAt(3).value<GenericRecord>().fieldAt(0) = GenericDatum(int32_t(3));
+    prototype.reset(datum);
+    BOOST_CHECK_EQUAL(r.fieldAt(3).unionBranch(), 0U);
+    BOOST_CHECK(encodeGenericDatum(datum) == fresh);
+}
+
+static void testLazyGenericRecord() {
+    ValidSchema schema = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"d\", \"type\":\"double\"},"
+        "{\"name\":\"f\", \"type\":{\"type\":\"fixed\", \"name\":\"f\", \"size\":3}},"
+        "{\"name\":\"s\", \"type\":\"string\"},"
+        "{\"name\":\"a\", \"type\":{\"type\":\"array\", \"items\":\"long\"}},"
+        "{\"name\":\"u\", \"type\":[\"null\", \"r\"]},"
+        "{\"name\":\"i\", \"type\":\"int\"}"
+        "]}");
+    GenericDatum datum(schema);
+    GenericRecord &r = datum.value<GenericRecord>();
+    r.fieldAt(0) = GenericDatum(2.5);
+    r.fieldAt(2) = GenericDatum(std::string("text"));
+    for (int64_t i = 0; i < 5; ++i) {
+        r.fieldAt(3).value<GenericArray>().value().push_back(GenericDatum(i));
+    }
+    r.fieldAt(4).selectBranch(1);
+    r.fieldAt(4).value<GenericRecord>().fieldAt(5) = GenericDatum(int32_t(8));
+    r.fieldAt(5) = GenericDatum(int32_t(-3));
+    const std::vector<uint8_t> encoded = encodeGenericDatum(datum);
+
+    LazyGenericRecord lazy(schema, encoded);
+    BOOST_CHECK_EQUAL(lazy.fieldCount(), 6U);
+    BOOST_CHECK(lazy.hasField("s"));
+    BOOST_CHECK(!lazy.hasField("x"));
+
+    // A field past the variable width ones, then one before it.
+    BOOST_CHECK_EQUAL(lazy.field("i").value<int32_t>(), -3);
+    BOOST_CHECK(!lazy.isDecoded(0));
+    BOOST_CHECK(!lazy.isDecoded(4));
+    BOOST_CHECK_EQUAL(lazy.field("s").value<std::string>(), "text");
+    BOOST_CHECK_EQUAL(lazy.field("d").value<double>(), 2.5);
+    BOOST_CHECK_EQUAL(lazy.field("u").value<GenericRecord>().field("i").value<int32_t>(), 8);
+    BOOST_CHECK(!lazy.isDecoded(3));
+
+    GenericDatum whole(schema.root(), lazy.record());
+    BOOST_CHECK(encodeGenericDatum(whole) == encoded);
+    BOOST_CHECK_THROW(lazy.field("x"), Exception);
+    BOOST_CHECK_THROW(lazy.fieldAt(6), Exception);
+}
+
+static void testHashDatum() {
+    ValidSchema schema = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"s\", \"type\":\"string\"},"
+        "{\"name\":\"m\", \"type\":{\"type\":\"map\", \"values\":\"int\"}}"
+        "]}");
+    GenericDatum a(schema);
+    a.value<GenericRecord>().fieldAt(0) = GenericDatum(std::string(100, 'x'));
+    a.value<GenericRecord>().fieldAt(1).value<GenericMap>().value().emplace_back(
+        "k", GenericDatum(int32_t(1)));
+    GenericDatum b(schema);
+    b.value<GenericRecord>().fieldAt(0) = GenericDatum(std::string(100, 'x'));
+
+    // A datum hashes as its encoding does.
+    std::vector<uint8_t> encoded = encodeGenericDatum(a);
+    BOOST_CHECK_EQUAL(hashDatum(a), hash64(encoded.data(), encoded.size()));
+    BOOST_CHECK_EQUAL(hashDatum(a, 7), hash64(encoded.data(), encoded.size(), 7));
+    BOOST_CHECK_NE(hashDatum(a), hashDatum(b));
+    b.value<GenericRecord>().fieldAt(1) = a.value<GenericRecord>().fieldAt(1);
+    BOOST_CHECK_EQUAL(std::hash<GenericDatum>()(a), std::hash<GenericDatum>()(b));
+}
+
+static std::string jsonOfDatum(const ValidSchema &schema, const GenericDatum &d) {
+    std::unique_ptr<OutputStream> out = memoryOutputStream();
+    EncoderPtr e = jsonEncoder(schema);
+    e->init(*out);
+    GenericWriter::write(*e, d);
+    e->flush();
+    std::shared_ptr<std::vector<uint8_t>> b = snapshot(*out);
+    return std::string(b->begin(), b->end());
+}
+
+static void testGenericJsonWriter() {
+    ValidSchema schema = compileJsonSchemaFromString(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"s\", \"type\":\"string\"},"
+        "{\"name\":\"q\\\"uoted\", \"type\":\"double\"},"
+        "{\"name\":\"f\", \"type\":\"float\"},"
+        "{\"name\":\"b\", \"type\":\"bytes\"},"
+        "{\"name\":\"e\", \"type\":{\"type\":\"enum\", \"name\":\"E\", \"symbols\":[\"A\", \"B\"]}},"
+        "{\"name\":\"a\", \"type\":{\"type\":\"array\", \"items\":\"long\"}},"
+        "{\"name\":\"m\", \"type\":{\"type\":\"map\", \"values\":\"boolean\"}},"
+        "{\"name\":\"u\", \"type\":[\"null\", \"int\", \"r\"]},"
+        "{\"name\":\"x\", \"type\":{\"type\":\"fixed\", \"name\":\"F\", \"size\":2}}"
+        "]}");
+    GenericDatum d(schema);
+    GenericRecord &r = d.value<GenericRecord>();
+    r.fieldAt(0) = GenericDatum(std::string("a \"b\"\n\xc3\xa9"));
+    r.fieldAt(1) = GenericDatum(-0.25);
+    r.fieldAt(2) = GenericDatum(std::numeric_limits<float>::infinity());
+    r.fieldAt(3) = GenericDatum(std::vector<uint8_t>{0, 'z', 0xff});
+    r.fieldAt(4).value<GenericEnum>().set(1);
+    r.fieldAt(5).value<GenericArray>().value().push_back(GenericDatum(int64_t(-3)));
+    r.fieldAt(5).value<GenericArray>().value().push_back(GenericDatum(int64_t(1) << 40));
+    r.fieldAt(6).value<GenericMap>().value().emplace_back("k/", GenericDatum(true));
+    r.fieldAt(7).selectBranch(2);
+    r.fieldAt(7).value<GenericRecord>().fieldAt(1) = GenericDatum(std::nan(""));
+    r.fieldAt(7).value<GenericRecord>().fieldAt(7).selectBranch(1);
+    r.fieldAt(7).value<GenericRecord>().fieldAt(7).value<int32_t>() = 12;
+
+    // The text is the JSON encoder's.
+    GenericJsonWriter writer(schema);
+    std::unique_ptr<OutputStream> out = memoryOutputStream(16);
+    writer.write(d, *out);
+    std::shared_ptr<std::vector<uint8_t>> b = snapshot(*out);
+    std::string expected = jsonOfDatum(schema, d);
+    BOOST_CHECK_EQUAL(std::string(b->begin(), b->end()), expected);
+
+    out = memoryOutputStream();
+    writer.writeArray(std::vector<GenericDatum>{d, d}, *out);
+    writer.writeArray(std::vector<GenericDatum>(), *out);
+    b = snapshot(*out);
+    BOOST_CHECK_EQUAL(std::string(b->begin(), b->end()), "[" + expected + "," + expected + "][]");
+
+    // A datum that is not of the schema is refused.
+    out = memoryOutputStream();
+    BOOST_CHECK_THROW(writer.write(GenericDatum(int32_t(1)), *out), Exception);
+    r.fieldAt(5).value<GenericArray>().value().push_back(GenericDatum(std::string("no")));
+    BOOST_CHECK_THROW(writer.write(d, *out), Exception);
+}
+
+static GenericDatum readJson(GenericJsonReader &reader, const ValidSchema &schema, const std::string &json) {
+    std::unique_ptr<InputStream> in = memoryInputStream(reinterpret_cast<const uint8_t *>(json.data()), json.size());
+    GenericDatum d(schema);
+    reader.read(*in, d);
+    return d;
+}
+
+static void testGenericJsonReader() {
+    ValidSchema schema = compileJsonSchemaFromString(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"s\", \"type\":\"string\"},"
+        "{\"name\":\"d\", \"type\":\"double\"},"
+        "{\"name\":\"b\", \"type\":\"bytes\"},"
+        "{\"name\":\"e\", \"type\":{\"type\":\"enum\", \"name\":\"E\", \"symbols\":[\"A\", \"B\", \"C\"]}},"
+        "{\"name\":\"a\", \"type\":{\"type\":\"array\", \"items\":\"long\"}},"
+        "{\"name\":\"m\", \"type\":{\"type\":\"map\", \"values\":\"int\"}},"
+        "{\"name\":\"u\", \"type\":[\"null\", \"string\", \"r\"]},"
+        "{\"name\":\"x\", \"type\":{\"type\":\"fixed\", \"name\":\"F\", \"size\":2}}"
+        "]}");
+    GenericJsonReader reader(schema);
+
+    // Fields may come in any order, and keys may be escaped.
+    GenericDatum d = readJson(reader, schema,
+                              "{\"x\":\"\\u0001\\u00ff\", \"u\":{\"string\":\"v\"}, \"\\u0073\":\"str\","
+                              " \"a\":[1, -2], \"d\":3, \"b\":\"z\", \"m\":{\"k\":7}, \"e\":\"C\"}");
+    const GenericRecord &r = d.value<GenericRecord>();
+    BOOST_CHECK_EQUAL(r.fieldAt(0).value<std::string>(), "str");
+    BOOST_CHECK_EQUAL(r.fieldAt(1).value<double>(), 3.0);
+    BOOST_CHECK(r.fieldAt(2).value<std::vector<uint8_t>>() == std::vector<uint8_t>(1, 'z'));
+    BOOST_CHECK_EQUAL(r.fieldAt(3).value<GenericEnum>().symbol(), "C");
+    BOOST_CHECK_EQUAL(r.fieldAt(4).value<GenericArray>().value().size(), 2);
+    BOOST_CHECK_EQUAL(r.fieldAt(4).value<GenericArray>().value()[1].value<int64_t>(), -2);
+    BOOST_CHECK_EQUAL(r.fieldAt(5).value<GenericMap>().value()[0].second.value<int32_t>(), 7);
+    BOOST_CHECK_EQUAL(r.fieldAt(6).unionBranch(), 1);
+    BOOST_CHECK_EQUAL(r.fieldAt(6).value<std::string>(), "v");
+    BOOST_CHECK(r.fieldAt(7).value<GenericFixed>().value() == (std::vector<uint8_t>{1, 0xff}));
+
+    // What the JSON writer writes reads back the same.
+    std::unique_ptr<OutputStream> out = memoryOutputStream();
+    GenericJsonWriter writer(schema);
+    GenericDatum nested(d);
+    nested.value<GenericRecord>().fieldAt(6).selectBranch(2);
+    nested.value<GenericRecord>().fieldAt(6).value<GenericRecord>() = d.value<GenericRecord>();
+    writer.write(nested, *out);
+    std::shared_ptr<std::vector<uint8_t>> b = snapshot(*out);
+    std::string json(b->begin(), b->end());
+    GenericDatum back = readJson(reader, schema, json);
+    out = memoryOutputStream();
+    writer.write(back, *out);
+    b = snapshot(*out);
+    BOOST_CHECK_EQUAL(std::string(b->begin(), b->end()), json);
+
+    // Fields in the order of the schema, as writers put them, read the
+    // same as out of order, and an out of order one after them is found.
+    const char *inOrder = "{\"s\":\"a\", \"d\":1, \"b\":\"\", \"e\":\"B\", \"a\":[4], \"m\":{}, \"u\":null, \"x\":\"ab\"}";
+    const char *shuffled = "{\"s\":\"a\", \"d\":1, \"e\":\"B\", \"x\":\"ab\", \"b\":\"\", \"a\":[4], \"m\":{}, \"u\":null}";
+    GenericDatum first = readJson(reader, schema, inOrder);
+    GenericDatum second = readJson(reader, schema, shuffled);
+    out = memoryOutputStream();
+    writer.write(first, *out);
+    std::unique_ptr<OutputStream> out2 = memoryOutputStream();
+    writer.write(second, *out2);
+    BOOST_CHECK(*snapshot(*out) == *snapshot(*out2));
+    BOOST_CHECK_EQUAL(first.value<GenericRecord>().fieldAt(3).value<GenericEnum>().symbol(), "B");
+
+    // Missing, repeated and unknown fields and symbols are refused.
+    BOOST_CHECK_THROW(readJson(reader, schema, "{\"s\":\"a\"}"), Exception);
+    std::string full = "\"d\":1, \"b\":\"\", \"e\":\"A\", \"a\":[], \"m\":{}, \"u\":null, \"x\":\"ab\"}";
+    BOOST_CHECK_NO_THROW(readJson(reader, schema, "{\"s\":\"a\", " + full));
+    BOOST_CHECK_THROW(readJson(reader, schema, "{\"s\":\"a\", \"s\":\"a\", " + full), Exception);
+    BOOST_CHECK_THROW(readJson(reader, schema, "{\"t\":\"a\", " + full), Exception);
+    BOOST_CHECK_THROW(readJson(reader, schema, "{\"s\":\"a\", " + full.replace(full.find("\"A\""), 3, "\"D\"")),
+                      Exception);
+}
+
+static void testTranscoder() {
+    ValidSchema writer = compileJsonSchemaFromString(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"id\", \"type\":\"long\"},"
+        "{\"name\":\"name\", \"type\":\"string\"},"
+        "{\"name\":\"gone\", \"type\":{\"type\":\"array\", \"items\":\"string\"}},"
+        "{\"name\":\"n\", \"type\":\"int\"},"
+        "{\"name\":\"e\", \"type\":{\"type\":\"enum\", \"name\":\"e\", \"symbols\":[\"a\", \"b\", \"c\"]}},"
+        "{\"name\":\"m\", \"type\":{\"type\":\"map\", \"values\":\"int\"}},"
+        "{\"name\":\"u\", \"type\":[\"null\", \"int\"]}"
+        "]}");
+    // Fields reordered, promoted, renumbered, dropped and added.
+    ValidSchema reader = compileJsonSchemaFromString(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"m\", \"type\":{\"type\":\"map\", \"values\":\"double\"}},"
+        "{\"name\":\"id\", \"type\":\"long\"},"
+        "{\"name\":\"name\", \"type\":\"string\"},"
+        "{\"name\":\"added\", \"type\":\"string\", \"default\":\"none\"},"
+        "{\"name\":\"n\", \"type\":\"float\"},"
+        "{\"name\":\"e\", \"type\":{\"type\":\"enum\", \"name\":\"e\", \"symbols\":[\"c\", \"a\"]}},"
+        "{\"name\":\"u\", \"type\":[\"long\", \"null\"]}"
+        "]}");
+
+    std::vector<uint8_t> data;
+    for (int64_t i = 0; i < 10; ++i) {
+        GenericDatum d(writer);
+        GenericRecord &r = d.value<GenericRecord>();
+        r.fieldAt(0) = GenericDatum(i * 1000003);
+        r.fieldAt(1) = GenericDatum(std::string(static_cast<size_t>(i), 'x'));
+        r.fieldAt(2).value<GenericArray>().value().emplace_back(std::string("dropped"));
+        r.fieldAt(3) = GenericDatum(static_cast<int32_t>(-i));
+        r.fieldAt(4).value<GenericEnum>().set(i % 2 == 0 ? "a" : "c");
+        r.fieldAt(5).value<GenericMap>().value().emplace_back("k", GenericDatum(static_cast<int32_t>(i)));
+        if (i % 3 == 0) {
+            r.fieldAt(6).selectBranch(1);
+            r.fieldAt(6).value<int32_t>() = static_cast<int32_t>(i);
+        }
+        std::vector<uint8_t> encoded = encodeGenericDatum(d);
+        data.insert(data.end(), encoded.begin(), encoded.end());
+    }
+
+    Transcoder transcoder(writer, reader);
+    std::vector<uint8_t> out;
+    InputStreamPtr is = memoryInputStream(data.data(), data.size());
+    DecoderPtr d = binaryDecoder();
+    d->init(*is);
+    GenericReader expected(writer, reader, d);
+    size_t pos = 0;
+    for (int64_t i = 0; i < 10; ++i) {
+        out.clear();
+        pos += transcoder.transcode(data.data() + pos, data.size() - pos, out);
+        GenericDatum reference;
+        expected.read(reference);
+        BOOST_CHECK(out == encodeGenericDatum(reference));
+        const GenericRecord &r = reference.value<GenericRecord>();
+        BOOST_CHECK_EQUAL(r.field("added").value<std::string>(), "none");
+        BOOST_CHECK_EQUAL(r.field("n").value<float>(), static_cast<float>(-i));
+    }
+    BOOST_CHECK_EQUAL(pos, data.size());
+
+    // The same schema is copied as it is.
+    out.clear();
+    for (pos = 0; pos < data.size();) {
+        pos += transcodeBinary(writer, writer, data.data() + pos, data.size() - pos, out);
+    }
+    BOOST_CHECK(out == data);
+
+    // A symbol the reader does not have is an error only when met.
+    ValidSchema narrow = compileJsonSchemaFromString(
+        "{\"type\":\"enum\", \"name\":\"e\", \"symbols\":[\"a\"]}");
+    ValidSchema wide = compileJsonSchemaFromString(
+        "{\"type\":\"enum\", \"name\":\"e\", \"symbols\":[\"a\", \"b\"]}");
+    Transcoder t(wide, narrow);
+    const uint8_t a[] = {0}, b[] = {2};
+    out.clear();
+    BOOST_CHECK_EQUAL(t.transcode(a, sizeof(a), out), 1);
+    BOOST_CHECK_THROW(t.transcode(b, sizeof(b), out), Exception);
+    BOOST_CHECK_THROW(t.transcode(b, 0, out), Exception);
+    BOOST_CHECK_THROW(Transcoder(narrow, writer).transcode(a, sizeof(a), out), Exception);
+}
+
+static void testFieldPathExtractor() {
+    ValidSchema schema = compileJsonSchemaFromString(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"x\", \"type\":\"double\"},"
+        "{\"name\":\"tags\", \"type\":{\"type\":\"array\", \"items\":\"string\"}},"
+        "{\"name\":\"header\", \"type\":{\"type\":\"record\",\"name\":\"h\",\"fields\":["
+        "{\"name\":\"f\", \"type\":\"float\"},"
+        "{\"name\":\"k\", \"type\":{\"type\":\"fixed\", \"name\":\"k\", \"size\":3}},"
+        "{\"name\":\"tenant_id\", \"type\":\"long\"},"
+        "{\"name\":\"region\", \"type\":\"string\"}]}},"
+        "{\"name\":\"extra\", \"type\":[\"null\", \"h\"]}"
+        "]}");
+    FieldPathExtractor tenant(schema, "header.tenant_id");
+    FieldPathExtractor region(schema, "header.region");
+    FieldPathExtractor extra(schema, "extra.tenant_id");
+    BOOST_CHECK_EQUAL(tenant.fieldSchema()->type(), AVRO_LONG);
+    BOOST_CHECK_THROW(FieldPathExtractor(schema, "header.nothing"), Exception);
+    BOOST_CHECK_THROW(FieldPathExtractor(schema, "x.y"), Exception);
+
+    std::vector<std::vector<uint8_t>> payloads;
+    for (int64_t i = 0; i < 4; ++i) {
+        GenericDatum d(schema);
+        GenericRecord &r = d.value<GenericRecord>();
+        r.fieldAt(0) = GenericDatum(1.5);
+        for (int64_t j = 0; j < i; ++j) {
+            r.fieldAt(1).value<GenericArray>().value().emplace_back(std::string("tag"));
+        }
+        GenericRecord &h = r.fieldAt(2).value<GenericRecord>();
+        h.fieldAt(2) = GenericDatum(i * 1000);
+        h.fieldAt(3) = GenericDatum(std::string("eu") + std::to_string(i));
+        if (i % 2 == 1) {
+            r.fieldAt(3).selectBranch(1);
+            r.fieldAt(3).value<GenericRecord>().fieldAt(2) = GenericDatum(-i);
+        }
+        payloads.push_back(encodeGenericDatum(d));
+    }
+
+    std::vector<const uint8_t *> data;
+    std::vector<size_t> lengths;
+    for (const std::vector<uint8_t> &v : payloads) {
+        data.push_back(v.data());
+        lengths.push_back(v.size());
+    }
+    std::vector<FieldSpan> spans(payloads.size());
+    tenant.find(data.data(), lengths.data(), data.size(), spans.data());
+    for (int64_t i = 0; i < 4; ++i) {
+        const std::vector<uint8_t> &v = payloads[i];
+        BOOST_CHECK(std::vector<uint8_t>(spans[i].data, spans[i].data + spans[i].size)
+                    == encodeGenericDatum(GenericDatum(i * 1000)));
+
+        GenericDatum value;
+        BOOST_REQUIRE(region.extract(v.data(), v.size(), value));
+        BOOST_CHECK_EQUAL(value.value<std::string>(), std::string("eu") + std::to_string(i));
+        FieldSpan e = extra.find(v.data(), v.size());
+        if (i % 2 == 1) {
+            BOOST_REQUIRE(extra.extract(v.data(), v.size(), value));
+            BOOST_CHECK_EQUAL(value.value<int64_t>(), -i);
+        } else {
+            BOOST_CHECK(e.data == nullptr);
+            BOOST_CHECK(!extra.extract(v.data(), v.size(), value));
+        }
+        BOOST_CHECK_THROW(region.find(v.data(), v.size() / 2), Exception);
+
+        // Replacing a field leaves the rest as it was.
+        std::vector<uint8_t> patched;
+        BOOST_REQUIRE(region.patch(v.data(), v.size(), GenericDatum(std::string("somewhere else")), patched));
+        GenericDatum d(schema);
+        InputStreamPtr is = memoryInputStream(patched.data(), patched.size());
+        DecoderPtr dec = binaryDecoder();
+        dec->init(*is);
+        GenericReader::read(*dec, d, schema);
+        BOOST_CHECK_EQUAL(is->byteCount(), patched.size());
+        GenericRecord &r = d.value<GenericRecord>();
+        BOOST_CHECK_EQUAL(r.fieldAt(2).value<GenericRecord>().fieldAt(3).value<std::string>(), "somewhere else");
+        r.fieldAt(2).value<GenericRecord>().fieldAt(3) = GenericDatum(std::string("eu") + std::to_string(i));
+        BOOST_CHECK(encodeGenericDatum(d) == v);
+
+        std::vector<uint8_t> inPlace = v;
+        for (int64_t t : {i * 1000 + 1, int64_t(1) << 40, int64_t(0), i * 1000}) {
+            std::vector<uint8_t> encoded = encodeGenericDatum(GenericDatum(t));
+            BOOST_REQUIRE(tenant.patchInPlace(inPlace, encoded.data(), encoded.size()));
+            BOOST_REQUIRE(tenant.extract(inPlace.data(), inPlace.size(), value));
+            BOOST_CHECK_EQUAL(value.value<int64_t>(), t);
+        }
+        BOOST_CHECK(inPlace == v);
+        patched.clear();
+        BOOST_CHECK_EQUAL(extra.patch(v.data(), v.size(), GenericDatum(int64_t(5)), patched), i % 2 == 1);
+        BOOST_CHECK_EQUAL(patched.empty(), i % 2 == 0);
+    }
+}
+
+static void testCompareBinary() {
+    const char *json =
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"k\", \"type\":\"string\"},"
+        "{\"name\":\"n\", \"type\":\"int\", \"order\":\"descending\"},"
+        "{\"name\":\"x\", \"type\":\"double\", \"order\":\"ignore\"},"
+        "{\"name\":\"a\", \"type\":{\"type\":\"array\", \"items\":\"long\"}},"
+        "{\"name\":\"u\", \"type\":[\"null\", \"float\"]},"
+        "{\"name\":\"m\", \"type\":{\"type\":\"map\", \"values\":\"int\"}, \"order\":\"ignore\"}"
+        "]}";
+    ValidSchema schema = compileJsonSchemaFromString(json);
+    BOOST_CHECK_EQUAL(schema.root()->fieldOrderAt(1), ORDER_DESCENDING);
+    BOOST_CHECK_EQUAL(schema.root()->fieldOrderAt(2), ORDER_IGNORE);
+    BOOST_CHECK_EQUAL(schema.root()->fieldOrderAt(3), ORDER_ASCENDING);
+    // The orders survive printing the schema, but not its canonical form.
+    ValidSchema reparsed = compileJsonSchemaFromString(schema.toJson());
+    BOOST_CHECK_EQUAL(reparsed.root()->fieldOrderAt(1), ORDER_DESCENDING);
+    BOOST_CHECK(schema.canonicalForm().find("order") == std::string::npos);
+    BOOST_CHECK_THROW(compileJsonSchemaFromString(
+                          "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+                          "{\"name\":\"k\", \"type\":\"int\", \"order\":\"up\"}]}"),
+                      Exception);
+
+    auto make = [&](const std::string &k, int32_t n, double x,
+                    std::vector<int64_t> a, bool hasU, float u) {
+        GenericDatum d(schema);
+        GenericRecord &r = d.value<GenericRecord>();
+        r.fieldAt(0) = GenericDatum(k);
+        r.fieldAt(1) = GenericDatum(n);
+        r.fieldAt(2) = GenericDatum(x);
+        for (int64_t v : a) {
+            r.fieldAt(3).value<GenericArray>().value().emplace_back(v);
+        }
+        if (hasU) {
+            r.fieldAt(4).selectBranch(1);
+            r.fieldAt(4).value<float>() = u;
+        }
+        r.fieldAt(5).value<GenericMap>().value().emplace_back(
+            std::to_string(n), GenericDatum(int32_t(x)));
+        return encodeGenericDatum(d);
+    };
+
+    BinaryComparator cmp(schema);
+    auto check = [&](const std::vector<uint8_t> &a,
+                     const std::vector<uint8_t> &b, int expected) {
+        int r = cmp.compare(a.data(), a.size(), b.data(), b.size());
+        BOOST_CHECK_EQUAL((r > 0) - (r < 0), expected);
+        r = cmp.compare(b.data(), b.size(), a.data(), a.size());
+        BOOST_CHECK_EQUAL((r > 0) - (r < 0), -expected);
+    };
+    std::vector<uint8_t> base = make("b", 5, 1.0, {1, 2}, true, 1.5f);
+    check(base, base, 0);
+    check(base, make("b", 5, 9.0, {1, 2}, true, 1.5f), 0);
+    check(base, make("c", 5, 1.0, {1, 2}, true, 1.5f), -1);
+    check(base, make("bb", 5, 1.0, {1, 2}, true, 1.5f), -1);
+    check(base, make("\xff", 5, 1.0, {1, 2}, true, 1.5f), -1);
+    check(base, make("b", 4, 1.0, {1, 2}, true, 1.5f), -1);
+    check(base, make("b", -6, 1.0, {1, 2}, true, 1.5f), -1);
+    check(base, make("b", 5, 1.0, {1, 3}, true, 1.5f), -1);
+    check(base, make("b", 5, 1.0, {1, 2, 0}, true, 1.5f), -1);
+    check(base, make("b", 5, 1.0, {-1, 2, 0}, true, 1.5f), 1);
+    check(base, make("b", 5, 1.0, {1, 2}, false, 0.0f), 1);
+    check(base, make("b", 5, 1.0, {1, 2}, true, -2.0f), 1);
+    check(make("b", 5, 1.0, {}, true, -0.0f), make("b", 5, 1.0, {}, true, 0.0f), -1);
+    check(make("b", 5, 1.0, {}, true, std::numeric_limits<float>::quiet_NaN()),
+          make("b", 5, 1.0, {}, true, std::numeric_limits<float>::infinity()), 1);
+
+    // Arrays compare item by item, however the writer split them into
+    // blocks: [1, 2] in blocks of one item each, with their sizes.
+    const uint8_t blocked[] = {2, 'b', 10, 0, 0, 0, 0, 0, 0, 0xf0, 0x3f,
+                               1, 2, 2, 1, 2, 4, 0,
+                               2, 0, 0, 0xc0, 0x3f, 2, 2, '5', 2, 0};
+    BOOST_CHECK_EQUAL(cmp.compare(blocked, sizeof(blocked), base.data(), base.size()), 0);
+    BOOST_CHECK(std::vector<uint8_t>(blocked, blocked + sizeof(blocked)) != base);
+    BOOST_CHECK_THROW(cmp.compare(base.data(), 3, base.data(), base.size()), Exception);
+
+    // Maps that are compared at all throw.
+    ValidSchema mapSchema = compileJsonSchemaFromString(
+        "{\"type\":\"map\", \"values\":\"int\"}");
+    const uint8_t emptyMap[] = {0};
+    BOOST_CHECK_THROW(compareBinary(mapSchema, emptyMap, 1, emptyMap, 1), Exception);
+
+    // Sorting the encodings sorts by the keys of the schema.
+    std::vector<std::vector<uint8_t>> data;
+    std::vector<std::pair<std::string, int32_t>> keys;
+    boost::mt19937 rnd(3);
+    for (int i = 0; i < 200; ++i) {
+        std::string k(1, static_cast<char>('a' + rnd() % 4));
+        int32_t n = static_cast<int32_t>(rnd() % 10) - 5;
+        data.push_back(make(k, n, double(rnd() % 100), {}, false, 0.0f));
+        keys.emplace_back(k, -n);
+    }
+    std::sort(data.begin(), data.end(), cmp);
+    std::sort(keys.begin(), keys.end());
+    for (size_t i = 0; i < data.size(); ++i) {
+        std::vector<uint8_t> expected = make(keys[i].first, -keys[i].second, 0.0, {}, false, 0.0f);
+        BOOST_CHECK_EQUAL(cmp.compare(data[i].data(), data[i].size(), expected.data(), expected.size()), 0);
+    }
+}
+
+// Decodes code points one by one, checking each against its shortest form.
+static bool referenceUtf8(const std::string &s) {
+    size_t i = 0;
+    while (i < s.size()) {
+        auto b = static_cast<uint8_t>(s[i]);
+        size_t n = b < 0x80 ? 1 : (b & 0xE0) == 0xC0 ? 2
+            : (b & 0xF0) == 0xE0                     ? 3
+            : (b & 0xF8) == 0xF0                     ? 4
+                                                     : 0;
+        if (n == 0 || i + n > s.size()) {
+            return false;
+        }
+        uint32_t c = n == 1 ? b : b & (0x7F >> n);
+        for (size_t j = 1; j < n; ++j) {
+            auto t = static_cast<uint8_t>(s[i + j]);
+            if ((t & 0xC0) != 0x80) {
+                return false;
+            }
+            c = (c << 6) | (t & 0x3F);
+        }
+        const uint32_t least[] = {0, 0, 0x80, 0x800, 0x10000};
+        if (c < least[n] || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) {
+            return false;
+        }
+        i += n;
+    }
+    return true;
+}
+
+static void testUtf8() {
+    const char *samples[] = {
+        "", "a", "\x7f", "\xc2\x80", "\xdf\xbf", "\xe0\xa0\x80", "\xed\x9f\xbf",
+        "\xee\x80\x80", "\xef\xbf\xbf", "\xf0\x90\x80\x80", "\xf4\x8f\xbf\xbf",
+        // Overlong, surrogates, too large, stray and cut short.
+        "\xc0\x80", "\xc1\xbf", "\xe0\x9f\xbf", "\xed\xa0\x80", "\xed\xbf\xbf",
+        "\xf0\x8f\xbf\xbf", "\xf4\x90\x80\x80", "\xf5\x80\x80\x80", "\xff", "\x80",
+        "\xbf\x80", "\xc2", "\xe0\xa0", "\xf0\x90\x80", "\xc2\xc2\x80", "\xe0\x80\x80\x80"};
+    for (const char *sample : samples) {
+        // At every position across the sixteen byte blocks.
+        for (size_t before = 0; before < 40; ++before) {
+            for (size_t after : {size_t(0), size_t(1), size_t(17)}) {
+                std::string s = std::string(before, 'x') + sample + std::string(after, 'y');
+                BOOST_CHECK_MESSAGE(isValidUtf8(s.data(), s.size()) == referenceUtf8(s),
+                                    "sample " << sample << " after " << before << " bytes");
+            }
+        }
+    }
+    boost::mt19937 rng(7);
+    const uint8_t interesting[] = {'a', 0x7f, 0x80, 0x8f, 0x90, 0x9f, 0xa0, 0xbf, 0xc0, 0xc2,
+                                   0xdf, 0xe0, 0xed, 0xef, 0xf0, 0xf4, 0xf5, 0xff};
+    for (int i = 0; i < 20000; ++i) {
+        std::string s(rng() % 70, 'a');
+        for (char &c : s) {
+            c = static_cast<char>(interesting[rng() % sizeof(interesting)]);
+        }
+        BOOST_CHECK_EQUAL(isValidUtf8(s.data(), s.size()), referenceUtf8(s));
+    }
+
+    // Decoders check only when asked to.
+    ValidSchema schema = parsing::makeValidSchema("{\"type\":\"array\", \"items\":\"string\"}");
+    std::vector<std::string> strings = {"ok", "caf\xc3\xa9", std::string(20, 'z') + "\xed\xa0\x80"};
+    std::unique_ptr<OutputStream> out = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*out);
+    avro::encode(*e, strings);
+    e->flush();
+    for (int kind = 0; kind < 3; ++kind) {
+        DecoderPtr d = kind == 0 ? binaryDecoder()
+            : kind == 1          ? resolvingDecoder(schema, schema, binaryDecoder())
+                                 : validatingDecoder(schema, binaryDecoder());
+        for (bool validate : {false, true}) {
+            d->setUtf8Validation(validate);
+            std::unique_ptr<InputStream> in = memoryInputStream(*out);
+            d->init(*in);
+            std::vector<std::string> decoded;
+            if (validate) {
+                BOOST_CHECK_THROW(avro::decode(*d, decoded), Exception);
+            } else {
+                avro::decode(*d, decoded);
+                BOOST_CHECK(decoded == strings);
+            }
+        }
+    }
+    DecoderPtr d = jsonDecoder(schema);
+    d->setUtf8Validation(true);
+    const std::string json = "[\"ok\", \"\\ud800\"]";
+    std::unique_ptr<InputStream> in = memoryInputStream(reinterpret_cast<const uint8_t *>(json.data()), json.size());
+    d->init(*in);
+    std::vector<std::string> decoded;
+    BOOST_CHECK_THROW(avro::decode(*d, decoded), Exception);
+}
+
+static void testValidateBinaryFailures() {
+    ValidSchema schema = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"b\", \"type\":\"boolean\"},"
+        "{\"name\":\"i\", \"type\":\"int\"},"
+        "{\"name\":\"e\", \"type\":{\"type\":\"enum\", \"name\":\"e\", \"symbols\":[\"x\", \"y\"]}},"
+        "{\"name\":\"u\", \"type\":[\"null\", \"string\"]},"
+        "{\"name\":\"a\", \"type\":{\"type\":\"array\", \"items\":\"long\"}}"
+        "]}");
+    BinaryValidator validator(schema);
+
+    // true, 1, y, "ab", an array in one block of two items given with its
+    // size, then a second datum.
+    const uint8_t good[] = {1, 2, 2, 2, 4, 'a', 'b', 3, 4, 4, 6, 0,
+                            0, 0, 0, 0, 0};
+    InputStreamPtr is = memoryInputStream(good, sizeof(good));
+    validator.validate(*is);
+    BOOST_CHECK_EQUAL(is->byteCount(), 12);
+    validator.validate(*is);
+    BOOST_CHECK_EQUAL(is->byteCount(), sizeof(good));
+    BOOST_CHECK_THROW(validator.validate(*is), Exception);
+
+    const uint8_t badBool[] = {2, 2, 2, 2, 4, 'a', 'b', 0};
+    const uint8_t badInt[] = {1, 0x80, 0x80, 0x80, 0x80, 0x10, 2, 0, 0};
+    const uint8_t badEnum[] = {1, 2, 4, 0, 0};
+    const uint8_t negativeEnum[] = {1, 2, 1, 0, 0};
+    const uint8_t badBranch[] = {1, 2, 2, 4, 0};
+    const uint8_t badLength[] = {1, 2, 2, 2, 3, 0};
+    const uint8_t truncated[] = {1, 2, 2, 2, 8, 'a', 'b'};
+    const uint8_t shortArray[] = {1, 2, 2, 0, 4, 2};
+    const struct {
+        const uint8_t *data;
+        size_t len;
+    } bad[] = {
+        {badBool, sizeof(badBool)},
+        {badInt, sizeof(badInt)},
+        {badEnum, sizeof(badEnum)},
+        {negativeEnum, sizeof(negativeEnum)},
+        {badBranch, sizeof(badBranch)},
+        {badLength, sizeof(badLength)},
+        {truncated, sizeof(truncated)},
+        {shortArray, sizeof(shortArray)},
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+        BOOST_TEST_CHECKPOINT("bad datum " << i);
+        InputStreamPtr in = memoryInputStream(bad[i].data, bad[i].len);
+        BOOST_CHECK_THROW(validateBinary(schema, *in), Exception);
+    }
+
+    // The same faults, told of without exceptions.
+    const struct {
+        DecodeStatus::Code code;
+        size_t offset;
+        int64_t value;
+    } expected[] = {
+        {DecodeStatus::badBool, 0, 2},
+        {DecodeStatus::badInt, 1, INT64_C(1) << 31},
+        {DecodeStatus::badEnum, 2, 2},
+        {DecodeStatus::badEnum, 2, -1},
+        {DecodeStatus::badUnion, 3, 2},
+        {DecodeStatus::badLength, 4, -2},
+        {DecodeStatus::truncated, 4, 0},
+        {DecodeStatus::truncated, 6, 0},
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+        BOOST_TEST_CHECKPOINT("bad datum " << i);
+        InputStreamPtr in = memoryInputStream(bad[i].data, bad[i].len);
+        DecodeStatus s = validator.tryValidate(*in);
+        BOOST_CHECK(!s);
+        BOOST_CHECK_EQUAL(s.code, expected[i].code);
+        BOOST_CHECK_EQUAL(s.offset, expected[i].offset);
+        BOOST_CHECK_EQUAL(s.value, expected[i].value);
+        BOOST_CHECK(!s.message().empty());
+    }
+    InputStreamPtr in = memoryInputStream(good, sizeof(good));
+    BOOST_CHECK(validator.tryValidate(*in));
+    BOOST_CHECK_EQUAL(in->byteCount(), 12);
+
+    // Decoding is all or nothing.
+    BinaryValidator strings(parsing::makeValidSchema("\"string\""));
+    std::string str = "unchanged";
+    const uint8_t goodString[] = {4, 'a', 'b'};
+    const uint8_t shortString[] = {8, 'a', 'b'};
+    DecodeStatus s = strings.tryDecode(shortString, sizeof(shortString), str);
+    BOOST_CHECK_EQUAL(s.code, DecodeStatus::truncated);
+    BOOST_CHECK_EQUAL(s.offset, 0);
+    BOOST_CHECK_EQUAL(str, "unchanged");
+    BOOST_CHECK(strings.tryDecode(goodString, sizeof(goodString), str));
+    BOOST_CHECK_EQUAL(str, "ab");
+}
+
+static std::map<std::string, DecodeCost> costsByPath(const DecodeProfile &profile) {
+    std::map<std::string, DecodeCost> result;
+    for (const DecodeCost &c : profile.costs()) {
+        result[c.path] = c;
+    }
+    return result;
+}
+
+static void testDecodeProfile() {
+    ValidSchema schema = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"id\", \"type\":\"long\"},"
+        "{\"name\":\"name\", \"type\":\"string\"},"
+        "{\"name\":\"tags\", \"type\":{\"type\":\"array\",\"items\":\"string\"}},"
+        "{\"name\":\"attrs\", \"type\":{\"type\":\"map\",\"values\":\"int\"}},"
+        "{\"name\":\"opt\", \"type\":[\"null\",{\"type\":\"record\",\"name\":\"inner\",\"fields\":["
+        "{\"name\":\"x\", \"type\":\"double\"},{\"name\":\"empty\", \"type\":{\"type\":\"record\",\"name\":\"e\",\"fields\":[]}}]}]},"
+        "{\"name\":\"last\", \"type\":\"boolean\"}"
+        "]}");
+    const char *json[] = {
+        "{\"id\":1,\"name\":\"first\",\"tags\":[\"a\",\"bb\"],\"attrs\":{\"k\":1},\"opt\":null,\"last\":true}",
+        "{\"id\":-300,\"name\":\"the second one, longer than a short string\",\"tags\":[],\"attrs\":{},"
+        "\"opt\":{\"inner\":{\"x\":1.5,\"empty\":{}}},\"last\":false}",
+    };
+
+    // JSON into datums, profiled.
+    DecodeProfilePtr jsonProfile = std::make_shared<DecodeProfile>();
+    std::vector<GenericDatum> datums;
+    for (const char *j : json) {
+        InputStreamPtr is = memoryInputStream(reinterpret_cast<const uint8_t *>(j), strlen(j));
+        DecoderPtr d = profilingDecoder(schema, jsonDecoder(schema), jsonProfile, 1);
+        d->init(*is);
+        datums.emplace_back(schema);
+        GenericReader::read(*d, datums.back(), schema);
+    }
+
+    OutputStreamPtr os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    for (const GenericDatum &datum : datums) {
+        GenericWriter::write(*e, datum, schema);
+    }
+    e->flush();
+    const uint64_t encoded = os->byteCount();
+
+    // The binary encoding of the same, which must cost the same bytes.
+    DecodeProfilePtr profile = std::make_shared<DecodeProfile>();
+    {
+        InputStreamPtr is = memoryInputStream(*os);
+        DecoderPtr d = profilingDecoder(schema, binaryDecoder(), profile, 1);
+        d->init(*is);
+        for (const GenericDatum &expected : datums) {
+            GenericDatum datum(schema);
+            GenericReader::read(*d, datum, schema);
+            BOOST_CHECK_EQUAL(datum.value<GenericRecord>().field("name").value<std::string>(),
+                              expected.value<GenericRecord>().field("name").value<std::string>());
+        }
+    }
+    std::map<std::string, DecodeCost> costs = costsByPath(*profile);
+    uint64_t bytes = 0;
+    for (const DecodeCost &c : profile->costs()) {
+        bytes += c.bytes;
+        BOOST_CHECK(c.samples != 0);
+    }
+    BOOST_CHECK_EQUAL(bytes, encoded);
+    BOOST_CHECK_EQUAL(costs["id"].values, 2U);
+    BOOST_CHECK_EQUAL(costs["id"].bytes, 1U + 2U);
+    BOOST_CHECK_EQUAL(costs["name"].bytes, 6U + 43U);
+    BOOST_CHECK_EQUAL(costs["tags[]"].values, 2U);
+    BOOST_CHECK_EQUAL(costs["tags[]"].bytes, 2U + 3U);
+    BOOST_CHECK_EQUAL(costs["attrs{}"].values, 1U);
+    BOOST_CHECK_EQUAL(costs["opt.x"].values, 1U);
+    BOOST_CHECK_EQUAL(costs["last"].values, 2U);
+    BOOST_CHECK(costs.find("") == costs.end());
+    BOOST_CHECK(costsByPath(*jsonProfile)["name"].bytes == costs["name"].bytes);
+
+    // Resolving to a reader without the tags, and the name moved last.
+    ValidSchema reader = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"id\", \"type\":\"long\"},"
+        "{\"name\":\"attrs\", \"type\":{\"type\":\"map\",\"values\":\"long\"}},"
+        "{\"name\":\"opt\", \"type\":[\"null\",{\"type\":\"record\",\"name\":\"inner\",\"fields\":["
+        "{\"name\":\"x\", \"type\":\"double\"},{\"name\":\"empty\", \"type\":{\"type\":\"record\",\"name\":\"e\",\"fields\":[]}}]}]},"
+        "{\"name\":\"last\", \"type\":\"boolean\"},"
+        "{\"name\":\"name\", \"type\":\"string\"}"
+        "]}");
+    DecodeProfilePtr resolved = std::make_shared<DecodeProfile>();
+    {
+        InputStreamPtr is = memoryInputStream(*os);
+        DecoderPtr d = profilingDecoder(reader, resolvingDecoder(schema, reader, binaryDecoder()), resolved);
+        BOOST_CHECK(dynamic_cast<ResolvingDecoder *>(d.get()) != nullptr);
+        d->init(*is);
+        for (size_t i = 0; i < datums.size(); ++i) {
+            GenericDatum datum(reader);
+            GenericReader::read(*d, datum, reader);
+            BOOST_CHECK_EQUAL(datum.value<GenericRecord>().field("name").value<std::string>(),
+                              datums[i].value<GenericRecord>().field("name").value<std::string>());
+        }
+    }
+    std::map<std::string, DecodeCost> r = costsByPath(*resolved);
+    BOOST_CHECK(r.find("tags[]") == r.end());
+    BOOST_CHECK_EQUAL(r["name"].bytes, costs["name"].bytes);
+    BOOST_CHECK_EQUAL(r["attrs{}"].values, 1U);
+    BOOST_CHECK_EQUAL(r["last"].values, 2U);
+
+    profile->merge(*resolved);
+    BOOST_CHECK_EQUAL(costsByPath(*profile)["name"].values, 4U);
+    std::ostringstream report;
+    profile->report(report, 3);
+    std::string table = report.str();
+    BOOST_CHECK_EQUAL(std::count(table.begin(), table.end(), '\n'), 4);
+    profile->clear();
+    BOOST_CHECK(profile->costs().empty());
+}
+
+static void testJsonEnumLookup() {
+    const size_t count = 3000;
+    std::ostringstream oss;
+    oss << "{\"type\":\"enum\",\"name\":\"code\",\"symbols\":[";
+    for (size_t i = 0; i < count; ++i) {
+        oss << (i == 0 ? "" : ",") << "\"S" << i << "\"";
+    }
+    oss << "]}";
+    ValidSchema schema = parsing::makeValidSchema(oss.str().c_str());
+
+    const size_t picks[] = {0, 1, count / 2, count - 1, 17, 0};
+    OutputStreamPtr os = memoryOutputStream();
+    EncoderPtr e = jsonEncoder(schema);
+    e->init(*os);
+    for (size_t p : picks) {
+        e->encodeEnum(p);
+    }
+    e->flush();
+
+    InputStreamPtr is = memoryInputStream(*os);
+    DecoderPtr d = jsonDecoder(schema);
+    d->init(*is);
+    for (size_t p : picks) {
+        BOOST_CHECK_EQUAL(d->decodeEnum(), p);
+    }
+
+    const char unknown[] = "\"S3000\"";
+    is = memoryInputStream(reinterpret_cast<const uint8_t *>(unknown), sizeof(unknown) - 1);
+    d = jsonDecoder(schema);
+    d->init(*is);
+    BOOST_CHECK_THROW(d->decodeEnum(), Exception);
+}
+
+static void testCodecPools() {
+    ValidSchema schema = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"a\", \"type\":\"long\"},"
+        "{\"name\":\"b\", \"type\":\"string\"}"
+        "]}");
+    ValidSchema reader = parsing::makeValidSchema(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"a\", \"type\":\"double\"}"
+        "]}");
+
+    EncoderPool encoders(schema, 2);
+    OutputStreamPtr os = memoryOutputStream();
+    Encoder *first;
+    {
+        EncoderPtr e = encoders.acquire();
+        first = e.get();
+        e->init(*os);
+        // Abandoned in the middle of a record.
+        e->encodeLong(1);
+    }
+    BOOST_CHECK_EQUAL(encoders.idle(), 1U);
+    {
+        EncoderPtr e = encoders.acquire();
+        BOOST_CHECK_EQUAL(e.get(), first);
+        BOOST_CHECK_EQUAL(encoders.idle(), 0U);
+        os = memoryOutputStream();
+        e->init(*os);
+        e->encodeLong(7);
+        e->encodeString("x");
+        e->encodeLong(8);
+        e->encodeString("y");
+        e->flush();
+    }
+
+    DecoderPool decoders(schema, 2);
+    const Decoder *firstDecoder;
+    {
+        InputStreamPtr is = memoryInputStream(*os);
+        DecoderPtr d = decoders.acquire();
+        firstDecoder = d.get();
+        d->init(*is);
+        BOOST_CHECK_EQUAL(d->decodeLong(), 7);
+    }
+    {
+        InputStreamPtr is = memoryInputStream(*os);
+        DecoderPtr d = decoders.acquire();
+        BOOST_CHECK_EQUAL(d.get(), firstDecoder);
+        d->init(*is);
+        BOOST_CHECK_EQUAL(d->decodeLong(), 7);
+        BOOST_CHECK_EQUAL(d->decodeString(), "x");
+        BOOST_CHECK_EQUAL(d->decodeLong(), 8);
+        BOOST_CHECK_EQUAL(d->decodeString(), "y");
+    }
+
+    // Only capacity codecs are kept.
+    {
+        DecoderPtr d1 = decoders.acquire();
+        DecoderPtr d2 = decoders.acquire();
+        DecoderPtr d3 = decoders.acquire();
+        BOOST_CHECK(d1 != d2 && d2 != d3 && d1 != d3);
+    }
+    BOOST_CHECK_EQUAL(decoders.idle(), 2U);
+
+    ResolvingDecoderPool resolvers(schema, reader);
+    for (int i = 0; i < 2; ++i) {
+        InputStreamPtr is = memoryInputStream(*os);
+        ResolvingDecoderPtr d = resolvers.acquire();
+        d->init(*is);
+        d->fieldOrder();
+        BOOST_CHECK_EQUAL(d->decodeDouble(), 7.0);
+        d->fieldOrder();
+        BOOST_CHECK_EQUAL(d->decodeDouble(), 8.0);
+    }
+    BOOST_CHECK_EQUAL(resolvers.idle(), 1U);
+
+    // Codecs outliving their pool are freed.
+    DecoderPtr orphan;
+    {
+        DecoderPool pool;
+        orphan = pool.acquire();
+    }
+    orphan.reset();
+}
+
 } // namespace avro
 
 boost::unit_test::test_suite *
@@ -1803,6 +4456,40 @@ init_unit_test_suite(int argc, char *argv[]) {
                                   ENDOF(avro::jsonData)));
     ts->add(BOOST_TEST_CASE(avro::testJsonCodecReinit));
     ts->add(BOOST_TEST_CASE(avro::testByteCount));
+    ts->add(BOOST_TEST_CASE(avro::testVarintBoundaries));
+    ts->add(BOOST_TEST_CASE(avro::testBlockingEncoder));
+    ts->add(BOOST_TEST_CASE(avro::testResolvingBulkArrays));
+    ts->add(BOOST_TEST_CASE(avro::testStringView));
+    ts->add(BOOST_TEST_CASE(avro::testResolvingDecoderCache));
+    ts->add(BOOST_TEST_CASE(avro::testValidatingCodecCache));
+    ts->add(BOOST_TEST_CASE(avro::testProjectionSkip));
+    ts->add(BOOST_TEST_CASE(avro::testDatumVisitor));
+    ts->add(BOOST_TEST_CASE(avro::testLogicalValues));
+    ts->add(BOOST_TEST_CASE(avro::testSingleObject));
+    ts->add(BOOST_TEST_CASE(avro::testBatch));
+    ts->add(BOOST_TEST_CASE(avro::testArena));
+    ts->add(BOOST_TEST_CASE(avro::testReadInPlace));
+    ts->add(BOOST_TEST_CASE(avro::testCompiledGenericReader));
+    ts->add(BOOST_TEST_CASE(avro::testCompiledGenericWriter));
+    ts->add(BOOST_TEST_CASE(avro::testGenericSizeEstimator));
+    ts->add(BOOST_TEST_CASE(avro::testCompiledDefaults));
+    ts->add(BOOST_TEST_CASE(avro::testUnionBranchChoice));
+    ts->add(BOOST_TEST_CASE(avro::testDatumValues));
+    ts->add(BOOST_TEST_CASE(avro::testDatumPrototype));
+    ts->add(BOOST_TEST_CASE(avro::testLazyGenericRecord));
+    ts->add(BOOST_TEST_CASE(avro::testHashDatum));
+    ts->add(BOOST_TEST_CASE(avro::testGenericJsonWriter));
+    ts->add(BOOST_TEST_CASE(avro::testGenericJsonReader));
+    ts->add(BOOST_TEST_CASE(avro::testCompareBinary));
+    ts->add(BOOST_TEST_CASE(avro::testTranscoder));
+    ts->add(BOOST_TEST_CASE(avro::testFieldPathExtractor));
+    ts->add(BOOST_TEST_CASE(avro::testValidateBinaryFailures));
+    ts->add(BOOST_TEST_CASE(avro::testUtf8));
+    ts->add(BOOST_TEST_CASE(avro::testCodecPools));
+    ts->add(BOOST_TEST_CASE(avro::testDecodeProfile));
+    ts->add(BOOST_TEST_CASE(avro::testJsonEnumLookup));
+    ts->add(BOOST_TEST_CASE(avro::testInternedStrings));
+    ts->add(BOOST_TEST_CASE(avro::testSharedDatums));
 
     return ts;
 }
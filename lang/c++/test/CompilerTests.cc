@@ -82,6 +82,61 @@ void test2dArray() {
     BOOST_CHECK_EQUAL(expected, actual.str());
 }
 
+// Schemas whose members are not in the usual order compile, through the
+// tree-based compiler, to the same schema as ordered ones.
+void testMemberOrder() {
+    const char *ordered = R"({"type": "record", "name": "R", "namespace": "a.b",
+        "doc": "A \"record\"", "fields": [
+        {"name": "f", "type": {"type": "fixed", "name": "F", "size": 4}, "default": "abcd"},
+        {"name": "e", "type": {"type": "enum", "name": "E", "symbols": ["X", "Y"]}},
+        {"name": "m", "type": {"type": "map", "values": ["null", "F"]}, "other": [1, {}]},
+        {"name": "d", "type": {"type": "bytes", "logicalType": "decimal", "precision": 9, "scale": 2}},
+        {"name": "r", "type": ["null", "R"], "doc": "self"}]})";
+    const char *unordered = R"({"fields": [
+        {"default": "abcd", "type": {"size": 4, "name": "F", "type": "fixed"}, "name": "f"},
+        {"type": {"symbols": ["X", "Y"], "type": "enum", "name": "E"}, "name": "e"},
+        {"other": [1, {}], "name": "m", "type": {"values": ["null", "F"], "type": "map"}},
+        {"name": "d", "type": {"scale": 2, "precision": 9, "logicalType": "decimal", "type": "bytes"}},
+        {"doc": "self", "type": ["null", "R"], "name": "r"}],
+        "namespace": "a.b", "doc": "A \"record\"", "name": "R", "type": "record"})";
+
+    avro::ValidSchema s1 = avro::compileJsonSchemaFromString(ordered);
+    avro::ValidSchema s2 = avro::compileJsonSchemaFromString(unordered);
+    BOOST_CHECK_EQUAL(s1.toJson(), s2.toJson());
+    BOOST_CHECK_EQUAL(s1.root()->leafAt(0)->name().fullname(), "a.b.F");
+    BOOST_CHECK_EQUAL(s1.root()->leafAt(3)->logicalType().precision(), 9);
+
+    std::istringstream is(ordered);
+    avro::ValidSchema s3;
+    avro::compileJsonSchema(is, s3);
+    BOOST_CHECK_EQUAL(s1.toJson(), s3.toJson());
+}
+
+void testCompileMany() {
+    std::vector<std::string> inputs;
+    for (int i = 0; i < 100; ++i) {
+        inputs.push_back(R"({"type": "record", "name": "R)" + std::to_string(i % 40) + R"(", "fields": [
+            {"name": "next", "type": ["null", "R)" + std::to_string(i % 40) + R"("]}]})");
+    }
+    inputs.emplace_back(R"({"type": "record", "name": "Bad", "fields": [{"name": "f", "type": "Undefined"}]})");
+    inputs.emplace_back(R"("string")");
+
+    std::vector<avro::CompiledSchema> result = avro::compileJsonSchemas(inputs);
+    BOOST_REQUIRE_EQUAL(result.size(), inputs.size());
+    for (size_t i = 0; i < 100; ++i) {
+        BOOST_CHECK(result[i].error.empty());
+        avro::ValidSchema s = avro::compileJsonSchemaFromString(inputs[i]);
+        BOOST_CHECK_EQUAL(result[i].schema.toJson(), s.toJson());
+        BOOST_CHECK_EQUAL(result[i].fingerprint, s.rabinFingerprint());
+        // Repeated inputs are compiled once.
+        BOOST_CHECK(result[i].schema.root() == result[i % 40].schema.root());
+    }
+    BOOST_CHECK(!result[100].error.empty());
+    BOOST_CHECK(result[101].error.empty());
+    BOOST_CHECK_EQUAL(result[101].schema.root()->type(), avro::AVRO_STRING);
+    BOOST_CHECK(avro::compileJsonSchemas(std::vector<std::string>()).empty());
+}
+
 boost::unit_test::test_suite *
 init_unit_test_suite(int argc, char *argv[]) {
     using namespace boost::unit_test;
@@ -89,5 +144,7 @@ init_unit_test_suite(int argc, char *argv[]) {
     test_suite *ts = BOOST_TEST_SUITE("Avro C++ unit tests for Compiler.cc");
     ts->add(BOOST_TEST_CASE(&testEmptyBytesDefault));
     ts->add(BOOST_TEST_CASE(&test2dArray));
+    ts->add(BOOST_TEST_CASE(&testMemberOrder));
+    ts->add(BOOST_TEST_CASE(&testCompileMany));
     return ts;
 }
@@ -16,6 +16,7 @@
  * limitations under the License.
  */
 
+#include <boost/crc.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
@@ -23,15 +24,34 @@
 #include <boost/test/included/unit_test_framework.hpp>
 #include <boost/test/unit_test.hpp>
 
+#include <atomic>
 #include <chrono>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <set>
 #include <thread>
 
 #include <sstream>
 
+#include "Codec.hh"
+#include "CodecSelector.hh"
+#include "ColumnarBatch.hh"
 #include "Compiler.hh"
+#include "ConcurrentDataFileWriter.hh"
+#include "Crc32.hh"
 #include "DataFile.hh"
+#include "DataFileScanner.hh"
+#include "DataFileSorter.hh"
+#include "DatasetReader.hh"
+#include "Executor.hh"
+#include "RollingDataFileWriter.hh"
 #include "Generic.hh"
+#include "GroupCommitter.hh"
+#include "JsonLines.hh"
 #include "Stream.hh"
+#include "Trace.hh"
+#include "XxHash.hh"
 
 using std::array;
 using std::istringstream;
@@ -431,6 +451,39 @@ public:
         BOOST_CHECK_EQUAL(actual.size(), count);
     }
 
+    void testReadMapped() {
+        avro::DataFileReader<ComplexInteger> df(
+            avro::mappedFileInputStream(filename), writerSchema);
+        std::vector<int64_t> sync_points;
+        int i = 0;
+        ComplexInteger ci;
+        int64_t re = 3;
+        int64_t im = 5;
+        while (df.read(ci)) {
+            BOOST_CHECK_EQUAL(ci.re, re);
+            BOOST_CHECK_EQUAL(ci.im, im);
+            if (sync_points.empty() || sync_points.back() != df.previousSync()) {
+                sync_points.push_back(df.previousSync());
+            }
+            re *= im;
+            im += 3;
+            ++i;
+        }
+        BOOST_CHECK_EQUAL(i, count);
+        BOOST_REQUIRE(sync_points.size() > 1);
+
+        // Seeking back into the mapping yields the same objects again.
+        int64_t middle = sync_points[sync_points.size() / 2];
+        df.seek(middle);
+        int rest = 0;
+        while (df.read(ci)) {
+            ++rest;
+        }
+        BOOST_CHECK(rest > 0 && rest < count);
+        df.sync(0);
+        BOOST_CHECK_EQUAL(df.previousSync(), sync_points[0]);
+    }
+
     void testReaderSyncDiscovery() {
         std::set<int64_t> sync_points_syncing;
         std::set<int64_t> sync_points_reading;
@@ -774,6 +827,27 @@ void testSkipStringSnappyCodec() {
 }
 #endif
 
+#ifdef ZSTD_CODEC_AVAILABLE
+void testSkipStringZstdCodec() {
+    BOOST_TEST_CHECKPOINT(__func__);
+    testSkipString(avro::ZSTD_CODEC);
+}
+#endif
+
+#ifdef XZ_CODEC_AVAILABLE
+void testSkipStringXzCodec() {
+    BOOST_TEST_CHECKPOINT(__func__);
+    testSkipString(avro::XZ_CODEC);
+}
+#endif
+
+#ifdef LZ4_CODEC_AVAILABLE
+void testSkipStringLz4Codec() {
+    BOOST_TEST_CHECKPOINT(__func__);
+    testSkipString(avro::LZ4_CODEC);
+}
+#endif
+
 struct TestRecord {
     std::string s1;
     int64_t id;
@@ -987,6 +1061,13 @@ void testLastSyncSnappyCodec() {
 }
 #endif
 
+#ifdef ZSTD_CODEC_AVAILABLE
+void testLastSyncZstdCodec() {
+    BOOST_TEST_CHECKPOINT(__func__);
+    testLastSync(avro::ZSTD_CODEC);
+}
+#endif
+
 void testReadRecordEfficientlyUsingLastSyncNullCodec() {
     BOOST_TEST_CHECKPOINT(__func__);
     testReadRecordEfficientlyUsingLastSync(avro::NULL_CODEC);
@@ -1004,146 +1085,3432 @@ void testReadRecordEfficientlyUsingLastSyncSnappyCodec() {
 }
 #endif
 
-test_suite *
-init_unit_test_suite(int argc, char *argv[]) {
+void testBlockReader(avro::Codec codec) {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    const char *filename = "test_blockReader.df";
+    const int numberOfRecords = 200;
     {
-        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test0.df");
-        shared_ptr<DataFileTest> t1(new DataFileTest("test1.d0", sch, isch, 0));
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testWrite, t1));
-        addReaderTests(ts, t1);
-        boost::unit_test::framework::master_test_suite().add(ts);
+        avro::DataFileWriter<TestRecord> df(filename, writerSchema, 1024, codec);
+        std::string s(100, 'a');
+        for (int i = 0; i < numberOfRecords; i++) {
+            df.write(TestRecord(s.c_str(), i));
+        }
+        df.close();
     }
+
+    std::vector<avro::DataFileBlock> blocks;
     {
-        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test1.df");
-        shared_ptr<DataFileTest> t1(new DataFileTest("test1.df", sch, isch));
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testWrite, t1));
-        addReaderTests(ts, t1);
-        boost::unit_test::framework::master_test_suite().add(ts);
+        avro::DataFileBlockReader br(filename);
+        BOOST_CHECK_EQUAL(br.codec(), codec);
+        BOOST_CHECK_EQUAL(br.dataSchema().toJson(), writerSchema.toJson());
+        avro::DataFileBlock b;
+        std::vector<uint8_t> raw;
+        while (br.next(b)) {
+            // Read every other block; the rest are skipped.
+            if (blocks.size() % 2 == 1) {
+                br.readBlockRaw(raw);
+                BOOST_CHECK_EQUAL(raw.size(), b.byteSize);
+                BOOST_CHECK_THROW(br.readBlockRaw(raw), avro::Exception);
+            }
+            blocks.push_back(b);
+        }
+        BOOST_CHECK(!br.next(b));
+    }
+
+    BOOST_REQUIRE_GT(blocks.size(), 2);
+    int64_t count = 0;
+    avro::DataFileReader<TestRecord> df(filename);
+    TestRecord r("", 0);
+    for (std::vector<avro::DataFileBlock>::const_iterator it = blocks.begin();
+         it != blocks.end(); ++it) {
+        df.seek(it->offset);
+        BOOST_CHECK_EQUAL(df.previousSync(), it->offset);
+        BOOST_REQUIRE(df.read(r));
+        BOOST_CHECK_EQUAL(r.id, count);
+        count += it->objectCount;
+    }
+    BOOST_CHECK_EQUAL(count, numberOfRecords);
+    df.close();
+    BOOST_CHECK(boost::filesystem::remove(filename));
+}
+
+void testBlockReaderNullCodec() {
+    BOOST_TEST_CHECKPOINT(__func__);
+    testBlockReader(avro::NULL_CODEC);
+}
+
+void testBlockReaderDeflateCodec() {
+    BOOST_TEST_CHECKPOINT(__func__);
+    testBlockReader(avro::DEFLATE_CODEC);
+}
+
+static std::vector<TestRecord> readTestRecords(const char *filename) {
+    avro::DataFileReader<TestRecord> df(filename);
+    std::vector<TestRecord> result;
+    TestRecord r("", 0);
+    while (df.read(r)) {
+        result.push_back(r);
     }
+    return result;
+}
+
+void testSortDataFile() {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    const char *input = "test_sort_in.df";
+    const char *output = "test_sort_out.df";
+    const int count = 5000;
+    boost::random::mt19937 rnd(5);
     {
-        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test1.defalate.df");
-        shared_ptr<DataFileTest> t1(new DataFileTest("test1.deflate.df", sch, isch));
-        ts->add(BOOST_CLASS_TEST_CASE(
-            &DataFileTest::testWriteWithDeflateCodec, t1));
-        addReaderTests(ts, t1);
-        boost::unit_test::framework::master_test_suite().add(ts);
+        avro::DataFileWriter<TestRecord> df(input, writerSchema, 1024, avro::DEFLATE_CODEC);
+        for (int i = 0; i < count; i++) {
+            // The string gives the original position, to check that
+            // objects with the same id keep their order.
+            df.write(TestRecord(std::to_string(100000 + i).c_str(), rnd() % 1000));
+        }
+        df.close();
     }
-#ifdef SNAPPY_CODEC_AVAILABLE
+
+    // Little memory, so that there are more runs than are merged at once.
+    avro::SortOptions options;
+    options.memoryLimit = 1000;
+    options.threads = 2;
+    options.keyField = "id";
+    BOOST_CHECK_EQUAL(avro::sortDataFile(input, output, options), count);
+    std::vector<TestRecord> sorted = readTestRecords(output);
+    BOOST_REQUIRE_EQUAL(sorted.size(), count);
+    for (size_t i = 1; i < sorted.size(); ++i) {
+        BOOST_CHECK(sorted[i - 1].id < sorted[i].id || (sorted[i - 1].id == sorted[i].id && sorted[i - 1].s1 < sorted[i].s1));
+    }
+    BOOST_CHECK_EQUAL(avro::DataFileBlockReader(output).codecName(), "deflate");
+    BOOST_CHECK(!boost::filesystem::exists("test_sort_out.df.run0"));
+
+    // By the whole record, in memory, which sorts by the unique string.
+    options.memoryLimit = 1 << 20;
+    options.keyField.clear();
+    options.codec = "null";
+    BOOST_CHECK_EQUAL(avro::sortDataFile(output, "test_sort_all.df", options), count);
+    sorted = readTestRecords("test_sort_all.df");
+    BOOST_REQUIRE_EQUAL(sorted.size(), count);
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        BOOST_CHECK_EQUAL(sorted[i].s1, std::to_string(100000 + i));
+    }
+
+    // Merging sorted files.
     {
-        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test1.snappy.df");
-        shared_ptr<DataFileTest> t1(new DataFileTest("test1.snappy.df", sch, isch));
-        ts->add(BOOST_CLASS_TEST_CASE(
-            &DataFileTest::testWriteWithSnappyCodec, t1));
-        addReaderTests(ts, t1);
-        boost::unit_test::framework::master_test_suite().add(ts);
+        avro::DataFileWriter<TestRecord> a("test_sort_a.df", writerSchema);
+        avro::DataFileWriter<TestRecord> b("test_sort_b.df", writerSchema);
+        for (int i = 0; i < 100; i++) {
+            (i % 3 == 0 ? a : b).write(TestRecord("x", i));
+        }
+        a.close();
+        b.close();
     }
-#endif
+    options.keyField = "id";
+    BOOST_CHECK_EQUAL(avro::mergeDataFiles({"test_sort_a.df", "test_sort_b.df"}, output, options), 100);
+    sorted = readTestRecords(output);
+    BOOST_REQUIRE_EQUAL(sorted.size(), 100);
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        BOOST_CHECK_EQUAL(sorted[i].id, static_cast<int64_t>(i));
+    }
+
     {
-        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test2.df");
-        shared_ptr<DataFileTest> t2(new DataFileTest("test2.df", sch, isch));
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testWriteGeneric, t2));
-        addReaderTests(ts, t2);
-        boost::unit_test::framework::master_test_suite().add(ts);
+        // Logical types that differ keep files apart.
+        avro::ValidSchema timestamps = avro::compileJsonSchemaFromString(
+            R"({"type": "record", "name": "R", "fields": [
+                {"name": "s1", "type": "string"},
+                {"name": "id", "type": {"type": "long", "logicalType": "timestamp-micros"}}]})");
+        avro::DataFileWriter<TestRecord> c("test_sort_c.df", timestamps);
+        c.write(TestRecord("x", 100));
+        c.close();
+    }
+    BOOST_CHECK_THROW(avro::mergeDataFiles({"test_sort_a.df", "test_sort_c.df"}, output, options), avro::Exception);
+
+    options.keyField = "missing";
+    BOOST_CHECK_THROW(avro::sortDataFile(input, output, options), avro::Exception);
+
+    for (const char *name : {input, output, "test_sort_all.df", "test_sort_a.df", "test_sort_b.df", "test_sort_c.df"}) {
+        boost::filesystem::remove(name);
     }
+}
+
+void testJsonLinesToDataFile() {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    const char *input = "test_jsonl.json";
+    const char *output = "test_jsonl.df";
+    const int count = 3000;
     {
-        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test3.df");
-        shared_ptr<DataFileTest> t3(new DataFileTest("test3.df", dsch, dblsch));
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testWriteDouble, t3));
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testReadDouble, t3));
-        ts->add(
-            BOOST_CLASS_TEST_CASE(&DataFileTest::testReadDoubleTwoStep, t3));
-        ts->add(BOOST_CLASS_TEST_CASE(
-            &DataFileTest::testReadDoubleTwoStepProject, t3));
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testCleanup, t3));
-        boost::unit_test::framework::master_test_suite().add(ts);
+        std::ofstream out(input);
+        for (int i = 0; i < count; i++) {
+            // Fields in either order, and some blank lines.
+            if (i % 2 == 0) {
+                out << "{\"s1\":\"s" << i << "\",\"id\":" << i << "}\n";
+            } else {
+                out << "  {\"id\":" << i << ", \"s1\":\"s" << i << "\"}\r\n";
+            }
+            if (i % 100 == 0) {
+                out << "\n";
+            }
+        }
+        // No newline after the last line.
+        out << "{\"id\":" << count << ",\"s1\":\"last\"}";
+    }
+
+    // Small batches and blocks, so that there are many of each.
+    avro::JsonLinesOptions options;
+    options.threads = 3;
+    options.batchSize = 1000;
+    options.syncInterval = 512;
+    options.codec = "deflate";
+    BOOST_CHECK_EQUAL(avro::jsonLinesToDataFile(input, writerSchema, output, options), count + 1);
+    std::vector<TestRecord> records = readTestRecords(output);
+    BOOST_REQUIRE_EQUAL(records.size(), count + 1);
+    for (int i = 0; i < count; i++) {
+        BOOST_CHECK_EQUAL(records[i].id, i);
+        BOOST_CHECK_EQUAL(records[i].s1, "s" + std::to_string(i));
     }
+    BOOST_CHECK_EQUAL(records[count].s1, "last");
     {
-        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test4.df");
-        shared_ptr<DataFileTest> t4(new DataFileTest("test4.df", dsch, dblsch));
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testTruncate, t4));
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testCleanup, t4));
-        boost::unit_test::framework::master_test_suite().add(ts);
+        avro::DataFileBlockReader blocks(output);
+        BOOST_CHECK_EQUAL(blocks.codecName(), "deflate");
+        avro::DataFileBlock block;
+        int n = 0;
+        while (blocks.next(block)) {
+            ++n;
+        }
+        BOOST_CHECK_GT(n, 10);
     }
+
+    // A bad line is reported with its number.
     {
-        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test5.df");
-        shared_ptr<DataFileTest> t5(new DataFileTest("test5.df", sch, isch));
-        ts->add(
-            BOOST_CLASS_TEST_CASE(&DataFileTest::testWriteGenericByName, t5));
-        addReaderTests(ts, t5);
-        boost::unit_test::framework::master_test_suite().add(ts);
+        std::ofstream out(input);
+        out << "{\"s1\":\"a\",\"id\":1}\n\n{\"s1\":\"b\"}\n";
+    }
+    try {
+        avro::jsonLinesToDataFile(input, writerSchema, output, options);
+        BOOST_ERROR("No exception for a bad line");
+    } catch (const avro::Exception &e) {
+        BOOST_CHECK(std::string(e.what()).find("Line 3") == 0);
+    }
+
+    boost::filesystem::remove(input);
+    boost::filesystem::remove(output);
+}
+
+void testDirectBlocks() {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    const char *filename = "test_directBlocks.df";
+    const int count = 3000;
+    std::unique_ptr<avro::OutputStream> out = avro::memoryOutputStream();
+    avro::EncoderPtr e = avro::binaryEncoder();
+    e->init(*out);
+    for (int i = 0; i < 100; i++) {
+        avro::encode(*e, TestRecord("batch", count + i));
     }
+    e->flush();
+    std::shared_ptr<std::vector<uint8_t>> batch = avro::snapshot(*out);
+
+    // Writes count objects and a batch of 100 to df, in blocks of
+    // about 1 KB, which the file's small buffer flushes mid-block.
+    auto fill = [&](avro::DataFileWriter<TestRecord> &df) {
+        df.setBlockIndex(avro::memoryOutputStream());
+        df.setDirectBlocks();
+        for (int i = 0; i < count; i++) {
+            df.write(TestRecord("abcdefghij", i));
+        }
+        df.appendEncodedBatch(batch->data(), batch->size(), 100);
+        df.close();
+    };
+    auto check = [&](avro::SeekableInputStreamPtr in) {
+        avro::DataFileReader<TestRecord> df(std::move(in), writerSchema);
+        TestRecord r("", 0);
+        int next = 0;
+        while (df.read(r)) {
+            BOOST_CHECK_EQUAL(r.id, next);
+            ++next;
+        }
+        BOOST_CHECK_EQUAL(next, count + 100);
+    };
+    avro::StreamOptions options;
+    options.chunkSize = 100;
     {
-        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test6.df");
-        shared_ptr<DataFileTest> t6(new DataFileTest("test6.df", dsch, dblsch));
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testZip, t6));
-        boost::unit_test::framework::master_test_suite().add(ts);
+        avro::DataFileWriter<TestRecord> df(filename, writerSchema, 1024, avro::NULL_CODEC, options);
+        fill(df);
     }
+    check(avro::fileSeekableInputStream(filename));
+    size_t blocks = 0;
     {
-        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test8.df");
-        shared_ptr<DataFileTest> t8(new DataFileTest("test8.df", dsch, dblsch));
-#ifdef SNAPPY_CODEC_AVAILABLE
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testSnappy, t8));
-#endif
-        boost::unit_test::framework::master_test_suite().add(ts);
+        avro::DataFileBlockReader br(filename);
+        avro::DataFileBlock b;
+        while (br.next(b)) {
+            ++blocks;
+        }
     }
+    BOOST_CHECK_GT(blocks, 10U);
     {
-        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test7.df");
-        shared_ptr<DataFileTest> t7(new DataFileTest("test7.df", fsch, fsch));
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testSchemaReadWrite, t7));
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testCleanup, t7));
-        boost::unit_test::framework::master_test_suite().add(ts);
+        avro::DataFileWriter<TestRecord> df(avro::mappedFileOutputStream(filename, 1024 * 1024), writerSchema, 1024);
+        fill(df);
     }
+    check(avro::mappedFileInputStream(filename));
+
+    // Streams that cannot go back, and compressed blocks, are refused.
     {
-        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test9.df");
-        shared_ptr<DataFileTest> t9(new DataFileTest("test9.df", sch, sch));
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testWrite, t9));
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testReaderSyncSeek, t9));
-        //ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testCleanup, t9));
-        boost::unit_test::framework::master_test_suite().add(ts);
+        avro::DataFileWriter<TestRecord> df(avro::fileAppendOutputStream(filename), writerSchema, 1024);
+        BOOST_CHECK_THROW(df.setDirectBlocks(), avro::Exception);
     }
     {
-        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test10.df");
-        shared_ptr<DataFileTest> t(new DataFileTest("test10.df", sch, sch));
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testWrite, t));
-        ts->add(
-            BOOST_CLASS_TEST_CASE(&DataFileTest::testReaderSyncDiscovery, t));
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testCleanup, t));
-        boost::unit_test::framework::master_test_suite().add(ts);
+        avro::DataFileWriter<TestRecord> df(filename, writerSchema, 1024, avro::DEFLATE_CODEC);
+        BOOST_CHECK_THROW(df.setDirectBlocks(), avro::Exception);
     }
+    std::remove(filename);
+}
+
+void testSizedWrites() {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    avro::GenericSizeEstimator estimator(writerSchema);
+    const char *filename = "test_sizedWrites.df";
+    // The largest block, written with or without the sizes of the
+    // objects to come.
+    auto largest = [&](bool sized) {
+        {
+            avro::DataFileWriter<avro::GenericDatum> df(filename, writerSchema, 1024);
+            avro::GenericDatum d(writerSchema);
+            avro::GenericRecord &r = d.value<avro::GenericRecord>();
+            for (int i = 0; i < 1000; i++) {
+                r.fieldAt(0).value<std::string>() = std::string(static_cast<size_t>(i % 97), 's');
+                r.fieldAt(1).value<int64_t>() = i;
+                if (sized) {
+                    df.write(d, estimator.size(d));
+                } else {
+                    df.write(d);
+                }
+            }
+            df.close();
+        }
+        int64_t result = 0;
+        int64_t objects = 0;
+        avro::DataFileBlockReader br(filename);
+        avro::DataFileBlock b;
+        while (br.next(b)) {
+            result = std::max(result, b.byteSize);
+            objects += b.objectCount;
+        }
+        BOOST_CHECK_EQUAL(objects, 1000);
+        return result;
+    };
+    BOOST_CHECK_GT(largest(false), 1024);
+    BOOST_CHECK_LE(largest(true), 1024);
+    std::remove(filename);
+}
+
+void testSharedDataFile() {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(sch);
+    const char *filename = "test_sharedDataFile.df";
+    const int count = 5000;
     {
-        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test11.df");
-        shared_ptr<DataFileTest> t(new DataFileTest("test11.df", sch, sch));
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testWrite, t));
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testReaderSplits, t));
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testCleanup, t));
-        boost::unit_test::framework::master_test_suite().add(ts);
+        avro::DataFileWriter<ComplexInteger> df(filename, writerSchema, 1024, avro::DEFLATE_CODEC);
+        for (int64_t i = 0; i < count; i++) {
+            df.write(ComplexInteger(i, -i));
+        }
+        df.close();
+    }
+    avro::DataFileIndex index = avro::buildDataFileIndex(filename);
+    const std::vector<avro::DataFileIndexEntry> &blocks = index.entries();
+    BOOST_CHECK_GT(blocks.size(), 10U);
+
+    // Threads read blocks at random through readers of their own over
+    // the one file, each reader starting at the first block.
+    avro::SharedDataFile file(filename);
+    BOOST_CHECK_EQUAL(file.dataStart(), blocks[0].offset);
+    std::atomic<int> errors(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            avro::DataFileReader<ComplexInteger> df(file, writerSchema);
+            ComplexInteger c;
+            if (!df.read(c) || c.re != 0) {
+                ++errors;
+            }
+            std::vector<ComplexInteger> items;
+            for (size_t i = 0; i < 200; ++i) {
+                const avro::DataFileIndexEntry &e = blocks[(i * 7 + static_cast<size_t>(t) * 13) % blocks.size()];
+                if (df.readBlockAt(e.offset, items) != static_cast<size_t>(e.objectCount)
+                    || items.front().re != e.firstObject || items.back().re != e.firstObject + e.objectCount - 1) {
+                    ++errors;
+                }
+            }
+        });
+    }
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    BOOST_CHECK_EQUAL(errors.load(), 0);
+    std::remove(filename);
+}
+
+void testAppendEncodedBatch() {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    const int count = 500;
+    std::unique_ptr<avro::OutputStream> out = avro::memoryOutputStream();
+    avro::EncoderPtr e = avro::binaryEncoder();
+    e->init(*out);
+    for (int i = 0; i < count; i++) {
+        avro::encode(*e, TestRecord("batch", i));
+    }
+    e->flush();
+    std::shared_ptr<std::vector<uint8_t>> bytes = avro::snapshot(*out);
+
+    const char *filename = "test_batch.df";
+    for (bool validate : {false, true}) {
+        {
+            avro::DataFileWriter<TestRecord> df(filename, writerSchema, 1024, avro::DEFLATE_CODEC);
+            if (validate) {
+                // Nothing is written of a batch that does not hold count objects.
+                BOOST_CHECK_THROW(df.appendEncodedBatch(bytes->data(), bytes->size(), count + 1), avro::Exception);
+                BOOST_CHECK_THROW(df.appendEncodedBatch(bytes->data(), bytes->size(), count - 1), avro::Exception);
+            }
+            df.appendEncodedBatch(bytes->data(), bytes->size(), count, validate);
+            df.close();
+        }
+        std::vector<TestRecord> records = readTestRecords(filename);
+        BOOST_REQUIRE_EQUAL(records.size(), count);
+        for (int i = 0; i < count; i++) {
+            BOOST_CHECK_EQUAL(records[i].id, i);
+            BOOST_CHECK_EQUAL(records[i].s1, "batch");
+        }
+        // Validated batches end blocks at the sync interval; trusted
+        // ones are kept whole.
+        avro::DataFileBlockReader blocks(filename);
+        avro::DataFileBlock block;
+        size_t n = 0;
+        while (blocks.next(block)) {
+            ++n;
+        }
+        BOOST_CHECK(validate ? n > 1 : n == 1);
+    }
+    boost::filesystem::remove(filename);
+}
+
+void testAppender() {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    const char *inputs[] = {"test_appender_1.df", "test_appender_2.df"};
+    const int recordsPerFile = 150;
+    for (int f = 0; f < 2; ++f) {
+        avro::DataFileWriter<TestRecord> df(inputs[f], writerSchema, 1024, avro::DEFLATE_CODEC);
+        for (int i = 0; i < recordsPerFile; i++) {
+            df.write(TestRecord("abc", f * recordsPerFile + i));
+        }
+        df.close();
     }
+
+    const char *filename = "test_appender.df";
     {
-        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test12.df");
-        shared_ptr<DataFileTest> t(new DataFileTest("test12.df", ischWithDoc, ischWithDoc));
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testWrite, t));
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testSchemaReadWriteWithDoc, t));
-        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testCleanup, t));
-        boost::unit_test::framework::master_test_suite().add(ts);
+        avro::DataFileAppender appender(filename, writerSchema, avro::DEFLATE_CODEC);
+        BOOST_CHECK_EQUAL(appender.append(inputs[0]), recordsPerFile);
+    }
+    {
+        // Reopen the file and append to its end.
+        avro::DataFileAppender appender(filename);
+        BOOST_CHECK_EQUAL(appender.codec(), avro::DEFLATE_CODEC);
+        BOOST_CHECK_EQUAL(appender.append(inputs[1]), recordsPerFile);
+    }
+    {
+        avro::DataFileAppender appender(filename);
+        avro::DataFileWriter<TestRecord> df("test_appender_null.df", writerSchema);
+        df.close();
+        BOOST_CHECK_THROW(appender.append("test_appender_null.df"), avro::Exception);
+    }
+    {
+        // The same encoding with another logical type is other data.
+        avro::DataFileAppender appender(filename);
+        avro::ValidSchema timestamps = avro::compileJsonSchemaFromString(
+            R"({"type": "record", "name": "R", "fields": [
+                {"name": "s1", "type": "string"},
+                {"name": "id", "type": {"type": "long", "logicalType": "timestamp-micros"}}]})");
+        BOOST_REQUIRE(timestamps.sameEncoding(writerSchema));
+        avro::DataFileWriter<TestRecord> df("test_appender_timestamps.df", timestamps, 1024, avro::DEFLATE_CODEC);
+        df.write(TestRecord("abc", 0));
+        df.close();
+        BOOST_CHECK_THROW(appender.append("test_appender_timestamps.df"), avro::Exception);
     }
 
-    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testSkipStringNullCodec));
-    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testSkipStringDeflateCodec));
-#ifdef SNAPPY_CODEC_AVAILABLE
-    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testSkipStringSnappyCodec));
-#endif
+    avro::DataFileReader<TestRecord> df(filename);
+    TestRecord r("", 0);
+    int64_t expected = 0;
+    while (df.read(r)) {
+        BOOST_CHECK_EQUAL(r.id, expected);
+        ++expected;
+    }
+    BOOST_CHECK_EQUAL(expected, 2 * recordsPerFile);
+    df.close();
+    BOOST_CHECK(boost::filesystem::remove(filename));
+    BOOST_CHECK(boost::filesystem::remove(inputs[0]));
+    BOOST_CHECK(boost::filesystem::remove(inputs[1]));
+    BOOST_CHECK(boost::filesystem::remove("test_appender_null.df"));
+    BOOST_CHECK(boost::filesystem::remove("test_appender_timestamps.df"));
+}
 
-    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testLastSyncNullCodec));
-    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testLastSyncDeflateCodec));
-#ifdef SNAPPY_CODEC_AVAILABLE
-    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testLastSyncSnappyCodec));
-#endif
+void testParallelScan() {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    const char *filename = "test_parallelScan.df";
+    const int numberOfRecords = 1000;
+    {
+        avro::DataFileWriter<TestRecord> df(filename, writerSchema, 1024, avro::DEFLATE_CODEC);
+        for (int i = 0; i < numberOfRecords; i++) {
+            df.write(TestRecord("abcdefghij", i));
+        }
+        df.close();
+    }
 
-    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testReadRecordEfficientlyUsingLastSyncNullCodec));
-    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testReadRecordEfficientlyUsingLastSyncDeflateCodec));
-#ifdef SNAPPY_CODEC_AVAILABLE
+    avro::ParallelDataFileScanner<TestRecord> scanner(filename, 4, TestRecord("", 0));
+    scanner.setSplits(7);
+    BOOST_CHECK_EQUAL(scanner.threads(), 4);
+
+    std::mutex mutex;
+    std::vector<int> seen(numberOfRecords, 0);
+    int64_t count = scanner.forEach([&](const TestRecord &r) {
+        std::lock_guard<std::mutex> lock(mutex);
+        seen[r.id]++;
+    });
+    BOOST_CHECK_EQUAL(count, numberOfRecords);
+    BOOST_CHECK(std::count(seen.begin(), seen.end(), 1) == numberOfRecords);
+
+    std::atomic<int64_t> blocks(0);
+    std::atomic<int64_t> objects(0);
+    std::atomic<bool> inOrder(true);
+    count = scanner.forEachBlock([&](const TestRecord *items, size_t n) {
+        for (size_t i = 1; i < n; ++i) {
+            if (items[i].id != items[i - 1].id + 1) {
+                inOrder = false;
+            }
+        }
+        ++blocks;
+        objects += n;
+    });
+    BOOST_CHECK_EQUAL(count, numberOfRecords);
+    BOOST_CHECK_EQUAL(objects, numberOfRecords);
+    BOOST_CHECK(inOrder);
+    BOOST_CHECK_GT(blocks, 7);
+
+    int64_t expected = 0;
+    count = scanner.forEachOrdered([&](const TestRecord &r) {
+        BOOST_CHECK_EQUAL(r.id, expected);
+        ++expected;
+    });
+    BOOST_CHECK_EQUAL(count, numberOfRecords);
+    BOOST_CHECK_EQUAL(expected, numberOfRecords);
+
+    BOOST_CHECK_THROW(scanner.forEachOrdered([](const TestRecord &r) {
+        if (r.id == 500) {
+            throw std::runtime_error("stop");
+        }
+    }),
+                      std::runtime_error);
+
+    BOOST_CHECK(boost::filesystem::remove(filename));
+}
+
+void testStreamOptions() {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    const char *filename = "test_streamOptions.df";
+    const int numberOfRecords = 5000;
+    avro::StreamOptions options;
+    options.chunkSize = 512;
+    options.growth = avro::StreamOptions::GEOMETRIC_CHUNKS;
+    options.maxChunkSize = 16 * 1024;
+    {
+        avro::DataFileWriter<TestRecord> df(filename, writerSchema, 64 * 1024,
+                                            avro::NULL_CODEC, options);
+        for (int i = 0; i < numberOfRecords; i++) {
+            df.write(TestRecord("abcdefghij", i));
+        }
+        df.close();
+    }
+    {
+        avro::DataFileReader<TestRecord> df(filename, writerSchema, options);
+        TestRecord r("", 0);
+        int i = 0;
+        while (df.read(r)) {
+            BOOST_CHECK_EQUAL(r.id, i);
+            BOOST_CHECK_EQUAL(r.s1, "abcdefghij");
+            ++i;
+        }
+        BOOST_CHECK_EQUAL(i, numberOfRecords);
+    }
+    BOOST_CHECK(boost::filesystem::remove(filename));
+}
+
+// Stores blocks reversed, with a count of the blocks it handled.
+class ReversingCodec : public avro::BlockCodec {
+    class Compressor : public avro::BlockCompressor {
+        std::atomic<int> &count_;
+
+    public:
+        explicit Compressor(std::atomic<int> &count) : count_(count) {}
+
+        size_t compress(const uint8_t *in, size_t len, int, std::vector<char> &out) override {
+            ++count_;
+            if (out.size() < len) {
+                out.resize(len);
+            }
+            std::reverse_copy(in, in + len, out.begin());
+            return len;
+        }
+    };
+
+    class Decompressor : public avro::BlockDecompressor {
+    public:
+        size_t decompress(const uint8_t *in, size_t len, std::vector<uint8_t> &out) override {
+            if (out.size() < len) {
+                out.resize(len);
+            }
+            std::reverse_copy(in, in + len, out.begin());
+            return len;
+        }
+    };
+
+public:
+    mutable std::atomic<int> blocks;
+
+    ReversingCodec() : blocks(0) {}
+
+    std::string name() const override { return "test-reversing"; }
+
+    std::unique_ptr<avro::BlockCompressor> newCompressor() const override {
+        return std::unique_ptr<avro::BlockCompressor>(new Compressor(blocks));
+    }
+
+    std::unique_ptr<avro::BlockDecompressor> newDecompressor() const override {
+        return std::unique_ptr<avro::BlockDecompressor>(new Decompressor());
+    }
+};
+
+void testTransposingCodec() {
+    avro::ValidSchema schema = avro::compileJsonSchemaFromString(
+        "{\"type\":\"record\",\"name\":\"reading\",\"fields\":["
+        "{\"name\":\"time\", \"type\":\"long\"},"
+        "{\"name\":\"value\", \"type\":\"double\"},"
+        "{\"name\":\"ratio\", \"type\":\"float\"},"
+        "{\"name\":\"ok\", \"type\":\"boolean\"},"
+        "{\"name\":\"id\", \"type\":{\"type\":\"fixed\", \"name\":\"id\", \"size\":4}},"
+        "{\"name\":\"label\", \"type\":[\"null\", \"string\"]},"
+        "{\"name\":\"samples\", \"type\":{\"type\":\"array\", \"items\":\"double\"}},"
+        "{\"name\":\"tags\", \"type\":{\"type\":\"map\", \"values\":\"int\"}}"
+        "]}");
+    BOOST_CHECK(!avro::findCodec("transposed-deflate"));
+    avro::BlockCodecPtr codec = avro::findCodec("transposed-deflate", schema);
+    BOOST_REQUIRE(codec);
+    BOOST_CHECK_EQUAL(codec->name(), "transposed-deflate");
+    BOOST_CHECK_EQUAL(codec->defaultLevel(), avro::blockCodec(avro::DEFLATE_CODEC)->defaultLevel());
+    BOOST_CHECK(!avro::findCodec("transposed-unknown", schema));
+
+    const int numberOfRecords = 3000;
+    std::vector<avro::GenericDatum> data;
+    for (int i = 0; i < numberOfRecords; ++i) {
+        avro::GenericDatum d(schema);
+        avro::GenericRecord &r = d.value<avro::GenericRecord>();
+        r.fieldAt(0) = avro::GenericDatum(int64_t(1700000000000) + i * 1000);
+        r.fieldAt(1) = avro::GenericDatum(20.0 + (i % 50) * 0.25);
+        r.fieldAt(2) = avro::GenericDatum(static_cast<float>(i % 7) / 8);
+        r.fieldAt(3) = avro::GenericDatum(i % 3 != 0);
+        r.fieldAt(4).value<avro::GenericFixed>().value() = {1, 2, 3, static_cast<uint8_t>(i % 4)};
+        if (i % 5 == 0) {
+            r.fieldAt(5).selectBranch(1);
+            r.fieldAt(5).value<std::string>() = "sensor-" + std::to_string(i % 10);
+        }
+        for (int j = 0; j < i % 4; ++j) {
+            r.fieldAt(6).value<avro::GenericArray>().value().push_back(avro::GenericDatum(j * 1.5));
+        }
+        if (i % 2 == 0) {
+            r.fieldAt(7).value<avro::GenericMap>().value().emplace_back("k", avro::GenericDatum(int32_t(i)));
+        }
+        data.push_back(d);
+    }
+
+    const char *transposed = "test_transposingCodec.df";
+    const char *plain = "test_transposingCodecPlain.df";
+    for (int pass = 0; pass < 2; ++pass) {
+        avro::DataFileWriter<avro::GenericDatum> df(pass == 0 ? transposed : plain, schema, 16 * 1024,
+                                                    pass == 0 ? codec : avro::blockCodec(avro::DEFLATE_CODEC));
+        if (pass == 0) {
+            df.setCompressionThreads(2, 2);
+        }
+        for (const avro::GenericDatum &d : data) {
+            df.write(d);
+        }
+        df.close();
+    }
+    BOOST_CHECK_LT(boost::filesystem::file_size(transposed), boost::filesystem::file_size(plain));
+    {
+        avro::DataFileReader<avro::GenericDatum> df(transposed);
+        avro::GenericDatum d(schema);
+        size_t i = 0;
+        for (; df.read(d); ++i) {
+            BOOST_REQUIRE_LT(i, data.size());
+            std::unique_ptr<avro::OutputStream> a = avro::memoryOutputStream();
+            std::unique_ptr<avro::OutputStream> b = avro::memoryOutputStream();
+            avro::EncoderPtr e = avro::binaryEncoder();
+            e->init(*a);
+            avro::encode(*e, d);
+            e->flush();
+            e->init(*b);
+            avro::encode(*e, data[i]);
+            e->flush();
+            BOOST_CHECK(*avro::snapshot(*a) == *avro::snapshot(*b));
+        }
+        BOOST_CHECK_EQUAL(i, data.size());
+    }
+    BOOST_CHECK(boost::filesystem::remove(transposed));
+    BOOST_CHECK(boost::filesystem::remove(plain));
+
+    // Blocks that do not hold objects of the schema go as they are.
+    std::unique_ptr<avro::BlockCompressor> compressor = codec->newCompressor();
+    std::unique_ptr<avro::BlockDecompressor> decompressor = codec->newDecompressor();
+    const uint8_t garbage[] = {0xff, 0xff, 0xff, 0x01, 0x02};
+    std::vector<char> compressed;
+    size_t n = compressor->compress(garbage, sizeof(garbage), codec->defaultLevel(), compressed);
+    std::vector<uint8_t> out;
+    BOOST_CHECK_EQUAL(decompressor->decompress(reinterpret_cast<const uint8_t *>(compressed.data()), n, out), sizeof(garbage));
+    BOOST_CHECK(std::equal(garbage, garbage + sizeof(garbage), out.begin()));
+}
+
+void testCodecRegistry() {
+    std::vector<std::string> names = avro::codecNames();
+    BOOST_CHECK(std::find(names.begin(), names.end(), "null") != names.end());
+    BOOST_CHECK(std::find(names.begin(), names.end(), "deflate") != names.end());
+    BOOST_CHECK_EQUAL(avro::blockCodec(avro::DEFLATE_CODEC)->name(), "deflate");
+    BOOST_CHECK(!avro::findCodec("test-reversing"));
+
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    const char *filename = "test_codecRegistry.df";
+    const int numberOfRecords = 1000;
+    {
+        avro::DataFileWriter<TestRecord> df(filename, writerSchema, 1024,
+                                            std::make_shared<ReversingCodec>());
+        df.write(TestRecord("abcdefghij", 0));
+    }
+    // Files are not readable until their codec is registered.
+    BOOST_CHECK_THROW(avro::DataFileReader<TestRecord>(filename, writerSchema), avro::Exception);
+
+    std::shared_ptr<ReversingCodec> codec = std::make_shared<ReversingCodec>();
+    avro::registerCodec(codec);
+    BOOST_CHECK(avro::findCodec("test-reversing") == codec);
+    {
+        avro::DataFileWriter<TestRecord> df(filename, writerSchema, 1024,
+                                            avro::findCodec("test-reversing"));
+        for (int i = 0; i < numberOfRecords; i++) {
+            df.write(TestRecord("abcdefghij", i));
+        }
+        df.close();
+    }
+    BOOST_CHECK_GT(codec->blocks, 1);
+    {
+        avro::DataFileReader<TestRecord> df(filename, writerSchema);
+        TestRecord r("", 0);
+        int i = 0;
+        while (df.read(r)) {
+            BOOST_CHECK_EQUAL(r.id, i);
+            ++i;
+        }
+        BOOST_CHECK_EQUAL(i, numberOfRecords);
+    }
+    {
+        avro::DataFileBlockReader reader(filename);
+        BOOST_CHECK_EQUAL(reader.codecName(), "test-reversing");
+        BOOST_CHECK_THROW(reader.codec(), avro::Exception);
+    }
+    BOOST_CHECK(boost::filesystem::remove(filename));
+}
+
+void testBlockStatistics() {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    BOOST_CHECK_THROW(avro::BlockStatisticsCollector(writerSchema, {"nonexistent"}), avro::Exception);
+
+    const char *filename = "test_blockStatistics.df";
+    const std::string statsFilename = std::string(filename) + ".stats";
+    const int numberOfRecords = 1000;
+    for (size_t threads = 0; threads < 3; threads += 2) {
+        {
+            avro::DataFileWriter<TestRecord> df(filename, writerSchema, 1024, avro::DEFLATE_CODEC);
+            df.setBlockStatistics({"id", "s1"});
+            df.setCompressionThreads(threads);
+            for (int i = 0; i < numberOfRecords; i++) {
+                df.write(TestRecord(i % 2 == 0 ? "even" : "odd", i));
+            }
+            df.close();
+        }
+        std::vector<avro::BlockStatistics> stats = avro::readBlockStatistics(statsFilename);
+        BOOST_REQUIRE_GT(stats.size(), 2);
+        int64_t count = 0;
+        int64_t next = 0;
+        for (const auto &b : stats) {
+            const avro::FieldStatistics *id = b.field("id");
+            BOOST_REQUIRE(id != nullptr);
+            BOOST_CHECK_EQUAL(id->min.value<int64_t>(), next);
+            BOOST_CHECK_EQUAL(id->max.value<int64_t>(), next + b.objectCount - 1);
+            BOOST_CHECK_EQUAL(b.field("s1")->min.value<std::string>(), "even");
+            BOOST_CHECK_EQUAL(b.field("s1")->max.value<std::string>(), "odd");
+            next += b.objectCount;
+            count += b.objectCount;
+        }
+        BOOST_CHECK_EQUAL(count, numberOfRecords);
+
+        for (size_t readThreads = 0; readThreads < 3; readThreads += 2) {
+            avro::DataFileReader<TestRecord> df(filename, writerSchema);
+            df.setDecompressionThreads(readThreads);
+            df.setBlockFilter(stats, [](const avro::BlockStatistics &b) {
+                return b.overlaps("id", avro::GenericDatum(int64_t(500)), avro::GenericDatum(int64_t(520)));
+            });
+            TestRecord r("", 0);
+            int read = 0;
+            bool found = false;
+            while (df.read(r)) {
+                found = found || r.id == 510;
+                ++read;
+            }
+            BOOST_CHECK(found);
+            BOOST_CHECK_GT(read, 20);
+            BOOST_CHECK_LT(read, numberOfRecords / 2);
+        }
+    }
+    {
+        avro::DataFileReader<TestRecord> df(filename, writerSchema);
+        std::vector<avro::BlockStatistics> stats = avro::readBlockStatistics(statsFilename);
+        // Rejecting every block, including the current one, reads nothing.
+        df.setBlockFilter(stats, [](const avro::BlockStatistics &b) {
+            return b.overlaps("s1", avro::GenericDatum(std::string("p")), avro::GenericDatum());
+        });
+        TestRecord r("", 0);
+        BOOST_CHECK(!df.read(r));
+    }
+    BOOST_CHECK(boost::filesystem::remove(filename));
+    BOOST_CHECK(boost::filesystem::remove(statsFilename));
+}
+
+void testRecordFilter() {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    auto third = [](const std::vector<avro::GenericDatum> &v) {
+        return v[0].value<int64_t>() % 3 == 0 && v[1].value<std::string>() == "even";
+    };
+    BOOST_CHECK_THROW(avro::RecordFilter(writerSchema, {"nonexistent"}, third), avro::Exception);
+
+    const char *filename = "test_recordFilter.df";
+    const int numberOfRecords = 1000;
+    for (avro::Codec codec : {avro::NULL_CODEC, avro::DEFLATE_CODEC}) {
+        {
+            avro::DataFileWriter<TestRecord> df(filename, writerSchema, 1024, codec);
+            for (int i = 0; i < numberOfRecords; i++) {
+                df.write(TestRecord(i % 2 == 0 ? "even" : "odd", i));
+            }
+            df.close();
+        }
+        for (size_t threads = 0; threads < 3; threads += 2) {
+            avro::DataFileReader<TestRecord> df(filename, writerSchema);
+            df.setDecompressionThreads(threads);
+            TestRecord r("", 0);
+            // Set once some records of the first block have been read.
+            for (int i = 0; i < 5; ++i) {
+                BOOST_REQUIRE(df.read(r));
+            }
+            df.setRecordFilter({"id", "s1"}, third);
+            int64_t expected = 6;
+            while (df.read(r)) {
+                BOOST_CHECK_EQUAL(r.id, expected);
+                BOOST_CHECK_EQUAL(r.s1, "even");
+                expected += 6;
+            }
+            BOOST_CHECK_EQUAL(expected, 1002);
+            avro::DataFileStats stats = df.stats();
+            BOOST_CHECK_EQUAL(stats.filteredObjects, numberOfRecords - 5 - 166);
+        }
+        {
+            avro::DataFileReader<TestRecord> df(filename, writerSchema);
+            df.setRecordFilter({"s1", "id"}, [](const std::vector<avro::GenericDatum> &v) {
+                return v[1].value<int64_t>() % 100 < 10 && v[0].value<std::string>() == "odd";
+            });
+            TestRecord r("", 0);
+            std::vector<int64_t> ids;
+            while (df.read(r)) {
+                ids.push_back(r.id);
+            }
+            BOOST_REQUIRE_EQUAL(ids.size(), 50u);
+            BOOST_CHECK_EQUAL(ids.front(), 1);
+            BOOST_CHECK_EQUAL(ids.back(), 909);
+        }
+        {
+            // Dropping the filter reads the rest as it is.
+            avro::DataFileReader<TestRecord> df(filename, writerSchema);
+            df.setRecordFilter({"id", "s1"}, third);
+            TestRecord r("", 0);
+            BOOST_REQUIRE(df.read(r));
+            BOOST_CHECK_EQUAL(r.id, 0);
+            BOOST_REQUIRE(df.read(r));
+            BOOST_CHECK_EQUAL(r.id, 6);
+            df.setRecordFilter({}, avro::RecordPredicate());
+            int64_t expected = 7;
+            while (df.read(r)) {
+                BOOST_CHECK_EQUAL(r.id, expected++);
+            }
+            BOOST_CHECK_EQUAL(expected, numberOfRecords);
+        }
+    }
+    {
+        avro::ValidSchema schema = avro::compileJsonSchemaFromString(sch);
+        {
+            avro::DataFileWriter<ComplexInteger> df(filename, schema, 100);
+            for (int64_t i = 0; i < numberOfRecords; i++) {
+                df.write(ComplexInteger(i, -i));
+            }
+        }
+        avro::DataFileReader<ComplexInteger> df(filename, schema);
+        df.setRecordFilter({"im"}, [](const std::vector<avro::GenericDatum> &v) {
+            return v[0].value<int64_t>() % 10 == 0;
+        });
+        std::vector<ComplexInteger> items;
+        int64_t i = 0;
+        for (size_t n; (n = df.readBatch(items, 7)) != 0;) {
+            BOOST_REQUIRE_LE(n, 7U);
+            for (const ComplexInteger &c : items) {
+                BOOST_CHECK_EQUAL(c.re, i);
+                i += 10;
+            }
+        }
+        BOOST_CHECK_EQUAL(i, numberOfRecords);
+
+        // The filter looks at a field that the reader's schema drops.
+        avro::DataFileReader<Integer> di(filename, avro::compileJsonSchemaFromString(isch));
+        di.setRecordFilter({"im"}, [](const std::vector<avro::GenericDatum> &v) {
+            return v[0].value<int64_t>() % 7 == 0;
+        });
+        Integer n;
+        i = 0;
+        while (di.read(n)) {
+            BOOST_CHECK_EQUAL(n.re, i);
+            i += 7;
+        }
+        BOOST_CHECK_EQUAL(i, 1001);
+    }
+    BOOST_CHECK(boost::filesystem::remove(filename));
+}
+
+void testReadFromMemory() {
+    avro::ValidSchema schema = avro::compileJsonSchemaFromString(sch);
+    const char *filename = "test_readFromMemory.df";
+    for (avro::Codec codec : {avro::NULL_CODEC, avro::DEFLATE_CODEC}) {
+        {
+            avro::DataFileWriter<ComplexInteger> df(filename, schema, 100, codec);
+            for (int64_t i = 0; i < 1000; i++) {
+                df.write(ComplexInteger(i, -i));
+            }
+        }
+        std::ifstream in(filename, std::ios::binary);
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+        avro::DataFileReader<ComplexInteger> df(data.data(), data.size(), schema);
+        ComplexInteger c;
+        int64_t i = 0;
+        // The start of each block and its first object.
+        std::vector<std::pair<int64_t, int64_t>> blocks;
+        while (df.read(c)) {
+            BOOST_CHECK_EQUAL(c.re, i);
+            BOOST_CHECK_EQUAL(c.im, -i);
+            if (blocks.empty() || blocks.back().first != df.previousSync()) {
+                blocks.emplace_back(df.previousSync(), i);
+            }
+            ++i;
+        }
+        BOOST_CHECK_EQUAL(i, 1000);
+        BOOST_CHECK_EQUAL(df.stats().objects, 1000);
+        BOOST_REQUIRE_GT(blocks.size(), 2u);
+
+        // Seeking works on the memory too.
+        const std::pair<int64_t, int64_t> &mid = blocks[blocks.size() / 2];
+        df.seek(mid.first);
+        BOOST_REQUIRE(df.read(c));
+        BOOST_CHECK_EQUAL(c.re, mid.second);
+
+        // With the reader's projection.
+        avro::DataFileReader<Integer> di(data.data(), data.size(), avro::compileJsonSchemaFromString(isch));
+        Integer n;
+        i = 0;
+        while (di.read(n)) {
+            BOOST_CHECK_EQUAL(n.re, i++);
+        }
+        BOOST_CHECK_EQUAL(i, 1000);
+
+        // A truncated file fails once its last block is reached.
+        avro::DataFileReader<ComplexInteger> dt(data.data(), data.size() - 20);
+        BOOST_CHECK_THROW(while (dt.read(c)) {}, avro::Exception);
+    }
+    BOOST_CHECK(boost::filesystem::remove(filename));
+}
+
+// Completes reads only when asked to, as an event loop would.
+class DeferredAsyncInputStream : public avro::AsyncInputStream {
+    const std::vector<uint8_t> &data_;
+    std::deque<std::function<void()>> pending_;
+
+public:
+    size_t reads;
+    size_t maxPending;
+    bool fail;
+
+    explicit DeferredAsyncInputStream(const std::vector<uint8_t> &data) : data_(data), reads(0), maxPending(0), fail(false) {}
+
+    void read(int64_t offset, size_t len, ReadHandler handler) override {
+        ++reads;
+        maxPending = std::max(maxPending, pending_.size() + 1);
+        pending_.push_back([this, offset, len, handler]() {
+            if (fail) {
+                handler(std::make_exception_ptr(avro::Exception("Read failed")), std::vector<uint8_t>());
+                return;
+            }
+            size_t from = std::min(static_cast<size_t>(offset), data_.size());
+            size_t to = std::min(from + len, data_.size());
+            handler(nullptr, std::vector<uint8_t>(data_.begin() + from, data_.begin() + to));
+        });
+    }
+
+    bool complete() {
+        if (pending_.empty()) {
+            return false;
+        }
+        std::function<void()> f = std::move(pending_.front());
+        pending_.pop_front();
+        f();
+        return true;
+    }
+
+    // Completes the latest read first.
+    bool completeLast() {
+        if (pending_.empty()) {
+            return false;
+        }
+        std::function<void()> f = std::move(pending_.back());
+        pending_.pop_back();
+        f();
+        return true;
+    }
+};
+
+void testAsyncReader() {
+    avro::ValidSchema schema = avro::compileJsonSchemaFromString(sch);
+    const char *filename = "test_asyncReader.df";
+    std::vector<std::vector<uint8_t>> files;
+    for (avro::Codec codec : {avro::NULL_CODEC, avro::DEFLATE_CODEC}) {
+        {
+            avro::DataFileWriter<ComplexInteger> df(filename, schema, 100, codec);
+            for (int64_t i = 0; i < 1000; i++) {
+                df.write(ComplexInteger(i, -i));
+            }
+        }
+        std::ifstream in(filename, std::ios::binary);
+        files.emplace_back((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    }
+
+    // One thread drives both scans, completing their reads in turn.
+    std::vector<std::shared_ptr<DeferredAsyncInputStream>> streams;
+    std::vector<std::unique_ptr<avro::AsyncDataFileReader<ComplexInteger>>> readers;
+    std::vector<int64_t> counts(files.size(), 0);
+    std::vector<int> done(files.size(), 0);
+    for (size_t k = 0; k < files.size(); ++k) {
+        streams.push_back(std::make_shared<DeferredAsyncInputStream>(files[k]));
+        readers.emplace_back(new avro::AsyncDataFileReader<ComplexInteger>(streams[k], 256));
+        readers[k]->start([&counts, k](ComplexInteger &c) {
+            BOOST_CHECK_EQUAL(c.re, counts[k]);
+            BOOST_CHECK_EQUAL(c.im, -counts[k]);
+            ++counts[k];
+        },
+                          [&done, k](std::exception_ptr error) {
+                              BOOST_CHECK(!error);
+                              ++done[k];
+                          });
+        BOOST_CHECK_EQUAL(counts[k], 0);
+    }
+    for (bool more = true; more;) {
+        more = false;
+        for (const std::shared_ptr<DeferredAsyncInputStream> &s : streams) {
+            more = s->complete() || more;
+        }
+    }
+    for (size_t k = 0; k < files.size(); ++k) {
+        BOOST_CHECK_EQUAL(counts[k], 1000);
+        BOOST_CHECK_EQUAL(done[k], 1);
+        BOOST_CHECK_GT(streams[k]->reads, 2u);
+        BOOST_CHECK_EQUAL(readers[k]->dataSchema().toJson(false), schema.toJson(false));
+    }
+
+    // Reads completing before they return, with the reader's projection.
+    {
+        std::unique_ptr<avro::SeekableInputStream> in = avro::fileSeekableInputStream(filename);
+        avro::AsyncDataFileReader<Integer> reader(avro::asyncInputStream(std::move(in)),
+                                                  avro::compileJsonSchemaFromString(isch), 64);
+        int64_t i = 0;
+        bool finished = false;
+        reader.start([&i](Integer &n) { BOOST_CHECK_EQUAL(n.re, i++); },
+                     [&finished](std::exception_ptr error) {
+                         BOOST_CHECK(!error);
+                         finished = true;
+                     });
+        BOOST_CHECK(finished);
+        BOOST_CHECK_EQUAL(i, 1000);
+    }
+
+    // Truncated data and failed reads end the scan with the error.
+    {
+        std::vector<uint8_t> truncated(files[0].begin(), files[0].end() - 20);
+        DeferredAsyncInputStream s(truncated);
+        std::shared_ptr<DeferredAsyncInputStream> stream(&s, [](DeferredAsyncInputStream *) {});
+        avro::AsyncDataFileReader<ComplexInteger> reader(stream, 256);
+        std::exception_ptr failure;
+        int calls = 0;
+        reader.start([](ComplexInteger &) {},
+                     [&failure, &calls](std::exception_ptr error) {
+                         failure = error;
+                         ++calls;
+                     });
+        while (s.complete()) {
+        }
+        BOOST_CHECK_EQUAL(calls, 1);
+        BOOST_CHECK_THROW(std::rethrow_exception(failure), avro::Exception);
+    }
+    {
+        DeferredAsyncInputStream s(files[1]);
+        std::shared_ptr<DeferredAsyncInputStream> stream(&s, [](DeferredAsyncInputStream *) {});
+        avro::AsyncDataFileReader<ComplexInteger> reader(stream, 256);
+        std::exception_ptr failure;
+        int64_t n = 0;
+        reader.start([&n, &s](ComplexInteger &) {
+            if (++n == 10) {
+                s.fail = true;
+            }
+        },
+                     [&failure](std::exception_ptr error) { failure = error; });
+        while (s.complete()) {
+        }
+        BOOST_CHECK_LT(n, 1000);
+        BOOST_CHECK_THROW(std::rethrow_exception(failure), avro::Exception);
+    }
+    BOOST_CHECK(boost::filesystem::remove(filename));
+}
+
+void testAsyncPrefetch() {
+    avro::ValidSchema schema = avro::compileJsonSchemaFromString(sch);
+    const char *filename = "test_asyncPrefetch.df";
+    {
+        avro::DataFileWriter<ComplexInteger> df(filename, schema, 100);
+        for (int64_t i = 0; i < 1000; i++) {
+            df.write(ComplexInteger(i, -i));
+        }
+    }
+    std::ifstream in(filename, std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    std::vector<avro::DataFileBlock> blocks;
+    {
+        avro::DataFileBlockReader br(filename);
+        avro::DataFileBlock b;
+        while (br.next(b)) {
+            blocks.push_back(b);
+        }
+    }
+    BOOST_REQUIRE_GT(blocks.size(), 10u);
+
+    // Reads completing out of order still hand the blocks over in order.
+    {
+        DeferredAsyncInputStream s(data);
+        std::shared_ptr<DeferredAsyncInputStream> stream(&s, [](DeferredAsyncInputStream *) {});
+        avro::AsyncDataFileReader<ComplexInteger> reader(stream, 64, 4);
+        int64_t i = 0;
+        bool finished = false;
+        reader.start([&i](ComplexInteger &c) { BOOST_CHECK_EQUAL(c.re, i++); },
+                     [&finished](std::exception_ptr error) {
+                         BOOST_CHECK(!error);
+                         finished = true;
+                     });
+        while (s.completeLast()) {
+        }
+        BOOST_CHECK(finished);
+        BOOST_CHECK_EQUAL(i, 1000);
+        BOOST_CHECK_EQUAL(s.maxPending, 4u);
+    }
+
+    // Small blocks are fetched together.
+    {
+        DeferredAsyncInputStream s(data);
+        std::shared_ptr<DeferredAsyncInputStream> stream(&s, [](DeferredAsyncInputStream *) {});
+        avro::AsyncDataFileReader<ComplexInteger> reader(stream, 4096, 2);
+        int64_t i = 0;
+        reader.start([&i](ComplexInteger &) { ++i; }, [](std::exception_ptr error) { BOOST_CHECK(!error); });
+        while (s.complete()) {
+        }
+        BOOST_CHECK_EQUAL(i, 1000);
+        BOOST_CHECK_LT(s.reads, blocks.size() / 2);
+    }
+
+    // Starting at a block skips the reads before it.
+    {
+        const avro::DataFileBlock &mid = blocks[blocks.size() / 2];
+        int64_t first = 0;
+        for (size_t k = 0; k < blocks.size() / 2; ++k) {
+            first += blocks[k].objectCount;
+        }
+        DeferredAsyncInputStream s(data);
+        std::shared_ptr<DeferredAsyncInputStream> stream(&s, [](DeferredAsyncInputStream *) {});
+        avro::AsyncDataFileReader<ComplexInteger> reader(stream, 64, 3);
+        reader.seek(mid.offset);
+        int64_t i = first;
+        reader.start([&i](ComplexInteger &c) { BOOST_CHECK_EQUAL(c.re, i++); },
+                     [](std::exception_ptr error) { BOOST_CHECK(!error); });
+        while (s.complete()) {
+        }
+        BOOST_CHECK_EQUAL(i, 1000);
+    }
+    BOOST_CHECK(boost::filesystem::remove(filename));
+}
+
+static const char *columnarSchema = R"({"type":"record","name":"R","fields":[
+        {"name":"id","type":"long"},
+        {"name":"name","type":"string"},
+        {"name":"flag","type":"boolean"},
+        {"name":"score","type":["null","double"]},
+        {"name":"e","type":{"type":"enum","name":"E","symbols":["A","B","C"]}},
+        {"name":"in","type":{"type":"record","name":"In","fields":[
+            {"name":"x","type":"int"},
+            {"name":"f","type":{"type":"fixed","name":"F","size":2}}]}},
+        {"name":"opt","type":["null",{"type":"record","name":"Opt","fields":[
+            {"name":"y","type":"string"}]}]}]})";
+
+void testColumnarBatchReader() {
+    avro::ValidSchema writerSchema = avro::compileJsonSchemaFromString(columnarSchema);
+    const char *filename = "test_columnar.df";
+    const int numberOfRecords = 1000;
+    {
+        avro::DataFileWriter<avro::GenericDatum> df(filename, writerSchema, 2048);
+        avro::GenericDatum d(writerSchema);
+        avro::GenericRecord &r = d.value<avro::GenericRecord>();
+        for (int i = 0; i < numberOfRecords; i++) {
+            r.fieldAt(0).value<int64_t>() = i;
+            r.fieldAt(1).value<std::string>() = std::string(static_cast<size_t>(i % 5), 'a');
+            r.fieldAt(2).value<bool>() = i % 3 == 0;
+            r.fieldAt(3).selectBranch(i % 4 == 0 ? 0 : 1);
+            if (i % 4 != 0) {
+                r.fieldAt(3).value<double>() = i / 2.0;
+            }
+            r.fieldAt(4).value<avro::GenericEnum>().set(static_cast<size_t>(i % 3));
+            avro::GenericRecord &in = r.fieldAt(5).value<avro::GenericRecord>();
+            in.fieldAt(0).value<int32_t>() = -i;
+            in.fieldAt(1).value<avro::GenericFixed>().value() = {static_cast<uint8_t>(i), static_cast<uint8_t>(i >> 8)};
+            r.fieldAt(6).selectBranch(i % 2);
+            if (i % 2 == 1) {
+                r.fieldAt(6).value<avro::GenericRecord>().fieldAt(0).value<std::string>() = std::to_string(i);
+            }
+            df.write(d);
+        }
+        df.close();
+    }
+
+    avro::ColumnarBatchReader reader(filename);
+    avro::ColumnarBatch batch;
+    BOOST_REQUIRE(reader.next(batch, 100));
+    BOOST_REQUIRE_EQUAL(batch.columns.size(), 8U);
+    const char *names[] = {"id", "name", "flag", "score", "e", "in.x", "in.f", "opt.y"};
+    for (size_t i = 0; i < 8; ++i) {
+        BOOST_CHECK_EQUAL(batch.columnIndex(names[i]), static_cast<int>(i));
+    }
+    BOOST_CHECK(!batch.columns[0].nullable);
+    BOOST_CHECK(batch.columns[3].nullable);
+    BOOST_CHECK(batch.columns[7].nullable);
+    BOOST_CHECK_EQUAL(batch.columns[4].symbols.size(), 3U);
+    BOOST_CHECK_EQUAL(batch.columns[6].fixedSize, 2U);
+
+    int64_t row = 0;
+    size_t batches = 0;
+    do {
+        BOOST_REQUIRE_LE(batch.length, 100U);
+        ++batches;
+        for (const avro::Column &c : batch.columns) {
+            BOOST_CHECK_EQUAL(c.length, batch.length);
+        }
+        const avro::Column &id = batch.columns[0];
+        const avro::Column &name = batch.columns[1];
+        const avro::Column &flag = batch.columns[2];
+        const avro::Column &score = batch.columns[3];
+        const avro::Column &e = batch.columns[4];
+        const avro::Column &x = batch.columns[5];
+        const avro::Column &f = batch.columns[6];
+        const avro::Column &y = batch.columns[7];
+        BOOST_REQUIRE_EQUAL(id.values.size(), batch.length * 8);
+        BOOST_REQUIRE_EQUAL(name.offsets.size(), batch.length + 1);
+        BOOST_REQUIRE_EQUAL(y.offsets.size(), batch.length + 1);
+        BOOST_CHECK_EQUAL(f.values.size(), batch.length * 2);
+        size_t scoreNulls = 0;
+        size_t yNulls = 0;
+        for (size_t j = 0; j < batch.length; ++j, ++row) {
+            int64_t v;
+            memcpy(&v, &id.values[j * 8], 8);
+            BOOST_CHECK_EQUAL(v, row);
+            BOOST_CHECK_EQUAL(name.offsets[j + 1] - name.offsets[j], row % 5);
+            BOOST_CHECK_EQUAL((flag.values[j / 8] >> (j % 8)) & 1, row % 3 == 0 ? 1 : 0);
+            bool valid = (score.validity[j / 8] >> (j % 8)) & 1;
+            BOOST_CHECK_EQUAL(valid, row % 4 != 0);
+            double dv;
+            memcpy(&dv, &score.values[j * 8], 8);
+            BOOST_CHECK_EQUAL(dv, valid ? row / 2.0 : 0.0);
+            scoreNulls += valid ? 0 : 1;
+            int32_t ev;
+            memcpy(&ev, &e.values[j * 4], 4);
+            BOOST_CHECK_EQUAL(ev, row % 3);
+            int32_t xv;
+            memcpy(&xv, &x.values[j * 4], 4);
+            BOOST_CHECK_EQUAL(xv, -row);
+            BOOST_CHECK_EQUAL(f.values[j * 2], static_cast<uint8_t>(row));
+            bool yValid = (y.validity[j / 8] >> (j % 8)) & 1;
+            BOOST_CHECK_EQUAL(yValid, row % 2 == 1);
+            std::string yv(y.values.begin() + y.offsets[j], y.values.begin() + y.offsets[j + 1]);
+            BOOST_CHECK_EQUAL(yv, yValid ? std::to_string(row) : std::string());
+            yNulls += yValid ? 0 : 1;
+        }
+        BOOST_CHECK_EQUAL(score.nullCount, scoreNulls);
+        BOOST_CHECK_EQUAL(y.nullCount, yNulls);
+    } while (reader.next(batch, 100));
+    BOOST_CHECK_EQUAL(row, numberOfRecords);
+    BOOST_CHECK_GT(batches, 10U);
+    BOOST_CHECK_EQUAL(batch.length, 0U);
+
+    // Resolved against a reader schema that drops and adds fields.
+    const char *readerJson = R"({"type":"record","name":"R","fields":[
+        {"name":"extra","type":"int","default":7},
+        {"name":"in","type":{"type":"record","name":"In","fields":[
+            {"name":"x","type":"long"}]}},
+        {"name":"id","type":"long"}]})";
+    avro::ValidSchema readerSchema = avro::compileJsonSchemaFromString(readerJson);
+    std::unique_ptr<avro::DataFileReaderBase> base(new avro::DataFileReaderBase(filename));
+    avro::ColumnarBatchReader resolved(std::move(base), readerSchema);
+    row = 0;
+    while (resolved.next(batch, 0)) {
+        BOOST_REQUIRE_EQUAL(batch.columns.size(), 3U);
+        for (size_t j = 0; j < batch.length; ++j, ++row) {
+            int32_t extra;
+            int64_t x;
+            int64_t id;
+            memcpy(&extra, &batch.columns[0].values[j * 4], 4);
+            memcpy(&x, &batch.columns[1].values[j * 8], 8);
+            memcpy(&id, &batch.columns[2].values[j * 8], 8);
+            BOOST_CHECK_EQUAL(extra, 7);
+            BOOST_CHECK_EQUAL(x, -row);
+            BOOST_CHECK_EQUAL(id, row);
+        }
+    }
+    BOOST_CHECK_EQUAL(row, numberOfRecords);
+    BOOST_CHECK(boost::filesystem::remove(filename));
+
+    avro::ValidSchema arrays = avro::compileJsonSchemaFromString(
+        R"({"type":"record","name":"A","fields":[{"name":"a","type":{"type":"array","items":"int"}}]})");
+    {
+        avro::DataFileWriter<avro::GenericDatum> df(filename, arrays);
+        df.close();
+    }
+    BOOST_CHECK_THROW(avro::ColumnarBatchReader r(filename), avro::Exception);
+    BOOST_CHECK(boost::filesystem::remove(filename));
+}
+
+void testColumnarBatchWriter() {
+    avro::ValidSchema schema = avro::compileJsonSchemaFromString(columnarSchema);
+    const char *filename = "test_columnarWriter.df";
+    const char *copyname = "test_columnarWriterCopy.df";
+    const size_t rows = 300;
+    {
+        avro::ColumnarBatchWriter w(filename, schema, 1024);
+        avro::ColumnarBatch batch = w.batch();
+        BOOST_REQUIRE_EQUAL(batch.columns.size(), 8U);
+        batch.length = rows;
+        for (avro::Column &c : batch.columns) {
+            c.length = rows;
+        }
+        avro::Column &id = batch.columns[0];
+        avro::Column &name = batch.columns[1];
+        avro::Column &flag = batch.columns[2];
+        avro::Column &score = batch.columns[3];
+        avro::Column &e = batch.columns[4];
+        avro::Column &x = batch.columns[5];
+        avro::Column &f = batch.columns[6];
+        avro::Column &y = batch.columns[7];
+        flag.values.resize((rows + 7) / 8);
+        score.validity.resize((rows + 7) / 8);
+        y.validity.resize((rows + 7) / 8);
+        for (size_t i = 0; i < rows; ++i) {
+            int64_t v = static_cast<int64_t>(i) * 3;
+            id.values.insert(id.values.end(), reinterpret_cast<uint8_t *>(&v), reinterpret_cast<uint8_t *>(&v) + 8);
+            std::string str = std::to_string(i);
+            name.values.insert(name.values.end(), str.begin(), str.end());
+            name.offsets.push_back(static_cast<int32_t>(name.values.size()));
+            if (i % 2 == 0) {
+                flag.values[i / 8] |= static_cast<uint8_t>(1 << (i % 8));
+            }
+            double dv = i * 0.5;
+            score.values.insert(score.values.end(), reinterpret_cast<uint8_t *>(&dv), reinterpret_cast<uint8_t *>(&dv) + 8);
+            if (i % 3 != 0) {
+                score.validity[i / 8] |= static_cast<uint8_t>(1 << (i % 8));
+            }
+            int32_t ev = static_cast<int32_t>(i % 3);
+            e.values.insert(e.values.end(), reinterpret_cast<uint8_t *>(&ev), reinterpret_cast<uint8_t *>(&ev) + 4);
+            int32_t xv = static_cast<int32_t>(i);
+            x.values.insert(x.values.end(), reinterpret_cast<uint8_t *>(&xv), reinterpret_cast<uint8_t *>(&xv) + 4);
+            f.values.push_back(static_cast<uint8_t>(i));
+            f.values.push_back(7);
+            if (i % 5 == 0) {
+                y.values.push_back('y');
+                y.validity[i / 8] |= static_cast<uint8_t>(1 << (i % 8));
+            }
+            y.offsets.push_back(static_cast<int32_t>(y.values.size()));
+        }
+        w.write(batch);
+
+        avro::ColumnarBatch bad = batch;
+        bad.columns[1].offsets.pop_back();
+        BOOST_CHECK_THROW(w.write(bad), avro::Exception);
+        bad = batch;
+        std::swap(bad.columns[0], bad.columns[1]);
+        BOOST_CHECK_THROW(w.write(bad), avro::Exception);
+        bad = batch;
+        bad.columns[4].values[0] = 9;
+        BOOST_CHECK_THROW(w.write(bad), avro::Exception);
+        w.close();
+    }
+    {
+        avro::DataFileReader<avro::GenericDatum> df(filename);
+        avro::GenericDatum d(df.dataSchema());
+        size_t i = 0;
+        for (; df.read(d); ++i) {
+            const avro::GenericRecord &r = d.value<avro::GenericRecord>();
+            BOOST_CHECK_EQUAL(r.fieldAt(0).value<int64_t>(), static_cast<int64_t>(i) * 3);
+            BOOST_CHECK_EQUAL(r.fieldAt(1).value<std::string>(), std::to_string(i));
+            BOOST_CHECK_EQUAL(r.fieldAt(2).value<bool>(), i % 2 == 0);
+            BOOST_CHECK_EQUAL(r.fieldAt(3).unionBranch(), i % 3 == 0 ? 0U : 1U);
+            if (i % 3 != 0) {
+                BOOST_CHECK_EQUAL(r.fieldAt(3).value<double>(), i * 0.5);
+            }
+            BOOST_CHECK_EQUAL(r.fieldAt(4).value<avro::GenericEnum>().value(), i % 3);
+            const avro::GenericRecord &in = r.fieldAt(5).value<avro::GenericRecord>();
+            BOOST_CHECK_EQUAL(in.fieldAt(0).value<int32_t>(), static_cast<int32_t>(i));
+            BOOST_CHECK_EQUAL(in.fieldAt(1).value<avro::GenericFixed>().value()[0], static_cast<uint8_t>(i));
+            BOOST_CHECK_EQUAL(r.fieldAt(6).unionBranch(), i % 5 == 0 ? 1U : 0U);
+            if (i % 5 == 0) {
+                BOOST_CHECK_EQUAL(r.fieldAt(6).value<avro::GenericRecord>().fieldAt(0).value<std::string>(), "y");
+            }
+        }
+        BOOST_CHECK_EQUAL(i, rows);
+    }
+
+    // What is read back in columns writes the same rows again.
+    {
+        avro::ColumnarBatchReader r(filename);
+        avro::ColumnarBatchWriter w(copyname, schema, 1024);
+        avro::ColumnarBatch batch;
+        while (r.next(batch)) {
+            w.write(batch);
+        }
+        w.close();
+    }
+    {
+        avro::ColumnarBatchReader r1(filename);
+        avro::ColumnarBatchReader r2(copyname);
+        avro::ColumnarBatch b1;
+        avro::ColumnarBatch b2;
+        while (r1.next(b1, 0)) {
+            BOOST_REQUIRE(r2.next(b2, 0));
+            BOOST_REQUIRE_EQUAL(b1.length, b2.length);
+            for (size_t c = 0; c < b1.columns.size(); ++c) {
+                BOOST_CHECK(b1.columns[c].validity == b2.columns[c].validity);
+                BOOST_CHECK(b1.columns[c].values == b2.columns[c].values);
+                BOOST_CHECK(b1.columns[c].offsets == b2.columns[c].offsets);
+            }
+        }
+        BOOST_CHECK(!r2.next(b2));
+    }
+    BOOST_CHECK(boost::filesystem::remove(filename));
+    BOOST_CHECK(boost::filesystem::remove(copyname));
+}
+
+void testBlockIndex() {
+    avro::ValidSchema writerSchema = avro::compileJsonSchemaFromString(sch);
+    const char *filename = "test_blockIndex.df";
+    const std::string indexFilename = std::string(filename) + ".idx";
+    const int numberOfRecords = 1000;
+    for (size_t threads = 0; threads < 3; threads += 2) {
+        {
+            avro::DataFileWriter<ComplexInteger> df(filename, writerSchema, 100, avro::DEFLATE_CODEC);
+            df.setBlockIndex();
+            df.setCompressionThreads(threads);
+            for (int i = 0; i < numberOfRecords; i++) {
+                df.write(ComplexInteger(i, -i));
+            }
+            df.close();
+        }
+        avro::DataFileIndex index = avro::readDataFileIndex(indexFilename);
+        BOOST_CHECK_GT(index.entries().size(), 10);
+        BOOST_CHECK_EQUAL(index.objectCount(), numberOfRecords);
+        avro::DataFileIndex built = avro::buildDataFileIndex(filename);
+        BOOST_REQUIRE_EQUAL(built.entries().size(), index.entries().size());
+        for (size_t i = 0; i < index.entries().size(); ++i) {
+            BOOST_CHECK_EQUAL(built.entries()[i].offset, index.entries()[i].offset);
+            BOOST_CHECK_EQUAL(built.entries()[i].firstObject, index.entries()[i].firstObject);
+        }
+
+        avro::DataFileReader<ComplexInteger> df(filename, writerSchema);
+        BOOST_CHECK_THROW(df.seekToRecord(0), avro::Exception);
+        df.setIndex(index);
+        ComplexInteger c;
+        for (int64_t n : {777, 3, 0, 999, 500}) {
+            BOOST_REQUIRE(df.seekToRecord(n));
+            BOOST_REQUIRE(df.read(c));
+            BOOST_CHECK_EQUAL(c.re, n);
+        }
+        BOOST_CHECK(df.read(c));
+        BOOST_CHECK_EQUAL(c.re, 501);
+        BOOST_CHECK(!df.seekToRecord(numberOfRecords));
+        BOOST_CHECK(!df.seekToRecord(-1));
+    }
+    {
+        // Too late once blocks are out.
+        avro::DataFileWriter<ComplexInteger> df(filename, writerSchema, 100);
+        df.write(ComplexInteger(1, 2));
+        df.flush();
+        BOOST_CHECK_THROW(df.setBlockIndex(), avro::Exception);
+    }
+    BOOST_CHECK(boost::filesystem::remove(filename));
+    BOOST_CHECK(boost::filesystem::remove(indexFilename));
+}
+
+void testTryRead() {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    const char *filename = "test_tryRead.df";
+    {
+        avro::DataFileWriter<TestRecord> df(filename, writerSchema, 100);
+        for (int64_t i = 0; i < 50; i++) {
+            df.write(TestRecord("ok", i));
+        }
+    }
+    {
+        // Checking starts in a block that is being read as it is decoded.
+        avro::DataFileReader<TestRecord> df(filename, writerSchema);
+        TestRecord r("", 0);
+        BOOST_REQUIRE(df.read(r));
+        BOOST_REQUIRE(df.read(r));
+        avro::DecodeStatus status;
+        int64_t expected = 2;
+        while (df.tryRead(r, status)) {
+            BOOST_CHECK_EQUAL(r.id, expected++);
+        }
+        BOOST_CHECK(status);
+        BOOST_CHECK_EQUAL(expected, 50);
+    }
+
+    // Two good records and one with a negative string length.
+    std::unique_ptr<avro::OutputStream> out = avro::memoryOutputStream();
+    avro::EncoderPtr e = avro::binaryEncoder();
+    e->init(*out);
+    avro::encode(*e, TestRecord("ok", 0));
+    avro::encode(*e, TestRecord("ok", 1));
+    e->flush();
+    std::shared_ptr<std::vector<uint8_t>> bytes = avro::snapshot(*out);
+    bytes->push_back(3);
+    bytes->push_back(0);
+    {
+        avro::DataFileWriter<TestRecord> df(filename, writerSchema);
+        df.appendEncodedBatch(bytes->data(), bytes->size(), 3, false);
+    }
+    avro::DataFileReader<TestRecord> df(filename, writerSchema);
+    TestRecord r("", 0);
+    avro::DecodeStatus status;
+    BOOST_REQUIRE(df.tryRead(r, status));
+    BOOST_REQUIRE(df.tryRead(r, status));
+    BOOST_CHECK_EQUAL(r.id, 1);
+    for (int i = 0; i < 2; ++i) {
+        BOOST_CHECK(!df.tryRead(r, status));
+        BOOST_CHECK_EQUAL(status.code, avro::DecodeStatus::badLength);
+        BOOST_CHECK_EQUAL(status.offset, 0);
+        BOOST_CHECK_EQUAL(status.value, -2);
+    }
+    BOOST_CHECK_EQUAL(r.id, 1);
+    BOOST_CHECK_EQUAL(status.message(), "Cannot have negative length: -2 at offset 0");
+    boost::filesystem::remove(filename);
+}
+
+void testSkip() {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    avro::ValidSchema readerSchema = avro::compileJsonSchemaFromString(
+        R"({"type":"record","name":"R","fields":[{"name":"id","type":"long"}]})");
+    const char *filename = "test_skip.df";
+    const int64_t numberOfRecords = 1000;
+    for (avro::Codec codec : {avro::NULL_CODEC, avro::DEFLATE_CODEC}) {
+        {
+            avro::DataFileWriter<TestRecord> df(filename, writerSchema, 100, codec);
+            for (int64_t i = 0; i < numberOfRecords; i++) {
+                df.write(TestRecord(i % 2 == 0 ? "even" : "odd", i));
+            }
+        }
+        for (size_t threads = 0; threads < 3; threads += 2) {
+            avro::DataFileReader<TestRecord> df(filename, writerSchema);
+            df.setDecompressionThreads(threads);
+            TestRecord r("", 0);
+            BOOST_CHECK_EQUAL(df.skip(0), 0);
+            BOOST_REQUIRE(df.read(r));
+            BOOST_REQUIRE(df.read(r));
+            // Within the block, then across many.
+            BOOST_CHECK_EQUAL(df.skip(3), 3);
+            BOOST_REQUIRE(df.read(r));
+            BOOST_CHECK_EQUAL(r.id, 5);
+            BOOST_CHECK_EQUAL(df.skip(600), 600);
+            BOOST_REQUIRE(df.read(r));
+            BOOST_CHECK_EQUAL(r.id, 606);
+            BOOST_CHECK_EQUAL(r.s1, "even");
+            BOOST_CHECK_EQUAL(df.skip(1), 1);
+            BOOST_CHECK_EQUAL(df.skip(1), 1);
+            BOOST_REQUIRE(df.read(r));
+            BOOST_CHECK_EQUAL(r.id, 609);
+            BOOST_CHECK_EQUAL(df.skip(numberOfRecords), numberOfRecords - 610);
+            BOOST_CHECK(!df.read(r));
+            BOOST_CHECK_EQUAL(df.skip(1), 0);
+        }
+        {
+            // The resolving decoder is left at the start of a record.
+            avro::DataFileReader<avro::GenericDatum> df(filename, readerSchema);
+            avro::GenericDatum datum(readerSchema);
+            for (int64_t expected : {0, 251, 252, 998}) {
+                BOOST_REQUIRE(df.read(datum));
+                BOOST_CHECK_EQUAL(datum.value<avro::GenericRecord>().fieldAt(0).value<int64_t>(), expected);
+                df.skip(expected == 251 ? 0 : 250);
+                if (expected == 252) {
+                    df.skip(495);
+                }
+            }
+        }
+        {
+            avro::DataFileReader<TestRecord> df(filename, writerSchema);
+            df.setRecordFilter({"s1"}, [](const std::vector<avro::GenericDatum> &v) {
+                return v[0].value<std::string>() == "odd";
+            });
+            TestRecord r("", 0);
+            BOOST_CHECK_EQUAL(df.skip(10), 10);
+            BOOST_REQUIRE(df.read(r));
+            BOOST_CHECK_EQUAL(r.id, 21);
+        }
+    }
+    BOOST_CHECK(boost::filesystem::remove(filename));
+}
+
+void testBlockChecksums() {
+    const uint8_t abc[] = {'a', 'b', 'c'};
+    BOOST_CHECK_EQUAL(avro::xxHash64(abc, 0), 0xef46db3751d8e999ull);
+    BOOST_CHECK_EQUAL(avro::xxHash64(abc, sizeof(abc)), 0x44bc2cf5ad770999ull);
+
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    const char *filename = "test_blockChecksums.df";
+    const std::string indexFilename = std::string(filename) + ".idx";
+    const int64_t numberOfRecords = 1000;
+    for (avro::Codec codec : {avro::NULL_CODEC, avro::DEFLATE_CODEC}) {
+        for (size_t threads = 0; threads < 3; threads += 2) {
+            {
+                avro::DataFileWriter<TestRecord> df(filename, writerSchema, 100, codec);
+                df.setBlockIndex();
+                df.setBlockChecksums();
+                df.setCompressionThreads(threads);
+                for (int64_t i = 0; i < numberOfRecords; i++) {
+                    df.write(TestRecord("checked", i));
+                }
+            }
+            avro::DataFileIndex index = avro::readDataFileIndex(indexFilename);
+            avro::DataFileIndex built = avro::buildDataFileIndex(filename, true);
+            BOOST_REQUIRE_GT(index.entries().size(), 10);
+            BOOST_REQUIRE_EQUAL(built.entries().size(), index.entries().size());
+            for (size_t i = 0; i < index.entries().size(); ++i) {
+                BOOST_CHECK(index.entries()[i].hasChecksum);
+                BOOST_CHECK_EQUAL(built.entries()[i].checksum, index.entries()[i].checksum);
+            }
+            BOOST_CHECK(!avro::buildDataFileIndex(filename).entries()[0].hasChecksum);
+
+            for (avro::BlockVerification v : {avro::VERIFY_BLOCKS, avro::VERIFY_BLOCKS_ASYNC}) {
+                avro::DataFileReader<TestRecord> df(filename, writerSchema);
+                df.setDecompressionThreads(threads);
+                df.setIndex(index);
+                df.setBlockVerification(v);
+                TestRecord r("", 0);
+                int64_t n = 0;
+                while (df.read(r)) {
+                    BOOST_CHECK_EQUAL(r.id, n++);
+                }
+                BOOST_CHECK_EQUAL(n, numberOfRecords);
+            }
+        }
+    }
+
+    // Change a string in the third block, which no codec can tell.
+    {
+        avro::DataFileWriter<TestRecord> df(filename, writerSchema, 100);
+        df.setBlockIndex();
+        df.setBlockChecksums();
+        for (int64_t i = 0; i < numberOfRecords; i++) {
+            df.write(TestRecord("checked", i));
+        }
+    }
+    avro::DataFileIndex index = avro::readDataFileIndex(indexFilename);
+    {
+        std::fstream f(filename, std::ios::in | std::ios::out | std::ios::binary);
+        std::string bytes((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        size_t pos = bytes.find("checked", static_cast<size_t>(index.entries()[2].offset));
+        BOOST_REQUIRE(pos != std::string::npos);
+        f.seekp(static_cast<std::streamoff>(pos));
+        f.put('C');
+    }
+    for (size_t threads = 0; threads < 3; threads += 2) {
+        for (avro::BlockVerification v : {avro::VERIFY_BLOCKS, avro::VERIFY_BLOCKS_ASYNC, avro::TRUST_BLOCKS}) {
+            avro::DataFileReader<TestRecord> df(filename, writerSchema);
+            df.setDecompressionThreads(threads);
+            df.setIndex(index);
+            df.setBlockVerification(v);
+            TestRecord r("", 0);
+            int64_t n = 0;
+            auto readAll = [&]() {
+                while (df.read(r)) {
+                    ++n;
+                }
+            };
+            if (v == avro::TRUST_BLOCKS) {
+                readAll();
+                BOOST_CHECK_EQUAL(n, numberOfRecords);
+            } else {
+                BOOST_CHECK_THROW(readAll(), avro::Exception);
+                BOOST_CHECK_LE(n, index.entries()[3].firstObject);
+            }
+        }
+    }
+    BOOST_CHECK(boost::filesystem::remove(filename));
+    BOOST_CHECK(boost::filesystem::remove(indexFilename));
+}
+
+void testSyncScan() {
+    avro::ValidSchema writerSchema = avro::compileJsonSchemaFromString(sch);
+    const char *filename = "test_syncScan.df";
+    const std::string indexFilename = std::string(filename) + ".idx";
+    {
+        avro::DataFileWriter<ComplexInteger> df(filename, writerSchema, 100);
+        df.setBlockIndex();
+        for (int i = 0; i < 1000; i++) {
+            df.write(ComplexInteger(i, 0));
+        }
+    }
+    avro::DataFileIndex index = avro::readDataFileIndex(indexFilename);
+    BOOST_REQUIRE_GT(index.entries().size(), 10);
+    // Small buffers make markers straddle the chunks of the stream.
+    for (size_t chunkSize : {7, 16, 23, 4096}) {
+        avro::StreamOptions options;
+        options.chunkSize = chunkSize;
+        avro::DataFileReader<ComplexInteger> df(filename, options);
+        for (const auto &e : index.entries()) {
+            for (int64_t before : {0, 1, 3, 17}) {
+                df.sync(e.offset - avro::SyncSize - before);
+                BOOST_CHECK_EQUAL(df.previousSync(), e.offset);
+                ComplexInteger c;
+                BOOST_REQUIRE(df.read(c));
+                BOOST_CHECK_EQUAL(c.re, e.firstObject);
+            }
+        }
+        // Past the last marker there is nothing to find.
+        df.sync(index.entries().back().offset - avro::SyncSize + 1);
+        ComplexInteger c;
+        BOOST_CHECK(!df.read(c));
+    }
+    BOOST_CHECK(boost::filesystem::remove(filename));
+    BOOST_CHECK(boost::filesystem::remove(indexFilename));
+}
+
+void testDatasetReader() {
+    // Half the files have the ids as ints, to be promoted to longs.
+    const std::string intSchema = std::string(schemaWithIdAndString).replace(
+        std::string(schemaWithIdAndString).find("\"long\""), 6, "\"int\"");
+    avro::ValidSchema readerSchema = avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    avro::ValidSchema writerSchemas[] = {readerSchema, avro::compileJsonSchemaFromString(intSchema)};
+    std::vector<std::string> files;
+    const int64_t perFile = 300;
+    for (int i = 0; i < 6; ++i) {
+        files.push_back("test_datasetReader" + std::to_string(i) + ".df");
+        avro::DataFileWriter<TestRecord> df(files.back().c_str(), writerSchemas[i % 2], 100);
+        for (int64_t j = 0; j < perFile; ++j) {
+            df.write(TestRecord("dataset", i * perFile + j));
+        }
+    }
+
+    {
+        avro::DatasetReader<TestRecord> dr(files, readerSchema, TestRecord("", 0));
+        TestRecord r("", 0);
+        int64_t n = 0;
+        while (dr.read(r)) {
+            BOOST_CHECK_EQUAL(r.id, n);
+            BOOST_CHECK_EQUAL(dr.currentFile(), files[n / perFile]);
+            ++n;
+        }
+        BOOST_CHECK_EQUAL(n, 6 * perFile);
+        BOOST_CHECK(!dr.read(r));
+        BOOST_CHECK_EQUAL(dr.schemas().size(), 2);
+    }
+
+    for (size_t threads : {1, 3, 0}) {
+        avro::DatasetReader<TestRecord> dr(files, readerSchema, TestRecord("", 0));
+        dr.setThreads(threads);
+        std::mutex mutex;
+        std::vector<int64_t> last(files.size(), -1);
+        int64_t sum = 0;
+        int64_t n = dr.forEach([&](const TestRecord &r) {
+            std::lock_guard<std::mutex> lock(mutex);
+            int64_t &l = last[r.id / perFile];
+            BOOST_CHECK_LT(l, r.id);
+            l = r.id;
+            sum += r.id;
+        });
+        BOOST_CHECK_EQUAL(n, 6 * perFile);
+        BOOST_CHECK_EQUAL(sum, n * (n - 1) / 2);
+        BOOST_CHECK_EQUAL(dr.schemas().size(), 2);
+    }
+
+    // Errors reading any of the files come out of forEach().
+    std::vector<std::string> missing(files);
+    missing.push_back("test_datasetReaderMissing.df");
+    avro::DatasetReader<TestRecord> dr(missing, readerSchema, TestRecord("", 0));
+    dr.setThreads(2);
+    BOOST_CHECK_THROW(dr.forEach([](const TestRecord &) {}), avro::Exception);
+
+    for (const std::string &f : files) {
+        BOOST_CHECK(boost::filesystem::remove(f));
+    }
+}
+
+void testReopen() {
+    const std::string intSchema = std::string(schemaWithIdAndString).replace(
+        std::string(schemaWithIdAndString).find("\"long\""), 6, "\"int\"");
+    avro::ValidSchema readerSchema = avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    avro::ValidSchema intWriterSchema = avro::compileJsonSchemaFromString(intSchema);
+    const char *files[] = {"test_reopen0.df", "test_reopen1.df", "test_reopen2.df", "test_reopen3.df"};
+    const int64_t perFile = 500;
+    {
+        avro::DataFileWriter<TestRecord> df0(files[0], readerSchema, 100);
+        avro::DataFileWriter<TestRecord> df1(files[1], readerSchema, 100, avro::DEFLATE_CODEC);
+        avro::DataFileWriter<TestRecord> df2(files[2], intWriterSchema, 100);
+        avro::DataFileWriter<TestRecord> df3(files[3], readerSchema, 100, avro::DEFLATE_CODEC);
+        for (int64_t i = 0; i < perFile; ++i) {
+            df0.write(TestRecord("reopened", i));
+            df1.write(TestRecord("reopened", perFile + i));
+            df2.write(TestRecord("reopened", 2 * perFile + i));
+            df3.write(TestRecord("reopened", 3 * perFile + i));
+        }
+    }
+
+    for (size_t threads = 0; threads < 3; threads += 2) {
+        for (bool withReaderSchema : {true, false}) {
+            std::unique_ptr<avro::DataFileReader<TestRecord>> df(withReaderSchema
+                                                                     ? new avro::DataFileReader<TestRecord>(files[0], readerSchema)
+                                                                     : new avro::DataFileReader<TestRecord>(files[0]));
+            df->setDecompressionThreads(threads);
+            const avro::ValidSchema first = df->dataSchema();
+            TestRecord r("", 0);
+            int64_t n = 0;
+            for (size_t f = 0; f < 4; ++f) {
+                if (f != 0) {
+                    // Leave the file being read in the middle of a block.
+                    if (f == 3) {
+                        df->reset(avro::fileSeekableInputStream(files[f]));
+                    } else {
+                        df->reopen(files[f]);
+                    }
+                }
+                // The schema is compiled again only when it differs from
+                // that of the file before.
+                BOOST_CHECK_EQUAL(df->dataSchema().root() == first.root(), f < 2);
+                BOOST_CHECK_EQUAL(df->readerSchema().root()->leafAt(1)->type(),
+                                  withReaderSchema || f != 2 ? avro::AVRO_LONG : avro::AVRO_INT);
+                int64_t limit = f == 3 ? perFile : perFile - 50;
+                for (int64_t i = 0; i < limit; ++i) {
+                    BOOST_REQUIRE(df->read(r));
+                    BOOST_CHECK_EQUAL(r.id, f * perFile + i);
+                    ++n;
+                }
+            }
+            BOOST_CHECK(!df->read(r));
+            BOOST_CHECK_EQUAL(n, 4 * perFile - 150);
+        }
+    }
+
+    // From memory to a file, and on to one that is not there.
+    std::ifstream in(files[1], std::ios::binary);
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    avro::DataFileReader<TestRecord> df(bytes.data(), bytes.size(), readerSchema);
+    df.reopen(files[0]);
+    TestRecord r("", 0);
+    BOOST_REQUIRE(df.read(r));
+    BOOST_CHECK_EQUAL(r.id, 0);
+    BOOST_CHECK_THROW(df.reopen("test_reopenMissing.df"), avro::Exception);
+
+    for (const char *f : files) {
+        BOOST_CHECK(boost::filesystem::remove(f));
+    }
+}
+
+void testBlockCache() {
+    avro::ValidSchema writerSchema = avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    const char *filename = "test_blockCache.df";
+    const std::string indexFilename = std::string(filename) + ".idx";
+    {
+        avro::DataFileWriter<TestRecord> df(filename, writerSchema, 100, avro::DEFLATE_CODEC);
+        df.setBlockIndex();
+        for (int64_t i = 0; i < 1000; i++) {
+            df.write(TestRecord("cached", i));
+        }
+    }
+    avro::DataFileIndex index = avro::readDataFileIndex(indexFilename);
+    const std::vector<avro::DataFileIndexEntry> &entries = index.entries();
+    BOOST_REQUIRE_GT(entries.size(), 10);
+
+    std::shared_ptr<avro::DataFileBlockCache> cache = std::make_shared<avro::DataFileBlockCache>(1024 * 1024);
+    avro::DataFileReader<TestRecord> df1(filename, writerSchema);
+    avro::DataFileReader<TestRecord> df2(filename, writerSchema);
+    df1.setBlockCache(cache);
+    df2.setBlockCache(cache);
+    TestRecord r("", 0);
+    for (int pass = 0; pass < 3; ++pass) {
+        for (size_t i = 0; i < entries.size(); i += 3) {
+            avro::DataFileReader<TestRecord> &df = pass % 2 == 0 ? df1 : df2;
+            df.seek(entries[i].offset);
+            BOOST_REQUIRE(df.read(r));
+            BOOST_CHECK_EQUAL(r.id, entries[i].firstObject);
+            BOOST_CHECK_EQUAL(r.s1, "cached");
+        }
+    }
+    // The first pass missed every block; the others, by either reader,
+    // found them all.
+    size_t seeks = (entries.size() + 2) / 3;
+    BOOST_CHECK_EQUAL(cache->misses(), seeks);
+    BOOST_CHECK_EQUAL(cache->hits(), 2 * seeks);
+    BOOST_CHECK_GT(cache->size(), 0);
+
+    // Reading on from a cached block goes through the rest of the file.
+    df2.seek(entries[0].offset);
+    int64_t n = 0;
+    while (df2.read(r)) {
+        BOOST_CHECK_EQUAL(r.id, n++);
+    }
+    BOOST_CHECK_EQUAL(n, 1000);
+
+    // A budget of about two blocks keeps no more than that.
+    std::shared_ptr<avro::DataFileBlockCache> small = std::make_shared<avro::DataFileBlockCache>(cache->size() * 2 / entries.size() + 1);
+    df1.setBlockCache(small);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        df1.seek(entries[i].offset);
+        BOOST_REQUIRE(df1.read(r));
+        BOOST_CHECK_EQUAL(r.id, entries[i].firstObject);
+        BOOST_CHECK_LE(small->size(), small->capacity());
+    }
+    df1.seek(entries[0].offset);
+    BOOST_CHECK_EQUAL(small->hits(), 0);
+    small->clear();
+    BOOST_CHECK_EQUAL(small->size(), 0);
+
+    BOOST_CHECK(boost::filesystem::remove(filename));
+    BOOST_CHECK(boost::filesystem::remove(indexFilename));
+}
+
+void testRollingWriter() {
+    avro::ValidSchema writerSchema = avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    avro::RollingPolicy policy;
+    policy.maxBytes = 8 * 1024;
+    avro::StreamOptions options;
+    options.preallocate = 64 * 1024;
+    std::vector<std::string> done;
+    {
+        avro::RollingDataFileWriter<TestRecord> rw(
+            [](int64_t n) { return "test_rolling" + std::to_string(n) + ".df"; },
+            writerSchema, policy, 1024, avro::NULL_CODEC, options);
+        rw.setFileDoneHandler([&done](const std::string &f) { done.push_back(f); });
+        rw.writer().setBlockIndex();
+        for (int64_t i = 0; i < 5000; ++i) {
+            rw.write(TestRecord("rolling along", i));
+        }
+        BOOST_CHECK_EQUAL(rw.currentNumber() + 1, static_cast<int64_t>(done.size() + 1));
+        rw.close();
+        BOOST_CHECK(rw.currentFile().empty());
+    }
+    BOOST_REQUIRE_GT(done.size(), 3);
+
+    std::set<avro::DataFileSync> syncs;
+    int64_t n = 0;
+    for (size_t f = 0; f < done.size(); ++f) {
+        BOOST_CHECK_EQUAL(done[f], "test_rolling" + std::to_string(f) + ".df");
+        // Files end at the first block past the limit, and keep no more
+        // of the space reserved for them than they use.
+        uintmax_t size = boost::filesystem::file_size(done[f]);
+        BOOST_CHECK_LT(size, static_cast<uintmax_t>(policy.maxBytes + 2 * 1024));
+        {
+            avro::DataFileBlockReader br(done[f].c_str());
+            syncs.insert(br.syncMarker());
+        }
+        avro::DataFileReader<TestRecord> df(done[f].c_str(), writerSchema);
+        TestRecord r("", 0);
+        int64_t first = n;
+        while (df.read(r)) {
+            BOOST_CHECK_EQUAL(r.id, n++);
+        }
+        BOOST_CHECK_GT(n, first);
+        avro::DataFileIndex index = avro::readDataFileIndex(done[f] + ".idx");
+        BOOST_CHECK_EQUAL(index.objectCount(), n - first);
+        BOOST_CHECK(boost::filesystem::remove(done[f]));
+        BOOST_CHECK(boost::filesystem::remove(done[f] + ".idx"));
+    }
+    BOOST_CHECK_EQUAL(n, 5000);
+    BOOST_CHECK_EQUAL(syncs.size(), done.size());
+
+    // Files older than maxAge end at the next object.
+    policy.maxBytes = 0;
+    policy.maxAge = std::chrono::nanoseconds(1);
+    done.clear();
+    {
+        avro::RollingDataFileWriter<TestRecord> rw(
+            [](int64_t n) { return "test_rollingAge" + std::to_string(n) + ".df"; },
+            writerSchema, policy);
+        rw.setFileDoneHandler([&done](const std::string &f) { done.push_back(f); });
+        for (int64_t i = 0; i < 3; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            rw.write(TestRecord("aged", i));
+        }
+        rw.close();
+    }
+    BOOST_REQUIRE_EQUAL(done.size(), 3);
+    for (size_t f = 0; f < done.size(); ++f) {
+        avro::DataFileReader<TestRecord> df(done[f].c_str());
+        TestRecord r("", 0);
+        BOOST_REQUIRE(df.read(r));
+        BOOST_CHECK_EQUAL(r.id, static_cast<int64_t>(f));
+        BOOST_CHECK(!df.read(r));
+        BOOST_CHECK(boost::filesystem::remove(done[f]));
+    }
+
+    // A closed writer rolls on to nothing.
+    {
+        avro::DataFileWriter<TestRecord> df("test_rollingClosed.df", writerSchema);
+        df.close();
+        BOOST_CHECK_THROW(df.roll("test_rollingClosed1.df"), avro::Exception);
+    }
+    BOOST_CHECK(boost::filesystem::remove("test_rollingClosed.df"));
+    BOOST_CHECK(!boost::filesystem::exists("test_rollingClosed1.df"));
+}
+
+void testCodecSelector() {
+    avro::ValidSchema writerSchema = avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    avro::BlockCodecPtr null = avro::findCodec("null");
+    avro::BlockCodecPtr deflate = avro::findCodec("deflate");
+    std::vector<avro::CodecSetting> candidates;
+    candidates.emplace_back(null);
+    candidates.emplace_back(deflate, 1);
+    candidates.emplace_back(deflate, 9);
+    BOOST_CHECK_THROW(avro::CodecSelector(std::vector<avro::CodecSetting>(), 1.0), avro::Exception);
+    BOOST_CHECK_THROW(avro::CodecSelector({avro::CodecSetting(deflate, 10)}, 1.0), avro::Exception);
+    BOOST_CHECK(!avro::CodecSelector::defaultCandidates().empty());
+
+    // With no limit on time, the smallest output wins; with none at all,
+    // the fastest.
+    std::shared_ptr<avro::CodecSelector> unlimited = std::make_shared<avro::CodecSelector>(
+        candidates, std::numeric_limits<double>::infinity(), 1);
+    std::vector<std::string> done;
+    {
+        avro::RollingDataFileWriter<TestRecord> rw(
+            [](int64_t n) { return "test_codecSelector" + std::to_string(n) + ".df"; },
+            writerSchema, avro::RollingPolicy(), 1024);
+        rw.setFileDoneHandler([&done](const std::string &f) { done.push_back(f); });
+        rw.writer().setCodecSelector(unlimited);
+        rw.writer().setCompressionThreads(2);
+        BOOST_CHECK_EQUAL(rw.writer().currentCodec(), null);
+        // Rolling before any block is sampled keeps the codec.
+        rw.writer().roll("test_codecSelectorEmpty.df");
+        BOOST_CHECK_EQUAL(rw.writer().currentCodec(), null);
+        for (int64_t i = 0; i < 2000; ++i) {
+            rw.write(TestRecord("compressible compressible compressible", i));
+        }
+        rw.writer().roll("test_codecSelectorNext.df");
+        BOOST_CHECK_EQUAL(rw.writer().currentCodec(), deflate);
+        BOOST_REQUIRE_EQUAL(unlimited->measurements().size(), candidates.size());
+        BOOST_CHECK_GT(unlimited->measurements()[0].compressedBytes,
+                       unlimited->measurements()[2].compressedBytes);
+        for (int64_t i = 2000; i < 4000; ++i) {
+            rw.write(TestRecord("compressible compressible compressible", i));
+        }
+        rw.writer().setCodecSelector(std::make_shared<avro::CodecSelector>(candidates, 0.0, 1));
+        rw.write(TestRecord("compressible compressible compressible", 4000));
+        rw.writer().roll("test_codecSelectorLast.df");
+        BOOST_CHECK_EQUAL(rw.writer().currentCodec(), null);
+        rw.write(TestRecord("compressible compressible compressible", 4001));
+        rw.close();
+    }
+
+    const char *files[] = {"test_codecSelector0.df", "test_codecSelectorEmpty.df",
+                           "test_codecSelectorNext.df", "test_codecSelectorLast.df"};
+    const char *codecs[] = {"null", "null", "deflate", "null"};
+    int64_t n = 0;
+    for (size_t f = 0; f < 4; ++f) {
+        {
+            avro::DataFileBlockReader br(files[f]);
+            BOOST_CHECK_EQUAL(br.codecName(), codecs[f]);
+        }
+        {
+            avro::DataFileReader<TestRecord> df(files[f], writerSchema);
+            TestRecord r("", 0);
+            while (df.read(r)) {
+                BOOST_CHECK_EQUAL(r.id, n++);
+            }
+        }
+        BOOST_CHECK(boost::filesystem::remove(files[f]));
+    }
+    BOOST_CHECK_EQUAL(n, 4002);
+}
+
+void testGroupCommit() {
+    avro::ValidSchema writerSchema = avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    std::shared_ptr<avro::GroupCommitter> committer = std::make_shared<avro::GroupCommitter>(std::chrono::milliseconds(1));
+    const int writers = 4;
+    const int flushes = 20;
+    std::vector<std::thread> threads;
+    for (int w = 0; w < writers; ++w) {
+        threads.emplace_back([w, &writerSchema, &committer]() {
+            std::string filename = "test_groupCommit" + std::to_string(w) + ".df";
+            avro::DataFileWriter<TestRecord> df(filename.c_str(), writerSchema);
+            df.setGroupCommitter(committer);
+            for (int64_t i = 0; i < flushes * 10; ++i) {
+                df.write(TestRecord("durable", i));
+                if (i % 10 == 9) {
+                    df.flush();
+                }
+            }
+            df.close();
+        });
+    }
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    // Every flush, and each close, commits; no batch syncs a file twice.
+    BOOST_CHECK_EQUAL(committer->commits(), writers * (flushes + 1));
+    BOOST_CHECK_GT(committer->syncs(), 0);
+    BOOST_CHECK_LE(committer->syncs(), committer->commits());
+    for (int w = 0; w < writers; ++w) {
+        std::string filename = "test_groupCommit" + std::to_string(w) + ".df";
+        {
+            avro::DataFileReader<TestRecord> df(filename.c_str());
+            TestRecord r("", 0);
+            int64_t n = 0;
+            while (df.read(r)) {
+                BOOST_CHECK_EQUAL(r.id, n++);
+            }
+            BOOST_CHECK_EQUAL(n, flushes * 10);
+        }
+        BOOST_CHECK(boost::filesystem::remove(filename));
+    }
+
+    // Streams that cannot be synced are committed all the same.
+    int64_t syncs = committer->syncs();
+    avro::DataFileWriter<TestRecord> df(avro::memoryOutputStream(), writerSchema);
+    df.setGroupCommitter(committer);
+    df.write(TestRecord("volatile", 0));
+    df.flush();
+    BOOST_CHECK_EQUAL(committer->syncs(), syncs);
+    BOOST_CHECK_EQUAL(committer->commits(), writers * (flushes + 1) + 1);
+}
+
+namespace {
+
+// Counts the tasks it hands over to a work-stealing executor.
+class CountingExecutor : public avro::Executor {
+    avro::WorkStealingExecutor executor_;
+
+public:
+    std::atomic<int> submitted;
+
+    CountingExecutor() : executor_(2), submitted(0) {}
+
+    void submit(std::function<void()> task) override {
+        ++submitted;
+        executor_.submit(std::move(task));
+    }
+
+    size_t concurrency() const override { return executor_.concurrency(); }
+};
+
+// Keeps the tasks it is given without running them, as an executor
+// whose threads are all busy would.
+class IdleExecutor : public avro::Executor {
+public:
+    std::vector<std::function<void()>> tasks;
+
+    void submit(std::function<void()> task) override {
+        tasks.push_back(std::move(task));
+    }
+
+    size_t concurrency() const override { return 2; }
+
+    void runAll() {
+        for (auto &t : tasks) {
+            t();
+        }
+        tasks.clear();
+    }
+};
+
+} // namespace
+
+void testExecutor() {
+    std::atomic<int> done(0);
+    {
+        avro::WorkStealingExecutor executor(3);
+        BOOST_CHECK_EQUAL(executor.concurrency(), 3);
+        for (int i = 0; i < 10; ++i) {
+            executor.submit([&executor, &done]() {
+                for (int j = 0; j < 10; ++j) {
+                    executor.submit([&done]() { ++done; });
+                }
+                ++done;
+            });
+        }
+        // The destructor runs what is still queued.
+        while (done < 10) {
+            std::this_thread::yield();
+        }
+    }
+    BOOST_CHECK_EQUAL(done, 110);
+
+    avro::ValidSchema writerSchema = avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    const char *filename = "test_executor.df";
+    const int numberOfRecords = 5000;
+    std::shared_ptr<CountingExecutor> counting = std::make_shared<CountingExecutor>();
+    std::shared_ptr<IdleExecutor> idle = std::make_shared<IdleExecutor>();
+    std::vector<avro::ExecutorPtr> executors = {counting, idle};
+    for (const avro::ExecutorPtr &executor : executors) {
+        {
+            avro::DataFileWriter<TestRecord> df(filename, writerSchema, 1024, avro::DEFLATE_CODEC);
+            df.setExecutor(executor);
+            df.setCompressionThreads(2, 3);
+            for (int i = 0; i < numberOfRecords; i++) {
+                df.write(TestRecord("abcdefghij", i));
+            }
+            df.close();
+        }
+        {
+            avro::DataFileReader<TestRecord> df(filename, writerSchema);
+            df.setExecutor(executor);
+            df.setDecompressionThreads(2);
+            TestRecord r("", 0);
+            int64_t next = 0;
+            while (df.read(r)) {
+                BOOST_CHECK_EQUAL(r.id, next);
+                ++next;
+            }
+            BOOST_CHECK_EQUAL(next, numberOfRecords);
+        }
+        avro::ParallelDataFileScanner<TestRecord> scanner(filename, 0, TestRecord("", 0));
+        scanner.setExecutor(executor);
+        BOOST_CHECK_EQUAL(scanner.threads(), 2);
+        std::atomic<int64_t> sum(0);
+        BOOST_CHECK_EQUAL(scanner.forEach([&sum](const TestRecord &r) { sum += r.id; }), numberOfRecords);
+        BOOST_CHECK_EQUAL(sum, int64_t(numberOfRecords) * (numberOfRecords - 1) / 2);
+        int64_t expected = 0;
+        scanner.forEachOrdered([&expected](const TestRecord &r) {
+            BOOST_CHECK_EQUAL(r.id, expected);
+            ++expected;
+        });
+        BOOST_CHECK_EQUAL(expected, numberOfRecords);
+    }
+    BOOST_CHECK_GT(counting->submitted, 0);
+    // Everything was done by the callers; what the executor runs late
+    // finds nothing left to do.
+    BOOST_CHECK(!idle->tasks.empty());
+    idle->runAll();
+    std::remove(filename);
+}
+
+void testNumaScan() {
+    std::vector<std::vector<int>> nodes = avro::numaNodes();
+    BOOST_REQUIRE(!nodes.empty());
+    {
+        // The machine's own nodes.
+        avro::NumaExecutor executor(1);
+        BOOST_CHECK_EQUAL(executor.nodes(), nodes.size());
+        BOOST_CHECK_EQUAL(executor.concurrency(), nodes.size());
+        std::atomic<int> done(0);
+        executor.submit([&done]() { ++done; });
+        executor.node(0)->submit([&done]() { ++done; });
+        while (done < 2) {
+            std::this_thread::yield();
+        }
+    }
+
+    avro::ValidSchema writerSchema = avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    const char *filename = "test_numaScan.df";
+    const int numberOfRecords = 5000;
+    {
+        avro::DataFileWriter<TestRecord> df(filename, writerSchema, 1024, avro::DEFLATE_CODEC);
+        for (int i = 0; i < numberOfRecords; i++) {
+            df.write(TestRecord("abcdefghij", i));
+        }
+        df.close();
+    }
+    // Three nodes that may run anywhere, and so one of them twice.
+    std::vector<std::vector<int>> three = {std::vector<int>(), nodes[0], std::vector<int>()};
+    std::shared_ptr<avro::NumaExecutor> executor = std::make_shared<avro::NumaExecutor>(three, 2);
+    BOOST_CHECK_EQUAL(executor->nodes(), 3);
+    BOOST_CHECK_EQUAL(executor->concurrency(), 6);
+    for (size_t threads = 0; threads < 3; ++threads) {
+        avro::ParallelDataFileScanner<TestRecord> scanner(filename, threads, TestRecord("", 0));
+        scanner.setExecutor(executor);
+        std::mutex mutex;
+        std::vector<int> seen(numberOfRecords, 0);
+        BOOST_CHECK_EQUAL(scanner.forEach([&](const TestRecord &r) {
+            std::lock_guard<std::mutex> lock(mutex);
+            seen[r.id]++;
+        }),
+                          numberOfRecords);
+        BOOST_CHECK(std::count(seen.begin(), seen.end(), 1) == numberOfRecords);
+        std::atomic<int64_t> objects(0);
+        BOOST_CHECK_EQUAL(scanner.forEachBlock([&objects](const TestRecord *, size_t n) { objects += n; }), numberOfRecords);
+        BOOST_CHECK_EQUAL(objects, numberOfRecords);
+    }
+    // A failing task stops all the nodes.
+    avro::ParallelDataFileScanner<TestRecord> scanner(filename, 0, TestRecord("", 0));
+    scanner.setExecutor(executor);
+    BOOST_CHECK_THROW(scanner.forEach([](const TestRecord &r) {
+        if (r.id == 4000) {
+            throw avro::Exception("stop");
+        }
+    }),
+                      avro::Exception);
+    std::remove(filename);
+}
+
+void testCopyCounters() {
+    avro::ValidSchema writerSchema = avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    const char *filename = "test_copyCounters.df";
+    const char *compressed = "test_copyCounters_deflate.df";
+    const int numberOfRecords = 2000;
+    avro::Codec codecs[] = {avro::NULL_CODEC, avro::DEFLATE_CODEC};
+    for (avro::Codec codec : codecs) {
+        avro::DataFileWriter<TestRecord> df(codec == avro::NULL_CODEC ? filename : compressed, writerSchema, 32 * 1024, codec);
+        for (int i = 0; i < numberOfRecords; i++) {
+            df.write(TestRecord("abcdefghijklmnopqrstuvwxyz", i));
+        }
+        df.close();
+        // The block buffer grew from 4 KB to hold a block.
+        avro::DataFileStats stats = df.stats();
+        BOOST_CHECK(stats.bufferAllocations > 1);
+        BOOST_CHECK(stats.copiedBytes > 0);
+    }
+
+    {
+        avro::DataFileReader<TestRecord> df(avro::mappedFileInputStream(filename), writerSchema);
+        TestRecord r("", 0);
+        int i = 0;
+        while (df.read(r)) {
+            BOOST_CHECK_EQUAL(r.id, i++);
+        }
+        BOOST_CHECK_EQUAL(i, numberOfRecords);
+        BOOST_CHECK_EQUAL(df.stats().copiedBytes, 0);
+        BOOST_CHECK_EQUAL(df.stats().bufferAllocations, 0);
+    }
+    {
+        // Compressed blocks span several chunks of a small buffer, so
+        // they are pieced together before they are decompressed.
+        avro::DataFileReader<TestRecord> df(avro::fileInputStream(compressed, 1024), writerSchema);
+        TestRecord r("", 0);
+        int i = 0;
+        while (df.read(r)) {
+            BOOST_CHECK_EQUAL(r.id, i++);
+        }
+        BOOST_CHECK_EQUAL(i, numberOfRecords);
+        BOOST_CHECK(df.stats().copiedBytes > 0);
+        BOOST_CHECK(df.stats().copiedBytes <= df.stats().compressedBytes);
+        BOOST_CHECK(df.stats().bufferAllocations > 0);
+    }
+    std::remove(filename);
+    std::remove(compressed);
+}
+
+void testCrc32() {
+    boost::mt19937 random(7);
+    std::vector<uint8_t> data(5000);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>(random());
+    }
+    for (size_t offset = 0; offset < 16; offset += 5) {
+        for (size_t len = 0; len + offset <= data.size(); len += (len < 300 ? 1 : 97)) {
+            boost::crc_32_type expected;
+            expected.process_bytes(&data[offset], len);
+            BOOST_CHECK_EQUAL(avro::crc32(&data[offset], len), expected.checksum());
+
+            // Computing it in two parts gives the same CRC.
+            size_t half = len / 3;
+            uint32_t crc = avro::crc32(&data[offset], half);
+            BOOST_CHECK_EQUAL(avro::crc32(&data[offset + half], len - half, crc), expected.checksum());
+        }
+    }
+    const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    BOOST_CHECK_EQUAL(avro::crc32(check, sizeof(check)), 0xCBF43926u);
+}
+
+void testCompressionLevel(avro::Codec codec, int level) {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+
+    const char *filename = "test_compressionLevel.df";
+    const int64_t numberOfRecords = 1000;
+    {
+        avro::DataFileWriter<TestRecord> df(filename, writerSchema, 1024, codec);
+        df.setCompressionLevel(level);
+        for (int64_t i = 0; i < numberOfRecords; i++) {
+            df.write(TestRecord("a string that compresses well", i));
+        }
+        df.close();
+    }
+    {
+        avro::DataFileReader<TestRecord> df(filename);
+        TestRecord readRecord("", 0);
+        int64_t i = 0;
+        while (df.read(readRecord)) {
+            BOOST_CHECK_EQUAL(readRecord.id, i);
+            ++i;
+        }
+        BOOST_CHECK_EQUAL(i, numberOfRecords);
+    }
+    BOOST_CHECK(boost::filesystem::remove(filename));
+}
+
+void testCompressionLevelDeflateCodec() {
+    BOOST_TEST_CHECKPOINT(__func__);
+    testCompressionLevel(avro::DEFLATE_CODEC, 1);
+    testCompressionLevel(avro::DEFLATE_CODEC, 9);
+
+    avro::ValidSchema schema = avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    {
+        avro::DataFileWriter<TestRecord> df("test_compressionLevel.df", schema, 1024, avro::DEFLATE_CODEC);
+        BOOST_CHECK_THROW(df.setCompressionLevel(10), avro::Exception);
+    }
+    {
+        avro::DataFileWriter<TestRecord> df("test_compressionLevel.df", schema, 1024, avro::NULL_CODEC);
+        BOOST_CHECK_THROW(df.setCompressionLevel(1), avro::Exception);
+    }
+    BOOST_CHECK(boost::filesystem::remove("test_compressionLevel.df"));
+}
+
+#ifdef ZSTD_CODEC_AVAILABLE
+void testCompressionLevelZstdCodec() {
+    BOOST_TEST_CHECKPOINT(__func__);
+    testCompressionLevel(avro::ZSTD_CODEC, 1);
+    testCompressionLevel(avro::ZSTD_CODEC, 19);
+}
+
+// Small blocks compress far better with a dictionary trained on objects
+// like theirs, which goes along in the metadata of the file.
+void testZstdDictionary() {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    std::vector<std::string> strings;
+    for (int64_t i = 0; i < 4000; ++i) {
+        strings.push_back("event " + std::to_string(i % 37) + " from host-" + std::to_string(i % 11) + ".example.com");
+    }
+    std::vector<std::vector<uint8_t>> samples;
+    avro::EncoderPtr e = avro::binaryEncoder();
+    for (size_t i = 0; i < 1000; ++i) {
+        std::unique_ptr<avro::OutputStream> out = avro::memoryOutputStream();
+        e->init(*out);
+        avro::encode(*e, TestRecord(strings[i].c_str(), static_cast<int64_t>(i)));
+        e->flush();
+        samples.push_back(*avro::snapshot(*out));
+    }
+    std::vector<uint8_t> dictionary = avro::trainZstdDictionary(samples, 4 * 1024);
+    BOOST_REQUIRE(!dictionary.empty());
+    BOOST_CHECK_LE(dictionary.size(), 4 * 1024U);
+    BOOST_CHECK_THROW(avro::zstdDictionaryCodec(std::vector<uint8_t>()), avro::Exception);
+
+    avro::BlockCodecPtr codec = avro::zstdDictionaryCodec(dictionary);
+    BOOST_CHECK_EQUAL(codec->name(), "zstandard");
+    const char *filenames[] = {"test_zstdPlain.df", "test_zstdDictionary.df"};
+    for (int f = 0; f < 2; ++f) {
+        avro::DataFileWriter<TestRecord> df(filenames[f], writerSchema, 128,
+                                            f == 0 ? avro::findCodec("zstandard") : codec);
+        if (f == 1) {
+            df.setCompressionThreads(2);
+        }
+        for (size_t i = 0; i < strings.size(); ++i) {
+            df.write(TestRecord(strings[i].c_str(), static_cast<int64_t>(i)));
+        }
+        df.close();
+    }
+    BOOST_CHECK_LT(boost::filesystem::file_size(filenames[1]) * 4 / 3,
+                   boost::filesystem::file_size(filenames[0]));
+
+    {
+        avro::DataFileBlockReader br(filenames[1]);
+        BOOST_CHECK_EQUAL(br.codecName(), "zstandard");
+    }
+    {
+        avro::DataFileReader<TestRecord> df(filenames[1], writerSchema);
+        TestRecord r("", 0);
+        size_t n = 0;
+        while (df.read(r)) {
+            BOOST_CHECK_EQUAL(r.s1, strings[n]);
+            BOOST_CHECK_EQUAL(r.id, static_cast<int64_t>(n));
+            ++n;
+        }
+        BOOST_CHECK_EQUAL(n, strings.size());
+    }
+    for (const char *f : filenames) {
+        BOOST_CHECK(boost::filesystem::remove(f));
+    }
+}
+#endif
+
+#ifdef XZ_CODEC_AVAILABLE
+void testCompressionLevelXzCodec() {
+    BOOST_TEST_CHECKPOINT(__func__);
+    testCompressionLevel(avro::XZ_CODEC, 0);
+    testCompressionLevel(avro::XZ_CODEC, 9);
+}
+
+// The lzma codec of the C library's data files.
+void testLzmaCodec() {
+    avro::BlockCodecPtr codec = avro::findCodec("lzma");
+    BOOST_REQUIRE(codec);
+    BOOST_CHECK_THROW(codec->checkLevel(10), avro::Exception);
+
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    const char *filename = "test_lzmaCodec.df";
+    const int64_t numberOfRecords = 5000;
+    {
+        avro::DataFileWriter<TestRecord> df(filename, writerSchema, 1024, codec);
+        df.setCompressionLevel(9);
+        for (int64_t i = 0; i < numberOfRecords; i++) {
+            df.write(TestRecord("a string that compresses well", i));
+        }
+        df.close();
+    }
+    {
+        avro::DataFileReader<TestRecord> df(filename);
+        TestRecord readRecord("", 0);
+        int64_t i = 0;
+        while (df.read(readRecord)) {
+            BOOST_CHECK_EQUAL(readRecord.id, i);
+            ++i;
+        }
+        BOOST_CHECK_EQUAL(i, numberOfRecords);
+    }
+    BOOST_CHECK(boost::filesystem::remove(filename));
+}
+#endif
+
+#ifdef LZ4_CODEC_AVAILABLE
+void testCompressionLevelLz4Codec() {
+    BOOST_TEST_CHECKPOINT(__func__);
+    testCompressionLevel(avro::LZ4_CODEC, 0);
+    testCompressionLevel(avro::LZ4_CODEC, 9);
+}
+#endif
+
+void testParallelCompression(avro::Codec codec) {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+
+    const char *filename = "test_parallelCompression.df";
+    const int64_t numberOfRecords = 10000;
+    std::set<uint64_t> blockStarts;
+    {
+        avro::DataFileWriter<TestRecord> df(filename, writerSchema, 1024, codec);
+        df.setCompressionThreads(4, 3);
+        for (int64_t i = 0; i < numberOfRecords; i++) {
+            std::ostringstream oss;
+            oss << "record-" << i;
+            df.write(TestRecord(oss.str().c_str(), i));
+            if (i % 1000 == 0) {
+                blockStarts.insert(df.getCurrentBlockStart());
+            }
+        }
+        df.close();
+    }
+    BOOST_CHECK_GT(blockStarts.size(), 5);
+
+    {
+        avro::DataFileReader<TestRecord> df(filename);
+        TestRecord readRecord("", 0);
+        int64_t i = 0;
+        while (df.read(readRecord)) {
+            std::ostringstream oss;
+            oss << "record-" << i;
+            BOOST_CHECK_EQUAL(readRecord.id, i);
+            BOOST_CHECK_EQUAL(readRecord.s1, oss.str());
+            ++i;
+        }
+        BOOST_CHECK_EQUAL(i, numberOfRecords);
+    }
+    {
+        // Every block start seen by the writer is a block start for the reader.
+        avro::DataFileReader<TestRecord> df(filename);
+        for (uint64_t blockStart : blockStarts) {
+            df.seek(blockStart);
+            BOOST_CHECK_EQUAL(df.previousSync(), blockStart);
+        }
+    }
+    BOOST_CHECK(boost::filesystem::remove(filename));
+}
+
+void testParallelCompressionDeflateCodec() {
+    BOOST_TEST_CHECKPOINT(__func__);
+    testParallelCompression(avro::DEFLATE_CODEC);
+}
+
+// Fails the failAt-th call to next(), counting the calls made after it.
+class FailingOutputStream : public avro::OutputStream {
+    std::unique_ptr<avro::OutputStream> out_;
+    size_t failAt_;
+    size_t &calls_;
+    size_t &callsAfterFailure_;
+
+public:
+    FailingOutputStream(size_t failAt, size_t &calls, size_t &callsAfterFailure)
+        : out_(avro::memoryOutputStream(64)), failAt_(failAt), calls_(calls), callsAfterFailure_(callsAfterFailure) {}
+
+    bool next(uint8_t **data, size_t *len) override {
+        if (++calls_ == failAt_) {
+            throw avro::Exception("Write failed");
+        }
+        if (calls_ > failAt_) {
+            ++callsAfterFailure_;
+        }
+        return out_->next(data, len);
+    }
+
+    void backup(size_t len) override { out_->backup(len); }
+
+    uint64_t byteCount() const override { return out_->byteCount(); }
+
+    void flush() override { out_->flush(); }
+};
+
+void testParallelCompressionFailure() {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    size_t calls = 0;
+    size_t callsAfterFailure = 0;
+    std::unique_ptr<avro::OutputStream> out(new FailingOutputStream(40, calls, callsAfterFailure));
+    avro::DataFileWriter<TestRecord> df(std::move(out), writerSchema, 256, avro::DEFLATE_CODEC);
+    df.setCompressionThreads(2, 2);
+    int64_t i = 0;
+    bool failed = false;
+    for (; !failed && i < 100000; ++i) {
+        try {
+            df.write(TestRecord("record", i));
+        } catch (const avro::Exception &) {
+            failed = true;
+        }
+    }
+    BOOST_REQUIRE(failed);
+
+    // The failure is reported again by every later call, and nothing
+    // written after it reaches the stream.
+    for (int64_t j = 0; j < 1000; ++j) {
+        try {
+            df.write(TestRecord("record", i + j));
+        } catch (const avro::Exception &) {
+        }
+    }
+    BOOST_CHECK_THROW(df.flush(), avro::Exception);
+    BOOST_CHECK_THROW(df.flush(), avro::Exception);
+    BOOST_CHECK_THROW(df.close(), avro::Exception);
+    BOOST_CHECK_THROW(df.close(), avro::Exception);
+    BOOST_CHECK_EQUAL(callsAfterFailure, 0);
+}
+
+#ifdef SNAPPY_CODEC_AVAILABLE
+void testParallelCompressionSnappyCodec() {
+    BOOST_TEST_CHECKPOINT(__func__);
+    testParallelCompression(avro::SNAPPY_CODEC);
+}
+#endif
+
+static avro::DataFileStats writeWithStats(const char *filename, avro::Codec codec,
+                                          size_t threads, bool timing) {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    avro::DataFileWriter<TestRecord> df(filename, writerSchema, 1024, codec);
+    df.setCompressionThreads(threads);
+    df.setTiming(timing);
+    for (int64_t i = 0; i < 10000; i++) {
+        std::ostringstream oss;
+        oss << "record-" << i;
+        df.write(TestRecord(oss.str().c_str(), i));
+    }
+    df.close();
+    return df.stats();
+}
+
+static avro::DataFileStats readWithStats(const char *filename, size_t threads) {
+    avro::DataFileReader<TestRecord> df(filename);
+    df.setDecompressionThreads(threads);
+    df.setTiming(true);
+    TestRecord readRecord("", 0);
+    int64_t n = 0;
+    while (df.read(readRecord)) {
+        ++n;
+    }
+    BOOST_CHECK_EQUAL(n, 10000);
+    return df.stats();
+}
+
+static void checkStats(const avro::DataFileStats &stats) {
+    BOOST_CHECK_EQUAL(stats.objects, 10000);
+    BOOST_CHECK_GT(stats.blocks, 5);
+    int64_t blocks = 0;
+    for (int64_t b : stats.blockSizes) {
+        blocks += b;
+    }
+    BOOST_CHECK_EQUAL(blocks, stats.blocks);
+    // Blocks are cut once they reach 1024 bytes.
+    BOOST_CHECK_GT(stats.blockSizes[10], 0);
+}
+
+void testDataFileStats() {
+    const char *filename = "test_dataFileStats.df";
+    avro::DataFileStats written = writeWithStats(filename, avro::DEFLATE_CODEC, 0, true);
+    checkStats(written);
+    BOOST_CHECK_LT(written.compressedBytes, written.rawBytes);
+    BOOST_CHECK_GT(written.encodeNanos, 0);
+    BOOST_CHECK_GT(written.compressNanos, 0);
+    BOOST_CHECK_GT(written.ioNanos, 0);
+    BOOST_CHECK_EQUAL(written.decodeNanos, 0);
+
+    // The counts do not depend on where blocks are compressed.
+    avro::DataFileStats parallel = writeWithStats(filename, avro::DEFLATE_CODEC, 2, false);
+    BOOST_CHECK_EQUAL(parallel.blocks, written.blocks);
+    BOOST_CHECK_EQUAL(parallel.rawBytes, written.rawBytes);
+    BOOST_CHECK_EQUAL(parallel.compressedBytes, written.compressedBytes);
+    BOOST_CHECK_EQUAL(parallel.encodeNanos, 0);
+    BOOST_CHECK_EQUAL(parallel.compressNanos, 0);
+
+    for (size_t threads = 0; threads < 3; threads += 2) {
+        avro::DataFileStats read = readWithStats(filename, threads);
+        BOOST_CHECK_EQUAL(read.blocks, written.blocks);
+        BOOST_CHECK_EQUAL(read.objects, written.objects);
+        BOOST_CHECK_EQUAL(read.rawBytes, written.rawBytes);
+        BOOST_CHECK_EQUAL(read.compressedBytes, written.compressedBytes);
+        BOOST_CHECK_GT(read.decodeNanos, 0);
+        BOOST_CHECK_GT(read.compressNanos, 0);
+        BOOST_CHECK_EQUAL(read.encodeNanos, 0);
+    }
+
+    written = writeWithStats(filename, avro::NULL_CODEC, 0, false);
+    checkStats(written);
+    BOOST_CHECK_EQUAL(written.compressedBytes, written.rawBytes);
+    avro::DataFileStats read = readWithStats(filename, 0);
+    BOOST_CHECK_EQUAL(read.rawBytes, written.rawBytes);
+    BOOST_CHECK_EQUAL(read.compressNanos, 0);
+    std::remove(filename);
+}
+
+static std::vector<avro::DataFileBlock> blocksOf(const char *filename) {
+    avro::DataFileBlockReader reader(filename);
+    std::vector<avro::DataFileBlock> result;
+    avro::DataFileBlock block;
+    while (reader.next(block)) {
+        if (block.objectCount != 0) {
+            result.push_back(block);
+        }
+    }
+    return result;
+}
+
+void testSyncPolicy() {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    const char *filename = "test_syncPolicy.df";
+    {
+        avro::DataFileWriter<TestRecord> df(filename, writerSchema, 16 * 1024);
+        avro::SyncPolicy policy;
+        policy.maxObjects = 100;
+        df.setSyncPolicy(policy);
+        for (int64_t i = 0; i < 1050; i++) {
+            df.write(TestRecord("record", i));
+        }
+    }
+    std::vector<avro::DataFileBlock> blocks = blocksOf(filename);
+    BOOST_REQUIRE_EQUAL(blocks.size(), 11U);
+    for (size_t i = 0; i < 10; ++i) {
+        BOOST_CHECK_EQUAL(blocks[i].objectCount, 100);
+    }
+
+    // Once the ratio is known, compressed blocks come close to the target.
+    {
+        avro::DataFileWriter<TestRecord> df(filename, writerSchema, 64 * 1024, avro::DEFLATE_CODEC);
+        avro::SyncPolicy policy;
+        policy.targetBlockSize = 2048;
+        df.setSyncPolicy(policy);
+        for (int64_t i = 0; i < 100000; i++) {
+            std::ostringstream oss;
+            oss << "record-" << i;
+            df.write(TestRecord(oss.str().c_str(), i));
+        }
+    }
+    blocks = blocksOf(filename);
+    BOOST_REQUIRE_GT(blocks.size(), 10U);
+    BOOST_CHECK_GT(blocks[0].byteSize, 4096);
+    for (size_t i = 2; i + 1 < blocks.size(); ++i) {
+        BOOST_CHECK_GT(blocks[i].byteSize, 1024);
+        BOOST_CHECK_LT(blocks[i].byteSize, 4096);
+    }
+
+    {
+        avro::DataFileWriter<TestRecord> df(filename, writerSchema, 16 * 1024);
+        avro::SyncPolicy policy;
+        policy.maxLatency = std::chrono::milliseconds(10);
+        df.setSyncPolicy(policy);
+        df.write(TestRecord("record", 0));
+        df.syncIfStale();
+        BOOST_CHECK_EQUAL(df.stats().blocks, 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        df.syncIfStale();
+        BOOST_CHECK_EQUAL(df.stats().blocks, 1);
+        df.write(TestRecord("record", 1));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        // The stale block ends before the next object goes in.
+        df.write(TestRecord("record", 2));
+        BOOST_CHECK_EQUAL(df.stats().blocks, 2);
+    }
+    blocks = blocksOf(filename);
+    BOOST_REQUIRE_EQUAL(blocks.size(), 3U);
+
+    avro::DataFileWriter<TestRecord> df(filename, writerSchema, 16 * 1024);
+    avro::SyncPolicy policy;
+    policy.targetBlockSize = 8;
+    BOOST_CHECK_THROW(df.setSyncPolicy(policy), avro::Exception);
+    df.close();
+    std::remove(filename);
+}
+
+void testWriteBatch() {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    const char *filename = "test_writeBatch.df";
+    std::vector<TestRecord> records;
+    for (int64_t i = 0; i < 5000; i++) {
+        records.emplace_back("record", i);
+    }
+    {
+        avro::DataFileWriter<TestRecord> df(filename, writerSchema, 4096);
+        avro::SyncPolicy policy;
+        policy.maxObjects = 300;
+        df.setSyncPolicy(policy);
+        df.writeBatch(records.data(), records.data());
+        df.writeBatch(records.data(), records.data() + 10);
+        df.writeBatch(records.data() + 10, records.data() + records.size());
+    }
+    std::vector<avro::DataFileBlock> blocks = blocksOf(filename);
+    BOOST_REQUIRE_GT(blocks.size(), 16U);
+    for (const avro::DataFileBlock &b : blocks) {
+        BOOST_CHECK_LE(b.objectCount, 300);
+        BOOST_CHECK_LT(b.byteSize, 2 * 4096);
+    }
+
+    avro::DataFileReader<TestRecord> df(filename, writerSchema);
+    TestRecord r("", 0);
+    int64_t i = 0;
+    while (df.read(r)) {
+        BOOST_CHECK_EQUAL(r.id, i);
+        BOOST_CHECK_EQUAL(r.s1, "record");
+        ++i;
+    }
+    BOOST_CHECK_EQUAL(i, 5000);
+    df.close();
+    std::remove(filename);
+}
+
+void testReadBatch() {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(sch);
+    const char *filename = "test_readBatch.df";
+    {
+        avro::DataFileWriter<ComplexInteger> df(filename, writerSchema, 100);
+        for (int64_t i = 0; i < 1000; i++) {
+            df.write(ComplexInteger(i, -i));
+        }
+    }
+    {
+        avro::DataFileReader<ComplexInteger> df(filename, writerSchema);
+        std::vector<ComplexInteger> items;
+        BOOST_CHECK_EQUAL(df.readBatch(items, 0), 0U);
+        int64_t i = 0;
+        size_t batches = 0;
+        for (size_t n; (n = df.readBatch(items, 7)) != 0; ++batches) {
+            BOOST_REQUIRE_LE(n, 7U);
+            BOOST_REQUIRE_EQUAL(items.size(), n);
+            for (const ComplexInteger &c : items) {
+                BOOST_CHECK_EQUAL(c.re, i);
+                BOOST_CHECK_EQUAL(c.im, -i);
+                ++i;
+            }
+        }
+        BOOST_CHECK_EQUAL(i, 1000);
+        BOOST_CHECK_GE(batches, 1000U / 7);
+        BOOST_CHECK(items.empty());
+    }
+
+    avro::DataFileReader<ComplexInteger> df(filename, writerSchema);
+    std::vector<avro::DataFileBlock> blocks = blocksOf(filename);
+    ComplexInteger first;
+    BOOST_REQUIRE(df.read(first));
+    std::vector<ComplexInteger> items;
+    int64_t i = 1;
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        size_t n = df.readBlock(items);
+        // The first block has lost the entry read on its own.
+        BOOST_CHECK_EQUAL(n, static_cast<size_t>(blocks[b].objectCount) - (b == 0 ? 1 : 0));
+        for (const ComplexInteger &c : items) {
+            BOOST_CHECK_EQUAL(c.re, i);
+            ++i;
+        }
+    }
+    BOOST_CHECK_EQUAL(i, 1000);
+    BOOST_CHECK_EQUAL(df.readBlock(items), 0U);
+    df.close();
+    std::remove(filename);
+}
+
+void testRecordBatch() {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(sch);
+    const char *filename = "test_recordBatch.df";
+    {
+        avro::DataFileWriter<ComplexInteger> df(filename, writerSchema);
+        for (int64_t i = 0; i < 1000; i++) {
+            df.write(ComplexInteger(i, -i));
+        }
+    }
+    avro::DataFileReader<ComplexInteger> df(filename, writerSchema);
+    avro::RecordBatch<ComplexInteger> batch;
+    BOOST_REQUIRE_EQUAL(df.readBatch(batch, 50), 50U);
+    BOOST_CHECK_EQUAL(batch.size(), 50U);
+
+    // Handlers on other threads share the records; their edits are
+    // their own.
+    std::vector<int64_t> sums(2, 0);
+    std::vector<std::thread> handlers;
+    for (size_t h = 0; h < sums.size(); ++h) {
+        handlers.emplace_back([&sums, h, batch]() {
+            avro::RecordBatchOverlay<ComplexInteger> overlay(batch);
+            overlay.edit(3).re = 1000 * static_cast<int64_t>(h + 1);
+            for (size_t i = 0; i < overlay.size(); ++i) {
+                sums[h] += overlay[i].re;
+            }
+        });
+    }
+    for (std::thread &t : handlers) {
+        t.join();
+    }
+    BOOST_CHECK_EQUAL(sums[0], 49 * 50 / 2 - 3 + 1000);
+    BOOST_CHECK_EQUAL(sums[1], 49 * 50 / 2 - 3 + 2000);
+    BOOST_CHECK_EQUAL(batch[3].re, 3);
+
+    avro::RecordBatchOverlay<ComplexInteger> overlay(batch);
+    BOOST_CHECK(!overlay.edited(3));
+    overlay.edit(3).im = 7;
+    overlay.edit(3).re = 8;
+    BOOST_CHECK_EQUAL(overlay.edits(), 1U);
+    BOOST_CHECK_EQUAL(overlay[3].re, 8);
+    BOOST_CHECK_EQUAL(overlay[4].re, 4);
+    overlay.reset();
+    BOOST_CHECK_EQUAL(overlay[3].im, -3);
+
+    // A shared batch gets new records; the holders keep theirs. A batch
+    // of its own is decoded over.
+    avro::RecordBatch<ComplexInteger> kept = batch;
+    BOOST_CHECK(!batch.unique());
+    BOOST_REQUIRE_EQUAL(df.readBatch(batch, 50), 50U);
+    BOOST_CHECK_EQUAL(kept[0].re, 0);
+    BOOST_CHECK_EQUAL(batch[0].re, 50);
+    kept = avro::RecordBatch<ComplexInteger>();
+    overlay = avro::RecordBatchOverlay<ComplexInteger>(avro::RecordBatch<ComplexInteger>());
+    BOOST_CHECK(batch.unique());
+    const ComplexInteger *first = &batch[0];
+    BOOST_REQUIRE_EQUAL(df.readBatch(batch, 50), 50U);
+    BOOST_CHECK_EQUAL(&batch[0], first);
+    BOOST_CHECK_EQUAL(batch[0].re, 100);
+    df.close();
+    std::remove(filename);
+}
+
+void testConcurrentWriter() {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+    const char *filename = "test_concurrentWriter.df";
+    const int64_t producers = 4;
+    const int64_t perProducer = 5000;
+    {
+        avro::ConcurrentDataFileWriter<TestRecord> df(filename, writerSchema, 1024, avro::DEFLATE_CODEC, 2);
+        std::vector<std::thread> threads;
+        for (int64_t p = 0; p < producers; ++p) {
+            threads.emplace_back([&df, p, perProducer]() {
+                avro::ConcurrentDataFileWriter<TestRecord>::Producer producer(df);
+                for (int64_t i = 0; i < perProducer; ++i) {
+                    producer.write(TestRecord("abcdefghij", p * perProducer + i));
+                }
+            });
+        }
+        for (std::thread &t : threads) {
+            t.join();
+        }
+        df.flush();
+        BOOST_CHECK_EQUAL(df.stats().objects, producers * perProducer);
+    }
+
+    // Each producer's objects come in order, though their blocks
+    // interleave with those of the others.
+    avro::DataFileReader<TestRecord> df(filename, writerSchema);
+    std::vector<int64_t> next(producers);
+    for (int64_t p = 0; p < producers; ++p) {
+        next[p] = p * perProducer;
+    }
+    TestRecord r("", 0);
+    int64_t count = 0;
+    while (df.read(r)) {
+        int64_t p = r.id / perProducer;
+        BOOST_REQUIRE_LT(p, producers);
+        BOOST_CHECK_EQUAL(r.id, next[p]);
+        next[p] = r.id + 1;
+        BOOST_CHECK_EQUAL(r.s1, "abcdefghij");
+        ++count;
+    }
+    BOOST_CHECK_EQUAL(count, producers * perProducer);
+    df.close();
+
+    avro::ConcurrentDataFileWriter<TestRecord> closed(filename, writerSchema);
+    avro::ConcurrentDataFileWriter<TestRecord>::Producer producer(closed);
+    closed.close();
+    producer.write(TestRecord("abc", 0));
+    BOOST_CHECK_THROW(producer.flush(), avro::Exception);
+    std::remove(filename);
+}
+
+// Counts the spans of each trace point.
+class CountingTraceHandler : public avro::TraceHandler {
+public:
+    std::mutex mutex;
+    std::map<avro::TracePoint, std::pair<int, int>> spans;
+
+    void begin(avro::TracePoint point, int64_t) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++spans[point].first;
+    }
+
+    void end(avro::TracePoint point, int64_t) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++spans[point].second;
+    }
+};
+
+void testTracing() {
+    CountingTraceHandler handler;
+    avro::TraceHandler *previous = avro::setTraceHandler(&handler);
+    const char *filename = "test_tracing.df";
+    {
+        avro::ValidSchema writerSchema =
+            avro::compileJsonSchemaFromString(schemaWithIdAndString);
+        avro::DataFileWriter<TestRecord> df(filename, writerSchema, 100);
+        for (int64_t i = 0; i < 100; i++) {
+            df.write(TestRecord("record", i));
+        }
+    }
+    {
+        avro::ValidSchema readerSchema = avro::compileJsonSchemaFromString(
+            R"({"type":"record","name":"R","fields":[{"name":"id","type":"long"}]})");
+        avro::DataFileReader<avro::GenericDatum> df(filename, readerSchema);
+        avro::GenericDatum datum(readerSchema);
+        int64_t n = 0;
+        while (df.read(datum)) {
+            ++n;
+        }
+        BOOST_CHECK_EQUAL(n, 100);
+        df.sync(0);
+    }
+    BOOST_CHECK_EQUAL(avro::setTraceHandler(previous), &handler);
+
+#ifdef AVRO_TRACING
+    avro::TracePoint points[] = {avro::TRACE_READ_DATA_BLOCK, avro::TRACE_SYNC,
+                                 avro::TRACE_RESOLVE, avro::TRACE_COMPILE_SCHEMA};
+    for (avro::TracePoint p : points) {
+        BOOST_CHECK_GT(handler.spans[p].first, 0);
+        BOOST_CHECK_EQUAL(handler.spans[p].first, handler.spans[p].second);
+    }
+    // One span per block and one for the end of the file.
+    BOOST_CHECK_GT(handler.spans[avro::TRACE_READ_DATA_BLOCK].first, 2);
+#else
+    BOOST_CHECK(handler.spans.empty());
+#endif
+    std::remove(filename);
+}
+
+void testParallelDecompression(avro::Codec codec) {
+    avro::ValidSchema writerSchema =
+        avro::compileJsonSchemaFromString(schemaWithIdAndString);
+
+    const char *filename = "test_parallelDecompression.df";
+    const int64_t numberOfRecords = 10000;
+    {
+        avro::DataFileWriter<TestRecord> df(filename, writerSchema, 1024, codec);
+        for (int64_t i = 0; i < numberOfRecords; i++) {
+            std::ostringstream oss;
+            oss << "record-" << i;
+            df.write(TestRecord(oss.str().c_str(), i));
+        }
+        df.close();
+    }
+
+    std::vector<int64_t> expectedSyncs;
+    {
+        avro::DataFileReader<TestRecord> df(filename);
+        TestRecord readRecord("", 0);
+        while (df.read(readRecord)) {
+            expectedSyncs.push_back(df.previousSync());
+        }
+        expectedSyncs.push_back(df.previousSync());
+    }
+
+    {
+        avro::DataFileReader<TestRecord> df(filename);
+        df.setDecompressionThreads(3, 4);
+        TestRecord readRecord("", 0);
+        std::vector<int64_t> syncs;
+        int64_t i = 0;
+        while (df.read(readRecord)) {
+            std::ostringstream oss;
+            oss << "record-" << i;
+            BOOST_CHECK_EQUAL(readRecord.id, i);
+            BOOST_CHECK_EQUAL(readRecord.s1, oss.str());
+            syncs.push_back(df.previousSync());
+            ++i;
+        }
+        syncs.push_back(df.previousSync());
+        BOOST_CHECK_EQUAL(i, numberOfRecords);
+        BOOST_CHECK(syncs == expectedSyncs);
+
+        // Seeking discards the blocks read ahead.
+        int64_t middle = expectedSyncs[expectedSyncs.size() / 2];
+        df.seek(middle);
+        BOOST_CHECK_EQUAL(df.previousSync(), middle);
+        int64_t remaining = 0;
+        while (df.read(readRecord)) {
+            ++remaining;
+        }
+        BOOST_CHECK_EQUAL(remaining, static_cast<int64_t>(std::count_if(
+                                         expectedSyncs.begin(), expectedSyncs.end() - 1,
+                                         [middle](int64_t s) { return s >= middle; })));
+    }
+    BOOST_CHECK(boost::filesystem::remove(filename));
+}
+
+void testParallelDecompressionDeflateCodec() {
+    BOOST_TEST_CHECKPOINT(__func__);
+    testParallelDecompression(avro::DEFLATE_CODEC);
+}
+
+#ifdef SNAPPY_CODEC_AVAILABLE
+void testParallelDecompressionSnappyCodec() {
+    BOOST_TEST_CHECKPOINT(__func__);
+    testParallelDecompression(avro::SNAPPY_CODEC);
+}
+#endif
+
+#ifdef ZSTD_CODEC_AVAILABLE
+void testParallelCompressionZstdCodec() {
+    BOOST_TEST_CHECKPOINT(__func__);
+    testParallelCompression(avro::ZSTD_CODEC);
+}
+
+void testParallelDecompressionZstdCodec() {
+    BOOST_TEST_CHECKPOINT(__func__);
+    testParallelDecompression(avro::ZSTD_CODEC);
+}
+#endif
+
+#ifdef XZ_CODEC_AVAILABLE
+void testParallelCompressionXzCodec() {
+    BOOST_TEST_CHECKPOINT(__func__);
+    testParallelCompression(avro::XZ_CODEC);
+}
+
+void testParallelDecompressionXzCodec() {
+    BOOST_TEST_CHECKPOINT(__func__);
+    testParallelDecompression(avro::XZ_CODEC);
+}
+#endif
+
+#ifdef LZ4_CODEC_AVAILABLE
+void testParallelCompressionLz4Codec() {
+    BOOST_TEST_CHECKPOINT(__func__);
+    testParallelCompression(avro::LZ4_CODEC);
+}
+
+void testParallelDecompressionLz4Codec() {
+    BOOST_TEST_CHECKPOINT(__func__);
+    testParallelDecompression(avro::LZ4_CODEC);
+}
+#endif
+
+test_suite *
+init_unit_test_suite(int argc, char *argv[]) {
+    {
+        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test0.df");
+        shared_ptr<DataFileTest> t1(new DataFileTest("test1.d0", sch, isch, 0));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testWrite, t1));
+        addReaderTests(ts, t1);
+        boost::unit_test::framework::master_test_suite().add(ts);
+    }
+    {
+        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test1.df");
+        shared_ptr<DataFileTest> t1(new DataFileTest("test1.df", sch, isch));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testWrite, t1));
+        addReaderTests(ts, t1);
+        boost::unit_test::framework::master_test_suite().add(ts);
+    }
+    {
+        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test1.defalate.df");
+        shared_ptr<DataFileTest> t1(new DataFileTest("test1.deflate.df", sch, isch));
+        ts->add(BOOST_CLASS_TEST_CASE(
+            &DataFileTest::testWriteWithDeflateCodec, t1));
+        addReaderTests(ts, t1);
+        boost::unit_test::framework::master_test_suite().add(ts);
+    }
+#ifdef SNAPPY_CODEC_AVAILABLE
+    {
+        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test1.snappy.df");
+        shared_ptr<DataFileTest> t1(new DataFileTest("test1.snappy.df", sch, isch));
+        ts->add(BOOST_CLASS_TEST_CASE(
+            &DataFileTest::testWriteWithSnappyCodec, t1));
+        addReaderTests(ts, t1);
+        boost::unit_test::framework::master_test_suite().add(ts);
+    }
+#endif
+    {
+        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test2.df");
+        shared_ptr<DataFileTest> t2(new DataFileTest("test2.df", sch, isch));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testWriteGeneric, t2));
+        addReaderTests(ts, t2);
+        boost::unit_test::framework::master_test_suite().add(ts);
+    }
+    {
+        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test3.df");
+        shared_ptr<DataFileTest> t3(new DataFileTest("test3.df", dsch, dblsch));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testWriteDouble, t3));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testReadDouble, t3));
+        ts->add(
+            BOOST_CLASS_TEST_CASE(&DataFileTest::testReadDoubleTwoStep, t3));
+        ts->add(BOOST_CLASS_TEST_CASE(
+            &DataFileTest::testReadDoubleTwoStepProject, t3));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testCleanup, t3));
+        boost::unit_test::framework::master_test_suite().add(ts);
+    }
+    {
+        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test4.df");
+        shared_ptr<DataFileTest> t4(new DataFileTest("test4.df", dsch, dblsch));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testTruncate, t4));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testCleanup, t4));
+        boost::unit_test::framework::master_test_suite().add(ts);
+    }
+    {
+        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test5.df");
+        shared_ptr<DataFileTest> t5(new DataFileTest("test5.df", sch, isch));
+        ts->add(
+            BOOST_CLASS_TEST_CASE(&DataFileTest::testWriteGenericByName, t5));
+        addReaderTests(ts, t5);
+        boost::unit_test::framework::master_test_suite().add(ts);
+    }
+    {
+        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test6.df");
+        shared_ptr<DataFileTest> t6(new DataFileTest("test6.df", dsch, dblsch));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testZip, t6));
+        boost::unit_test::framework::master_test_suite().add(ts);
+    }
+    {
+        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test8.df");
+        shared_ptr<DataFileTest> t8(new DataFileTest("test8.df", dsch, dblsch));
+#ifdef SNAPPY_CODEC_AVAILABLE
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testSnappy, t8));
+#endif
+        boost::unit_test::framework::master_test_suite().add(ts);
+    }
+    {
+        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test7.df");
+        shared_ptr<DataFileTest> t7(new DataFileTest("test7.df", fsch, fsch));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testSchemaReadWrite, t7));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testCleanup, t7));
+        boost::unit_test::framework::master_test_suite().add(ts);
+    }
+    {
+        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test9.df");
+        shared_ptr<DataFileTest> t9(new DataFileTest("test9.df", sch, sch));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testWrite, t9));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testReaderSyncSeek, t9));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testReadMapped, t9));
+        //ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testCleanup, t9));
+        boost::unit_test::framework::master_test_suite().add(ts);
+    }
+    {
+        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test10.df");
+        shared_ptr<DataFileTest> t(new DataFileTest("test10.df", sch, sch));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testWrite, t));
+        ts->add(
+            BOOST_CLASS_TEST_CASE(&DataFileTest::testReaderSyncDiscovery, t));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testCleanup, t));
+        boost::unit_test::framework::master_test_suite().add(ts);
+    }
+    {
+        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test11.df");
+        shared_ptr<DataFileTest> t(new DataFileTest("test11.df", sch, sch));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testWrite, t));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testReaderSplits, t));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testCleanup, t));
+        boost::unit_test::framework::master_test_suite().add(ts);
+    }
+    {
+        test_suite *ts = BOOST_TEST_SUITE("DataFile tests: test12.df");
+        shared_ptr<DataFileTest> t(new DataFileTest("test12.df", ischWithDoc, ischWithDoc));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testWrite, t));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testSchemaReadWriteWithDoc, t));
+        ts->add(BOOST_CLASS_TEST_CASE(&DataFileTest::testCleanup, t));
+        boost::unit_test::framework::master_test_suite().add(ts);
+    }
+
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testSkipStringNullCodec));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testSkipStringDeflateCodec));
+#ifdef SNAPPY_CODEC_AVAILABLE
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testSkipStringSnappyCodec));
+#endif
+#ifdef ZSTD_CODEC_AVAILABLE
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testSkipStringZstdCodec));
+#endif
+#ifdef XZ_CODEC_AVAILABLE
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testSkipStringXzCodec));
+#endif
+#ifdef LZ4_CODEC_AVAILABLE
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testSkipStringLz4Codec));
+#endif
+
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testLastSyncNullCodec));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testLastSyncDeflateCodec));
+#ifdef SNAPPY_CODEC_AVAILABLE
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testLastSyncSnappyCodec));
+#endif
+#ifdef ZSTD_CODEC_AVAILABLE
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testLastSyncZstdCodec));
+#endif
+
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testReadRecordEfficientlyUsingLastSyncNullCodec));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testReadRecordEfficientlyUsingLastSyncDeflateCodec));
+#ifdef SNAPPY_CODEC_AVAILABLE
     boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testReadRecordEfficientlyUsingLastSyncSnappyCodec));
 #endif
 
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testParallelCompressionDeflateCodec));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testParallelCompressionFailure));
+#ifdef SNAPPY_CODEC_AVAILABLE
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testParallelCompressionSnappyCodec));
+#endif
+
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testParallelDecompressionDeflateCodec));
+#ifdef SNAPPY_CODEC_AVAILABLE
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testParallelDecompressionSnappyCodec));
+#endif
+#ifdef ZSTD_CODEC_AVAILABLE
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testParallelCompressionZstdCodec));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testParallelDecompressionZstdCodec));
+#endif
+#ifdef XZ_CODEC_AVAILABLE
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testParallelCompressionXzCodec));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testParallelDecompressionXzCodec));
+#endif
+#ifdef LZ4_CODEC_AVAILABLE
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testParallelCompressionLz4Codec));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testParallelDecompressionLz4Codec));
+#endif
+
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testBlockReaderNullCodec));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testBlockReaderDeflateCodec));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testAppendEncodedBatch));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testDirectBlocks));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testSizedWrites));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testSharedDataFile));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testAppender));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testSortDataFile));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testJsonLinesToDataFile));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testParallelScan));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testStreamOptions));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testCrc32));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testCodecRegistry));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testTransposingCodec));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testBlockStatistics));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testRecordFilter));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testReadFromMemory));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testAsyncReader));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testAsyncPrefetch));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testBlockIndex));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testSkip));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testTryRead));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testBlockChecksums));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testColumnarBatchReader));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testColumnarBatchWriter));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testDataFileStats));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testTracing));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testSyncPolicy));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testWriteBatch));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testReadBatch));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testRecordBatch));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testConcurrentWriter));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testSyncScan));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testDatasetReader));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testReopen));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testBlockCache));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testRollingWriter));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testCodecSelector));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testGroupCommit));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testExecutor));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testNumaScan));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testCopyCounters));
+
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testCompressionLevelDeflateCodec));
+#ifdef ZSTD_CODEC_AVAILABLE
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testCompressionLevelZstdCodec));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testZstdDictionary));
+#endif
+#ifdef XZ_CODEC_AVAILABLE
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testCompressionLevelXzCodec));
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testLzmaCodec));
+#endif
+#ifdef LZ4_CODEC_AVAILABLE
+    boost::unit_test::framework::master_test_suite().add(BOOST_TEST_CASE(&testCompressionLevelLz4Codec));
+#endif
+
     return 0;
 }
@@ -0,0 +1,268 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "Compiler.hh"
+#include "Ipc.hh"
+#include "Protocol.hh"
+#include "Stream.hh"
+#include <boost/test/included/unit_test_framework.hpp>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#endif
+
+namespace avro {
+namespace ipc {
+
+static const char mailProtocol[] = R"({
+    "protocol": "Mail",
+    "namespace": "org.example",
+    "doc": "Sends mail.",
+    "types": [
+        {"type": "record", "name": "Letter", "fields": [
+            {"name": "to", "type": "string"},
+            {"name": "body", "type": "string"}
+        ]},
+        {"type": "error", "name": "Undeliverable", "fields": [
+            {"name": "reason", "type": "string"}
+        ]}
+    ],
+    "messages": {
+        "send": {
+            "doc": "Sends a letter, and returns its number.",
+            "request": [{"name": "letter", "type": "Letter"}],
+            "response": "long",
+            "errors": ["Undeliverable"]
+        },
+        "count": {"request": [], "response": "int"},
+        "ping": {"request": [{"name": "n", "type": "int"}], "response": "null", "one-way": true}
+    }
+})";
+
+static void testCompileProtocol() {
+    Protocol p = compileJsonProtocolFromString(mailProtocol);
+    BOOST_CHECK_EQUAL(p.name(), "Mail");
+    BOOST_CHECK_EQUAL(p.ns(), "org.example");
+    BOOST_REQUIRE_EQUAL(p.types().size(), 2);
+    BOOST_CHECK_EQUAL(p.types()[0]->name().fullname(), "org.example.Letter");
+    BOOST_REQUIRE_EQUAL(p.messages().size(), 3);
+
+    const Message *send = p.message("send");
+    BOOST_REQUIRE(send != nullptr);
+    BOOST_CHECK_EQUAL(send->doc, "Sends a letter, and returns its number.");
+    BOOST_CHECK_EQUAL(send->request->type(), AVRO_RECORD);
+    BOOST_REQUIRE_EQUAL(send->request->leaves(), 1);
+    BOOST_CHECK_EQUAL(send->request->nameAt(0), "letter");
+    BOOST_CHECK_EQUAL(send->response->type(), AVRO_LONG);
+    BOOST_REQUIRE_EQUAL(send->errors->leaves(), 2);
+    BOOST_CHECK_EQUAL(send->errors->leafAt(0)->type(), AVRO_STRING);
+    BOOST_CHECK(!send->oneWay);
+    BOOST_CHECK(p.message("ping")->oneWay);
+    BOOST_CHECK(p.message("none") == nullptr);
+
+    // The same protocol written differently has the same JSON, and so
+    // the same hash.
+    Protocol q = compileJsonProtocolFromString(p.json());
+    BOOST_CHECK_EQUAL(q.json(), p.json());
+    BOOST_CHECK(q.md5() == p.md5());
+
+    BOOST_CHECK_THROW(compileJsonProtocolFromString(R"({"protocol": "P", "messages": {"m": {"request": [], "response": "Nowhere"}}})"),
+                      Exception);
+}
+
+static void testFrames() {
+    std::vector<uint8_t> bytes(20000);
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        bytes[i] = static_cast<uint8_t>(i * 7);
+    }
+    OutputStreamPtr out = memoryOutputStream();
+    writeFrames(*out, *memoryInputStream(bytes.data(), bytes.size()), 3000);
+    writeFrames(*out, *memoryInputStream(bytes.data(), 0));
+    out->flush();
+
+    InputStreamPtr in = memoryInputStream(*out);
+    std::vector<uint8_t> message;
+    BOOST_REQUIRE(readFrames(*in, message));
+    BOOST_CHECK(message == bytes);
+    BOOST_REQUIRE(readFrames(*in, message));
+    BOOST_CHECK(message.empty());
+    BOOST_CHECK(!readFrames(*in, message));
+
+    // A message cut short.
+    std::vector<uint8_t> cut = {0, 0, 0, 5, 1, 2};
+    in = memoryInputStream(cut.data(), cut.size());
+    BOOST_CHECK_THROW(readFrames(*in, message), Exception);
+}
+
+#ifndef _WIN32
+class MailResponder : public RpcResponder {
+public:
+    explicit MailResponder(const Protocol &p) : RpcResponder(p), sent_(0), pings_(0) {}
+
+    void respond(const Message &message, const GenericDatum &request,
+                 GenericDatum &response) override {
+        const GenericRecord &r = request.value<GenericRecord>();
+        if (message.name == "send") {
+            const GenericRecord &letter = r.fieldAt(0).value<GenericRecord>();
+            const std::string &to = letter.field("to").value<std::string>();
+            if (to == "nobody") {
+                GenericDatum error(protocol_.types()[1]);
+                error.value<GenericRecord>().fieldAt(0).value<std::string>() = "no such person";
+                throw RpcError("undeliverable", error);
+            }
+            if (to.empty()) {
+                throw Exception("no address");
+            }
+            response.value<int64_t>() = ++sent_;
+        } else if (message.name == "count") {
+            response.value<int32_t>() = static_cast<int32_t>(sent_ + pings_);
+        } else {
+            pings_ += r.fieldAt(0).value<int32_t>();
+        }
+    }
+
+private:
+    int64_t sent_;
+    int64_t pings_;
+};
+
+static GenericDatum letter(const Message &send, const std::string &to) {
+    GenericDatum request(send.request);
+    GenericRecord &letter = request.value<GenericRecord>().fieldAt(0).value<GenericRecord>();
+    letter.field("to").value<std::string>() = to;
+    letter.field("body").value<std::string>() = "Hello";
+    return request;
+}
+
+// Runs a client of p over a new connection to a MailResponder of the
+// protocol of the test.
+template<typename F>
+static void withServer(const Protocol &p, std::shared_ptr<HandshakeCache> cache, F f) {
+    Protocol server = compileJsonProtocolFromString(mailProtocol);
+    int sv[2];
+    BOOST_REQUIRE_EQUAL(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+    std::thread t([&]() {
+        InputStreamPtr in = socketInputStream(sv[1]);
+        OutputStreamPtr out = socketOutputStream(sv[1]);
+        MailResponder responder(server);
+        responder.serve(*in, *out);
+    });
+    {
+        InputStreamPtr in = socketInputStream(sv[0]);
+        OutputStreamPtr out = socketOutputStream(sv[0]);
+        RpcClient client(p, *in, *out, cache, "mail");
+        f(client);
+        ::shutdown(sv[0], SHUT_WR);
+    }
+    t.join();
+    ::close(sv[0]);
+    ::close(sv[1]);
+}
+
+static void testCalls() {
+    Protocol p = compileJsonProtocolFromString(mailProtocol);
+    const Message &send = *p.message("send");
+    auto cache = std::make_shared<HandshakeCache>();
+
+    withServer(p, cache, [&](RpcClient &client) {
+        BOOST_CHECK_EQUAL(client.call("send", letter(send, "alice")).value<int64_t>(), 1);
+
+        // Pipelined: all of the calls go out before any response is read.
+        client.send("send", letter(send, "bob"));
+        client.send("send", letter(send, "nobody"));
+        client.send("send", letter(send, ""));
+        GenericDatum ping(p.message("ping")->request);
+        ping.value<GenericRecord>().fieldAt(0).value<int32_t>() = 10;
+        client.send("ping", ping);
+        client.send("count", GenericDatum(p.message("count")->request));
+        BOOST_CHECK_EQUAL(client.pending(), 4);
+
+        GenericDatum response;
+        client.receive(response);
+        BOOST_CHECK_EQUAL(response.value<int64_t>(), 2);
+        try {
+            client.receive(response);
+            BOOST_ERROR("Expected a declared error");
+        } catch (RpcError &e) {
+            BOOST_CHECK_EQUAL(std::string(e.what()), "Remote error org.example.Undeliverable");
+            BOOST_REQUIRE_EQUAL(e.error().unionBranch(), 1);
+            BOOST_CHECK_EQUAL(e.error().value<GenericRecord>().fieldAt(0).value<std::string>(), "no such person");
+        }
+        try {
+            client.receive(response);
+            BOOST_ERROR("Expected a string error");
+        } catch (RpcError &e) {
+            BOOST_CHECK_EQUAL(std::string(e.what()), "no address");
+            BOOST_CHECK_EQUAL(e.error().unionBranch(), 0);
+        }
+        client.receive(response);
+        BOOST_CHECK_EQUAL(response.value<int32_t>(), 12);
+        BOOST_CHECK_EQUAL(client.pending(), 0);
+        BOOST_CHECK_THROW(client.receive(response), Exception);
+
+        BOOST_CHECK_THROW(client.send("none", ping), Exception);
+        BOOST_CHECK_THROW(client.send("send", ping), Exception);
+    });
+
+    // The second connection reuses the handshake of the first.
+    HandshakeCache::Hash hash;
+    BOOST_REQUIRE(cache->lookup("mail", p.md5(), hash));
+    BOOST_CHECK(hash == p.md5());
+    withServer(p, cache, [&](RpcClient &client) {
+        BOOST_CHECK_EQUAL(client.call("send", letter(send, "carol")).value<int64_t>(), 1);
+    });
+
+    // The server corrects a stale cached hash of its protocol.
+    HandshakeCache::Hash stale = {};
+    cache->store("mail", p.md5(), stale);
+    withServer(p, cache, [&](RpcClient &client) {
+        BOOST_CHECK_EQUAL(client.call("send", letter(send, "dave")).value<int64_t>(), 1);
+    });
+    BOOST_REQUIRE(cache->lookup("mail", p.md5(), hash));
+    BOOST_CHECK(hash == p.md5());
+}
+
+static void testRefusedProtocol() {
+    Protocol other = compileJsonProtocolFromString(R"({
+        "protocol": "Other",
+        "messages": {"count": {"request": [], "response": "int"}}
+    })");
+    withServer(other, nullptr, [&](RpcClient &client) {
+        BOOST_CHECK_THROW(client.call("count", GenericDatum(other.message("count")->request)),
+                          Exception);
+    });
+}
+#endif
+
+} // namespace ipc
+} // namespace avro
+
+boost::unit_test::test_suite *
+init_unit_test_suite(int /*argc*/, char * /*argv*/[]) {
+    boost::unit_test::test_suite *ts =
+        BOOST_TEST_SUITE("Avro C++ unit tests for RPC");
+    ts->add(BOOST_TEST_CASE(&avro::ipc::testCompileProtocol));
+    ts->add(BOOST_TEST_CASE(&avro::ipc::testFrames));
+#ifndef _WIN32
+    ts->add(BOOST_TEST_CASE(&avro::ipc::testCalls));
+    ts->add(BOOST_TEST_CASE(&avro::ipc::testRefusedProtocol));
+#endif
+    return ts;
+}
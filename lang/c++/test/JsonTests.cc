@@ -16,6 +16,8 @@
  * limitations under the License.
  */
 
+#include <cstdint>
+#include <cstdlib>
 #include <limits>
 
 #include <boost/test/included/unit_test_framework.hpp>
@@ -48,6 +50,7 @@ TestData<int64_t> longData[] = {
     {"1", etLong, 1, "1"},
     {"9223372036854775807", etLong, 9223372036854775807LL, "9223372036854775807"},
     {"-9223372036854775807", etLong, -9223372036854775807LL, "-9223372036854775807"},
+    {"-9223372036854775808", etLong, INT64_MIN, "-9223372036854775808"},
 };
 
 TestData<double> doubleData[] = {
@@ -59,6 +62,10 @@ TestData<double> doubleData[] = {
     {"1e4", etDouble, 10000, "10000"},
     {"-1e-4", etDouble, -0.0001, "-0.0001"},
     {"-0e0", etDouble, 0.0, "-0"},
+    {"0.1", etDouble, 0.1, "0.1"},
+    {"3.141592653589793238", etDouble, 3.141592653589793238, "3.141592653589793"},
+    {"1.7976931348623157e308", etDouble, 1.7976931348623157e308, NULL},
+    {"123456789012345678901234.5", etDouble, 123456789012345678901234.5, NULL},
 };
 
 TestData<const char *> stringData[] = {
@@ -70,6 +77,9 @@ TestData<const char *> stringData[] = {
     {"\"\\/\"", etString, "/", "\"\\/\""},
     {"\"\\u20ac\"", etString, "\xe2\x82\xac", "\"\\u20ac\""},
     {"\"\\u03c0\"", etString, "\xcf\x80", "\"\\u03c0\""},
+    {"\"abcdefghijklmnopqrstuvwxyz\\nABCDEFGHIJKLMNOPQRSTUVWXYZ\"", etString,
+     "abcdefghijklmnopqrstuvwxyz\nABCDEFGHIJKLMNOPQRSTUVWXYZ",
+     "\"abcdefghijklmnopqrstuvwxyz\\nABCDEFGHIJKLMNOPQRSTUVWXYZ\""},
 };
 
 void testBool(const TestData<bool> &d) {
@@ -102,6 +112,20 @@ void testString(const TestData<const char *> &d) {
     BOOST_CHECK_EQUAL(n.toString(), d.output);
 }
 
+// Numbers converted on the fast path and on the slow one give the same,
+// correctly rounded, doubles.
+static void testDoubleConversions() {
+    const char *inputs[] = {
+        "0.5", "1.25e-3", "9007199254740992.0", "9007199254740993.0", "1e22", "1e23",
+        "12345.678901234567", "0.000001", "2.2250738585072014e-308", "5e-324",
+        "8.98846567431158e307", "-123.456e-10", "1234567890123456789.0", "0.30000000000000004"};
+    for (const char *input : inputs) {
+        Entity n = loadEntity(input);
+        BOOST_REQUIRE_EQUAL(n.type(), etDouble);
+        BOOST_CHECK_EQUAL(n.doubleValue(), strtod(input, nullptr));
+    }
+}
+
 static void testNull() {
     Entity n = loadEntity("null");
     BOOST_CHECK_EQUAL(n.type(), etNull);
@@ -198,6 +222,8 @@ init_unit_test_suite(int argc, char *argv[]) {
                                   avro::json::stringData,
                                   avro::json::stringData + COUNTOF(avro::json::stringData)));
 
+    ts->add(BOOST_TEST_CASE(&avro::json::testDoubleConversions));
+
     ts->add(BOOST_TEST_CASE(&avro::json::testArray0));
     ts->add(BOOST_TEST_CASE(&avro::json::testArray1));
     ts->add(BOOST_TEST_CASE(&avro::json::testArray2));
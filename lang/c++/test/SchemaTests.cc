@@ -17,9 +17,18 @@
  */
 
 #include "Compiler.hh"
+#include "Fingerprint.hh"
 #include "GenericDatum.hh"
+#include "NodeImpl.hh"
+#include "SchemaPool.hh"
+#include "SchemaSnapshot.hh"
 #include "ValidSchema.hh"
 
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
 #include <boost/test/included/unit_test_framework.hpp>
 #include <boost/test/parameterized_test.hpp>
 #include <boost/test/unit_test.hpp>
@@ -299,6 +308,137 @@ static void testRoundTrip(const char *schema) {
     BOOST_CHECK(result2 == std::string(schema));
 }
 
+// Test that a schema loaded from its snapshot is the schema snapshotted.
+static void testSnapshot(const char *schema) {
+    BOOST_TEST_CHECKPOINT(schema);
+    avro::ValidSchema compiledSchema =
+        compileJsonSchemaFromString(std::string(schema));
+    std::vector<uint8_t> snapshot = snapshotSchema(compiledSchema);
+    avro::ValidSchema loaded = loadSchemaSnapshot(snapshot.data(), snapshot.size());
+    BOOST_CHECK_EQUAL(loaded.toJson(), compiledSchema.toJson());
+    BOOST_CHECK_EQUAL(loaded.rabinFingerprint(), compiledSchema.rabinFingerprint());
+
+    BOOST_CHECK_THROW(loadSchemaSnapshot(snapshot.data(), 5), Exception);
+    snapshot[0] = '{';
+    BOOST_CHECK_THROW(loadSchemaSnapshot(snapshot.data(), snapshot.size()), Exception);
+}
+
+static void testRoundTripSnapshot(const char *schema) {
+    testSnapshot(schema);
+}
+
+// Test that interning leaves schemas as they were, with one pool for all.
+static void testInterned(const char *schema) {
+    BOOST_TEST_CHECKPOINT(schema);
+    static SchemaPool pool;
+    avro::ValidSchema compiledSchema =
+        compileJsonSchemaFromString(std::string(schema));
+    BOOST_CHECK_EQUAL(pool.intern(compiledSchema).toJson(), compiledSchema.toJson());
+}
+
+static void testSchemaPool() {
+    const char *v1 = R"({"type":"record","name":"R","fields":[
+        {"name":"a","type":{"type":"record","name":"A","fields":[
+            {"name":"x","type":"int","default":1},
+            {"name":"e","type":{"type":"enum","name":"E","symbols":["P","Q"]}}]}},
+        {"name":"l","type":{"type":"record","name":"L","fields":[
+            {"name":"next","type":["null","L"]},{"name":"e","type":"E"}]}},
+        {"name":"m","type":{"type":"map","values":"long"}}]})";
+    const char *v2 = R"({"type":"record","name":"R","fields":[
+        {"name":"a","type":{"type":"record","name":"A","fields":[
+            {"name":"x","type":"int","default":1},
+            {"name":"e","type":{"type":"enum","name":"E","symbols":["P","Q"]}}]}},
+        {"name":"l","type":{"type":"record","name":"L","fields":[
+            {"name":"next","type":["null","L"]},{"name":"e","type":"E"}]}},
+        {"name":"m","type":{"type":"map","values":"long"},"doc":"changed"}]})";
+
+    SchemaPool pool;
+    ValidSchema s1 = compileJsonSchemaFromString(v1);
+    ValidSchema p1 = pool.intern(s1);
+    BOOST_CHECK_EQUAL(p1.toJson(), s1.toJson());
+    size_t size = pool.size();
+
+    // Interning an equal schema adds nothing and gives the same nodes.
+    ValidSchema p1b = pool.intern(compileJsonSchemaFromString(v1));
+    BOOST_CHECK(p1b.root() == p1.root());
+    BOOST_CHECK_EQUAL(pool.size(), size);
+
+    ValidSchema s2 = compileJsonSchemaFromString(v2);
+    ValidSchema p2 = pool.intern(s2);
+    BOOST_CHECK_EQUAL(p2.toJson(), s2.toJson());
+    BOOST_CHECK(p2.root() != p1.root());
+    BOOST_CHECK(p2.root()->leafAt(0) == p1.root()->leafAt(0));
+    BOOST_CHECK(p2.root()->leafAt(1) == p1.root()->leafAt(1));
+    BOOST_CHECK(p2.root()->leafAt(2) != p1.root()->leafAt(2));
+    BOOST_CHECK_EQUAL(p2.root()->defaultValueAt(0).type(), AVRO_NULL);
+    BOOST_CHECK_EQUAL(p2.root()->leafAt(0)->defaultValueAt(0).value<int32_t>(), 1);
+
+    // The recursive record refers to its own pooled node.
+    const NodePtr &l = p2.root()->leafAt(1);
+    const NodePtr &next = l->leafAt(0)->leafAt(1);
+    BOOST_CHECK_EQUAL(next->type(), AVRO_SYMBOLIC);
+    BOOST_CHECK(std::static_pointer_cast<NodeSymbolic>(next)->getNode() == l);
+    BOOST_CHECK(&resolvedNode(*next) == l.get());
+    BOOST_CHECK(&resolvedNode(*l) == l.get());
+
+    pool.clear();
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+    BOOST_CHECK(pool.intern(s1).root() != p1.root());
+    BOOST_CHECK_EQUAL(p1.toJson(), s1.toJson());
+}
+
+static void testFrozen(const char *schema) {
+    BOOST_TEST_CHECKPOINT(schema);
+    avro::ValidSchema compiledSchema =
+        compileJsonSchemaFromString(std::string(schema));
+    ValidSchema frozen = compiledSchema.frozen();
+    BOOST_CHECK_EQUAL(frozen.toJson(), compiledSchema.toJson());
+    BOOST_CHECK_EQUAL(frozen.canonicalForm(), compiledSchema.canonicalForm());
+    BOOST_CHECK_EQUAL(frozen.root().use_count(), 0);
+}
+
+static void testFrozenSchema() {
+    const char *json = R"({"type":"record","name":"L","doc":"list","fields":[
+        {"name":"v","type":{"type":"int","logicalType":"date"},"default":3},
+        {"name":"e","type":{"type":"enum","name":"E","symbols":["P","Q"]}},
+        {"name":"f","type":["null","E"]},
+        {"name":"next","type":["null","L"]},
+        {"name":"m","type":{"type":"map","values":"L"}}]})";
+    ValidSchema frozen;
+    std::string expected;
+    {
+        ValidSchema s = compileJsonSchemaFromString(json);
+        expected = s.toJson();
+        frozen = s.frozen();
+    }
+    BOOST_CHECK_EQUAL(frozen.toJson(), expected);
+
+    const NodePtr &root = frozen.root();
+    BOOST_CHECK_EQUAL(root->leafAt(0)->logicalType().type(), LogicalType::DATE);
+    BOOST_CHECK_EQUAL(root->defaultValueAt(0).value<int32_t>(), 3);
+    const NodePtr &e = root->leafAt(1);
+    const NodePtr &f = root->leafAt(2)->leafAt(1);
+    BOOST_CHECK_EQUAL(f->type(), AVRO_SYMBOLIC);
+    BOOST_CHECK(&resolvedNode(*f) == e.get());
+    const NodePtr &next = root->leafAt(3)->leafAt(1);
+    BOOST_CHECK_EQUAL(next->type(), AVRO_SYMBOLIC);
+    BOOST_CHECK(std::static_pointer_cast<NodeSymbolic>(next)->getNode() == root);
+    BOOST_CHECK_EQUAL(next->leaves(), 0U);
+    for (size_t i = 0; i < root->leaves(); ++i) {
+        BOOST_CHECK_EQUAL(root->leafAt(i).use_count(), 0);
+    }
+
+    // Datums refer to the frozen nodes.
+    GenericDatum d(frozen);
+    GenericRecord &r = d.value<GenericRecord>();
+    BOOST_CHECK(r.schema() == root);
+    BOOST_CHECK_EQUAL(r.schema().use_count(), 0);
+    GenericDatum &n = r.fieldAt(3);
+    n.selectBranch(1);
+    BOOST_CHECK(n.value<GenericRecord>().schema() == root);
+    BOOST_CHECK_THROW(root->addLeaf(root->leafAt(0)), Exception);
+}
+
 static void testCompactSchemas() {
     for (size_t i = 0; i < sizeof(schemasToCompact) / sizeof(schemasToCompact[0]); i++) {
         const char *schema = schemasToCompact[i];
@@ -311,6 +451,104 @@ static void testCompactSchemas() {
     }
 }
 
+static void testSharedPrimitives() {
+    ValidSchema a = compileJsonSchemaFromString(
+        R"({"type": "record", "name": "R", "fields": [
+            {"name": "s", "type": "string"},
+            {"name": "d", "type": "string", "doc": "described"},
+            {"name": "t", "type": {"type": "long", "logicalType": "timestamp-millis"}},
+            {"name": "m", "type": {"type": "map", "values": "long"}}]})");
+    ValidSchema b = compileJsonSchemaFromString(R"({"type": "array", "items": "string"})");
+    const NodePtr &r = a.root();
+    BOOST_CHECK_EQUAL(r->leafAt(0).get(), b.root()->leafAt(0).get());
+    BOOST_CHECK_EQUAL(r->leafAt(0).get(), r->leafAt(3)->leafAt(0).get());
+    BOOST_CHECK_EQUAL(r->leafAt(1)->getDoc(), "described");
+    BOOST_CHECK(r->leafAt(0)->getDoc().empty());
+    BOOST_CHECK_EQUAL(r->leafAt(2)->logicalType().type(), LogicalType::TIMESTAMP_MILLIS);
+    BOOST_CHECK_EQUAL(primitiveNode(AVRO_LONG)->logicalType().type(), LogicalType::NONE);
+    BOOST_CHECK_THROW(r->leafAt(0)->setDoc("no"), Exception);
+
+    size_t index;
+    BOOST_CHECK(r->nameIndex("m", index));
+    BOOST_CHECK_EQUAL(index, 3);
+    BOOST_CHECK(!r->nameIndex("x", index));
+}
+
+static void testSharedSubtrees() {
+    ValidSchema a = compileJsonSchemaFromString(
+        R"({"type": "record", "name": "R", "fields": [
+            {"name": "a", "type": ["null", {"type": "record", "name": "S", "fields": []}]},
+            {"name": "b", "type": ["null", "S"]},
+            {"name": "c", "type": ["null", "S"]},
+            {"name": "d", "type": {"type": "array", "items": ["null", "S"]}},
+            {"name": "e", "type": {"type": "int", "logicalType": "date"}},
+            {"name": "f", "type": {"type": "int", "logicalType": "date"}}]})");
+    const NodePtr &r = a.root();
+    BOOST_CHECK_NE(r->leafAt(0).get(), r->leafAt(1).get());
+    BOOST_CHECK_EQUAL(r->leafAt(1).get(), r->leafAt(2).get());
+    BOOST_CHECK_EQUAL(r->leafAt(1).get(), r->leafAt(3)->leafAt(0).get());
+    BOOST_CHECK_EQUAL(r->leafAt(4).get(), r->leafAt(5).get());
+
+    ValidSchema b = compileJsonSchemaFromString(R"({"type": "int", "logicalType": "date"})");
+    BOOST_CHECK_EQUAL(b.root().get(), r->leafAt(4).get());
+    BOOST_CHECK_EQUAL(a.toJson(false), compileJsonSchemaFromString(a.toJson()).toJson(false));
+}
+
+static void testCachedJson() {
+    ValidSchema a = compileJsonSchemaFromString(
+        R"({"type": "record", "name": "R", "doc": "a \"quoted\" doc", "fields": [{"name": "f", "type": "long"}]})");
+    const std::string &pretty = a.json();
+    const std::string &compact = a.json(false);
+    BOOST_CHECK_EQUAL(&pretty, &a.json());
+    BOOST_CHECK_EQUAL(&compact, &a.json(false));
+    ValidSchema b = a;
+    BOOST_CHECK_EQUAL(&compact, &b.json(false));
+
+    std::ostringstream oss;
+    a.root()->printJson(oss, 0);
+    oss << '\n';
+    BOOST_CHECK_EQUAL(pretty, oss.str());
+    BOOST_CHECK_EQUAL(a.toJson(), pretty);
+    BOOST_CHECK_EQUAL(a.toJson(false), compact);
+    BOOST_CHECK_EQUAL(compact, R"({"type":"record","name":"R","doc":"a \"quoted\" doc","fields":[{"name":"f","type":"long"}]})");
+}
+
+static void testSameEncoding() {
+    ValidSchema a = compileJsonSchemaFromString(
+        R"({"type": "record", "name": "R", "fields": [{"name": "f", "type": "long"}, {"name": "g", "type": "string"}]})");
+    ValidSchema b = compileJsonSchemaFromString(
+        R"({"type": "record", "name": "R", "doc": "R", "aliases": ["S"], "fields": [
+            {"name": "f", "type": {"type": "long", "logicalType": "timestamp-millis"}, "default": 0, "order": "descending"},
+            {"name": "g", "type": "string", "doc": "g"}]})");
+    ValidSchema c = compileJsonSchemaFromString(
+        R"({"type": "record", "name": "R", "fields": [{"name": "f", "type": "int"}, {"name": "g", "type": "string"}]})");
+    ValidSchema d = compileJsonSchemaFromString(
+        R"({"type": "record", "name": "R", "fields": [{"name": "g", "type": "string"}, {"name": "f", "type": "long"}]})");
+    BOOST_CHECK(a.sameEncoding(a));
+    BOOST_CHECK(a.sameEncoding(b));
+    BOOST_CHECK(b.sameEncoding(a));
+    BOOST_CHECK(!a.sameEncoding(c));
+    BOOST_CHECK(!a.sameEncoding(d));
+
+    // Docs, defaults, aliases and orders change nothing about the data;
+    // logical types do.
+    ValidSchema e = compileJsonSchemaFromString(
+        R"({"type": "record", "name": "R", "doc": "R", "fields": [
+            {"name": "f", "type": "long", "default": 0}, {"name": "g", "type": "string", "order": "ignore"}]})");
+    BOOST_CHECK(a.sameData(a));
+    BOOST_CHECK(a.sameData(e));
+    BOOST_CHECK(!a.sameData(b));
+    BOOST_CHECK(!b.sameData(a));
+    BOOST_CHECK(!a.sameData(c));
+    ValidSchema decimal2 = compileJsonSchemaFromString(
+        R"({"type": "array", "items": {"type": "bytes", "logicalType": "decimal", "precision": 10, "scale": 2}})");
+    ValidSchema decimal4 = compileJsonSchemaFromString(
+        R"({"type": "array", "items": {"type": "bytes", "logicalType": "decimal", "precision": 10, "scale": 4}})");
+    BOOST_CHECK(decimal2.sameEncoding(decimal4));
+    BOOST_CHECK(!decimal2.sameData(decimal4));
+    BOOST_CHECK(decimal2.sameData(compileJsonSchemaFromString(decimal2.toJson())));
+}
+
 static void testLogicalTypes() {
     const char *bytesDecimalType = "{\n\
         \"type\": \"bytes\",\n\
@@ -447,6 +685,111 @@ static void testMalformedLogicalTypes(const char *schema) {
     BOOST_CHECK(datum.logicalType().type() == LogicalType::NONE);
 }
 
+
+static std::string hex(const uint8_t *data, size_t len) {
+    std::ostringstream oss;
+    for (size_t i = 0; i < len; ++i) {
+        oss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(data[i]);
+    }
+    return oss.str();
+}
+
+static std::string hex(const std::string &s, bool sha256) {
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(s.data());
+    if (sha256) {
+        std::array<uint8_t, 32> d = sha256Fingerprint(data, s.size());
+        return hex(d.data(), d.size());
+    }
+    std::array<uint8_t, 16> d = md5Fingerprint(data, s.size());
+    return hex(d.data(), d.size());
+}
+
+static void testDigests() {
+    std::string bulk;
+    for (int i = 0; i < 4 * 256; ++i) {
+        bulk.push_back(static_cast<char>(i));
+    }
+    bulk += "xyz";
+
+    BOOST_CHECK_EQUAL(hex("", false), "d41d8cd98f00b204e9800998ecf8427e");
+    BOOST_CHECK_EQUAL(hex(std::string(56, 'a'), false), "3b0c8ac703f828b04c6c197006d17218");
+    BOOST_CHECK_EQUAL(hex(bulk, false), "e2301d76c2219cb28dfe5f06cb60d53d");
+    BOOST_CHECK_EQUAL(hex("abc", true),
+                      "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    BOOST_CHECK_EQUAL(hex(std::string(55, 'a'), true),
+                      "9f4390f8d30c2dd92ec9f095b65e2b9ae9b0a925a5258e241c9f1e910f734318");
+    BOOST_CHECK_EQUAL(hex(bulk, true),
+                      "32b377390e072c37cfeb9bb327d8825616819a76b0ad3749e16fe22e53afbdfc");
+
+    // The wyhash test vectors, each hashed with its index as the seed.
+    const char *messages[] = {
+        "", "a", "abc", "message digest", "abcdefghijklmnopqrstuvwxyz",
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789",
+        "12345678901234567890123456789012345678901234567890123456789012345678901234567890"};
+    const uint64_t hashes[] = {
+        0x93228a4de0eec5a2ULL, 0xc5bac3db178713c4ULL, 0xa97f2f7b1d9b3314ULL,
+        0x786d1f1df3801df4ULL, 0xdca5a8138ad37c87ULL, 0xb9e734f117cfaf70ULL,
+        0x6cc5eab49a92d617ULL};
+    for (uint64_t i = 0; i < 7; ++i) {
+        BOOST_CHECK_EQUAL(hash64(reinterpret_cast<const uint8_t *>(messages[i]),
+                                 strlen(messages[i]), i),
+                          hashes[i]);
+    }
+
+    ValidSchema schema = compileJsonSchemaFromString("\"null\"");
+    BOOST_CHECK_EQUAL(hex(schema.md5Fingerprint().data(), 16),
+                      "9b41ef67651c18488a8b08bb67c75699");
+    BOOST_CHECK_EQUAL(hex(schema.sha256Fingerprint().data(), 32),
+                      "f072cbec3bf8841871d4284230c5e983dc211a56837aed862487148f947d1a1f");
+}
+
+// Checks the canonical forms and fingerprints in the test data shared by
+// all the language implementations.
+static void testCanonicalForm() {
+    std::ifstream in("../../share/test/data/schema-tests.txt");
+    BOOST_REQUIRE(in.good());
+
+    std::string line;
+    std::string input;
+    std::string canonical;
+    size_t cases = 0;
+    while (std::getline(in, line)) {
+        if (input == "[  ]") {
+            // This implementation does not accept empty unions.
+            if (line.compare(0, 7, "<<INPUT") != 0) {
+                continue;
+            }
+        }
+        if (line.compare(0, 8, "<<INPUT ") == 0) {
+            input = line.substr(8);
+        } else if (line == "<<INPUT") {
+            input.clear();
+            while (std::getline(in, line) && line != "INPUT") {
+                input += line + '\n';
+            }
+        } else if (line.compare(0, 12, "<<canonical ") == 0) {
+            canonical = line.substr(12);
+            BOOST_TEST_CHECKPOINT(input);
+            ValidSchema schema = compileJsonSchemaFromString(input);
+            BOOST_CHECK_EQUAL(schema.canonicalForm(), canonical);
+            ValidSchema copy = schema;
+            BOOST_CHECK_EQUAL(&copy.canonicalForm(), &schema.canonicalForm());
+            ++cases;
+        } else if (line.compare(0, 14, "<<fingerprint ") == 0) {
+            std::istringstream iss(line.substr(14));
+            int64_t expected;
+            iss >> expected;
+            ValidSchema schema = compileJsonSchemaFromString(input);
+            BOOST_CHECK_EQUAL(static_cast<int64_t>(schema.rabinFingerprint()), expected);
+            std::string c = schema.canonicalForm();
+            BOOST_CHECK_EQUAL(static_cast<int64_t>(rabinFingerprint(
+                                  reinterpret_cast<const uint8_t *>(c.data()), c.size())),
+                              expected);
+        }
+    }
+    BOOST_CHECK(cases > 0);
+}
+
 } // namespace schema
 } // namespace avro
 
@@ -466,9 +809,21 @@ init_unit_test_suite(int argc, char *argv[]) {
                    avro::schema::basicSchemaErrors);
     ADD_PARAM_TEST(ts, avro::schema::testCompile, avro::schema::basicSchemas);
     ADD_PARAM_TEST(ts, avro::schema::testRoundTrip, avro::schema::roundTripSchemas);
+    ADD_PARAM_TEST(ts, avro::schema::testSnapshot, avro::schema::basicSchemas);
+    ADD_PARAM_TEST(ts, avro::schema::testRoundTripSnapshot, avro::schema::roundTripSchemas);
     ts->add(BOOST_TEST_CASE(&avro::schema::testLogicalTypes));
     ADD_PARAM_TEST(ts, avro::schema::testMalformedLogicalTypes,
                    avro::schema::malformedLogicalTypes);
+    ADD_PARAM_TEST(ts, avro::schema::testInterned, avro::schema::basicSchemas);
+    ts->add(BOOST_TEST_CASE(&avro::schema::testSchemaPool));
+    ADD_PARAM_TEST(ts, avro::schema::testFrozen, avro::schema::basicSchemas);
+    ts->add(BOOST_TEST_CASE(&avro::schema::testFrozenSchema));
     ts->add(BOOST_TEST_CASE(&avro::schema::testCompactSchemas));
+    ts->add(BOOST_TEST_CASE(&avro::schema::testDigests));
+    ts->add(BOOST_TEST_CASE(&avro::schema::testCanonicalForm));
+    ts->add(BOOST_TEST_CASE(&avro::schema::testSharedPrimitives));
+    ts->add(BOOST_TEST_CASE(&avro::schema::testSharedSubtrees));
+    ts->add(BOOST_TEST_CASE(&avro::schema::testCachedJson));
+    ts->add(BOOST_TEST_CASE(&avro::schema::testSameEncoding));
     return ts;
 }
@@ -19,6 +19,10 @@
 #include <boost/test/included/unit_test_framework.hpp>
 #include <boost/test/unit_test.hpp>
 
+#include "BinaryCodec.hh"
+#include "Compiler.hh"
+#include "FlatMap.hh"
+#include "Generic.hh"
 #include "Specific.hh"
 #include "Stream.hh"
 
@@ -154,6 +158,62 @@ void testArray() {
     BOOST_CHECK_EQUAL_COLLECTIONS(b.begin(), b.end(), n.begin(), n.end());
 }
 
+void testLongArray() {
+    vector<int64_t> n;
+    for (int64_t i = 0; i < 1000; ++i) {
+        n.push_back(i * i * i * (i % 2 == 0 ? 1 : -1));
+    }
+    vector<int64_t> b = encodeAndDecode(n);
+
+    BOOST_CHECK_EQUAL_COLLECTIONS(b.begin(), b.end(), n.begin(), n.end());
+}
+
+void testFloatArray() {
+    vector<float> n;
+    for (int i = 0; i < 1000; ++i) {
+        n.push_back(i / 7.0f);
+    }
+    vector<float> b = encodeAndDecode(n);
+
+    BOOST_CHECK_EQUAL_COLLECTIONS(b.begin(), b.end(), n.begin(), n.end());
+}
+
+void testDoubleArray() {
+    // Larger than one decoding step, so the vector is filled in pieces.
+    vector<double> n;
+    for (int i = 0; i < 100000; ++i) {
+        n.push_back(i / 3.0);
+    }
+    vector<double> b = encodeAndDecode(n);
+
+    BOOST_CHECK_EQUAL_COLLECTIONS(b.begin(), b.end(), n.begin(), n.end());
+}
+
+void testPrimitiveArrayValidating() {
+    // The default bulk calls go item by item, which keeps validating
+    // encoders and decoders in step with the schema.
+    ValidSchema s = compileJsonSchemaFromString(
+        "{\"type\": \"array\", \"items\": \"double\"}");
+    vector<double> n;
+    for (int i = 0; i < 100; ++i) {
+        n.push_back(i * 1.5);
+    }
+
+    unique_ptr<OutputStream> os = memoryOutputStream();
+    EncoderPtr e = validatingEncoder(s, binaryEncoder());
+    e->init(*os);
+    avro::encode(*e, n);
+    e->flush();
+
+    unique_ptr<InputStream> is = memoryInputStream(*os);
+    DecoderPtr d = validatingDecoder(s, binaryDecoder());
+    d->init(*is);
+    vector<double> b;
+    avro::decode(*d, b);
+
+    BOOST_CHECK_EQUAL_COLLECTIONS(b.begin(), b.end(), n.begin(), n.end());
+}
+
 void testBoolArray() {
     bool values[] = {true, false, true, false};
     vector<bool> n(values, values + 4);
@@ -162,6 +222,37 @@ void testBoolArray() {
     BOOST_CHECK_EQUAL_COLLECTIONS(b.begin(), b.end(), n.begin(), n.end());
 }
 
+void testArrayBlockCounts() {
+    // One block of 1000 items is reserved for at once.
+    vector<string> n(1000, "x");
+    vector<string> b = encodeAndDecode(n);
+    BOOST_CHECK(b == n);
+    BOOST_CHECK_EQUAL(b.capacity(), n.size());
+
+    // A block claiming far more items than the data holds fails once
+    // the data runs out rather than reserving for all of them.
+    unique_ptr<OutputStream> os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    e->encodeLong(int64_t(1) << 40);
+    e->encodeString("a");
+    e->flush();
+
+    unique_ptr<InputStream> is = memoryInputStream(*os);
+    DecoderPtr d = binaryDecoder();
+    d->init(*is);
+    BOOST_CHECK_THROW(avro::decode(*d, b), Exception);
+
+    std::shared_ptr<vector<uint8_t>> data = snapshot(*os);
+    DirectBinaryDecoder dd(data->data(), data->size());
+    BOOST_CHECK_THROW(directDecode(dd, b), Exception);
+
+    // So does a negative-count block whose byte size overruns the data.
+    const uint8_t sized[] = {0x03, 0x7e, 0x02, 'a', 0x00};
+    DirectBinaryDecoder dd2(sized, sizeof(sized));
+    BOOST_CHECK_THROW(directDecode(dd2, b), Exception);
+}
+
 void testMap() {
     map<string, int32_t> n;
     n["a"] = 1;
@@ -172,12 +263,224 @@ void testMap() {
     BOOST_CHECK(b == n);
 }
 
+void testUnorderedMap() {
+    std::unordered_map<string, int32_t> n;
+    n["a"] = 1;
+    n["b"] = 101;
+
+    std::unordered_map<string, int32_t> b = encodeAndDecode(n);
+
+    BOOST_CHECK(b == n);
+}
+
+void testFlatMap() {
+    FlatMap<int32_t> n{{"b", 101}, {"a", 1}};
+    BOOST_CHECK_EQUAL(n.begin()->first, "a");
+    n["c"] = 7;
+    BOOST_CHECK_EQUAL(n.at("c"), 7);
+    BOOST_CHECK_EQUAL(n.count("d"), 0);
+
+    FlatMap<int32_t> b = encodeAndDecode(n);
+    BOOST_CHECK(b == n);
+
+    // Entries in two blocks, unsorted and with a repeated key, of which
+    // the last one wins.
+    unique_ptr<OutputStream> os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    e->encodeLong(2);
+    e->encodeString("b");
+    e->encodeInt(1);
+    e->encodeString("a");
+    e->encodeInt(2);
+    e->encodeLong(1);
+    e->encodeString("a");
+    e->encodeInt(3);
+    e->encodeLong(0);
+    e->flush();
+
+    unique_ptr<InputStream> is = memoryInputStream(*os);
+    DecoderPtr d = binaryDecoder();
+    d->init(*is);
+    avro::decode(*d, b);
+    BOOST_REQUIRE_EQUAL(b.size(), 2);
+    BOOST_CHECK_EQUAL(b.begin()->first, "a");
+    BOOST_CHECK_EQUAL(b.at("a"), 3);
+    BOOST_CHECK_EQUAL(b.at("b"), 1);
+
+    std::shared_ptr<vector<uint8_t>> data = snapshot(*os);
+    DirectBinaryDecoder dd(data->data(), data->size());
+    FlatMap<int32_t> c;
+    directDecode(dd, c);
+    BOOST_CHECK(c == b);
+
+    unique_ptr<InputStream> is2 = memoryInputStream(*os);
+    d->init(*is2);
+    std::unordered_map<string, int32_t> u;
+    avro::decode(*d, u);
+    BOOST_CHECK_EQUAL(u.size(), 2);
+    BOOST_CHECK_EQUAL(u["a"], 3);
+}
+
 void testCustom() {
     C n(10, 1023);
     C b = encodeAndDecode(n);
     BOOST_CHECK(b == n);
 }
 
+template<typename T>
+size_t binarySize(const T &t) {
+    unique_ptr<OutputStream> os = memoryOutputStream();
+    EncoderPtr e = binaryEncoder();
+    e->init(*os);
+    avro::encode(*e, t);
+    e->flush();
+    return static_cast<size_t>(os->byteCount());
+}
+
+void testViews() {
+    Test t;
+    const char *cs = "a C string";
+    t.encode(cs);
+    string s;
+    t.decode(s);
+    BOOST_CHECK_EQUAL(s, cs);
+
+    uint8_t fixed[4] = {1, 2, 3, 4};
+    uint8_t decoded[4] = {0, 0, 0, 0};
+    Test f;
+    f.encode(fixed);
+    f.decode(decoded);
+    BOOST_CHECK(std::equal(fixed, fixed + 4, decoded));
+
+#if __cplusplus >= 201703L
+    const string held = "held elsewhere";
+    std::string_view view(held.data() + 5, 9);
+    Test v;
+    v.encode(view);
+    v.decode(s);
+    BOOST_CHECK_EQUAL(s, "elsewhere");
+#endif
+
+    // Each encoder writes a view as it does the same string.
+    ValidSchema schema = compileJsonSchemaFromString(
+        "{\"type\":\"array\", \"items\":\"string\"}");
+    const EncoderPtr encoders[] = {
+        binaryEncoder(), validatingEncoder(schema, binaryEncoder()), jsonEncoder(schema)};
+    for (const EncoderPtr &e : encoders) {
+        unique_ptr<OutputStream> a = memoryOutputStream();
+        unique_ptr<OutputStream> b = memoryOutputStream();
+        const char *const items[] = {"x", "quote\" and \\ and \u00e9", ""};
+        for (int pass = 0; pass < 2; ++pass) {
+            e->init(pass == 0 ? *a : *b);
+            e->arrayStart();
+            e->setItemCount(3);
+            for (const char *item : items) {
+                e->startItem();
+                if (pass == 0) {
+                    e->encodeString(item);
+                } else {
+                    e->encodeStringView(item);
+                }
+            }
+            e->arrayEnd();
+            e->flush();
+        }
+        unique_ptr<InputStream> ia = memoryInputStream(*a);
+        unique_ptr<InputStream> ib = memoryInputStream(*b);
+        BOOST_CHECK_EQUAL(a->byteCount(), b->byteCount());
+        StreamReader ra(*ia), rb(*ib);
+        vector<uint8_t> ba(a->byteCount()), bb(b->byteCount());
+        ra.readBytes(ba.data(), ba.size());
+        rb.readBytes(bb.data(), bb.size());
+        BOOST_CHECK(ba == bb);
+    }
+}
+
+void testConcreteCodecs() {
+    vector<int64_t> longs;
+    for (int i = 0; i < 70; ++i) {
+        longs.push_back((int64_t(1) << i % 63) - 5);
+    }
+    map<string, string> m;
+    m["k"] = "v";
+    m[string(300, 'x')] = "long key";
+    C c(-7, int64_t(1) << 40);
+
+    // The concrete encoder writes what the one behind EncoderPtr does,
+    // whether a type goes through direct_codec_traits or codec_traits.
+    unique_ptr<OutputStream> os = memoryOutputStream(16);
+    BinaryEncoder e;
+    e.init(*os);
+    avro::encode(e, longs);
+    avro::encode(e, m);
+    avro::encode(e, c);
+    e.flush();
+
+    unique_ptr<OutputStream> expected = memoryOutputStream();
+    EncoderPtr ve = binaryEncoder();
+    ve->init(*expected);
+    avro::encode(*ve, longs);
+    avro::encode(*ve, m);
+    avro::encode(*ve, c);
+    ve->flush();
+    BOOST_CHECK_EQUAL(os->byteCount(), expected->byteCount());
+
+    unique_ptr<InputStream> is = memoryInputStream(*os);
+    BinaryDecoder d;
+    d.init(*is);
+    vector<int64_t> longs2;
+    map<string, string> m2;
+    C c2;
+    avro::decode(d, longs2);
+    avro::decode(d, m2);
+    avro::decode(d, c2);
+    BOOST_CHECK(longs2 == longs);
+    BOOST_CHECK(m2 == m);
+    BOOST_CHECK(c2 == c);
+}
+
+void testEncodedSize() {
+    BOOST_CHECK_EQUAL(encodedSize(true), 1);
+    BOOST_CHECK_EQUAL(encodedSize(int32_t(63)), 1);
+    BOOST_CHECK_EQUAL(encodedSize(int32_t(64)), 2);
+    BOOST_CHECK_EQUAL(encodedSize(int64_t(-1) << 62), 9);
+    BOOST_CHECK_EQUAL(encodedSize(std::numeric_limits<int64_t>::min()), 10);
+    BOOST_CHECK_EQUAL(encodedSize(string(200, 'x')), binarySize(string(200, 'x')));
+    BOOST_CHECK_EQUAL(encodedSize(vector<uint8_t>()), 1);
+
+    vector<int64_t> longs;
+    vector<double> doubles;
+    for (int i = 0; i < 70; ++i) {
+        longs.push_back(int64_t(1) << i % 63);
+        doubles.push_back(i);
+    }
+    BOOST_CHECK_EQUAL(encodedSize(longs), binarySize(longs));
+    BOOST_CHECK_EQUAL(encodedSize(doubles), binarySize(doubles));
+    BOOST_CHECK_EQUAL(encodedSize(vector<bool>(3, true)), binarySize(vector<bool>(3, true)));
+
+    map<string, int32_t> m;
+    m["a"] = 1;
+    m["b"] = 1000;
+    BOOST_CHECK_EQUAL(encodedSize(m), binarySize(m));
+    BOOST_CHECK_EQUAL(encodedSize(C(10, 1023)), binarySize(C(10, 1023)));
+
+    ValidSchema schema = compileJsonSchemaFromString(
+        "{\"type\":\"record\",\"name\":\"r\",\"fields\":["
+        "{\"name\":\"s\", \"type\":\"string\"},"
+        "{\"name\":\"u\", \"type\":[\"null\", \"double\"]},"
+        "{\"name\":\"a\", \"type\":{\"type\":\"array\", \"items\":\"long\"}}"
+        "]}");
+    GenericDatum datum(schema);
+    GenericRecord &r = datum.value<GenericRecord>();
+    r.fieldAt(0) = GenericDatum(string(130, 's'));
+    r.fieldAt(1).selectBranch(1);
+    for (int i = 0; i < 5; ++i) {
+        r.fieldAt(2).value<GenericArray>().value().push_back(GenericDatum(int64_t(1000) * i));
+    }
+    BOOST_CHECK_EQUAL(encodedSize(datum), binarySize(datum));
+}
+
 } // namespace specific
 } // namespace avro
 
@@ -195,8 +498,18 @@ init_unit_test_suite(int argc, char *argv[]) {
     ts->add(BOOST_TEST_CASE(avro::specific::testBytes));
     ts->add(BOOST_TEST_CASE(avro::specific::testFixed));
     ts->add(BOOST_TEST_CASE(avro::specific::testArray));
+    ts->add(BOOST_TEST_CASE(avro::specific::testLongArray));
+    ts->add(BOOST_TEST_CASE(avro::specific::testFloatArray));
+    ts->add(BOOST_TEST_CASE(avro::specific::testDoubleArray));
+    ts->add(BOOST_TEST_CASE(avro::specific::testPrimitiveArrayValidating));
     ts->add(BOOST_TEST_CASE(avro::specific::testBoolArray));
+    ts->add(BOOST_TEST_CASE(avro::specific::testArrayBlockCounts));
     ts->add(BOOST_TEST_CASE(avro::specific::testMap));
+    ts->add(BOOST_TEST_CASE(avro::specific::testUnorderedMap));
+    ts->add(BOOST_TEST_CASE(avro::specific::testFlatMap));
     ts->add(BOOST_TEST_CASE(avro::specific::testCustom));
+    ts->add(BOOST_TEST_CASE(avro::specific::testEncodedSize));
+    ts->add(BOOST_TEST_CASE(avro::specific::testViews));
+    ts->add(BOOST_TEST_CASE(avro::specific::testConcreteCodecs));
     return ts;
 }
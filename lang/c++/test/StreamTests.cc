@@ -21,6 +21,13 @@
 #include "boost/filesystem.hpp"
 #include <boost/test/included/unit_test_framework.hpp>
 #include <boost/test/parameterized_test.hpp>
+#include <cstring>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#endif
 
 namespace avro {
 namespace stream {
@@ -167,6 +174,63 @@ void testNonEmpty_fileStream(const TestData &td) {
     (*is, td.dataSize);
 }
 
+template<typename V>
+void testEmpty_mappedStream() {
+    FileRemover fr(filename);
+    {
+        std::unique_ptr<OutputStream> os = fileOutputStream(filename);
+    }
+    std::unique_ptr<InputStream> is = mappedFileInputStream(filename);
+    V()
+    (*is);
+}
+
+template<typename F, typename V>
+void testNonEmpty_mappedStream(const TestData &td) {
+    FileRemover fr(filename);
+    {
+        std::unique_ptr<OutputStream> os = fileOutputStream(filename,
+                                                            td.chunkSize);
+        F()
+        (*os, td.dataSize);
+    }
+
+    std::unique_ptr<InputStream> is = mappedFileInputStream(filename);
+    V()
+    (*is, td.dataSize);
+}
+
+void testSeek_mappedStream() {
+    const size_t len = 1000;
+    FileRemover fr(filename);
+    {
+        std::unique_ptr<OutputStream> os = fileOutputStream(filename);
+        Fill1()(*os, len);
+    }
+
+    std::unique_ptr<SeekableInputStream> is = mappedFileInputStream(filename);
+    const uint8_t *b;
+    size_t n;
+    is->seek(995);
+    BOOST_CHECK_EQUAL(is->byteCount(), 995);
+    BOOST_REQUIRE(is->next(&b, &n));
+    BOOST_CHECK_EQUAL(n, 5);
+    BOOST_CHECK_EQUAL(*b, '5');
+    BOOST_CHECK(!is->next(&b, &n));
+
+    is->seek(10);
+    is->skip(3);
+    BOOST_REQUIRE(is->next(&b, &n));
+    BOOST_CHECK_EQUAL(n, len - 13);
+    BOOST_CHECK_EQUAL(*b, '3');
+    is->backup(n - 1);
+    BOOST_CHECK_EQUAL(is->byteCount(), 14);
+
+    is->seek(len + 1);
+    BOOST_CHECK(!is->next(&b, &n));
+    BOOST_CHECK_THROW(is->seek(-1), Exception);
+}
+
 TestData data[] = {
     {100, 0},
     {100, 1},
@@ -176,6 +240,466 @@ TestData data[] = {
     {100, 1000},
     {100, 1024}};
 
+void testAsyncFileStream(const AsyncFileOptions &options) {
+    std::vector<uint8_t> expected(300 * 1024 + 123);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        expected[i] = static_cast<uint8_t>(i * 7 + i / 251);
+    }
+    {
+        std::unique_ptr<OutputStream> os = asyncFileOutputStream(filename, options);
+        size_t done = 0;
+        while (done < expected.size()) {
+            uint8_t *p;
+            size_t n;
+            BOOST_REQUIRE(os->next(&p, &n));
+            size_t len = std::min(n, std::min(expected.size() - done, static_cast<size_t>(1000)));
+            memcpy(p, &expected[done], len);
+            os->backup(n - len);
+            done += len;
+            if (done % 7 == 0) {
+                os->flush();
+            }
+        }
+        BOOST_CHECK_EQUAL(os->byteCount(), expected.size());
+        os->flush();
+    }
+    std::unique_ptr<InputStream> is = fileInputStream(filename);
+    std::vector<uint8_t> actual;
+    const uint8_t *p;
+    size_t n;
+    while (is->next(&p, &n)) {
+        actual.insert(actual.end(), p, p + n);
+    }
+    BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(),
+                                  expected.begin(), expected.end());
+    boost::filesystem::remove(filename);
+}
+
+void testAsyncFileStreams() {
+    for (int backend = 0; backend < 2; ++backend) {
+        for (int direct = 0; direct < 2; ++direct) {
+            AsyncFileOptions options;
+            options.ioUring = backend == 1;
+            options.direct = direct == 1;
+            options.bufferSize = 8 * 1024;
+            testAsyncFileStream(options);
+            options.sync = AsyncFileOptions::SYNC_EACH_WRITE;
+            testAsyncFileStream(options);
+            options.sync = AsyncFileOptions::SYNC_ON_CLOSE;
+            testAsyncFileStream(options);
+        }
+    }
+}
+
+void testGeometricMemoryStream(bool hugePages) {
+    StreamOptions options;
+    options.chunkSize = 1024;
+    options.growth = StreamOptions::GEOMETRIC_CHUNKS;
+    options.maxChunkSize = 64 * 1024;
+    options.hugePages = hugePages;
+    std::unique_ptr<OutputStream> os = memoryOutputStream(options);
+
+    std::vector<uint8_t> expected(500 * 1024 + 17);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        expected[i] = static_cast<uint8_t>(i * 13 + i / 257);
+    }
+    size_t done = 0;
+    size_t chunks = 0;
+    while (done < expected.size()) {
+        uint8_t *p;
+        size_t n;
+        BOOST_REQUIRE(os->next(&p, &n));
+        BOOST_CHECK_LE(n, options.maxChunkSize);
+        size_t len = std::min(n, expected.size() - done);
+        memcpy(p, &expected[done], len);
+        os->backup(n - len);
+        done += len;
+        ++chunks;
+    }
+    BOOST_CHECK_EQUAL(os->byteCount(), expected.size());
+    // 1 + 2 + ... + 32 KB, then 64 KB chunks.
+    BOOST_CHECK_EQUAL(chunks, 6 + (expected.size() - 63 * 1024 + 64 * 1024 - 1) / (64 * 1024));
+
+    std::shared_ptr<std::vector<uint8_t>> b = snapshot(*os);
+    BOOST_CHECK(*b == expected);
+
+    std::unique_ptr<InputStream> is = memoryInputStream(*os);
+    std::vector<uint8_t> actual;
+    const uint8_t *p;
+    size_t n;
+    while (is->next(&p, &n)) {
+        actual.insert(actual.end(), p, p + n);
+        BOOST_CHECK_EQUAL(is->byteCount(), actual.size());
+    }
+    BOOST_CHECK(actual == expected);
+
+    is = memoryInputStream(*os);
+    is->skip(100 * 1024 + 5);
+    BOOST_CHECK_EQUAL(is->byteCount(), 100 * 1024 + 5);
+    BOOST_REQUIRE(is->next(&p, &n));
+    BOOST_CHECK_EQUAL(*p, expected[100 * 1024 + 5]);
+}
+
+void testGeometricMemoryStreams() {
+    testGeometricMemoryStream(false);
+    testGeometricMemoryStream(true);
+}
+
+std::vector<uint8_t> writeChunks(OutputStream &os) {
+    std::vector<uint8_t> expected;
+    for (size_t i = 0; i < 5000; ++i) {
+        expected.push_back(static_cast<uint8_t>(i * 13));
+    }
+    // Small enough to be copied into the buffer, then larger than it.
+    OutputChunk small[] = {{expected.data(), 3}, {expected.data() + 3, 0}, {expected.data() + 3, 7}};
+    OutputChunk large[] = {{expected.data() + 10, 990}, {expected.data() + 1000, 4000}};
+    os.writeChunks(small, 3);
+    BOOST_CHECK_EQUAL(os.byteCount(), 10);
+    os.writeChunks(large, 2);
+    BOOST_CHECK_EQUAL(os.byteCount(), expected.size());
+    os.flush();
+    return expected;
+}
+
+std::vector<uint8_t> readAll(InputStream &is) {
+    std::vector<uint8_t> result;
+    const uint8_t *p;
+    size_t n;
+    while (is.next(&p, &n)) {
+        result.insert(result.end(), p, p + n);
+    }
+    return result;
+}
+
+void testWriteChunks() {
+    {
+        std::unique_ptr<OutputStream> os = memoryOutputStream(100);
+        std::vector<uint8_t> expected = writeChunks(*os);
+        BOOST_CHECK(readAll(*memoryInputStream(*os)) == expected);
+    }
+    {
+        FileRemover fr(filename);
+        std::vector<uint8_t> expected;
+        {
+            std::unique_ptr<OutputStream> os = fileOutputStream(filename, 100);
+            expected = writeChunks(*os);
+        }
+        BOOST_CHECK(readAll(*fileInputStream(filename)) == expected);
+    }
+#ifndef _WIN32
+    {
+        FileRemover fr(filename);
+        int fd = ::open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        BOOST_REQUIRE(fd >= 0);
+        std::vector<uint8_t> expected;
+        {
+            std::unique_ptr<OutputStream> os = fdOutputStream(fd, 100);
+            expected = writeChunks(*os);
+        }
+        // The stream leaves the descriptor open.
+        BOOST_CHECK_EQUAL(::close(fd), 0);
+        BOOST_CHECK(readAll(*fileInputStream(filename)) == expected);
+    }
+#endif
+}
+
+#ifndef _WIN32
+void testMappedFileOutputStream() {
+    FileRemover fr(filename);
+    std::vector<uint8_t> expected;
+    {
+        std::unique_ptr<OutputStream> os = mappedFileOutputStream(filename, 64 * 1024);
+        BOOST_CHECK_EQUAL(boost::filesystem::file_size(filename), 64 * 1024);
+        expected = writeChunks(*os);
+        os->flush();
+        BOOST_CHECK(os->sync());
+        BOOST_CHECK_EQUAL(os->byteCount(), expected.size());
+    }
+    // The file is cut to what was written.
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(filename), expected.size());
+    BOOST_CHECK(readAll(*fileInputStream(filename)) == expected);
+
+    // Writing past the end throws, leaving what fitted.
+    {
+        std::unique_ptr<OutputStream> os = mappedFileOutputStream(filename, 10);
+        uint8_t *p;
+        size_t n;
+        BOOST_REQUIRE(os->next(&p, &n));
+        BOOST_CHECK_EQUAL(n, 10U);
+        memset(p, 'x', n);
+        BOOST_CHECK_THROW(os->next(&p, &n), Exception);
+    }
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(filename), 10U);
+    BOOST_CHECK_THROW(mappedFileOutputStream(filename, 0), Exception);
+}
+
+void testRewrite() {
+    // Writes over a run across chunks of 100 bytes, and across what a
+    // file stream has flushed and what it still holds.
+    auto rewrite = [](OutputStream &os) {
+        std::vector<uint8_t> expected = writeChunks(os);
+        uint8_t *p;
+        size_t n;
+        BOOST_REQUIRE(os.next(&p, &n));
+        BOOST_REQUIRE_GE(n, 50U);
+        memset(p, 'q', 50);
+        os.backup(n - 50);
+        expected.insert(expected.end(), 50, 'q');
+        std::vector<uint8_t> patch(150, 'p');
+        BOOST_CHECK(os.rewrite(expected.size() - 170, patch.data(), patch.size()));
+        std::copy(patch.begin(), patch.end(), expected.end() - 170);
+        BOOST_CHECK_EQUAL(os.byteCount(), expected.size());
+        os.flush();
+        return expected;
+    };
+    {
+        std::unique_ptr<OutputStream> os = memoryOutputStream(100);
+        std::vector<uint8_t> expected = rewrite(*os);
+        BOOST_CHECK(readAll(*memoryInputStream(*os)) == expected);
+    }
+    {
+        FileRemover fr(filename);
+        std::vector<uint8_t> expected;
+        {
+            std::unique_ptr<OutputStream> os = fileOutputStream(filename, 100);
+            expected = rewrite(*os);
+        }
+        BOOST_CHECK(readAll(*fileInputStream(filename)) == expected);
+        std::unique_ptr<OutputStream> os = fileAppendOutputStream(filename);
+        uint8_t b = 0;
+        BOOST_CHECK(!os->rewrite(0, &b, 1));
+    }
+    // Not even what a pipe's stream still holds.
+    int fds[2];
+    BOOST_REQUIRE_EQUAL(::pipe(fds), 0);
+    {
+        std::unique_ptr<OutputStream> os = fdOutputStream(fds[1]);
+        uint8_t b = 0;
+        OutputChunk chunk = {&b, 1};
+        os->writeChunks(&chunk, 1);
+        BOOST_CHECK(!os->rewrite(0, &b, 1));
+    }
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+void testResetMemoryStream() {
+    std::unique_ptr<OutputStream> os = memoryOutputStream(100);
+    uint8_t *first;
+    uint8_t *p;
+    size_t n;
+    BOOST_REQUIRE(os->next(&first, &n));
+    os->backup(n);
+    std::vector<uint8_t> expected = writeChunks(*os);
+    resetMemoryOutputStream(*os);
+    BOOST_CHECK_EQUAL(os->byteCount(), 0);
+    BOOST_CHECK(readAll(*memoryInputStream(*os)).empty());
+
+    // The same chunks are handed out again, in order.
+    BOOST_REQUIRE(os->next(&p, &n));
+    BOOST_CHECK(p == first);
+    BOOST_CHECK_EQUAL(n, 100);
+    os->backup(n);
+    resetMemoryOutputStream(*os);
+    BOOST_CHECK(writeChunks(*os) == expected);
+    BOOST_CHECK(readAll(*memoryInputStream(*os)) == expected);
+    BOOST_CHECK(*snapshot(*os) == expected);
+
+    // Writing more than before allocates new chunks after the kept ones.
+    resetMemoryOutputStream(*os);
+    std::vector<uint8_t> twice(expected);
+    twice.insert(twice.end(), expected.begin(), expected.end());
+    OutputChunk all = {twice.data(), twice.size()};
+    os->writeChunks(&all, 1);
+    BOOST_CHECK_EQUAL(os->byteCount(), twice.size());
+    BOOST_CHECK(readAll(*memoryInputStream(*os)) == twice);
+}
+
+void testCachedFileStreams() {
+    std::vector<uint8_t> expected(3 * 1024 * 1024 + 123);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        expected[i] = static_cast<uint8_t>(i % 251);
+    }
+    FileRemover fr(filename);
+    {
+        std::unique_ptr<OutputStream> os = fileOutputStream(filename);
+        OutputChunk all = {expected.data(), expected.size()};
+        os->writeChunks(&all, 1);
+    }
+
+    StreamOptions::CacheMode modes[] = {StreamOptions::CACHE_DROP_BEHIND, StreamOptions::CACHE_DIRECT};
+    for (StreamOptions::CacheMode mode : modes) {
+        StreamOptions options;
+        options.cache = mode;
+        BOOST_CHECK(readAll(*fileInputStream(filename, options)) == expected);
+
+        std::unique_ptr<SeekableInputStream> is = fileSeekableInputStream(filename, options);
+        const uint8_t *b;
+        size_t n;
+        // Unaligned positions, forwards and backwards.
+        is->seek(5007);
+        BOOST_REQUIRE(is->next(&b, &n));
+        BOOST_CHECK_EQUAL(*b, expected[5007]);
+        is->skip(1024 * 1024);
+        size_t at = is->byteCount();
+        BOOST_REQUIRE(is->next(&b, &n));
+        BOOST_CHECK_EQUAL(*b, expected[at]);
+        is->seek(3);
+        BOOST_REQUIRE(is->next(&b, &n));
+        BOOST_CHECK_EQUAL(*b, expected[3]);
+        is->seek(static_cast<int64_t>(expected.size()));
+        BOOST_CHECK(!is->next(&b, &n));
+
+        BOOST_REQUIRE(reopenFileInputStream(*is, filename));
+        BOOST_CHECK(readAll(*is) == expected);
+    }
+}
+
+class CountingResource : public MemoryResource {
+public:
+    size_t allocations = 0;
+    size_t outstanding = 0;
+
+    void *allocate(size_t bytes, size_t alignment) override {
+        ++allocations;
+        outstanding += bytes;
+        return newDeleteResource()->allocate(bytes, alignment);
+    }
+
+    void deallocate(void *p, size_t bytes, size_t alignment) override {
+        BOOST_REQUIRE(outstanding >= bytes);
+        outstanding -= bytes;
+        newDeleteResource()->deallocate(p, bytes, alignment);
+    }
+};
+
+void testMemoryResource() {
+    std::vector<uint8_t> expected(100 * 1024 + 7);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        expected[i] = static_cast<uint8_t>(i % 251);
+    }
+    OutputChunk all = {expected.data(), expected.size()};
+    FileRemover fr(filename);
+
+    CountingResource counting;
+    {
+        StreamOptions options;
+        options.memoryResource = &counting;
+        options.growth = StreamOptions::GEOMETRIC_CHUNKS;
+        std::unique_ptr<OutputStream> os = memoryOutputStream(options);
+        os->writeChunks(&all, 1);
+        BOOST_CHECK(readAll(*memoryInputStream(*os)) == expected);
+        BOOST_CHECK(counting.allocations > 1);
+
+        size_t before = counting.allocations;
+        std::unique_ptr<OutputStream> fos = fileOutputStream(filename, options);
+        fos->writeChunks(&all, 1);
+        fos->flush();
+        fos.reset();
+        BOOST_CHECK(readAll(*fileSeekableInputStream(filename, options)) == expected);
+        BOOST_CHECK(counting.allocations > before);
+    }
+    BOOST_CHECK_EQUAL(counting.outstanding, 0);
+
+    // Streams made without a resource take the thread's default.
+    CountingResource scoped;
+    {
+        ScopedMemoryResource scope(&scoped);
+        BOOST_CHECK(defaultMemoryResource() == &scoped);
+        std::unique_ptr<OutputStream> os = memoryOutputStream();
+        os->writeChunks(&all, 1);
+        BOOST_CHECK(readAll(*fileInputStream(filename)) == expected);
+    }
+    BOOST_CHECK(defaultMemoryResource() == newDeleteResource());
+    BOOST_CHECK(scoped.allocations > 1);
+    BOOST_CHECK_EQUAL(scoped.outstanding, 0);
+}
+
+#ifdef AVRO_STREAM_COUNTERS
+void testStreamCounters() {
+    std::vector<uint8_t> expected(20 * 1024 + 3);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        expected[i] = static_cast<uint8_t>(i % 251);
+    }
+    OutputChunk all = {expected.data(), expected.size()};
+    FileRemover fr(filename);
+
+    std::unique_ptr<OutputStream> os = memoryOutputStream(4 * 1024);
+    os->writeChunks(&all, 1);
+    BOOST_CHECK_EQUAL(os->counters().copiedBytes, expected.size());
+    BOOST_CHECK_EQUAL(os->counters().chunksAllocated, 6U);
+    BOOST_CHECK_EQUAL(os->counters().refills, 0U);
+    {
+        std::unique_ptr<OutputStream> fos = fileOutputStream(filename, 4 * 1024);
+        // Too big to copy into the buffer; written as it is.
+        fos->writeChunks(&all, 1);
+        StreamWriter w(*fos);
+        w.writeBytes(expected.data(), 10);
+        w.flush();
+        BOOST_CHECK_EQUAL(fos->counters().copiedBytes, 10U);
+        BOOST_CHECK_EQUAL(fos->counters().chunksAllocated, 1U);
+        BOOST_CHECK_EQUAL(fos->counters().refills, 2U);
+    }
+
+    std::unique_ptr<InputStream> is = fileInputStream(filename, 4 * 1024);
+    StreamReader r(*is);
+    std::vector<uint8_t> b(expected.size() + 10);
+    r.readBytes(b.data(), b.size());
+    BOOST_CHECK_EQUAL(is->counters().copiedBytes, b.size());
+    BOOST_CHECK_EQUAL(is->counters().refills, 6U);
+
+    // Nothing is copied out of a mapped file unless asked for.
+    std::unique_ptr<SeekableInputStream> mapped = mappedFileInputStream(filename);
+    BOOST_CHECK_EQUAL(readAll(*mapped).size(), b.size());
+    BOOST_CHECK_EQUAL(mapped->counters().copiedBytes, 0U);
+    BOOST_CHECK_EQUAL(mapped->counters().chunksAllocated, 0U);
+}
+#endif
+
+void testSocketStreams() {
+    int sv[2];
+    BOOST_REQUIRE_EQUAL(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+    SocketOptions options;
+    options.chunkSize = 100;
+    options.chunkCount = 4;
+    // Unix sockets do not support MSG_ZEROCOPY; the stream falls back
+    // to ordinary sends.
+    options.zeroCopy = true;
+    options.zeroCopyThreshold = 0;
+
+    std::vector<uint8_t> expected;
+    std::thread writer([&]() {
+        std::unique_ptr<OutputStream> os = socketOutputStream(sv[0], options);
+        expected = writeChunks(*os);
+        // More than the four chunks hold.
+        for (size_t i = 0; i < 1000; ++i) {
+            uint8_t *p;
+            size_t n;
+            os->next(&p, &n);
+            *p = static_cast<uint8_t>(i);
+            os->backup(n - 1);
+            expected.push_back(static_cast<uint8_t>(i));
+        }
+        BOOST_CHECK_EQUAL(os->byteCount(), expected.size());
+        os->flush();
+        ::shutdown(sv[0], SHUT_WR);
+    });
+
+    std::vector<uint8_t> actual;
+    {
+        std::unique_ptr<InputStream> is = socketInputStream(sv[1], options);
+        is->skip(10);
+        actual = readAll(*is);
+        BOOST_CHECK_EQUAL(is->byteCount(), actual.size() + 10);
+    }
+    writer.join();
+    BOOST_REQUIRE_EQUAL(actual.size() + 10, expected.size());
+    BOOST_CHECK(std::equal(actual.begin(), actual.end(), expected.begin() + 10));
+    ::close(sv[0]);
+    ::close(sv[1]);
+}
+#endif
+
 } // namespace stream
 
 } // namespace avro
@@ -230,5 +754,36 @@ init_unit_test_suite(int argc, char *argv[]) {
                                                 avro::stream::Verify2>),
         avro::stream::data,
         avro::stream::data + sizeof(avro::stream::data) / sizeof(avro::stream::data[0])));
+
+    ts->add(BOOST_TEST_CASE(
+        &avro::stream::testEmpty_mappedStream<avro::stream::CheckEmpty1>));
+    ts->add(BOOST_TEST_CASE(
+        &avro::stream::testEmpty_mappedStream<avro::stream::CheckEmpty2>));
+
+    ts->add(BOOST_PARAM_TEST_CASE(
+        (&avro::stream::testNonEmpty_mappedStream<avro::stream::Fill1,
+                                                  avro::stream::Verify1>),
+        avro::stream::data,
+        avro::stream::data + sizeof(avro::stream::data) / sizeof(avro::stream::data[0])));
+    ts->add(BOOST_PARAM_TEST_CASE(
+        (&avro::stream::testNonEmpty_mappedStream<avro::stream::Fill2,
+                                                  avro::stream::Verify2>),
+        avro::stream::data,
+        avro::stream::data + sizeof(avro::stream::data) / sizeof(avro::stream::data[0])));
+    ts->add(BOOST_TEST_CASE(&avro::stream::testSeek_mappedStream));
+    ts->add(BOOST_TEST_CASE(&avro::stream::testAsyncFileStreams));
+    ts->add(BOOST_TEST_CASE(&avro::stream::testGeometricMemoryStreams));
+    ts->add(BOOST_TEST_CASE(&avro::stream::testWriteChunks));
+    ts->add(BOOST_TEST_CASE(&avro::stream::testResetMemoryStream));
+    ts->add(BOOST_TEST_CASE(&avro::stream::testCachedFileStreams));
+    ts->add(BOOST_TEST_CASE(&avro::stream::testMemoryResource));
+#ifdef AVRO_STREAM_COUNTERS
+    ts->add(BOOST_TEST_CASE(&avro::stream::testStreamCounters));
+#endif
+#ifndef _WIN32
+    ts->add(BOOST_TEST_CASE(&avro::stream::testSocketStreams));
+    ts->add(BOOST_TEST_CASE(&avro::stream::testMappedFileOutputStream));
+    ts->add(BOOST_TEST_CASE(&avro::stream::testRewrite));
+#endif
     return ts;
 }
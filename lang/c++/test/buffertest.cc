@@ -32,6 +32,9 @@
 #include "buffer/BufferReader.hh"
 #include "buffer/BufferStream.hh"
 
+#include "Decoder.hh"
+#include "Encoder.hh"
+
 using namespace avro;
 using detail::kDefaultBlockSize;
 using detail::kMaxBlockSize;
@@ -409,6 +412,41 @@ void TestBufferStream() {
     }
 }
 
+void TestStreamAdapters() {
+    BOOST_TEST_MESSAGE("TestStreamAdapters");
+
+    std::string junk = makeString(3 * kDefaultBlockSize);
+    OutputBuffer buf;
+    {
+        OutputStreamPtr out = bufferOutputStream(buf);
+        EncoderPtr e = binaryEncoder();
+        e->init(*out);
+        e->encodeString(junk);
+        e->encodeLong(1234567);
+        e->flush();
+        BOOST_CHECK_EQUAL(out->byteCount(), buf.size());
+    }
+    BOOST_CHECK_GT(buf.numDataChunks(), 1);
+
+    InputBuffer in(buf);
+    InputStreamPtr is = bufferInputStream(in);
+    const uint8_t *data;
+    size_t len;
+    BOOST_REQUIRE(is->next(&data, &len));
+    // The chunks are read in place.
+    BOOST_CHECK_EQUAL(reinterpret_cast<const char *>(data), in.begin()->data());
+    BOOST_CHECK_EQUAL(len, in.begin()->size());
+    is->backup(len);
+    BOOST_CHECK_EQUAL(is->byteCount(), 0u);
+
+    DecoderPtr d = binaryDecoder();
+    d->init(*is);
+    BOOST_CHECK_EQUAL(d->decodeString(), junk);
+    BOOST_CHECK_EQUAL(d->decodeLong(), 1234567);
+    BOOST_CHECK(!is->next(&data, &len));
+    BOOST_CHECK_EQUAL(is->byteCount(), in.size());
+}
+
 template<typename T>
 void TestEof() {
     // create a message full of eof chars
@@ -1074,6 +1112,46 @@ void TestPrinter() {
     }
 }
 
+void TestBlockPool() {
+    BOOST_TEST_MESSAGE("TestBlockPool");
+    {
+        avro::detail::trimBlockPool();
+
+        // blocks are rounded up to the next pooled size
+        avro::detail::Block *b = avro::detail::allocateBlock(5000);
+        BOOST_CHECK_EQUAL(b->size, 2 * kMinBlockSize);
+        avro::detail::Block *c = avro::detail::allocateBlock(kMaxBlockSize + 1);
+        BOOST_CHECK_EQUAL(c->size, kMaxBlockSize + 1);
+
+        // a released block is handed out again, but a larger one is freed
+        const void *p = b;
+        avro::detail::releaseBlock(b);
+        avro::detail::releaseBlock(c);
+        b = avro::detail::allocateBlock(6000);
+        BOOST_CHECK_EQUAL(b, p);
+        avro::detail::releaseBlock(b);
+    }
+
+    {
+        // the blocks of a buffer are reused by the next one
+        const char *first;
+        {
+            OutputBuffer ob(kMaxBlockSize);
+            BOOST_CHECK_EQUAL(ob.freeSpace(), kMaxBlockSize);
+            addDataToBuffer(ob, 100);
+            first = ob.begin()->data();
+        }
+        OutputBuffer ob(kMaxBlockSize);
+        addDataToBuffer(ob, 100);
+        BOOST_CHECK_EQUAL(static_cast<const void *>(ob.begin()->data()), static_cast<const void *>(first));
+
+        // a chunk holds what was reserved, whatever the size of its block
+        ob.reserve(ob.freeSpace() + 5000);
+        BOOST_CHECK_EQUAL(ob.freeSpace(), kMaxBlockSize - 100 + 5000);
+    }
+    avro::detail::trimBlockPool();
+}
+
 struct BufferTestSuite : public boost::unit_test::test_suite {
     BufferTestSuite() : boost::unit_test::test_suite("BufferTestSuite") {
         add(BOOST_TEST_CASE(TestReserve));
@@ -1084,6 +1162,7 @@ struct BufferTestSuite : public boost::unit_test::test_suite {
         add(BOOST_TEST_CASE(TestAppend));
         add(BOOST_TEST_CASE(TestBufferStream));
         add(BOOST_TEST_CASE(TestBufferStreamEof));
+        add(BOOST_TEST_CASE(TestStreamAdapters));
         add(BOOST_TEST_CASE(TestSeekAndTell));
         add(BOOST_TEST_CASE(TestReadSome));
         add(BOOST_TEST_CASE(TestSeek));
@@ -1097,6 +1176,7 @@ struct BufferTestSuite : public boost::unit_test::test_suite {
         add(BOOST_TEST_CASE(TestForeign));
         add(BOOST_TEST_CASE(TestForeignDiscard));
         add(BOOST_TEST_CASE(TestPrinter));
+        add(BOOST_TEST_CASE(TestBlockPool));
     }
 };
 
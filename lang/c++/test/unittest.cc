@@ -24,6 +24,7 @@
 #include "Compiler.hh"
 #include "Decoder.hh"
 #include "Encoder.hh"
+#include "GenericDatum.hh"
 #include "Node.hh"
 #include "Parser.hh"
 #include "Schema.hh"
@@ -954,6 +955,85 @@ void testNestedMapSchema() {
     BOOST_CHECK_EQUAL(expected, actual.str());
 }
 
+void testWideRecordLookup() {
+    const size_t fieldCount = 300;
+    RecordSchema record("Wide");
+    for (size_t i = 0; i < fieldCount; ++i) {
+        record.addField("field" + std::to_string(i), LongSchema());
+    }
+    avro::ValidSchema vs(record);
+    const avro::NodePtr &node = vs.root();
+    for (size_t i = 0; i < fieldCount; ++i) {
+        size_t index = fieldCount;
+        BOOST_CHECK(node->nameIndex("field" + std::to_string(i), index));
+        BOOST_CHECK_EQUAL(index, i);
+    }
+    size_t index;
+    BOOST_CHECK(!node->nameIndex("field", index));
+    BOOST_CHECK(!node->nameIndex("field300", index));
+    BOOST_CHECK(!node->nameIndex("", index));
+
+    // Names need not be terminated.
+    const char text[] = "field123field45";
+    BOOST_CHECK(node->nameIndex(text, 8, index));
+    BOOST_CHECK_EQUAL(index, 123);
+    BOOST_CHECK(node->nameIndex(text + 8, 7, index));
+    BOOST_CHECK_EQUAL(index, 45);
+    BOOST_CHECK(!node->nameIndex(text, 9, index));
+
+    avro::GenericDatum datum(vs);
+    auto &r = datum.value<avro::GenericRecord>();
+    r.field("field299") = avro::GenericDatum(int64_t(7));
+    BOOST_CHECK_EQUAL(r.fieldAt(299).value<int64_t>(), 7);
+    BOOST_CHECK_EQUAL(r.fieldIndex(std::string("field42")), 42);
+    BOOST_CHECK(r.hasField("field0"));
+    BOOST_CHECK(!r.hasField("field-1"));
+    BOOST_CHECK_THROW(r.field("nope"), avro::Exception);
+}
+
+// Writer and Reader go through the binary encoder and decoder; values
+// written one at a time read back whole blocks at once.
+void testReaderWriterRoundTrip() {
+    Writer w;
+    w.writeValue(true);
+    w.writeValue(std::string("abc"));
+    w.writeArrayBlock(3);
+    for (int64_t i = -1; i < 2; ++i) {
+        w.writeValue(i * 1000000000000);
+    }
+    w.writeArrayEnd();
+    w.writeArrayBlock(2);
+    w.writeValue(1.5);
+    w.writeValue(-2.25);
+    w.writeArrayEnd();
+    const uint8_t fixed[3] = {1, 2, 3};
+    w.writeFixed(fixed);
+
+    Reader r(w.buffer());
+    bool b = false;
+    r.readValue(b);
+    BOOST_CHECK(b);
+    std::string s;
+    r.readValue(s);
+    BOOST_CHECK_EQUAL(s, "abc");
+    BOOST_CHECK_EQUAL(r.readArrayBlockSize(), 3);
+    int64_t longs[3];
+    r.readValues(longs, 3);
+    BOOST_CHECK_EQUAL(longs[0], -1000000000000);
+    BOOST_CHECK_EQUAL(longs[2], 1000000000000);
+    BOOST_CHECK_EQUAL(r.readArrayBlockSize(), 0);
+    BOOST_CHECK_EQUAL(r.readArrayBlockSize(), 2);
+    double doubles[2];
+    r.readValues(doubles, 2);
+    BOOST_CHECK_EQUAL(doubles[0], 1.5);
+    BOOST_CHECK_EQUAL(doubles[1], -2.25);
+    BOOST_CHECK_EQUAL(r.readArrayBlockSize(), 0);
+    uint8_t got[3];
+    r.readFixed(got);
+    BOOST_CHECK_EQUAL_COLLECTIONS(got, got + 3, fixed, fixed + 3);
+    BOOST_CHECK_THROW(r.readValue(b), avro::Exception);
+}
+
 boost::unit_test::test_suite *
 init_unit_test_suite(int argc, char *argv[]) {
     using namespace boost::unit_test;
@@ -974,6 +1054,8 @@ init_unit_test_suite(int argc, char *argv[]) {
                                     boost::make_shared<TestResolution>()));
     test->add(BOOST_TEST_CASE(&testNestedArraySchema));
     test->add(BOOST_TEST_CASE(&testNestedMapSchema));
+    test->add(BOOST_TEST_CASE(&testWideRecordLookup));
+    test->add(BOOST_TEST_CASE(&testReaderWriterRoundTrip));
 
     return test;
 }
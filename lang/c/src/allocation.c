@@ -21,6 +21,7 @@
 #include "avro_private.h"
 #include "avro/allocation.h"
 #include "avro/data.h"
+#include "avro/errors.h"
 #include "avro/legacy.h"
 
 static void *
@@ -37,17 +38,40 @@ avro_default_allocator(void *ud, void *ptr, size_t osize, size_t nsize)
 	}
 }
 
+/*
+ * AVRO_CURRENT_ALLOCATOR dispatches to the calling thread's arena, if
+ * it has one bound, and otherwise to the allocator set with
+ * avro_set_allocator, which is kept here and also supplies the arenas'
+ * own chunks.  The dispatcher is in place from the start, so that
+ * binding an arena never swaps allocators under other threads.
+ */
+
+static void *
+avro_arena_dispatch(void *ud, void *ptr, size_t osize, size_t nsize);
+
 struct avro_allocator_state  AVRO_CURRENT_ALLOCATOR = {
+	avro_arena_dispatch,
+	NULL
+};
+
+static struct avro_allocator_state  AVRO_BACKING_ALLOCATOR = {
 	avro_default_allocator,
 	NULL
 };
 
 void avro_set_allocator(avro_allocator_t alloc, void *user_data)
 {
-	AVRO_CURRENT_ALLOCATOR.alloc = alloc;
+	AVRO_BACKING_ALLOCATOR.alloc = alloc;
+	AVRO_BACKING_ALLOCATOR.user_data = user_data;
 	AVRO_CURRENT_ALLOCATOR.user_data = user_data;
 }
 
+void *avro_backing_realloc(void *ptr, size_t osize, size_t nsize)
+{
+	return AVRO_BACKING_ALLOCATOR.alloc
+	    (AVRO_BACKING_ALLOCATOR.user_data, ptr, osize, nsize);
+}
+
 void *avro_calloc(size_t count, size_t size)
 {
 	void  *ptr = avro_malloc(count * size);
@@ -114,3 +138,239 @@ avro_alloc_free_func(void *ptr, size_t sz)
 {
 	avro_free(ptr, sz);
 }
+
+
+/*
+ * Arenas
+ *
+ * An arena hands out memory from a list of chunks, which it gets from
+ * the backing allocator.  Freeing a block only gives it back if it's
+ * the last one handed out; everything else waits for
+ * avro_arena_reset, which rewinds to the first chunk and keeps the
+ * whole list for reuse.  Each new chunk is twice the size of the one
+ * before, so the list stays short however much a batch allocates.
+ */
+
+#if defined THREADSAFE
+#if defined __unix__ || defined __unix
+#include <pthread.h>
+static pthread_key_t arena_key;
+static pthread_once_t arena_key_once = PTHREAD_ONCE_INIT;
+
+static void make_arena_key()
+{
+	pthread_key_create(&arena_key, NULL);
+}
+
+#define get_bound_arena() \
+	(pthread_once(&arena_key_once, make_arena_key), \
+	 (avro_arena_t) pthread_getspecific(arena_key))
+#define set_bound_arena(arena) \
+	(pthread_once(&arena_key_once, make_arena_key), \
+	 pthread_setspecific(arena_key, (arena)))
+#elif defined _WIN32
+static __declspec( thread ) avro_arena_t  BOUND_ARENA = NULL;
+#define get_bound_arena()  (BOUND_ARENA)
+#define set_bound_arena(arena)  (BOUND_ARENA = (arena))
+#endif /* unix||_unix||_WIN32 */
+#else /* not thread-safe */
+static avro_arena_t  BOUND_ARENA = NULL;
+#define get_bound_arena()  (BOUND_ARENA)
+#define set_bound_arena(arena)  (BOUND_ARENA = (arena))
+#endif
+
+#define ARENA_ALIGNMENT  16
+#define ARENA_DEFAULT_CHUNK_SIZE  (64 * 1024)
+#define ARENA_MAX_CHUNK_SIZE  (16 * 1024 * 1024)
+
+#define arena_align(sz) \
+	(((sz) + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1))
+
+struct avro_arena_chunk {
+	struct avro_arena_chunk  *next;
+	size_t  size;
+	size_t  used;
+	/* keeps the data that follows aligned */
+	char  padding[ARENA_ALIGNMENT - (2 * sizeof(size_t) + sizeof(void *)) % ARENA_ALIGNMENT];
+};
+
+#define chunk_data(chunk)  ((char *) ((chunk) + 1))
+
+struct avro_arena_t_ {
+	struct avro_arena_chunk  *head;
+	struct avro_arena_chunk  *current;
+	size_t  next_size;
+	/* start of the last block handed out, for frees and in-place growth */
+	char  *last;
+};
+
+avro_arena_t avro_arena_new(size_t chunk_size)
+{
+	avro_arena_t  arena = (avro_arena_t)
+	    avro_backing_realloc(NULL, 0, sizeof(struct avro_arena_t_));
+	if (arena == NULL) {
+		avro_set_error("Cannot allocate arena");
+		return NULL;
+	}
+	arena->head = NULL;
+	arena->current = NULL;
+	arena->next_size = chunk_size? chunk_size: ARENA_DEFAULT_CHUNK_SIZE;
+	arena->last = NULL;
+	return arena;
+}
+
+void avro_arena_reset(avro_arena_t arena)
+{
+	arena->current = arena->head;
+	if (arena->current != NULL) {
+		arena->current->used = 0;
+	}
+	arena->last = NULL;
+}
+
+void avro_arena_free(avro_arena_t arena)
+{
+	struct avro_arena_chunk  *chunk = arena->head;
+	while (chunk != NULL) {
+		struct avro_arena_chunk  *next = chunk->next;
+		avro_backing_realloc(chunk, sizeof(struct avro_arena_chunk) + chunk->size, 0);
+		chunk = next;
+	}
+	avro_backing_realloc(arena, sizeof(struct avro_arena_t_), 0);
+}
+
+/*
+ * Moves on to a chunk with room for size bytes: the next one in the
+ * list if it's big enough, or a new one linked in after the current
+ * one otherwise.
+ */
+
+static struct avro_arena_chunk *
+arena_next_chunk(avro_arena_t arena, size_t size)
+{
+	struct avro_arena_chunk  *next =
+	    arena->current == NULL? arena->head: arena->current->next;
+
+	if (next == NULL || next->size < size) {
+		size_t  chunk_size = arena->next_size;
+		while (chunk_size < size) {
+			chunk_size *= 2;
+		}
+		struct avro_arena_chunk  *chunk = (struct avro_arena_chunk *)
+		    avro_backing_realloc(NULL, 0, sizeof(struct avro_arena_chunk) + chunk_size);
+		if (chunk == NULL) {
+			return NULL;
+		}
+		chunk->size = chunk_size;
+		chunk->next = next;
+		if (arena->current == NULL) {
+			arena->head = chunk;
+		} else {
+			arena->current->next = chunk;
+		}
+		if (arena->next_size < ARENA_MAX_CHUNK_SIZE) {
+			arena->next_size *= 2;
+		}
+		next = chunk;
+	}
+
+	next->used = 0;
+	arena->current = next;
+	return next;
+}
+
+static void *
+arena_alloc(avro_arena_t arena, size_t size)
+{
+	struct avro_arena_chunk  *chunk = arena->current;
+	size = arena_align(size);
+	if (chunk == NULL || chunk->size - chunk->used < size) {
+		chunk = arena_next_chunk(arena, size);
+		if (chunk == NULL) {
+			return NULL;
+		}
+	}
+
+	char  *ptr = chunk_data(chunk) + chunk->used;
+	chunk->used += size;
+	arena->last = ptr;
+	return ptr;
+}
+
+/*
+ * Returns whether ptr was handed out by the arena since it was last
+ * reset.  Recent blocks are in the current chunk, so it's checked
+ * first.
+ */
+
+static int
+arena_owns(avro_arena_t arena, const char *ptr)
+{
+	struct avro_arena_chunk  *chunk = arena->current;
+	if (chunk == NULL) {
+		return 0;
+	}
+	if (ptr >= chunk_data(chunk) && ptr < chunk_data(chunk) + chunk->used) {
+		return 1;
+	}
+	for (chunk = arena->head; chunk != arena->current; chunk = chunk->next) {
+		if (ptr >= chunk_data(chunk) && ptr < chunk_data(chunk) + chunk->size) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void *
+arena_realloc(avro_arena_t arena, void *ptr, size_t osize, size_t nsize)
+{
+	if (ptr == NULL) {
+		return nsize == 0? NULL: arena_alloc(arena, nsize);
+	}
+
+	/* Memory from before the arena was bound goes back where it came from. */
+	if (!arena_owns(arena, (char *) ptr)) {
+		return avro_backing_realloc(ptr, osize, nsize);
+	}
+
+	struct avro_arena_chunk  *chunk = arena->current;
+	if (ptr == arena->last) {
+		size_t  start = arena->last - chunk_data(chunk);
+		if (nsize == 0) {
+			chunk->used = start;
+			arena->last = NULL;
+			return NULL;
+		}
+		if (chunk->size - start >= arena_align(nsize)) {
+			chunk->used = start + arena_align(nsize);
+			return ptr;
+		}
+	}
+
+	if (nsize == 0) {
+		return NULL;
+	}
+	void  *new_ptr = arena_alloc(arena, nsize);
+	if (new_ptr != NULL) {
+		memcpy(new_ptr, ptr, osize < nsize? osize: nsize);
+	}
+	return new_ptr;
+}
+
+static void *
+avro_arena_dispatch(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+	AVRO_UNUSED(ud);
+	avro_arena_t  arena = get_bound_arena();
+	if (arena == NULL) {
+		return avro_backing_realloc(ptr, osize, nsize);
+	}
+	return arena_realloc(arena, ptr, osize, nsize);
+}
+
+avro_arena_t avro_arena_bind(avro_arena_t arena)
+{
+	avro_arena_t  previous = get_bound_arena();
+	set_bound_arena(arena);
+	return previous;
+}
@@ -85,5 +85,46 @@ char *avro_strdup(const char *str);
 char *avro_strndup(const char *str, size_t size);
 void avro_str_free(char *str);
 
+/*
+ * Arenas.  An arena allocates from large chunks and frees them all at
+ * once, which is much cheaper than allocating and freeing each piece
+ * of a value on its own.  avro_arena_bind makes an arena the target of
+ * every allocation the calling thread makes through the library, so
+ * that values created with avro_generic_value_new, and everything read
+ * into them, come from the arena until it's unbound again.
+ *
+ * Freeing memory from an arena does next to nothing, and memory that
+ * was allocated before the arena was bound is still freed normally.
+ * Values from an arena must still be released with avro_value_decref
+ * (they hold a reference to their class), and must not be used after
+ * avro_arena_reset, which makes all of the arena's memory available
+ * again in constant time.  Memory allocated while an arena is bound
+ * must not be freed while a different arena, or none, is bound.  In
+ * particular, create schemas and value classes before binding, and
+ * unbind an arena before freeing it.
+ *
+ * The arenas take their chunks from the allocator set with
+ * avro_set_allocator, which is also used by threads with no arena.
+ * The resolver cache and the memos the library keeps on schemas come
+ * from that allocator too, whatever arena is bound when they're
+ * filled, so they outlive it.
+ */
+
+typedef struct avro_arena_t_ *avro_arena_t;
+
+/*
+ * Creates an arena whose first chunk is chunk_size bytes.  Zero
+ * selects 64 KiB.
+ */
+avro_arena_t avro_arena_new(size_t chunk_size);
+void avro_arena_reset(avro_arena_t arena);
+void avro_arena_free(avro_arena_t arena);
+
+/*
+ * Binds arena to the calling thread, or unbinds the current one if
+ * arena is NULL, and returns the arena that was bound before.
+ */
+avro_arena_t avro_arena_bind(avro_arena_t arena);
+
 CLOSE_EXTERN
 #endif
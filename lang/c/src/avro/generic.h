@@ -52,6 +52,15 @@ avro_generic_class_from_schema(avro_schema_t schema);
 int
 avro_generic_value_new(avro_value_iface_t *iface, avro_value_t *dest);
 
+/**
+ * Like @ref avro_generic_value_new, but the new value's reference count
+ * is updated without atomic instructions, so only one thread may ever
+ * incref or decref it.  The class and schema keep their shared counts.
+ */
+
+int
+avro_generic_value_new_local(avro_value_iface_t *iface, avro_value_t *dest);
+
 
 /*
  * These functions return an avro_value_iface_t implementation for each
@@ -46,9 +46,46 @@ avro_writer_t avro_writer_file_fp(FILE * fp, int should_close);
 avro_reader_t avro_reader_memory(const char *buf, int64_t len);
 avro_writer_t avro_writer_memory(const char *buf, int64_t len);
 
+/*
+ * Like avro_reader_file_fp, with a read buffer of buffer_size bytes
+ * instead of the default 4 KiB.  Zero selects the default.
+ */
+avro_reader_t avro_reader_file_fp_bs(FILE * fp, int should_close,
+				     size_t buffer_size);
+
+/*
+ * Tells the kernel that the file of a file reader is read once, in
+ * order, and drops the pages behind the read position from the page
+ * cache as the reader goes, so that scanning a large file does not
+ * evict the pages other processes need.  Does nothing where
+ * posix_fadvise is not available.
+ */
+int avro_reader_file_drop_behind(avro_reader_t reader);
+
+/*
+ * Maps the file at path into memory and returns a reader over it.
+ * It behaves as a memory reader (see avro_reader_memory) that owns its
+ * buffer, and unmaps the file when freed.  Not available on Windows.
+ */
+avro_reader_t avro_reader_mmap(const char *path);
+
 void
 avro_reader_memory_set_source(avro_reader_t reader, const char *buf, int64_t len);
 
+/*
+ * Returns a memory writer over a buffer of its own, initial_size bytes
+ * to start with (4 KiB if zero), that grows as it is written.  Its
+ * contents are avro_writer_memory_buf, up to avro_writer_tell; writes
+ * may move them.  The buffer is freed with the writer, and can't be
+ * replaced with avro_writer_memory_set_dest.
+ */
+avro_writer_t avro_writer_memory_growable(size_t initial_size);
+
+/*
+ * Returns the buffer of a memory writer, or NULL for any other writer.
+ */
+const char *avro_writer_memory_buf(avro_writer_t writer);
+
 void
 avro_writer_memory_set_dest(avro_writer_t writer, const char *buf, int64_t len);
 
@@ -58,6 +95,19 @@ int avro_write(avro_writer_t writer, void *buf, int64_t len);
 
 void avro_reader_reset(avro_reader_t reader);
 
+/*
+ * Returns the position of a file or memory reader: the offset in its
+ * file or buffer of the next byte it reads.  Returns -1 on error.
+ */
+int64_t avro_reader_tell(avro_reader_t reader);
+
+/*
+ * Moves a file or memory reader to the given offset in its file or
+ * buffer.  A file reader moving within what it has buffered reads
+ * nothing again.
+ */
+int avro_reader_seek(avro_reader_t reader, int64_t position);
+
 void avro_writer_reset(avro_writer_t writer);
 int64_t avro_writer_tell(avro_writer_t writer);
 void avro_writer_flush(avro_writer_t writer);
@@ -80,6 +130,23 @@ int avro_schema_to_json(const avro_schema_t schema, avro_writer_t out);
 int
 avro_value_read(avro_reader_t reader, avro_value_t *dest);
 
+/*
+ * Like avro_value_read, but the reader must be a memory reader over
+ * the contents of source, and string, bytes and fixed values are
+ * stored as slices of source instead of being copied.  Create source
+ * with avro_wrapped_buffer_new_copy so that the slices share its
+ * reference count; the values keep it alive after the caller frees
+ * its own reference.
+ *
+ * String contents are shifted in place to make room for their NUL
+ * terminators, so the part of source that has been read can't be read
+ * again.
+ */
+
+int
+avro_value_read_wrapped(avro_reader_t reader, avro_value_t *dest,
+			avro_wrapped_buffer_t *source);
+
 /*
  * Writes a binary-encoded Avro value to the given writer object.
  */
@@ -109,15 +176,73 @@ int avro_file_writer_create_with_codec(const char *path,
 int avro_file_writer_create_with_codec_fp(FILE *fp, const char *path, int should_close,
 				avro_schema_t schema, avro_file_writer_t * writer,
 				const char *codec, size_t block_size);
+
+/*
+ * Creates a data file in memory, in a buffer that grows as blocks are
+ * written; see avro_file_writer_get_buffer.
+ */
+int avro_file_writer_create_memory(avro_schema_t schema,
+				   avro_file_writer_t * writer,
+				   const char *codec, size_t block_size);
+
+/*
+ * Flushes a writer made by avro_file_writer_create_memory and returns
+ * the data file written so far.  The buffer belongs to the writer: it
+ * may move as more is written, and is freed when the writer is closed.
+ */
+int avro_file_writer_get_buffer(avro_file_writer_t writer, const char **buf,
+				int64_t *len);
+
 int avro_file_writer_open(const char *path, avro_file_writer_t * writer);
 int avro_file_writer_open_bs(const char *path, avro_file_writer_t * writer, size_t block_size);
 int avro_file_reader(const char *path, avro_file_reader_t * reader);
 int avro_file_reader_fp(FILE *fp, const char *path, int should_close,
 			avro_file_reader_t * reader);
 
+/*
+ * Opens a data file through avro_reader_mmap.  Blocks are decoded
+ * straight from the mapping, and with the null codec the values are
+ * read from it without copying the block at all.
+ */
+int avro_file_reader_mmap(const char *path, avro_file_reader_t * reader);
+
+/*
+ * Opens a data file held in the len bytes at buf, which must stay as
+ * they are until the reader is closed.  As with avro_file_reader_mmap,
+ * blocks are decoded where they are, and with the null codec the
+ * values are read from buf without copying.
+ */
+int avro_file_reader_memory(const char *buf, int64_t len,
+			    avro_file_reader_t * reader);
+
+/*
+ * Has a data file reader opened with avro_file_reader or
+ * avro_file_reader_fp drop the blocks it has read from the page cache;
+ * see avro_reader_file_drop_behind.  Returns EINVAL for mapped files.
+ */
+int avro_file_reader_drop_behind(avro_file_reader_t reader);
+
 avro_schema_t
 avro_file_reader_get_writer_schema(avro_file_reader_t reader);
 
+/*
+ * Sets the compression level used for the blocks written from now on.
+ * Only the deflate and zstandard codecs have levels.
+ */
+int avro_file_writer_set_codec_level(avro_file_writer_t writer, int level);
+
+/*
+ * With background compression on, each full block is encoded and
+ * written by a separate thread while appending carries on into a
+ * second buffer.  An error writing a block is returned from the next
+ * call that waits for the thread: an append that fills a block, or a
+ * sync, flush or close.  From then on every append, sync, flush and
+ * close returns it, and no later block is written; close still
+ * releases the writer.  Only available when the library is built with
+ * THREADSAFE; otherwise returns ENOSYS.
+ */
+int avro_file_writer_set_background(avro_file_writer_t writer, int enabled);
+
 int avro_file_writer_sync(avro_file_writer_t writer);
 int avro_file_writer_flush(avro_file_writer_t writer);
 int avro_file_writer_close(avro_file_writer_t writer);
@@ -127,13 +252,217 @@ int avro_file_reader_close(avro_file_reader_t reader);
 int
 avro_file_reader_read_value(avro_file_reader_t reader, avro_value_t *dest);
 
+/*
+ * Splitting a file between readers.  Every block of a data file starts
+ * just past a sync marker, the first one past the marker that ends the
+ * header, and a reader can start at any block; positions are offsets in
+ * the file.
+ *
+ * avro_file_reader_seek moves to the block starting at position, which
+ * must be a block start, such as one returned by
+ * avro_file_reader_previous_sync.
+ *
+ * avro_file_reader_sync moves to the block after the first sync marker
+ * that starts at or after position, searching the file for it.
+ *
+ * avro_file_reader_past_sync sets *past once the reader has gone past
+ * the first sync marker that starts at or after position, or reached
+ * the end of the file.  To read the blocks whose markers start in the
+ * byte range [start, end), sync to start and read while past_sync(end)
+ * is false; readers of adjacent ranges read every block exactly once.
+ *
+ * avro_file_reader_previous_sync returns the start of the block being
+ * read, or -1 on error.
+ *
+ * Prefetching readers cannot seek or sync.
+ */
+
+int
+avro_file_reader_seek(avro_file_reader_t reader, int64_t position);
+
+int
+avro_file_reader_sync(avro_file_reader_t reader, int64_t position);
+
+int
+avro_file_reader_past_sync(avro_file_reader_t reader, int64_t position,
+			   int *past);
+
+int64_t
+avro_file_reader_previous_sync(avro_file_reader_t reader);
+
+/*
+ * Reads the next value from the file like avro_file_reader_read_value,
+ * but transcodes it straight to JSON with avro_binary_to_json instead
+ * of building an avro_value_t.
+ */
+
+int
+avro_file_reader_read_json(avro_file_reader_t reader,
+			   char **buf, size_t *size, size_t *len);
+
+/*
+ * Hashes up to count of the next values in the file, as
+ * avro_binary_hash does, into hashes, and sets *hashed to the number
+ * hashed.  Fewer than count are only hashed at the end of the file;
+ * EOF is returned once no value is left.
+ */
+
+int
+avro_file_reader_read_hashes(avro_file_reader_t reader, uint64_t seed,
+			     uint64_t *hashes, size_t count, size_t *hashed);
+
+/*
+ * In zero-copy mode, avro_file_reader_read_value stores string, bytes
+ * and fixed values as slices of the decoded block (see
+ * avro_value_read_wrapped) instead of allocating each one.  Each block
+ * is copied once into a reference counted buffer, which stays alive
+ * for as long as any value read from it.
+ */
+
+int
+avro_file_reader_set_zero_copy(avro_file_reader_t reader, int enabled);
+
+/*
+ * Decodes up to depth blocks ahead of the reader on nthreads worker
+ * threads.  The blocks are still read from the file on the calling
+ * thread.  Only available when the library is built with THREADSAFE;
+ * otherwise returns ENOSYS.
+ */
+
+int
+avro_file_reader_prefetch(avro_file_reader_t reader, int nthreads, int depth);
+
+/*
+ * Formats the count values of a file block, read off block_reader, as
+ * text appended to *buf, with the buffer conventions of
+ * avro_binary_to_json.  first is the position of the block's first
+ * value, counting from the first value still to be read when
+ * formatting started.
+ */
+
+typedef int
+(*avro_file_block_formatter_t)(void *user_data, avro_reader_t block_reader,
+			       avro_schema_t writers_schema,
+			       int64_t first, int64_t count,
+			       char **buf, size_t *size, size_t *len);
+
+/*
+ * Prefetches blocks as avro_file_reader_prefetch does, and has the
+ * worker threads also run formatter over each block they decode, so
+ * that decoding and formatting the values of a file are both spread
+ * over the threads.  The text of each block is then taken in file
+ * order with avro_file_reader_read_formatted, which returns EOF at the
+ * end of the file; the text stays valid until the next call.  Values
+ * cannot also be read one by one from such a reader.  Only available
+ * when the library is built with THREADSAFE; otherwise returns ENOSYS.
+ */
+
+int
+avro_file_reader_prefetch_formatted(avro_file_reader_t reader,
+				    int nthreads, int depth,
+				    avro_file_block_formatter_t formatter,
+				    void *user_data);
+
+int
+avro_file_reader_read_formatted(avro_file_reader_t reader,
+				const char **text, size_t *len);
+
 int
 avro_file_writer_append_value(avro_file_writer_t writer, avro_value_t *src);
 
+/*
+ * Appends the values left in a file reader to a file writer a block at
+ * a time, without decoding any of the values; the two files must have
+ * the same schema.  Blocks are copied as they are when the writer uses
+ * the reader's codec and no compression level has been set on it, and
+ * are otherwise decompressed and compressed again, which with nthreads
+ * above zero is done on that many threads if the library is built with
+ * THREADSAFE.  The reader is left at the end of the file.
+ */
+
+int
+avro_file_writer_append_blocks(avro_file_writer_t writer,
+			       avro_file_reader_t reader, int nthreads);
+
 int
 avro_file_writer_append_encoded(avro_file_writer_t writer,
 				const void *buf, int64_t len);
 
+/*
+ * Appends count values whose binary encodings are concatenated in the
+ * len bytes of buf, copying them into the current block as they are.
+ * With validate set, the batch is first walked with the writer's
+ * schema, and nothing is appended unless it holds exactly count values.
+ * Otherwise the bytes are trusted, and only walked to split a batch
+ * larger than a block between values.
+ */
+
+int
+avro_file_writer_append_encoded_batch(avro_file_writer_t writer,
+				      const void *buf, int64_t len,
+				      int64_t count, int validate);
+
+/*
+ * Reads a value of the given schema off the reader, in the binary
+ * encoding, and appends its JSON encoding to a buffer, walking the
+ * encoding with the schema rather than building a value first.  The
+ * text is the one avro_value_to_json gives with one_line set.  *buf
+ * holds *size bytes, of which the first *len are text already there;
+ * the buffer is grown as needed, so it can start out NULL with a size
+ * of 0, and must eventually be freed with avro_free(*buf, *size).  The
+ * text is always NUL-terminated, and *len is only advanced if the
+ * whole value was transcoded.
+ */
+
+int
+avro_binary_to_json(avro_reader_t reader, avro_schema_t writers_schema,
+		    char **buf, size_t *size, size_t *len);
+
+/*
+ * Returns the 64-bit wyhash of a buffer.
+ */
+
+uint64_t
+avro_hash_bytes(const void *buf, size_t len, uint64_t seed);
+
+/*
+ * Hashes the binary encoding of the next value of the given schema on a
+ * memory reader with avro_hash_bytes, skipping over the value rather
+ * than decoding it.  Values hash the same when their encodings match,
+ * so maps must list their entries in the same order, and arrays and
+ * maps must be split into the same blocks; this hash does not agree
+ * with avro_value_hash.
+ */
+
+int
+avro_binary_hash(avro_reader_t reader, avro_schema_t writers_schema,
+		 uint64_t seed, uint64_t *hash);
+
+/*
+ * Hashes the next count values on a memory reader, as
+ * avro_binary_hash does, into hashes.
+ */
+
+int
+avro_binary_hash_batch(avro_reader_t reader, avro_schema_t writers_schema,
+		       uint64_t seed, uint64_t *hashes, size_t count);
+
+/*
+ * Compares the binary encoded value of the given schema at the start of
+ * a with the one at the start of b, in the sort order of the Avro
+ * specification, and sets *result to a negative number, zero or a
+ * positive number as the first sorts before, together with or after the
+ * second.  Records honour the "order" of their fields.  The encodings
+ * are walked side by side only up to their first difference, without
+ * decoding the values.  Maps have no order, and comparing one is an
+ * error.
+ */
+
+int
+avro_binary_compare(avro_schema_t writers_schema,
+		    const void *a, size_t a_len,
+		    const void *b, size_t b_len, int *result);
+
 /*
  * Legacy avro_datum_t API
  */
@@ -141,6 +470,19 @@ avro_file_writer_append_encoded(avro_file_writer_t writer,
 int avro_read_data(avro_reader_t reader,
 		   avro_schema_t writer_schema,
 		   avro_schema_t reader_schema, avro_datum_t * datum);
+
+/*
+ * Reads a value into a datum the caller already has, which must have
+ * the reader schema (or the writer schema if reader_schema is NULL),
+ * instead of allocating a new one.  Reading records one after another
+ * into the same datum costs no allocations beyond those of strings and
+ * bytes.
+ */
+
+int avro_read_data_into(avro_reader_t reader,
+			avro_schema_t writer_schema,
+			avro_schema_t reader_schema, avro_datum_t datum);
+
 int avro_skip_data(avro_reader_t reader, avro_schema_t writer_schema);
 int avro_write_data(avro_writer_t writer,
 		    avro_schema_t writer_schema, avro_datum_t datum);
@@ -152,5 +494,16 @@ int avro_file_writer_append(avro_file_writer_t writer, avro_datum_t datum);
 int avro_file_reader_read(avro_file_reader_t reader,
 			  avro_schema_t readers_schema, avro_datum_t * datum);
 
+/*
+ * With datum reuse on, avro_file_reader_read reads into the datum it
+ * returned last time, instead of a new one, if the caller has released
+ * it by then.  This must be turned on only when the caller keeps no
+ * references into a datum, such as fields it has increfed, once the
+ * datum itself is released.
+ */
+
+int
+avro_file_reader_set_datum_reuse(avro_file_reader_t reader, int enabled);
+
 CLOSE_EXTERN
 #endif
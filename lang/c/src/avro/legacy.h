@@ -228,6 +228,15 @@ avro_datum_reset(avro_datum_t value);
 avro_datum_t avro_datum_incref(avro_datum_t value);
 void avro_datum_decref(avro_datum_t value);
 
+/*
+ * Switches a datum to a reference count that is updated without atomic
+ * instructions.  Only call it on a datum that no other thread can see,
+ * usually straight after creating it, and never share it afterwards.
+ * Only the datum itself changes, not the datums it contains or its
+ * schema.
+ */
+void avro_datum_make_local(avro_datum_t value);
+
 void avro_datum_print(avro_datum_t value, FILE * fp);
 
 int avro_datum_equal(avro_datum_t a, avro_datum_t b);
@@ -53,6 +53,36 @@ avro_refcount_inc(volatile int *refcount);
 static inline int
 avro_refcount_dec(volatile int *refcount);
 
+/**
+ * Sets the value of a reference count that is only ever touched by one
+ * thread.  avro_refcount_inc and avro_refcount_dec then update it
+ * without atomic instructions.
+ */
+
+static inline void
+avro_refcount_set_local(volatile int *refcount, int value);
+
+/**
+ * Returns whether a reference count, local or shared, is 1, so that
+ * its holder has the only reference.
+ */
+
+static inline int
+avro_refcount_is_unique(const volatile int *refcount);
+
+/*
+ * Local counts are tagged with this bit, which a shared count would
+ * need a billion references to reach.  -1 marks an object that is
+ * never freed, and is neither.
+ */
+
+#define AVRO_REFCOUNT_LOCAL  0x40000000
+
+/*
+ * Each platform below provides avro_refcount_atomic_inc and
+ * avro_refcount_atomic_dec for shared counts.
+ */
+
 
 /*-----------------------------------------------------------------------
  * Non-Atomic Reference Count
@@ -65,7 +95,7 @@ avro_refcount_set(volatile int *refcount, int value)
 }
 
 static inline void
-avro_refcount_inc(volatile int *refcount)
+avro_refcount_atomic_inc(volatile int *refcount)
 {
 	if (*refcount != (int) -1) {
 		*refcount += 1;
@@ -73,7 +103,7 @@ avro_refcount_inc(volatile int *refcount)
 }
 
 static inline int
-avro_refcount_dec(volatile int *refcount)
+avro_refcount_atomic_dec(volatile int *refcount)
 {
 	if (*refcount != (int) -1) {
 		*refcount -= 1;
@@ -97,7 +127,7 @@ avro_refcount_set(volatile int *refcount, int value)
 }
 
 static inline void
-avro_refcount_inc(volatile int *refcount)
+avro_refcount_atomic_inc(volatile int *refcount)
 {
 	if (*refcount != (int) -1) {
 		OSAtomicIncrement32(refcount);
@@ -105,7 +135,7 @@ avro_refcount_inc(volatile int *refcount)
 }
 
 static inline int
-avro_refcount_dec(volatile int *refcount)
+avro_refcount_atomic_dec(volatile int *refcount)
 {
 	if (*refcount != (int) -1) {
 		return (OSAtomicDecrement32(refcount) == 0);
@@ -128,7 +158,7 @@ avro_refcount_set(volatile int *refcount, int value)
 }
 
 static inline void
-avro_refcount_inc(volatile int *refcount)
+avro_refcount_atomic_inc(volatile int *refcount)
 {
 	if (*refcount != (int) -1) {
 		__sync_add_and_fetch(refcount, 1);
@@ -136,7 +166,7 @@ avro_refcount_inc(volatile int *refcount)
 }
 
 static inline int
-avro_refcount_dec(volatile int *refcount)
+avro_refcount_atomic_dec(volatile int *refcount)
 {
 	if (*refcount != (int) -1) {
 		return (__sync_sub_and_fetch(refcount, 1) == 0);
@@ -170,7 +200,7 @@ avro_refcount_set(volatile int *refcount, int value)
 }
 
 static inline void
-avro_refcount_inc(volatile int *refcount)
+avro_refcount_atomic_inc(volatile int *refcount)
 {
 	if (*refcount != (int) -1) {
 		__asm__ __volatile__ ("lock ; inc"REFCOUNT_SS" %0"
@@ -180,7 +210,7 @@ avro_refcount_inc(volatile int *refcount)
 }
 
 static inline int
-avro_refcount_dec(volatile int *refcount)
+avro_refcount_atomic_dec(volatile int *refcount)
 {
 	if (*refcount != (int) -1) {
 		char result;
@@ -235,7 +265,7 @@ avro_refcount_set(volatile int *refcount, int value)
 }
 
 static inline void
-avro_refcount_inc(volatile int *refcount)
+avro_refcount_atomic_inc(volatile int *refcount)
 {
 	int prev;
 	do {
@@ -247,7 +277,7 @@ avro_refcount_inc(volatile int *refcount)
 }
 
 static inline int
-avro_refcount_dec(volatile int *refcount)
+avro_refcount_atomic_dec(volatile int *refcount)
 {
 	int prev;
 	do {
@@ -279,7 +309,7 @@ avro_refcount_set(volatile int *refcount, int value)
 }
 
 static inline void
-avro_refcount_inc(volatile int *refcount)
+avro_refcount_atomic_inc(volatile int *refcount)
 {
 	if (*refcount != (int) -1) {
 		_InterlockedIncrement((volatile long *) refcount);
@@ -287,7 +317,7 @@ avro_refcount_inc(volatile int *refcount)
 }
 
 static inline int
-avro_refcount_dec(volatile int *refcount)
+avro_refcount_atomic_dec(volatile int *refcount)
 {
 	if (*refcount != (int) -1) {
 		return (_InterlockedDecrement((volatile long *) refcount) == 0);
@@ -302,5 +332,43 @@ avro_refcount_dec(volatile int *refcount)
 #error "No atomic implementation!"
 #endif
 
+/*-----------------------------------------------------------------------
+ * Local or shared
+ */
+
+static inline void
+avro_refcount_set_local(volatile int *refcount, int value)
+{
+	*refcount = value | AVRO_REFCOUNT_LOCAL;
+}
+
+static inline void
+avro_refcount_inc(volatile int *refcount)
+{
+	int  value = *refcount;
+	if (value != (int) -1 && (value & AVRO_REFCOUNT_LOCAL)) {
+		*refcount = value + 1;
+	} else {
+		avro_refcount_atomic_inc(refcount);
+	}
+}
+
+static inline int
+avro_refcount_dec(volatile int *refcount)
+{
+	int  value = *refcount;
+	if (value != (int) -1 && (value & AVRO_REFCOUNT_LOCAL)) {
+		*refcount = value - 1;
+		return (value - 1 == AVRO_REFCOUNT_LOCAL);
+	}
+	return avro_refcount_atomic_dec(refcount);
+}
+
+static inline int
+avro_refcount_is_unique(const volatile int *refcount)
+{
+	return (*refcount & ~AVRO_REFCOUNT_LOCAL) == 1;
+}
+
 CLOSE_EXTERN
 #endif
@@ -126,5 +126,39 @@ avro_resolved_reader_set_source(avro_value_t *resolved,
 void
 avro_resolved_reader_clear_source(avro_value_t *resolved);
 
+
+/**
+ * Like avro_resolved_reader_new and avro_resolved_writer_new, but the
+ * implementations are kept in a thread-safe cache shared by the whole
+ * process, so that resolving the same pair of schemas again, even if
+ * they were parsed separately, returns the same implementation.  You
+ * get your own reference, to release with avro_value_iface_decref.
+ */
+
+avro_value_iface_t *
+avro_resolved_reader_new_cached(avro_schema_t writer_schema,
+				avro_schema_t reader_schema);
+
+avro_value_iface_t *
+avro_resolved_writer_new_cached(avro_schema_t writer_schema,
+				avro_schema_t reader_schema);
+
+/**
+ * Sets the number of implementations of each kind that the cache keeps,
+ * dropping the least recently used ones past that.  The default is 64,
+ * and zero turns the cache off.
+ */
+
+void
+avro_resolver_cache_set_limit(size_t limit);
+
+/**
+ * Drops every cached implementation.  Implementations still in use stay
+ * alive until their last reference is released.
+ */
+
+void
+avro_resolver_cache_clear(void);
+
 CLOSE_EXTERN
 #endif
@@ -51,6 +51,21 @@ avro_schema_t avro_schema_record_field_get_by_index
 int avro_schema_record_field_append(const avro_schema_t record,
 				    const char *field_name,
 				    const avro_schema_t type);
+
+/*
+ * The order in which the values of a record field sort, as given by the
+ * field's "order" attribute.  Fields are ascending unless set otherwise.
+ */
+typedef enum {
+	AVRO_ORDER_ASCENDING,
+	AVRO_ORDER_DESCENDING,
+	AVRO_ORDER_IGNORE
+} avro_field_order_t;
+
+avro_field_order_t avro_schema_record_field_order(const avro_schema_t record,
+						  int index);
+int avro_schema_record_field_set_order(const avro_schema_t record,
+				       int index, avro_field_order_t order);
 size_t avro_schema_record_size(const avro_schema_t record);
 
 avro_schema_t avro_schema_enum(const char *name);
@@ -112,6 +127,14 @@ const char *avro_schema_type_name(const avro_schema_t schema);
 avro_schema_t avro_schema_copy(avro_schema_t schema);
 int avro_schema_equal(avro_schema_t a, avro_schema_t b);
 
+/*
+ * Returns a hash of a schema that equal schemas share.  Complex schemas
+ * remember theirs until a schema is next changed, so that
+ * avro_schema_equal can tell most unequal schemas apart without
+ * walking them.
+ */
+uint32_t avro_schema_hash(avro_schema_t schema);
+
 avro_schema_t avro_schema_incref(avro_schema_t schema);
 int avro_schema_decref(avro_schema_t schema);
 
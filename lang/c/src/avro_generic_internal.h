@@ -27,6 +27,7 @@ extern "C" {
 #include <sys/types.h>
 
 #include "avro/generic.h"
+#include "avro/io.h"
 #include "avro/schema.h"
 #include "avro/value.h"
 
@@ -58,6 +59,22 @@ typedef struct avro_generic_value_iface {
 	 */
 	void
 	(*done)(const avro_value_iface_t *iface, void *self);
+
+	/**
+	 * Read a value in the binary encoding into an instance that
+	 * has been reset, straight into its memory.
+	 */
+	int
+	(*read)(const avro_value_iface_t *iface, void *self,
+		avro_reader_t reader);
+
+	/**
+	 * Copy an instance of this value type over another, reusing
+	 * the destination's buffers and elements where it can.
+	 */
+	int
+	(*copy)(const avro_value_iface_t *iface, void *dest,
+		const void *src);
 } avro_generic_value_iface_t;
 
 
@@ -67,6 +84,33 @@ typedef struct avro_generic_value_iface {
     ((gcls)->init == NULL? EINVAL: (gcls)->init(&(gcls)->parent, (self)))
 #define avro_value_done(gcls, self) \
     ((gcls)->done == NULL? (void) 0: (gcls)->done(&(gcls)->parent, (self)))
+#define avro_generic_value_read_into(gcls, self, reader) \
+    ((gcls)->read(&(gcls)->parent, (self), (reader)))
+#define avro_generic_value_copy_into(gcls, dest, src) \
+    ((gcls)->copy(&(gcls)->parent, (dest), (src)))
+
+
+/*
+ * avro_value_read hands generic values to avro_generic_value_read,
+ * which reads into them without going through avro_value_iface_t for
+ * each setter, and without allocating for strings and bytes read from
+ * memory once their buffers are large enough.
+ */
+
+int
+avro_value_is_generic(const avro_value_t *value);
+
+int
+avro_generic_value_read(avro_reader_t reader, avro_value_t *dest);
+
+/*
+ * Likewise, avro_value_copy hands two generic values of the same
+ * implementation to avro_generic_value_copy, which copies between
+ * their memory directly.
+ */
+
+int
+avro_generic_value_copy(avro_value_t *dest, const avro_value_t *src);
 
 
 CLOSE_EXTERN
@@ -0,0 +1,80 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to you under the Apache License, Version 2.0 
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ * 
+ * https://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License. 
+ */
+
+#ifndef AVRO_IO_INTERNAL_H
+#define AVRO_IO_INTERNAL_H
+#ifdef __cplusplus
+extern "C" {
+#define CLOSE_EXTERN }
+#else
+#define CLOSE_EXTERN
+#endif
+
+#include <avro/platform.h>
+#include "avro/io.h"
+#include "avro_private.h"
+
+/*
+ * The layout of readers and writers, shared by io.c with the encoders so
+ * that they can work on memory readers directly instead of calling
+ * avro_read() for every few bytes.
+ */
+
+enum avro_io_type_t {
+	AVRO_FILE_IO,
+	AVRO_MEMORY_IO,
+	AVRO_MMAP_IO,		/* a memory reader over a mapped file */
+	AVRO_GROWABLE_IO	/* a memory writer that owns its buffer */
+};
+typedef enum avro_io_type_t avro_io_type_t;
+
+struct avro_reader_t_ {
+	avro_io_type_t type;
+	volatile int  refcount;
+};
+
+struct avro_writer_t_ {
+	avro_io_type_t type;
+	volatile int  refcount;
+};
+
+struct _avro_reader_memory_t {
+	struct avro_reader_t_ reader;
+	const char *buf;
+	int64_t len;
+	int64_t read;
+};
+
+#define avro_io_typeof(obj)      ((obj)->type)
+#define is_memory_io(obj)        (obj && (avro_io_typeof(obj) == AVRO_MEMORY_IO || \
+					  avro_io_typeof(obj) == AVRO_MMAP_IO || \
+					  avro_io_typeof(obj) == AVRO_GROWABLE_IO))
+#define is_mmap_io(obj)          (obj && avro_io_typeof(obj) == AVRO_MMAP_IO)
+#define is_growable_io(obj)      (obj && avro_io_typeof(obj) == AVRO_GROWABLE_IO)
+#define is_file_io(obj)          (obj && avro_io_typeof(obj) == AVRO_FILE_IO)
+
+#define avro_reader_to_memory(reader_)  container_of(reader_, struct _avro_reader_memory_t, reader)
+
+/*
+ * Moves a file or memory reader just past the next occurrence of the len
+ * bytes of marker, or to the end of its input, returning EOF, if there
+ * is none.
+ */
+int avro_reader_skip_past(avro_reader_t reader, const char *marker, size_t len);
+
+CLOSE_EXTERN
+#endif
@@ -24,6 +24,7 @@ extern "C" {
 #endif
 
 #include <errno.h>
+#include <stddef.h>
 
 #include "avro/errors.h"
 #include "avro/platform.h"
@@ -95,5 +96,19 @@ extern "C" {
 #define nullstrcmp(s1, s2) \
     (((s1) && (s2)) ? strcmp(s1, s2) : ((s1) || (s2)))
 
+/*
+ * Allocates from the allocator set with avro_set_allocator, whatever
+ * arena the calling thread has bound.  Memos and caches that outlive
+ * the call that fills them, such as those attached to schemas, come
+ * from here.
+ */
+
+void *avro_backing_realloc(void *ptr, size_t osize, size_t nsize);
+
+#define avro_backing_new(type) \
+    (avro_backing_realloc(NULL, 0, sizeof(type)))
+#define avro_backing_freet(type, ptr) \
+    (avro_backing_realloc((ptr), sizeof(type), 0))
+
 CLOSE_EXTERN
 #endif
@@ -26,6 +26,35 @@
 
 /*-- PROCESSING A FILE --*/
 
+/* The number of threads decoding and formatting blocks, if any. */
+
+static int  nthreads = 0;
+
+/**
+ * Formats the values of a block as JSON, one per line.  Runs on the
+ * reader's worker threads when there are any.
+ */
+
+static int
+format_block(void *user_data, avro_reader_t block_reader,
+	     avro_schema_t wschema, int64_t first, int64_t count,
+	     char **buf, size_t *size, size_t *len)
+{
+	int  rval;
+	int64_t  i;
+
+	AVRO_UNUSED(user_data);
+	AVRO_UNUSED(first);
+
+	for (i = 0; i < count; i++) {
+		check(rval, avro_binary_to_json(block_reader, wschema,
+						buf, size, len));
+		/* There is always room left for the terminator. */
+		(*buf)[(*len)++] = '\n';
+	}
+	return 0;
+}
+
 static void
 process_file(const char *filename)
 {
@@ -57,28 +86,49 @@ process_file(const char *filename)
 		exit(1);
 	}
 
-	avro_schema_t  wschema;
-	avro_value_iface_t  *iface;
-	avro_value_t  value;
+	int rval;
 
-	wschema = avro_file_reader_get_writer_schema(reader);
-	iface = avro_generic_class_from_schema(wschema);
-	avro_generic_value_new(iface, &value);
+	if (nthreads > 0) {
+		/*
+		 * The worker threads turn whole blocks into text, and the
+		 * blocks' text is written here in file order.
+		 */
 
-	int rval;
+		const char  *text;
+		size_t  text_len;
 
-	while ((rval = avro_file_reader_read_value(reader, &value)) == 0) {
-		char  *json;
+		if (avro_file_reader_prefetch_formatted(reader, nthreads,
+							2 * nthreads,
+							format_block, NULL)) {
+			fprintf(stderr, "Error reading %s in parallel:\n  %s\n",
+				filename, avro_strerror());
+			exit(1);
+		}
 
-		if (avro_value_to_json(&value, 1, &json)) {
-			fprintf(stderr, "Error converting value to JSON: %s\n",
-				avro_strerror());
-		} else {
-			printf("%s\n", json);
-			free(json);
+		while ((rval = avro_file_reader_read_formatted(reader, &text,
+							       &text_len)) == 0) {
+			fwrite(text, 1, text_len, stdout);
+		}
+	} else {
+		/*
+		 * Each value is transcoded straight from the file block into
+		 * one reused buffer; no avro_value_t is built along the way.
+		 */
+
+		char  *json = NULL;
+		size_t  json_size = 0;
+		size_t  json_len = 0;
+
+		while ((rval = avro_file_reader_read_json(reader, &json, &json_size,
+							  &json_len)) == 0) {
+			fwrite(json, 1, json_len, stdout);
+			putchar('\n');
+			json_len = 0;
 		}
 
-		avro_value_reset(&value);
+		if (json != NULL) {
+			avro_free(json, json_size);
+		}
 	}
 
 	// If it was not an EOF that caused it to fail,
@@ -88,9 +138,6 @@ process_file(const char *filename)
 	}
 
 	avro_file_reader_close(reader);
-	avro_value_decref(&value);
-	avro_value_iface_decref(iface);
-	avro_schema_decref(wschema);
 
 	if (should_close) {
 		fclose(fp);
@@ -103,7 +150,7 @@ process_file(const char *filename)
 static void usage(void)
 {
 	fprintf(stderr,
-		"Usage: avrocat <avro data file>\n");
+		"Usage: avrocat [-j <threads>] <avro data file>\n");
 }
 
 
@@ -111,6 +158,17 @@ int main(int argc, char **argv)
 {
 	char  *data_filename;
 
+	if (argc >= 3 && strcmp(argv[1], "-j") == 0) {
+		nthreads = atoi(argv[2]);
+		if (nthreads <= 0) {
+			fprintf(stderr, "Invalid number of threads: %s\n", argv[2]);
+			usage();
+			exit(1);
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
 	if (argc == 2) {
 		data_filename = argv[1];
 	} else if (argc == 1) {
@@ -32,6 +32,9 @@ static const char  *codec = "null";
 /* The block size to use. */
 static size_t  block_size = 0;
 
+/* The number of threads recompressing blocks. */
+static int  nthreads = 0;
+
 /*-- PROCESSING A FILE --*/
 
 static void
@@ -70,17 +73,30 @@ process_file(const char *in_filename, const char *out_filename)
 		exit(1);
 	}
 
-	while ((rval = avro_file_reader_read_value(reader, &value)) == 0) {
-		if (avro_file_writer_append_value(writer, &value)) {
-			fprintf(stderr, "Error writing to %s:\n  %s\n",
+	if (block_size == 0) {
+		/*
+		 * The input's blocks are kept, so they are copied whole
+		 * rather than value by value, and only recompressed if the
+		 * codec changes.
+		 */
+		if (avro_file_writer_append_blocks(writer, reader, nthreads)) {
+			fprintf(stderr, "Error copying blocks to %s:\n  %s\n",
 				out_filename, avro_strerror());
 			exit(1);
 		}
-		avro_value_reset(&value);
-	}
+	} else {
+		while ((rval = avro_file_reader_read_value(reader, &value)) == 0) {
+			if (avro_file_writer_append_value(writer, &value)) {
+				fprintf(stderr, "Error writing to %s:\n  %s\n",
+					out_filename, avro_strerror());
+				exit(1);
+			}
+			avro_value_reset(&value);
+		}
 
-	if (rval != EOF) {
-		fprintf(stderr, "Error reading value: %s", avro_strerror());
+		if (rval != EOF) {
+			fprintf(stderr, "Error reading value: %s", avro_strerror());
+		}
 	}
 
 	avro_file_reader_close(reader);
@@ -96,6 +112,7 @@ process_file(const char *in_filename, const char *out_filename)
 static struct option longopts[] = {
 	{ "block-size", required_argument, NULL, 'b' },
 	{ "codec", required_argument, NULL, 'c' },
+	{ "jobs", required_argument, NULL, 'j' },
 	{ NULL, 0, NULL, 0 }
 };
 
@@ -104,6 +121,7 @@ static void usage(void)
 	fprintf(stderr,
 		"Usage: avromod [--codec=<compression codec>]\n"
 		"               [--block-size=<block size>]\n"
+		"               [--jobs=<threads>]\n"
 		"               [<input avro file>]\n"
 		"                <output avro file>\n");
 }
@@ -131,7 +149,7 @@ int main(int argc, char **argv)
 	char  *out_filename;
 
 	int  ch;
-	while ((ch = getopt_long(argc, argv, "b:c:", longopts, NULL)) != -1) {
+	while ((ch = getopt_long(argc, argv, "b:c:j:", longopts, NULL)) != -1) {
 		switch (ch) {
 			case 'b':
 				parse_block_size(optarg);
@@ -141,6 +159,15 @@ int main(int argc, char **argv)
 				codec = optarg;
 				break;
 
+			case 'j':
+				nthreads = atoi(optarg);
+				if (nthreads <= 0) {
+					fprintf(stderr, "Invalid number of threads: %s\n\n", optarg);
+					usage();
+					exit(1);
+				}
+				break;
+
 			default:
 				usage();
 				exit(1);
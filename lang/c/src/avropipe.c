@@ -42,7 +42,7 @@ static const char  *separator = "/";
 static void
 create_array_prefix(avro_raw_string_t *dest, const char *prefix, size_t index)
 {
-	static char  buf[100];
+	char  buf[100];
 	snprintf(buf, sizeof(buf), "%" PRIsz, index);
 	avro_raw_string_set(dest, prefix);
 	avro_raw_string_append(dest, separator);
@@ -72,42 +72,42 @@ create_object_prefix(avro_raw_string_t *dest, const char *prefix, const char *ke
 }
 
 static void
-print_bytes_value(const char *buf, size_t size)
+print_bytes_value(FILE *out, const char *buf, size_t size)
 {
 	size_t  i;
-	printf("\"");
+	fprintf(out, "\"");
 	for (i = 0; i < size; i++)
 	{
 		if (buf[i] == '"') {
-			printf("\\\"");
+			fprintf(out, "\\\"");
 		} else if (buf[i] == '\\') {
-			printf("\\\\");
+			fprintf(out, "\\\\");
 		} else if (buf[i] == '\b') {
-			printf("\\b");
+			fprintf(out, "\\b");
 		} else if (buf[i] == '\f') {
-			printf("\\f");
+			fprintf(out, "\\f");
 		} else if (buf[i] == '\n') {
-			printf("\\n");
+			fprintf(out, "\\n");
 		} else if (buf[i] == '\r') {
-			printf("\\r");
+			fprintf(out, "\\r");
 		} else if (buf[i] == '\t') {
-			printf("\\t");
+			fprintf(out, "\\t");
 		} else if (isprint(buf[i])) {
-			printf("%c", (int) buf[i]);
+			fprintf(out, "%c", (int) buf[i]);
 		} else {
-			printf("\\u00%02x", (unsigned int) (unsigned char) buf[i]);
+			fprintf(out, "\\u00%02x", (unsigned int) (unsigned char) buf[i]);
 		}
 	}
-	printf("\"");
+	fprintf(out, "\"");
 }
 
 static void
-process_value(const char *prefix, avro_value_t *value);
+process_value(FILE *out, const char *prefix, avro_value_t *value);
 
 static void
-process_array(const char *prefix, avro_value_t *value)
+process_array(FILE *out, const char *prefix, avro_value_t *value)
 {
-	printf("%s\t[]\n", prefix);
+	fprintf(out, "%s\t[]\n", prefix);
 	size_t  element_count;
 	avro_value_get_size(value, &element_count);
 
@@ -120,14 +120,14 @@ process_array(const char *prefix, avro_value_t *value)
 		avro_value_get_by_index(value, i, &element_value, NULL);
 
 		create_array_prefix(&element_prefix, prefix, i);
-		process_value((const char *) avro_raw_string_get(&element_prefix), &element_value);
+		process_value(out, (const char *) avro_raw_string_get(&element_prefix), &element_value);
 	}
 
 	avro_raw_string_done(&element_prefix);
 }
 
 static void
-process_enum(const char *prefix, avro_value_t *value)
+process_enum(FILE *out, const char *prefix, avro_value_t *value)
 {
 	int  val;
 	const char  *symbol_name;
@@ -135,15 +135,15 @@ process_enum(const char *prefix, avro_value_t *value)
 	avro_schema_t  schema = avro_value_get_schema(value);
 	avro_value_get_enum(value, &val);
 	symbol_name = avro_schema_enum_get(schema, val);
-	printf("%s\t", prefix);
-	print_bytes_value(symbol_name, strlen(symbol_name));
-	printf("\n");
+	fprintf(out, "%s\t", prefix);
+	print_bytes_value(out, symbol_name, strlen(symbol_name));
+	fprintf(out, "\n");
 }
 
 static void
-process_map(const char *prefix, avro_value_t *value)
+process_map(FILE *out, const char *prefix, avro_value_t *value)
 {
-	printf("%s\t{}\n", prefix);
+	fprintf(out, "%s\t{}\n", prefix);
 	size_t  element_count;
 	avro_value_get_size(value, &element_count);
 
@@ -157,16 +157,16 @@ process_map(const char *prefix, avro_value_t *value)
 		avro_value_get_by_index(value, i, &element_value, &key);
 
 		create_object_prefix(&element_prefix, prefix, key);
-		process_value((const char *) avro_raw_string_get(&element_prefix), &element_value);
+		process_value(out, (const char *) avro_raw_string_get(&element_prefix), &element_value);
 	}
 
 	avro_raw_string_done(&element_prefix);
 }
 
 static void
-process_record(const char *prefix, avro_value_t *value)
+process_record(FILE *out, const char *prefix, avro_value_t *value)
 {
-	printf("%s\t{}\n", prefix);
+	fprintf(out, "%s\t{}\n", prefix);
 	size_t  field_count;
 	avro_value_get_size(value, &field_count);
 
@@ -180,21 +180,21 @@ process_record(const char *prefix, avro_value_t *value)
 		avro_value_get_by_index(value, i, &field_value, &field_name);
 
 		create_object_prefix(&field_prefix, prefix, field_name);
-		process_value((const char *) avro_raw_string_get(&field_prefix), &field_value);
+		process_value(out, (const char *) avro_raw_string_get(&field_prefix), &field_value);
 	}
 
 	avro_raw_string_done(&field_prefix);
 }
 
 static void
-process_union(const char *prefix, avro_value_t *value)
+process_union(FILE *out, const char *prefix, avro_value_t *value)
 {
 	avro_value_t  branch_value;
 	avro_value_get_current_branch(value, &branch_value);
 
 	/* nulls in a union aren't wrapped in a JSON object */
 	if (avro_value_get_type(&branch_value) == AVRO_NULL) {
-		printf("%s\tnull\n", prefix);
+		fprintf(out, "%s\tnull\n", prefix);
 		return;
 	}
 
@@ -209,14 +209,14 @@ process_union(const char *prefix, avro_value_t *value)
 	avro_raw_string_init(&branch_prefix);
 	create_object_prefix(&branch_prefix, prefix, branch_name);
 
-	printf("%s\t{}\n", prefix);
-	process_value((const char *) avro_raw_string_get(&branch_prefix), &branch_value);
+	fprintf(out, "%s\t{}\n", prefix);
+	process_value(out, (const char *) avro_raw_string_get(&branch_prefix), &branch_value);
 
 	avro_raw_string_done(&branch_prefix);
 }
 
 static void
-process_value(const char *prefix, avro_value_t *value)
+process_value(FILE *out, const char *prefix, avro_value_t *value)
 {
 	avro_type_t  type = avro_value_get_type(value);
 	switch (type) {
@@ -224,7 +224,7 @@ process_value(const char *prefix, avro_value_t *value)
 		{
 			int  val;
 			avro_value_get_boolean(value, &val);
-			printf("%s\t%s\n", prefix, val? "true": "false");
+			fprintf(out, "%s\t%s\n", prefix, val? "true": "false");
 			return;
 		}
 
@@ -233,9 +233,9 @@ process_value(const char *prefix, avro_value_t *value)
 			const void  *buf;
 			size_t  size;
 			avro_value_get_bytes(value, &buf, &size);
-			printf("%s\t", prefix);
-			print_bytes_value((const char *) buf, size);
-			printf("\n");
+			fprintf(out, "%s\t", prefix);
+			print_bytes_value(out, (const char *) buf, size);
+			fprintf(out, "\n");
 			return;
 		}
 
@@ -243,7 +243,7 @@ process_value(const char *prefix, avro_value_t *value)
 		{
 			double  val;
 			avro_value_get_double(value, &val);
-			printf("%s\t%lf\n", prefix, val);
+			fprintf(out, "%s\t%lf\n", prefix, val);
 			return;
 		}
 
@@ -251,7 +251,7 @@ process_value(const char *prefix, avro_value_t *value)
 		{
 			float  val;
 			avro_value_get_float(value, &val);
-			printf("%s\t%f\n", prefix, val);
+			fprintf(out, "%s\t%f\n", prefix, val);
 			return;
 		}
 
@@ -259,7 +259,7 @@ process_value(const char *prefix, avro_value_t *value)
 		{
 			int32_t  val;
 			avro_value_get_int(value, &val);
-			printf("%s\t%" PRId32 "\n", prefix, val);
+			fprintf(out, "%s\t%" PRId32 "\n", prefix, val);
 			return;
 		}
 
@@ -267,14 +267,14 @@ process_value(const char *prefix, avro_value_t *value)
 		{
 			int64_t  val;
 			avro_value_get_long(value, &val);
-			printf("%s\t%" PRId64 "\n", prefix, val);
+			fprintf(out, "%s\t%" PRId64 "\n", prefix, val);
 			return;
 		}
 
 		case AVRO_NULL:
 		{
 			avro_value_get_null(value);
-			printf("%s\tnull\n", prefix);
+			fprintf(out, "%s\tnull\n", prefix);
 			return;
 		}
 
@@ -285,19 +285,19 @@ process_value(const char *prefix, avro_value_t *value)
 			const char  *buf;
 			size_t  size;
 			avro_value_get_string(value, &buf, &size);
-			printf("%s\t", prefix);
+			fprintf(out, "%s\t", prefix);
                         /* For strings, size includes the NUL terminator. */
-			print_bytes_value(buf, size-1);
-			printf("\n");
+			print_bytes_value(out, buf, size-1);
+			fprintf(out, "\n");
 			return;
 		}
 
 		case AVRO_ARRAY:
-			process_array(prefix, value);
+			process_array(out, prefix, value);
 			return;
 
 		case AVRO_ENUM:
-			process_enum(prefix, value);
+			process_enum(out, prefix, value);
 			return;
 
 		case AVRO_FIXED:
@@ -305,22 +305,22 @@ process_value(const char *prefix, avro_value_t *value)
 			const void  *buf;
 			size_t  size;
 			avro_value_get_fixed(value, &buf, &size);
-			printf("%s\t", prefix);
-			print_bytes_value((const char *) buf, size);
-			printf("\n");
+			fprintf(out, "%s\t", prefix);
+			print_bytes_value(out, (const char *) buf, size);
+			fprintf(out, "\n");
 			return;
 		}
 
 		case AVRO_MAP:
-			process_map(prefix, value);
+			process_map(out, prefix, value);
 			return;
 
 		case AVRO_RECORD:
-			process_record(prefix, value);
+			process_record(out, prefix, value);
 			return;
 
 		case AVRO_UNION:
-			process_union(prefix, value);
+			process_union(out, prefix, value);
 			return;
 
 		default:
@@ -331,8 +331,69 @@ process_value(const char *prefix, avro_value_t *value)
 	}
 }
 
+/**
+ * Formats the values of a block, numbered from first, into the text of
+ * the block.  Runs on the reader's worker threads.
+ */
+
+static int
+format_block(void *user_data, avro_reader_t block_reader,
+	     avro_schema_t wschema, int64_t first, int64_t count,
+	     char **buf, size_t *size, size_t *len)
+{
+	int  rval = 0;
+	int64_t  i;
+	avro_value_iface_t  *iface = (avro_value_iface_t *) user_data;
+	avro_value_t  value;
+	avro_raw_string_t  prefix;
+	char  *text = NULL;
+	size_t  text_len = 0;
+	FILE  *out;
+
+	AVRO_UNUSED(wschema);
+
+	out = open_memstream(&text, &text_len);
+	if (out == NULL) {
+		avro_set_error("Cannot open block text stream");
+		return ENOMEM;
+	}
+
+	avro_raw_string_init(&prefix);
+	avro_generic_value_new(iface, &value);
+	for (i = 0; i < count; i++) {
+		rval = avro_value_read(block_reader, &value);
+		if (rval) {
+			break;
+		}
+		create_array_prefix(&prefix, "", first + i);
+		process_value(out, (const char *) avro_raw_string_get(&prefix), &value);
+		avro_value_reset(&value);
+	}
+	avro_value_decref(&value);
+	avro_raw_string_done(&prefix);
+	fclose(out);
+
+	/* The values read before any error are kept. */
+	if (*len + text_len >= *size) {
+		size_t  new_size = *len + text_len + 1;
+		char  *new_buf = (char *) avro_realloc(*buf, *size, new_size);
+		if (new_buf == NULL) {
+			free(text);
+			avro_set_error("Cannot allocate block text");
+			return ENOMEM;
+		}
+		*buf = new_buf;
+		*size = new_size;
+	}
+	memcpy(*buf + *len, text, text_len);
+	*len += text_len;
+	(*buf)[*len] = '\0';
+	free(text);
+	return rval;
+}
+
 static void
-process_file(const char *filename)
+process_file(const char *filename, int nthreads)
 {
 	avro_file_reader_t  reader;
 
@@ -353,31 +414,56 @@ process_file(const char *filename)
 	/* The JSON root is an array */
 	printf("%s\t[]\n", separator);
 
-	avro_raw_string_t  prefix;
-	avro_raw_string_init(&prefix);
-
 	avro_schema_t  wschema = avro_file_reader_get_writer_schema(reader);
 	avro_value_iface_t  *iface = avro_generic_class_from_schema(wschema);
-	avro_value_t  value;
-	avro_generic_value_new(iface, &value);
-
-	size_t  record_number = 0;
 	int rval;
 
-	for (; (rval = avro_file_reader_read_value(reader, &value)) == 0; record_number++) {
-		create_array_prefix(&prefix, "", record_number);
-		process_value((const char *) avro_raw_string_get(&prefix), &value);
-		avro_value_reset(&value);
+	if (nthreads > 0) {
+		/*
+		 * The worker threads format whole blocks, and the blocks'
+		 * text is written here in file order.
+		 */
+
+		const char  *text;
+		size_t  text_len;
+
+		if (avro_file_reader_prefetch_formatted(reader, nthreads,
+							2 * nthreads,
+							format_block, iface)) {
+			fprintf(stderr, "Error reading in parallel:\n  %s\n",
+				avro_strerror());
+			exit(1);
+		}
+
+		while ((rval = avro_file_reader_read_formatted(reader, &text,
+							       &text_len)) == 0) {
+			fwrite(text, 1, text_len, stdout);
+		}
+	} else {
+		avro_raw_string_t  prefix;
+		avro_raw_string_init(&prefix);
+
+		avro_value_t  value;
+		avro_generic_value_new(iface, &value);
+
+		size_t  record_number = 0;
+
+		for (; (rval = avro_file_reader_read_value(reader, &value)) == 0; record_number++) {
+			create_array_prefix(&prefix, "", record_number);
+			process_value(stdout, (const char *) avro_raw_string_get(&prefix), &value);
+			avro_value_reset(&value);
+		}
+
+		avro_raw_string_done(&prefix);
+		avro_value_decref(&value);
 	}
 
 	if (rval != EOF) {
 		fprintf(stderr, "Error reading value: %s", avro_strerror());
 	}
 
-	avro_raw_string_done(&prefix);
-	avro_value_decref(&value);
-	avro_value_iface_decref(iface);
 	avro_file_reader_close(reader);
+	avro_value_iface_decref(iface);
 	avro_schema_decref(wschema);
 }
 
@@ -385,13 +471,14 @@ process_file(const char *filename)
 /*-- MAIN PROGRAM --*/
 static struct option longopts[] = {
 	{ "separator", required_argument, NULL, 's' },
+	{ "jobs", required_argument, NULL, 'j' },
 	{ NULL, 0, NULL, 0 }
 };
 
 static void usage(void)
 {
 	fprintf(stderr,
-		"Usage: avropipe [--separator=<separator>]\n"
+		"Usage: avropipe [--separator=<separator>] [--jobs=<threads>]\n"
 		"                <avro data file>\n");
 }
 
@@ -399,14 +486,24 @@ static void usage(void)
 int main(int argc, char **argv)
 {
 	char  *data_filename;
+	int  nthreads = 0;
 
 	int  ch;
-	while ((ch = getopt_long(argc, argv, "s:", longopts, NULL) ) != -1) {
+	while ((ch = getopt_long(argc, argv, "s:j:", longopts, NULL) ) != -1) {
 		switch (ch) {
 			case 's':
 				separator = optarg;
 				break;
 
+			case 'j':
+				nthreads = atoi(optarg);
+				if (nthreads <= 0) {
+					fprintf(stderr, "Invalid number of threads: %s\n", optarg);
+					usage();
+					exit(1);
+				}
+				break;
+
 			default:
 				usage();
 				exit(1);
@@ -427,6 +524,6 @@ int main(int argc, char **argv)
 	}
 
 	/* Process the data file */
-	process_file(data_filename);
+	process_file(data_filename, nthreads);
 	return 0;
 }
@@ -0,0 +1,409 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to you under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ * https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <avro/platform.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "avro/errors.h"
+#include "avro/io.h"
+#include "avro/schema.h"
+#include "avro_private.h"
+#include "schema.h"
+#include "st.h"
+
+/*
+ * Compares binary encoded values in the sort order of the Avro
+ * specification, walking the two encodings side by side with the
+ * schema and stopping at the first difference.  No value is decoded
+ * beyond the longs and floating point numbers being compared.
+ */
+
+struct cursor {
+	const uint8_t  *p;
+	const uint8_t  *end;
+};
+
+static int
+need(struct cursor *c, int64_t len)
+{
+	if (len < 0 || (uint64_t) len > (uint64_t) (c->end - c->p)) {
+		avro_set_error("Binary data ends before its value");
+		return EINVAL;
+	}
+	return 0;
+}
+
+static int
+read_long(struct cursor *c, int64_t *l)
+{
+	uint64_t  value = 0;
+	int  offset = 0;
+	uint8_t  b;
+
+	do {
+		if (offset == 10) {
+			avro_set_error("Varint too long");
+			return EILSEQ;
+		}
+		if (c->p == c->end) {
+			avro_set_error("Binary data ends before its value");
+			return EINVAL;
+		}
+		b = *c->p++;
+		value |= (uint64_t) (b & 0x7F) << (7 * offset);
+		++offset;
+	} while (b & 0x80);
+	*l = ((value >> 1) ^ -(value & 1));
+	return 0;
+}
+
+static int
+read_length(struct cursor *c, int64_t *len)
+{
+	int  rval;
+	check(rval, read_long(c, len));
+	return need(c, *len);
+}
+
+/*
+ * Reads the item count of a block of an array or map, skipping the
+ * size in bytes that comes with a negative count.
+ */
+
+static int
+read_block_count(struct cursor *c, int64_t *count)
+{
+	int  rval;
+	int64_t  size;
+
+	check(rval, read_long(c, count));
+	if (*count < 0) {
+		if (*count == INT64_MIN) {
+			avro_set_error("Invalid block count");
+			return EINVAL;
+		}
+		*count = -*count;
+		check(rval, read_long(c, &size));
+	}
+	return 0;
+}
+
+static int
+read_branch(struct cursor *c, avro_schema_t schema, avro_schema_t *branch,
+	    int64_t *index)
+{
+	int  rval;
+	union {
+		st_data_t data;
+		avro_schema_t schema;
+	} val;
+
+	check(rval, read_long(c, index));
+	if (!st_lookup(avro_schema_to_union(schema)->branches, *index,
+		       &val.data)) {
+		avro_set_error("Union branch %" PRId64 " out of range", *index);
+		return EINVAL;
+	}
+	*branch = val.schema;
+	return 0;
+}
+
+static int
+skip(struct cursor *c, avro_schema_t schema)
+{
+	int  rval;
+	int64_t  l;
+	long  i;
+
+	switch (avro_typeof(schema)) {
+	case AVRO_NULL:
+		return 0;
+
+	case AVRO_BOOLEAN:
+		l = 1;
+		break;
+
+	case AVRO_INT32:
+	case AVRO_INT64:
+	case AVRO_ENUM:
+		return read_long(c, &l);
+
+	case AVRO_FLOAT:
+		l = sizeof(float);
+		break;
+
+	case AVRO_DOUBLE:
+		l = sizeof(double);
+		break;
+
+	case AVRO_STRING:
+	case AVRO_BYTES:
+		check(rval, read_length(c, &l));
+		break;
+
+	case AVRO_FIXED:
+		l = avro_schema_to_fixed(schema)->size;
+		break;
+
+	case AVRO_RECORD:
+		for (i = 0; i < avro_schema_to_record(schema)->fields->num_entries; i++) {
+			check(rval, skip(c, avro_schema_record_field_get_by_index(schema, i)));
+		}
+		return 0;
+
+	case AVRO_UNION:
+		{
+			avro_schema_t  branch;
+			check(rval, read_branch(c, schema, &branch, &l));
+			return skip(c, branch);
+		}
+
+	case AVRO_ARRAY:
+	case AVRO_MAP:
+		{
+			int  is_map = is_avro_map(schema);
+			avro_schema_t  items = is_map
+			    ? avro_schema_to_map(schema)->values
+			    : avro_schema_to_array(schema)->items;
+			int64_t  count;
+			int64_t  key_len;
+
+			check(rval, read_block_count(c, &count));
+			while (count != 0) {
+				for (; count != 0; count--) {
+					if (is_map) {
+						check(rval, read_length(c, &key_len));
+						c->p += key_len;
+					}
+					check(rval, skip(c, items));
+				}
+				check(rval, read_block_count(c, &count));
+			}
+			return 0;
+		}
+
+	case AVRO_LINK:
+		return skip(c, avro_schema_to_link(schema)->to);
+
+	default:
+		avro_set_error("Unknown schema type");
+		return EINVAL;
+	}
+
+	check(rval, need(c, l));
+	c->p += l;
+	return 0;
+}
+
+static int
+compare_longs(int64_t a, int64_t b)
+{
+	return (a > b) - (a < b);
+}
+
+static int
+compare_bytes(struct cursor *a, struct cursor *b, int64_t a_len,
+	      int64_t b_len, int *result)
+{
+	int  rval;
+	int  cmp;
+
+	check(rval, need(a, a_len));
+	check(rval, need(b, b_len));
+	cmp = memcmp(a->p, b->p, a_len < b_len ? a_len : b_len);
+	*result = cmp != 0 ? (cmp > 0) - (cmp < 0) : compare_longs(a_len, b_len);
+	a->p += a_len;
+	b->p += b_len;
+	return 0;
+}
+
+/*
+ * Floating point numbers sort as Java's Float.compare and
+ * Double.compare have them: -0.0 before 0.0, and NaN after everything
+ * else.  When neither number is less than the other, the bits tell
+ * them apart, with every NaN taken to be the greatest.
+ */
+
+#define COMPARE_FLOATING(ftype, itype, imax) \
+	{ \
+		ftype  x, y; \
+		itype  i, j; \
+		check(rval, need(a, sizeof(ftype))); \
+		check(rval, need(b, sizeof(ftype))); \
+		memcpy(&x, a->p, sizeof(ftype)); \
+		memcpy(&y, b->p, sizeof(ftype)); \
+		memcpy(&i, a->p, sizeof(ftype)); \
+		memcpy(&j, b->p, sizeof(ftype)); \
+		a->p += sizeof(ftype); \
+		b->p += sizeof(ftype); \
+		if (x < y) { \
+			*result = -1; \
+		} else if (y < x) { \
+			*result = 1; \
+		} else { \
+			*result = compare_longs(x != x ? imax : i, \
+						y != y ? imax : j); \
+		} \
+		return 0; \
+	}
+
+static int
+compare(struct cursor *a, struct cursor *b, avro_schema_t schema,
+	int *result)
+{
+	int  rval;
+	int64_t  i, j;
+
+	switch (avro_typeof(schema)) {
+	case AVRO_NULL:
+		*result = 0;
+		return 0;
+
+	case AVRO_BOOLEAN:
+		check(rval, need(a, 1));
+		check(rval, need(b, 1));
+		*result = compare_longs(*a->p++, *b->p++);
+		return 0;
+
+	case AVRO_INT32:
+	case AVRO_INT64:
+	case AVRO_ENUM:
+		check(rval, read_long(a, &i));
+		check(rval, read_long(b, &j));
+		*result = compare_longs(i, j);
+		return 0;
+
+	case AVRO_FLOAT:
+		COMPARE_FLOATING(float, int32_t, INT32_MAX)
+
+	case AVRO_DOUBLE:
+		COMPARE_FLOATING(double, int64_t, INT64_MAX)
+
+	case AVRO_STRING:
+	case AVRO_BYTES:
+		check(rval, read_long(a, &i));
+		check(rval, read_long(b, &j));
+		return compare_bytes(a, b, i, j, result);
+
+	case AVRO_FIXED:
+		i = avro_schema_to_fixed(schema)->size;
+		return compare_bytes(a, b, i, i, result);
+
+	case AVRO_RECORD:
+		{
+			struct avro_record_schema_t  *record =
+			    avro_schema_to_record(schema);
+			long  f;
+
+			*result = 0;
+			for (f = 0; f < record->fields->num_entries; f++) {
+				union {
+					st_data_t data;
+					struct avro_record_field_t *field;
+				} val;
+				st_lookup(record->fields, f, &val.data);
+				switch (val.field->order) {
+				case AVRO_ORDER_DESCENDING:
+					check(rval, compare(b, a, val.field->type, result));
+					break;
+				case AVRO_ORDER_IGNORE:
+					check(rval, skip(a, val.field->type));
+					check(rval, skip(b, val.field->type));
+					break;
+				default:
+					check(rval, compare(a, b, val.field->type, result));
+					break;
+				}
+				if (*result != 0) {
+					return 0;
+				}
+			}
+			return 0;
+		}
+
+	case AVRO_UNION:
+		{
+			avro_schema_t  a_branch;
+			avro_schema_t  b_branch;
+			check(rval, read_branch(a, schema, &a_branch, &i));
+			check(rval, read_branch(b, schema, &b_branch, &j));
+			if (i != j) {
+				*result = compare_longs(i, j);
+				return 0;
+			}
+			return compare(a, b, a_branch, result);
+		}
+
+	case AVRO_ARRAY:
+		{
+			avro_schema_t  items = avro_schema_to_array(schema)->items;
+			i = 0;
+			j = 0;
+			for (;;) {
+				if (i == 0) {
+					check(rval, read_block_count(a, &i));
+				}
+				if (j == 0) {
+					check(rval, read_block_count(b, &j));
+				}
+				if (i == 0 || j == 0) {
+					*result = compare_longs(i != 0, j != 0);
+					return 0;
+				}
+				check(rval, compare(a, b, items, result));
+				if (*result != 0) {
+					return 0;
+				}
+				i--;
+				j--;
+			}
+		}
+
+	case AVRO_MAP:
+		avro_set_error("Maps cannot be compared");
+		return EINVAL;
+
+	case AVRO_LINK:
+		return compare(a, b, avro_schema_to_link(schema)->to, result);
+
+	default:
+		avro_set_error("Unknown schema type");
+		return EINVAL;
+	}
+}
+
+int
+avro_binary_compare(avro_schema_t writers_schema,
+		    const void *a, size_t a_len,
+		    const void *b, size_t b_len, int *result)
+{
+	struct cursor  ca;
+	struct cursor  cb;
+
+	check_param(EINVAL, is_avro_schema(writers_schema), "writer schema");
+	check_param(EINVAL, a || a_len == 0, "first buffer");
+	check_param(EINVAL, b || b_len == 0, "second buffer");
+	check_param(EINVAL, result, "result");
+
+	ca.p = (const uint8_t *) a;
+	ca.end = ca.p + a_len;
+	cb.p = (const uint8_t *) b;
+	cb.end = cb.p + b_len;
+	return compare(&ca, &cb, writers_schema, result);
+}
@@ -0,0 +1,169 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to you under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ * https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <avro/platform.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "avro/errors.h"
+#include "avro/io.h"
+#include "avro/schema.h"
+#include "avro_io_internal.h"
+#include "avro_private.h"
+
+/*
+ * Hashes the binary encoding of values, as the bytes lie in a memory
+ * reader, rather than walking the values.  The hash is wyhash (final
+ * version 4) [1], which is public domain, with its default secret.  It
+ * reads the input as little-endian words whatever the platform, so a
+ * hash is the same everywhere, and the same as the C++ library's
+ * avro::hash64.
+ *
+ * [1] https://github.com/wangyi-fudan/wyhash
+ */
+
+static const uint64_t  wyp[4] = {
+	UINT64_C(0x2d358dccaa6c78a5), UINT64_C(0x8bb84b93962eacc9),
+	UINT64_C(0x4b33a62ed433d4a3), UINT64_C(0x4d5a2da51de1aa47)
+};
+
+static inline void
+wymum(uint64_t *a, uint64_t *b)
+{
+#if defined(__SIZEOF_INT128__)
+	__uint128_t  r = (__uint128_t) *a * *b;
+	*a = (uint64_t) r;
+	*b = (uint64_t) (r >> 64);
+#else
+	uint64_t  ha = *a >> 32, hb = *b >> 32;
+	uint64_t  la = (uint32_t) *a, lb = (uint32_t) *b;
+	uint64_t  rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t  t = rl + (rm0 << 32);
+	uint64_t  c = t < rl;
+	uint64_t  lo = t + (rm1 << 32);
+	c += lo < t;
+	*a = lo;
+	*b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t
+wymix(uint64_t a, uint64_t b)
+{
+	wymum(&a, &b);
+	return a ^ b;
+}
+
+static inline uint64_t
+wyr8(const uint8_t *p)
+{
+	return (uint64_t) p[0] | ((uint64_t) p[1] << 8) |
+	    ((uint64_t) p[2] << 16) | ((uint64_t) p[3] << 24) |
+	    ((uint64_t) p[4] << 32) | ((uint64_t) p[5] << 40) |
+	    ((uint64_t) p[6] << 48) | ((uint64_t) p[7] << 56);
+}
+
+static inline uint64_t
+wyr4(const uint8_t *p)
+{
+	return (uint64_t) p[0] | ((uint64_t) p[1] << 8) |
+	    ((uint64_t) p[2] << 16) | ((uint64_t) p[3] << 24);
+}
+
+static inline uint64_t
+wyr3(const uint8_t *p, size_t k)
+{
+	return ((uint64_t) p[0] << 16) | ((uint64_t) p[k >> 1] << 8) | p[k - 1];
+}
+
+uint64_t
+avro_hash_bytes(const void *buf, size_t len, uint64_t seed)
+{
+	const uint8_t  *p = (const uint8_t *) buf;
+	uint64_t  a;
+	uint64_t  b;
+
+	seed ^= wymix(seed ^ wyp[0], wyp[1]);
+	if (len <= 16) {
+		if (len >= 4) {
+			a = (wyr4(p) << 32) | wyr4(p + ((len >> 3) << 2));
+			b = (wyr4(p + len - 4) << 32) |
+			    wyr4(p + len - 4 - ((len >> 3) << 2));
+		} else if (len > 0) {
+			a = wyr3(p, len);
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		size_t  i = len;
+		if (i > 48) {
+			uint64_t  see1 = seed;
+			uint64_t  see2 = seed;
+			do {
+				seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+				see1 = wymix(wyr8(p + 16) ^ wyp[2], wyr8(p + 24) ^ see1);
+				see2 = wymix(wyr8(p + 32) ^ wyp[3], wyr8(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+		while (i > 16) {
+			seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+		a = wyr8(p + i - 16);
+		b = wyr8(p + i - 8);
+	}
+
+	a ^= wyp[1];
+	b ^= seed;
+	wymum(&a, &b);
+	return wymix(a ^ wyp[0] ^ len, b ^ wyp[1]);
+}
+
+int
+avro_binary_hash(avro_reader_t reader, avro_schema_t writers_schema,
+		 uint64_t seed, uint64_t *hash)
+{
+	return avro_binary_hash_batch(reader, writers_schema, seed, hash, 1);
+}
+
+int
+avro_binary_hash_batch(avro_reader_t reader, avro_schema_t writers_schema,
+		       uint64_t seed, uint64_t *hashes, size_t count)
+{
+	int  rval;
+	size_t  i;
+	struct _avro_reader_memory_t  *mem;
+
+	check_param(EINVAL, is_memory_io(reader), "memory reader");
+	check_param(EINVAL, is_avro_schema(writers_schema), "writer schema");
+	check_param(EINVAL, hashes || count == 0, "hashes");
+
+	mem = avro_reader_to_memory(reader);
+	for (i = 0; i < count; i++) {
+		int64_t  start = mem->read;
+		check(rval, avro_skip_data(reader, writers_schema));
+		hashes[i] = avro_hash_bytes(mem->buf + start,
+					    mem->read - start, seed);
+	}
+	return 0;
+}
@@ -0,0 +1,614 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to you under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ * https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <avro/platform.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "avro/allocation.h"
+#include "avro/errors.h"
+#include "avro/io.h"
+#include "avro/schema.h"
+#include "avro_io_internal.h"
+#include "avro_private.h"
+#include "encoding.h"
+#include "schema.h"
+
+/*
+ * Transcodes the binary encoding of a value straight into JSON text,
+ * walking the schema as it goes.  No avro_value_t or jansson tree is
+ * built; the text is the one avro_value_to_json produces with one_line
+ * set: jansson's separators, its formatting of reals, and every
+ * character outside ASCII escaped.  Bytes and fixed values are written
+ * as strings of the characters U+0000..U+00FF, as encode_utf8_bytes
+ * maps them.
+ */
+
+struct json_out {
+	char  **buf;
+	size_t  *size;
+	size_t  len;
+};
+
+static int
+json_reserve(struct json_out *out, size_t extra)
+{
+	/* Leave room for the NUL terminator too. */
+	size_t  needed = out->len + extra + 1;
+	if (needed <= *out->size) {
+		return 0;
+	}
+
+	size_t  new_size = *out->size < 256? 256: *out->size;
+	while (new_size < needed) {
+		new_size *= 2;
+	}
+	char  *new_buf = (char *) avro_realloc(*out->buf, *out->size, new_size);
+	if (new_buf == NULL) {
+		avro_set_error("Cannot allocate JSON buffer");
+		return ENOMEM;
+	}
+	*out->buf = new_buf;
+	*out->size = new_size;
+	return 0;
+}
+
+static int
+json_append(struct json_out *out, const char *src, size_t len)
+{
+	int  rval;
+	check(rval, json_reserve(out, len));
+	memcpy(*out->buf + out->len, src, len);
+	out->len += len;
+	return 0;
+}
+
+#define json_append_literal(out, lit) \
+	json_append((out), (lit), sizeof(lit) - 1)
+
+/*
+ * Writes a code point the way jansson does with JSON_ENSURE_ASCII.
+ */
+
+static int
+json_append_code_point(struct json_out *out, uint32_t cp)
+{
+	char  seq[13];
+	int  len;
+
+	switch (cp) {
+		case '\\': return json_append_literal(out, "\\\\");
+		case '"':  return json_append_literal(out, "\\\"");
+		case '\b': return json_append_literal(out, "\\b");
+		case '\f': return json_append_literal(out, "\\f");
+		case '\n': return json_append_literal(out, "\\n");
+		case '\r': return json_append_literal(out, "\\r");
+		case '\t': return json_append_literal(out, "\\t");
+	}
+
+	if (cp < 0x20 || (cp > 0x7f && cp < 0x10000)) {
+		len = snprintf(seq, sizeof(seq), "\\u%04X", (unsigned) cp);
+	} else if (cp >= 0x10000) {
+		cp -= 0x10000;
+		len = snprintf(seq, sizeof(seq), "\\u%04X\\u%04X",
+			       (unsigned) (0xD800 | ((cp & 0xffc00) >> 10)),
+			       (unsigned) (0xDC00 | (cp & 0x003ff)));
+	} else {
+		seq[0] = (char) cp;
+		len = 1;
+	}
+	return json_append(out, seq, len);
+}
+
+/*
+ * Returns how many of the leading characters of src are plain ASCII,
+ * which need no escaping and can be copied in one go.
+ */
+
+static size_t
+plain_ascii_prefix(const uint8_t *src, size_t len)
+{
+	size_t  i;
+	for (i = 0; i < len; i++) {
+		if (src[i] < 0x20 || src[i] > 0x7f ||
+		    src[i] == '"' || src[i] == '\\') {
+			break;
+		}
+	}
+	return i;
+}
+
+static int
+json_append_utf8(struct json_out *out, const uint8_t *src, size_t len)
+{
+	int  rval;
+	size_t  i = 0;
+
+	check(rval, json_append_literal(out, "\""));
+	while (i < len) {
+		size_t  plain = plain_ascii_prefix(src + i, len - i);
+		if (plain > 0) {
+			check(rval, json_append(out, (const char *) src + i, plain));
+			i += plain;
+			continue;
+		}
+
+		uint32_t  cp = src[i];
+		size_t  extra;
+		if (cp < 0x80) {
+			extra = 0;
+		} else if ((cp & 0xe0) == 0xc0 && cp >= 0xc2) {
+			cp &= 0x1f;
+			extra = 1;
+		} else if ((cp & 0xf0) == 0xe0) {
+			cp &= 0x0f;
+			extra = 2;
+		} else if ((cp & 0xf8) == 0xf0 && cp <= 0xf4) {
+			cp &= 0x07;
+			extra = 3;
+		} else {
+			avro_set_error("Invalid UTF-8 in string");
+			return EINVAL;
+		}
+		if (extra > len - i - 1) {
+			avro_set_error("Invalid UTF-8 in string");
+			return EINVAL;
+		}
+
+		size_t  j;
+		for (j = 1; j <= extra; j++) {
+			if ((src[i + j] & 0xc0) != 0x80) {
+				avro_set_error("Invalid UTF-8 in string");
+				return EINVAL;
+			}
+			cp = (cp << 6) | (src[i + j] & 0x3f);
+		}
+		/* Overlong forms, surrogates and values past U+10FFFF */
+		if ((extra == 2 && cp < 0x800) ||
+		    (extra == 3 && cp < 0x10000) ||
+		    (cp >= 0xd800 && cp <= 0xdfff) || cp > 0x10ffff) {
+			avro_set_error("Invalid UTF-8 in string");
+			return EINVAL;
+		}
+
+		check(rval, json_append_code_point(out, cp));
+		i += extra + 1;
+	}
+	return json_append_literal(out, "\"");
+}
+
+static int
+json_append_latin1(struct json_out *out, const uint8_t *src, size_t len)
+{
+	int  rval;
+	size_t  i = 0;
+
+	check(rval, json_append_literal(out, "\""));
+	while (i < len) {
+		size_t  plain = plain_ascii_prefix(src + i, len - i);
+		if (plain > 0) {
+			check(rval, json_append(out, (const char *) src + i, plain));
+			i += plain;
+		} else {
+			check(rval, json_append_code_point(out, src[i]));
+			i++;
+		}
+	}
+	return json_append_literal(out, "\"");
+}
+
+static int
+json_append_integer(struct json_out *out, int64_t val)
+{
+	char  buf[32];
+	int  len = snprintf(buf, sizeof(buf), "%" PRId64, val);
+	return json_append(out, buf, len);
+}
+
+/*
+ * Formats a real as jansson's jsonp_dtostr does: 17 significant
+ * digits, a ".0" if it would otherwise read as an integer, and no plus
+ * sign or leading zeros in the exponent.
+ */
+
+static int
+json_append_real(struct json_out *out, double val)
+{
+	char  buf[64];
+	char  *start;
+	char  *end;
+	size_t  len;
+
+	if (isnan(val) || isinf(val)) {
+		avro_set_error("Cannot encode a non-finite real in JSON");
+		return EINVAL;
+	}
+
+	len = snprintf(buf, sizeof(buf), "%.17g", val);
+	if (strchr(buf, '.') == NULL && strchr(buf, 'e') == NULL) {
+		buf[len++] = '.';
+		buf[len++] = '0';
+		buf[len] = '\0';
+	}
+
+	start = strchr(buf, 'e');
+	if (start) {
+		start++;
+		end = start + 1;
+		if (*start == '-') {
+			start++;
+		}
+		while (*end == '0') {
+			end++;
+		}
+		if (end != start) {
+			memmove(start, end, len - (size_t) (end - buf) + 1);
+			len -= (size_t) (end - start);
+		}
+	}
+	return json_append(out, buf, len);
+}
+
+/*
+ * Gets len bytes off the reader.  A memory reader hands out a slice of
+ * its buffer; any other reader reads into a copy, which is returned in
+ * *copy for the caller to free.
+ */
+
+static int
+read_raw(avro_reader_t reader, int64_t len,
+	 const uint8_t **data, char **copy)
+{
+	*copy = NULL;
+	if (len < 0) {
+		avro_set_error("Invalid length %" PRId64, len);
+		return EINVAL;
+	}
+	if (is_memory_io(reader)) {
+		struct _avro_reader_memory_t  *mem = avro_reader_to_memory(reader);
+		if (len > mem->len - mem->read) {
+			avro_set_error("Cannot read %" PRId64 " bytes from memory buffer",
+				       len);
+			return ENOSPC;
+		}
+		*data = (const uint8_t *) mem->buf + mem->read;
+		mem->read += len;
+		return 0;
+	}
+
+	*copy = (char *) avro_malloc(len + 1);
+	if (*copy == NULL) {
+		avro_set_error("Cannot allocate buffer for value");
+		return ENOMEM;
+	}
+	int  rval = avro_read(reader, *copy, len);
+	if (rval) {
+		avro_free(*copy, len + 1);
+		*copy = NULL;
+		return rval;
+	}
+	*data = (const uint8_t *) *copy;
+	return 0;
+}
+
+static int
+transcode_bytes(avro_reader_t reader, struct json_out *out,
+		int64_t len, int is_string)
+{
+	int  rval;
+	const uint8_t  *data;
+	char  *copy;
+
+	check(rval, read_raw(reader, len, &data, &copy));
+	if (is_string) {
+		rval = json_append_utf8(out, data, len);
+	} else {
+		rval = json_append_latin1(out, data, len);
+	}
+	if (copy != NULL) {
+		avro_free(copy, len + 1);
+	}
+	return rval;
+}
+
+static int
+transcode(avro_reader_t reader, avro_schema_t schema, struct json_out *out);
+
+/*
+ * Arrays and maps are written as their items come, block by block.
+ */
+
+static int
+transcode_array(avro_reader_t reader, avro_schema_t schema,
+		struct json_out *out)
+{
+	int  rval;
+	int64_t  i;
+	int64_t  block_count;
+	int64_t  block_size;
+	int  first = 1;
+	avro_schema_t  items = avro_schema_to_array(schema)->items;
+
+	check(rval, json_append_literal(out, "["));
+	check_prefix(rval, avro_binary_encoding.read_long(reader, &block_count),
+		     "Cannot read array block count: ");
+	while (block_count != 0) {
+		if (block_count < 0) {
+			block_count = block_count * -1;
+			check_prefix(rval, avro_binary_encoding.
+				     read_long(reader, &block_size),
+				     "Cannot read array block size: ");
+		}
+
+		for (i = 0; i < block_count; i++) {
+			if (!first) {
+				check(rval, json_append_literal(out, ", "));
+			}
+			first = 0;
+			check(rval, transcode(reader, items, out));
+		}
+
+		check_prefix(rval, avro_binary_encoding.
+			     read_long(reader, &block_count),
+			     "Cannot read array block count: ");
+	}
+	return json_append_literal(out, "]");
+}
+
+static int
+transcode_map(avro_reader_t reader, avro_schema_t schema,
+	      struct json_out *out)
+{
+	int  rval;
+	int64_t  i;
+	int64_t  block_count;
+	int64_t  block_size;
+	int64_t  key_len;
+	int  first = 1;
+	avro_schema_t  values = avro_schema_to_map(schema)->values;
+
+	check(rval, json_append_literal(out, "{"));
+	check_prefix(rval, avro_binary_encoding.read_long(reader, &block_count),
+		     "Cannot read map block count: ");
+	while (block_count != 0) {
+		if (block_count < 0) {
+			block_count = block_count * -1;
+			check_prefix(rval, avro_binary_encoding.
+				     read_long(reader, &block_size),
+				     "Cannot read map block size: ");
+		}
+
+		for (i = 0; i < block_count; i++) {
+			if (!first) {
+				check(rval, json_append_literal(out, ", "));
+			}
+			first = 0;
+			check_prefix(rval, avro_binary_encoding.
+				     read_long(reader, &key_len),
+				     "Cannot read map key length: ");
+			check(rval, transcode_bytes(reader, out, key_len, 1));
+			check(rval, json_append_literal(out, ": "));
+			check(rval, transcode(reader, values, out));
+		}
+
+		check_prefix(rval, avro_binary_encoding.
+			     read_long(reader, &block_count),
+			     "Cannot read map block count: ");
+	}
+	return json_append_literal(out, "}");
+}
+
+static int
+transcode_record(avro_reader_t reader, avro_schema_t schema,
+		 struct json_out *out)
+{
+	int  rval;
+	size_t  i;
+	size_t  field_count = avro_schema_record_size(schema);
+
+	check(rval, json_append_literal(out, "{"));
+	for (i = 0; i < field_count; i++) {
+		const char  *name = avro_schema_record_field_name(schema, i);
+		if (i > 0) {
+			check(rval, json_append_literal(out, ", "));
+		}
+		check(rval, json_append_utf8(out, (const uint8_t *) name,
+					     strlen(name)));
+		check(rval, json_append_literal(out, ": "));
+		check_prefix(rval, transcode
+			     (reader,
+			      avro_schema_record_field_get_by_index(schema, i),
+			      out),
+			     "Cannot read record field: ");
+	}
+	return json_append_literal(out, "}");
+}
+
+static int
+transcode_union(avro_reader_t reader, avro_schema_t schema,
+		struct json_out *out)
+{
+	int  rval;
+	int64_t  discriminant;
+	avro_schema_t  branch;
+	avro_schema_t  target;
+	const char  *name;
+
+	check_prefix(rval, avro_binary_encoding.
+		     read_long(reader, &discriminant),
+		     "Cannot read union discriminant: ");
+	if (discriminant < 0 ||
+	    discriminant >= (int64_t) avro_schema_union_size(schema)) {
+		avro_set_error("Invalid union discriminant value: (%d)",
+			       (int) discriminant);
+		return EILSEQ;
+	}
+	branch = avro_schema_union_branch(schema, discriminant);
+
+	target = is_avro_link(branch)? avro_schema_link_target(branch): branch;
+	if (is_avro_null(target)) {
+		return json_append_literal(out, "null");
+	}
+
+	name = avro_schema_type_name(branch);
+	check(rval, json_append_literal(out, "{"));
+	check(rval, json_append_utf8(out, (const uint8_t *) name, strlen(name)));
+	check(rval, json_append_literal(out, ": "));
+	check(rval, transcode(reader, branch, out));
+	return json_append_literal(out, "}");
+}
+
+static int
+transcode(avro_reader_t reader, avro_schema_t schema, struct json_out *out)
+{
+	int  rval;
+
+	switch (avro_typeof(schema)) {
+		case AVRO_NULL:
+			return json_append_literal(out, "null");
+
+		case AVRO_BOOLEAN:
+		{
+			int8_t  val;
+			check_prefix(rval, avro_binary_encoding.
+				     read_boolean(reader, &val),
+				     "Cannot read boolean value: ");
+			return val? json_append_literal(out, "true"):
+			    json_append_literal(out, "false");
+		}
+
+		case AVRO_INT32:
+		{
+			int32_t  val;
+			check_prefix(rval, avro_binary_encoding.
+				     read_int(reader, &val),
+				     "Cannot read int value: ");
+			return json_append_integer(out, val);
+		}
+
+		case AVRO_INT64:
+		{
+			int64_t  val;
+			check_prefix(rval, avro_binary_encoding.
+				     read_long(reader, &val),
+				     "Cannot read long value: ");
+			return json_append_integer(out, val);
+		}
+
+		case AVRO_FLOAT:
+		{
+			float  val;
+			check_prefix(rval, avro_binary_encoding.
+				     read_float(reader, &val),
+				     "Cannot read float value: ");
+			return json_append_real(out, val);
+		}
+
+		case AVRO_DOUBLE:
+		{
+			double  val;
+			check_prefix(rval, avro_binary_encoding.
+				     read_double(reader, &val),
+				     "Cannot read double value: ");
+			return json_append_real(out, val);
+		}
+
+		case AVRO_STRING:
+		case AVRO_BYTES:
+		{
+			int64_t  len;
+			check_prefix(rval, avro_binary_encoding.
+				     read_long(reader, &len),
+				     "Cannot read string length: ");
+			return transcode_bytes(reader, out, len,
+					       is_avro_string(schema));
+		}
+
+		case AVRO_FIXED:
+			return transcode_bytes(reader, out,
+					       avro_schema_fixed_size(schema), 0);
+
+		case AVRO_ENUM:
+		{
+			int64_t  val;
+			const char  *symbol;
+			check_prefix(rval, avro_binary_encoding.
+				     read_long(reader, &val),
+				     "Cannot read enum value: ");
+			symbol = avro_schema_enum_get(schema, (int) val);
+			if (symbol == NULL) {
+				avro_set_error("No enum symbol for value %" PRId64, val);
+				return EINVAL;
+			}
+			return json_append_utf8(out, (const uint8_t *) symbol,
+						strlen(symbol));
+		}
+
+		case AVRO_ARRAY:
+			return transcode_array(reader, schema, out);
+
+		case AVRO_MAP:
+			return transcode_map(reader, schema, out);
+
+		case AVRO_RECORD:
+			return transcode_record(reader, schema, out);
+
+		case AVRO_UNION:
+			return transcode_union(reader, schema, out);
+
+		case AVRO_LINK:
+			return transcode(reader, avro_schema_link_target(schema), out);
+
+		default:
+			avro_set_error("Unknown schema type");
+			return EINVAL;
+	}
+}
+
+int
+avro_binary_to_json(avro_reader_t reader, avro_schema_t writers_schema,
+		    char **buf, size_t *size, size_t *len)
+{
+	int  rval;
+	struct json_out  out;
+
+	check_param(EINVAL, reader, "reader");
+	check_param(EINVAL, is_avro_schema(writers_schema), "writer schema");
+	check_param(EINVAL, buf, "buffer");
+	check_param(EINVAL, size, "buffer size");
+	check_param(EINVAL, len, "text length");
+
+	out.buf = buf;
+	out.size = size;
+	out.len = *len;
+
+	rval = transcode(reader, writers_schema, &out);
+	if (rval == 0) {
+		rval = json_reserve(&out, 0);
+	}
+	if (rval == 0) {
+		(*buf)[out.len] = '\0';
+		*len = out.len;
+	} else if (*buf != NULL && *len < *size) {
+		/* Drop what was written of the failed value. */
+		(*buf)[*len] = '\0';
+	}
+	return rval;
+}
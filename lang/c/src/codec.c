@@ -15,6 +15,7 @@
  * permissions and limitations under the License. 
  */
 
+#include <errno.h>
 #include <string.h>
 #ifdef SNAPPY_CODEC
 #include <snappy-c.h>
@@ -37,9 +38,13 @@
 #ifdef LZMA_CODEC
 #include <lzma.h>
 #endif
+#ifdef ZSTD_CODEC
+#include <zstd.h>
+#endif
 #include "avro/errors.h"
 #include "avro/allocation.h"
 #include "codec.h"
+#include "crc32.h"
 
 #define DEFAULT_BLOCK_SIZE	(16 * 1024)
 
@@ -127,7 +132,7 @@ static int encode_snappy(avro_codec_t c, void * data, int64_t len)
 		return 1;
 	}
 
-        crc = __bswap_32(crc32(0, (const Bytef *)data, len));
+        crc = __bswap_32(avro_crc32(0, data, len));
         memcpy((char*)c->block_data+outlen, &crc, 4);
         c->used_size = outlen+4;
 
@@ -164,7 +169,7 @@ static int decode_snappy(avro_codec_t c, void * data, int64_t len)
 		return 1;
 	}
 
-        crc = __bswap_32(crc32(0, (const Bytef *)c->block_data, outlen));
+        crc = __bswap_32(avro_crc32(0, c->block_data, outlen));
         if (memcmp(&crc, (char*)data+len-4, 4))
         {
                 avro_set_error("CRC32 check failure uncompressing block with Snappy");
@@ -516,6 +521,169 @@ static int reset_lzma(avro_codec_t c)
 
 #endif // LZMA_CODEC
 
+/* Zstandard codec */
+
+#ifdef ZSTD_CODEC
+
+#define DEFAULT_ZSTD_LEVEL	3
+
+/* The contexts are kept for the lifetime of the codec so that their
+ * internal tables are not reallocated for every block. */
+struct codec_data_zstd {
+	ZSTD_CCtx *cctx;
+	ZSTD_DCtx *dctx;
+	int level;
+};
+#define codec_data_zstd_cctx(cd)	((struct codec_data_zstd *)cd)->cctx
+#define codec_data_zstd_dctx(cd)	((struct codec_data_zstd *)cd)->dctx
+#define codec_data_zstd_level(cd)	((struct codec_data_zstd *)cd)->level
+
+static int
+codec_zstd(avro_codec_t codec)
+{
+	codec->name = "zstandard";
+	codec->type = AVRO_CODEC_ZSTD;
+	codec->block_size = 0;
+	codec->used_size = 0;
+	codec->block_data = NULL;
+	codec->codec_data = avro_new(struct codec_data_zstd);
+
+	if (!codec->codec_data) {
+		avro_set_error("Cannot allocate memory for zstd");
+		return 1;
+	}
+
+	codec_data_zstd_level(codec->codec_data) = DEFAULT_ZSTD_LEVEL;
+	codec_data_zstd_cctx(codec->codec_data) = ZSTD_createCCtx();
+	codec_data_zstd_dctx(codec->codec_data) = ZSTD_createDCtx();
+
+	if (!codec_data_zstd_cctx(codec->codec_data) ||
+	    !codec_data_zstd_dctx(codec->codec_data)) {
+		ZSTD_freeCCtx(codec_data_zstd_cctx(codec->codec_data));
+		ZSTD_freeDCtx(codec_data_zstd_dctx(codec->codec_data));
+		avro_freet(struct codec_data_zstd, codec->codec_data);
+		codec->codec_data = NULL;
+		avro_set_error("Cannot initialize zstd");
+		return 1;
+	}
+
+	return 0;
+}
+
+static int encode_zstd(avro_codec_t c, void * data, int64_t len)
+{
+	size_t ret;
+	int64_t outlen = ZSTD_compressBound(len);
+
+	if (!c->block_data) {
+		c->block_data = avro_malloc(outlen);
+		c->block_size = outlen;
+	} else if (c->block_size < outlen) {
+		c->block_data = avro_realloc(c->block_data, c->block_size, outlen);
+		c->block_size = outlen;
+	}
+
+	if (!c->block_data) {
+		avro_set_error("Cannot allocate memory for zstd");
+		return 1;
+	}
+
+	ret = ZSTD_compressCCtx(codec_data_zstd_cctx(c->codec_data),
+				c->block_data, c->block_size, data, len,
+				codec_data_zstd_level(c->codec_data));
+	if (ZSTD_isError(ret)) {
+		avro_set_error("Error compressing block with zstd: %s",
+			       ZSTD_getErrorName(ret));
+		return 1;
+	}
+
+	c->used_size = ret;
+
+	return 0;
+}
+
+static int decode_zstd(avro_codec_t c, void * data, int64_t len)
+{
+	size_t ret;
+	ZSTD_DCtx *dctx = codec_data_zstd_dctx(c->codec_data);
+	ZSTD_inBuffer in = { data, (size_t) len, 0 };
+	ZSTD_outBuffer out;
+	unsigned long long content_size = ZSTD_getFrameContentSize(data, len);
+
+	/* Frames written by streaming compressors need not record their
+	 * size, in which case the buffer grows as we go. */
+	if (content_size != ZSTD_CONTENTSIZE_UNKNOWN &&
+	    content_size != ZSTD_CONTENTSIZE_ERROR &&
+	    (int64_t) content_size > c->block_size) {
+		if (!c->block_data) {
+			c->block_data = avro_malloc(content_size);
+		} else {
+			c->block_data = avro_realloc(c->block_data, c->block_size, content_size);
+		}
+		c->block_size = content_size;
+	} else if (!c->block_data) {
+		c->block_data = avro_malloc(DEFAULT_BLOCK_SIZE);
+		c->block_size = DEFAULT_BLOCK_SIZE;
+	}
+
+	if (!c->block_data) {
+		avro_set_error("Cannot allocate memory for zstd");
+		return 1;
+	}
+
+	ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+	out.dst = c->block_data;
+	out.size = c->block_size;
+	out.pos = 0;
+
+	do {
+		ret = ZSTD_decompressStream(dctx, &out, &in);
+		if (ZSTD_isError(ret)) {
+			avro_set_error("Error decompressing block with zstd: %s",
+				       ZSTD_getErrorName(ret));
+			return 1;
+		}
+		if (ret != 0 && out.pos == out.size) {
+			c->block_data = avro_realloc(c->block_data, c->block_size, c->block_size * 2);
+			if (!c->block_data) {
+				avro_set_error("Cannot allocate memory for zstd");
+				return 1;
+			}
+			c->block_size = c->block_size * 2;
+			out.dst = c->block_data;
+			out.size = c->block_size;
+		} else if (ret != 0 && in.pos == in.size) {
+			avro_set_error("Error decompressing block with zstd: truncated frame");
+			return 1;
+		}
+	} while (ret != 0);
+
+	c->used_size = out.pos;
+
+	return 0;
+}
+
+static int reset_zstd(avro_codec_t c)
+{
+	if (c->block_data) {
+		avro_free(c->block_data, c->block_size);
+	}
+	if (c->codec_data) {
+		ZSTD_freeCCtx(codec_data_zstd_cctx(c->codec_data));
+		ZSTD_freeDCtx(codec_data_zstd_dctx(c->codec_data));
+		avro_freet(struct codec_data_zstd, c->codec_data);
+	}
+
+	c->block_data = NULL;
+	c->block_size = 0;
+	c->used_size = 0;
+	c->codec_data = NULL;
+
+	return 0;
+}
+
+#endif // ZSTD_CODEC
+
 /* Common interface */
 
 int avro_codec(avro_codec_t codec, const char *type)
@@ -542,6 +710,12 @@ int avro_codec(avro_codec_t codec, const char *type)
 	}
 #endif
 
+#ifdef ZSTD_CODEC
+	if (strcmp("zstandard", type) == 0) {
+		return codec_zstd(codec);
+	}
+#endif
+
 	if (strcmp("null", type) == 0) {
 		return codec_null(codec);
 	}
@@ -567,6 +741,10 @@ int avro_codec_encode(avro_codec_t c, void * data, int64_t len)
 #ifdef LZMA_CODEC
 	case AVRO_CODEC_LZMA:
 		return encode_lzma(c, data, len);
+#endif
+#ifdef ZSTD_CODEC
+	case AVRO_CODEC_ZSTD:
+		return encode_zstd(c, data, len);
 #endif
 	default:
 		return 1;
@@ -590,6 +768,10 @@ int avro_codec_decode(avro_codec_t c, void * data, int64_t len)
 #ifdef LZMA_CODEC
 	case AVRO_CODEC_LZMA:
 		return decode_lzma(c, data, len);
+#endif
+#ifdef ZSTD_CODEC
+	case AVRO_CODEC_ZSTD:
+		return decode_zstd(c, data, len);
 #endif
 	default:
 		return 1;
@@ -613,8 +795,44 @@ int avro_codec_reset(avro_codec_t c)
 #ifdef LZMA_CODEC
 	case AVRO_CODEC_LZMA:
 		return reset_lzma(c);
+#endif
+#ifdef ZSTD_CODEC
+	case AVRO_CODEC_ZSTD:
+		return reset_zstd(c);
 #endif
 	default:
 		return 1;
 	}
 }
+
+int avro_codec_set_level(avro_codec_t c, int level)
+{
+	switch(c->type)
+	{
+#ifdef DEFLATE_CODEC
+	case AVRO_CODEC_DEFLATE:
+		if (level < Z_NO_COMPRESSION || level > Z_BEST_COMPRESSION) {
+			avro_set_error("Invalid deflate level %d", level);
+			return EINVAL;
+		}
+		if (deflateParams(codec_data_deflate_stream(c->codec_data),
+				  level, Z_DEFAULT_STRATEGY) != Z_OK) {
+			avro_set_error("Cannot set deflate level %d", level);
+			return 1;
+		}
+		return 0;
+#endif
+#ifdef ZSTD_CODEC
+	case AVRO_CODEC_ZSTD:
+		if (level < ZSTD_minCLevel() || level > ZSTD_maxCLevel()) {
+			avro_set_error("Invalid zstd level %d", level);
+			return EINVAL;
+		}
+		codec_data_zstd_level(c->codec_data) = level;
+		return 0;
+#endif
+	default:
+		avro_set_error("Codec %s does not support compression levels", c->name);
+		return EINVAL;
+	}
+}
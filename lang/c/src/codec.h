@@ -30,7 +30,8 @@ enum avro_codec_type_t {
 	AVRO_CODEC_NULL,
 	AVRO_CODEC_DEFLATE,
 	AVRO_CODEC_LZMA,
-	AVRO_CODEC_SNAPPY
+	AVRO_CODEC_SNAPPY,
+	AVRO_CODEC_ZSTD
 };
 typedef enum avro_codec_type_t avro_codec_type_t;
 
@@ -46,6 +47,7 @@ typedef struct avro_codec_t_* avro_codec_t;
 
 int avro_codec(avro_codec_t c, const char *type);
 int avro_codec_reset(avro_codec_t c);
+int avro_codec_set_level(avro_codec_t c, int level);
 int avro_codec_encode(avro_codec_t c, void * data, int64_t len);
 int avro_codec_decode(avro_codec_t c, void * data, int64_t len);
 
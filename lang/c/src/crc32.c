@@ -0,0 +1,242 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to you under the Apache License, Version 2.0 
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ * 
+ * https://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License. 
+ */
+
+#include "crc32.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define AVRO_CRC32_PCLMUL
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__GNUC__) && defined(__linux__)
+#define AVRO_CRC32_ARM
+#include <arm_acle.h>
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#include <string.h>
+#endif
+
+/*
+ * Tables for slicing by eight: crc_table[0] is the classic byte-wise
+ * table and crc_table[k][i] is the CRC of byte i followed by k zero bytes.
+ * The functions below work on the inverted CRC, the state of the register.
+ */
+
+static uint32_t crc_table[8][256];
+
+static void
+crc32_init_tables(void)
+{
+	uint32_t i, c;
+	int j, k;
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (j = 0; j < 8; j++) {
+			c = (c & 1) ? (c >> 1) ^ 0xEDB88320u : c >> 1;
+		}
+		crc_table[0][i] = c;
+	}
+	for (k = 1; k < 8; k++) {
+		for (i = 0; i < 256; i++) {
+			c = crc_table[k - 1][i];
+			crc_table[k][i] = (c >> 8) ^ crc_table[0][c & 0xFF];
+		}
+	}
+}
+
+static uint32_t
+crc32_slice8(const uint8_t *p, size_t len, uint32_t crc)
+{
+	uint32_t lo, hi;
+
+	for (; len >= 8; p += 8, len -= 8) {
+		lo = crc ^ ((uint32_t) p[0] | (uint32_t) p[1] << 8 |
+			    (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24);
+		hi = (uint32_t) p[4] | (uint32_t) p[5] << 8 |
+		     (uint32_t) p[6] << 16 | (uint32_t) p[7] << 24;
+		crc = crc_table[7][lo & 0xFF] ^ crc_table[6][(lo >> 8) & 0xFF] ^
+		      crc_table[5][(lo >> 16) & 0xFF] ^ crc_table[4][lo >> 24] ^
+		      crc_table[3][hi & 0xFF] ^ crc_table[2][(hi >> 8) & 0xFF] ^
+		      crc_table[1][(hi >> 16) & 0xFF] ^ crc_table[0][hi >> 24];
+	}
+	for (; len > 0; p++, len--) {
+		crc = crc_table[0][(crc ^ *p) & 0xFF] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+#if defined(AVRO_CRC32_PCLMUL)
+
+/*
+ * Folds 64 bytes at a time with carry-less multiplication and reduces the
+ * result with Barrett's method, as in Intel's "Fast CRC Computation for
+ * Generic Polynomials Using PCLMULQDQ Instruction".  len must be a
+ * multiple of 16 and at least 64.
+ */
+
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t
+crc32_pclmul(const uint8_t *p, size_t len, uint32_t crc)
+{
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+	const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+	const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+	__m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_loadu_si128((const __m128i *) p);
+	x2 = _mm_loadu_si128((const __m128i *) (p + 16));
+	x3 = _mm_loadu_si128((const __m128i *) (p + 32));
+	x4 = _mm_loadu_si128((const __m128i *) (p + 48));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int) crc));
+	p += 64;
+	len -= 64;
+
+	for (; len >= 64; p += 64, len -= 64) {
+		x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+				   _mm_loadu_si128((const __m128i *) p));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+				   _mm_loadu_si128((const __m128i *) (p + 16)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+				   _mm_loadu_si128((const __m128i *) (p + 32)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+				   _mm_loadu_si128((const __m128i *) (p + 48)));
+	}
+
+	/* Fold the four lanes, then any remaining 16-byte blocks, into one. */
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+	for (; len >= 16; p += 16, len -= 16) {
+		x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1,
+				   _mm_loadu_si128((const __m128i *) p)), x5);
+	}
+
+	/* Fold 128 bits to 64. */
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask32);
+	x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduction to 32 bits. */
+	x2 = _mm_and_si128(x1, mask32);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+	x2 = _mm_and_si128(x2, mask32);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	return (uint32_t) _mm_extract_epi32(x1, 1);
+}
+
+static uint32_t
+crc32_accelerated(const uint8_t *p, size_t len, uint32_t crc)
+{
+	size_t n;
+
+	if (len >= 64) {
+		n = len & ~(size_t) 15;
+		crc = crc32_pclmul(p, n, crc);
+		p += n;
+		len -= n;
+	}
+	return crc32_slice8(p, len, crc);
+}
+
+static int
+crc32_has_acceleration(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("pclmul") &&
+	       __builtin_cpu_supports("sse4.1");
+}
+
+#elif defined(AVRO_CRC32_ARM)
+
+__attribute__((target("+crc")))
+static uint32_t
+crc32_accelerated(const uint8_t *p, size_t len, uint32_t crc)
+{
+	uint64_t v;
+
+	for (; len >= 8; p += 8, len -= 8) {
+		memcpy(&v, p, 8);
+		crc = __crc32d(crc, v);
+	}
+	for (; len > 0; p++, len--) {
+		crc = __crc32b(crc, *p);
+	}
+	return crc;
+}
+
+static int
+crc32_has_acceleration(void)
+{
+	return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+}
+
+#endif
+
+typedef uint32_t (*crc32_func_t)(const uint8_t *, size_t, uint32_t);
+
+static crc32_func_t crc32_func = NULL;
+
+static void
+crc32_select(void)
+{
+	crc32_init_tables();
+	crc32_func = crc32_slice8;
+#if defined(AVRO_CRC32_PCLMUL) || defined(AVRO_CRC32_ARM)
+	if (crc32_has_acceleration()) {
+		crc32_func = crc32_accelerated;
+	}
+#endif
+}
+
+#if defined THREADSAFE && (defined __unix__ || defined __unix)
+#include <pthread.h>
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+#endif
+
+uint32_t
+avro_crc32(uint32_t crc, const void *buf, size_t len)
+{
+#if defined THREADSAFE && (defined __unix__ || defined __unix)
+	pthread_once(&crc32_once, crc32_select);
+#else
+	if (crc32_func == NULL) {
+		crc32_select();
+	}
+#endif
+	return ~crc32_func((const uint8_t *) buf, len, ~crc);
+}
@@ -15,13 +15,17 @@
  * permissions and limitations under the License. 
  */
 
+#include "avro_io_internal.h"
 #include "avro_private.h"
 #include "avro/allocation.h"
 #include "avro/generic.h"
 #include "avro/errors.h"
+#include "avro/refcount.h"
+#include "avro/resolver.h"
 #include "avro/value.h"
-#include "encoding.h"
 #include "codec.h"
+#include "datum.h"
+#include "encoding.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
@@ -29,6 +33,14 @@
 #include <time.h>
 #include <string.h>
 
+#if defined THREADSAFE && (defined __unix__ || defined __unix)
+#define AVRO_DATAFILE_THREADS
+#include <pthread.h>
+#endif
+
+struct file_prefetch;
+struct file_background;
+
 struct avro_file_reader_t_ {
 	avro_schema_t writers_schema;
 	avro_reader_t reader;
@@ -37,8 +49,20 @@ struct avro_file_reader_t_ {
 	char sync[16];
 	int64_t blocks_read;
 	int64_t blocks_total;
+	/* The position of the block being read, just past its sync marker. */
+	int64_t block_start;
 	int64_t current_blocklen;
 	char * current_blockdata;
+	int zero_copy;
+	avro_wrapped_buffer_t block;
+	struct file_prefetch *prefetch;
+	/* avro_file_reader_read resolves into datum_schema with
+	 * datum_resolver, or reads straight into it if NULL, and keeps
+	 * the last datum read for reuse when reuse_datum is set. */
+	avro_schema_t datum_schema;
+	avro_value_iface_t *datum_resolver;
+	avro_datum_t datum;
+	int reuse_datum;
 };
 
 struct avro_file_writer_t_ {
@@ -51,6 +75,9 @@ struct avro_file_writer_t_ {
 	avro_writer_t datum_writer;
 	char* datum_buffer;
 	size_t datum_buffer_size;
+	struct file_background *background;
+	int codec_level;
+	int codec_level_set;
 	char schema_buf[64 * 1024];
 };
 
@@ -139,15 +166,24 @@ file_writer_init_fp(FILE *fp, const char *path, int should_close, const char *mo
   #define EXCLUSIVE_WRITE_MODE   "wbx"
 #endif
 
+/*
+ * Writes a new data file to base if given, or else to fp or the file
+ * at path.
+ */
 static int
-file_writer_create(FILE *fp, const char *path, int should_close, avro_schema_t schema, avro_file_writer_t w, size_t block_size)
+file_writer_create(FILE *fp, avro_writer_t base, const char *path, int should_close, avro_schema_t schema, avro_file_writer_t w, size_t block_size)
 {
 	int rval;
 
 	w->block_count = 0;
-	rval = file_writer_init_fp(fp, path, should_close, EXCLUSIVE_WRITE_MODE, w);
-	if (rval) {
-		check(rval, file_writer_init_fp(fp, path, should_close, "wb", w));
+	w->block_size = 0;
+	if (base) {
+		w->writer = base;
+	} else {
+		rval = file_writer_init_fp(fp, path, should_close, EXCLUSIVE_WRITE_MODE, w);
+		if (rval) {
+			check(rval, file_writer_init_fp(fp, path, should_close, "wb", w));
+		}
 	}
 
 	w->datum_buffer_size = block_size;
@@ -172,6 +208,58 @@ file_writer_create(FILE *fp, const char *path, int should_close, avro_schema_t s
 	return write_header(w);
 }
 
+/*
+ * Creates a file writer over base, or else fp or the file at path.
+ * base is freed on failure.
+ */
+static int
+file_writer_new(FILE *fp, avro_writer_t base, const char *path,
+		int should_close, avro_schema_t schema,
+		avro_file_writer_t * writer, const char *codec,
+		size_t block_size)
+{
+	avro_file_writer_t w;
+	int rval;
+
+	if (block_size == 0) {
+		block_size = DEFAULT_BLOCK_SIZE;
+	}
+
+	w = (avro_file_writer_t) avro_new(struct avro_file_writer_t_);
+	if (!w) {
+		avro_writer_free(base);
+		avro_set_error("Cannot allocate new file writer");
+		return ENOMEM;
+	}
+	w->background = NULL;
+	w->codec_level_set = 0;
+	w->codec = (avro_codec_t) avro_new(struct avro_codec_t_);
+	if (!w->codec) {
+		avro_writer_free(base);
+		avro_set_error("Cannot allocate new codec");
+		avro_freet(struct avro_file_writer_t_, w);
+		return ENOMEM;
+	}
+	rval = avro_codec(w->codec, codec);
+	if (rval) {
+		avro_writer_free(base);
+		avro_codec_reset(w->codec);
+		avro_freet(struct avro_codec_t_, w->codec);
+		avro_freet(struct avro_file_writer_t_, w);
+		return rval;
+	}
+	rval = file_writer_create(fp, base, path, should_close, schema, w, block_size);
+	if (rval) {
+		avro_codec_reset(w->codec);
+		avro_freet(struct avro_codec_t_, w->codec);
+		avro_freet(struct avro_file_writer_t_, w);
+		return rval;
+	}
+	*writer = w;
+
+	return 0;
+}
+
 int
 avro_file_writer_create(const char *path, avro_schema_t schema,
 			avro_file_writer_t * writer)
@@ -197,44 +285,46 @@ int avro_file_writer_create_with_codec_fp(FILE *fp, const char *path, int should
 			avro_schema_t schema, avro_file_writer_t * writer,
 			const char *codec, size_t block_size)
 {
-	avro_file_writer_t w;
-	int rval;
 	check_param(EINVAL, path, "path");
 	check_param(EINVAL, is_avro_schema(schema), "schema");
 	check_param(EINVAL, writer, "writer");
 	check_param(EINVAL, codec, "codec");
+	return file_writer_new(fp, NULL, path, should_close, schema, writer,
+			       codec, block_size);
+}
 
-	if (block_size == 0) {
-		block_size = DEFAULT_BLOCK_SIZE;
-	}
+int avro_file_writer_create_memory(avro_schema_t schema,
+			avro_file_writer_t * writer,
+			const char *codec, size_t block_size)
+{
+	avro_writer_t base;
+	check_param(EINVAL, is_avro_schema(schema), "schema");
+	check_param(EINVAL, writer, "writer");
+	check_param(EINVAL, codec, "codec");
 
-	w = (avro_file_writer_t) avro_new(struct avro_file_writer_t_);
-	if (!w) {
-		avro_set_error("Cannot allocate new file writer");
-		return ENOMEM;
-	}
-	w->codec = (avro_codec_t) avro_new(struct avro_codec_t_);
-	if (!w->codec) {
-		avro_set_error("Cannot allocate new codec");
-		avro_freet(struct avro_file_writer_t_, w);
+	base = avro_writer_memory_growable(0);
+	if (!base) {
 		return ENOMEM;
 	}
-	rval = avro_codec(w->codec, codec);
-	if (rval) {
-		avro_codec_reset(w->codec);
-		avro_freet(struct avro_codec_t_, w->codec);
-		avro_freet(struct avro_file_writer_t_, w);
-		return rval;
-	}
-	rval = file_writer_create(fp, path, should_close, schema, w, block_size);
-	if (rval) {
-		avro_codec_reset(w->codec);
-		avro_freet(struct avro_codec_t_, w->codec);
-		avro_freet(struct avro_file_writer_t_, w);
-		return rval;
+	return file_writer_new(NULL, base, "memory", 0, schema, writer,
+			       codec, block_size);
+}
+
+int avro_file_writer_get_buffer(avro_file_writer_t w, const char **buf,
+				int64_t *len)
+{
+	int rval;
+	check_param(EINVAL, w, "writer");
+	check_param(EINVAL, buf, "buffer");
+	check_param(EINVAL, len, "length");
+	if (!is_growable_io(w->writer)) {
+		avro_set_error("Not a memory file writer");
+		return EINVAL;
 	}
-	*writer = w;
 
+	check(rval, avro_file_writer_flush(w));
+	*buf = avro_writer_memory_buf(w->writer);
+	*len = avro_writer_tell(w->writer);
 	return 0;
 }
 
@@ -359,6 +449,7 @@ file_writer_open(const char *path, avro_file_writer_t w, size_t block_size)
 	}
 
 	w->block_count = 0;
+	w->block_size = 0;
 
 	/* Position to end of file and get ready to write */
 	fseek(fp, 0, SEEK_END);
@@ -409,6 +500,8 @@ avro_file_writer_open_bs(const char *path, avro_file_writer_t * writer,
 		avro_set_error("Cannot create new file writer for %s", path);
 		return ENOMEM;
 	}
+	w->background = NULL;
+	w->codec_level_set = 0;
 	w->codec = (avro_codec_t) avro_new(struct avro_codec_t_);
 	if (!w->codec) {
 		avro_set_error("Cannot allocate new codec");
@@ -434,68 +527,121 @@ avro_file_writer_open(const char *path, avro_file_writer_t * writer)
 	return avro_file_writer_open_bs(path, writer, 0);
 }
 
-static int file_read_block_count(avro_file_reader_t r)
+/*
+ * Copies the block the block reader is over into r->block, a reference
+ * counted buffer that the values read in zero-copy mode can share, and
+ * moves the block reader onto it without losing its place.
+ */
+static int file_wrap_block(avro_file_reader_t r)
+{
+	int rval;
+	struct _avro_reader_memory_t *mem = avro_reader_to_memory(r->block_reader);
+	int64_t read = mem->read;
+	avro_wrapped_buffer_t block;
+
+	check_prefix(rval, avro_wrapped_buffer_new_copy(&block, mem->buf, mem->len),
+		     "Cannot copy file block: ");
+	avro_wrapped_buffer_free(&r->block);
+	avro_wrapped_buffer_move(&r->block, &block);
+
+	avro_reader_memory_set_source(r->block_reader, (const char *) r->block.buf, r->block.size);
+	mem->read = read;
+	return 0;
+}
+
+/*
+ * Reads the count and size of the next block, and the block itself,
+ * still encoded by the file's codec.  A block of a file held in memory
+ * is left where it is.
+ */
+static int file_read_raw_block(avro_file_reader_t r, char **data, int64_t *len)
 {
 	int rval;
-	int64_t len;
 	const avro_encoding_t *enc = &avro_binary_encoding;
 
+	r->block_start = avro_reader_tell(r->reader);
+
 	/* For a correctly formatted file, EOF will occur here */
 	rval = enc->read_long(r->reader, &r->blocks_total);
 
-	if (rval == EILSEQ && avro_reader_is_eof(r->reader)) {
+	if ((rval == EILSEQ || rval == ENOSPC) && avro_reader_is_eof(r->reader)) {
 		return EOF;
 	}
 
 	check_prefix(rval, rval,
 		     "Cannot read file block count: ");
-	check_prefix(rval, enc->read_long(r->reader, &len),
+	check_prefix(rval, enc->read_long(r->reader, len),
 		     "Cannot read file block size: ");
+	if (*len < 0) {
+		avro_set_error("Invalid file block size: %" PRId64, *len);
+		return EILSEQ;
+	}
+
+	if (is_memory_io(r->reader)) {
+		struct _avro_reader_memory_t *mem = avro_reader_to_memory(r->reader);
+
+		*data = (char *) mem->buf + mem->read;
+		check_prefix(rval, avro_skip(r->reader, *len),
+			     "Cannot read file block: ");
+		return 0;
+	}
 
-	if (r->current_blockdata && len > r->current_blocklen) {
-		r->current_blockdata = (char *) avro_realloc(r->current_blockdata, r->current_blocklen, len);
-		r->current_blocklen = len;
+	if (r->current_blockdata && *len > r->current_blocklen) {
+		r->current_blockdata = (char *) avro_realloc(r->current_blockdata, r->current_blocklen, *len);
+		r->current_blocklen = *len;
 	} else if (!r->current_blockdata) {
-		r->current_blockdata = (char *) avro_malloc(len);
-		r->current_blocklen = len;
+		r->current_blockdata = (char *) avro_malloc(*len);
+		r->current_blocklen = *len;
 	}
 
-	if (len > 0) {
-		check_prefix(rval, avro_read(r->reader, r->current_blockdata, len),
+	*data = r->current_blockdata;
+	if (*len > 0) {
+		check_prefix(rval, avro_read(r->reader, r->current_blockdata, *len),
 			     "Cannot read file block: ");
+	}
+	return 0;
+}
+
+static int file_read_block_count(avro_file_reader_t r)
+{
+	int rval;
+	char *data;
+	int64_t len;
 
-		check_prefix(rval, avro_codec_decode(r->codec, r->current_blockdata, len),
+	/*
+	 * A block of a file held in memory is decoded where it is; the
+	 * null codec then reads it in place.
+	 */
+	check(rval, file_read_raw_block(r, &data, &len));
+	if (len > 0) {
+		check_prefix(rval, avro_codec_decode(r->codec, data, len),
 			     "Cannot decode file block: ");
 	}
 
 	avro_reader_memory_set_source(r->block_reader, (const char *) r->codec->block_data, r->codec->used_size);
+	if (r->zero_copy) {
+		check(rval, file_wrap_block(r));
+	}
 
 	r->blocks_read = 0;
 	return 0;
 }
 
-int avro_file_reader_fp(FILE *fp, const char *path, int should_close,
-			avro_file_reader_t * reader)
+/*
+ * Opens a data file over the given reader, which is freed on failure.
+ */
+static int file_reader_open(avro_reader_t base, const char *path,
+			    avro_file_reader_t * reader)
 {
 	int rval;
 	avro_file_reader_t r = (avro_file_reader_t) avro_new(struct avro_file_reader_t_);
 	if (!r) {
-		if (should_close) {
-			fclose(fp);
-		}
+		avro_reader_free(base);
 		avro_set_error("Cannot allocate file reader for %s", path);
 		return ENOMEM;
 	}
 
-	r->reader = avro_reader_file_fp(fp, should_close);
-	if (!r->reader) {
-		if (should_close) {
-			fclose(fp);
-		}
-		avro_set_error("Cannot allocate reader for file %s", path);
-		avro_freet(struct avro_file_reader_t_, r);
-		return ENOMEM;
-	}
+	r->reader = base;
 	r->block_reader = avro_reader_memory(0, 0);
 	if (!r->block_reader) {
 		avro_set_error("Cannot allocate block reader for file %s", path);
@@ -525,6 +671,13 @@ int avro_file_reader_fp(FILE *fp, const char *path, int should_close,
 
 	r->current_blockdata = NULL;
 	r->current_blocklen = 0;
+	r->zero_copy = 0;
+	avro_wrapped_buffer_new(&r->block, NULL, 0);
+	r->prefetch = NULL;
+	r->datum_schema = NULL;
+	r->datum_resolver = NULL;
+	r->datum = NULL;
+	r->reuse_datum = 0;
 
 	rval = file_read_block_count(r);
 	if (rval == EOF) {
@@ -541,6 +694,43 @@ int avro_file_reader_fp(FILE *fp, const char *path, int should_close,
 	return 0;
 }
 
+int avro_file_reader_fp(FILE *fp, const char *path, int should_close,
+			avro_file_reader_t * reader)
+{
+	avro_reader_t base = avro_reader_file_fp(fp, should_close);
+	if (!base) {
+		if (should_close) {
+			fclose(fp);
+		}
+		avro_set_error("Cannot allocate reader for file %s", path);
+		return ENOMEM;
+	}
+	return file_reader_open(base, path, reader);
+}
+
+int avro_file_reader_mmap(const char *path, avro_file_reader_t * reader)
+{
+	avro_reader_t base = avro_reader_mmap(path);
+	if (!base) {
+		return EINVAL;
+	}
+	return file_reader_open(base, path, reader);
+}
+
+int avro_file_reader_memory(const char *buf, int64_t len,
+			    avro_file_reader_t * reader)
+{
+	avro_reader_t base;
+	check_param(EINVAL, buf || len == 0, "buffer");
+	check_param(EINVAL, reader, "reader");
+
+	base = avro_reader_memory(buf, len);
+	if (!base) {
+		return ENOMEM;
+	}
+	return file_reader_open(base, "memory", reader);
+}
+
 int avro_file_reader(const char *path, avro_file_reader_t * reader)
 {
 	FILE *fp;
@@ -553,6 +743,12 @@ int avro_file_reader(const char *path, avro_file_reader_t * reader)
 	return avro_file_reader_fp(fp, path, 1, reader);
 }
 
+int avro_file_reader_drop_behind(avro_file_reader_t r)
+{
+	check_param(EINVAL, r, "reader");
+	return avro_reader_file_drop_behind(r->reader);
+}
+
 avro_schema_t
 avro_file_reader_get_writer_schema(avro_file_reader_t r)
 {
@@ -560,128 +756,1121 @@ avro_file_reader_get_writer_schema(avro_file_reader_t r)
 	return avro_schema_incref(r->writers_schema);
 }
 
-static int file_write_block(avro_file_writer_t w)
+/*
+ * Writes a block whose data is already encoded by the file's codec.
+ */
+static int file_write_raw_block(avro_file_writer_t w, const char *data,
+				int64_t block_count, int64_t len)
 {
 	const avro_encoding_t *enc = &avro_binary_encoding;
 	int rval;
 
-	if (w->block_count) {
-		/* Write the block count */
-		check_prefix(rval, enc->write_long(w->writer, w->block_count),
-			     "Cannot write file block count: ");
-		/* Encode the block */
-		check_prefix(rval, avro_codec_encode(w->codec, w->datum_buffer, w->block_size),
-			     "Cannot encode file block: ");
-		/* Write the block length */
-		check_prefix(rval, enc->write_long(w->writer, w->codec->used_size),
-			     "Cannot write file block size: ");
-		/* Write the block */
-		check_prefix(rval, avro_write(w->writer, w->codec->block_data, w->codec->used_size),
-			     "Cannot write file block: ");
-		/* Write the sync marker */
-		check_prefix(rval, write_sync(w),
-			     "Cannot write sync marker: ");
-		/* Reset the datum writer */
-		avro_writer_reset(w->datum_writer);
-		w->block_count = 0;
-		w->block_size = 0;
-	}
+	/* Write the block count */
+	check_prefix(rval, enc->write_long(w->writer, block_count),
+		     "Cannot write file block count: ");
+	/* Write the block length */
+	check_prefix(rval, enc->write_long(w->writer, len),
+		     "Cannot write file block size: ");
+	/* Write the block */
+	check_prefix(rval, avro_write(w->writer, (void *) data, len),
+		     "Cannot write file block: ");
+	/* Write the sync marker */
+	check_prefix(rval, write_sync(w),
+		     "Cannot write sync marker: ");
 	return 0;
 }
 
-int avro_file_writer_append(avro_file_writer_t w, avro_datum_t datum)
+static int file_write_block_data(avro_file_writer_t w, char *data,
+				 int block_count, size_t block_size)
 {
 	int rval;
-	check_param(EINVAL, w, "writer");
-	check_param(EINVAL, datum, "datum");
 
-	rval = avro_write_data(w->datum_writer, w->writers_schema, datum);
-	if (rval) {
-		check(rval, file_write_block(w));
-		rval =
-		    avro_write_data(w->datum_writer, w->writers_schema, datum);
-		if (rval) {
-			avro_set_error("Datum too large for file block size");
-			/* TODO: if the datum encoder larger than our buffer,
-			   just write a single large datum */
-			return rval;
+	/* Encode the block */
+	check_prefix(rval, avro_codec_encode(w->codec, data, block_size),
+		     "Cannot encode file block: ");
+	return file_write_raw_block(w, (const char *) w->codec->block_data,
+				    block_count, w->codec->used_size);
+}
+
+#ifdef AVRO_DATAFILE_THREADS
+
+/*
+ * Background compression.  A full block is swapped with a spare buffer
+ * and handed to a thread that encodes and writes it, while appending
+ * carries on into the other buffer.  Only that thread touches the codec
+ * and the file writer while it is busy.  Its errors are returned from
+ * the next call that waits for it, and from every call after that: the
+ * blocks after a failed one must not follow it into the file.
+ */
+
+struct file_background {
+	avro_file_writer_t w;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int stop;
+	int busy;
+	char *buffer;
+	int block_count;
+	size_t block_size;
+	int rval;
+	/* Set once a wait has returned rval; only the writer's thread
+	 * touches it. */
+	int reported;
+	char error[256];
+};
+
+static void *background_worker(void *arg)
+{
+	struct file_background *b = (struct file_background *) arg;
+
+	pthread_mutex_lock(&b->lock);
+	for (;;) {
+		int rval;
+
+		while (!b->busy && !b->stop) {
+			pthread_cond_wait(&b->cond, &b->lock);
+		}
+		if (!b->busy) {
+			break;
 		}
+		pthread_mutex_unlock(&b->lock);
+
+		rval = file_write_block_data(b->w, b->buffer, b->block_count,
+					     b->block_size);
+
+		pthread_mutex_lock(&b->lock);
+		if (rval && !b->rval) {
+			b->rval = rval;
+			strncpy(b->error, avro_strerror(), sizeof(b->error) - 1);
+			b->error[sizeof(b->error) - 1] = '\0';
+		}
+		b->busy = 0;
+		pthread_cond_broadcast(&b->cond);
 	}
-	w->block_count++;
-	w->block_size = avro_writer_tell(w->datum_writer);
-	return 0;
+	pthread_mutex_unlock(&b->lock);
+	return NULL;
 }
 
-int
-avro_file_writer_append_value(avro_file_writer_t w, avro_value_t *value)
+/*
+ * Waits for the block being written, and returns the first error the
+ * thread has had.
+ */
+static int background_wait(struct file_background *b)
 {
 	int rval;
-	check_param(EINVAL, w, "writer");
-	check_param(EINVAL, value, "value");
 
-	rval = avro_value_write(w->datum_writer, value);
+	pthread_mutex_lock(&b->lock);
+	while (b->busy) {
+		pthread_cond_wait(&b->cond, &b->lock);
+	}
+	rval = b->rval;
+	pthread_mutex_unlock(&b->lock);
+
 	if (rval) {
-		check(rval, file_write_block(w));
-		rval = avro_value_write(w->datum_writer, value);
-		if (rval) {
-			avro_set_error("Value too large for file block size");
-			/* TODO: if the value encoder larger than our buffer,
-			   just write a single large datum */
-			return rval;
-		}
+		b->reported = rval;
+		avro_set_error("%s", b->error);
 	}
-	w->block_count++;
-	w->block_size = avro_writer_tell(w->datum_writer);
-	return 0;
+	return rval;
 }
 
-int
-avro_file_writer_append_encoded(avro_file_writer_t w,
-				const void *buf, int64_t len)
+static int background_submit(avro_file_writer_t w)
 {
 	int rval;
-	check_param(EINVAL, w, "writer");
+	struct file_background *b = w->background;
+	char *full = w->datum_buffer;
 
-	rval = avro_write(w->datum_writer, (void *) buf, len);
-	if (rval) {
-		check(rval, file_write_block(w));
-		rval = avro_write(w->datum_writer, (void *) buf, len);
-		if (rval) {
-			avro_set_error("Value too large for file block size");
-			/* TODO: if the value encoder larger than our buffer,
-			   just write a single large datum */
-			return rval;
-		}
-	}
-	w->block_count++;
-	w->block_size = avro_writer_tell(w->datum_writer);
+	check(rval, background_wait(b));
+
+	w->datum_buffer = b->buffer;
+	avro_writer_memory_set_dest(w->datum_writer, w->datum_buffer, w->datum_buffer_size);
+
+	pthread_mutex_lock(&b->lock);
+	b->buffer = full;
+	b->block_count = w->block_count;
+	b->block_size = w->block_size;
+	b->busy = 1;
+	pthread_cond_signal(&b->cond);
+	pthread_mutex_unlock(&b->lock);
 	return 0;
 }
 
-int avro_file_writer_sync(avro_file_writer_t w)
+static int background_stop(avro_file_writer_t w)
 {
-	return file_write_block(w);
+	int rval;
+	struct file_background *b = w->background;
+
+	rval = background_wait(b);
+
+	pthread_mutex_lock(&b->lock);
+	b->stop = 1;
+	pthread_cond_signal(&b->cond);
+	pthread_mutex_unlock(&b->lock);
+	pthread_join(b->thread, NULL);
+
+	pthread_mutex_destroy(&b->lock);
+	pthread_cond_destroy(&b->cond);
+	avro_free(b->buffer, w->datum_buffer_size);
+	avro_freet(struct file_background, b);
+	w->background = NULL;
+	return rval;
 }
 
-int avro_file_writer_flush(avro_file_writer_t w)
+#endif
+
+/*
+ * Returns the error a wait has already returned, without waiting, so
+ * that appends keep failing after it.
+ */
+static int file_writer_failed(avro_file_writer_t w)
 {
-	int rval;
-	check(rval, file_write_block(w));
-	avro_writer_flush(w->writer);
+#ifdef AVRO_DATAFILE_THREADS
+	if (w->background && w->background->reported) {
+		avro_set_error("%s", w->background->error);
+		return w->background->reported;
+	}
+#else
+	(void) w;
+#endif
 	return 0;
 }
 
-int avro_file_writer_close(avro_file_writer_t w)
-{
+/*
+ * Waits until no block is being written in the background.
+ */
+static int file_writer_idle(avro_file_writer_t w)
+{
+#ifdef AVRO_DATAFILE_THREADS
+	if (w->background) {
+		return background_wait(w->background);
+	}
+#else
+	(void) w;
+#endif
+	return 0;
+}
+
+static int file_write_block(avro_file_writer_t w)
+{
+	int rval;
+
+	if (w->block_count) {
+#ifdef AVRO_DATAFILE_THREADS
+		if (w->background) {
+			check(rval, background_submit(w));
+		} else
+#endif
+		{
+			check(rval, file_write_block_data(w, w->datum_buffer,
+							  w->block_count, w->block_size));
+			/* Reset the datum writer */
+			avro_writer_reset(w->datum_writer);
+		}
+		w->block_count = 0;
+		w->block_size = 0;
+	}
+	return 0;
+}
+
+int avro_file_writer_set_background(avro_file_writer_t w, int enabled)
+{
+	check_param(EINVAL, w, "writer");
+
+#ifdef AVRO_DATAFILE_THREADS
+	if (!enabled) {
+		int rval;
+		if (!w->background) {
+			return 0;
+		}
+		/* After a failed block, later ones must not be written inline either. */
+		check(rval, background_wait(w->background));
+		return background_stop(w);
+	}
+	if (w->background) {
+		return 0;
+	}
+
+	struct file_background *b = (struct file_background *) avro_new(struct file_background);
+	if (!b) {
+		avro_set_error("Cannot allocate background writer");
+		return ENOMEM;
+	}
+	memset(b, 0, sizeof(struct file_background));
+	b->w = w;
+	b->buffer = (char *) avro_malloc(w->datum_buffer_size);
+	if (!b->buffer) {
+		avro_freet(struct file_background, b);
+		avro_set_error("Cannot allocate background datum buffer");
+		return ENOMEM;
+	}
+	pthread_mutex_init(&b->lock, NULL);
+	pthread_cond_init(&b->cond, NULL);
+	if (pthread_create(&b->thread, NULL, background_worker, b) != 0) {
+		pthread_mutex_destroy(&b->lock);
+		pthread_cond_destroy(&b->cond);
+		avro_free(b->buffer, w->datum_buffer_size);
+		avro_freet(struct file_background, b);
+		avro_set_error("Cannot start background writer thread");
+		return EAGAIN;
+	}
+	w->background = b;
+	return 0;
+#else
+	if (!enabled) {
+		return 0;
+	}
+	avro_set_error("Background compression needs a thread-safe build");
+	return ENOSYS;
+#endif
+}
+
+int avro_file_writer_append(avro_file_writer_t w, avro_datum_t datum)
+{
+	int rval;
+	check_param(EINVAL, w, "writer");
+	check_param(EINVAL, datum, "datum");
+	check(rval, file_writer_failed(w));
+
+	rval = avro_write_data(w->datum_writer, w->writers_schema, datum);
+	if (rval) {
+		check(rval, file_write_block(w));
+		rval =
+		    avro_write_data(w->datum_writer, w->writers_schema, datum);
+		if (rval) {
+			avro_set_error("Datum too large for file block size");
+			/* TODO: if the datum encoder larger than our buffer,
+			   just write a single large datum */
+			return rval;
+		}
+	}
+	w->block_count++;
+	w->block_size = avro_writer_tell(w->datum_writer);
+	return 0;
+}
+
+int
+avro_file_writer_append_value(avro_file_writer_t w, avro_value_t *value)
+{
+	int rval;
+	check_param(EINVAL, w, "writer");
+	check_param(EINVAL, value, "value");
+	check(rval, file_writer_failed(w));
+
+	rval = avro_value_write(w->datum_writer, value);
+	if (rval) {
+		check(rval, file_write_block(w));
+		rval = avro_value_write(w->datum_writer, value);
+		if (rval) {
+			avro_set_error("Value too large for file block size");
+			/* TODO: if the value encoder larger than our buffer,
+			   just write a single large datum */
+			return rval;
+		}
+	}
+	w->block_count++;
+	w->block_size = avro_writer_tell(w->datum_writer);
+	return 0;
+}
+
+int
+avro_file_writer_append_encoded(avro_file_writer_t w,
+				const void *buf, int64_t len)
+{
+	int rval;
+	check_param(EINVAL, w, "writer");
+	check(rval, file_writer_failed(w));
+
+	rval = avro_write(w->datum_writer, (void *) buf, len);
+	if (rval) {
+		check(rval, file_write_block(w));
+		rval = avro_write(w->datum_writer, (void *) buf, len);
+		if (rval) {
+			avro_set_error("Value too large for file block size");
+			/* TODO: if the value encoder larger than our buffer,
+			   just write a single large datum */
+			return rval;
+		}
+	}
+	w->block_count++;
+	w->block_size = avro_writer_tell(w->datum_writer);
+	return 0;
+}
+
+/*
+ * Finds how many of the count values at the start of the reader, at
+ * most, fit in limit bytes, and how many bytes those take.
+ */
+
+static int
+file_fit_encoded(avro_schema_t schema, avro_reader_t reader, int64_t count,
+		 int64_t limit, int64_t *fit, int64_t *fit_len)
+{
+	int rval;
+	struct _avro_reader_memory_t *mem = avro_reader_to_memory(reader);
+	int64_t start = mem->read;
+
+	*fit = 0;
+	*fit_len = 0;
+	while (*fit < count) {
+		check(rval, avro_skip_data(reader, schema));
+		if (mem->read - start > limit) {
+			break;
+		}
+		*fit_len = mem->read - start;
+		(*fit)++;
+	}
+	mem->read = start + *fit_len;
+	return 0;
+}
+
+int
+avro_file_writer_append_encoded_batch(avro_file_writer_t w,
+				      const void *buf, int64_t len,
+				      int64_t count, int validate)
+{
+	int rval = 0;
+	avro_reader_t reader = NULL;
+
+	check_param(EINVAL, w, "writer");
+	check_param(EINVAL, buf || len == 0, "buffer");
+	check_param(EINVAL, len >= 0 && count >= 0, "batch size");
+	check(rval, file_writer_failed(w));
+
+	if (validate) {
+		int64_t fit, fit_len;
+		reader = avro_reader_memory((const char *) buf, len);
+		if (!reader) {
+			return ENOMEM;
+		}
+		rval = file_fit_encoded(w->writers_schema, reader, count, len,
+					&fit, &fit_len);
+		if (!rval && (fit != count || fit_len != len)) {
+			avro_set_error("Batch does not hold %" PRId64
+				       " values in %" PRId64 " bytes",
+				       count, len);
+			rval = EINVAL;
+		}
+		if (rval) {
+			avro_reader_free(reader);
+			return rval;
+		}
+		avro_reader_memory_set_source(reader, (const char *) buf, len);
+	}
+
+	while (count > 0) {
+		int64_t room = (int64_t) w->datum_buffer_size - (int64_t) w->block_size;
+		int64_t fit, fit_len;
+
+		if (len <= room) {
+			fit = count;
+			fit_len = len;
+		} else if (w->block_count) {
+			rval = file_write_block(w);
+			if (rval) {
+				break;
+			}
+			continue;
+		} else {
+			/* More than a block holds: split it between values. */
+			if (!reader) {
+				reader = avro_reader_memory((const char *) buf, len);
+				if (!reader) {
+					return ENOMEM;
+				}
+			}
+			rval = file_fit_encoded(w->writers_schema, reader, count,
+						room, &fit, &fit_len);
+			if (rval) {
+				break;
+			}
+			if (fit == 0) {
+				avro_set_error("Value too large for file block size");
+				rval = EINVAL;
+				break;
+			}
+		}
+
+		rval = avro_write(w->datum_writer, (void *) buf, fit_len);
+		if (rval) {
+			break;
+		}
+		w->block_count += (int) fit;
+		w->block_size = avro_writer_tell(w->datum_writer);
+		buf = (const char *) buf + fit_len;
+		len -= fit_len;
+		count -= fit;
+	}
+
+	if (reader) {
+		avro_reader_free(reader);
+	}
+	return rval;
+}
+
+int avro_file_writer_set_codec_level(avro_file_writer_t w, int level)
+{
+	int rval;
+	check_param(EINVAL, w, "writer");
+	check(rval, file_writer_idle(w));
+	check(rval, avro_codec_set_level(w->codec, level));
+	w->codec_level = level;
+	w->codec_level_set = 1;
+	return 0;
+}
+
+int avro_file_writer_sync(avro_file_writer_t w)
+{
+	int rval;
+	check(rval, file_write_block(w));
+	return file_writer_idle(w);
+}
+
+int avro_file_writer_flush(avro_file_writer_t w)
+{
+	int rval;
+	check(rval, file_write_block(w));
+	check(rval, file_writer_idle(w));
+	avro_writer_flush(w->writer);
+	return 0;
+}
+
+int avro_file_writer_close(avro_file_writer_t w)
+{
+	int rval = avro_file_writer_flush(w);
+#ifdef AVRO_DATAFILE_THREADS
+	if (w->background) {
+		/*
+		 * A failed block fails every later call, closing again
+		 * included, so the writer is released all the same.
+		 */
+		int stopped = background_stop(w);
+		if (!rval) {
+			rval = stopped;
+		}
+	} else
+#endif
+	if (rval) {
+		return rval;
+	}
+	avro_schema_decref(w->writers_schema);
+	avro_writer_free(w->datum_writer);
+	avro_writer_free(w->writer);
+	avro_free(w->datum_buffer, w->datum_buffer_size);
+	avro_codec_reset(w->codec);
+	avro_freet(struct avro_codec_t_, w->codec);
+	avro_freet(struct avro_file_writer_t_, w);
+	return rval;
+}
+
+#ifdef AVRO_DATAFILE_THREADS
+
+/*
+ * Block prefetching.  The consumer thread reads the compressed blocks
+ * ahead of itself into a ring of slots, and worker threads decode them.
+ * Each slot has its own codec, and so its own output buffer, which the
+ * consumer reads values from once the slot is done.  A slot holding an
+ * error, or EOF, ends the ring.  With a formatter, the workers go on to
+ * format the values of the decoded block into the slot's text, and the
+ * consumer takes that instead of the values.
+ */
+
+enum prefetch_slot_state {
+	SLOT_EMPTY,
+	SLOT_PENDING,
+	SLOT_RUNNING,
+	SLOT_DONE
+};
+
+struct prefetch_slot {
+	enum prefetch_slot_state state;
+	int64_t count;
+	int64_t len;
+	char *input;
+	char *buffer;
+	int64_t buffer_len;
+	struct avro_codec_t_ codec;
+	int64_t first;		/* the position of the block's first value */
+	int64_t start;		/* the position of the block in the file */
+	avro_reader_t block_reader;
+	char *text;
+	size_t text_size;
+	size_t text_len;
+	int rval;
+	char error[256];
+};
+
+struct file_prefetch {
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	int stop;
+	int finished;
+	int nthreads;
+	pthread_t *threads;
+	int nslots;
+	struct prefetch_slot *slots;
+	int head;		/* the oldest filled slot */
+	int filled;		/* the number of filled slots */
+	int current;		/* whether the consumer is reading the head */
+	avro_schema_t writers_schema;
+	avro_file_block_formatter_t formatter;
+	void *user_data;
+	int64_t next_first;	/* the position of the next block read */
+	/* The text of the block being read when prefetching started. */
+	int started;
+	char *text;
+	size_t text_size;
+	size_t text_len;
+	/*
+	 * An error formatting a block, put off until the text of the
+	 * values formatted before it has been taken.
+	 */
+	int deferred_rval;
+	char deferred_error[256];
+};
+
+static void prefetch_save_error(struct prefetch_slot *slot, int rval)
+{
+	slot->rval = rval;
+	strncpy(slot->error, avro_strerror(), sizeof(slot->error) - 1);
+	slot->error[sizeof(slot->error) - 1] = '\0';
+}
+
+static void *prefetch_worker(void *arg)
+{
+	struct file_prefetch *p = (struct file_prefetch *) arg;
+
+	pthread_mutex_lock(&p->lock);
+	while (!p->stop) {
+		struct prefetch_slot *slot = NULL;
+		int i;
+
+		/* Oldest first, since the consumer waits for those. */
+		for (i = 0; i < p->filled; i++) {
+			struct prefetch_slot *s = &p->slots[(p->head + i) % p->nslots];
+			if (s->state == SLOT_PENDING) {
+				slot = s;
+				break;
+			}
+		}
+		if (slot == NULL) {
+			pthread_cond_wait(&p->work, &p->lock);
+			continue;
+		}
+
+		slot->state = SLOT_RUNNING;
+		pthread_mutex_unlock(&p->lock);
+
+		if (avro_codec_decode(&slot->codec, slot->input, slot->len)) {
+			avro_prefix_error("Cannot decode file block: ");
+			prefetch_save_error(slot, EILSEQ);
+		} else if (p->formatter) {
+			int rval;
+			avro_reader_memory_set_source(slot->block_reader,
+						      (const char *) slot->codec.block_data,
+						      slot->codec.used_size);
+			rval = p->formatter(p->user_data, slot->block_reader,
+					    p->writers_schema, slot->first, slot->count,
+					    &slot->text, &slot->text_size, &slot->text_len);
+			if (rval) {
+				avro_prefix_error("Cannot format file block: ");
+				prefetch_save_error(slot, rval);
+			}
+		}
+
+		pthread_mutex_lock(&p->lock);
+		slot->state = SLOT_DONE;
+		pthread_cond_broadcast(&p->done);
+	}
+	pthread_mutex_unlock(&p->lock);
+	return NULL;
+}
+
+/*
+ * Reads the sync marker ending the previous block, and the next
+ * block, into a slot.  Only the consumer touches an empty slot, so this
+ * runs without the lock.
+ */
+static void prefetch_read(avro_file_reader_t r, struct prefetch_slot *slot)
+{
+	int rval;
+	char sync[16];
+	const avro_encoding_t *enc = &avro_binary_encoding;
+
+	slot->rval = 0;
+	slot->len = 0;
+	slot->text_len = 0;
+
+	rval = avro_read(r->reader, sync, sizeof(sync));
+	if (rval) {
+		prefetch_save_error(slot, rval);
+		return;
+	}
+	if (memcmp(r->sync, sync, sizeof(r->sync)) != 0) {
+		avro_set_error("Incorrect sync bytes");
+		prefetch_save_error(slot, EILSEQ);
+		return;
+	}
+
+	slot->start = avro_reader_tell(r->reader);
+	rval = enc->read_long(r->reader, &slot->count);
+	if ((rval == EILSEQ || rval == ENOSPC) && avro_reader_is_eof(r->reader)) {
+		slot->rval = EOF;
+		return;
+	}
+	if (rval) {
+		avro_prefix_error("Cannot read file block count: ");
+		prefetch_save_error(slot, rval);
+		return;
+	}
+
+	rval = enc->read_long(r->reader, &slot->len);
+	if (rval) {
+		avro_prefix_error("Cannot read file block size: ");
+		prefetch_save_error(slot, rval);
+		return;
+	}
+	if (slot->len < 0) {
+		avro_set_error("Invalid file block size: %" PRId64, slot->len);
+		prefetch_save_error(slot, EILSEQ);
+		return;
+	}
+
+	if (is_memory_io(r->reader)) {
+		struct _avro_reader_memory_t *mem = avro_reader_to_memory(r->reader);
+		slot->input = (char *) mem->buf + mem->read;
+		rval = avro_skip(r->reader, slot->len);
+	} else {
+		if (slot->len > slot->buffer_len) {
+			char *buffer = (char *) avro_realloc(slot->buffer, slot->buffer_len, slot->len);
+			if (!buffer) {
+				avro_set_error("Cannot allocate file block");
+				prefetch_save_error(slot, ENOMEM);
+				return;
+			}
+			slot->buffer = buffer;
+			slot->buffer_len = slot->len;
+		}
+		slot->input = slot->buffer;
+		rval = avro_read(r->reader, slot->buffer, slot->len);
+	}
+	if (rval) {
+		avro_prefix_error("Cannot read file block: ");
+		prefetch_save_error(slot, rval);
+	}
+}
+
+/*
+ * Fills every free slot, stopping at the end of the file or the first
+ * error.
+ */
+static void prefetch_fill(avro_file_reader_t r)
+{
+	struct file_prefetch *p = r->prefetch;
+
+	while (!p->finished && p->filled < p->nslots) {
+		struct prefetch_slot *slot = &p->slots[(p->head + p->filled) % p->nslots];
+
+		prefetch_read(r, slot);
+		slot->first = p->next_first;
+		if (!slot->rval) {
+			p->next_first += slot->count;
+		}
+
+		pthread_mutex_lock(&p->lock);
+		if (slot->rval) {
+			p->finished = 1;
+			slot->state = SLOT_DONE;
+		} else if (slot->len == 0) {
+			slot->state = SLOT_DONE;
+		} else {
+			slot->state = SLOT_PENDING;
+			pthread_cond_signal(&p->work);
+		}
+		p->filled++;
+		pthread_mutex_unlock(&p->lock);
+	}
+}
+
+static int prefetch_next_block(avro_file_reader_t r)
+{
+	int rval;
+	struct file_prefetch *p = r->prefetch;
+	struct prefetch_slot *slot;
+
+	/* The block being read is finished with, so its slot is free. */
+	if (p->current) {
+		pthread_mutex_lock(&p->lock);
+		p->slots[p->head].state = SLOT_EMPTY;
+		p->head = (p->head + 1) % p->nslots;
+		p->filled--;
+		p->current = 0;
+		pthread_mutex_unlock(&p->lock);
+	}
+
+	prefetch_fill(r);
+
+	slot = &p->slots[p->head];
+	pthread_mutex_lock(&p->lock);
+	while (slot->state != SLOT_DONE) {
+		pthread_cond_wait(&p->done, &p->lock);
+	}
+	pthread_mutex_unlock(&p->lock);
+
+	/* An error stays at the head, to be returned from then on. */
+	if (slot->rval) {
+		if (slot->rval != EOF) {
+			avro_set_error("%s", slot->error);
+		}
+		return slot->rval;
+	}
+
+	p->current = 1;
+	r->blocks_total = slot->count;
+	r->blocks_read = 0;
+	r->block_start = slot->start;
+	if (slot->len > 0) {
+		avro_reader_memory_set_source(r->block_reader, (const char *) slot->codec.block_data, slot->codec.used_size);
+	} else {
+		avro_reader_memory_set_source(r->block_reader, NULL, 0);
+	}
+	if (r->zero_copy) {
+		check(rval, file_wrap_block(r));
+	}
+	return 0;
+}
+
+static void prefetch_free(struct file_prefetch *p)
+{
+	int i;
+
+	pthread_mutex_lock(&p->lock);
+	p->stop = 1;
+	pthread_cond_broadcast(&p->work);
+	pthread_mutex_unlock(&p->lock);
+	for (i = 0; i < p->nthreads; i++) {
+		pthread_join(p->threads[i], NULL);
+	}
+
+	for (i = 0; i < p->nslots; i++) {
+		avro_codec_reset(&p->slots[i].codec);
+		if (p->slots[i].buffer) {
+			avro_free(p->slots[i].buffer, p->slots[i].buffer_len);
+		}
+		if (p->slots[i].block_reader) {
+			avro_reader_free(p->slots[i].block_reader);
+		}
+		if (p->slots[i].text) {
+			avro_free(p->slots[i].text, p->slots[i].text_size);
+		}
+	}
+	if (p->text) {
+		avro_free(p->text, p->text_size);
+	}
+	pthread_mutex_destroy(&p->lock);
+	pthread_cond_destroy(&p->work);
+	pthread_cond_destroy(&p->done);
+	avro_free(p->threads, sizeof(pthread_t) * p->nthreads);
+	avro_free(p->slots, sizeof(struct prefetch_slot) * p->nslots);
+	avro_freet(struct file_prefetch, p);
+}
+
+#endif
+
+static int
+file_reader_prefetch(avro_file_reader_t r, int nthreads, int depth,
+		     avro_file_block_formatter_t formatter, void *user_data)
+{
+#ifdef AVRO_DATAFILE_THREADS
+	struct file_prefetch *p;
+	int i;
+
+	check_param(EINVAL, r, "reader");
+	if (nthreads <= 0 || depth <= 0) {
+		avro_set_error("Invalid prefetch of %d blocks on %d threads",
+			       depth, nthreads);
+		return EINVAL;
+	}
+	if (r->prefetch) {
+		avro_set_error("File reader is already prefetching");
+		return EINVAL;
+	}
+	if (r->blocks_total == 0) {
+		/* an empty file */
+		return 0;
+	}
+
+	p = (struct file_prefetch *) avro_new(struct file_prefetch);
+	if (!p) {
+		avro_set_error("Cannot allocate block prefetcher");
+		return ENOMEM;
+	}
+	memset(p, 0, sizeof(struct file_prefetch));
+
+	/* The decoded blocks, plus the one being read. */
+	p->nslots = depth + 1;
+	p->slots = (struct prefetch_slot *) avro_malloc(sizeof(struct prefetch_slot) * p->nslots);
+	p->threads = (pthread_t *) avro_malloc(sizeof(pthread_t) * nthreads);
+	if (!p->slots || !p->threads) {
+		if (p->slots) {
+			avro_free(p->slots, sizeof(struct prefetch_slot) * p->nslots);
+		}
+		if (p->threads) {
+			avro_free(p->threads, sizeof(pthread_t) * nthreads);
+		}
+		avro_freet(struct file_prefetch, p);
+		avro_set_error("Cannot allocate block prefetcher");
+		return ENOMEM;
+	}
+	memset(p->slots, 0, sizeof(struct prefetch_slot) * p->nslots);
+	for (i = 0; i < p->nslots; i++) {
+		avro_codec(&p->slots[i].codec, r->codec->name);
+	}
+
+	p->writers_schema = r->writers_schema;
+	p->formatter = formatter;
+	p->user_data = user_data;
+	p->next_first = r->blocks_total - r->blocks_read;
+
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->work, NULL);
+	pthread_cond_init(&p->done, NULL);
+	for (i = 0; formatter && i < p->nslots; i++) {
+		p->slots[i].block_reader = avro_reader_memory(NULL, 0);
+		if (!p->slots[i].block_reader) {
+			prefetch_free(p);
+			avro_set_error("Cannot allocate block prefetcher");
+			return ENOMEM;
+		}
+	}
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&p->threads[i], NULL, prefetch_worker, p) != 0) {
+			break;
+		}
+		p->nthreads++;
+	}
+	if (p->nthreads < nthreads) {
+		prefetch_free(p);
+		avro_set_error("Cannot start block prefetching threads");
+		return EAGAIN;
+	}
+
+	/*
+	 * The block being read stays with the reader's own codec; the
+	 * first prefetched block is the one after it.
+	 */
+	r->prefetch = p;
+	return 0;
+#else
+	check_param(EINVAL, r, "reader");
+	(void) nthreads;
+	(void) depth;
+	(void) formatter;
+	(void) user_data;
+	avro_set_error("Block prefetching needs a thread-safe build");
+	return ENOSYS;
+#endif
+}
+
+int avro_file_reader_prefetch(avro_file_reader_t r, int nthreads, int depth)
+{
+	return file_reader_prefetch(r, nthreads, depth, NULL, NULL);
+}
+
+int
+avro_file_reader_prefetch_formatted(avro_file_reader_t r, int nthreads, int depth,
+				    avro_file_block_formatter_t formatter,
+				    void *user_data)
+{
+	check_param(EINVAL, formatter, "formatter");
+	return file_reader_prefetch(r, nthreads, depth, formatter, user_data);
+}
+
+static int file_read_sync(avro_file_reader_t r)
+{
+	int rval;
+	char sync[16];
+
+	/* reads sync bytes and buffers further bytes */
+	check(rval, avro_read(r->reader, sync, sizeof(sync)));
+	if (memcmp(r->sync, sync, sizeof(r->sync)) != 0) {
+		/* wrong sync bytes */
+		avro_set_error("Incorrect sync bytes");
+		return EILSEQ;
+	}
+	return 0;
+}
+
+/*
+ * Moves on to the next block once the current one has been read.
+ */
+static int file_next_block(avro_file_reader_t r)
+{
+	int rval;
+
+#ifdef AVRO_DATAFILE_THREADS
+	if (r->prefetch) {
+		return prefetch_next_block(r);
+	}
+#endif
+
+	check(rval, file_read_sync(r));
+	return file_read_block_count(r);
+}
+
+/*
+ * Reads the block at the reader's position, as the first one after a
+ * seek; the end of the file leaves the reader with nothing to read.
+ */
+static int file_read_block_at(avro_file_reader_t r)
+{
+	int rval = file_read_block_count(r);
+	if (rval == EOF) {
+		r->blocks_total = 0;
+		r->blocks_read = 0;
+		return 0;
+	}
+	return rval;
+}
+
+int avro_file_reader_seek(avro_file_reader_t r, int64_t position)
+{
 	int rval;
-	check(rval, avro_file_writer_flush(w));
-	avro_schema_decref(w->writers_schema);
-	avro_writer_free(w->datum_writer);
-	avro_writer_free(w->writer);
-	avro_free(w->datum_buffer, w->datum_buffer_size);
-	avro_codec_reset(w->codec);
-	avro_freet(struct avro_codec_t_, w->codec);
-	avro_freet(struct avro_file_writer_t_, w);
+
+	check_param(EINVAL, r, "reader");
+	if (r->prefetch) {
+		avro_set_error("Cannot seek a prefetching file reader");
+		return EINVAL;
+	}
+	check(rval, avro_reader_seek(r->reader, position));
+	return file_read_block_at(r);
+}
+
+int avro_file_reader_sync(avro_file_reader_t r, int64_t position)
+{
+	int rval;
+
+	check_param(EINVAL, r, "reader");
+	if (r->prefetch) {
+		avro_set_error("Cannot sync a prefetching file reader");
+		return EINVAL;
+	}
+	check(rval, avro_reader_seek(r->reader, position));
+	rval = avro_reader_skip_past(r->reader, r->sync, sizeof(r->sync));
+	if (rval == EOF) {
+		r->block_start = avro_reader_tell(r->reader);
+		r->blocks_total = 0;
+		r->blocks_read = 0;
+		return 0;
+	}
+	check(rval, rval);
+	return file_read_block_at(r);
+}
+
+int avro_file_reader_past_sync(avro_file_reader_t r, int64_t position,
+			       int *past)
+{
+	int rval;
+
+	check_param(EINVAL, r, "reader");
+	check_param(EINVAL, past, "past");
+
+	/* The next block tells, once this one has been read. */
+	while (r->blocks_total != 0 && r->blocks_read == r->blocks_total) {
+		rval = file_next_block(r);
+		if (rval == EOF) {
+			r->blocks_total = 0;
+			r->blocks_read = 0;
+		} else if (rval) {
+			return rval;
+		}
+	}
+	*past = r->blocks_total == 0 ||
+	    r->block_start >= position + (int64_t) sizeof(r->sync);
+	return 0;
+}
+
+int64_t avro_file_reader_previous_sync(avro_file_reader_t r)
+{
+	check_param(-1, r, "reader");
+	return r->block_start;
+}
+
+static void file_clear_datum(avro_file_reader_t r)
+{
+	if (r->datum) {
+		avro_datum_decref(r->datum);
+		r->datum = NULL;
+	}
+	if (r->datum_resolver) {
+		avro_value_iface_decref(r->datum_resolver);
+		r->datum_resolver = NULL;
+	}
+	if (r->datum_schema) {
+		avro_schema_decref(r->datum_schema);
+		r->datum_schema = NULL;
+	}
+}
+
+/*
+ * Reads the next value as a datum of readers_schema.  The resolver is
+ * built once per reader schema instead of once per value, and with
+ * reuse on, the last datum is read into again once the caller has
+ * released it, so that it costs no more allocations than a value.
+ */
+
+static int file_read_datum(avro_file_reader_t r, avro_schema_t readers_schema,
+			   avro_datum_t * datum)
+{
+	int rval;
+	avro_datum_t result;
+
+	if (!readers_schema) {
+		readers_schema = r->writers_schema;
+	}
+
+	if (readers_schema != r->datum_schema) {
+		file_clear_datum(r);
+		if (readers_schema != r->writers_schema &&
+		    !avro_schema_equal(r->writers_schema, readers_schema)) {
+			r->datum_resolver =
+			    avro_resolved_writer_new(r->writers_schema,
+						     readers_schema);
+			if (!r->datum_resolver) {
+				return EINVAL;
+			}
+		}
+		r->datum_schema = avro_schema_incref(readers_schema);
+	}
+
+	/* Only we hold the last datum once the caller has released it. */
+	if (r->datum && avro_refcount_is_unique(&r->datum->refcount)) {
+		result = r->datum;
+	} else {
+		result = avro_datum_from_schema(readers_schema);
+		if (!result) {
+			return EINVAL;
+		}
+		if (r->datum) {
+			avro_datum_decref(r->datum);
+			r->datum = NULL;
+		}
+	}
+
+	rval = avro_read_datum_resolved(r->block_reader, r->datum_resolver,
+					result);
+	if (rval) {
+		if (result != r->datum) {
+			avro_datum_decref(result);
+		}
+		return rval;
+	}
+
+	if (r->reuse_datum) {
+		r->datum = result;
+		avro_datum_incref(result);
+	}
+	*datum = result;
 	return 0;
 }
 
@@ -689,7 +1878,6 @@ int avro_file_reader_read(avro_file_reader_t r, avro_schema_t readers_schema,
 			  avro_datum_t * datum)
 {
 	int rval;
-	char sync[16];
 
 	check_param(EINVAL, r, "reader");
 	check_param(EINVAL, datum, "datum");
@@ -701,18 +1889,10 @@ int avro_file_reader_read(avro_file_reader_t r, avro_schema_t readers_schema,
 	}
 
 	if (r->blocks_read == r->blocks_total) {
-		check(rval, avro_read(r->reader, sync, sizeof(sync)));
-		if (memcmp(r->sync, sync, sizeof(r->sync)) != 0) {
-			/* wrong sync bytes */
-			avro_set_error("Incorrect sync bytes");
-			return EILSEQ;
-		}
-		check(rval, file_read_block_count(r));
+		check(rval, file_next_block(r));
 	}
 
-	check(rval,
-	      avro_read_data(r->block_reader, r->writers_schema, readers_schema,
-			     datum));
+	check(rval, file_read_datum(r, readers_schema, datum));
 	r->blocks_read++;
 
 	return 0;
@@ -722,7 +1902,6 @@ int
 avro_file_reader_read_value(avro_file_reader_t r, avro_value_t *value)
 {
 	int rval;
-	char sync[16];
 
 	check_param(EINVAL, r, "reader");
 	check_param(EINVAL, value, "value");
@@ -734,25 +1913,436 @@ avro_file_reader_read_value(avro_file_reader_t r, avro_value_t *value)
 	}
 
 	if (r->blocks_read == r->blocks_total) {
-		/* reads sync bytes and buffers further bytes */
-		check(rval, avro_read(r->reader, sync, sizeof(sync)));
-		if (memcmp(r->sync, sync, sizeof(r->sync)) != 0) {
-			/* wrong sync bytes */
-			avro_set_error("Incorrect sync bytes");
-			return EILSEQ;
-		}
+		check(rval, file_next_block(r));
+	}
+
+	if (r->zero_copy) {
+		check(rval, avro_value_read_wrapped(r->block_reader, value, &r->block));
+	} else {
+		check(rval, avro_value_read(r->block_reader, value));
+	}
+	r->blocks_read++;
+
+	return 0;
+}
+
+int
+avro_file_reader_read_json(avro_file_reader_t r,
+			   char **buf, size_t *size, size_t *len)
+{
+	int rval;
+
+	check_param(EINVAL, r, "reader");
+
+	if (r->blocks_total == 0) {
+		return EOF;
+	}
 
-		check(rval, file_read_block_count(r));
+	if (r->blocks_read == r->blocks_total) {
+		check(rval, file_next_block(r));
 	}
 
-	check(rval, avro_value_read(r->block_reader, value));
+	check(rval, avro_binary_to_json(r->block_reader, r->writers_schema,
+					buf, size, len));
 	r->blocks_read++;
 
 	return 0;
 }
 
+int
+avro_file_reader_read_hashes(avro_file_reader_t r, uint64_t seed,
+			     uint64_t *hashes, size_t count, size_t *hashed)
+{
+	int rval;
+
+	check_param(EINVAL, r, "reader");
+	check_param(EINVAL, hashes || count == 0, "hashes");
+	check_param(EINVAL, hashed, "hashed count");
+
+	*hashed = 0;
+	if (r->blocks_total == 0) {
+		return EOF;
+	}
+
+	while (*hashed < count) {
+		size_t n;
+
+		if (r->blocks_read == r->blocks_total) {
+			rval = file_next_block(r);
+			if (rval == EOF && *hashed > 0) {
+				/* The next call returns EOF straight away. */
+				r->blocks_total = 0;
+				return 0;
+			}
+			if (rval) {
+				return rval;
+			}
+		}
+
+		n = count - *hashed;
+		if ((int64_t) n > r->blocks_total - r->blocks_read) {
+			n = r->blocks_total - r->blocks_read;
+		}
+		check(rval, avro_binary_hash_batch(r->block_reader, r->writers_schema,
+						   seed, hashes + *hashed, n));
+		r->blocks_read += n;
+		*hashed += n;
+	}
+	return 0;
+}
+
+int
+avro_file_reader_read_formatted(avro_file_reader_t r,
+				const char **text, size_t *len)
+{
+	check_param(EINVAL, r, "reader");
+	check_param(EINVAL, text, "text");
+	check_param(EINVAL, len, "text length");
+
+	if (r->blocks_total == 0) {
+		return EOF;
+	}
+
+#ifdef AVRO_DATAFILE_THREADS
+	int rval;
+	struct file_prefetch *p = r->prefetch;
+	struct prefetch_slot *slot;
+
+	if (!p || !p->formatter) {
+		avro_set_error("File reader is not formatting blocks");
+		return EINVAL;
+	}
+	if (p->deferred_rval) {
+		avro_set_error("%s", p->deferred_error);
+		return p->deferred_rval;
+	}
+
+	/*
+	 * The rest of the block being read when prefetching started is
+	 * formatted here, on the calling thread.
+	 */
+	if (!p->started) {
+		p->started = 1;
+		if (r->blocks_read < r->blocks_total) {
+			p->text_len = 0;
+			rval = p->formatter(p->user_data, r->block_reader,
+					    r->writers_schema, 0,
+					    r->blocks_total - r->blocks_read,
+					    &p->text, &p->text_size, &p->text_len);
+			r->blocks_read = r->blocks_total;
+			if (rval) {
+				avro_prefix_error("Cannot format file block: ");
+				if (p->text_len == 0) {
+					return rval;
+				}
+				p->deferred_rval = rval;
+				strncpy(p->deferred_error, avro_strerror(), sizeof(p->deferred_error) - 1);
+			}
+			*text = p->text;
+			*len = p->text_len;
+			return 0;
+		}
+	}
+
+	rval = prefetch_next_block(r);
+	slot = &p->slots[p->head];
+	if (rval && rval != EOF && slot->text_len > 0) {
+		p->deferred_rval = rval;
+		strncpy(p->deferred_error, avro_strerror(), sizeof(p->deferred_error) - 1);
+	} else if (rval) {
+		return rval;
+	}
+	r->blocks_read = r->blocks_total;
+	*text = slot->text;
+	*len = slot->text_len;
+	return 0;
+#else
+	avro_set_error("File reader is not formatting blocks");
+	return EINVAL;
+#endif
+}
+
+#ifdef AVRO_DATAFILE_THREADS
+
+/*
+ * Recompressing blocks in parallel.  Prefetching decodes the blocks,
+ * and a formatter re-encodes each one; its text is the block just as
+ * it is written, framing and sync marker included.  The workers borrow
+ * the writer's codec settings from a pool of codecs, one for each
+ * worker and one for the calling thread.
+ */
+
+struct recoder_codec {
+	struct avro_codec_t_ codec;
+	avro_writer_t writer;
+	int busy;
+};
+
+struct file_recoder {
+	avro_file_writer_t w;
+	pthread_mutex_t lock;
+	int ncodecs;
+	struct recoder_codec *codecs;
+};
+
+static int
+recode_frame(struct file_recoder *rc, struct recoder_codec *c,
+	     const char *data, int64_t data_len, int64_t count,
+	     char **buf, size_t *size, size_t *len)
+{
+	int rval;
+	const avro_encoding_t *enc = &avro_binary_encoding;
+	size_t needed;
+
+	check_prefix(rval, avro_codec_encode(&c->codec, (void *) data, data_len),
+		     "Cannot encode file block: ");
+
+	/* Two longs, the block, the sync marker and a NUL terminator. */
+	needed = *len + 20 + c->codec.used_size + sizeof(rc->w->sync) + 1;
+	if (needed > *size) {
+		size_t new_size = *size < 256 ? 256 : *size;
+		char *new_buf;
+
+		while (new_size < needed) {
+			new_size *= 2;
+		}
+		new_buf = (char *) avro_realloc(*buf, *size, new_size);
+		if (!new_buf) {
+			avro_set_error("Cannot allocate file block");
+			return ENOMEM;
+		}
+		*buf = new_buf;
+		*size = new_size;
+	}
+
+	avro_writer_memory_set_dest(c->writer, *buf + *len, *size - *len);
+	check(rval, enc->write_long(c->writer, count));
+	check(rval, enc->write_long(c->writer, c->codec.used_size));
+	check(rval, avro_write(c->writer, c->codec.block_data, c->codec.used_size));
+	check(rval, avro_write(c->writer, rc->w->sync, sizeof(rc->w->sync)));
+	*len += avro_writer_tell(c->writer);
+	(*buf)[*len] = '\0';
+	return 0;
+}
+
+static int
+recode_block(void *user_data, avro_reader_t block_reader,
+	     avro_schema_t writers_schema, int64_t first, int64_t count,
+	     char **buf, size_t *size, size_t *len)
+{
+	struct file_recoder *rc = (struct file_recoder *) user_data;
+	struct _avro_reader_memory_t *mem = avro_reader_to_memory(block_reader);
+	struct recoder_codec *c = NULL;
+	int rval;
+	int i;
+
+	(void) writers_schema;
+	(void) first;
+
+	pthread_mutex_lock(&rc->lock);
+	for (i = 0; i < rc->ncodecs; i++) {
+		if (!rc->codecs[i].busy) {
+			c = &rc->codecs[i];
+			c->busy = 1;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&rc->lock);
+
+	rval = recode_frame(rc, c, mem->buf + mem->read, mem->len - mem->read,
+			    count, buf, size, len);
+
+	pthread_mutex_lock(&rc->lock);
+	c->busy = 0;
+	pthread_mutex_unlock(&rc->lock);
+	return rval;
+}
+
+static void recoder_free(struct file_recoder *rc)
+{
+	int i;
+
+	for (i = 0; i < rc->ncodecs; i++) {
+		avro_codec_reset(&rc->codecs[i].codec);
+		if (rc->codecs[i].writer) {
+			avro_writer_free(rc->codecs[i].writer);
+		}
+	}
+	avro_free(rc->codecs, sizeof(struct recoder_codec) * rc->ncodecs);
+}
+
+static int
+file_recode_blocks(avro_file_writer_t w, avro_file_reader_t r, int nthreads)
+{
+	int rval = 0;
+	int i;
+	struct file_recoder rc;
+	const char *text;
+	size_t len;
+
+	rc.w = w;
+	rc.ncodecs = nthreads + 1;
+	rc.codecs = (struct recoder_codec *) avro_malloc(sizeof(struct recoder_codec) * rc.ncodecs);
+	if (!rc.codecs) {
+		avro_set_error("Cannot allocate block recoder");
+		return ENOMEM;
+	}
+	memset(rc.codecs, 0, sizeof(struct recoder_codec) * rc.ncodecs);
+	for (i = 0; !rval && i < rc.ncodecs; i++) {
+		rval = avro_codec(&rc.codecs[i].codec, w->codec->name);
+		if (!rval && w->codec_level_set) {
+			rval = avro_codec_set_level(&rc.codecs[i].codec, w->codec_level);
+		}
+		if (!rval) {
+			rc.codecs[i].writer = avro_writer_memory(NULL, 0);
+			if (!rc.codecs[i].writer) {
+				rval = ENOMEM;
+			}
+		}
+	}
+	if (rval) {
+		recoder_free(&rc);
+		return rval;
+	}
+
+	pthread_mutex_init(&rc.lock, NULL);
+	rval = file_reader_prefetch(r, nthreads, 2 * nthreads, recode_block, &rc);
+	if (!rval) {
+		while ((rval = avro_file_reader_read_formatted(r, &text, &len)) == 0) {
+			rval = avro_write(w->writer, (void *) text, len);
+			if (rval) {
+				avro_prefix_error("Cannot write file block: ");
+				break;
+			}
+		}
+		if (rval == EOF) {
+			rval = 0;
+		}
+
+		/* The workers use the codecs until prefetching stops. */
+		prefetch_free(r->prefetch);
+		r->prefetch = NULL;
+		r->blocks_total = 0;
+	}
+	pthread_mutex_destroy(&rc.lock);
+	recoder_free(&rc);
+	return rval;
+}
+
+#endif
+
+int
+avro_file_writer_append_blocks(avro_file_writer_t w, avro_file_reader_t r,
+			       int nthreads)
+{
+	int rval;
+	int raw;
+	char *data;
+	int64_t len;
+
+	check_param(EINVAL, w, "writer");
+	check_param(EINVAL, r, "reader");
+	if (!avro_schema_equal(w->writers_schema, r->writers_schema)) {
+		avro_set_error("Cannot append blocks of a different schema");
+		return EINVAL;
+	}
+	if (r->prefetch) {
+		avro_set_error("Cannot append blocks from a prefetching file reader");
+		return EINVAL;
+	}
+
+	/* Values appended one at a time go before the blocks. */
+	check(rval, file_write_block(w));
+	check(rval, file_writer_idle(w));
+
+	if (r->blocks_total == 0) {
+		return 0;
+	}
+
+	/*
+	 * The blocks are copied as they are if the writer encodes them the
+	 * same way, and are otherwise decoded and encoded again.
+	 */
+	raw = strcmp(r->codec->name, w->codec->name) == 0 && !w->codec_level_set;
+
+#ifdef AVRO_DATAFILE_THREADS
+	if (!raw && nthreads > 0) {
+		return file_recode_blocks(w, r, nthreads);
+	}
+#else
+	(void) nthreads;
+#endif
+
+	/* What is left of the current block has been decoded already. */
+	if (r->blocks_read < r->blocks_total) {
+		struct _avro_reader_memory_t *mem = avro_reader_to_memory(r->block_reader);
+		check(rval, file_write_block_data(w, (char *) mem->buf + mem->read,
+						  r->blocks_total - r->blocks_read,
+						  mem->len - mem->read));
+	}
+
+	for (;;) {
+		rval = file_read_sync(r);
+		if (!rval) {
+			rval = file_read_raw_block(r, &data, &len);
+		}
+		if (rval == EOF) {
+			break;
+		}
+		if (rval) {
+			return rval;
+		}
+
+		if (raw) {
+			check(rval, file_write_raw_block(w, data, r->blocks_total, len));
+		} else if (len > 0) {
+			check_prefix(rval, avro_codec_decode(r->codec, data, len),
+				     "Cannot decode file block: ");
+			check(rval, file_write_block_data(w, (char *) r->codec->block_data,
+							  r->blocks_total, r->codec->used_size));
+		}
+	}
+
+	/* Every value has been read. */
+	r->blocks_total = 0;
+	return 0;
+}
+
+int
+avro_file_reader_set_datum_reuse(avro_file_reader_t r, int enabled)
+{
+	check_param(EINVAL, r, "reader");
+
+	if (!enabled && r->datum) {
+		avro_datum_decref(r->datum);
+		r->datum = NULL;
+	}
+	r->reuse_datum = enabled;
+	return 0;
+}
+
+int
+avro_file_reader_set_zero_copy(avro_file_reader_t r, int enabled)
+{
+	int rval;
+
+	check_param(EINVAL, r, "reader");
+
+	if (enabled && !r->zero_copy && r->blocks_total > 0) {
+		check(rval, file_wrap_block(r));
+	}
+	r->zero_copy = enabled;
+	return 0;
+}
+
 int avro_file_reader_close(avro_file_reader_t reader)
 {
+#ifdef AVRO_DATAFILE_THREADS
+	if (reader->prefetch) {
+		prefetch_free(reader->prefetch);
+	}
+#endif
+	file_clear_datum(reader);
 	avro_schema_decref(reader->writers_schema);
 	avro_reader_free(reader->reader);
 	avro_reader_free(reader->block_reader);
@@ -761,6 +2351,7 @@ int avro_file_reader_close(avro_file_reader_t reader)
 	if (reader->current_blockdata) {
 		avro_free(reader->current_blockdata, reader->current_blocklen);
 	}
+	avro_wrapped_buffer_free(&reader->block);
 	avro_freet(struct avro_file_reader_t_, reader);
 	return 0;
 }
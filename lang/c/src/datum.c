@@ -1241,6 +1241,14 @@ avro_datum_t avro_datum_incref(avro_datum_t datum)
 	return datum;
 }
 
+void avro_datum_make_local(avro_datum_t datum)
+{
+	int  count = datum->refcount;
+	if (count != (int) -1 && !(count & AVRO_REFCOUNT_LOCAL)) {
+		avro_refcount_set_local(&datum->refcount, count);
+	}
+}
+
 void avro_datum_decref(avro_datum_t datum)
 {
 	if (datum && avro_refcount_dec(&datum->refcount)) {
@@ -20,8 +20,10 @@
 #include <avro/platform.h>
 #include "avro/basics.h"
 #include "avro/data.h"
+#include "avro/io.h"
 #include "avro/legacy.h"
 #include "avro/schema.h"
+#include "avro/value.h"
 #include "avro_private.h"
 #include "st.h"
 
@@ -120,4 +122,12 @@ struct avro_union_datum_t {
 #define avro_datum_to_array(datum_)     (container_of(datum_, struct avro_array_datum_t, obj))
 #define avro_datum_to_union(datum_)	(container_of(datum_, struct avro_union_datum_t, obj))
 
+/*
+ * Reads a value into an existing datum through the given resolved
+ * writer, or straight into the datum if resolver is NULL.
+ */
+
+int avro_read_datum_resolved(avro_reader_t reader,
+			     avro_value_iface_t *resolver, avro_datum_t datum);
+
 #endif
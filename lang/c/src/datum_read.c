@@ -25,6 +25,7 @@
 #include "avro/schema.h"
 #include "avro/value.h"
 #include "avro_private.h"
+#include "datum.h"
 
 int
 avro_schema_match(avro_schema_t wschema, avro_schema_t rschema)
@@ -42,6 +43,53 @@ avro_schema_match(avro_schema_t wschema, avro_schema_t rschema)
 	return 0;
 }
 
+/*
+ * Finds the resolver that reads data written with writers_schema into
+ * a datum of readers_schema.  When the two schemas are the same, no
+ * resolution is needed, and the data is read straight into the datum,
+ * which is what *resolver is left NULL for.
+ */
+
+static int
+datum_resolver(avro_schema_t writers_schema, avro_schema_t readers_schema,
+	       avro_value_iface_t **resolver)
+{
+	*resolver = NULL;
+	if (writers_schema == readers_schema ||
+	    avro_schema_equal(writers_schema, readers_schema)) {
+		return 0;
+	}
+
+	*resolver = avro_resolved_writer_new_cached(writers_schema, readers_schema);
+	return *resolver ? 0 : EINVAL;
+}
+
+int
+avro_read_datum_resolved(avro_reader_t reader, avro_value_iface_t *resolver,
+			 avro_datum_t datum)
+{
+	int rval;
+	avro_value_t  value;
+	avro_value_t  resolved_value;
+
+	check(rval, avro_datum_as_value(&value, datum));
+
+	if (!resolver) {
+		rval = avro_value_read(reader, &value);
+		avro_value_decref(&value);
+		return rval;
+	}
+
+	rval = avro_resolved_writer_new_value(resolver, &resolved_value);
+	if (rval == 0) {
+		avro_resolved_writer_set_dest(&resolved_value, &value);
+		rval = avro_value_read(reader, &resolved_value);
+		avro_value_decref(&resolved_value);
+	}
+	avro_value_decref(&value);
+	return rval;
+}
+
 int
 avro_read_data(avro_reader_t reader, avro_schema_t writers_schema,
 	       avro_schema_t readers_schema, avro_datum_t * datum)
@@ -56,44 +104,56 @@ avro_read_data(avro_reader_t reader, avro_schema_t writers_schema,
 		readers_schema = writers_schema;
 	}
 
+	avro_value_iface_t  *resolver;
+	check(rval, datum_resolver(writers_schema, readers_schema, &resolver));
+
 	avro_datum_t  result = avro_datum_from_schema(readers_schema);
 	if (!result) {
+		if (resolver) {
+			avro_value_iface_decref(resolver);
+		}
 		return EINVAL;
 	}
 
-	avro_value_t  value;
-	check(rval, avro_datum_as_value(&value, result));
-
-	avro_value_iface_t  *resolver =
-	    avro_resolved_writer_new(writers_schema, readers_schema);
-	if (!resolver) {
-		avro_value_decref(&value);
-		avro_datum_decref(result);
-		return EINVAL;
-	}
-
-	avro_value_t  resolved_value;
-	rval = avro_resolved_writer_new_value(resolver, &resolved_value);
-	if (rval) {
+	rval = avro_read_datum_resolved(reader, resolver, result);
+	if (resolver) {
 		avro_value_iface_decref(resolver);
-		avro_value_decref(&value);
-		avro_datum_decref(result);
-		return rval;
 	}
-
-	avro_resolved_writer_set_dest(&resolved_value, &value);
-	rval = avro_value_read(reader, &resolved_value);
 	if (rval) {
-		avro_value_decref(&resolved_value);
-		avro_value_iface_decref(resolver);
-		avro_value_decref(&value);
 		avro_datum_decref(result);
 		return rval;
 	}
 
-	avro_value_decref(&resolved_value);
-	avro_value_iface_decref(resolver);
-	avro_value_decref(&value);
 	*datum = result;
 	return 0;
 }
+
+int
+avro_read_data_into(avro_reader_t reader, avro_schema_t writers_schema,
+		    avro_schema_t readers_schema, avro_datum_t datum)
+{
+	int rval;
+
+	check_param(EINVAL, reader, "reader");
+	check_param(EINVAL, is_avro_schema(writers_schema), "writer schema");
+	check_param(EINVAL, is_avro_datum(datum), "datum");
+
+	if (!readers_schema) {
+		readers_schema = writers_schema;
+	}
+
+	avro_schema_t  datum_schema = avro_datum_get_schema(datum);
+	if (datum_schema != readers_schema &&
+	    !avro_schema_equal(datum_schema, readers_schema)) {
+		avro_set_error("Datum does not have the reader schema");
+		return EINVAL;
+	}
+
+	avro_value_iface_t  *resolver;
+	check(rval, datum_resolver(writers_schema, readers_schema, &resolver));
+	rval = avro_read_datum_resolved(reader, resolver, datum);
+	if (resolver) {
+		avro_value_iface_decref(resolver);
+	}
+	return rval;
+}
@@ -16,103 +16,552 @@
  */
 
 #include "avro_private.h"
+#include "avro/allocation.h"
 #include "avro/errors.h"
+#include "avro/refcount.h"
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include "avro_io_internal.h"
 #include "encoding.h"
 #include "schema.h"
+#include "st.h"
 
-static int skip_array(avro_reader_t reader, const avro_encoding_t * enc,
-		      struct avro_array_schema_t *writers_schema)
+#define MAX_VARINT_SIZE 10
+
+#if defined THREADSAFE && (defined __unix__ || defined __unix)
+#include <pthread.h>
+static pthread_mutex_t  plan_lock = PTHREAD_MUTEX_INITIALIZER;
+#define plan_lock()    pthread_mutex_lock(&plan_lock)
+#define plan_unlock()  pthread_mutex_unlock(&plan_lock)
+#else
+#define plan_lock()
+#define plan_unlock()
+#endif
+
+/*
+ * Values are skipped by running a plan compiled from their schema
+ * rather than by walking the schema itself.  A plan is a set of
+ * sequences of steps, the first of which skips the whole value.  Runs
+ * of fixed-width values are fused into one step that skips their bytes
+ * at once, and runs of longs, ints and enums into one that skips that
+ * many varints.  Records are inlined into the sequence holding them
+ * unless they hold themselves; array items, map values and union
+ * branches get sequences of their own.
+ *
+ * A record memoizes its plan, along with the schema stamp the plan was
+ * compiled at (see schema.h), so that skipping the same record again
+ * costs nothing but a lookup.  Plans come from the backing allocator,
+ * so that a memo outlives any arena bound while it was compiled.
+ */
+
+enum skip_step_kind {
+	SKIP_BYTES,		/* n bytes */
+	SKIP_VARINTS,		/* n varints */
+	SKIP_LENGTHS,		/* n strings or bytes */
+	SKIP_ARRAY,		/* blocks of items, each sequence seq */
+	SKIP_MAP,		/* blocks of keys and values, each sequence seq */
+	SKIP_UNION,		/* one of n branches, listed from branches[seq] */
+	SKIP_CALL		/* sequence seq */
+};
+
+struct skip_step {
+	enum skip_step_kind kind;
+	int64_t n;
+	size_t seq;
+};
+
+struct skip_seq {
+	struct skip_step *steps;
+	size_t count;
+	size_t size;
+};
+
+struct avro_skip_plan {
+	volatile int refcount;
+	uint32_t stamp;
+	struct skip_seq *seqs;
+	size_t seq_count;
+	size_t seq_size;
+	size_t *branches;
+	size_t branch_count;
+	size_t branch_size;
+};
+
+/*
+ * The records being compiled into sequences of their own, by schema,
+ * when a plan is compiled.
+ */
+struct plan_compiler {
+	struct avro_skip_plan *plan;
+	st_table *records;
+};
+
+static int
+grow(void **items, size_t *size, size_t count, size_t item_size)
+{
+	size_t new_size;
+	void *bigger;
+
+	if (count < *size) {
+		return 0;
+	}
+	new_size = *size ? *size * 2 : 4;
+	bigger = avro_backing_realloc(*items, *size * item_size, new_size * item_size);
+	if (!bigger) {
+		avro_set_error("Cannot allocate skip plan");
+		return ENOMEM;
+	}
+	*items = bigger;
+	*size = new_size;
+	return 0;
+}
+
+static void plan_free(struct avro_skip_plan *plan)
+{
+	size_t i;
+	for (i = 0; i < plan->seq_count; i++) {
+		struct skip_seq *seq = &plan->seqs[i];
+		if (seq->steps) {
+			avro_backing_realloc(seq->steps, seq->size * sizeof(struct skip_step), 0);
+		}
+	}
+	if (plan->seqs) {
+		avro_backing_realloc(plan->seqs, plan->seq_size * sizeof(struct skip_seq), 0);
+	}
+	if (plan->branches) {
+		avro_backing_realloc(plan->branches, plan->branch_size * sizeof(size_t), 0);
+	}
+	avro_backing_freet(struct avro_skip_plan, plan);
+}
+
+void avro_skip_plan_decref(struct avro_skip_plan *plan)
+{
+	if (plan && avro_refcount_dec(&plan->refcount)) {
+		plan_free(plan);
+	}
+}
+
+static int new_seq(struct avro_skip_plan *plan, size_t *index)
 {
 	int rval;
-	int64_t i;
-	int64_t block_count;
-	int64_t block_size;
+	check(rval, grow((void **) &plan->seqs, &plan->seq_size,
+			 plan->seq_count, sizeof(struct skip_seq)));
+	*index = plan->seq_count++;
+	memset(&plan->seqs[*index], 0, sizeof(struct skip_seq));
+	return 0;
+}
 
-	check_prefix(rval, enc->read_long(reader, &block_count),
-		     "Cannot read array block count: ");
+/*
+ * Appends a step to a sequence, fusing it into the last one when both
+ * skip bytes, varints or lengths.
+ */
+static int
+emit(struct avro_skip_plan *plan, size_t s, enum skip_step_kind kind,
+     int64_t n, size_t target)
+{
+	int rval;
+	struct skip_seq *seq = &plan->seqs[s];
+	struct skip_step *last = seq->count ? &seq->steps[seq->count - 1] : NULL;
 
-	while (block_count != 0) {
-		if (block_count < 0) {
-			block_count = block_count * -1;
-			check_prefix(rval, enc->read_long(reader, &block_size),
-				     "Cannot read array block size: ");
+	if (kind <= SKIP_LENGTHS) {
+		if (n == 0) {
+			return 0;
+		}
+		if (last && last->kind == kind) {
+			last->n += n;
+			return 0;
+		}
+	}
+	check(rval, grow((void **) &seq->steps, &seq->size, seq->count,
+			 sizeof(struct skip_step)));
+	seq->steps[seq->count].kind = kind;
+	seq->steps[seq->count].n = n;
+	seq->steps[seq->count].seq = target;
+	seq->count++;
+	return 0;
+}
+
+/*
+ * Whether a record can be reached from schema, and so would be inlined
+ * into itself.  visiting holds the records on the way, so that other
+ * recursive records end the search.
+ */
+static int
+reaches(avro_schema_t schema, avro_schema_t record, st_table *visiting)
+{
+	long i;
+	st_data_t key;
+
+	switch (avro_typeof(schema)) {
+	case AVRO_RECORD:
+		if (schema == record) {
+			return 1;
+		}
+		if (st_lookup(visiting, (st_data_t) schema, NULL)) {
+			return 0;
+		}
+		st_insert(visiting, (st_data_t) schema, 0);
+		for (i = 0; i < avro_schema_to_record(schema)->fields->num_entries; i++) {
+			if (reaches(avro_schema_record_field_get_by_index(schema, i),
+				    record, visiting)) {
+				return 1;
+			}
 		}
+		key = (st_data_t) schema;
+		st_delete(visiting, &key, NULL);
+		return 0;
 
-		for (i = 0; i < block_count; i++) {
-			check_prefix(rval, avro_skip_data(reader, writers_schema->items),
-				     "Cannot skip array element: ");
+	case AVRO_ARRAY:
+		return reaches(avro_schema_to_array(schema)->items, record, visiting);
+
+	case AVRO_MAP:
+		return reaches(avro_schema_to_map(schema)->values, record, visiting);
+
+	case AVRO_UNION:
+		for (i = 0; i < avro_schema_to_union(schema)->branches->num_entries; i++) {
+			if (reaches(avro_schema_union_branch(schema, i), record, visiting)) {
+				return 1;
+			}
 		}
+		return 0;
+
+	case AVRO_LINK:
+		return reaches(avro_schema_to_link(schema)->to, record, visiting);
+
+	default:
+		return 0;
+	}
+}
+
+static int is_recursive(avro_schema_t record)
+{
+	long i;
+	int result = 0;
+	st_table *visiting = st_init_numtable();
+
+	for (i = 0; !result && i < avro_schema_to_record(record)->fields->num_entries; i++) {
+		result = reaches(avro_schema_record_field_get_by_index(record, i),
+				 record, visiting);
+	}
+	st_free_table(visiting);
+	return result;
+}
+
+static int compile(struct plan_compiler *c, size_t s, avro_schema_t schema);
 
-		check_prefix(rval, enc->read_long(reader, &block_count),
-			     "Cannot read array block count: ");
+static int compile_fields(struct plan_compiler *c, size_t s, avro_schema_t record)
+{
+	int rval;
+	long i;
+	for (i = 0; i < avro_schema_to_record(record)->fields->num_entries; i++) {
+		check(rval, compile(c, s, avro_schema_record_field_get_by_index(record, i)));
 	}
 	return 0;
 }
 
-static int skip_map(avro_reader_t reader, const avro_encoding_t * enc,
-		    struct avro_map_schema_t *writers_schema)
+/* Compiles schema into a sequence of its own. */
+static int compile_seq(struct plan_compiler *c, avro_schema_t schema, size_t *s)
 {
 	int rval;
-	int64_t i, block_count;
+	check(rval, new_seq(c->plan, s));
+	return compile(c, *s, schema);
+}
 
-	check_prefix(rval, enc->read_long(reader, &block_count),
-		     "Cannot read map block count: ");
-	while (block_count != 0) {
-		int64_t block_size;
-		if (block_count < 0) {
-			block_count = block_count * -1;
-			check_prefix(rval, enc->read_long(reader, &block_size),
-				     "Cannot read map block size: ");
+static int compile(struct plan_compiler *c, size_t s, avro_schema_t schema)
+{
+	int rval;
+	size_t target;
+	st_data_t data;
+
+	switch (avro_typeof(schema)) {
+	case AVRO_NULL:
+		return 0;
+
+	case AVRO_BOOLEAN:
+		return emit(c->plan, s, SKIP_BYTES, 1, 0);
+
+	case AVRO_INT32:
+	case AVRO_INT64:
+	case AVRO_ENUM:
+		return emit(c->plan, s, SKIP_VARINTS, 1, 0);
+
+	case AVRO_FLOAT:
+		return emit(c->plan, s, SKIP_BYTES, sizeof(float), 0);
+
+	case AVRO_DOUBLE:
+		return emit(c->plan, s, SKIP_BYTES, sizeof(double), 0);
+
+	case AVRO_STRING:
+	case AVRO_BYTES:
+		return emit(c->plan, s, SKIP_LENGTHS, 1, 0);
+
+	case AVRO_FIXED:
+		return emit(c->plan, s, SKIP_BYTES,
+			    avro_schema_to_fixed(schema)->size, 0);
+
+	case AVRO_RECORD:
+		if (st_lookup(c->records, (st_data_t) schema, &data)) {
+			return emit(c->plan, s, SKIP_CALL, 0, (size_t) data);
+		}
+		if (!is_recursive(schema)) {
+			return compile_fields(c, s, schema);
 		}
-		for (i = 0; i < block_count; i++) {
-			check_prefix(rval, enc->skip_string(reader),
-				     "Cannot skip map key: ");
-			check_prefix(rval,
-				     avro_skip_data(reader,
-						    avro_schema_to_map(writers_schema)->
-						    values),
-				     "Cannot skip map value: ");
+		check(rval, new_seq(c->plan, &target));
+		st_insert(c->records, (st_data_t) schema, (st_data_t) target);
+		check(rval, compile_fields(c, target, schema));
+		return emit(c->plan, s, SKIP_CALL, 0, target);
+
+	case AVRO_ARRAY:
+		check(rval, compile_seq(c, avro_schema_to_array(schema)->items, &target));
+		return emit(c->plan, s, SKIP_ARRAY, 0, target);
+
+	case AVRO_MAP:
+		check(rval, compile_seq(c, avro_schema_to_map(schema)->values, &target));
+		return emit(c->plan, s, SKIP_MAP, 0, target);
+
+	case AVRO_UNION:
+		{
+			struct avro_skip_plan *plan = c->plan;
+			size_t count = avro_schema_to_union(schema)->branches->num_entries;
+			size_t first = plan->branch_count;
+			size_t i;
+
+			while (plan->branch_count + count > plan->branch_size) {
+				check(rval, grow((void **) &plan->branches,
+						 &plan->branch_size,
+						 plan->branch_size, sizeof(size_t)));
+			}
+			plan->branch_count += count;
+			for (i = 0; i < count; i++) {
+				check(rval, compile_seq(c, avro_schema_union_branch(schema, i),
+							&target));
+				plan->branches[first + i] = target;
+			}
+			return emit(plan, s, SKIP_UNION, count, first);
 		}
-		check_prefix(rval, enc->read_long(reader, &block_count),
-			     "Cannot read map block count: ");
+
+	case AVRO_LINK:
+		return compile(c, s, avro_schema_to_link(schema)->to);
+
+	default:
+		avro_set_error("Unknown schema type");
+		return EINVAL;
 	}
+}
+
+static int
+plan_new(avro_schema_t schema, uint32_t stamp,
+	 struct avro_skip_plan **plan)
+{
+	int rval;
+	size_t root;
+	struct plan_compiler c;
+
+	c.plan = (struct avro_skip_plan *) avro_backing_new(struct avro_skip_plan);
+	if (!c.plan) {
+		avro_set_error("Cannot allocate skip plan");
+		return ENOMEM;
+	}
+	memset(c.plan, 0, sizeof(struct avro_skip_plan));
+	avro_refcount_set(&c.plan->refcount, 1);
+	c.plan->stamp = stamp;
+	c.records = st_init_numtable();
+
+	rval = compile_seq(&c, schema, &root);
+	st_free_table(c.records);
+	if (rval) {
+		plan_free(c.plan);
+		return rval;
+	}
+	*plan = c.plan;
 	return 0;
 }
 
-static int skip_union(avro_reader_t reader, const avro_encoding_t * enc,
-		      struct avro_union_schema_t *writers_schema)
+/*
+ * Gets a reference to the plan of a record, compiling it unless the
+ * memo is current.
+ */
+static int record_plan(avro_schema_t schema, struct avro_skip_plan **plan)
 {
 	int rval;
-	int64_t index;
-	avro_schema_t branch_schema;
+	struct avro_record_schema_t *record = avro_schema_to_record(schema);
+	struct avro_skip_plan *old;
+	uint32_t current = avro_schema_stamp(schema);
+
+	if (current == 0) {
+		return plan_new(schema, current, plan);
+	}
 
-	check_prefix(rval, enc->read_long(reader, &index),
-		     "Cannot read union discriminant: ");
-	branch_schema = avro_schema_union_branch(&writers_schema->obj, index);
-	if (!branch_schema) {
-		return EILSEQ;
+	plan_lock();
+	*plan = record->skip_plan;
+	if (*plan && (*plan)->stamp == current) {
+		avro_refcount_inc(&(*plan)->refcount);
+		plan_unlock();
+		return 0;
 	}
-	return avro_skip_data(reader, branch_schema);
+	plan_unlock();
+
+	/* The stamp was read first, so a change while compiling leaves
+	 * a plan that is already out of date. */
+	check(rval, plan_new(schema, current, plan));
+	avro_refcount_inc(&(*plan)->refcount);
+	plan_lock();
+	old = record->skip_plan;
+	record->skip_plan = *plan;
+	plan_unlock();
+	avro_skip_plan_decref(old);
+	return 0;
 }
 
-static int skip_record(avro_reader_t reader, const avro_encoding_t * enc,
-		       struct avro_record_schema_t *writers_schema)
+static int skip_varints(avro_reader_t reader, int64_t n)
 {
 	int rval;
-	long i;
 
-	AVRO_UNUSED(enc);
+	if (is_memory_io(reader)) {
+		struct _avro_reader_memory_t *mem = avro_reader_to_memory(reader);
+		const uint8_t *p = (const uint8_t *) mem->buf + mem->read;
+		const uint8_t *end = (const uint8_t *) mem->buf + mem->len;
+
+		for (; n > 0; n--) {
+			const uint8_t *start = p;
+			do {
+				if (p == end) {
+					avro_set_error("Cannot skip varint past the end of the buffer");
+					return ENOSPC;
+				}
+				if (p - start == MAX_VARINT_SIZE) {
+					avro_set_error("Varint too long");
+					return EILSEQ;
+				}
+			} while (*p++ & 0x80);
+		}
+		mem->read = (const char *) p - mem->buf;
+		return 0;
+	}
 
-	for (i = 0; i < writers_schema->fields->num_entries; i++) {
-		avro_schema_t  field_schema;
+	for (; n > 0; n--) {
+		check(rval, avro_binary_encoding.skip_long(reader));
+	}
+	return 0;
+}
 
-		field_schema = avro_schema_record_field_get_by_index
-		    (&writers_schema->obj, i);
-		check_prefix(rval, avro_skip_data(reader, field_schema),
-			     "Cannot skip record field: ");
+static int skip_lengths(avro_reader_t reader, int64_t n)
+{
+	int rval;
+	int64_t len;
+
+	for (; n > 0; n--) {
+		check_prefix(rval, avro_binary_encoding.read_long(reader, &len),
+			     "Cannot read string length: ");
+		if (len < 0) {
+			avro_set_error("Invalid string length: %" PRId64, len);
+			return EILSEQ;
+		}
+		check(rval, avro_skip(reader, len));
+	}
+	return 0;
+}
+
+static int run(avro_reader_t reader, const struct avro_skip_plan *plan, size_t s);
+
+/*
+ * Skips the blocks of an array or map.  A block that gives its size in
+ * bytes is skipped whole, as is one whose items are all of one fixed
+ * width.
+ */
+static int
+skip_blocks(avro_reader_t reader, const struct avro_skip_plan *plan,
+	    const struct skip_step *step)
+{
+	int rval;
+	int64_t i;
+	int64_t block_count;
+	int64_t block_size;
+	const struct skip_seq *items = &plan->seqs[step->seq];
+	int64_t width = -1;
+
+	if (step->kind == SKIP_ARRAY) {
+		if (items->count == 0) {
+			width = 0;
+		} else if (items->count == 1 && items->steps[0].kind == SKIP_BYTES) {
+			width = items->steps[0].n;
+		}
+	}
+
+	check_prefix(rval, avro_binary_encoding.read_long(reader, &block_count),
+		     "Cannot read block count: ");
+	while (block_count != 0) {
+		if (block_count < 0) {
+			if (block_count == INT64_MIN) {
+				avro_set_error("Invalid block count");
+				return EILSEQ;
+			}
+			check_prefix(rval, avro_binary_encoding.read_long(reader, &block_size),
+				     "Cannot read block size: ");
+			if (block_size < 0) {
+				avro_set_error("Invalid block size: %" PRId64, block_size);
+				return EILSEQ;
+			}
+			check(rval, avro_skip(reader, block_size));
+		} else if (width >= 0) {
+			check(rval, avro_skip(reader, block_count * width));
+		} else {
+			for (i = 0; i < block_count; i++) {
+				if (step->kind == SKIP_MAP) {
+					check_prefix(rval, skip_lengths(reader, 1),
+						     "Cannot skip map key: ");
+				}
+				check(rval, run(reader, plan, step->seq));
+			}
+		}
+		check_prefix(rval, avro_binary_encoding.read_long(reader, &block_count),
+			     "Cannot read block count: ");
+	}
+	return 0;
+}
+
+static int run(avro_reader_t reader, const struct avro_skip_plan *plan, size_t s)
+{
+	int rval;
+	int64_t index;
+	const struct skip_seq *seq = &plan->seqs[s];
+	const struct skip_step *step = seq->steps;
+	const struct skip_step *end = seq->steps + seq->count;
+
+	for (; step != end; step++) {
+		switch (step->kind) {
+		case SKIP_BYTES:
+			check(rval, avro_skip(reader, step->n));
+			break;
+
+		case SKIP_VARINTS:
+			check(rval, skip_varints(reader, step->n));
+			break;
+
+		case SKIP_LENGTHS:
+			check(rval, skip_lengths(reader, step->n));
+			break;
+
+		case SKIP_ARRAY:
+		case SKIP_MAP:
+			check(rval, skip_blocks(reader, plan, step));
+			break;
+
+		case SKIP_UNION:
+			check_prefix(rval, avro_binary_encoding.read_long(reader, &index),
+				     "Cannot read union discriminant: ");
+			if (index < 0 || index >= step->n) {
+				avro_set_error("Union branch %" PRId64 " out of range", index);
+				return EILSEQ;
+			}
+			check(rval, run(reader, plan, plan->branches[step->seq + index]));
+			break;
+
+		case SKIP_CALL:
+			check(rval, run(reader, plan, step->seq));
+			break;
+		}
 	}
 	return 0;
 }
@@ -122,81 +571,54 @@ int avro_skip_data(avro_reader_t reader, avro_schema_t writers_schema)
 	check_param(EINVAL, reader, "reader");
 	check_param(EINVAL, is_avro_schema(writers_schema), "writer schema");
 
-	int rval = EINVAL;
+	int rval;
+	struct avro_skip_plan *plan;
 	const avro_encoding_t *enc = &avro_binary_encoding;
 
 	switch (avro_typeof(writers_schema)) {
 	case AVRO_NULL:
-		rval = enc->skip_null(reader);
-		break;
+		return 0;
 
 	case AVRO_BOOLEAN:
-		rval = enc->skip_boolean(reader);
-		break;
+		return avro_skip(reader, 1);
 
 	case AVRO_STRING:
-		rval = enc->skip_string(reader);
-		break;
+	case AVRO_BYTES:
+		return enc->skip_bytes(reader);
 
 	case AVRO_INT32:
-		rval = enc->skip_int(reader);
-		break;
-
 	case AVRO_INT64:
-		rval = enc->skip_long(reader);
-		break;
+	case AVRO_ENUM:
+		return enc->skip_long(reader);
 
 	case AVRO_FLOAT:
-		rval = enc->skip_float(reader);
-		break;
+		return avro_skip(reader, sizeof(float));
 
 	case AVRO_DOUBLE:
-		rval = enc->skip_double(reader);
-		break;
-
-	case AVRO_BYTES:
-		rval = enc->skip_bytes(reader);
-		break;
+		return avro_skip(reader, sizeof(double));
 
 	case AVRO_FIXED:
-		rval =
-		    avro_skip(reader,
-			      avro_schema_to_fixed(writers_schema)->size);
-		break;
+		return avro_skip(reader, avro_schema_to_fixed(writers_schema)->size);
 
-	case AVRO_ENUM:
-		rval = enc->skip_long(reader);
-		break;
+	case AVRO_LINK:
+		return avro_skip_data(reader, avro_schema_to_link(writers_schema)->to);
 
-	case AVRO_ARRAY:
-		rval =
-		    skip_array(reader, enc,
-			       avro_schema_to_array(writers_schema));
+	case AVRO_RECORD:
+		check(rval, record_plan(writers_schema, &plan));
 		break;
 
+	case AVRO_ARRAY:
 	case AVRO_MAP:
-		rval =
-		    skip_map(reader, enc, avro_schema_to_map(writers_schema));
-		break;
-
 	case AVRO_UNION:
-		rval =
-		    skip_union(reader, enc,
-			       avro_schema_to_union(writers_schema));
+		/* A plan for this value only. */
+		check(rval, plan_new(writers_schema, 0, &plan));
 		break;
 
-	case AVRO_RECORD:
-		rval =
-		    skip_record(reader, enc,
-				avro_schema_to_record(writers_schema));
-		break;
-
-	case AVRO_LINK:
-		rval =
-		    avro_skip_data(reader,
-				   (avro_schema_to_link(writers_schema))->to);
-		break;
+	default:
+		avro_set_error("Unknown schema type");
+		return EINVAL;
 	}
-
+	rval = run(reader, plan, 0);
+	avro_skip_plan_decref(plan);
 	return rval;
 }
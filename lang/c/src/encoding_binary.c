@@ -16,6 +16,7 @@
  */
 
 #include "avro_private.h"
+#include "avro_io_internal.h"
 #include "avro/allocation.h"
 #include "avro/errors.h"
 #include "encoding.h"
@@ -26,11 +27,51 @@
 
 #define MAX_VARINT_BUF_SIZE 10
 
+/*
+ * Decodes a varint straight out of the buffer of a memory reader. Returns
+ * 0 with the value in *l, EILSEQ for a varint that is too long, or -1 if
+ * the buffer ends within the varint, which the byte-at-a-time path then
+ * reports.
+ */
+static inline int read_long_memory(struct _avro_reader_memory_t *mem, uint64_t * value)
+{
+	const uint8_t *p = (const uint8_t *) mem->buf + mem->read;
+	int64_t available = mem->len - mem->read;
+	int limit = available < MAX_VARINT_BUF_SIZE ? (int) available : MAX_VARINT_BUF_SIZE;
+	uint64_t v = 0;
+	int offset;
+
+	for (offset = 0; offset < limit; offset++) {
+		uint8_t b = p[offset];
+		v |= (uint64_t) (b & 0x7F) << (7 * offset);
+		if (!(b & 0x80)) {
+			mem->read += offset + 1;
+			*value = v;
+			return 0;
+		}
+	}
+	if (limit == MAX_VARINT_BUF_SIZE) {
+		avro_set_error("Varint too long");
+		return EILSEQ;
+	}
+	return -1;
+}
+
 static int read_long(avro_reader_t reader, int64_t * l)
 {
 	uint64_t value = 0;
 	uint8_t b;
 	int offset = 0;
+	if (is_memory_io(reader)) {
+		int rval = read_long_memory(avro_reader_to_memory(reader), &value);
+		if (rval == 0) {
+			*l = ((value >> 1) ^ -(value & 1));
+			return 0;
+		} else if (rval > 0) {
+			return rval;
+		}
+		value = 0;
+	}
 	do {
 		if (offset == MAX_VARINT_BUF_SIZE) {
 			/*
@@ -52,6 +93,13 @@ static int skip_long(avro_reader_t reader)
 {
 	uint8_t b;
 	int offset = 0;
+	if (is_memory_io(reader)) {
+		uint64_t value;
+		int rval = read_long_memory(avro_reader_to_memory(reader), &value);
+		if (rval >= 0) {
+			return rval;
+		}
+	}
 	do {
 		if (offset == MAX_VARINT_BUF_SIZE) {
 			avro_set_error("Varint too long");
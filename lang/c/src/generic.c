@@ -27,7 +27,9 @@
 #include "avro/schema.h"
 #include "avro/value.h"
 #include "avro_generic_internal.h"
+#include "avro_io_internal.h"
 #include "avro_private.h"
+#include "encoding.h"
 
 
 /*-----------------------------------------------------------------------
@@ -50,8 +52,8 @@ avro_generic_class_from_schema_memoized(avro_schema_t schema,
  * Generic support functions
  */
 
-int
-avro_generic_value_new(avro_value_iface_t *iface, avro_value_t *dest)
+static int
+generic_value_new(avro_value_iface_t *iface, avro_value_t *dest, int local)
 {
 	int  rval;
 	avro_generic_value_iface_t  *giface =
@@ -68,7 +70,11 @@ avro_generic_value_new(avro_value_iface_t *iface, avro_value_t *dest)
 	volatile int  *refcount = (volatile int *) self;
 	self = (char *) self + sizeof(volatile int);
 
-	*refcount = 1;
+	if (local) {
+		avro_refcount_set_local(refcount, 1);
+	} else {
+		*refcount = 1;
+	}
 	rval = avro_value_init(giface, self);
 	if (rval != 0) {
 		avro_free(self, instance_size);
@@ -82,6 +88,18 @@ avro_generic_value_new(avro_value_iface_t *iface, avro_value_t *dest)
 	return 0;
 }
 
+int
+avro_generic_value_new(avro_value_iface_t *iface, avro_value_t *dest)
+{
+	return generic_value_new(iface, dest, 0);
+}
+
+int
+avro_generic_value_new_local(avro_value_iface_t *iface, avro_value_t *dest)
+{
+	return generic_value_new(iface, dest, 1);
+}
+
 static void
 avro_generic_value_free(const avro_value_iface_t *iface, void *self)
 {
@@ -119,6 +137,119 @@ avro_generic_value_decref(avro_value_t *value)
 	}
 }
 
+int
+avro_value_is_generic(const avro_value_t *value)
+{
+	return value->iface->incref == avro_generic_value_incref;
+}
+
+int
+avro_generic_value_read(avro_reader_t reader, avro_value_t *dest)
+{
+	avro_generic_value_iface_t  *giface =
+	    container_of(dest->iface, avro_generic_value_iface_t, parent);
+	return avro_generic_value_read_into(giface, dest->self, reader);
+}
+
+int
+avro_generic_value_copy(avro_value_t *dest, const avro_value_t *src)
+{
+	avro_generic_value_iface_t  *giface =
+	    container_of(dest->iface, avro_generic_value_iface_t, parent);
+	if (dest->self == src->self) {
+		return 0;
+	}
+	return avro_generic_value_copy_into(giface, dest->self, src->self);
+}
+
+/*
+ * Copies the values that are stored in place and own no memory:
+ * booleans, numbers, nulls, enums and fixeds.
+ */
+
+static int
+avro_generic_scalar_copy(const avro_value_iface_t *iface, void *dest,
+			 const void *src)
+{
+	avro_generic_value_iface_t  *giface =
+	    container_of(iface, avro_generic_value_iface_t, parent);
+	memcpy(dest, src, avro_value_instance_size(giface));
+	return 0;
+}
+
+/*
+ * Reads a string or bytes value into a raw string.  From memory, the
+ * contents are copied into the string's own buffer, which is kept from
+ * one value to the next.  Strings keep a NUL terminator, counted in
+ * their size.
+ */
+
+static int
+generic_read_raw_string(avro_reader_t reader, avro_raw_string_t *str,
+			int is_string)
+{
+	int  rval;
+	char  *buf;
+	int64_t  len;
+
+	if (is_memory_io(reader)) {
+		struct _avro_reader_memory_t  *mem = avro_reader_to_memory(reader);
+		check(rval, avro_binary_encoding.read_long(reader, &len));
+		if (len < 0 || len > mem->len - mem->read) {
+			avro_set_error("Cannot read %" PRId64 " bytes from memory buffer",
+				       len);
+			return ENOSPC;
+		}
+		avro_raw_string_set_length(str, mem->buf + mem->read, len);
+		mem->read += len;
+		if (is_string) {
+			str->wrapped.size++;
+		}
+		return 0;
+	}
+
+	/*
+	 * read_string and read_bytes both allocate a NUL terminator;
+	 * only read_string counts it in the length.
+	 */
+	if (is_string) {
+		check(rval, avro_binary_encoding.read_string(reader, &buf, &len));
+		avro_raw_string_set_length(str, buf, len - 1);
+		str->wrapped.size++;
+		avro_free(buf, len);
+	} else {
+		check(rval, avro_binary_encoding.read_bytes(reader, &buf, &len));
+		avro_raw_string_set_length(str, buf, len);
+		avro_free(buf, len + 1);
+	}
+	return 0;
+}
+
+
+/*
+ * Copies a string or bytes value into the destination's own buffer,
+ * which is kept from one value to the next, as
+ * generic_read_raw_string does.  An empty string is copied as a
+ * terminator alone, which reads back as the same empty string.
+ */
+
+static void
+generic_copy_raw_string(avro_raw_string_t *dest, const avro_raw_string_t *src,
+			int is_string)
+{
+	if (avro_raw_string_length(src) == 0) {
+		if (is_string) {
+			avro_raw_string_set_length(dest, "", 1);
+		} else {
+			avro_raw_string_clear(dest);
+		}
+		return;
+	}
+	/* The sizes of strings already count their terminator. */
+	avro_raw_string_set_length(dest, avro_raw_string_get(src),
+				   avro_raw_string_length(src));
+}
+
 
 /*-----------------------------------------------------------------------
  * Recursive schemas
@@ -589,6 +720,27 @@ avro_generic_link_done(const avro_value_iface_t *iface, void *vself)
 	self->self = NULL;
 }
 
+static int
+avro_generic_link_read(const avro_value_iface_t *viface, void *vself,
+		       avro_reader_t reader)
+{
+	const avro_generic_link_value_iface_t  *iface =
+	    container_of(viface, avro_generic_link_value_iface_t, parent);
+	avro_value_t  *self = (avro_value_t *) vself;
+	return avro_generic_value_read_into(iface->target_giface, self->self, reader);
+}
+
+static int
+avro_generic_link_copy(const avro_value_iface_t *viface, void *vdest,
+		       const void *vsrc)
+{
+	const avro_generic_link_value_iface_t  *iface =
+	    container_of(viface, avro_generic_link_value_iface_t, parent);
+	avro_value_t  *dest = (avro_value_t *) vdest;
+	const avro_value_t  *src = (const avro_value_t *) vsrc;
+	return avro_generic_value_copy_into(iface->target_giface, dest->self, src->self);
+}
+
 static avro_generic_value_iface_t  AVRO_GENERIC_LINK_CLASS =
 {
 	{
@@ -643,7 +795,9 @@ static avro_generic_value_iface_t  AVRO_GENERIC_LINK_CLASS =
 	},
 	avro_generic_link_instance_size,
 	avro_generic_link_init,
-	avro_generic_link_done
+	avro_generic_link_done,
+	avro_generic_link_read,
+	avro_generic_link_copy
 };
 
 static avro_generic_link_value_iface_t *
@@ -740,6 +894,19 @@ avro_generic_boolean_done(const avro_value_iface_t *iface, void *vself)
 	AVRO_UNUSED(vself);
 }
 
+static int
+avro_generic_boolean_read(const avro_value_iface_t *iface, void *vself,
+			  avro_reader_t reader)
+{
+	AVRO_UNUSED(iface);
+	int  rval;
+	int8_t  val;
+	check_prefix(rval, avro_binary_encoding.read_boolean(reader, &val),
+		     "Cannot read boolean value: ");
+	*(int *) vself = val;
+	return 0;
+}
+
 static avro_generic_value_iface_t  AVRO_GENERIC_BOOLEAN_CLASS =
 {
 	{
@@ -794,7 +961,9 @@ static avro_generic_value_iface_t  AVRO_GENERIC_BOOLEAN_CLASS =
 	},
 	avro_generic_boolean_instance_size,
 	avro_generic_boolean_init,
-	avro_generic_boolean_done
+	avro_generic_boolean_done,
+	avro_generic_boolean_read,
+	avro_generic_scalar_copy
 };
 
 avro_value_iface_t *
@@ -909,6 +1078,28 @@ avro_generic_bytes_done(const avro_value_iface_t *iface, void *vself)
 	avro_raw_string_done(self);
 }
 
+static int
+avro_generic_bytes_read(const avro_value_iface_t *iface, void *vself,
+			avro_reader_t reader)
+{
+	AVRO_UNUSED(iface);
+	int  rval;
+	check_prefix(rval, generic_read_raw_string
+		     (reader, (avro_raw_string_t *) vself, 0),
+		     "Cannot read bytes value: ");
+	return 0;
+}
+
+static int
+avro_generic_bytes_copy(const avro_value_iface_t *iface, void *vdest,
+			const void *vsrc)
+{
+	AVRO_UNUSED(iface);
+	generic_copy_raw_string((avro_raw_string_t *) vdest,
+				(const avro_raw_string_t *) vsrc, 0);
+	return 0;
+}
+
 static avro_generic_value_iface_t  AVRO_GENERIC_BYTES_CLASS =
 {
 	{
@@ -963,7 +1154,9 @@ static avro_generic_value_iface_t  AVRO_GENERIC_BYTES_CLASS =
 	},
 	avro_generic_bytes_instance_size,
 	avro_generic_bytes_init,
-	avro_generic_bytes_done
+	avro_generic_bytes_done,
+	avro_generic_bytes_read,
+	avro_generic_bytes_copy
 };
 
 avro_value_iface_t *
@@ -1052,6 +1245,17 @@ avro_generic_double_done(const avro_value_iface_t *iface, void *vself)
 	AVRO_UNUSED(vself);
 }
 
+static int
+avro_generic_double_read(const avro_value_iface_t *iface, void *vself,
+			 avro_reader_t reader)
+{
+	AVRO_UNUSED(iface);
+	int  rval;
+	check_prefix(rval, avro_binary_encoding.read_double(reader, (double *) vself),
+		     "Cannot read double value: ");
+	return 0;
+}
+
 static avro_generic_value_iface_t  AVRO_GENERIC_DOUBLE_CLASS =
 {
 	{
@@ -1106,7 +1310,9 @@ static avro_generic_value_iface_t  AVRO_GENERIC_DOUBLE_CLASS =
 	},
 	avro_generic_double_instance_size,
 	avro_generic_double_init,
-	avro_generic_double_done
+	avro_generic_double_done,
+	avro_generic_double_read,
+	avro_generic_scalar_copy
 };
 
 avro_value_iface_t *
@@ -1195,6 +1401,17 @@ avro_generic_float_done(const avro_value_iface_t *iface, void *vself)
 	AVRO_UNUSED(vself);
 }
 
+static int
+avro_generic_float_read(const avro_value_iface_t *iface, void *vself,
+			avro_reader_t reader)
+{
+	AVRO_UNUSED(iface);
+	int  rval;
+	check_prefix(rval, avro_binary_encoding.read_float(reader, (float *) vself),
+		     "Cannot read float value: ");
+	return 0;
+}
+
 static avro_generic_value_iface_t  AVRO_GENERIC_FLOAT_CLASS =
 {
 	{
@@ -1249,7 +1466,9 @@ static avro_generic_value_iface_t  AVRO_GENERIC_FLOAT_CLASS =
 	},
 	avro_generic_float_instance_size,
 	avro_generic_float_init,
-	avro_generic_float_done
+	avro_generic_float_done,
+	avro_generic_float_read,
+	avro_generic_scalar_copy
 };
 
 avro_value_iface_t *
@@ -1338,6 +1557,17 @@ avro_generic_int_done(const avro_value_iface_t *iface, void *vself)
 	AVRO_UNUSED(vself);
 }
 
+static int
+avro_generic_int_read(const avro_value_iface_t *iface, void *vself,
+		      avro_reader_t reader)
+{
+	AVRO_UNUSED(iface);
+	int  rval;
+	check_prefix(rval, avro_binary_encoding.read_int(reader, (int32_t *) vself),
+		     "Cannot read int value: ");
+	return 0;
+}
+
 static avro_generic_value_iface_t  AVRO_GENERIC_INT_CLASS =
 {
 	{
@@ -1392,7 +1622,9 @@ static avro_generic_value_iface_t  AVRO_GENERIC_INT_CLASS =
 	},
 	avro_generic_int_instance_size,
 	avro_generic_int_init,
-	avro_generic_int_done
+	avro_generic_int_done,
+	avro_generic_int_read,
+	avro_generic_scalar_copy
 };
 
 avro_value_iface_t *
@@ -1481,6 +1713,17 @@ avro_generic_long_done(const avro_value_iface_t *iface, void *vself)
 	AVRO_UNUSED(vself);
 }
 
+static int
+avro_generic_long_read(const avro_value_iface_t *iface, void *vself,
+		       avro_reader_t reader)
+{
+	AVRO_UNUSED(iface);
+	int  rval;
+	check_prefix(rval, avro_binary_encoding.read_long(reader, (int64_t *) vself),
+		     "Cannot read long value: ");
+	return 0;
+}
+
 static avro_generic_value_iface_t  AVRO_GENERIC_LONG_CLASS =
 {
 	{
@@ -1535,7 +1778,9 @@ static avro_generic_value_iface_t  AVRO_GENERIC_LONG_CLASS =
 	},
 	avro_generic_long_instance_size,
 	avro_generic_long_init,
-	avro_generic_long_done
+	avro_generic_long_done,
+	avro_generic_long_read,
+	avro_generic_scalar_copy
 };
 
 avro_value_iface_t *
@@ -1620,6 +1865,18 @@ avro_generic_null_done(const avro_value_iface_t *iface, void *vself)
 	AVRO_UNUSED(vself);
 }
 
+static int
+avro_generic_null_read(const avro_value_iface_t *iface, void *vself,
+		       avro_reader_t reader)
+{
+	AVRO_UNUSED(iface);
+	AVRO_UNUSED(vself);
+	int  rval;
+	check_prefix(rval, avro_binary_encoding.read_null(reader),
+		     "Cannot read null value: ");
+	return 0;
+}
+
 static avro_generic_value_iface_t  AVRO_GENERIC_NULL_CLASS =
 {
 	{
@@ -1674,7 +1931,9 @@ static avro_generic_value_iface_t  AVRO_GENERIC_NULL_CLASS =
 	},
 	avro_generic_null_instance_size,
 	avro_generic_null_init,
-	avro_generic_null_done
+	avro_generic_null_done,
+	avro_generic_null_read,
+	avro_generic_scalar_copy
 };
 
 avro_value_iface_t *
@@ -1819,6 +2078,28 @@ avro_generic_string_done(const avro_value_iface_t *iface, void *vself)
 	avro_raw_string_done(self);
 }
 
+static int
+avro_generic_string_read(const avro_value_iface_t *iface, void *vself,
+			 avro_reader_t reader)
+{
+	AVRO_UNUSED(iface);
+	int  rval;
+	check_prefix(rval, generic_read_raw_string
+		     (reader, (avro_raw_string_t *) vself, 1),
+		     "Cannot read string value: ");
+	return 0;
+}
+
+static int
+avro_generic_string_copy(const avro_value_iface_t *iface, void *vdest,
+			 const void *vsrc)
+{
+	AVRO_UNUSED(iface);
+	generic_copy_raw_string((avro_raw_string_t *) vdest,
+				(const avro_raw_string_t *) vsrc, 1);
+	return 0;
+}
+
 static avro_generic_value_iface_t  AVRO_GENERIC_STRING_CLASS =
 {
 	{
@@ -1873,7 +2154,9 @@ static avro_generic_value_iface_t  AVRO_GENERIC_STRING_CLASS =
 	},
 	avro_generic_string_instance_size,
 	avro_generic_string_init,
-	avro_generic_string_done
+	avro_generic_string_done,
+	avro_generic_string_read,
+	avro_generic_string_copy
 };
 
 avro_value_iface_t *
@@ -2062,6 +2345,81 @@ avro_generic_array_done(const avro_value_iface_t *viface, void *vself)
 	avro_raw_array_done(&self->array);
 }
 
+static int
+avro_generic_array_read(const avro_value_iface_t *viface, void *vself,
+			avro_reader_t reader)
+{
+	const avro_generic_array_value_iface_t  *iface =
+	    container_of(viface, avro_generic_array_value_iface_t, parent);
+	int  rval;
+	int64_t  i;
+	int64_t  block_count;
+	int64_t  block_size;
+	avro_value_t  child;
+
+	check_prefix(rval, avro_binary_encoding.read_long(reader, &block_count),
+		     "Cannot read array block count: ");
+	while (block_count != 0) {
+		if (block_count < 0) {
+			block_count = block_count * -1;
+			check_prefix(rval, avro_binary_encoding.
+				     read_long(reader, &block_size),
+				     "Cannot read array block size: ");
+		}
+
+		for (i = 0; i < block_count; i++) {
+			check(rval, avro_generic_array_append(viface, vself, &child, NULL));
+			check(rval, avro_generic_value_read_into
+			      (iface->child_giface, child.self, reader));
+		}
+
+		check_prefix(rval, avro_binary_encoding.read_long(reader, &block_count),
+			     "Cannot read array block count: ");
+	}
+	return 0;
+}
+
+/*
+ * Copies into the elements the destination already has, finalizing
+ * those beyond the end of the source and appending the rest.
+ */
+
+static int
+avro_generic_array_copy(const avro_value_iface_t *viface, void *vdest,
+			const void *vsrc)
+{
+	const avro_generic_array_value_iface_t  *iface =
+	    container_of(viface, avro_generic_array_value_iface_t, parent);
+	int  rval;
+	size_t  i;
+	avro_generic_array_t  *dest = (avro_generic_array_t *) vdest;
+	const avro_generic_array_t  *src = (const avro_generic_array_t *) vsrc;
+	size_t  src_count = avro_raw_array_size(&src->array);
+	size_t  dest_count = avro_raw_array_size(&dest->array);
+	avro_value_t  child;
+
+	for (i = src_count; i < dest_count; i++) {
+		avro_value_done(iface->child_giface,
+				avro_raw_array_get_raw(&dest->array, i));
+	}
+	if (dest_count > src_count) {
+		dest->array.element_count = src_count;
+		dest_count = src_count;
+	}
+
+	for (i = 0; i < src_count; i++) {
+		if (i < dest_count) {
+			child.self = avro_raw_array_get_raw(&dest->array, i);
+		} else {
+			check(rval, avro_generic_array_append(viface, vdest, &child, NULL));
+		}
+		check(rval, avro_generic_value_copy_into
+		      (iface->child_giface, child.self,
+		       avro_raw_array_get_raw(&src->array, i)));
+	}
+	return 0;
+}
+
 static avro_generic_value_iface_t  AVRO_GENERIC_ARRAY_CLASS =
 {
 {
@@ -2116,7 +2474,9 @@ static avro_generic_value_iface_t  AVRO_GENERIC_ARRAY_CLASS =
 },
 	avro_generic_array_instance_size,
 	avro_generic_array_init,
-	avro_generic_array_done
+	avro_generic_array_done,
+	avro_generic_array_read,
+	avro_generic_array_copy
 };
 
 static avro_generic_value_iface_t *
@@ -2256,6 +2616,19 @@ avro_generic_enum_done(const avro_value_iface_t *viface, void *vself)
 	AVRO_UNUSED(vself);
 }
 
+static int
+avro_generic_enum_read(const avro_value_iface_t *viface, void *vself,
+		       avro_reader_t reader)
+{
+	AVRO_UNUSED(viface);
+	int  rval;
+	int64_t  val;
+	check_prefix(rval, avro_binary_encoding.read_long(reader, &val),
+		     "Cannot read enum value: ");
+	*(int *) vself = (int) val;
+	return 0;
+}
+
 static avro_generic_value_iface_t  AVRO_GENERIC_ENUM_CLASS =
 {
 	{
@@ -2310,7 +2683,9 @@ static avro_generic_value_iface_t  AVRO_GENERIC_ENUM_CLASS =
 	},
 	avro_generic_enum_instance_size,
 	avro_generic_enum_init,
-	avro_generic_enum_done
+	avro_generic_enum_done,
+	avro_generic_enum_read,
+	avro_generic_scalar_copy
 };
 
 static avro_generic_value_iface_t *
@@ -2460,6 +2835,18 @@ avro_generic_fixed_done(const avro_value_iface_t *viface, void *vself)
 	AVRO_UNUSED(vself);
 }
 
+static int
+avro_generic_fixed_read(const avro_value_iface_t *viface, void *vself,
+			avro_reader_t reader)
+{
+	const avro_generic_fixed_value_iface_t  *iface =
+	    container_of(viface, avro_generic_fixed_value_iface_t, parent);
+	int  rval;
+	check_prefix(rval, avro_read(reader, vself, iface->data_size),
+		     "Cannot read fixed value: ");
+	return 0;
+}
+
 static avro_generic_value_iface_t  AVRO_GENERIC_FIXED_CLASS =
 {
 	{
@@ -2514,7 +2901,9 @@ static avro_generic_value_iface_t  AVRO_GENERIC_FIXED_CLASS =
 	},
 	avro_generic_fixed_instance_size,
 	avro_generic_fixed_init,
-	avro_generic_fixed_done
+	avro_generic_fixed_done,
+	avro_generic_fixed_read,
+	avro_generic_scalar_copy
 };
 
 static avro_generic_value_iface_t *
@@ -2718,6 +3107,94 @@ avro_generic_map_done(const avro_value_iface_t *viface, void *vself)
 	avro_raw_map_done(&self->map);
 }
 
+static int
+avro_generic_map_read(const avro_value_iface_t *viface, void *vself,
+		      avro_reader_t reader)
+{
+	const avro_generic_map_value_iface_t  *iface =
+	    container_of(viface, avro_generic_map_value_iface_t, parent);
+	int  rval;
+	int64_t  i;
+	int64_t  block_count;
+	int64_t  block_size;
+	avro_value_t  child;
+
+	check_prefix(rval, avro_binary_encoding.read_long(reader, &block_count),
+		     "Cannot read map block count: ");
+	while (block_count != 0) {
+		if (block_count < 0) {
+			block_count = block_count * -1;
+			check_prefix(rval, avro_binary_encoding.
+				     read_long(reader, &block_size),
+				     "Cannot read map block size: ");
+		}
+
+		for (i = 0; i < block_count; i++) {
+			char  *key;
+			int64_t  key_size;
+
+			check_prefix(rval, avro_binary_encoding.
+				     read_string(reader, &key, &key_size),
+				     "Cannot read map key: ");
+			rval = avro_generic_map_add(viface, vself, key, &child, NULL, NULL);
+			avro_free(key, key_size);
+			if (rval) {
+				return rval;
+			}
+			check(rval, avro_generic_value_read_into
+			      (iface->child_giface, child.self, reader));
+		}
+
+		check_prefix(rval, avro_binary_encoding.read_long(reader, &block_count),
+			     "Cannot read map block count: ");
+	}
+	return 0;
+}
+
+/*
+ * Copies into the elements the destination already has if its keys
+ * are those of the source, in the same order, as they are when the
+ * same kind of map is copied over and over.  Otherwise the destination
+ * is rebuilt.
+ */
+
+static int
+avro_generic_map_copy(const avro_value_iface_t *viface, void *vdest,
+		      const void *vsrc)
+{
+	const avro_generic_map_value_iface_t  *iface =
+	    container_of(viface, avro_generic_map_value_iface_t, parent);
+	int  rval;
+	size_t  i;
+	avro_generic_map_t  *dest = (avro_generic_map_t *) vdest;
+	const avro_generic_map_t  *src = (const avro_generic_map_t *) vsrc;
+	size_t  count = avro_raw_map_size(&src->map);
+	int  same_keys = avro_raw_map_size(&dest->map) == count;
+	avro_value_t  child;
+
+	for (i = 0; same_keys && i < count; i++) {
+		same_keys = strcmp(avro_raw_get_entry(&dest->map, i)->key,
+				   avro_raw_get_entry(&src->map, i)->key) == 0;
+	}
+
+	if (!same_keys) {
+		check(rval, avro_generic_map_reset(viface, vdest));
+	}
+	for (i = 0; i < count; i++) {
+		if (same_keys) {
+			child.self = avro_raw_map_get_raw(&dest->map, i);
+		} else {
+			check(rval, avro_generic_map_add
+			      (viface, vdest, avro_raw_get_entry(&src->map, i)->key,
+			       &child, NULL, NULL));
+		}
+		check(rval, avro_generic_value_copy_into
+		      (iface->child_giface, child.self,
+		       avro_raw_map_get_raw(&src->map, i)));
+	}
+	return 0;
+}
+
 static avro_generic_value_iface_t  AVRO_GENERIC_MAP_CLASS =
 {
 	{
@@ -2772,7 +3249,9 @@ static avro_generic_value_iface_t  AVRO_GENERIC_MAP_CLASS =
 	},
 	avro_generic_map_instance_size,
 	avro_generic_map_init,
-	avro_generic_map_done
+	avro_generic_map_done,
+	avro_generic_map_read,
+	avro_generic_map_copy
 };
 
 static avro_generic_value_iface_t *
@@ -3031,6 +3510,39 @@ avro_generic_record_done(const avro_value_iface_t *viface, void *vself)
 	}
 }
 
+static int
+avro_generic_record_read(const avro_value_iface_t *viface, void *vself,
+			 avro_reader_t reader)
+{
+	const avro_generic_record_value_iface_t  *iface =
+	    container_of(viface, avro_generic_record_value_iface_t, parent);
+	int  rval;
+	size_t  i;
+	for (i = 0; i < iface->field_count; i++) {
+		check(rval, avro_generic_value_read_into
+		      (iface->field_ifaces[i],
+		       avro_generic_record_field(iface, vself, i), reader));
+	}
+	return 0;
+}
+
+static int
+avro_generic_record_copy(const avro_value_iface_t *viface, void *vdest,
+			 const void *vsrc)
+{
+	const avro_generic_record_value_iface_t  *iface =
+	    container_of(viface, avro_generic_record_value_iface_t, parent);
+	int  rval;
+	size_t  i;
+	for (i = 0; i < iface->field_count; i++) {
+		check(rval, avro_generic_value_copy_into
+		      (iface->field_ifaces[i],
+		       avro_generic_record_field(iface, vdest, i),
+		       avro_generic_record_field(iface, (void *) vsrc, i)));
+	}
+	return 0;
+}
+
 static avro_generic_value_iface_t  AVRO_GENERIC_RECORD_CLASS =
 {
 	{
@@ -3085,7 +3597,9 @@ static avro_generic_value_iface_t  AVRO_GENERIC_RECORD_CLASS =
 	},
 	avro_generic_record_instance_size,
 	avro_generic_record_init,
-	avro_generic_record_done
+	avro_generic_record_done,
+	avro_generic_record_read,
+	avro_generic_record_copy
 };
 
 static avro_generic_value_iface_t *
@@ -3424,6 +3938,54 @@ avro_generic_union_done(const avro_value_iface_t *viface, void *vself)
 	}
 }
 
+static int
+avro_generic_union_read(const avro_value_iface_t *viface, void *vself,
+			avro_reader_t reader)
+{
+	const avro_generic_union_value_iface_t  *iface =
+	    container_of(viface, avro_generic_union_value_iface_t, parent);
+	int  rval;
+	int64_t  discriminant;
+	avro_generic_union_t  *self = (avro_generic_union_t *) vself;
+
+	check_prefix(rval, avro_binary_encoding.read_long(reader, &discriminant),
+		     "Cannot read union discriminant: ");
+	if (discriminant < 0 || discriminant >= (int64_t) iface->branch_count) {
+		avro_set_error("Invalid union discriminant value: (%" PRId64 ")",
+			       discriminant);
+		return EINVAL;
+	}
+
+	check(rval, avro_generic_union_set_branch(viface, vself, (int) discriminant, NULL));
+	return avro_generic_value_read_into
+	    (avro_generic_union_branch_giface(iface, self),
+	     avro_generic_union_branch(self), reader);
+}
+
+/*
+ * Keeps the destination's branch if it is the source's.
+ */
+
+static int
+avro_generic_union_copy(const avro_value_iface_t *viface, void *vdest,
+			const void *vsrc)
+{
+	const avro_generic_union_value_iface_t  *iface =
+	    container_of(viface, avro_generic_union_value_iface_t, parent);
+	int  rval;
+	avro_generic_union_t  *dest = (avro_generic_union_t *) vdest;
+	const avro_generic_union_t  *src = (const avro_generic_union_t *) vsrc;
+
+	check(rval, avro_generic_union_set_branch(viface, vdest, src->discriminant, NULL));
+	if (src->discriminant < 0) {
+		return 0;
+	}
+	return avro_generic_value_copy_into
+	    (avro_generic_union_branch_giface(iface, dest),
+	     avro_generic_union_branch(dest),
+	     avro_generic_union_branch(src));
+}
+
 static avro_generic_value_iface_t  AVRO_GENERIC_UNION_CLASS =
 {
 	{
@@ -3478,7 +4040,9 @@ static avro_generic_value_iface_t  AVRO_GENERIC_UNION_CLASS =
 	},
 	avro_generic_union_instance_size,
 	avro_generic_union_init,
-	avro_generic_union_done
+	avro_generic_union_done,
+	avro_generic_union_read,
+	avro_generic_union_copy
 };
 
 static avro_generic_value_iface_t *
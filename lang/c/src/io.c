@@ -20,27 +20,21 @@
 #include "avro/errors.h"
 #include "avro/io.h"
 #include "avro_private.h"
+#include "avro_io_internal.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
 #include "dump.h"
 
-enum avro_io_type_t {
-	AVRO_FILE_IO,
-	AVRO_MEMORY_IO
-};
-typedef enum avro_io_type_t avro_io_type_t;
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
-struct avro_reader_t_ {
-	avro_io_type_t type;
-	volatile int  refcount;
-};
-
-struct avro_writer_t_ {
-	avro_io_type_t type;
-	volatile int  refcount;
-};
+#define DEFAULT_READ_BUFFER_SIZE 4096
 
 struct _avro_reader_file_t {
 	struct avro_reader_t_ reader;
@@ -48,7 +42,30 @@ struct _avro_reader_file_t {
 	int should_close;
 	char *cur;
 	char *end;
-	char buffer[4096];
+	char *buffer;
+	size_t buffer_size;
+	/* With drop behind set, the pages of the file before dropped have
+	 * been dropped from the page cache. */
+	int drop_behind;
+	int64_t dropped;
+};
+
+/*
+ * How many bytes a file reader with drop behind reads between dropping
+ * them from the page cache.
+ */
+#define DROP_BEHIND_INTERVAL (1024 * 1024)
+
+/*
+ * The buffer of a file reader is allocated along with it.
+ */
+#define file_reader_alloc_size(buffer_size) \
+	(sizeof(struct _avro_reader_file_t) + (buffer_size))
+
+struct _avro_reader_mmap_t {
+	struct _avro_reader_memory_t memory;
+	void *addr;
+	size_t size;
 };
 
 struct _avro_writer_file_t {
@@ -57,13 +74,6 @@ struct _avro_writer_file_t {
 	int should_close;
 };
 
-struct _avro_reader_memory_t {
-	struct avro_reader_t_ reader;
-	const char *buf;
-	int64_t len;
-	int64_t read;
-};
-
 struct _avro_writer_memory_t {
 	struct avro_writer_t_ writer;
 	const char *buf;
@@ -71,14 +81,21 @@ struct _avro_writer_memory_t {
 	int64_t written;
 };
 
-#define avro_io_typeof(obj)      ((obj)->type)
-#define is_memory_io(obj)        (obj && avro_io_typeof(obj) == AVRO_MEMORY_IO)
-#define is_file_io(obj)          (obj && avro_io_typeof(obj) == AVRO_FILE_IO)
+/*
+ * A growable memory writer reallocates its buffer, of size bytes, when
+ * a write does not fit.
+ */
+struct _avro_writer_growable_t {
+	struct _avro_writer_memory_t memory;
+	size_t size;
+};
+
+#define DEFAULT_GROWABLE_SIZE 4096
 
-#define avro_reader_to_memory(reader_)  container_of(reader_, struct _avro_reader_memory_t, reader)
 #define avro_reader_to_file(reader_)    container_of(reader_, struct _avro_reader_file_t, reader)
 #define avro_writer_to_memory(writer_)  container_of(writer_, struct _avro_writer_memory_t, writer)
 #define avro_writer_to_file(writer_)    container_of(writer_, struct _avro_writer_file_t, writer)
+#define avro_writer_to_growable(writer_) container_of(writer_, struct _avro_writer_growable_t, memory.writer)
 
 static void reader_init(avro_reader_t reader, avro_io_type_t type)
 {
@@ -92,10 +109,16 @@ static void writer_init(avro_writer_t writer, avro_io_type_t type)
 	avro_refcount_set(&writer->refcount, 1);
 }
 
-avro_reader_t avro_reader_file_fp(FILE * fp, int should_close)
+avro_reader_t avro_reader_file_fp_bs(FILE * fp, int should_close,
+				     size_t buffer_size)
 {
-	struct _avro_reader_file_t *file_reader =
-	    (struct _avro_reader_file_t *) avro_new(struct _avro_reader_file_t);
+	struct _avro_reader_file_t *file_reader;
+
+	if (buffer_size == 0) {
+		buffer_size = DEFAULT_READ_BUFFER_SIZE;
+	}
+	file_reader = (struct _avro_reader_file_t *)
+	    avro_malloc(file_reader_alloc_size(buffer_size));
 	if (!file_reader) {
 		avro_set_error("Cannot allocate new file reader");
 		return NULL;
@@ -103,10 +126,65 @@ avro_reader_t avro_reader_file_fp(FILE * fp, int should_close)
 	memset(file_reader, 0, sizeof(struct _avro_reader_file_t));
 	file_reader->fp = fp;
 	file_reader->should_close = should_close;
+	file_reader->buffer = (char *) (file_reader + 1);
+	file_reader->buffer_size = buffer_size;
+	file_reader->cur = file_reader->end = file_reader->buffer;
 	reader_init(&file_reader->reader, AVRO_FILE_IO);
 	return &file_reader->reader;
 }
 
+int avro_reader_file_drop_behind(avro_reader_t reader)
+{
+	struct _avro_reader_file_t *file_reader;
+
+	check_param(EINVAL, is_file_io(reader), "file reader");
+
+	file_reader = avro_reader_to_file(reader);
+#if !defined(_WIN32) && defined(POSIX_FADV_DONTNEED)
+	{
+		int fd = fileno(file_reader->fp);
+		off_t pos = ftello(file_reader->fp);
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		posix_fadvise(fd, 0, 0, POSIX_FADV_NOREUSE);
+		file_reader->drop_behind = 1;
+		file_reader->dropped = pos < 0 ? 0 : pos;
+	}
+#endif
+	return 0;
+}
+
+/*
+ * Drops the part of the file read since the last time from the page
+ * cache, once there is enough of it.
+ */
+
+static void drop_behind(struct _avro_reader_file_t *reader)
+{
+#if !defined(_WIN32) && defined(POSIX_FADV_DONTNEED)
+	off_t pos;
+
+	if (!reader->drop_behind) {
+		return;
+	}
+	pos = ftello(reader->fp);
+	if (pos < reader->dropped) {
+		/* Seeked backwards; drop from here on. */
+		reader->dropped = pos < 0 ? reader->dropped : pos;
+	} else if (pos - reader->dropped >= DROP_BEHIND_INTERVAL) {
+		posix_fadvise(fileno(reader->fp), reader->dropped,
+			      pos - reader->dropped, POSIX_FADV_DONTNEED);
+		reader->dropped = pos;
+	}
+#else
+	AVRO_UNUSED(reader);
+#endif
+}
+
+avro_reader_t avro_reader_file_fp(FILE * fp, int should_close)
+{
+	return avro_reader_file_fp_bs(fp, should_close, 0);
+}
+
 avro_reader_t avro_reader_file(FILE * fp)
 {
 	return avro_reader_file_fp(fp, 1);
@@ -146,6 +224,65 @@ avro_reader_t avro_reader_memory(const char *buf, int64_t len)
 	return &mem_reader->reader;
 }
 
+avro_reader_t avro_reader_mmap(const char *path)
+{
+#ifdef _WIN32
+	avro_set_error("Cannot map %s: not supported on this platform", path);
+	return NULL;
+#else
+	struct _avro_reader_mmap_t *mmap_reader;
+	struct stat st;
+	void *addr = NULL;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		avro_set_error("Cannot open file %s: %s", path, strerror(errno));
+		return NULL;
+	}
+	if (fstat(fd, &st) < 0) {
+		avro_set_error("Cannot stat file %s: %s", path, strerror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	/*
+	 * The mapping is private, so that nothing written into it can
+	 * reach the file.  An empty file can't be mapped, and reads as an
+	 * empty buffer.
+	 */
+	if (st.st_size > 0) {
+		addr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE, fd, 0);
+		if (addr == MAP_FAILED) {
+			avro_set_error("Cannot map file %s: %s", path, strerror(errno));
+			close(fd);
+			return NULL;
+		}
+#ifdef MADV_SEQUENTIAL
+		madvise(addr, st.st_size, MADV_SEQUENTIAL);
+#endif
+	}
+	close(fd);
+
+	mmap_reader = (struct _avro_reader_mmap_t *) avro_new(struct _avro_reader_mmap_t);
+	if (!mmap_reader) {
+		if (addr) {
+			munmap(addr, st.st_size);
+		}
+		avro_set_error("Cannot allocate new mmap reader");
+		return NULL;
+	}
+	mmap_reader->addr = addr;
+	mmap_reader->size = st.st_size;
+	mmap_reader->memory.buf = (const char *) addr;
+	mmap_reader->memory.len = st.st_size;
+	mmap_reader->memory.read = 0;
+	reader_init(&mmap_reader->memory.reader, AVRO_MMAP_IO);
+	return &mmap_reader->memory.reader;
+#endif
+}
+
 void
 avro_reader_memory_set_source(avro_reader_t reader, const char *buf, int64_t len)
 {
@@ -172,10 +309,46 @@ avro_writer_t avro_writer_memory(const char *buf, int64_t len)
 	return &mem_writer->writer;
 }
 
+avro_writer_t avro_writer_memory_growable(size_t initial_size)
+{
+	struct _avro_writer_growable_t *growable;
+	char *buf;
+
+	if (initial_size == 0) {
+		initial_size = DEFAULT_GROWABLE_SIZE;
+	}
+	buf = (char *) avro_malloc(initial_size);
+	if (!buf) {
+		avro_set_error("Cannot allocate memory writer buffer");
+		return NULL;
+	}
+	growable = (struct _avro_writer_growable_t *) avro_new(struct _avro_writer_growable_t);
+	if (!growable) {
+		avro_free(buf, initial_size);
+		avro_set_error("Cannot allocate new memory writer");
+		return NULL;
+	}
+	growable->size = initial_size;
+	growable->memory.buf = buf;
+	growable->memory.len = initial_size;
+	growable->memory.written = 0;
+	writer_init(&growable->memory.writer, AVRO_GROWABLE_IO);
+	return &growable->memory.writer;
+}
+
+const char *avro_writer_memory_buf(avro_writer_t writer)
+{
+	if (is_memory_io(writer)) {
+		return avro_writer_to_memory(writer)->buf;
+	}
+	avro_set_error("Not a memory writer");
+	return NULL;
+}
+
 void
 avro_writer_memory_set_dest(avro_writer_t writer, const char *buf, int64_t len)
 {
-	if (is_memory_io(writer)) {
+	if (is_memory_io(writer) && !is_growable_io(writer)) {
 		struct _avro_writer_memory_t *mem_writer = avro_writer_to_memory(writer);
 		mem_writer->buf = buf;
 		mem_writer->len = len;
@@ -212,7 +385,7 @@ avro_read_file(struct _avro_reader_file_t *reader, void *buf, int64_t len)
 		return 0;
 	}
 
-	if (needed > (int64_t) sizeof(reader->buffer)) {
+	if (needed > (int64_t) reader->buffer_size) {
 		if (bytes_available(reader) > 0) {
 			memcpy(p, reader->cur, bytes_available(reader));
 			p += bytes_available(reader);
@@ -220,6 +393,7 @@ avro_read_file(struct _avro_reader_file_t *reader, void *buf, int64_t len)
 			buffer_reset(reader);
 		}
 		rval = fread(p, 1, needed, reader->fp);
+		drop_behind(reader);
 		if (rval != needed) {
 			avro_set_error("Cannot read %" PRIsz " bytes from file",
 				       (size_t) needed);
@@ -236,8 +410,9 @@ avro_read_file(struct _avro_reader_file_t *reader, void *buf, int64_t len)
 		needed -= bytes_available(reader);
 
 		rval =
-		    fread(reader->buffer, 1, sizeof(reader->buffer),
+		    fread(reader->buffer, 1, reader->buffer_size,
 			  reader->fp);
+		drop_behind(reader);
 		if (rval == 0) {
 			avro_set_error("Cannot read %" PRIsz " bytes from file",
 				       (size_t) needed);
@@ -323,10 +498,42 @@ int avro_skip(avro_reader_t reader, int64_t len)
 	return 0;
 }
 
+/*
+ * Makes room for len more bytes in a growable writer, at least
+ * doubling its buffer.
+ */
+static int
+growable_reserve(struct _avro_writer_growable_t *growable, int64_t len)
+{
+	struct _avro_writer_memory_t *mem = &growable->memory;
+	size_t needed = (size_t) (mem->written + len);
+	size_t size = growable->size;
+	char *buf;
+
+	while (size < needed) {
+		size *= 2;
+	}
+	buf = (char *) avro_realloc((char *) mem->buf, growable->size, size);
+	if (!buf) {
+		avro_set_error("Cannot grow memory writer to %" PRIsz " bytes",
+			       size);
+		return ENOMEM;
+	}
+	growable->size = size;
+	mem->buf = buf;
+	mem->len = size;
+	return 0;
+}
+
 static int
 avro_write_memory(struct _avro_writer_memory_t *writer, void *buf, int64_t len)
 {
 	if (len) {
+		if ((writer->len - writer->written) < len &&
+		    is_growable_io(&writer->writer)) {
+			int rval;
+			check(rval, growable_reserve(avro_writer_to_growable(&writer->writer), len));
+		}
 		if ((writer->len - writer->written) < len) {
 			avro_set_error("Cannot write %" PRIsz " bytes in memory buffer",
 				       (size_t) len);
@@ -365,6 +572,137 @@ int avro_write(avro_writer_t writer, void *buf, int64_t len)
 	return EINVAL;
 }
 
+#ifdef _WIN32
+#define file_tell _ftelli64
+#define file_seek _fseeki64
+#else
+#define file_tell ftello
+#define file_seek fseeko
+#endif
+
+int64_t avro_reader_tell(avro_reader_t reader)
+{
+	if (is_memory_io(reader)) {
+		return avro_reader_to_memory(reader)->read;
+	} else if (is_file_io(reader)) {
+		struct _avro_reader_file_t *file = avro_reader_to_file(reader);
+		int64_t pos = file_tell(file->fp);
+		if (pos < 0) {
+			avro_set_error("Cannot tell the position in file: %s",
+				       strerror(errno));
+			return -1;
+		}
+		return pos - bytes_available(file);
+	}
+	avro_set_error("Invalid reader");
+	return -1;
+}
+
+int avro_reader_seek(avro_reader_t reader, int64_t position)
+{
+	check_param(EINVAL, position >= 0, "position");
+	if (is_memory_io(reader)) {
+		struct _avro_reader_memory_t *mem = avro_reader_to_memory(reader);
+		if (position > mem->len) {
+			avro_set_error("Cannot seek to %" PRId64 " in a buffer of %" PRId64 " bytes",
+				       position, mem->len);
+			return EINVAL;
+		}
+		mem->read = position;
+		return 0;
+	} else if (is_file_io(reader)) {
+		struct _avro_reader_file_t *file = avro_reader_to_file(reader);
+		int64_t pos = file_tell(file->fp);
+		/* Within the buffer, nothing needs reading again. */
+		if (pos >= 0 && position <= pos && position >= pos - (file->end - file->buffer)) {
+			file->cur = file->end - (pos - position);
+			return 0;
+		}
+		if (file_seek(file->fp, position, SEEK_SET)) {
+			int err = errno ? errno : EIO;
+			avro_set_error("Cannot seek to %" PRId64 " in file: %s",
+				       position, strerror(err));
+			return err;
+		}
+		buffer_reset(file);
+		return 0;
+	}
+	avro_set_error("Invalid reader");
+	return EINVAL;
+}
+
+/*
+ * Returns the first occurrence of the len bytes of marker in [p, end),
+ * or NULL.  Markers such as sync markers are random, so their first
+ * byte is rare and memchr skips most of the input.
+ */
+static const char *
+find_marker(const char *p, const char *end, const char *marker, size_t len)
+{
+	while ((size_t) (end - p) >= len) {
+		p = (const char *) memchr(p, marker[0], end - p - len + 1);
+		if (p == NULL) {
+			return NULL;
+		}
+		if (memcmp(p, marker, len) == 0) {
+			return p;
+		}
+		p++;
+	}
+	return NULL;
+}
+
+int avro_reader_skip_past(avro_reader_t reader, const char *marker, size_t len)
+{
+	check_param(EINVAL, marker && len > 0, "marker");
+	if (is_memory_io(reader)) {
+		struct _avro_reader_memory_t *mem = avro_reader_to_memory(reader);
+		const char *p = find_marker(mem->buf + mem->read, mem->buf + mem->len,
+					    marker, len);
+		if (p == NULL) {
+			mem->read = mem->len;
+			return EOF;
+		}
+		mem->read = (p - mem->buf) + len;
+		return 0;
+	} else if (is_file_io(reader)) {
+		struct _avro_reader_file_t *file = avro_reader_to_file(reader);
+		if (len > file->buffer_size) {
+			avro_set_error("Marker of %" PRIsz " bytes is longer than the read buffer",
+				       len);
+			return EINVAL;
+		}
+		for (;;) {
+			const char *p = find_marker(file->cur, file->end, marker, len);
+			size_t keep;
+			size_t n;
+			if (p != NULL) {
+				file->cur = (char *) p + len;
+				return 0;
+			}
+			/* Keep the bytes that may begin a marker ending
+			 * in what is read next. */
+			keep = bytes_available(file) < (int64_t) (len - 1)
+			    ? (size_t) bytes_available(file) : len - 1;
+			memmove(file->buffer, file->end - keep, keep);
+			n = fread(file->buffer + keep, 1, file->buffer_size - keep, file->fp);
+			drop_behind(file);
+			file->cur = file->buffer;
+			file->end = file->buffer + keep + n;
+			if (n == 0) {
+				file->cur = file->end;
+				if (ferror(file->fp)) {
+					avro_set_error("Cannot read file");
+					return EIO;
+				}
+				return EOF;
+			}
+		}
+	}
+	avro_set_error("Invalid reader");
+	return EINVAL;
+}
+
 void
 avro_reader_reset(avro_reader_t reader)
 {
@@ -413,19 +751,33 @@ void avro_reader_dump(avro_reader_t reader, FILE * fp)
 
 void avro_reader_free(avro_reader_t reader)
 {
-	if (is_memory_io(reader)) {
+	if (is_mmap_io(reader)) {
+		struct _avro_reader_mmap_t *mmap_reader =
+		    container_of(reader, struct _avro_reader_mmap_t, memory.reader);
+#ifndef _WIN32
+		if (mmap_reader->addr) {
+			munmap(mmap_reader->addr, mmap_reader->size);
+		}
+#endif
+		avro_freet(struct _avro_reader_mmap_t, mmap_reader);
+	} else if (is_memory_io(reader)) {
 		avro_freet(struct _avro_reader_memory_t, reader);
 	} else if (is_file_io(reader)) {
-		if (avro_reader_to_file(reader)->should_close) {
-			fclose(avro_reader_to_file(reader)->fp);
+		struct _avro_reader_file_t *file = avro_reader_to_file(reader);
+		if (file->should_close) {
+			fclose(file->fp);
 		}
-		avro_freet(struct _avro_reader_file_t, reader);
+		avro_free(file, file_reader_alloc_size(file->buffer_size));
 	}
 }
 
 void avro_writer_free(avro_writer_t writer)
 {
-	if (is_memory_io(writer)) {
+	if (is_growable_io(writer)) {
+		struct _avro_writer_growable_t *growable = avro_writer_to_growable(writer);
+		avro_free((char *) growable->memory.buf, growable->size);
+		avro_freet(struct _avro_writer_growable_t, growable);
+	} else if (is_memory_io(writer)) {
 		avro_freet(struct _avro_writer_memory_t, writer);
 	} else if (is_file_io(writer)) {
 		if (avro_writer_to_file(writer)->should_close) {
@@ -442,6 +794,9 @@ int avro_reader_is_eof(avro_reader_t reader)
 		if (feof(file->fp)) {
 			return file->cur == file->end;
 		}
+	} else if (is_memory_io(reader)) {
+		struct _avro_reader_memory_t *mem = avro_reader_to_memory(reader);
+		return mem->read == mem->len;
 	}
 	return 0;
 }
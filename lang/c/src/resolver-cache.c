@@ -0,0 +1,351 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to you under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ * https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <avro/platform.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "avro_private.h"
+#include "avro/allocation.h"
+#include "avro/errors.h"
+#include "avro/io.h"
+#include "avro/resolver.h"
+#include "avro/value.h"
+#include "st.h"
+
+#if defined THREADSAFE && (defined __unix__ || defined __unix)
+#include <pthread.h>
+static pthread_mutex_t  cache_lock = PTHREAD_MUTEX_INITIALIZER;
+#define cache_lock()    pthread_mutex_lock(&cache_lock)
+#define cache_unlock()  pthread_mutex_unlock(&cache_lock)
+#else
+#define cache_lock()
+#define cache_unlock()
+#endif
+
+
+/*
+ * A cache of resolved reader and writer implementations, shared by the
+ * whole process.  Schemas parsed separately are different objects, so
+ * the key is the JSON text of both schemas rather than their
+ * addresses.  The full text is used rather than a fingerprint of the
+ * canonical form, so that two pairs only share an implementation if
+ * their schemas agree down to the attributes canonical form drops.
+ *
+ * The cache holds one reference to each implementation, and drops the
+ * least recently used one when it grows past its limit.  Callers keep
+ * their own references, so an evicted implementation lives on for as
+ * long as they need it.
+ */
+
+#define DEFAULT_CACHE_LIMIT  64
+
+/* JSON never contains a raw control character. */
+#define KEY_SEPARATOR  '\x1f'
+
+struct resolver_cache_entry {
+	struct resolver_cache_entry  *prev;
+	struct resolver_cache_entry  *next;
+	char  *key;
+	size_t  key_size;
+	avro_value_iface_t  *iface;
+};
+
+struct resolver_cache {
+	st_table  *entries;
+	/* most recently used first */
+	struct resolver_cache_entry  *head;
+	struct resolver_cache_entry  *tail;
+	size_t  count;
+};
+
+static struct resolver_cache  reader_cache = { NULL, NULL, NULL, 0 };
+static struct resolver_cache  writer_cache = { NULL, NULL, NULL, 0 };
+static size_t  cache_limit = DEFAULT_CACHE_LIMIT;
+
+
+/*
+ * Appends the JSON text of a schema to a growing buffer.
+ */
+
+static int
+append_schema_json(avro_schema_t schema, char **buf, size_t *size,
+		   size_t *used)
+{
+	for (;;) {
+		avro_writer_t  writer =
+		    avro_writer_memory(*buf + *used, *size - *used);
+		if (writer == NULL) {
+			return ENOMEM;
+		}
+		int  rval = avro_schema_to_json(schema, writer);
+		int64_t  written = avro_writer_tell(writer);
+		avro_writer_free(writer);
+		if (rval == 0 && *used + written < *size) {
+			*used += written;
+			return 0;
+		}
+		if (rval != 0 && rval != ENOSPC) {
+			return rval;
+		}
+
+		char  *bigger = (char *) avro_realloc(*buf, *size, *size * 2);
+		if (bigger == NULL) {
+			avro_set_error("Cannot allocate resolver cache key");
+			return ENOMEM;
+		}
+		*buf = bigger;
+		*size *= 2;
+	}
+}
+
+static char *
+cache_key(avro_schema_t wschema, avro_schema_t rschema, size_t *key_size)
+{
+	size_t  size = 1024;
+	size_t  used = 0;
+	char  *buf = (char *) avro_malloc(size);
+	if (buf == NULL) {
+		avro_set_error("Cannot allocate resolver cache key");
+		return NULL;
+	}
+
+	if (append_schema_json(wschema, &buf, &size, &used) != 0) {
+		goto error;
+	}
+	buf[used++] = KEY_SEPARATOR;
+	if (append_schema_json(rschema, &buf, &size, &used) != 0) {
+		goto error;
+	}
+	buf[used] = '\0';
+
+	*key_size = size;
+	return buf;
+
+error:
+	avro_prefix_error("Cannot build resolver cache key: ");
+	avro_free(buf, size);
+	return NULL;
+}
+
+
+static void
+cache_unlink(struct resolver_cache *cache, struct resolver_cache_entry *entry)
+{
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		cache->head = entry->next;
+	}
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		cache->tail = entry->prev;
+	}
+	entry->prev = entry->next = NULL;
+}
+
+static void
+cache_push_front(struct resolver_cache *cache,
+		 struct resolver_cache_entry *entry)
+{
+	entry->prev = NULL;
+	entry->next = cache->head;
+	if (cache->head) {
+		cache->head->prev = entry;
+	} else {
+		cache->tail = entry;
+	}
+	cache->head = entry;
+}
+
+static void
+cache_evict(struct resolver_cache *cache, struct resolver_cache_entry *entry)
+{
+	st_data_t  key = (st_data_t) entry->key;
+	cache_unlink(cache, entry);
+	st_delete(cache->entries, &key, NULL);
+	cache->count--;
+
+	avro_value_iface_decref(entry->iface);
+	avro_free(entry->key, entry->key_size);
+	avro_freet(struct resolver_cache_entry, entry);
+}
+
+static void
+cache_trim(struct resolver_cache *cache, size_t limit)
+{
+	while (cache->count > limit) {
+		cache_evict(cache, cache->tail);
+	}
+}
+
+/*
+ * Returns a new reference to the cached implementation for key, or
+ * NULL.  Must be called with the lock held.
+ */
+
+static avro_value_iface_t *
+cache_lookup(struct resolver_cache *cache, const char *key)
+{
+	st_data_t  data;
+	if (cache->entries == NULL ||
+	    !st_lookup(cache->entries, (st_data_t) key, &data)) {
+		return NULL;
+	}
+
+	struct resolver_cache_entry  *entry =
+	    (struct resolver_cache_entry *) data;
+	cache_unlink(cache, entry);
+	cache_push_front(cache, entry);
+	return avro_value_iface_incref(entry->iface);
+}
+
+static avro_value_iface_t *
+cache_find_or_create(struct resolver_cache *cache,
+		     avro_value_iface_t *(*create)(avro_schema_t, avro_schema_t),
+		     avro_schema_t wschema, avro_schema_t rschema)
+{
+	size_t  key_size;
+	char  *key = cache_key(wschema, rschema, &key_size);
+	if (key == NULL) {
+		return NULL;
+	}
+
+	cache_lock();
+	avro_value_iface_t  *iface = cache_lookup(cache, key);
+	cache_unlock();
+	if (iface != NULL) {
+		avro_free(key, key_size);
+		return iface;
+	}
+
+	/*
+	 * Resolve without the lock, so that threads resolving different
+	 * schemas don't wait for each other.  If another thread got
+	 * there first, we use its implementation instead.
+	 */
+
+	iface = create(wschema, rschema);
+	if (iface == NULL) {
+		avro_free(key, key_size);
+		return NULL;
+	}
+
+	struct resolver_cache_entry  *entry =
+	    (struct resolver_cache_entry *) avro_new(struct resolver_cache_entry);
+	if (entry == NULL) {
+		/* The implementation is still good, just not cached. */
+		avro_free(key, key_size);
+		return iface;
+	}
+	entry->key = key;
+	entry->key_size = key_size;
+	entry->iface = avro_value_iface_incref(iface);
+
+	cache_lock();
+	avro_value_iface_t  *existing = cache_lookup(cache, key);
+	if (existing == NULL) {
+		if (cache->entries == NULL) {
+			cache->entries = st_init_strtable();
+		}
+		st_insert(cache->entries, (st_data_t) entry->key, (st_data_t) entry);
+		cache_push_front(cache, entry);
+		cache->count++;
+		cache_trim(cache, cache_limit);
+		entry = NULL;
+	}
+	cache_unlock();
+
+	if (existing != NULL) {
+		avro_value_iface_decref(entry->iface);
+		avro_value_iface_decref(iface);
+		avro_free(entry->key, entry->key_size);
+		avro_freet(struct resolver_cache_entry, entry);
+		return existing;
+	}
+	return iface;
+}
+
+static avro_value_iface_t *
+cache_get(struct resolver_cache *cache,
+	  avro_value_iface_t *(*create)(avro_schema_t, avro_schema_t),
+	  avro_schema_t wschema, avro_schema_t rschema)
+{
+	if (cache_limit == 0) {
+		return create(wschema, rschema);
+	}
+
+	/*
+	 * Cached implementations outlive any arena the caller has bound,
+	 * so they're built without it.
+	 */
+
+	avro_arena_t  arena = avro_arena_bind(NULL);
+	avro_value_iface_t  *iface =
+	    cache_find_or_create(cache, create, wschema, rschema);
+	avro_arena_bind(arena);
+	return iface;
+}
+
+
+avro_value_iface_t *
+avro_resolved_reader_new_cached(avro_schema_t wschema, avro_schema_t rschema)
+{
+	check_param(NULL, is_avro_schema(wschema), "writer schema");
+	check_param(NULL, is_avro_schema(rschema), "reader schema");
+	return cache_get(&reader_cache, avro_resolved_reader_new,
+			 wschema, rschema);
+}
+
+avro_value_iface_t *
+avro_resolved_writer_new_cached(avro_schema_t wschema, avro_schema_t rschema)
+{
+	check_param(NULL, is_avro_schema(wschema), "writer schema");
+	check_param(NULL, is_avro_schema(rschema), "reader schema");
+	return cache_get(&writer_cache, avro_resolved_writer_new,
+			 wschema, rschema);
+}
+
+static void
+cache_free(struct resolver_cache *cache)
+{
+	cache_trim(cache, 0);
+	if (cache->entries != NULL) {
+		st_free_table(cache->entries);
+		cache->entries = NULL;
+	}
+}
+
+void
+avro_resolver_cache_set_limit(size_t limit)
+{
+	cache_lock();
+	cache_limit = limit;
+	cache_trim(&reader_cache, limit);
+	cache_trim(&writer_cache, limit);
+	cache_unlock();
+}
+
+void
+avro_resolver_cache_clear(void)
+{
+	cache_lock();
+	cache_free(&reader_cache);
+	cache_free(&writer_cache);
+	cache_unlock();
+}
@@ -140,6 +140,7 @@ static void avro_schema_free(avro_schema_t schema)
 					   0);
 				st_free_table(record->fields_byname);
 				st_free_table(record->fields);
+				avro_skip_plan_decref(record->skip_plan);
 				avro_freet(struct avro_record_schema_t, record);
 			}
 			break;
@@ -344,6 +345,7 @@ avro_schema_t avro_schema_fixed_ns(const char *name, const char *space,
 		return NULL;
 	}
 	fixed->size = size;
+	avro_schema_memo_init(&fixed->memo);
 	avro_schema_init(&fixed->obj, AVRO_FIXED);
 	return &fixed->obj;
 }
@@ -376,6 +378,7 @@ avro_schema_t avro_schema_union(void)
 		return NULL;
 	}
 
+	avro_schema_memo_init(&schema->memo);
 	avro_schema_init(&schema->obj, AVRO_UNION);
 	return &schema->obj;
 }
@@ -395,6 +398,7 @@ avro_schema_union_append(const avro_schema_t union_schema,
 	st_insert(unionp->branches_byname, (st_data_t) name,
 		  (st_data_t) new_index);
 	avro_schema_incref(schema);
+	avro_schema_changed(union_schema);
 	return 0;
 }
 
@@ -452,6 +456,7 @@ avro_schema_t avro_schema_array(const avro_schema_t items)
 		return NULL;
 	}
 	array->items = avro_schema_incref(items);
+	avro_schema_memo_init(&array->memo);
 	avro_schema_init(&array->obj, AVRO_ARRAY);
 	return &array->obj;
 }
@@ -470,6 +475,7 @@ avro_schema_t avro_schema_map(const avro_schema_t values)
 		return NULL;
 	}
 	map->values = avro_schema_incref(values);
+	avro_schema_memo_init(&map->memo);
 	avro_schema_init(&map->obj, AVRO_MAP);
 	return &map->obj;
 }
@@ -526,6 +532,7 @@ avro_schema_t avro_schema_enum_ns(const char *name, const char *space)
 		avro_freet(struct avro_enum_schema_t, enump);
 		return NULL;
 	}
+	avro_schema_memo_init(&enump->memo);
 	avro_schema_init(&enump->obj, AVRO_ENUM);
 	return &enump->obj;
 }
@@ -577,6 +584,7 @@ avro_schema_enum_symbol_append(const avro_schema_t enum_schema,
 	idx = enump->symbols->num_entries;
 	st_insert(enump->symbols, (st_data_t) idx, (st_data_t) sym);
 	st_insert(enump->symbols_byname, (st_data_t) sym, (st_data_t) idx);
+	avro_schema_changed(enum_schema);
 	return 0;
 }
 
@@ -619,10 +627,12 @@ avro_schema_record_field_append(const avro_schema_t record_schema,
 	new_field->index = record->fields->num_entries;
 	new_field->name = avro_strdup(field_name);
 	new_field->type = avro_schema_incref(field_schema);
+	new_field->order = AVRO_ORDER_ASCENDING;
 	st_insert(record->fields, record->fields->num_entries,
 		  (st_data_t) new_field);
 	st_insert(record->fields_byname, (st_data_t) new_field->name,
 		  (st_data_t) new_field);
+	avro_schema_changed(record_schema);
 	return 0;
 }
 
@@ -673,6 +683,8 @@ avro_schema_t avro_schema_record(const char *name, const char *space)
 		return NULL;
 	}
 
+	avro_schema_memo_init(&record->memo);
+	record->skip_plan = NULL;
 	avro_schema_init(&record->obj, AVRO_RECORD);
 	return &record->obj;
 }
@@ -720,6 +732,39 @@ const char *avro_schema_record_field_name(const avro_schema_t schema, int index)
 	return val.field->name;
 }
 
+avro_field_order_t avro_schema_record_field_order(const avro_schema_t record,
+						  int index)
+{
+	union {
+		st_data_t data;
+		struct avro_record_field_t *field;
+	} val;
+	st_lookup(avro_schema_to_record(record)->fields, index, &val.data);
+	return val.field->order;
+}
+
+int avro_schema_record_field_set_order(const avro_schema_t record,
+				       int index, avro_field_order_t order)
+{
+	union {
+		st_data_t data;
+		struct avro_record_field_t *field;
+	} val;
+
+	check_param(EINVAL, is_avro_schema(record), "record schema");
+	check_param(EINVAL, is_avro_record(record), "record schema");
+	check_param(EINVAL, order == AVRO_ORDER_ASCENDING ||
+		    order == AVRO_ORDER_DESCENDING ||
+		    order == AVRO_ORDER_IGNORE, "field order");
+
+	if (!st_lookup(avro_schema_to_record(record)->fields, index, &val.data)) {
+		avro_set_error("No field at index %d in record", index);
+		return EINVAL;
+	}
+	val.field->order = order;
+	return 0;
+}
+
 avro_schema_t avro_schema_record_field_get_by_index
 (const avro_schema_t record, int index)
 {
@@ -979,6 +1024,8 @@ avro_schema_from_json_t(json_t *json, avro_schema_t *schema,
 				    json_array_get(json_fields, i);
 				json_t *json_field_name;
 				json_t *json_field_type;
+				json_t *json_field_order;
+				avro_field_order_t field_order = AVRO_ORDER_ASCENDING;
 				avro_schema_t json_field_type_schema;
 				int field_rval;
 
@@ -1001,6 +1048,21 @@ avro_schema_from_json_t(json_t *json, avro_schema_t *schema,
 					avro_schema_decref(*schema);
 					return EINVAL;
 				}
+				json_field_order =
+				    json_object_get(json_field, "order");
+				if (json_field_order) {
+					const char *order =
+					    json_string_value(json_field_order);
+					if (order && strcmp(order, "descending") == 0) {
+						field_order = AVRO_ORDER_DESCENDING;
+					} else if (order && strcmp(order, "ignore") == 0) {
+						field_order = AVRO_ORDER_IGNORE;
+					} else if (!order || strcmp(order, "ascending") != 0) {
+						avro_set_error("Record field %d has an invalid \"order\"", i);
+						avro_schema_decref(*schema);
+						return EINVAL;
+					}
+				}
 				field_rval =
 				    avro_schema_from_json_t(json_field_type,
 							    &json_field_type_schema,
@@ -1020,6 +1082,7 @@ avro_schema_from_json_t(json_t *json, avro_schema_t *schema,
 					avro_schema_decref(*schema);
 					return field_rval;
 				}
+				avro_schema_record_field_set_order(*schema, i, field_order);
 			}
 		}
 		break;
@@ -1336,6 +1399,8 @@ avro_schema_t avro_schema_copy_root(avro_schema_t schema, st_table *named_schema
 				avro_schema_record_field_append(new_schema,
 								val.field->name,
 								type_copy);
+				avro_schema_record_field_set_order(new_schema, i,
+								   val.field->order);
 				avro_schema_decref(type_copy);
 			}
 		}
@@ -1692,6 +1757,11 @@ static int write_field(avro_writer_t out, const struct avro_record_field_t *fiel
 	check(rval, avro_write_str(out, field->name));
 	check(rval, avro_write_str(out, "\",\"type\":"));
 	check(rval, avro_schema_to_json2(field->type, out, parent_namespace));
+	if (field->order == AVRO_ORDER_DESCENDING) {
+		check(rval, avro_write_str(out, ",\"order\":\"descending\""));
+	} else if (field->order == AVRO_ORDER_IGNORE) {
+		check(rval, avro_write_str(out, ",\"order\":\"ignore\""));
+	}
 	return avro_write_str(out, "}");
 }
 
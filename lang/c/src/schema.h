@@ -23,10 +23,44 @@
 #include "avro_private.h"
 #include "st.h"
 
+/*
+ * Each complex schema but a link memoizes its hash, as computed by
+ * avro_schema_hash, in memo.hash: the stamp the hash was taken at is in
+ * the high 32 bits, and the hash in the low ones.  A schema's stamp is
+ * its own version, which every change to it moves on, plus a count of
+ * the changes made to schemas that others may hold, which is how a
+ * change to a schema reaches the hashes of the schemas holding it.
+ * Schemas are built before they're shared, so parsing one only moves
+ * its own versions on, and leaves every other memo alone.
+ */
+
+struct avro_schema_memo {
+	uint64_t hash;
+	volatile int version;
+};
+
+#define avro_schema_memo_init(memo) \
+	((memo)->hash = 0, (memo)->version = 1)
+
+void avro_schema_changed(avro_schema_t schema);
+
+/* The current stamp of a complex schema, or 0 if memos are off. */
+uint32_t avro_schema_stamp(avro_schema_t schema);
+
+/*
+ * A record also memoizes the plan avro_skip_data compiles to skip it,
+ * tagged with the stamp it was compiled at, and releases it when
+ * freed.
+ */
+
+struct avro_skip_plan;
+void avro_skip_plan_decref(struct avro_skip_plan *plan);
+
 struct avro_record_field_t {
 	int index;
 	char *name;
 	avro_schema_t type;
+	avro_field_order_t order;
 	/*
 	 * TODO: default values 
 	 */
@@ -34,14 +68,17 @@ struct avro_record_field_t {
 
 struct avro_record_schema_t {
 	struct avro_obj_t obj;
+	struct avro_schema_memo memo;
 	char *name;
 	char *space;
 	st_table *fields;
 	st_table *fields_byname;
+	struct avro_skip_plan *skip_plan;
 };
 
 struct avro_enum_schema_t {
 	struct avro_obj_t obj;
+	struct avro_schema_memo memo;
 	char *name;
 	char *space;
 	st_table *symbols;
@@ -50,22 +87,26 @@ struct avro_enum_schema_t {
 
 struct avro_array_schema_t {
 	struct avro_obj_t obj;
+	struct avro_schema_memo memo;
 	avro_schema_t items;
 };
 
 struct avro_map_schema_t {
 	struct avro_obj_t obj;
+	struct avro_schema_memo memo;
 	avro_schema_t values;
 };
 
 struct avro_union_schema_t {
 	struct avro_obj_t obj;
+	struct avro_schema_memo memo;
 	st_table *branches;
 	st_table *branches_byname;
 };
 
 struct avro_fixed_schema_t {
 	struct avro_obj_t obj;
+	struct avro_schema_memo memo;
 	const char *name;
 	const char *space;
 	int64_t size;
@@ -16,9 +16,253 @@
  */
 
 #include "avro_private.h"
+#include "avro/refcount.h"
 #include "schema.h"
 #include <string.h>
 
+/*
+ * Memos and versions are read and written atomically, so that threads
+ * hashing the same schema never see half of a memo, and a 32-bit
+ * target still reads and writes a memo as one word.  Where there are no
+ * atomics to hand, a lock stands in for them.
+ */
+#if (__GNUC__ * 10000 + __GNUC_MINOR__ * 100 + __GNUC_PATCHLEVEL__) >= 40700 \
+|| defined(__clang__)
+#define memo_load(memo)  __atomic_load_n((memo), __ATOMIC_ACQUIRE)
+#define memo_store(memo, value) \
+	__atomic_store_n((memo), (value), __ATOMIC_RELEASE)
+#define version_load(version)  __atomic_load_n((version), __ATOMIC_ACQUIRE)
+#define version_inc(version) \
+	__atomic_add_fetch((version), 1, __ATOMIC_ACQ_REL)
+#elif defined(_WIN32)
+#include <windows.h>
+#define memo_load(memo) \
+	((uint64_t) InterlockedCompareExchange64((volatile LONG64 *) (memo), 0, 0))
+#define memo_store(memo, value) \
+	InterlockedExchange64((volatile LONG64 *) (memo), (LONG64) (value))
+#define version_load(version) \
+	InterlockedCompareExchange((volatile LONG *) (version), 0, 0)
+#define version_inc(version)  InterlockedIncrement((volatile LONG *) (version))
+#else
+#if defined THREADSAFE && (defined __unix__ || defined __unix)
+#include <pthread.h>
+static pthread_mutex_t  memo_lock = PTHREAD_MUTEX_INITIALIZER;
+#define memo_lock()    pthread_mutex_lock(&memo_lock)
+#define memo_unlock()  pthread_mutex_unlock(&memo_lock)
+#else
+#define memo_lock()
+#define memo_unlock()
+#endif
+
+static uint64_t memo_load(const uint64_t *memo)
+{
+	uint64_t value;
+	memo_lock();
+	value = *memo;
+	memo_unlock();
+	return value;
+}
+
+static void memo_store(uint64_t *memo, uint64_t value)
+{
+	memo_lock();
+	*memo = value;
+	memo_unlock();
+}
+
+static int version_load(volatile int *version)
+{
+	int value;
+	memo_lock();
+	value = *version;
+	memo_unlock();
+	return value;
+}
+
+static void version_inc(volatile int *version)
+{
+	memo_lock();
+	*version += 1;
+	memo_unlock();
+}
+#endif
+
+/*
+ * The number of changes made to schemas that other schemas may hold,
+ * which is part of the stamp of every schema.
+ */
+static volatile int  shared_changes = 0;
+
+/* 32-bit FNV-1a */
+#define HASH_BASIS  2166136261u
+#define HASH_PRIME  16777619u
+
+static uint32_t hash_bytes(uint32_t h, const void *buf, size_t len)
+{
+	const unsigned char *p = (const unsigned char *) buf;
+	size_t i;
+	for (i = 0; i < len; i++) {
+		h = (h ^ p[i]) * HASH_PRIME;
+	}
+	return h;
+}
+
+static uint32_t hash_long(uint32_t h, int64_t l)
+{
+	return hash_bytes(h, &l, sizeof(l));
+}
+
+/* NULL hashes apart from every string, as nullstrcmp compares it. */
+static uint32_t hash_string(uint32_t h, const char *s)
+{
+	if (!s) {
+		return hash_long(h, -1);
+	}
+	return hash_bytes(h, s, strlen(s) + 1);
+}
+
+static struct avro_schema_memo *schema_memo(avro_schema_t schema)
+{
+	switch (avro_typeof(schema)) {
+	case AVRO_RECORD:
+		return &avro_schema_to_record(schema)->memo;
+	case AVRO_ENUM:
+		return &avro_schema_to_enum(schema)->memo;
+	case AVRO_FIXED:
+		return &avro_schema_to_fixed(schema)->memo;
+	case AVRO_MAP:
+		return &avro_schema_to_map(schema)->memo;
+	case AVRO_ARRAY:
+		return &avro_schema_to_array(schema)->memo;
+	case AVRO_UNION:
+		return &avro_schema_to_union(schema)->memo;
+	default:
+		return NULL;
+	}
+}
+
+void avro_schema_changed(avro_schema_t schema)
+{
+	struct avro_schema_memo *memo = schema_memo(schema);
+	if (memo) {
+		version_inc(&memo->version);
+	}
+	/* Another schema may hold this one, and hash it into its own. */
+	if (!avro_refcount_is_unique(&schema->refcount)) {
+		version_inc(&shared_changes);
+	}
+}
+
+uint32_t avro_schema_stamp(avro_schema_t schema)
+{
+	struct avro_schema_memo *memo = schema_memo(schema);
+	if (!memo) {
+		return 0;
+	}
+	/* Both only ever grow, so their sum moves on with either. */
+	return (uint32_t) version_load(&memo->version) +
+	    (uint32_t) version_load(&shared_changes);
+}
+
+/*
+ * Hashes what avro_schema_equal compares, and nothing else.  A link
+ * hashes only the name of the schema it points to, which also keeps
+ * recursive schemas from recursing forever.
+ */
+static uint32_t schema_hash(avro_schema_t schema)
+{
+	uint32_t h = hash_long(HASH_BASIS, avro_typeof(schema));
+	long i;
+
+	if (is_avro_record(schema)) {
+		struct avro_record_schema_t *record = avro_schema_to_record(schema);
+		h = hash_string(h, record->name);
+		h = hash_string(h, record->space);
+		h = hash_long(h, record->fields->num_entries);
+		for (i = 0; i < record->fields->num_entries; i++) {
+			union {
+				st_data_t data;
+				struct avro_record_field_t *f;
+			} field;
+			st_lookup(record->fields, i, &field.data);
+			h = hash_string(h, field.f->name);
+			h = hash_long(h, avro_schema_hash(field.f->type));
+		}
+	} else if (is_avro_enum(schema)) {
+		struct avro_enum_schema_t *enump = avro_schema_to_enum(schema);
+		h = hash_string(h, enump->name);
+		h = hash_string(h, enump->space);
+		h = hash_long(h, enump->symbols->num_entries);
+		for (i = 0; i < enump->symbols->num_entries; i++) {
+			union {
+				st_data_t data;
+				char *sym;
+			} sym;
+			st_lookup(enump->symbols, i, &sym.data);
+			h = hash_string(h, sym.sym);
+		}
+	} else if (is_avro_fixed(schema)) {
+		struct avro_fixed_schema_t *fixed = avro_schema_to_fixed(schema);
+		h = hash_string(h, fixed->name);
+		h = hash_string(h, fixed->space);
+		h = hash_long(h, fixed->size);
+	} else if (is_avro_map(schema)) {
+		h = hash_long(h, avro_schema_hash(avro_schema_to_map(schema)->values));
+	} else if (is_avro_array(schema)) {
+		h = hash_long(h, avro_schema_hash(avro_schema_to_array(schema)->items));
+	} else if (is_avro_union(schema)) {
+		struct avro_union_schema_t *unionp = avro_schema_to_union(schema);
+		h = hash_long(h, unionp->branches->num_entries);
+		for (i = 0; i < unionp->branches->num_entries; i++) {
+			union {
+				st_data_t data;
+				avro_schema_t schema;
+			} branch;
+			st_lookup(unionp->branches, i, &branch.data);
+			h = hash_long(h, avro_schema_hash(branch.schema));
+		}
+	} else if (is_avro_link(schema)) {
+		avro_schema_t to = avro_schema_to_link(schema)->to;
+		if (is_avro_record(to)) {
+			h = hash_string(h, avro_schema_to_record(to)->space);
+		}
+		h = hash_string(h, avro_schema_name(to));
+	}
+	return h;
+}
+
+uint32_t avro_schema_hash(avro_schema_t schema)
+{
+	struct avro_schema_memo *memo;
+	uint32_t current;
+	uint64_t value;
+	uint32_t h;
+
+	if (!is_avro_schema(schema)) {
+		return 0;
+	}
+
+	/*
+	 * The stamp is read before hashing, so a change made while
+	 * hashing leaves a memo that is already out of date.  A stamp
+	 * that has wrapped round to 0 turns the memo off.
+	 */
+	memo = schema_memo(schema);
+	current = avro_schema_stamp(schema);
+	if (current != 0) {
+		value = memo_load(&memo->hash);
+		if ((uint32_t) (value >> 32) == current) {
+			return (uint32_t) value;
+		}
+	}
+
+	h = schema_hash(schema);
+	if (current != 0) {
+		memo_store(&memo->hash, ((uint64_t) current << 32) | h);
+	}
+	return h;
+}
+
 static int
 schema_record_equal(struct avro_record_schema_t *a,
 		    struct avro_record_schema_t *b)
@@ -75,6 +319,10 @@ schema_enum_equal(struct avro_enum_schema_t *a, struct avro_enum_schema_t *b)
 	if (nullstrcmp(a->space, b->space)) {
 		return 0;
 	}
+	if (a->symbols->num_entries != b->symbols->num_entries) {
+		/* They have different numbers of symbols */
+		return 0;
+	}
 	for (i = 0; i < a->symbols->num_entries; i++) {
 		union {
 			st_data_t data;
@@ -125,6 +373,10 @@ static int
 schema_union_equal(struct avro_union_schema_t *a, struct avro_union_schema_t *b)
 {
 	long i;
+	if (a->branches->num_entries != b->branches->num_entries) {
+		/* They have different numbers of branches */
+		return 0;
+	}
 	for (i = 0; i < a->branches->num_entries; i++) {
 		union {
 			st_data_t data;
@@ -178,6 +430,13 @@ int avro_schema_equal(avro_schema_t a, avro_schema_t b)
 		return 1;
 	} else if (avro_typeof(a) != avro_typeof(b)) {
 		return 0;
+	} else if (schema_memo(a) &&
+		   avro_schema_hash(a) != avro_schema_hash(b)) {
+		/*
+		 * complex schemas with different hashes differ, which
+		 * is quick to tell once the hashes are memoized
+		 */
+		return 0;
 	} else if (is_avro_record(a)) {
 		return schema_record_equal(avro_schema_to_record(a),
 					   avro_schema_to_record(b));
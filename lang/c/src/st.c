@@ -19,23 +19,29 @@ typedef struct st_table_entry st_table_entry;
 
 struct st_table_entry {
 	unsigned int hash;
+	int state;
 	st_data_t key;
 	st_data_t record;
-	st_table_entry *next;
 };
 
-#define ST_DEFAULT_MAX_DENSITY 5
-#define ST_DEFAULT_INIT_TABLE_SIZE 11
+/*
+ * The entries live directly in bins, an open-addressed array probed
+ * linearly, with each key's hash saved next to it.  A lookup usually
+ * reads one cache line and only calls the compare function on a
+ * matching hash, and rehashing never calls the hash function again.
+ *
+ * Deleting an entry leaves a marker in its bin, which probes step
+ * over.  The markers are cleared the next time the table is rebuilt,
+ * which happens when live and deleted entries fill three quarters of
+ * the bins: bigger if most of them are live, the same size otherwise.
+ */
+
+#define EMPTY_BIN 0
+#define LIVE_BIN 1
+#define DELETED_BIN 2
+
+#define MINSIZE 8
 
-	/*
-	 * DEFAULT_MAX_DENSITY is the default for the largest we allow the
-	 * average number of items per bin before increasing the number of
-	 * bins
-	 *
-	 * DEFAULT_INIT_TABLE_SIZE is the default for the number of bins
-	 * allocated initially
-	 *
-	 */
 static int numcmp(long, long);
 static int numhash(long);
 static struct st_hash_type type_numhash = {
@@ -52,100 +58,61 @@ static struct st_hash_type type_strhash = {
 	HASH_FUNCTION_CAST strhash
 };
 
-static void rehash(st_table *);
-
-#ifdef RUBY
-#define malloc xmalloc
-#define calloc xcalloc
-#endif
-
-#define Calloc(n,s) (char*)avro_calloc((n),(s))
+static int rehash(st_table *);
 
 #define free_bins(tbl)  \
-	avro_free(tbl->bins, tbl->num_bins * sizeof(st_table_entry *))
+	avro_free((tbl)->bins, (tbl)->num_bins * sizeof(st_table_entry))
 
 #define EQUAL(table,x,y) ((x)==(y) || (*table->type->compare)((x),(y)) == 0)
 
 #define do_hash(key,table) (unsigned int)(*(table)->type->hash)((key))
-#define do_hash_bin(key,table) (do_hash(key, table)%(table)->num_bins)
 
 /*
- * MINSIZE is the minimum size of a dictionary.
+ * Pointer keys have their low bits clear and the string hash is weak
+ * in its low bits, so the hash is mixed before it picks the first bin.
  */
 
-#define MINSIZE 8
+#define first_bin(hash_val)  (((hash_val) * 0x9E3779B1u) >> 7)
+
+#define max_used(num_bins)  ((num_bins) / 4 * 3)
+
+#ifdef HASH_LOG
+static int collision = 0;
+static int init_st = 0;
+
+static void stat_col()
+{
+	FILE *f = fopen("/tmp/col", "w");
+	fprintf(f, "collision: %d\n", collision);
+	fclose(f);
+}
+#define COLLISION collision++
+#else
+#define COLLISION
+#endif
 
 /*
- * Table of prime numbers 2^n+a, 2<=n<=30. 
+ * Returns the number of bins needed to hold size entries.
  */
-static long primes[] = {
-	8 + 3,
-	16 + 3,
-	32 + 5,
-	64 + 3,
-	128 + 3,
-	256 + 27,
-	512 + 9,
-	1024 + 9,
-	2048 + 5,
-	4096 + 3,
-	8192 + 27,
-	16384 + 43,
-	32768 + 3,
-	65536 + 45,
-	131072 + 29,
-	262144 + 3,
-	524288 + 21,
-	1048576 + 7,
-	2097152 + 17,
-	4194304 + 15,
-	8388608 + 9,
-	16777216 + 43,
-	33554432 + 35,
-	67108864 + 15,
-	134217728 + 29,
-	268435456 + 3,
-	536870912 + 11,
-	1073741824 + 85,
-	0
-};
 
 static int new_size(int size)
 {
-	unsigned int i;
+	int  newsize;
 
-#if 0
-	for (i = 3; i < 31; i++) {
-		if ((1 << i) > size)
-			return 1 << i;
-	}
-	return -1;
-#else
-	int newsize;
-
-	for (i = 0, newsize = MINSIZE;
-	     i < sizeof(primes) / sizeof(primes[0]); i++, newsize <<= 1) {
-		if (newsize > size)
-			return primes[i];
+	for (newsize = MINSIZE; newsize > 0; newsize <<= 1) {
+		if (max_used(newsize) >= size)
+			return newsize;
 	}
 	/*
-	 * Ran out of polynomials 
+	 * Ran out of bits
 	 */
-	return -1;		/* should raise exception */
-#endif
+	return -1;
 }
 
-#ifdef HASH_LOG
-static int collision = 0;
-static int init_st = 0;
-
-static void stat_col()
+static st_table_entry *alloc_bins(int num_bins)
 {
-	FILE *f = fopen("/tmp/col", "w");
-	fprintf(f, "collision: %d\n", collision);
-	fclose(f);
+	return (st_table_entry *) avro_calloc(num_bins, sizeof(st_table_entry));
 }
-#endif
 
 st_table *st_init_table_with_size(struct st_hash_type *type, int size)
 {
@@ -158,13 +125,24 @@ st_table *st_init_table_with_size(struct st_hash_type *type, int size)
 	}
 #endif
 
-	size = new_size(size);	/* round up to prime number */
+	size = new_size(size);	/* round up to a power of two */
+	if (size < 0) {
+		return 0;
+	}
 
 	tbl = (st_table *) avro_new(st_table);
+	if (tbl == 0) {
+		return 0;
+	}
 	tbl->type = type;
-	tbl->num_entries = 0;
 	tbl->num_bins = size;
-	tbl->bins = (st_table_entry **) Calloc(size, sizeof(st_table_entry *));
+	tbl->num_entries = 0;
+	tbl->num_used = 0;
+	tbl->bins = alloc_bins(size);
+	if (tbl->bins == 0) {
+		avro_freet(st_table, tbl);
+		return 0;
+	}
 
 	return tbl;
 }
@@ -196,49 +174,46 @@ st_table *st_init_strtable_with_size(int size)
 
 void st_free_table(st_table *table)
 {
-	register st_table_entry *ptr, *next;
-	int i;
-
-	for (i = 0; i < table->num_bins; i++) {
-		ptr = table->bins[i];
-		while (ptr != 0) {
-			next = ptr->next;
-			avro_freet(st_table_entry, ptr);
-			ptr = next;
-		}
-	}
 	free_bins(table);
 	avro_freet(st_table, table);
 }
 
-#define PTR_NOT_EQUAL(table, ptr, hash_val, key) \
-((ptr) != 0 && (ptr->hash != (hash_val) || !EQUAL((table), (key), (ptr)->key)))
+/*
+ * Returns the live entry for key, or 0.
+ */
 
-#ifdef HASH_LOG
-#define COLLISION collision++
-#else
-#define COLLISION
-#endif
+static inline st_table_entry *
+find_entry(st_table *table, st_data_t key, unsigned int hash_val)
+{
+	unsigned int  mask = table->num_bins - 1;
+	unsigned int  i = first_bin(hash_val) & mask;
+	st_table_entry  *ptr;
+
+	while ((ptr = &table->bins[i])->state != EMPTY_BIN) {
+		if (ptr->hash == hash_val && ptr->state == LIVE_BIN &&
+		    EQUAL(table, key, ptr->key)) {
+			return ptr;
+		}
+		COLLISION;
+		i = (i + 1) & mask;
+	}
+	return 0;
+}
+
+static st_table_entry *empty_bin(st_table *table, unsigned int hash_val)
+{
+	unsigned int  mask = table->num_bins - 1;
+	unsigned int  i = first_bin(hash_val) & mask;
 
-#define FIND_ENTRY(table, ptr, hash_val, bin_pos) do {\
-    bin_pos = hash_val%(table)->num_bins;\
-    ptr = (table)->bins[bin_pos];\
-    if (PTR_NOT_EQUAL(table, ptr, hash_val, key)) {\
-	COLLISION;\
-	while (PTR_NOT_EQUAL(table, ptr->next, hash_val, key)) {\
-	    ptr = ptr->next;\
-	}\
-	ptr = ptr->next;\
-    }\
-} while (0)
+	while (table->bins[i].state != EMPTY_BIN) {
+		i = (i + 1) & mask;
+	}
+	return &table->bins[i];
+}
 
 int st_lookup(st_table *table, register st_data_t key, st_data_t *value)
 {
-	unsigned int hash_val, bin_pos;
-	register st_table_entry *ptr;
-
-	hash_val = do_hash(key, table);
-	FIND_ENTRY(table, ptr, hash_val, bin_pos);
+	st_table_entry  *ptr = find_entry(table, key, do_hash(key, table));
 
 	if (ptr == 0) {
 		return 0;
@@ -249,80 +224,91 @@ int st_lookup(st_table *table, register st_data_t key, st_data_t *value)
 	}
 }
 
-#define ADD_DIRECT(table, key, value, hash_val, bin_pos)\
-do {\
-    st_table_entry *entry;\
-    if (table->num_entries/(table->num_bins) > ST_DEFAULT_MAX_DENSITY) {\
-	rehash(table);\
-        bin_pos = hash_val % table->num_bins;\
-    }\
-    \
-    entry = (st_table_entry *) avro_new(st_table_entry);\
-    \
-    entry->hash = hash_val;\
-    entry->key = key;\
-    entry->record = value;\
-    entry->next = table->bins[bin_pos];\
-    table->bins[bin_pos] = entry;\
-    table->num_entries++;\
-} while (0)
+static int
+add_direct(st_table *table, st_data_t key, st_data_t value,
+	   unsigned int hash_val)
+{
+	st_table_entry  *entry;
+
+	if (table->num_used >= max_used(table->num_bins)) {
+		if (rehash(table) != 0) {
+			return -1;
+		}
+	}
+
+	entry = empty_bin(table, hash_val);
+	entry->hash = hash_val;
+	entry->state = LIVE_BIN;
+	entry->key = key;
+	entry->record = value;
+	table->num_used++;
+	table->num_entries++;
+	return 0;
+}
+
+/*
+ * Returns 1 if key was there already, 0 if it has been added, and -1
+ * if the table could not grow to hold it.
+ */
 
 int st_insert(register st_table *table, register st_data_t key, st_data_t value)
 {
-	unsigned int hash_val, bin_pos;
-	register st_table_entry *ptr;
+	unsigned int hash_val;
+	st_table_entry *ptr;
 
 	hash_val = do_hash(key, table);
-	FIND_ENTRY(table, ptr, hash_val, bin_pos);
+	ptr = find_entry(table, key, hash_val);
 
 	if (ptr == 0) {
-		ADD_DIRECT(table, key, value, hash_val, bin_pos);
-		return 0;
+		return add_direct(table, key, value, hash_val);
 	} else {
 		ptr->record = value;
 		return 1;
 	}
 }
 
-void st_add_direct(st_table *table,st_data_t key,st_data_t value)
+int st_add_direct(st_table *table,st_data_t key,st_data_t value)
 {
-	unsigned int hash_val, bin_pos;
-
-	hash_val = do_hash(key, table);
-	bin_pos = hash_val % table->num_bins;
-	ADD_DIRECT(table, key, value, hash_val, bin_pos);
+	return add_direct(table, key, value, do_hash(key, table));
 }
 
-static void rehash(register st_table *table)
+/*
+ * Rebuilds the table without its deleted entries, doubling it if all
+ * of its entries are live.  The new bins are allocated before the old
+ * ones are freed, so they always move, which st_foreach relies on to
+ * notice a rebuild.
+ */
+
+static int rehash(register st_table *table)
 {
-	register st_table_entry *ptr, *next, **new_bins;
+	st_table_entry *old_bins = table->bins;
 	int i, old_num_bins = table->num_bins, new_num_bins;
-	unsigned int hash_val;
 
-	new_num_bins = new_size(old_num_bins + 1);
-	new_bins =
-	    (st_table_entry **) Calloc(new_num_bins, sizeof(st_table_entry *));
+	new_num_bins = new_size(table->num_entries * 2);
+	if (new_num_bins < 0) {
+		return -1;
+	}
+	table->bins = alloc_bins(new_num_bins);
+	if (table->bins == 0) {
+		table->bins = old_bins;
+		return -1;
+	}
+	table->num_bins = new_num_bins;
 
 	for (i = 0; i < old_num_bins; i++) {
-		ptr = table->bins[i];
-		while (ptr != 0) {
-			next = ptr->next;
-			hash_val = ptr->hash % new_num_bins;
-			ptr->next = new_bins[hash_val];
-			new_bins[hash_val] = ptr;
-			ptr = next;
+		if (old_bins[i].state == LIVE_BIN) {
+			*empty_bin(table, old_bins[i].hash) = old_bins[i];
 		}
 	}
-	free_bins(table);
-	table->num_bins = new_num_bins;
-	table->bins = new_bins;
+	table->num_used = table->num_entries;
+
+	avro_free(old_bins, old_num_bins * sizeof(st_table_entry));
+	return 0;
 }
 
 st_table *st_copy(st_table *old_table)
 {
 	st_table *new_table;
-	st_table_entry *ptr, *entry;
-	int i, num_bins = old_table->num_bins;
 
 	new_table = (st_table *) avro_new(st_table);
 	if (new_table == 0) {
@@ -330,41 +316,20 @@ st_table *st_copy(st_table *old_table)
 	}
 
 	*new_table = *old_table;
-	new_table->bins = (st_table_entry **)
-	    Calloc((unsigned)num_bins, sizeof(st_table_entry *));
-
+	new_table->bins = alloc_bins(old_table->num_bins);
 	if (new_table->bins == 0) {
 		avro_freet(st_table, new_table);
 		return 0;
 	}
 
-	for (i = 0; i < num_bins; i++) {
-		new_table->bins[i] = 0;
-		ptr = old_table->bins[i];
-		while (ptr != 0) {
-			entry = (st_table_entry *) avro_new(st_table_entry);
-			if (entry == 0) {
-				free_bins(new_table);
-				avro_freet(st_table, new_table);
-				return 0;
-			}
-			*entry = *ptr;
-			entry->next = new_table->bins[i];
-			new_table->bins[i] = entry;
-			ptr = ptr->next;
-		}
-	}
+	memcpy(new_table->bins, old_table->bins,
+	       old_table->num_bins * sizeof(st_table_entry));
 	return new_table;
 }
 
 int st_delete(register st_table *table,register st_data_t *key,st_data_t *value)
 {
-	unsigned int hash_val;
-	st_table_entry *tmp;
-	register st_table_entry *ptr;
-
-	hash_val = do_hash_bin(*key, table);
-	ptr = table->bins[hash_val];
+	st_table_entry *ptr = find_entry(table, *key, do_hash(*key, table));
 
 	if (ptr == 0) {
 		if (value != 0)
@@ -372,58 +337,30 @@ int st_delete(register st_table *table,register st_data_t *key,st_data_t *value)
 		return 0;
 	}
 
-	if (EQUAL(table, *key, ptr->key)) {
-		table->bins[hash_val] = ptr->next;
-		table->num_entries--;
-		if (value != 0)
-			*value = ptr->record;
-		*key = ptr->key;
-		avro_freet(st_table_entry, ptr);
-		return 1;
-	}
-
-	for (; ptr->next != 0; ptr = ptr->next) {
-		if (EQUAL(table, ptr->next->key, *key)) {
-			tmp = ptr->next;
-			ptr->next = ptr->next->next;
-			table->num_entries--;
-			if (value != 0)
-				*value = tmp->record;
-			*key = tmp->key;
-			avro_freet(st_table_entry, tmp);
-			return 1;
-		}
-	}
-
-	return 0;
+	ptr->state = DELETED_BIN;
+	table->num_entries--;
+	if (value != 0)
+		*value = ptr->record;
+	*key = ptr->key;
+	return 1;
 }
 
 int st_delete_safe(register st_table *table,register st_data_t *key,st_data_t *value,st_data_t never)
 {
-	unsigned int hash_val;
-	register st_table_entry *ptr;
+	st_table_entry *ptr = find_entry(table, *key, do_hash(*key, table));
 
-	hash_val = do_hash_bin(*key, table);
-	ptr = table->bins[hash_val];
-
-	if (ptr == 0) {
+	if (ptr == 0 || ptr->key == never) {
 		if (value != 0)
 			*value = 0;
 		return 0;
 	}
 
-	for (; ptr != 0; ptr = ptr->next) {
-		if ((ptr->key != never) && EQUAL(table, ptr->key, *key)) {
-			table->num_entries--;
-			*key = ptr->key;
-			if (value != 0)
-				*value = ptr->record;
-			ptr->key = ptr->record = never;
-			return 1;
-		}
-	}
-
-	return 0;
+	table->num_entries--;
+	*key = ptr->key;
+	if (value != 0)
+		*value = ptr->record;
+	ptr->key = ptr->record = never;
+	return 1;
 }
 
 static int delete_never(st_data_t key, st_data_t value, st_data_t never)
@@ -445,51 +382,37 @@ void st_cleanup_safe(st_table *table,st_data_t never)
 
 int st_foreach(st_table *table,int (*func) (ANYARGS),st_data_t arg)
 {
-	st_table_entry *ptr, *last, *tmp;
+	st_table_entry *bins;
 	enum st_retval retval;
 	int i;
 
 	for (i = 0; i < table->num_bins; i++) {
-		last = 0;
-		for (ptr = table->bins[i]; ptr != 0;) {
-			retval = (enum st_retval) (*func) (ptr->key, ptr->record, arg);
-			switch (retval) {
-			case ST_CHECK:	/* check if hash is modified during
-					 * iteration */
-				tmp = 0;
-				if (i < table->num_bins) {
-					for (tmp = table->bins[i]; tmp;
-					     tmp = tmp->next) {
-						if (tmp == ptr)
-							break;
-					}
-				}
-				if (!tmp) {
-					/*
-					 * call func with error notice 
-					 */
-					return 1;
-				}
+		if (table->bins[i].state != LIVE_BIN)
+			continue;
+		bins = table->bins;
+		retval = (enum st_retval) (*func) (bins[i].key,
+						   bins[i].record, arg);
+		switch (retval) {
+		case ST_CHECK:	/* check if hash is modified during
+				 * iteration */
+			if (table->bins != bins ||
+			    table->bins[i].state != LIVE_BIN) {
 				/*
-				 * fall through 
+				 * call func with error notice 
 				 */
-			case ST_CONTINUE:
-				last = ptr;
-				ptr = ptr->next;
-				break;
-			case ST_STOP:
-				return 0;
-			case ST_DELETE:
-				tmp = ptr;
-				if (last == 0) {
-					table->bins[i] = ptr->next;
-				} else {
-					last->next = ptr->next;
-				}
-				ptr = ptr->next;
-				avro_freet(st_table_entry, tmp);
+				return 1;
+			}
+			break;
+		case ST_CONTINUE:
+			break;
+		case ST_STOP:
+			return 0;
+		case ST_DELETE:
+			if (table->bins == bins) {
+				table->bins[i].state = DELETED_BIN;
 				table->num_entries--;
 			}
+			break;
 		}
 	}
 	return 0;
@@ -42,11 +42,15 @@ struct st_hash_type {
   int (*hash) (ANYARGS);
 };
 
+/*
+ * The entries are stored in bins, which is open-addressed (see st.c).
+ */
 struct st_table {
 	struct st_hash_type *type;
-	int num_bins;
-	int num_entries;
-	struct st_table_entry **bins;
+	int num_bins;		/* size of bins, a power of two */
+	int num_entries;	/* live entries */
+	int num_used;		/* live and deleted entries */
+	struct st_table_entry *bins;
 };
 
 #define st_is_member(table,key) st_lookup(table,key,(st_data_t *)0)
@@ -68,7 +72,7 @@ int st_delete_safe _((st_table *, st_data_t *, st_data_t *, st_data_t));
 int st_insert _((st_table *, st_data_t, st_data_t));
 int st_lookup _((st_table *, st_data_t, st_data_t *));
 int st_foreach _((st_table *, int (*)(ANYARGS), st_data_t));
-void st_add_direct _((st_table *, st_data_t, st_data_t));
+int st_add_direct _((st_table *, st_data_t, st_data_t));
 void st_free_table _((st_table *));
 void st_cleanup_safe _((st_table *, st_data_t));
 st_table *st_copy _((st_table *));
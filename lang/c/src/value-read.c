@@ -24,6 +24,8 @@
 #include "avro/data.h"
 #include "avro/io.h"
 #include "avro/value.h"
+#include "avro_generic_internal.h"
+#include "avro_io_internal.h"
 #include "avro_private.h"
 #include "encoding.h"
 
@@ -35,11 +37,63 @@
  */
 
 static int
-read_value(avro_reader_t reader, avro_value_t *dest);
+read_value(avro_reader_t reader, avro_value_t *dest,
+	   avro_wrapped_buffer_t *source);
+
+
+/*
+ * Helpers for avro_value_read_wrapped.  The reader is a memory reader
+ * over the contents of the source buffer, so the current offset into
+ * one is also an offset into the other.
+ */
+
+static int
+read_wrapped_slice(avro_reader_t reader, int64_t len, size_t *offset)
+{
+	struct _avro_reader_memory_t  *mem = avro_reader_to_memory(reader);
+	if (len < 0 || len > mem->len - mem->read) {
+		avro_set_error("Cannot read %" PRId64 " bytes from memory buffer",
+			       len);
+		return ENOSPC;
+	}
+	*offset = mem->read;
+	mem->read += len;
+	return 0;
+}
+
+/*
+ * Reads a string as a NUL-terminated run of the source buffer.  The
+ * contents are moved back a byte, over the last byte of the length
+ * that precedes them, which leaves room for the terminator without
+ * touching the data that follows.  The size includes the NUL, as with
+ * read_string.
+ */
+
+static int
+read_wrapped_string(avro_reader_t reader, avro_wrapped_buffer_t *source,
+		    size_t *offset, size_t *size)
+{
+	int  rval;
+	int64_t  len;
+	size_t  start;
+	char  *str;
+
+	check(rval, avro_binary_encoding.read_long(reader, &len));
+	check(rval, read_wrapped_slice(reader, len, &start));
+
+	str = (char *) source->buf + start - 1;
+	memmove(str, str + 1, len);
+	str[len] = '\0';
+
+	*offset = start - 1;
+	*size = len + 1;
+	return 0;
+}
 
 
 static int
-read_array_value(avro_reader_t reader, avro_value_t *dest)
+read_array_value(avro_reader_t reader, avro_value_t *dest,
+		  avro_wrapped_buffer_t *source)
 {
 	int  rval;
 	size_t  i;          /* index within the current block */
@@ -63,7 +117,7 @@ read_array_value(avro_reader_t reader, avro_value_t *dest)
 			avro_value_t  child;
 
 			check(rval, avro_value_append(dest, &child, NULL));
-			check(rval, read_value(reader, &child));
+			check(rval, read_value(reader, &child, source));
 		}
 
 		check_prefix(rval, avro_binary_encoding.
@@ -76,7 +130,8 @@ read_array_value(avro_reader_t reader, avro_value_t *dest)
 
 
 static int
-read_map_value(avro_reader_t reader, avro_value_t *dest)
+read_map_value(avro_reader_t reader, avro_value_t *dest,
+	        avro_wrapped_buffer_t *source)
 {
 	int  rval;
 	size_t  i;          /* index within the current block */
@@ -100,6 +155,23 @@ read_map_value(avro_reader_t reader, avro_value_t *dest)
 			int64_t key_size;
 			avro_value_t  child;
 
+			if (source != NULL) {
+				/*
+				 * avro_value_add copies the key, so it can be
+				 * used in place.
+				 */
+				size_t  offset;
+				size_t  size;
+				check_prefix(rval, read_wrapped_string
+					     (reader, source, &offset, &size),
+					     "Cannot read map key: ");
+				check(rval, avro_value_add
+				      (dest, (const char *) source->buf + offset,
+				       &child, NULL, NULL));
+				check(rval, read_value(reader, &child, source));
+				continue;
+			}
+
 			check_prefix(rval, avro_binary_encoding.
 				     read_string(reader, &key, &key_size),
 				     "Cannot read map key: ");
@@ -110,7 +182,7 @@ read_map_value(avro_reader_t reader, avro_value_t *dest)
 				return rval;
 			}
 
-			rval = read_value(reader, &child);
+			rval = read_value(reader, &child, source);
 			if (rval) {
 				avro_free(key, key_size);
 				return rval;
@@ -129,7 +201,8 @@ read_map_value(avro_reader_t reader, avro_value_t *dest)
 
 
 static int
-read_record_value(avro_reader_t reader, avro_value_t *dest)
+read_record_value(avro_reader_t reader, avro_value_t *dest,
+		   avro_wrapped_buffer_t *source)
 {
 	int  rval;
 	size_t  field_count;
@@ -143,7 +216,7 @@ read_record_value(avro_reader_t reader, avro_value_t *dest)
 
 		check(rval, avro_value_get_by_index(dest, i, &field, NULL));
 		if (field.iface != NULL) {
-			check(rval, read_value(reader, &field));
+			check(rval, read_value(reader, &field, source));
 		} else {
 			avro_schema_t  field_schema =
 			    avro_schema_record_field_get_by_index(record_schema, i);
@@ -156,7 +229,8 @@ read_record_value(avro_reader_t reader, avro_value_t *dest)
 
 
 static int
-read_union_value(avro_reader_t reader, avro_value_t *dest)
+read_union_value(avro_reader_t reader, avro_value_t *dest,
+		  avro_wrapped_buffer_t *source)
 {
 	int rval;
 	int64_t discriminant;
@@ -178,7 +252,7 @@ read_union_value(avro_reader_t reader, avro_value_t *dest)
 	}
 
 	check(rval, avro_value_set_branch(dest, discriminant, &branch));
-	check(rval, read_value(reader, &branch));
+	check(rval, read_value(reader, &branch, source));
 	return 0;
 }
 
@@ -223,8 +297,10 @@ avro_wrapped_alloc_new(avro_wrapped_buffer_t *dest,
 }
 
 
+
 static int
-read_value(avro_reader_t reader, avro_value_t *dest)
+read_value(avro_reader_t reader, avro_value_t *dest,
+	   avro_wrapped_buffer_t *source)
 {
 	int  rval;
 
@@ -242,6 +318,21 @@ read_value(avro_reader_t reader, avro_value_t *dest)
 		{
 			char  *bytes;
 			int64_t  len;
+
+			if (source != NULL) {
+				size_t  offset;
+				avro_wrapped_buffer_t  buf;
+				check_prefix(rval, avro_binary_encoding.
+					     read_long(reader, &len),
+					     "Cannot read bytes value: ");
+				check_prefix(rval, read_wrapped_slice
+					     (reader, len, &offset),
+					     "Cannot read bytes value: ");
+				check(rval, avro_wrapped_buffer_copy
+				      (&buf, source, offset, len));
+				return avro_value_give_bytes(dest, &buf);
+			}
+
 			check_prefix(rval, avro_binary_encoding.
 				     read_bytes(reader, &bytes, &len),
 				     "Cannot read bytes value: ");
@@ -309,6 +400,18 @@ read_value(avro_reader_t reader, avro_value_t *dest)
 			char  *str;
 			int64_t  size;
 
+			if (source != NULL) {
+				size_t  offset;
+				size_t  len;
+				avro_wrapped_buffer_t  buf;
+				check_prefix(rval, read_wrapped_string
+					     (reader, source, &offset, &len),
+					     "Cannot read string value: ");
+				check(rval, avro_wrapped_buffer_copy
+				      (&buf, source, offset, len));
+				return avro_value_give_string_len(dest, &buf);
+			}
+
 			/*
 			 * read_string returns a size that includes the
 			 * NUL terminator, and the free function will be
@@ -325,7 +428,7 @@ read_value(avro_reader_t reader, avro_value_t *dest)
 		}
 
 		case AVRO_ARRAY:
-			return read_array_value(reader, dest);
+			return read_array_value(reader, dest, source);
 
 		case AVRO_ENUM:
 		{
@@ -342,6 +445,17 @@ read_value(avro_reader_t reader, avro_value_t *dest)
 			char *bytes;
 			int64_t size = avro_schema_fixed_size(schema);
 
+			if (source != NULL) {
+				size_t  offset;
+				avro_wrapped_buffer_t  buf;
+				check_prefix(rval, read_wrapped_slice
+					     (reader, size, &offset),
+					     "Cannot read fixed value: ");
+				check(rval, avro_wrapped_buffer_copy
+				      (&buf, source, offset, size));
+				return avro_value_give_fixed(dest, &buf);
+			}
+
 			bytes = (char *) avro_malloc(size);
 			if (!bytes) {
 				avro_prefix_error("Cannot allocate new fixed value");
@@ -365,13 +479,13 @@ read_value(avro_reader_t reader, avro_value_t *dest)
 		}
 
 		case AVRO_MAP:
-			return read_map_value(reader, dest);
+			return read_map_value(reader, dest, source);
 
 		case AVRO_RECORD:
-			return read_record_value(reader, dest);
+			return read_record_value(reader, dest, source);
 
 		case AVRO_UNION:
-			return read_union_value(reader, dest);
+			return read_union_value(reader, dest, source);
 
 		default:
 		{
@@ -388,5 +502,24 @@ avro_value_read(avro_reader_t reader, avro_value_t *dest)
 {
 	int  rval;
 	check(rval, avro_value_reset(dest));
-	return read_value(reader, dest);
+	if (avro_value_is_generic(dest)) {
+		return avro_generic_value_read(reader, dest);
+	}
+	return read_value(reader, dest, NULL);
+}
+
+int
+avro_value_read_wrapped(avro_reader_t reader, avro_value_t *dest,
+			avro_wrapped_buffer_t *source)
+{
+	int  rval;
+
+	if (!is_memory_io(reader) ||
+	    avro_reader_to_memory(reader)->buf != source->buf) {
+		avro_set_error("Reader must be a memory reader over the source buffer");
+		return EINVAL;
+	}
+
+	check(rval, avro_value_reset(dest));
+	return read_value(reader, dest, source);
 }
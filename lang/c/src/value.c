@@ -24,6 +24,7 @@
 #include "avro/errors.h"
 #include "avro/value.h"
 #include "avro_private.h"
+#include "avro_generic_internal.h"
 
 
 #define check_return(retval, call) \
@@ -513,6 +514,10 @@ avro_value_cmp(avro_value_t *val1, avro_value_t *val2)
 int
 avro_value_copy_fast(avro_value_t *dest, const avro_value_t *src)
 {
+	if (dest->iface == src->iface && avro_value_is_generic(dest)) {
+		return avro_generic_value_copy(dest, src);
+	}
+
 	avro_type_t  dest_type = avro_value_get_type(dest);
 	avro_type_t  src_type = avro_value_get_type(src);
 	if (dest_type != src_type) {
@@ -679,6 +684,14 @@ avro_value_copy_fast(avro_value_t *dest, const avro_value_t *src)
 int
 avro_value_copy(avro_value_t *dest, const avro_value_t *src)
 {
+	/*
+	 * Generic values of one implementation have the same schema, and
+	 * are copied between directly.
+	 */
+	if (dest->iface == src->iface && avro_value_is_generic(dest)) {
+		return avro_generic_value_copy(dest, src);
+	}
+
 	avro_schema_t  dest_schema = avro_value_get_schema(dest);
 	avro_schema_t  src_schema = avro_value_get_schema(src);
 	if (!avro_schema_equal(dest_schema, src_schema)) {
@@ -40,6 +40,13 @@
 typedef void
 (*test_func_t)(unsigned long);
 
+/*
+ * Tests that handle encoded data add its size here, once per
+ * operation, so that the harness can report a throughput.
+ */
+
+static uint64_t  bytes_processed = 0;
+
 
 void init_rand(void)
 {
@@ -83,6 +90,25 @@ test_refcount(unsigned long num_tests)
 }
 
 
+/**
+ * The same, with a datum whose reference count isn't atomic.
+ */
+
+static void
+test_refcount_local(unsigned long num_tests)
+{
+	unsigned long  i;
+
+	avro_datum_t  datum = avro_int32(42);
+	avro_datum_make_local(datum);
+	for (i = 0; i < num_tests; i++) {
+		avro_datum_incref(datum);
+		avro_datum_decref(datum);
+	}
+	avro_datum_decref(datum);
+}
+
+
 /**
  * Tests the performance of serializing and deserializing a somewhat
  * complex record type using the legacy datum API.
@@ -149,6 +175,7 @@ test_nested_record_datum(unsigned long num_tests)
 
 		avro_writer_reset(writer);
 		avro_write_data(writer, schema, in);
+		bytes_processed += avro_writer_tell(writer);
 
 		avro_datum_t  out = NULL;
 
@@ -250,6 +277,7 @@ test_nested_record_value_by_index(unsigned long num_tests)
 
 		avro_writer_reset(writer);
 		avro_value_write(writer, &val);
+		bytes_processed += avro_writer_tell(writer);
 
 		avro_reader_reset(reader);
 		avro_value_read(reader, &out);
@@ -354,6 +382,7 @@ test_nested_record_value_by_name(unsigned long num_tests)
 
 		avro_writer_reset(writer);
 		avro_value_write(writer, &val);
+		bytes_processed += avro_writer_tell(writer);
 
 		avro_reader_reset(reader);
 		avro_value_read(reader, &out);
@@ -461,6 +490,7 @@ test_generic_helper( unsigned long num_tests,
 
 		avro_writer_reset(writer);
 		avro_value_write(writer, p_value_to_write_to_memory);
+		bytes_processed += avro_writer_tell(writer);
 
 		avro_reader_reset(reader);
 		avro_value_read(reader, p_value_to_read_from_memory);
@@ -774,75 +804,675 @@ test_nested_array_resolved_reader(unsigned long num_tests)
 
 
 
+/**
+ * Tests driven by a schema, which is the nested record schema above
+ * unless another one is given with -s.  They all work on one sample
+ * value filled in with random data, and so measure the library rather
+ * than the code populating the value.
+ */
+
+#define DATAFILE_PATH  "performance.avro"
+#define DATAFILE_BLOCK_SIZE  (64 * 1024)
+
+static avro_schema_t  bench_schema = NULL;
+static avro_value_iface_t  *bench_iface = NULL;
+static avro_value_t  bench_sample;
+static char  *bench_buf = NULL;
+static size_t  bench_size = 0;
+static const char  *bench_codec = NULL;
+
+#define MAX_FILL_DEPTH  4
+
+static void
+fill_random_bytes(char *buf, size_t size)
+{
+	static const char  alphabet[] =
+	    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+	size_t  i;
+	for (i = 0; i < size; i++) {
+		buf[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+	}
+}
+
+/*
+ * Fills value with random data.  Arrays, maps and unions stop
+ * recursing past MAX_FILL_DEPTH, so recursive schemas terminate.
+ */
+
+static int
+fill_value(avro_value_t *value, int depth)
+{
+	avro_schema_t  schema = avro_value_get_schema(value);
+	avro_value_t  child;
+	char  buf[32];
+	size_t  count;
+	size_t  i;
+	int  rval;
+
+	switch (avro_value_get_type(value)) {
+	case AVRO_STRING:
+		count = rand() % sizeof(buf);
+		fill_random_bytes(buf, count);
+		return avro_value_set_string_len(value, buf, count);
+	case AVRO_BYTES:
+		count = rand() % sizeof(buf);
+		fill_random_bytes(buf, count);
+		return avro_value_set_bytes(value, buf, count);
+	case AVRO_INT32:
+		return avro_value_set_int(value, rand_int32());
+	case AVRO_INT64:
+		return avro_value_set_long(value, rand_int64());
+	case AVRO_FLOAT:
+		return avro_value_set_float(value, rand_number(-1e10, 1e10));
+	case AVRO_DOUBLE:
+		return avro_value_set_double(value, rand_number(-1e10, 1e10));
+	case AVRO_BOOLEAN:
+		return avro_value_set_boolean(value, rand() % 2);
+	case AVRO_NULL:
+		return avro_value_set_null(value);
+	case AVRO_ENUM:
+		return avro_value_set_enum
+		    (value, rand() % avro_schema_enum_number_of_symbols(schema));
+	case AVRO_FIXED:
+	{
+		size_t  size = avro_schema_fixed_size(schema);
+		char  *fixed = (char *) malloc(size + 1);
+		fill_random_bytes(fixed, size);
+		rval = avro_value_set_fixed(value, fixed, size);
+		free(fixed);
+		return rval;
+	}
+	case AVRO_RECORD:
+		avro_value_get_size(value, &count);
+		for (i = 0; i < count; i++) {
+			avro_value_get_by_index(value, i, &child, NULL);
+			check(rval, fill_value(&child, depth + 1));
+		}
+		return 0;
+	case AVRO_ARRAY:
+		count = depth < MAX_FILL_DEPTH? rand() % 8: 0;
+		for (i = 0; i < count; i++) {
+			avro_value_append(value, &child, NULL);
+			check(rval, fill_value(&child, depth + 1));
+		}
+		return 0;
+	case AVRO_MAP:
+		count = depth < MAX_FILL_DEPTH? rand() % 8: 0;
+		for (i = 0; i < count; i++) {
+			snprintf(buf, sizeof(buf), "key%lu", (unsigned long) i);
+			avro_value_add(value, buf, &child, NULL, NULL);
+			check(rval, fill_value(&child, depth + 1));
+		}
+		return 0;
+	case AVRO_UNION:
+	{
+		size_t  branches = avro_schema_union_size(schema);
+		int  discriminant = rand() % branches;
+		if (depth >= MAX_FILL_DEPTH) {
+			/* Prefer a null branch, which can't recurse. */
+			for (i = 0; i < branches; i++) {
+				if (is_avro_null(avro_schema_union_branch(schema, i))) {
+					discriminant = i;
+				}
+			}
+		}
+		avro_value_set_branch(value, discriminant, &child);
+		return fill_value(&child, depth + 1);
+	}
+	default:
+		return EINVAL;
+	}
+}
+
+static int
+bench_init(const char *schema_json, size_t schema_len)
+{
+	avro_writer_t  writer;
+
+	if (avro_schema_from_json_length(schema_json, schema_len, &bench_schema)) {
+		fprintf(stderr, "Cannot parse schema:\n  %s\n", avro_strerror());
+		return EINVAL;
+	}
+	/* The same sample on every run, so results can be compared. */
+	srand(1);
+	bench_iface = avro_generic_class_from_schema(bench_schema);
+	if (bench_iface == NULL ||
+	    avro_generic_value_new(bench_iface, &bench_sample) ||
+	    fill_value(&bench_sample, 0) ||
+	    avro_value_sizeof(&bench_sample, &bench_size)) {
+		fprintf(stderr, "Cannot create sample value:\n  %s\n", avro_strerror());
+		return EINVAL;
+	}
+
+	bench_buf = (char *) malloc(bench_size + 1);
+	writer = avro_writer_memory(bench_buf, bench_size + 1);
+	avro_value_write(writer, &bench_sample);
+	avro_writer_free(writer);
+	return 0;
+}
+
+static void
+bench_done(void)
+{
+	if (bench_buf != NULL) {
+		free(bench_buf);
+	}
+	if (bench_iface != NULL) {
+		avro_value_decref(&bench_sample);
+		avro_value_iface_decref(bench_iface);
+	}
+	if (bench_schema != NULL) {
+		avro_schema_decref(bench_schema);
+	}
+}
+
+
+/**
+ * Writes the sample value with the value API.
+ */
+
+static void
+test_value_write(unsigned long num_tests)
+{
+	avro_writer_t  writer = avro_writer_memory(bench_buf, bench_size + 1);
+	unsigned long  i;
+
+	for (i = 0; i < num_tests; i++) {
+		avro_writer_reset(writer);
+		avro_value_write(writer, &bench_sample);
+		bytes_processed += bench_size;
+	}
+	avro_writer_free(writer);
+}
+
+
+/**
+ * Reads the encoded sample value with the value API, into one value
+ * that is reset each time.
+ */
+
+static void
+test_value_read(unsigned long num_tests)
+{
+	avro_reader_t  reader = avro_reader_memory(bench_buf, bench_size);
+	avro_value_t  value;
+	unsigned long  i;
+
+	avro_generic_value_new(bench_iface, &value);
+	for (i = 0; i < num_tests; i++) {
+		avro_reader_reset(reader);
+		avro_value_reset(&value);
+		avro_value_read(reader, &value);
+		bytes_processed += bench_size;
+	}
+	avro_value_decref(&value);
+	avro_reader_free(reader);
+}
+
+
+/**
+ * Writes the sample value through a resolved reader, between two
+ * copies of the schema.
+ */
+
+static void
+test_value_write_resolved_reader(unsigned long num_tests)
+{
+	avro_writer_t  writer = avro_writer_memory(bench_buf, bench_size + 1);
+	avro_value_iface_t  *iface =
+	    avro_resolved_reader_new(bench_schema, bench_schema);
+	avro_value_t  resolved;
+	unsigned long  i;
+
+	avro_resolved_reader_new_value(iface, &resolved);
+	avro_resolved_reader_set_source(&resolved, &bench_sample);
+	for (i = 0; i < num_tests; i++) {
+		avro_writer_reset(writer);
+		avro_value_write(writer, &resolved);
+		bytes_processed += bench_size;
+	}
+	avro_value_decref(&resolved);
+	avro_value_iface_decref(iface);
+	avro_writer_free(writer);
+}
+
+
+/**
+ * Reads the encoded sample value through a resolved writer, between
+ * two copies of the schema.
+ */
+
+static void
+test_value_read_resolved_writer(unsigned long num_tests)
+{
+	avro_reader_t  reader = avro_reader_memory(bench_buf, bench_size);
+	avro_value_iface_t  *iface =
+	    avro_resolved_writer_new(bench_schema, bench_schema);
+	avro_value_t  resolved;
+	avro_value_t  value;
+	unsigned long  i;
+
+	avro_generic_value_new(bench_iface, &value);
+	avro_resolved_writer_new_value(iface, &resolved);
+	avro_resolved_writer_set_dest(&resolved, &value);
+	for (i = 0; i < num_tests; i++) {
+		avro_reader_reset(reader);
+		avro_value_reset(&value);
+		avro_value_read(reader, &resolved);
+		bytes_processed += bench_size;
+	}
+	avro_value_decref(&resolved);
+	avro_value_decref(&value);
+	avro_value_iface_decref(iface);
+	avro_reader_free(reader);
+}
+
+
+/**
+ * Writes the sample value as a datum with the legacy API.
+ */
+
+static void
+test_datum_write(unsigned long num_tests)
+{
+	avro_reader_t  reader = avro_reader_memory(bench_buf, bench_size);
+	avro_writer_t  writer;
+	avro_datum_t  datum = NULL;
+	unsigned long  i;
+
+	avro_read_data(reader, bench_schema, NULL, &datum);
+	avro_reader_free(reader);
+
+	writer = avro_writer_memory(bench_buf, bench_size + 1);
+	for (i = 0; i < num_tests; i++) {
+		avro_writer_reset(writer);
+		avro_write_data(writer, bench_schema, datum);
+		bytes_processed += bench_size;
+	}
+	avro_writer_free(writer);
+	avro_datum_decref(datum);
+}
+
+
+/**
+ * Reads the encoded sample value into a new datum each time, which is
+ * the only way the legacy API reads.
+ */
+
+static void
+test_datum_read(unsigned long num_tests)
+{
+	avro_reader_t  reader = avro_reader_memory(bench_buf, bench_size);
+	unsigned long  i;
+
+	for (i = 0; i < num_tests; i++) {
+		avro_datum_t  datum = NULL;
+		avro_reader_reset(reader);
+		avro_read_data(reader, bench_schema, NULL, &datum);
+		avro_datum_decref(datum);
+		bytes_processed += bench_size;
+	}
+	avro_reader_free(reader);
+}
+
+
+/**
+ * Writes a data file of num_tests copies of the sample value with
+ * bench_codec.
+ */
+
+static int
+write_datafile(unsigned long num_tests)
+{
+	avro_file_writer_t  writer;
+	unsigned long  i;
+	int  rval;
+
+	remove(DATAFILE_PATH);
+	rval = avro_file_writer_create_with_codec
+	    (DATAFILE_PATH, bench_schema, &writer, bench_codec, DATAFILE_BLOCK_SIZE);
+	if (rval) {
+		return rval;
+	}
+	for (i = 0; i < num_tests; i++) {
+		avro_file_writer_append_value(writer, &bench_sample);
+	}
+	avro_file_writer_close(writer);
+	bytes_processed += (uint64_t) num_tests * bench_size;
+	return 0;
+}
+
+static void
+test_datafile_write(unsigned long num_tests)
+{
+	write_datafile(num_tests);
+}
+
+static void
+setup_datafile_read(unsigned long num_tests)
+{
+	write_datafile(num_tests);
+}
+
+static void
+test_datafile_read(unsigned long num_tests)
+{
+	avro_file_reader_t  reader;
+	avro_value_t  value;
+
+	if (avro_file_reader(DATAFILE_PATH, &reader)) {
+		return;
+	}
+	avro_generic_value_new(bench_iface, &value);
+	while (avro_file_reader_read_value(reader, &value) == 0) {
+		bytes_processed += bench_size;
+		avro_value_reset(&value);
+	}
+	avro_value_decref(&value);
+	avro_file_reader_close(reader);
+	AVRO_UNUSED(num_tests);
+}
+
+static void
+remove_datafile(void)
+{
+	remove(DATAFILE_PATH);
+}
+
+/*
+ * Data file tests are skipped for codecs this build doesn't have.
+ */
+
+static int
+codec_available(const char *codec)
+{
+	avro_file_writer_t  writer;
+	if (avro_file_writer_create_with_codec
+	    (DATAFILE_PATH, bench_schema, &writer, codec, 0)) {
+		return 0;
+	}
+	avro_file_writer_close(writer);
+	remove(DATAFILE_PATH);
+	return 1;
+}
+
+
 /**
  * Test harness
  */
 
 #define NUM_RUNS  3
+#define NUM_WARMUP_RUNS  1
+
+static double
+bench_now(void)
+{
+#if defined(CLOCK_MONOTONIC)
+	struct timespec  ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+	return ((double) clock()) / CLOCKS_PER_SEC;
+#endif
+}
+
+static void
+print_json_string(const char *str)
+{
+	putchar('"');
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\') {
+			putchar('\\');
+		}
+		putchar(*str);
+	}
+	putchar('"');
+}
+
+static void
+usage(const char *program)
+{
+	fprintf(stderr,
+		"Usage: %s [-j] [-f filter] [-n iterations] [-w runs] [-r runs]\n"
+		"          [-s schema.json]\n"
+		"  -j  also print the results to stdout as JSON\n"
+		"  -f  only run the tests whose names contain filter\n"
+		"  -n  iterations per run, instead of each test's default\n"
+		"  -w  untimed warmup runs (default %d)\n"
+		"  -r  timed runs (default %d)\n"
+		"  -s  schema for the value, datum and data file tests\n",
+		program, NUM_WARMUP_RUNS, NUM_RUNS);
+}
+
+static char *
+read_schema_file(const char *path, size_t *len)
+{
+	FILE  *fp = fopen(path, "rb");
+	char  *json;
+	long  size;
+
+	if (fp == NULL) {
+		return NULL;
+	}
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	json = (char *) malloc(size + 1);
+	*len = fread(json, 1, size, fp);
+	json[*len] = '\0';
+	fclose(fp);
+	return json;
+}
 
 int
 main(int argc, char **argv)
 {
-	AVRO_UNUSED(argc);
-	AVRO_UNUSED(argv);
+	int  json = 0;
+	const char  *filter = NULL;
+	unsigned long  iterations = 0;
+	unsigned int  warmup_runs = NUM_WARMUP_RUNS;
+	unsigned int  num_runs = NUM_RUNS;
+	const char  *schema_path = NULL;
+	int  first_result = 1;
+	int  arg;
+
+	for (arg = 1; arg < argc; arg++) {
+		const char  *opt = argv[arg];
+		if (strcmp(opt, "-j") == 0) {
+			json = 1;
+		} else if (arg + 1 < argc && strcmp(opt, "-f") == 0) {
+			filter = argv[++arg];
+		} else if (arg + 1 < argc && strcmp(opt, "-n") == 0) {
+			iterations = strtoul(argv[++arg], NULL, 10);
+		} else if (arg + 1 < argc && strcmp(opt, "-w") == 0) {
+			warmup_runs = strtoul(argv[++arg], NULL, 10);
+		} else if (arg + 1 < argc && strcmp(opt, "-r") == 0) {
+			num_runs = strtoul(argv[++arg], NULL, 10);
+		} else if (arg + 1 < argc && strcmp(opt, "-s") == 0) {
+			schema_path = argv[++arg];
+		} else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (num_runs == 0) {
+		num_runs = 1;
+	}
 
 	init_rand();
 
+	if (schema_path != NULL) {
+		size_t  len;
+		char  *schema_json = read_schema_file(schema_path, &len);
+		if (schema_json == NULL) {
+			fprintf(stderr, "Cannot read %s\n", schema_path);
+			return EXIT_FAILURE;
+		}
+		if (bench_init(schema_json, len)) {
+			free(schema_json);
+			return EXIT_FAILURE;
+		}
+		free(schema_json);
+	} else if (bench_init(complex_record_schema_json,
+			      strlen(complex_record_schema_json))) {
+		return EXIT_FAILURE;
+	}
+
 	unsigned int  i;
 	struct avro_tests {
 		const char  *name;
 		unsigned long  num_tests;
 		test_func_t  func;
+		/* for the data file tests */
+		const char  *codec;
+		test_func_t  setup;
+		void  (*teardown)(void);
 	} tests[] = {
 		{ "refcount", 100000000,
-		  test_refcount },
+		  test_refcount, NULL, NULL, NULL },
+		{ "refcount (local)", 100000000,
+		  test_refcount_local, NULL, NULL, NULL },
 		{ "nested record (legacy)", 100000,
-		  test_nested_record_datum },
+		  test_nested_record_datum, NULL, NULL, NULL },
 		{ "nested record (value by index)", 1000000,
-		  test_nested_record_value_by_index },
+		  test_nested_record_value_by_index, NULL, NULL, NULL },
 		{ "nested record (value by name)", 1000000,
-		  test_nested_record_value_by_name },
+		  test_nested_record_value_by_name, NULL, NULL, NULL },
 		{ "nested record (value by index) matched schemas", 1000000,
-		  test_nested_record_value_by_index_matched_schemas },
+		  test_nested_record_value_by_index_matched_schemas, NULL, NULL, NULL },
 		{ "nested record (value by index) resolved writer", 1000000,
-		  test_nested_record_value_by_index_resolved_writer },
+		  test_nested_record_value_by_index_resolved_writer, NULL, NULL, NULL },
 		{ "nested record (value by index) resolved reader", 1000000,
-		  test_nested_record_value_by_index_resolved_reader },
+		  test_nested_record_value_by_index_resolved_reader, NULL, NULL, NULL },
 		{ "simple array matched schemas", 250000,
-		  test_simple_array },
+		  test_simple_array, NULL, NULL, NULL },
 		{ "simple array resolved writer", 250000,
-		  test_simple_array_resolved_writer },
+		  test_simple_array_resolved_writer, NULL, NULL, NULL },
 		{ "simple array resolved reader", 250000,
-		  test_simple_array_resolved_reader },
+		  test_simple_array_resolved_reader, NULL, NULL, NULL },
 		{ "nested array matched schemas", 250000,
-		  test_nested_array },
+		  test_nested_array, NULL, NULL, NULL },
 		{ "nested array resolved writer", 250000,
-		  test_nested_array_resolved_writer },
+		  test_nested_array_resolved_writer, NULL, NULL, NULL },
 		{ "nested array resolved reader", 250000,
-		  test_nested_array_resolved_reader },
+		  test_nested_array_resolved_reader, NULL, NULL, NULL },
+		{ "value write", 1000000,
+		  test_value_write, NULL, NULL, NULL },
+		{ "value read", 1000000,
+		  test_value_read, NULL, NULL, NULL },
+		{ "value write resolved reader", 1000000,
+		  test_value_write_resolved_reader, NULL, NULL, NULL },
+		{ "value read resolved writer", 1000000,
+		  test_value_read_resolved_writer, NULL, NULL, NULL },
+		{ "datum write (legacy)", 1000000,
+		  test_datum_write, NULL, NULL, NULL },
+		{ "datum read (legacy)", 250000,
+		  test_datum_read, NULL, NULL, NULL },
+		{ "datafile write null", 250000,
+		  test_datafile_write, "null", NULL, remove_datafile },
+		{ "datafile read null", 250000,
+		  test_datafile_read, "null", setup_datafile_read, remove_datafile },
+		{ "datafile write deflate", 250000,
+		  test_datafile_write, "deflate", NULL, remove_datafile },
+		{ "datafile read deflate", 250000,
+		  test_datafile_read, "deflate", setup_datafile_read, remove_datafile },
+		{ "datafile write snappy", 250000,
+		  test_datafile_write, "snappy", NULL, remove_datafile },
+		{ "datafile read snappy", 250000,
+		  test_datafile_read, "snappy", setup_datafile_read, remove_datafile },
+		{ "datafile write lzma", 250000,
+		  test_datafile_write, "lzma", NULL, remove_datafile },
+		{ "datafile read lzma", 250000,
+		  test_datafile_read, "lzma", setup_datafile_read, remove_datafile },
+		{ "datafile write zstd", 250000,
+		  test_datafile_write, "zstd", NULL, remove_datafile },
+		{ "datafile read zstd", 250000,
+		  test_datafile_read, "zstd", setup_datafile_read, remove_datafile },
 	};
 
+	if (json) {
+		printf("{\"schema_size\": %lu, \"results\": [",
+		       (unsigned long) bench_size);
+	}
+
 	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
-		fprintf(stderr, "**** Running %s ****\n  %lu tests per run\n",
-			tests[i].name, tests[i].num_tests);
+		unsigned long  num_tests =
+		    iterations? iterations: tests[i].num_tests;
 		unsigned int  run;
 
+		if (filter != NULL && strstr(tests[i].name, filter) == NULL) {
+			continue;
+		}
+		bench_codec = tests[i].codec;
+		if (bench_codec != NULL && !codec_available(bench_codec)) {
+			fprintf(stderr, "**** Skipping %s ****\n  codec not available\n",
+				tests[i].name);
+			continue;
+		}
+
+		fprintf(stderr, "**** Running %s ****\n  %lu tests per run\n",
+			tests[i].name, num_tests);
+
+		if (tests[i].setup != NULL) {
+			tests[i].setup(num_tests);
+		}
+
+		for (run = 1; run <= warmup_runs; run++) {
+			fprintf(stderr, "  Warmup %u\n", run);
+			tests[i].func(num_tests);
+		}
+
 		double  sum = 0.0;
+		double  best = 0.0;
+		uint64_t  bytes = 0;
 
-		for (run = 1; run <= NUM_RUNS; run++) {
+		for (run = 1; run <= num_runs; run++) {
 			fprintf(stderr, "  Run %u\n", run);
 
-			clock_t  before = clock();
-			tests[i].func(tests[i].num_tests);
-			clock_t  after = clock();
-			double  secs = ((double) after-before) / CLOCKS_PER_SEC;
+			bytes_processed = 0;
+			double  before = bench_now();
+			tests[i].func(num_tests);
+			double  after = bench_now();
+			double  secs = after - before;
 			sum += secs;
+			if (run == 1 || secs < best) {
+				best = secs;
+			}
+			bytes = bytes_processed;
+		}
+
+		if (tests[i].teardown != NULL) {
+			tests[i].teardown();
+		}
+
+		double  avg = sum / num_runs;
+		double  ns_per_op = avg * 1e9 / num_tests;
+		double  bytes_per_sec = avg > 0? bytes / avg: 0;
+
+		fprintf(stderr, "  Average time: %.03lfs\n", avg);
+		fprintf(stderr, "  Tests/sec:    %.0lf\n", num_tests / avg);
+		fprintf(stderr, "  ns/op:        %.1lf\n", ns_per_op);
+		if (bytes > 0) {
+			fprintf(stderr, "  MB/sec:       %.1lf\n", bytes_per_sec / 1e6);
 		}
 
-		fprintf(stderr, "  Average time: %.03lfs\n", sum / NUM_RUNS);
-		fprintf(stderr, "  Tests/sec:    %.0lf\n",
-			tests[i].num_tests / (sum / NUM_RUNS));
+		if (json) {
+			printf("%s\n  {\"name\": ", first_result? "": ",");
+			print_json_string(tests[i].name);
+			printf(", \"iterations\": %lu, \"runs\": %u, "
+			       "\"average_seconds\": %.6f, \"best_seconds\": %.6f, "
+			       "\"ns_per_op\": %.3f, \"bytes_per_run\": %.0f, "
+			       "\"bytes_per_sec\": %.0f}",
+			       num_tests, num_runs, avg, best, ns_per_op,
+			       (double) bytes, bytes_per_sec);
+			first_result = 0;
+		}
+	}
+
+	if (json) {
+		printf("\n]}\n");
 	}
 
+	bench_done();
 	return EXIT_SUCCESS;
 }
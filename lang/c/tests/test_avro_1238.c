@@ -62,27 +62,22 @@
 		} \
 	} while (0)
 
-int main(void)
+static void
+check_files(int (*open)(const char *, avro_file_reader_t *),
+	    avro_value_iface_t *iface)
 {
-	avro_schema_t  schema;
 	avro_file_reader_t  reader;
-	avro_value_iface_t  *iface;
 	avro_value_t  actual;
 	avro_value_t  expected;
 	avro_value_t  branch;
 
-	schema = avro_schema_union();
-	avro_schema_union_append(schema, avro_schema_null());
-	avro_schema_union_append(schema, avro_schema_int());
-
-	iface = avro_generic_class_from_schema(schema);
 	avro_generic_value_new(iface, &actual);
 	avro_generic_value_new(iface, &expected);
 
 
 	/* First read the contents of the good file. */
 
-	check_exit(avro_file_reader("avro-1238-good.avro", &reader));
+	check_exit(open("avro-1238-good.avro", &reader));
 
 	check_exit(avro_file_reader_read_value(reader, &actual));
 	check_exit(avro_value_set_branch(&expected, 0, &branch));
@@ -100,7 +95,7 @@ int main(void)
 
 	/* Then read from the truncated file. */
 
-	check_exit(avro_file_reader("avro-1238-truncated.avro", &reader));
+	check_exit(open("avro-1238-truncated.avro", &reader));
 
 	check_exit(avro_file_reader_read_value(reader, &actual));
 	check_exit(avro_value_set_branch(&expected, 0, &branch));
@@ -115,10 +110,28 @@ int main(void)
 	expect_error(avro_file_reader_read_value(reader, &actual));
 	check_exit(avro_file_reader_close(reader));
 
-
-	/* Clean up and exit */
 	avro_value_decref(&actual);
 	avro_value_decref(&expected);
+}
+
+int main(void)
+{
+	avro_schema_t  schema;
+	avro_value_iface_t  *iface;
+
+	schema = avro_schema_union();
+	avro_schema_union_append(schema, avro_schema_null());
+	avro_schema_union_append(schema, avro_schema_int());
+
+	iface = avro_generic_class_from_schema(schema);
+
+	check_files(avro_file_reader, iface);
+#ifndef _WIN32
+	/* The same again, with the files mapped into memory. */
+	check_files(avro_file_reader_mmap, iface);
+#endif
+
+	/* Clean up and exit */
 	avro_value_iface_decref(iface);
 	avro_schema_decref(schema);
 	exit(EXIT_SUCCESS);
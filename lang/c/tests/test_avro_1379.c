@@ -119,6 +119,47 @@ int main(void)
 	check(rval, avro_file_reader_close(file_reader));
 	remove(outpath);
 
+	/* A batch of values, with blocks too small to hold all of them. */
+	const int  batch_count = 20;
+	int  i, validate;
+	avro_writer_reset(writer);
+	for (i = 0; i < batch_count; i++) {
+		check(rval, avro_value_write(writer, &val));
+	}
+	len = avro_writer_tell(writer);
+
+	for (validate = 0; validate <= 1; validate++) {
+		fprintf(stderr, "Writing a batch of %d values to %s "
+			"using avro_file_writer_append_encoded_batch(), "
+			"validate=%d\n", batch_count, outpath, validate);
+		check(rval, avro_file_writer_create_with_codec
+		      (outpath, schema, &file_writer, "null", 4 * len / batch_count + 1));
+		if (validate &&
+		    avro_file_writer_append_encoded_batch(file_writer, buf, len,
+							  batch_count + 1, 1) == 0) {
+			fprintf(stderr, "Batch with a wrong count was appended\n");
+			exit(EXIT_FAILURE);
+		}
+		check(rval, avro_file_writer_append_encoded_batch
+		      (file_writer, buf, len, batch_count, validate));
+		check(rval, avro_file_writer_close(file_writer));
+
+		check(rval, avro_file_reader(outpath, &file_reader));
+		for (i = 0; i < batch_count; i++) {
+			check(rval, avro_file_reader_read_value(file_reader, &out));
+			if (!avro_value_equal(&val, &out)) {
+				fprintf(stderr, "Value %d of the batch differs\n", i);
+				exit(EXIT_FAILURE);
+			}
+		}
+		if (avro_file_reader_read_value(file_reader, &out) != EOF) {
+			fprintf(stderr, "Batch has too many values\n");
+			exit(EXIT_FAILURE);
+		}
+		check(rval, avro_file_reader_close(file_reader));
+		remove(outpath);
+	}
+
 	avro_writer_free(writer);
 	avro_value_decref(&out);
 	avro_value_decref(&val);
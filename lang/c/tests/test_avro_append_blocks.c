@@ -0,0 +1,179 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to you under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ * https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#include <avro.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCHEMA \
+"{\"type\": \"record\", \"name\": \"Person\", \"fields\": [" \
+"  {\"name\": \"ID\", \"type\": \"long\"}," \
+"  {\"name\": \"Name\", \"type\": \"string\"}]}"
+
+#define SOURCE  "avro_append_blocks.dat"
+#define COPY  "avro_append_blocks_copy.dat"
+#define NUM_RECORDS  100
+
+#define check_exit(cond, msg) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s\n  %s\n", msg, avro_strerror()); \
+			exit(EXIT_FAILURE); \
+		} \
+	} while (0)
+
+static void
+append_record(avro_file_writer_t writer, avro_value_t *value, int64_t id)
+{
+	avro_value_t  field;
+
+	check_exit(avro_value_get_by_name(value, "ID", &field, NULL) == 0 &&
+		   avro_value_set_long(&field, id) == 0, "Cannot set ID");
+	check_exit(avro_value_get_by_name(value, "Name", &field, NULL) == 0 &&
+		   avro_value_set_string(&field, "Firstname Lastname") == 0,
+		   "Cannot set Name");
+	check_exit(avro_file_writer_append_value(writer, value) == 0,
+		   "Cannot append value");
+}
+
+/*
+ * Writes the first NUM_RECORDS / 2 records with the deflate codec, in
+ * blocks of a few each.
+ */
+static void
+write_source(avro_schema_t schema)
+{
+	avro_file_writer_t  writer;
+	avro_value_iface_t  *iface;
+	avro_value_t  value;
+	int  i;
+
+	remove(SOURCE);
+	check_exit(avro_file_writer_create_with_codec(SOURCE, schema, &writer, "deflate", 128) == 0,
+		   "Cannot create file");
+	iface = avro_generic_class_from_schema(schema);
+	check_exit(avro_generic_value_new(iface, &value) == 0, "Cannot create value");
+	for (i = 0; i < NUM_RECORDS / 2; i++) {
+		append_record(writer, &value, i);
+	}
+	check_exit(avro_file_writer_close(writer) == 0, "Cannot close file");
+	avro_value_decref(&value);
+	avro_value_iface_decref(iface);
+}
+
+/*
+ * Copies the source after a record appended by value, then appends the
+ * rest by value, and reads the copy back.  Returns nonzero if the codec
+ * is not built in.
+ */
+static int
+copy_blocks(avro_schema_t schema, const char *codec, int nthreads)
+{
+	avro_file_reader_t  reader;
+	avro_file_writer_t  writer;
+	avro_value_iface_t  *iface;
+	avro_value_t  value;
+	avro_value_t  field;
+	int64_t  id;
+	int64_t  expected;
+	int  records_read = 0;
+	int  rval;
+	int  i;
+
+	remove(COPY);
+	if (avro_file_writer_create_with_codec(COPY, schema, &writer, codec, 0)) {
+		return 1;
+	}
+	iface = avro_generic_class_from_schema(schema);
+	check_exit(avro_generic_value_new(iface, &value) == 0, "Cannot create value");
+
+	/* Values appended one at a time go before the blocks. */
+	append_record(writer, &value, NUM_RECORDS);
+	check_exit(avro_file_reader(SOURCE, &reader) == 0, "Cannot open file");
+	check_exit(avro_file_writer_append_blocks(writer, reader, nthreads) == 0,
+		   "Cannot append blocks");
+	avro_file_reader_close(reader);
+	for (i = NUM_RECORDS / 2; i < NUM_RECORDS; i++) {
+		append_record(writer, &value, i);
+	}
+	check_exit(avro_file_writer_close(writer) == 0, "Cannot close file");
+
+	check_exit(avro_file_reader(COPY, &reader) == 0, "Cannot open copy");
+	while ((rval = avro_file_reader_read_value(reader, &value)) == 0) {
+		check_exit(avro_value_get_by_name(&value, "ID", &field, NULL) == 0 &&
+			   avro_value_get_long(&field, &id) == 0, "Cannot get ID");
+		expected = records_read == 0 ? NUM_RECORDS : records_read - 1;
+		if (id != expected) {
+			fprintf(stderr, "Read record %" PRId64 " in place of %" PRId64 "\n",
+				id, expected);
+			exit(EXIT_FAILURE);
+		}
+		records_read++;
+		avro_value_reset(&value);
+	}
+	check_exit(rval == EOF, "Cannot read value");
+	check_exit(records_read == NUM_RECORDS + 1, "Unexpected number of records");
+	avro_file_reader_close(reader);
+
+	avro_value_decref(&value);
+	avro_value_iface_decref(iface);
+	return 0;
+}
+
+static void
+test_different_schema(void)
+{
+	avro_schema_t  other = avro_schema_long();
+	avro_file_reader_t  reader;
+	avro_file_writer_t  writer;
+
+	remove(COPY);
+	check_exit(avro_file_writer_create(COPY, other, &writer) == 0,
+		   "Cannot create file");
+	check_exit(avro_file_reader(SOURCE, &reader) == 0, "Cannot open file");
+	check_exit(avro_file_writer_append_blocks(writer, reader, 0) == EINVAL,
+		   "Blocks of a different schema should not be appended");
+	avro_file_reader_close(reader);
+	check_exit(avro_file_writer_close(writer) == 0, "Cannot close file");
+	avro_schema_decref(other);
+}
+
+int main(void)
+{
+	static const char  *codecs[] = {"null", "deflate", "lzma"};
+	avro_schema_t  schema;
+	size_t  i;
+	int  nthreads;
+
+	check_exit(avro_schema_from_json_literal(SCHEMA, &schema) == 0,
+		   "Cannot parse schema");
+	write_source(schema);
+	for (i = 0; i < sizeof(codecs) / sizeof(codecs[0]); i++) {
+		for (nthreads = 0; nthreads <= 2; nthreads += 2) {
+			if (copy_blocks(schema, codecs[i], nthreads)) {
+				/* The codec is not built in. */
+				break;
+			}
+		}
+	}
+	test_different_schema();
+	remove(SOURCE);
+	remove(COPY);
+	avro_schema_decref(schema);
+	return EXIT_SUCCESS;
+}
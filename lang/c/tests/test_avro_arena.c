@@ -0,0 +1,230 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to you under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ * https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#include <avro.h>
+#include "avro_private.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCHEMA \
+"{\"type\": \"record\", \"name\": \"r\", \"fields\": [" \
+"  {\"name\": \"s\", \"type\": \"string\"}," \
+"  {\"name\": \"a\", \"type\": {\"type\": \"array\", \"items\": \"long\"}}]}"
+
+#define BATCH_SIZE  100
+
+#define check_exit(cond, msg) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s\n  %s\n", msg, avro_strerror()); \
+			exit(EXIT_FAILURE); \
+		} \
+	} while (0)
+
+static size_t  backing_calls = 0;
+
+static void *
+counting_allocator(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+	AVRO_UNUSED(ud);
+	AVRO_UNUSED(osize);
+	backing_calls++;
+	if (nsize == 0) {
+		free(ptr);
+		return NULL;
+	}
+	return realloc(ptr, nsize);
+}
+
+static void
+fill_value(avro_value_iface_t *iface, int n)
+{
+	avro_value_t  value;
+	avro_value_t  field;
+	avro_value_t  element;
+	char  str[64];
+	int  i;
+
+	check_exit(avro_generic_value_new(iface, &value) == 0, "Cannot create value");
+	snprintf(str, sizeof(str), "value number %d", n);
+	check_exit(avro_value_get_by_name(&value, "s", &field, NULL) == 0 &&
+		   avro_value_set_string(&field, str) == 0, "Cannot set string");
+	check_exit(avro_value_get_by_name(&value, "a", &field, NULL) == 0,
+		   "Cannot get array");
+	for (i = 0; i < 50; i++) {
+		check_exit(avro_value_append(&field, &element, NULL) == 0 &&
+			   avro_value_set_long(&element, n * i) == 0,
+			   "Cannot append to array");
+	}
+
+	/* Read back from arena memory. */
+	const char  *got;
+	int64_t  last;
+	check_exit(avro_value_get_by_name(&value, "s", &field, NULL) == 0 &&
+		   avro_value_get_string(&field, &got, NULL) == 0 &&
+		   strcmp(got, str) == 0, "Unexpected string");
+	check_exit(avro_value_get_by_name(&value, "a", &field, NULL) == 0 &&
+		   avro_value_get_by_index(&field, 49, &element, NULL) == 0 &&
+		   avro_value_get_long(&element, &last) == 0 &&
+		   last == n * 49, "Unexpected array element");
+	avro_value_decref(&value);
+}
+
+/*
+ * Resolves the schema through the cache with the arena bound, reuses
+ * the arena, and checks that the cached implementation is intact.
+ */
+static void
+resolve_in_arena(avro_schema_t schema, avro_value_iface_t *iface,
+		 avro_arena_t arena)
+{
+	avro_value_iface_t  *cached;
+	avro_value_iface_t  *again;
+	avro_value_t  value;
+	avro_value_t  resolved;
+	avro_value_t  field;
+	const char  *got;
+	int  i;
+
+	cached = avro_resolved_reader_new_cached(schema, schema);
+	check_exit(cached != NULL, "Cannot resolve schema");
+	avro_value_iface_decref(cached);
+	avro_arena_reset(arena);
+	for (i = 0; i < BATCH_SIZE; i++) {
+		fill_value(iface, i);
+	}
+
+	again = avro_resolved_reader_new_cached(schema, schema);
+	check_exit(again == cached, "The implementation should be cached");
+	check_exit(avro_generic_value_new(iface, &value) == 0, "Cannot create value");
+	check_exit(avro_value_get_by_name(&value, "s", &field, NULL) == 0 &&
+		   avro_value_set_string(&field, "resolved") == 0, "Cannot set string");
+	check_exit(avro_resolved_reader_new_value(again, &resolved) == 0,
+		   "Cannot create resolved value");
+	avro_resolved_reader_set_source(&resolved, &value);
+	check_exit(avro_value_get_by_name(&resolved, "s", &field, NULL) == 0 &&
+		   avro_value_get_string(&field, &got, NULL) == 0 &&
+		   strcmp(got, "resolved") == 0, "Unexpected resolved string");
+	avro_value_decref(&resolved);
+	avro_value_decref(&value);
+	avro_value_iface_decref(again);
+	avro_arena_reset(arena);
+}
+
+/*
+ * Skips a record with the arena bound, which memoizes its plan on the
+ * schema, reuses the arena, and skips it again before freeing the
+ * schema with the plan.
+ */
+static void
+skip_in_arena(avro_value_iface_t *iface, avro_arena_t arena)
+{
+	avro_schema_t  schema;
+	avro_value_iface_t  *record_iface;
+	avro_value_t  value;
+	avro_value_t  field;
+	avro_value_t  element;
+	avro_writer_t  writer;
+	avro_reader_t  reader;
+	char  buf[1024];
+	int64_t  len;
+	int  pass;
+	int  i;
+
+	check_exit(avro_schema_from_json_length(SCHEMA, strlen(SCHEMA), &schema) == 0,
+		   "Cannot parse schema");
+	record_iface = avro_generic_class_from_schema(schema);
+	check_exit(record_iface != NULL, "Cannot create class");
+	check_exit(avro_generic_value_new(record_iface, &value) == 0, "Cannot create value");
+	check_exit(avro_value_get_by_name(&value, "s", &field, NULL) == 0 &&
+		   avro_value_set_string(&field, "skipped") == 0, "Cannot set string");
+	check_exit(avro_value_get_by_name(&value, "a", &field, NULL) == 0 &&
+		   avro_value_append(&field, &element, NULL) == 0 &&
+		   avro_value_set_long(&element, 42) == 0, "Cannot append to array");
+	writer = avro_writer_memory(buf, sizeof(buf));
+	check_exit(avro_value_write(writer, &value) == 0, "Cannot write value");
+	len = avro_writer_tell(writer);
+	avro_writer_free(writer);
+	avro_value_decref(&value);
+	avro_value_iface_decref(record_iface);
+
+	check_exit(avro_arena_bind(arena) == NULL, "No arena should be bound");
+	for (pass = 0; pass < 2; pass++) {
+		size_t  calls;
+		reader = avro_reader_memory(buf, len);
+		calls = backing_calls;
+		check_exit(avro_skip_data(reader, schema) == 0, "Cannot skip record");
+		check_exit(avro_reader_is_eof(reader), "The record should be skipped");
+		/* Compiled from the backing allocator once, then reused. */
+		check_exit(pass == 0? backing_calls > calls: backing_calls == calls,
+			   "The plan should be memoized outside the arena");
+		avro_reader_free(reader);
+		avro_arena_reset(arena);
+		for (i = 0; i < BATCH_SIZE; i++) {
+			fill_value(iface, i);
+		}
+		avro_arena_reset(arena);
+	}
+	check_exit(avro_arena_bind(NULL) == arena, "The arena should be bound");
+	avro_schema_decref(schema);
+}
+
+int main(void)
+{
+	avro_schema_t  schema;
+	avro_value_iface_t  *iface;
+	avro_value_t  before;
+	avro_arena_t  arena;
+	int  batch;
+	int  i;
+
+	avro_set_allocator(counting_allocator, NULL);
+	check_exit(avro_schema_from_json_length(SCHEMA, strlen(SCHEMA), &schema) == 0,
+		   "Cannot parse schema");
+	iface = avro_generic_class_from_schema(schema);
+	check_exit(iface != NULL, "Cannot create class");
+
+	/* Created before the arena is bound, freed while it is. */
+	check_exit(avro_generic_value_new(iface, &before) == 0, "Cannot create value");
+
+	arena = avro_arena_new(1024);
+	check_exit(arena != NULL, "Cannot create arena");
+	check_exit(avro_arena_bind(arena) == NULL, "No arena should be bound yet");
+
+	for (batch = 0; batch < 3; batch++) {
+		size_t  calls = backing_calls;
+		for (i = 0; i < BATCH_SIZE; i++) {
+			fill_value(iface, i);
+		}
+		/* Once the first batch has grown the arena, later ones reuse it. */
+		check_exit(batch == 0 || backing_calls == calls,
+			   "A reset arena should not allocate again");
+		avro_arena_reset(arena);
+	}
+
+	resolve_in_arena(schema, iface, arena);
+	avro_value_decref(&before);
+
+	check_exit(avro_arena_bind(NULL) == arena, "The arena should be bound");
+	skip_in_arena(iface, arena);
+	avro_arena_free(arena);
+	avro_resolver_cache_clear();
+
+	avro_value_iface_decref(iface);
+	avro_schema_decref(schema);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,187 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to you under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ * https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#include <avro.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCHEMA \
+"{\"type\": \"record\", \"name\": \"Person\", \"fields\": [" \
+"  {\"name\": \"ID\", \"type\": \"long\"}," \
+"  {\"name\": \"Name\", \"type\": \"string\"}]}"
+
+#define FILENAME  "avro_background.dat"
+#define NUM_RECORDS  100
+
+#define check_exit(cond, msg) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s\n  %s\n", msg, avro_strerror()); \
+			exit(EXIT_FAILURE); \
+		} \
+	} while (0)
+
+static void
+set_record(avro_value_t *value, int64_t id)
+{
+	avro_value_t  field;
+
+	check_exit(avro_value_get_by_name(value, "ID", &field, NULL) == 0 &&
+		   avro_value_set_long(&field, id) == 0, "Cannot set ID");
+	check_exit(avro_value_get_by_name(value, "Name", &field, NULL) == 0 &&
+		   avro_value_set_string(&field, "Firstname Lastname") == 0,
+		   "Cannot set Name");
+}
+
+/*
+ * Writes the records in blocks of a few each, with the blocks written
+ * by the background thread.  Returns nonzero if the codec is not built
+ * in or the library is not thread-safe.
+ */
+static int
+write_records(avro_schema_t schema, const char *codec)
+{
+	avro_file_writer_t  writer;
+	avro_value_iface_t  *iface;
+	avro_value_t  value;
+	int  rval;
+	int  i;
+
+	remove(FILENAME);
+	if (avro_file_writer_create_with_codec(FILENAME, schema, &writer, codec, 128)) {
+		return 1;
+	}
+	rval = avro_file_writer_set_background(writer, 1);
+	if (rval == ENOSYS) {
+		avro_file_writer_close(writer);
+		return 1;
+	}
+	check_exit(rval == 0, "Cannot start the background writer");
+
+	iface = avro_generic_class_from_schema(schema);
+	check_exit(avro_generic_value_new(iface, &value) == 0, "Cannot create value");
+	for (i = 0; i < NUM_RECORDS; i++) {
+		set_record(&value, i);
+		check_exit(avro_file_writer_append_value(writer, &value) == 0,
+			   "Cannot append value");
+		if (i == NUM_RECORDS / 2) {
+			check_exit(avro_file_writer_sync(writer) == 0, "Cannot sync");
+		}
+	}
+	check_exit(avro_file_writer_close(writer) == 0, "Cannot close file");
+	avro_value_decref(&value);
+	avro_value_iface_decref(iface);
+	return 0;
+}
+
+static void
+read_records(avro_schema_t schema)
+{
+	avro_file_reader_t  reader;
+	avro_value_iface_t  *iface;
+	avro_value_t  value;
+	avro_value_t  field;
+	int64_t  id;
+	int  records_read = 0;
+	int  rval;
+
+	check_exit(avro_file_reader(FILENAME, &reader) == 0, "Cannot open file");
+	iface = avro_generic_class_from_schema(schema);
+	check_exit(avro_generic_value_new(iface, &value) == 0, "Cannot create value");
+	while ((rval = avro_file_reader_read_value(reader, &value)) == 0) {
+		check_exit(avro_value_get_by_name(&value, "ID", &field, NULL) == 0 &&
+			   avro_value_get_long(&field, &id) == 0, "Cannot get ID");
+		if (id != records_read) {
+			fprintf(stderr, "Read record %" PRId64 " in place of %d\n",
+				id, records_read);
+			exit(EXIT_FAILURE);
+		}
+		records_read++;
+		avro_value_reset(&value);
+	}
+	check_exit(rval == EOF, "Cannot read value");
+	check_exit(records_read == NUM_RECORDS, "Unexpected number of records");
+
+	avro_value_decref(&value);
+	avro_value_iface_decref(iface);
+	avro_file_reader_close(reader);
+}
+
+/*
+ * Writes to /dev/full, where a write fails once the stdio buffer fills,
+ * checking that the failure is returned by every call after it.
+ */
+static void
+write_failing(avro_schema_t schema)
+{
+	avro_file_writer_t  writer;
+	avro_value_iface_t  *iface;
+	avro_value_t  value;
+	int  failed = 0;
+	int  i;
+
+	if (avro_file_writer_create_with_codec("/dev/full", schema, &writer, "null", 128)) {
+		return;
+	}
+	if (avro_file_writer_set_background(writer, 1)) {
+		avro_file_writer_close(writer);
+		return;
+	}
+
+	iface = avro_generic_class_from_schema(schema);
+	check_exit(avro_generic_value_new(iface, &value) == 0, "Cannot create value");
+	for (i = 0; i < 100000 && !failed; i++) {
+		set_record(&value, i);
+		failed = avro_file_writer_append_value(writer, &value) != 0;
+	}
+	check_exit(failed, "Writing to /dev/full should fail");
+	for (i = 0; i < 10; i++) {
+		check_exit(avro_file_writer_append_value(writer, &value) != 0,
+			   "An append after a failed block should fail");
+	}
+	check_exit(avro_file_writer_sync(writer) != 0,
+		   "A sync after a failed block should fail");
+	check_exit(avro_file_writer_flush(writer) != 0,
+		   "A flush after a failed block should fail");
+	check_exit(avro_file_writer_set_background(writer, 0) != 0,
+		   "Stopping the background writer after a failed block should fail");
+	check_exit(avro_file_writer_close(writer) != 0,
+		   "Closing after a failed block should fail");
+	avro_value_decref(&value);
+	avro_value_iface_decref(iface);
+}
+
+int main(void)
+{
+	static const char  *codecs[] = {"null", "deflate"};
+	avro_schema_t  schema;
+	size_t  i;
+
+	check_exit(avro_schema_from_json_literal(SCHEMA, &schema) == 0,
+		   "Cannot parse schema");
+	for (i = 0; i < sizeof(codecs) / sizeof(codecs[0]); i++) {
+		if (write_records(schema, codecs[i])) {
+			continue;
+		}
+		read_records(schema);
+	}
+	remove(FILENAME);
+	write_failing(schema);
+	avro_schema_decref(schema);
+	return EXIT_SUCCESS;
+}
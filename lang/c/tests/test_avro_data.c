@@ -131,6 +131,21 @@ write_read_check(avro_schema_t writers_schema, avro_datum_t datum,
 			exit(EXIT_FAILURE);
 		}
 
+		/* Reading again into the same datum gives the same value. */
+		avro_reader_reset(reader);
+		if (avro_read_data_into
+		    (reader, writers_schema, readers_schema, datum_out)) {
+			fprintf(stderr, "Unable to read %s into datum validate=%d\n  %s\n",
+				type, validate, avro_strerror());
+			exit(EXIT_FAILURE);
+		}
+		if (!avro_datum_equal(expected, datum_out)) {
+			fprintf(stderr,
+				"Unable to decode %s into datum validate=%d\n  %s\n",
+				type, validate, avro_strerror());
+			exit(EXIT_FAILURE);
+		}
+
 		avro_reader_dump(reader, stderr);
 		avro_datum_decref(datum_out);
 		avro_reader_free(reader);
@@ -282,6 +297,140 @@ static int test_int64(void)
 	return 0;
 }
 
+/*
+ * Reads a varint from a memory reader over len bytes of buf, and skips
+ * it, returning whether both got through the whole buffer.
+ */
+static int read_varint(avro_schema_t schema, const char *varint, int64_t len,
+		       int64_t expected)
+{
+	avro_datum_t  datum;
+	int64_t  value;
+	int  ok;
+
+	reader = avro_reader_memory(varint, len);
+	ok = avro_read_data(reader, schema, NULL, &datum) == 0;
+	if (ok) {
+		avro_int64_get(datum, &value);
+		avro_datum_decref(datum);
+		ok = value == expected && avro_reader_is_eof(reader);
+	}
+	avro_reader_free(reader);
+
+	reader = avro_reader_memory(varint, len);
+	ok = avro_skip_data(reader, schema) == 0 && avro_reader_is_eof(reader) && ok;
+	avro_reader_free(reader);
+	return ok;
+}
+
+static int test_varint_memory(void)
+{
+	static const int64_t  values[] = {
+		0, -1, 1, 63, -64, 64, -65, 8191, -8192, 8192,
+		INT32_MAX, INT32_MIN, (int64_t) 1 << 62, INT64_MAX, INT64_MIN
+	};
+	avro_schema_t  schema = avro_schema_long();
+	char  varint[16];
+	int64_t  len;
+	size_t  i;
+
+	/* Each value on its own, whole and cut short. */
+	for (i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+		avro_datum_t  datum = avro_int64(values[i]);
+		writer = avro_writer_memory(varint, sizeof(varint));
+		if (avro_write_data(writer, schema, datum)) {
+			fprintf(stderr, "Unable to write varint: %s\n", avro_strerror());
+			exit(EXIT_FAILURE);
+		}
+		len = avro_writer_tell(writer);
+		avro_writer_free(writer);
+		avro_datum_decref(datum);
+
+		if (!read_varint(schema, varint, len, values[i])) {
+			fprintf(stderr, "Unable to read varint %" PRId64 "\n", values[i]);
+			exit(EXIT_FAILURE);
+		}
+		for (; len > 1; len--) {
+			avro_datum_t  truncated = NULL;
+			reader = avro_reader_memory(varint, len - 1);
+			if (avro_read_data(reader, schema, NULL, &truncated) == 0) {
+				fprintf(stderr, "Read truncated varint %" PRId64 "\n", values[i]);
+				exit(EXIT_FAILURE);
+			}
+			avro_reader_reset(reader);
+			if (avro_skip_data(reader, schema) == 0) {
+				fprintf(stderr, "Skipped truncated varint %" PRId64 "\n", values[i]);
+				exit(EXIT_FAILURE);
+			}
+			avro_reader_free(reader);
+		}
+	}
+
+	/* One after another, so that each starts partway into the buffer. */
+	writer = avro_writer_memory(buf, sizeof(buf));
+	for (i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+		avro_datum_t  datum = avro_int64(values[i]);
+		avro_write_data(writer, schema, datum);
+		avro_datum_decref(datum);
+	}
+	len = avro_writer_tell(writer);
+	avro_writer_free(writer);
+	reader = avro_reader_memory(buf, len);
+	for (i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+		avro_datum_t  datum;
+		int64_t  value;
+		if (avro_read_data(reader, schema, NULL, &datum)) {
+			fprintf(stderr, "Unable to read varint %" PRId64 " in sequence\n",
+				values[i]);
+			exit(EXIT_FAILURE);
+		}
+		avro_int64_get(datum, &value);
+		avro_datum_decref(datum);
+		if (value != values[i]) {
+			fprintf(stderr, "Read %" PRId64 " in place of %" PRId64 " in sequence\n",
+				value, values[i]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	avro_reader_reset(reader);
+	for (i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+		if (avro_skip_data(reader, schema)) {
+			fprintf(stderr, "Unable to skip varint in sequence\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (!avro_reader_is_eof(reader)) {
+		fprintf(stderr, "Varints left over in sequence\n");
+		exit(EXIT_FAILURE);
+	}
+	avro_reader_free(reader);
+
+	/* Longer than any 64-bit varint. */
+	memset(varint, 0x80, 11);
+	varint[11] = 0x01;
+	if (read_varint(schema, varint, 12, 0)) {
+		fprintf(stderr, "Read overlong varint\n");
+		exit(EXIT_FAILURE);
+	}
+	reader = avro_reader_memory(varint, 12);
+	{
+		avro_datum_t  datum = NULL;
+		if (avro_read_data(reader, schema, NULL, &datum) != EILSEQ) {
+			fprintf(stderr, "Overlong varint not rejected as such\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	avro_reader_reset(reader);
+	if (avro_skip_data(reader, schema) != EILSEQ) {
+		fprintf(stderr, "Overlong varint not skipped as such\n");
+		exit(EXIT_FAILURE);
+	}
+	avro_reader_free(reader);
+
+	avro_schema_decref(schema);
+	return 0;
+}
+
 static int test_double(void)
 {
 	int i;
@@ -645,6 +794,90 @@ static int test_fixed(void)
 	return 0;
 }
 
+static int test_file_datum_reuse(void)
+{
+	const char  *path = "test_avro_data.avro";
+	avro_schema_t schema = avro_schema_record("person", NULL);
+	avro_schema_record_field_append(schema, "name", avro_schema_string());
+	avro_schema_record_field_append(schema, "age", avro_schema_int());
+
+	avro_file_writer_t  file_writer;
+	avro_file_reader_t  file_reader;
+	avro_datum_t  datum = avro_datum_from_schema(schema);
+	int  rc;
+	int32_t  age;
+
+	remove(path);
+	if (avro_file_writer_create(path, schema, &file_writer)) {
+		fprintf(stderr, "Unable to create file: %s\n", avro_strerror());
+		exit(EXIT_FAILURE);
+	}
+	for (age = 0; age < 10; age++) {
+		avro_record_set_field_value(rc, datum, givestring, "name",
+					    age % 2 ? "odd" : "even", NULL);
+		avro_record_set_field_value(rc, datum, int32, "age", age);
+		if (avro_file_writer_append(file_writer, datum)) {
+			fprintf(stderr, "Unable to append: %s\n", avro_strerror());
+			exit(EXIT_FAILURE);
+		}
+	}
+	avro_file_writer_close(file_writer);
+	avro_datum_decref(datum);
+
+	if (avro_file_reader(path, &file_reader) ||
+	    avro_file_reader_set_datum_reuse(file_reader, 1)) {
+		fprintf(stderr, "Unable to open file: %s\n", avro_strerror());
+		exit(EXIT_FAILURE);
+	}
+
+	/* Released datums are read into again; held ones are not. */
+	avro_datum_t  last = NULL;
+	avro_datum_t  held = NULL;
+	for (age = 0; age < 10; age++) {
+		int32_t  read_age = -1;
+		char  *name = NULL;
+		if (avro_file_reader_read(file_reader, NULL, &datum)) {
+			fprintf(stderr, "Unable to read: %s\n", avro_strerror());
+			exit(EXIT_FAILURE);
+		}
+		avro_record_get_field_value(rc, datum, int32, "age", &read_age);
+		avro_record_get_field_value(rc, datum, string, "name", &name);
+		if (read_age != age || strcmp(name, age % 2 ? "odd" : "even")) {
+			fprintf(stderr, "Read the wrong record %d\n", age);
+			exit(EXIT_FAILURE);
+		}
+		if (age > 0 && age != 5 && datum != last) {
+			fprintf(stderr, "Released datum not reused\n");
+			exit(EXIT_FAILURE);
+		}
+		if (age == 5 && datum == last) {
+			fprintf(stderr, "Held datum reused\n");
+			exit(EXIT_FAILURE);
+		}
+		/* Local counts are tagged, and still count one holder. */
+		if (age >= 6) {
+			avro_datum_make_local(datum);
+		}
+		if (age == 4) {
+			held = datum;
+		} else {
+			avro_datum_decref(datum);
+		}
+		last = datum;
+	}
+
+	avro_record_get_field_value(rc, held, int32, "age", &age);
+	if (age != 4) {
+		fprintf(stderr, "Held datum was overwritten\n");
+		exit(EXIT_FAILURE);
+	}
+	avro_datum_decref(held);
+	avro_file_reader_close(file_reader);
+	avro_schema_decref(schema);
+	remove(path);
+	return 0;
+}
+
 int main(void)
 {
 	avro_set_allocator(test_allocator, NULL);
@@ -659,6 +892,7 @@ int main(void)
 		"bytes", test_bytes}, {
 		"int", test_int32}, {
 		"long", test_int64}, {
+		"memory varint", test_varint_memory}, {
 		"float", test_float}, {
 		"double", test_double}, {
 		"boolean", test_boolean}, {
@@ -669,7 +903,8 @@ int main(void)
 		"array", test_array}, {
 		"map", test_map}, {
 		"fixed", test_fixed}, {
-		"union", test_union}
+		"union", test_union}, {
+		"file datum reuse", test_file_datum_reuse}
 	};
 
 	init_rand();
@@ -0,0 +1,167 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to you under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ * https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#include <avro.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCHEMA \
+"{\"type\": \"record\", \"name\": \"Person\", \"fields\": [" \
+"  {\"name\": \"ID\", \"type\": \"long\"}," \
+"  {\"name\": \"Name\", \"type\": \"string\"}]}"
+
+#define FILENAME  "avro_memory_file.dat"
+#define NUM_RECORDS  10
+#define COPIES  50
+
+#define check_exit(cond, msg) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s\n  %s\n", msg, avro_strerror()); \
+			exit(EXIT_FAILURE); \
+		} \
+	} while (0)
+
+static void
+append_records(avro_file_writer_t writer, avro_value_iface_t *iface)
+{
+	avro_value_t  value;
+	avro_value_t  field;
+	int  i;
+
+	check_exit(avro_generic_value_new(iface, &value) == 0, "Cannot create value");
+	for (i = 0; i < NUM_RECORDS; i++) {
+		check_exit(avro_value_get_by_name(&value, "ID", &field, NULL) == 0 &&
+			   avro_value_set_long(&field, i) == 0, "Cannot set ID");
+		check_exit(avro_value_get_by_name(&value, "Name", &field, NULL) == 0 &&
+			   avro_value_set_string(&field, "Firstname Lastname") == 0,
+			   "Cannot set Name");
+		check_exit(avro_file_writer_append_value(writer, &value) == 0,
+			   "Cannot append value");
+	}
+	avro_value_decref(&value);
+}
+
+/*
+ * Reads the data file in buf, checking that it holds copies of the
+ * records, in order.
+ */
+static void
+read_copies(avro_value_iface_t *iface, const char *buf, int64_t len, int copies)
+{
+	avro_file_reader_t  reader;
+	avro_value_t  value;
+	avro_value_t  field;
+	int64_t  id;
+	int  records_read = 0;
+	int  rval;
+
+	check_exit(avro_file_reader_memory(buf, len, &reader) == 0,
+		   "Cannot open file in memory");
+	check_exit(avro_generic_value_new(iface, &value) == 0, "Cannot create value");
+	while ((rval = avro_file_reader_read_value(reader, &value)) == 0) {
+		check_exit(avro_value_get_by_name(&value, "ID", &field, NULL) == 0 &&
+			   avro_value_get_long(&field, &id) == 0, "Cannot get ID");
+		if (id != records_read % NUM_RECORDS) {
+			fprintf(stderr, "Read record %" PRId64 " in place of %d from memory\n",
+				id, records_read % NUM_RECORDS);
+			exit(EXIT_FAILURE);
+		}
+		records_read++;
+		avro_value_reset(&value);
+	}
+	check_exit(rval == EOF, "Cannot read value");
+	check_exit(records_read == copies * NUM_RECORDS, "Unexpected number of records");
+	avro_value_decref(&value);
+	avro_file_reader_close(reader);
+}
+
+/*
+ * Copies the file into memory as many times as it takes for the buffer
+ * to grow, and reads the copies back from memory.  Returns nonzero if
+ * the codec is not built in.
+ */
+static int
+copy_memory(avro_schema_t schema, avro_value_iface_t *iface, const char *codec)
+{
+	avro_file_reader_t  reader;
+	avro_file_writer_t  writer;
+	const char  *buf;
+	int64_t  len;
+	int  i;
+
+	if (avro_file_writer_create_memory(schema, &writer, codec, 0)) {
+		return 1;
+	}
+	for (i = 0; i < COPIES; i++) {
+		check_exit(avro_file_reader(FILENAME, &reader) == 0, "Cannot open file");
+		check_exit(avro_file_writer_append_blocks(writer, reader, 0) == 0,
+			   "Cannot append blocks");
+		avro_file_reader_close(reader);
+		if (i == 0) {
+			/* The buffer may move as it grows. */
+			check_exit(avro_file_writer_get_buffer(writer, &buf, &len) == 0,
+				   "Cannot get buffer");
+			read_copies(iface, buf, len, 1);
+		}
+	}
+	/* Values appended one at a time end up in memory all the same. */
+	append_records(writer, iface);
+	check_exit(avro_file_writer_get_buffer(writer, &buf, &len) == 0,
+		   "Cannot get buffer");
+	read_copies(iface, buf, len, COPIES + 1);
+	check_exit(avro_file_writer_close(writer) == 0, "Cannot close writer");
+	return 0;
+}
+
+int main(void)
+{
+	static const char  *codecs[] = {"null", "deflate"};
+	avro_schema_t  schema;
+	avro_value_iface_t  *iface;
+	avro_file_writer_t  writer;
+	size_t  i;
+
+	check_exit(avro_schema_from_json_literal(SCHEMA, &schema) == 0,
+		   "Cannot parse schema");
+	iface = avro_generic_class_from_schema(schema);
+
+	remove(FILENAME);
+	check_exit(avro_file_writer_create(FILENAME, schema, &writer) == 0,
+		   "Cannot create file");
+	append_records(writer, iface);
+	check_exit(avro_file_writer_close(writer) == 0, "Cannot close file");
+
+	for (i = 0; i < sizeof(codecs) / sizeof(codecs[0]); i++) {
+		copy_memory(schema, iface, codecs[i]);
+	}
+
+	/* A file writer has no buffer to return. */
+	check_exit(avro_file_writer_open(FILENAME, &writer) == 0, "Cannot open file");
+	{
+		const char  *buf;
+		int64_t  len;
+		check_exit(avro_file_writer_get_buffer(writer, &buf, &len) != 0,
+			   "A file writer should have no buffer");
+	}
+	check_exit(avro_file_writer_close(writer) == 0, "Cannot close file");
+
+	remove(FILENAME);
+	avro_value_iface_decref(iface);
+	avro_schema_decref(schema);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,211 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to you under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ * https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#include <avro.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCHEMA \
+"{\"type\": \"record\", \"name\": \"Person\", \"fields\": [" \
+"  {\"name\": \"ID\", \"type\": \"long\"}," \
+"  {\"name\": \"Name\", \"type\": \"string\"}]}"
+
+#define FILENAME  "avro_prefetch.dat"
+#define NUM_RECORDS  100
+
+#define check_exit(cond, msg) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s\n  %s\n", msg, avro_strerror()); \
+			exit(EXIT_FAILURE); \
+		} \
+	} while (0)
+
+/*
+ * Writes the records in blocks of a few each, so that there are many
+ * blocks to read ahead.  Returns nonzero if the codec is not built in.
+ */
+static int
+write_records(avro_schema_t schema, const char *codec)
+{
+	avro_file_writer_t  writer;
+	avro_value_iface_t  *iface;
+	avro_value_t  value;
+	avro_value_t  field;
+	int  i;
+
+	remove(FILENAME);
+	if (avro_file_writer_create_with_codec(FILENAME, schema, &writer, codec, 128)) {
+		return 1;
+	}
+	iface = avro_generic_class_from_schema(schema);
+	check_exit(avro_generic_value_new(iface, &value) == 0, "Cannot create value");
+	for (i = 0; i < NUM_RECORDS; i++) {
+		check_exit(avro_value_get_by_name(&value, "ID", &field, NULL) == 0 &&
+			   avro_value_set_long(&field, i) == 0, "Cannot set ID");
+		check_exit(avro_value_get_by_name(&value, "Name", &field, NULL) == 0 &&
+			   avro_value_set_string(&field, "Firstname Lastname") == 0,
+			   "Cannot set Name");
+		check_exit(avro_file_writer_append_value(writer, &value) == 0,
+			   "Cannot append value");
+	}
+	check_exit(avro_file_writer_close(writer) == 0, "Cannot close file");
+	avro_value_decref(&value);
+	avro_value_iface_decref(iface);
+	return 0;
+}
+
+/*
+ * Reads the file with blocks decoded ahead of the reader, checking
+ * that every record comes once and in order.  With drop_behind, pages
+ * already read are dropped from the page cache, as a scan would.
+ */
+static void
+read_prefetched(avro_schema_t schema, int drop_behind)
+{
+	avro_file_reader_t  reader;
+	avro_value_iface_t  *iface;
+	avro_value_t  value;
+	avro_value_t  field;
+	int64_t  id;
+	int  records_read = 0;
+	int  rval;
+
+	check_exit(avro_file_reader(FILENAME, &reader) == 0, "Cannot open file");
+	if (drop_behind) {
+		check_exit(avro_file_reader_drop_behind(reader) == 0,
+			   "Cannot drop pages behind the reader");
+	}
+	/* Not available unless the library is thread-safe. */
+	rval = avro_file_reader_prefetch(reader, 2, 3);
+	check_exit(rval == 0 || rval == ENOSYS, "Cannot start prefetching");
+
+	iface = avro_generic_class_from_schema(schema);
+	check_exit(avro_generic_value_new(iface, &value) == 0, "Cannot create value");
+	while ((rval = avro_file_reader_read_value(reader, &value)) == 0) {
+		check_exit(avro_value_get_by_name(&value, "ID", &field, NULL) == 0 &&
+			   avro_value_get_long(&field, &id) == 0, "Cannot get ID");
+		if (id != records_read) {
+			fprintf(stderr, "Read record %" PRId64 " in place of %d\n",
+				id, records_read);
+			exit(EXIT_FAILURE);
+		}
+		records_read++;
+		avro_value_reset(&value);
+	}
+	check_exit(rval == EOF, "Cannot read value");
+	check_exit(records_read == NUM_RECORDS, "Unexpected number of records");
+
+	avro_value_decref(&value);
+	avro_value_iface_decref(iface);
+	avro_file_reader_close(reader);
+}
+
+static int
+format_block(void *user_data, avro_reader_t block_reader,
+	     avro_schema_t wschema, int64_t first, int64_t count,
+	     char **buf, size_t *size, size_t *len)
+{
+	int64_t  i;
+	(void) user_data;
+	(void) first;
+
+	for (i = 0; i < count; i++) {
+		int  rval = avro_binary_to_json(block_reader, wschema,
+						buf, size, len);
+		if (rval) {
+			return rval;
+		}
+		(*buf)[(*len)++] = '\n';
+	}
+	return 0;
+}
+
+/*
+ * Reads the file with blocks formatted as JSON lines ahead of the
+ * reader, checking that every record comes once and in order.
+ */
+static void
+read_formatted(void)
+{
+	avro_file_reader_t  reader;
+	const char  *text;
+	size_t  text_len;
+	int  records_read = 0;
+	int  rval;
+
+	check_exit(avro_file_reader(FILENAME, &reader) == 0, "Cannot open file");
+	/* Not available unless the library is thread-safe. */
+	rval = avro_file_reader_prefetch_formatted(reader, 2, 3,
+						   format_block, NULL);
+	if (rval == ENOSYS) {
+		avro_file_reader_close(reader);
+		return;
+	}
+	check_exit(rval == 0, "Cannot start prefetching");
+
+	while ((rval = avro_file_reader_read_formatted(reader, &text, &text_len)) == 0) {
+		const char  *end = text + text_len;
+		while (text < end) {
+			char  expected[32];
+			const char  *eol = (const char *) memchr(text, '\n', end - text);
+			check_exit(eol != NULL, "Unterminated value");
+			snprintf(expected, sizeof(expected), "{\"ID\": %d,", records_read);
+			if (strncmp(text, expected, strlen(expected)) != 0) {
+				fprintf(stderr, "Read %.*s in place of record %d\n",
+					(int) (eol - text), text, records_read);
+				exit(EXIT_FAILURE);
+			}
+			records_read++;
+			text = eol + 1;
+		}
+	}
+	check_exit(rval == EOF, "Cannot read formatted values");
+	check_exit(records_read == NUM_RECORDS, "Unexpected number of records");
+
+	avro_file_reader_close(reader);
+}
+
+int main(void)
+{
+	static const char  *codecs[] = {"null", "deflate"};
+	avro_schema_t  schema;
+	avro_file_reader_t  reader;
+	size_t  i;
+
+	check_exit(avro_schema_from_json_literal(SCHEMA, &schema) == 0,
+		   "Cannot parse schema");
+	for (i = 0; i < sizeof(codecs) / sizeof(codecs[0]); i++) {
+		if (write_records(schema, codecs[i])) {
+			/* The codec is not built in. */
+			continue;
+		}
+		read_prefetched(schema, 0);
+		read_prefetched(schema, 1);
+		read_formatted();
+	}
+
+	/* A mapped file has no pages of its own to drop. */
+	check_exit(avro_file_reader_mmap(FILENAME, &reader) == 0, "Cannot map file");
+	check_exit(avro_file_reader_drop_behind(reader) == EINVAL,
+		   "A mapped file should not drop pages");
+	avro_file_reader_close(reader);
+	remove(FILENAME);
+	avro_schema_decref(schema);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,125 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to you under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ * https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#include <avro.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WRITER_SCHEMA \
+"{\"type\": \"record\", \"name\": \"r\", \"fields\": [" \
+"  {\"name\": \"a\", \"type\": \"int\"}]}"
+
+#define READER_SCHEMA \
+"{\"type\": \"record\", \"name\": \"r\", \"fields\": [" \
+"  {\"name\": \"a\", \"type\": \"long\"}]}"
+
+#define OTHER_READER_SCHEMA \
+"{\"type\": \"record\", \"name\": \"r\", \"fields\": [" \
+"  {\"name\": \"a\", \"type\": \"double\"}]}"
+
+#define check_exit(cond, msg) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s\n  %s\n", msg, avro_strerror()); \
+			exit(EXIT_FAILURE); \
+		} \
+	} while (0)
+
+static avro_schema_t
+parse(const char *json)
+{
+	avro_schema_t  schema;
+	check_exit(avro_schema_from_json_length(json, strlen(json), &schema) == 0,
+		   "Cannot parse schema");
+	return schema;
+}
+
+int main(void)
+{
+	avro_schema_t  writer1 = parse(WRITER_SCHEMA);
+	avro_schema_t  writer2 = parse(WRITER_SCHEMA);
+	avro_schema_t  reader1 = parse(READER_SCHEMA);
+	avro_schema_t  reader2 = parse(READER_SCHEMA);
+	avro_schema_t  other = parse(OTHER_READER_SCHEMA);
+
+	/* Separately parsed copies of the same schemas share a reader. */
+	avro_value_iface_t  *r1 = avro_resolved_reader_new_cached(writer1, reader1);
+	avro_value_iface_t  *r2 = avro_resolved_reader_new_cached(writer2, reader2);
+	check_exit(r1 != NULL && r2 != NULL, "Cannot resolve schemas");
+	check_exit(r1 == r2, "Equal schemas should share a resolved reader");
+
+	/* A different reader schema is a different resolution. */
+	avro_value_iface_t  *r3 = avro_resolved_reader_new_cached(writer1, other);
+	check_exit(r3 != NULL, "Cannot resolve schemas");
+	check_exit(r3 != r1, "Different schemas should not share a resolved reader");
+
+	/* Readers and writers are cached apart. */
+	avro_value_iface_t  *w1 = avro_resolved_writer_new_cached(writer1, reader1);
+	avro_value_iface_t  *w2 = avro_resolved_writer_new_cached(writer2, reader2);
+	check_exit(w1 != NULL && w1 == w2, "Equal schemas should share a resolved writer");
+	check_exit(w1 != r1, "Readers and writers should not be shared");
+
+	/* The cached reader works. */
+	avro_value_iface_t  *wclass = avro_generic_class_from_schema(writer1);
+	avro_value_t  src;
+	avro_value_t  resolved;
+	avro_value_t  field;
+	int64_t  a;
+	check_exit(avro_generic_value_new(wclass, &src) == 0, "Cannot create value");
+	check_exit(avro_value_get_by_index(&src, 0, &field, NULL) == 0, "Cannot get field");
+	check_exit(avro_value_set_int(&field, 42) == 0, "Cannot set field");
+	check_exit(avro_resolved_reader_new_value(r1, &resolved) == 0,
+		   "Cannot create resolved value");
+	avro_resolved_reader_set_source(&resolved, &src);
+	check_exit(avro_value_get_by_index(&resolved, 0, &field, NULL) == 0, "Cannot get field");
+	check_exit(avro_value_get_long(&field, &a) == 0 && a == 42, "Unexpected field value");
+	avro_value_decref(&resolved);
+	avro_value_decref(&src);
+	avro_value_iface_decref(wclass);
+
+	/* Past the limit, the least recently used pair is dropped... */
+	avro_resolver_cache_set_limit(1);
+	avro_value_iface_t  *r4 = avro_resolved_reader_new_cached(writer1, reader1);
+	check_exit(r4 != NULL && r4 != r1, "The cache should have been trimmed");
+
+	/* ...but stays usable through the references still held. */
+	avro_value_t  value;
+	check_exit(avro_resolved_reader_new_value(r1, &value) == 0,
+		   "Cannot use an evicted resolved reader");
+	avro_value_decref(&value);
+
+	/* With no cache, every call resolves again. */
+	avro_resolver_cache_set_limit(0);
+	avro_value_iface_t  *r5 = avro_resolved_reader_new_cached(writer1, reader1);
+	check_exit(r5 != NULL && r5 != r4, "The cache should be off");
+
+	avro_value_iface_decref(r1);
+	avro_value_iface_decref(r2);
+	avro_value_iface_decref(r3);
+	avro_value_iface_decref(r4);
+	avro_value_iface_decref(r5);
+	avro_value_iface_decref(w1);
+	avro_value_iface_decref(w2);
+	avro_resolver_cache_clear();
+
+	avro_schema_decref(writer1);
+	avro_schema_decref(writer2);
+	avro_schema_decref(reader1);
+	avro_schema_decref(reader2);
+	avro_schema_decref(other);
+	return EXIT_SUCCESS;
+}
@@ -17,6 +17,7 @@
 
 #include "avro.h"
 #include "avro_private.h"
+#include "schema.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -84,6 +85,12 @@ static void run_tests(char *dirpath, int should_pass)
 							"failed to avro_schema_equal(schema,avro_schema_copy())\n");
 						exit(EXIT_FAILURE);
 					}
+					if (avro_schema_hash(schema) !=
+					    avro_schema_hash(schema_copy)) {
+						fprintf(stderr,
+							"failed to hash avro_schema_copy() the same\n");
+						exit(EXIT_FAILURE);
+					}
 					jsontext2_writer = avro_writer_memory(jsontext2, sizeof(jsontext2));
 					if (avro_schema_to_json(schema, jsontext2_writer)) {
 						fprintf(stderr, "failed to write schema (%s)\n",
@@ -268,6 +275,53 @@ static int test_union(void)
 	return 0;
 }
 
+static int test_hash(void)
+{
+	avro_schema_t record1 = avro_schema_record("r", NULL);
+	avro_schema_t record2 = avro_schema_record("r", NULL);
+	avro_schema_t array1 = avro_schema_array(record1);
+	avro_schema_t array2 = avro_schema_array(record2);
+
+	avro_schema_record_field_append(record1, "a", avro_schema_int());
+	if (avro_schema_equal(array1, array2)) {
+		fprintf(stderr, "Unexpected equal arrays of different records\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Changing a record must reach the hashes of the arrays. */
+	avro_schema_record_field_append(record2, "a", avro_schema_int());
+	if (!avro_schema_equal(array1, array2) ||
+	    avro_schema_hash(array1) != avro_schema_hash(array2)) {
+		fprintf(stderr, "Unexpected different arrays of equal records\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Building another schema leaves the memos alone. */
+	uint32_t stamp = avro_schema_stamp(array1);
+	avro_schema_t other = avro_schema_record("other", NULL);
+	avro_schema_record_field_append(other, "b", avro_schema_long());
+	avro_schema_t parsed;
+	if (avro_schema_from_json_literal(
+		"{\"type\": \"record\", \"name\": \"p\", \"fields\": ["
+		"{\"name\": \"c\", \"type\": {\"type\": \"array\", \"items\": \"int\"}}]}",
+		&parsed)) {
+		fprintf(stderr, "Cannot parse schema\n");
+		exit(EXIT_FAILURE);
+	}
+	if (avro_schema_stamp(array1) != stamp) {
+		fprintf(stderr, "Unrelated schemas should not invalidate memos\n");
+		exit(EXIT_FAILURE);
+	}
+	avro_schema_decref(parsed);
+	avro_schema_decref(other);
+
+	avro_schema_decref(array1);
+	avro_schema_decref(array2);
+	avro_schema_decref(record1);
+	avro_schema_decref(record2);
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	char *srcdir = getenv("srcdir");
@@ -304,6 +358,8 @@ int main(int argc, char *argv[])
 	test_record();
 	fprintf(stderr, "*** Running union tests **\n");
 	test_union();
+	fprintf(stderr, "*** Running hash tests **\n");
+	test_hash();
 
 	fprintf(stderr, "==================================================\n");
 	fprintf(stderr,
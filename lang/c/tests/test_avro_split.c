@@ -0,0 +1,191 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to you under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ * https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#include <avro.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCHEMA \
+"{\"type\": \"record\", \"name\": \"Person\", \"fields\": [" \
+"  {\"name\": \"ID\", \"type\": \"long\"}," \
+"  {\"name\": \"Name\", \"type\": \"string\"}]}"
+
+#define FILENAME  "avro_split.dat"
+#define NUM_RECORDS  100
+
+#define check_exit(cond, msg) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s\n  %s\n", msg, avro_strerror()); \
+			exit(EXIT_FAILURE); \
+		} \
+	} while (0)
+
+/*
+ * Writes the records in blocks of a few each, so that there are many
+ * block boundaries to split at.
+ */
+static void
+write_records(avro_schema_t schema)
+{
+	avro_file_writer_t  writer;
+	avro_value_iface_t  *iface;
+	avro_value_t  value;
+	avro_value_t  field;
+	int  i;
+
+	remove(FILENAME);
+	check_exit(avro_file_writer_create_with_codec(FILENAME, schema, &writer, "null", 128) == 0,
+		   "Cannot create file");
+	iface = avro_generic_class_from_schema(schema);
+	check_exit(avro_generic_value_new(iface, &value) == 0, "Cannot create value");
+	for (i = 0; i < NUM_RECORDS; i++) {
+		check_exit(avro_value_get_by_name(&value, "ID", &field, NULL) == 0 &&
+			   avro_value_set_long(&field, i) == 0, "Cannot set ID");
+		check_exit(avro_value_get_by_name(&value, "Name", &field, NULL) == 0 &&
+			   avro_value_set_string(&field, "Firstname Lastname") == 0,
+			   "Cannot set Name");
+		check_exit(avro_file_writer_append_value(writer, &value) == 0,
+			   "Cannot append value");
+	}
+	check_exit(avro_file_writer_close(writer) == 0, "Cannot close file");
+	avro_value_decref(&value);
+	avro_value_iface_decref(iface);
+}
+
+static int64_t
+get_id(avro_value_t *value)
+{
+	avro_value_t  field;
+	int64_t  id;
+
+	check_exit(avro_value_get_by_name(value, "ID", &field, NULL) == 0 &&
+		   avro_value_get_long(&field, &id) == 0, "Cannot get ID");
+	return id;
+}
+
+/*
+ * Reads the file in ranges of range_size bytes, each with a reader of
+ * its own, as the mappers of a split file do, checking that every
+ * record is read once.  Then seeks back to the block of the middle
+ * record and reads on from there.
+ */
+static void
+read_split(avro_schema_t schema, int64_t range_size, int use_mmap)
+{
+	int64_t  size;
+	int64_t  start;
+	int64_t  middle = -1;
+	int64_t  last_block = -1;
+	int64_t  id;
+	int  block_first = 0;
+	int  middle_first = 0;
+	int  records_read = 0;
+	int  rval;
+	FILE  *fp;
+	avro_file_reader_t  reader;
+	avro_value_iface_t  *iface;
+	avro_value_t  value;
+
+	fp = fopen(FILENAME, "rb");
+	check_exit(fp != NULL, "Cannot open file");
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fclose(fp);
+
+	iface = avro_generic_class_from_schema(schema);
+	check_exit(avro_generic_value_new(iface, &value) == 0, "Cannot create value");
+
+	for (start = 0; start < size; start += range_size) {
+		int  past;
+		rval = use_mmap ? avro_file_reader_mmap(FILENAME, &reader)
+		    : avro_file_reader(FILENAME, &reader);
+		check_exit(rval == 0, "Cannot open file");
+		check_exit(avro_file_reader_sync(reader, start) == 0,
+			   "Cannot sync to the start of the range");
+		for (;;) {
+			int64_t  block;
+			check_exit(avro_file_reader_past_sync(reader, start + range_size, &past) == 0,
+				   "Cannot check the end of the range");
+			if (past) {
+				break;
+			}
+			block = avro_file_reader_previous_sync(reader);
+			if (block < start + 16) {
+				fprintf(stderr, "Block at %" PRId64 " read in range from %" PRId64 "\n",
+					block, start);
+				exit(EXIT_FAILURE);
+			}
+			check_exit(avro_file_reader_read_value(reader, &value) == 0,
+				   "Cannot read value");
+			id = get_id(&value);
+			if (id != records_read) {
+				fprintf(stderr, "Read record %" PRId64 " in place of %d\n",
+					id, records_read);
+				exit(EXIT_FAILURE);
+			}
+			if (block != last_block) {
+				last_block = block;
+				block_first = records_read;
+			}
+			if (id == NUM_RECORDS / 2) {
+				middle = block;
+				middle_first = block_first;
+			}
+			records_read++;
+			avro_value_reset(&value);
+		}
+		avro_file_reader_close(reader);
+	}
+	check_exit(records_read == NUM_RECORDS, "Unexpected number of records in ranges");
+	check_exit(middle >= 0, "The middle record was not read");
+
+	check_exit(avro_file_reader(FILENAME, &reader) == 0, "Cannot open file");
+	check_exit(avro_file_reader_seek(reader, middle) == 0, "Cannot seek");
+	records_read = middle_first;
+	while ((rval = avro_file_reader_read_value(reader, &value)) == 0) {
+		id = get_id(&value);
+		if (id != records_read) {
+			fprintf(stderr, "Read record %" PRId64 " in place of %d after seeking\n",
+				id, records_read);
+			exit(EXIT_FAILURE);
+		}
+		records_read++;
+		avro_value_reset(&value);
+	}
+	check_exit(rval == EOF, "Cannot read value");
+	check_exit(records_read == NUM_RECORDS, "Unexpected number of records after seeking");
+	avro_file_reader_close(reader);
+
+	avro_value_decref(&value);
+	avro_value_iface_decref(iface);
+}
+
+int main(void)
+{
+	avro_schema_t  schema;
+
+	check_exit(avro_schema_from_json_literal(SCHEMA, &schema) == 0,
+		   "Cannot parse schema");
+	write_records(schema);
+	read_split(schema, 100, 0);
+	read_split(schema, 7, 1);
+	read_split(schema, 1 << 20, 0);
+	remove(FILENAME);
+	avro_schema_decref(schema);
+	return EXIT_SUCCESS;
+}
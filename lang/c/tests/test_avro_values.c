@@ -334,6 +334,131 @@ _check_write_read(avro_value_t *val)
 		exit(EXIT_FAILURE);
 	}
 
+	/*
+	 * Read it again, into the same value, from a file rather than
+	 * from memory.
+	 */
+
+	FILE  *fp = tmpfile();
+	if (fp == NULL || fwrite(buf, 1, size, fp) != size) {
+		fprintf(stderr, "Unable to write encoded value to a file\n");
+		return EXIT_FAILURE;
+	}
+	rewind(fp);
+	avro_reader_t  file_reader = avro_reader_file_fp(fp, 1);
+	if (avro_value_read(file_reader, &val_in)) {
+		fprintf(stderr, "Unable to read value from file:\n  %s\n",
+			avro_strerror());
+		return EXIT_FAILURE;
+	}
+	avro_reader_free(file_reader);
+
+	if (!avro_value_equal(val, &val_in)) {
+		fprintf(stderr, "Round-trip values through a file not equal\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/*
+	 * Transcoding the encoded value straight to JSON has to give the
+	 * same text as going through the value.
+	 */
+
+	char  *expected_json;
+	if (avro_value_to_json(val, 1, &expected_json)) {
+		fprintf(stderr, "Unable to convert value to JSON:\n  %s\n",
+			avro_strerror());
+		return EXIT_FAILURE;
+	}
+
+	char  *json = NULL;
+	size_t  json_size = 0;
+	size_t  json_len = 0;
+	avro_reader_memory_set_source(reader, buf, size);
+	if (avro_binary_to_json(reader, avro_value_get_schema(val),
+				&json, &json_size, &json_len)) {
+		fprintf(stderr, "Unable to transcode value to JSON:\n  %s\n",
+			avro_strerror());
+		return EXIT_FAILURE;
+	}
+
+	if (json_len != strlen(expected_json) ||
+	    strcmp(json, expected_json) != 0) {
+		fprintf(stderr, "Transcoded JSON differs:\n  %s\n  %s\n",
+			json, expected_json);
+		exit(EXIT_FAILURE);
+	}
+	avro_free(json, json_size);
+	free(expected_json);
+
+	/*
+	 * Hashing the encoded value hashes exactly its bytes.
+	 */
+
+	uint64_t  hash;
+	avro_reader_memory_set_source(reader, buf, size);
+	if (avro_binary_hash(reader, avro_value_get_schema(val), 0, &hash)) {
+		fprintf(stderr, "Unable to hash encoded value:\n  %s\n",
+			avro_strerror());
+		return EXIT_FAILURE;
+	}
+
+	if (hash != avro_hash_bytes(buf, size, 0)) {
+		fprintf(stderr, "Encoded value hash differs\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/*
+	 * Skipping the value in a file lands on the value written after
+	 * it.
+	 */
+
+	fp = tmpfile();
+	if (fp == NULL || fwrite(buf, 1, size, fp) != size ||
+	    fwrite(buf, 1, size, fp) != size) {
+		fprintf(stderr, "Unable to write encoded values to a file\n");
+		return EXIT_FAILURE;
+	}
+	rewind(fp);
+	file_reader = avro_reader_file_fp(fp, 1);
+	if (avro_skip_data(file_reader, avro_value_get_schema(val)) ||
+	    avro_value_read(file_reader, &val_in)) {
+		fprintf(stderr, "Unable to skip value in file:\n  %s\n",
+			avro_strerror());
+		return EXIT_FAILURE;
+	}
+	avro_reader_free(file_reader);
+
+	if (!avro_value_equal(val, &val_in)) {
+		fprintf(stderr, "Value read after skipping not equal\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/*
+	 * Read it again as slices of a copy of the encoded value.  The
+	 * copy is released before the comparison; the value's own
+	 * references have to keep it alive.
+	 */
+
+	avro_wrapped_buffer_t  source;
+	if (avro_wrapped_buffer_new_copy(&source, buf, size)) {
+		fprintf(stderr, "Cannot copy encoded value:\n  %s\n",
+			avro_strerror());
+		return EXIT_FAILURE;
+	}
+
+	avro_reader_memory_set_source(reader, (const char *) source.buf, size);
+	if (avro_value_read_wrapped(reader, &val_in, &source)) {
+		fprintf(stderr, "Unable to read wrapped value:\n  %s\n",
+			avro_strerror());
+		return EXIT_FAILURE;
+	}
+	avro_wrapped_buffer_free(&source);
+
+	if (!avro_value_equal(val, &val_in)) {
+		fprintf(stderr, "Wrapped round-trip values not equal\n");
+		exit(EXIT_FAILURE);
+	}
+
 	avro_value_decref(&val_in);
 	avro_reader_free(reader);
 	avro_writer_free(writer);
@@ -382,6 +507,28 @@ _check_copy(avro_value_t *val)
 
 	check_hash(val, &copied_val);
 
+	/*
+	 * Copy an empty value over the copy, and the value over that
+	 * again, so that the copy's own strings, elements and branches
+	 * are copied into.
+	 */
+
+	avro_value_t  empty_val;
+	if (avro_generic_value_new(val->iface, &empty_val) ||
+	    avro_value_copy(&copied_val, &empty_val) ||
+	    avro_value_copy(&copied_val, val) ||
+	    avro_value_copy(&copied_val, val)) {
+		fprintf(stderr, "Cannot copy value over a copy:\n  %s\n",
+			avro_strerror());
+		return EXIT_FAILURE;
+	}
+	avro_value_decref(&empty_val);
+
+	if (!avro_value_equal(val, &copied_val)) {
+		fprintf(stderr, "Values copied over a copy not equal\n");
+		return EXIT_FAILURE;
+	}
+
 	avro_value_decref(&copied_val);
 	return EXIT_SUCCESS;
 }
@@ -1418,6 +1565,199 @@ test_union(void)
 	return 0;
 }
 
+/*
+ * Encodes a record of the sort order test, with an array [a0, a1] and a
+ * null union unless u is given.
+ */
+
+static int
+encode_sortable(avro_value_iface_t *iface, char *buf, size_t size,
+		const char *k, int32_t n, double x, int64_t a0, int64_t a1,
+		const float *u, int64_t *len)
+{
+	avro_value_t  val;
+	avro_value_t  field;
+	avro_value_t  element;
+	avro_value_t  branch;
+	avro_writer_t  writer = avro_writer_memory(buf, size);
+
+	try(avro_generic_value_new(iface, &val), "Cannot create record");
+	try(avro_value_get_by_index(&val, 0, &field, NULL), "Cannot get k");
+	try(avro_value_set_string(&field, k), "Cannot set k");
+	try(avro_value_get_by_index(&val, 1, &field, NULL), "Cannot get n");
+	try(avro_value_set_int(&field, n), "Cannot set n");
+	try(avro_value_get_by_index(&val, 2, &field, NULL), "Cannot get x");
+	try(avro_value_set_double(&field, x), "Cannot set x");
+	try(avro_value_get_by_index(&val, 3, &field, NULL), "Cannot get a");
+	if (a0 >= 0) {
+		try(avro_value_append(&field, &element, NULL), "Cannot append");
+		try(avro_value_set_long(&element, a0), "Cannot set a0");
+	}
+	if (a1 >= 0) {
+		try(avro_value_append(&field, &element, NULL), "Cannot append");
+		try(avro_value_set_long(&element, a1), "Cannot set a1");
+	}
+	try(avro_value_get_by_index(&val, 4, &field, NULL), "Cannot get u");
+	if (u) {
+		try(avro_value_set_branch(&field, 1, &branch), "Cannot set u");
+		try(avro_value_set_float(&branch, *u), "Cannot set u");
+	} else {
+		try(avro_value_set_branch(&field, 0, &branch), "Cannot set u");
+	}
+	try(avro_value_write(writer, &val), "Cannot write record");
+	*len = avro_writer_tell(writer);
+	avro_writer_free(writer);
+	avro_value_decref(&val);
+	return 0;
+}
+
+static int
+test_sort_order(void)
+{
+	static const char  SCHEMA_JSON[] =
+	"{"
+	"  \"type\": \"record\","
+	"  \"name\": \"r\","
+	"  \"fields\": ["
+	"    { \"name\": \"k\", \"type\": \"string\" },"
+	"    { \"name\": \"n\", \"type\": \"int\", \"order\": \"descending\" },"
+	"    { \"name\": \"x\", \"type\": \"double\", \"order\": \"ignore\" },"
+	"    { \"name\": \"a\", \"type\": { \"type\": \"array\", \"items\": \"long\" } },"
+	"    { \"name\": \"u\", \"type\": [\"null\", \"float\"] }"
+	"  ]"
+	"}";
+
+	avro_schema_t  schema = NULL;
+	if (avro_schema_from_json_literal(SCHEMA_JSON, &schema)) {
+		fprintf(stderr, "Error parsing schema:\n  %s\n",
+			avro_strerror());
+		return EXIT_FAILURE;
+	}
+	if (avro_schema_record_field_order(schema, 0) != AVRO_ORDER_ASCENDING ||
+	    avro_schema_record_field_order(schema, 1) != AVRO_ORDER_DESCENDING ||
+	    avro_schema_record_field_order(schema, 2) != AVRO_ORDER_IGNORE) {
+		fprintf(stderr, "Unexpected field orders\n");
+		return EXIT_FAILURE;
+	}
+
+	/* The orders are kept by copies and by the schema's JSON. */
+	char  json_buf[1024];
+	avro_writer_t  json_writer = avro_writer_memory(json_buf, sizeof(json_buf));
+	avro_schema_t  copy = avro_schema_copy(schema);
+	avro_schema_t  reparsed = NULL;
+	try(avro_schema_to_json(copy, json_writer), "Cannot write schema");
+	if (avro_schema_from_json_length(json_buf, avro_writer_tell(json_writer),
+					 &reparsed) ||
+	    avro_schema_record_field_order(reparsed, 1) != AVRO_ORDER_DESCENDING ||
+	    avro_schema_record_field_order(reparsed, 2) != AVRO_ORDER_IGNORE) {
+		fprintf(stderr, "Field orders lost in copy\n");
+		return EXIT_FAILURE;
+	}
+	avro_writer_free(json_writer);
+	avro_schema_decref(copy);
+	avro_schema_decref(reparsed);
+
+	static const char  BAD_ORDER_JSON[] =
+	"{\"type\": \"record\", \"name\": \"r\", \"fields\": ["
+	" {\"name\": \"k\", \"type\": \"int\", \"order\": \"up\"}]}";
+	avro_schema_t  bad = NULL;
+	if (avro_schema_from_json_literal(BAD_ORDER_JSON, &bad) == 0) {
+		fprintf(stderr, "Invalid field order accepted\n");
+		return EXIT_FAILURE;
+	}
+
+	avro_value_iface_t  *iface = avro_generic_class_from_schema(schema);
+	static const float  one = 1.5f, minus = -2.0f, zero = 0.0f;
+	static const struct {
+		const char  *k;
+		int32_t  n;
+		double  x;
+		int64_t  a0, a1;
+		const float  *u;
+		int  expected;
+	} cases[] = {
+		{ "b", 5, 9.0, 1, 2, &one, 0 },
+		{ "c", 5, 1.0, 1, 2, &one, -1 },
+		{ "bb", 5, 1.0, 1, 2, &one, -1 },
+		{ "\xff", 5, 1.0, 1, 2, &one, -1 },
+		{ "b", 4, 1.0, 1, 2, &one, -1 },
+		{ "b", -6, 1.0, 1, 2, &one, -1 },
+		{ "b", 5, 1.0, 1, 3, &one, -1 },
+		{ "b", 5, 1.0, 1, -1, &one, 1 },
+		{ "b", 5, 1.0, 0, 2, &one, 1 },
+		{ "b", 5, 1.0, 1, 2, NULL, 1 },
+		{ "b", 5, 1.0, 1, 2, &minus, 1 },
+		{ "b", 5, 1.0, 1, 2, &zero, 1 },
+	};
+
+	char  base[256];
+	char  other[256];
+	int64_t  base_len;
+	int64_t  other_len;
+	int  rval;
+	check(rval, encode_sortable(iface, base, sizeof(base),
+				    "b", 5, 1.0, 1, 2, &one, &base_len));
+	size_t  i;
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		check(rval, encode_sortable(iface, other, sizeof(other),
+					    cases[i].k, cases[i].n, cases[i].x,
+					    cases[i].a0, cases[i].a1, cases[i].u,
+					    &other_len));
+		int  result;
+		try(avro_binary_compare(schema, base, base_len,
+					other, other_len, &result),
+		    "Cannot compare encoded records");
+		if ((result > 0) - (result < 0) != cases[i].expected) {
+			fprintf(stderr, "Case %" PRIsz ": got %d, expected %d\n",
+				i, result, cases[i].expected);
+			return EXIT_FAILURE;
+		}
+		try(avro_binary_compare(schema, other, other_len,
+					base, base_len, &result),
+		    "Cannot compare encoded records");
+		if ((result > 0) - (result < 0) != -cases[i].expected) {
+			fprintf(stderr, "Case %" PRIsz " reversed: got %d\n",
+				i, result);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/*
+	 * The array [1, 2] written in blocks of one item each, with their
+	 * sizes, compares the same as written in one block.
+	 */
+	static const char  blocked[] = {
+		2, 'b', 10, 0, 0, 0, 0, 0, 0, (char) 0xf0, 0x3f,
+		1, 2, 2, 1, 2, 4, 0, 2, 0, 0, (char) 0xc0, 0x3f
+	};
+	int  result;
+	try(avro_binary_compare(schema, blocked, sizeof(blocked),
+				base, base_len, &result),
+	    "Cannot compare blocked array");
+	if (result != 0) {
+		fprintf(stderr, "Blocked array compares unequal\n");
+		return EXIT_FAILURE;
+	}
+
+	if (avro_binary_compare(schema, base, 3, base, base_len, &result) == 0) {
+		fprintf(stderr, "Truncated record compared\n");
+		return EXIT_FAILURE;
+	}
+
+	avro_schema_t  map_schema = avro_schema_map(schema);
+	static const char  empty_map[] = { 0 };
+	if (avro_binary_compare(map_schema, empty_map, 1,
+				empty_map, 1, &result) == 0) {
+		fprintf(stderr, "Map compared\n");
+		return EXIT_FAILURE;
+	}
+	avro_schema_decref(map_schema);
+
+	avro_value_iface_decref(iface);
+	avro_schema_decref(schema);
+	return 0;
+}
+
 int main(void)
 {
 	avro_set_allocator(test_allocator, NULL);
@@ -1440,7 +1780,8 @@ int main(void)
 		{ "fixed", test_fixed },
 		{ "map", test_map },
 		{ "record", test_record },
-		{ "union", test_union }
+		{ "union", test_union },
+		{ "sort order", test_sort_order }
 	};
 
 	init_rand();
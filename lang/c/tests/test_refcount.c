@@ -52,6 +52,24 @@ int main(void)
 
   // Release the avro class and value
   avro_value_decref( &simple );
+
+  // A value with a local count is freed when its last reference goes
+  avro_value_t local;
+  avro_value_t copy;
+  if ( avro_generic_value_new_local( simple_array_class, &local ) )
+  {
+    fprintf(stdout, "Error creating local instance of record\n" );
+    exit(EXIT_FAILURE);
+  }
+  avro_value_copy_ref( &copy, &local );
+  avro_value_decref( &local );
+  avro_value_decref( &copy );
+
+  avro_datum_t datum = avro_int32(42);
+  avro_datum_make_local(datum);
+  avro_datum_incref(datum);
+  avro_datum_decref(datum);
+  avro_datum_decref(datum);
   avro_value_iface_decref( simple_array_class );
   avro_schema_decref(schema);
   